@@ -0,0 +1,59 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <quickjs.h>
+#include <cutils.h>
+#include <stddef.h>
+
+/**
+ * \defgroup arena arena: Scoped bump allocator for scratch buffers
+ *
+ * A native function takes an arena_mark() on entry, places its temporary
+ * DynBufs and Vectors on the arena and calls arena_release() before it
+ * returns. The growth of the most recent allocation happens in place.
+ * Blocks are kept for the next call, so once warmed up such a function
+ * makes no malloc() calls.
+ *
+ * Scopes have to nest: a buffer of an outer scope must not grow while an
+ * inner scope is open, releasing the inner mark would discard it.
+ * @{
+ */
+#define ARENA_BLOCK_SIZE 65536
+
+typedef struct arena_block {
+  struct arena_block* prev;
+  size_t size, used;
+  char data[];
+} ArenaBlock;
+
+typedef struct arena {
+  ArenaBlock* block;
+  ArenaBlock* spare; /**< largest block released, reused before malloc() */
+} Arena;
+
+typedef struct arena_mark {
+  ArenaBlock* block;
+  size_t used;
+} ArenaMark;
+
+Arena* js_arena(JSContext*);
+void* arena_alloc(Arena*, size_t size);
+void* arena_realloc(Arena*, void* ptr, size_t size);
+void arena_release(Arena*, ArenaMark mark);
+void arena_free(Arena*);
+
+static inline ArenaMark
+arena_mark(Arena* a) {
+  return (ArenaMark){a->block, a->block ? a->block->used : 0};
+}
+
+static inline void
+dbuf_init_arena(DynBuf* s, Arena* a) {
+  dbuf_init2(s, a, (DynBufReallocFunc*)&arena_realloc);
+}
+
+/**
+ * @}
+ */
+
+#endif /* defined(ARENA_H) */
@@ -8,6 +8,12 @@
 
 /**
  * \defgroup async-closure async-closure: Async Handler Closure
+ *
+ * Where epoll or kqueue are available the closures' fds are watched by one
+ * native registry. Only the registry's own fd is known to the os module,
+ * so changing a closure's event costs a syscall instead of calls to
+ * os.setReadHandler()/os.setWriteHandler(), and all closures that became
+ * ready in one loop iteration are resumed in a single native pass.
  * @{
  */
 
@@ -20,6 +26,7 @@ typedef enum {
 struct AsyncHandlerClosure {
   int ref_count, fd;
   AsyncEvent state : 2;
+  unsigned native : 1; /**< registered with the native readiness registry */
   CClosureFunc* ccfunc;
   JSContext* ctx;
   JSValue result, set_handler;
@@ -3,9 +3,13 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 /**
  * \defgroup base64 base64: Base64 encoding
+ *
+ * Whole blocks go through SSSE3 or NEON when the compiler targets them,
+ * the rest through a table per group of 3 bytes / 4 characters.
  * @{
  */
 size_t b64_get_encoded_buffer_size(const size_t decoded_size);
@@ -16,6 +20,7 @@ void b64_encode(const uint8_t* raw, const size_t len, uint8_t* out);
 void b64url_encode(const uint8_t* raw, const size_t len, uint8_t* out);
 size_t b64_decode(const uint8_t* enc, const size_t len, uint8_t* out);
 size_t b64url_decode(const uint8_t* enc, const size_t len, uint8_t* out);
+ssize_t b64_decode_partial(const uint8_t* enc, size_t len, uint8_t* out, int url, size_t* pos);
 
 /**
  * @}
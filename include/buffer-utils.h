@@ -52,6 +52,7 @@ uint8_t* dbuf_reserve(DynBuf*, size_t);
 size_t dbuf_token_pop(DynBuf*, char);
 size_t dbuf_token_push(DynBuf*, const char*, size_t len, char delim);
 JSValue dbuf_tostring_free(DynBuf*, JSContext*);
+JSValue dbuf_steal_arraybuffer(DynBuf*, JSContext*);
 ssize_t dbuf_load(DynBuf*, const char*);
 int dbuf_vprintf(DynBuf*, const char*, va_list);
 
@@ -91,6 +92,22 @@ dbuf_zero(DynBuf* db) {
 
 size_t dbuf_bitflags(DynBuf* db, uint32_t bits, const char* const names[]);
 
+/**
+ * Detaches the buffer from \p s, the caller frees it with the allocator
+ * \p s was initialized with.
+ */
+static inline uint8_t*
+dbuf_steal(DynBuf* s, size_t* lenp) {
+  uint8_t* buf = s->buf;
+
+  if(lenp)
+    *lenp = s->size;
+
+  s->buf = 0;
+  s->size = s->allocated_size = 0;
+  return buf;
+}
+
 #define js_dbuf_init(ctx, buf) dbuf_init2((buf), (ctx), (realloc_func*)&utils_js_realloc)
 #define js_dbuf_init_rt(rt, buf) dbuf_init2((buf), (rt), (realloc_func*)&utils_js_realloc_rt)
 
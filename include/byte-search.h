@@ -0,0 +1,38 @@
+#ifndef BYTE_SEARCH_H
+#define BYTE_SEARCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <cutils.h>
+
+/**
+ * \defgroup byte-search byte-search: Substring and multi-pattern search
+ *
+ * byte_search() filters candidate positions by comparing the first and
+ * last needle byte 16 or 32 positions at a time before memcmp() checks
+ * the rest. ByteMatcher is an Aho-Corasick automaton over byte classes
+ * (the distinct bytes of the patterns) which finds every occurrence of
+ * a set of patterns in one pass.
+ * @{
+ */
+const uint8_t* byte_search(const uint8_t* h, size_t hl, const uint8_t* n, size_t nl);
+
+typedef struct byte_matcher {
+  uint8_t classes[256]; /**< byte -> class, 0 for bytes in no pattern */
+  uint32_t nclasses, nstates, npatterns;
+  int32_t* next;     /**< nstates * nclasses transitions */
+  int32_t* match;    /**< first pattern ending in a state, or -1 */
+  int32_t* suffix;   /**< nearest proper suffix state with a match, or -1 */
+  int32_t* chain;    /**< next pattern ending in the same state, or -1 */
+  uint32_t* lengths; /**< pattern lengths */
+} ByteMatcher;
+
+int byte_matcher_init(ByteMatcher*, const uint8_t* const patterns[], const size_t lengths[], uint32_t count);
+void byte_matcher_free(ByteMatcher*);
+ssize_t byte_matcher_scan(const ByteMatcher*, const uint8_t* p, size_t n, uint64_t base, DynBuf* offsets, DynBuf* ids);
+
+/**
+ * @}
+ */
+#endif /* defined(BYTE_SEARCH_H) */
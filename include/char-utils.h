@@ -4,6 +4,8 @@
 #include <cutils.h>
 #include <string.h>
 #include "debug.h"
+#include "line-index.h"
+#include "simd.h"
 
 /**
  * \defgroup char-utils char-utils: Character Utilities
@@ -100,15 +102,7 @@ is_integer(const char* str) {
 
 static inline size_t
 byte_count(const void* s, size_t n, char c) {
-  const uint8_t* t;
-  uint8_t ch = (uint8_t)c;
-  size_t count;
-
-  for(t = (uint8_t*)s, count = 0; n; ++t, --n)
-    if(*t == ch)
-      ++count;
-
-  return count;
+  return line_index_count(s, n, (uint8_t)c);
 }
 
 static inline size_t
@@ -383,9 +377,15 @@ size_t scan_lineskip(const char*, size_t);
 size_t scan_lineskip_escaped(const char*, size_t);
 size_t scan_eolskip(const char*, size_t);
 size_t utf8_strlen(const void*, size_t);
+size_t utf8_byte_offset(const void*, size_t, size_t chars);
 wchar_t* utf8_towcs(const char*);
 char* utf8_fromwcs(const wchar_t*);
 BOOL utf16_multiword(const void*);
+size_t utf8_valid(const void*, size_t);
+size_t utf16_to_utf8(uint8_t* out, const void* in, size_t* plen, BOOL big);
+size_t utf32_to_utf8(uint8_t* out, const void* in, size_t* plen, BOOL big);
+size_t utf8_to_utf16(uint8_t* out, const void* in, size_t* plen, BOOL big);
+size_t utf8_to_utf32(uint8_t* out, const void* in, size_t* plen, BOOL big);
 int case_lowerc(int);
 int case_starts(const char*, const char*);
 int case_diffb(const void*, size_t, const void* T);
@@ -413,6 +413,27 @@ scan_8long(const char* src, uint32_t* dest) {
   return scan_8longn(src, (size_t)-1, dest);
 }
 
+/* all 16 bytes at x are ASCII */
+static inline BOOL
+utf_ascii16(const uint8_t* x) {
+  uint64_t w[2];
+
+  memcpy(w, x, sizeof(w));
+  return !((w[0] | w[1]) & 0x8080808080808080ull);
+}
+
+/* all UTF_ASCII_BLOCK bytes at x are ASCII */
+#ifdef SIMD_BLOCK
+#define UTF_ASCII_BLOCK SIMD_BLOCK
+static inline BOOL
+utf_ascii_block(const uint8_t* x) {
+  return simd_movemask(simd_gt(simd_load(x), -1)) == SIMD_ALL;
+}
+#else
+#define UTF_ASCII_BLOCK 16
+#define utf_ascii_block(x) utf_ascii16(x)
+#endif
+
 static inline size_t
 utf8_charlen(const char* in, size_t len) {
   const uint8_t* next = (const void*)in;
@@ -431,6 +452,24 @@ utf8_charcode(const char* in, size_t len) {
 
 BOOL utf16_multiword(const void*);
 
+/**
+ * Sparse character index over UTF-8 data, built on demand: the character
+ * count at every UTF8_INDEX_STRIDE bytes. Data must not change while the
+ * index is in use.
+ */
+#define UTF8_INDEX_STRIDE 4096
+
+typedef struct utf8_index {
+  const uint8_t* data;
+  size_t len;
+  DynBuf marks;
+} Utf8Index;
+
+void utf8_index_init(Utf8Index*, const void* data, size_t len);
+void utf8_index_free(Utf8Index*);
+size_t utf8_index_chars(Utf8Index*, size_t pos);
+size_t utf8_index_bytes(Utf8Index*, size_t chars);
+
 ssize_t write_file(const char* file, const void* buf, size_t len);
 ssize_t puts_file(const char* file, const char* s);
 
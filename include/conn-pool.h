@@ -0,0 +1,68 @@
+#ifndef CONN_POOL_H
+#define CONN_POOL_H
+
+#include <quickjs.h>
+#include <list.h>
+#include "js-utils.h"
+#include "utils.h"
+
+/**
+ * \defgroup conn-pool conn-pool: Database connection pool
+ * @{
+ */
+
+/**
+ * Driver hooks: connect() returns a Promise resolving to a connected
+ * object, built on the driver's nonblocking connect state machine.
+ */
+typedef struct conn_pool_backend {
+  const char* name;
+  JSValue (*connect)(JSContext*, int argc, JSValueConst argv[]);
+  BOOL (*healthy)(JSContext*, JSValueConst conn);
+  void (*close)(JSContext*, JSValueConst conn);
+} ConnPoolBackend;
+
+typedef struct conn_pool_entry {
+  struct list_head link;
+  JSValue conn;
+  int64_t since;
+} ConnPoolEntry;
+
+typedef struct conn_pool_waiter {
+  struct list_head link;
+  Promise promise;
+  int64_t since;
+} ConnPoolWaiter;
+
+struct ConnectionPool {
+  int ref_count;
+  JSContext* ctx;
+  const ConnPoolBackend* backend;
+  int argc;
+  JSValue* argv;
+  uint32_t min, max, size, opening, nidle, nwaiting;
+  int64_t idle_timeout;
+  uint64_t acquired;
+  int64_t wait_time, max_wait;
+  struct list_head idle, busy, waiters;
+  JSValue timer;
+  BOOL closed;
+};
+
+typedef struct ConnectionPool ConnPool;
+
+ConnPool* connpool_new(JSContext*, const ConnPoolBackend*, int argc, JSValueConst argv[]);
+ConnPool* connpool_dup(ConnPool*);
+void connpool_free(ConnPool*);
+void connpool_options(ConnPool*, JSValueConst options);
+void connpool_fill(ConnPool*);
+JSValue connpool_acquire(ConnPool*);
+BOOL connpool_release(ConnPool*, JSValueConst conn);
+void connpool_close(ConnPool*);
+JSValue connpool_stats(ConnPool*);
+
+/**
+ * @}
+ */
+
+#endif /* defined(CONN_POOL_H) */
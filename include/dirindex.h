@@ -0,0 +1,55 @@
+#ifndef DIRINDEX_H
+#define DIRINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <cutils.h>
+
+/**
+ * \defgroup dirindex dirindex: Incrementally maintained directory index
+ *
+ * One crawl of the tree below root, then inotify events keep a sorted
+ * table of relative paths up to date. Every change gets a sequence
+ * number; removed paths stay as tombstones so changes can be listed
+ * since any earlier sequence number. An event queue overflow triggers a
+ * rescan that only records the differences.
+ * @{
+ */
+typedef struct dir_index_entry {
+  uint64_t ino, seq;
+  int type;
+  BOOL removed, seen;
+  uint32_t len;
+  char path[];
+} DirIndexEntry;
+
+typedef struct {
+  DirIndexEntry* entry;
+  uint64_t seq;
+} DirIndexChange;
+
+typedef struct dir_index {
+  int fd, rootfd;
+  char* root;
+  size_t rootlen;
+  uint64_t seq;
+  DirIndexEntry** entries;
+  size_t count, capacity;
+  DirIndexChange* log;
+  size_t nlog, alog;
+  char** watches;
+  int nwatches;
+} DirIndex;
+
+int dirindex_open(DirIndex*, const char* root);
+void dirindex_close(DirIndex*);
+int dirindex_update(DirIndex*);
+void dirindex_rescan(DirIndex*);
+size_t dirindex_find(DirIndex*, const char* path, size_t len);
+DirIndexEntry* dirindex_lookup(DirIndex*, const char* path, size_t len);
+size_t dirindex_since(DirIndex*, uint64_t seq);
+
+/**
+ * @}
+ */
+#endif /* defined(DIRINDEX_H) */
@@ -32,6 +32,11 @@ const void* getdents_cname(const DirEntry*);
 char* getdents_name(const DirEntry*);
 const uint8_t* getdents_namebuf(const DirEntry*, size_t* len);
 int getdents_type(const DirEntry*);
+uint64_t getdents_ino(const DirEntry*);
+#ifndef _WIN32
+int getdents_dtype(unsigned d_type);
+int getdents_mode(unsigned mode);
+#endif
 void getdents_close(Directory*);
 int getdents_initialized(Directory* d);
 
@@ -0,0 +1,49 @@
+#ifndef GPIO_CAPTURE_H
+#define GPIO_CAPTURE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "shared-ringbuffer.h"
+
+/**
+ * \defgroup gpio-capture gpio-capture: Timestamped GPIO edge capture
+ *
+ * Requests lines from a gpiochip through the Linux v2 character device
+ * interface. The kernel timestamps every edge. A capture thread reads
+ * the events in blocks into a SharedRing and wakes the event loop once
+ * per batch through a pipe.
+ * @{
+ */
+#define GPIO_CAPTURE_MAX_LINES 64
+#define GPIO_EDGE_RISING 1
+#define GPIO_EDGE_FALLING 2
+#define GPIO_EDGE_BOTH 3
+
+typedef struct gpio_edge {
+  uint64_t timestamp_ns;
+  uint32_t line;
+  uint32_t edge; /**< GPIO_EDGE_RISING or GPIO_EDGE_FALLING */
+} GPIOEdge;
+
+typedef struct gpio_capture {
+  int line_fd;
+  int wake[2]; /**< capture thread -> event loop */
+  int stop[2]; /**< event loop -> capture thread */
+  pthread_t thread;
+  bool running;
+  int notified;
+  uint64_t dropped;
+  SharedRing ring;
+  void* ring_mem;
+} GPIOCapture;
+
+int gpio_capture_open(GPIOCapture*, const char* chip, const uint32_t* lines, uint32_t num_lines, int edges, uint32_t debounce_us, uint32_t capacity);
+size_t gpio_capture_read(GPIOCapture*, GPIOEdge* out, size_t max);
+size_t gpio_capture_pending(GPIOCapture*);
+void gpio_capture_close(GPIOCapture*);
+
+/**
+ * @}
+ */
+#endif /* defined(GPIO_CAPTURE_H) */
@@ -22,6 +22,8 @@ void gpio_close(struct gpio*);
 void gpio_init_pin(struct gpio*, const uint8_t pin, const bool output);
 void gpio_set_pin(struct gpio*, const uint8_t pin, const bool value);
 bool gpio_get_pin(struct gpio*, const uint8_t pin);
+uint32_t gpio_read_bank(struct gpio*, const uint8_t bank);
+void gpio_write_bank(struct gpio*, const uint8_t bank, const uint32_t mask, const uint32_t value);
 
 static inline struct gpio*
 gpio_dup(struct gpio* gp) {
@@ -17,6 +17,7 @@ typedef struct {
   uint8_t* bytecode;
   void* opaque;
   char* expansion;
+  uint64_t first[4];
 } LexerRule;
 
 static const uint64_t MASK_ALL = ~(uint64_t)0;
@@ -33,8 +34,27 @@ enum lexer_result {
   LEXER_ERROR_NOMATCH = -3,
   LEXER_ERROR_COMPILE = -4,
   LEXER_ERROR_EXEC = -5,
+  LEXER_INCOMPLETE = -6,
 };
 
+/**
+ * Lexer state at a token boundary: position, location, start condition
+ * and state stack (a slice of Lexer.checkpoint_stack), plus the index of
+ * the next token record.
+ */
+typedef struct {
+  size_t pos, index;
+  int32_t line, column;
+  int64_t char_offset;
+  int32_t state;
+  uint32_t stack_start, stack_depth;
+} LexerCheckpoint;
+
+#define LEXER_CHECKPOINT_INTERVAL 64
+
+/* when compacting chunked input, keep up to this many bytes of the current line */
+#define LEXER_CHUNK_KEEP_LINE 4096
+
 typedef struct {
   union {
     int ref_count;
@@ -50,12 +70,19 @@ typedef struct {
   };
   enum lexer_mode mode;
   size_t byte_length;
+  size_t loc_pos; /**< position loc was last brought up to, see lexer_location() */
   int32_t token_id, state;
   Vector defines;
   Vector rules;
   Vector states;
   Vector state_stack;
   uint64_t seq;
+  size_t records;
+  Vector checkpoints;
+  Vector checkpoint_stack;
+  size_t base, capacity;
+  uint32_t lookahead;
+  BOOL chunked : 1, closed : 1;
 } Lexer;
 
 int lexer_state_findb(Lexer*, const char* state, size_t slen);
@@ -83,8 +110,17 @@ void lexer_clear_token(Lexer*);
 char* lexer_lexeme(Lexer*, size_t* lenp);
 int lexer_next(Lexer*, JSContext* ctx);
 void lexer_set_input(Lexer*, InputBuffer input, int32_t file_atom);
+int lexer_feed(Lexer*, const void* x, size_t n, JSContext* ctx);
+void lexer_end(Lexer*);
 void lexer_set_location(Lexer*, const Location* loc, JSContext* ctx);
+Location* lexer_location(Lexer*);
 Location lexer_get_location(Lexer*, JSContext* ctx);
+void lexer_checkpoint(Lexer*);
+LexerCheckpoint* lexer_checkpoint_find(Lexer*, size_t pos);
+void lexer_checkpoint_restore(Lexer*, const LexerCheckpoint* cp);
+BOOL lexer_checkpoint_same_state(Lexer*, const LexerCheckpoint* cp, const int32_t* stack);
+void lexer_checkpoint_truncate(Lexer*, const LexerCheckpoint* cp);
+void lexer_checkpoints_clear(Lexer*);
 void lexer_release(Lexer*, JSRuntime* rt);
 void lexer_free(Lexer*, JSRuntime* rt);
 void lexer_dump(Lexer*, DynBuf* dbuf);
@@ -124,6 +160,25 @@ lexer_num_states(Lexer* lex) {
   return vector_size(&lex->states, sizeof(char*));
 }
 
+/**
+ * TRUE while chunked input may still grow, so a match reaching the end of
+ * the buffered data is not final.
+ */
+static inline BOOL
+lexer_awaiting_input(Lexer* lex) {
+  return lex->chunked && !lex->closed;
+}
+
+static inline size_t
+lexer_num_checkpoints(Lexer* lex) {
+  return vector_size(&lex->checkpoints, sizeof(LexerCheckpoint));
+}
+
+static inline LexerCheckpoint*
+lexer_checkpoint_at(Lexer* lex, size_t i) {
+  return vector_at(&lex->checkpoints, sizeof(LexerCheckpoint), i);
+}
+
 static inline char*
 lexer_state_topname(Lexer* lex) {
   return lexer_state_name(lex, lexer_state_top(lex, 0));
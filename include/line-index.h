@@ -0,0 +1,26 @@
+#ifndef LINE_INDEX_H
+#define LINE_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <cutils.h>
+
+/**
+ * \defgroup line-index line-index: Record separator scanner
+ *
+ * Collects the offsets following every separator byte of a buffer, 16 or
+ * 32 bytes at a time. With a quote byte, separators between an odd number
+ * of quotes do not count, so CSV records may span lines. Chunks of one
+ * buffer can be scanned independently once the quote parity at their
+ * start is known from line_index_count().
+ * @{
+ */
+size_t line_index_count(const uint8_t* p, size_t n, uint8_t ch);
+size_t line_index_span(const uint8_t* p, size_t n, const uint8_t* set, size_t nset);
+ssize_t line_index_scan(const uint8_t* p, size_t n, int sep, int quote, BOOL* inquote, uint64_t base, DynBuf* out);
+
+/**
+ * @}
+ */
+#endif /* defined(LINE_INDEX_H) */
@@ -0,0 +1,80 @@
+#ifndef MIRROR_RINGBUFFER_H
+#define MIRROR_RINGBUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <cutils.h>
+
+/**
+ * \defgroup mirror-ringbuffer mirror-ringbuffer: Virtual-memory mirrored ring buffer
+ *
+ * The same pages are mapped twice, back to back, so the byte after the
+ * last one of the buffer is the first one again. Every readable and every
+ * writable region is then one contiguous span and can be handed straight
+ * to parsers, read() or write() without ringbuffer_normalize().
+ *
+ * The size is rounded up to the page size (the allocation granularity on
+ * Windows) and is fixed after mirror_ring_init().
+ * @{
+ */
+typedef struct mirror_ring {
+  uint8_t* data;
+  size_t size;
+  /* head - tail bytes are queued, tail < size */
+  size_t head, tail;
+} MirrorRing;
+
+#define MIRROR_RING_INIT() \
+  { 0, 0, 0, 0 }
+
+BOOL mirror_ring_init(MirrorRing*, size_t min_size);
+void mirror_ring_free(MirrorRing*);
+size_t mirror_ring_write(MirrorRing*, const void* x, size_t len);
+size_t mirror_ring_read(MirrorRing*, void* x, size_t len);
+ssize_t mirror_ring_fill(MirrorRing*, int fd);
+ssize_t mirror_ring_drain(MirrorRing*, int fd);
+
+static inline size_t
+mirror_ring_length(const MirrorRing* r) {
+  return r->head - r->tail;
+}
+
+static inline size_t
+mirror_ring_avail(const MirrorRing* r) {
+  return r->size - mirror_ring_length(r);
+}
+
+/* start of the mirror_ring_length() queued bytes */
+static inline uint8_t*
+mirror_ring_begin(const MirrorRing* r) {
+  return r->data + r->tail % r->size;
+}
+
+/* start of the mirror_ring_avail() free bytes */
+static inline uint8_t*
+mirror_ring_end(const MirrorRing* r) {
+  return r->data + r->head % r->size;
+}
+
+/* marks n bytes written at mirror_ring_end() as queued */
+static inline void
+mirror_ring_produce(MirrorRing* r, size_t n) {
+  r->head += n;
+}
+
+/* drops n bytes from mirror_ring_begin() */
+static inline void
+mirror_ring_consume(MirrorRing* r, size_t n) {
+  r->tail += n;
+
+  if(r->tail >= r->size) {
+    r->tail -= r->size;
+    r->head -= r->size;
+  }
+}
+
+/**
+ * @}
+ */
+#endif /* defined(MIRROR_RINGBUFFER_H) */
@@ -28,6 +28,11 @@ char is_junction(const char*);
 #define PATH_FNM_NOESCAPE (1 << 1)
 #define PATH_FNM_PERIOD (1 << 2)
 
+#define PATH_STAT_MODE (1 << 0)
+#define PATH_STAT_SIZE (1 << 1)
+#define PATH_STAT_MTIME (1 << 2)
+#define PATH_STAT_ALL (PATH_STAT_MODE | PATH_STAT_SIZE | PATH_STAT_MTIME)
+
 #if /*defined(__MINGW32__) ||*/ defined(__MSYS__) || defined(__CYGWIN__)
 #define PATHSEP_S "/"
 #define PATHSEP_C '/'
@@ -64,6 +69,19 @@ typedef struct {
   size_t sz1, sz2;
 } SizePair;
 
+typedef struct path_glob PathGlob;
+
+typedef struct {
+  uint32_t mode;
+  uint64_t size;
+  double mtime; /* milliseconds since the epoch */
+} PathStat;
+
+typedef struct {
+  size_t size, capacity;
+  uint64_t hits, misses;
+} PathCacheStats;
+
 char* path_dup3(const char* path, size_t n, DynBuf* db);
 char* path_dup1(const char* path);
 char* path_dup2(const char* path, size_t n);
@@ -101,6 +119,7 @@ char* path_getcwd0(void);
 char* path_gethome(void);
 char* path_gethome1(int uid);
 int path_stat2(const char* p, size_t plen, struct stat* st);
+int path_statat(int dirfd, const char* name, int fields, BOOL follow, PathStat* st);
 int path_isabsolute2(const char* x, size_t n);
 int path_isabsolute1(const char* x);
 int path_isdir1(const char* p);
@@ -138,6 +157,17 @@ int path_readlink2(const char* path, DynBuf* dir);
 char* path_readlink1(const char* path);
 int path_compare4(const char* a, size_t alen, const char* b, size_t blen);
 char* path_search(const char** path_ptr, const char* name, DynBuf* db);
+PathGlob* path_glob_compile(const char* pattern, size_t len, int flags);
+void path_glob_free(PathGlob*);
+uint64_t path_glob_start(const PathGlob*);
+uint64_t path_glob_step(const PathGlob*, uint64_t states, const char* name, size_t len);
+BOOL path_glob_accepts(const PathGlob*, uint64_t states);
+BOOL path_glob_live(const PathGlob*, uint64_t states);
+BOOL path_glob_match(const PathGlob*, const char* s, size_t len);
+BOOL path_cache_enable(size_t capacity);
+void path_cache_clear(void);
+size_t path_cache_invalidate(const char* dir, size_t dirlen);
+void path_cache_stats(PathCacheStats* st);
 
 static inline size_t
 path_component1(const char* p) {
@@ -4,6 +4,7 @@
 #include <quickjs.h>
 #include <assert.h>
 #include "stream-utils.h"
+#include "vector.h"
 
 /**
  * \defgroup pointer pointer: JS Object pointer (deep key)
@@ -15,6 +16,18 @@ typedef struct Pointer {
   JSAtom* atoms;
 } Pointer;
 
+/** Node of a PointerSet trie, pointers with a common prefix share nodes */
+typedef struct PointerSetNode {
+  JSAtom atom;
+  int32_t slot; /* property slot guess for pointer_get_cached() */
+  uint32_t parent, first_child, next_sibling;
+} PointerSetNode;
+
+typedef struct PointerSet {
+  Vector nodes; /* PointerSetNode, the root is at index 0 */
+  Vector ends;  /* uint32_t node index of each added pointer */
+} PointerSet;
+
 #define POINTER_LENGTH(ptr) ((ptr)->n)
 #define POINTER_ATOMS(ptr) ((ptr)->atoms)
 
@@ -37,6 +50,7 @@ BOOL pointer_unshift(Pointer*, JSValueConst value, JSContext*);
 void pointer_push(Pointer*, JSValueConst item, JSContext*);
 void pointer_pushfree(Pointer*, JSValue item, JSContext*);
 JSValue pointer_deref(Pointer const*, JSValueConst arg, JSContext*);
+JSValue pointer_deref_cached(Pointer const*, int32_t* slots, JSValueConst arg, JSContext*);
 JSValue pointer_acquire(Pointer const*, JSValueConst arg, JSContext*);
 BOOL pointer_fromstring(Pointer*, JSValueConst value, JSContext*);
 void pointer_fromarray(Pointer*, JSValueConst array, JSContext*);
@@ -44,6 +58,15 @@ void pointer_fromiterable(Pointer*, JSValueConst arg, JSContext*);
 int pointer_from(Pointer*, JSValueConst value, JSContext*);
 Pointer* pointer_concat(Pointer const*, JSValueConst iterable, JSContext*);
 JSValue pointer_toarray(Pointer const*, JSContext*);
+void pointerset_init(PointerSet*, JSRuntime*);
+void pointerset_reset(PointerSet*, JSRuntime*);
+int32_t pointerset_add(PointerSet*, Pointer const*, JSContext*);
+JSValue pointerset_deref(PointerSet*, JSValueConst arg, JSContext*);
+
+static inline uint32_t
+pointerset_size(PointerSet const* set) {
+  return vector_size(&set->ends, sizeof(uint32_t));
+}
 
 static inline Pointer*
 pointer_new(JSContext* ctx) {
@@ -52,6 +52,11 @@ typedef struct {
   char* set;
   size_t len;
   Vector chars;
+  /* built on first use: bitmap of code points below 256, sorted ranges above */
+  BOOL built;
+  uint32_t latin1[8];
+  uint32_t (*ranges)[2];
+  size_t nranges;
 } CharsetPredicate;
 
 typedef struct {
@@ -110,6 +115,8 @@ typedef struct {
   int arity;
 } FunctionPredicate;
 
+typedef struct predicate_program PredicateProgram;
+
 typedef struct Predicate {
   enum PredicateId id;
   union {
@@ -127,6 +134,8 @@ typedef struct Predicate {
     IndexPredicate index;
     FunctionPredicate function;
   };
+  /* set by predicate_compile() */
+  PredicateProgram* program;
 } Predicate;
 
 #define PREDICATE_INIT(id) \
@@ -153,6 +162,17 @@ JSValue predicate_values(const Predicate*, JSContext* ctx);
 JSValue predicate_keys(const Predicate*, JSContext* ctx);
 Predicate* predicate_clone(const Predicate*, JSContext* ctx);
 int predicate_regexp_compile(Predicate*, JSContext* ctx);
+int predicate_compile(Predicate*, JSContext* ctx);
+
+#define PREDICATE_KERNEL_BLOCK 256
+
+typedef struct predicate_kernel PredicateKernel;
+typedef void PredicateScanFunc(void* opaque, size_t offset, const uint8_t* results, size_t n);
+
+PredicateKernel* predicate_kernel_new(const Predicate*, JSContext* ctx);
+void predicate_kernel_free(PredicateKernel*, JSContext* ctx);
+void predicate_kernel_run(const PredicateKernel*, const double* x, const uint8_t* isint, size_t offset, size_t n, uint8_t* out);
+int predicate_scan(Predicate*, JSContext* ctx, JSValueConst array, PredicateScanFunc* fn, void* opaque);
 int predicate_recursive_num_args(const Predicate*);
 int predicate_direct_num_args(const Predicate*);
 JSPrecedence predicate_precedence(const Predicate*);
@@ -180,6 +200,9 @@ predicate_charset(const char* str, size_t len) {
   ret.charset.set = (char*)str;
   ret.charset.len = len;
   memset(&ret.charset.chars, 0, sizeof(Vector));
+  ret.charset.built = FALSE;
+  ret.charset.ranges = 0;
+  ret.charset.nranges = 0;
   return ret;
 }
 
@@ -15,6 +15,7 @@ typedef struct PropertyEnumeration {
   uint32_t tab_atom_len;
   JSAtom* tab_atom;
   JSValue obj;
+  BOOL array; /**< keys are the indices of a fast array, tab_atom is NULL */
 } PropertyEnumeration;
 
 typedef struct {
@@ -22,11 +23,15 @@ typedef struct {
 } IndexTuple;
 
 #define PROPENUM_INIT() \
-  { 0, 0, NULL, JS_UNDEFINED }
+  { 0, 0, NULL, JS_UNDEFINED, FALSE }
 #define PROPENUM_SORT_ATOMS (1 << 6)
 
 #define PROPENUM_DEFAULT_FLAGS (JS_GPN_STRING_MASK | JS_GPN_SYMBOL_MASK | JS_GPN_ENUM_ONLY)
 
+/* array index atoms are tagged integers, as in quickjs.c */
+#define PROPENUM_INDEX_ATOM(i) ((JSAtom)((uint32_t)(i) | (1U << 31)))
+#define PROPENUM_ATOM_IS_INDEX(a) (!!((a) & (1U << 31)))
+
 #define property_enumeration_new(vec) vector_emplace((vec), sizeof(PropertyEnumeration))
 #define property_enumeration_index(enum) ((enum)->idx)
 
@@ -54,10 +59,20 @@ property_enumeration_length(const PropertyEnumeration* propenum) {
   return propenum->tab_atom_len;
 }
 
+static inline JSAtom
+property_enumeration_atom(const PropertyEnumeration* it) {
+  assert(it->idx < it->tab_atom_len);
+
+  return it->array ? PROPENUM_INDEX_ATOM(it->idx) : it->tab_atom[it->idx];
+}
+
 static inline JSValue
 property_enumeration_value(const PropertyEnumeration* it, JSContext* ctx) {
   assert(it->idx < it->tab_atom_len);
 
+  if(it->array)
+    return JS_GetPropertyUint32(ctx, it->obj, it->idx);
+
   return JS_GetProperty(ctx, it->obj, it->tab_atom[it->idx]);
 }
 
@@ -71,30 +86,20 @@ property_enumeration_valuestrlen(const PropertyEnumeration* it, size_t* len, JSC
   return str;
 }
 
-static inline JSAtom
-property_enumeration_atom(const PropertyEnumeration* it) {
-  assert(it->idx < it->tab_atom_len);
-
-  return it->tab_atom[it->idx];
-}
-
 static inline const char*
 property_enumeration_keystr(const PropertyEnumeration* it, JSContext* ctx) {
-  assert(it->idx < it->tab_atom_len);
-
-  return JS_AtomToCString(ctx, it->tab_atom[it->idx]);
+  return JS_AtomToCString(ctx, property_enumeration_atom(it));
 }
 
 static inline const char*
 property_enumeration_keystrlen(const PropertyEnumeration* it, size_t* len, JSContext* ctx) {
-  assert(it->idx < it->tab_atom_len);
-
-  return js_atom_to_cstringlen(ctx, len, it->tab_atom[it->idx]);
+  return js_atom_to_cstringlen(ctx, len, property_enumeration_atom(it));
 }
 
 static inline void
 property_enumeration_sort(PropertyEnumeration* it, JSContext* ctx) {
-  quicksort_r(it->tab_atom, it->tab_atom_len, sizeof(JSPropertyEnum), &js_propenum_cmp, ctx);
+  if(!it->array)
+    quicksort_r(it->tab_atom, it->tab_atom_len, sizeof(JSPropertyEnum), &js_propenum_cmp, ctx);
 }
 
 static inline int
@@ -0,0 +1,47 @@
+#ifndef QUERY_STATS_H
+#define QUERY_STATS_H
+
+#include <quickjs.h>
+#include <cutils.h>
+
+/**
+ * \defgroup query-stats query-stats: Per-connection query instrumentation
+ *
+ * Connections keep a NULL pointer until stats are enabled, so the cost
+ * when disabled is one branch per query step. A connection runs one
+ * query at a time, so a single in-flight timer per connection suffices.
+ * @{
+ */
+#define QUERY_STATS_BUCKETS 24
+
+typedef struct query_timer {
+  int64_t start, first_byte;
+  uint32_t wakeups;
+  uint64_t bytes_sent, bytes_received, rows;
+  BOOL active;
+} QueryTimer;
+
+typedef struct query_stats {
+  uint64_t queries, errors, rows, wakeups, bytes_sent, bytes_received;
+  int64_t first_byte_time, last_row_time;
+  /* bucket i counts queries whose time to last row was below 2^i µs */
+  uint32_t histogram[QUERY_STATS_BUCKETS];
+  QueryTimer current;
+  JSValue hook;
+} QueryStats;
+
+QueryStats* query_stats_new(JSContext*);
+void query_stats_free(QueryStats*, JSRuntime*);
+void query_stats_reset(QueryStats*);
+void query_stats_begin(QueryStats*, size_t bytes_sent);
+void query_stats_wakeup(QueryStats*);
+void query_stats_first_byte(QueryStats*);
+void query_stats_received(QueryStats*, uint64_t rows, size_t bytes);
+void query_stats_end(QueryStats*, BOOL error, JSContext*);
+JSValue query_stats_value(QueryStats*, JSContext*);
+
+/**
+ * @}
+ */
+
+#endif /* defined(QUERY_STATS_H) */
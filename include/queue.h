@@ -28,13 +28,37 @@ typedef struct block {
     struct list_head link;
   };
   int ref_count;
+  /* size class of pooled chunks, -1 when malloc'ed */
+  int pool;
+  /* pool of the allocating thread, which gets the chunk back */
+  struct chunk_pool* owner;
   void* opaque;
   size_t size, pos;
-  uint8_t data[0];
+  uint8_t* data;
+  void (*release)(struct block*);
+  uint8_t buf[0];
 } Chunk;
 
+/**
+ * Chunks of up to 256 bytes, 4K, 16K and 64K come from per-thread free
+ * lists backed by 2M slabs, so steady-state streaming does not call
+ * malloc. Chunks freed on another thread go back to the allocating
+ * thread's lists. A thread's slabs are freed when it exits, or later
+ * when the last of its chunks held by another thread is freed.
+ */
+#define CHUNK_POOL_CLASSES 4
+#define CHUNK_SLAB_SIZE (2 << 20)
+
+typedef struct chunk_pool_stats {
+  uint64_t hits, misses, slabs;
+  size_t free[CHUNK_POOL_CLASSES];
+} ChunkPoolStats;
+
 Chunk* chunk_alloc(size_t);
+Chunk* chunk_external(void* data, size_t size, void (*release)(Chunk*), size_t extra);
 void chunk_free(Chunk*);
+void chunk_pool_stats(ChunkPoolStats*);
+void chunk_pool_hugepages(int enable);
 
 static inline Chunk*
 chunk_dup(Chunk* ch) {
@@ -42,13 +66,20 @@ chunk_dup(Chunk* ch) {
   return ch;
 }
 
+/* chunks covered by a single queue_writev() / queue_readv() */
+#define QUEUE_IOV 64
+#define QUEUE_READ_CHUNK 65536
+
 void queue_init(Queue*);
 ssize_t queue_write(Queue*, const void* x, size_t n);
+void queue_put(Queue*, Chunk*);
 ssize_t queue_read(Queue*, void* x, size_t n);
 ssize_t queue_peek(Queue*, void* x, size_t n);
 ssize_t queue_skip(Queue*, size_t n);
 Chunk* queue_next(Queue*);
 void queue_clear(Queue*);
+ssize_t queue_writev(Queue*, int fd, size_t max);
+ssize_t queue_readv(Queue*, int fd, size_t max);
 
 static inline size_t
 queue_size(Queue* q) {
@@ -0,0 +1,46 @@
+#ifndef RESULT_COLUMNS_H
+#define RESULT_COLUMNS_H
+
+#include <quickjs.h>
+#include <cutils.h>
+#include "buffer-utils.h"
+
+/**
+ * \defgroup result-columns result-columns: Columnar database results
+ *
+ * Decodes the text cells of a result column by column into typed arrays
+ * (numbers), offsets plus one shared byte buffer (strings and binary) and
+ * a validity bitmap, so a fetch allocates O(columns) JS values instead of
+ * O(cells).
+ * @{
+ */
+typedef enum {
+  COLUMN_INT32 = 0,
+  COLUMN_INT64,
+  COLUMN_FLOAT64,
+  COLUMN_BOOL,
+  COLUMN_STRING,
+  COLUMN_BINARY,
+} ColumnType;
+
+typedef struct result_column {
+  char* name;
+  ColumnType type;
+  uint32_t length, null_count;
+  DynBuf values, offsets, validity;
+} ResultColumn;
+
+void column_init(ResultColumn*, const char* name, ColumnType, JSContext*);
+void column_reserve(ResultColumn*, uint32_t rows);
+BOOL column_push(ResultColumn*, const char* buf, size_t len);
+BOOL column_push_raw(ResultColumn*, const void* value);
+JSValue column_value(ResultColumn*, JSContext*);
+void column_free(ResultColumn*, JSRuntime*);
+JSValue columns_value(ResultColumn*, uint32_t num_columns, JSContext*);
+void columns_free(ResultColumn*, uint32_t num_columns, JSRuntime*);
+
+/**
+ * @}
+ */
+
+#endif /* defined(RESULT_COLUMNS_H) */
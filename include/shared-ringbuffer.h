@@ -0,0 +1,77 @@
+#ifndef SHARED_RINGBUFFER_H
+#define SHARED_RINGBUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <cutils.h>
+
+/**
+ * \defgroup shared-ringbuffer shared-ringbuffer: Lock-free ring buffer in shared memory
+ *
+ * Header and data live in one block of shared memory (a SharedArrayBuffer
+ * or a MAP_SHARED mapping), so every thread or process attaching to it
+ * works on the same ring. Positions run freely modulo 2^32 over a
+ * power-of-two capacity; producers publish with release stores and the
+ * single consumer observes them with acquire loads.
+ *
+ * In MPSC mode producers claim space with a CAS on reserve and publish in
+ * claim order through head, so each write is all-or-nothing.
+ * @{
+ */
+#define SHARED_RING_MAGIC 0x474e4952 /* "RING" */
+#define SHARED_RING_CACHELINE 64
+
+typedef enum {
+  SHARED_RING_SPSC = 0,
+  SHARED_RING_MPSC = 1,
+} SharedRingMode;
+
+/* producer and consumer fields on separate cache lines */
+typedef struct shared_ring_header {
+  uint32_t magic, capacity, mode, reserved;
+  uint8_t pad0[SHARED_RING_CACHELINE - 4 * sizeof(uint32_t)];
+  uint32_t reserve;
+  uint8_t pad1[SHARED_RING_CACHELINE - sizeof(uint32_t)];
+  uint32_t head, readers_waiting;
+  uint8_t pad2[SHARED_RING_CACHELINE - 2 * sizeof(uint32_t)];
+  uint32_t tail, writers_waiting;
+  uint8_t pad3[SHARED_RING_CACHELINE - 2 * sizeof(uint32_t)];
+} SharedRingHeader;
+
+typedef struct shared_ring {
+  SharedRingHeader* hdr;
+  uint8_t* data;
+  uint32_t mask;
+} SharedRing;
+
+/* readable bytes in place, the second span holds what wrapped around */
+typedef struct shared_ring_span {
+  const uint8_t* ptr;
+  size_t len;
+} SharedRingSpan;
+
+size_t shared_ring_size(size_t capacity);
+BOOL shared_ring_init(SharedRing*, void* mem, size_t size, SharedRingMode mode);
+BOOL shared_ring_attach(SharedRing*, void* mem, size_t size);
+size_t shared_ring_length(SharedRing*);
+size_t shared_ring_avail(SharedRing*);
+size_t shared_ring_write(SharedRing*, const void* x, size_t len);
+size_t shared_ring_read(SharedRing*, void* x, size_t len);
+BOOL shared_ring_send(SharedRing*, const void* x, size_t len);
+ssize_t shared_ring_next(SharedRing*);
+ssize_t shared_ring_receive(SharedRing*, void* x, size_t len);
+size_t shared_ring_peek(SharedRing*, SharedRingSpan span[2]);
+void shared_ring_skip(SharedRing*, size_t len);
+BOOL shared_ring_wait_readable(SharedRing*, int64_t timeout_ms);
+BOOL shared_ring_wait_writable(SharedRing*, size_t len, int64_t timeout_ms);
+
+static inline uint32_t
+shared_ring_capacity(const SharedRing* ring) {
+  return ring->mask + 1;
+}
+
+/**
+ * @}
+ */
+#endif /* defined(SHARED_RINGBUFFER_H) */
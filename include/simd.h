@@ -0,0 +1,80 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdint.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+/**
+ * \defgroup simd simd: byte comparison masks
+ *
+ * Compares SIMD_BLOCK bytes at a time and turns the result into a bit
+ * mask. On NEON, which has no movemask, each byte becomes 4 bits, so bit
+ * positions are shifted right by SIMD_SHIFT to get byte offsets.
+ * SIMD_ALL is the mask of a block where every byte matched. SIMD_BLOCK
+ * is undefined when none of AVX2, SSE2 or NEON is available.
+ * @{
+ */
+#if defined(__AVX2__)
+#define SIMD_BLOCK 32
+#define SIMD_SHIFT 0
+#define SIMD_ALL 0xffffffffull
+typedef __m256i simd_vec;
+#define simd_load(p) _mm256_loadu_si256((const __m256i*)(p))
+#define simd_eq(v, ch) _mm256_cmpeq_epi8((v), _mm256_set1_epi8(ch))
+#define simd_gt(v, ch) _mm256_cmpgt_epi8((v), _mm256_set1_epi8(ch))
+#define simd_and(a, b) _mm256_and_si256((a), (b))
+#define simd_or(a, b) _mm256_or_si256((a), (b))
+#define simd_movemask(m) ((uint64_t)(uint32_t)_mm256_movemask_epi8(m))
+#elif defined(__SSE2__)
+#define SIMD_BLOCK 16
+#define SIMD_SHIFT 0
+#define SIMD_ALL 0xffffull
+typedef __m128i simd_vec;
+#define simd_load(p) _mm_loadu_si128((const __m128i*)(p))
+#define simd_eq(v, ch) _mm_cmpeq_epi8((v), _mm_set1_epi8(ch))
+#define simd_gt(v, ch) _mm_cmpgt_epi8((v), _mm_set1_epi8(ch))
+#define simd_and(a, b) _mm_and_si128((a), (b))
+#define simd_or(a, b) _mm_or_si128((a), (b))
+#define simd_movemask(m) ((uint64_t)(uint32_t)_mm_movemask_epi8(m))
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define SIMD_BLOCK 16
+#define SIMD_SHIFT 2
+#define SIMD_ALL (~0ull)
+typedef uint8x16_t simd_vec;
+#define simd_load(p) vld1q_u8((const uint8_t*)(p))
+#define simd_eq(v, ch) vceqq_u8((v), vdupq_n_u8(ch))
+#define simd_gt(v, ch) vcgtq_s8(vreinterpretq_s8_u8(v), vdupq_n_s8(ch))
+#define simd_and(a, b) vandq_u8((a), (b))
+#define simd_or(a, b) vorrq_u8((a), (b))
+
+static inline uint64_t
+simd_movemask(uint8x16_t m) {
+  return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+}
+#endif
+
+#ifdef SIMD_BLOCK
+/* byte offset of the first match in a mask */
+#define simd_first(m) (__builtin_ctzll(m) >> SIMD_SHIFT)
+/* number of matches in a mask */
+#define simd_count(m) (__builtin_popcountll(m) >> SIMD_SHIFT)
+/* the mask bits of byte i */
+#define simd_byte(i) ((((uint64_t)1 << (1 << SIMD_SHIFT)) - 1) << ((i) << SIMD_SHIFT))
+
+/* clears the first match */
+#if SIMD_SHIFT
+#define simd_clear(m) ((m) & ~((uint64_t)0xf << (__builtin_ctzll(m) & ~3)))
+#else
+#define simd_clear(m) ((m) & ((m)-1))
+#endif
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* defined(SIMD_H) */
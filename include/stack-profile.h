@@ -0,0 +1,56 @@
+#ifndef STACK_PROFILE_H
+#define STACK_PROFILE_H
+
+#include <quickjs.h>
+#include <cutils.h>
+
+/**
+ * \defgroup stack-profile stack-profile: Aggregated JS stack samples
+ *
+ * Frames are read straight from the runtime's stack frame list and
+ * symbolized from the bytecode debug info, so taking a sample neither
+ * allocates JS values nor calls into the interpreter. That makes it usable
+ * from allocator hooks and interrupt handlers. Only libc memory is used.
+ * @{
+ */
+#define STACK_PROFILE_MAX_DEPTH 64
+
+typedef struct stack_profile_frame {
+  JSAtom name, file;
+  int line; /**< -1 for C functions */
+} StackProfileFrame;
+
+typedef struct stack_profile_entry {
+  struct stack_profile_entry* next;
+  uint64_t hash;
+  uint64_t samples, weight;
+  int depth;
+  StackProfileFrame frames[];
+} StackProfileEntry;
+
+typedef struct stack_profile {
+  JSRuntime* rt;
+  StackProfileEntry** table;
+  size_t size, count;
+  uint64_t samples;
+} StackProfile;
+
+int stack_profile_capture(JSRuntime*, StackProfileFrame* frames, int max_depth);
+void stack_profile_add(StackProfile*, JSContext*, const StackProfileFrame* frames, int depth, uint64_t weight);
+void stack_profile_collapse(StackProfile*, DynBuf* db);
+int stack_profile_write(StackProfile*, const char* file);
+void stack_profile_reset(StackProfile*);
+
+static inline void
+stack_profile_init(StackProfile* sp, JSRuntime* rt) {
+  sp->rt = rt;
+  sp->table = 0;
+  sp->size = sp->count = 0;
+  sp->samples = 0;
+}
+
+/**
+ * @}
+ */
+
+#endif /* defined(STACK_PROFILE_H) */
@@ -15,20 +15,26 @@ struct StreamWriter;
 
 typedef ssize_t WriteFunction(intptr_t, const void*, size_t, struct StreamWriter*);
 typedef ssize_t WriterFinalizer(void*);
+typedef ssize_t WriterFlush(void*);
 
 typedef struct StreamWriter {
   WriteFunction* write;
   void* opaque;
   WriterFinalizer* finalizer;
+  WriterFlush* flush; /**< when set, pushes out what the writer holds back */
 } Writer;
 
+#define WRITER_BUFFER_SIZE 8192
+
 Writer writer_from_dynbuf(DynBuf*);
 Writer writer_from_fd(intptr_t fd, bool close_on_end);
 Writer writer_tee(const Writer a, const Writer b);
 Writer writer_escaped(Writer*, const char[], size_t);
 Writer writer_urlencode(Writer*);
+Writer writer_vectored(intptr_t fd, size_t capacity, bool close_on_end);
 
 ssize_t writer_write(Writer*, const void*, size_t);
+ssize_t writer_flush(Writer*);
 void writer_free(Writer*);
 
 static inline ssize_t
@@ -287,6 +287,10 @@ RegExp regexp_from_argv(int argc, JSValueConst argv[], JSContext* ctx);
 RegExp regexp_from_string(char* str, int flags);
 RegExp regexp_from_dbuf(DynBuf* dbuf, int flags);
 uint8_t* regexp_compile(RegExp re, JSContext* ctx);
+uint8_t* regexp_compile_shared(RegExp re, JSContext* ctx);
+uint8_t* regexp_bytecode_dup(uint8_t* bc);
+void regexp_bytecode_free(uint8_t* bc);
+void regexp_cache_clear(void);
 JSValue regexp_to_value(RegExp re, JSContext* ctx);
 void regexp_free_rt(RegExp re, JSRuntime* rt);
 BOOL regexp_match(const uint8_t* bc, const void* cbuf, size_t clen, JSContext* ctx);
@@ -832,6 +836,55 @@ js_value_isclass(JSContext* ctx, JSValue obj, int id) {
   return js_object_isclass(obj, class_id);
 }
 
+/**
+ * Builtin classes, indexing the fixed IDs from js_builtin_classes(), so that
+ * the js_is_* tests below compare class IDs instead of calling instanceof and
+ * Object.prototype.toString.
+ */
+enum builtin_classes {
+  BUILTIN_ARRAYBUFFER = 0,
+  BUILTIN_SHAREDARRAYBUFFER,
+  BUILTIN_DATE,
+  BUILTIN_MAP,
+  BUILTIN_SET,
+  BUILTIN_GENERATOR,
+  BUILTIN_ASYNCGENERATOR,
+  BUILTIN_REGEXP,
+  BUILTIN_PROMISE,
+  BUILTIN_DATAVIEW,
+  BUILTIN_ERROR,
+  BUILTIN_TYPEDARRAY,      // Uint8ClampedArray, the first typed array class
+  BUILTIN_TYPEDARRAY_LAST, // Float64Array
+  BUILTIN_CLASS_COUNT,
+};
+
+typedef enum {
+  OBJECT_ARRAYBUFFER = (1 << BUILTIN_ARRAYBUFFER),
+  OBJECT_SHAREDARRAYBUFFER = (1 << BUILTIN_SHAREDARRAYBUFFER),
+  OBJECT_DATE = (1 << BUILTIN_DATE),
+  OBJECT_MAP = (1 << BUILTIN_MAP),
+  OBJECT_SET = (1 << BUILTIN_SET),
+  OBJECT_GENERATOR = (1 << BUILTIN_GENERATOR),
+  OBJECT_ASYNCGENERATOR = (1 << BUILTIN_ASYNCGENERATOR),
+  OBJECT_REGEXP = (1 << BUILTIN_REGEXP),
+  OBJECT_PROMISE = (1 << BUILTIN_PROMISE),
+  OBJECT_DATAVIEW = (1 << BUILTIN_DATAVIEW),
+  OBJECT_ERROR = (1 << BUILTIN_ERROR),
+  OBJECT_TYPEDARRAY = (1 << BUILTIN_TYPEDARRAY),
+  OBJECT_ANYBUFFER = (OBJECT_ARRAYBUFFER | OBJECT_SHAREDARRAYBUFFER),
+  OBJECT_BUFFERVIEW = (OBJECT_TYPEDARRAY | OBJECT_DATAVIEW),
+} BuiltinTypeMask;
+
+const JSClassID* js_builtin_classes(JSContext*);
+BuiltinTypeMask js_value_type_flags(JSContext*, JSValueConst);
+
+static inline BOOL
+js_is_builtin(JSContext* ctx, JSValueConst value, int index) {
+  JSClassID id;
+
+  return JS_IsObject(value) && (id = js_builtin_classes(ctx)[index]) && JS_GetClassID(value) == id;
+}
+
 BOOL js_is_arraybuffer(JSContext*, JSValueConst);
 BOOL js_is_sharedarraybuffer(JSContext*, JSValueConst);
 BOOL js_is_date(JSContext*, JSValueConst);
@@ -891,10 +944,7 @@ js_is_basic_array(JSContext* ctx, JSValueConst value) {
 
 static inline BOOL
 js_is_typedarray(JSContext* ctx, JSValueConst value) {
-  JSValue ctor = js_typedarray_constructor(ctx);
-  BOOL ret = JS_IsInstanceOf(ctx, value, js_typedarray_constructor(ctx));
-  JS_FreeValue(ctx, ctor);
-  return ret;
+  return !!(js_value_type_flags(ctx, value) & OBJECT_TYPEDARRAY);
 }
 
 int64_t js_array_length(JSContext* ctx, JSValueConst array);
@@ -1088,6 +1138,7 @@ void js_error_print(JSContext*, JSValueConst);
 JSValue js_error_stack(JSContext* ctx);
 /*JSValue js_error_uncatchable(JSContext* ctx);*/
 
+JSValue js_os_function(JSContext*, const char* name);
 JSValue js_iohandler_fn(JSContext*, BOOL write);
 BOOL js_iohandler_set(JSContext* ctx, JSValueConst set_handler, int fd, JSValue handler);
 
@@ -12,6 +12,7 @@
 #include <sys/types.h>
 
 #include "debug.h"
+#include "arena.h"
 
 /**
  * \defgroup vector vector: Vector implementation
@@ -38,6 +39,25 @@ typedef union Vector {
 
 #define vector_init(vec, ctx) dbuf_init2(&((vec)->dbuf), (ctx), (DynBufReallocFunc*)&vector_js_realloc)
 #define vector_init_rt(vec, rt) dbuf_init2(&((vec)->dbuf), (rt), (DynBufReallocFunc*)&vector_js_realloc_rt)
+/**
+ * Inline storage of a Vector: the first elements live in the declaring
+ * frame, more spill to js_malloc(). A VECTOR_INLINE() must not be returned
+ * or outlive its block, vector_move() it out instead.
+ */
+typedef struct vector_storage {
+  JSContext* ctx;
+  void* data;
+  size_t size;
+} VectorStorage;
+
+#define VECTOR_INLINE(name, type, n, ctx) \
+  type name##_inline[n]; \
+  VectorStorage name##_storage = {(ctx), name##_inline, sizeof(name##_inline)}; \
+  Vector name = { \
+      {(uint8_t*)name##_inline, 0, sizeof(name##_inline), 0, (DynBufReallocFunc*)&vector_inline_realloc, &name##_storage} \
+  }
+
+#define vector_init_arena(vec, a) dbuf_init2(&((vec)->dbuf), (a), (DynBufReallocFunc*)&arena_realloc)
 #define VECTOR(ctx) \
   (Vector) { \
     { 0, 0, 0, 0, (DynBufReallocFunc*)&vector_js_realloc, ctx } \
@@ -46,6 +66,10 @@ typedef union Vector {
   (Vector) { \
     { 0, 0, 0, 0, (DynBufReallocFunc*)&vector_js_realloc_rt, rt } \
   }
+#define VECTOR_ARENA(a) \
+  (Vector) { \
+    { 0, 0, 0, 0, (DynBufReallocFunc*)&arena_realloc, a } \
+  }
 
 #define vector_begin(vec) ((void*)((vec)->data))
 #define vector_end(vec) ((void*)((vec)->data + (vec)->size))
@@ -76,6 +100,8 @@ extern int umult64(uint64_t a, uint64_t b, uint64_t* c);
 void* vector_realloc(void*, void* ptr, size_t size);
 void* vector_js_realloc(JSContext* ctx, void* ptr, size_t size);
 void* vector_js_realloc_rt(JSRuntime* rt, void* ptr, size_t size);
+void* vector_inline_realloc(VectorStorage*, void* ptr, size_t size);
+BOOL vector_move(Vector* dst, Vector* src);
 int32_t vector_indexof(const Vector* vec, size_t elsz, void* ptr);
 int32_t vector_find(const Vector* vec, size_t elsz, void* ptr);
 int32_t vector_finds(const Vector* vec, const char* str);
@@ -96,6 +122,11 @@ void vector_dumpstrings(const Vector*, DynBuf* buf);
 
 #define vector_push(vec, elem) vector_put((vec), &(elem), sizeof((elem)))
 
+static inline BOOL
+vector_is_inline(const Vector* vec) {
+  return vec->realloc_func == (DynBufReallocFunc*)&vector_inline_realloc && vec->data == ((VectorStorage*)vec->opaque)->data;
+}
+
 static inline void*
 vector_allocate(Vector* vec, size_t elsz, int32_t pos) {
   uint64_t need;
@@ -1,6 +1,7 @@
 import * as os from 'os';
 import inspect from 'inspect';
 import * as std from 'std';
+import * as ringbuffer from 'ringbuffer';
 import { define, properties, getPerformanceCounter } from 'util';
 
 export function Console(...args) {
@@ -64,7 +65,34 @@ export function Console(...args) {
   /* if(globalThis.inspect !== inspect) globalThis.inspect = inspect;
   if(!globalThis.inspect) globalThis.inspect = arg => arg;*/
 
-  const printFunction = out => (typeof out == 'function' ? out : typeof out.flush == 'function' ? text => (out.puts(text), out.flush()) : text => out.puts(text));
+  /* buffered: { capacity, policy } queues the output in RingWriters, a thread writes it */
+  const writers = [];
+
+  if(opts.buffered) {
+    if(!ringbuffer.RingWriter) throw new Error('buffered console output is not supported on this platform');
+
+    const { capacity, policy } = typeof opts.buffered == 'object' ? opts.buffered : {};
+    const writer = file => {
+      const w = new ringbuffer.RingWriter(file.fileno(), { capacity, policy });
+      writers.push(w);
+      return w;
+    };
+
+    if(typeof out == 'object' && out != null && typeof out.fileno == 'function') out = writer(out);
+    else if(typeof out != 'function') out = undefined;
+
+    writers.stdout = out ?? writer(std.out);
+    writers.stderr = out ?? writer(std.err);
+  }
+
+  const printFunction = out =>
+    typeof out == 'function'
+      ? out
+      : typeof out.puts != 'function'
+      ? text => out.write(text)
+      : typeof out.flush == 'function'
+      ? text => (out.puts(text), out.flush())
+      : text => out.puts(text);
 
   const outputFunction = out => {
     const print = printFunction(out);
@@ -111,6 +139,14 @@ export function Console(...args) {
     };
 
   newcons.options = options;
+
+  /* waits until buffered output has been written, call it before exit() */
+  newcons.flush = (timeout = -1) => {
+    if(writers.length) return writers.every(w => w.flush(timeout));
+    std.out.flush();
+    std.err.flush();
+    return true;
+  };
   //globalThis.console = newcons;
 
   return addMissingMethods(newcons);
@@ -119,11 +155,11 @@ export function Console(...args) {
     let fns = {};
 
     for(let [method, output] of [
-      ['log', out || std.out],
-      ['info', out || std.out],
-      ['error', out || std.err],
-      ['warn', out || std.err],
-      ['debug', out || std.out]
+      ['log', out || writers.stdout || std.out],
+      ['info', out || writers.stdout || std.out],
+      ['error', out || writers.stderr || std.err],
+      ['warn', out || writers.stderr || std.err],
+      ['debug', out || writers.stdout || std.out]
     ]) {
       if(cons[method] === undefined) fns[method] = logFunction(outputFunction(output));
     }
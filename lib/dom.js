@@ -3,7 +3,7 @@ import { extend, arrayFacade, assert, camelize, decamelize, define, getset, gett
 import { parseSelectors } from './css3-selectors.js';
 import { get, iterate, RETURN_PATH } from 'deep';
 import { TreeWalker } from 'tree_walker';
-import { read as readXML, write as writeXML } from 'xml';
+import { index as indexXML, read as readXML, write as writeXML } from 'xml';
 
 const inspectSymbol = Symbol.for('quickjs.inspect.custom');
 
@@ -87,6 +87,43 @@ function* query(root, selectors, t = (path, root) => path) {
   for(let selector of selectors) for (let path of iterate(root, selector, RETURN_PATH)) yield t(path, root);
 }
 
+function* applyPaths(paths, obj) {
+  for(let path of paths) yield applyPath(path, obj);
+}
+
+/*
+ * Tag, id and class tables from xml.index(), per raw node. Any mutation
+ * through the DOM layer bumps the generation, so a table is rebuilt on
+ * the next lookup after a change.
+ */
+const indexes = new WeakMap();
+let generation = 0;
+
+const invalidateIndexes = () => generation++;
+
+function nodeIndex(node) {
+  const raw = Node.raw(node);
+  let entry = indexes.get(raw);
+
+  if(!entry || entry.generation != generation) indexes.set(raw, (entry = { generation, ...indexXML(raw) }));
+
+  return entry;
+}
+
+/* 'tag', '.class' and (for the first match only) '#id' are answered from nodeIndex() */
+function indexedQuery(node, selectors, first) {
+  let match;
+
+  if(selectors.length != 1 || !isString(selectors[0]) || !(match = /^([#.]?)([-\w:]+)$/.exec(selectors[0].trim()))) return;
+
+  const [, prefix, name] = match;
+  const { tags, ids, classes } = nodeIndex(node);
+
+  if(prefix == '#') return first ? (ids[name] ? [ids[name]] : []) : undefined;
+
+  return (prefix == '.' ? classes : tags)[name] ?? [];
+}
+
 export const nodeTypes = [
   undefined,
   'ELEMENT_NODE',
@@ -344,6 +381,8 @@ export class Interface {
   appendChild(node) {
     const { children } = Node.raw(this);
 
+    invalidateIndexes();
+
     if(node instanceof Text) {
       const k = children.length;
 
@@ -369,6 +408,8 @@ export class Interface {
   insertBefore(node, ref) {
     const { children } = Node.raw(this);
 
+    invalidateIndexes();
+
     const old = isObject(node) && node instanceof Node ? Node.raw(node) : node,
       before = isObject(ref) && ref instanceof Node ? Node.raw(ref) : ref;
 
@@ -383,6 +424,8 @@ export class Interface {
   removeChild(node) {
     const { children } = Node.raw(this);
 
+    invalidateIndexes();
+
     const old = isObject(node) && node instanceof Node ? Node.raw(node) : node;
 
     const index = children.indexOf(old);
@@ -396,6 +439,8 @@ export class Interface {
   replaceChild(newChild, oldChild) {
     const { children } = Node.raw(this);
 
+    invalidateIndexes();
+
     const old = isObject(oldChild) && oldChild instanceof Node ? Node.raw(oldChild) : oldChild,
       replacement = isObject(newChild) && newChild instanceof Node ? Node.raw(newChild) : newChild;
 
@@ -407,7 +452,30 @@ export class Interface {
     return newChild;
   }
 
+  getElementsByTagName(name) {
+    if(name == '*') return [...this.querySelectorAll('*')];
+
+    return (nodeIndex(this).tags[name] ?? []).map(path => applyPath(path, this));
+  }
+
+  getElementsByClassName(names) {
+    const [first, ...rest] = (names + '').trim().split(/\s+/g);
+    const { classes } = nodeIndex(this);
+    let paths = classes[first] ?? [];
+
+    for(let name of rest) {
+      const other = new Set((classes[name] ?? []).map(path => path + ''));
+      paths = paths.filter(path => other.has(path + ''));
+    }
+
+    return paths.map(path => applyPath(path, this));
+  }
+
   querySelector(...selectors) {
+    const indexed = indexedQuery(this, selectors, true);
+
+    if(indexed) return indexed.length ? applyPath(indexed[0], this) : undefined;
+
     if(isString(selectors[0])) selectors = [...parseSelectors(...selectors)];
 
     const gen = query(Node.raw(this), selectors);
@@ -417,6 +485,10 @@ export class Interface {
   }
 
   querySelectorAll(...selectors) {
+    const indexed = indexedQuery(this, selectors, false);
+
+    if(indexed) return applyPaths(indexed, this);
+
     if(isString(selectors[0])) selectors = [...parseSelectors(...selectors)];
 
     return query(Node.raw(this), selectors, p => applyPath(p, this));
@@ -843,6 +915,7 @@ export class Element extends Node {
   }
 
   set tagName(value) {
+    invalidateIndexes();
     Node.raw(this).tagName = value;
   }
 
@@ -933,6 +1006,7 @@ export class Element extends Node {
   }
 
   removeAttribute(name) {
+    invalidateIndexes();
     Element.attributes(this)(attributes => delete attributes[name]);
   }
 
@@ -945,6 +1019,7 @@ export class Element extends Node {
 
     value = value + '';
 
+    invalidateIndexes();
     Element.attributes(this)(attributes => (attributes[name] = value));
   }
 
@@ -1139,6 +1214,12 @@ export class Document extends Element {
     return new Text(text);
   }
 
+  getElementById(id) {
+    const path = nodeIndex(this).ids[id];
+
+    return path ? applyPath(path, this) : null;
+  }
+
   createTreeWalker(root, whatToShow = TreeWalker.TYPE_ALL, filter = { acceptNode: node => TreeWalker.FILTER_ACCEPT }, expandEntityReferences = false) {
     const raw = Node.raw(root);
 
@@ -1345,7 +1426,7 @@ export class TokenList {
     const { attributes } = Node.raw(owner);
 
     const get = () => attributes[key] ?? '';
-    const set = value => (attributes[key] = value);
+    const set = value => (invalidateIndexes(), (attributes[key] = value));
 
     Tokens(
       this,
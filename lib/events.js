@@ -1,60 +1,6 @@
-const indexOf = (haystack, needle) => Array.prototype.indexOf.call(haystack, needle);
+import { EventEmitter } from 'emitter';
 
-const getHandlers = (
-  (map = new WeakMap()) =>
-  obj => (map.has(obj) || map.set(obj, {}), map.get(obj))
-)();
-
-export class EventEmitter {
-  on(event, listener) {
-    const events = getHandlers(this);
-    if(!Array.isArray(events[event])) events[event] = [];
-    events[event].push(listener);
-  }
-
-  removeListener(event, listener) {
-    const events = getHandlers(this);
-
-    if(Array.isArray(events[event])) {
-      const idx = indexOf(events[event], listener);
-      if(idx > -1) {
-        events[event].splice(idx, 1);
-        if(events[event].length == 0) delete events[event];
-      }
-    }
-  }
-
-  removeAllListeners(event) {
-    const events = getHandlers(this);
-
-    if(event) {
-      if(Array.isArray(events[event])) delete events[event];
-    } else {
-      for(let key in events) delete events[key];
-    }
-  }
-
-  rawListeners(event) {
-    const events = getHandlers(this);
-    if(Array.isArray(events[event])) return [...events[event]];
-  }
-
-  emit(event, ...args) {
-    const events = getHandlers(this);
-    if(Array.isArray(events[event])) for(let handler of events[event]) handler.apply(this, args);
-  }
-
-  once(event, listener) {
-    const callback = (...args) => {
-      this.removeListener(event, callback);
-      listener.apply(this, args);
-    };
-    callback.listener = listener;
-    this.on(event, callback);
-  }
-}
-
-EventEmitter.prototype[Symbol.toStringTag] = 'EventEmitter';
+export { EventEmitter };
 
 const PRIVATE = Symbol('EventTarget');
 
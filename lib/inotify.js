@@ -1,4 +1,6 @@
+import * as os from 'os';
 import { close, read, setReadHandler } from 'os';
+import { cacheClear, cacheInvalidate } from 'path';
 import { define, error, watch } from 'util';
 import { IN_ACCESS, IN_ALL_EVENTS, IN_ATTRIB, IN_CLOSE, IN_CLOSE_NOWRITE, IN_CLOSE_WRITE, IN_CREATE, IN_DELETE, IN_DELETE_SELF, IN_DONT_FOLLOW, IN_EXCL_UNLINK, IN_IGNORED, IN_ISDIR, IN_MASK_ADD, IN_MODIFY, IN_MOVE, IN_MOVE_SELF, IN_MOVED_FROM, IN_MOVED_TO, IN_NONBLOCK, IN_ONESHOT, IN_ONLYDIR, IN_OPEN, IN_Q_OVERFLOW, IN_UNMOUNT, inotify_event_size } from 'misc';
 
@@ -124,4 +126,20 @@ export class inotify {
   onerror(errno) {}
 }
 
+/* Keeps the path cache (path.cacheEnable()) coherent with changes below the given directories */
+export function watchPathCache(dirs, mask = IN_CREATE | IN_DELETE | IN_MOVE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF) {
+  const ino = new inotify();
+
+  for(let dir of Array.isArray(dirs) ? dirs : [dirs]) ino.add(dir, mask);
+
+  ino.onread = ({ wd, mask, name }) => {
+    const w = ino.watch(wd);
+
+    if(mask & IN_Q_OVERFLOW || !w) cacheClear();
+    else cacheInvalidate(name ? w.pathname + '/' + name : w.pathname);
+  };
+
+  return ino;
+}
+
 export default inotify;
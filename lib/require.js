@@ -8,6 +8,11 @@ let modules = {};
 let paths = [];
 let required = [];
 
+// stat() results (negative ones too), package.json contents and lookupModule() results
+const statCache = new Map();
+const packageCache = new Map();
+const lookupCache = new Map();
+
 let getPackagePaths;
 
 let debug = arg => puts(arg + '\n');
@@ -172,8 +177,11 @@ class ESModule extends Module {
 define(ESModule.prototype, { [Symbol.toStringTag]: 'ESModule' });
 
 function statPath(path) {
+  let ret = statCache.get(path);
+  if(ret) return ret;
+
   const [fstat, err] = stat(path);
-  let ret = {
+  ret = {
     errno: err,
     isFile: fstat && fstat.mode & S_IFREG && true,
     isDir: fstat && fstat.mode & S_IFDIR && true
@@ -181,6 +189,7 @@ function statPath(path) {
 
   // if(!err) debug(`statPath('${path}') ${err ? '-1' : ret.isFile ? 'file' : ret.isDir ? 'dir' : ''}`);
 
+  statCache.set(path, ret);
   return ret;
 }
 
@@ -407,7 +416,8 @@ function lookupModule(m) {
   // Try with package.json for NPM or YARN modules
   if(statPath(`${m}/package.json`).isFile) {
     debug(`lookupModule# ${m}/package.json exists, looking for main script...`);
-    let pkg = JSON.parse(loadFile(`${m}/package.json`));
+    let pkg = packageCache.get(m);
+    if(pkg === undefined) packageCache.set(m, (pkg = JSON.parse(loadFile(`${m}/package.json`))));
     if(pkg && Object.keys(pkg).indexOf('main') !== -1 && pkg.main !== '' && statPath(`${m}/${pkg.main}`).isFile) {
       tryOthers = false;
       modulePath = `${m}/${pkg.main}`;
@@ -483,7 +493,8 @@ export function require(m) {
     if(pkg) m = pkg;
   }
 
-  let _path = lookupModule(m);
+  let _path = lookupCache.get(m);
+  if(_path === undefined) lookupCache.set(m, (_path = lookupModule(m)));
 
   // Module not found
   if(_path instanceof Error) {
@@ -518,7 +529,14 @@ require.main = Object.defineProperties(
   }
 );
 
-Object.defineProperties(require, { cache: { value: modules } });
+function clearResolveCache() {
+  statCache.clear();
+  packageCache.clear();
+  lookupCache.clear();
+  globalThis.clearResolveCache?.();
+}
+
+Object.defineProperties(require, { cache: { value: modules }, clearResolveCache: { value: clearResolveCache } });
 
 globalThis.require = require;
 
@@ -2,7 +2,7 @@ import * as fs from 'fs';
 import { ReadableStream, TransformStream, WritableStream } from 'stream';
 import { define, error, F_GETFL, F_SETFL, fcntl, O_NONBLOCK, quote, toString } from 'util';
 import * as std from 'std';
-import { TextDecoder, TextEncoder } from 'textcode';
+export { TextDecoderStream, TextEncoderStream } from 'textcode';
 
 export function FileSystemReadableStream(file, bufSize = 1024 * 64) {
   let err = {},
@@ -207,50 +207,3 @@ export function FileSystemWritableFileStream(path) {
     }
   });
 }
-
-export class TextEncoderStream extends TransformStream {
-  constructor(encoding) {
-    let enc;
-    super({
-      start(ctl) {
-        //console.log('TextEncoderStream.start', { ctl });
-      },
-      transform(chunk, ctl) {
-        console.log('TextEncoderStream.transform', quote(chunk, "'"), ctl);
-        enc ??= new TextEncoder(encoding ?? 'utf-8');
-        let buf = enc.encode(chunk);
-        //console.log('TextEncoderStream.transform', { buf, ctl });
-        if(!buf) return ctl.error();
-
-        return ctl.enqueue(buf.buffer);
-      },
-      flush() {
-        //console.log('TextEncoderStream.flush', { enc });
-        enc = null;
-      }
-    });
-  }
-}
-
-export class TextDecoderStream extends TransformStream {
-  constructor(encoding) {
-    let dec;
-    super({
-      start(ctl) {
-        dec = new TextDecoder(encoding ?? 'utf-8');
-      },
-      transform(chunk, ctl) {
-        let str;
-
-        if(!(str = dec.decode(chunk))) return ctl.error();
-
-        console.log('TextDecoderStream.transform', { chunk, str });
-
-        return ctl.enqueue(str);
-      },
-      flush() {
-        dec = null;
-      }
-    });
-  }
-}
@@ -16,13 +16,52 @@ function contains(dir, entry, res = true) {
   return length(entry) > len && dir == slice(entry, 0, len);
 }
 
+function components(path) {
+  return path.split('/').filter(c => c != '' && c != '.');
+}
+
+/* maps path prefixes to values, one trie node per path component */
+export class PathTrie {
+  #root = { children: new Map() };
+
+  set(path, value) {
+    let node = this.#root;
+
+    for(let c of components(path)) {
+      let child = node.children.get(c);
+      if(!child) node.children.set(c, (child = { children: new Map() }));
+      node = child;
+    }
+
+    node.value = value;
+  }
+
+  /* values stored at path and at its ancestors, outermost first */
+  match(path) {
+    const values = [];
+    let node = this.#root;
+
+    if('value' in node) values.push(node.value);
+
+    for(let c of components(path)) {
+      if(!(node = node.children.get(c))) break;
+      if('value' in node) values.push(node.value);
+    }
+
+    return values;
+  }
+}
+
 export class UnionFS {
   #paths = [];
   #impl = [];
+  #roots = new PathTrie();
+  #resolved = new Map();
 
   appendPath(p, impl = fs) {
     if(ArrayExtensions.pushUnique.call(this.#paths, resolve(p))) {
       this.#impl.push(impl);
+      this.#update();
       return true;
     }
   }
@@ -30,6 +69,7 @@ export class UnionFS {
   prependPath(p, impl = fs) {
     if(ArrayExtensions.unshiftUnique.call(this.#paths, resolve(p))) {
       this.#impl.unshift(impl);
+      this.#update();
       return true;
     }
   }
@@ -42,9 +82,27 @@ export class UnionFS {
       [fs] = this.#impl.splice(i, i + 1);
     }
 
+    this.#update();
     return [dir, fs];
   }
 
+  #update() {
+    this.#roots = new PathTrie();
+    this.#paths.forEach((p, i) => this.#roots.set(p, i));
+
+    for(let i = 0; i < this.#paths.length; i++) if(this.#impl[i] instanceof ArchiveFS) this.#impl[i].root ??= this.#paths[i];
+
+    this.clearCache();
+  }
+
+  /**
+   * Relative paths are resolved once and cached until the union changes
+   * through its own methods. Call this after changing a layer directly.
+   */
+  clearCache() {
+    this.#resolved.clear();
+  }
+
   hasPath(p) {
     return ArrayPrototype.indexOf.call(this.#paths, resolve(p)) != -1;
   }
@@ -52,15 +110,17 @@ export class UnionFS {
   #basePath(path, mustExist = false, doThrow = false) {
     if(path == '.') return this.#paths[0] ?? path;
     if(isAbsolute(path)) {
-      let i = 0;
-      for(let p of this.#paths) {
-        if(contains(p, path)) return mustExist && !this.#impl[i].existsSync(path) ? null : resolve(path);
-        ++i;
-      }
+      const i = this.#baseIndex(path);
+      if(i != -1) return mustExist && !this.#impl[i].existsSync(path) ? null : resolve(path);
     } else {
-      let i = 0;
+      let i = 0,
+        found = this.#resolved.get(path);
+      if(found) return found;
       for(let p of this.#paths) {
-        if(this.#impl[i].existsSync(join(p, path))) return resolve(join(p, path));
+        if(this.#impl[i].existsSync(join(p, path))) {
+          this.#resolved.set(path, (found = resolve(join(p, path))));
+          return found;
+        }
         ++i;
       }
       let p2 = resolve(path);
@@ -71,15 +131,11 @@ export class UnionFS {
     return null;
   }
 
+  /* the first layer whose root is path or one of its ancestors */
   #baseIndex(path) {
-    let i = 0;
     if(isRelative(path)) path = absolute(path);
-    for(let p of this.#paths) {
-      if(contains(p, path)) break;
-      ++i;
-    }
-    if(i >= this.#paths.length) i = -1;
-    return i;
+    const found = this.#roots.match(resolve(path));
+    return found.length ? Math.min(...found) : -1;
   }
 
   #baseImpl(path) {
@@ -107,11 +163,13 @@ export class UnionFS {
   }
 
   mkdirSync(p, mode = 0x1ed) {
+    this.clearCache();
     const path = this.#basePath(p);
     return this.#baseImpl(path).mkdirSync(path, mode);
   }
 
   mkstempSync(p) {
+    this.clearCache();
     const path = this.#basePath(p);
     return this.#baseImpl(path).mkstempSync(path);
   }
@@ -156,6 +214,7 @@ export class UnionFS {
   }
 
   renameSync(p, ...args) {
+    this.clearCache();
     const path = this.#basePath(p, true, true);
     return this.#baseImpl(path).renameSync(path, ...args);
   }
@@ -166,6 +225,7 @@ export class UnionFS {
   }
 
   symlinkSync(p, ...args) {
+    this.clearCache();
     const path = this.#basePath(p, true, true);
     return this.#baseImpl(path).symlinkSync(path, ...args);
   }
@@ -176,11 +236,13 @@ export class UnionFS {
   }
 
   unlinkSync(p) {
+    this.clearCache();
     const path = this.#basePath(p, true, true);
     return this.#baseImpl(path).unlinkSync(path);
   }
 
   writeFileSync(p, ...args) {
+    this.clearCache();
     const path = this.#basePath(p, false, true);
     return this.#baseImpl(path).writeFileSync(path, ...args);
   }
@@ -210,14 +272,44 @@ define(
   })
 );
 
+const S_IFMT = 0o170000,
+  S_IFDIR = 0o040000,
+  S_IFREG = 0o100000,
+  S_IFLNK = 0o120000;
+
+class ArchiveStat {
+  constructor({ size, mode, mtime }) {
+    this.size = size;
+    this.mode = mode;
+    if(mtime != null) this.mtime = new Date(mtime * 1000);
+  }
+
+  isFile() {
+    return (this.mode & S_IFMT) == S_IFREG;
+  }
+
+  isDirectory() {
+    return (this.mode & S_IFMT) == S_IFDIR;
+  }
+
+  isSymbolicLink() {
+    return (this.mode & S_IFMT) == S_IFLNK;
+  }
+}
+
 export class ArchiveFS {
   #archive = null;
   #mode = undefined;
+  #reader = null;
+  #tree = null;
+
+  /* absolute paths below root address the archive members */
+  root = undefined;
 
   constructor(ar, rw) {
     if(typeof ar == 'string') {
       this.#archive = rw ? Archive.write(ar) : ar;
-      this.#mode = rw;
+      this.#mode = rw || Archive.READ;
     } else {
       const { file, mode } = ar;
 
@@ -230,47 +322,83 @@ export class ArchiveFS {
     if(typeof this.#archive == 'object') return this.#archive;
   }
 
-  readdirSync(dir) {
+  /* the headers are read once, the directory tree is built from the index */
+  #entries() {
+    if(this.#tree) return this.#tree;
     if(this.#mode != Archive.READ) throw new Error(`archive is not in read mode`);
 
-    const a = [],
-      instance = new Archive();
+    this.#reader ??= typeof this.#archive == 'string' ? Archive.read(this.#archive) : this.#archive;
+
+    const tree = { size: 0, mode: S_IFDIR | 0o755, children: new Map() },
+      { entries } = this.#reader.index();
+
+    for(let pathname in entries) {
+      const [offset, size, mode, mtime] = entries[pathname];
+      let node = tree;
+
+      for(let c of components(pathname)) {
+        let child = node.children.get(c);
+        if(!child) node.children.set(c, (child = { size: 0, mode: S_IFDIR | 0o755, children: new Map() }));
+        node = child;
+      }
+
+      if(node != tree) Object.assign(node, { pathname, offset, size, mode, mtime });
+    }
+
+    return (this.#tree = tree);
+  }
+
+  #lookup(path) {
+    let node = this.#entries();
+
+    if(this.root && isAbsolute(path)) {
+      const r = resolve(this.root),
+        a = resolve(path);
+
+      if(a == r) path = '';
+      else if(a.startsWith(r + '/')) path = a.slice(r.length + 1);
+    }
 
-    for(let entry of instance.open(this.#archive)) if(contains(dir, entry.pathname)) a.push(entry.pathname);
+    for(let c of components(path)) if(!(node = node.children.get(c))) return null;
 
-    return a;
+    return node;
   }
 
-  #find(path) {
-    const instance = new Archive().open(this.#archive);
-    let entry;
+  /* seeks to the entry's header through the index */
+  #open(path) {
+    const node = this.#lookup(path);
+
+    if(node && node.pathname && (node.mode & S_IFMT) != S_IFDIR) {
+      const entry = this.#reader.openEntry(node.pathname);
+      if(entry) return [entry.archive, entry];
+    }
 
-    while((entry = instance.next())) if(entry.pathname == path) return [instance, entry];
     return [,];
   }
 
+  readdirSync(dir) {
+    const node = this.#lookup(dir);
+
+    if(!node || (node.mode & S_IFMT) != S_IFDIR) throw new Error(`'${dir}' is not a directory in the archive`);
+
+    return [...node.children.keys()];
+  }
+
   existsSync(path) {
-    const [ar, ent] = this.#find(path);
-    ar?.close();
-    return !!ent;
+    return !!this.#lookup(path);
   }
 
   sizeSync(path) {
-    const [ar, ent] = this.#find(path);
-    ar?.close();
-    return ent?.size;
+    return this.#lookup(path)?.size;
   }
 
   statSync(path) {
-    const [ar, ent] = this.#find(path);
-    ar?.close();
-    return ent;
+    const node = this.#lookup(path);
+    if(node) return new ArchiveStat(node);
   }
 
   lstatSync(path) {
-    const [ar, ent] = this.#find(path);
-    ar?.close();
-    return ent;
+    return this.statSync(path);
   }
 
   readFileSync(path, options = {}) {
@@ -278,10 +406,10 @@ export class ArchiveFS {
 
     let b;
     options = typeof options == 'string' ? { encoding: options } : options;
-    const [ar, entry] = this.#find(path);
+    const [ar, entry] = this.#open(path);
 
     if(entry) {
-      const { size, pathname } = entry;
+      const { size } = entry;
       b = new ArrayBuffer(size);
       let r = ar.read(b);
       if(options.encoding == 'utf-8') b = toString(b, 0, r);
@@ -313,14 +441,15 @@ export class ArchiveFS {
         [Symbol.toStringTag]: 'WriteStream'
       };
     } else {
-      const [ar, entry] = this.#find(path);
+      const [ar, entry] = this.#open(path);
 
       if(entry) {
         const { size } = entry;
+        let r;
 
         obj = {
           read: (b, ofs, len) => {
-            const r = ar.read(b, ofs ?? 0, len ?? b.byteLength);
+            r = ar.read(b, ofs ?? 0, len ?? b.byteLength);
             if(r > 0) pos += r;
             return r;
           },
@@ -2,10 +2,27 @@
 #include <archive.h>
 #include <archive_entry.h>
 #include "quickjs-archive.h"
+#include "quickjs-stream.h"
 #include "utils.h"
 #include "buffer-utils.h"
+#include "js-utils.h"
 #include "debug.h"
 
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#include <limits.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
 /**
  * \addtogroup quickjs-archive
  * @{
@@ -150,6 +167,11 @@ js_archive_free_buffer(JSRuntime* rt, void* opaque, void* ptr) {
   js_free_rt(rt, ainst);
 }
 
+static void
+js_archive_free_buffer_rt(JSRuntime* rt, void* opaque, void* ptr) {
+  js_free_rt(rt, ptr);
+}
+
 static void
 js_archive_progress_callback(void* opaque) {
   ArchiveEntryRef* aeref = opaque;
@@ -207,7 +229,7 @@ js_archive_functions(JSContext* ctx, JSValueConst this_val, int argc, JSValueCon
         JS_ToUint32(ctx, &block_size, argv[1]);
 
       wchar_t* filename = js_towstring(ctx, argv[0]);
-      int r = (ar, filename, block_size);
+      int r = archive_read_open_filename_w(ar, filename, block_size);
       js_free(ctx, filename);
 
       if(r != ARCHIVE_OK) {
@@ -658,6 +680,185 @@ js_archive_write(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst a
   return ret;
 }
 
+/* writes len bytes of entry data, returns the count written or -1 */
+static int64_t
+archive_write_all(struct archive* ar, const uint8_t* buf, size_t len) {
+  int64_t bytes = 0;
+  la_ssize_t r;
+
+  while(len > 0) {
+    if((r = archive_write_data(ar, buf, MIN_NUM(len, 1 << 20))) <= 0)
+      return r < 0 ? -1 : bytes;
+
+    buf += r;
+    len -= r;
+    bytes += r;
+  }
+
+  return bytes;
+}
+
+/**
+ * Copies at most size bytes from offset 0 of fd in bounded blocks, so a file
+ * that shrinks after fstat() just ends the entry early.
+ */
+static int64_t
+archive_write_fd(struct archive* ar, int fd, int64_t size) {
+  int64_t bytes = 0, r;
+  uint8_t* buf;
+  ssize_t n = 0;
+
+  if(!(buf = malloc(1 << 20)))
+    return -1;
+
+#ifdef _WIN32
+  if(lseek(fd, 0, SEEK_SET) == -1) {
+    free(buf);
+    return -1;
+  }
+#endif
+
+  while(bytes < size) {
+#ifdef _WIN32
+    n = read(fd, buf, MIN_NUM(size - bytes, 1 << 20));
+#else
+    n = pread(fd, buf, MIN_NUM(size - bytes, 1 << 20), bytes);
+#endif
+
+    if(n == -1 && errno == EINTR)
+      continue;
+
+    if(n <= 0)
+      break;
+
+    if((r = archive_write_all(ar, buf, n)) != n) {
+      n = -1;
+      break;
+    }
+
+    bytes += r;
+  }
+
+  free(buf);
+
+  return n == -1 ? -1 : bytes;
+}
+
+/**
+ * addFile(path | fd, entryOptions): fills an ArchiveEntry from stat() of
+ * the file and the entryOptions (pathname is required for an fd), writes
+ * the header and copies the contents natively. Returns the number of data bytes written.
+ */
+static JSValue
+js_archive_addfile(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  struct archive* ar;
+  struct archive_entry* ent;
+  struct stat st;
+  JSValue entry, ret;
+  const char* path = 0;
+  int fd = -1;
+  BOOL own_fd = FALSE;
+  int64_t bytes = 0;
+
+  if(!(ar = js_archive_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(js_archive_mode(ctx, this_val) != WRITE)
+    return JS_ThrowInternalError(ctx, "archive not in write mode");
+
+  if(JS_IsNumber(argv[0])) {
+    JS_ToInt32(ctx, &fd, argv[0]);
+
+    if(fstat(fd, &st) == -1)
+      return JS_ThrowInternalError(ctx, "fstat(%d) failed: %s", fd, strerror(errno));
+
+    if(!(argc > 1 && js_has_propertystr(ctx, argv[1], "pathname")))
+      return JS_ThrowTypeError(ctx, "addFile(fd) needs a pathname in entryOptions");
+  } else {
+    if(!(path = JS_ToCString(ctx, argv[0])))
+      return JS_EXCEPTION;
+
+#ifdef _WIN32
+    if(stat(path, &st) == -1) {
+#else
+    if(lstat(path, &st) == -1) {
+#endif
+      ret = JS_ThrowInternalError(ctx, "stat('%s') failed: %s", path, strerror(errno));
+      JS_FreeCString(ctx, path);
+      return ret;
+    }
+  }
+
+  if(!(ent = archive_entry_new())) {
+    JS_FreeCString(ctx, path);
+    return JS_ThrowOutOfMemory(ctx);
+  }
+
+  archive_entry_copy_stat(ent, &st);
+
+  if(path) {
+    const char* p = path;
+
+    while(*p == '/')
+      p++;
+
+    archive_entry_set_pathname_utf8(ent, p);
+
+#ifndef _WIN32
+    if(S_ISLNK(st.st_mode)) {
+      char target[PATH_MAX];
+      ssize_t n;
+
+      if((n = readlink(path, target, sizeof(target) - 1)) >= 0) {
+        target[n] = '\0';
+        archive_entry_set_symlink_utf8(ent, target);
+      }
+    }
+#endif
+  }
+
+  entry = js_archiveentry_wrap(ctx, entry_proto, ent);
+
+  if(argc > 1 && JS_IsObject(argv[1]))
+    js_object_copy(ctx, entry, argv[1]);
+
+  if(js_has_propertystr(ctx, this_val, "entry")) {
+    js_delete_propertystr(ctx, this_val, "entry");
+    archive_write_finish_entry(ar);
+  }
+
+  if(archive_write_header(ar, ent) < ARCHIVE_WARN) {
+    ret = JS_ThrowInternalError(ctx, "libarchive error: %s", archive_error_string(ar));
+    goto end;
+  }
+
+  if(S_ISREG(st.st_mode) && archive_entry_size(ent) > 0) {
+    if(fd == -1) {
+      if((fd = open(path, O_RDONLY | O_BINARY)) == -1) {
+        ret = JS_ThrowInternalError(ctx, "open('%s') failed: %s", path, strerror(errno));
+        goto end;
+      }
+
+      own_fd = TRUE;
+    }
+
+    bytes = archive_write_fd(ar, fd, archive_entry_size(ent));
+
+    if(own_fd)
+      close(fd);
+  }
+
+  if(bytes < 0 || archive_write_finish_entry(ar) < ARCHIVE_WARN)
+    ret = JS_ThrowInternalError(ctx, "libarchive error: %s", archive_error_string(ar) ? archive_error_string(ar) : strerror(errno));
+  else
+    ret = JS_NewInt64(ctx, bytes);
+
+end:
+  JS_FreeCString(ctx, path);
+  JS_FreeValue(ctx, entry);
+  return ret;
+}
+
 static JSValue
 js_archive_skip(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
   struct archive* ar;
@@ -811,6 +1012,7 @@ js_archive_next(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst ar
 
     default: {
       ret = js_archiveentry_wrap(ctx, entry_proto, ent);
+      JS_DefinePropertyValueStr(ctx, ret, "archive", JS_DupValue(ctx, this_val), JS_PROP_CONFIGURABLE);
       JS_DefinePropertyValueStr(ctx, this_val, "entry", JS_DupValue(ctx, ret), JS_PROP_CONFIGURABLE);
       break;
     }
@@ -876,130 +1078,1022 @@ js_archive_iterator_next(JSContext* ctx, JSValueConst iter, int argc, JSValueCon
 
   *pdone = FALSE;
 
-  return js_archiveentry_wrap(ctx, entry_proto, ent);
+  JSValue ret = js_archiveentry_wrap(ctx, entry_proto, ent);
+  JS_DefinePropertyValueStr(ctx, ret, "archive", this_val, JS_PROP_CONFIGURABLE);
+  JS_DefinePropertyValueStr(ctx, this_val, "entry", JS_DupValue(ctx, ret), JS_PROP_CONFIGURABLE);
+
+  return ret;
 }
 
-static void
-js_archive_finalizer(JSRuntime* rt, JSValue val) {
+typedef struct {
+  int fd;
+  size_t block_size;
+  uint8_t buf[];
+} ArchiveFile;
+
+static la_ssize_t
+archive_file_read(struct archive* ar, void* client_data, const void** buffer) {
+  ArchiveFile* af = client_data;
+  ssize_t r;
+
+  *buffer = af->buf;
+
+  while((r = read(af->fd, af->buf, af->block_size)) == -1 && errno == EINTR) {}
+
+  if(r == -1)
+    archive_set_error(ar, errno, "read failed");
+
+  return r;
+}
+
+static int
+archive_file_close(struct archive* ar, void* client_data) {
+  ArchiveFile* af = client_data;
+
+  close(af->fd);
+  free(af);
+
+  return ARCHIVE_OK;
+}
+
+/**
+ * Opens a new reader on the source of archive obj ("file" or "buffer"),
+ * starting offset bytes into it. Readers started at a header offset only
+ * work for formats whose headers are self-contained (tar, cpio, ar, and
+ * zip local headers), callers check the first header they get.
+ */
+static struct archive*
+archive_open_at(JSContext* ctx, JSValueConst obj, int64_t offset, BOOL streamable) {
   struct archive* ar;
+  JSValue source;
+  int r = ARCHIVE_FATAL;
 
-  if((ar = js_archive_data(val)))
-    archive_free(ar);
+  if(!(ar = archive_read_new())) {
+    JS_ThrowOutOfMemory(ctx);
+    return 0;
+  }
+
+  /* the seekable zip reader starts from the central directory */
+  if(streamable) {
+    archive_read_support_format_tar(ar);
+    archive_read_support_format_cpio(ar);
+    archive_read_support_format_ar(ar);
+    archive_read_support_format_zip_streamable(ar);
+  } else {
+    archive_read_support_format_all(ar);
+  }
+
+  archive_read_support_filter_all(ar);
+
+  source = JS_GetPropertyStr(ctx, obj, "file");
+
+  if(JS_IsString(source)) {
+    const char* filename = JS_ToCString(ctx, source);
+    ArchiveFile* af;
+    int fd = open(filename, O_RDONLY | O_BINARY);
+
+    JS_FreeCString(ctx, filename);
+
+    if(fd == -1 || lseek(fd, offset, SEEK_SET) != offset || !(af = malloc(sizeof(ArchiveFile) + 65536))) {
+      if(fd != -1)
+        close(fd);
+
+      JS_ThrowInternalError(ctx, "failed opening archive: %s", strerror(errno));
+      JS_FreeValue(ctx, source);
+      archive_read_free(ar);
+      return 0;
+    }
+
+    af->fd = fd;
+    af->block_size = 65536;
+
+    r = archive_read_open(ar, af, 0, archive_file_read, archive_file_close);
+  } else {
+    uint8_t* data;
+    size_t length;
+
+    JS_FreeValue(ctx, source);
+    source = JS_GetPropertyStr(ctx, obj, "buffer");
+
+    if((data = JS_GetArrayBuffer(ctx, &length, source)) && offset <= (int64_t)length)
+      r = archive_read_open_memory(ar, data + offset, length - offset);
+    else
+      JS_FreeValue(ctx, JS_GetException(ctx));
+  }
+
+  JS_FreeValue(ctx, source);
+
+  if(r != ARCHIVE_OK) {
+    JS_ThrowInternalError(ctx, "libarchive error: %s", archive_error_string(ar) ? archive_error_string(ar) : "archive has no file or buffer");
+    archive_read_free(ar);
+    return 0;
+  }
+
+  return ar;
 }
 
-static JSClassDef js_archive_class = {
-    .class_name = "Archive",
-    .finalizer = js_archive_finalizer,
-};
+/**
+ * index([persisted]): reads all headers once through a separate reader
+ * and returns { format, seekable, entries: { pathname: [offset, size,
+ * mode, mtime] } }, a plain object that survives JSON.stringify(). mtime
+ * is in seconds, or null. Passing a persisted index adopts it instead.
+ * The result is kept for openEntry().
+ */
+static JSValue
+js_archive_index(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  struct archive* ar;
+  struct archive_entry* ent;
+  JSValue ret, entries;
+  const char* format;
+  int r;
 
-static const JSCFunctionListEntry js_archive_funcs[] = {
-    JS_CGETSET_MAGIC_DEF("errno", js_archive_get, 0, PROP_ERRNO),
-    JS_CGETSET_MAGIC_DEF("error", js_archive_get, 0, PROP_ERROR_STRING),
-    JS_CGETSET_MAGIC_DEF("format", js_archive_get, js_archive_set, PROP_FORMAT),
-    JS_CGETSET_MAGIC_DEF("compression", js_archive_get, 0, PROP_COMPRESSION),
-    JS_CGETSET_MAGIC_DEF("filters", js_archive_get, 0, PROP_FILTERS),
-    JS_CGETSET_MAGIC_DEF("position", js_archive_get, 0, PROP_POSITION),
-    JS_CGETSET_MAGIC_DEF("readHeaderPosition", js_archive_get, 0, PROP_READ_HEADER_POSITION),
-    JS_CGETSET_MAGIC_DEF("hasEncryptedEntries", js_archive_get, 0, PROP_HAS_ENCRYPTED_ENTRIES),
-    JS_CGETSET_MAGIC_DEF("blockSize", js_archive_get, js_archive_set, PROP_BLOCKSIZE),
-    JS_CGETSET_MAGIC_DEF("fileCount", js_archive_get, 0, PROP_FILECOUNT),
-    JS_CFUNC_DEF("next", 0, js_archive_next),
-    JS_CFUNC_DEF("open", 1, js_archive_open),
-    JS_CFUNC_DEF("read", 1, js_archive_read),
-    JS_CFUNC_DEF("write", 1, js_archive_write),
-    JS_CFUNC_DEF("skip", 0, js_archive_skip),
-    JS_CFUNC_DEF("seek", 2, js_archive_seek),
-    JS_CFUNC_DEF("extract", 1, js_archive_extract),
-    JS_CFUNC_DEF("filterBytes", 1, js_archive_filterbytes),
-    JS_CFUNC_DEF("close", 0, js_archive_close),
-    JS_CFUNC_DEF("[Symbol.iterator]", 0, js_archive_iterator),
-    JS_PROP_INT32_DEF("READ", 0, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("WRITE", 1, JS_PROP_CONFIGURABLE),
-    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Archive", JS_PROP_CONFIGURABLE),
-};
+  if(argc > 0 && JS_IsObject(argv[0])) {
+    ret = JS_DupValue(ctx, argv[0]);
+  } else {
+    if(!(ar = archive_open_at(ctx, this_val, 0, FALSE)))
+      return JS_EXCEPTION;
 
-static const JSCFunctionListEntry js_archive_iterator_funcs[] = {
-    JS_ITERATOR_NEXT_DEF("next", 0, js_archive_iterator_next, 0),
-    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "ArchiveIterator", JS_PROP_CONFIGURABLE),
-};
+    /* no prototype, so names like "__proto__" or "toString" are plain keys */
+    entries = JS_NewObjectProto(ctx, JS_NULL);
 
-static const JSCFunctionListEntry js_archive_static_funcs[] = {
-    JS_CFUNC_MAGIC_DEF("read", 1, js_archive_functions, METHOD_READ),
-    JS_CFUNC_MAGIC_DEF("write", 1, js_archive_functions, METHOD_WRITE),
-    JS_PROP_INT32_DEF("READ", 0, JS_PROP_CONFIGURABLE | JS_PROP_ENUMERABLE),
-    JS_PROP_INT32_DEF("WRITE", 1, JS_PROP_CONFIGURABLE | JS_PROP_ENUMERABLE),
-    JS_PROP_INT32_DEF("SEEK_SET", SEEK_SET, JS_PROP_ENUMERABLE),
-    JS_PROP_INT32_DEF("SEEK_CUR", SEEK_CUR, JS_PROP_ENUMERABLE),
-    JS_PROP_INT32_DEF("SEEK_END", SEEK_END, JS_PROP_ENUMERABLE),
-    JS_PROP_INT32_DEF("EOF", ARCHIVE_EOF, 0),
-    JS_PROP_INT32_DEF("OK", ARCHIVE_OK, 0),
-    JS_PROP_INT32_DEF("RETRY", ARCHIVE_RETRY, 0),
-    JS_PROP_INT32_DEF("WARN", ARCHIVE_WARN, 0),
-    JS_PROP_INT32_DEF("FAILED", ARCHIVE_FAILED, 0),
-    JS_PROP_INT32_DEF("FATAL", ARCHIVE_FATAL, 0),
-#ifdef ARCHIVE_FILTER_NONE
-    JS_PROP_INT32_DEF("FILTER_NONE", ARCHIVE_FILTER_NONE, 0),
-#endif
-#ifdef ARCHIVE_FILTER_GZIP
-    JS_PROP_INT32_DEF("FILTER_GZIP", ARCHIVE_FILTER_GZIP, 0),
-#endif
-#ifdef ARCHIVE_FILTER_BZIP2
-    JS_PROP_INT32_DEF("FILTER_BZIP2", ARCHIVE_FILTER_BZIP2, 0),
-#endif
-#ifdef ARCHIVE_FILTER_COMPRESS
-    JS_PROP_INT32_DEF("FILTER_COMPRESS", ARCHIVE_FILTER_COMPRESS, 0),
-#endif
-#ifdef ARCHIVE_FILTER_PROGRAM
-    JS_PROP_INT32_DEF("FILTER_PROGRAM", ARCHIVE_FILTER_PROGRAM, 0),
-#endif
-#ifdef ARCHIVE_FILTER_LZMA
-    JS_PROP_INT32_DEF("FILTER_LZMA", ARCHIVE_FILTER_LZMA, 0),
-#endif
-#ifdef ARCHIVE_FILTER_XZ
-    JS_PROP_INT32_DEF("FILTER_XZ", ARCHIVE_FILTER_XZ, 0),
-#endif
-#ifdef ARCHIVE_FILTER_UU
-    JS_PROP_INT32_DEF("FILTER_UU", ARCHIVE_FILTER_UU, 0),
-#endif
-#ifdef ARCHIVE_FILTER_RPM
-    JS_PROP_INT32_DEF("FILTER_RPM", ARCHIVE_FILTER_RPM, 0),
-#endif
-#ifdef ARCHIVE_FILTER_LZIP
-    JS_PROP_INT32_DEF("FILTER_LZIP", ARCHIVE_FILTER_LZIP, 0),
-#endif
-#ifdef ARCHIVE_FILTER_LRZIP
-    JS_PROP_INT32_DEF("FILTER_LRZIP", ARCHIVE_FILTER_LRZIP, 0),
-#endif
-#ifdef ARCHIVE_FILTER_LZOP
-    JS_PROP_INT32_DEF("FILTER_LZOP", ARCHIVE_FILTER_LZOP, 0),
-#endif
-#ifdef ARCHIVE_FILTER_GRZIP
-    JS_PROP_INT32_DEF("FILTER_GRZIP", ARCHIVE_FILTER_GRZIP, 0),
-#endif
-#ifdef ARCHIVE_FILTER_LZ4
-    JS_PROP_INT32_DEF("FILTER_LZ4", ARCHIVE_FILTER_LZ4, 0),
-#endif
-#ifdef ARCHIVE_FILTER_ZSTD
-    JS_PROP_INT32_DEF("FILTER_ZSTD", ARCHIVE_FILTER_ZSTD, 0),
-#endif
+    while((r = archive_read_next_header(ar, &ent)) == ARCHIVE_OK || r == ARCHIVE_WARN) {
+      const char* pathname = archive_entry_pathname(ent);
 
-#ifdef ARCHIVE_FORMAT_BASE_MASK
-    JS_PROP_INT32_DEF("FORMAT_BASE_MASK", ARCHIVE_FORMAT_BASE_MASK, 0),
-#endif
-#ifdef ARCHIVE_FORMAT_CPIO
-    JS_PROP_INT32_DEF("FORMAT_CPIO", ARCHIVE_FORMAT_CPIO, 0),
-#endif
-#ifdef ARCHIVE_FORMAT_CPIO_POSIX
-    JS_PROP_INT32_DEF("FORMAT_CPIO_POSIX", ARCHIVE_FORMAT_CPIO_POSIX, 0),
-#endif
-#ifdef ARCHIVE_FORMAT_CPIO
-    JS_PROP_INT32_DEF("FORMAT_CPIO", ARCHIVE_FORMAT_CPIO, 0),
-#endif
-#ifdef ARCHIVE_FORMAT_CPIO_BIN_LE
-    JS_PROP_INT32_DEF("FORMAT_CPIO_BIN_LE", ARCHIVE_FORMAT_CPIO_BIN_LE, 0),
-#endif
-#ifdef ARCHIVE_FORMAT_CPIO
-    JS_PROP_INT32_DEF("FORMAT_CPIO", ARCHIVE_FORMAT_CPIO, 0),
+      /* later entries replace earlier ones, as on extraction */
+      if(pathname) {
+        JSValue pos = JS_NewArray(ctx);
+
+        JS_SetPropertyUint32(ctx, pos, 0, JS_NewInt64(ctx, archive_read_header_position(ar)));
+        JS_SetPropertyUint32(ctx, pos, 1, JS_NewInt64(ctx, archive_entry_size(ent)));
+        JS_SetPropertyUint32(ctx, pos, 2, JS_NewUint32(ctx, archive_entry_mode(ent)));
+        JS_SetPropertyUint32(ctx, pos, 3, archive_entry_mtime_is_set(ent) ? JS_NewInt64(ctx, archive_entry_mtime(ent)) : JS_NULL);
+        JS_DefinePropertyValueStr(ctx, entries, pathname, pos, JS_PROP_C_W_E);
+      }
+
+      archive_read_data_skip(ar);
+    }
+
+    if(r != ARCHIVE_EOF) {
+      JS_FreeValue(ctx, entries);
+      ret = JS_ThrowInternalError(ctx, "libarchive error: %s", archive_error_string(ar));
+      archive_read_free(ar);
+      return ret;
+    }
+
+    format = archive_format_name(ar);
+
+    ret = JS_NewObject(ctx);
+    JS_SetPropertyStr(ctx, ret, "format", format ? JS_NewString(ctx, format) : JS_NULL);
+    /* offsets into a decompressed stream can't be seeked to */
+    JS_SetPropertyStr(ctx, ret, "seekable", JS_NewBool(ctx, archive_filter_count(ar) <= 1 || archive_filter_code(ar, 0) == ARCHIVE_FILTER_NONE));
+    JS_SetPropertyStr(ctx, ret, "entries", entries);
+
+    archive_read_free(ar);
+  }
+
+  JS_DefinePropertyValueStr(ctx, this_val, "entryIndex", JS_DupValue(ctx, ret), JS_PROP_CONFIGURABLE);
+
+  return ret;
+}
+
+static BOOL
+archive_find_entry(struct archive* ar, struct archive_entry* ent, const char* name, BOOL first) {
+  int r;
+
+  while((r = archive_read_next_header2(ar, ent)) == ARCHIVE_OK || r == ARCHIVE_WARN) {
+    const char* pathname = archive_entry_pathname(ent);
+
+    if(pathname && !strcmp(pathname, name))
+      return TRUE;
+
+    if(first)
+      break;
+
+    archive_read_data_skip(ar);
+  }
+
+  return FALSE;
+}
+
+/**
+ * openEntry(name): returns the ArchiveEntry name on a new Archive
+ * positioned at its data (read() or entry.stream() read it), or null.
+ * Uses the index to start reading right at the entry's header and falls
+ * back to scanning the headers when that isn't possible.
+ */
+static JSValue
+js_archive_openentry(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  struct archive* ar = 0;
+  struct archive_entry* ent;
+  JSValue index, pos = JS_UNDEFINED, archive, ret;
+  const char *name, *prop;
+  BOOL found = FALSE;
+
+  if(!(name = JS_ToCString(ctx, argv[0])))
+    return JS_EXCEPTION;
+
+  index = JS_GetPropertyStr(ctx, this_val, "entryIndex");
+
+  if(!JS_IsObject(index)) {
+    JS_FreeValue(ctx, index);
+    index = js_archive_index(ctx, this_val, 0, 0);
+  }
+
+  if(JS_IsException(index)) {
+    JS_FreeCString(ctx, name);
+    return JS_EXCEPTION;
+  }
+
+  if(js_get_propertystr_bool(ctx, index, "seekable")) {
+    JSValue entries = JS_GetPropertyStr(ctx, index, "entries");
+
+    pos = JS_IsObject(entries) ? JS_GetPropertyStr(ctx, entries, name) : JS_UNDEFINED;
+    JS_FreeValue(ctx, entries);
+  }
+
+  JS_FreeValue(ctx, index);
+
+  if(!(ent = archive_entry_new())) {
+    JS_FreeValue(ctx, pos);
+    JS_FreeCString(ctx, name);
+    return JS_ThrowOutOfMemory(ctx);
+  }
+
+  if(JS_IsArray(ctx, pos)) {
+    int64_t offset = -1;
+    JSValue value = JS_GetPropertyUint32(ctx, pos, 0);
+
+    JS_ToInt64(ctx, &offset, value);
+    JS_FreeValue(ctx, value);
+
+    if(offset >= 0 && (ar = archive_open_at(ctx, this_val, offset, TRUE))) {
+      if(!(found = archive_find_entry(ar, ent, name, TRUE))) {
+        archive_read_free(ar);
+        ar = 0;
+      }
+    } else {
+      JS_FreeValue(ctx, JS_GetException(ctx));
+    }
+  }
+
+  JS_FreeValue(ctx, pos);
+
+  if(!found) {
+    if(!(ar = archive_open_at(ctx, this_val, 0, FALSE))) {
+      archive_entry_free(ent);
+      JS_FreeCString(ctx, name);
+      return JS_EXCEPTION;
+    }
+
+    found = archive_find_entry(ar, ent, name, FALSE);
+  }
+
+  JS_FreeCString(ctx, name);
+
+  if(!found) {
+    archive_entry_free(ent);
+    archive_read_free(ar);
+    return JS_NULL;
+  }
+
+  archive = js_archive_wrap(ctx, archive_proto, ar);
+  js_archive_set_mode(ctx, archive, READ);
+
+  /* the memory an ArrayBuffer reader points into must stay alive */
+  prop = js_has_propertystr(ctx, this_val, "file") ? "file" : "buffer";
+  JS_DefinePropertyValueStr(ctx, archive, prop, JS_GetPropertyStr(ctx, this_val, prop), JS_PROP_CONFIGURABLE | JS_PROP_ENUMERABLE);
+
+  ret = js_archiveentry_wrap(ctx, entry_proto, ent);
+  JS_DefinePropertyValueStr(ctx, ret, "archive", archive, JS_PROP_CONFIGURABLE);
+  JS_DefinePropertyValueStr(ctx, archive, "entry", JS_DupValue(ctx, ret), JS_PROP_CONFIGURABLE);
+
+  return ret;
+}
+
+#ifndef _WIN32
+typedef struct {
+  char* pathname;
+  int64_t size;
+  /* -1: extracted after the workers, hardlinks may point at any entry */
+  int worker;
+} ArchiveJobEntry;
+
+enum {
+  JOB_SCANNED = 0,
+  JOB_ENTRY,
+  JOB_DONE,
+};
+
+typedef struct {
+  uint32_t type, index;
+} ArchiveJobMessage;
+
+typedef struct archive_job {
+  int ref_count;
+  JSContext* ctx;
+  char *filename, *dest;
+  uint8_t* data;
+  size_t length;
+  JSValue on_progress;
+  int flags, fds[2];
+  uint32_t threads, block_size, extracted;
+  ArchiveJobEntry* entries;
+  uint32_t num_entries;
+  pthread_t coordinator;
+  BOOL joined;
+  pthread_mutex_t lock;
+  volatile int failed;
+  char error[256];
+  Promise promise;
+} ArchiveJob;
+
+typedef struct {
+  ArchiveJob* job;
+  int id;
+  uint32_t last;
+  pthread_t thread;
+} ArchiveWorker;
+
+static void
+archivejob_free(void* ptr) {
+  ArchiveJob* job = ptr;
+
+  if(--job->ref_count == 0) {
+    JSContext* ctx = job->ctx;
+
+    for(uint32_t i = 0; i < job->num_entries; i++)
+      free(job->entries[i].pathname);
+
+    free(job->entries);
+    close(job->fds[0]);
+    close(job->fds[1]);
+    pthread_mutex_destroy(&job->lock);
+
+    if(job->filename)
+      js_free(ctx, job->filename);
+
+    js_free(ctx, job->dest);
+    js_free(ctx, job->data);
+    JS_FreeValue(ctx, job->on_progress);
+    promise_free(JS_GetRuntime(ctx), &job->promise);
+    js_free(ctx, job);
+  }
+}
+
+static void
+archivejob_post(ArchiveJob* job, uint32_t type, uint32_t index) {
+  ArchiveJobMessage msg = {type, index};
+
+  /* smaller than PIPE_BUF, so concurrent writes don't interleave */
+  while(write(job->fds[1], &msg, sizeof(msg)) == -1 && errno == EINTR) {}
+}
+
+static void
+archivejob_fail(ArchiveJob* job, struct archive* ar, const char* msg) {
+  pthread_mutex_lock(&job->lock);
+
+  if(!job->failed) {
+    snprintf(job->error, sizeof(job->error), "libarchive error: %s", ar && archive_error_string(ar) ? archive_error_string(ar) : msg);
+    job->failed = 1;
+  }
+
+  pthread_mutex_unlock(&job->lock);
+}
+
+static struct archive*
+archivejob_open(ArchiveJob* job) {
+  struct archive* ar;
+  int r;
+
+  if(!(ar = archive_read_new()))
+    return 0;
+
+  archive_read_support_format_all(ar);
+  archive_read_support_filter_all(ar);
+
+  r = job->filename ? archive_read_open_filename(ar, job->filename, job->block_size) : archive_read_open_memory(ar, job->data, job->length);
+
+  if(r != ARCHIVE_OK) {
+    archivejob_fail(job, ar, "open failed");
+    archive_read_free(ar);
+    return 0;
+  }
+
+  return ar;
+}
+
+/* whether a path has a ".." component */
+static BOOL
+archivejob_dotdot(const char* p) {
+  for(;;) {
+    size_t n = strcspn(p, "/");
+
+    if(n == 2 && p[0] == '.' && p[1] == '.')
+      return TRUE;
+
+    if(!p[n])
+      return FALSE;
+
+    p += n + 1;
+  }
+}
+
+/* prefixes the entry's path (and hardlink target) with the destination */
+static BOOL
+archivejob_relocate(ArchiveJob* job, struct archive_entry* ent) {
+  const char* paths[2] = {archive_entry_pathname(ent), archive_entry_hardlink(ent)};
+  char buf[PATH_MAX];
+
+  for(int i = 0; i < 2; i++) {
+    const char* p = paths[i];
+
+    if(!p)
+      continue;
+
+    while(*p == '/')
+      p++;
+
+    if(archivejob_dotdot(p)) {
+      archivejob_fail(job, 0, "'..' in entry pathname");
+      return FALSE;
+    }
+
+    if(snprintf(buf, sizeof(buf), "%s/%s", job->dest, p) >= (int)sizeof(buf)) {
+      archivejob_fail(job, 0, "pathname too long");
+      return FALSE;
+    }
+
+    if(i == 0)
+      archive_entry_set_pathname(ent, buf);
+    else
+      archive_entry_set_hardlink(ent, buf);
+  }
+
+  return TRUE;
+}
+
+/**
+ * Walks the archive from the start and extracts the entries assigned to
+ * worker id, skipping the data of all others.
+ */
+static void
+archivejob_extract(ArchiveJob* job, int id, uint32_t last) {
+  struct archive* ar;
+  struct archive_entry* ent;
+  uint32_t index = 0;
+  int r;
+
+  if(!(ar = archivejob_open(job)))
+    return;
+
+  while(!job->failed && index <= last) {
+    if((r = archive_read_next_header(ar, &ent)) == ARCHIVE_EOF)
+      break;
+
+    if(r != ARCHIVE_OK && r != ARCHIVE_WARN) {
+      archivejob_fail(job, ar, "read failed");
+      break;
+    }
+
+    if(index < job->num_entries && job->entries[index].worker == id) {
+      if(!archivejob_relocate(job, ent))
+        break;
+
+      if(archive_read_extract(ar, ent, job->flags) < ARCHIVE_WARN) {
+        archivejob_fail(job, ar, "extract failed");
+        break;
+      }
+
+      archivejob_post(job, JOB_ENTRY, index);
+    }
+
+    index++;
+  }
+
+  archive_read_free(ar);
+}
+
+static void*
+archivejob_worker(void* ptr) {
+  ArchiveWorker* w = ptr;
+
+  archivejob_extract(w->job, w->id, w->last);
+  return 0;
+}
+
+static int
+archivejob_compare(const void* a, const void* b) {
+  const ArchiveJobEntry *x = *(ArchiveJobEntry* const*)a, *y = *(ArchiveJobEntry* const*)b;
+
+  return x->size < y->size ? 1 : x->size > y->size ? -1 : 0;
+}
+
+/* reads the headers once and spreads the entries over the workers by size */
+static BOOL
+archivejob_scan(ArchiveJob* job) {
+  struct archive* ar;
+  struct archive_entry* ent;
+  ArchiveJobEntry** order;
+  uint64_t* load;
+  uint32_t i, capacity = 0;
+  int r;
+
+  if(!(ar = archivejob_open(job)))
+    return FALSE;
+
+  while((r = archive_read_next_header(ar, &ent)) == ARCHIVE_OK || r == ARCHIVE_WARN) {
+    ArchiveJobEntry* e;
+
+    if(job->num_entries == capacity) {
+      ArchiveJobEntry* entries;
+
+      if(!(entries = realloc(job->entries, sizeof(ArchiveJobEntry) * (capacity = capacity ? capacity * 2 : 256)))) {
+        archivejob_fail(job, 0, "out of memory");
+        break;
+      }
+
+      job->entries = entries;
+    }
+
+    e = &job->entries[job->num_entries];
+
+    if(!(e->pathname = strdup(archive_entry_pathname(ent) ? archive_entry_pathname(ent) : ""))) {
+      archivejob_fail(job, 0, "out of memory");
+      break;
+    }
+
+    job->num_entries++;
+    e->size = archive_entry_size_is_set(ent) ? archive_entry_size(ent) : 0;
+    e->worker = archive_entry_hardlink(ent) ? -1 : 0;
+
+    archive_read_data_skip(ar);
+  }
+
+  if(r != ARCHIVE_EOF && r != ARCHIVE_OK && r != ARCHIVE_WARN)
+    archivejob_fail(job, ar, "read failed");
+
+  archive_read_free(ar);
+
+  if(job->failed)
+    return FALSE;
+
+  order = malloc(sizeof(ArchiveJobEntry*) * MAX_NUM(job->num_entries, 1));
+  load = calloc(job->threads, sizeof(uint64_t));
+
+  if(!order || !load) {
+    free(order);
+    free(load);
+    archivejob_fail(job, 0, "out of memory");
+    return FALSE;
+  }
+
+  for(i = 0; i < job->num_entries; i++)
+    order[i] = &job->entries[i];
+
+  qsort(order, job->num_entries, sizeof(ArchiveJobEntry*), archivejob_compare);
+
+  for(i = 0; i < job->num_entries; i++) {
+    uint32_t j, least = 0;
+
+    if(order[i]->worker == -1)
+      continue;
+
+    for(j = 1; j < job->threads; j++)
+      if(load[j] < load[least])
+        least = j;
+
+    order[i]->worker = least;
+    /* count headers too, so empty files and directories are spread as well */
+    load[least] += order[i]->size + 512;
+  }
+
+  free(order);
+  free(load);
+
+  return TRUE;
+}
+
+static void*
+archivejob_coordinator(void* ptr) {
+  ArchiveJob* job = ptr;
+  ArchiveWorker* workers;
+  uint32_t i, started = 0;
+
+  if(archivejob_scan(job)) {
+    archivejob_post(job, JOB_SCANNED, job->num_entries);
+
+    if((workers = calloc(job->threads, sizeof(ArchiveWorker)))) {
+      for(i = 0; i < job->num_entries; i++)
+        if(job->entries[i].worker >= 0)
+          workers[job->entries[i].worker].last = i;
+
+      for(i = 0; i < job->threads; i++) {
+        workers[i].job = job;
+        workers[i].id = i;
+
+        if(pthread_create(&workers[i].thread, 0, archivejob_worker, &workers[i]))
+          break;
+
+        started++;
+      }
+
+      /* threads that failed to start are made up for on this one */
+      for(i = started; i < job->threads; i++)
+        archivejob_extract(job, i, workers[i].last);
+
+      for(i = 0; i < started; i++)
+        pthread_join(workers[i].thread, 0);
+
+      free(workers);
+
+      archivejob_extract(job, -1, job->num_entries);
+    } else {
+      archivejob_fail(job, 0, "out of memory");
+    }
+  }
+
+  archivejob_post(job, JOB_DONE, 0);
+  return 0;
+}
+
+/* joins the coordinator and drops the reference it held */
+static void
+archivejob_join(ArchiveJob* job) {
+  if(!job->joined) {
+    pthread_join(job->coordinator, 0);
+    job->joined = TRUE;
+    archivejob_free(job);
+  }
+}
+
+/**
+ * Stops the threads early and waits for them. The pipe is drained up to
+ * JOB_DONE, so the coordinator can't block on a full pipe meanwhile.
+ */
+static void
+archivejob_cancel(ArchiveJob* job) {
+  ArchiveJobMessage msg;
+  ssize_t n;
+
+  if(job->joined)
+    return;
+
+  archivejob_fail(job, 0, "cancelled");
+  fcntl(job->fds[0], F_SETFL, fcntl(job->fds[0], F_GETFL) & ~O_NONBLOCK);
+
+  while((n = read(job->fds[0], &msg, sizeof(msg))) == sizeof(msg) || (n == -1 && errno == EINTR))
+    if(n > 0 && msg.type == JOB_DONE)
+      break;
+
+  archivejob_join(job);
+}
+
+/* the io handler's reference, also dropped when the handler is removed early */
+static void
+archivejob_release(void* ptr) {
+  ArchiveJob* job = ptr;
+
+  archivejob_cancel(job);
+  archivejob_free(job);
+}
+
+static JSValue
+js_archivejob_event(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  ArchiveJob* job = ptr;
+  ArchiveJobMessage msg;
+
+  while(read(job->fds[0], &msg, sizeof(msg)) == sizeof(msg)) {
+    switch(msg.type) {
+      case JOB_ENTRY: {
+        if(msg.index >= job->num_entries)
+          break;
+
+        job->extracted++;
+
+        if(JS_IsFunction(ctx, job->on_progress)) {
+          JSValue info = JS_NewObject(ctx);
+
+          JS_SetPropertyStr(ctx, info, "index", JS_NewUint32(ctx, msg.index));
+          JS_SetPropertyStr(ctx, info, "pathname", JS_NewString(ctx, job->entries[msg.index].pathname));
+          JS_SetPropertyStr(ctx, info, "extracted", JS_NewUint32(ctx, job->extracted));
+          JS_SetPropertyStr(ctx, info, "total", JS_NewUint32(ctx, job->num_entries));
+
+          JS_FreeValue(ctx, JS_Call(ctx, job->on_progress, JS_UNDEFINED, 1, &info));
+          JS_FreeValue(ctx, info);
+        }
+
+        break;
+      }
+
+      case JOB_DONE: {
+        JSValue set_handler = js_iohandler_fn(ctx, FALSE);
+
+        archivejob_join(job);
+
+        if(job->failed) {
+          JSValue error = JS_NewError(ctx);
+
+          JS_SetPropertyStr(ctx, error, "message", JS_NewString(ctx, job->error));
+          promise_reject(ctx, &job->promise.funcs, error);
+          JS_FreeValue(ctx, error);
+        } else {
+          JSValue count = JS_NewUint32(ctx, job->extracted);
+
+          promise_resolve(ctx, &job->promise.funcs, count);
+        }
+
+        /* drops the handler's reference, job may be gone after this */
+        js_iohandler_set(ctx, set_handler, job->fds[0], JS_NULL);
+        JS_FreeValue(ctx, set_handler);
+        return JS_UNDEFINED;
+      }
+    }
+  }
+
+  return JS_UNDEFINED;
+}
+#endif
+
+/**
+ * extractAll(dest, { threads, flags, onProgress }): extracts every entry
+ * below dest on worker threads that each open the archive on their own,
+ * so the archive must have been opened from a file or an ArrayBuffer.
+ * dest must exist. Entries with a ".." component or written through a
+ * symlink are refused. Resolves with the number of entries extracted.
+ */
+static JSValue
+js_archive_extractall(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+#ifdef _WIN32
+  return JS_ThrowInternalError(ctx, "extractAll() needs POSIX threads");
+#else
+  ArchiveJob* job;
+  JSValue file, set_handler, handler, ret, error;
+  const char* dest;
+  char resolved[PATH_MAX];
+  BOOL ok;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if(js_archive_mode(ctx, this_val) != READ)
+    return JS_ThrowInternalError(ctx, "archive not in read mode");
+
+  if(!(dest = JS_ToCString(ctx, argv[0])))
+    return JS_EXCEPTION;
+
+  /* resolved, so that the secure flags only look at the entry's own path */
+  if(!realpath(dest, resolved)) {
+    ret = JS_ThrowInternalError(ctx, "extractAll(): realpath('%s') failed: %s", dest, strerror(errno));
+    JS_FreeCString(ctx, dest);
+    return ret;
+  }
+
+  JS_FreeCString(ctx, dest);
+
+  if(!(job = js_mallocz(ctx, sizeof(ArchiveJob))))
+    return JS_EXCEPTION;
+
+  job->ref_count = 1;
+  job->ctx = ctx;
+  job->on_progress = JS_UNDEFINED;
+  job->threads = cpus > 0 ? cpus : 1;
+  job->block_size = 65536;
+  job->fds[0] = job->fds[1] = -1;
+  promise_zero(&job->promise);
+  pthread_mutex_init(&job->lock, 0);
+
+  if(!(job->dest = js_strdup(ctx, resolved))) {
+    archivejob_free(job);
+    return JS_EXCEPTION;
+  }
+
+  if(argc > 1 && JS_IsObject(argv[1])) {
+    if(js_has_propertystr(ctx, argv[1], "threads"))
+      job->threads = MAX_NUM(js_get_propertystr_int32(ctx, argv[1], "threads"), 1);
+
+    job->flags = js_get_propertystr_int32(ctx, argv[1], "flags");
+    job->on_progress = JS_GetPropertyStr(ctx, argv[1], "onProgress");
+  }
+
+#ifdef ARCHIVE_EXTRACT_SECURE_NODOTDOT
+  job->flags |= ARCHIVE_EXTRACT_SECURE_NODOTDOT;
+#endif
+#ifdef ARCHIVE_EXTRACT_SECURE_SYMLINKS
+  job->flags |= ARCHIVE_EXTRACT_SECURE_SYMLINKS;
+#endif
+
+  job->threads = MIN_NUM(MAX_NUM(job->threads, 1), 64);
+
+  file = JS_GetPropertyStr(ctx, this_val, "file");
+
+  if(JS_IsString(file)) {
+    const char* str = JS_ToCString(ctx, file);
+
+    job->filename = str ? js_strdup(ctx, str) : 0;
+    JS_FreeCString(ctx, str);
+    JS_FreeValue(ctx, file);
+
+    if(!job->filename) {
+      archivejob_free(job);
+      return JS_EXCEPTION;
+    }
+  } else {
+    JSValue source = JS_GetPropertyStr(ctx, this_val, "buffer");
+    uint8_t* data;
+
+    JS_FreeValue(ctx, file);
+
+    if(!(data = JS_GetArrayBuffer(ctx, &job->length, source))) {
+      JS_FreeValue(ctx, JS_GetException(ctx));
+      JS_FreeValue(ctx, source);
+      archivejob_free(job);
+      return JS_ThrowTypeError(ctx, "extractAll() needs an archive opened from a file or an ArrayBuffer");
+    }
+
+    /* copied, as the buffer may be detached or resized while the threads read it */
+    if((job->data = js_malloc(ctx, MAX_NUM(job->length, 1))))
+      memcpy(job->data, data, job->length);
+
+    JS_FreeValue(ctx, source);
+
+    if(!job->data) {
+      archivejob_free(job);
+      return JS_EXCEPTION;
+    }
+  }
+
+  if(pipe(job->fds) == -1) {
+    archivejob_free(job);
+    return JS_ThrowInternalError(ctx, "pipe() failed: %s", strerror(errno));
+  }
+
+  fcntl(job->fds[0], F_SETFL, fcntl(job->fds[0], F_GETFL) | O_NONBLOCK);
+
+  if(!promise_init(ctx, &job->promise)) {
+    archivejob_free(job);
+    return JS_EXCEPTION;
+  }
+
+  ret = JS_DupValue(ctx, job->promise.value);
+
+  /* the coordinator's reference, dropped once it has been joined */
+  job->ref_count++;
+
+  if(pthread_create(&job->coordinator, 0, archivejob_coordinator, job)) {
+    job->ref_count--;
+    archivejob_free(job);
+    JS_FreeValue(ctx, ret);
+    return JS_ThrowInternalError(ctx, "pthread_create() failed");
+  }
+
+  /* the handler takes over the initial reference */
+  handler = js_function_cclosure(ctx, js_archivejob_event, 0, 0, job, archivejob_release);
+
+  if(JS_IsException(handler)) {
+    ok = FALSE;
+  } else {
+    /* keeps the job if setReadHandler() fails and drops the handler */
+    job->ref_count++;
+    set_handler = js_iohandler_fn(ctx, FALSE);
+    ok = js_iohandler_set(ctx, set_handler, job->fds[0], handler);
+    JS_FreeValue(ctx, set_handler);
+  }
+
+  if(!ok) {
+    archivejob_cancel(job);
+    error = JS_GetException(ctx);
+    promise_reject(ctx, &job->promise.funcs, error);
+    JS_FreeValue(ctx, error);
+  }
+
+  archivejob_free(job);
+  return ret;
+#endif
+}
+
+static void
+js_archive_finalizer(JSRuntime* rt, JSValue val) {
+  struct archive* ar;
+
+  if((ar = js_archive_data(val)))
+    archive_free(ar);
+}
+
+static JSClassDef js_archive_class = {
+    .class_name = "Archive",
+    .finalizer = js_archive_finalizer,
+};
+
+static const JSCFunctionListEntry js_archive_funcs[] = {
+    JS_CGETSET_MAGIC_DEF("errno", js_archive_get, 0, PROP_ERRNO),
+    JS_CGETSET_MAGIC_DEF("error", js_archive_get, 0, PROP_ERROR_STRING),
+    JS_CGETSET_MAGIC_DEF("format", js_archive_get, js_archive_set, PROP_FORMAT),
+    JS_CGETSET_MAGIC_DEF("compression", js_archive_get, 0, PROP_COMPRESSION),
+    JS_CGETSET_MAGIC_DEF("filters", js_archive_get, 0, PROP_FILTERS),
+    JS_CGETSET_MAGIC_DEF("position", js_archive_get, 0, PROP_POSITION),
+    JS_CGETSET_MAGIC_DEF("readHeaderPosition", js_archive_get, 0, PROP_READ_HEADER_POSITION),
+    JS_CGETSET_MAGIC_DEF("hasEncryptedEntries", js_archive_get, 0, PROP_HAS_ENCRYPTED_ENTRIES),
+    JS_CGETSET_MAGIC_DEF("blockSize", js_archive_get, js_archive_set, PROP_BLOCKSIZE),
+    JS_CGETSET_MAGIC_DEF("fileCount", js_archive_get, 0, PROP_FILECOUNT),
+    JS_CFUNC_DEF("next", 0, js_archive_next),
+    JS_CFUNC_DEF("open", 1, js_archive_open),
+    JS_CFUNC_DEF("read", 1, js_archive_read),
+    JS_CFUNC_DEF("write", 1, js_archive_write),
+    JS_CFUNC_DEF("addFile", 1, js_archive_addfile),
+    JS_CFUNC_DEF("skip", 0, js_archive_skip),
+    JS_CFUNC_DEF("seek", 2, js_archive_seek),
+    JS_CFUNC_DEF("extract", 1, js_archive_extract),
+    JS_CFUNC_DEF("extractAll", 1, js_archive_extractall),
+    JS_CFUNC_DEF("index", 0, js_archive_index),
+    JS_CFUNC_DEF("openEntry", 1, js_archive_openentry),
+    JS_CFUNC_DEF("filterBytes", 1, js_archive_filterbytes),
+    JS_CFUNC_DEF("close", 0, js_archive_close),
+    JS_CFUNC_DEF("[Symbol.iterator]", 0, js_archive_iterator),
+    JS_PROP_INT32_DEF("READ", 0, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("WRITE", 1, JS_PROP_CONFIGURABLE),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Archive", JS_PROP_CONFIGURABLE),
+};
+
+static const JSCFunctionListEntry js_archive_iterator_funcs[] = {
+    JS_ITERATOR_NEXT_DEF("next", 0, js_archive_iterator_next, 0),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "ArchiveIterator", JS_PROP_CONFIGURABLE),
+};
+
+static const JSCFunctionListEntry js_archive_static_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("read", 1, js_archive_functions, METHOD_READ),
+    JS_CFUNC_MAGIC_DEF("write", 1, js_archive_functions, METHOD_WRITE),
+    JS_PROP_INT32_DEF("READ", 0, JS_PROP_CONFIGURABLE | JS_PROP_ENUMERABLE),
+    JS_PROP_INT32_DEF("WRITE", 1, JS_PROP_CONFIGURABLE | JS_PROP_ENUMERABLE),
+    JS_PROP_INT32_DEF("SEEK_SET", SEEK_SET, JS_PROP_ENUMERABLE),
+    JS_PROP_INT32_DEF("SEEK_CUR", SEEK_CUR, JS_PROP_ENUMERABLE),
+    JS_PROP_INT32_DEF("SEEK_END", SEEK_END, JS_PROP_ENUMERABLE),
+    JS_PROP_INT32_DEF("EOF", ARCHIVE_EOF, 0),
+    JS_PROP_INT32_DEF("OK", ARCHIVE_OK, 0),
+    JS_PROP_INT32_DEF("RETRY", ARCHIVE_RETRY, 0),
+    JS_PROP_INT32_DEF("WARN", ARCHIVE_WARN, 0),
+    JS_PROP_INT32_DEF("FAILED", ARCHIVE_FAILED, 0),
+    JS_PROP_INT32_DEF("FATAL", ARCHIVE_FATAL, 0),
+#ifdef ARCHIVE_FILTER_NONE
+    JS_PROP_INT32_DEF("FILTER_NONE", ARCHIVE_FILTER_NONE, 0),
+#endif
+#ifdef ARCHIVE_FILTER_GZIP
+    JS_PROP_INT32_DEF("FILTER_GZIP", ARCHIVE_FILTER_GZIP, 0),
+#endif
+#ifdef ARCHIVE_FILTER_BZIP2
+    JS_PROP_INT32_DEF("FILTER_BZIP2", ARCHIVE_FILTER_BZIP2, 0),
+#endif
+#ifdef ARCHIVE_FILTER_COMPRESS
+    JS_PROP_INT32_DEF("FILTER_COMPRESS", ARCHIVE_FILTER_COMPRESS, 0),
+#endif
+#ifdef ARCHIVE_FILTER_PROGRAM
+    JS_PROP_INT32_DEF("FILTER_PROGRAM", ARCHIVE_FILTER_PROGRAM, 0),
+#endif
+#ifdef ARCHIVE_FILTER_LZMA
+    JS_PROP_INT32_DEF("FILTER_LZMA", ARCHIVE_FILTER_LZMA, 0),
+#endif
+#ifdef ARCHIVE_FILTER_XZ
+    JS_PROP_INT32_DEF("FILTER_XZ", ARCHIVE_FILTER_XZ, 0),
+#endif
+#ifdef ARCHIVE_FILTER_UU
+    JS_PROP_INT32_DEF("FILTER_UU", ARCHIVE_FILTER_UU, 0),
+#endif
+#ifdef ARCHIVE_FILTER_RPM
+    JS_PROP_INT32_DEF("FILTER_RPM", ARCHIVE_FILTER_RPM, 0),
+#endif
+#ifdef ARCHIVE_FILTER_LZIP
+    JS_PROP_INT32_DEF("FILTER_LZIP", ARCHIVE_FILTER_LZIP, 0),
+#endif
+#ifdef ARCHIVE_FILTER_LRZIP
+    JS_PROP_INT32_DEF("FILTER_LRZIP", ARCHIVE_FILTER_LRZIP, 0),
+#endif
+#ifdef ARCHIVE_FILTER_LZOP
+    JS_PROP_INT32_DEF("FILTER_LZOP", ARCHIVE_FILTER_LZOP, 0),
+#endif
+#ifdef ARCHIVE_FILTER_GRZIP
+    JS_PROP_INT32_DEF("FILTER_GRZIP", ARCHIVE_FILTER_GRZIP, 0),
+#endif
+#ifdef ARCHIVE_FILTER_LZ4
+    JS_PROP_INT32_DEF("FILTER_LZ4", ARCHIVE_FILTER_LZ4, 0),
+#endif
+#ifdef ARCHIVE_FILTER_ZSTD
+    JS_PROP_INT32_DEF("FILTER_ZSTD", ARCHIVE_FILTER_ZSTD, 0),
+#endif
+
+#ifdef ARCHIVE_FORMAT_BASE_MASK
+    JS_PROP_INT32_DEF("FORMAT_BASE_MASK", ARCHIVE_FORMAT_BASE_MASK, 0),
+#endif
+#ifdef ARCHIVE_FORMAT_CPIO
+    JS_PROP_INT32_DEF("FORMAT_CPIO", ARCHIVE_FORMAT_CPIO, 0),
+#endif
+#ifdef ARCHIVE_FORMAT_CPIO_POSIX
+    JS_PROP_INT32_DEF("FORMAT_CPIO_POSIX", ARCHIVE_FORMAT_CPIO_POSIX, 0),
+#endif
+#ifdef ARCHIVE_FORMAT_CPIO
+    JS_PROP_INT32_DEF("FORMAT_CPIO", ARCHIVE_FORMAT_CPIO, 0),
+#endif
+#ifdef ARCHIVE_FORMAT_CPIO_BIN_LE
+    JS_PROP_INT32_DEF("FORMAT_CPIO_BIN_LE", ARCHIVE_FORMAT_CPIO_BIN_LE, 0),
+#endif
+#ifdef ARCHIVE_FORMAT_CPIO
+    JS_PROP_INT32_DEF("FORMAT_CPIO", ARCHIVE_FORMAT_CPIO, 0),
 #endif
 #ifdef ARCHIVE_FORMAT_CPIO_BIN_BE
     JS_PROP_INT32_DEF("FORMAT_CPIO_BIN_BE", ARCHIVE_FORMAT_CPIO_BIN_BE, 0),
@@ -1254,6 +2348,223 @@ fail:
   return JS_EXCEPTION;
 }
 
+typedef struct {
+  int ref_count;
+  JSContext* ctx;
+  JSValue archive, chunk;
+  int file_count;
+  int64_t position;
+  BOOL copy, done;
+  /* block read past a hole, enqueued once the hole is filled */
+  BOOL pending;
+  const void* data;
+  size_t size;
+  int64_t offset;
+} ArchiveStream;
+
+enum {
+  ENTRY_STREAM_PULL,
+  ENTRY_STREAM_CANCEL,
+};
+
+static ArchiveStream*
+archivestream_dup(ArchiveStream* as) {
+  ++as->ref_count;
+  return as;
+}
+
+static void
+archivestream_free(void* ptr) {
+  ArchiveStream* as = ptr;
+
+  if(--as->ref_count == 0) {
+    JSContext* ctx = as->ctx;
+
+    JS_FreeValue(ctx, as->chunk);
+    JS_FreeValue(ctx, as->archive);
+    js_free(ctx, as);
+  }
+}
+
+static void
+archivestream_finish(ArchiveStream* as) {
+  JSContext* ctx = as->ctx;
+
+  as->done = TRUE;
+
+  if(!as->copy && JS_IsObject(as->chunk))
+    JS_DetachArrayBuffer(ctx, as->chunk);
+
+  JS_FreeValue(ctx, as->chunk);
+  as->chunk = JS_UNDEFINED;
+}
+
+/**
+ * Wraps the current block: either as a copy, or pointing into libarchive's
+ * buffer, in which case it is detached before the next block is read.
+ */
+static JSValue
+archivestream_chunk(ArchiveStream* as, const void* data, size_t size) {
+  JSContext* ctx = as->ctx;
+  ArchiveInstance* abuf;
+
+  if(as->copy || !(abuf = js_malloc(ctx, sizeof(ArchiveInstance))))
+    return JS_NewArrayBufferCopy(ctx, data, size);
+
+  abuf->archive = JS_DupValue(ctx, as->archive);
+
+  return JS_NewArrayBuffer(ctx, (uint8_t*)data, size, js_archive_free_buffer, abuf, FALSE);
+}
+
+static JSValue
+js_archivestream_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  ArchiveStream* as = ptr;
+  struct archive* ar = js_archive_data(as->archive);
+
+  switch(magic) {
+    case ENTRY_STREAM_PULL: {
+      __LA_INT64_T offset;
+      JSValue chunk;
+      int result;
+
+      if(as->done)
+        break;
+
+      if(!ar || archive_file_count(ar) != as->file_count) {
+        JSValue error = JS_NewError(ctx);
+
+        JS_SetPropertyStr(ctx, error, "message", JS_NewString(ctx, "archive has moved past this entry"));
+        archivestream_finish(as);
+        JS_FreeValue(ctx, js_invoke(ctx, argv[0], "error", 1, &error));
+        JS_FreeValue(ctx, error);
+        break;
+      }
+
+      if(!as->pending) {
+        if(!as->copy && JS_IsObject(as->chunk))
+          JS_DetachArrayBuffer(ctx, as->chunk);
+
+        JS_FreeValue(ctx, as->chunk);
+        as->chunk = JS_UNDEFINED;
+
+        result = archive_read_data_block(ar, &as->data, &as->size, &offset);
+        as->offset = offset;
+        as->pending = result >= ARCHIVE_WARN && result != ARCHIVE_EOF;
+      } else {
+        result = ARCHIVE_OK;
+      }
+
+      if(result == ARCHIVE_EOF) {
+        archivestream_finish(as);
+        JS_FreeValue(ctx, js_invoke(ctx, argv[0], "close", 0, 0));
+        break;
+      }
+
+      if(result < ARCHIVE_WARN) {
+        JSValue error = JS_NewError(ctx);
+
+        JS_SetPropertyStr(ctx, error, "message", JS_NewString(ctx, archive_error_string(ar)));
+        archivestream_finish(as);
+        JS_FreeValue(ctx, js_invoke(ctx, argv[0], "error", 1, &error));
+        JS_FreeValue(ctx, error);
+        break;
+      }
+
+      /* sparse entries: fill the hole up to the block's offset, 64K per pull */
+      if(as->offset > as->position) {
+        size_t hole = MIN_NUM(as->offset - as->position, 65536);
+        uint8_t* zero;
+
+        if(!(zero = js_mallocz(ctx, hole)))
+          return JS_EXCEPTION;
+
+        as->position += hole;
+        chunk = JS_NewArrayBuffer(ctx, zero, hole, js_archive_free_buffer_rt, 0, FALSE);
+        JS_FreeValue(ctx, js_invoke(ctx, argv[0], "enqueue", 1, &chunk));
+        JS_FreeValue(ctx, chunk);
+        break;
+      }
+
+      as->pending = FALSE;
+      as->position = as->offset + as->size;
+      chunk = archivestream_chunk(as, as->data, as->size);
+
+      if(!as->copy)
+        as->chunk = JS_DupValue(ctx, chunk);
+
+      JS_FreeValue(ctx, js_invoke(ctx, argv[0], "enqueue", 1, &chunk));
+      JS_FreeValue(ctx, chunk);
+      break;
+    }
+
+    case ENTRY_STREAM_CANCEL: {
+      if(!as->done && ar && archive_file_count(ar) == as->file_count)
+        archive_read_data_skip(ar);
+
+      archivestream_finish(as);
+      break;
+    }
+  }
+
+  return JS_UNDEFINED;
+}
+
+/**
+ * stream(options): ReadableStream of the entry's data, read block by
+ * block. With { copy: false } chunks point into libarchive's buffer and
+ * are detached once the next block is read, so they must be consumed
+ * before that.
+ */
+static JSValue
+js_archiveentry_stream(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  JSValue archive, entry, underlying, ret;
+  struct archive* ar;
+  ArchiveStream* as;
+  BOOL current;
+
+  archive = JS_GetPropertyStr(ctx, this_val, "archive");
+
+  if(!(ar = js_archive_data(archive))) {
+    JS_FreeValue(ctx, archive);
+    return JS_ThrowTypeError(ctx, "ArchiveEntry was not read from an Archive");
+  }
+
+  entry = JS_GetPropertyStr(ctx, archive, "entry");
+  current = JS_IsObject(entry) && JS_VALUE_GET_OBJ(entry) == JS_VALUE_GET_OBJ(this_val);
+  JS_FreeValue(ctx, entry);
+
+  if(!current) {
+    JS_FreeValue(ctx, archive);
+    return JS_ThrowInternalError(ctx, "archive has moved past this entry");
+  }
+
+  if(!(as = js_mallocz(ctx, sizeof(ArchiveStream)))) {
+    JS_FreeValue(ctx, archive);
+    return JS_EXCEPTION;
+  }
+
+  as->ref_count = 1;
+  as->ctx = ctx;
+  as->archive = archive;
+  as->chunk = JS_UNDEFINED;
+  as->file_count = archive_file_count(ar);
+  as->copy = argc > 0 && JS_IsObject(argv[0]) && js_has_propertystr(ctx, argv[0], "copy") ? js_get_propertystr_bool(ctx, argv[0], "copy") : TRUE;
+
+  if(js_readable_class_id == 0)
+    js_stream_init(ctx, 0);
+
+  underlying = JS_NewObject(ctx);
+  JS_SetPropertyStr(ctx, underlying, "pull", js_function_cclosure(ctx, js_archivestream_method, 1, ENTRY_STREAM_PULL, archivestream_dup(as), archivestream_free));
+  JS_SetPropertyStr(ctx, underlying, "cancel", js_function_cclosure(ctx, js_archivestream_method, 1, ENTRY_STREAM_CANCEL, archivestream_dup(as), archivestream_free));
+
+  ret = js_readable_constructor(ctx, readable_ctor, 1, &underlying);
+
+  JS_FreeValue(ctx, underlying);
+  archivestream_free(as);
+
+  return ret;
+}
+
 enum {
   ENTRY_CLONE,
 };
@@ -1866,6 +3177,7 @@ static JSClassDef js_archiveentry_class = {
 
 static const JSCFunctionListEntry js_archiveentry_funcs[] = {
     JS_CFUNC_MAGIC_DEF("clone", 0, js_archiveentry_functions, ENTRY_CLONE),
+    JS_CFUNC_DEF("stream", 0, js_archiveentry_stream),
     JS_CGETSET_MAGIC_DEF("atime", js_archiveentry_get, js_archiveentry_set, ENTRY_ATIME),
     JS_CGETSET_MAGIC_DEF("ctime", js_archiveentry_get, js_archiveentry_set, ENTRY_CTIME),
     JS_CGETSET_MAGIC_DEF("mtime", js_archiveentry_get, js_archiveentry_set, ENTRY_MTIME),
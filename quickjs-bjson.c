@@ -25,12 +25,701 @@
 #include "utils.h"
 #include "defines.h"
 #include "debug.h"
+#include "buffer-utils.h"
+#include "vector.h"
+#include "quickjs-queue.h"
+#include <string.h>
 
 /**
  * \defgroup quickjs-bjson quickjs-bjson: Binary JSON
  * @{
  */
 
+/* a varint holds 7 bits per byte */
+#define FRAME_PREFIX_MAX 10
+#define FRAME_DEFAULT_MAX_LENGTH INT32_MAX
+
+#define DICT_DEFAULT_MAX_SHAPES 1024
+#define DICT_MAX_DEPTH 512
+
+static JSClassID js_frame_decoder_class_id = 0, js_dictionary_class_id = 0;
+static JSValue frame_decoder_proto = {{0}, JS_TAG_UNDEFINED}, frame_decoder_ctor = {{0}, JS_TAG_UNDEFINED};
+static JSValue dictionary_proto = {{0}, JS_TAG_UNDEFINED}, dictionary_ctor = {{0}, JS_TAG_UNDEFINED};
+
+/** The ordered keys of a record */
+typedef struct {
+  uint32_t hash, natoms;
+  JSAtom* atoms;
+} DictShape;
+
+/**
+ * Session state of the dictionary encoding. A shape is written out the
+ * first time a record of that key order is encoded; afterwards records
+ * only carry its id. Both ends have to see the messages in the same order.
+ */
+typedef struct {
+  Vector wshapes, rshapes;
+  uint32_t last, max_shapes;
+  JSValue object_proto;
+} Dictionary;
+
+enum {
+  DICT_UNDEFINED = 0,
+  DICT_NULL,
+  DICT_FALSE,
+  DICT_TRUE,
+  DICT_INT,
+  DICT_FLOAT,
+  DICT_STRING,
+  DICT_ARRAY,
+  DICT_SHAPE_NEW,
+  DICT_SHAPE_REF,
+  DICT_SHAPE_INLINE,
+  DICT_BJSON,
+};
+
+enum {
+  DICTIONARY_WRITE = 0,
+  DICTIONARY_READ,
+  DICTIONARY_RESET,
+};
+
+/**
+ * Incremental decoder of length-prefixed bjson frames. Bytes are queued as
+ * they arrive and each message is read in place when its frame is complete.
+ */
+typedef struct {
+  Queue q;
+  int flags;
+  uint64_t max_length;
+  JSValue callback, dictionary;
+} FrameDecoder;
+
+enum {
+  FRAME_DECODER_PUSH = 0,
+  FRAME_DECODER_NEXT,
+  FRAME_DECODER_WRITE,
+  FRAME_DECODER_CLOSE,
+};
+
+static size_t
+frame_prefix_length(uint64_t n) {
+  size_t i = 1;
+
+  while(n >= 0x80) {
+    n >>= 7;
+    i++;
+  }
+
+  return i;
+}
+
+static void
+frame_prefix_put(uint8_t* p, uint64_t n) {
+  while(n >= 0x80) {
+    *p++ = (n & 0x7f) | 0x80;
+    n >>= 7;
+  }
+
+  *p = n;
+}
+
+/**
+ * @return  length of the prefix, 0 if it is incomplete, -1 if it is invalid
+ */
+static int
+frame_prefix_get(const uint8_t* p, size_t len, uint64_t* n) {
+  size_t i;
+
+  *n = 0;
+
+  for(i = 0; i < len && i < FRAME_PREFIX_MAX; i++) {
+    *n |= (uint64_t)(p[i] & 0x7f) << (7 * i);
+
+    if(!(p[i] & 0x80))
+      return i + 1;
+  }
+
+  return i < FRAME_PREFIX_MAX ? 0 : -1;
+}
+
+static void
+dict_varint_put(DynBuf* db, uint64_t n) {
+  uint8_t buf[FRAME_PREFIX_MAX];
+
+  frame_prefix_put(buf, n);
+  dbuf_put(db, buf, frame_prefix_length(n));
+}
+
+static void
+dict_shapes_truncate(JSRuntime* rt, Vector* shapes, uint32_t n) {
+  DictShape *shape, *end = vector_end_t(shapes, DictShape);
+
+  for(shape = vector_begin_t(shapes, DictShape) + n; shape < end; shape++) {
+    uint32_t i;
+
+    for(i = 0; i < shape->natoms; i++)
+      JS_FreeAtomRT(rt, shape->atoms[i]);
+
+    js_free_rt(rt, shape->atoms);
+  }
+
+  shapes->size = n * sizeof(DictShape);
+}
+
+static inline uint32_t
+dict_shapes_count(Vector* shapes) {
+  return vector_size(shapes, sizeof(DictShape));
+}
+
+/**
+ * @return  id of the shape with the keys \p tab, or -1 if it is unknown
+ */
+static int32_t
+dict_shape_find(Dictionary* d, JSPropertyEnum* tab, uint32_t n, uint32_t hash) {
+  DictShape* shapes = vector_begin_t(&d->wshapes, DictShape);
+  uint32_t i, j, count = dict_shapes_count(&d->wshapes);
+
+  /* records mostly come in runs of one shape */
+  for(i = 0; i < count; i++) {
+    uint32_t id = (d->last + i) % count;
+    DictShape* shape = &shapes[id];
+
+    if(shape->hash != hash || shape->natoms != n)
+      continue;
+
+    for(j = 0; j < n; j++)
+      if(shape->atoms[j] != tab[j].atom)
+        break;
+
+    if(j == n)
+      return d->last = id;
+  }
+
+  return -1;
+}
+
+static int
+dict_put_atom(JSContext* ctx, DynBuf* db, JSAtom atom) {
+  const char* str;
+  size_t len;
+  JSValue key = JS_AtomToString(ctx, atom);
+
+  str = JS_ToCStringLen(ctx, &len, key);
+  JS_FreeValue(ctx, key);
+
+  if(!str)
+    return -1;
+
+  dict_varint_put(db, len);
+  dbuf_put(db, (const uint8_t*)str, len);
+  JS_FreeCString(ctx, str);
+  return 0;
+}
+
+static BOOL
+dict_is_record(JSContext* ctx, Dictionary* d, JSValueConst value) {
+  JSValue proto;
+
+  if(JS_IsArray(ctx, value) || JS_IsFunction(ctx, value))
+    return FALSE;
+
+  proto = JS_GetPrototype(ctx, value);
+
+  return JS_IsObject(proto) && JS_VALUE_GET_OBJ(proto) == JS_VALUE_GET_OBJ(d->object_proto);
+}
+
+static int
+dict_encode_value(JSContext* ctx, Dictionary* d, DynBuf* db, JSValueConst value, int depth) {
+  int tag = JS_VALUE_GET_TAG(value);
+
+  if(depth > DICT_MAX_DEPTH) {
+    JS_ThrowRangeError(ctx, "nesting exceeds %d levels", DICT_MAX_DEPTH);
+    return -1;
+  }
+
+  if(JS_TAG_IS_FLOAT64(tag)) {
+    union {
+      double d;
+      uint64_t u;
+    } u = {JS_VALUE_GET_FLOAT64(value)};
+    int i;
+
+    dbuf_putc(db, DICT_FLOAT);
+
+    for(i = 0; i < 8; i++)
+      dbuf_putc(db, u.u >> (i * 8));
+
+    return 0;
+  }
+
+  switch(tag) {
+    case JS_TAG_UNDEFINED: dbuf_putc(db, DICT_UNDEFINED); return 0;
+    case JS_TAG_NULL: dbuf_putc(db, DICT_NULL); return 0;
+    case JS_TAG_BOOL: dbuf_putc(db, JS_VALUE_GET_BOOL(value) ? DICT_TRUE : DICT_FALSE); return 0;
+
+    case JS_TAG_INT: {
+      int32_t i = JS_VALUE_GET_INT(value);
+
+      dbuf_putc(db, DICT_INT);
+      dict_varint_put(db, ((uint32_t)i << 1) ^ (uint32_t)(i >> 31));
+      return 0;
+    }
+
+    case JS_TAG_STRING: {
+      const char* str;
+      size_t len;
+
+      if(!(str = JS_ToCStringLen(ctx, &len, value)))
+        return -1;
+
+      dbuf_putc(db, DICT_STRING);
+      dict_varint_put(db, len);
+      dbuf_put(db, (const uint8_t*)str, len);
+      JS_FreeCString(ctx, str);
+      return 0;
+    }
+
+    case JS_TAG_OBJECT: {
+      if(JS_IsArray(ctx, value) == TRUE) {
+        int64_t i, len = js_array_length(ctx, value);
+
+        dbuf_putc(db, DICT_ARRAY);
+        dict_varint_put(db, len);
+
+        for(i = 0; i < len; i++) {
+          JSValue item = JS_GetPropertyUint32(ctx, value, i);
+          int r = JS_IsException(item) ? -1 : dict_encode_value(ctx, d, db, item, depth + 1);
+
+          JS_FreeValue(ctx, item);
+
+          if(r == -1)
+            return -1;
+        }
+
+        return 0;
+      }
+
+      if(dict_is_record(ctx, d, value)) {
+        JSPropertyEnum* tab;
+        uint32_t i, n, hash;
+        int32_t id;
+
+        if(JS_GetOwnPropertyNames(ctx, &tab, &n, value, JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY))
+          return -1;
+
+        hash = 0x811c9dc5;
+
+        for(i = 0; i < n; i++)
+          hash = (hash ^ tab[i].atom) * 0x01000193;
+
+        if((id = dict_shape_find(d, tab, n, hash)) != -1) {
+          dbuf_putc(db, DICT_SHAPE_REF);
+          dict_varint_put(db, id);
+        } else {
+          BOOL store = dict_shapes_count(&d->wshapes) < d->max_shapes;
+
+          dbuf_putc(db, store ? DICT_SHAPE_NEW : DICT_SHAPE_INLINE);
+          dict_varint_put(db, n);
+
+          for(i = 0; i < n; i++)
+            if(dict_put_atom(ctx, db, tab[i].atom) == -1) {
+              js_propertyenums_free(ctx, tab, n);
+              return -1;
+            }
+
+          if(store) {
+            DictShape shape = {hash, n, js_malloc(ctx, MAX_NUM(n, 1) * sizeof(JSAtom))};
+
+            if(!shape.atoms) {
+              js_propertyenums_free(ctx, tab, n);
+              return -1;
+            }
+
+            for(i = 0; i < n; i++)
+              shape.atoms[i] = JS_DupAtom(ctx, tab[i].atom);
+
+            d->last = dict_shapes_count(&d->wshapes);
+            vector_push(&d->wshapes, shape);
+          }
+        }
+
+        for(i = 0; i < n; i++) {
+          JSValue item = JS_GetProperty(ctx, value, tab[i].atom);
+          int r = JS_IsException(item) ? -1 : dict_encode_value(ctx, d, db, item, depth + 1);
+
+          JS_FreeValue(ctx, item);
+
+          if(r == -1) {
+            js_propertyenums_free(ctx, tab, n);
+            return -1;
+          }
+        }
+
+        js_propertyenums_free(ctx, tab, n);
+        return 0;
+      }
+
+      break;
+    }
+  }
+
+  /* anything else keeps the plain bjson encoding */
+  {
+    uint8_t* buf;
+    size_t len;
+
+    if(!(buf = JS_WriteObject(ctx, &len, value, 0)))
+      return -1;
+
+    dbuf_putc(db, DICT_BJSON);
+    dict_varint_put(db, len);
+    dbuf_put(db, buf, len);
+    js_free(ctx, buf);
+  }
+
+  return 0;
+}
+
+/**
+ * Encodes \p value using the shapes of \p d. When encoding fails the
+ * shapes added by this message are dropped again, so the session stays in
+ * step with the reader.
+ */
+static uint8_t*
+dict_encode(JSContext* ctx, Dictionary* d, JSValueConst value, size_t* plen) {
+  DynBuf db;
+  uint32_t nshapes = dict_shapes_count(&d->wshapes);
+
+  js_dbuf_init(ctx, &db);
+
+  if(dict_encode_value(ctx, d, &db, value, 0) == -1 || db.error) {
+    if(db.error)
+      JS_ThrowOutOfMemory(ctx);
+
+    dict_shapes_truncate(JS_GetRuntime(ctx), &d->wshapes, nshapes);
+    d->last = 0;
+    dbuf_free(&db);
+    return 0;
+  }
+
+  *plen = db.size;
+  return db.buf;
+}
+
+typedef struct {
+  const uint8_t *ptr, *end;
+} DictReader;
+
+static int
+dict_get_varint(JSContext* ctx, DictReader* rd, uint64_t* n) {
+  int r;
+
+  if((r = frame_prefix_get(rd->ptr, rd->end - rd->ptr, n)) <= 0) {
+    JS_ThrowRangeError(ctx, "truncated dictionary message");
+    return -1;
+  }
+
+  rd->ptr += r;
+  return 0;
+}
+
+/**
+ * Reads a length and checks that it leaves at least \p n * \p unit bytes
+ */
+static int
+dict_get_length(JSContext* ctx, DictReader* rd, uint64_t* n, size_t unit) {
+  if(dict_get_varint(ctx, rd, n) == -1)
+    return -1;
+
+  if(*n > (uint64_t)(rd->end - rd->ptr) / unit) {
+    JS_ThrowRangeError(ctx, "truncated dictionary message");
+    return -1;
+  }
+
+  return 0;
+}
+
+static JSAtom*
+dict_get_atoms(JSContext* ctx, DictReader* rd, uint32_t* pn) {
+  uint64_t i, n, len;
+  JSAtom* atoms;
+
+  if(dict_get_length(ctx, rd, &n, 1) == -1)
+    return 0;
+
+  if(!(atoms = js_malloc(ctx, MAX_NUM(n, 1) * sizeof(JSAtom))))
+    return 0;
+
+  for(i = 0; i < n; i++) {
+    if(dict_get_length(ctx, rd, &len, 1) == -1 || (atoms[i] = JS_NewAtomLen(ctx, (const char*)rd->ptr, len)) == JS_ATOM_NULL) {
+      while(i > 0)
+        JS_FreeAtom(ctx, atoms[--i]);
+
+      js_free(ctx, atoms);
+      return 0;
+    }
+
+    rd->ptr += len;
+  }
+
+  *pn = n;
+  return atoms;
+}
+
+static JSValue dict_decode_value(JSContext*, Dictionary*, DictReader*, int);
+
+/**
+ * Defines the properties in shape order, so all records of a shape end up
+ * with the same hidden class.
+ */
+static JSValue
+dict_decode_record(JSContext* ctx, Dictionary* d, DictReader* rd, JSAtom* atoms, uint32_t n, int depth) {
+  JSValue obj = JS_NewObject(ctx);
+  uint32_t i;
+
+  if(JS_IsException(obj))
+    return obj;
+
+  for(i = 0; i < n; i++) {
+    JSValue item = dict_decode_value(ctx, d, rd, depth + 1);
+
+    if(JS_IsException(item) || JS_DefinePropertyValue(ctx, obj, atoms[i], item, JS_PROP_C_W_E) < 0) {
+      JS_FreeValue(ctx, obj);
+      return JS_EXCEPTION;
+    }
+  }
+
+  return obj;
+}
+
+static JSValue
+dict_decode_value(JSContext* ctx, Dictionary* d, DictReader* rd, int depth) {
+  uint64_t n;
+
+  if(depth > DICT_MAX_DEPTH)
+    return JS_ThrowRangeError(ctx, "nesting exceeds %d levels", DICT_MAX_DEPTH);
+
+  if(rd->ptr >= rd->end)
+    return JS_ThrowRangeError(ctx, "truncated dictionary message");
+
+  switch(*rd->ptr++) {
+    case DICT_UNDEFINED: return JS_UNDEFINED;
+    case DICT_NULL: return JS_NULL;
+    case DICT_FALSE: return JS_FALSE;
+    case DICT_TRUE: return JS_TRUE;
+
+    case DICT_INT: {
+      if(dict_get_varint(ctx, rd, &n) == -1)
+        return JS_EXCEPTION;
+
+      return JS_NewInt32(ctx, (int32_t)((uint32_t)(n >> 1) ^ -(uint32_t)(n & 1)));
+    }
+
+    case DICT_FLOAT: {
+      union {
+        double d;
+        uint64_t u;
+      } u = {0};
+      int i;
+
+      if(rd->end - rd->ptr < 8)
+        return JS_ThrowRangeError(ctx, "truncated dictionary message");
+
+      for(i = 0; i < 8; i++)
+        u.u |= (uint64_t)*rd->ptr++ << (i * 8);
+
+      return JS_NewFloat64(ctx, u.d);
+    }
+
+    case DICT_STRING: {
+      const char* str;
+
+      if(dict_get_length(ctx, rd, &n, 1) == -1)
+        return JS_EXCEPTION;
+
+      str = (const char*)rd->ptr;
+      rd->ptr += n;
+      return JS_NewStringLen(ctx, str, n);
+    }
+
+    case DICT_ARRAY: {
+      JSValue arr;
+      uint64_t i;
+
+      if(dict_get_length(ctx, rd, &n, 1) == -1)
+        return JS_EXCEPTION;
+
+      arr = JS_NewArray(ctx);
+
+      for(i = 0; i < n && !JS_IsException(arr); i++) {
+        JSValue item = dict_decode_value(ctx, d, rd, depth + 1);
+
+        if(JS_IsException(item) || JS_DefinePropertyValueUint32(ctx, arr, i, item, JS_PROP_C_W_E) < 0) {
+          JS_FreeValue(ctx, arr);
+          arr = JS_EXCEPTION;
+        }
+      }
+
+      return arr;
+    }
+
+    case DICT_SHAPE_NEW: {
+      DictShape shape = {0};
+
+      if(!(shape.atoms = dict_get_atoms(ctx, rd, &shape.natoms)))
+        return JS_EXCEPTION;
+
+      vector_push(&d->rshapes, shape);
+
+      return dict_decode_record(ctx, d, rd, shape.atoms, shape.natoms, depth);
+    }
+
+    case DICT_SHAPE_REF: {
+      DictShape* shape;
+
+      if(dict_get_varint(ctx, rd, &n) == -1)
+        return JS_EXCEPTION;
+
+      if(n >= dict_shapes_count(&d->rshapes))
+        return JS_ThrowRangeError(ctx, "unknown shape %" PRIu64, n);
+
+      shape = vector_begin_t(&d->rshapes, DictShape) + n;
+
+      return dict_decode_record(ctx, d, rd, shape->atoms, shape->natoms, depth);
+    }
+
+    case DICT_SHAPE_INLINE: {
+      JSAtom* atoms;
+      uint32_t i, natoms;
+      JSValue obj;
+
+      if(!(atoms = dict_get_atoms(ctx, rd, &natoms)))
+        return JS_EXCEPTION;
+
+      obj = dict_decode_record(ctx, d, rd, atoms, natoms, depth);
+
+      for(i = 0; i < natoms; i++)
+        JS_FreeAtom(ctx, atoms[i]);
+
+      js_free(ctx, atoms);
+      return obj;
+    }
+
+    case DICT_BJSON: {
+      const uint8_t* buf;
+
+      if(dict_get_length(ctx, rd, &n, 1) == -1)
+        return JS_EXCEPTION;
+
+      buf = rd->ptr;
+      rd->ptr += n;
+      return JS_ReadObject(ctx, buf, n, 0);
+    }
+  }
+
+  return JS_ThrowRangeError(ctx, "invalid dictionary tag 0x%02x", rd->ptr[-1]);
+}
+
+static JSValue
+dict_decode(JSContext* ctx, Dictionary* d, const uint8_t* buf, size_t len) {
+  DictReader rd = {buf, buf + len};
+  uint32_t nshapes = dict_shapes_count(&d->rshapes);
+  JSValue ret = dict_decode_value(ctx, d, &rd, 0);
+
+  if(JS_IsException(ret))
+    dict_shapes_truncate(JS_GetRuntime(ctx), &d->rshapes, nshapes);
+
+  return ret;
+}
+
+static inline Dictionary*
+js_dictionary_data(JSValueConst value) {
+  return JS_GetOpaque(value, js_dictionary_class_id);
+}
+
+/**
+ * Serializes \p obj behind its varint length. The JS_WriteObject() buffer
+ * is grown in place, so the frame is not copied a second time.
+ */
+static uint8_t*
+frame_encode(JSContext* ctx, JSValueConst obj, int flags, Dictionary* d, size_t* plen) {
+  uint8_t *buf, *frame;
+  size_t len, prefix;
+
+  if(!(buf = d ? dict_encode(ctx, d, obj, &len) : JS_WriteObject(ctx, &len, obj, flags)))
+    return 0;
+
+  prefix = frame_prefix_length(len);
+
+  if(!(frame = js_realloc(ctx, buf, len + prefix))) {
+    js_free(ctx, buf);
+    return 0;
+  }
+
+  memmove(frame + prefix, frame, len);
+  frame_prefix_put(frame, len);
+
+  *plen = len + prefix;
+  return frame;
+}
+
+static void
+frame_chunk_release(Chunk* ch) {
+  js_free_rt(*(JSRuntime**)ch->opaque, ch->data);
+}
+
+static void
+frame_free_buffer(JSRuntime* rt, void* opaque, void* ptr) {
+  js_free_rt(rt, ptr);
+}
+
+/**
+ * Decodes the next complete frame from \p q.
+ *
+ * @return  1 when a message was stored in \p pmsg, 0 when more bytes are
+ *          needed, -1 on error
+ */
+static int
+frame_decode(JSContext* ctx, Queue* q, int flags, Dictionary* d, uint64_t max_length, JSValue* pmsg) {
+  uint8_t prefix[FRAME_PREFIX_MAX], *buf;
+  uint64_t len;
+  int r;
+  Chunk* ch;
+
+  if((r = frame_prefix_get(prefix, queue_peek(q, prefix, sizeof(prefix)), &len)) <= 0) {
+    if(r == -1)
+      JS_ThrowRangeError(ctx, "invalid frame length");
+
+    return r;
+  }
+
+  if(len > max_length) {
+    JS_ThrowRangeError(ctx, "frame of %" PRIu64 " bytes exceeds maxLength", len);
+    return -1;
+  }
+
+  if(queue_size(q) < r + len)
+    return 0;
+
+  queue_skip(q, r);
+
+  /* read in place when the frame does not straddle chunks */
+  if((ch = queue_tail(q)) && ch->size - ch->pos >= len) {
+    *pmsg = d ? dict_decode(ctx, d, ch->data + ch->pos, len) : JS_ReadObject(ctx, ch->data + ch->pos, len, flags);
+    queue_skip(q, len);
+  } else {
+    if(!(buf = js_malloc(ctx, MAX_NUM(len, 1))))
+      return -1;
+
+    queue_read(q, buf, len);
+    *pmsg = d ? dict_decode(ctx, d, buf, len) : JS_ReadObject(ctx, buf, len, flags);
+    js_free(ctx, buf);
+  }
+
+  return JS_IsException(*pmsg) ? -1 : 1;
+}
+
 static JSValue
 js_bjson_read(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
   uint8_t* buf;
@@ -68,18 +757,419 @@ js_bjson_write(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst arg
   buf = JS_WriteObject(ctx, &len, argv[0], flags);
   if(!buf)
     return JS_EXCEPTION;
-  array = JS_NewArrayBufferCopy(ctx, buf, len);
-  js_free(ctx, buf);
+  /* the ArrayBuffer takes over the buffer */
+  array = JS_NewArrayBuffer(ctx, buf, len, frame_free_buffer, 0, FALSE);
   return array;
 }
 
+/**
+ * writeFrame(obj, reference, target): encodes a length-prefixed frame.
+ * Passing a Dictionary as \p reference selects the dictionary encoding.
+ * Without a target the frame is returned as an ArrayBuffer. A Queue takes
+ * the frame as a chunk without copying. A stream controller gets it via
+ * enqueue(), a writer via write(), whose promise is returned for
+ * backpressure.
+ */
+static JSValue
+js_bjson_write_frame(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  uint8_t* frame;
+  size_t len;
+  Queue* q;
+  Dictionary* d = argc > 1 ? js_dictionary_data(argv[1]) : 0;
+  JSValue buffer, ret;
+  int flags = 0;
+
+  if(!d && argc > 1 && JS_ToBool(ctx, argv[1]))
+    flags |= JS_WRITE_OBJ_REFERENCE;
+
+  if(!(frame = frame_encode(ctx, argv[0], flags, d, &len)))
+    return JS_EXCEPTION;
+
+  if(argc > 2 && (q = js_queue_data(argv[2]))) {
+    Chunk* ch;
+
+    if(!(ch = chunk_external(frame, len, frame_chunk_release, sizeof(JSRuntime*)))) {
+      js_free(ctx, frame);
+      return JS_ThrowOutOfMemory(ctx);
+    }
+
+    *(JSRuntime**)ch->opaque = JS_GetRuntime(ctx);
+    queue_put(q, ch);
+
+    return JS_NewInt64(ctx, len);
+  }
+
+  buffer = JS_NewArrayBuffer(ctx, frame, len, frame_free_buffer, 0, FALSE);
+
+  if(argc < 3 || !JS_IsObject(argv[2]))
+    return buffer;
+
+  if(js_has_propertystr(ctx, argv[2], "enqueue")) {
+    JSValue args[2] = {buffer, JS_NewObject(ctx)};
+
+    JS_SetPropertyStr(ctx, args[1], "copy", JS_FALSE);
+    ret = js_invoke(ctx, argv[2], "enqueue", countof(args), args);
+    JS_FreeValue(ctx, args[1]);
+  } else {
+    ret = js_invoke(ctx, argv[2], "write", 1, &buffer);
+  }
+
+  JS_FreeValue(ctx, buffer);
+  return ret;
+}
+
+static JSValue
+js_frame_decoder_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  FrameDecoder* dec;
+  JSValue proto, obj = JS_UNDEFINED;
+  int argi = 0;
+
+  if(!(dec = js_mallocz(ctx, sizeof(FrameDecoder))))
+    return JS_EXCEPTION;
+
+  queue_init(&dec->q);
+  dec->max_length = FRAME_DEFAULT_MAX_LENGTH;
+  dec->callback = JS_UNDEFINED;
+  dec->dictionary = JS_UNDEFINED;
+
+  if(argi < argc && JS_IsFunction(ctx, argv[argi]))
+    dec->callback = JS_DupValue(ctx, argv[argi++]);
+
+  if(argi < argc && JS_IsObject(argv[argi])) {
+    if(js_get_propertystr_bool(ctx, argv[argi], "reference"))
+      dec->flags |= JS_READ_OBJ_REFERENCE;
+
+    if(js_has_propertystr(ctx, argv[argi], "maxLength"))
+      dec->max_length = js_get_propertystr_uint64(ctx, argv[argi], "maxLength");
+
+    dec->dictionary = JS_GetPropertyStr(ctx, argv[argi], "dictionary");
+
+    if(!JS_IsUndefined(dec->dictionary) && !js_dictionary_data(dec->dictionary)) {
+      JS_ThrowTypeError(ctx, "options.dictionary must be a Dictionary");
+      goto fail;
+    }
+  }
+
+  /* using new_target to get the prototype is necessary when the class is extended. */
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  if(JS_IsException(proto))
+    goto fail;
+
+  obj = JS_NewObjectProtoClass(ctx, proto, js_frame_decoder_class_id);
+  JS_FreeValue(ctx, proto);
+  if(JS_IsException(obj))
+    goto fail;
+
+  JS_SetOpaque(obj, dec);
+  return obj;
+
+fail:
+  JS_FreeValue(ctx, dec->callback);
+  JS_FreeValue(ctx, dec->dictionary);
+  js_free(ctx, dec);
+  JS_FreeValue(ctx, obj);
+  return JS_EXCEPTION;
+}
+
+static int
+js_frame_decoder_push(JSContext* ctx, FrameDecoder* dec, JSValueConst chunk) {
+  InputBuffer input = js_input_chars(ctx, chunk);
+  ssize_t r = input_buffer_length(&input) ? queue_write(&dec->q, input_buffer_data(&input), input_buffer_length(&input)) : 0;
+
+  input_buffer_free(&input, ctx);
+
+  if(r == -1) {
+    JS_ThrowOutOfMemory(ctx);
+    return -1;
+  }
+
+  return 0;
+}
+
+static JSValue
+js_frame_decoder_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  FrameDecoder* dec;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(dec = JS_GetOpaque2(ctx, this_val, js_frame_decoder_class_id)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case FRAME_DECODER_PUSH: {
+      int i;
+
+      for(i = 0; i < argc; i++)
+        if(js_frame_decoder_push(ctx, dec, argv[i]) == -1)
+          return JS_EXCEPTION;
+
+      ret = JS_NewInt64(ctx, queue_size(&dec->q));
+      break;
+    }
+
+    /* next([queue]) decodes from the internal queue or a Queue object */
+    case FRAME_DECODER_NEXT: {
+      Queue* q = argc > 0 ? js_queue_data(argv[0]) : 0;
+      JSValue msg;
+      int r;
+
+      if((r = frame_decode(ctx, q ? q : &dec->q, dec->flags, js_dictionary_data(dec->dictionary), dec->max_length, &msg)) == -1)
+        return JS_EXCEPTION;
+
+      ret = r ? msg : JS_UNDEFINED;
+      break;
+    }
+
+    /* write(chunk) of a WritableStream sink, so readable.pipeTo(new
+       WritableStream(decoder)) decodes a stream. Pending callback
+       promises are returned to hold the pipe back. */
+    case FRAME_DECODER_WRITE: {
+      JSValue msg, result, promises = JS_UNDEFINED;
+      uint32_t npromises = 0;
+      int r;
+
+      if(argc > 0 && js_frame_decoder_push(ctx, dec, argv[0]) == -1)
+        return JS_EXCEPTION;
+
+      while((r = frame_decode(ctx, &dec->q, dec->flags, js_dictionary_data(dec->dictionary), dec->max_length, &msg)) == 1) {
+        if(!JS_IsFunction(ctx, dec->callback)) {
+          JS_FreeValue(ctx, msg);
+          continue;
+        }
+
+        result = JS_Call(ctx, dec->callback, this_val, 1, &msg);
+        JS_FreeValue(ctx, msg);
+
+        if(JS_IsException(result)) {
+          JS_FreeValue(ctx, promises);
+          return JS_EXCEPTION;
+        }
+
+        if(js_is_promise(ctx, result)) {
+          if(npromises == 0)
+            promises = JS_NewArray(ctx);
+
+          JS_SetPropertyUint32(ctx, promises, npromises++, result);
+        } else {
+          JS_FreeValue(ctx, result);
+        }
+      }
+
+      if(r == -1) {
+        JS_FreeValue(ctx, promises);
+        return JS_EXCEPTION;
+      }
+
+      if(npromises) {
+        JSValue all = js_global_static_func(ctx, "Promise", "all");
+
+        ret = JS_Call(ctx, all, JS_UNDEFINED, 1, &promises);
+        JS_FreeValue(ctx, all);
+        JS_FreeValue(ctx, promises);
+      }
+
+      break;
+    }
+
+    case FRAME_DECODER_CLOSE: {
+      if(queue_size(&dec->q))
+        return JS_ThrowRangeError(ctx, "stream ended within a frame (%zu bytes pending)", queue_size(&dec->q));
+
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static JSValue
+js_frame_decoder_pending(JSContext* ctx, JSValueConst this_val) {
+  FrameDecoder* dec;
+
+  if(!(dec = JS_GetOpaque2(ctx, this_val, js_frame_decoder_class_id)))
+    return JS_EXCEPTION;
+
+  return JS_NewInt64(ctx, queue_size(&dec->q));
+}
+
+static void
+js_frame_decoder_finalizer(JSRuntime* rt, JSValue val) {
+  FrameDecoder* dec;
+
+  if((dec = JS_GetOpaque(val, js_frame_decoder_class_id))) {
+    queue_clear(&dec->q);
+    JS_FreeValueRT(rt, dec->callback);
+    JS_FreeValueRT(rt, dec->dictionary);
+    js_free_rt(rt, dec);
+  }
+}
+
+static JSClassDef js_frame_decoder_class = {
+    .class_name = "FrameDecoder",
+    .finalizer = js_frame_decoder_finalizer,
+};
+
+static const JSCFunctionListEntry js_frame_decoder_proto_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("push", 1, js_frame_decoder_method, FRAME_DECODER_PUSH),
+    JS_CFUNC_MAGIC_DEF("next", 0, js_frame_decoder_method, FRAME_DECODER_NEXT),
+    JS_CFUNC_MAGIC_DEF("write", 1, js_frame_decoder_method, FRAME_DECODER_WRITE),
+    JS_CFUNC_MAGIC_DEF("close", 0, js_frame_decoder_method, FRAME_DECODER_CLOSE),
+    JS_CGETSET_DEF("pending", js_frame_decoder_pending, 0),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "FrameDecoder", JS_PROP_CONFIGURABLE),
+};
+
+static JSValue
+js_dictionary_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  Dictionary* d;
+  JSValue proto, obj = JS_UNDEFINED;
+
+  if(!(d = js_mallocz(ctx, sizeof(Dictionary))))
+    return JS_EXCEPTION;
+
+  vector_init_rt(&d->wshapes, JS_GetRuntime(ctx));
+  vector_init_rt(&d->rshapes, JS_GetRuntime(ctx));
+  d->max_shapes = DICT_DEFAULT_MAX_SHAPES;
+  d->object_proto = js_global_prototype(ctx, "Object");
+
+  if(argc > 0 && JS_IsObject(argv[0]) && js_has_propertystr(ctx, argv[0], "maxShapes"))
+    d->max_shapes = MIN_NUM(js_get_propertystr_uint64(ctx, argv[0], "maxShapes"), UINT32_MAX);
+
+  /* using new_target to get the prototype is necessary when the class is extended. */
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  if(JS_IsException(proto))
+    goto fail;
+
+  obj = JS_NewObjectProtoClass(ctx, proto, js_dictionary_class_id);
+  JS_FreeValue(ctx, proto);
+  if(JS_IsException(obj))
+    goto fail;
+
+  JS_SetOpaque(obj, d);
+  return obj;
+
+fail:
+  JS_FreeValue(ctx, d->object_proto);
+  js_free(ctx, d);
+  JS_FreeValue(ctx, obj);
+  return JS_EXCEPTION;
+}
+
+static JSValue
+js_dictionary_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  Dictionary* d;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(d = JS_GetOpaque2(ctx, this_val, js_dictionary_class_id)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case DICTIONARY_WRITE: {
+      uint8_t* buf;
+      size_t len;
+
+      if(!(buf = dict_encode(ctx, d, argv[0], &len)))
+        return JS_EXCEPTION;
+
+      ret = JS_NewArrayBuffer(ctx, buf, len, frame_free_buffer, 0, FALSE);
+      break;
+    }
+
+    case DICTIONARY_READ: {
+      InputBuffer input = js_input_buffer(ctx, argv[0]);
+      OffsetLength ol = OFFSET_INIT();
+
+      if(!input_buffer_valid(&input))
+        return JS_ThrowTypeError(ctx, "argument 1 must be an ArrayBuffer or typed array");
+
+      js_offset_length(ctx, input_buffer_length(&input), argc - 1, argv + 1, &ol);
+
+      ret = dict_decode(ctx, d, offset_data(&ol, input_buffer_data(&input)), offset_size(&ol, input_buffer_length(&input)));
+      input_buffer_free(&input, ctx);
+      break;
+    }
+
+    /* both ends have to reset at the same message boundary */
+    case DICTIONARY_RESET: {
+      JSRuntime* rt = JS_GetRuntime(ctx);
+
+      dict_shapes_truncate(rt, &d->wshapes, 0);
+      dict_shapes_truncate(rt, &d->rshapes, 0);
+      d->last = 0;
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static JSValue
+js_dictionary_size(JSContext* ctx, JSValueConst this_val) {
+  Dictionary* d;
+
+  if(!(d = JS_GetOpaque2(ctx, this_val, js_dictionary_class_id)))
+    return JS_EXCEPTION;
+
+  return JS_NewUint32(ctx, dict_shapes_count(&d->wshapes));
+}
+
+static void
+js_dictionary_finalizer(JSRuntime* rt, JSValue val) {
+  Dictionary* d;
+
+  if((d = JS_GetOpaque(val, js_dictionary_class_id))) {
+    dict_shapes_truncate(rt, &d->wshapes, 0);
+    dict_shapes_truncate(rt, &d->rshapes, 0);
+    vector_free(&d->wshapes);
+    vector_free(&d->rshapes);
+    JS_FreeValueRT(rt, d->object_proto);
+    js_free_rt(rt, d);
+  }
+}
+
+static JSClassDef js_dictionary_class = {
+    .class_name = "Dictionary",
+    .finalizer = js_dictionary_finalizer,
+};
+
+static const JSCFunctionListEntry js_dictionary_proto_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("write", 1, js_dictionary_method, DICTIONARY_WRITE),
+    JS_CFUNC_MAGIC_DEF("read", 1, js_dictionary_method, DICTIONARY_READ),
+    JS_CFUNC_MAGIC_DEF("reset", 0, js_dictionary_method, DICTIONARY_RESET),
+    JS_CGETSET_DEF("size", js_dictionary_size, 0),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Dictionary", JS_PROP_CONFIGURABLE),
+};
+
 static const JSCFunctionListEntry js_bjson_funcs[] = {
     JS_CFUNC_DEF("read", 4, js_bjson_read),
     JS_CFUNC_DEF("write", 2, js_bjson_write),
+    JS_CFUNC_DEF("writeFrame", 3, js_bjson_write_frame),
 };
 
 static int
 js_bjson_init(JSContext* ctx, JSModuleDef* m) {
+  JS_NewClassID(&js_frame_decoder_class_id);
+  JS_NewClass(JS_GetRuntime(ctx), js_frame_decoder_class_id, &js_frame_decoder_class);
+
+  frame_decoder_proto = JS_NewObject(ctx);
+  JS_SetPropertyFunctionList(ctx, frame_decoder_proto, js_frame_decoder_proto_funcs, countof(js_frame_decoder_proto_funcs));
+  JS_SetClassProto(ctx, js_frame_decoder_class_id, frame_decoder_proto);
+
+  frame_decoder_ctor = JS_NewCFunction2(ctx, js_frame_decoder_constructor, "FrameDecoder", 2, JS_CFUNC_constructor, 0);
+  JS_SetConstructor(ctx, frame_decoder_ctor, frame_decoder_proto);
+
+  JS_SetModuleExport(ctx, m, "FrameDecoder", frame_decoder_ctor);
+
+  JS_NewClassID(&js_dictionary_class_id);
+  JS_NewClass(JS_GetRuntime(ctx), js_dictionary_class_id, &js_dictionary_class);
+
+  dictionary_proto = JS_NewObject(ctx);
+  JS_SetPropertyFunctionList(ctx, dictionary_proto, js_dictionary_proto_funcs, countof(js_dictionary_proto_funcs));
+  JS_SetClassProto(ctx, js_dictionary_class_id, dictionary_proto);
+
+  dictionary_ctor = JS_NewCFunction2(ctx, js_dictionary_constructor, "Dictionary", 1, JS_CFUNC_constructor, 0);
+  JS_SetConstructor(ctx, dictionary_ctor, dictionary_proto);
+
+  JS_SetModuleExport(ctx, m, "Dictionary", dictionary_ctor);
+
   return JS_SetModuleExportList(ctx, m, js_bjson_funcs, countof(js_bjson_funcs));
 }
 
@@ -95,6 +1185,8 @@ JS_INIT_MODULE(JSContext* ctx, const char* module_name) {
 
   if((m = JS_NewCModule(ctx, module_name, js_bjson_init))) {
     JS_AddModuleExportList(ctx, m, js_bjson_funcs, countof(js_bjson_funcs));
+    JS_AddModuleExport(ctx, m, "FrameDecoder");
+    JS_AddModuleExport(ctx, m, "Dictionary");
   }
 
   return m;
@@ -3,6 +3,15 @@
 #include "utils.h"
 #include "buffer-utils.h"
 #include "debug.h"
+#include "quickjs-stream.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 /**
  * \addtogroup quickjs-blob
@@ -23,12 +32,53 @@ enum {
   BLOB_TEXT,
 };
 
+#define BLOB_CHUNK_SIZE 65536
+#define BLOB_MMAP_THRESHOLD (1 << 20)
+
+static BlobSource*
+blob_source_new(JSContext* ctx, int fd, uint64_t size) {
+  BlobSource* src;
+
+  if((src = js_mallocz(ctx, sizeof(BlobSource)))) {
+    src->ref_count = 1;
+    src->fd = fd;
+    src->size = size;
+  }
+
+  return src;
+}
+
+static void
+blob_source_free(JSRuntime* rt, BlobSource* src) {
+  if(--src->ref_count == 0) {
+    if(src->fd != -1)
+      close(src->fd);
+
+    if(src->data)
+      js_free_rt(rt, src->data);
+
+    js_free_rt(rt, src);
+  }
+}
+
+static BOOL
+blob_push(Blob* blob, BlobSource* src, uint64_t offset, uint64_t length) {
+  BlobPiece piece = {src, offset, length};
+
+  if(!vector_push(&blob->pieces, piece))
+    return FALSE;
+
+  src->ref_count++;
+  blob->size += length;
+  return TRUE;
+}
+
 void
 blob_init(JSContext* ctx, Blob* blob, const void* x, size_t len, const char* type) {
-  // blob->vec = VECTOR(ctx);
   blob->type = type ? js_strdup(ctx, type) : 0;
+  blob->size = 0;
 
-  js_dbuf_allocator(ctx, &blob->vec.dbuf);
+  vector_init_rt(&blob->pieces, JS_GetRuntime(ctx));
 
   if(x && len)
     blob_write(ctx, blob, x, len);
@@ -46,32 +96,373 @@ blob_new(JSContext* ctx, const void* x, size_t len, const char* type) {
   return blob;
 }
 
+/**
+ * Takes ownership of \p fd, its contents are only read on demand.
+ */
+Blob*
+blob_fromfd(JSContext* ctx, int fd, const char* type) {
+  Blob* blob;
+  BlobSource* src;
+  struct stat st;
+
+  if(fstat(fd, &st) == -1)
+    return 0;
+
+  if(!(blob = blob_new(ctx, 0, 0, type)))
+    return 0;
+
+  if(!(src = blob_source_new(ctx, fd, st.st_size))) {
+    blob_free(JS_GetRuntime(ctx), blob);
+    return 0;
+  }
+
+  if(st.st_size > 0)
+    blob_push(blob, src, 0, st.st_size);
+
+  blob_source_free(JS_GetRuntime(ctx), src);
+
+  return blob;
+}
+
+/**
+ * Appends bytes to the blob. Consecutive writes grow the same memory
+ * source as long as no other piece or buffer refers to it.
+ */
 ssize_t
 blob_write(JSContext* ctx, Blob* blob, const void* x, size_t len) {
-  if(dbuf_put(&blob->vec.dbuf, x, len))
+  BlobPiece* last = blob_npieces(blob) ? vector_back(&blob->pieces, sizeof(BlobPiece)) : 0;
+  BlobSource* src;
+  uint8_t* data;
+  BOOL ok;
+
+  if(len == 0)
+    return 0;
+
+  if(last && (src = last->source)->fd == -1 && src->ref_count == 1 && last->offset + last->length == src->size) {
+    if(!(data = js_realloc(ctx, src->data, src->size + len)))
+      return -1;
+
+    memcpy(data + src->size, x, len);
+    src->data = data;
+    src->size += len;
+    last->length += len;
+    blob->size += len;
+    return len;
+  }
+
+  if(!(src = blob_source_new(ctx, -1, len)))
+    return -1;
+
+  if(!(src->data = js_malloc(ctx, len))) {
+    js_free(ctx, src);
     return -1;
+  }
+
+  memcpy(src->data, x, len);
+
+  ok = blob_push(blob, src, 0, len);
+  blob_source_free(JS_GetRuntime(ctx), src);
+
+  return ok ? (ssize_t)len : -1;
+}
+
+/**
+ * Appends the range [start, end) of \p other, sharing its sources.
+ */
+BOOL
+blob_append(JSContext* ctx, Blob* blob, Blob const* other, uint64_t start, uint64_t end) {
+  BlobPiece* piece;
+  uint64_t pos = 0;
+
+  vector_foreach_t(&other->pieces, piece) {
+    uint64_t s = MAX_NUM(start, pos), e = MIN_NUM(end, pos + piece->length);
+
+    if(s < e)
+      if(!blob_push(blob, piece->source, piece->offset + (s - pos), e - s))
+        return FALSE;
 
-  return len;
+    if((pos += piece->length) >= end)
+      break;
+  }
+
+  return TRUE;
+}
+
+/**
+ * Copies up to \p len bytes starting at \p offset into \p buf, reading
+ * file-backed pieces with pread().
+ *
+ * @return  number of bytes copied, less than requested at the end of the
+ *          blob or when a file shrunk, -1 on a read error
+ */
+ssize_t
+blob_read(Blob const* blob, uint64_t offset, void* buf, size_t len) {
+  BlobPiece* piece;
+  uint64_t pos = 0;
+  size_t n = 0;
+
+  vector_foreach_t(&blob->pieces, piece) {
+    if(n == len)
+      break;
+
+    if(offset < pos + piece->length) {
+      uint64_t from = piece->offset + (offset - pos);
+      size_t count = MIN_NUM(len - n, piece->length - (offset - pos));
+
+      if(piece->source->fd == -1) {
+        memcpy((uint8_t*)buf + n, piece->source->data + from, count);
+      } else {
+        size_t done = 0;
+
+        while(done < count) {
+#ifdef _WIN32
+          ssize_t r = lseek(piece->source->fd, from + done, SEEK_SET) == -1 ? -1 : read(piece->source->fd, (uint8_t*)buf + n + done, count - done);
+#else
+          ssize_t r = pread(piece->source->fd, (uint8_t*)buf + n + done, count - done, from + done);
+#endif
+          if(r == -1 && errno == EINTR)
+            continue;
+
+          if(r == -1)
+            return -1;
+
+          if(r == 0)
+            return n + done;
+
+          done += r;
+        }
+      }
+
+      n += count;
+      offset += count;
+    }
+
+    pos += piece->length;
+  }
+
+  return n;
 }
 
 void
 blob_free(JSRuntime* rt, Blob* blob) {
-  if(blob->vec.data)
-    dbuf_free(&blob->vec.dbuf);
+  BlobPiece* piece;
+
+  vector_foreach_t(&blob->pieces, piece) { blob_source_free(rt, piece->source); }
+  vector_free(&blob->pieces);
+
+  if(blob->type)
+    js_free_rt(rt, blob->type);
 
   js_free_rt(rt, blob);
 }
 
+static void
+js_blob_free_func(JSRuntime* rt, void* opaque, void* ptr) {
+  js_free_rt(rt, ptr);
+}
+
+static void
+js_blob_free_source(JSRuntime* rt, void* opaque, void* ptr) {
+  blob_source_free(rt, opaque);
+}
+
+/**
+ * Reads the whole blob into a new buffer.
+ */
+static uint8_t*
+blob_flatten(JSContext* ctx, Blob* blob) {
+  uint8_t* buf;
+  ssize_t r;
+
+  if(blob->size > INT32_MAX) {
+    JS_ThrowRangeError(ctx, "Blob of %" PRIu64 " bytes is too large, use stream() or slice()", blob->size);
+    return 0;
+  }
+
+  if(!(buf = js_malloc(ctx, MAX_NUM(blob->size, 1))))
+    return 0;
+
+  if((r = blob_read(blob, 0, buf, blob->size)) != (ssize_t)blob->size) {
+    js_free(ctx, buf);
+
+    if(r == -1)
+      JS_ThrowInternalError(ctx, "pread() failed: %s", strerror(errno));
+    else
+      JS_ThrowInternalError(ctx, "Blob file shrunk to %zd bytes", r);
+    return 0;
+  }
+
+  return buf;
+}
+
 InputBuffer
 blob_input(JSContext* ctx, Blob* blob) {
-  InputBuffer ret = {{{blob->data, blob->size}}, 0, &input_buffer_free_default, JS_UNDEFINED, {0, INT64_MAX}};
+  InputBuffer ret = {{{blob_data(blob), blob->size}}, 0, &input_buffer_free_default, JS_UNDEFINED, {0, INT64_MAX}};
+
+  if(!ret.data && blob->size) {
+    uint8_t* buf;
+
+    if((buf = blob_flatten(ctx, blob))) {
+      ret.value = JS_NewArrayBuffer(ctx, buf, blob->size, js_blob_free_func, 0, FALSE);
+      ret.data = buf;
+    } else {
+      ret.size = 0;
+    }
+  }
 
   return ret;
 }
 
+#ifndef _WIN32
+typedef struct {
+  void* base;
+  size_t length;
+} BlobMapping;
+
 static void
-js_blob_free_func(JSRuntime* rt, void* opaque, void* ptr) {
-  // js_free_rt(rt, ptr);
+js_blob_unmap(JSRuntime* rt, void* opaque, void* ptr) {
+  BlobMapping* map = opaque;
+
+  munmap(map->base, map->length);
+  js_free_rt(rt, map);
+}
+
+/**
+ * Maps a file-backed piece copy-on-write, so large files are paged in only
+ * as the buffer is accessed. Returns undefined when mapping is not possible.
+ */
+static JSValue
+js_blob_map(JSContext* ctx, BlobPiece const* piece) {
+  uint64_t start = piece->offset - piece->offset % (uint64_t)sysconf(_SC_PAGESIZE);
+  BlobMapping* map;
+  struct stat st;
+
+  /* pages past the end of a shrunk file would fault */
+  if(fstat(piece->source->fd, &st) == -1 || (uint64_t)st.st_size < piece->offset + piece->length)
+    return JS_UNDEFINED;
+
+  if(!(map = js_malloc(ctx, sizeof(BlobMapping))))
+    return JS_EXCEPTION;
+
+  map->length = piece->offset - start + piece->length;
+
+  if((map->base = mmap(0, map->length, PROT_READ | PROT_WRITE, MAP_PRIVATE, piece->source->fd, start)) == MAP_FAILED) {
+    js_free(ctx, map);
+    return JS_UNDEFINED;
+  }
+
+  return JS_NewArrayBuffer(ctx, (uint8_t*)map->base + (piece->offset - start), piece->length, js_blob_unmap, map, FALSE);
+}
+#endif
+
+static JSValue
+js_blob_arraybuffer(JSContext* ctx, Blob* blob) {
+  BlobPiece* piece = blob_npieces(blob) == 1 ? vector_begin(&blob->pieces) : 0;
+  uint8_t* buf;
+
+  if(piece && piece->source->fd == -1) {
+    piece->source->ref_count++;
+    return JS_NewArrayBuffer(ctx, piece->source->data + piece->offset, piece->length, js_blob_free_source, piece->source, FALSE);
+  }
+
+#ifndef _WIN32
+  if(piece && piece->length >= BLOB_MMAP_THRESHOLD && piece->length <= INT32_MAX) {
+    JSValue ret = js_blob_map(ctx, piece);
+
+    if(!JS_IsUndefined(ret))
+      return ret;
+  }
+#endif
+
+  if(!(buf = blob_flatten(ctx, blob)))
+    return JS_EXCEPTION;
+
+  return JS_NewArrayBuffer(ctx, buf, blob->size, js_blob_free_func, 0, FALSE);
+}
+
+typedef struct {
+  JSRuntime* rt;
+  JSValue blob, options;
+  uint64_t pos;
+} BlobReader;
+
+static void
+js_blob_reader_free(void* opaque) {
+  BlobReader* rd = opaque;
+
+  JS_FreeValueRT(rd->rt, rd->blob);
+  JS_FreeValueRT(rd->rt, rd->options);
+  js_free_rt(rd->rt, rd);
+}
+
+/**
+ * pull(controller) of the stream() source: enqueues the next chunk.
+ */
+static JSValue
+js_blob_reader_pull(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* opaque) {
+  BlobReader* rd = opaque;
+  Blob* blob;
+  uint8_t* buf;
+  size_t len;
+  ssize_t r;
+  JSValue args[2], ret;
+
+  if(!(blob = js_blob_data(ctx, rd->blob)))
+    return JS_EXCEPTION;
+
+  if(rd->pos >= blob->size)
+    return js_invoke(ctx, argv[0], "close", 0, 0);
+
+  len = MIN_NUM(blob->size - rd->pos, BLOB_CHUNK_SIZE);
+
+  if(!(buf = js_malloc(ctx, len)))
+    return JS_EXCEPTION;
+
+  if((r = blob_read(blob, rd->pos, buf, len)) <= 0) {
+    js_free(ctx, buf);
+
+    if(r == 0)
+      return js_invoke(ctx, argv[0], "close", 0, 0);
+
+    return JS_ThrowInternalError(ctx, "pread() failed: %s", strerror(errno));
+  }
+
+  rd->pos += r;
+
+  ret = JS_NewArrayBuffer(ctx, buf, r, js_blob_free_func, 0, FALSE);
+  args[0] = js_typedarray_new(ctx, 8, FALSE, FALSE, ret);
+  args[1] = rd->options;
+  JS_FreeValue(ctx, ret);
+
+  ret = js_invoke(ctx, argv[0], "enqueue", countof(args), args);
+  JS_FreeValue(ctx, args[0]);
+
+  return ret;
+}
+
+static JSValue
+js_blob_stream(JSContext* ctx, JSValueConst this_val) {
+  BlobReader* rd;
+  JSValue source, ret;
+
+  if(js_readable_class_id == 0)
+    js_stream_init(ctx, 0);
+
+  if(!(rd = js_mallocz(ctx, sizeof(BlobReader))))
+    return JS_EXCEPTION;
+
+  rd->rt = JS_GetRuntime(ctx);
+  rd->blob = JS_DupValue(ctx, this_val);
+  rd->options = JS_NewObject(ctx);
+  JS_SetPropertyStr(ctx, rd->options, "copy", JS_FALSE);
+
+  source = JS_NewObject(ctx);
+  JS_SetPropertyStr(ctx, source, "pull", js_function_cclosure(ctx, js_blob_reader_pull, 1, 0, rd, js_blob_reader_free));
+
+  ret = js_readable_constructor(ctx, readable_ctor, 1, &source);
+  JS_FreeValue(ctx, source);
+
+  return ret;
 }
 
 JSValue
@@ -91,6 +482,61 @@ js_blob_new(JSContext* ctx, const void* x, size_t len, const char* type) {
   return js_blob_wrap(ctx, blob);
 }
 
+static JSValue
+js_blob_from_file(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  Blob* blob;
+  char* type = 0;
+  int fd;
+
+  if(JS_IsNumber(argv[0])) {
+    int32_t arg = -1;
+
+    JS_ToInt32(ctx, &arg, argv[0]);
+
+#ifdef F_DUPFD_CLOEXEC
+    fd = fcntl(arg, F_DUPFD_CLOEXEC, 0);
+#else
+    fd = dup(arg);
+#endif
+
+    if(fd == -1)
+      return JS_ThrowInternalError(ctx, "dup() failed: %s", strerror(errno));
+  } else {
+    const char* path;
+
+    if(!(path = JS_ToCString(ctx, argv[0])))
+      return JS_EXCEPTION;
+
+#ifdef O_CLOEXEC
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+#else
+    fd = open(path, O_RDONLY);
+#endif
+
+    JS_FreeCString(ctx, path);
+
+    if(fd == -1)
+      return JS_ThrowInternalError(ctx, "open() failed: %s", strerror(errno));
+  }
+
+  if(argc > 1 && JS_IsObject(argv[1]) && js_has_propertystr(ctx, argv[1], "type"))
+    type = js_get_propertystr_string(ctx, argv[1], "type");
+
+  blob = blob_fromfd(ctx, fd, type ? type : "application/octet-stream");
+
+  if(type)
+    js_free(ctx, type);
+
+  if(!blob) {
+    int err = errno;
+
+    close(fd);
+    return JS_ThrowInternalError(ctx, "fstat() failed: %s", strerror(err));
+  }
+
+  return js_blob_wrap(ctx, blob);
+}
+
 static JSValue
 js_blob_get(JSContext* ctx, JSValueConst this_val, int magic) {
   Blob* blob;
@@ -101,7 +547,7 @@ js_blob_get(JSContext* ctx, JSValueConst this_val, int magic) {
 
   switch(magic) {
     case BLOB_SIZE: {
-      ret = JS_NewUint32(ctx, blob->size);
+      ret = JS_NewInt64(ctx, blob->size);
       break;
     }
 
@@ -138,7 +584,6 @@ js_blob_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueCo
   if(JS_IsException(obj))
     goto fail;
 
-  size_t size = 0;
   blob->type = 0;
 
   if(argc >= 1) {
@@ -148,32 +593,31 @@ js_blob_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueCo
 
     if(js_is_array(ctx, argv[0])) {
       uint32_t i, len = js_array_length(ctx, argv[0]);
-      InputBuffer* parts = js_malloc(ctx, sizeof(InputBuffer) * len);
 
+      /* blob parts are referenced as pieces, other parts are copied */
       for(i = 0; i < len; i++) {
         Blob* other;
+        BOOL ok;
         JSValue item = JS_GetPropertyUint32(ctx, argv[0], i);
-        parts[i] = (other = js_blob_data(ctx, item)) ? blob_input(ctx, other) : js_input_chars(ctx, item);
-        size += parts[i].size;
-        JS_FreeValue(ctx, item);
-      }
 
-      for(i = 0; i < len; i++) {
-        if(blob_write(ctx, blob, input_buffer_data(&parts[i]), input_buffer_length(&parts[i])) == -1) {
+        if((other = js_blob_data(ctx, item))) {
+          ok = blob_append(ctx, blob, other, 0, other->size);
+        } else {
+          InputBuffer input = js_input_chars(ctx, item);
+
+          ok = blob_write(ctx, blob, input_buffer_data(&input), input_buffer_length(&input)) != -1;
+          input_buffer_free(&input, ctx);
+        }
 
-          while(i < len)
-            input_buffer_free(&parts[i++], ctx);
+        JS_FreeValue(ctx, item);
 
+        if(!ok) {
+          JS_FreeValue(ctx, obj);
           blob_free(JS_GetRuntime(ctx), blob);
-          js_free(ctx, parts);
           return JS_ThrowInternalError(ctx, "blob_write returned -1");
         }
-
-        input_buffer_free(&parts[i], ctx);
       }
 
-      js_free(ctx, parts);
-
     } else {
       JS_ThrowInternalError(ctx, "argument 1 must be array");
       goto fail;
@@ -197,7 +641,7 @@ js_blob_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueCo
   return obj;
 
 fail:
-  js_free(ctx, blob);
+  blob_free(JS_GetRuntime(ctx), blob);
   JS_FreeValue(ctx, obj);
   return JS_EXCEPTION;
 }
@@ -212,34 +656,37 @@ js_blob_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst arg
 
   switch(magic) {
     case BLOB_ARRAYBUFFER: {
-      ret = js_arraybuffer_fromvalue(ctx, blob->data, blob->size, this_val);
+      ret = js_blob_arraybuffer(ctx, blob);
       break;
     }
 
+    /* O(pieces): the slice references the same sources */
     case BLOB_SLICE: {
-      int64_t n = blob->size, s = 0, e = INT64_MAX;
+      int64_t n = blob->size, s = 0, e = n;
       char* type = 0;
+      Blob* slice;
 
-      if(argc >= 1) {
+      if(argc >= 1 && !JS_IsUndefined(argv[0])) {
         JS_ToInt64(ctx, &s, argv[0]);
-        if(s < 0)
-          s = n + s % n;
-        else if(s > n)
-          s = n;
-
-        if(argc >= 2) {
-          JS_ToInt64(ctx, &e, argv[1]);
-          if(e < 0)
-            e = n + e % n;
-          else if(e > n)
-            e = n;
-
-          if(argc >= 3)
-            type = js_tostring(ctx, argv[2]);
-        }
+        s = s < 0 ? MAX_NUM(n + s, 0) : MIN_NUM(s, n);
       }
 
-      ret = js_blob_new(ctx, &blob->data[s], e - s, type ? type : blob->type);
+      if(argc >= 2 && !JS_IsUndefined(argv[1])) {
+        JS_ToInt64(ctx, &e, argv[1]);
+        e = e < 0 ? MAX_NUM(n + e, 0) : MIN_NUM(e, n);
+      }
+
+      if(argc >= 3)
+        type = js_tostring(ctx, argv[2]);
+
+      if(!(slice = blob_new(ctx, 0, 0, type ? type : blob->type))) {
+        ret = JS_EXCEPTION;
+      } else if(s < e && !blob_append(ctx, slice, blob, s, e)) {
+        blob_free(JS_GetRuntime(ctx), slice);
+        ret = JS_ThrowOutOfMemory(ctx);
+      } else {
+        ret = js_blob_wrap(ctx, slice);
+      }
 
       if(type)
         js_free(ctx, type);
@@ -248,12 +695,21 @@ js_blob_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst arg
     }
 
     case BLOB_STREAM: {
-      ret = JS_UNDEFINED;
+      ret = js_blob_stream(ctx, this_val);
       break;
     }
 
     case BLOB_TEXT: {
-      ret = JS_NewStringLen(ctx, (const char*)blob->data, blob->size);
+      uint8_t* data;
+
+      if((data = blob_data(blob)))
+        return JS_NewStringLen(ctx, (const char*)data, blob->size);
+
+      if(!(data = blob_flatten(ctx, blob)))
+        return JS_EXCEPTION;
+
+      ret = JS_NewStringLen(ctx, (const char*)data, blob->size);
+      js_free(ctx, data);
       break;
     }
   }
@@ -270,7 +726,7 @@ js_blob_inspect(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst ar
 
   JSValue obj = JS_NewObjectClass(ctx, js_blob_class_id);
 
-  JS_DefinePropertyValueStr(ctx, obj, "size", JS_NewUint32(ctx, blob->size), JS_PROP_ENUMERABLE);
+  JS_DefinePropertyValueStr(ctx, obj, "size", JS_NewInt64(ctx, blob->size), JS_PROP_ENUMERABLE);
   JS_DefinePropertyValueStr(ctx, obj, "type", JS_NewString(ctx, blob->type), JS_PROP_ENUMERABLE);
 
   return obj;
@@ -299,6 +755,10 @@ static const JSCFunctionListEntry js_blob_funcs[] = {
     JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Blob", JS_PROP_CONFIGURABLE),
 };
 
+static const JSCFunctionListEntry js_blob_static_funcs[] = {
+    JS_CFUNC_DEF("fromFile", 1, js_blob_from_file),
+};
+
 int
 js_blob_init(JSContext* ctx, JSModuleDef* m) {
 
@@ -314,6 +774,7 @@ js_blob_init(JSContext* ctx, JSModuleDef* m) {
 
   JS_SetClassProto(ctx, js_blob_class_id, blob_proto);
   JS_SetConstructor(ctx, blob_ctor, blob_proto);
+  JS_SetPropertyFunctionList(ctx, blob_ctor, js_blob_static_funcs, countof(js_blob_static_funcs));
 
   js_set_inspect_method(ctx, blob_proto, js_blob_inspect);
 
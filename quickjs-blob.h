@@ -9,35 +9,65 @@
  * \defgroup quickjs-blob quickjs-blob: Blob
  * @{
  */
-typedef union blob {
-  struct {
-    uint8_t* data;
-    size_t size, capacity;
-    BOOL error;
-    DynBufReallocFunc* realloc_func;
-    void* opaque;
-    char* type;
-  };
-  Vector vec;
+
+/** Backing store shared by the pieces of one or more blobs */
+typedef struct blob_source {
+  int ref_count;
+  int fd;        /**< file read lazily with pread(), -1 for memory */
+  uint8_t* data; /**< memory contents */
+  uint64_t size;
+} BlobSource;
+
+typedef struct blob_piece {
+  BlobSource* source;
+  uint64_t offset, length;
+} BlobPiece;
+
+/**
+ * A Blob is a list of pieces, so slicing and concatenation share the
+ * sources instead of copying bytes.
+ */
+typedef struct blob {
+  Vector pieces;
+  uint64_t size;
+  char* type;
 } Blob;
 
 extern VISIBLE JSClassID js_blob_class_id;
 extern VISIBLE JSValue blob_proto, blob_ctor;
 
 Blob* blob_new(JSContext*, const void* x, size_t len, const char* type);
+Blob* blob_fromfd(JSContext*, int fd, const char* type);
 ssize_t blob_write(JSContext*, Blob* blob, const void* x, size_t len);
+BOOL blob_append(JSContext*, Blob* blob, Blob const* other, uint64_t start, uint64_t end);
+ssize_t blob_read(Blob const* blob, uint64_t offset, void* buf, size_t len);
 void blob_free(JSRuntime*, Blob* blob);
 InputBuffer blob_input(JSContext*, Blob* blob);
 
 VISIBLE JSValue js_blob_wrap(JSContext*, Blob* blob);
 VISIBLE JSValue js_blob_new(JSContext*, const void* x, size_t len, const char* type);
 
+static inline size_t
+blob_npieces(Blob const* blob) {
+  return vector_size(&blob->pieces, sizeof(BlobPiece));
+}
+
+/**
+ * @return  pointer to the contents if they are contiguous in memory, else NULL
+ */
 static inline void*
 blob_data(Blob* blob) {
-  return blob->data;
+  BlobPiece* piece;
+
+  if(blob_npieces(blob) != 1)
+    return 0;
+
+  piece = vector_begin(&blob->pieces);
+
+  return piece->source->fd == -1 ? piece->source->data + piece->offset : 0;
 }
 
-static inline size_t
+static inline uint64_t
 blob_size(Blob* blob) {
   return blob->size;
 }
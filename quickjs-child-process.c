@@ -3,6 +3,9 @@
 #include "char-utils.h"
 #include "child-process.h"
 #include "property-enumeration.h"
+#include "js-utils.h"
+#include "buffer-utils.h"
+#include "quickjs-stream.h"
 #include "debug.h"
 
 /**
@@ -15,10 +18,14 @@
 #else
 #include <unistd.h>
 #include <sys/wait.h>
+#include <sys/socket.h>
 #endif
 #include <signal.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
 
 enum {
   CHILD_PROCESS_FILE = 0,
@@ -33,10 +40,14 @@ enum {
   CHILD_PROCESS_SIGNALED,
   CHILD_PROCESS_STOPPED,
   CHILD_PROCESS_CONTINUED,
+  CHILD_PROCESS_STDIN,
+  CHILD_PROCESS_STDOUT,
+  CHILD_PROCESS_STDERR,
 };
 
 VISIBLE JSClassID js_child_process_class_id = 0;
 VISIBLE JSValue child_process_proto = {{0}, JS_TAG_UNDEFINED}, child_process_ctor = {{0}, JS_TAG_UNDEFINED};
+static JSValue process_pool_proto = {{0}, JS_TAG_UNDEFINED}, process_pool_ctor = {{0}, JS_TAG_UNDEFINED};
 
 ChildProcess*
 js_child_process_data(JSValueConst value) {
@@ -124,6 +135,70 @@ js_child_process_exec(JSContext* ctx, JSValueConst this_val, int argc, JSValueCo
   return ret;
 }
 
+/**
+ * fromFd() stream that owns the parent end of a stdio pipe
+ */
+static JSValue
+js_child_process_stream(JSContext* ctx, int fd, BOOL writable) {
+  JSValue ret, args[2] = {JS_NewInt32(ctx, fd), JS_NewObject(ctx)};
+
+  if(js_readable_class_id == 0)
+    js_stream_init(ctx, 0);
+
+#ifndef _WIN32
+  /* a full pipe must not block the event loop */
+  if(writable)
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#endif
+
+  JS_SetPropertyStr(ctx, args[1], "autoClose", JS_TRUE);
+  ret = (writable ? js_writable_from_fd : js_readable_from_fd)(ctx, JS_UNDEFINED, countof(args), args);
+  JS_FreeValue(ctx, args[1]);
+  return ret;
+}
+
+/**
+ * stdio entry given as a stream: an fromFd() stream hands its fd straight
+ * to the child, so bytes between two children never pass through here.
+ * Other streams are piped natively to or from a new pipe.
+ */
+static int
+js_child_process_stdio_stream(JSContext* ctx, int i, JSValueConst stream) {
+  JSValue local, fn, done;
+  int fd, fds[2];
+  BOOL input = i == 0;
+
+  if(js_readable_class_id == 0)
+    js_stream_init(ctx, 0);
+
+  if(!js_stream_detach_fd(ctx, stream, &fd) || fd >= 0)
+    return fd;
+
+  if(!(input ? !!js_readable_data(stream) : !!js_writable_data(stream))) {
+    JS_ThrowTypeError(ctx, "stdio[%d] must be a %s", i, input ? "ReadableStream" : "WritableStream");
+    return -1;
+  }
+
+  if(pipe(fds) == -1) {
+    JS_ThrowInternalError(ctx, "pipe() failed: %s", strerror(errno));
+    return -1;
+  }
+
+#ifndef _WIN32
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+#endif
+
+  local = js_child_process_stream(ctx, input ? fds[1] : fds[0], input);
+  fn = JS_GetPropertyStr(ctx, input ? stream : local, "pipeTo");
+  done = JS_Call(ctx, fn, input ? stream : local, 1, input ? &local : &stream);
+
+  JS_FreeValue(ctx, done);
+  JS_FreeValue(ctx, fn);
+  JS_FreeValue(ctx, local);
+  return input ? fds[0] : fds[1];
+}
+
 static int
 js_child_process_options(JSContext* ctx, ChildProcess* cp, JSValueConst obj) {
   JSValue value;
@@ -183,6 +258,12 @@ js_child_process_options(JSContext* ctx, ChildProcess* cp, JSValueConst obj) {
         if(pipe(fds) == -1)
           fds[0] = fds[1] = -1;
 
+#ifndef _WIN32
+        /* keeps sibling children from holding the other end open */
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+#endif
+
         if(i == 0) {
           child_fds[i] = fds[0];
           parent_fds[i] = fds[1];
@@ -198,7 +279,15 @@ js_child_process_options(JSContext* ctx, ChildProcess* cp, JSValueConst obj) {
       }
 
       JS_FreeCString(ctx, s);
+    } else if(JS_IsObject(item)) {
+      if((child_fds[i] = js_child_process_stdio_stream(ctx, i, item)) == -1) {
+        JS_FreeValue(ctx, item);
+        JS_FreeValue(ctx, value);
+        return -1;
+      }
     }
+
+    JS_FreeValue(ctx, item);
   }
   JS_FreeValue(ctx, value);
 
@@ -245,7 +334,10 @@ js_child_process_spawn(JSContext* ctx, JSValueConst this_val, int argc, JSValueC
   }
 
   if(argc > 1 && JS_IsObject(argv[1]))
-    js_child_process_options(ctx, cp, argv[1]);
+    if(js_child_process_options(ctx, cp, argv[1])) {
+      JS_FreeValue(ctx, ret);
+      return JS_EXCEPTION;
+    }
 
   child_process_spawn(cp);
 
@@ -295,6 +387,25 @@ js_child_process_get(JSContext* ctx, JSValueConst this_val, int magic) {
       break;
     }
 
+    case CHILD_PROCESS_STDIN:
+    case CHILD_PROCESS_STDOUT:
+    case CHILD_PROCESS_STDERR: {
+      static const char* const names[] = {"stdin", "stdout", "stderr"};
+      int i = magic - CHILD_PROCESS_STDIN;
+
+      if(!cp->parent_fds || i >= cp->num_fds || cp->parent_fds[i] < 0) {
+        ret = JS_NULL;
+        break;
+      }
+
+      /* the stream owns the fd now; later reads find the own property */
+      ret = js_child_process_stream(ctx, cp->parent_fds[i], i == 0);
+      cp->parent_fds[i] = -1;
+
+      JS_DefinePropertyValueStr(ctx, this_val, names[i], JS_DupValue(ctx, ret), JS_PROP_CONFIGURABLE);
+      break;
+    }
+
     case CHILD_PROCESS_PID: {
       ret = JS_NewInt32(ctx, cp->pid);
       break;
@@ -395,6 +506,9 @@ static const JSCFunctionListEntry js_child_process_proto_funcs[] = {
     JS_CGETSET_ENUMERABLE_DEF("args", js_child_process_get, 0, CHILD_PROCESS_ARGS),
     JS_CGETSET_MAGIC_DEF("env", js_child_process_get, 0, CHILD_PROCESS_ENV),
     JS_CGETSET_ENUMERABLE_DEF("stdio", js_child_process_get, 0, CHILD_PROCESS_STDIO),
+    JS_CGETSET_MAGIC_DEF("stdin", js_child_process_get, 0, CHILD_PROCESS_STDIN),
+    JS_CGETSET_MAGIC_DEF("stdout", js_child_process_get, 0, CHILD_PROCESS_STDOUT),
+    JS_CGETSET_MAGIC_DEF("stderr", js_child_process_get, 0, CHILD_PROCESS_STDERR),
     JS_CGETSET_ENUMERABLE_DEF("pid", js_child_process_get, 0, CHILD_PROCESS_PID),
     JS_CGETSET_ENUMERABLE_DEF("exitcode", js_child_process_get, 0, CHILD_PROCESS_EXITCODE),
     JS_CGETSET_ENUMERABLE_DEF("termsig", js_child_process_get, 0, CHILD_PROCESS_TERMSIG),
@@ -407,6 +521,933 @@ static const JSCFunctionListEntry js_child_process_proto_funcs[] = {
     JS_PROP_STRING_DEF("[Symbol.toStringTag]", "ChildProcess", 0),
 };
 
+#ifndef _WIN32
+/**
+ * \defgroup process-pool Pre-spawned worker processes
+ *
+ * Each worker gets one end of a socketpair as fd 3. Requests and replies
+ * are frames of a 12-byte header (payload length, job id, flags) followed
+ * by the JS_WriteObject() serialization of the value. File descriptors
+ * travel as SCM_RIGHTS with the first byte of a request, whose flags
+ * carry their count.
+ * @{
+ */
+#define POOL_HEADER 12
+#define POOL_MAX_FDS 16
+#define POOL_MAX_FAILURES 5
+
+enum {
+  POOL_MSG_ERROR = 1,
+};
+
+#define POOL_FDS_SHIFT 8
+
+typedef struct pool_frame {
+  struct pool_frame* next;
+  size_t len, sent;
+  int nfds, fds[POOL_MAX_FDS];
+  uint8_t data[];
+} PoolFrame;
+
+typedef struct pool_job {
+  struct pool_job* next;
+  uint32_t id;
+  ResolveFunctions funcs;
+} PoolJob;
+
+struct process_pool;
+
+typedef struct {
+  struct process_pool* pool;
+  pid_t pid;
+  int fd, failures;
+  uint32_t busy;
+  BOOL writing;
+  PoolJob *jobs, **jobs_tail;
+  PoolFrame *out, **out_tail;
+  DynBuf in;
+} PoolWorker;
+
+typedef struct process_pool {
+  int ref_count;
+  JSContext* ctx;
+  ChildProcess cp;
+  int target_fd;
+  BOOL restart, closed;
+  uint32_t next_id, size, restarts;
+  PoolWorker* workers;
+} ProcessPool;
+
+static JSClassID js_process_pool_class_id = 0;
+
+static BOOL pool_spawn(ProcessPool*, PoolWorker*);
+static void pool_flush(PoolWorker*);
+
+static ProcessPool*
+pool_dup(ProcessPool* pool) {
+  pool->ref_count++;
+  return pool;
+}
+
+static void
+pool_free(void* ptr) {
+  ProcessPool* pool = ptr;
+  JSContext* ctx = pool->ctx;
+
+  if(--pool->ref_count == 0) {
+    for(uint32_t i = 0; i < pool->size; i++)
+      dbuf_free(&pool->workers[i].in);
+
+    js_free(ctx, pool->workers);
+    js_free(ctx, pool->cp.file);
+    js_free(ctx, pool->cp.cwd);
+    js_free(ctx, pool->cp.child_fds);
+
+    if(pool->cp.args)
+      js_strv_free(ctx, pool->cp.args);
+
+    if(pool->cp.env)
+      js_strv_free(ctx, pool->cp.env);
+
+    js_free(ctx, pool);
+  }
+}
+
+static void
+pool_frame_free(PoolFrame* f) {
+  for(int i = 0; i < f->nfds; i++)
+    close(f->fds[i]);
+
+  free(f);
+}
+
+static PoolFrame*
+pool_frame_new(uint32_t id, uint32_t flags, const uint8_t* data, size_t len) {
+  PoolFrame* f;
+  uint32_t header[3] = {len, id, flags};
+
+  if(!(f = malloc(sizeof(PoolFrame) + POOL_HEADER + len)))
+    return 0;
+
+  f->next = 0;
+  f->len = POOL_HEADER + len;
+  f->sent = 0;
+  f->nfds = 0;
+  memcpy(f->data, header, POOL_HEADER);
+  memcpy(f->data + POOL_HEADER, data, len);
+  return f;
+}
+
+/* sends what the socket takes, with the frame's fds on its first byte */
+static ssize_t
+pool_sendframe(int fd, PoolFrame* f) {
+  struct iovec iov = {f->data + f->sent, f->len - f->sent};
+  struct msghdr msg = {0};
+  char control[CMSG_SPACE(sizeof(int) * POOL_MAX_FDS)];
+  ssize_t n;
+
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+
+  if(f->sent == 0 && f->nfds > 0) {
+    struct cmsghdr* cmsg;
+
+    memset(control, 0, sizeof(control));
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * f->nfds);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * f->nfds);
+    memcpy(CMSG_DATA(cmsg), f->fds, sizeof(int) * f->nfds);
+  }
+
+  if((n = sendmsg(fd, &msg, MSG_NOSIGNAL)) > 0) {
+    /* the receiver holds its own copies now */
+    for(int i = 0; i < f->nfds; i++)
+      close(f->fds[i]);
+
+    f->nfds = 0;
+    f->sent += n;
+  }
+
+  return n;
+}
+
+/* receives into buf, queueing received fds on fds (closing them when NULL) */
+static ssize_t
+pool_recv(int fd, DynBuf* buf, DynBuf* fds, int flags) {
+  struct iovec iov;
+  struct msghdr msg = {0};
+  char control[CMSG_SPACE(sizeof(int) * POOL_MAX_FDS)];
+  ssize_t n;
+
+  if(dbuf_realloc(buf, buf->size + 65536))
+    return -1;
+
+  iov.iov_base = buf->buf + buf->size;
+  iov.iov_len = buf->allocated_size - buf->size;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  if((n = recvmsg(fd, &msg, flags | MSG_CMSG_CLOEXEC)) <= 0)
+    return n;
+
+  buf->size += n;
+
+  for(struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int), *p = (int*)CMSG_DATA(cmsg);
+
+      for(int i = 0; i < count; i++)
+        if(!fds || dbuf_put(fds, (const uint8_t*)&p[i], sizeof(int)))
+          close(p[i]);
+    }
+  }
+
+  return n;
+}
+
+static JSValue
+pool_error(JSContext* ctx, const char* fmt, ...) {
+  JSValue error = JS_NewError(ctx);
+  char msg[256];
+  va_list args;
+
+  va_start(args, fmt);
+  vsnprintf(msg, sizeof(msg), fmt, args);
+  va_end(args);
+
+  JS_SetPropertyStr(ctx, error, "message", JS_NewString(ctx, msg));
+  return error;
+}
+
+static JSValue
+js_process_pool_event(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr);
+
+static void
+pool_worker_handler(PoolWorker* w, BOOL write, BOOL set) {
+  ProcessPool* pool = w->pool;
+  JSContext* ctx = pool->ctx;
+  JSValue set_handler = js_iohandler_fn(ctx, write);
+  int index = w - pool->workers;
+
+  js_iohandler_set(ctx, set_handler, w->fd, set ? js_function_cclosure(ctx, js_process_pool_event, 0, index << 1 | write, pool_dup(pool), pool_free) : JS_NULL);
+  JS_FreeValue(ctx, set_handler);
+}
+
+/* the worker's socket closed: fail its jobs, reap it and maybe restart */
+static void
+pool_worker_exit(PoolWorker* w, BOOL block) {
+  ProcessPool* pool = w->pool;
+  JSContext* ctx = pool->ctx;
+  int status = 0, index = w - pool->workers;
+  PoolJob* job;
+  PoolFrame* f;
+
+  if(w->writing)
+    pool_worker_handler(w, TRUE, FALSE);
+
+  pool_worker_handler(w, FALSE, FALSE);
+  close(w->fd);
+  w->fd = -1;
+  w->writing = FALSE;
+  w->in.size = 0;
+
+  /* a worker that closed its socket but lingers for 100ms is killed */
+  for(int i = 0; waitpid(w->pid, &status, block ? 0 : WNOHANG) == 0; i++) {
+    if(i == 100) {
+      kill(w->pid, SIGKILL);
+      block = TRUE;
+    } else {
+      usleep(1000);
+    }
+  }
+
+  while((f = w->out)) {
+    w->out = f->next;
+    pool_frame_free(f);
+  }
+
+  w->out_tail = &w->out;
+
+  while((job = w->jobs)) {
+    JSValue error = pool_error(ctx, "worker %d (pid %d) exited with status %d", index, (int)w->pid, status);
+
+    w->jobs = job->next;
+    promise_reject(ctx, &job->funcs, error);
+    JS_FreeValue(ctx, error);
+    js_free(ctx, job);
+  }
+
+  w->jobs_tail = &w->jobs;
+  w->busy = 0;
+  w->pid = -1;
+
+  if(!pool->closed && pool->restart && ++w->failures < POOL_MAX_FAILURES && pool_spawn(pool, w))
+    pool->restarts++;
+}
+
+static void
+pool_reply(PoolWorker* w, uint32_t id, uint32_t flags, const uint8_t* data, size_t len) {
+  JSContext* ctx = w->pool->ctx;
+  PoolJob **pjob, *job;
+  JSValue value;
+
+  for(pjob = &w->jobs; (job = *pjob); pjob = &job->next)
+    if(job->id == id)
+      break;
+
+  if(!job)
+    return;
+
+  if(!(*pjob = job->next))
+    w->jobs_tail = pjob;
+
+  w->busy--;
+  w->failures = 0;
+
+  if(JS_IsException((value = JS_ReadObject(ctx, data, len, 0)))) {
+    value = JS_GetException(ctx);
+    flags |= POOL_MSG_ERROR;
+  }
+
+  if(flags & POOL_MSG_ERROR) {
+    const char* msg = JS_ToCString(ctx, value);
+    JSValue error = pool_error(ctx, "%s", msg ? msg : "worker error");
+
+    JS_FreeCString(ctx, msg);
+    promise_reject(ctx, &job->funcs, error);
+    JS_FreeValue(ctx, error);
+  } else {
+    promise_resolve(ctx, &job->funcs, value);
+  }
+
+  JS_FreeValue(ctx, value);
+  js_free(ctx, job);
+}
+
+static JSValue
+js_process_pool_event(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  ProcessPool* pool = pool_dup(ptr);
+  PoolWorker* w = &pool->workers[magic >> 1];
+
+  if(w->fd == -1) {
+    /* handler removed already */
+  } else if(magic & 1) {
+    pool_flush(w);
+  } else {
+    ssize_t n;
+
+    while((n = pool_recv(w->fd, &w->in, 0, MSG_DONTWAIT)) > 0) {
+      size_t pos = 0;
+      uint32_t header[3];
+
+      while(w->in.size - pos >= POOL_HEADER) {
+        memcpy(header, w->in.buf + pos, POOL_HEADER);
+
+        if(w->in.size - pos - POOL_HEADER < header[0])
+          break;
+
+        pool_reply(w, header[1], header[2], w->in.buf + pos + POOL_HEADER, header[0]);
+        pos += POOL_HEADER + header[0];
+      }
+
+      memmove(w->in.buf, w->in.buf + pos, w->in.size - pos);
+      w->in.size -= pos;
+    }
+
+    if(w->fd != -1 && (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)))
+      pool_worker_exit(w, FALSE);
+  }
+
+  pool_free(pool);
+  return JS_UNDEFINED;
+}
+
+static void
+pool_flush(PoolWorker* w) {
+  PoolFrame* f;
+
+  while((f = w->out)) {
+    ssize_t n = pool_sendframe(w->fd, f);
+
+    if(n == -1) {
+      if(errno == EINTR)
+        continue;
+
+      /* EAGAIN waits for writability, anything else shows as EOF */
+      if(errno == EAGAIN || errno == EWOULDBLOCK) {
+        if(!w->writing) {
+          w->writing = TRUE;
+          pool_worker_handler(w, TRUE, TRUE);
+        }
+      }
+
+      return;
+    }
+
+    if(f->sent == f->len) {
+      if(!(w->out = f->next))
+        w->out_tail = &w->out;
+
+      pool_frame_free(f);
+    }
+  }
+
+  if(w->writing) {
+    w->writing = FALSE;
+    pool_worker_handler(w, TRUE, FALSE);
+  }
+}
+
+static BOOL
+pool_spawn(ProcessPool* pool, PoolWorker* w) {
+  int sv[2], devnull;
+
+  if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1)
+    return FALSE;
+
+  /* an end already at the target fd would keep FD_CLOEXEC, dup2() clears it */
+  if(sv[1] == pool->target_fd) {
+    int fd = fcntl(sv[1], F_DUPFD_CLOEXEC, pool->target_fd + 1);
+
+    close(sv[1]);
+    sv[1] = fd;
+  }
+
+  if((devnull = open("/dev/null", O_RDONLY | O_CLOEXEC)) == -1) {
+    close(sv[0]);
+    close(sv[1]);
+    return FALSE;
+  }
+
+  pool->cp.child_fds[0] = devnull;
+  pool->cp.child_fds[pool->target_fd] = sv[1];
+
+  w->pid = child_process_spawn(&pool->cp);
+
+  /* child_process_spawn() closes the child's ends in the parent */
+  pool->cp.child_fds[0] = -1;
+  pool->cp.child_fds[pool->target_fd] = -1;
+
+  if(w->pid <= 0) {
+    close(sv[0]);
+    w->pid = -1;
+    return FALSE;
+  }
+
+  fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+  w->fd = sv[0];
+  pool_worker_handler(w, FALSE, TRUE);
+  return TRUE;
+}
+
+static inline ProcessPool*
+js_process_pool_data2(JSContext* ctx, JSValueConst value) {
+  return JS_GetOpaque2(ctx, value, js_process_pool_class_id);
+}
+
+enum {
+  POOL_RUN = 0,
+  POOL_CLOSE,
+};
+
+enum {
+  POOL_SIZE = 0,
+  POOL_PIDS,
+  POOL_PENDING,
+  POOL_RESTARTS,
+};
+
+static JSValue
+js_process_pool_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  ProcessPool* pool;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(pool = js_process_pool_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case POOL_RUN: {
+      PoolWorker* w = 0;
+      PoolFrame* f;
+      PoolJob* job;
+      uint8_t* data;
+      size_t len;
+      int64_t nfds = 0;
+
+      if(pool->closed)
+        return JS_ThrowInternalError(ctx, "ProcessPool is closed");
+
+      /* the least busy worker that is alive */
+      for(uint32_t i = 0; i < pool->size; i++)
+        if(pool->workers[i].fd != -1 && (!w || pool->workers[i].busy < w->busy))
+          w = &pool->workers[i];
+
+      if(!w)
+        return JS_ThrowInternalError(ctx, "ProcessPool has no workers left");
+
+      if(argc > 1 && JS_IsArray(ctx, argv[1]) && (nfds = js_array_length(ctx, argv[1])) > POOL_MAX_FDS)
+        return JS_ThrowRangeError(ctx, "at most %d fds per job", POOL_MAX_FDS);
+
+      if(!(data = JS_WriteObject(ctx, &len, argv[0], 0)))
+        return JS_EXCEPTION;
+
+      f = pool_frame_new(pool->next_id, nfds << POOL_FDS_SHIFT, data, len);
+      js_free(ctx, data);
+
+      if(!f)
+        return JS_ThrowOutOfMemory(ctx);
+
+      /* duplicates, so the caller may close its fds right away */
+      for(int64_t i = 0; i < nfds; i++) {
+        int32_t fd = -1;
+        JSValue item = JS_GetPropertyUint32(ctx, argv[1], i);
+
+        JS_ToInt32(ctx, &fd, item);
+        JS_FreeValue(ctx, item);
+
+        if((f->fds[f->nfds] = fcntl(fd, F_DUPFD_CLOEXEC, 0)) == -1) {
+          pool_frame_free(f);
+          return JS_ThrowInternalError(ctx, "fcntl(%d) failed: %s", fd, strerror(errno));
+        }
+
+        f->nfds++;
+      }
+
+      if(!(job = js_mallocz(ctx, sizeof(PoolJob)))) {
+        pool_frame_free(f);
+        return JS_EXCEPTION;
+      }
+
+      job->id = pool->next_id++;
+      ret = promise_create(ctx, &job->funcs);
+
+      *w->jobs_tail = job;
+      w->jobs_tail = &job->next;
+      w->busy++;
+
+      *w->out_tail = f;
+      w->out_tail = &f->next;
+
+      if(!w->writing)
+        pool_flush(w);
+
+      break;
+    }
+
+    case POOL_CLOSE: {
+      BOOL terminate = argc > 0 && JS_ToBool(ctx, argv[0]);
+
+      pool->closed = TRUE;
+
+      /* workers see EOF on their socket and exit */
+      for(uint32_t i = 0; i < pool->size; i++) {
+        PoolWorker* w = &pool->workers[i];
+
+        if(w->fd != -1) {
+          if(terminate)
+            kill(w->pid, SIGTERM);
+
+          shutdown(w->fd, SHUT_WR);
+        }
+      }
+
+      for(uint32_t i = 0; i < pool->size; i++)
+        if(pool->workers[i].fd != -1)
+          pool_worker_exit(&pool->workers[i], TRUE);
+
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static JSValue
+js_process_pool_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  ProcessPool* pool;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(pool = js_process_pool_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case POOL_SIZE: {
+      ret = JS_NewUint32(ctx, pool->size);
+      break;
+    }
+
+    case POOL_PIDS: {
+      ret = JS_NewArray(ctx);
+
+      for(uint32_t i = 0; i < pool->size; i++)
+        JS_SetPropertyUint32(ctx, ret, i, JS_NewInt32(ctx, pool->workers[i].pid));
+
+      break;
+    }
+
+    case POOL_PENDING: {
+      uint32_t n = 0;
+
+      for(uint32_t i = 0; i < pool->size; i++)
+        n += pool->workers[i].busy;
+
+      ret = JS_NewUint32(ctx, n);
+      break;
+    }
+
+    case POOL_RESTARTS: {
+      ret = JS_NewUint32(ctx, pool->restarts);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static void
+js_process_pool_finalizer(JSRuntime* rt, JSValue val) {
+  ProcessPool* pool;
+
+  if((pool = JS_GetOpaque(val, js_process_pool_class_id)))
+    pool_free(pool);
+}
+
+static JSClassDef js_process_pool_class = {
+    .class_name = "ProcessPool",
+    .finalizer = js_process_pool_finalizer,
+};
+
+static const JSCFunctionListEntry js_process_pool_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("run", 1, js_process_pool_method, POOL_RUN),
+    JS_CFUNC_MAGIC_DEF("close", 0, js_process_pool_method, POOL_CLOSE),
+    JS_CGETSET_MAGIC_DEF("size", js_process_pool_get, 0, POOL_SIZE),
+    JS_CGETSET_MAGIC_DEF("pids", js_process_pool_get, 0, POOL_PIDS),
+    JS_CGETSET_MAGIC_DEF("pending", js_process_pool_get, 0, POOL_PENDING),
+    JS_CGETSET_MAGIC_DEF("restarts", js_process_pool_get, 0, POOL_RESTARTS),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "ProcessPool", 0),
+};
+
+/* worker side: one request at a time from the pool's socket */
+typedef struct {
+  int ref_count, fd;
+  JSContext* ctx;
+  JSValue handler;
+  DynBuf in, fds;
+} PoolServer;
+
+static PoolServer*
+pool_server_dup(PoolServer* s) {
+  s->ref_count++;
+  return s;
+}
+
+static void
+pool_server_free(void* ptr) {
+  PoolServer* s = ptr;
+
+  if(--s->ref_count == 0) {
+    for(size_t i = 0; i < s->fds.size; i += sizeof(int))
+      close(*(int*)&s->fds.buf[i]);
+
+    JS_FreeValue(s->ctx, s->handler);
+    dbuf_free(&s->in);
+    dbuf_free(&s->fds);
+    js_free(s->ctx, s);
+  }
+}
+
+/* blocking: the pool always reads, so this only waits for buffer space */
+static void
+pool_server_send(PoolServer* s, uint32_t id, uint32_t flags, JSValueConst value) {
+  JSContext* ctx = s->ctx;
+  PoolFrame* f;
+  uint8_t* data;
+  size_t len;
+
+  if(!(data = JS_WriteObject(ctx, &len, value, 0))) {
+    JSValue error = JS_GetException(ctx);
+
+    data = JS_WriteObject(ctx, &len, error, 0);
+    JS_FreeValue(ctx, error);
+    flags |= POOL_MSG_ERROR;
+
+    if(!data)
+      return;
+  }
+
+  f = pool_frame_new(id, flags, data, len);
+  js_free(ctx, data);
+
+  if(!f)
+    return;
+
+  while(f->sent < f->len)
+    if(pool_sendframe(s->fd, f) == -1 && errno != EINTR)
+      break;
+
+  pool_frame_free(f);
+}
+
+/* sends an error as its message, Error objects do not serialize */
+static void
+pool_server_error(PoolServer* s, uint32_t id, JSValueConst error) {
+  JSContext* ctx = s->ctx;
+  JSValue msg = JS_IsError(ctx, error) ? JS_GetPropertyStr(ctx, error, "message") : JS_DupValue(ctx, error);
+  JSValue str = JS_ToString(ctx, msg);
+
+  pool_server_send(s, id, POOL_MSG_ERROR, str);
+  JS_FreeValue(ctx, str);
+  JS_FreeValue(ctx, msg);
+}
+
+static JSValue
+js_process_pool_settled(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  PoolServer* s = ptr;
+  uint32_t id = magic >> 1;
+
+  if(magic & 1)
+    pool_server_error(s, id, argc > 0 ? argv[0] : JS_UNDEFINED);
+  else
+    pool_server_send(s, id, 0, argc > 0 ? argv[0] : JS_UNDEFINED);
+
+  return JS_UNDEFINED;
+}
+
+static void
+pool_server_request(PoolServer* s, uint32_t id, uint32_t flags, const uint8_t* data, size_t len) {
+  JSContext* ctx = s->ctx;
+  JSValue args[2], result;
+  size_t nfds = MIN_NUM(flags >> POOL_FDS_SHIFT, s->fds.size / sizeof(int));
+
+  args[0] = JS_ReadObject(ctx, data, len, 0);
+  args[1] = JS_NewArray(ctx);
+
+  /* the fds arrived with the first byte of this frame, in order */
+  for(size_t i = 0; i < nfds; i++)
+    JS_SetPropertyUint32(ctx, args[1], i, JS_NewInt32(ctx, ((int*)s->fds.buf)[i]));
+
+  memmove(s->fds.buf, s->fds.buf + nfds * sizeof(int), s->fds.size - nfds * sizeof(int));
+  s->fds.size -= nfds * sizeof(int);
+
+  if(JS_IsException(args[0])) {
+    result = JS_EXCEPTION;
+  } else {
+    result = JS_Call(ctx, s->handler, JS_UNDEFINED, countof(args), args);
+  }
+
+  if(JS_IsException(result)) {
+    JSValue error = JS_GetException(ctx);
+
+    pool_server_error(s, id, error);
+    JS_FreeValue(ctx, error);
+  } else if(js_is_promise(ctx, result)) {
+    JSValue fns[2] = {
+        js_function_cclosure(ctx, js_process_pool_settled, 1, id << 1, pool_server_dup(s), pool_server_free),
+        js_function_cclosure(ctx, js_process_pool_settled, 1, id << 1 | 1, pool_server_dup(s), pool_server_free),
+    };
+    JSValue then = JS_GetPropertyStr(ctx, result, "then");
+
+    JS_FreeValue(ctx, JS_Call(ctx, then, result, countof(fns), fns));
+    JS_FreeValue(ctx, then);
+    JS_FreeValue(ctx, fns[0]);
+    JS_FreeValue(ctx, fns[1]);
+  } else {
+    pool_server_send(s, id, 0, result);
+  }
+
+  JS_FreeValue(ctx, result);
+  JS_FreeValue(ctx, args[0]);
+  JS_FreeValue(ctx, args[1]);
+}
+
+static JSValue
+js_process_pool_request(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  PoolServer* s = pool_server_dup(ptr);
+  ssize_t n;
+
+  for(;;) {
+    size_t pos = 0;
+    uint32_t header[3];
+
+    if((n = pool_recv(s->fd, &s->in, &s->fds, MSG_DONTWAIT)) <= 0)
+      break;
+
+    while(s->in.size - pos >= POOL_HEADER) {
+      memcpy(header, s->in.buf + pos, POOL_HEADER);
+
+      if(s->in.size - pos - POOL_HEADER < header[0])
+        break;
+
+      pool_server_request(s, header[1], header[2], s->in.buf + pos + POOL_HEADER, header[0]);
+      pos += POOL_HEADER + header[0];
+    }
+
+    memmove(s->in.buf, s->in.buf + pos, s->in.size - pos);
+    s->in.size -= pos;
+  }
+
+  if(n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+    JSValue set_handler = js_iohandler_fn(ctx, FALSE);
+
+    js_iohandler_set(ctx, set_handler, s->fd, JS_NULL);
+    JS_FreeValue(ctx, set_handler);
+    close(s->fd);
+    s->fd = -1;
+  }
+
+  pool_server_free(s);
+  return JS_UNDEFINED;
+}
+/**
+ * @}
+ */
+#endif
+
+/**
+ * new ProcessPool(args, { size, env, cwd, fd = 3, restart = true }): keeps
+ * size workers running args (e.g. ['qjsm', 'worker.js']). run(value, fds)
+ * sends value to the least busy worker and resolves with its reply. A
+ * worker that dies fails its pending jobs and is spawned again.
+ */
+static JSValue
+js_process_pool_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+#ifdef _WIN32
+  return JS_ThrowInternalError(ctx, "ProcessPool needs socketpair() and SCM_RIGHTS");
+#else
+  ProcessPool* pool;
+  JSValue proto, obj, value;
+  int32_t size = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if(!JS_IsArray(ctx, argv[0]) || js_array_length(ctx, argv[0]) < 1)
+    return JS_ThrowTypeError(ctx, "argument 1 must be a non-empty array");
+
+  if(!(pool = js_mallocz(ctx, sizeof(ProcessPool))))
+    return JS_EXCEPTION;
+
+  pool->ref_count = 1;
+  pool->ctx = ctx;
+  pool->target_fd = 3;
+  pool->restart = TRUE;
+  pool->cp.use_path = 1;
+  pool->cp.args = js_array_to_argv(ctx, NULL, argv[0]);
+  pool->cp.file = js_strdup(ctx, pool->cp.args[0]);
+
+  if(argc > 1 && JS_IsObject(argv[1])) {
+    if(js_has_propertystr(ctx, argv[1], "size"))
+      size = js_get_propertystr_int32(ctx, argv[1], "size");
+
+    if(js_has_propertystr(ctx, argv[1], "fd"))
+      pool->target_fd = MAX_NUM(js_get_propertystr_int32(ctx, argv[1], "fd"), 3);
+
+    if(js_has_propertystr(ctx, argv[1], "restart"))
+      pool->restart = js_get_propertystr_bool(ctx, argv[1], "restart");
+
+    value = JS_GetPropertyStr(ctx, argv[1], "env");
+
+    if(JS_IsObject(value))
+      pool->cp.env = child_process_environment(ctx, value);
+
+    JS_FreeValue(ctx, value);
+    value = JS_GetPropertyStr(ctx, argv[1], "cwd");
+
+    if(JS_IsString(value))
+      pool->cp.cwd = js_tostring(ctx, value);
+
+    JS_FreeValue(ctx, value);
+  }
+
+  if(!pool->cp.env)
+    pool->cp.env = js_strv_dup(ctx, environ);
+
+  pool->size = MAX_NUM(size, 1);
+  pool->cp.num_fds = pool->target_fd + 1;
+  pool->cp.child_fds = js_malloc(ctx, sizeof(int) * pool->cp.num_fds);
+  pool->workers = js_mallocz(ctx, sizeof(PoolWorker) * pool->size);
+
+  for(int i = 0; i < pool->cp.num_fds; i++)
+    pool->cp.child_fds[i] = i <= 2 ? i : -1;
+
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  obj = JS_NewObjectProtoClass(ctx, proto, js_process_pool_class_id);
+  JS_FreeValue(ctx, proto);
+
+  if(JS_IsException(obj)) {
+    pool_free(pool);
+    return obj;
+  }
+
+  JS_SetOpaque(obj, pool);
+
+  for(uint32_t i = 0; i < pool->size; i++) {
+    PoolWorker* w = &pool->workers[i];
+
+    w->pool = pool;
+    w->fd = -1;
+    w->jobs_tail = &w->jobs;
+    w->out_tail = &w->out;
+    dbuf_init(&w->in);
+
+    if(!pool_spawn(pool, w)) {
+      JSValue terminate = JS_TRUE;
+      int err = errno;
+
+      js_process_pool_method(ctx, obj, 1, &terminate, POOL_CLOSE);
+      JS_ThrowInternalError(ctx, "spawning %s failed: %s", pool->cp.file, strerror(err));
+      JS_FreeValue(ctx, obj);
+      return JS_EXCEPTION;
+    }
+  }
+
+  return obj;
+#endif
+}
+
+/**
+ * ProcessPool.serve(handler, fd = 3): the worker side. Calls
+ * handler(value, fds) for every job and replies with its result, awaiting
+ * it when it is a Promise. Received fds belong to the handler.
+ */
+static JSValue
+js_process_pool_serve(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+#ifdef _WIN32
+  return JS_ThrowInternalError(ctx, "ProcessPool needs socketpair() and SCM_RIGHTS");
+#else
+  PoolServer* s;
+  JSValue set_handler;
+  int32_t fd = 3;
+
+  if(!JS_IsFunction(ctx, argv[0]))
+    return JS_ThrowTypeError(ctx, "argument 1 must be a function");
+
+  if(argc > 1 && JS_ToInt32(ctx, &fd, argv[1]))
+    return JS_EXCEPTION;
+
+  if(!(s = js_mallocz(ctx, sizeof(PoolServer))))
+    return JS_EXCEPTION;
+
+  s->ref_count = 1;
+  s->fd = fd;
+  s->ctx = ctx;
+  s->handler = JS_DupValue(ctx, argv[0]);
+  dbuf_init(&s->in);
+  dbuf_init(&s->fds);
+
+  set_handler = js_iohandler_fn(ctx, FALSE);
+  js_iohandler_set(ctx, set_handler, fd, js_function_cclosure(ctx, js_process_pool_request, 0, 0, s, pool_server_free));
+  JS_FreeValue(ctx, set_handler);
+  return JS_UNDEFINED;
+#endif
+}
+
+static const JSCFunctionListEntry js_process_pool_static[] = {
+    JS_CFUNC_DEF("serve", 1, js_process_pool_serve),
+};
+
 static const JSCFunctionListEntry js_child_process_funcs[] = {
     JS_CFUNC_DEF("exec", 1, js_child_process_exec),
     JS_CFUNC_DEF("spawn", 1, js_child_process_spawn),
@@ -468,9 +1509,26 @@ js_child_process_init(JSContext* ctx, JSModuleDef* m) {
   JS_SetPropertyFunctionList(ctx, child_process_ctor, js_child_process_funcs, countof(js_child_process_funcs));
   // js_set_inspect_method(ctx, child_process_proto, js_child_process_inspect);
 
+#ifndef _WIN32
+  JS_NewClassID(&js_process_pool_class_id);
+  JS_NewClass(JS_GetRuntime(ctx), js_process_pool_class_id, &js_process_pool_class);
+
+  process_pool_proto = JS_NewObject(ctx);
+  JS_SetPropertyFunctionList(ctx, process_pool_proto, js_process_pool_funcs, countof(js_process_pool_funcs));
+  JS_SetClassProto(ctx, js_process_pool_class_id, process_pool_proto);
+#else
+  process_pool_proto = JS_NewObject(ctx);
+#endif
+
+  process_pool_ctor = JS_NewCFunction2(ctx, js_process_pool_constructor, "ProcessPool", 1, JS_CFUNC_constructor, 0);
+
+  JS_SetConstructor(ctx, process_pool_ctor, process_pool_proto);
+  JS_SetPropertyFunctionList(ctx, process_pool_ctor, js_process_pool_static, countof(js_process_pool_static));
+
   if(m) {
     JS_SetModuleExportList(ctx, m, js_child_process_funcs, countof(js_child_process_funcs));
     JS_SetModuleExport(ctx, m, "ChildProcess", child_process_ctor);
+    JS_SetModuleExport(ctx, m, "ProcessPool", process_pool_ctor);
     JS_SetModuleExport(ctx, m, "default", child_process_ctor);
   }
   return 0;
@@ -490,6 +1548,7 @@ JS_INIT_MODULE(JSContext* ctx, const char* module_name) {
     return NULL;
   JS_AddModuleExportList(ctx, m, js_child_process_funcs, countof(js_child_process_funcs));
   JS_AddModuleExport(ctx, m, "ChildProcess");
+  JS_AddModuleExport(ctx, m, "ProcessPool");
   JS_AddModuleExport(ctx, m, "default");
   return m;
 }
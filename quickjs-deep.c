@@ -8,7 +8,9 @@
 #include "quickjs-predicate.h"
 #include "debug.h"
 
-#include <stdint.h>
+#include <inttypes.h>
+#include <math.h>
+#include <string.h>
 
 /**
  * \defgroup quickjs-deep quickjs-deep: Deep object
@@ -17,9 +19,203 @@
 VISIBLE JSClassID js_deep_iterator_class_id = 0;
 VISIBLE JSValue deep_functions = {{0}, JS_TAG_UNDEFINED}, deep_iterator_proto = {{0}, JS_TAG_UNDEFINED}, deep_iterator_ctor = {{0}, JS_TAG_UNDEFINED};
 
+enum deep_segment_type {
+  SEGMENT_KEY = 0,
+  SEGMENT_ANY,
+  SEGMENT_DEEP,
+};
+
+typedef struct {
+  enum deep_segment_type type;
+  JSAtom atom;
+} DeepSegment;
+
+/**
+ * Compiled path pattern: 'a.*.b', '**.name' or ['a', '*', 'b'], where
+ * '*' matches one key and '**' any number of keys. Matching runs a bit
+ * set of pattern positions along the traversal, one set per depth, so a
+ * node costs a few bit operations and paths are only built for matches.
+ */
+typedef struct {
+  uint32_t len;
+  DeepSegment* segments;
+  uint64_t* states;
+  uint32_t num_states;
+} DeepPattern;
+
+#define DEEP_PATTERN_MAX 63
+
+static void
+deep_pattern_free(DeepPattern* dp, JSRuntime* rt) {
+  for(uint32_t i = 0; i < dp->len; i++)
+    if(dp->segments[i].type == SEGMENT_KEY)
+      JS_FreeAtomRT(rt, dp->segments[i].atom);
+
+  js_free_rt(rt, dp->segments);
+  js_free_rt(rt, dp->states);
+  js_free_rt(rt, dp);
+}
+
+static BOOL
+deep_pattern_push(DeepPattern* dp, JSContext* ctx, const char* s, size_t n) {
+  DeepSegment* seg;
+
+  if(dp->len == DEEP_PATTERN_MAX) {
+    JS_ThrowRangeError(ctx, "path pattern has more than %d segments", DEEP_PATTERN_MAX);
+    return FALSE;
+  }
+
+  seg = &dp->segments[dp->len++];
+
+  if(n == 1 && s[0] == '*') {
+    seg->type = SEGMENT_ANY;
+  } else if(n == 2 && s[0] == '*' && s[1] == '*') {
+    seg->type = SEGMENT_DEEP;
+  } else {
+    seg->type = SEGMENT_KEY;
+    seg->atom = JS_NewAtomLen(ctx, s, n);
+  }
+
+  return TRUE;
+}
+
+static BOOL
+deep_is_pattern(JSContext* ctx, JSValueConst value) {
+  return JS_IsString(value) || (JS_IsArray(ctx, value) && !predicate_callable(ctx, value));
+}
+
+static DeepPattern*
+deep_pattern_compile(JSContext* ctx, JSValueConst value) {
+  DeepPattern* dp;
+
+  if(!(dp = js_mallocz(ctx, sizeof(DeepPattern))))
+    return 0;
+
+  if(!(dp->segments = js_mallocz(ctx, sizeof(DeepSegment) * DEEP_PATTERN_MAX)))
+    goto fail;
+
+  if(JS_IsString(value)) {
+    size_t len, i, start = 0;
+    const char* str;
+
+    if(!(str = JS_ToCStringLen(ctx, &len, value)))
+      goto fail;
+
+    for(i = 0; i <= len; i++) {
+      if(i == len || str[i] == '.') {
+        if(!deep_pattern_push(dp, ctx, str + start, i - start)) {
+          JS_FreeCString(ctx, str);
+          goto fail;
+        }
+
+        start = i + 1;
+      }
+    }
+
+    JS_FreeCString(ctx, str);
+  } else {
+    int64_t i, len = js_array_length(ctx, value);
+
+    for(i = 0; i < len; i++) {
+      JSValue item = JS_GetPropertyUint32(ctx, value, i);
+      size_t n;
+      const char* s = JS_ToCStringLen(ctx, &n, item);
+      BOOL ok = s && deep_pattern_push(dp, ctx, s, n);
+
+      JS_FreeCString(ctx, s);
+      JS_FreeValue(ctx, item);
+
+      if(!ok)
+        goto fail;
+    }
+  }
+
+  return dp;
+
+fail:
+  deep_pattern_free(dp, JS_GetRuntime(ctx));
+  return 0;
+}
+
+/* adds the positions reachable by letting '**' match nothing */
+static uint64_t
+deep_pattern_closure(const DeepPattern* dp, uint64_t set) {
+  for(uint32_t i = 0; i < dp->len; i++)
+    if((set & (1ull << i)) && dp->segments[i].type == SEGMENT_DEEP)
+      set |= 1ull << (i + 1);
+
+  return set;
+}
+
+static uint64_t
+deep_pattern_step(const DeepPattern* dp, uint64_t set, JSAtom atom) {
+  uint64_t next = 0;
+
+  for(uint32_t i = 0; i < dp->len; i++) {
+    if(!(set & (1ull << i)))
+      continue;
+
+    switch(dp->segments[i].type) {
+      case SEGMENT_KEY: {
+        if(dp->segments[i].atom == atom)
+          next |= 1ull << (i + 1);
+        break;
+      }
+
+      case SEGMENT_ANY: {
+        next |= 1ull << (i + 1);
+        break;
+      }
+
+      case SEGMENT_DEEP: {
+        next |= 1ull << i;
+        break;
+      }
+    }
+  }
+
+  return deep_pattern_closure(dp, next);
+}
+
+/**
+ * Advances the pattern to the node on top of frames.
+ * Returns 1 when its path matches, 0 when a descendant still might and
+ * -1 when the subtree can be skipped.
+ */
+static int
+deep_pattern_visit(DeepPattern* dp, JSContext* ctx, const Vector* frames) {
+  PropertyEnumeration* top = property_recursion_top(frames);
+  uint32_t depth = property_recursion_depth(frames);
+  uint64_t set;
+
+  if(!top || property_enumeration_length(top) == 0)
+    return -1;
+
+  if(depth >= dp->num_states) {
+    uint32_t n = MAX_NUM(depth + 1, dp->num_states * 2);
+    uint64_t* states;
+
+    if(!(states = js_realloc(ctx, dp->states, sizeof(uint64_t) * n)))
+      return -1;
+
+    dp->states = states;
+    dp->num_states = n;
+  }
+
+  dp->states[0] = deep_pattern_closure(dp, 1);
+  dp->states[depth] = set = deep_pattern_step(dp, dp->states[depth - 1], property_enumeration_atom(top));
+
+  if(set & (1ull << dp->len))
+    return 1;
+
+  return set ? 0 : -1;
+}
+
 typedef struct DeepIterator {
   Vector frames;
   JSValue root, pred;
+  DeepPattern* pattern;
+  BOOL prune;
   uint32_t flags, seq;
 } DeepIterator;
 
@@ -183,6 +379,7 @@ fail:
 static JSValue
 js_deep_iterator_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
   JSValue proto, obj = JS_UNDEFINED, root = JS_UNDEFINED, pred = JS_UNDEFINED;
+  DeepPattern* pattern = 0;
   uint32_t flags = js_deep_defaultflags;
   int i = 0;
 
@@ -193,14 +390,30 @@ js_deep_iterator_constructor(JSContext* ctx, JSValueConst new_target, int argc,
 
   if(i < argc)
     root = argv[i++];
-  if(i < argc && JS_IsFunction(ctx, argv[i]))
+  if(i < argc && deep_is_pattern(ctx, argv[i])) {
+    if(!(pattern = deep_pattern_compile(ctx, argv[i++]))) {
+      JS_FreeValue(ctx, proto);
+      return JS_EXCEPTION;
+    }
+  } else if(i < argc && JS_IsFunction(ctx, argv[i])) {
     pred = argv[i++];
+  }
+
   if(i < argc)
     flags = js_deep_parseflags(ctx, argc - i, argv + i);
 
   obj = js_deep_iterator_new(ctx, proto, root, pred, flags);
   JS_FreeValue(ctx, proto);
 
+  if(pattern) {
+    DeepIterator* it;
+
+    if((it = JS_GetOpaque(obj, js_deep_iterator_class_id)))
+      it->pattern = pattern;
+    else
+      deep_pattern_free(pattern, JS_GetRuntime(ctx));
+  }
+
   return obj;
 }
 
@@ -224,11 +437,12 @@ js_deep_iterator_next(JSContext* ctx, JSValueConst this_val, int argc, JSValueCo
 
   for(;;) {
     depth = property_recursion_depth(&it->frames);
-    it->seq == 0           ? (property_recursion_push(&it->frames, ctx, JS_DupValue(ctx, it->root), PROPENUM_DEFAULT_FLAGS), 1)
-    : (depth >= max_depth) ? property_recursion_skip(&it->frames, ctx)
-                           : /*depth > 0          ?*/ property_recursion_next(&it->frames, ctx);
+    it->seq == 0                        ? (property_recursion_push(&it->frames, ctx, JS_DupValue(ctx, it->root), PROPENUM_DEFAULT_FLAGS), 1)
+    : (depth >= max_depth || it->prune) ? property_recursion_skip(&it->frames, ctx)
+                                        : /*depth > 0          ?*/ property_recursion_next(&it->frames, ctx);
 
     ++it->seq;
+    it->prune = FALSE;
 
     if(!(penum = property_recursion_top(&it->frames))) {
       *pdone = TRUE;
@@ -238,8 +452,16 @@ js_deep_iterator_next(JSContext* ctx, JSValueConst this_val, int argc, JSValueCo
     if(property_enumeration_length(penum) == 0)
       continue;
 
-    if(!js_deep_predicate(ctx, it->pred, &it->frames))
+    if(it->pattern) {
+      int r = deep_pattern_visit(it->pattern, ctx, &it->frames);
+
+      it->prune = r < 0;
+
+      if(r <= 0)
+        continue;
+    } else if(!js_deep_predicate(ctx, it->pred, &it->frames)) {
       continue;
+    }
 
     ret = js_deep_return(ctx, &it->frames, it->flags & ~MAXDEPTH_MASK);
     *pdone = FALSE;
@@ -257,6 +479,9 @@ js_deep_iterator_finalizer(JSRuntime* rt, JSValue val) {
     property_recursion_free(&it->frames, rt);
     JS_FreeValueRT(rt, it->root);
     JS_FreeValueRT(rt, it->pred);
+
+    if(it->pattern)
+      deep_pattern_free(it->pattern, rt);
   }
 }
 
@@ -265,6 +490,53 @@ js_deep_iterator_iterator(JSContext* ctx, JSValueConst this_val, int argc, JSVal
   return JS_DupValue(ctx, this_val);
 }
 
+/**
+ * find() and select() with a path pattern: walks the tree with the frame
+ * stack, skipping subtrees the pattern can't match below.
+ */
+static JSValue
+js_deep_match(JSContext* ctx, JSValueConst root, JSValueConst pattern, uint32_t flags, BOOL all) {
+  JSValue ret = all ? JS_NewArray(ctx) : JS_UNDEFINED;
+  uint32_t i = 0, max_depth;
+  DeepPattern* dp;
+  Vector frames;
+  int r;
+
+  if((max_depth = (flags & MAXDEPTH_MASK)) == 0)
+    max_depth = INT32_MAX;
+
+  if(!(dp = deep_pattern_compile(ctx, pattern))) {
+    JS_FreeValue(ctx, ret);
+    return JS_EXCEPTION;
+  }
+
+  vector_init(&frames, ctx);
+  property_recursion_push(&frames, ctx, JS_DupValue(ctx, root), PROPENUM_DEFAULT_FLAGS);
+
+  while(property_recursion_top(&frames)) {
+    if((r = deep_pattern_visit(dp, ctx, &frames)) > 0) {
+      JSValue value = js_deep_return(ctx, &frames, flags & ~MAXDEPTH_MASK);
+
+      if(!all) {
+        ret = value;
+        break;
+      }
+
+      JS_SetPropertyUint32(ctx, ret, i++, value);
+    }
+
+    if(r < 0 || (uint32_t)property_recursion_depth(&frames) >= max_depth)
+      property_recursion_skip(&frames, ctx);
+    else
+      property_recursion_next(&frames, ctx);
+  }
+
+  property_recursion_free(&frames, JS_GetRuntime(ctx));
+  deep_pattern_free(dp, JS_GetRuntime(ctx));
+
+  return ret;
+}
+
 static JSValue
 js_deep_find(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
   JSValue ret = JS_UNDEFINED;
@@ -279,12 +551,15 @@ js_deep_find(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[
   if((max_depth = (flags & MAXDEPTH_MASK)) == 0)
     max_depth = INT32_MAX;
 
-  if(!predicate_callable(ctx, argv[1]))
-    return JS_ThrowTypeError(ctx, "argument 2 (predicate) is not a function");
-
   if(!JS_IsObject(argv[0]))
     return JS_ThrowTypeError(ctx, "argument 1 (root) is not an object");
 
+  if(deep_is_pattern(ctx, argv[1]))
+    return js_deep_match(ctx, argv[0], argv[1], flags, FALSE);
+
+  if(!predicate_callable(ctx, argv[1]))
+    return JS_ThrowTypeError(ctx, "argument 2 (predicate) is not a function");
+
   vector_init(&frames, ctx);
 
   property_recursion_push(&frames, ctx, JS_DupValue(ctx, argv[0]), PROPENUM_DEFAULT_FLAGS);
@@ -320,6 +595,9 @@ js_deep_select(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst arg
   if((max_depth = (flags & MAXDEPTH_MASK)) == 0)
     max_depth = INT32_MAX;
 
+  if(deep_is_pattern(ctx, argv[1]))
+    return JS_IsObject(argv[0]) ? js_deep_match(ctx, argv[0], argv[1], flags, TRUE) : JS_NewArray(ctx);
+
   if(!predicate_callable(ctx, argv[1]))
     return JS_ThrowTypeError(ctx, "argument 1 (predicate) is not a function");
 
@@ -517,6 +795,306 @@ js_deep_flatten(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst ar
   return ret;
 }
 
+/**
+ * One output column of flattenColumns(): the key path (as atoms, PROPENUM
+ * index atoms for array positions) and a cell for every record so far.
+ */
+typedef struct {
+  uint32_t hash, depth;
+  JSAtom* atoms;
+  JSValue path;
+  JSValue* cells;
+  uint32_t ncells, numbers, ints, booleans;
+} DeepColumn;
+
+typedef struct {
+  DeepColumn* columns;
+  uint32_t count, allocated;
+  int32_t* table;
+  uint32_t mask;
+} DeepColumns;
+
+static uint32_t
+deep_columns_hash(const Vector* frames) {
+  PropertyEnumeration* it;
+  uint32_t h = 2166136261u;
+
+  vector_foreach_t(frames, it) h = (h ^ property_enumeration_atom(it)) * 16777619u;
+
+  return h;
+}
+
+static BOOL
+deep_columns_grow(DeepColumns* dc, JSContext* ctx) {
+  uint32_t size = dc->table ? (dc->mask + 1) * 2 : 64;
+  int32_t* table;
+
+  if(!(table = js_malloc(ctx, size * sizeof(int32_t))))
+    return FALSE;
+
+  memset(table, 0xff, size * sizeof(int32_t));
+
+  for(uint32_t i = 0; i < dc->count; i++) {
+    uint32_t pos = dc->columns[i].hash & (size - 1);
+
+    while(table[pos] != -1)
+      pos = (pos + 1) & (size - 1);
+
+    table[pos] = i;
+  }
+
+  js_free(ctx, dc->table);
+  dc->table = table;
+  dc->mask = size - 1;
+  return TRUE;
+}
+
+/* column for the path of the current leaf, the path string is only built when it is new */
+static DeepColumn*
+deep_columns_find(DeepColumns* dc, const Vector* frames, JSContext* ctx) {
+  uint32_t i, pos, depth = property_recursion_depth(frames), h = deep_columns_hash(frames);
+  DeepColumn* col;
+  PropertyEnumeration* it;
+
+  if(!dc->table || (dc->count + 1) * 2 > dc->mask + 1)
+    if(!deep_columns_grow(dc, ctx))
+      return 0;
+
+  for(pos = h & dc->mask; dc->table[pos] != -1; pos = (pos + 1) & dc->mask) {
+    col = &dc->columns[dc->table[pos]];
+
+    if(col->hash != h || col->depth != depth)
+      continue;
+
+    i = 0;
+    vector_foreach_t(frames, it) {
+      if(col->atoms[i] != property_enumeration_atom(it))
+        break;
+      i++;
+    }
+
+    if(i == depth)
+      return col;
+  }
+
+  if(dc->count == dc->allocated) {
+    uint32_t n = dc->allocated ? dc->allocated * 2 : 16;
+    DeepColumn* columns;
+
+    if(!(columns = js_realloc(ctx, dc->columns, n * sizeof(DeepColumn))))
+      return 0;
+
+    dc->columns = columns;
+    dc->allocated = n;
+  }
+
+  col = &dc->columns[dc->count];
+  memset(col, 0, sizeof(DeepColumn));
+
+  if(!(col->atoms = js_malloc(ctx, depth * sizeof(JSAtom))))
+    return 0;
+
+  i = 0;
+  vector_foreach_t(frames, it) {
+    JSAtom atom = property_enumeration_atom(it);
+    col->atoms[i++] = PROPENUM_ATOM_IS_INDEX(atom) ? atom : JS_DupAtom(ctx, atom);
+  }
+
+  col->hash = h;
+  col->depth = depth;
+  col->path = property_recursion_pathstr_value(frames, ctx);
+  dc->table[pos] = dc->count++;
+  return col;
+}
+
+/* stores value (owned) as cell row, cells of earlier records without this path stay undefined */
+static BOOL
+deep_column_set(DeepColumn* col, uint32_t row, JSValue value, JSContext* ctx) {
+  if(row >= col->ncells) {
+    uint32_t n = row + 1 > col->ncells * 2 ? row + 1 : col->ncells * 2;
+    JSValue* cells;
+
+    if(!(cells = js_realloc(ctx, col->cells, n * sizeof(JSValue)))) {
+      JS_FreeValue(ctx, value);
+      return FALSE;
+    }
+
+    for(uint32_t i = col->ncells; i < n; i++)
+      cells[i] = JS_UNDEFINED;
+
+    col->cells = cells;
+    col->ncells = n;
+  }
+
+  JS_FreeValue(ctx, col->cells[row]);
+  col->cells[row] = value;
+
+  if(JS_IsBool(value))
+    col->booleans++;
+  else if(JS_VALUE_GET_TAG(value) == JS_TAG_INT)
+    col->numbers++, col->ints++;
+  else if(JS_IsNumber(value))
+    col->numbers++;
+
+  return TRUE;
+}
+
+static void
+deep_arraybuffer_free(JSRuntime* rt, void* opaque, void* ptr) {
+  js_free_rt(rt, ptr);
+}
+
+/**
+ * Int32Array when every record has an integer, Float64Array for numbers
+ * (NaN where a record lacks the path), Uint8Array when every record has a
+ * boolean, otherwise an Array with undefined for missing cells.
+ */
+static JSValue
+deep_column_value(DeepColumn* col, uint32_t rows, JSContext* ctx) {
+  uint32_t present = 0, i;
+  int bits = 0;
+  BOOL floating = FALSE;
+  void* data;
+  JSValue buf, ret;
+
+  for(i = 0; i < rows && i < col->ncells; i++)
+    if(!JS_IsUndefined(col->cells[i]))
+      present++;
+
+  if(col->ints == rows && present == rows)
+    bits = 32;
+  else if(present && col->numbers == present)
+    bits = 64, floating = TRUE;
+  else if(col->booleans == rows && present == rows)
+    bits = 8;
+
+  if(!bits) {
+    ret = JS_NewArray(ctx);
+
+    for(i = 0; i < rows; i++)
+      JS_SetPropertyUint32(ctx, ret, i, i < col->ncells ? JS_DupValue(ctx, col->cells[i]) : JS_UNDEFINED);
+
+    return ret;
+  }
+
+  if(!(data = js_malloc(ctx, rows * (bits / 8) + 1)))
+    return JS_EXCEPTION;
+
+  for(i = 0; i < rows; i++) {
+    JSValueConst cell = i < col->ncells ? col->cells[i] : JS_UNDEFINED;
+
+    if(bits == 32)
+      ((int32_t*)data)[i] = JS_VALUE_GET_INT(cell);
+    else if(bits == 8)
+      ((uint8_t*)data)[i] = JS_VALUE_GET_BOOL(cell);
+    else
+      JS_ToFloat64(ctx, &((double*)data)[i], cell);
+  }
+
+  buf = JS_NewArrayBuffer(ctx, data, rows * (bits / 8), deep_arraybuffer_free, 0, FALSE);
+  ret = js_typedarray_new(ctx, bits, floating, TRUE, buf);
+  JS_FreeValue(ctx, buf);
+  return ret;
+}
+
+static void
+deep_columns_free(DeepColumns* dc, JSContext* ctx) {
+  for(uint32_t i = 0; i < dc->count; i++) {
+    DeepColumn* col = &dc->columns[i];
+
+    for(uint32_t j = 0; j < col->depth; j++)
+      if(!PROPENUM_ATOM_IS_INDEX(col->atoms[j]))
+        JS_FreeAtom(ctx, col->atoms[j]);
+
+    for(uint32_t j = 0; j < col->ncells; j++)
+      JS_FreeValue(ctx, col->cells[j]);
+
+    js_free(ctx, col->atoms);
+    js_free(ctx, col->cells);
+    JS_FreeValue(ctx, col->path);
+  }
+
+  js_free(ctx, dc->columns);
+  js_free(ctx, dc->table);
+}
+
+/**
+ * flattenColumns(records): flattens an array of records into one column per
+ * leaf path, as { length, paths, columns }. Paths are looked up by their
+ * key atoms, so a path string is only built the first time it occurs.
+ * Nested objects and arrays are descended into and never become cells.
+ */
+static JSValue
+js_deep_flatten_columns(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  DeepColumns dc = {0};
+  Vector frames;
+  int64_t rows;
+  uint32_t row;
+  JSValue ret = JS_EXCEPTION, paths, columns;
+
+  if((rows = js_array_length(ctx, argv[0])) < 0)
+    return JS_ThrowTypeError(ctx, "argument 1 must be an array of records");
+
+  vector_init(&frames, ctx);
+
+  for(row = 0; row < rows; row++) {
+    JSValue record = JS_GetPropertyUint32(ctx, argv[0], row);
+    PropertyEnumeration* it;
+
+    if(JS_IsException(record)) {
+      property_recursion_free(&frames, JS_GetRuntime(ctx));
+      goto fail;
+    }
+
+    if(!JS_IsObject(record)) {
+      JS_FreeValue(ctx, record);
+      continue;
+    }
+
+    if(!(it = property_recursion_push(&frames, ctx, record, PROPENUM_DEFAULT_FLAGS)))
+      continue;
+
+    do {
+      JSValue value = property_enumeration_value(it, ctx);
+      DeepColumn* col;
+
+      /* objects are entered by property_recursion_next(), only leaves get a column */
+      if(JS_IsObject(value)) {
+        JS_FreeValue(ctx, value);
+        continue;
+      }
+
+      if(!(col = deep_columns_find(&dc, &frames, ctx)) || !deep_column_set(col, row, value, ctx)) {
+        if(!col)
+          JS_FreeValue(ctx, value);
+
+        property_recursion_free(&frames, JS_GetRuntime(ctx));
+        goto fail;
+      }
+
+    } while((property_recursion_next(&frames, ctx), it = property_recursion_top(&frames)));
+  }
+
+  property_recursion_free(&frames, JS_GetRuntime(ctx));
+
+  ret = JS_NewObject(ctx);
+  paths = JS_NewArray(ctx);
+  columns = JS_NewArray(ctx);
+
+  for(uint32_t i = 0; i < dc.count; i++) {
+    JS_SetPropertyUint32(ctx, paths, i, JS_DupValue(ctx, dc.columns[i].path));
+    JS_SetPropertyUint32(ctx, columns, i, deep_column_value(&dc.columns[i], rows, ctx));
+  }
+
+  JS_SetPropertyStr(ctx, ret, "length", JS_NewUint32(ctx, rows));
+  JS_SetPropertyStr(ctx, ret, "paths", paths);
+  JS_SetPropertyStr(ctx, ret, "columns", columns);
+
+fail:
+  deep_columns_free(&dc, ctx);
+  return ret;
+}
+
 static JSValue
 js_deep_pathof(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
   JSValue ret = JS_UNDEFINED;
@@ -594,50 +1172,470 @@ js_deep_foreach(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst ar
   return JS_UNDEFINED;
 }
 
-static JSValue
-js_deep_equals(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
-  JSValue ret = JS_TRUE;
-  struct {
-    Vector frames;
-    PropertyEnumeration* it;
-    JSValue val;
-  } a = {VECTOR(ctx), 0, JS_UNDEFINED}, b = {VECTOR(ctx), 0, JS_UNDEFINED};
+/**
+ * Structural hashes: numbers hash by value (ints and floats alike),
+ * arrays in order, objects independent of key order. A hash is cached in
+ * a WeakMap only for deeply frozen objects, which cannot change
+ * afterwards, so a cache hit needs no recheck. Different hashes prove
+ * two values unequal; equal hashes prove nothing.
+ */
+#define DEEP_MAX_DEPTH 1000
+#define DEEP_HASH_MASK ((((uint64_t)1) << 53) - 1)
+
+static JSValue deep_hash_cache = {{0}, JS_TAG_UNDEFINED};
+
+static inline uint64_t
+deep_hash_mix(uint64_t h, uint64_t v) {
+  h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+  h ^= h >> 31;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27;
+  return h;
+}
 
-  if(!JS_IsObject(argv[0]) || !JS_IsObject(argv[1]))
-    return JS_NewBool(ctx, js_value_equals(ctx, argv[0], argv[1]));
+static uint64_t
+deep_hash_string(const char* s) {
+  uint64_t h = 0xcbf29ce484222325ULL;
 
-  a.it = property_recursion_push(&a.frames, ctx, JS_DupValue(ctx, argv[0]), PROPENUM_DEFAULT_FLAGS | PROPENUM_SORT_ATOMS);
-  b.it = property_recursion_push(&b.frames, ctx, JS_DupValue(ctx, argv[1]), PROPENUM_DEFAULT_FLAGS | PROPENUM_SORT_ATOMS);
+  while(*s) {
+    h ^= (uint8_t)*s++;
+    h *= 0x100000001b3ULL;
+  }
 
-  for(;;) {
-    BOOL result = TRUE;
+  return h;
+}
+
+static BOOL
+deep_hash_cached(JSContext* ctx, JSValueConst obj, uint64_t* hash) {
+  JSValue value;
+  int64_t i;
+  BOOL ret = FALSE;
+
+  if(JS_IsUndefined(deep_hash_cache) || JS_IsExtensible(ctx, obj) != FALSE)
+    return FALSE;
+
+  value = js_invoke(ctx, deep_hash_cache, "get", 1, &obj);
+
+  if(JS_IsNumber(value) && !JS_ToInt64(ctx, &i, value)) {
+    *hash = i;
+    ret = TRUE;
+  }
+
+  JS_FreeValue(ctx, value);
+  return ret;
+}
+
+static void
+deep_hash_store(JSContext* ctx, JSValueConst obj, uint64_t hash) {
+  JSValueConst args[2] = {obj, JS_UNDEFINED};
+  JSValue ret;
+
+  if(JS_IsUndefined(deep_hash_cache))
+    deep_hash_cache = js_global_new(ctx, "WeakMap", 0, 0);
+
+  args[1] = JS_NewInt64(ctx, hash);
+  ret = js_invoke(ctx, deep_hash_cache, "set", 2, args);
+  JS_FreeValue(ctx, ret);
+}
+
+static uint64_t
+deep_hash_primitive(JSContext* ctx, JSValueConst value) {
+  uint64_t bits;
+  double d;
+  const char* s;
+
+  switch(JS_VALUE_GET_TAG(value)) {
+    case JS_TAG_INT:
+    case JS_TAG_FLOAT64: {
+      d = JS_VALUE_GET_TAG(value) == JS_TAG_INT ? JS_VALUE_GET_INT(value) : JS_VALUE_GET_FLOAT64(value);
+
+      if(d == 0)
+        d = 0;
+      else if(isnan(d))
+        return deep_hash_mix('n', 0);
+
+      memcpy(&bits, &d, sizeof(bits));
+      return deep_hash_mix('n', bits);
+    }
+
+    case JS_TAG_STRING:
+    case JS_TAG_BIG_INT: {
+      uint64_t h = 0;
+
+      if((s = JS_ToCString(ctx, value))) {
+        h = deep_hash_string(s);
+        JS_FreeCString(ctx, s);
+      }
+
+      return deep_hash_mix(JS_VALUE_GET_TAG(value) == JS_TAG_STRING ? 's' : 'b', h);
+    }
+
+    case JS_TAG_BOOL: return deep_hash_mix('t', JS_VALUE_GET_BOOL(value));
+    default: return deep_hash_mix('x', JS_VALUE_GET_TAG(value));
+  }
+}
+
+/**
+ * Hashes value into *hash; *frozen is cleared unless it is deeply
+ * immutable. Returns -1 on exception.
+ */
+static int
+deep_hash_value(JSContext* ctx, JSValueConst value, uint32_t depth, uint64_t* hash, BOOL* frozen) {
+  JSPropertyEnum* tab;
+  uint32_t len;
+  uint64_t h, acc = 0;
+  BOOL is_array, sealed;
+  int ret = 0;
+
+  if(!JS_IsObject(value) || JS_IsFunction(ctx, value)) {
+    *hash = deep_hash_primitive(ctx, value) & DEEP_HASH_MASK;
+    *frozen &= !JS_IsObject(value);
+    return 0;
+  }
+
+  if(deep_hash_cached(ctx, value, hash))
+    return 0;
+
+  if(depth >= DEEP_MAX_DEPTH) {
+    JS_ThrowRangeError(ctx, "deep: nesting deeper than %d", DEEP_MAX_DEPTH);
+    return -1;
+  }
+
+  if(JS_GetOwnPropertyNames(ctx, &tab, &len, value, JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY))
+    return -1;
+
+  is_array = JS_IsArray(ctx, value);
+  sealed = JS_IsExtensible(ctx, value) == FALSE;
+  h = deep_hash_mix(is_array ? 'a' : 'o', len);
+
+  for(uint32_t i = 0; i < len; i++) {
+    JSPropertyDescriptor desc;
+    JSValue child;
+    uint64_t ch;
+    BOOL child_frozen = TRUE;
 
-    if(!a.it || !b.it) {
-      ret = (!a.it && !b.it) ? JS_TRUE : JS_FALSE;
+    if(JS_GetOwnProperty(ctx, &desc, value, tab[i].atom) <= 0) {
+      ret = -1;
       break;
     }
 
-    a.val = property_enumeration_value(a.it, ctx);
-    b.val = property_enumeration_value(b.it, ctx);
+    if(desc.flags & JS_PROP_GETSET) {
+      JS_FreeValue(ctx, desc.getter);
+      JS_FreeValue(ctx, desc.setter);
+      child = JS_GetProperty(ctx, value, tab[i].atom);
+      sealed = FALSE;
+    } else {
+      child = desc.value;
+      sealed &= !(desc.flags & (JS_PROP_WRITABLE | JS_PROP_CONFIGURABLE));
+    }
+
+    ret = deep_hash_value(ctx, child, depth + 1, &ch, &child_frozen);
+    JS_FreeValue(ctx, child);
+
+    if(ret < 0)
+      break;
+
+    sealed &= child_frozen;
+
+    if(is_array) {
+      h = deep_hash_mix(h, ch);
+    } else {
+      const char* key = JS_AtomToCString(ctx, tab[i].atom);
+
+      acc += deep_hash_mix(key ? deep_hash_string(key) : 0, ch);
+      JS_FreeCString(ctx, key);
+    }
+  }
+
+  js_propertyenums_free(ctx, tab, len);
+
+  if(ret < 0)
+    return -1;
+
+  *hash = (is_array ? h : deep_hash_mix(h, acc)) & DEEP_HASH_MASK;
 
-    result = (JS_IsObject(a.val) && JS_IsObject(b.val)) ? TRUE : js_value_equals(ctx, a.val, b.val);
+  if(sealed)
+    deep_hash_store(ctx, value, *hash);
+  else
+    *frozen = FALSE;
 
-    JS_FreeValue(ctx, a.val);
-    JS_FreeValue(ctx, b.val);
+  return 0;
+}
+
+/**
+ * Compares a and b structurally: identical objects end the descent
+ * there, cached hashes rule out unequal subtrees without walking them,
+ * and with_hash hashes both sides up front. Returns -1 on exception.
+ */
+static int
+deep_equal(JSContext* ctx, JSValueConst a, JSValueConst b, uint32_t depth, BOOL with_hash) {
+  JSPropertyEnum *atab, *btab;
+  uint32_t alen, blen;
+  uint64_t ahash, bhash;
+  int ret = 1;
+
+  if(!JS_IsObject(a) || !JS_IsObject(b) || JS_IsFunction(ctx, a) || JS_IsFunction(ctx, b))
+    return js_value_equals(ctx, a, b);
+
+  if(js_object_same(a, b))
+    return 1;
+
+  if(JS_IsArray(ctx, a) != JS_IsArray(ctx, b))
+    return 0;
+
+  if(with_hash) {
+    BOOL frozen = TRUE;
+
+    if(deep_hash_value(ctx, a, depth, &ahash, &frozen) < 0 || deep_hash_value(ctx, b, depth, &bhash, &frozen) < 0)
+      return -1;
+
+    if(ahash != bhash)
+      return 0;
+
+  } else if(deep_hash_cached(ctx, a, &ahash) && deep_hash_cached(ctx, b, &bhash) && ahash != bhash) {
+    return 0;
+  }
+
+  if(depth >= DEEP_MAX_DEPTH) {
+    JS_ThrowRangeError(ctx, "deep: nesting deeper than %d", DEEP_MAX_DEPTH);
+    return -1;
+  }
+
+  if(JS_GetOwnPropertyNames(ctx, &atab, &alen, a, JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY))
+    return -1;
+
+  if(JS_GetOwnPropertyNames(ctx, &btab, &blen, b, JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY)) {
+    js_propertyenums_free(ctx, atab, alen);
+    return -1;
+  }
 
-    if(!result) {
-      ret = JS_FALSE;
+  if(alen != blen)
+    ret = 0;
+
+  for(uint32_t i = 0; ret == 1 && i < alen; i++) {
+    JSValue aval, bval;
+
+    if((ret = JS_GetOwnProperty(ctx, 0, b, atab[i].atom)) <= 0)
       break;
+
+    aval = JS_GetProperty(ctx, a, atab[i].atom);
+    bval = JS_GetProperty(ctx, b, atab[i].atom);
+
+    ret = deep_equal(ctx, aval, bval, depth + 1, FALSE);
+
+    JS_FreeValue(ctx, aval);
+    JS_FreeValue(ctx, bval);
+  }
+
+  js_propertyenums_free(ctx, atab, alen);
+  js_propertyenums_free(ctx, btab, blen);
+
+  return ret;
+}
+
+/**
+ * equals(a, b[, { hash: true }])
+ */
+static JSValue
+js_deep_equals(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  BOOL with_hash = argc > 2 && JS_IsObject(argv[2]) && js_get_propertystr_bool(ctx, argv[2], "hash");
+  int ret = deep_equal(ctx, argv[0], argv[1], 0, with_hash);
+
+  return ret < 0 ? JS_EXCEPTION : JS_NewBool(ctx, ret);
+}
+
+/**
+ * hash(value): structural hash as a 53-bit integer
+ */
+static JSValue
+js_deep_hash(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  uint64_t hash;
+  BOOL frozen = TRUE;
+
+  if(deep_hash_value(ctx, argv[0], 0, &hash, &frozen) < 0)
+    return JS_EXCEPTION;
+
+  return JS_NewInt64(ctx, hash);
+}
+
+typedef struct {
+  Pointer path;
+  JSValue ops;
+  uint32_t count;
+} DeepDiff;
+
+static void
+deep_diff_push(JSContext* ctx, DeepDiff* dd, const char* op, JSValueConst value) {
+  JSValue entry = JS_NewObject(ctx);
+
+  JS_SetPropertyStr(ctx, entry, "op", JS_NewString(ctx, op));
+  JS_SetPropertyStr(ctx, entry, "path", pointer_toarray(&dd->path, ctx));
+
+  if(!JS_IsUninitialized(value))
+    JS_SetPropertyStr(ctx, entry, "value", JS_DupValue(ctx, value));
+
+  JS_SetPropertyUint32(ctx, dd->ops, dd->count++, entry);
+}
+
+/**
+ * Appends the operations turning a into b. Common keys come first,
+ * then removals in reverse key order (so arrays shrink from the end),
+ * then additions. Shared subtrees are skipped. Returns -1 on exception.
+ */
+static int
+deep_diff(JSContext* ctx, DeepDiff* dd, JSValueConst a, JSValueConst b, uint32_t depth) {
+  JSPropertyEnum *atab, *btab;
+  uint32_t alen, blen, i;
+  int ret = 0, r;
+
+  if(!JS_IsObject(a) || !JS_IsObject(b) || JS_IsFunction(ctx, a) || JS_IsFunction(ctx, b) || JS_IsArray(ctx, a) != JS_IsArray(ctx, b)) {
+    if(!js_value_equals(ctx, a, b))
+      deep_diff_push(ctx, dd, "replace", b);
+
+    return 0;
+  }
+
+  if(js_object_same(a, b))
+    return 0;
+
+  if(depth >= DEEP_MAX_DEPTH) {
+    JS_ThrowRangeError(ctx, "deep: nesting deeper than %d", DEEP_MAX_DEPTH);
+    return -1;
+  }
+
+  if(JS_GetOwnPropertyNames(ctx, &atab, &alen, a, JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY))
+    return -1;
+
+  if(JS_GetOwnPropertyNames(ctx, &btab, &blen, b, JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY)) {
+    js_propertyenums_free(ctx, atab, alen);
+    return -1;
+  }
+
+  for(i = 0; ret == 0 && i < alen; i++) {
+    JSValue aval, bval;
+
+    if((r = JS_GetOwnProperty(ctx, 0, b, atab[i].atom)) <= 0) {
+      ret = r;
+      continue;
+    }
+
+    aval = JS_GetProperty(ctx, a, atab[i].atom);
+    bval = JS_GetProperty(ctx, b, atab[i].atom);
+
+    pointer_pushatom(&dd->path, JS_DupAtom(ctx, atab[i].atom), ctx);
+    ret = deep_diff(ctx, dd, aval, bval, depth + 1);
+    JS_FreeAtom(ctx, pointer_popatom(&dd->path));
+
+    JS_FreeValue(ctx, aval);
+    JS_FreeValue(ctx, bval);
+  }
+
+  for(i = alen; ret == 0 && i > 0; i--)
+    if((r = JS_GetOwnProperty(ctx, 0, b, atab[i - 1].atom)) == 0) {
+      pointer_pushatom(&dd->path, JS_DupAtom(ctx, atab[i - 1].atom), ctx);
+      deep_diff_push(ctx, dd, "remove", JS_UNINITIALIZED);
+      JS_FreeAtom(ctx, pointer_popatom(&dd->path));
+    } else if(r < 0) {
+      ret = r;
+    }
+
+  for(i = 0; ret == 0 && i < blen; i++)
+    if((r = JS_GetOwnProperty(ctx, 0, a, btab[i].atom)) == 0) {
+      JSValue bval = JS_GetProperty(ctx, b, btab[i].atom);
+
+      pointer_pushatom(&dd->path, JS_DupAtom(ctx, btab[i].atom), ctx);
+      deep_diff_push(ctx, dd, "add", bval);
+      JS_FreeAtom(ctx, pointer_popatom(&dd->path));
+      JS_FreeValue(ctx, bval);
+    } else if(r < 0) {
+      ret = r;
+    }
+
+  js_propertyenums_free(ctx, atab, alen);
+  js_propertyenums_free(ctx, btab, blen);
+
+  return ret < 0 ? -1 : 0;
+}
+
+/**
+ * diff(a, b): array of { op: 'add' | 'remove' | 'replace', path, value }
+ */
+static JSValue
+js_deep_diff(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  DeepDiff dd = {{0, 0}, JS_NewArray(ctx), 0};
+
+  if(deep_diff(ctx, &dd, argv[0], argv[1], 0) < 0) {
+    JS_FreeValue(ctx, dd.ops);
+    dd.ops = JS_EXCEPTION;
+  }
+
+  pointer_reset(&dd.path, JS_GetRuntime(ctx));
+  return dd.ops;
+}
+
+/**
+ * patch(target, ops): applies diff() output in place and returns the
+ * result, which differs from target only when the root is replaced
+ */
+static JSValue
+js_deep_patch(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  JSValue ret = JS_DupValue(ctx, argv[0]);
+  int64_t i, len = js_array_length(ctx, argv[1]);
+  Pointer* ptr;
+  int r = 0;
+
+  if(!(ptr = pointer_new(ctx))) {
+    JS_FreeValue(ctx, ret);
+    return JS_EXCEPTION;
+  }
+
+  for(i = 0; r >= 0 && i < len; i++) {
+    JSValue entry = JS_GetPropertyUint32(ctx, argv[1], i);
+    JSValue path = JS_GetPropertyStr(ctx, entry, "path"), value = JS_GetPropertyStr(ctx, entry, "value");
+    const char* op = js_get_propertystr_cstring(ctx, entry, "op");
+    BOOL remove = op && !strcmp(op, "remove");
+
+    pointer_reset(ptr, JS_GetRuntime(ctx));
+    pointer_from(ptr, path, ctx);
+
+    if(!op || (!remove && strcmp(op, "add") && strcmp(op, "replace"))) {
+      JS_ThrowTypeError(ctx, "patch: invalid op at index %" PRId64, i);
+      r = -1;
+    } else if(ptr->n == 0) {
+      JS_FreeValue(ctx, ret);
+      ret = remove ? JS_UNDEFINED : JS_DupValue(ctx, value);
+    } else {
+      JSAtom prop = pointer_popatom(ptr);
+      JSValue obj = remove ? pointer_deref(ptr, ret, ctx) : pointer_acquire(ptr, ret, ctx);
+      int64_t index;
+
+      if(JS_IsException(obj))
+        r = -1;
+      else if(!remove)
+        r = JS_SetProperty(ctx, obj, prop, JS_DupValue(ctx, value));
+      else if(JS_IsArray(ctx, obj) && js_atom_toint64(ctx, &index, prop) && index == js_array_length(ctx, obj) - 1)
+        r = JS_SetPropertyStr(ctx, obj, "length", JS_NewInt64(ctx, index));
+      else
+        r = JS_DeleteProperty(ctx, obj, prop, 0);
+
+      JS_FreeAtom(ctx, prop);
+      JS_FreeValue(ctx, obj);
     }
 
-    property_recursion_next(&a.frames, ctx);
-    a.it = property_recursion_top(&a.frames);
-    property_recursion_next(&b.frames, ctx);
-    b.it = property_recursion_top(&b.frames);
+    if(op)
+      JS_FreeCString(ctx, op);
+
+    JS_FreeValue(ctx, value);
+    JS_FreeValue(ctx, path);
+    JS_FreeValue(ctx, entry);
   }
 
-  property_recursion_free(&a.frames, JS_GetRuntime(ctx));
-  property_recursion_free(&b.frames, JS_GetRuntime(ctx));
+  pointer_free(ptr, JS_GetRuntime(ctx));
+
+  if(r < 0) {
+    JS_FreeValue(ctx, ret);
+    ret = JS_EXCEPTION;
+  }
 
   return ret;
 }
@@ -647,8 +1645,276 @@ js_deep_iterate(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst ar
   return js_deep_iterator_constructor(ctx, deep_iterator_ctor, argc, argv);
 }
 
+/**
+ * Copy-on-write clones are proxies whose target holds what was written:
+ * reads fall through to the source, nested objects are wrapped on first
+ * access and cached on the target, deletions are recorded with a
+ * sentinel. Unmodified subtrees stay shared with the source, which must
+ * not change afterwards.
+ */
+static JSAtom deep_cow_atom;
+static JSValue deep_cow_handler = {{0}, JS_TAG_UNDEFINED}, deep_cow_deleted = {{0}, JS_TAG_UNDEFINED};
+
+enum {
+  COW_GET = 0,
+  COW_SET,
+  COW_HAS,
+  COW_DELETE,
+  COW_OWNKEYS,
+  COW_DESCRIPTOR,
+  COW_DEFINE,
+  COW_PROTOTYPE,
+};
+
+static JSValue deep_cow_new(JSContext* ctx, JSValueConst source);
+
+static inline BOOL
+deep_cow_isdeleted(JSValueConst value) {
+  return JS_IsObject(value) && JS_VALUE_GET_OBJ(value) == JS_VALUE_GET_OBJ(deep_cow_deleted);
+}
+
+/* 1 when target holds prop, -1 when prop was deleted, 0 otherwise */
+static int
+deep_cow_own(JSContext* ctx, JSValueConst target, JSAtom prop, JSPropertyDescriptor* desc) {
+  JSPropertyDescriptor tmp;
+  int r;
+
+  if(!desc)
+    desc = &tmp;
+
+  if((r = JS_GetOwnProperty(ctx, desc, target, prop)) <= 0)
+    return 0;
+
+  if(deep_cow_isdeleted(desc->value)) {
+    JS_FreeValue(ctx, desc->value);
+    JS_FreeValue(ctx, desc->getter);
+    JS_FreeValue(ctx, desc->setter);
+    return -1;
+  }
+
+  if(desc == &tmp) {
+    JS_FreeValue(ctx, tmp.value);
+    JS_FreeValue(ctx, tmp.getter);
+    JS_FreeValue(ctx, tmp.setter);
+  }
+
+  return 1;
+}
+
+/* reads prop from the source, wrapping and caching objects on the target */
+static JSValue
+deep_cow_fetch(JSContext* ctx, JSValueConst target, JSValueConst source, JSAtom prop) {
+  JSValue value = JS_GetProperty(ctx, source, prop), child;
+
+  if(!JS_IsObject(value) || JS_IsFunction(ctx, value))
+    return value;
+
+  child = deep_cow_new(ctx, value);
+  JS_FreeValue(ctx, value);
+
+  JS_DefinePropertyValue(ctx, target, prop, JS_DupValue(ctx, child), JS_PROP_C_W_E);
+  return child;
+}
+
+static JSValue
+deep_cow_descriptor(JSContext* ctx, JSPropertyDescriptor* desc) {
+  JSValue ret = JS_NewObject(ctx);
+
+  if(desc->flags & (JS_PROP_GETSET)) {
+    JS_SetPropertyStr(ctx, ret, "get", desc->getter);
+    JS_SetPropertyStr(ctx, ret, "set", desc->setter);
+    JS_FreeValue(ctx, desc->value);
+  } else {
+    JS_SetPropertyStr(ctx, ret, "value", desc->value);
+    JS_SetPropertyStr(ctx, ret, "writable", JS_NewBool(ctx, desc->flags & JS_PROP_WRITABLE));
+    JS_FreeValue(ctx, desc->getter);
+    JS_FreeValue(ctx, desc->setter);
+  }
+
+  JS_SetPropertyStr(ctx, ret, "enumerable", JS_NewBool(ctx, desc->flags & JS_PROP_ENUMERABLE));
+  JS_SetPropertyStr(ctx, ret, "configurable", JS_NewBool(ctx, desc->flags & JS_PROP_CONFIGURABLE));
+
+  return ret;
+}
+
+static JSValue
+js_deep_cow_trap(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  JSValueConst target = argv[0];
+  JSValue source, ret = JS_UNDEFINED;
+  JSAtom prop = 0;
+
+  source = JS_GetProperty(ctx, target, deep_cow_atom);
+
+  if(magic != COW_OWNKEYS && magic != COW_PROTOTYPE)
+    prop = JS_ValueToAtom(ctx, argv[1]);
+
+  switch(magic) {
+    case COW_GET: {
+      JSPropertyDescriptor desc;
+      int r;
+
+      if(prop == deep_cow_atom)
+        break;
+
+      if((r = deep_cow_own(ctx, target, prop, &desc)) > 0) {
+        JS_FreeValue(ctx, desc.value);
+        JS_FreeValue(ctx, desc.getter);
+        JS_FreeValue(ctx, desc.setter);
+        ret = JS_GetProperty(ctx, target, prop);
+      } else if(r == 0) {
+        ret = deep_cow_fetch(ctx, target, source, prop);
+      }
+
+      break;
+    }
+
+    case COW_SET: {
+      ret = JS_NewBool(ctx, JS_SetProperty(ctx, target, prop, JS_DupValue(ctx, argv[2])) >= 0);
+      break;
+    }
+
+    case COW_HAS: {
+      int r = deep_cow_own(ctx, target, prop, 0);
+
+      ret = JS_NewBool(ctx, r > 0 || (r == 0 && prop != deep_cow_atom && JS_HasProperty(ctx, source, prop) > 0));
+      break;
+    }
+
+    case COW_DELETE: {
+      ret = JS_NewBool(ctx, JS_DefinePropertyValue(ctx, target, prop, JS_DupValue(ctx, deep_cow_deleted), JS_PROP_C_W_E) >= 0);
+      break;
+    }
+
+    case COW_OWNKEYS: {
+      JSPropertyEnum* tab = 0;
+      uint32_t i, len = 0, n = 0;
+      JSPropertyDescriptor desc;
+
+      ret = JS_NewArray(ctx);
+
+      if(!JS_GetOwnPropertyNames(ctx, &tab, &len, source, JS_GPN_STRING_MASK | JS_GPN_SYMBOL_MASK)) {
+        for(i = 0; i < len; i++)
+          if(deep_cow_own(ctx, target, tab[i].atom, 0) >= 0)
+            JS_SetPropertyUint32(ctx, ret, n++, JS_AtomToValue(ctx, tab[i].atom));
+
+        js_propertyenums_free(ctx, tab, len);
+      }
+
+      if(!JS_GetOwnPropertyNames(ctx, &tab, &len, target, JS_GPN_STRING_MASK | JS_GPN_SYMBOL_MASK)) {
+        for(i = 0; i < len; i++) {
+          if(tab[i].atom == deep_cow_atom || deep_cow_own(ctx, target, tab[i].atom, 0) < 0)
+            continue;
+
+          if(JS_GetOwnProperty(ctx, &desc, source, tab[i].atom) > 0) {
+            JS_FreeValue(ctx, desc.value);
+            JS_FreeValue(ctx, desc.getter);
+            JS_FreeValue(ctx, desc.setter);
+            continue;
+          }
+
+          JS_SetPropertyUint32(ctx, ret, n++, JS_AtomToValue(ctx, tab[i].atom));
+        }
+
+        js_propertyenums_free(ctx, tab, len);
+      }
+
+      break;
+    }
+
+    case COW_DESCRIPTOR: {
+      JSPropertyDescriptor desc;
+      int r;
+
+      if(prop == deep_cow_atom || (r = deep_cow_own(ctx, target, prop, &desc)) < 0)
+        break;
+
+      if(r == 0) {
+        if(JS_GetOwnProperty(ctx, &desc, source, prop) <= 0)
+          break;
+
+        JS_FreeValue(ctx, desc.value);
+        desc.value = JS_UNDEFINED;
+
+        if(!(desc.flags & JS_PROP_GETSET))
+          desc.value = deep_cow_fetch(ctx, target, source, prop);
+
+        /* the target lacks it, so it can't be reported non-configurable */
+        desc.flags |= JS_PROP_CONFIGURABLE;
+      }
+
+      ret = deep_cow_descriptor(ctx, &desc);
+      break;
+    }
+
+    case COW_DEFINE: {
+      JSValue reflect = js_global_get_str(ctx, "Reflect");
+
+      ret = js_invoke(ctx, reflect, "defineProperty", 3, argv);
+      JS_FreeValue(ctx, reflect);
+      break;
+    }
+
+    case COW_PROTOTYPE: {
+      ret = JS_GetPrototype(ctx, source);
+      break;
+    }
+  }
+
+  if(prop)
+    JS_FreeAtom(ctx, prop);
+
+  JS_FreeValue(ctx, source);
+
+  return ret;
+}
+
+static const JSCFunctionListEntry js_deep_cow_traps[] = {
+    JS_CFUNC_MAGIC_DEF("get", 3, js_deep_cow_trap, COW_GET),
+    JS_CFUNC_MAGIC_DEF("set", 4, js_deep_cow_trap, COW_SET),
+    JS_CFUNC_MAGIC_DEF("has", 2, js_deep_cow_trap, COW_HAS),
+    JS_CFUNC_MAGIC_DEF("deleteProperty", 2, js_deep_cow_trap, COW_DELETE),
+    JS_CFUNC_MAGIC_DEF("ownKeys", 1, js_deep_cow_trap, COW_OWNKEYS),
+    JS_CFUNC_MAGIC_DEF("getOwnPropertyDescriptor", 2, js_deep_cow_trap, COW_DESCRIPTOR),
+    JS_CFUNC_MAGIC_DEF("defineProperty", 3, js_deep_cow_trap, COW_DEFINE),
+    JS_CFUNC_MAGIC_DEF("getPrototypeOf", 1, js_deep_cow_trap, COW_PROTOTYPE),
+};
+
+static JSValue
+deep_cow_new(JSContext* ctx, JSValueConst source) {
+  JSValue target, args[2], ret;
+
+  if(JS_IsUndefined(deep_cow_handler)) {
+    deep_cow_atom = js_symbol_for_atom(ctx, "quickjs.deep.cow");
+    deep_cow_deleted = JS_NewObjectProto(ctx, JS_NULL);
+    deep_cow_handler = JS_NewObjectProto(ctx, JS_NULL);
+    JS_SetPropertyFunctionList(ctx, deep_cow_handler, js_deep_cow_traps, countof(js_deep_cow_traps));
+  }
+
+  if(JS_IsArray(ctx, source)) {
+    target = JS_NewArray(ctx);
+    JS_SetPropertyStr(ctx, target, "length", JS_NewInt64(ctx, js_array_length(ctx, source)));
+  } else {
+    target = JS_NewObject(ctx);
+  }
+
+  JS_DefinePropertyValue(ctx, target, deep_cow_atom, JS_DupValue(ctx, source), JS_PROP_CONFIGURABLE);
+
+  args[0] = target;
+  args[1] = deep_cow_handler;
+  ret = js_global_new(ctx, "Proxy", countof(args), args);
+
+  JS_FreeValue(ctx, target);
+  return ret;
+}
+
+/**
+ * clone(value[, { cow: true }]): deep copy, or a copy-on-write clone
+ */
 static JSValue
 js_deep_clone(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  if(argc > 1 && JS_IsObject(argv[1]) && js_get_propertystr_bool(ctx, argv[1], "cow"))
+    return JS_IsObject(argv[0]) && !JS_IsFunction(ctx, argv[0]) ? deep_cow_new(ctx, argv[0]) : JS_DupValue(ctx, argv[0]);
+
   return js_value_clone(ctx, argv[0]);
 }
 
@@ -664,8 +1930,12 @@ static const JSCFunctionListEntry js_deep_funcs[] = {
     JS_CFUNC_DEF("set", 3, js_deep_set),
     JS_CFUNC_DEF("unset", 2, js_deep_unset),
     JS_CFUNC_DEF("flatten", 1, js_deep_flatten),
+    JS_CFUNC_DEF("flattenColumns", 1, js_deep_flatten_columns),
     JS_CFUNC_DEF("pathOf", 2, js_deep_pathof),
     JS_CFUNC_DEF("equals", 2, js_deep_equals),
+    JS_CFUNC_DEF("hash", 1, js_deep_hash),
+    JS_CFUNC_DEF("diff", 2, js_deep_diff),
+    JS_CFUNC_DEF("patch", 2, js_deep_patch),
     JS_CFUNC_DEF("iterate", 1, js_deep_iterate),
     JS_CFUNC_DEF("forEach", 2, js_deep_foreach),
     JS_CFUNC_DEF("clone", 1, js_deep_clone),
@@ -702,7 +1972,6 @@ static const JSCFunctionListEntry js_deep_iterator_proto_funcs[] = {
 
 static int
 js_deep_init(JSContext* ctx, JSModuleDef* m) {
-
   JS_NewClassID(&js_deep_iterator_class_id);
   JS_NewClass(JS_GetRuntime(ctx), js_deep_iterator_class_id, &js_deep_iterator_class);
 
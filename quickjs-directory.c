@@ -2,8 +2,16 @@
 #include "getdents.h"
 #include "utils.h"
 #include "char-utils.h"
+#include "buffer-utils.h"
+#include "dirindex.h"
 #include <errno.h>
 #include <string.h>
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 /**
  * \defgroup quickjs-directory quickjs-directory: Directory reader
@@ -11,11 +19,15 @@
  */
 VISIBLE JSClassID js_directory_class_id = 0;
 VISIBLE JSValue directory_proto = {{0}, JS_TAG_UNDEFINED}, directory_ctor = {{0}, JS_TAG_UNDEFINED};
+static JSValue directory_index_ctor = {{0}, JS_TAG_UNDEFINED};
+static JSClassID js_directory_walker_class_id = 0;
+static JSClassID js_directory_index_class_id = 0;
 
 enum {
   FLAG_NAME = 1,
   FLAG_TYPE = 2,
   FLAG_BOTH = FLAG_NAME | FLAG_TYPE,
+  FLAG_INODE = 4,
   FLAG_BUFFER = 0x80,
 };
 
@@ -28,6 +40,7 @@ enum {
   DIRECTORY_NEXT,
   DIRECTORY_RETURN,
   DIRECTORY_THROW,
+  DIRECTORY_READ_BATCH,
 };
 
 static JSValue
@@ -53,39 +66,42 @@ directory_namestr(JSContext* ctx, DirEntry* entry) {
 #endif
 }
 
+/* name, type and inode as selected by dflags, an array when more than one */
 static JSValue
-js_directory_entry(JSContext* ctx, DirEntry* entry, int dflags) {
-  JSValue name, ret;
-  int type = -1;
+directory_value(JSContext* ctx, JSValue name, int type, uint64_t ino, int dflags) {
+  JSValue values[3], ret;
+  int n = 0;
 
   if(dflags & FLAG_NAME)
-    name = (dflags & FLAG_BUFFER) ? directory_namebuf(ctx, entry) : directory_namestr(ctx, entry);
+    values[n++] = name;
 
   if(dflags & FLAG_TYPE)
-    type = getdents_type(entry);
+    values[n++] = JS_NewInt32(ctx, type);
 
-  switch(dflags) {
-    case FLAG_NAME: {
-      ret = name;
-      break;
-    }
+  if(dflags & FLAG_INODE)
+    values[n++] = JS_NewInt64(ctx, ino);
 
-    case FLAG_TYPE: {
-      ret = JS_NewInt32(ctx, type);
-      break;
-    }
+  if(n == 1)
+    return values[0];
 
-    case FLAG_BOTH: {
-      ret = JS_NewArray(ctx);
+  ret = JS_NewArray(ctx);
+
+  for(int i = 0; i < n; i++)
+    JS_SetPropertyUint32(ctx, ret, i, values[i]);
 
-      JS_SetPropertyUint32(ctx, ret, 0, name);
-      JS_SetPropertyUint32(ctx, ret, 1, JS_NewInt32(ctx, type));
-      break;
-    }
-  }
   return ret;
 }
 
+static JSValue
+js_directory_entry(JSContext* ctx, DirEntry* entry, int dflags) {
+  JSValue name = JS_UNDEFINED;
+
+  if(dflags & FLAG_NAME)
+    name = (dflags & FLAG_BUFFER) ? directory_namebuf(ctx, entry) : directory_namestr(ctx, entry);
+
+  return directory_value(ctx, name, getdents_type(entry), (dflags & FLAG_INODE) ? getdents_ino(entry) : 0, dflags);
+}
+
 static inline Directory*
 js_directory_data(JSValueConst value) {
   return JS_GetOpaque(value, js_directory_class_id);
@@ -248,6 +264,36 @@ js_directory_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueCons
       break;
     }
 
+    case DIRECTORY_READ_BATCH: {
+      DirEntry* entry;
+      int32_t* opts = ((int32_t*)((char*)directory + getdents_size()));
+      int32_t flags = opts[0], mask = opts[1];
+      uint32_t i = 0, max = 1024;
+
+      if(argc > 0 && !JS_IsUndefined(argv[0]))
+        JS_ToUint32(ctx, &max, argv[0]);
+
+      if(argc > 1)
+        JS_ToInt32(ctx, &flags, argv[1]);
+
+      if(argc > 2)
+        JS_ToInt32(ctx, &mask, argv[2]);
+
+      ret = JS_NewArray(ctx);
+
+      while(i < max) {
+        if(!(entry = getdents_read(directory))) {
+          getdents_close(directory);
+          break;
+        }
+
+        if(getdents_type(entry) & mask)
+          JS_SetPropertyUint32(ctx, ret, i++, js_directory_entry(ctx, entry, flags));
+      }
+
+      break;
+    }
+
     case DIRECTORY_THROW: {
       ret = JS_Throw(ctx, argv[0]);
       break;
@@ -280,6 +326,7 @@ static const JSCFunctionListEntry js_directory_funcs[] = {
     JS_CFUNC_MAGIC_DEF("next", 0, js_directory_method, DIRECTORY_NEXT),
     JS_CFUNC_MAGIC_DEF("return", 0, js_directory_method, DIRECTORY_RETURN),
     JS_CFUNC_MAGIC_DEF("throw", 1, js_directory_method, DIRECTORY_THROW),
+    JS_CFUNC_MAGIC_DEF("readBatch", 0, js_directory_method, DIRECTORY_READ_BATCH),
     JS_CFUNC_MAGIC_DEF("[Symbol.iterator]", 0, js_directory_method, DIRECTORY_ITERATOR),
     JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Directory", JS_PROP_CONFIGURABLE),
 };
@@ -288,6 +335,8 @@ static const JSCFunctionListEntry js_directory_static[] = {
     JS_PROP_INT32_DEF("NAME", FLAG_NAME, JS_PROP_ENUMERABLE),
     JS_PROP_INT32_DEF("TYPE", FLAG_TYPE, JS_PROP_ENUMERABLE),
     JS_PROP_INT32_DEF("BOTH", FLAG_BOTH, JS_PROP_ENUMERABLE),
+    JS_PROP_INT32_DEF("INODE", FLAG_INODE, JS_PROP_ENUMERABLE),
+    JS_PROP_INT32_DEF("BUFFER", FLAG_BUFFER, JS_PROP_ENUMERABLE),
     JS_PROP_INT32_DEF("TYPE_BLK", TYPE_BLK, JS_PROP_ENUMERABLE),
     JS_PROP_INT32_DEF("TYPE_CHR", TYPE_CHR, JS_PROP_ENUMERABLE),
     JS_PROP_INT32_DEF("TYPE_DIR", TYPE_DIR, JS_PROP_ENUMERABLE),
@@ -298,6 +347,676 @@ static const JSCFunctionListEntry js_directory_static[] = {
     JS_PROP_INT32_DEF("TYPE_MASK", TYPE_MASK, JS_PROP_ENUMERABLE),
 };
 
+#ifndef _WIN32
+enum {
+  WALKER_NEXT = 0,
+  WALKER_RETURN,
+  WALKER_SKIP,
+  WALKER_ITERATOR,
+};
+
+enum {
+  WALKER_NAME = 0,
+  WALKER_PATH,
+  WALKER_TYPE,
+  WALKER_INODE,
+  WALKER_DEPTH,
+};
+
+typedef struct {
+  DIR* dir;
+  size_t pathlen;
+  dev_t dev;
+  ino_t ino;
+} DirFrame;
+
+/* one open directory per level, the path is only joined on request */
+typedef struct {
+  DirFrame* stack;
+  uint32_t depth, capacity, max_depth;
+  int32_t flags, types, type;
+  BOOL follow, descend;
+  uint64_t ino;
+  DynBuf path;
+  size_t namelen;
+} DirWalker;
+
+static void
+dirwalker_pop(DirWalker* w) {
+  DirFrame* f = &w->stack[--w->depth];
+
+  closedir(f->dir);
+  w->path.size = f->pathlen;
+}
+
+static void
+dirwalker_free(JSRuntime* rt, DirWalker* w) {
+  while(w->depth > 0)
+    dirwalker_pop(w);
+
+  js_free_rt(rt, w->stack);
+  dbuf_free(&w->path);
+  js_free_rt(rt, w);
+}
+
+/* a followed symlink leading back to a directory on the stack would loop */
+static BOOL
+dirwalker_onstack(DirWalker* w, dev_t dev, ino_t ino) {
+  for(uint32_t i = 0; i < w->depth; i++)
+    if(w->stack[i].dev == dev && w->stack[i].ino == ino)
+      return TRUE;
+
+  return FALSE;
+}
+
+static BOOL
+dirwalker_push(JSContext* ctx, DirWalker* w, int fd) {
+  struct stat st;
+  DirFrame* f;
+  DIR* dir;
+
+  if(fstat(fd, &st) == -1 || (w->follow && dirwalker_onstack(w, st.st_dev, st.st_ino)) || !(dir = fdopendir(fd))) {
+    close(fd);
+    return FALSE;
+  }
+
+  if(w->depth == w->capacity) {
+    uint32_t capacity = w->capacity ? w->capacity * 2 : 16;
+    DirFrame* stack;
+
+    if(!(stack = js_realloc(ctx, w->stack, sizeof(DirFrame) * capacity))) {
+      closedir(dir);
+      return FALSE;
+    }
+
+    w->stack = stack;
+    w->capacity = capacity;
+  }
+
+  f = &w->stack[w->depth++];
+  f->dir = dir;
+  f->pathlen = w->path.size;
+  f->dev = st.st_dev;
+  f->ino = st.st_ino;
+  return TRUE;
+}
+
+/* enters the directory returned last, unless skip() was called */
+static void
+dirwalker_descend(JSContext* ctx, DirWalker* w) {
+  DirFrame* f = &w->stack[w->depth - 1];
+  const char* name = (const char*)w->path.buf + w->path.size + 1;
+  int fd;
+
+  w->descend = FALSE;
+
+  if((fd = openat(dirfd(f->dir), name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | (w->follow ? 0 : O_NOFOLLOW))) == -1)
+    return;
+
+  w->path.buf[w->path.size] = '/';
+  w->path.size += 1 + w->namelen;
+
+  if(!dirwalker_push(ctx, w, fd))
+    w->path.size -= 1 + w->namelen;
+}
+
+/* next matching entry; its name is stored after the path, not appended to it */
+static BOOL
+dirwalker_next(JSContext* ctx, DirWalker* w) {
+  struct dirent* ent;
+
+  if(w->descend)
+    dirwalker_descend(ctx, w);
+
+  while(w->depth > 0) {
+    DirFrame* f = &w->stack[w->depth - 1];
+    const char* name;
+    int type;
+
+    if(!(ent = readdir(f->dir))) {
+      dirwalker_pop(w);
+      continue;
+    }
+
+    name = ent->d_name;
+
+    if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+      continue;
+
+    type = getdents_dtype(ent->d_type);
+
+    if(type == 0 || (type == TYPE_LNK && w->follow)) {
+      struct stat st;
+
+      /* dangling symlinks stay TYPE_LNK */
+      if(fstatat(dirfd(f->dir), name, &st, w->follow ? 0 : AT_SYMLINK_NOFOLLOW) == 0)
+        type = getdents_mode(st.st_mode);
+      else if(type == 0)
+        continue;
+    }
+
+    w->namelen = strlen(name);
+
+    if(dbuf_realloc(&w->path, w->path.size + 1 + w->namelen + 1))
+      return FALSE;
+
+    w->path.buf[w->path.size] = '/';
+    memcpy(w->path.buf + w->path.size + 1, name, w->namelen + 1);
+    w->type = type;
+    w->ino = ent->d_ino;
+    w->descend = type == TYPE_DIR && w->depth <= w->max_depth;
+
+    if(type & w->types)
+      return TRUE;
+
+    if(w->descend)
+      dirwalker_descend(ctx, w);
+  }
+
+  return FALSE;
+}
+
+static inline DirWalker*
+js_directory_walker_data2(JSContext* ctx, JSValueConst value) {
+  return JS_GetOpaque2(ctx, value, js_directory_walker_class_id);
+}
+
+static JSValue
+js_directory_walker_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  DirWalker* w;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(w = js_directory_walker_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case WALKER_NEXT: {
+      JSValue value = JS_UNDEFINED;
+      BOOL done = !dirwalker_next(ctx, w);
+
+      if(!done)
+        value = directory_value(ctx, JS_NewStringLen(ctx, (const char*)w->path.buf + w->path.size + 1, w->namelen), w->type, w->ino, w->flags);
+
+      ret = js_iterator_result(ctx, value, done);
+      JS_FreeValue(ctx, value);
+      break;
+    }
+
+    case WALKER_RETURN: {
+      while(w->depth > 0)
+        dirwalker_pop(w);
+
+      w->descend = FALSE;
+      ret = js_iterator_result(ctx, argc > 0 ? argv[0] : JS_UNDEFINED, TRUE);
+      break;
+    }
+
+    case WALKER_SKIP: {
+      w->descend = FALSE;
+      break;
+    }
+
+    case WALKER_ITERATOR: {
+      ret = JS_DupValue(ctx, this_val);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static JSValue
+js_directory_walker_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  DirWalker* w;
+  const char* name;
+
+  if(!(w = js_directory_walker_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(w->depth == 0)
+    return JS_UNDEFINED;
+
+  name = (const char*)w->path.buf + w->path.size + 1;
+
+  switch(magic) {
+    case WALKER_NAME: return JS_NewStringLen(ctx, name, w->namelen);
+    case WALKER_PATH: return JS_NewStringLen(ctx, (const char*)w->path.buf, w->path.size + 1 + w->namelen);
+    case WALKER_TYPE: return JS_NewInt32(ctx, w->type);
+    case WALKER_INODE: return JS_NewInt64(ctx, w->ino);
+    case WALKER_DEPTH: return JS_NewUint32(ctx, w->depth - 1);
+  }
+
+  return JS_UNDEFINED;
+}
+
+static void
+js_directory_walker_finalizer(JSRuntime* rt, JSValue val) {
+  DirWalker* w;
+
+  if((w = JS_GetOpaque(val, js_directory_walker_class_id)))
+    dirwalker_free(rt, w);
+}
+
+static JSClassDef js_directory_walker_class = {
+    .class_name = "DirectoryWalker",
+    .finalizer = js_directory_walker_finalizer,
+};
+
+static const JSCFunctionListEntry js_directory_walker_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("next", 0, js_directory_walker_method, WALKER_NEXT),
+    JS_CFUNC_MAGIC_DEF("return", 0, js_directory_walker_method, WALKER_RETURN),
+    JS_CFUNC_MAGIC_DEF("skip", 0, js_directory_walker_method, WALKER_SKIP),
+    JS_CFUNC_MAGIC_DEF("[Symbol.iterator]", 0, js_directory_walker_method, WALKER_ITERATOR),
+    JS_CGETSET_MAGIC_DEF("name", js_directory_walker_get, NULL, WALKER_NAME),
+    JS_CGETSET_MAGIC_DEF("path", js_directory_walker_get, NULL, WALKER_PATH),
+    JS_CGETSET_MAGIC_DEF("type", js_directory_walker_get, NULL, WALKER_TYPE),
+    JS_CGETSET_MAGIC_DEF("inode", js_directory_walker_get, NULL, WALKER_INODE),
+    JS_CGETSET_MAGIC_DEF("depth", js_directory_walker_get, NULL, WALKER_DEPTH),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "DirectoryWalker", JS_PROP_CONFIGURABLE),
+};
+#endif
+
+/**
+ * Directory.walk(root, { types, maxDepth, followSymlinks, flags }):
+ * depth-first iterator over everything below root, yielding entries like
+ * Directory.next(). The walker's path, name, type, inode and depth
+ * describe the entry returned last; skip() keeps it from being entered.
+ */
+static JSValue
+js_directory_walk(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+#ifdef _WIN32
+  return JS_ThrowInternalError(ctx, "Directory.walk() needs openat()");
+#else
+  DirWalker* w;
+  JSValue obj;
+  const char* root;
+  size_t len;
+  int fd;
+
+  if(!(w = js_mallocz(ctx, sizeof(DirWalker))))
+    return JS_EXCEPTION;
+
+  w->flags = FLAG_NAME;
+  w->types = TYPE_MASK;
+  w->max_depth = UINT32_MAX;
+  js_dbuf_init(ctx, &w->path);
+
+  if(argc > 1 && JS_IsObject(argv[1])) {
+    if(js_has_propertystr(ctx, argv[1], "types"))
+      w->types = js_get_propertystr_int32(ctx, argv[1], "types");
+
+    if(js_has_propertystr(ctx, argv[1], "flags"))
+      w->flags = js_get_propertystr_int32(ctx, argv[1], "flags");
+
+    if(js_has_propertystr(ctx, argv[1], "maxDepth"))
+      w->max_depth = MAX_NUM(js_get_propertystr_int32(ctx, argv[1], "maxDepth"), 0);
+
+    w->follow = js_get_propertystr_bool(ctx, argv[1], "followSymlinks");
+  }
+
+  if(!(root = JS_ToCStringLen(ctx, &len, argv[0]))) {
+    dirwalker_free(JS_GetRuntime(ctx), w);
+    return JS_EXCEPTION;
+  }
+
+  /* "/" becomes "", so entries below it read "/name" */
+  while(len > 0 && root[len - 1] == '/')
+    len--;
+
+  dbuf_put(&w->path, (const uint8_t*)root, len);
+
+  if((fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1 || !dirwalker_push(ctx, w, fd)) {
+    JS_ThrowInternalError(ctx, "Directory.walk(%s) failed: %s", root, strerror(errno));
+    JS_FreeCString(ctx, root);
+    dirwalker_free(JS_GetRuntime(ctx), w);
+    return JS_EXCEPTION;
+  }
+
+  JS_FreeCString(ctx, root);
+
+  obj = JS_NewObjectClass(ctx, js_directory_walker_class_id);
+
+  if(JS_IsException(obj)) {
+    dirwalker_free(JS_GetRuntime(ctx), w);
+    return obj;
+  }
+
+  JS_SetOpaque(obj, w);
+  return obj;
+#endif
+}
+
+#ifdef __linux__
+enum {
+  INDEX_UPDATE = 0,
+  INDEX_LOOKUP,
+  INDEX_LIST,
+  INDEX_CHANGED_SINCE,
+  INDEX_CLOSE,
+};
+
+enum {
+  INDEX_SEQ = 0,
+  INDEX_SIZE,
+  INDEX_FD,
+};
+
+/* shared by the object and its read handler, which keeps self alive */
+typedef struct {
+  int ref_count;
+  JSContext* ctx;
+  JSValue self;
+  BOOL watching;
+  DirIndex idx;
+} DirIndexHandle;
+
+static void
+dirindexhandle_free(void* ptr) {
+  DirIndexHandle* h = ptr;
+
+  if(--h->ref_count == 0) {
+    dirindex_close(&h->idx);
+    js_free(h->ctx, h);
+  }
+}
+
+/* dropped by the read handler once it is removed */
+static void
+dirindexhandle_release(void* ptr) {
+  DirIndexHandle* h = ptr;
+  JSContext* ctx = h->ctx;
+  JSValue self = h->self;
+
+  h->self = JS_UNDEFINED;
+  dirindexhandle_free(h);
+  JS_FreeValue(ctx, self);
+}
+
+static void
+dirindexhandle_unwatch(JSContext* ctx, DirIndexHandle* h) {
+  if(h->watching) {
+    JSValue set_handler = js_iohandler_fn(ctx, FALSE);
+
+    h->watching = FALSE;
+    js_iohandler_set(ctx, set_handler, h->idx.fd, JS_NULL);
+    JS_FreeValue(ctx, set_handler);
+  }
+}
+
+static JSValue
+dirindex_entry(JSContext* ctx, DirIndexEntry* e, BOOL removed) {
+  JSValue obj = JS_NewObject(ctx);
+
+  JS_SetPropertyStr(ctx, obj, "path", JS_NewStringLen(ctx, e->path, e->len));
+  JS_SetPropertyStr(ctx, obj, "type", JS_NewInt32(ctx, e->type));
+  JS_SetPropertyStr(ctx, obj, "inode", JS_NewInt64(ctx, e->ino));
+  JS_SetPropertyStr(ctx, obj, "seq", JS_NewInt64(ctx, e->seq));
+
+  if(removed)
+    JS_SetPropertyStr(ctx, obj, "removed", JS_NewBool(ctx, e->removed));
+
+  return obj;
+}
+
+/* applies pending events and tells this.onchange about them */
+static JSValue
+js_directory_index_event(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  DirIndexHandle* h = ptr;
+  JSValue self = JS_DupValue(ctx, h->self), fn, ret = JS_UNDEFINED;
+  uint64_t seq = h->idx.seq;
+
+  if(dirindex_update(&h->idx) > 0) {
+    fn = JS_GetPropertyStr(ctx, self, "onchange");
+
+    if(JS_IsFunction(ctx, fn)) {
+      JSValue arg = JS_NewInt64(ctx, seq);
+
+      ret = JS_Call(ctx, fn, self, 1, &arg);
+    }
+
+    JS_FreeValue(ctx, fn);
+  }
+
+  JS_FreeValue(ctx, self);
+  return ret;
+}
+
+static inline DirIndexHandle*
+js_directory_index_data2(JSContext* ctx, JSValueConst value) {
+  return JS_GetOpaque2(ctx, value, js_directory_index_class_id);
+}
+
+static JSValue
+js_directory_index_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  DirIndexHandle* h;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(h = js_directory_index_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(h->idx.fd == -1 && magic != INDEX_CLOSE)
+    return JS_ThrowInternalError(ctx, "DirectoryIndex is closed");
+
+  switch(magic) {
+    case INDEX_UPDATE: {
+      int n;
+
+      if((n = dirindex_update(&h->idx)) == -1)
+        return JS_ThrowInternalError(ctx, "read() failed: %s", strerror(errno));
+
+      ret = JS_NewInt32(ctx, n);
+      break;
+    }
+
+    case INDEX_LOOKUP: {
+      DirIndexEntry* e;
+      const char* path;
+      size_t len;
+
+      if(!(path = JS_ToCStringLen(ctx, &len, argv[0])))
+        return JS_EXCEPTION;
+
+      ret = (e = dirindex_lookup(&h->idx, path, len)) && !e->removed ? dirindex_entry(ctx, e, FALSE) : JS_NULL;
+      JS_FreeCString(ctx, path);
+      break;
+    }
+
+    case INDEX_LIST: {
+      DynBuf prefix;
+      const char* dir = 0;
+      size_t len = 0, i;
+      uint32_t n = 0;
+
+      if(argc > 0 && !JS_IsUndefined(argv[0]) && !(dir = JS_ToCStringLen(ctx, &len, argv[0])))
+        return JS_EXCEPTION;
+
+      js_dbuf_init(ctx, &prefix);
+      dbuf_put(&prefix, (const uint8_t*)dir, len);
+
+      if(len)
+        dbuf_putc(&prefix, '/');
+
+      ret = JS_NewArray(ctx);
+      i = dirindex_find(&h->idx, (const char*)prefix.buf, prefix.size);
+
+      while(i < h->idx.count) {
+        DirIndexEntry* e = h->idx.entries[i];
+        size_t namelen;
+
+        if(e->len < prefix.size || memcmp(e->path, prefix.buf, prefix.size))
+          break;
+
+        namelen = e->len - prefix.size;
+
+        if(!e->removed)
+          JS_SetPropertyUint32(ctx, ret, n++, JS_NewStringLen(ctx, e->path + prefix.size, namelen));
+
+        /* skips the subtree: everything below sorts before name + '0' */
+        dbuf_put(&prefix, (const uint8_t*)e->path + prefix.size, namelen);
+        dbuf_putc(&prefix, '/' + 1);
+        i = dirindex_find(&h->idx, (const char*)prefix.buf, prefix.size);
+        prefix.size -= namelen + 1;
+      }
+
+      dbuf_free(&prefix);
+
+      if(dir)
+        JS_FreeCString(ctx, dir);
+
+      break;
+    }
+
+    case INDEX_CHANGED_SINCE: {
+      int64_t seq = 0;
+      uint32_t n = 0;
+
+      if(argc > 0)
+        JS_ToInt64(ctx, &seq, argv[0]);
+
+      ret = JS_NewArray(ctx);
+
+      for(size_t i = dirindex_since(&h->idx, MAX_NUM(seq, 0)); i < h->idx.nlog; i++) {
+        DirIndexChange* c = &h->idx.log[i];
+
+        if(c->entry->seq == c->seq)
+          JS_SetPropertyUint32(ctx, ret, n++, dirindex_entry(ctx, c->entry, TRUE));
+      }
+
+      break;
+    }
+
+    case INDEX_CLOSE: {
+      if(h->idx.fd != -1) {
+        dirindexhandle_unwatch(ctx, h);
+        dirindex_close(&h->idx);
+      }
+
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static JSValue
+js_directory_index_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  DirIndexHandle* h;
+
+  if(!(h = js_directory_index_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case INDEX_SEQ: return JS_NewInt64(ctx, h->idx.seq);
+    case INDEX_SIZE: {
+      uint32_t n = 0;
+
+      for(size_t i = 0; i < h->idx.count; i++)
+        if(!h->idx.entries[i]->removed)
+          n++;
+
+      return JS_NewUint32(ctx, n);
+    }
+    case INDEX_FD: return JS_NewInt32(ctx, h->idx.fd);
+  }
+
+  return JS_UNDEFINED;
+}
+
+static void
+js_directory_index_finalizer(JSRuntime* rt, JSValue val) {
+  DirIndexHandle* h;
+
+  if((h = JS_GetOpaque(val, js_directory_index_class_id)))
+    dirindexhandle_free(h);
+}
+
+static JSClassDef js_directory_index_class = {
+    .class_name = "DirectoryIndex",
+    .finalizer = js_directory_index_finalizer,
+};
+
+static const JSCFunctionListEntry js_directory_index_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("update", 0, js_directory_index_method, INDEX_UPDATE),
+    JS_CFUNC_MAGIC_DEF("lookup", 1, js_directory_index_method, INDEX_LOOKUP),
+    JS_CFUNC_MAGIC_DEF("list", 0, js_directory_index_method, INDEX_LIST),
+    JS_CFUNC_MAGIC_DEF("changedSince", 1, js_directory_index_method, INDEX_CHANGED_SINCE),
+    JS_CFUNC_MAGIC_DEF("close", 0, js_directory_index_method, INDEX_CLOSE),
+    JS_CGETSET_MAGIC_DEF("seq", js_directory_index_get, NULL, INDEX_SEQ),
+    JS_CGETSET_MAGIC_DEF("size", js_directory_index_get, NULL, INDEX_SIZE),
+    JS_CGETSET_MAGIC_DEF("fd", js_directory_index_get, NULL, INDEX_FD),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "DirectoryIndex", JS_PROP_CONFIGURABLE),
+};
+#endif
+
+/**
+ * new DirectoryIndex(root, { watch = true }): crawls root once, then keeps
+ * a sorted index of the paths below it current from inotify events. With
+ * watch the events are applied from the event loop and this.onchange(seq)
+ * is called; otherwise update() applies them.
+ */
+static JSValue
+js_directory_index_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+#ifndef __linux__
+  return JS_ThrowInternalError(ctx, "DirectoryIndex needs inotify");
+#else
+  DirIndexHandle* h;
+  JSValue proto, obj;
+  const char* root;
+  BOOL watch = TRUE;
+
+  if(argc > 1 && JS_IsObject(argv[1]) && js_has_propertystr(ctx, argv[1], "watch"))
+    watch = js_get_propertystr_bool(ctx, argv[1], "watch");
+
+  if(!(root = JS_ToCString(ctx, argv[0])))
+    return JS_EXCEPTION;
+
+  if(!(h = js_mallocz(ctx, sizeof(DirIndexHandle)))) {
+    JS_FreeCString(ctx, root);
+    return JS_EXCEPTION;
+  }
+
+  h->ref_count = 1;
+  h->ctx = ctx;
+  h->self = JS_UNDEFINED;
+
+  if(dirindex_open(&h->idx, root) == -1) {
+    JS_ThrowInternalError(ctx, "DirectoryIndex(%s) failed: %s", root, strerror(errno));
+    JS_FreeCString(ctx, root);
+    js_free(ctx, h);
+    return JS_EXCEPTION;
+  }
+
+  JS_FreeCString(ctx, root);
+
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  obj = JS_NewObjectProtoClass(ctx, proto, js_directory_index_class_id);
+  JS_FreeValue(ctx, proto);
+
+  if(JS_IsException(obj)) {
+    dirindexhandle_free(h);
+    return obj;
+  }
+
+  JS_SetOpaque(obj, h);
+
+  if(watch) {
+    JSValue set_handler = js_iohandler_fn(ctx, FALSE);
+
+    h->ref_count++;
+    h->self = JS_DupValue(ctx, obj);
+    h->watching = TRUE;
+    js_iohandler_set(ctx, set_handler, h->idx.fd, js_function_cclosure(ctx, js_directory_index_event, 0, 0, h, dirindexhandle_release));
+    JS_FreeValue(ctx, set_handler);
+  }
+
+  return obj;
+#endif
+}
+
+static const JSCFunctionListEntry js_directory_ctor_funcs[] = {
+    JS_CFUNC_DEF("walk", 1, js_directory_walk),
+};
+
 int
 js_directory_init(JSContext* ctx, JSModuleDef* m) {
 
@@ -318,9 +1037,32 @@ js_directory_init(JSContext* ctx, JSModuleDef* m) {
 
   JS_SetClassProto(ctx, js_directory_class_id, directory_proto);
   JS_SetConstructor(ctx, directory_ctor, directory_proto);
+  JS_SetPropertyFunctionList(ctx, directory_ctor, js_directory_ctor_funcs, countof(js_directory_ctor_funcs));
+
+#ifndef _WIN32
+  JSValue walker_proto = JS_NewObject(ctx);
+
+  JS_NewClassID(&js_directory_walker_class_id);
+  JS_NewClass(JS_GetRuntime(ctx), js_directory_walker_class_id, &js_directory_walker_class);
+  JS_SetPropertyFunctionList(ctx, walker_proto, js_directory_walker_funcs, countof(js_directory_walker_funcs));
+  JS_SetClassProto(ctx, js_directory_walker_class_id, walker_proto);
+#endif
+
+  directory_index_ctor = JS_NewCFunction2(ctx, js_directory_index_constructor, "DirectoryIndex", 1, JS_CFUNC_constructor, 0);
+  JSValue index_proto = JS_NewObject(ctx);
+
+#ifdef __linux__
+  JS_NewClassID(&js_directory_index_class_id);
+  JS_NewClass(JS_GetRuntime(ctx), js_directory_index_class_id, &js_directory_index_class);
+  JS_SetPropertyFunctionList(ctx, index_proto, js_directory_index_funcs, countof(js_directory_index_funcs));
+  JS_SetClassProto(ctx, js_directory_index_class_id, JS_DupValue(ctx, index_proto));
+#endif
+  JS_SetConstructor(ctx, directory_index_ctor, index_proto);
+  JS_FreeValue(ctx, index_proto);
 
   if(m) {
     JS_SetModuleExport(ctx, m, "Directory", directory_ctor);
+    JS_SetModuleExport(ctx, m, "DirectoryIndex", directory_index_ctor);
     JS_SetModuleExportList(ctx, m, js_directory_static, countof(js_directory_static));
 
     const char* module_name = module_namecstr(ctx, m);
@@ -346,6 +1088,7 @@ JS_INIT_MODULE(JSContext* ctx, const char* module_name) {
 
   if((m = JS_NewCModule(ctx, module_name, js_directory_init))) {
     JS_AddModuleExport(ctx, m, "Directory");
+    JS_AddModuleExport(ctx, m, "DirectoryIndex");
     JS_AddModuleExportList(ctx, m, js_directory_static, countof(js_directory_static));
 
     /* if(!strcmp(module_name, "directory"))
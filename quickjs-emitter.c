@@ -0,0 +1,479 @@
+#include "defines.h"
+#include "utils.h"
+#include <list.h>
+#include <string.h>
+
+/**
+ * \defgroup quickjs-emitter quickjs-emitter: Native EventEmitter
+ * @{
+ */
+
+VISIBLE JSClassID js_emitter_class_id = 0;
+VISIBLE JSValue emitter_proto = {{0}, JS_TAG_UNDEFINED}, emitter_ctor = {{0}, JS_TAG_UNDEFINED};
+
+/* holds the listeners of objects that aren't EventEmitter instances (eventify()) */
+static JSAtom emitter_atom = JS_ATOM_NULL;
+
+enum {
+  EMITTER_ON = 0,
+  EMITTER_ONCE,
+  EMITTER_REMOVE_LISTENER,
+  EMITTER_REMOVE_ALL,
+  EMITTER_RAW_LISTENERS,
+  EMITTER_LISTENER_COUNT,
+};
+
+typedef struct {
+  JSValue fn;
+  BOOL once;
+} Listener;
+
+/**
+ * Copy-on-write: emit() holds a reference while it calls the listeners,
+ * changing a shared array replaces it with a copy.
+ */
+typedef struct {
+  int ref_count;
+  uint32_t len, size;
+  Listener items[];
+} ListenerArray;
+
+typedef struct {
+  struct list_head link;
+  JSAtom event;
+  ListenerArray* arr;
+} EmitterEvent;
+
+typedef struct {
+  struct list_head events;
+} Emitter;
+
+static void
+listeners_release(JSRuntime* rt, ListenerArray* arr) {
+  if(--arr->ref_count == 0) {
+    for(uint32_t i = 0; i < arr->len; i++)
+      JS_FreeValueRT(rt, arr->items[i].fn);
+
+    js_free_rt(rt, arr);
+  }
+}
+
+/**
+ * Returns the listeners of ev ready to be changed in place, with room for
+ * need entries.
+ */
+static ListenerArray*
+listeners_writable(JSContext* ctx, EmitterEvent* ev, uint32_t need) {
+  ListenerArray *arr = ev->arr, *copy;
+  uint32_t i, size;
+
+  if(arr && arr->ref_count == 1 && arr->size >= need)
+    return arr;
+
+  size = MAX_NUM(need, arr ? arr->len * 2 : 2);
+
+  if(!(copy = js_malloc(ctx, sizeof(ListenerArray) + size * sizeof(Listener))))
+    return 0;
+
+  copy->ref_count = 1;
+  copy->size = size;
+  copy->len = arr ? arr->len : 0;
+
+  if(arr) {
+    if(arr->ref_count == 1) {
+      memcpy(copy->items, arr->items, arr->len * sizeof(Listener));
+      js_free(ctx, arr);
+    } else {
+      for(i = 0; i < arr->len; i++)
+        copy->items[i] = (Listener){JS_DupValue(ctx, arr->items[i].fn), arr->items[i].once};
+
+      --arr->ref_count;
+    }
+  }
+
+  return ev->arr = copy;
+}
+
+static void
+emitter_event_free(JSRuntime* rt, EmitterEvent* ev) {
+  list_del(&ev->link);
+  JS_FreeAtomRT(rt, ev->event);
+
+  if(ev->arr)
+    listeners_release(rt, ev->arr);
+
+  js_free_rt(rt, ev);
+}
+
+static EmitterEvent*
+emitter_find(Emitter* e, JSAtom event) {
+  struct list_head* el;
+
+  list_for_each(el, &e->events) {
+    EmitterEvent* ev = list_entry(el, EmitterEvent, link);
+
+    if(ev->event == event)
+      return ev;
+  }
+
+  return 0;
+}
+
+static int
+emitter_add(JSContext* ctx, Emitter* e, JSAtom event, JSValueConst fn, BOOL once) {
+  EmitterEvent* ev;
+  ListenerArray* arr;
+
+  if(!(ev = emitter_find(e, event))) {
+    if(!(ev = js_mallocz(ctx, sizeof(EmitterEvent))))
+      return -1;
+
+    ev->event = JS_DupAtom(ctx, event);
+    list_add_tail(&ev->link, &e->events);
+  }
+
+  if(!(arr = listeners_writable(ctx, ev, (ev->arr ? ev->arr->len : 0) + 1)))
+    return -1;
+
+  arr->items[arr->len++] = (Listener){JS_DupValue(ctx, fn), once};
+  return 0;
+}
+
+static void
+emitter_remove_at(JSContext* ctx, EmitterEvent* ev, uint32_t i) {
+  ListenerArray* arr;
+
+  if(ev->arr->len == 1) {
+    emitter_event_free(JS_GetRuntime(ctx), ev);
+    return;
+  }
+
+  if(!(arr = listeners_writable(ctx, ev, ev->arr->len)))
+    return;
+
+  JS_FreeValue(ctx, arr->items[i].fn);
+  memmove(&arr->items[i], &arr->items[i + 1], (arr->len - i - 1) * sizeof(Listener));
+  --arr->len;
+}
+
+static inline BOOL
+listener_is(JSValueConst a, JSValueConst b) {
+  return JS_VALUE_GET_TAG(a) == JS_VALUE_GET_TAG(b) && JS_VALUE_GET_PTR(a) == JS_VALUE_GET_PTR(b);
+}
+
+static BOOL
+emitter_remove(JSContext* ctx, Emitter* e, JSAtom event, JSValueConst fn, BOOL once_only) {
+  EmitterEvent* ev;
+
+  if((ev = emitter_find(e, event)))
+    for(uint32_t i = 0; i < ev->arr->len; i++)
+      if(listener_is(ev->arr->items[i].fn, fn) && (!once_only || ev->arr->items[i].once)) {
+        emitter_remove_at(ctx, ev, i);
+        return TRUE;
+      }
+
+  return FALSE;
+}
+
+static Emitter*
+emitter_new(JSContext* ctx) {
+  Emitter* e;
+
+  if((e = js_mallocz(ctx, sizeof(Emitter))))
+    init_list_head(&e->events);
+
+  return e;
+}
+
+static Emitter*
+js_emitter_data(JSContext* ctx, JSValueConst obj, BOOL create) {
+  Emitter* e;
+  JSValue state;
+
+  if((e = JS_GetOpaque(obj, js_emitter_class_id)))
+    return e;
+
+  state = JS_GetProperty(ctx, obj, emitter_atom);
+
+  if((e = JS_GetOpaque(state, js_emitter_class_id)) || !create) {
+    JS_FreeValue(ctx, state);
+    return e;
+  }
+
+  JS_FreeValue(ctx, state);
+  state = JS_NewObjectProtoClass(ctx, JS_NULL, js_emitter_class_id);
+
+  if(!(e = emitter_new(ctx))) {
+    JS_FreeValue(ctx, state);
+    return 0;
+  }
+
+  JS_SetOpaque(state, e);
+  JS_DefinePropertyValue(ctx, obj, emitter_atom, state, 0);
+  return e;
+}
+
+/**
+ * emit(event, ...args): calls the listeners with this and args as they
+ * are, listeners added or removed meanwhile take effect from the next
+ * emit() on.
+ */
+static JSValue
+js_emitter_emit(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  Emitter* e;
+  EmitterEvent* ev;
+  ListenerArray* arr;
+  JSAtom event;
+  JSValue ret = JS_FALSE;
+
+  if(!JS_IsObject(this_val))
+    return JS_ThrowTypeError(ctx, "EventEmitter.prototype.emit called on non-object");
+
+  if(!(e = js_emitter_data(ctx, this_val, FALSE)) || argc < 1)
+    return JS_FALSE;
+
+  if((event = JS_ValueToAtom(ctx, argv[0])) == JS_ATOM_NULL)
+    return JS_EXCEPTION;
+
+  if(!(ev = emitter_find(e, event))) {
+    JS_FreeAtom(ctx, event);
+    return JS_FALSE;
+  }
+
+  arr = ev->arr;
+
+  /* a single listener needs no snapshot */
+  if(arr->len == 1 && !arr->items[0].once) {
+    JSValue fn = JS_DupValue(ctx, arr->items[0].fn), result;
+
+    result = JS_Call(ctx, fn, this_val, argc - 1, argv + 1);
+    JS_FreeValue(ctx, fn);
+    ret = JS_IsException(result) ? JS_EXCEPTION : JS_TRUE;
+    JS_FreeValue(ctx, result);
+  } else {
+    ++arr->ref_count;
+
+    for(uint32_t i = 0; i < arr->len; i++) {
+      JSValue result;
+
+      if(arr->items[i].once)
+        if(!(e = js_emitter_data(ctx, this_val, FALSE)) || !emitter_remove(ctx, e, event, arr->items[i].fn, TRUE))
+          continue;
+
+      result = JS_Call(ctx, arr->items[i].fn, this_val, argc - 1, argv + 1);
+
+      if(JS_IsException(result)) {
+        ret = JS_EXCEPTION;
+        break;
+      }
+
+      JS_FreeValue(ctx, result);
+      ret = JS_TRUE;
+    }
+
+    listeners_release(JS_GetRuntime(ctx), arr);
+  }
+
+  JS_FreeAtom(ctx, event);
+  return ret;
+}
+
+static JSValue
+js_emitter_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  Emitter* e;
+  EmitterEvent* ev;
+  JSAtom event = JS_ATOM_NULL;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!JS_IsObject(this_val))
+    return JS_ThrowTypeError(ctx, "EventEmitter method called on non-object");
+
+  if(magic == EMITTER_REMOVE_ALL && (argc < 1 || !JS_ToBool(ctx, argv[0]))) {
+    if((e = js_emitter_data(ctx, this_val, FALSE)))
+      while(!list_empty(&e->events))
+        emitter_event_free(JS_GetRuntime(ctx), list_entry(e->events.next, EmitterEvent, link));
+
+    return JS_DupValue(ctx, this_val);
+  }
+
+  if((event = JS_ValueToAtom(ctx, argc > 0 ? argv[0] : JS_UNDEFINED)) == JS_ATOM_NULL)
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case EMITTER_ON:
+    case EMITTER_ONCE: {
+      if(argc < 2 || !JS_IsFunction(ctx, argv[1])) {
+        ret = JS_ThrowTypeError(ctx, "listener must be a function");
+        break;
+      }
+
+      if(!(e = js_emitter_data(ctx, this_val, TRUE)) || emitter_add(ctx, e, event, argv[1], magic == EMITTER_ONCE)) {
+        ret = JS_EXCEPTION;
+        break;
+      }
+
+      ret = JS_DupValue(ctx, this_val);
+      break;
+    }
+
+    case EMITTER_REMOVE_LISTENER: {
+      if((e = js_emitter_data(ctx, this_val, FALSE)) && argc > 1)
+        emitter_remove(ctx, e, event, argv[1], FALSE);
+
+      ret = JS_DupValue(ctx, this_val);
+      break;
+    }
+
+    case EMITTER_REMOVE_ALL: {
+      if((e = js_emitter_data(ctx, this_val, FALSE)) && (ev = emitter_find(e, event)))
+        emitter_event_free(JS_GetRuntime(ctx), ev);
+
+      ret = JS_DupValue(ctx, this_val);
+      break;
+    }
+
+    case EMITTER_RAW_LISTENERS: {
+      if((e = js_emitter_data(ctx, this_val, FALSE)) && (ev = emitter_find(e, event))) {
+        ret = JS_NewArray(ctx);
+
+        for(uint32_t i = 0; i < ev->arr->len; i++)
+          JS_SetPropertyUint32(ctx, ret, i, JS_DupValue(ctx, ev->arr->items[i].fn));
+      }
+
+      break;
+    }
+
+    case EMITTER_LISTENER_COUNT: {
+      ev = (e = js_emitter_data(ctx, this_val, FALSE)) ? emitter_find(e, event) : 0;
+      ret = JS_NewUint32(ctx, ev ? ev->arr->len : 0);
+      break;
+    }
+  }
+
+  JS_FreeAtom(ctx, event);
+  return ret;
+}
+
+static JSValue
+js_emitter_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  JSValue proto, obj = JS_UNDEFINED;
+  Emitter* e;
+
+  if(!(e = emitter_new(ctx)))
+    return JS_EXCEPTION;
+
+  /* using new_target to get the prototype is necessary when the class is extended. */
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  if(JS_IsException(proto))
+    goto fail;
+
+  obj = JS_NewObjectProtoClass(ctx, proto, js_emitter_class_id);
+  JS_FreeValue(ctx, proto);
+  if(JS_IsException(obj))
+    goto fail;
+
+  JS_SetOpaque(obj, e);
+  return obj;
+
+fail:
+  js_free(ctx, e);
+  JS_FreeValue(ctx, obj);
+  return JS_EXCEPTION;
+}
+
+static void
+js_emitter_finalizer(JSRuntime* rt, JSValue val) {
+  Emitter* e;
+
+  if((e = JS_GetOpaque(val, js_emitter_class_id))) {
+    while(!list_empty(&e->events))
+      emitter_event_free(rt, list_entry(e->events.next, EmitterEvent, link));
+
+    js_free_rt(rt, e);
+  }
+}
+
+static void
+js_emitter_mark(JSRuntime* rt, JSValueConst val, JS_MarkFunc* mark_func) {
+  Emitter* e;
+  struct list_head* el;
+
+  if((e = JS_GetOpaque(val, js_emitter_class_id)))
+    list_for_each(el, &e->events) {
+      EmitterEvent* ev = list_entry(el, EmitterEvent, link);
+
+      for(uint32_t i = 0; i < ev->arr->len; i++)
+        JS_MarkValue(rt, ev->arr->items[i].fn, mark_func);
+    }
+}
+
+static JSClassDef js_emitter_class = {
+    .class_name = "EventEmitter",
+    .finalizer = js_emitter_finalizer,
+    .gc_mark = js_emitter_mark,
+};
+
+static const JSCFunctionListEntry js_emitter_proto_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("on", 2, js_emitter_method, EMITTER_ON),
+    JS_CFUNC_MAGIC_DEF("once", 2, js_emitter_method, EMITTER_ONCE),
+    JS_CFUNC_MAGIC_DEF("removeListener", 2, js_emitter_method, EMITTER_REMOVE_LISTENER),
+    JS_CFUNC_MAGIC_DEF("removeAllListeners", 0, js_emitter_method, EMITTER_REMOVE_ALL),
+    JS_CFUNC_MAGIC_DEF("rawListeners", 1, js_emitter_method, EMITTER_RAW_LISTENERS),
+    JS_CFUNC_MAGIC_DEF("listenerCount", 1, js_emitter_method, EMITTER_LISTENER_COUNT),
+    JS_CFUNC_DEF("emit", 1, js_emitter_emit),
+    JS_ALIAS_DEF("addListener", "on"),
+    JS_ALIAS_DEF("off", "removeListener"),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "EventEmitter", JS_PROP_CONFIGURABLE),
+};
+
+static int
+js_emitter_init(JSContext* ctx, JSModuleDef* m) {
+  if(js_emitter_class_id == 0) {
+    JSValue name = JS_NewString(ctx, "EventEmitter"), symbol_ctor = js_symbol_ctor(ctx);
+    JSValue sym = JS_Call(ctx, symbol_ctor, JS_UNDEFINED, 1, &name);
+
+    emitter_atom = JS_ValueToAtom(ctx, sym);
+    JS_FreeValue(ctx, sym);
+    JS_FreeValue(ctx, symbol_ctor);
+    JS_FreeValue(ctx, name);
+
+    JS_NewClassID(&js_emitter_class_id);
+    JS_NewClass(JS_GetRuntime(ctx), js_emitter_class_id, &js_emitter_class);
+
+    emitter_proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, emitter_proto, js_emitter_proto_funcs, countof(js_emitter_proto_funcs));
+    JS_SetClassProto(ctx, js_emitter_class_id, emitter_proto);
+
+    emitter_ctor = JS_NewCFunction2(ctx, js_emitter_constructor, "EventEmitter", 0, JS_CFUNC_constructor, 0);
+    JS_SetConstructor(ctx, emitter_ctor, emitter_proto);
+  }
+
+  if(m) {
+    JS_SetModuleExport(ctx, m, "EventEmitter", emitter_ctor);
+    JS_SetModuleExport(ctx, m, "default", emitter_ctor);
+  }
+
+  return 0;
+}
+
+#ifdef JS_SHARED_LIBRARY
+#define JS_INIT_MODULE js_init_module
+#else
+#define JS_INIT_MODULE js_init_module_emitter
+#endif
+
+VISIBLE JSModuleDef*
+JS_INIT_MODULE(JSContext* ctx, const char* module_name) {
+  JSModuleDef* m;
+
+  if((m = JS_NewCModule(ctx, module_name, js_emitter_init))) {
+    JS_AddModuleExport(ctx, m, "EventEmitter");
+    JS_AddModuleExport(ctx, m, "default");
+  }
+
+  return m;
+}
+
+/**
+ * @}
+ */
@@ -1,22 +1,28 @@
 #include "defines.h"
 #include "gpio.h"
+#include "gpio-capture.h"
 //#include "utils.h"
 #include "quickjs-gpio.h"
 #include "utils.h"
 #include "debug.h"
+#include <errno.h>
+#include <string.h>
 
 /**
  * \addtogroup quickjs-gpio
  * @{
  */
 
-VISIBLE JSClassID js_gpio_class_id = 0;
-VISIBLE JSValue gpio_proto = {{0}, JS_TAG_UNDEFINED}, gpio_ctor = {{0}, JS_TAG_UNDEFINED};
+VISIBLE JSClassID js_gpio_class_id = 0, js_gpiocapture_class_id = 0;
+VISIBLE JSValue gpio_proto = {{0}, JS_TAG_UNDEFINED}, gpio_ctor = {{0}, JS_TAG_UNDEFINED}, gpiocapture_proto = {{0}, JS_TAG_UNDEFINED},
+                gpiocapture_ctor = {{0}, JS_TAG_UNDEFINED};
 
 enum {
   GPIO_METHOD_INIT_PIN = 0,
   GPIO_METHOD_SET_PIN,
   GPIO_METHOD_GET_PIN,
+  GPIO_METHOD_READ_BANK,
+  GPIO_METHOD_WRITE_BANK,
 };
 
 enum {
@@ -92,6 +98,31 @@ js_gpio_functions(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
       ret = JS_NewInt32(ctx, value);
       break;
     }
+
+    case GPIO_METHOD_READ_BANK: {
+      uint32_t bank = 0;
+
+      if(argc > 0)
+        JS_ToUint32(ctx, &bank, argv[0]);
+
+      ret = JS_NewUint32(ctx, gpio_read_bank(gpio, bank));
+      break;
+    }
+
+    case GPIO_METHOD_WRITE_BANK: {
+      uint32_t value = 0, mask = 0xffffffff, bank = 0;
+
+      JS_ToUint32(ctx, &value, argv[0]);
+
+      if(argc > 1 && !JS_IsUndefined(argv[1]))
+        JS_ToUint32(ctx, &mask, argv[1]);
+
+      if(argc > 2)
+        JS_ToUint32(ctx, &bank, argv[2]);
+
+      gpio_write_bank(gpio, bank, mask, value);
+      break;
+    }
   }
 
   return ret;
@@ -179,10 +210,326 @@ static const JSCFunctionListEntry js_gpio_funcs[] = {
     JS_CFUNC_MAGIC_DEF("initPin", 2, js_gpio_functions, GPIO_METHOD_INIT_PIN),
     JS_CFUNC_MAGIC_DEF("setPin", 2, js_gpio_functions, GPIO_METHOD_SET_PIN),
     JS_CFUNC_MAGIC_DEF("getPin", 1, js_gpio_functions, GPIO_METHOD_GET_PIN),
+    JS_CFUNC_MAGIC_DEF("readBank", 0, js_gpio_functions, GPIO_METHOD_READ_BANK),
+    JS_CFUNC_MAGIC_DEF("writeBank", 1, js_gpio_functions, GPIO_METHOD_WRITE_BANK),
     JS_CGETSET_MAGIC_DEF("buffer", js_gpio_getter, 0, GPIO_BUFFER),
     JS_PROP_STRING_DEF("[Symbol.toStringTag]", "GPIO", JS_PROP_CONFIGURABLE),
 };
 
+/**
+ * GPIOCapture: kernel-timestamped edges, delivered in batches
+ */
+typedef struct {
+  JSContext* ctx;
+  GPIOCapture capture;
+  JSValue callback, handler;
+  BOOL active;
+} JSGPIOCapture;
+
+enum {
+  GPIOCAPTURE_STOP = 0,
+};
+
+enum {
+  GPIOCAPTURE_ACTIVE = 0,
+  GPIOCAPTURE_DROPPED,
+  GPIOCAPTURE_PENDING,
+};
+
+#define GPIOCAPTURE_DEFAULT_SIZE 65536
+
+static inline JSGPIOCapture*
+js_gpiocapture_data2(JSContext* ctx, JSValueConst value) {
+  return JS_GetOpaque2(ctx, value, js_gpiocapture_class_id);
+}
+
+static void
+gpiocapture_watch(JSGPIOCapture* jc, BOOL on) {
+  JSContext* ctx = jc->ctx;
+  JSValue set_handler = js_iohandler_fn(ctx, FALSE);
+
+  if(!JS_IsException(set_handler))
+    js_iohandler_set(ctx, set_handler, jc->capture.wake[0], on ? JS_DupValue(ctx, jc->handler) : JS_NULL);
+
+  JS_FreeValue(ctx, set_handler);
+}
+
+static void
+gpiocapture_stop(JSGPIOCapture* jc) {
+  if(jc->active) {
+    jc->active = FALSE;
+    gpiocapture_watch(jc, FALSE);
+    gpio_capture_close(&jc->capture);
+  }
+}
+
+static void
+gpiocapture_free_buffer(JSRuntime* rt, void* opaque, void* ptr) {
+  js_free_rt(rt, ptr);
+}
+
+static JSValue
+gpiocapture_view(JSContext* ctx, const char* ctor, JSValueConst buffer, size_t offset, size_t length) {
+  JSValue args[3] = {buffer, JS_NewInt64(ctx, offset), JS_NewInt64(ctx, length)};
+
+  return js_global_new(ctx, ctor, countof(args), args);
+}
+
+/**
+ * Read handler: one callback per wakeup with every edge queued so far,
+ * as columns over one ArrayBuffer
+ */
+static JSValue
+js_gpiocapture_ready(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, JSValue data[]) {
+  JSGPIOCapture* jc;
+  GPIOEdge* edges;
+  uint8_t* mem;
+  size_t n;
+  JSValue buffer, batch, ret;
+
+  if(!(jc = js_gpiocapture_data2(ctx, data[0])))
+    return JS_EXCEPTION;
+
+  if(!jc->active || (n = gpio_capture_pending(&jc->capture)) == 0) {
+    gpio_capture_read(&jc->capture, 0, 0);
+    return JS_UNDEFINED;
+  }
+
+  if(!(edges = js_malloc(ctx, n * sizeof(GPIOEdge))))
+    return JS_EXCEPTION;
+
+  if(!(mem = js_malloc(ctx, n * (sizeof(uint64_t) + sizeof(uint32_t) + 1)))) {
+    js_free(ctx, edges);
+    return JS_EXCEPTION;
+  }
+
+  n = gpio_capture_read(&jc->capture, edges, n);
+
+  for(size_t i = 0; i < n; i++) {
+    ((uint64_t*)mem)[i] = edges[i].timestamp_ns;
+    ((uint32_t*)(mem + n * sizeof(uint64_t)))[i] = edges[i].line;
+    mem[n * (sizeof(uint64_t) + sizeof(uint32_t)) + i] = edges[i].edge;
+  }
+
+  js_free(ctx, edges);
+
+  buffer = JS_NewArrayBuffer(ctx, mem, n * (sizeof(uint64_t) + sizeof(uint32_t) + 1), gpiocapture_free_buffer, 0, FALSE);
+
+  batch = JS_NewObject(ctx);
+  JS_SetPropertyStr(ctx, batch, "timestamps", gpiocapture_view(ctx, "BigUint64Array", buffer, 0, n));
+  JS_SetPropertyStr(ctx, batch, "lines", gpiocapture_view(ctx, "Uint32Array", buffer, n * sizeof(uint64_t), n));
+  JS_SetPropertyStr(ctx, batch, "edges", gpiocapture_view(ctx, "Uint8Array", buffer, n * (sizeof(uint64_t) + sizeof(uint32_t)), n));
+  JS_SetPropertyStr(ctx, batch, "length", JS_NewInt64(ctx, n));
+  JS_SetPropertyStr(ctx, batch, "dropped", JS_NewInt64(ctx, __atomic_load_n(&jc->capture.dropped, __ATOMIC_RELAXED)));
+  JS_FreeValue(ctx, buffer);
+
+  ret = JS_Call(ctx, jc->callback, JS_UNDEFINED, 1, &batch);
+  JS_FreeValue(ctx, batch);
+
+  if(JS_IsException(ret))
+    return JS_EXCEPTION;
+
+  JS_FreeValue(ctx, ret);
+  return JS_UNDEFINED;
+}
+
+/**
+ * new GPIOCapture(lines, { chip, edge, debounce, bufferSize }, callback)
+ *
+ * lines are offsets on the gpiochip (default /dev/gpiochip0), edge is
+ * 'rising', 'falling' or 'both', debounce in microseconds and bufferSize
+ * the number of edges held between two callbacks.
+ */
+static JSValue
+js_gpiocapture_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  JSGPIOCapture* jc;
+  JSValue obj = JS_UNDEFINED, proto, value;
+  JSValueConst options = argc > 1 && JS_IsObject(argv[1]) ? argv[1] : JS_UNDEFINED;
+  uint32_t lines[GPIO_CAPTURE_MAX_LINES], num_lines = 0, debounce = 0, size = GPIOCAPTURE_DEFAULT_SIZE;
+  int edges = GPIO_EDGE_BOTH;
+  const char* chip = 0;
+  int64_t len;
+
+  if(!JS_IsFunction(ctx, argv[2]))
+    return JS_ThrowTypeError(ctx, "argument 3 must be a function");
+
+  if(JS_IsNumber(argv[0])) {
+    JS_ToUint32(ctx, &lines[num_lines++], argv[0]);
+  } else if((len = js_array_length(ctx, argv[0])) > 0) {
+    if(len > GPIO_CAPTURE_MAX_LINES)
+      return JS_ThrowRangeError(ctx, "at most %d lines can be captured", GPIO_CAPTURE_MAX_LINES);
+
+    for(; num_lines < len; num_lines++) {
+      value = JS_GetPropertyUint32(ctx, argv[0], num_lines);
+      JS_ToUint32(ctx, &lines[num_lines], value);
+      JS_FreeValue(ctx, value);
+    }
+  } else {
+    return JS_ThrowTypeError(ctx, "argument 1 must be a line offset or an array of them");
+  }
+
+  if(JS_IsObject(options)) {
+    if(JS_IsString((value = JS_GetPropertyStr(ctx, options, "edge")))) {
+      const char* str = JS_ToCString(ctx, value);
+
+      edges = !strcmp(str, "rising") ? GPIO_EDGE_RISING : !strcmp(str, "falling") ? GPIO_EDGE_FALLING : GPIO_EDGE_BOTH;
+      JS_FreeCString(ctx, str);
+    }
+
+    JS_FreeValue(ctx, value);
+
+    value = JS_GetPropertyStr(ctx, options, "debounce");
+    JS_ToUint32(ctx, &debounce, value);
+    JS_FreeValue(ctx, value);
+
+    if(!JS_IsUndefined((value = JS_GetPropertyStr(ctx, options, "bufferSize"))))
+      JS_ToUint32(ctx, &size, value);
+
+    JS_FreeValue(ctx, value);
+
+    if(JS_IsString((value = JS_GetPropertyStr(ctx, options, "chip"))))
+      chip = JS_ToCString(ctx, value);
+
+    JS_FreeValue(ctx, value);
+  }
+
+  if(!(jc = js_mallocz(ctx, sizeof(JSGPIOCapture)))) {
+    if(chip)
+      JS_FreeCString(ctx, chip);
+
+    return JS_EXCEPTION;
+  }
+
+  jc->ctx = ctx;
+  jc->callback = JS_DupValue(ctx, argv[2]);
+  jc->handler = JS_UNDEFINED;
+
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  if(JS_IsException(proto))
+    goto fail;
+  obj = JS_NewObjectProtoClass(ctx, proto, js_gpiocapture_class_id);
+  JS_FreeValue(ctx, proto);
+  if(JS_IsException(obj))
+    goto fail;
+
+  JS_SetOpaque(obj, jc);
+
+  if(gpio_capture_open(&jc->capture, chip ? chip : "/dev/gpiochip0", lines, num_lines, edges, debounce, MAX_NUM(size, 64))) {
+    JS_ThrowInternalError(ctx, "GPIO edge capture on %s failed: %s", chip ? chip : "/dev/gpiochip0", strerror(errno));
+    goto fail;
+  }
+
+  if(chip)
+    JS_FreeCString(ctx, chip);
+
+  jc->handler = JS_NewCFunctionData(ctx, js_gpiocapture_ready, 0, 0, 1, &obj);
+  jc->active = TRUE;
+  gpiocapture_watch(jc, TRUE);
+  return obj;
+
+fail:
+  if(chip)
+    JS_FreeCString(ctx, chip);
+
+  if(JS_IsObject(obj)) {
+    JS_FreeValue(ctx, obj);
+  } else {
+    JS_FreeValue(ctx, jc->callback);
+    js_free(ctx, jc);
+  }
+
+  return JS_EXCEPTION;
+}
+
+static JSValue
+js_gpiocapture_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  JSGPIOCapture* jc;
+
+  if(!(jc = js_gpiocapture_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case GPIOCAPTURE_STOP: {
+      gpiocapture_stop(jc);
+      break;
+    }
+  }
+
+  return JS_UNDEFINED;
+}
+
+static JSValue
+js_gpiocapture_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  JSGPIOCapture* jc;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(jc = js_gpiocapture_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case GPIOCAPTURE_ACTIVE: {
+      ret = JS_NewBool(ctx, jc->active);
+      break;
+    }
+
+    case GPIOCAPTURE_DROPPED: {
+      ret = JS_NewInt64(ctx, __atomic_load_n(&jc->capture.dropped, __ATOMIC_RELAXED));
+      break;
+    }
+
+    case GPIOCAPTURE_PENDING: {
+      ret = JS_NewInt64(ctx, jc->active ? gpio_capture_pending(&jc->capture) : 0);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static void
+js_gpiocapture_finalizer(JSRuntime* rt, JSValue val) {
+  JSGPIOCapture* jc;
+
+  /* while active the read handler keeps the object alive */
+  if((jc = JS_GetOpaque(val, js_gpiocapture_class_id))) {
+    if(jc->active)
+      gpio_capture_close(&jc->capture);
+
+    JS_FreeValueRT(rt, jc->callback);
+    JS_FreeValueRT(rt, jc->handler);
+    js_free_rt(rt, jc);
+  }
+}
+
+static void
+js_gpiocapture_mark(JSRuntime* rt, JSValueConst val, JS_MarkFunc* mark_func) {
+  JSGPIOCapture* jc;
+
+  if((jc = JS_GetOpaque(val, js_gpiocapture_class_id))) {
+    JS_MarkValue(rt, jc->callback, mark_func);
+    JS_MarkValue(rt, jc->handler, mark_func);
+  }
+}
+
+static JSClassDef js_gpiocapture_class = {
+    .class_name = "GPIOCapture",
+    .finalizer = js_gpiocapture_finalizer,
+    .gc_mark = js_gpiocapture_mark,
+};
+
+static const JSCFunctionListEntry js_gpiocapture_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("stop", 0, js_gpiocapture_method, GPIOCAPTURE_STOP),
+    JS_CGETSET_MAGIC_DEF("active", js_gpiocapture_get, 0, GPIOCAPTURE_ACTIVE),
+    JS_CGETSET_MAGIC_DEF("dropped", js_gpiocapture_get, 0, GPIOCAPTURE_DROPPED),
+    JS_CGETSET_MAGIC_DEF("pending", js_gpiocapture_get, 0, GPIOCAPTURE_PENDING),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "GPIOCapture", JS_PROP_CONFIGURABLE),
+};
+
+static const JSCFunctionListEntry js_gpiocapture_static_funcs[] = {
+    JS_PROP_INT32_DEF("RISING", GPIO_EDGE_RISING, JS_PROP_ENUMERABLE),
+    JS_PROP_INT32_DEF("FALLING", GPIO_EDGE_FALLING, JS_PROP_ENUMERABLE),
+};
+
 static const JSCFunctionListEntry js_gpio_static_funcs[] = {
     JS_PROP_INT32_DEF("INPUT", 0, JS_PROP_ENUMERABLE),
     JS_PROP_INT32_DEF("OUTPUT", 1, JS_PROP_ENUMERABLE),
@@ -204,10 +551,21 @@ js_gpio_init(JSContext* ctx, JSModuleDef* m) {
     JS_SetPropertyFunctionList(ctx, gpio_ctor, js_gpio_static_funcs, countof(js_gpio_static_funcs));
     JS_SetConstructor(ctx, gpio_ctor, gpio_proto);
     // JS_SetClassProto(ctx, js_gpio_class_id, gpio_proto);
+
+    JS_NewClassID(&js_gpiocapture_class_id);
+    JS_NewClass(JS_GetRuntime(ctx), js_gpiocapture_class_id, &js_gpiocapture_class);
+
+    gpiocapture_ctor = JS_NewCFunction2(ctx, js_gpiocapture_constructor, "GPIOCapture", 3, JS_CFUNC_constructor, 0);
+    gpiocapture_proto = JS_NewObject(ctx);
+
+    JS_SetPropertyFunctionList(ctx, gpiocapture_proto, js_gpiocapture_funcs, countof(js_gpiocapture_funcs));
+    JS_SetPropertyFunctionList(ctx, gpiocapture_ctor, js_gpiocapture_static_funcs, countof(js_gpiocapture_static_funcs));
+    JS_SetConstructor(ctx, gpiocapture_ctor, gpiocapture_proto);
   }
 
   if(m) {
     JS_SetModuleExport(ctx, m, "GPIO", gpio_ctor);
+    JS_SetModuleExport(ctx, m, "GPIOCapture", gpiocapture_ctor);
   }
 
   return 0;
@@ -225,6 +583,7 @@ JS_INIT_MODULE(JSContext* ctx, const char* module_name) {
 
   if((m = JS_NewCModule(ctx, module_name, js_gpio_init))) {
     JS_AddModuleExport(ctx, m, "GPIO");
+    JS_AddModuleExport(ctx, m, "GPIOCapture");
   }
 
   return m;
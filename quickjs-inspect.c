@@ -16,6 +16,7 @@
 #include <math.h>
 #include <string.h>
 #include <fcntl.h>
+#include <errno.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -54,6 +55,7 @@ typedef struct {
   unsigned getters : 1;
   unsigned string_break_newline : 1;
   unsigned reparseable : 1;
+  unsigned offsets : 1;
   int32_t depth;
   uint32_t max_array_length;
   uint32_t max_string_length;
@@ -61,14 +63,69 @@ typedef struct {
   int32_t compact;
   int32_t proto_chain;
   int32_t number_base;
+  int32_t group_bytes;
   Vector hide_keys;
   PropertyKey class_key;
 } InspectOptions;
 
+/**
+ * Output with budgets: once max_bytes are written or the deadline has
+ * passed, further output is dropped and the traversal stops at the next
+ * element. Output goes to out directly, for write callbacks in
+ * INSPECT_CHUNK sized pieces. An fd gets a vectored writer that stages
+ * INSPECT_CHUNK bytes and sends long strings without copying them.
+ */
+#define INSPECT_CHUNK 4096
+
+typedef struct {
+  Writer out;
+  JSContext* ctx;
+  JSValue callback;
+  DynBuf chunk;
+  size_t written, max_bytes;
+  uint64_t deadline;
+  uint32_t calls;
+  unsigned buffered : 1;
+  unsigned truncated : 1;
+  unsigned stopped : 1;
+  unsigned error : 1;
+} InspectSink;
+
+typedef enum {
+  KIND_OBJECT = 0,
+  KIND_TYPEDARRAY,
+  KIND_DATAVIEW,
+  KIND_ARRAYBUFFER,
+  KIND_DATE,
+  KIND_MAP,
+  KIND_SET,
+  KIND_REGEXP,
+  KIND_ERROR,
+  KIND_GENERATOR,
+} InspectKind;
+
+/**
+ * What inspect_object() resolves from an object's class and prototype
+ * chain: the special inspector to use, inherited custom inspect methods
+ * and the class tag. Cached for the duration of one inspect() call, keyed
+ * by class id and prototype, so prototype changes between calls are
+ * always seen; own properties are still checked on every object.
+ */
+typedef struct {
+  JSClassID class_id;
+  JSValue proto;
+  InspectKind kind;
+  JSValue custom, custom_node;
+  BOOL has_tag;
+  char *tag, *builtin;
+} InspectClass;
+
 typedef struct {
   InspectOptions opts;
   Writer wr;
   Vector hier;
+  InspectSink* sink;
+  Vector classes;
 } Inspector;
 
 static int stdout_isatty, stderr_isatty;
@@ -122,6 +179,8 @@ options_init(InspectOptions* opts, JSContext* ctx) {
   opts->compact = 5;
   opts->proto_chain = TRUE;
   opts->number_base = 10;
+  opts->offsets = FALSE;
+  opts->group_bytes = 1;
 
   vector_init(&opts->hide_keys, ctx);
 
@@ -196,6 +255,21 @@ options_get(InspectOptions* opts, JSContext* ctx, JSValueConst object) {
     JS_FreeValue(ctx, value);
   }
 
+  value = JS_GetPropertyStr(ctx, object, "offsets");
+
+  if(!JS_IsException(value) && !JS_IsUndefined(value)) {
+    opts->offsets = JS_ToBool(ctx, value);
+    JS_FreeValue(ctx, value);
+  }
+
+  value = JS_GetPropertyStr(ctx, object, "groupBytes");
+
+  if(JS_IsNumber(value)) {
+    JS_ToInt32(ctx, &opts->group_bytes, value);
+    opts->group_bytes = MAX_NUM(1, MIN_NUM(opts->group_bytes, 16));
+    JS_FreeValue(ctx, value);
+  }
+
   value = JS_GetPropertyStr(ctx, object, "depth");
 
   if(!JS_IsUndefined(value) && !JS_IsException(value)) {
@@ -303,6 +377,8 @@ options_object(InspectOptions* opts, JSContext* ctx) {
   JS_SetPropertyStr(ctx, ret, "getters", JS_NewBool(ctx, opts->getters));
   JS_SetPropertyStr(ctx, ret, "stringBreakNewline", JS_NewBool(ctx, opts->string_break_newline));
   JS_SetPropertyStr(ctx, ret, "reparseable", JS_NewBool(ctx, opts->reparseable));
+  JS_SetPropertyStr(ctx, ret, "offsets", JS_NewBool(ctx, opts->offsets));
+  JS_SetPropertyStr(ctx, ret, "groupBytes", JS_NewInt32(ctx, opts->group_bytes));
   JS_SetPropertyStr(ctx, ret, "depth", js_number_new(ctx, opts->depth));
   JS_SetPropertyStr(ctx, ret, "maxArrayLength", js_number_new(ctx, opts->max_array_length));
   JS_SetPropertyStr(ctx, ret, "maxStringLength", js_number_new(ctx, opts->max_string_length));
@@ -336,6 +412,168 @@ options_hidden(InspectOptions* opts, JSAtom atom) {
   return 0;
 }
 
+/* length of the chunk prefix that does not end in a partial UTF-8 sequence */
+static size_t
+sink_complete(const uint8_t* buf, size_t len) {
+  size_t i = len;
+
+  while(i > 0 && (buf[i - 1] & 0xc0) == 0x80)
+    i--;
+
+  if(i > 0 && buf[i - 1] >= 0xc0) {
+    size_t need = buf[i - 1] >= 0xf0 ? 4 : buf[i - 1] >= 0xe0 ? 3 : 2;
+
+    if(len - (i - 1) < need)
+      return i - 1;
+  }
+
+  return len;
+}
+
+static void
+sink_flush(InspectSink* sink, BOOL final) {
+  size_t n = sink->chunk.size;
+
+  if(!n || sink->stopped)
+    return;
+
+  if(JS_IsFunction(sink->ctx, sink->callback)) {
+    JSValue str, ret;
+
+    if(!final)
+      n = sink_complete(sink->chunk.buf, n);
+
+    str = JS_NewStringLen(sink->ctx, (const char*)sink->chunk.buf, n);
+    ret = JS_Call(sink->ctx, sink->callback, JS_UNDEFINED, 1, &str);
+
+    if(JS_IsException(ret))
+      sink->stopped = sink->error = TRUE;
+    else if(JS_IsBool(ret) && !JS_VALUE_GET_BOOL(ret))
+      sink->stopped = TRUE;
+
+    JS_FreeValue(sink->ctx, ret);
+    JS_FreeValue(sink->ctx, str);
+  }
+
+  memmove(sink->chunk.buf, sink->chunk.buf + n, sink->chunk.size - n);
+  sink->chunk.size -= n;
+}
+
+static ssize_t
+sink_put(InspectSink* sink, const void* buf, size_t len) {
+  if(sink->out.flush) {
+    for(size_t pos = 0; pos < len;) {
+      ssize_t r;
+
+      if((r = writer_write(&sink->out, (const uint8_t*)buf + pos, len - pos)) <= 0)
+        return -1;
+
+      pos += r;
+    }
+
+    return len;
+  }
+
+  if(!sink->buffered)
+    return writer_write(&sink->out, buf, len);
+
+  if(dbuf_put(&sink->chunk, buf, len))
+    return -1;
+
+  if(sink->chunk.size >= INSPECT_CHUNK)
+    sink_flush(sink, FALSE);
+
+  return len;
+}
+
+static ssize_t
+write_sink(InspectSink* sink, const void* buf, size_t len, Writer* wr) {
+  if(sink->truncated || sink->stopped)
+    return len;
+
+  if(sink->deadline && !(++sink->calls & 63) && time_us() >= sink->deadline)
+    sink->truncated = TRUE;
+
+  if(sink->written + len > sink->max_bytes) {
+    len = sink->max_bytes - sink->written;
+    sink->truncated = TRUE;
+  }
+
+  if(sink_put(sink, buf, len) < 0) {
+    if(sink->out.flush)
+      JS_ThrowInternalError(sink->ctx, "inspect: write error: %s", strerror(errno));
+    else
+      JS_ThrowOutOfMemory(sink->ctx);
+
+    sink->stopped = sink->error = TRUE;
+  }
+
+  sink->written += len;
+  return len;
+}
+
+static inline Writer
+writer_from_sink(InspectSink* sink) {
+  return (Writer){(WriteFunction*)&write_sink, sink, NULL};
+}
+
+static inline BOOL
+inspect_stopped(Inspector* insp) {
+  return insp->sink && (insp->sink->truncated || insp->sink->stopped);
+}
+
+/**
+ * Reads { write, fd, maxBytes, timeout } from the inspect() options.
+ */
+static void
+sink_options(InspectSink* sink, JSContext* ctx, JSValueConst object) {
+  JSValue value;
+
+  value = JS_GetPropertyStr(ctx, object, "maxBytes");
+
+  if(JS_IsNumber(value)) {
+    double d;
+
+    JS_ToFloat64(ctx, &d, value);
+    sink->max_bytes = (isinf(d) || d < 0) ? SIZE_MAX : (size_t)d;
+  }
+
+  JS_FreeValue(ctx, value);
+  value = JS_GetPropertyStr(ctx, object, "timeout");
+
+  if(JS_IsNumber(value)) {
+    double ms;
+
+    JS_ToFloat64(ctx, &ms, value);
+
+    if(isfinite(ms) && ms >= 0)
+      sink->deadline = time_us() + (uint64_t)(ms * 1000);
+  }
+
+  JS_FreeValue(ctx, value);
+  value = JS_GetPropertyStr(ctx, object, "write");
+
+  if(JS_IsFunction(ctx, value)) {
+    sink->callback = value;
+    sink->buffered = TRUE;
+  } else {
+    JS_FreeValue(ctx, value);
+    value = JS_GetPropertyStr(ctx, object, "fd");
+
+    if(JS_IsNumber(value)) {
+      int32_t fd = -1;
+
+      JS_ToInt32(ctx, &fd, value);
+      sink->out = writer_vectored(fd, INSPECT_CHUNK, false);
+    }
+
+    JS_FreeValue(ctx, value);
+  }
+
+  if(sink->buffered)
+    js_dbuf_init(ctx, &sink->chunk);
+}
+
 static void
 put_newline(Writer* wr, int32_t depth) {
   writer_putc(wr, '\n');
@@ -416,16 +654,134 @@ put_escaped(Writer* wr, const char* str, size_t len) {
   }
 }
 
+/* X of "[object X]" unless it is "Object" */
+static char*
+inspect_builtin_tag(JSContext* ctx, JSValueConst value) {
+  const char *s = 0, *e;
+  char* ret = 0;
+
+  if(JS_IsFunction(ctx, object_tostring))
+    s = js_object_tostring2(ctx, object_tostring, value);
+
+  if(s && !strncmp(s, "[object ", 8) && (e = strchr(s, ']')))
+    if(e - (s + 8) != 6 || memcmp(s + 8, "Object", 6))
+      ret = js_strndup(ctx, s + 8, e - (s + 8));
+
+  if(s)
+    JS_FreeCString(ctx, s);
+
+  return ret;
+}
+
+static InspectKind
+inspect_kind(JSContext* ctx, JSValueConst value) {
+  switch(js_value_type_flags(ctx, value)) {
+    case OBJECT_TYPEDARRAY: return KIND_TYPEDARRAY;
+    case OBJECT_DATAVIEW: return KIND_DATAVIEW;
+    case OBJECT_ARRAYBUFFER:
+    case OBJECT_SHAREDARRAYBUFFER: return KIND_ARRAYBUFFER;
+    case OBJECT_DATE: return KIND_DATE;
+    case OBJECT_MAP: return KIND_MAP;
+    case OBJECT_SET: return KIND_SET;
+    case OBJECT_REGEXP: return KIND_REGEXP;
+    case OBJECT_ERROR: return KIND_ERROR;
+    case OBJECT_GENERATOR: return KIND_GENERATOR;
+    default: break;
+  }
+
+  return KIND_OBJECT;
+}
+
+static inline BOOL
+inspect_same(JSValueConst a, JSValueConst b) {
+  return JS_VALUE_GET_TAG(a) == JS_VALUE_GET_TAG(b) && JS_VALUE_GET_PTR(a) == JS_VALUE_GET_PTR(b);
+}
+
+/**
+ * Looks up or fills the class cache entry for value; the first object of
+ * a class is used to resolve its kind and tags.
+ */
+static InspectClass*
+inspect_class(Inspector* insp, JSValueConst value) {
+  JSContext* const ctx = insp->hier.opaque;
+  InspectOptions* const opts = &insp->opts;
+  JSClassID class_id = JS_GetClassID(value);
+  JSValue proto = JS_GetPrototype(ctx, value);
+  InspectClass *ic, entry;
+
+  if(JS_IsException(proto))
+    return 0;
+
+  vector_foreach_t(&insp->classes, ic) {
+    if(ic->class_id == class_id && inspect_same(ic->proto, proto)) {
+      JS_FreeValue(ctx, proto);
+      return ic;
+    }
+  }
+
+  entry.class_id = class_id;
+  entry.proto = proto;
+  entry.kind = inspect_kind(ctx, value);
+  entry.custom = JS_IsObject(proto) ? JS_GetProperty(ctx, proto, inspect_custom_atom) : JS_UNDEFINED;
+  entry.custom_node = JS_IsObject(proto) ? JS_GetProperty(ctx, proto, inspect_custom_atom_node) : JS_UNDEFINED;
+  entry.has_tag = opts->class_key.atom != 1 && JS_IsObject(proto) && JS_HasProperty(ctx, proto, opts->class_key.atom) > 0;
+  entry.tag = entry.has_tag ? js_get_property_string(ctx, value, opts->class_key.atom) : 0;
+  entry.builtin = (entry.has_tag && entry.kind != KIND_TYPEDARRAY) ? 0 : inspect_builtin_tag(ctx, value);
+
+  if(!(ic = vector_push(&insp->classes, entry))) {
+    JS_FreeValue(ctx, entry.proto);
+    JS_FreeValue(ctx, entry.custom);
+    JS_FreeValue(ctx, entry.custom_node);
+
+    if(entry.tag)
+      js_free(ctx, entry.tag);
+    if(entry.builtin)
+      js_free(ctx, entry.builtin);
+  }
+
+  return ic;
+}
+
+static void
+inspect_classes_free(Inspector* insp, JSContext* ctx) {
+  InspectClass* ic;
+
+  vector_foreach_t(&insp->classes, ic) {
+    JS_FreeValue(ctx, ic->proto);
+    JS_FreeValue(ctx, ic->custom);
+    JS_FreeValue(ctx, ic->custom_node);
+
+    if(ic->tag)
+      js_free(ctx, ic->tag);
+    if(ic->builtin)
+      js_free(ctx, ic->builtin);
+  }
+
+  vector_free(&insp->classes);
+}
+
+/* own property, else the inherited value from the class cache */
 static JSValue
-inspect_custom(Inspector* insp, JSValueConst obj, int32_t level) {
+inspect_lookup(JSContext* ctx, JSValueConst obj, JSAtom atom, const JSValue* inherited) {
+  if(!inherited)
+    return JS_HasProperty(ctx, obj, atom) ? JS_GetProperty(ctx, obj, atom) : JS_UNDEFINED;
+
+  if(JS_GetOwnProperty(ctx, 0, obj, atom) > 0)
+    return JS_GetProperty(ctx, obj, atom);
+
+  return JS_DupValue(ctx, *inherited);
+}
+
+static JSValue
+inspect_custom(Inspector* insp, JSValueConst obj, int32_t level, InspectClass* ic) {
   JSContext* const ctx = insp->hier.opaque;
   InspectOptions* const opts = &insp->opts;
-  JSValue ret = JS_UNDEFINED, inspect = JS_UNDEFINED;
+  JSValue ret = JS_UNDEFINED, inspect;
+
+  inspect = inspect_lookup(ctx, obj, inspect_custom_atom, ic ? &ic->custom : 0);
 
-  if(JS_HasProperty(ctx, obj, inspect_custom_atom))
-    inspect = JS_GetProperty(ctx, obj, inspect_custom_atom);
-  else if(JS_HasProperty(ctx, obj, inspect_custom_atom_node))
-    inspect = JS_GetProperty(ctx, obj, inspect_custom_atom_node);
+  if(JS_IsUndefined(inspect))
+    inspect = inspect_lookup(ctx, obj, inspect_custom_atom_node, ic ? &ic->custom_node : 0);
 
   if(JS_IsFunction(ctx, inspect)) {
     JSValueConst args[2];
@@ -506,7 +862,7 @@ inspect_map(Inspector* insp, JSValueConst obj, int32_t level) {
   else
     put_newline(wr, depth);
 
-  for(i = 0; !(finish = iteration_next(&it, ctx)); i++) {
+  for(i = 0; !inspect_stopped(insp) && !(finish = iteration_next(&it, ctx)); i++) {
     if(!finish) {
       data = iteration_value(&it, ctx);
 
@@ -573,7 +929,7 @@ inspect_set(Inspector* insp, JSValueConst obj, int32_t level) {
   else
     put_newline(wr, depth);
 
-  for(i = 0; !(finish = iteration_next(&it, ctx)); i++) {
+  for(i = 0; !inspect_stopped(insp) && !(finish = iteration_next(&it, ctx)); i++) {
     if(!finish) {
       value = iteration_value(&it, ctx);
 
@@ -599,18 +955,75 @@ inspect_set(Inspector* insp, JSValueConst obj, int32_t level) {
   return 1;
 }
 
+static const char inspect_hex[] = "0123456789abcdef";
+
+/**
+ * Hex dump of up to maxArrayLength bytes, formatted a line at a time
+ * into a local buffer: groups of groupBytes bytes, each line optionally
+ * preceded by its offset. Returns the number of bytes dumped.
+ */
+static size_t
+inspect_hexdump(Inspector* insp, const uint8_t* ptr, size_t size, int32_t depth) {
+  InspectOptions* const opts = &insp->opts;
+  Writer* const wr = &insp->wr;
+  size_t i, j, pos = 0, group = opts->group_bytes, n = MIN_NUM(size, (size_t)opts->max_array_length), per_line = SIZE_MAX;
+  char line[512];
+
+  if(opts->break_length != INT32_MAX) {
+    int32_t width = opts->break_length - (depth + 3) * 2 - (opts->offsets ? 10 : 0);
+
+    per_line = MAX_NUM(1, (width + 1) / (int32_t)(group * 2 + 1)) * group;
+  }
+
+  for(i = 0; i < n && !inspect_stopped(insp); i += group) {
+    if(i % per_line == 0) {
+      if(i) {
+        writer_write(wr, line, pos);
+        pos = 0;
+
+        if(IS_COMPACT(depth + 2))
+          writer_putc(wr, ' ');
+        else
+          put_newline(wr, depth + 3);
+      }
+
+      if(opts->offsets) {
+        pos += fmt_xlonglong0(&line[pos], i, 8);
+        line[pos++] = ':';
+        line[pos++] = ' ';
+      }
+    } else {
+      line[pos++] = ' ';
+    }
+
+    for(j = i; j < i + group && j < n; j++) {
+      line[pos++] = inspect_hex[ptr[j] >> 4];
+      line[pos++] = inspect_hex[ptr[j] & 0xf];
+    }
+
+    if(pos > sizeof(line) - 64) {
+      writer_write(wr, line, pos);
+      pos = 0;
+    }
+  }
+
+  if(pos)
+    writer_write(wr, line, pos);
+
+  return MIN_NUM(i, n);
+}
+
+/**
+ * ArrayBuffer, SharedArrayBuffer and DataView contents; name is the
+ * class to print, view is TRUE for a DataView
+ */
 static int
-inspect_arraybuffer(Inspector* insp, JSValueConst value, int32_t level) {
-  JSContext* const ctx = insp->hier.opaque;
+inspect_bytes(Inspector* insp, const char* name, BOOL view, const uint8_t* ptr, size_t size, int32_t depth) {
   InspectOptions* const opts = &insp->opts;
   Writer* const wr = &insp->wr;
   char buf[FMT_ULONG];
-  const char *str, *str2;
-  uint8_t* ptr;
-  size_t i, slen, size;
-  int32_t depth = INT32_IN_RANGE(level) ? level : 0;
-  int column, break_len = opts->break_length;
-  JSValue proto;
+  size_t i, column = 0;
+  int32_t break_len = opts->break_length;
 
   break_len = (break_len + 1) / 3;
   break_len *= 3;
@@ -618,27 +1031,10 @@ inspect_arraybuffer(Inspector* insp, JSValueConst value, int32_t level) {
   if(break_len > opts->break_length)
     break_len = opts->break_length;
 
-  ptr = JS_GetArrayBuffer(ctx, &size, value);
-  proto = JS_GetPrototype(ctx, value);
-  str = js_object_tostring2(ctx, object_tostring, proto);
-  JS_FreeValue(ctx, proto);
-
   if(opts->reparseable) {
-    writer_puts(wr, "new Uint8Array([");
+    writer_puts(wr, view ? "new DataView(new Uint8Array([" : "new Uint8Array([");
   } else {
-    if(js_is_arraybuffer(ctx, value))
-      writer_puts(wr, "ArrayBuffer");
-    else if(js_is_sharedarraybuffer(ctx, value))
-      writer_puts(wr, "SharedArrayBuffer");
-    else if(str && (str2 = strchr(str, ' '))) {
-      str2++;
-      slen = byte_chr(str2, strlen(str2), ']');
-      writer_write(wr, str2, slen);
-    }
-
-    if(str)
-      JS_FreeCString(ctx, str);
-
+    writer_puts(wr, name);
     writer_puts(wr, " {");
 
     if(IS_COMPACT(depth + 1))
@@ -656,23 +1052,22 @@ inspect_arraybuffer(Inspector* insp, JSValueConst value, int32_t level) {
   else
     put_newline(wr, depth + 3);
 
-  break_len -= (depth + 3) * 2;
-  column = 0;
+  if(opts->reparseable) {
+    break_len -= (depth + 3) * 2;
 
-  for(i = 0; i < size; i++) {
-    if(column + (opts->reparseable ? 6 : 3) >= break_len && opts->break_length != INT32_MAX) {
-      if(opts->reparseable && i > 0)
-        writer_putc(wr, ',');
+    for(i = 0; i < size; i++) {
+      if(column + 6 >= (size_t)break_len && opts->break_length != INT32_MAX) {
+        if(i > 0)
+          writer_putc(wr, ',');
 
-      if(IS_COMPACT(depth + 2))
-        writer_putc(wr, ' ');
-      else
-        put_newline(wr, depth + 3);
+        if(IS_COMPACT(depth + 2))
+          writer_putc(wr, ' ');
+        else
+          put_newline(wr, depth + 3);
 
-      column = 0;
-    }
+        column = 0;
+      }
 
-    if(opts->reparseable) {
       if(i > 0) {
         writer_puts(wr, column > 0 ? ", " : "");
         column += 2;
@@ -686,26 +1081,16 @@ inspect_arraybuffer(Inspector* insp, JSValueConst value, int32_t level) {
         writer_write(wr, buf, fmt_xlong0(buf, ptr[i], 2));
         column += 4;
       }
-    } else if(i == (size_t)opts->max_array_length) {
-      break;
-    } else {
-      writer_puts(wr, column ? " " : "");
-      writer_write(wr, buf, fmt_xlong0(buf, ptr[i], 2));
-
-      column += column ? 3 : 2;
     }
-  }
-
-  if(opts->reparseable) {
 
     if(IS_COMPACT(depth + 2))
       writer_putc(wr, ' ');
     else
       put_newline(wr, depth + 2);
 
-    writer_puts(wr, "]).buffer");
+    writer_puts(wr, view ? "]).buffer)" : "]).buffer");
   } else {
-    if(i < size) {
+    if((i = inspect_hexdump(insp, ptr, size, depth)) < size) {
       if(IS_COMPACT(depth + 3))
         writer_putc(wr, ' ');
       else
@@ -734,6 +1119,207 @@ inspect_arraybuffer(Inspector* insp, JSValueConst value, int32_t level) {
   return 1;
 }
 
+static int
+inspect_arraybuffer(Inspector* insp, JSValueConst value, int32_t level) {
+  JSContext* const ctx = insp->hier.opaque;
+  const char *str = 0, *name = "";
+  char tmp[64];
+  uint8_t* ptr;
+  size_t size;
+  int32_t depth = INT32_IN_RANGE(level) ? level : 0;
+  JSValue proto;
+
+  ptr = JS_GetArrayBuffer(ctx, &size, value);
+
+  if(js_is_arraybuffer(ctx, value)) {
+    name = "ArrayBuffer";
+  } else if(js_is_sharedarraybuffer(ctx, value)) {
+    name = "SharedArrayBuffer";
+  } else {
+    const char* str2;
+
+    proto = JS_GetPrototype(ctx, value);
+    str = js_object_tostring2(ctx, object_tostring, proto);
+    JS_FreeValue(ctx, proto);
+
+    if(str && (str2 = strchr(str, ' '))) {
+      str2++;
+      pstrcpy(tmp, MIN_NUM(sizeof(tmp), byte_chr(str2, strlen(str2), ']') + 1), str2);
+      name = tmp;
+    }
+
+    if(str)
+      JS_FreeCString(ctx, str);
+  }
+
+  return inspect_bytes(insp, name, FALSE, ptr, size, depth);
+}
+
+static int
+inspect_dataview(Inspector* insp, JSValueConst value, int32_t level) {
+  JSContext* const ctx = insp->hier.opaque;
+  JSValue buffer = JS_GetPropertyStr(ctx, value, "buffer");
+  uint64_t offset = js_get_propertystr_uint64(ctx, value, "byteOffset");
+  uint64_t length = js_get_propertystr_uint64(ctx, value, "byteLength");
+  int32_t depth = INT32_IN_RANGE(level) ? level : 0;
+  uint8_t* ptr;
+  size_t size;
+  int ret = 0;
+
+  if((ptr = JS_GetArrayBuffer(ctx, &size, buffer)) && offset + length <= size)
+    ret = inspect_bytes(insp, "DataView", TRUE, ptr + offset, length, depth);
+
+  JS_FreeValue(ctx, buffer);
+  return ret;
+}
+
+/**
+ * TypedArray elements read straight from the backing buffer and
+ * formatted into a line buffer, numberBase applying to integers; name is
+ * the class name, e.g. "Int16Array". Returns 0 to fall back to the
+ * generic path.
+ */
+static int
+inspect_typedarray(Inspector* insp, JSValueConst value, int32_t level, const char* name) {
+  JSContext* const ctx = insp->hier.opaque;
+  InspectOptions* const opts = &insp->opts;
+  Writer* const wr = &insp->wr;
+  int32_t depth = INT32_IN_RANGE(level) ? level : 0, width = opts->break_length - (depth + 1) * 2;
+  size_t offset, length, bpe, size, count, i, pos = 0, column = 0;
+  BOOL is_float = name[0] == 'F', is_big = name[0] == 'B', is_signed = name[0] == 'I' || !strncmp(name, "BigInt", 6);
+  BOOL compact = IS_COMPACT(depth + 1), wrap = opts->break_length != INT32_MAX;
+  int base = opts->number_base;
+  const uint8_t* ptr;
+  char line[512], buf[FMT_ULONG];
+  JSValue buffer;
+
+  if(opts->reparseable || (is_float && opts->number_base != 10) || (base != 2 && base != 8 && base != 10 && base != 16))
+    return 0;
+
+  buffer = JS_GetTypedArrayBuffer(ctx, value, &offset, &length, &bpe);
+
+  if(JS_IsException(buffer))
+    return -1;
+
+  ptr = JS_GetArrayBuffer(ctx, &size, buffer);
+  JS_FreeValue(ctx, buffer);
+
+  if(!ptr || (is_float && bpe != 4 && bpe != 8) || (!is_float && bpe > 8))
+    return 0;
+
+  ptr += offset;
+  count = length / bpe;
+
+  writer_puts(wr, name);
+  writer_puts(wr, count ? " [" : " []");
+
+  for(i = 0; i < count && i < (size_t)opts->max_array_length && !inspect_stopped(insp); i++) {
+    const uint8_t* p = ptr + i * bpe;
+    char num[FMT_LONG + 8];
+    size_t len = 0;
+
+    if(is_float) {
+      double d = bpe == 4 ? (double)*(const float*)p : *(const double*)p;
+      JSValue v = JS_NewFloat64(ctx, d);
+      const char* str;
+      size_t slen;
+
+      if((str = JS_ToCStringLen(ctx, &slen, v))) {
+        len = MIN_NUM(slen, sizeof(num));
+        memcpy(num, str, len);
+        JS_FreeCString(ctx, str);
+      }
+
+      JS_FreeValue(ctx, v);
+    } else {
+      uint64_t u = 0;
+      int64_t n;
+
+      memcpy(&u, p, bpe);
+
+      if(is_signed && bpe < 8 && (u >> (bpe * 8 - 1)))
+        u |= ~(uint64_t)0 << (bpe * 8);
+
+      n = (int64_t)u;
+
+      if(is_signed && n < 0 && base != 10) {
+        num[len++] = '-';
+        u = -(uint64_t)n;
+      }
+
+      switch(base) {
+        case 16: num[len++] = '0', num[len++] = 'x'; break;
+        case 8: num[len++] = '0', num[len++] = 'o'; break;
+        case 2: num[len++] = '0', num[len++] = 'b'; break;
+      }
+
+      len += (is_signed && base == 10) ? i64toa(&num[len], n, 10) : u64toa(&num[len], u, base);
+
+      if(is_big)
+        num[len++] = 'n';
+    }
+
+    if(i)
+      line[pos++] = ',';
+
+    if(!compact && (i == 0 || (wrap && column + len + 2 > (size_t)MAX_NUM(width, 1)))) {
+      writer_write(wr, line, pos);
+      pos = 0;
+      put_newline(wr, depth + 1);
+      column = 0;
+    } else {
+      line[pos++] = ' ';
+      column += i ? 2 : 1;
+    }
+
+    if(opts->colors) {
+      memcpy(&line[pos], COLOR_YELLOW, sizeof(COLOR_YELLOW) - 1);
+      pos += sizeof(COLOR_YELLOW) - 1;
+    }
+
+    memcpy(&line[pos], num, len);
+    pos += len;
+    column += len;
+
+    if(opts->colors) {
+      memcpy(&line[pos], COLOR_NONE, sizeof(COLOR_NONE) - 1);
+      pos += sizeof(COLOR_NONE) - 1;
+    }
+
+    if(pos > sizeof(line) - 128) {
+      writer_write(wr, line, pos);
+      pos = 0;
+    }
+  }
+
+  if(pos)
+    writer_write(wr, line, pos);
+
+  if(i < count) {
+    writer_puts(wr, ",");
+
+    if(compact)
+      writer_putc(wr, ' ');
+    else
+      put_newline(wr, depth + 1);
+
+    writer_puts(wr, "... ");
+    writer_write(wr, buf, fmt_ulong(buf, count - i));
+    writer_puts(wr, " more items");
+  }
+
+  if(count) {
+    if(compact)
+      writer_putc(wr, ' ');
+    else
+      put_newline(wr, depth);
+
+    writer_puts(wr, "]");
+  }
+
+  return 1;
+}
+
 static int
 inspect_regexp(Inspector* insp, JSValueConst value, int32_t depth) {
   JSContext* const ctx = insp->hier.opaque;
@@ -1001,10 +1587,9 @@ inspect_object(Inspector* insp, JSValueConst value, int32_t level) {
   InspectOptions* const opts = &insp->opts;
   Writer* const wr = &insp->wr;
   int32_t depth = INT32_IN_RANGE(level) ? level : 0;
-  JSObject* obj = JS_VALUE_GET_OBJ(value);
-
   BOOL is_array = js_is_array(ctx, value);
   BOOL is_function = JS_IsFunction(ctx, value);
+  InspectClass* ic;
 
   if(opts->depth != INT32_MAX && depth + 1 > opts->depth) {
     writer_puts(wr,
@@ -1014,8 +1599,10 @@ inspect_object(Inspector* insp, JSValueConst value, int32_t level) {
     return 1;
   }
 
+  ic = inspect_class(insp, value);
+
   if(opts->custom_inspect) {
-    JSValue tmp = inspect_custom(insp, value, depth + 1);
+    JSValue tmp = inspect_custom(insp, value, depth + 1, ic);
 
     if(JS_IsString(tmp)) {
       const char* s = JS_ToCString(ctx, tmp);
@@ -1036,56 +1623,66 @@ inspect_object(Inspector* insp, JSValueConst value, int32_t level) {
   if(!is_function) {
     BOOL is_typedarray = js_is_typedarray(ctx, value);
 
+    InspectKind kind = ic ? ic->kind : inspect_kind(ctx, value);
+
+    if(kind == KIND_TYPEDARRAY) {
+      char* name = ic ? ic->builtin : inspect_builtin_tag(ctx, value);
+      int r = name ? inspect_typedarray(insp, value, depth, name) : 0;
+
+      if(!ic && name)
+        js_free(ctx, name);
+
+      if(r)
+        return r;
+    }
+
     if(!is_array && !is_typedarray) {
-      if(js_is_arraybuffer(ctx, value) || js_is_sharedarraybuffer(ctx, value))
-        return inspect_arraybuffer(insp, value, depth);
-      if(js_is_date(ctx, value))
-        return inspect_date(insp, value, depth);
-      if(js_is_map(ctx, value))
-        return inspect_map(insp, value, depth);
-      if(js_is_set(ctx, value))
-        return inspect_set(insp, value, depth);
-      if(js_is_regexp(ctx, value))
-        return inspect_regexp(insp, value, depth);
-      if(js_is_error(ctx, value))
-        return inspect_error(insp, value, depth);
+      switch(kind) {
+        case KIND_DATAVIEW:
+          if(inspect_dataview(insp, value, depth))
+            return 1;
+          break;
+        case KIND_ARRAYBUFFER: return inspect_arraybuffer(insp, value, depth);
+        case KIND_DATE: return inspect_date(insp, value, depth);
+        case KIND_MAP: return inspect_map(insp, value, depth);
+        case KIND_SET: return inspect_set(insp, value, depth);
+        case KIND_REGEXP: return inspect_regexp(insp, value, depth);
+        case KIND_ERROR: return inspect_error(insp, value, depth);
+        default: break;
+      }
     }
 
-    if(js_is_generator(ctx, value)) {
+    if(kind == KIND_GENERATOR) {
       writer_puts(wr, "Object [Generator] {}");
       return 1;
     }
   }
 
   if(!is_function) {
-    if(opts->class_key.atom != 1 && JS_HasProperty(ctx, value, opts->class_key.atom)) {
-      char* tostring_tag;
+    BOOL own_tag = opts->class_key.atom != 1 && JS_GetOwnProperty(ctx, 0, value, opts->class_key.atom) > 0;
+
+    if(own_tag || (ic ? ic->has_tag : opts->class_key.atom != 1 && JS_HasProperty(ctx, value, opts->class_key.atom))) {
+      char* tostring_tag = (own_tag || !ic) ? js_get_property_string(ctx, value, opts->class_key.atom) : ic->tag;
 
-      if((tostring_tag = js_get_property_string(ctx, value, opts->class_key.atom))) {
+      if(tostring_tag) {
         writer_puts(wr, opts->colors ? COLOR_LIGHTRED : "");
         writer_puts(wr, tostring_tag);
         writer_puts(wr, opts->colors ? COLOR_NONE " " : " ");
-        js_free(ctx, tostring_tag);
+
+        if(tostring_tag != (ic ? ic->tag : 0))
+          js_free(ctx, tostring_tag);
       }
     } else if(!is_array) {
-      const char* s = 0;
-
-      if(s == 0 && JS_IsFunction(ctx, object_tostring))
-        s = js_object_tostring2(ctx, object_tostring, value);
+      char* builtin = (own_tag || !ic) ? inspect_builtin_tag(ctx, value) : ic->builtin;
 
-      if(s && !strncmp(s, "[object ", 8)) {
-        const char* e = strchr(s, ']');
-        size_t slen = e - (s + 8);
+      if(builtin) {
+        writer_puts(wr, opts->colors ? COLOR_LIGHTRED : "[");
+        writer_puts(wr, builtin);
+        writer_puts(wr, opts->colors ? COLOR_NONE " " : "] ");
 
-        if(slen != 6 || memcmp(s + 8, "Object", 6)) {
-          writer_puts(wr, opts->colors ? COLOR_LIGHTRED : "[");
-          writer_write(wr, s + 8, e - (s + 8));
-          writer_puts(wr, opts->colors ? COLOR_NONE " " : "] ");
-        }
+        if(builtin != (ic ? ic->builtin : 0))
+          js_free(ctx, builtin);
       }
-
-      if(s)
-        JS_FreeCString(ctx, s);
     }
   } else {
     JSValue name = JS_GetPropertyStr(ctx, value, "name");
@@ -1261,6 +1858,9 @@ inspect_recursive(Inspector* insp, JSValueConst obj, int32_t level) {
   }
 
   while(it) {
+    if(inspect_stopped(insp))
+      break;
+
     JSValue value = property_enumeration_value(it, ctx);
     index = property_enumeration_index(it);
 
@@ -1365,17 +1965,22 @@ js_inspect(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[])
   int32_t level;
   JSValue ret = JS_UNDEFINED;
   int optind = 1;
-  js_dbuf_init(ctx, &dbuf);
+  Arena* arena = js_arena(ctx);
+  ArenaMark mark = arena_mark(arena);
+  dbuf_init_arena(&dbuf, arena);
   buf_wr = writer_from_dynbuf(&dbuf);
-  Inspector insp = {{}, buf_wr, VECTOR(ctx)};
+  InspectSink sink = {buf_wr, ctx, JS_UNDEFINED, {0}, 0, SIZE_MAX};
+  Inspector insp = {{}, writer_from_sink(&sink), VECTOR(ctx), &sink, VECTOR(ctx)};
 
   options_init(&insp.opts, ctx);
 
   if(argc > 1 && JS_IsNumber(argv[1]))
     optind++;
 
-  if(optind < argc)
+  if(optind < argc) {
     options_get(&insp.opts, ctx, argv[optind]);
+    sink_options(&sink, ctx, argv[optind]);
+  }
 
   if(optind > 1) {
     double d;
@@ -1390,9 +1995,29 @@ js_inspect(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[])
   else
     inspect_value(&insp, argv[0], level);
 
-  ret = JS_NewStringLen(ctx, (const char*)dbuf.buf, dbuf.size);
+  if(sink.truncated && !sink.stopped)
+    sink_put(&sink, "...", 3);
+
+  if(sink.out.flush) {
+    if(writer_flush(&sink.out) < 0 && !sink.error) {
+      JS_ThrowInternalError(ctx, "inspect: write error: %s", strerror(errno));
+      sink.error = TRUE;
+    }
+
+    writer_free(&sink.out);
+    ret = sink.error ? JS_EXCEPTION : JS_NewInt64(ctx, sink.written);
+  } else if(sink.buffered) {
+    sink_flush(&sink, TRUE);
+    ret = sink.error ? JS_EXCEPTION : JS_NewInt64(ctx, sink.written);
+    dbuf_free(&sink.chunk);
+    JS_FreeValue(ctx, sink.callback);
+  } else {
+    ret = JS_NewStringLen(ctx, (const char*)dbuf.buf, dbuf.size);
+  }
 
-  writer_free(&insp.wr);
+  dbuf_free(&dbuf);
+  arena_release(arena, mark);
+  inspect_classes_free(&insp, ctx);
   options_free(&insp.opts, ctx);
 
   return ret;
@@ -1413,10 +2038,11 @@ js_inspect_tostring(JSContext* ctx, JSValueConst value) {
 
   printf("options {\n  depth: %i\n}\n", options.depth);
 
-  Inspector insp = {{}, writer_from_dynbuf(&dbuf), VECTOR(ctx)};
+  Inspector insp = {{}, writer_from_dynbuf(&dbuf), VECTOR(ctx), 0, VECTOR(ctx)};
 
   inspect_value(&insp, value, options.depth);
 
+  inspect_classes_free(&insp, ctx);
   options_free(&insp.opts, ctx);
 
   dbuf_0(&dbuf);
@@ -10,6 +10,8 @@
 #include "buffer-utils.h"
 #include "debug.h"
 #include "token.h"
+#include "quickjs-perf.h"
+#include "arena.h"
 
 /**
  * \addtogroup quickjs-lexer
@@ -37,7 +39,9 @@ js_lexer_rule_new(JSContext* ctx, Lexer* lex, LexerRule* rule) {
   JSValue ret, states;
   DynBuf dbuf;
   size_t i, j;
-  js_dbuf_init(ctx, &dbuf);
+  Arena* arena = js_arena(ctx);
+  ArenaMark mark = arena_mark(arena);
+  dbuf_init_arena(&dbuf, arena);
   lexer_rule_dump(lex, rule, &dbuf);
   dbuf_0(&dbuf);
 
@@ -68,6 +72,7 @@ js_lexer_rule_new(JSContext* ctx, Lexer* lex, LexerRule* rule) {
   // JS_SetPropertyUint32(ctx, ret, 3, JS_NewInt64(ctx, rule->mask));
 
   dbuf_free(&dbuf);
+  arena_release(arena, mark);
   return ret;
 }
 
@@ -662,6 +667,8 @@ enum {
   LEXER_POP_STATE,
   LEXER_TOP_STATE,
   LEXER_PEEK,
+  LEXER_FEED,
+  LEXER_END,
 };
 
 JSValue
@@ -680,7 +687,7 @@ js_lexer_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst ar
 
       if((other = JS_GetOpaque(argv[0], js_lexer_class_id))) {
         input = input_buffer_clone(&other->input, ctx);
-        loc = other->loc;
+        loc = *lexer_location(other);
         // lex->start = other->start;
       } else {
         input = js_input_chars(ctx, argv[0]);
@@ -690,6 +697,11 @@ js_lexer_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst ar
       lex->input = input;
       location_release(&lex->loc, JS_GetRuntime(ctx));
       lex->loc = loc;
+      lex->loc_pos = lex->pos;
+      lexer_checkpoints_clear(lex);
+      lex->base = 0;
+      lex->chunked = FALSE;
+      lex->closed = FALSE;
 
       if(argc > 1 && JS_IsString(argv[1])) {
         if(lex->loc.file > -1)
@@ -876,7 +888,7 @@ js_lexer_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst ar
 
     case LEXER_ERROR: {
       const char* message = JS_ToCString(ctx, argv[0]);
-      char* location = location_tostring(&lex->loc, ctx);
+      char* location = location_tostring(lexer_location(lex), ctx);
 
       ret = JS_ThrowSyntaxError(ctx, "%s at %s", message, location);
 
@@ -924,6 +936,33 @@ js_lexer_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst ar
       ret = JS_NewInt32(ctx, lexer_peek(lex, 0, ctx));
       break;
     }
+
+    case LEXER_FEED:
+    case LEXER_END: {
+      if(argc > 0 && !js_is_null_or_undefined(argv[0])) {
+        InputBuffer chunk = js_input_chars(ctx, argv[0]);
+
+        if(JS_IsException(chunk.value))
+          return JS_EXCEPTION;
+
+        if(lex->closed)
+          ret = JS_ThrowInternalError(ctx, "lexer input already ended");
+        else if(lexer_feed(lex, input_buffer_data(&chunk), input_buffer_length(&chunk), ctx))
+          ret = JS_ThrowOutOfMemory(ctx);
+
+        input_buffer_free(&chunk, ctx);
+
+        if(JS_IsException(ret))
+          break;
+      } else if(magic == LEXER_FEED && !lex->chunked) {
+        lexer_feed(lex, "", 0, ctx);
+      }
+
+      if(magic == LEXER_END)
+        lexer_end(lex);
+
+      break;
+    }
   }
   return ret;
 }
@@ -947,6 +986,8 @@ enum {
   LEXER_SOURCE,
   LEXER_LEXEME,
   LEXER_TOKEN,
+  LEXER_LOOKAHEAD,
+  LEXER_BASE,
 };
 
 JSValue
@@ -987,7 +1028,7 @@ js_lexer_get(JSContext* ctx, JSValueConst this_val, int magic) {
       Location* loc;
 
       if((loc = location_new(ctx))) {
-        location_copy(loc, &lex->loc, ctx);
+        location_copy(loc, lexer_location(lex), ctx);
         ret = js_location_wrap(ctx, loc);
       }
       break;
@@ -1091,6 +1132,16 @@ js_lexer_get(JSContext* ctx, JSValueConst this_val, int magic) {
 
       break;
     }
+
+    case LEXER_LOOKAHEAD: {
+      ret = JS_NewUint32(ctx, lex->lookahead);
+      break;
+    }
+
+    case LEXER_BASE: {
+      ret = JS_NewInt64(ctx, lex->base);
+      break;
+    }
   }
 
   return ret;
@@ -1108,11 +1159,7 @@ js_lexer_set(JSContext* ctx, JSValueConst this_val, JSValueConst value, int magi
       Token* tok;
 
       if((tok = js_token_data(value))) {
-        lex->pos = tok->loc->char_offset;
-
-        location_release(&lex->loc, JS_GetRuntime(ctx));
-        location_copy(&lex->loc, tok->loc, ctx);
-        //        lex->loc = tok->loc;
+        lexer_set_location(lex, tok->loc, ctx);
       } /* else if(JS_IsNumber(value)) {
          uint64_t newpos = lex->pos;
          JS_ToIndex(ctx, &newpos, value);
@@ -1148,6 +1195,11 @@ js_lexer_set(JSContext* ctx, JSValueConst this_val, JSValueConst value, int magi
       break;
     }
 
+    case LEXER_LOOKAHEAD: {
+      JS_ToUint32(ctx, &lex->lookahead, value);
+      break;
+    }
+
     case LEXER_SEQUENCE: {
       uint64_t s;
       JS_ToIndex(ctx, &s, value);
@@ -1228,12 +1280,17 @@ JSValue
 js_lexer_escape(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
   InputBuffer input = js_input_chars(ctx, argv[0]);
   DynBuf output;
-  js_dbuf_init(ctx, &output);
+  Arena* arena = js_arena(ctx);
+  ArenaMark mark = arena_mark(arena);
+  JSValue ret;
+  dbuf_init_arena(&output, arena);
 
   magic ? dbuf_put_unescaped_pred(&output, (const char*)input.data, input.size, lexer_unescape_pred)
         : dbuf_put_escaped_pred(&output, (const char*)input.data, input.size, lexer_escape_pred);
 
-  return dbuf_tostring_free(&output, ctx);
+  ret = dbuf_tostring_free(&output, ctx);
+  arena_release(arena, mark);
+  return ret;
 }
 
 JSValue
@@ -1256,11 +1313,39 @@ js_lexer_tostring(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
   return ret;
 }
 
+static JSValue
+lexer_throw_nomatch(Lexer* lex, JSContext* ctx) {
+  JSValue ret;
+  char* lexeme = lexer_lexeme_s(lex, ctx);
+  const Location* loc = lexer_location(lex);
+  char* file = location_file(loc, ctx);
+  size_t column = MIN_NUM((size_t)loc->column, lex->pos);
+
+  ret = JS_ThrowInternalError(ctx,
+                              "%s:%" PRIu32 ":%" PRIu32 ": No matching token (%d: %s)\n%.*s\n%*s",
+                              file,
+                              loc->line + 1,
+                              loc->column + 1,
+                              lexer_state_top(lex, 0),
+                              lexer_state_name(lex, lexer_state_top(lex, 0)),
+                              /*   lexeme,*/
+                              (int)(byte_chr((const char*)&lex->data[lex->pos], lex->size - lex->pos, '\n') + column),
+                              &lex->data[lex->pos - column],
+                              loc->column + 1,
+                              "^");
+  if(file)
+    js_free(ctx, file);
+  js_free(ctx, lexeme);
+
+  return ret;
+}
+
 JSValue
 js_lexer_lex(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
   JSValue ret = JS_UNDEFINED;
   Lexer* lex;
   int id, state = -1;
+  int64_t trace_start;
 
   if(!(lex = js_lexer_data2(ctx, this_val)))
     return JS_EXCEPTION;
@@ -1271,31 +1356,16 @@ js_lexer_lex(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[
     JS_FreeCString(ctx, name);
   }
 
+  trace_start = perf_trace_begin(PERF_TRACE_LEXER);
   id = lexer_lex(lex, ctx, this_val, argc, argv);
+  perf_trace_end(PERF_TRACE_LEXER, trace_start, id >= 0 ? lex->byte_length : 0);
 
   if(state > -1)
     lexer_state_pop(lex);
 
   switch(id) {
     case LEXER_ERROR_NOMATCH: {
-      char* lexeme = lexer_lexeme_s(lex, ctx);
-      char* file = location_file(&lex->loc, ctx);
-
-      ret = JS_ThrowInternalError(ctx,
-                                  "%s:%" PRIu32 ":%" PRIu32 ": No matching token (%d: %s)\n%.*s\n%*s",
-                                  file,
-                                  lex->loc.line + 1,
-                                  lex->loc.column + 1,
-                                  lexer_state_top(lex, 0),
-                                  lexer_state_name(lex, lexer_state_top(lex, 0)),
-                                  /*   lexeme,*/
-                                  (int)(byte_chr((const char*)&lex->data[lex->pos], lex->size - lex->pos, '\n') + lex->loc.column),
-                                  &lex->data[lex->pos - lex->loc.column],
-                                  lex->loc.column + 1,
-                                  "^");
-      if(file)
-        js_free(ctx, file);
-      js_free(ctx, lexeme);
+      ret = lexer_throw_nomatch(lex, ctx);
       break;
     }
 
@@ -1304,6 +1374,11 @@ js_lexer_lex(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[
       break;
     }
 
+    case LEXER_INCOMPLETE: {
+      ret = JS_UNDEFINED;
+      break;
+    }
+
     case LEXER_EXCEPTION: {
       ret = JS_EXCEPTION;
       break;
@@ -1318,6 +1393,433 @@ js_lexer_lex(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[
   return ret;
 }
 
+#define LEXER_RECORD_FIELDS 4
+
+/**
+ * Checkpoints of a previous token stream (after an edit) and the byte
+ * offset shift to apply to them. Lexing stops once the lexer reaches one
+ * of them in an identical state.
+ */
+typedef struct {
+  Vector checkpoints;
+  Vector stack;
+  size_t next;
+  int64_t delta;
+  BOOL synced;
+} LexerResync;
+
+static BOOL
+lexer_resync(Lexer* lex, LexerResync* rs) {
+  LexerCheckpoint* cps = vector_begin(&rs->checkpoints);
+  size_t n = vector_size(&rs->checkpoints, sizeof(LexerCheckpoint));
+
+  while(rs->next < n && (int64_t)cps[rs->next].pos + rs->delta < (int64_t)lex->pos)
+    rs->next++;
+
+  if(rs->next < n && (int64_t)cps[rs->next].pos + rs->delta == (int64_t)lex->pos)
+    if(lexer_checkpoint_same_state(lex, &cps[rs->next], (int32_t*)vector_begin(&rs->stack) + cps[rs->next].stack_start))
+      return rs->synced = TRUE;
+
+  return FALSE;
+}
+
+/**
+ * Lex up to \p max tokens and store them as packed records of
+ * LEXER_RECORD_FIELDS integers (id, byte offset, byte length, line), each
+ * \p elsize (4 or 8) bytes wide. Rule actions and skip rules still apply.
+ * Every LEXER_CHECKPOINT_INTERVAL records a checkpoint is taken.
+ *
+ * \param  rs   when non-NULL, stop as soon as the lexer re-synchronizes with it
+ * \param  idp  receives the id that ended the run (LEXER_EOF, error, or >= 0 when full)
+ * \return number of records written
+ */
+static size_t
+lexer_tokenize(Lexer* lex, JSContext* ctx, JSValueConst this_val, void* out, size_t elsize, size_t max, LexerResync* rs, int* idp) {
+  size_t i;
+  int id = LEXER_EOF;
+
+  for(i = 0; i < max; i++) {
+    int64_t rec[LEXER_RECORD_FIELDS];
+    size_t ncp;
+
+    if(lex->byte_length > 0 && lex->token_id != -1)
+      lexer_skip(lex);
+
+    if(rs && lexer_resync(lex, rs)) {
+      id = LEXER_EOF;
+      break;
+    }
+
+    if(!lex->chunked && lex->records % LEXER_CHECKPOINT_INTERVAL == 0)
+      if(!(ncp = lexer_num_checkpoints(lex)) || lexer_checkpoint_at(lex, ncp - 1)->index < lex->records)
+        lexer_checkpoint(lex);
+
+    if((id = lexer_lex(lex, ctx, this_val, 0, 0)) < 0)
+      break;
+
+    rec[0] = id;
+    rec[1] = lex->base + lex->pos;
+    rec[2] = lex->byte_length;
+    rec[3] = lexer_location(lex)->line;
+
+    if(elsize == sizeof(int64_t)) {
+      memcpy((int64_t*)out + i * LEXER_RECORD_FIELDS, rec, sizeof(rec));
+    } else {
+      int32_t* r = (int32_t*)out + i * LEXER_RECORD_FIELDS;
+
+      r[0] = rec[0];
+      r[1] = rec[1];
+      r[2] = rec[2];
+      r[3] = rec[3];
+    }
+
+    lex->records++;
+  }
+
+  *idp = id;
+  return i;
+}
+
+/**
+ * Like lexer_tokenize(), but lexes until the end of input (or until
+ * re-synchronized) into a growing buffer of int32_t records.
+ */
+static int32_t*
+lexer_tokenize_all(Lexer* lex, JSContext* ctx, JSValueConst this_val, LexerResync* rs, size_t* countp, int* idp) {
+  size_t capacity = 1024, count = 0;
+  int32_t* records = 0;
+
+  for(;;) {
+    int32_t* r;
+
+    if(!(r = js_realloc(ctx, records, sizeof(int32_t) * LEXER_RECORD_FIELDS * capacity))) {
+      js_free(ctx, records);
+      *idp = LEXER_EXCEPTION;
+      return 0;
+    }
+
+    records = r;
+    count += lexer_tokenize(lex, ctx, this_val, records + count * LEXER_RECORD_FIELDS, sizeof(int32_t), capacity - count, rs, idp);
+
+    if(*idp < 0)
+      break;
+
+    capacity *= 2;
+  }
+
+  *countp = count;
+  return records;
+}
+
+static JSValue
+lexer_records_new(JSContext* ctx, int32_t* records, size_t count) {
+  JSValue buf, ctor, ret;
+
+  buf = JS_NewArrayBuffer(ctx, (void*)records, sizeof(int32_t) * LEXER_RECORD_FIELDS * count, (JSFreeArrayBufferDataFunc*)(void*)&orig_js_free_rt, records, FALSE);
+  ctor = js_global_get_str(ctx, "Int32Array");
+  ret = JS_CallConstructor(ctx, ctor, 1, &buf);
+  JS_FreeValue(ctx, ctor);
+  JS_FreeValue(ctx, buf);
+
+  return ret;
+}
+
+static JSValue
+lexer_tokenize_result(Lexer* lex, JSContext* ctx, JSValue ret, int id) {
+  if(id == LEXER_ERROR_NOMATCH) {
+    JS_FreeValue(ctx, ret);
+    ret = lexer_throw_nomatch(lex, ctx);
+  } else if(id == LEXER_EXCEPTION) {
+    JS_FreeValue(ctx, ret);
+    ret = JS_EXCEPTION;
+  }
+
+  return ret;
+}
+
+JSValue
+js_lexer_tokenize(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  JSValue ret = JS_UNDEFINED;
+  Lexer* lex;
+  size_t count;
+  int id;
+
+  if(!(lex = js_lexer_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(magic) {
+    /* tokensInto(typedArray) */
+    JSValue buffer;
+    size_t offset, length, elsize;
+    uint8_t* data;
+    size_t size;
+
+    buffer = JS_GetTypedArrayBuffer(ctx, argv[0], &offset, &length, &elsize);
+
+    if(JS_IsException(buffer))
+      return JS_EXCEPTION;
+
+    if(elsize != sizeof(int32_t) && elsize != sizeof(int64_t)) {
+      JS_FreeValue(ctx, buffer);
+      return JS_ThrowTypeError(ctx, "argument 1 must be an Int32Array or BigInt64Array");
+    }
+
+    data = JS_GetArrayBuffer(ctx, &size, buffer);
+    count = lexer_tokenize(lex, ctx, this_val, data + offset, elsize, length / (elsize * LEXER_RECORD_FIELDS), 0, &id);
+    JS_FreeValue(ctx, buffer);
+
+    ret = JS_NewInt64(ctx, count);
+  } else if(argc > 0 && !js_is_null_or_undefined(argv[0])) {
+    /* tokenize(n) */
+    int64_t n = 0;
+    int32_t* records;
+
+    JS_ToInt64(ctx, &n, argv[0]);
+
+    if(n < 0)
+      n = 0;
+
+    if(!(records = js_malloc(ctx, sizeof(int32_t) * LEXER_RECORD_FIELDS * (n ? n : 1))))
+      return JS_EXCEPTION;
+
+    count = lexer_tokenize(lex, ctx, this_val, records, sizeof(int32_t), n, 0, &id);
+    ret = lexer_records_new(ctx, records, count);
+  } else {
+    /* tokenize() */
+    int32_t* records;
+
+    if(!(records = lexer_tokenize_all(lex, ctx, this_val, 0, &count, &id)))
+      return JS_EXCEPTION;
+
+    ret = lexer_records_new(ctx, records, count);
+  }
+
+  return lexer_tokenize_result(lex, ctx, ret, id);
+}
+
+static int32_t
+lexer_column_at(Lexer* lex, size_t pos) {
+  size_t start = pos;
+
+  while(start > 0 && lex->data[start - 1] != '\n')
+    start--;
+
+  return utf8_strlen(&lex->data[start], pos - start);
+}
+
+static size_t
+lexer_count_lines(const uint8_t* x, size_t n) {
+  return line_index_count(x, n, '\n');
+}
+
+/**
+ * edit(offset, deletedLength, insertedText)
+ *
+ * Replace a range of the input and re-lex from the nearest checkpoint
+ * until the token stream produced by tokenize() re-synchronizes.
+ *
+ * Returns { index, deleteCount, tokens, byteDelta, lineDelta }: replace
+ * deleteCount records at index with tokens, then add byteDelta to the
+ * offset and lineDelta to the line of every following record.
+ */
+JSValue
+js_lexer_edit(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  Lexer* lex;
+  int64_t offset = 0, deleted = 0, delta, line_delta, char_delta;
+  InputBuffer insert = {{{0, 0}}, 0, &input_buffer_free_default, JS_UNDEFINED, OFFSET_INIT()}, input, old_input;
+  LexerCheckpoint *cp, *end, *tail;
+  LexerResync rs = {VECTOR(ctx), VECTOR(ctx), 0, 0, FALSE};
+  Vector saved_checkpoints = VECTOR(ctx), saved_stack = VECTOR(ctx);
+  size_t i, ntail, old_records, cp_index, delete_count, count = 0, edit_end;
+  uint8_t* data;
+  int32_t* records = 0;
+  int id = LEXER_EOF;
+  JSValue buf, ret = JS_UNDEFINED;
+
+  if(!(lex = js_lexer_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(lex->chunked)
+    return JS_ThrowTypeError(ctx, "edit() is not supported on chunked input");
+
+  JS_ToInt64(ctx, &offset, argv[0]);
+  JS_ToInt64(ctx, &deleted, argv[1]);
+
+  if(offset < 0 || deleted < 0 || (size_t)(offset + deleted) > lex->size)
+    return JS_ThrowRangeError(ctx, "edit range %" PRId64 "+%" PRId64 " outside of input (%zu bytes)", offset, deleted, lex->size);
+
+  if(argc > 2 && !js_is_null_or_undefined(argv[2])) {
+    insert = js_input_chars(ctx, argv[2]);
+
+    if(JS_IsException(insert.value))
+      return JS_EXCEPTION;
+  }
+
+  delta = (int64_t)insert.size - deleted;
+  edit_end = offset + insert.size;
+  line_delta = (int64_t)lexer_count_lines(insert.data, insert.size) - (int64_t)lexer_count_lines(&lex->data[offset], deleted);
+  char_delta = (int64_t)utf8_strlen(insert.data, insert.size) - (int64_t)utf8_strlen(&lex->data[offset], deleted);
+
+  /* the current end of the token stream becomes the last checkpoint */
+  if(lex->byte_length > 0 && lex->token_id != -1)
+    lexer_skip(lex);
+
+  if(!(ntail = lexer_num_checkpoints(lex)) || lexer_checkpoint_at(lex, ntail - 1)->pos != lex->pos)
+    lexer_checkpoint(lex);
+
+  old_records = lex->records;
+
+  /* copies of the checkpoints, put back when re-lexing fails */
+  if(!vector_put(&saved_checkpoints, vector_begin(&lex->checkpoints), vector_size(&lex->checkpoints, 1)) ||
+     (vector_size(&lex->checkpoint_stack, 1) && !vector_put(&saved_stack, vector_begin(&lex->checkpoint_stack), vector_size(&lex->checkpoint_stack, 1)))) {
+    input_buffer_free(&insert, ctx);
+    vector_free(&saved_checkpoints);
+    vector_free(&saved_stack);
+    return JS_ThrowOutOfMemory(ctx);
+  }
+
+  /* build the new input */
+  if(!(data = js_malloc_rt(JS_GetRuntime(ctx), lex->size + delta + 1))) {
+    input_buffer_free(&insert, ctx);
+    vector_free(&saved_checkpoints);
+    vector_free(&saved_stack);
+    return JS_EXCEPTION;
+  }
+
+  memcpy(data, lex->data, offset);
+  memcpy(data + offset, insert.data, insert.size);
+  memcpy(data + offset + insert.size, lex->data + offset + deleted, lex->size - offset - deleted);
+  data[lex->size + delta] = '\0';
+  input_buffer_free(&insert, ctx);
+
+  buf = JS_NewArrayBuffer(ctx, data, lex->size + delta, (JSFreeArrayBufferDataFunc*)(void*)&orig_js_free_rt, data, FALSE);
+  input = js_input_chars(ctx, buf);
+  JS_FreeValue(ctx, buf);
+
+  if(JS_IsException(input.value)) {
+    vector_free(&saved_checkpoints);
+    vector_free(&saved_stack);
+    return JS_EXCEPTION;
+  }
+
+  old_input = lex->input;
+  end = lexer_checkpoint_at(lex, lexer_num_checkpoints(lex) - 1);
+
+  if((size_t)offset > end->pos) {
+    /* edit lies beyond what has been tokenized: nothing to re-lex */
+    LexerCheckpoint last = *end;
+
+    lex->input = input;
+    lexer_checkpoint_restore(lex, &last);
+    lexer_checkpoint_truncate(lex, end);
+
+    cp_index = delete_count = old_records;
+    records = js_malloc(ctx, sizeof(int32_t) * LEXER_RECORD_FIELDS);
+    goto result;
+  }
+
+  cp = lexer_checkpoint_find(lex, offset);
+  cp_index = cp->index;
+
+  /* keep the checkpoints behind the edit for re-synchronization */
+  for(tail = cp + 1; tail <= end; tail++) {
+    LexerCheckpoint t = *tail;
+
+    if(t.pos < (size_t)(offset + deleted))
+      continue;
+
+    if(t.stack_depth)
+      vector_put(&rs.stack, (int32_t*)vector_begin(&lex->checkpoint_stack) + t.stack_start, t.stack_depth * sizeof(int32_t));
+
+    t.stack_start = vector_size(&rs.stack, sizeof(int32_t)) - t.stack_depth;
+    vector_push(&rs.checkpoints, t);
+  }
+
+  rs.delta = delta;
+  lex->input = input;
+
+  lexer_checkpoint_restore(lex, cp);
+  lexer_checkpoint_truncate(lex, cp);
+
+  if(!(records = lexer_tokenize_all(lex, ctx, this_val, &rs, &count, &id)))
+    goto fail;
+
+  if(id != LEXER_EOF)
+    goto fail;
+
+  delete_count = old_records - cp_index;
+
+  if(rs.synced) {
+    const int32_t* stack = vector_begin(&rs.stack);
+    size_t index_delta = lex->records;
+
+    tail = vector_begin(&rs.checkpoints);
+    ntail = vector_size(&rs.checkpoints, sizeof(LexerCheckpoint));
+    delete_count = tail[rs.next].index - cp_index;
+    index_delta -= tail[rs.next].index;
+
+    /* shift the remaining checkpoints into the new input */
+    for(i = rs.next; i < ntail; i++) {
+      LexerCheckpoint t = tail[i];
+
+      t.pos += delta;
+      t.index += index_delta;
+      t.line += line_delta;
+      t.char_offset += char_delta;
+
+      if(byte_chr((const char*)&lex->data[edit_end], t.pos - edit_end, '\n') == t.pos - edit_end)
+        t.column = lexer_column_at(lex, t.pos);
+
+      t.stack_start = vector_size(&lex->checkpoint_stack, sizeof(int32_t));
+
+      if(t.stack_depth)
+        vector_put(&lex->checkpoint_stack, &stack[tail[i].stack_start], t.stack_depth * sizeof(int32_t));
+
+      vector_push(&lex->checkpoints, t);
+    }
+
+    /* continue where the previous token stream ended */
+    lexer_checkpoint_restore(lex, lexer_checkpoint_at(lex, lexer_num_checkpoints(lex) - 1));
+  }
+
+result:
+  ret = JS_NewObject(ctx);
+  JS_SetPropertyStr(ctx, ret, "index", JS_NewInt64(ctx, cp_index));
+  JS_SetPropertyStr(ctx, ret, "deleteCount", JS_NewInt64(ctx, delete_count));
+  JS_SetPropertyStr(ctx, ret, "tokens", lexer_records_new(ctx, records, count));
+  JS_SetPropertyStr(ctx, ret, "byteDelta", JS_NewInt64(ctx, delta));
+  JS_SetPropertyStr(ctx, ret, "lineDelta", JS_NewInt64(ctx, line_delta));
+
+fail:
+  if(JS_IsUndefined(ret)) {
+    if(records)
+      js_free(ctx, records);
+
+    ret = lexer_tokenize_result(lex, ctx, JS_UNDEFINED, id);
+
+    if(JS_IsUndefined(ret))
+      ret = JS_ThrowInternalError(ctx, "edit(): lexer stopped with id %d", id);
+
+    /* put the old input and token stream back */
+    input_buffer_free(&lex->input, ctx);
+    lex->input = old_input;
+
+    vector_clear(&lex->checkpoints);
+    vector_clear(&lex->checkpoint_stack);
+    vector_put(&lex->checkpoints, vector_begin(&saved_checkpoints), vector_size(&saved_checkpoints, 1));
+    vector_put(&lex->checkpoint_stack, vector_begin(&saved_stack), vector_size(&saved_stack, 1));
+    lexer_checkpoint_restore(lex, lexer_checkpoint_at(lex, lexer_num_checkpoints(lex) - 1));
+  } else {
+    input_buffer_free(&old_input, ctx);
+  }
+
+  vector_free(&saved_checkpoints);
+  vector_free(&saved_stack);
+  vector_free(&rs.checkpoints);
+  vector_free(&rs.stack);
+  return ret;
+}
+
 enum {
   YIELD_ID = 0,
   YIELD_OBJ = 1,
@@ -1462,6 +1964,10 @@ static const JSCFunctionListEntry js_lexer_proto_funcs[] = {
     JS_CGETSET_MAGIC_DEF("token", js_lexer_get, 0, LEXER_TOKEN),
     JS_CGETSET_MAGIC_DEF("fileName", js_lexer_get, js_lexer_set, LEXER_FILENAME),
     JS_CFUNC_MAGIC_DEF("setInput", 1, js_lexer_method, LEXER_SET_INPUT),
+    JS_CFUNC_MAGIC_DEF("feed", 1, js_lexer_method, LEXER_FEED),
+    JS_CFUNC_MAGIC_DEF("end", 0, js_lexer_method, LEXER_END),
+    JS_CGETSET_MAGIC_DEF("lookahead", js_lexer_get, js_lexer_set, LEXER_LOOKAHEAD),
+    JS_CGETSET_MAGIC_DEF("base", js_lexer_get, 0, LEXER_BASE),
     JS_CFUNC_MAGIC_DEF("skipBytes", 0, js_lexer_method, LEXER_SKIP_BYTES),
     JS_CFUNC_MAGIC_DEF("skipToken", 0, js_lexer_method, LEXER_SKIP_TOKEN),
     JS_CFUNC_MAGIC_DEF("skipChars", 0, js_lexer_method, LEXER_SKIP_CHARS),
@@ -1479,6 +1985,9 @@ static const JSCFunctionListEntry js_lexer_proto_funcs[] = {
     JS_CGETSET_MAGIC_DEF("ruleNames", js_lexer_get, 0, LEXER_RULENAMES),
     JS_CGETSET_MAGIC_DEF("rules", js_lexer_get, 0, LEXER_RULES),
     JS_CFUNC_DEF("lex", 0, js_lexer_lex),
+    JS_CFUNC_MAGIC_DEF("tokenize", 0, js_lexer_tokenize, 0),
+    JS_CFUNC_MAGIC_DEF("tokensInto", 1, js_lexer_tokenize, 1),
+    JS_CFUNC_DEF("edit", 3, js_lexer_edit),
     // JS_CFUNC_DEF("inspect", 0, js_lexer_inspect),
     JS_CGETSET_DEF("tokens", js_lexer_tokens, 0),
     JS_CGETSET_DEF("states", js_lexer_states, 0),
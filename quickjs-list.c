@@ -13,13 +13,6 @@
  * @{
  */
 
-typedef struct Node {
-  struct list_head link;
-  JSValue value;
-} Node;
-
-//  typedef Node* SkipCall(Node*, List*);
-
 typedef enum Direction {
   FWD = 0,
   REV = 1,
@@ -31,15 +24,15 @@ typedef enum ListIteratorKind {
   ITERATOR_KIND_KEY_AND_VALUE,
 } ListIteratorKind;
 
+/* iterators address values by index, like Array iterators */
 typedef struct ListIterator {
   List* list;
-  struct list_head* link;
   int64_t index;
   ListIteratorKind kind;
   Direction dir;
 } ListIterator;
 
-typedef int64_t FindCall(List*, JSValueConst, JSValueConst, Node**, JSContext*);
+typedef int64_t FindCall(List*, JSValueConst, JSValueConst, JSValue*, JSContext*);
 
 VISIBLE JSClassID js_list_class_id = 0, js_list_iterator_class_id = 0;
 VISIBLE JSValue list_proto = {{0}, JS_TAG_UNDEFINED}, list_ctor = {{0}, JS_TAG_UNDEFINED}, list_iterator_proto = {{0}, JS_TAG_UNDEFINED},
@@ -85,55 +78,211 @@ enum {
   PROP_LENGTH = 0,
 };
 
-static Node*
-node_new(JSContext* ctx, JSValueConst value) {
-  Node* node;
+#define list_first(list) list_entry((list)->head.next, ListBlock, link)
+#define list_last(list) list_entry((list)->head.prev, ListBlock, link)
+#define block_next(block) list_entry((block)->link.next, ListBlock, link)
+#define block_prev(block) list_entry((block)->link.prev, ListBlock, link)
+
+/* iterates over the values of a list, in order; the list must not change */
+#define list_for_each_value(block, i, list) \
+  for(struct list_head* block##_link = (list)->head.next; \
+      block##_link != &(list)->head && ((block) = list_entry(block##_link, ListBlock, link)); \
+      block##_link = block##_link->next) \
+    for((i) = (block)->start; (i) < (uint32_t)(block)->start + (block)->count; (i)++)
+
+static ListBlock*
+block_new(JSContext* ctx, uint8_t start) {
+  ListBlock* block;
+
+  if((block = js_malloc(ctx, sizeof(ListBlock)))) {
+    block->link.next = NULL;
+    block->link.prev = NULL;
+    block->parent = block->left = block->right = NULL;
+    block->total = 0;
+    block->start = start;
+    block->count = 0;
+  }
+
+  return block;
+}
+
+static inline size_t
+block_total(ListBlock* block) {
+  return block ? block->total : 0;
+}
+
+static inline void
+block_update(ListBlock* block) {
+  block->total = block->count + block_total(block->left) + block_total(block->right);
+}
+
+static inline ListBlock*
+block_leftmost(ListBlock* block) {
+  while(block->left)
+    block = block->left;
+
+  return block;
+}
+
+/* rotates block above its parent, keeping the in-order sequence */
+static void
+block_rotate(List* list, ListBlock* block) {
+  ListBlock *parent = block->parent, *grand = parent->parent;
+
+  if(parent->left == block) {
+    if((parent->left = block->right))
+      parent->left->parent = parent;
+
+    block->right = parent;
+  } else {
+    if((parent->right = block->left))
+      parent->right->parent = parent;
+
+    block->left = parent;
+  }
+
+  parent->parent = block;
+  block->parent = grand;
 
-  if((node = js_malloc(ctx, sizeof(Node)))) {
-    node->link.next = NULL;
-    node->link.prev = NULL;
-    node->value = JS_DupValue(ctx, value);
+  if(!grand)
+    list->root = block;
+  else if(grand->left == parent)
+    grand->left = block;
+  else
+    grand->right = block;
+
+  block_update(parent);
+  block_update(block);
+}
+
+static uint32_t
+list_random(List* list) {
+  uint32_t x = list->seed;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+
+  return list->seed = x;
+}
+
+/* adds block to the index, right after prev (first when prev is NULL) */
+static void
+block_attach(List* list, ListBlock* block, ListBlock* prev) {
+  ListBlock* parent;
+
+  block->left = block->right = NULL;
+  block->total = block->count;
+  block->priority = list_random(list);
+
+  if(!list->root) {
+    block->parent = NULL;
+    list->root = block;
+    return;
   }
 
-  return node;
+  if(!prev)
+    (parent = block_leftmost(list->root))->left = block;
+  else if(!prev->right)
+    (parent = prev)->right = block;
+  else
+    (parent = block_leftmost(prev->right))->left = block;
+
+  block->parent = parent;
+
+  for(ListBlock* b = parent; b; b = b->parent)
+    b->total += block->count;
+
+  while(block->parent && block->parent->priority < block->priority)
+    block_rotate(list, block);
 }
 
 static void
-node_free(Node* node, JSRuntime* rt) {
-  JS_FreeValueRT(rt, node->value);
-  node->value = JS_UNINITIALIZED;
+block_detach(List* list, ListBlock* block) {
+  ListBlock* parent;
+
+  while(block->left || block->right)
+    block_rotate(list, !block->right || (block->left && block->left->priority > block->right->priority) ? block->left : block->right);
 
-  js_free_rt(rt, node);
+  if(!(parent = block->parent))
+    list->root = NULL;
+  else if(parent->left == block)
+    parent->left = NULL;
+  else
+    parent->right = NULL;
+
+  for(; parent; parent = parent->parent)
+    parent->total -= block->count;
 }
 
-static inline JSValue
-node_remove(Node* node, List* list, JSContext* ctx) {
-  JSValue ret = node->value;
+static void
+list_index_build(List* list) {
+  struct list_head* link;
+  ListBlock* prev = NULL;
 
-  list_del(&node->link);
-  --list->size;
+  list->indexed = TRUE;
+  list->root = NULL;
 
-  js_free(ctx, node);
-  return ret;
+  list_for_each(link, &list->head) {
+    ListBlock* block = list_entry(link, ListBlock, link);
+
+    block_attach(list, block, prev);
+    prev = block;
+  }
+}
+
+/* must follow every change of block->count */
+static inline void
+list_resized(List* list, ListBlock* block, int64_t delta) {
+  if(list->indexed)
+    for(; block; block = block->parent)
+      block->total += delta;
+}
+
+/* links block after prev (first when prev is NULL) */
+static void
+block_link(List* list, ListBlock* block, ListBlock* prev) {
+  if(prev)
+    __list_add(&block->link, &prev->link, prev->link.next);
+  else
+    list_add(&block->link, &list->head);
+
+  list->blocks++;
+
+  if(list->indexed)
+    block_attach(list, block, prev);
+  else if(list->blocks >= LIST_INDEX_BLOCKS)
+    list_index_build(list);
+}
+
+static void
+block_free(ListBlock* block, List* list, JSRuntime* rt) {
+  if(list->cursor == block)
+    list->cursor = NULL;
+
+  if(list->indexed)
+    block_detach(list, block);
+
+  list->blocks--;
+
+  list_del(&block->link);
+  js_free_rt(rt, block);
 }
 
 static JSValue
-node_call(Node* node, JSValueConst fn, JSValueConst list_obj, int64_t i, JSContext* ctx) {
+value_call(JSValueConst value, JSValueConst fn, JSValueConst list_obj, int64_t i, JSContext* ctx) {
   JSValueConst args[] = {
-      node->value,
+      value,
       JS_NewInt64(ctx, i),
       list_obj,
   };
-  JSValue ret = JS_Call(ctx, fn, JS_UNDEFINED, countof(args), args);
 
-  JS_FreeValue(ctx, args[1]);
-
-  return ret;
+  return JS_Call(ctx, fn, JS_UNDEFINED, countof(args), args);
 }
 
 static BOOL
-node_predicate(Node* node, JSValueConst fn, JSValueConst list_obj, int64_t i, JSContext* ctx) {
-  JSValue ret = node_call(node, fn, list_obj, i, ctx);
+value_predicate(JSValueConst value, JSValueConst fn, JSValueConst list_obj, int64_t i, JSContext* ctx) {
+  JSValue ret = value_call(value, fn, list_obj, i, ctx);
   BOOL result = JS_ToBool(ctx, ret);
   JS_FreeValue(ctx, ret);
 
@@ -148,113 +297,291 @@ list_new(JSContext* ctx) {
     init_list_head(&list->head);
     list->ref_count = 1;
     list->size = 0;
+    list->blocks = 0;
+    list->cursor = NULL;
+    list->cursor_base = 0;
+    list->root = NULL;
+    list->seed = (uint32_t)(uintptr_t)list | 1;
+    list->indexed = FALSE;
   }
 
   return list;
 }
 
-static Node*
-list_push(List* list, JSValueConst value, JSContext* ctx) {
-  Node* node;
+/**
+ * Finds the block holding index (0 <= index < size) and leaves the
+ * cursor there, so sequential access is O(1). Walks from whichever of
+ * the front, the back or the cursor is nearest, unless that is more than
+ * a block away in an indexed list, which descends the treap instead.
+ */
+static ListBlock*
+list_seek(List* list, size_t index, size_t* pbase) {
+  ListBlock* block;
+  size_t base, dist;
+
+  if(index >= list->size)
+    return NULL;
+
+  if(index < list->size - 1 - index) {
+    block = list_first(list);
+    base = 0;
+    dist = index;
+  } else {
+    block = list_last(list);
+    base = list->size - block->count;
+    dist = list->size - 1 - index;
+  }
 
-  if((node = node_new(ctx, value))) {
-    list_add_tail(&node->link, &list->head);
-    ++list->size;
+  if(list->cursor && (index > list->cursor_base ? index - list->cursor_base : list->cursor_base - index) < dist) {
+    block = list->cursor;
+    base = list->cursor_base;
+    dist = index > base ? index - base : base - index;
   }
 
-  return node;
-}
+  if(list->indexed && dist > LIST_BLOCK_SIZE) {
+    block = list->root;
+    base = 0;
 
-static Node*
-list_unshift(List* list, JSValueConst value, JSContext* ctx) {
-  Node* node;
+    for(;;) {
+      size_t left = block_total(block->left);
+
+      if(index < base + left) {
+        block = block->left;
+      } else if(index < base + left + block->count) {
+        base += left;
+        break;
+      } else {
+        base += left + block->count;
+        block = block->right;
+      }
+    }
+  }
+
+  while(index < base) {
+    block = block_prev(block);
+    base -= block->count;
+  }
 
-  if((node = node_new(ctx, value))) {
-    list_add(&node->link, &list->head);
-    ++list->size;
+  while(index >= base + block->count) {
+    base += block->count;
+    block = block_next(block);
   }
 
-  return node;
+  list->cursor = block;
+  list->cursor_base = base;
+
+  if(pbase)
+    *pbase = base;
+
+  return block;
 }
 
-static struct list_head*
-list_insert(List* list, struct list_head* prev, JSValueConst value, JSContext* ctx) {
-  Node* node;
+static JSValue*
+list_at(List* list, int64_t index) {
+  ListBlock* block;
+  size_t base;
 
-  if((node = node_new(ctx, value))) {
-    __list_add(&node->link, prev, prev->next);
-    ++list->size;
-  }
+  if(index < 0)
+    index += list->size;
+
+  if(index < 0 || !(block = list_seek(list, index, &base)))
+    return NULL;
 
-  return (struct list_head*)node;
+  return &block->values[block->start + (index - base)];
 }
 
-static Node*
-list_at_forward(List* list, int64_t index) {
-  struct list_head* ptr;
-  int64_t i = 0;
+static BOOL
+list_push(List* list, JSValueConst value, JSContext* ctx) {
+  ListBlock* block = list_empty(&list->head) ? NULL : list_last(list);
+
+  if(!block || block->start + block->count == LIST_BLOCK_SIZE) {
+    if(!(block = block_new(ctx, 0)))
+      return FALSE;
 
-  list_for_each(ptr, &list->head) {
-    if(i++ == index)
-      return list_entry(ptr, Node, link);
+    block_link(list, block, list_empty(&list->head) ? NULL : list_last(list));
   }
 
-  return NULL;
+  block->values[block->start + block->count++] = JS_DupValue(ctx, value);
+  list_resized(list, block, 1);
+  ++list->size;
+  return TRUE;
 }
 
-static Node*
-list_at_reverse(List* list, int64_t index) {
-  struct list_head* ptr;
-  int64_t i = 0;
+static BOOL
+list_unshift(List* list, JSValueConst value, JSContext* ctx) {
+  ListBlock* block = list_empty(&list->head) ? NULL : list_first(list);
 
-  list_for_each_prev(ptr, &list->head) {
-    if(i++ == index)
-      return list_entry(ptr, Node, link);
+  if(!block || block->start == 0) {
+    if(!(block = block_new(ctx, LIST_BLOCK_SIZE)))
+      return FALSE;
+
+    block_link(list, block, NULL);
   }
 
-  return NULL;
+  if(list->cursor && list->cursor != block)
+    list->cursor_base++;
+
+  block->values[--block->start] = JS_DupValue(ctx, value);
+  block->count++;
+  list_resized(list, block, 1);
+  ++list->size;
+  return TRUE;
 }
 
-static inline BOOL
-list_has(List* list, int64_t index) {
-  if(index < 0)
-    return index >= -(int64_t)list->size;
+static JSValue
+list_pop(List* list, JSRuntime* rt) {
+  ListBlock* block;
+  JSValue ret;
 
-  return index < (int64_t)list->size;
+  if(list_empty(&list->head))
+    return JS_UNDEFINED;
+
+  block = list_last(list);
+  ret = block->values[block->start + --block->count];
+  list_resized(list, block, -1);
+  --list->size;
+
+  if(block->count == 0)
+    block_free(block, list, rt);
+
+  return ret;
 }
 
-static inline int64_t
-list_index(List* list, int64_t index) {
-  if(index < 0)
-    index += list->size;
+static JSValue
+list_shift(List* list, JSRuntime* rt) {
+  ListBlock* block;
+  JSValue ret;
 
-  return index;
+  if(list_empty(&list->head))
+    return JS_UNDEFINED;
+
+  block = list_first(list);
+  ret = block->values[block->start++];
+  block->count--;
+  list_resized(list, block, -1);
+  --list->size;
+
+  if(list->cursor && list->cursor != block)
+    list->cursor_base--;
+
+  if(block->count == 0)
+    block_free(block, list, rt);
+
+  return ret;
 }
 
-static Node*
-list_at(List* list, int64_t index) {
-  if(index < 0)
-    index += list->size;
-  int64_t from_back = (list->size - 1) - index;
+/**
+ * Inserts value before index (0 <= index <= size); a full block is split
+ * in halves first.
+ */
+static BOOL
+list_insert(List* list, size_t index, JSValueConst value, JSContext* ctx) {
+  ListBlock *block, *next;
+  size_t base, offset;
 
-  if(index < (int64_t)list->size) {
-    if(from_back < index)
-      return list_at_reverse(list, from_back);
+  if(index >= list->size)
+    return list_push(list, value, ctx);
 
-    return list_at_forward(list, index);
+  if(index == 0)
+    return list_unshift(list, value, ctx);
+
+  block = list_seek(list, index, &base);
+  offset = index - base;
+
+  if(block->count == LIST_BLOCK_SIZE) {
+    uint8_t half = LIST_BLOCK_SIZE / 2;
+
+    if(!(next = block_new(ctx, 0)))
+      return FALSE;
+
+    memcpy(next->values, &block->values[block->start + half], (block->count - half) * sizeof(JSValue));
+    next->count = block->count - half;
+    block->count = half;
+    list_resized(list, block, -(int64_t)next->count);
+    block_link(list, next, block);
+
+    if(offset > half) {
+      base += half;
+      offset -= half;
+      block = next;
+    }
   }
 
-  return NULL;
+  if(block->start + block->count < LIST_BLOCK_SIZE) {
+    memmove(&block->values[block->start + offset + 1], &block->values[block->start + offset], (block->count - offset) * sizeof(JSValue));
+  } else {
+    memmove(&block->values[block->start - 1], &block->values[block->start], offset * sizeof(JSValue));
+    block->start--;
+  }
+
+  block->values[block->start + offset] = JS_DupValue(ctx, value);
+  block->count++;
+  list_resized(list, block, 1);
+  ++list->size;
+
+  list->cursor = block;
+  list->cursor_base = base;
+  return TRUE;
 }
 
-static inline JSValue
-list_value(List* list, int64_t index) {
-  Node* node;
+/**
+ * Removes count values from index on, appending them to out when given,
+ * block by block; the block where removal ends is merged with its
+ * successor when both together fill at most half a block.
+ */
+static void
+list_remove(List* list, size_t index, size_t count, List* out, JSContext* ctx) {
+  ListBlock *block, *next;
+  size_t base;
+
+  if(index + count > list->size)
+    count = list->size - index;
+
+  if(!count || !(block = list_seek(list, index, &base)))
+    return;
+
+  while(count > 0) {
+    size_t offset = index - base, n = MIN_NUM(count, block->count - offset);
+    JSValue* values = &block->values[block->start + offset];
 
-  if((node = list_at(list, index)))
-    return node->value;
+    for(size_t i = 0; i < n; i++) {
+      if(out)
+        list_push(out, values[i], ctx);
 
-  return JS_UNINITIALIZED;
+      JS_FreeValue(ctx, values[i]);
+    }
+
+    memmove(values, values + n, (block->count - offset - n) * sizeof(JSValue));
+    block->count -= n;
+    list_resized(list, block, -(int64_t)n);
+    list->size -= n;
+    count -= n;
+
+    next = block->link.next == &list->head ? NULL : block_next(block);
+
+    if(block->count == 0) {
+      block_free(block, list, JS_GetRuntime(ctx));
+    } else {
+      if(count == 0 && next && block->count + next->count <= LIST_BLOCK_SIZE / 2) {
+        memmove(block->values, &block->values[block->start], block->count * sizeof(JSValue));
+        memcpy(&block->values[block->count], &next->values[next->start], next->count * sizeof(JSValue));
+        block->start = 0;
+        block->count += next->count;
+        list_resized(list, block, next->count);
+        block_free(next, list, JS_GetRuntime(ctx));
+        next = block->link.next == &list->head ? NULL : block_next(block);
+      }
+
+      base += block->count;
+    }
+
+    if(!next)
+      break;
+
+    block = next;
+  }
+
+  list->cursor = NULL;
 }
 
 static void
@@ -263,9 +590,12 @@ list_free_rt(List* list, JSRuntime* rt) {
     struct list_head *ptr, *ptr2;
 
     list_for_each_safe(ptr, ptr2, &list->head) {
-      Node* node = list_entry(ptr, Node, link);
+      ListBlock* block = list_entry(ptr, ListBlock, link);
+
+      for(uint32_t i = block->start; i < (uint32_t)block->start + block->count; i++)
+        JS_FreeValueRT(rt, block->values[i]);
 
-      node_free(node, rt);
+      js_free_rt(rt, block);
     }
 
     js_free_rt(rt, list);
@@ -292,16 +622,32 @@ list_dup(List* list) {
   return list;
 }
 
+static inline BOOL
+list_has(List* list, int64_t index) {
+  if(index < 0)
+    return index >= -(int64_t)list->size;
+
+  return index < (int64_t)list->size;
+}
+
+static inline int64_t
+list_index(List* list, int64_t index) {
+  if(index < 0)
+    index += list->size;
+
+  return index;
+}
+
 static int64_t
 list_indexof_forward(List* list, JSValueConst value, JSContext* ctx) {
-  struct list_head* ptr;
-  int64_t i = 0;
-
-  list_for_each(ptr, &list->head) {
-    Node* node = list_entry(ptr, Node, link);
-    if(js_value_equals(ctx, value, node->value))
-      return i;
-    i++;
+  ListBlock* block;
+  uint32_t i;
+  int64_t n = 0;
+
+  list_for_each_value(block, i, list) {
+    if(js_value_equals(ctx, value, block->values[i]))
+      return n;
+    n++;
   }
 
   return -1;
@@ -310,47 +656,59 @@ list_indexof_forward(List* list, JSValueConst value, JSContext* ctx) {
 static int64_t
 list_indexof_reverse(List* list, JSValueConst value, JSContext* ctx) {
   struct list_head* ptr;
-  int64_t i = 0;
+  int64_t n = 0;
 
   list_for_each_prev(ptr, &list->head) {
-    Node* node = list_entry(ptr, Node, link);
-    if(js_value_equals(ctx, value, node->value))
-      return i;
-    i++;
+    ListBlock* block = list_entry(ptr, ListBlock, link);
+
+    for(uint32_t i = block->start + block->count; i-- > block->start;) {
+      if(js_value_equals(ctx, value, block->values[i]))
+        return n;
+      n++;
+    }
   }
 
   return -1;
 }
 
+/* the predicate may modify the list, so these go by index */
 static int64_t
-list_find_forward(List* list, JSValueConst list_obj, JSValueConst fn, Node** nptr, JSContext* ctx) {
-  struct list_head* ptr;
-  int64_t i = 0;
+list_find_forward(List* list, JSValueConst list_obj, JSValueConst fn, JSValue* pvalue, JSContext* ctx) {
+  JSValue* ptr;
+
+  for(int64_t i = 0; (ptr = list_at(list, i)); i++) {
+    JSValue value = JS_DupValue(ctx, *ptr);
 
-  list_for_each(ptr, &list->head) {
-    Node* node = list_entry(ptr, Node, link);
-    if(node_predicate(node, fn, list_obj, i++, ctx)) {
-      if(nptr)
-        *nptr = node;
+    if(value_predicate(value, fn, list_obj, i, ctx)) {
+      if(pvalue)
+        *pvalue = value;
+      else
+        JS_FreeValue(ctx, value);
       return i;
     }
+
+    JS_FreeValue(ctx, value);
   }
 
   return -1;
 }
 
 static int64_t
-list_find_reverse(List* list, JSValueConst list_obj, JSValueConst fn, Node** nptr, JSContext* ctx) {
-  struct list_head* ptr;
-  int64_t i = list->size - 1;
+list_find_reverse(List* list, JSValueConst list_obj, JSValueConst fn, JSValue* pvalue, JSContext* ctx) {
+  JSValue* ptr;
 
-  list_for_each_prev(ptr, &list->head) {
-    Node* node = list_entry(ptr, Node, link);
-    if(node_predicate(node, fn, list_obj, i--, ctx)) {
-      if(nptr)
-        *nptr = node;
+  for(int64_t i = list->size - 1; i >= 0 && (ptr = list_at(list, i)); i--) {
+    JSValue value = JS_DupValue(ctx, *ptr);
+
+    if(value_predicate(value, fn, list_obj, i, ctx)) {
+      if(pvalue)
+        *pvalue = value;
+      else
+        JS_FreeValue(ctx, value);
       return i;
     }
+
+    JS_FreeValue(ctx, value);
   }
 
   return -1;
@@ -358,9 +716,193 @@ list_find_reverse(List* list, JSValueConst list_obj, JSValueConst fn, Node** npt
 
 static JSValue
 list_find_value(List* list, JSValueConst list_obj, JSValueConst fn, FindCall* findcall, JSContext* ctx) {
-  Node* node = 0;
-  findcall(list, list_obj, fn, &node, ctx);
-  return node ? JS_DupValue(ctx, node->value) : JS_UNDEFINED;
+  JSValue value = JS_UNDEFINED;
+  findcall(list, list_obj, fn, &value, ctx);
+  return value;
+}
+
+/* appends values [start, end) of list to other */
+static void
+list_copy(List* list, size_t start, size_t end, List* other, JSContext* ctx) {
+  ListBlock* block;
+  size_t base;
+
+  if(start >= end || !(block = list_seek(list, start, &base)))
+    return;
+
+  for(;;) {
+    for(size_t i = start - base; i < block->count && start < end; i++, start++)
+      list_push(other, block->values[block->start + i], ctx);
+
+    if(start >= end || block->link.next == &list->head)
+      break;
+
+    base += block->count;
+    block = block_next(block);
+  }
+}
+
+typedef struct SortEntry {
+  JSValue value, key;
+  /* default comparison: numbers, then strings, then undefined */
+  enum { SORT_NUMBER, SORT_STRING, SORT_UNDEFINED } kind;
+  double num;
+  const char* str;
+  size_t len;
+} SortEntry;
+
+typedef struct ListSort {
+  JSContext* ctx;
+  JSValueConst compare;
+  BOOL error;
+} ListSort;
+
+static int
+sort_default(const SortEntry* a, const SortEntry* b) {
+  int r;
+
+  if(a->kind != b->kind)
+    return a->kind < b->kind ? -1 : 1;
+
+  switch(a->kind) {
+    case SORT_NUMBER: return a->num < b->num ? -1 : a->num > b->num ? 1 : 0;
+    case SORT_STRING: return (r = memcmp(a->str, b->str, MIN_NUM(a->len, b->len))) ? r : (a->len > b->len) - (a->len < b->len);
+    default: return 0;
+  }
+}
+
+static int
+sort_compare(ListSort* s, const SortEntry* a, const SortEntry* b) {
+  JSValueConst args[2];
+  JSValue result;
+  double d = 0;
+
+  if(s->error)
+    return 0;
+
+  if(JS_IsUndefined(s->compare))
+    return sort_default(a, b);
+
+  args[0] = a->key;
+  args[1] = b->key;
+  result = JS_Call(s->ctx, s->compare, JS_UNDEFINED, countof(args), args);
+
+  if(JS_IsException(result) || JS_ToFloat64(s->ctx, &d, result))
+    s->error = TRUE;
+
+  JS_FreeValue(s->ctx, result);
+  return d < 0 ? -1 : d > 0 ? 1 : 0;
+}
+
+/**
+ * Stable bottom-up merge sort of n entries, alternating between entries
+ * and tmp; returns whichever holds the result. Runs already in order are
+ * copied without merging, so sorted input takes O(n) comparisons.
+ */
+static SortEntry*
+sort_merge(ListSort* s, SortEntry* entries, SortEntry* tmp, size_t n) {
+  SortEntry *src = entries, *dst = tmp, *swap;
+
+  for(size_t width = 1; width < n; width *= 2) {
+    for(size_t lo = 0; lo < n; lo += 2 * width) {
+      size_t mid = MIN_NUM(lo + width, n), hi = MIN_NUM(lo + 2 * width, n), i = lo, j = mid, k = lo;
+
+      if(mid == hi || sort_compare(s, &src[mid - 1], &src[mid]) <= 0) {
+        memcpy(&dst[lo], &src[lo], (hi - lo) * sizeof(SortEntry));
+        continue;
+      }
+
+      while(i < mid && j < hi)
+        dst[k++] = sort_compare(s, &src[j], &src[i]) < 0 ? src[j++] : src[i++];
+
+      while(i < mid)
+        dst[k++] = src[i++];
+
+      while(j < hi)
+        dst[k++] = src[j++];
+    }
+
+    swap = src;
+    src = dst;
+    dst = swap;
+  }
+
+  return src;
+}
+
+/**
+ * Sorts the list in place, by key(value) when key is a function, with
+ * compare(a, b) or the default comparison. Values are written back into
+ * the blocks they came from, so the block layout and index stay intact.
+ */
+static BOOL
+list_sort(List* list, JSValueConst list_obj, JSValueConst compare, JSValueConst key, JSContext* ctx) {
+  ListSort s = {ctx, compare, FALSE};
+  SortEntry *entries, *sorted;
+  ListBlock* block;
+  uint32_t j;
+  size_t i = 0, n = list->size;
+
+  if(n < 2)
+    return TRUE;
+
+  if(!(entries = js_malloc(ctx, 2 * n * sizeof(SortEntry))))
+    return FALSE;
+
+  /* hold references first, as key() and compare() may modify the list */
+  list_for_each_value(block, j, list) {
+    entries[i].value = JS_DupValue(ctx, block->values[j]);
+    entries[i].key = JS_UNDEFINED;
+    entries[i].str = NULL;
+    i++;
+  }
+
+  for(i = 0; i < n && !s.error; i++) {
+    SortEntry* e = &entries[i];
+
+    e->key = JS_IsFunction(ctx, key) ? value_call(e->value, key, list_obj, i, ctx) : JS_DupValue(ctx, e->value);
+
+    if(JS_IsException(e->key)) {
+      e->key = JS_UNDEFINED;
+      s.error = TRUE;
+    } else if(JS_IsUndefined(compare)) {
+      if(JS_IsNumber(e->key)) {
+        e->kind = SORT_NUMBER;
+        JS_ToFloat64(ctx, &e->num, e->key);
+      } else if(JS_IsUndefined(e->key)) {
+        e->kind = SORT_UNDEFINED;
+      } else {
+        e->kind = SORT_STRING;
+
+        if(!(e->str = JS_ToCStringLen(ctx, &e->len, e->key)))
+          s.error = TRUE;
+      }
+    }
+  }
+
+  sorted = s.error ? entries : sort_merge(&s, entries, entries + n, n);
+  i = 0;
+
+  list_for_each_value(block, j, list) {
+    if(i == n)
+      break;
+
+    JS_FreeValue(ctx, block->values[j]);
+    block->values[j] = sorted[i++].value;
+  }
+
+  for(size_t k = 0; k < n; k++) {
+    if(k >= i)
+      JS_FreeValue(ctx, sorted[k].value);
+
+    JS_FreeValue(ctx, sorted[k].key);
+
+    if(sorted[k].str)
+      JS_FreeCString(ctx, sorted[k].str);
+  }
+
+  js_free(ctx, entries);
+  return !s.error;
 }
 
 static BOOL
@@ -376,6 +918,7 @@ list_append(List* list, JSValueConst iterable, JSContext* ctx) {
     JSValue value = iteration_value(&iter, ctx);
 
     list_push(list, value, ctx);
+    JS_FreeValue(ctx, value);
   }
 
   iteration_reset(&iter, ctx);
@@ -392,29 +935,27 @@ list_iterator_free(ListIterator* it, JSRuntime* rt) {
 
 static JSValue
 list_iterator_value(ListIterator* it, JSContext* ctx) {
-  JSValue ret;
-  Node* node;
+  JSValue ret = JS_UNDEFINED;
+  JSValue* ptr;
 
-  if(it->link == &it->list->head)
+  if(it->index < 0 || !(ptr = list_at(it->list, it->index)))
     return JS_UNDEFINED;
 
-  node = (Node*)it->link;
-
   switch(it->kind) {
     case ITERATOR_KIND_KEY: {
-      ret = JS_NewInt64(ctx, it->index + it->list->size);
+      ret = JS_NewInt64(ctx, it->index);
       break;
     }
 
     case ITERATOR_KIND_VALUE: {
-      ret = JS_DupValue(ctx, node->value);
+      ret = JS_DupValue(ctx, *ptr);
       break;
     }
 
     case ITERATOR_KIND_KEY_AND_VALUE: {
       ret = JS_NewArray(ctx);
-      JS_SetPropertyUint32(ctx, ret, 0, JS_NewInt64(ctx, it->index + it->list->size));
-      JS_SetPropertyUint32(ctx, ret, 1, JS_DupValue(ctx, node->value));
+      JS_SetPropertyUint32(ctx, ret, 0, JS_NewInt64(ctx, it->index));
+      JS_SetPropertyUint32(ctx, ret, 1, JS_DupValue(ctx, *ptr));
       break;
     }
   }
@@ -424,21 +965,14 @@ list_iterator_value(ListIterator* it, JSContext* ctx) {
 
 static BOOL
 list_iterator_skip(ListIterator* it, JSContext* ctx) {
-  struct list_head* link = it->link;
-
-  if(link == &it->list->head)
+  if(it->index < 0 || it->index >= (int64_t)it->list->size)
     return TRUE;
 
   switch(it->dir) {
-    case FWD:
-      it->link = link->next;
-      it->index++;
-      break;
-    case REV:
-      it->link = link->prev;
-      it->index--;
-      break;
+    case FWD: it->index++; break;
+    case REV: it->index--; break;
   }
+
   return FALSE;
 }
 
@@ -460,8 +994,7 @@ js_list_iterator_new(JSContext* ctx, JSValueConst proto, List* list, ListIterato
     return JS_EXCEPTION;
 
   it->list = list_dup(list);
-  it->index = dir == REV ? -1 : 0;
-  it->link = dir == REV ? list->head.prev : list->head.next;
+  it->index = dir == REV ? (int64_t)list->size - 1 : 0;
   it->kind = kind;
   it->dir = dir;
 
@@ -628,7 +1161,7 @@ static JSValue
 js_list_functions(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
   int64_t index;
   List* list;
-  Node* node = 0;
+  JSValue* ptr;
   JSValue ret = JS_UNDEFINED;
 
   if(!(list = js_list_data2(ctx, this_val)))
@@ -645,10 +1178,7 @@ js_list_functions(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
     }
 
     case METHOD_POP: {
-      if(list->head.prev != &list->head) {
-        node = list_entry(list->head.prev, Node, link);
-        ret = node_remove(node, list, ctx);
-      }
+      ret = list_pop(list, JS_GetRuntime(ctx));
       break;
     }
 
@@ -662,10 +1192,7 @@ js_list_functions(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
     }
 
     case METHOD_SHIFT: {
-      if(list->head.next != &list->head) {
-        node = list_entry(list->head.next, Node, link);
-        ret = node_remove(node, list, ctx);
-      }
+      ret = list_shift(list, JS_GetRuntime(ctx));
       break;
     }
 
@@ -673,8 +1200,8 @@ js_list_functions(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
       if(JS_ToInt64(ctx, &index, argv[0]))
         return JS_ThrowRangeError(ctx, "argument 1 must be numeric index");
 
-      if((node = list_at(list, index)))
-        ret = JS_DupValue(ctx, node->value);
+      if((ptr = list_at(list, index)))
+        ret = JS_DupValue(ctx, *ptr);
       else
         ret = JS_ThrowRangeError(ctx, "Index %ld is out of range", (long)index);
 
@@ -704,16 +1231,11 @@ js_list_functions(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
 
     case METHOD_CONCAT: {
       List* other;
-      struct list_head* ptr;
 
       if(!(other = list_new(ctx)))
         return JS_EXCEPTION;
 
-      list_for_each(ptr, &list->head) {
-        node = list_entry(ptr, Node, link);
-
-        list_push(other, node->value, ctx);
-      }
+      list_copy(list, 0, list->size, other, ctx);
 
       for(int i = 0; i < argc; i++) {
         if(!list_append(other, argv[i], ctx)) {
@@ -728,8 +1250,7 @@ js_list_functions(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
 
     case METHOD_SLICE: {
       List* other;
-      struct list_head* ptr;
-      int64_t i = 0, start = 0, end = list->size;
+      int64_t start = 0, end = list->size;
 
       if(argc > 0 && JS_ToInt64(ctx, &start, argv[0]))
         return JS_ThrowRangeError(ctx, "argument 1 must be numeric index");
@@ -737,20 +1258,14 @@ js_list_functions(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
       if(argc > 1 && JS_ToInt64(ctx, &end, argv[1]))
         return JS_ThrowRangeError(ctx, "argument 2 must be numeric index");
 
-      start = list_index(list, start);
-      end = list_index(list, end);
+      start = MAX_NUM(list_index(list, start), 0);
+      end = MIN_NUM(list_index(list, end), (int64_t)list->size);
 
       if(!(other = list_new(ctx)))
         return JS_EXCEPTION;
 
-      list_for_each(ptr, &list->head) {
-        node = list_entry(ptr, Node, link);
-
-        if(i >= start && i < end)
-          list_push(other, node->value, ctx);
-
-        i++;
-      }
+      if(start < end)
+        list_copy(list, start, end, other, ctx);
 
       ret = js_list_wrap_species(ctx, this_val, other);
       break;
@@ -758,39 +1273,24 @@ js_list_functions(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
 
     case METHOD_SPLICE: {
       List* other;
-      struct list_head *ptr, *ptr2;
-      int64_t i = 0, start = 0, end = list->size;
+      int64_t start = 0, count = list->size;
 
       if(argc > 0 && JS_ToInt64(ctx, &start, argv[0]))
         return JS_ThrowRangeError(ctx, "argument 1 must be numeric index");
 
-      if(argc > 1 && JS_ToInt64(ctx, &end, argv[1]))
+      if(argc > 1 && JS_ToInt64(ctx, &count, argv[1]))
         return JS_ThrowRangeError(ctx, "argument 2 must be numeric count");
 
-      start = list_index(list, start);
-      end = list_index(list, start + end);
+      start = MIN_NUM(MAX_NUM(list_index(list, start), 0), (int64_t)list->size);
+      count = MIN_NUM(MAX_NUM(count, 0), (int64_t)list->size - start);
 
       if(!(other = list_new(ctx)))
         return JS_EXCEPTION;
 
-      list_for_each_safe(ptr, ptr2, &list->head) {
-        node = list_entry(ptr, Node, link);
+      list_remove(list, start, count, other, ctx);
 
-        if(i == end)
-          break;
-
-        if(i >= start) {
-          list_del(&node->link);
-          list_add_tail(&node->link, &other->head);
-        }
-
-        i++;
-      }
-
-      ptr2 = ptr->prev;
-
-      for(i = 2; i < argc; i++)
-        ptr2 = list_insert(list, ptr2, argv[i], ctx);
+      for(int i = 2; i < argc; i++)
+        list_insert(list, start + i - 2, argv[i], ctx);
 
       ret = js_list_wrap_species(ctx, this_val, other);
       break;
@@ -798,7 +1298,8 @@ js_list_functions(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
 
     case METHOD_FILL: {
       List* other;
-      struct list_head* ptr;
+      ListBlock* block;
+      uint32_t j;
       int64_t i = 0, start = 0, end = list->size;
 
       if(argc > 1 && JS_ToInt64(ctx, &start, argv[1]))
@@ -813,16 +1314,8 @@ js_list_functions(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
       if(!(other = list_new(ctx)))
         return JS_EXCEPTION;
 
-      list_for_each(ptr, &list->head) {
-        node = list_entry(ptr, Node, link);
-        JSValue value = node->value;
-
-        if(i >= start && i < end) {
-          value = argv[0];
-        }
-
-        list_push(other, value, ctx);
-
+      list_for_each_value(block, j, list) {
+        list_push(other, i >= start && i < end ? argv[0] : block->values[j], ctx);
         i++;
       }
 
@@ -834,19 +1327,22 @@ js_list_functions(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
       if(JS_ToInt64(ctx, &index, argv[0]))
         return JS_ThrowRangeError(ctx, "argument 1 must be numeric index");
 
-      index %= (int64_t)list->size;
+      if(list->size > 0)
+        index %= (int64_t)list->size;
+
+      while(index > 0 && list->size) {
+        JSValue value = list_pop(list, JS_GetRuntime(ctx));
 
-      while(index > 0 && list->head.prev != &list->head) {
-        node = list_entry(list->head.prev, Node, link);
-        list_del(&node->link);
-        list_add(&node->link, &list->head);
+        list_unshift(list, value, ctx);
+        JS_FreeValue(ctx, value);
         index--;
       }
 
-      while(index < 0 && list->head.next != &list->head) {
-        node = list_entry(list->head.next, Node, link);
-        list_del(&node->link);
-        list_add_tail(&node->link, &list->head);
+      while(index < 0 && list->size) {
+        JSValue value = list_shift(list, JS_GetRuntime(ctx));
+
+        list_push(list, value, ctx);
+        JS_FreeValue(ctx, value);
         index++;
       }
 
@@ -856,24 +1352,48 @@ js_list_functions(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
 
     case METHOD_REVERSE: {
       List* other;
-      struct list_head* ptr;
+      struct list_head* link;
 
       if(!(other = list_new(ctx)))
         return JS_EXCEPTION;
 
-      list_for_each_prev(ptr, &list->head) {
-        node = list_entry(ptr, Node, link);
+      list_for_each_prev(link, &list->head) {
+        ListBlock* block = list_entry(link, ListBlock, link);
 
-        list_push(other, node->value, ctx);
+        for(uint32_t i = block->start + block->count; i-- > block->start;)
+          list_push(other, block->values[i], ctx);
       }
 
       ret = js_list_wrap_species(ctx, this_val, other);
       break;
     }
 
+    case METHOD_SORT: {
+      JSValue compare = JS_UNDEFINED, key = JS_UNDEFINED;
+
+      if(argc > 0 && JS_IsFunction(ctx, argv[0])) {
+        compare = JS_DupValue(ctx, argv[0]);
+      } else if(argc > 0 && JS_IsObject(argv[0])) {
+        compare = JS_GetPropertyStr(ctx, argv[0], "compare");
+        key = JS_GetPropertyStr(ctx, argv[0], "key");
+      } else if(argc > 0 && !JS_IsUndefined(argv[0])) {
+        return JS_ThrowTypeError(ctx, "argument 1 must be a function or { compare, key }");
+      }
+
+      if(!JS_IsFunction(ctx, compare)) {
+        JS_FreeValue(ctx, compare);
+        compare = JS_UNDEFINED;
+      }
+
+      ret = list_sort(list, this_val, compare, key, ctx) ? JS_DupValue(ctx, this_val) : JS_EXCEPTION;
+
+      JS_FreeValue(ctx, compare);
+      JS_FreeValue(ctx, key);
+      break;
+    }
+
     case METHOD_INSERT: {
       ListIterator* iter;
-      struct list_head* ptr;
 
       if(!(iter = JS_GetOpaque2(ctx, argv[0], js_list_iterator_class_id)))
         return JS_EXCEPTION;
@@ -881,10 +1401,11 @@ js_list_functions(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
       if(iter->list != list)
         return JS_ThrowReferenceError(ctx, "Iterator not from this list");
 
-      ptr = iter->link;
+      /* after the value the iterator returns next */
+      index = MIN_NUM(MAX_NUM(iter->index + 1, 0), (int64_t)list->size);
 
       for(int i = 1; i < argc; i++)
-        ptr = list_insert(list, ptr, argv[i], ctx);
+        list_insert(list, index++, argv[i], ctx);
       break;
     }
   }
@@ -947,30 +1468,29 @@ js_list_search(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst arg
 static JSValue
 js_list_functional(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
   List* list;
-  JSValue pred, ret = JS_UNDEFINED;
-  struct list_head* ptr;
+  JSValue pred, ret = JS_UNDEFINED, *ptr;
   int64_t i = 0;
 
   if(!(list = js_list_data2(ctx, this_val)))
     return JS_EXCEPTION;
 
-  if(argc < 1 && magic == METHOD_SORT) {
-    const char* fn = "(a, b) => a - b";
-    argv[0] = JS_Eval(ctx, fn, strlen(fn), "-", 0);
-    argc = 1;
-  } else if(argc < 1 || !JS_IsFunction(ctx, argv[0])) {
+  if(argc < 1 || !JS_IsFunction(ctx, argv[0])) {
     return JS_ThrowTypeError(ctx, "argument 1 must be a function");
   }
 
   pred = js_list_predicate(ctx, argc, argv);
 
+  /* callbacks may modify the list, so values are looked up by index (O(1) amortized through the cursor) and held during the call */
   switch(magic) {
     case METHOD_EVERY: {
       ret = JS_TRUE;
-      list_for_each(ptr, &list->head) {
-        Node* node = list_entry(ptr, Node, link);
-        if(!node_predicate(node, pred, this_val, i++, ctx)) {
-          JS_FreeValue(ctx, pred);
+      for(i = 0; (ptr = list_at(list, i)); i++) {
+        JSValue value = JS_DupValue(ctx, *ptr);
+        BOOL result = value_predicate(value, pred, this_val, i, ctx);
+
+        JS_FreeValue(ctx, value);
+
+        if(!result) {
           ret = JS_FALSE;
           break;
         }
@@ -980,10 +1500,13 @@ js_list_functional(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
 
     case METHOD_SOME: {
       ret = JS_FALSE;
-      list_for_each(ptr, &list->head) {
-        Node* node = list_entry(ptr, Node, link);
-        if(node_predicate(node, pred, this_val, i++, ctx)) {
-          JS_FreeValue(ctx, pred);
+      for(i = 0; (ptr = list_at(list, i)); i++) {
+        JSValue value = JS_DupValue(ctx, *ptr);
+        BOOL result = value_predicate(value, pred, this_val, i, ctx);
+
+        JS_FreeValue(ctx, value);
+
+        if(result) {
           ret = JS_TRUE;
           break;
         }
@@ -999,10 +1522,13 @@ js_list_functional(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
         break;
       }
 
-      list_for_each(ptr, &list->head) {
-        Node* node = list_entry(ptr, Node, link);
-        if(node_predicate(node, pred, this_val, i++, ctx))
-          list_push(other, node->value, ctx);
+      for(i = 0; (ptr = list_at(list, i)); i++) {
+        JSValue value = JS_DupValue(ctx, *ptr);
+
+        if(value_predicate(value, pred, this_val, i, ctx))
+          list_push(other, value, ctx);
+
+        JS_FreeValue(ctx, value);
       }
 
       ret = js_list_wrap_species(ctx, this_val, other);
@@ -1010,10 +1536,11 @@ js_list_functional(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
     }
 
     case METHOD_FOREACH: {
-      list_for_each(ptr, &list->head) {
-        Node* node = list_entry(ptr, Node, link);
+      for(i = 0; (ptr = list_at(list, i)); i++) {
+        JSValue value = JS_DupValue(ctx, *ptr);
 
-        node_predicate(node, pred, this_val, i++, ctx);
+        JS_FreeValue(ctx, value_call(value, pred, this_val, i, ctx));
+        JS_FreeValue(ctx, value);
       }
       break;
     }
@@ -1026,11 +1553,13 @@ js_list_functional(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
         break;
       }
 
-      list_for_each(ptr, &list->head) {
-        Node* node = list_entry(ptr, Node, link);
-        JSValue value = node_call(node, pred, this_val, i++, ctx);
+      for(i = 0; (ptr = list_at(list, i)); i++) {
+        JSValue value = JS_DupValue(ctx, *ptr);
+        JSValue result = value_call(value, pred, this_val, i, ctx);
 
-        list_push(other, value, ctx);
+        list_push(other, result, ctx);
+        JS_FreeValue(ctx, result);
+        JS_FreeValue(ctx, value);
       }
 
       ret = js_list_wrap_species(ctx, this_val, other);
@@ -1038,20 +1567,13 @@ js_list_functional(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
     }
 
     case METHOD_REDUCE: {
-      List* other;
       ret = JS_DupValue(ctx, argc > 1 ? argv[1] : JS_UNDEFINED);
 
-      if(!(other = list_new(ctx))) {
-        ret = JS_EXCEPTION;
-        break;
-      }
-
-      list_for_each(ptr, &list->head) {
-        Node* node = list_entry(ptr, Node, link);
+      for(i = 0; (ptr = list_at(list, i)); i++) {
         JSValueConst args[] = {
             ret,
-            node->value,
-            JS_NewInt64(ctx, i++),
+            JS_DupValue(ctx, *ptr),
+            JS_NewInt64(ctx, i),
             this_val,
         };
 
@@ -1065,22 +1587,13 @@ js_list_functional(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
     }
 
     case METHOD_REDUCE_RIGHT: {
-      List* other;
       ret = JS_DupValue(ctx, argc > 1 ? argv[1] : JS_UNDEFINED);
 
-      if(!(other = list_new(ctx))) {
-        ret = JS_EXCEPTION;
-        break;
-      }
-
-      i = list->size;
-
-      list_for_each_prev(ptr, &list->head) {
-        Node* node = list_entry(ptr, Node, link);
+      for(i = list->size - 1; i >= 0 && (ptr = list_at(list, i)); i--) {
         JSValueConst args[] = {
             ret,
-            node->value,
-            JS_NewInt64(ctx, --i),
+            JS_DupValue(ctx, *ptr),
+            JS_NewInt64(ctx, i),
             this_val,
         };
 
@@ -1091,41 +1604,6 @@ js_list_functional(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
       }
       break;
     }
-
-    case METHOD_SORT: {
-      List* other;
-      struct list_head* ptr2;
-
-      if(!(other = list_new(ctx))) {
-        ret = JS_EXCEPTION;
-        break;
-      }
-
-      list_for_each(ptr, &list->head) {
-        Node* node = list_entry(ptr, Node, link);
-
-        list_for_each(ptr2, &other->head) {
-          JSValueConst args[] = {
-              node->value,
-              list_entry(ptr2, Node, link)->value,
-          };
-
-          JSValue value = JS_Call(ctx, pred, JS_UNDEFINED, countof(args), args);
-          int32_t retval;
-          JS_ToInt32(ctx, &retval, value);
-          JS_FreeValue(ctx, value);
-
-          if(retval <= 0)
-            break;
-        }
-
-        ptr2 = ptr2->prev;
-        list_insert(other, ptr2, node->value, ctx);
-      }
-
-      ret = js_list_wrap_species(ctx, this_val, other);
-      break;
-    }
   }
 
   JS_FreeValue(ctx, pred);
@@ -1232,7 +1710,7 @@ static const JSCFunctionListEntry js_list_proto_funcs[] = {
     JS_CFUNC_MAGIC_DEF("map", 1, js_list_functional, METHOD_MAP),
     JS_CFUNC_MAGIC_DEF("reduce", 1, js_list_functional, METHOD_REDUCE),
     JS_CFUNC_MAGIC_DEF("reduceRight", 1, js_list_functional, METHOD_REDUCE_RIGHT),
-    JS_CFUNC_MAGIC_DEF("sort", 0, js_list_functional, METHOD_SORT),
+    JS_CFUNC_MAGIC_DEF("sort", 0, js_list_functions, METHOD_SORT),
     JS_CFUNC_MAGIC_DEF("values", 0, js_list_iterator, ITERATOR_KIND_VALUE),
     JS_CFUNC_MAGIC_DEF("keys", 0, js_list_iterator, ITERATOR_KIND_KEY),
     JS_CFUNC_MAGIC_DEF("entries", 0, js_list_iterator, ITERATOR_KIND_KEY_AND_VALUE),
@@ -1262,13 +1740,13 @@ js_list_get_own_property(JSContext* ctx, JSPropertyDescriptor* pdesc, JSValueCon
   int64_t index;
 
   if(js_atom_is_index(ctx, &index, prop)) {
-    Node* node;
+    JSValue* ptr;
 
-    if((node = list_at(list, index))) {
+    if((ptr = list_at(list, index))) {
 
       if(pdesc) {
         pdesc->flags = JS_PROP_ENUMERABLE;
-        pdesc->value = JS_DupValue(ctx, node->value);
+        pdesc->value = JS_DupValue(ctx, *ptr);
         pdesc->getter = JS_UNDEFINED;
         pdesc->setter = JS_UNDEFINED;
       }
@@ -1298,8 +1776,10 @@ js_list_get_property(JSContext* ctx, JSValueConst obj, JSAtom prop, JSValueConst
   int32_t entry;
 
   if(js_atom_is_index(ctx, &index, prop)) {
-    if(list_has(list, index))
-      value = JS_DupValue(ctx, list_value(list, index));
+    JSValue* ptr;
+
+    if((ptr = list_at(list, index)))
+      value = JS_DupValue(ctx, *ptr);
 
   } else if(js_atom_is_length(ctx, prop)) {
     value = JS_NewInt64(ctx, list->size);
@@ -1336,12 +1816,10 @@ js_list_set_property(JSContext* ctx, JSValueConst obj, JSAtom prop, JSValueConst
 
       list_unshift(list, value, ctx);
     } else {
-      Node* node;
-
-      node = list_at(list, index);
+      JSValue* ptr = list_at(list, index);
 
-      JS_FreeValue(ctx, node->value);
-      node->value = JS_DupValue(ctx, value);
+      JS_FreeValue(ctx, *ptr);
+      *ptr = JS_DupValue(ctx, value);
     }
 
     return TRUE;
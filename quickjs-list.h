@@ -9,10 +9,38 @@
  * @{
  */
 
+#define LIST_BLOCK_SIZE 32
+/* lists with more blocks maintain an order-statistics index over them */
+#define LIST_INDEX_BLOCKS 16
+
+/**
+ * Unrolled list: a list of blocks, each holding up to LIST_BLOCK_SIZE
+ * values in values[start .. start + count), so both ends grow in O(1)
+ * and scans walk contiguous memory.
+ *
+ * Long lists also keep the blocks in a treap ordered by position, where
+ * each block knows how many values its subtree holds, so finding the
+ * block for an index takes O(log n).
+ */
+typedef struct ListBlock {
+  struct list_head link;
+  struct ListBlock *parent, *left, *right;
+  uint32_t priority;
+  size_t total;
+  uint8_t start, count;
+  JSValue values[LIST_BLOCK_SIZE];
+} ListBlock;
+
 typedef struct List {
   struct list_head head;
-  size_t size;
+  size_t size, blocks;
   int ref_count;
+  /* last block looked up by index and the index of its first value */
+  ListBlock* cursor;
+  size_t cursor_base;
+  ListBlock* root;
+  uint32_t seed;
+  BOOL indexed;
 } List;
 
 extern VISIBLE JSClassID js_list_class_id, js_list_iterator_class_id;
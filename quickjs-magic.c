@@ -1,8 +1,14 @@
 #include "defines.h"
 #include "buffer-utils.h"
 #include "utils.h"
+#include <list.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <magic.h>
 
 /**
@@ -29,11 +35,325 @@ enum {
   METHOD_VERSION,
 };
 
+enum {
+  STATIC_PRELOAD = 0,
+  STATIC_CLASSIFY,
+  STATIC_CACHESIZE,
+  STATIC_CLEARCACHE,
+};
+
+/**
+ * Process-wide state shared by every runtime and thread: compiled
+ * databases mapped once, a pool of cookies loaded from them and a cache of
+ * results. All of it is guarded by magic_lock.
+ */
+typedef struct magic_db {
+  struct magic_db* next;
+  char* path;
+  void* map;
+  size_t size;
+} MagicDB;
+
+typedef struct {
+  uint64_t a, b, c, d;
+  int32_t kind, flags;
+} MagicKey;
+
+typedef struct magic_entry {
+  struct list_head link; /**< in magic_lru, most recent first */
+  struct magic_entry* chain;
+  MagicKey key;
+  uint32_t hash;
+  char* result;
+} MagicEntry;
+
+typedef struct {
+  magic_t cookie;
+  MagicDB* db;
+} MagicCookie;
+
+#define MAGIC_POOL_MAX 16
+#define MAGIC_CACHE_DEFAULT 1024
+/* libmagic looks at no more than MAGIC_PARAM_BYTES_MAX bytes, 1MiB by default */
+#define MAGIC_HASH_MAX (1 << 20)
+
+enum {
+  MAGIC_KEY_FILE = 1,
+  MAGIC_KEY_DESCRIPTOR,
+  MAGIC_KEY_BUFFER,
+};
+
+static pthread_mutex_t magic_lock = PTHREAD_MUTEX_INITIALIZER;
+static MagicDB* magic_dbs;
+static MagicDB* magic_pool_db;
+static MagicCookie magic_pool[MAGIC_POOL_MAX];
+static uint32_t magic_pool_count;
+static MagicEntry** magic_table;
+static uint32_t magic_table_size, magic_cache_count, magic_cache_max = MAGIC_CACHE_DEFAULT;
+static struct list_head magic_lru = LIST_HEAD_INIT(magic_lru);
+
 static inline magic_t
 js_magic_data(JSContext* ctx, JSValueConst value) {
   return JS_GetOpaque(value, js_magic_class_id);
 }
 
+static BOOL
+magic_db_compiled(const void* map, size_t size) {
+  static const uint32_t mgc = 0xF11E041C;
+  uint32_t x;
+
+  if(size < sizeof(x))
+    return FALSE;
+
+  memcpy(&x, map, sizeof(x));
+  return x == mgc || x == __builtin_bswap32(mgc);
+}
+
+/**
+ * Maps the compiled database for \p path (trying path.mgc first) the
+ * first time it is asked for. Databases stay mapped for the lifetime of
+ * the process, cookies load them with magic_load_buffers() which does not
+ * copy. Called with magic_lock held.
+ */
+static MagicDB*
+magic_db_get(const char* path) {
+  MagicDB* db;
+  size_t len = strlen(path);
+  char* file;
+
+  for(db = magic_dbs; db; db = db->next)
+    if(!strcmp(db->path, path))
+      return db;
+
+  if(!(file = malloc(len + 5)))
+    return 0;
+
+  memcpy(file, path, len);
+  strcpy(file + len, len > 4 && !strcmp(path + len - 4, ".mgc") ? "" : ".mgc");
+
+  for(int i = 0; i < 2; i++) {
+    struct stat st;
+    int fd;
+    void* map;
+
+    if((fd = open(i == 0 ? file : path, O_RDONLY | O_CLOEXEC)) == -1)
+      continue;
+
+    /* libmagic byte-swaps foreign databases in place, keep that private */
+    map = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) ? mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+
+    if(map == MAP_FAILED)
+      continue;
+
+    if(!magic_db_compiled(map, st.st_size) || !(db = malloc(sizeof(MagicDB)))) {
+      munmap(map, st.st_size);
+      continue;
+    }
+
+    db->path = strdup(path);
+    db->map = map;
+    db->size = st.st_size;
+    db->next = magic_dbs;
+    magic_dbs = db;
+    break;
+  }
+
+  free(file);
+  return db;
+}
+
+static int
+magic_db_load(magic_t cookie, MagicDB* db) {
+  void* buf[] = {db->map};
+  size_t siz[] = {db->size};
+
+  return magic_load_buffers(cookie, buf, siz, 1);
+}
+
+static inline uint32_t
+magic_key_hash(const MagicKey* key) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  const uint8_t* p = (const uint8_t*)key;
+
+  for(size_t i = 0; i < sizeof(MagicKey); i++)
+    h = (h ^ p[i]) * 0x100000001b3ull;
+
+  return h ^ (h >> 32);
+}
+
+static void
+magic_cache_unlink(MagicEntry* e) {
+  MagicEntry** pp = &magic_table[e->hash & (magic_table_size - 1)];
+
+  while(*pp != e)
+    pp = &(*pp)->chain;
+
+  *pp = e->chain;
+  list_del(&e->link);
+  magic_cache_count--;
+  free(e->result);
+  free(e);
+}
+
+static void
+magic_cache_clear(void) {
+  struct list_head *el, *next;
+
+  list_for_each_safe(el, next, &magic_lru) magic_cache_unlink(list_entry(el, MagicEntry, link));
+}
+
+/**
+ * @return  a copy of the cached result, NULL when there is none
+ */
+static char*
+magic_cache_get(const MagicKey* key) {
+  uint32_t hash = magic_key_hash(key);
+  char* ret = 0;
+
+  pthread_mutex_lock(&magic_lock);
+
+  if(magic_table)
+    for(MagicEntry* e = magic_table[hash & (magic_table_size - 1)]; e; e = e->chain)
+      if(e->hash == hash && !memcmp(&e->key, key, sizeof(MagicKey))) {
+        list_del(&e->link);
+        list_add(&e->link, &magic_lru);
+        ret = strdup(e->result);
+        break;
+      }
+
+  pthread_mutex_unlock(&magic_lock);
+  return ret;
+}
+
+static void
+magic_cache_put(const MagicKey* key, const char* result) {
+  uint32_t hash = magic_key_hash(key);
+  MagicEntry* e;
+
+  pthread_mutex_lock(&magic_lock);
+
+  if(magic_cache_max == 0)
+    goto end;
+
+  if(!magic_table) {
+    magic_table_size = 1;
+
+    while(magic_table_size < magic_cache_max * 2)
+      magic_table_size <<= 1;
+
+    if(!(magic_table = calloc(magic_table_size, sizeof(MagicEntry*))))
+      goto end;
+  }
+
+  for(e = magic_table[hash & (magic_table_size - 1)]; e; e = e->chain)
+    if(e->hash == hash && !memcmp(&e->key, key, sizeof(MagicKey)))
+      goto end;
+
+  while(magic_cache_count >= magic_cache_max)
+    magic_cache_unlink(list_entry(magic_lru.prev, MagicEntry, link));
+
+  if((e = malloc(sizeof(MagicEntry)))) {
+    if(!(e->result = strdup(result))) {
+      free(e);
+      goto end;
+    }
+
+    e->key = *key;
+    e->hash = hash;
+    e->chain = magic_table[hash & (magic_table_size - 1)];
+    magic_table[hash & (magic_table_size - 1)] = e;
+    list_add(&e->link, &magic_lru);
+    magic_cache_count++;
+  }
+
+end:
+  pthread_mutex_unlock(&magic_lock);
+}
+
+/**
+ * Takes a cookie off the pool, or opens one on the pool's database
+ */
+static MagicCookie
+magic_pool_acquire(int flags) {
+  MagicCookie mc = {0, 0};
+
+  pthread_mutex_lock(&magic_lock);
+
+  if(!magic_pool_db)
+    magic_pool_db = magic_db_get(LIBMAGIC_DB);
+
+  if(magic_pool_count)
+    mc = magic_pool[--magic_pool_count];
+  else
+    mc.db = magic_pool_db;
+
+  pthread_mutex_unlock(&magic_lock);
+
+  if(mc.cookie) {
+    magic_setflags(mc.cookie, flags);
+    return mc;
+  }
+
+  if((mc.cookie = magic_open(flags)))
+    if(mc.db ? magic_db_load(mc.cookie, mc.db) : magic_load(mc.cookie, LIBMAGIC_DB)) {
+      magic_close(mc.cookie);
+      mc.cookie = 0;
+    }
+
+  return mc;
+}
+
+static void
+magic_pool_release(MagicCookie mc) {
+  pthread_mutex_lock(&magic_lock);
+
+  /* cookies on a database replaced meanwhile are not kept */
+  if(magic_pool_count < MAGIC_POOL_MAX && mc.db == magic_pool_db) {
+    magic_pool[magic_pool_count++] = mc;
+    mc.cookie = 0;
+  }
+
+  pthread_mutex_unlock(&magic_lock);
+
+  if(mc.cookie)
+    magic_close(mc.cookie);
+}
+
+/**
+ * Switches the pool to \p path, closing the cookies on the previous
+ * database and dropping the cached results
+ */
+static BOOL
+magic_pool_preload(const char* path) {
+  MagicCookie closed[MAGIC_POOL_MAX];
+  uint32_t n;
+  MagicDB* db;
+
+  pthread_mutex_lock(&magic_lock);
+
+  if((db = magic_db_get(path)) && db != magic_pool_db) {
+    magic_pool_db = db;
+    magic_cache_clear();
+  }
+
+  memcpy(closed, magic_pool, sizeof(MagicCookie) * magic_pool_count);
+  n = magic_pool_count;
+  magic_pool_count = 0;
+
+  for(uint32_t i = 0; i < n; i++)
+    if(closed[i].db == db)
+      magic_pool[magic_pool_count++] = closed[i], closed[i].cookie = 0;
+
+  pthread_mutex_unlock(&magic_lock);
+
+  for(uint32_t i = 0; i < n; i++)
+    if(closed[i].cookie)
+      magic_close(closed[i].cookie);
+
+  return db != 0;
+}
+
 static int
 js_magic_load(JSContext* ctx, magic_t cookie, int argc, JSValueConst argv[]) {
   int n = 1;
@@ -41,7 +361,16 @@ js_magic_load(JSContext* ctx, magic_t cookie, int argc, JSValueConst argv[]) {
   if(JS_IsString(argv[0])) {
     const char* str;
     if((str = JS_ToCString(ctx, argv[0]))) {
-      magic_load(cookie, str);
+      MagicDB* db;
+
+      /* a compiled database is parsed from the shared mapping */
+      pthread_mutex_lock(&magic_lock);
+      db = magic_db_get(str);
+      pthread_mutex_unlock(&magic_lock);
+
+      if(!db || magic_db_load(cookie, db))
+        magic_load(cookie, str);
+
       JS_FreeCString(ctx, str);
     }
 
@@ -297,6 +626,164 @@ js_magic_call(JSContext* ctx, JSValueConst func_obj, JSValueConst this_val, int
   return js_magic_exec(ctx, func_obj, argc, argv);
 }
 
+static BOOL
+magic_key_stat(MagicKey* key, const struct stat* st, int kind, int flags) {
+  key->a = st->st_dev;
+  key->b = st->st_ino;
+#ifdef __APPLE__
+  key->c = (uint64_t)st->st_mtimespec.tv_sec * 1000000000 + st->st_mtimespec.tv_nsec;
+#else
+  key->c = (uint64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+#endif
+  key->d = st->st_size;
+  key->kind = kind;
+  key->flags = flags;
+  return S_ISREG(st->st_mode);
+}
+
+static void
+magic_key_buffer(MagicKey* key, const uint8_t* data, size_t len, int flags) {
+  uint64_t h1 = 0xcbf29ce484222325ull, h2 = 0x84222325cbf29ce4ull;
+  size_t n = MIN_NUM(len, MAGIC_HASH_MAX);
+
+  /* two independent hashes of the bytes libmagic can look at */
+  for(size_t i = 0; i < n; i++) {
+    h1 = (h1 ^ data[i]) * 0x100000001b3ull;
+    h2 = (h2 + data[i]) * 0x9e3779b97f4a7c15ull;
+  }
+
+  key->a = h1;
+  key->b = h2;
+  key->c = n;
+  key->d = 0;
+  key->kind = MAGIC_KEY_BUFFER;
+  key->flags = flags;
+}
+
+/**
+ * Magic.classify(file | fd | buffer, flags = MIME_TYPE): classifies on a
+ * pooled cookie, usable from any thread. Regular files are cached by
+ * (dev, inode, mtime, size), buffers by a hash of their content.
+ */
+static JSValue
+js_magic_classify(JSContext* ctx, int argc, JSValueConst argv[]) {
+  int32_t flags = MAGIC_MIME_TYPE;
+  MagicKey key;
+  BOOL cacheable = FALSE;
+  const char *filename = 0, *str = 0;
+  char* result;
+  int32_t fd = -1;
+  InputBuffer input = {{{0, 0}}, 0, 0, JS_UNDEFINED};
+  MagicCookie mc;
+  JSValue ret;
+  struct stat st;
+
+  if(argc > 1 && JS_IsNumber(argv[1]))
+    JS_ToInt32(ctx, &flags, argv[1]);
+
+  memset(&key, 0, sizeof(key));
+
+  if(JS_IsNumber(argv[0])) {
+    JS_ToInt32(ctx, &fd, argv[0]);
+    cacheable = fstat(fd, &st) == 0 && magic_key_stat(&key, &st, MAGIC_KEY_DESCRIPTOR, flags);
+  } else if(JS_IsString(argv[0])) {
+    if(!(filename = JS_ToCString(ctx, argv[0])))
+      return JS_EXCEPTION;
+
+    cacheable = ((flags & MAGIC_SYMLINK) ? stat(filename, &st) : lstat(filename, &st)) == 0 && magic_key_stat(&key, &st, MAGIC_KEY_FILE, flags);
+  } else {
+    input = js_input_chars(ctx, argv[0]);
+
+    if(!input_buffer_valid(&input))
+      return JS_EXCEPTION;
+
+    magic_key_buffer(&key, input_buffer_data(&input), input_buffer_length(&input), flags);
+    cacheable = TRUE;
+  }
+
+  if(cacheable && (result = magic_cache_get(&key))) {
+    ret = JS_NewString(ctx, result);
+    free(result);
+    goto end;
+  }
+
+  if(!(mc = magic_pool_acquire(flags)).cookie) {
+    ret = JS_ThrowInternalError(ctx, "libmagic: could not load database '%s'", LIBMAGIC_DB);
+    goto end;
+  }
+
+  str = filename ? magic_file(mc.cookie, filename) : fd != -1 ? magic_descriptor(mc.cookie, fd) : magic_buffer(mc.cookie, input_buffer_data(&input), input_buffer_length(&input));
+
+  if(str) {
+    ret = JS_NewString(ctx, str);
+
+    if(cacheable)
+      magic_cache_put(&key, str);
+  } else {
+    ret = JS_ThrowInternalError(ctx, "libmagic error: %s", magic_error(mc.cookie));
+  }
+
+  magic_pool_release(mc);
+
+end:
+  if(filename)
+    JS_FreeCString(ctx, filename);
+
+  if(!JS_IsUndefined(input.value))
+    input_buffer_free(&input, ctx);
+
+  return ret;
+}
+
+static JSValue
+js_magic_static_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  JSValue ret = JS_UNDEFINED;
+
+  switch(magic) {
+    case STATIC_PRELOAD: {
+      const char* path = argc > 0 && !JS_IsUndefined(argv[0]) ? JS_ToCString(ctx, argv[0]) : 0;
+
+      ret = JS_NewBool(ctx, magic_pool_preload(path ? path : LIBMAGIC_DB));
+
+      if(path)
+        JS_FreeCString(ctx, path);
+
+      break;
+    }
+
+    case STATIC_CLASSIFY: {
+      ret = js_magic_classify(ctx, argc, argv);
+      break;
+    }
+
+    case STATIC_CACHESIZE: {
+      uint32_t size;
+
+      pthread_mutex_lock(&magic_lock);
+      ret = JS_NewUint32(ctx, magic_cache_max);
+
+      if(argc > 0 && !JS_ToUint32(ctx, &size, argv[0])) {
+        magic_cache_clear();
+        free(magic_table);
+        magic_table = 0;
+        magic_cache_max = size;
+      }
+
+      pthread_mutex_unlock(&magic_lock);
+      break;
+    }
+
+    case STATIC_CLEARCACHE: {
+      pthread_mutex_lock(&magic_lock);
+      magic_cache_clear();
+      pthread_mutex_unlock(&magic_lock);
+      break;
+    }
+  }
+
+  return ret;
+}
+
 static void
 js_magic_finalizer(JSRuntime* rt, JSValue val) {
   magic_t cookie;
@@ -328,6 +815,10 @@ static const JSCFunctionListEntry js_magic_funcs[] = {
 };
 
 static const JSCFunctionListEntry js_magic_static[] = {
+    JS_CFUNC_MAGIC_DEF("preload", 0, js_magic_static_method, STATIC_PRELOAD),
+    JS_CFUNC_MAGIC_DEF("classify", 1, js_magic_static_method, STATIC_CLASSIFY),
+    JS_CFUNC_MAGIC_DEF("cacheSize", 0, js_magic_static_method, STATIC_CACHESIZE),
+    JS_CFUNC_MAGIC_DEF("clearCache", 0, js_magic_static_method, STATIC_CLEARCACHE),
     JS_PROP_INT32_DEF("NONE", MAGIC_NONE, 0),
     JS_PROP_INT32_DEF("DEBUG", MAGIC_DEBUG, 0),
     JS_PROP_INT32_DEF("SYMLINK", MAGIC_SYMLINK, 0),
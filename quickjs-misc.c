@@ -3,6 +3,7 @@
 #include <windows.h>
 #else
 #include <unistd.h>
+#include <pthread.h>
 #endif
 #include "defines.h"
 #include <quickjs.h>
@@ -54,6 +55,7 @@
 #include <sys/inotify.h>
 #endif
 #include "buffer-utils.h"
+#include "byte-search.h"
 #ifdef HAVE_TERMIOS_H
 #include <termios.h>
 #include <sys/ioctl.h>
@@ -98,10 +100,6 @@ BOOL JS_IsUncatchableError(JSContext* ctx, JSValueConst val);
  * @{
  */
 
-#ifndef HAVE_MEMMEM
-void* memmem(const void*, size_t, const void*, size_t);
-#endif
-
 enum {
   FUNC_GETEXECUTABLE = 0,
   FUNC_GETCWD,
@@ -732,7 +730,7 @@ js_misc_searcharraybuffer(JSContext* ctx, JSValueConst this_val, int argc, JSVal
       }
     }
 
-    if(needle.size <= haystack.size && (ptr = memmem(haystack.base, haystack.size, needle.base, needle.size))) {
+    if((ptr = (uint8_t*)byte_search(haystack.base, haystack.size, needle.base, needle.size))) {
       ofs = ptr - haystack.base;
       ofs += start_pos;
 
@@ -775,6 +773,104 @@ js_misc_searcharraybuffer(JSContext* ctx, JSValueConst this_val, int argc, JSVal
   return JS_NULL;
 }
 
+/**
+ * searchAll(haystack, needles, offset, length) finds every occurrence of
+ * any of the needles in one pass and returns { offsets, ids }: a
+ * Float64Array of match offsets and a Uint32Array with the index of the
+ * needle found at each.
+ */
+static JSValue
+js_misc_searchall(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  InputBuffer haystack;
+  InputBuffer* needles = 0;
+  const uint8_t** patterns = 0;
+  size_t* lengths = 0;
+  OffsetLength ol = OFFSET_INIT();
+  ByteMatcher bm;
+  DynBuf offsets, ids;
+  JSValue ret = JS_EXCEPTION;
+  int64_t i, count;
+  ssize_t found;
+
+  haystack = js_input_buffer(ctx, argv[0]);
+
+  if(!input_buffer_valid(&haystack))
+    return JS_ThrowTypeError(ctx, "argument 1 (haystack) must be an ArrayBuffer or typed array");
+
+  if((count = js_array_length(ctx, argv[1])) < 0) {
+    input_buffer_free(&haystack, ctx);
+    return JS_ThrowTypeError(ctx, "argument 2 (needles) must be an array");
+  }
+
+  js_offset_length(ctx, input_buffer_length(&haystack), argc - 2, argv + 2, &ol);
+
+  if(!(needles = js_mallocz(ctx, MAX_NUM(count, 1) * sizeof(InputBuffer))) || !(patterns = js_malloc(ctx, MAX_NUM(count, 1) * sizeof(uint8_t*))) ||
+     !(lengths = js_malloc(ctx, MAX_NUM(count, 1) * sizeof(size_t))))
+    goto fail;
+
+  for(i = 0; i < count; i++) {
+    JSValue item = JS_GetPropertyUint32(ctx, argv[1], i);
+
+    needles[i] = js_input_chars(ctx, item);
+    JS_FreeValue(ctx, item);
+
+    if(!input_buffer_valid(&needles[i]) || input_buffer_length(&needles[i]) == 0) {
+      JS_ThrowTypeError(ctx, "needle %" PRId64 " must be a non-empty string or buffer", i);
+      goto fail;
+    }
+
+    patterns[i] = input_buffer_data(&needles[i]);
+    lengths[i] = input_buffer_length(&needles[i]);
+  }
+
+  if(byte_matcher_init(&bm, patterns, lengths, count)) {
+    JS_ThrowOutOfMemory(ctx);
+    goto fail;
+  }
+
+  js_dbuf_init(ctx, &offsets);
+  js_dbuf_init(ctx, &ids);
+
+  found = byte_matcher_scan(&bm, offset_data(&ol, input_buffer_data(&haystack)), offset_size(&ol, input_buffer_length(&haystack)), ol.offset, &offsets, &ids);
+  byte_matcher_free(&bm);
+
+  if(found == -1) {
+    dbuf_free(&offsets);
+    dbuf_free(&ids);
+    JS_ThrowOutOfMemory(ctx);
+    goto fail;
+  }
+
+  /* the offsets are converted in place, both buffers are handed over */
+  for(i = 0; i < found; i++) {
+    double d = ((uint64_t*)offsets.buf)[i];
+
+    memcpy(offsets.buf + i * sizeof(double), &d, sizeof(double));
+  }
+
+  {
+    JSValue obuf = dbuf_steal_arraybuffer(&offsets, ctx);
+    JSValue ibuf = dbuf_steal_arraybuffer(&ids, ctx);
+
+    ret = JS_NewObject(ctx);
+    JS_SetPropertyStr(ctx, ret, "offsets", js_typedarray_new(ctx, 64, TRUE, FALSE, obuf));
+    JS_SetPropertyStr(ctx, ret, "ids", js_typedarray_new(ctx, 32, FALSE, FALSE, ibuf));
+    JS_FreeValue(ctx, obuf);
+    JS_FreeValue(ctx, ibuf);
+  }
+
+fail:
+  if(needles)
+    for(i = 0; i < count; i++)
+      input_buffer_free(&needles[i], ctx);
+
+  js_free(ctx, needles);
+  js_free(ctx, patterns);
+  js_free(ctx, lengths);
+  input_buffer_free(&haystack, ctx);
+  return ret;
+}
+
 static JSValue
 js_misc_memcpy(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
   MemoryBlock dst = {0, 0}, src = {0, 0};
@@ -882,6 +978,27 @@ js_misc_getperformancecounter(JSContext* ctx, JSValueConst this_val, int argc, J
   return JS_NewFloat64(ctx, (double)ts.tv_sec * 1000 + ((double)ts.tv_nsec / 1e06));
 }
 
+static JSValue
+js_misc_getmemoryusage(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  JSMemoryUsage mu;
+  JSValue ret = JS_NewObject(ctx);
+
+  JS_ComputeMemoryUsage(JS_GetRuntime(ctx), &mu);
+
+  JS_SetPropertyStr(ctx, ret, "mallocSize", JS_NewInt64(ctx, mu.malloc_size));
+  JS_SetPropertyStr(ctx, ret, "mallocLimit", JS_NewInt64(ctx, mu.malloc_limit));
+  JS_SetPropertyStr(ctx, ret, "memoryUsedSize", JS_NewInt64(ctx, mu.memory_used_size));
+  JS_SetPropertyStr(ctx, ret, "mallocCount", JS_NewInt64(ctx, mu.malloc_count));
+  JS_SetPropertyStr(ctx, ret, "memoryUsedCount", JS_NewInt64(ctx, mu.memory_used_count));
+  JS_SetPropertyStr(ctx, ret, "atomCount", JS_NewInt64(ctx, mu.atom_count));
+  JS_SetPropertyStr(ctx, ret, "strCount", JS_NewInt64(ctx, mu.str_count));
+  JS_SetPropertyStr(ctx, ret, "objCount", JS_NewInt64(ctx, mu.obj_count));
+  JS_SetPropertyStr(ctx, ret, "arrayCount", JS_NewInt64(ctx, mu.array_count));
+  JS_SetPropertyStr(ctx, ret, "jsFuncCount", JS_NewInt64(ctx, mu.js_func_count));
+
+  return ret;
+}
+
 static JSValue
 js_misc_proclink(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
   JSValue ret = JS_UNDEFINED;
@@ -1482,39 +1599,158 @@ js_misc_consolemode(JSContext* ctx, JSValueConst this_val, int argc, JSValueCons
 }
 #endif
 
+enum {
+  BTOA_STRING = 0,
+  BTOA_BUFFER,
+};
+
+enum {
+  ATOB_BUFFER = 0,
+  ATOB_STRING,
+  ATOB_DECODE,
+};
+
+enum {
+  BASE64_ENCODE = 0,
+  BASE64_DECODE,
+};
+
+/**
+ * btoa(data, url) returns a string, base64Encode(data, url) an
+ * ArrayBuffer without going through a JS string.
+ */
 static JSValue
-js_misc_btoa(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+js_misc_btoa(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
   JSValue ret;
   InputBuffer input = js_input_chars(ctx, argv[0]);
-  size_t enclen = b64_get_encoded_buffer_size(input.size);
-  uint8_t* encbuf = js_malloc(ctx, enclen);
+  BOOL url = argc > 1 && JS_ToBool(ctx, argv[1]);
+  size_t enclen = url ? b64url_get_encoded_buffer_size(input_buffer_length(&input)) : b64_get_encoded_buffer_size(input_buffer_length(&input));
+  uint8_t* encbuf;
 
-  b64_encode(input.data, input.size, encbuf);
+  if(!(encbuf = js_malloc(ctx, MAX_NUM(enclen, 1)))) {
+    input_buffer_free(&input, ctx);
+    return JS_EXCEPTION;
+  }
+
+  (url ? b64url_encode : b64_encode)(input_buffer_data(&input), input_buffer_length(&input), encbuf);
+  input_buffer_free(&input, ctx);
+
+  if(magic == BTOA_BUFFER)
+    return JS_NewArrayBuffer(ctx, encbuf, enclen, js_arraybuffer_free_pointer, 0, FALSE);
 
   ret = JS_NewStringLen(ctx, (const char*)encbuf, enclen);
   js_free(ctx, encbuf);
   return ret;
 }
 
+/**
+ * atob(str, toString, url), atos() which returns a string by default and
+ * base64Decode(str, url) which always returns an ArrayBuffer.
+ */
 static JSValue
 js_misc_atob(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
   JSValue ret;
   InputBuffer input = js_input_chars(ctx, argv[0]);
-  size_t declen = b64_get_decoded_buffer_size(input.size);
-  uint8_t* decbuf = js_malloc(ctx, declen);
-  BOOL output_string = magic > 0;
+  BOOL output_string = magic == ATOB_STRING, url;
+  size_t declen, len = input_buffer_length(&input);
+  uint8_t* decbuf;
 
-  if(argc > 1 && JS_ToBool(ctx, argv[1]))
+  if(magic != ATOB_DECODE && argc > 1 && JS_ToBool(ctx, argv[1]))
     output_string = TRUE;
 
-  b64_decode(input.data, input.size, decbuf);
+  url = magic == ATOB_DECODE ? argc > 1 && JS_ToBool(ctx, argv[1]) : argc > 2 && JS_ToBool(ctx, argv[2]);
+  declen = url ? b64url_get_decoded_buffer_size(len) : b64_get_decoded_buffer_size(len);
+
+  if(!(decbuf = js_malloc(ctx, MAX_NUM(declen, 1)))) {
+    input_buffer_free(&input, ctx);
+    return JS_EXCEPTION;
+  }
+
+  /* the size above counts padding characters as data */
+  declen = (url ? b64url_decode : b64_decode)(input_buffer_data(&input), len, decbuf);
+  input_buffer_free(&input, ctx);
 
-  ret = output_string ? JS_NewStringLen(ctx, (const char*)decbuf, declen) : JS_NewArrayBufferCopy(ctx, (const uint8_t*)decbuf, declen);
+  if(!output_string)
+    return JS_NewArrayBuffer(ctx, decbuf, declen, js_arraybuffer_free_pointer, 0, FALSE);
 
+  ret = JS_NewStringLen(ctx, (const char*)decbuf, declen);
   js_free(ctx, decbuf);
   return ret;
 }
 
+/**
+ * base64EncodeInto(src, dst, url, final) and base64DecodeInto() convert as
+ * much of src as fits into dst and return [read, written]. Unless final
+ * is true (the default), only whole groups are converted, so a stream of
+ * chunks can be processed by carrying the unread rest over to the next.
+ */
+static JSValue
+js_misc_base64_into(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  InputBuffer src = js_input_chars(ctx, argv[0]), dst = js_input_buffer(ctx, argv[1]);
+  BOOL url = argc > 2 && JS_ToBool(ctx, argv[2]), final = argc <= 3 || JS_ToBool(ctx, argv[3]);
+  size_t len = input_buffer_length(&src), cap = input_buffer_length(&dst), read = 0, written = 0;
+  const uint8_t* in = input_buffer_data(&src);
+  uint8_t* out = input_buffer_data(&dst);
+  JSValue ret = JS_EXCEPTION;
+
+  if(!input_buffer_valid(&dst)) {
+    JS_ThrowTypeError(ctx, "argument 2 (dst) must be an ArrayBuffer or typed array");
+    goto fail;
+  }
+
+  if(magic == BASE64_ENCODE) {
+    size_t enclen = url ? b64url_get_encoded_buffer_size(len) : b64_get_encoded_buffer_size(len);
+
+    if(final && enclen <= cap) {
+      read = len;
+      written = enclen;
+    } else {
+      size_t groups = MIN_NUM(len / 3, cap / 4);
+
+      read = groups * 3;
+      written = groups * 4;
+    }
+
+    (url ? b64url_encode : b64_encode)(in, read, out);
+  } else {
+    size_t limit = MIN_NUM(len, cap / 3 * 4);
+    ssize_t r = b64_decode_partial(in, limit, out, url, &read);
+
+    if(r == -1) {
+      JS_ThrowRangeError(ctx, "invalid base64 at offset %zu", read);
+      goto fail;
+    }
+
+    written = r;
+
+    /* the last group, possibly padded or (url) short */
+    if(final && limit == len && read < len) {
+      uint8_t tail[3];
+      size_t n = len - read <= 4 ? (url ? b64url_decode : b64_decode)(in + read, len - read, tail) : 0;
+
+      if(n == 0) {
+        JS_ThrowRangeError(ctx, "invalid base64 at offset %zu", read);
+        goto fail;
+      }
+
+      if(written + n <= cap) {
+        memcpy(out + written, tail, n);
+        written += n;
+        read = len;
+      }
+    }
+  }
+
+  ret = JS_NewArray(ctx);
+  JS_SetPropertyUint32(ctx, ret, 0, JS_NewInt64(ctx, read));
+  JS_SetPropertyUint32(ctx, ret, 1, JS_NewInt64(ctx, written));
+
+fail:
+  input_buffer_free(&src, ctx);
+  input_buffer_free(&dst, ctx);
+  return ret;
+}
+
 static JSValue
 js_misc_bcrypt(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
   JSValue ret;
@@ -1593,6 +1829,225 @@ js_misc_bcrypt(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst arg
   return ret;
 }
 
+#ifndef _WIN32
+enum {
+  BCRYPT_HASH = 0,
+  BCRYPT_COMPARE,
+};
+
+typedef struct bcrypt_job {
+  struct bcrypt_job* next;
+  JSContext* ctx;
+  int mode, cost, result, fds[2];
+  char* password;
+  char salt[BCRYPT_HASHSIZE], hash[BCRYPT_HASHSIZE];
+  Promise promise;
+} BcryptJob;
+
+/**
+ * Worker threads shared by every context of the process. They are started
+ * on demand, one per CPU at most, and wait for further jobs when idle.
+ */
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  BcryptJob *head, **tail;
+  uint32_t threads, idle;
+} bcrypt_pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, &bcrypt_pool.head, 0, 0};
+
+static void
+bcryptjob_free(void* ptr) {
+  BcryptJob* job = ptr;
+  JSContext* ctx = job->ctx;
+
+  if(job->password) {
+    volatile char* p = job->password;
+
+    while(*p)
+      *p++ = '\0';
+
+    js_free(ctx, job->password);
+  }
+
+  close(job->fds[0]);
+  close(job->fds[1]);
+  promise_free(JS_GetRuntime(ctx), &job->promise);
+  js_free(ctx, job);
+}
+
+static void*
+bcrypt_worker(void* arg) {
+  for(;;) {
+    BcryptJob* job;
+
+    pthread_mutex_lock(&bcrypt_pool.lock);
+
+    while(!bcrypt_pool.head) {
+      bcrypt_pool.idle++;
+      pthread_cond_wait(&bcrypt_pool.cond, &bcrypt_pool.lock);
+      bcrypt_pool.idle--;
+    }
+
+    job = bcrypt_pool.head;
+
+    if(!(bcrypt_pool.head = job->next))
+      bcrypt_pool.tail = &bcrypt_pool.head;
+
+    pthread_mutex_unlock(&bcrypt_pool.lock);
+
+    if(job->mode == BCRYPT_COMPARE) {
+      job->result = bcrypt_checkpw(job->password, job->hash);
+    } else {
+      job->result = job->cost ? bcrypt_gensalt(job->cost, job->salt) : 0;
+
+      if(job->result == 0)
+        job->result = bcrypt_hashpw(job->password, job->salt, job->hash);
+    }
+
+    /* the job belongs to the JS thread again after this */
+    while(write(job->fds[1], "", 1) == -1 && errno == EINTR) {}
+  }
+
+  return 0;
+}
+
+/**
+ * @return  FALSE if there is no thread to run the job
+ */
+static BOOL
+bcrypt_submit(BcryptJob* job) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  BOOL ok = TRUE;
+
+  pthread_mutex_lock(&bcrypt_pool.lock);
+
+  if(bcrypt_pool.idle == 0 && bcrypt_pool.threads < (uint32_t)MAX_NUM(cpus, 1)) {
+    pthread_t thread;
+
+    if(!pthread_create(&thread, 0, bcrypt_worker, 0)) {
+      pthread_detach(thread);
+      bcrypt_pool.threads++;
+    }
+  }
+
+  if((ok = bcrypt_pool.threads > 0)) {
+    job->next = 0;
+    *bcrypt_pool.tail = job;
+    bcrypt_pool.tail = &job->next;
+    pthread_cond_signal(&bcrypt_pool.cond);
+  }
+
+  pthread_mutex_unlock(&bcrypt_pool.lock);
+  return ok;
+}
+
+static JSValue
+js_bcryptjob_event(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  BcryptJob* job = ptr;
+  JSValue set_handler;
+  char c;
+
+  if(read(job->fds[0], &c, 1) != 1)
+    return JS_UNDEFINED;
+
+  if(job->result < 0) {
+    JSValue error = JS_NewError(ctx);
+
+    JS_SetPropertyStr(ctx, error, "message", JS_NewString(ctx, job->mode == BCRYPT_COMPARE ? "bcrypt_checkpw() failed" : "bcrypt_hashpw() failed"));
+    promise_reject(ctx, &job->promise.funcs, error);
+    JS_FreeValue(ctx, error);
+  } else {
+    JSValue value = job->mode == BCRYPT_COMPARE ? JS_NewBool(ctx, job->result == 0) : JS_NewString(ctx, job->hash);
+
+    promise_resolve(ctx, &job->promise.funcs, value);
+    JS_FreeValue(ctx, value);
+  }
+
+  /* drops the handler's reference, job is gone after this */
+  set_handler = js_iohandler_fn(ctx, FALSE);
+  js_iohandler_set(ctx, set_handler, job->fds[0], JS_NULL);
+  JS_FreeValue(ctx, set_handler);
+  return JS_UNDEFINED;
+}
+#endif
+
+/**
+ * bcryptAsync(password, salt|cost) and bcryptCompareAsync(password, hash)
+ * hash on the worker pool instead of the JS thread. They resolve with the
+ * hash string and with whether the password matches respectively.
+ */
+static JSValue
+js_misc_bcrypt_async(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+#ifdef _WIN32
+  return JS_ThrowInternalError(ctx, "bcrypt%sAsync() needs POSIX threads", magic ? "Compare" : "");
+#else
+  BcryptJob* job;
+  InputBuffer input;
+  JSValue set_handler, ret;
+
+  if(!(job = js_mallocz(ctx, sizeof(BcryptJob))))
+    return JS_EXCEPTION;
+
+  job->ctx = ctx;
+  job->mode = magic;
+  job->cost = 12;
+  job->fds[0] = job->fds[1] = -1;
+  promise_zero(&job->promise);
+
+  input = js_input_chars(ctx, argv[0]);
+  job->password = js_strndup(ctx, (const char*)input_buffer_data(&input), input_buffer_length(&input));
+  input_buffer_free(&input, ctx);
+
+  if(!job->password) {
+    bcryptjob_free(job);
+    return JS_EXCEPTION;
+  }
+
+  if(magic == BCRYPT_COMPARE || (argc > 1 && JS_IsString(argv[1]))) {
+    input = js_input_chars(ctx, argc > 1 ? argv[1] : JS_UNDEFINED);
+
+    if(input_buffer_length(&input) == 0 || input_buffer_length(&input) >= BCRYPT_HASHSIZE) {
+      input_buffer_free(&input, ctx);
+      bcryptjob_free(job);
+      return JS_ThrowRangeError(ctx, "argument 2 must be a %s shorter than %d bytes", magic == BCRYPT_COMPARE ? "hash" : "salt", BCRYPT_HASHSIZE);
+    }
+
+    memcpy(magic == BCRYPT_COMPARE ? job->hash : job->salt, input_buffer_data(&input), input_buffer_length(&input));
+    input_buffer_free(&input, ctx);
+    job->cost = 0;
+  } else if(argc > 1 && !JS_IsUndefined(argv[1])) {
+    JS_ToInt32(ctx, &job->cost, argv[1]);
+    job->cost = MIN_NUM(MAX_NUM(job->cost, 4), 31);
+  }
+
+  if(pipe(job->fds) == -1) {
+    bcryptjob_free(job);
+    return JS_ThrowInternalError(ctx, "pipe() failed: %s", strerror(errno));
+  }
+
+  fcntl(job->fds[0], F_SETFL, fcntl(job->fds[0], F_GETFL) | O_NONBLOCK);
+
+  if(!promise_init(ctx, &job->promise)) {
+    bcryptjob_free(job);
+    return JS_EXCEPTION;
+  }
+
+  ret = JS_DupValue(ctx, job->promise.value);
+
+  if(!bcrypt_submit(job)) {
+    bcryptjob_free(job);
+    JS_FreeValue(ctx, ret);
+    return JS_ThrowInternalError(ctx, "pthread_create() failed");
+  }
+
+  set_handler = js_iohandler_fn(ctx, FALSE);
+  js_iohandler_set(ctx, set_handler, job->fds[0], js_function_cclosure(ctx, js_bcryptjob_event, 0, 0, job, bcryptjob_free));
+  JS_FreeValue(ctx, set_handler);
+
+  return ret;
+#endif
+}
+
 static JSValue
 js_misc_compile(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
   JSValue ret = JS_UNDEFINED;
@@ -3214,6 +3669,7 @@ static const JSCFunctionListEntry js_misc_funcs[] = {
     // JS_CFUNC_DEF("resizeArrayBuffer", 1, js_misc_resizearraybuffer),
     JS_CFUNC_DEF("concat", 1, js_misc_concat),
     JS_CFUNC_DEF("searchArrayBuffer", 2, js_misc_searcharraybuffer),
+    JS_CFUNC_DEF("searchAll", 2, js_misc_searchall),
     // JS_ALIAS_DEF("search", "searchArrayBuffer"),
     JS_CFUNC_DEF("memcpy", 2, js_misc_memcpy),
     JS_CFUNC_DEF("memcmp", 2, js_misc_memcmp),
@@ -3221,6 +3677,7 @@ static const JSCFunctionListEntry js_misc_funcs[] = {
     JS_CFUNC_DEF("fmemopen", 2, js_misc_fmemopen),
 #endif
     JS_CFUNC_DEF("getPerformanceCounter", 0, js_misc_getperformancecounter),
+    JS_CFUNC_DEF("getMemoryUsage", 0, js_misc_getmemoryusage),
     JS_CFUNC_MAGIC_DEF("getExecutable", 0, js_misc_proclink, FUNC_GETEXECUTABLE),
     JS_CFUNC_MAGIC_DEF("getCurrentWorkingDirectory", 0, js_misc_proclink, FUNC_GETCWD),
     JS_CFUNC_MAGIC_DEF("getRootDirectory", 0, js_misc_proclink, FUNC_GETROOT),
@@ -3266,11 +3723,17 @@ static const JSCFunctionListEntry js_misc_funcs[] = {
     JS_CFUNC_MAGIC_DEF("setConsoleMode", 2, js_misc_consolemode, SET_CONSOLE_MODE),
     JS_CFUNC_MAGIC_DEF("getConsoleMode", 1, js_misc_consolemode, GET_CONSOLE_MODE),
 #endif
-    JS_CFUNC_DEF("btoa", 1, js_misc_btoa),
-    JS_CFUNC_DEF("stoa", 1, js_misc_btoa),
-    JS_CFUNC_MAGIC_DEF("atob", 1, js_misc_atob, 0),
-    JS_CFUNC_MAGIC_DEF("atos", 1, js_misc_atob, 1),
+    JS_CFUNC_MAGIC_DEF("btoa", 1, js_misc_btoa, BTOA_STRING),
+    JS_CFUNC_MAGIC_DEF("stoa", 1, js_misc_btoa, BTOA_STRING),
+    JS_CFUNC_MAGIC_DEF("base64Encode", 1, js_misc_btoa, BTOA_BUFFER),
+    JS_CFUNC_MAGIC_DEF("atob", 1, js_misc_atob, ATOB_BUFFER),
+    JS_CFUNC_MAGIC_DEF("atos", 1, js_misc_atob, ATOB_STRING),
+    JS_CFUNC_MAGIC_DEF("base64Decode", 1, js_misc_atob, ATOB_DECODE),
+    JS_CFUNC_MAGIC_DEF("base64EncodeInto", 2, js_misc_base64_into, BASE64_ENCODE),
+    JS_CFUNC_MAGIC_DEF("base64DecodeInto", 2, js_misc_base64_into, BASE64_DECODE),
     JS_CFUNC_MAGIC_DEF("bcrypt", 1, js_misc_bcrypt, 1),
+    JS_CFUNC_MAGIC_DEF("bcryptAsync", 2, js_misc_bcrypt_async, BCRYPT_HASH),
+    JS_CFUNC_MAGIC_DEF("bcryptCompareAsync", 2, js_misc_bcrypt_async, BCRYPT_COMPARE),
     JS_CFUNC_MAGIC_DEF("not", 1, js_misc_bitop, BITOP_NOT),
     JS_CFUNC_MAGIC_DEF("xor", 2, js_misc_bitop, BITOP_XOR),
     JS_CFUNC_MAGIC_DEF("and", 2, js_misc_bitop, BITOP_AND),
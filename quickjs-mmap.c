@@ -1,18 +1,32 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 #include "defines.h"
 #include <cutils.h>
 #include <quickjs.h>
 #include "utils.h"
+#include "buffer-utils.h"
+#include "line-index.h"
 #ifdef _WIN32
 #include "mmap-win32.h"
 #else
 #include <sys/mman.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 /**
  * \defgroup quickjs-mmap quickjs-mmap: Memory mapped I/O
  * @{
  */
+static JSClassID js_line_index_class_id = 0, js_mapped_file_class_id = 0;
+static JSValue line_index_ctor = {{0}, JS_TAG_UNDEFINED}, mapped_file_ctor = {{0}, JS_TAG_UNDEFINED};
+
 static void
 js_mmap_free_func(JSRuntime* rt, void* opaque, void* ptr) {
   munmap(ptr, (size_t)opaque);
@@ -108,6 +122,176 @@ js_mmap_mprotect(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst a
   return JS_NewInt32(ctx, mprotect(data + offset, MIN_NUM(length, (int64_t)len), flags));
 }
 
+#ifndef _WIN32
+/**
+ * Parses (buffer, offset = 0, length = rest) into a page-aligned range of
+ * the mapping. Returns -1 after throwing.
+ */
+static int
+js_mmap_range(JSContext* ctx, int argc, JSValueConst argv[], uint8_t** pptr, size_t* plen) {
+  uint64_t offset = 0, length;
+  uintptr_t page = sysconf(_SC_PAGESIZE), start;
+  uint8_t* data;
+  size_t len;
+
+  if(!(data = JS_GetArrayBuffer(ctx, &len, argv[0]))) {
+    JS_ThrowTypeError(ctx, "argument 1 must be an ArrayBuffer");
+    return -1;
+  }
+
+  if(argc > 1 && !js_is_null_or_undefined(argv[1]) && JS_ToIndex(ctx, &offset, argv[1]))
+    return -1;
+
+  if(offset > len) {
+    JS_ThrowRangeError(ctx, "offset %" PRIu64 " beyond the mapping's %zu bytes", offset, len);
+    return -1;
+  }
+
+  length = len - offset;
+
+  if(argc > 2 && !js_is_null_or_undefined(argv[2])) {
+    if(JS_ToIndex(ctx, &length, argv[2]))
+      return -1;
+
+    length = MIN_NUM(length, len - offset);
+  }
+
+  /* the kernel wants page boundaries, so widen to the pages touched */
+  start = ((uintptr_t)data + offset) & ~(page - 1);
+  *pptr = (uint8_t*)start;
+  *plen = (uintptr_t)data + offset + length - start;
+  return 0;
+}
+
+/**
+ * madvise(buffer, offset, length, advice): hints how the range will be
+ * accessed, e.g. MADV_RANDOM for index lookups, MADV_SEQUENTIAL then
+ * MADV_DONTNEED for scans.
+ */
+static JSValue
+js_mmap_madvise(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  uint8_t* ptr;
+  size_t len;
+  int32_t advice = MADV_NORMAL;
+
+  if(js_mmap_range(ctx, argc, argv, &ptr, &len))
+    return JS_EXCEPTION;
+
+  if(argc > 3 && JS_ToInt32(ctx, &advice, argv[3]))
+    return JS_EXCEPTION;
+
+  return JS_NewInt32(ctx, madvise(ptr, len, advice));
+}
+
+enum {
+  MMAP_MLOCK = 0,
+  MMAP_MUNLOCK,
+};
+
+static JSValue
+js_mmap_mlock(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  uint8_t* ptr;
+  size_t len;
+
+  if(js_mmap_range(ctx, argc, argv, &ptr, &len))
+    return JS_EXCEPTION;
+
+  return JS_NewInt32(ctx, magic == MMAP_MLOCK ? mlock(ptr, len) : munlock(ptr, len));
+}
+
+/**
+ * mincore(buffer, offset, length): Uint8Array with one byte per page of
+ * the range, bit 0 set when the page is resident.
+ */
+static JSValue
+js_mmap_mincore(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  uint8_t* ptr;
+  size_t len, page = sysconf(_SC_PAGESIZE), n;
+  JSValue buf, ret;
+
+  if(js_mmap_range(ctx, argc, argv, &ptr, &len))
+    return JS_EXCEPTION;
+
+  n = (len + page - 1) / page;
+  buf = JS_NewArrayBufferCopy(ctx, 0, n);
+
+  if(JS_IsException(buf))
+    return buf;
+
+  if(mincore(ptr, len, (void*)JS_GetArrayBuffer(ctx, &n, buf)) == -1) {
+    JS_FreeValue(ctx, buf);
+    return JS_ThrowInternalError(ctx, "mincore() failed: %s", strerror(errno));
+  }
+
+  ret = js_typedarray_new(ctx, 8, FALSE, FALSE, buf);
+  JS_FreeValue(ctx, buf);
+  return ret;
+}
+
+/**
+ * fadvise(fd, offset, length, advice): posix_fadvise() on the file behind
+ * a mapping, length 0 meaning up to the end.
+ */
+static JSValue
+js_mmap_fadvise(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+#ifdef POSIX_FADV_NORMAL
+  int32_t fd, advice = POSIX_FADV_NORMAL;
+  int64_t offset = 0, length = 0;
+  int err;
+
+  if(JS_ToInt32(ctx, &fd, argv[0]))
+    return JS_EXCEPTION;
+
+  if(argc > 1 && JS_ToInt64(ctx, &offset, argv[1]))
+    return JS_EXCEPTION;
+
+  if(argc > 2 && JS_ToInt64(ctx, &length, argv[2]))
+    return JS_EXCEPTION;
+
+  if(argc > 3 && JS_ToInt32(ctx, &advice, argv[3]))
+    return JS_EXCEPTION;
+
+  /* reports the error itself instead of setting errno */
+  if((err = posix_fadvise(fd, offset, length, advice))) {
+    errno = err;
+    return JS_NewInt32(ctx, -1);
+  }
+
+  return JS_NewInt32(ctx, 0);
+#else
+  return JS_ThrowInternalError(ctx, "posix_fadvise() not available");
+#endif
+}
+
+/**
+ * readahead(fd, offset, count): starts reading the range into the page
+ * cache without waiting for it.
+ */
+static JSValue
+js_mmap_readahead(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  int32_t fd;
+  int64_t offset = 0;
+  uint64_t count = 0;
+
+  if(JS_ToInt32(ctx, &fd, argv[0]))
+    return JS_EXCEPTION;
+
+  if(argc > 1 && JS_ToInt64(ctx, &offset, argv[1]))
+    return JS_EXCEPTION;
+
+  if(argc > 2 && JS_ToIndex(ctx, &count, argv[2]))
+    return JS_EXCEPTION;
+
+#ifdef __linux__
+  return JS_NewInt32(ctx, readahead(fd, offset, count) == -1 ? -1 : 0);
+#elif defined(POSIX_FADV_WILLNEED)
+  return JS_NewInt32(ctx, posix_fadvise(fd, offset, count, POSIX_FADV_WILLNEED) ? -1 : 0);
+#else
+  return JS_ThrowInternalError(ctx, "readahead() not available");
+#endif
+}
+#endif
+
 static JSValue
 js_mmap_filename(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
   uint8_t* data;
@@ -151,11 +335,817 @@ js_mmap_tostring(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst a
   return ret;
 }
 
+enum {
+  LINE_INDEX_LINE = 0,
+  LINE_INDEX_BYTES,
+  LINE_INDEX_RANGE,
+  LINE_INDEX_FIND,
+  LINE_INDEX_FIELDS,
+  LINE_INDEX_FIELD,
+};
+
+enum {
+  LINE_INDEX_LENGTH = 0,
+  LINE_INDEX_OFFSETS,
+};
+
+/* starts[i] is where record i begins; the buffer is looked up on each use
+ * so an munmap() in between is caught */
+typedef struct {
+  JSValue buffer;
+  size_t size;
+  uint64_t* starts;
+  size_t count;
+  BOOL trailing;
+  int sep, quote, delimiter;
+} LineIndex;
+
+typedef struct {
+  const uint8_t* data;
+  size_t start, end, quotes;
+  int sep, quote;
+  BOOL inquote, count;
+  ssize_t found;
+  DynBuf out;
+} LineChunk;
+
+static void*
+line_chunk_run(void* ptr) {
+  LineChunk* c = ptr;
+
+  if(c->count)
+    c->quotes = line_index_count(c->data + c->start, c->end - c->start, c->quote);
+  else
+    c->found = line_index_scan(c->data + c->start, c->end - c->start, c->sep, c->quote, &c->inquote, c->start, &c->out);
+
+  return 0;
+}
+
+/* runs every chunk, on threads when there are several */
+static void
+line_chunks_run(LineChunk* chunks, int n) {
+#ifndef _WIN32
+  pthread_t threads[n];
+  int started = 0;
+
+  for(int i = 1; i < n; i++, started++)
+    if(pthread_create(&threads[i], 0, line_chunk_run, &chunks[i]))
+      break;
+
+  line_chunk_run(&chunks[0]);
+
+  for(int i = 1; i <= started; i++)
+    pthread_join(threads[i], 0);
+
+  for(int i = started + 1; i < n; i++)
+    line_chunk_run(&chunks[i]);
+#else
+  for(int i = 0; i < n; i++)
+    line_chunk_run(&chunks[i]);
+#endif
+}
+
+static BOOL
+line_index_build(JSContext* ctx, LineIndex* li, const uint8_t* data, int threads) {
+  LineChunk* chunks;
+  size_t total = 0, pos = 1;
+  BOOL inquote = FALSE, ok = TRUE;
+
+  if(!(chunks = js_mallocz(ctx, sizeof(LineChunk) * threads)))
+    return FALSE;
+
+  for(int i = 0; i < threads; i++) {
+    chunks[i].data = data;
+    chunks[i].start = li->size / threads * i;
+    chunks[i].end = i + 1 < threads ? li->size / threads * (i + 1) : li->size;
+    chunks[i].sep = li->sep;
+    chunks[i].quote = li->quote;
+    chunks[i].count = li->quote >= 0;
+    dbuf_init(&chunks[i].out);
+  }
+
+  /* the quote parity at each chunk start decides what its separators mean */
+  if(li->quote >= 0) {
+    line_chunks_run(chunks, threads);
+
+    for(int i = 0; i < threads; i++) {
+      chunks[i].inquote = inquote;
+      chunks[i].count = FALSE;
+      inquote ^= chunks[i].quotes & 1;
+    }
+  }
+
+  line_chunks_run(chunks, threads);
+
+  for(int i = 0; i < threads; i++) {
+    if(chunks[i].found < 0)
+      ok = FALSE;
+
+    total += MAX_NUM(chunks[i].found, 0);
+  }
+
+  if(ok && (li->starts = js_malloc(ctx, sizeof(uint64_t) * (total + 1)))) {
+    li->starts[0] = 0;
+
+    for(int i = 0; i < threads; i++) {
+      if(chunks[i].out.size)
+        memcpy(&li->starts[pos], chunks[i].out.buf, chunks[i].out.size);
+
+      pos += chunks[i].out.size / sizeof(uint64_t);
+    }
+
+    /* a separator at the very end does not start another record */
+    if((li->trailing = total > 0 && li->starts[total] == li->size))
+      total--;
+
+    li->count = li->size ? total + 1 : 0;
+  } else {
+    ok = FALSE;
+  }
+
+  for(int i = 0; i < threads; i++)
+    dbuf_free(&chunks[i].out);
+
+  js_free(ctx, chunks);
+  return ok;
+}
+
+static inline LineIndex*
+js_line_index_data2(JSContext* ctx, JSValueConst value) {
+  return JS_GetOpaque2(ctx, value, js_line_index_class_id);
+}
+
+static const uint8_t*
+js_line_index_buffer(JSContext* ctx, LineIndex* li) {
+  uint8_t* data;
+  size_t len;
+
+  if(!(data = JS_GetArrayBuffer(ctx, &len, li->buffer)) || len != li->size) {
+    JS_ThrowInternalError(ctx, "LineIndex buffer has been unmapped");
+    return 0;
+  }
+
+  return data;
+}
+
+/* record i without its separator, and without a '\r' before a '\n' */
+static void
+line_index_range(LineIndex* li, const uint8_t* data, size_t i, size_t* pstart, size_t* pend) {
+  size_t start = li->starts[i];
+  size_t end = i + 1 < li->count ? li->starts[i + 1] - 1 : li->size - li->trailing;
+
+  if(li->sep == '\n' && end > start && data[end - 1] == '\r')
+    end--;
+
+  *pstart = start;
+  *pend = end;
+}
+
+/* the field starting at *ppos, unquoted; *ppos ends up on the delimiter */
+static JSValue
+line_index_field(JSContext* ctx, LineIndex* li, const uint8_t* data, size_t* ppos, size_t end) {
+  size_t pos = *ppos, start;
+  JSValue ret;
+
+  if(li->quote >= 0 && pos < end && data[pos] == li->quote) {
+    DynBuf buf;
+
+    js_dbuf_init(ctx, &buf);
+
+    /* "" inside quotes is one quote; an unterminated field runs to the end */
+    for(start = ++pos; pos < end; pos++) {
+      if(data[pos] != li->quote)
+        continue;
+
+      dbuf_put(&buf, data + start, pos - start);
+
+      if(pos + 1 < end && data[pos + 1] == li->quote) {
+        start = ++pos;
+        continue;
+      }
+
+      start = ++pos;
+      break;
+    }
+
+    if(start < pos)
+      dbuf_put(&buf, data + start, pos - start);
+
+    while(pos < end && data[pos] != li->delimiter)
+      pos++;
+
+    ret = JS_NewStringLen(ctx, (const char*)buf.buf, buf.size);
+    dbuf_free(&buf);
+  } else {
+    for(start = pos; pos < end && data[pos] != li->delimiter; pos++) {}
+
+    ret = JS_NewStringLen(ctx, (const char*)data + start, pos - start);
+  }
+
+  *ppos = pos;
+  return ret;
+}
+
+static JSValue
+js_line_index_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  LineIndex* li;
+  const uint8_t* data;
+  size_t start, end;
+  int64_t i;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(li = js_line_index_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(!(data = js_line_index_buffer(ctx, li)))
+    return JS_EXCEPTION;
+
+  if(JS_ToInt64(ctx, &i, argv[0]))
+    return JS_EXCEPTION;
+
+  if(magic == LINE_INDEX_FIND) {
+    size_t lo = 0, hi = li->count;
+
+    if(i < 0 || (uint64_t)i >= li->size)
+      return JS_NewInt32(ctx, -1);
+
+    /* last record starting at or before the offset */
+    while(lo < hi) {
+      size_t mid = (lo + hi) / 2;
+
+      if(li->starts[mid] <= (uint64_t)i)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+    return JS_NewInt64(ctx, lo - 1);
+  }
+
+  /* negative indices count from the end, like Array.prototype.at() */
+  if(i < 0)
+    i += li->count;
+
+  if(i < 0 || (uint64_t)i >= li->count)
+    return JS_UNDEFINED;
+
+  line_index_range(li, data, i, &start, &end);
+
+  switch(magic) {
+    case LINE_INDEX_LINE: {
+      ret = JS_NewStringLen(ctx, (const char*)data + start, end - start);
+      break;
+    }
+
+    case LINE_INDEX_BYTES: {
+      JSValue args[] = {li->buffer, JS_NewInt64(ctx, start), JS_NewInt64(ctx, end - start)};
+
+      ret = js_global_new(ctx, "Uint8Array", countof(args), args);
+      break;
+    }
+
+    case LINE_INDEX_RANGE: {
+      ret = JS_NewArray(ctx);
+      JS_SetPropertyUint32(ctx, ret, 0, JS_NewInt64(ctx, start));
+      JS_SetPropertyUint32(ctx, ret, 1, JS_NewInt64(ctx, end));
+      break;
+    }
+
+    case LINE_INDEX_FIELDS: {
+      uint32_t n = 0;
+
+      ret = JS_NewArray(ctx);
+
+      for(;;) {
+        JS_SetPropertyUint32(ctx, ret, n++, line_index_field(ctx, li, data, &start, end));
+
+        if(start++ >= end)
+          break;
+      }
+
+      break;
+    }
+
+    case LINE_INDEX_FIELD: {
+      int32_t j = 0;
+
+      if(argc > 1 && JS_ToInt32(ctx, &j, argv[1]))
+        return JS_EXCEPTION;
+
+      /* skips to field j without creating the ones before it */
+      while(j > 0) {
+        JS_FreeValue(ctx, line_index_field(ctx, li, data, &start, end));
+
+        if(start++ >= end)
+          return JS_UNDEFINED;
+
+        j--;
+      }
+
+      ret = j == 0 ? line_index_field(ctx, li, data, &start, end) : JS_UNDEFINED;
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static JSValue
+js_line_index_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  LineIndex* li;
+
+  if(!(li = js_line_index_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case LINE_INDEX_LENGTH: return JS_NewInt64(ctx, li->count);
+    case LINE_INDEX_OFFSETS: {
+      JSValue buf, ret;
+      double* offsets;
+
+      if(!(offsets = js_malloc(ctx, sizeof(double) * (li->count + 1))))
+        return JS_EXCEPTION;
+
+      for(size_t i = 0; i < li->count; i++)
+        offsets[i] = li->starts[i];
+
+      offsets[li->count] = li->size;
+
+      buf = JS_NewArrayBufferCopy(ctx, (const uint8_t*)offsets, sizeof(double) * (li->count + 1));
+      js_free(ctx, offsets);
+      ret = js_typedarray_new(ctx, 64, TRUE, TRUE, buf);
+      JS_FreeValue(ctx, buf);
+      return ret;
+    }
+  }
+
+  return JS_UNDEFINED;
+}
+
+static int
+js_line_index_char(JSContext* ctx, JSValueConst options, const char* prop, int def) {
+  JSValue value = JS_GetPropertyStr(ctx, options, prop);
+  int ret = def;
+
+  if(JS_IsString(value)) {
+    const char* str = JS_ToCString(ctx, value);
+
+    ret = str && str[0] ? (uint8_t)str[0] : -1;
+    JS_FreeCString(ctx, str);
+  } else if(JS_IsNull(value)) {
+    ret = -1;
+  }
+
+  JS_FreeValue(ctx, value);
+  return ret;
+}
+
+/**
+ * new LineIndex(buffer, { threads, separator = '\n', delimiter = ',',
+ * quote }): indexes the records of a mapped ArrayBuffer. Only the offsets
+ * are kept; line(i) and fields(i) create strings on demand and bytes(i)
+ * is a view into the mapping. With quote, separators and delimiters
+ * between quotes are part of the field.
+ */
+static JSValue
+js_line_index_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  LineIndex* li;
+  const uint8_t* data;
+  JSValue proto, obj;
+  int32_t threads = 0;
+  long cpus = 1;
+
+  if(!(li = js_mallocz(ctx, sizeof(LineIndex))))
+    return JS_EXCEPTION;
+
+  li->sep = '\n';
+  li->delimiter = ',';
+  li->quote = -1;
+
+  if(!(data = JS_GetArrayBuffer(ctx, &li->size, argv[0]))) {
+    js_free(ctx, li);
+    return JS_ThrowTypeError(ctx, "argument 1 must be an ArrayBuffer");
+  }
+
+  if(argc > 1 && JS_IsObject(argv[1])) {
+    if(js_has_propertystr(ctx, argv[1], "threads"))
+      threads = js_get_propertystr_int32(ctx, argv[1], "threads");
+
+    li->sep = js_line_index_char(ctx, argv[1], "separator", li->sep);
+    li->delimiter = js_line_index_char(ctx, argv[1], "delimiter", li->delimiter);
+    li->quote = js_line_index_char(ctx, argv[1], "quote", li->quote);
+  }
+
+  if(li->sep < 0) {
+    js_free(ctx, li);
+    return JS_ThrowRangeError(ctx, "separator must not be empty");
+  }
+
+#ifndef _WIN32
+  cpus = MAX_NUM(sysconf(_SC_NPROCESSORS_ONLN), 1);
+#endif
+
+  /* below about 1MB per thread, starting threads costs more than it saves */
+  if(threads <= 0)
+    threads = MIN_NUM(cpus, (long)(li->size >> 20) + 1);
+
+  threads = MAX_NUM(MIN_NUM(threads, 64), 1);
+
+  if(!line_index_build(ctx, li, data, threads)) {
+    js_free(ctx, li);
+    return JS_ThrowOutOfMemory(ctx);
+  }
+
+  li->buffer = JS_DupValue(ctx, argv[0]);
+
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  obj = JS_NewObjectProtoClass(ctx, proto, js_line_index_class_id);
+  JS_FreeValue(ctx, proto);
+
+  if(JS_IsException(obj)) {
+    JS_FreeValue(ctx, li->buffer);
+    js_free(ctx, li->starts);
+    js_free(ctx, li);
+    return obj;
+  }
+
+  JS_SetOpaque(obj, li);
+  return obj;
+}
+
+static void
+js_line_index_finalizer(JSRuntime* rt, JSValue val) {
+  LineIndex* li;
+
+  if((li = JS_GetOpaque(val, js_line_index_class_id))) {
+    JS_FreeValueRT(rt, li->buffer);
+    js_free_rt(rt, li->starts);
+    js_free_rt(rt, li);
+  }
+}
+
+static void
+js_line_index_mark(JSRuntime* rt, JSValueConst val, JS_MarkFunc* mark_func) {
+  LineIndex* li;
+
+  if((li = JS_GetOpaque(val, js_line_index_class_id)))
+    JS_MarkValue(rt, li->buffer, mark_func);
+}
+
+static JSClassDef js_line_index_class = {
+    .class_name = "LineIndex",
+    .finalizer = js_line_index_finalizer,
+    .gc_mark = js_line_index_mark,
+};
+
+static const JSCFunctionListEntry js_line_index_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("line", 1, js_line_index_method, LINE_INDEX_LINE),
+    JS_CFUNC_MAGIC_DEF("bytes", 1, js_line_index_method, LINE_INDEX_BYTES),
+    JS_CFUNC_MAGIC_DEF("range", 1, js_line_index_method, LINE_INDEX_RANGE),
+    JS_CFUNC_MAGIC_DEF("find", 1, js_line_index_method, LINE_INDEX_FIND),
+    JS_CFUNC_MAGIC_DEF("fields", 1, js_line_index_method, LINE_INDEX_FIELDS),
+    JS_CFUNC_MAGIC_DEF("field", 2, js_line_index_method, LINE_INDEX_FIELD),
+    JS_CGETSET_MAGIC_DEF("length", js_line_index_get, NULL, LINE_INDEX_LENGTH),
+    JS_CGETSET_MAGIC_DEF("offsets", js_line_index_get, NULL, LINE_INDEX_OFFSETS),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "LineIndex", JS_PROP_CONFIGURABLE),
+};
+
+#ifndef _WIN32
+enum {
+  MAPPED_FILE_GROW = 0,
+  MAPPED_FILE_FLUSH,
+  MAPPED_FILE_CLOSE,
+};
+
+enum {
+  MAPPED_FILE_BUFFER = 0,
+  MAPPED_FILE_SIZE,
+  MAPPED_FILE_FD,
+  MAPPED_FILE_FILENAME,
+};
+
+/* one MAP_SHARED mapping of fd, referenced by the MappedFile and by the
+ * ArrayBuffer over it, so the buffer stays valid after close() */
+typedef struct {
+  int ref_count, fd, prot;
+  uint8_t* ptr;
+  size_t size;
+  char* filename;
+} MappedRegion;
+
+typedef struct {
+  MappedRegion* region;
+  JSValue buffer;
+} MappedFile;
+
+static void
+mapped_region_free(JSRuntime* rt, MappedRegion* r) {
+  if(--r->ref_count == 0) {
+    if(r->ptr)
+      munmap(r->ptr, r->size);
+
+    if(r->fd != -1)
+      close(r->fd);
+
+    js_free_rt(rt, r->filename);
+    js_free_rt(rt, r);
+  }
+}
+
+/* a detached buffer is finalized with NULL, its reference is already gone */
+static void
+js_mapped_free_func(JSRuntime* rt, void* opaque, void* ptr) {
+  if(ptr)
+    mapped_region_free(rt, opaque);
+}
+
+static JSValue
+mapped_region_buffer(JSContext* ctx, MappedRegion* r) {
+  if(!r->ptr)
+    return JS_NewArrayBufferCopy(ctx, 0, 0);
+
+  r->ref_count++;
+  return JS_NewArrayBuffer(ctx, r->ptr, r->size, js_mapped_free_func, r, FALSE);
+}
+
+/* moves the mapping to size bytes; on failure the old one stays */
+static BOOL
+mapped_region_resize(MappedRegion* r, size_t size) {
+  void* ptr = MAP_FAILED;
+
+  if(r->ptr && size) {
+#ifdef MREMAP_MAYMOVE
+    ptr = mremap(r->ptr, r->size, size, MREMAP_MAYMOVE);
+#endif
+  }
+
+  /* without mremap(), or for the first pages: a new mapping elsewhere */
+  if(ptr == MAP_FAILED && size) {
+    if((ptr = mmap(0, size, r->prot, MAP_SHARED, r->fd, 0)) == MAP_FAILED)
+      return FALSE;
+
+    if(r->ptr)
+      munmap(r->ptr, r->size);
+  }
+
+  r->ptr = size ? ptr : 0;
+  r->size = size;
+  return TRUE;
+}
+
+static inline MappedFile*
+js_mapped_file_data2(JSContext* ctx, JSValueConst value) {
+  return JS_GetOpaque2(ctx, value, js_mapped_file_class_id);
+}
+
+static JSValue
+js_mapped_file_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  MappedFile* mf;
+  MappedRegion* r;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(mf = js_mapped_file_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(!(r = mf->region))
+    return magic == MAPPED_FILE_CLOSE ? JS_UNDEFINED : JS_ThrowInternalError(ctx, "MappedFile is closed");
+
+  switch(magic) {
+    case MAPPED_FILE_GROW: {
+      uint64_t size;
+      BOOL ok;
+
+      if(JS_ToIndex(ctx, &size, argv[0]))
+        return JS_EXCEPTION;
+
+      if(size < r->size)
+        return JS_ThrowRangeError(ctx, "grow(%" PRIu64 ") is smaller than %zu bytes", size, r->size);
+
+      if(size == r->size)
+        return JS_DupValue(ctx, mf->buffer);
+
+      if(ftruncate(r->fd, size) == -1)
+        return JS_ThrowInternalError(ctx, "ftruncate() failed: %s", strerror(errno));
+
+      /* the old buffer must not see the mapping move */
+      JS_DetachArrayBuffer(ctx, mf->buffer);
+      JS_FreeValue(ctx, mf->buffer);
+
+      ok = mapped_region_resize(r, size);
+      mf->buffer = mapped_region_buffer(ctx, r);
+
+      if(!ok)
+        return JS_ThrowInternalError(ctx, "mremap() failed: %s", strerror(errno));
+
+      ret = JS_DupValue(ctx, mf->buffer);
+      break;
+    }
+
+    case MAPPED_FILE_FLUSH: {
+      uint64_t offset = 0, length = r->size;
+      uintptr_t page = sysconf(_SC_PAGESIZE), start;
+      BOOL async = FALSE;
+
+      if(argc > 0 && !js_is_null_or_undefined(argv[0]) && JS_ToIndex(ctx, &offset, argv[0]))
+        return JS_EXCEPTION;
+
+      if(argc > 1 && !js_is_null_or_undefined(argv[1]) && JS_ToIndex(ctx, &length, argv[1]))
+        return JS_EXCEPTION;
+
+      if(argc > 2)
+        async = JS_ToBool(ctx, argv[2]);
+
+      if(offset >= r->size)
+        break;
+
+      length = MIN_NUM(length, r->size - offset);
+      start = ((uintptr_t)r->ptr + offset) & ~(page - 1);
+
+      if(msync((void*)start, (uintptr_t)r->ptr + offset + length - start, async ? MS_ASYNC : MS_SYNC) == -1)
+        return JS_ThrowInternalError(ctx, "msync() failed: %s", strerror(errno));
+
+      break;
+    }
+
+    case MAPPED_FILE_CLOSE: {
+      JS_DetachArrayBuffer(ctx, mf->buffer);
+      JS_FreeValue(ctx, mf->buffer);
+      mf->buffer = JS_UNDEFINED;
+      mf->region = 0;
+      mapped_region_free(JS_GetRuntime(ctx), r);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static JSValue
+js_mapped_file_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  MappedFile* mf;
+  MappedRegion* r;
+
+  if(!(mf = js_mapped_file_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(!(r = mf->region))
+    return JS_UNDEFINED;
+
+  switch(magic) {
+    case MAPPED_FILE_BUFFER: return JS_DupValue(ctx, mf->buffer);
+    case MAPPED_FILE_SIZE: return JS_NewInt64(ctx, r->size);
+    case MAPPED_FILE_FD: return JS_NewInt32(ctx, r->fd);
+    case MAPPED_FILE_FILENAME: return JS_NewString(ctx, r->filename);
+  }
+
+  return JS_UNDEFINED;
+}
+#endif
+
+/**
+ * new MappedFile(filename, { size, readonly = false, create = true }):
+ * a MAP_SHARED mapping of a whole file. grow(size) extends the file and
+ * the mapping (mremap() where available) and returns the new buffer; the
+ * previous one is detached. flush(offset, length, async) is msync().
+ */
+static JSValue
+js_mapped_file_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+#ifdef _WIN32
+  return JS_ThrowInternalError(ctx, "MappedFile needs ftruncate() and mremap()");
+#else
+  MappedFile* mf;
+  MappedRegion* r;
+  JSValue proto, obj;
+  const char* filename;
+  BOOL readonly = FALSE, create = TRUE;
+  uint64_t size = 0;
+  struct stat st;
+
+  if(argc > 1 && JS_IsObject(argv[1])) {
+    readonly = js_get_propertystr_bool(ctx, argv[1], "readonly");
+
+    if(js_has_propertystr(ctx, argv[1], "create"))
+      create = js_get_propertystr_bool(ctx, argv[1], "create");
+
+    if(js_has_propertystr(ctx, argv[1], "size")) {
+      JSValue value = JS_GetPropertyStr(ctx, argv[1], "size");
+      int err = JS_ToIndex(ctx, &size, value);
+
+      JS_FreeValue(ctx, value);
+
+      if(err)
+        return JS_EXCEPTION;
+    }
+  }
+
+  if(!(filename = JS_ToCString(ctx, argv[0])))
+    return JS_EXCEPTION;
+
+  if(!(r = js_mallocz(ctx, sizeof(MappedRegion)))) {
+    JS_FreeCString(ctx, filename);
+    return JS_EXCEPTION;
+  }
+
+  r->ref_count = 1;
+  r->fd = -1;
+  r->prot = readonly ? PROT_READ : PROT_READ | PROT_WRITE;
+  r->filename = js_strdup(ctx, filename);
+
+  if((r->fd = open(filename, (readonly ? O_RDONLY : O_RDWR | (create ? O_CREAT : 0)) | O_CLOEXEC, 0666)) == -1) {
+    JS_ThrowInternalError(ctx, "open(%s) failed: %s", filename, strerror(errno));
+    goto fail;
+  }
+
+  if(fstat(r->fd, &st) == -1 || (!readonly && (uint64_t)st.st_size < size && ftruncate(r->fd, size) == -1) || !mapped_region_resize(r, MAX_NUM((uint64_t)st.st_size, readonly ? 0 : size))) {
+    JS_ThrowInternalError(ctx, "mmap(%s) failed: %s", filename, strerror(errno));
+    goto fail;
+  }
+
+  JS_FreeCString(ctx, filename);
+
+  if(!(mf = js_mallocz(ctx, sizeof(MappedFile)))) {
+    mapped_region_free(JS_GetRuntime(ctx), r);
+    return JS_EXCEPTION;
+  }
+
+  mf->region = r;
+  mf->buffer = mapped_region_buffer(ctx, r);
+
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  obj = JS_NewObjectProtoClass(ctx, proto, js_mapped_file_class_id);
+  JS_FreeValue(ctx, proto);
+
+  if(JS_IsException(obj)) {
+    JS_FreeValue(ctx, mf->buffer);
+    mapped_region_free(JS_GetRuntime(ctx), r);
+    js_free(ctx, mf);
+    return obj;
+  }
+
+  JS_SetOpaque(obj, mf);
+  return obj;
+
+fail:
+  JS_FreeCString(ctx, filename);
+  mapped_region_free(JS_GetRuntime(ctx), r);
+  return JS_EXCEPTION;
+#endif
+}
+
+#ifndef _WIN32
+static void
+js_mapped_file_finalizer(JSRuntime* rt, JSValue val) {
+  MappedFile* mf;
+
+  if((mf = JS_GetOpaque(val, js_mapped_file_class_id))) {
+    JS_FreeValueRT(rt, mf->buffer);
+
+    if(mf->region)
+      mapped_region_free(rt, mf->region);
+
+    js_free_rt(rt, mf);
+  }
+}
+
+static void
+js_mapped_file_mark(JSRuntime* rt, JSValueConst val, JS_MarkFunc* mark_func) {
+  MappedFile* mf;
+
+  if((mf = JS_GetOpaque(val, js_mapped_file_class_id)))
+    JS_MarkValue(rt, mf->buffer, mark_func);
+}
+
+static JSClassDef js_mapped_file_class = {
+    .class_name = "MappedFile",
+    .finalizer = js_mapped_file_finalizer,
+    .gc_mark = js_mapped_file_mark,
+};
+
+static const JSCFunctionListEntry js_mapped_file_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("grow", 1, js_mapped_file_method, MAPPED_FILE_GROW),
+    JS_CFUNC_MAGIC_DEF("flush", 0, js_mapped_file_method, MAPPED_FILE_FLUSH),
+    JS_CFUNC_MAGIC_DEF("close", 0, js_mapped_file_method, MAPPED_FILE_CLOSE),
+    JS_CGETSET_MAGIC_DEF("buffer", js_mapped_file_get, NULL, MAPPED_FILE_BUFFER),
+    JS_CGETSET_MAGIC_DEF("size", js_mapped_file_get, NULL, MAPPED_FILE_SIZE),
+    JS_CGETSET_MAGIC_DEF("fd", js_mapped_file_get, NULL, MAPPED_FILE_FD),
+    JS_CGETSET_MAGIC_DEF("filename", js_mapped_file_get, NULL, MAPPED_FILE_FILENAME),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "MappedFile", JS_PROP_CONFIGURABLE),
+};
+#endif
+
 static const JSCFunctionListEntry js_mmap_funcs[] = {
     JS_CFUNC_DEF("mmap", 2, js_mmap_map),
     JS_CFUNC_DEF("munmap", 1, js_mmap_unmap),
     JS_CFUNC_DEF("msync", 3, js_mmap_msync),
     JS_CFUNC_DEF("mprotect", 3, js_mmap_mprotect),
+#ifndef _WIN32
+    JS_CFUNC_DEF("madvise", 4, js_mmap_madvise),
+    JS_CFUNC_MAGIC_DEF("mlock", 3, js_mmap_mlock, MMAP_MLOCK),
+    JS_CFUNC_MAGIC_DEF("munlock", 3, js_mmap_mlock, MMAP_MUNLOCK),
+    JS_CFUNC_DEF("mincore", 3, js_mmap_mincore),
+    JS_CFUNC_DEF("fadvise", 4, js_mmap_fadvise),
+    JS_CFUNC_DEF("readahead", 3, js_mmap_readahead),
+#endif
     JS_CFUNC_DEF("filename", 1, js_mmap_filename),
     JS_CFUNC_DEF("toString", 1, js_mmap_tostring),
     JS_PROP_INT32_DEF("PROT_READ", 0x01, 0),
@@ -207,11 +1197,96 @@ static const JSCFunctionListEntry js_mmap_funcs[] = {
 #ifdef PROT_SEM
     JS_CONSTANT(PROT_SEM),
 #endif
+#ifdef MADV_NORMAL
+    JS_CONSTANT(MADV_NORMAL),
+#endif
+#ifdef MADV_RANDOM
+    JS_CONSTANT(MADV_RANDOM),
+#endif
+#ifdef MADV_SEQUENTIAL
+    JS_CONSTANT(MADV_SEQUENTIAL),
+#endif
+#ifdef MADV_WILLNEED
+    JS_CONSTANT(MADV_WILLNEED),
+#endif
+#ifdef MADV_DONTNEED
+    JS_CONSTANT(MADV_DONTNEED),
+#endif
+#ifdef MADV_FREE
+    JS_CONSTANT(MADV_FREE),
+#endif
+#ifdef MADV_HUGEPAGE
+    JS_CONSTANT(MADV_HUGEPAGE),
+#endif
+#ifdef MADV_NOHUGEPAGE
+    JS_CONSTANT(MADV_NOHUGEPAGE),
+#endif
+#ifdef MADV_POPULATE_READ
+    JS_CONSTANT(MADV_POPULATE_READ),
+#endif
+#ifdef MADV_POPULATE_WRITE
+    JS_CONSTANT(MADV_POPULATE_WRITE),
+#endif
+#ifdef MADV_COLD
+    JS_CONSTANT(MADV_COLD),
+#endif
+#ifdef MADV_PAGEOUT
+    JS_CONSTANT(MADV_PAGEOUT),
+#endif
+#ifdef MAP_HUGE_2MB
+    JS_CONSTANT(MAP_HUGE_2MB),
+#endif
+#ifdef MAP_HUGE_1GB
+    JS_CONSTANT(MAP_HUGE_1GB),
+#endif
+#ifdef POSIX_FADV_NORMAL
+    JS_CONSTANT(POSIX_FADV_NORMAL),
+#endif
+#ifdef POSIX_FADV_RANDOM
+    JS_CONSTANT(POSIX_FADV_RANDOM),
+#endif
+#ifdef POSIX_FADV_SEQUENTIAL
+    JS_CONSTANT(POSIX_FADV_SEQUENTIAL),
+#endif
+#ifdef POSIX_FADV_WILLNEED
+    JS_CONSTANT(POSIX_FADV_WILLNEED),
+#endif
+#ifdef POSIX_FADV_DONTNEED
+    JS_CONSTANT(POSIX_FADV_DONTNEED),
+#endif
+#ifdef POSIX_FADV_NOREUSE
+    JS_CONSTANT(POSIX_FADV_NOREUSE),
+#endif
 };
 
 static int
 js_mmap_init(JSContext* ctx, JSModuleDef* m) {
+  JSValue proto;
+
+  JS_NewClassID(&js_line_index_class_id);
+  JS_NewClass(JS_GetRuntime(ctx), js_line_index_class_id, &js_line_index_class);
+
+  line_index_ctor = JS_NewCFunction2(ctx, js_line_index_constructor, "LineIndex", 1, JS_CFUNC_constructor, 0);
+  proto = JS_NewObject(ctx);
+  JS_SetPropertyFunctionList(ctx, proto, js_line_index_funcs, countof(js_line_index_funcs));
+  JS_SetClassProto(ctx, js_line_index_class_id, proto);
+  JS_SetConstructor(ctx, line_index_ctor, proto);
+
+  mapped_file_ctor = JS_NewCFunction2(ctx, js_mapped_file_constructor, "MappedFile", 1, JS_CFUNC_constructor, 0);
+  proto = JS_NewObject(ctx);
+
+#ifndef _WIN32
+  JS_NewClassID(&js_mapped_file_class_id);
+  JS_NewClass(JS_GetRuntime(ctx), js_mapped_file_class_id, &js_mapped_file_class);
+  JS_SetPropertyFunctionList(ctx, proto, js_mapped_file_funcs, countof(js_mapped_file_funcs));
+  JS_SetClassProto(ctx, js_mapped_file_class_id, JS_DupValue(ctx, proto));
+#endif
+  JS_SetConstructor(ctx, mapped_file_ctor, proto);
+  JS_FreeValue(ctx, proto);
+
   JS_SetModuleExportList(ctx, m, js_mmap_funcs, countof(js_mmap_funcs));
+  JS_SetModuleExport(ctx, m, "LineIndex", line_index_ctor);
+  JS_SetModuleExport(ctx, m, "MappedFile", mapped_file_ctor);
   return 0;
 }
 
@@ -227,6 +1302,8 @@ JS_INIT_MODULE(JSContext* ctx, const char* module_name) {
 
   if((m = JS_NewCModule(ctx, module_name, js_mmap_init))) {
     JS_AddModuleExportList(ctx, m, js_mmap_funcs, countof(js_mmap_funcs));
+    JS_AddModuleExport(ctx, m, "LineIndex");
+    JS_AddModuleExport(ctx, m, "MappedFile");
   }
 
   return m;
@@ -5,6 +5,9 @@
 #include "char-utils.h"
 #include "js-utils.h"
 #include "async-closure.h"
+#include "conn-pool.h"
+#include "result-columns.h"
+#include "query-stats.h"
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -17,11 +20,14 @@
  * @{
  */
 
-VISIBLE JSClassID js_connectparams_class_id = 0, js_mysqlerror_class_id = 0, js_mysql_class_id = 0, js_mysqlresult_class_id = 0;
+VISIBLE JSClassID js_connectparams_class_id = 0, js_mysqlerror_class_id = 0, js_mysql_class_id = 0, js_mysqlresult_class_id = 0,
+                   js_mysqlpool_class_id = 0, js_mysqlstmt_class_id = 0;
 VISIBLE JSValue mysqlerror_proto = {{0}, JS_TAG_UNDEFINED}, mysqlerror_ctor = {{0}, JS_TAG_UNDEFINED}, mysql_proto = {{0}, JS_TAG_UNDEFINED},
-                mysql_ctor = {{0}, JS_TAG_UNDEFINED}, mysqlresult_proto = {{0}, JS_TAG_UNDEFINED}, mysqlresult_ctor = {{0}, JS_TAG_UNDEFINED};
+                mysql_ctor = {{0}, JS_TAG_UNDEFINED}, mysqlresult_proto = {{0}, JS_TAG_UNDEFINED}, mysqlresult_ctor = {{0}, JS_TAG_UNDEFINED},
+                mysqlpool_proto = {{0}, JS_TAG_UNDEFINED}, mysqlpool_ctor = {{0}, JS_TAG_UNDEFINED}, mysqlstmt_proto = {{0}, JS_TAG_UNDEFINED};
 
 static JSValue js_mysqlresult_wrap(JSContext* ctx, MYSQL_RES* res);
+static JSValue js_mysqlresult_new(JSContext* ctx, JSValueConst proto, MYSQL_RES* res);
 
 typedef enum {
   RESULT_OBJECT = 1 << 0,
@@ -42,6 +48,32 @@ typedef char* FieldNameFunc(JSContext*, MYSQL_FIELD const*);
 typedef JSValue RowValueFunc(JSContext*, MYSQL_RES*, MYSQL_ROW, ResultFlags);
 typedef struct ConnectParameters MYSQLConnectParameters;
 
+struct MYSQLStatementCache;
+
+/* a server-side prepared statement, owned by its MySQLStatement objects
+ * and (while cached) by the per-connection statement cache */
+struct MYSQLStatement {
+  int ref_count;
+  MYSQL_STMT* stmt;
+  char* sql;
+  BOOL cached;
+  struct MYSQLStatementCache* cache;
+  struct list_head link;
+};
+
+/* per-connection LRU of statements keyed by SQL text, most recently used first */
+struct MYSQLStatementCache {
+  struct list_head statements;
+  uint32_t num_cached, capacity;
+  DynBuf closing;
+};
+
+typedef struct MYSQLStatement MYSQLStatement;
+typedef struct MYSQLStatementCache MYSQLStatementCache;
+
+static MYSQLStatementCache* mysql_statement_cache(JSContext* ctx, MYSQL* my, BOOL create);
+static void mysql_statement_cache_trim(MYSQLStatementCache* cache, JSRuntime* rt);
+
 static char* field_id(JSContext* ctx, MYSQL_FIELD const* field);
 static char* field_name(JSContext* ctx, MYSQL_FIELD const* field);
 static JSValue field_array(JSContext* ctx, MYSQL_FIELD* field);
@@ -65,6 +97,8 @@ static JSValue string_to_object(JSContext* ctx, const char* ctor_name, const cha
 #define string_to_date(ctx, s) string_to_object(ctx, "Date", s);
 
 static JSValue js_mysqlerror_new(JSContext* ctx, const char* msg);
+static JSValue result_value(JSContext* ctx, MYSQL_FIELD const* field, char* buf, size_t len, ResultFlags rtype);
+static JSValue js_mysql_query_params(JSContext* ctx, JSValueConst this_val, JSValueConst sql, JSValueConst params);
 
 static AsyncEvent
 to_asyncevent(int my_wait) {
@@ -406,10 +440,63 @@ fail:
   return JS_EXCEPTION;
 }
 
+/**
+ * Query stats live in the handle's userdata like the statement cache;
+ * NULL while collection is disabled.
+ */
+static QueryStats*
+mysql_query_stats(JSContext* ctx, MYSQL* my, BOOL create) {
+  QueryStats* qs = 0;
+
+  mysql_get_optionv(my, MARIADB_OPT_USERDATA, (void*)"MYSQLQueryStats", (void*)&qs);
+
+  if(!qs && create && (qs = query_stats_new(ctx)))
+    mysql_optionsv(my, MARIADB_OPT_USERDATA, (void*)"MYSQLQueryStats", (void*)qs);
+
+  return qs;
+}
+
+static void
+mysql_query_stats_free(JSRuntime* rt, MYSQL* my) {
+  QueryStats* qs = 0;
+
+  mysql_get_optionv(my, MARIADB_OPT_USERDATA, (void*)"MYSQLQueryStats", (void*)&qs);
+
+  if(qs) {
+    mysql_optionsv(my, MARIADB_OPT_USERDATA, (void*)"MYSQLQueryStats", (void*)0);
+    query_stats_free(qs, rt);
+  }
+}
+
+/**
+ * Accounts one fetched row, or ends the query when row is NULL.
+ */
+static void
+mysql_query_stats_row(JSContext* ctx, MYSQL* my, MYSQL_RES* res, MYSQL_ROW row) {
+  QueryStats* qs;
+
+  if(!my || !(qs = mysql_query_stats(ctx, my, FALSE)))
+    return;
+
+  if(row) {
+    unsigned long* lengths = mysql_fetch_lengths(res);
+    uint32_t i, n = mysql_num_fields(res);
+    size_t bytes = 0;
+
+    for(i = 0; lengths && i < n; i++)
+      bytes += lengths[i];
+
+    query_stats_received(qs, 1, bytes);
+  } else {
+    query_stats_end(qs, mysql_errno(my) != 0, ctx);
+  }
+}
+
 enum {
   METHOD_ESCAPE_STRING,
   METHOD_GET_OPTION,
   METHOD_SET_OPTION,
+  METHOD_RESET_STATS,
 };
 
 static JSValue
@@ -521,6 +608,15 @@ js_mysql_methods(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst a
       break;
     }
 
+    case METHOD_RESET_STATS: {
+      QueryStats* qs;
+
+      if((qs = mysql_query_stats(ctx, my, FALSE)))
+        query_stats_reset(qs);
+
+      break;
+    }
+
     case METHOD_SET_OPTION: {
       int32_t opt = -1;
 
@@ -651,6 +747,10 @@ enum {
   PROP_STATUS,
   PROP_PENDING,
   PROP_SOCKET,
+  PROP_COLLECT_STATS,
+  PROP_STATS,
+  PROP_STATS_HOOK,
+  PROP_STATEMENT_CACHE_SIZE,
 };
 
 static JSValue
@@ -793,11 +893,87 @@ js_mysql_get(JSContext* ctx, JSValueConst this_val, int magic) {
       ret = JS_NewInt32(ctx, pending);
       break;
     }
+
+    case PROP_COLLECT_STATS: {
+      ret = JS_NewBool(ctx, !!mysql_query_stats(ctx, my, FALSE));
+      break;
+    }
+
+    case PROP_STATS: {
+      QueryStats* qs;
+
+      ret = (qs = mysql_query_stats(ctx, my, FALSE)) ? query_stats_value(qs, ctx) : JS_NULL;
+      break;
+    }
+
+    case PROP_STATS_HOOK: {
+      QueryStats* qs;
+
+      ret = (qs = mysql_query_stats(ctx, my, FALSE)) ? JS_DupValue(ctx, qs->hook) : JS_NULL;
+      break;
+    }
+
+    case PROP_STATEMENT_CACHE_SIZE: {
+      MYSQLStatementCache* cache;
+
+      ret = JS_NewUint32(ctx, (cache = mysql_statement_cache(ctx, my, FALSE)) ? cache->capacity : 32);
+      break;
+    }
   }
 
   return ret;
 }
 
+static JSValue
+js_mysql_set(JSContext* ctx, JSValueConst this_val, JSValueConst value, int magic) {
+  MYSQL* my;
+  QueryStats* qs;
+
+  if(!(my = JS_GetOpaque(this_val, js_mysql_class_id)))
+    return JS_UNDEFINED;
+
+  switch(magic) {
+    case PROP_COLLECT_STATS: {
+      if(JS_ToBool(ctx, value))
+        mysql_query_stats(ctx, my, TRUE);
+      else
+        mysql_query_stats_free(JS_GetRuntime(ctx), my);
+
+      break;
+    }
+
+    case PROP_STATS_HOOK: {
+      if(!JS_IsFunction(ctx, value) && !JS_IsNull(value) && !JS_IsUndefined(value))
+        return JS_ThrowTypeError(ctx, "onQueryStats must be a function or null");
+
+      /* setting a hook enables collection */
+      if((qs = mysql_query_stats(ctx, my, JS_IsFunction(ctx, value)))) {
+        JS_FreeValue(ctx, qs->hook);
+        qs->hook = JS_IsFunction(ctx, value) ? JS_DupValue(ctx, value) : JS_UNDEFINED;
+      }
+
+      break;
+    }
+
+    case PROP_STATEMENT_CACHE_SIZE: {
+      MYSQLStatementCache* cache;
+      uint32_t size;
+
+      if(JS_ToUint32(ctx, &size, value))
+        return JS_EXCEPTION;
+
+      if(!(cache = mysql_statement_cache(ctx, my, TRUE)))
+        return JS_EXCEPTION;
+
+      cache->capacity = size;
+      mysql_statement_cache_trim(cache, JS_GetRuntime(ctx));
+      break;
+    }
+  }
+
+  return JS_UNDEFINED;
+}
+
 static JSValue
 js_mysql_getstatic(JSContext* ctx, JSValueConst this_val, int magic) {
   JSValue ret = JS_UNDEFINED;
@@ -1009,8 +1185,15 @@ js_mysql_connect_continue(JSContext* ctx, JSValueConst this_val, int argc, JSVal
 
   asyncclosure_change_event(ac, to_asyncevent(state));
 
-  if(state == 0)
-    asyncclosure_resolve(ac);
+  if(state == 0) {
+    if(ret) {
+      asyncclosure_resolve(ac);
+    } else {
+      JSValue error = js_mysqlerror_new(ctx, mysql_error(my));
+      asyncclosure_error(ac, error);
+      JS_FreeValue(ctx, error);
+    }
+  }
 
   return JS_UNDEFINED;
 }
@@ -1052,20 +1235,34 @@ js_mysql_query_continue(JSContext* ctx, JSValueConst this_val, int argc, JSValue
   AsyncClosure* ac = ptr;
   int err = 0, state, as;
 
+  QueryStats* qs = mysql_query_stats(ctx, ac->opaque, FALSE);
+
   state = mysql_real_query_cont(&err, ac->opaque, to_mysql_wait(ac->state));
   as = to_asyncevent(state);
   asyncclosure_change_event(ac, as);
 
+  if(qs)
+    query_stats_wakeup(qs);
+
   if(state == 0) {
     MYSQL_RES* res;
 
+    if(qs)
+      query_stats_first_byte(qs);
+
     if(err) {
+      if(qs)
+        query_stats_end(qs, TRUE, ctx);
+
       JSValue error = js_mysqlerror_new(ctx, mysql_error(ac->opaque));
       asyncclosure_error(ac, error);
       JS_FreeValue(ctx, error);
     } else if((res = mysql_use_result(ac->opaque))) {
       JS_SetOpaque(ac->result, res);
       asyncclosure_resolve(ac);
+    } else if(qs) {
+      /* no result set: the query ends with the OK packet */
+      query_stats_end(qs, FALSE, ctx);
     }
   }
 
@@ -1075,6 +1272,7 @@ js_mysql_query_continue(JSContext* ctx, JSValueConst this_val, int argc, JSValue
 static JSValue
 js_mysql_query(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
   AsyncClosure* ac;
+  QueryStats* qs;
   const char* query = 0;
   size_t i;
   MYSQL* my;
@@ -1083,7 +1281,14 @@ js_mysql_query(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst arg
   if(!(my = js_mysql_data2(ctx, this_val)))
     return JS_EXCEPTION;
 
+  if(argc > 1 && JS_IsArray(ctx, argv[1]))
+    return js_mysql_query_params(ctx, this_val, argv[0], argv[1]);
+
   query = JS_ToCStringLen(ctx, &i, argv[0]);
+
+  if((qs = mysql_query_stats(ctx, my, FALSE)))
+    query_stats_begin(qs, i);
+
   state = mysql_real_query_start(&err, my, query, i);
   fd = js_mysql_fd(ctx, this_val);
   as = to_asyncevent(state);
@@ -1098,174 +1303,1491 @@ js_mysql_query(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst arg
   return asyncclosure_promise(ac);
 }
 
-static JSValue
-js_mysql_close(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
-  JSValue ret = JS_UNDEFINED;
-  MYSQL* my;
-  AsyncClosure* ac;
-  int fd = -1;
-
-  if(!(my = js_mysql_data2(ctx, this_val)))
-    return JS_EXCEPTION;
+static MYSQLStatementCache*
+mysql_statement_cache(JSContext* ctx, MYSQL* my, BOOL create) {
+  MYSQLStatementCache* cache = 0;
 
-#ifdef _WIN32
-  if(js_has_propertystr(ctx, this_val, "fd")) {
-    fd = js_get_propertystr_int32(ctx, this_val, "fd");
-    _close(fd);
-  }
-#else
-  fd = mysql_get_socket(my);
-#endif
+  mysql_get_optionv(my, MARIADB_OPT_USERDATA, (void*)"MYSQLStatementCache", (void*)&cache);
 
-  if(fd > -1)
-    if((ac = asyncclosure_lookup(fd)))
-      asyncclosure_done(ac);
+  if(!cache && create && (cache = js_mallocz(ctx, sizeof(MYSQLStatementCache)))) {
+    init_list_head(&cache->statements);
+    cache->capacity = 32;
+    js_dbuf_init_rt(JS_GetRuntime(ctx), &cache->closing);
 
-  mysql_close(my);
+    mysql_optionsv(my, MARIADB_OPT_USERDATA, (void*)"MYSQLStatementCache", (void*)cache);
+  }
 
-  JS_SetOpaque(this_val, 0);
+  return cache;
+}
 
-  return ret;
+static MYSQLStatement*
+mysqlstmt_dup(MYSQLStatement* st) {
+  ++st->ref_count;
+  return st;
 }
 
+/**
+ * Drops a reference. The last one defers mysql_stmt_close() to the next
+ * prepare, so it never interleaves with a command in progress.
+ */
 static void
-js_mysql_finalizer(JSRuntime* rt, JSValue val) {
-  MYSQL* my;
+mysqlstmt_free(JSRuntime* rt, MYSQLStatement* st) {
+  if(--st->ref_count == 0) {
+    if(st->cache) {
+      list_del(&st->link);
+      dbuf_put(&st->cache->closing, (const uint8_t*)&st->stmt, sizeof(MYSQL_STMT*));
+    } else if(st->stmt) {
+      mysql_stmt_close(st->stmt);
+    }
 
-  if((my = JS_GetOpaque(val, js_mysql_class_id))) {
-    mysql_close(my);
+    js_free_rt(rt, st->sql);
+    js_free_rt(rt, st);
   }
 }
 
-static JSClassDef js_mysql_class = {
-    .class_name = "MySQL",
-    .finalizer = js_mysql_finalizer,
-};
-
-static const JSCFunctionListEntry js_mysql_funcs[] = {
-    JS_CGETSET_MAGIC_DEF("moreResults", js_mysql_get, 0, PROP_MORE_RESULTS),
-    JS_CGETSET_MAGIC_DEF("affectedRows", js_mysql_get, 0, PROP_AFFECTED_ROWS),
-    JS_CGETSET_MAGIC_DEF("warningCount", js_mysql_get, 0, PROP_WARNING_COUNT),
-    JS_CGETSET_MAGIC_DEF("fieldCount", js_mysql_get, 0, PROP_FIELD_COUNT),
-#ifndef _WIN32
-    JS_CGETSET_MAGIC_DEF("fd", js_mysql_get, 0, PROP_SOCKET),
-#endif
-    JS_CGETSET_MAGIC_DEF("socket", js_mysql_get, 0, PROP_SOCKET),
-    JS_CGETSET_MAGIC_DEF("errno", js_mysql_get, 0, PROP_ERRNO),
-    JS_CGETSET_MAGIC_DEF("error", js_mysql_get, 0, PROP_ERROR),
-    JS_CGETSET_MAGIC_DEF("info", js_mysql_get, 0, PROP_INFO),
-    JS_CGETSET_MAGIC_DEF("insertId", js_mysql_get, 0, PROP_INSERT_ID),
-    JS_CGETSET_MAGIC_DEF("charset", js_mysql_get, 0, PROP_CHARSET),
-    JS_CGETSET_MAGIC_DEF("timeout", js_mysql_get, 0, PROP_TIMEOUT),
-    JS_CGETSET_MAGIC_DEF("timeoutMs", js_mysql_get, 0, PROP_TIMEOUT_MS),
-    JS_CGETSET_MAGIC_DEF("serverName", js_mysql_get, 0, PROP_SERVER_NAME),
-    JS_CGETSET_MAGIC_DEF("serverInfo", js_mysql_get, 0, PROP_SERVER_INFO),
-    JS_CGETSET_MAGIC_DEF("serverVersion", js_mysql_get, 0, PROP_SERVER_VERSION),
-    JS_CGETSET_MAGIC_DEF("user", js_mysql_get, 0, PROP_USER),
-    JS_CGETSET_MAGIC_DEF("password", js_mysql_get, 0, PROP_PASSWORD),
-    JS_CGETSET_MAGIC_DEF("host", js_mysql_get, 0, PROP_HOST),
-    JS_CGETSET_MAGIC_DEF("port", js_mysql_get, 0, PROP_PORT),
-    JS_CGETSET_MAGIC_DEF("socket", js_mysql_get, 0, PROP_UNIX_SOCKET),
-    JS_CGETSET_MAGIC_DEF("db", js_mysql_get, 0, PROP_DB),
-    JS_CGETSET_MAGIC_DEF("status", js_mysql_get, 0, PROP_STATUS),
-    JS_CGETSET_MAGIC_DEF("pending", js_mysql_get, 0, PROP_PENDING),
-    JS_CFUNC_DEF("connect", 1, js_mysql_connect),
-    JS_CFUNC_DEF("query", 1, js_mysql_query),
-    JS_CFUNC_DEF("close", 0, js_mysql_close),
-    JS_ALIAS_DEF("execute", "query"),
-    JS_CFUNC_MAGIC_DEF("escapeString", 1, js_mysql_methods, METHOD_ESCAPE_STRING),
-    JS_CFUNC_MAGIC_DEF("getOption", 1, js_mysql_methods, METHOD_GET_OPTION),
-    JS_CFUNC_MAGIC_DEF("setOption", 2, js_mysql_methods, METHOD_SET_OPTION),
-    JS_PROP_INT32_DEF("resultType", 0, JS_PROP_C_W_E),
-    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "MySQL", JS_PROP_CONFIGURABLE),
-};
+static void
+mysqlstmt_release(JSRuntime* rt, void* ptr) {
+  mysqlstmt_free(rt, ptr);
+}
 
-static const JSCFunctionListEntry js_mysql_static[] = {
-    JS_CGETSET_MAGIC_DEF("clientInfo", js_mysql_getstatic, 0, PROP_CLIENT_INFO),
-    JS_CGETSET_MAGIC_DEF("clientVersion", js_mysql_getstatic, 0, PROP_CLIENT_VERSION),
-    JS_CGETSET_MAGIC_DEF("threadSafe", js_mysql_getstatic, 0, PROP_THREAD_SAFE),
-    JS_CFUNC_DEF("escapeString", 1, js_mysql_escape_string),
-    JS_CFUNC_DEF("valueString", 0, js_mysql_value_string),
-    JS_CFUNC_DEF("valuesString", 1, js_mysql_values_string),
-    JS_CFUNC_DEF("insertQuery", 2, js_mysql_insert_query),
-};
+static void
+mysql_statement_cache_flush(MYSQLStatementCache* cache) {
+  MYSQL_STMT** stmts = (MYSQL_STMT**)cache->closing.buf;
+  size_t i, n = cache->closing.size / sizeof(MYSQL_STMT*);
 
-static const JSCFunctionListEntry js_mysql_defines[] = {
-    JS_PROP_INT32_DEF("RESULT_OBJECT", RESULT_OBJECT, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("RESULT_STRING", RESULT_STRING, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("RESULT_TBLNAM", RESULT_TBLNAM, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT64_DEF("COUNT_ERROR", MYSQL_COUNT_ERROR, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("DATABASE_DRIVER", MYSQL_DATABASE_DRIVER, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("DEFAULT_AUTH", MYSQL_DEFAULT_AUTH, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("ENABLE_CLEARTEXT_PLUGIN", MYSQL_ENABLE_CLEARTEXT_PLUGIN, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("INIT_COMMAND", MYSQL_INIT_COMMAND, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("STATUS_READY", MYSQL_STATUS_READY, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("STATUS_GET_RESULT", MYSQL_STATUS_GET_RESULT, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("STATUS_USE_RESULT", MYSQL_STATUS_USE_RESULT, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("STATUS_QUERY_SENT", MYSQL_STATUS_QUERY_SENT, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("STATUS_SENDING_LOAD_DATA", MYSQL_STATUS_SENDING_LOAD_DATA, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("STATUS_FETCHING_DATA", MYSQL_STATUS_FETCHING_DATA, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("STATUS_NEXT_RESULT_PENDING", MYSQL_STATUS_NEXT_RESULT_PENDING, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("STATUS_QUIT_SENT", MYSQL_STATUS_QUIT_SENT, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("STATUS_STMT_RESULT", MYSQL_STATUS_STMT_RESULT, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_BIND", MYSQL_OPT_BIND, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_CAN_HANDLE_EXPIRED_PASSWORDS", MYSQL_OPT_CAN_HANDLE_EXPIRED_PASSWORDS, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_COMPRESS", MYSQL_OPT_COMPRESS, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_CONNECT_ATTR_ADD", MYSQL_OPT_CONNECT_ATTR_ADD, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_CONNECT_ATTR_DELETE", MYSQL_OPT_CONNECT_ATTR_DELETE, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_CONNECT_ATTR_RESET", MYSQL_OPT_CONNECT_ATTR_RESET, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_CONNECT_ATTRS", MYSQL_OPT_CONNECT_ATTRS, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_CONNECT_TIMEOUT", MYSQL_OPT_CONNECT_TIMEOUT, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_GUESS_CONNECTION", MYSQL_OPT_GUESS_CONNECTION, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_LOCAL_INFILE", MYSQL_OPT_LOCAL_INFILE, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_MAX_ALLOWED_PACKET", MYSQL_OPT_MAX_ALLOWED_PACKET, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_NAMED_PIPE", MYSQL_OPT_NAMED_PIPE, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_NET_BUFFER_LENGTH", MYSQL_OPT_NET_BUFFER_LENGTH, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_NONBLOCK", MYSQL_OPT_NONBLOCK, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_PROTOCOL", MYSQL_OPT_PROTOCOL, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_READ_TIMEOUT", MYSQL_OPT_READ_TIMEOUT, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_RECONNECT", MYSQL_OPT_RECONNECT, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_SSL_CA", MYSQL_OPT_SSL_CA, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_SSL_CAPATH", MYSQL_OPT_SSL_CAPATH, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_SSL_CERT", MYSQL_OPT_SSL_CERT, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_SSL_CIPHER", MYSQL_OPT_SSL_CIPHER, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_SSL_CRL", MYSQL_OPT_SSL_CRL, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_SSL_CRLPATH", MYSQL_OPT_SSL_CRLPATH, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_SSL_ENFORCE", MYSQL_OPT_SSL_ENFORCE, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_SSL_KEY", MYSQL_OPT_SSL_KEY, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_SSL_VERIFY_SERVER_CERT", MYSQL_OPT_SSL_VERIFY_SERVER_CERT, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_TLS_VERSION", MYSQL_OPT_TLS_VERSION, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_USE_EMBEDDED_CONNECTION", MYSQL_OPT_USE_EMBEDDED_CONNECTION, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_USE_REMOTE_CONNECTION", MYSQL_OPT_USE_REMOTE_CONNECTION, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_USE_RESULT", MYSQL_OPT_USE_RESULT, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("OPT_WRITE_TIMEOUT", MYSQL_OPT_WRITE_TIMEOUT, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("PLUGIN_DIR", MYSQL_PLUGIN_DIR, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("PROGRESS_CALLBACK", MYSQL_PROGRESS_CALLBACK, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("READ_DEFAULT_FILE", MYSQL_READ_DEFAULT_FILE, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("READ_DEFAULT_GROUP", MYSQL_READ_DEFAULT_GROUP, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("REPORT_DATA_TRUNCATION", MYSQL_REPORT_DATA_TRUNCATION, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("SECURE_AUTH", MYSQL_SECURE_AUTH, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("SERVER_PUBLIC_KEY", MYSQL_SERVER_PUBLIC_KEY, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("SET_CHARSET_DIR", MYSQL_SET_CHARSET_DIR, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("SET_CHARSET_NAME", MYSQL_SET_CHARSET_NAME, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("SET_CLIENT_IP", MYSQL_SET_CLIENT_IP, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("SHARED_MEMORY_BASE_NAME", MYSQL_SHARED_MEMORY_BASE_NAME, JS_PROP_CONFIGURABLE),
-};
+  for(i = 0; i < n; i++)
+    mysql_stmt_close(stmts[i]);
 
-static JSValue
-js_mysqlerror_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
-  JSValue obj, proto;
-  JSAtom prop;
+  cache->closing.size = 0;
+}
 
-  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
-  if(JS_IsException(proto))
-    return JS_EXCEPTION;
+static void
+mysql_statement_cache_trim(MYSQLStatementCache* cache, JSRuntime* rt) {
+  struct list_head *el, *next;
 
-  if(!JS_IsObject(proto))
-    proto = JS_DupValue(ctx, mysqlerror_proto);
+  list_for_each_prev_safe(el, next, &cache->statements) {
+    MYSQLStatement* st = list_entry(el, MYSQLStatement, link);
 
-  obj = JS_NewObjectProtoClass(ctx, proto, js_mysqlerror_class_id);
-  JS_FreeValue(ctx, proto);
+    if(cache->num_cached <= cache->capacity)
+      break;
+
+    if(st->cached) {
+      st->cached = FALSE;
+      cache->num_cached--;
+      mysqlstmt_free(rt, st);
+    }
+  }
+}
+
+/**
+ * Called before mysql_close(): closes pending statements, detaches the
+ * ones still referenced from JS and frees the cache.
+ */
+static void
+mysql_statement_cache_free(JSRuntime* rt, MYSQL* my) {
+  MYSQLStatementCache* cache = 0;
+  struct list_head *el, *next;
+
+  mysql_get_optionv(my, MARIADB_OPT_USERDATA, (void*)"MYSQLStatementCache", (void*)&cache);
+
+  if(!cache)
+    return;
+
+  mysql_optionsv(my, MARIADB_OPT_USERDATA, (void*)"MYSQLStatementCache", (void*)0);
+  mysql_statement_cache_flush(cache);
+
+  list_for_each_safe(el, next, &cache->statements) {
+    MYSQLStatement* st = list_entry(el, MYSQLStatement, link);
+
+    list_del(&st->link);
+    st->cache = 0;
+
+    if(st->cached) {
+      st->cached = FALSE;
+      mysqlstmt_free(rt, st);
+    }
+  }
+
+  dbuf_free(&cache->closing);
+  js_free_rt(rt, cache);
+}
+
+static MYSQLStatement*
+mysql_statement_cache_lookup(MYSQLStatementCache* cache, const char* sql) {
+  struct list_head* el;
+
+  list_for_each(el, &cache->statements) {
+    MYSQLStatement* st = list_entry(el, MYSQLStatement, link);
+
+    if(st->cached && !strcmp(st->sql, sql)) {
+      list_del(&st->link);
+      list_add(&st->link, &cache->statements);
+      return st;
+    }
+  }
+
+  return 0;
+}
+
+static void
+mysql_statement_cache_add(MYSQLStatementCache* cache, MYSQLStatement* st, JSRuntime* rt) {
+  if(!st->cache || cache->capacity == 0)
+    return;
+
+  st->cached = TRUE;
+  mysqlstmt_dup(st);
+  cache->num_cached++;
+
+  mysql_statement_cache_trim(cache, rt);
+}
+
+static JSValue
+js_mysqlstmt_wrap(JSContext* ctx, JSValueConst conn, MYSQLStatement* st) {
+  JSValue obj;
+
+  obj = JS_NewObjectProtoClass(ctx, mysqlstmt_proto, js_mysqlstmt_class_id);
+  if(JS_IsException(obj))
+    return obj;
+
+  JS_SetOpaque(obj, mysqlstmt_dup(st));
+  JS_DefinePropertyValueStr(ctx, obj, "handle", JS_DupValue(ctx, conn), JS_PROP_CONFIGURABLE);
+
+  return obj;
+}
+
+static void
+mysql_prepare_done(JSContext* ctx, AsyncClosure* ac, int err) {
+  MYSQLStatement* st = ac->opaque;
+
+  if(err) {
+    JSValue error = js_mysqlerror_new(ctx, mysql_stmt_error(st->stmt));
+    asyncclosure_error(ac, error);
+    JS_FreeValue(ctx, error);
+  } else {
+    if(st->cache)
+      mysql_statement_cache_add(st->cache, st, JS_GetRuntime(ctx));
+
+    asyncclosure_resolve(ac);
+  }
+}
+
+static JSValue
+js_mysql_prepare_continue(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  AsyncClosure* ac = ptr;
+  MYSQLStatement* st = ac->opaque;
+  int err = 0, state = mysql_stmt_prepare_cont(&err, st->stmt, to_mysql_wait(ac->state));
+
+  asyncclosure_change_event(ac, to_asyncevent(state));
+
+  if(state == 0)
+    mysql_prepare_done(ctx, ac, err);
+
+  return JS_UNDEFINED;
+}
+
+/**
+ * Prepares sql (or reuses the cached statement for it). Returns a
+ * MySQLStatement, or a Promise for one on nonblocking connections.
+ */
+static JSValue
+js_mysql_prepare(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  MYSQLStatementCache* cache;
+  MYSQLStatement* st;
+  MYSQL* my;
+  const char* sql;
+  size_t len;
+  my_bool update_max_length = 1;
+  JSValue obj;
+
+  if(!(my = js_mysql_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(!(cache = mysql_statement_cache(ctx, my, TRUE)))
+    return JS_EXCEPTION;
+
+  if(!(sql = JS_ToCStringLen(ctx, &len, argv[0])))
+    return JS_EXCEPTION;
+
+  if((st = mysql_statement_cache_lookup(cache, sql))) {
+    JS_FreeCString(ctx, sql);
+    obj = js_mysqlstmt_wrap(ctx, this_val, st);
+
+    if(mysql_nonblock(my)) {
+      JSValue promise = js_promise_resolve(ctx, obj);
+      JS_FreeValue(ctx, obj);
+      obj = promise;
+    }
+
+    return obj;
+  }
+
+  mysql_statement_cache_flush(cache);
+
+  if(!(st = js_mallocz(ctx, sizeof(MYSQLStatement)))) {
+    JS_FreeCString(ctx, sql);
+    return JS_EXCEPTION;
+  }
+
+  st->ref_count = 1;
+  st->stmt = mysql_stmt_init(my);
+  st->sql = js_strndup(ctx, sql, len);
+  st->cache = cache;
+  list_add(&st->link, &cache->statements);
+  JS_FreeCString(ctx, sql);
+
+  if(!st->stmt) {
+    mysqlstmt_free(JS_GetRuntime(ctx), st);
+    return JS_Throw(ctx, js_mysqlerror_new(ctx, mysql_error(my)));
+  }
+
+  /* so that result buffers can be sized after mysql_stmt_store_result() */
+  mysql_stmt_attr_set(st->stmt, STMT_ATTR_UPDATE_MAX_LENGTH, &update_max_length);
+
+  obj = js_mysqlstmt_wrap(ctx, this_val, st);
+
+  if(!mysql_nonblock(my)) {
+    if(mysql_stmt_prepare(st->stmt, st->sql, len)) {
+      JSValue error = js_mysqlerror_new(ctx, mysql_stmt_error(st->stmt));
+
+      JS_FreeValue(ctx, obj);
+      obj = JS_Throw(ctx, error);
+    } else {
+      mysql_statement_cache_add(cache, st, JS_GetRuntime(ctx));
+    }
+
+    mysqlstmt_free(JS_GetRuntime(ctx), st);
+    return obj;
+  } else {
+    AsyncClosure* ac;
+    int err = 0, state = mysql_stmt_prepare_start(&err, st->stmt, st->sql, len);
+    JSValue promise;
+
+    ac = asyncclosure_new(ctx, js_mysql_fd(ctx, this_val), to_asyncevent(state), obj, &js_mysql_prepare_continue);
+    asyncclosure_opaque(ac, st, mysqlstmt_release);
+
+    if(state == 0)
+      mysql_prepare_done(ctx, ac, err);
+
+    promise = asyncclosure_promise(ac);
+    JS_FreeValue(ctx, obj);
+    return promise;
+  }
+}
+
+typedef union {
+  int64_t i;
+  double d;
+} MYSQLNumber;
+
+typedef struct {
+  MYSQLStatement* stmt;
+  MYSQL_BIND* binds;
+  MYSQLNumber* numbers;
+  void** data;
+  int count;
+  ResultFlags flags;
+  BOOL storing;
+  QueryStats* stats;
+} MYSQLExecute;
+
+static void
+mysqlexec_free(JSRuntime* rt, void* ptr) {
+  MYSQLExecute* ex = ptr;
+
+  for(int i = 0; ex->data && i < ex->count; i++)
+    if(ex->data[i])
+      js_free_rt(rt, ex->data[i]);
+
+  js_free_rt(rt, ex->binds);
+  js_free_rt(rt, ex->numbers);
+  js_free_rt(rt, ex->data);
+
+  mysqlstmt_free(rt, ex->stmt);
+  js_free_rt(rt, ex);
+}
+
+static MYSQLExecute*
+mysqlexec_new(JSContext* ctx, MYSQLStatement* st, int count) {
+  MYSQLExecute* ex;
+  size_t n = MAX_NUM(count, 1);
+
+  if(!(ex = js_mallocz(ctx, sizeof(MYSQLExecute))))
+    return 0;
+
+  ex->stmt = mysqlstmt_dup(st);
+  ex->count = count;
+  ex->binds = js_mallocz(ctx, sizeof(MYSQL_BIND) * n);
+  ex->numbers = js_mallocz(ctx, sizeof(MYSQLNumber) * n);
+  ex->data = js_mallocz(ctx, sizeof(void*) * n);
+
+  if(!ex->binds || !ex->numbers || !ex->data) {
+    mysqlexec_free(JS_GetRuntime(ctx), ex);
+    return 0;
+  }
+
+  return ex;
+}
+
+static void
+mysqlexec_bind_data(JSContext* ctx, MYSQLExecute* ex, int i, enum enum_field_types type, const void* x, size_t n) {
+  MYSQL_BIND* b = &ex->binds[i];
+
+  if((ex->data[i] = js_malloc(ctx, MAX_NUM(n, 1))))
+    memcpy(ex->data[i], x, n);
+
+  b->buffer_type = type;
+  b->buffer = ex->data[i];
+  b->buffer_length = n;
+}
+
+/**
+ * Binds one parameter in the binary protocol: integers and booleans as
+ * LONGLONG, other numbers as DOUBLE, buffers as BLOB, Dates as DATETIME
+ * strings, other objects as JSON and everything else as STRING.
+ */
+static void
+mysqlexec_bind(JSContext* ctx, MYSQLExecute* ex, int i, JSValueConst value) {
+  MYSQL_BIND* b = &ex->binds[i];
+  MYSQLNumber* num = &ex->numbers[i];
+
+  if(js_is_null_or_undefined(value)) {
+    b->buffer_type = MYSQL_TYPE_NULL;
+  } else if(JS_IsBool(value)) {
+    num->i = JS_ToBool(ctx, value);
+    b->buffer_type = MYSQL_TYPE_LONGLONG;
+    b->buffer = &num->i;
+  } else if(JS_IsBigInt(ctx, value)) {
+    JS_ToBigInt64(ctx, &num->i, value);
+    b->buffer_type = MYSQL_TYPE_LONGLONG;
+    b->buffer = &num->i;
+  } else if(JS_IsNumber(value)) {
+    double d;
+
+    JS_ToFloat64(ctx, &d, value);
+
+    if(d == (double)(int64_t)d) {
+      num->i = (int64_t)d;
+      b->buffer_type = MYSQL_TYPE_LONGLONG;
+      b->buffer = &num->i;
+    } else {
+      num->d = d;
+      b->buffer_type = MYSQL_TYPE_DOUBLE;
+      b->buffer = &num->d;
+    }
+  } else if(js_is_arraybuffer(ctx, value) || js_is_typedarray(ctx, value)) {
+    InputBuffer input = js_input_buffer(ctx, value);
+
+    mysqlexec_bind_data(ctx, ex, i, MYSQL_TYPE_BLOB, input_buffer_data(&input), input_buffer_length(&input));
+    input_buffer_free(&input, ctx);
+  } else {
+    JSValue str;
+    const char* s;
+    size_t len;
+    char* p;
+
+    if(js_is_date(ctx, value))
+      str = js_invoke(ctx, value, "toISOString", 0, 0);
+    else if(JS_IsObject(value))
+      str = JS_JSONStringify(ctx, value, JS_UNDEFINED, JS_UNDEFINED);
+    else
+      str = JS_DupValue(ctx, value);
+
+    if((s = JS_ToCStringLen(ctx, &len, str))) {
+      mysqlexec_bind_data(ctx, ex, i, MYSQL_TYPE_STRING, s, len);
+      JS_FreeCString(ctx, s);
+
+      /* 'YYYY-MM-DDTHH:MM:SS.sssZ' -> 'YYYY-MM-DD HH:MM:SS.sss' */
+      if(js_is_date(ctx, value) && (p = ex->data[i]) && len == 24) {
+        p[10] = ' ';
+        ex->binds[i].buffer_length = 23;
+      }
+    }
+
+    JS_FreeValue(ctx, str);
+  }
+}
+
+/**
+ * Fetches the stored result set into an array of rows (arrays, or
+ * objects with RESULT_OBJECT), with affectedRows and insertId set on it.
+ */
+static JSValue
+mysqlexec_rows(JSContext* ctx, MYSQLExecute* ex) {
+  MYSQL_STMT* stmt = ex->stmt->stmt;
+  MYSQL_RES* meta;
+  JSValue ret = JS_NewArray(ctx);
+
+  if((meta = mysql_stmt_result_metadata(stmt))) {
+    uint32_t i, j = 0, num_fields = mysql_num_fields(meta);
+    MYSQL_FIELD* fields = mysql_fetch_fields(meta);
+    FieldNameFunc* fn = (ex->flags & RESULT_TBLNAM) ? field_id : field_namefunc(fields, num_fields);
+    MYSQL_BIND* binds = js_mallocz(ctx, sizeof(MYSQL_BIND) * MAX_NUM(num_fields, 1));
+    unsigned long* lengths = js_mallocz(ctx, sizeof(unsigned long) * MAX_NUM(num_fields, 1));
+    my_bool* nulls = js_mallocz(ctx, sizeof(my_bool) * MAX_NUM(num_fields, 1));
+    int r;
+
+    for(i = 0; binds && i < num_fields; i++) {
+      /* numeric and temporal columns are converted to text, 64 bytes fit them all */
+      size_t size = MAX_NUM(fields[i].max_length, 64) + 1;
+
+      binds[i].buffer_type = MYSQL_TYPE_STRING;
+      binds[i].buffer = js_malloc(ctx, size);
+      binds[i].buffer_length = size;
+      binds[i].length = &lengths[i];
+      binds[i].is_null = &nulls[i];
+    }
+
+    if(binds && lengths && nulls && !mysql_stmt_bind_result(stmt, binds)) {
+      while((r = mysql_stmt_fetch(stmt)) == 0 || r == MYSQL_DATA_TRUNCATED) {
+        JSValue row = (ex->flags & RESULT_OBJECT) ? JS_NewObject(ctx) : JS_NewArray(ctx);
+
+        for(i = 0; i < num_fields; i++) {
+          char* buf = binds[i].buffer;
+          size_t len = MIN_NUM(lengths[i], binds[i].buffer_length - 1);
+          JSValue value;
+
+          if(!nulls[i])
+            buf[len] = '\0';
+
+          value = result_value(ctx, &fields[i], nulls[i] ? 0 : buf, len, ex->flags);
+
+          if(ex->flags & RESULT_OBJECT) {
+            char* id;
+
+            if((id = fn(ctx, &fields[i]))) {
+              JS_SetPropertyStr(ctx, row, id, value);
+              js_free(ctx, id);
+            } else {
+              JS_FreeValue(ctx, value);
+            }
+          } else {
+            JS_SetPropertyUint32(ctx, row, i, value);
+          }
+        }
+
+        JS_SetPropertyUint32(ctx, ret, j++, row);
+
+        if(ex->stats) {
+          size_t bytes = 0;
+
+          for(i = 0; i < num_fields; i++)
+            bytes += nulls[i] ? 0 : lengths[i];
+
+          query_stats_received(ex->stats, 1, bytes);
+        }
+      }
+    }
+
+    for(i = 0; binds && i < num_fields; i++)
+      js_free(ctx, binds[i].buffer);
+
+    js_free(ctx, binds);
+    js_free(ctx, lengths);
+    js_free(ctx, nulls);
+
+    mysql_free_result(meta);
+    mysql_stmt_free_result(stmt);
+  }
+
+  JS_SetPropertyStr(ctx, ret, "affectedRows", JS_NewInt64(ctx, mysql_stmt_affected_rows(stmt)));
+  JS_SetPropertyStr(ctx, ret, "insertId", JS_NewInt64(ctx, mysql_stmt_insert_id(stmt)));
+
+  if(ex->stats)
+    query_stats_end(ex->stats, FALSE, ctx);
+
+  return ret;
+}
+
+/**
+ * Approximates the request size as the sum of the bound parameter sizes.
+ */
+static size_t
+mysqlexec_param_bytes(MYSQLExecute* ex) {
+  size_t bytes = 0;
+
+  for(int i = 0; i < ex->count; i++)
+    bytes += ex->binds[i].buffer_length;
+
+  return bytes;
+}
+
+static void
+mysqlexec_error(JSContext* ctx, AsyncClosure* ac, MYSQL_STMT* stmt) {
+  MYSQLExecute* ex = ac->opaque;
+  JSValue error = js_mysqlerror_new(ctx, mysql_stmt_error(stmt));
+
+  if(ex->stats)
+    query_stats_end(ex->stats, TRUE, ctx);
+
+  asyncclosure_error(ac, error);
+  JS_FreeValue(ctx, error);
+}
+
+/**
+ * Advances an execute after mysql_stmt_execute or
+ * mysql_stmt_store_result completed.
+ */
+static void
+mysqlexec_step(JSContext* ctx, AsyncClosure* ac, int err) {
+  MYSQLExecute* ex = ac->opaque;
+  MYSQL_STMT* stmt = ex->stmt->stmt;
+  JSValue rows;
+
+  if(err) {
+    mysqlexec_error(ctx, ac, stmt);
+    return;
+  }
+
+  if(!ex->storing && mysql_stmt_field_count(stmt) > 0) {
+    int state;
+
+    ex->storing = TRUE;
+    state = mysql_stmt_store_result_start(&err, stmt);
+
+    if(state) {
+      asyncclosure_change_event(ac, to_asyncevent(state));
+      return;
+    }
+
+    if(err) {
+      mysqlexec_error(ctx, ac, stmt);
+      return;
+    }
+  }
+
+  rows = mysqlexec_rows(ctx, ex);
+  asyncclosure_yield(ac, rows);
+  JS_FreeValue(ctx, rows);
+}
+
+static JSValue
+js_mysqlstmt_execute_continue(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  AsyncClosure* ac = ptr;
+  MYSQLExecute* ex = ac->opaque;
+  MYSQL_STMT* stmt = ex->stmt->stmt;
+  int err = 0, state;
+
+  if(ex->storing)
+    state = mysql_stmt_store_result_cont(&err, stmt, to_mysql_wait(ac->state));
+  else
+    state = mysql_stmt_execute_cont(&err, stmt, to_mysql_wait(ac->state));
+
+  asyncclosure_change_event(ac, to_asyncevent(state));
+
+  if(ex->stats) {
+    query_stats_wakeup(ex->stats);
+
+    if(state == 0)
+      query_stats_first_byte(ex->stats);
+  }
+
+  if(state == 0)
+    mysqlexec_step(ctx, ac, err);
+
+  return JS_UNDEFINED;
+}
+
+static JSValue
+mysqlstmt_execute(JSContext* ctx, JSValueConst stmt_obj, MYSQLExecute* ex) {
+  MYSQLStatement* st = ex->stmt;
+  JSValue conn = JS_GetPropertyStr(ctx, stmt_obj, "handle");
+  MYSQL* my = js_mysql_data(conn);
+  JSValue ret;
+
+  ex->flags = js_get_propertystr_int32(ctx, conn, "resultType");
+
+  if(!my || !st->cache) {
+    ret = JS_ThrowInternalError(ctx, "MySQLStatement connection closed");
+    mysqlexec_free(JS_GetRuntime(ctx), ex);
+  } else if(mysql_stmt_bind_param(st->stmt, ex->binds)) {
+    ret = JS_Throw(ctx, js_mysqlerror_new(ctx, mysql_stmt_error(st->stmt)));
+    mysqlexec_free(JS_GetRuntime(ctx), ex);
+  } else if(!mysql_nonblock(my)) {
+    if((ex->stats = mysql_query_stats(ctx, my, FALSE)))
+      query_stats_begin(ex->stats, mysqlexec_param_bytes(ex));
+
+    if(mysql_stmt_execute(st->stmt) || (mysql_stmt_field_count(st->stmt) > 0 && mysql_stmt_store_result(st->stmt))) {
+      if(ex->stats)
+        query_stats_end(ex->stats, TRUE, ctx);
+
+      ret = JS_Throw(ctx, js_mysqlerror_new(ctx, mysql_stmt_error(st->stmt)));
+    } else
+      ret = mysqlexec_rows(ctx, ex);
+
+    mysqlexec_free(JS_GetRuntime(ctx), ex);
+  } else {
+    AsyncClosure* ac;
+    int err = 0, state;
+
+    if((ex->stats = mysql_query_stats(ctx, my, FALSE)))
+      query_stats_begin(ex->stats, mysqlexec_param_bytes(ex));
+
+    state = mysql_stmt_execute_start(&err, st->stmt);
+
+    ac = asyncclosure_new(ctx, js_mysql_fd(ctx, conn), to_asyncevent(state), JS_UNDEFINED, &js_mysqlstmt_execute_continue);
+    asyncclosure_opaque(ac, ex, mysqlexec_free);
+
+    if(state == 0)
+      mysqlexec_step(ctx, ac, err);
+
+    ret = asyncclosure_promise(ac);
+  }
+
+  JS_FreeValue(ctx, conn);
+  return ret;
+}
+
+static JSValue
+js_mysqlstmt_execute(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  MYSQLStatement* st;
+  MYSQLExecute* ex;
+
+  if(!(st = JS_GetOpaque2(ctx, this_val, js_mysqlstmt_class_id)))
+    return JS_EXCEPTION;
+
+  if((int)mysql_stmt_param_count(st->stmt) != argc)
+    return JS_ThrowRangeError(ctx, "statement expects %lu parameters, got %d", (unsigned long)mysql_stmt_param_count(st->stmt), argc);
+
+  if(!(ex = mysqlexec_new(ctx, st, argc)))
+    return JS_EXCEPTION;
+
+  for(int i = 0; i < argc; i++)
+    mysqlexec_bind(ctx, ex, i, argv[i]);
+
+  return mysqlstmt_execute(ctx, this_val, ex);
+}
+
+static JSValue
+js_mysqlstmt_execute_array(JSContext* ctx, JSValueConst stmt_obj, JSValueConst array) {
+  int64_t i, len = js_array_length(ctx, array);
+  JSValue *args, ret;
+
+  if(!(args = js_mallocz(ctx, sizeof(JSValue) * MAX_NUM(len, 1))))
+    return JS_EXCEPTION;
+
+  for(i = 0; i < len; i++)
+    args[i] = JS_GetPropertyUint32(ctx, array, i);
+
+  ret = js_mysqlstmt_execute(ctx, stmt_obj, len, args);
+
+  for(i = 0; i < len; i++)
+    JS_FreeValue(ctx, args[i]);
+
+  js_free(ctx, args);
+  return ret;
+}
+
+static JSValue
+js_mysql_query_prepared(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, JSValue data[]) {
+  return js_mysqlstmt_execute_array(ctx, argv[0], data[0]);
+}
+
+/**
+ * query(sql, params): runs sql through the statement cache.
+ */
+static JSValue
+js_mysql_query_params(JSContext* ctx, JSValueConst this_val, JSValueConst sql, JSValueConst params) {
+  JSValue stmt, ret;
+
+  stmt = js_mysql_prepare(ctx, this_val, 1, &sql);
+
+  if(JS_IsException(stmt))
+    return stmt;
+
+  if(js_is_promise(ctx, stmt)) {
+    JSValue handler = JS_NewCFunctionData(ctx, js_mysql_query_prepared, 1, 0, 1, &params);
+
+    ret = promise_then(ctx, stmt, handler);
+    JS_FreeValue(ctx, handler);
+  } else {
+    ret = js_mysqlstmt_execute_array(ctx, stmt, params);
+  }
+
+  JS_FreeValue(ctx, stmt);
+  return ret;
+}
+
+enum {
+  STMT_SQL,
+  STMT_CACHED,
+  STMT_PARAM_COUNT,
+  STMT_FIELD_COUNT,
+};
+
+static JSValue
+js_mysqlstmt_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  MYSQLStatement* st;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(st = JS_GetOpaque2(ctx, this_val, js_mysqlstmt_class_id)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case STMT_SQL: {
+      ret = JS_NewString(ctx, st->sql);
+      break;
+    }
+
+    case STMT_CACHED: {
+      ret = JS_NewBool(ctx, st->cached);
+      break;
+    }
+
+    case STMT_PARAM_COUNT: {
+      ret = JS_NewUint32(ctx, mysql_stmt_param_count(st->stmt));
+      break;
+    }
+
+    case STMT_FIELD_COUNT: {
+      ret = JS_NewUint32(ctx, mysql_stmt_field_count(st->stmt));
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static void
+js_mysqlstmt_finalizer(JSRuntime* rt, JSValue val) {
+  MYSQLStatement* st;
+
+  if((st = JS_GetOpaque(val, js_mysqlstmt_class_id)))
+    mysqlstmt_free(rt, st);
+}
+
+static JSClassDef js_mysqlstmt_class = {
+    .class_name = "MySQLStatement",
+    .finalizer = js_mysqlstmt_finalizer,
+};
+
+static const JSCFunctionListEntry js_mysqlstmt_funcs[] = {
+    JS_CFUNC_DEF("execute", 0, js_mysqlstmt_execute),
+    JS_CGETSET_MAGIC_DEF("sql", js_mysqlstmt_get, 0, STMT_SQL),
+    JS_CGETSET_MAGIC_DEF("cached", js_mysqlstmt_get, 0, STMT_CACHED),
+    JS_CGETSET_MAGIC_DEF("paramCount", js_mysqlstmt_get, 0, STMT_PARAM_COUNT),
+    JS_CGETSET_MAGIC_DEF("fieldCount", js_mysqlstmt_get, 0, STMT_FIELD_COUNT),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "MySQLStatement", JS_PROP_CONFIGURABLE),
+};
+
+typedef enum {
+  BATCH_START = 0,
+  BATCH_OPTION,
+  BATCH_QUERY,
+  BATCH_STORE,
+  BATCH_STORED,
+  BATCH_NEXT,
+  BATCH_RESTORE,
+  BATCH_DONE,
+} BatchStep;
+
+typedef struct {
+  int ref_count;
+  MYSQL* my;
+  JSValue conn;
+  DynBuf sql;
+  BatchStep step;
+  BOOL busy, draining, enabled;
+  JSValue error;
+} MYSQLBatch;
+
+static JSClassID js_mysqlbatch_class_id;
+static JSValue mysqlbatch_proto;
+
+static MYSQLBatch*
+mysqlbatch_dup(MYSQLBatch* b) {
+  ++b->ref_count;
+  return b;
+}
+
+static void
+mysqlbatch_release(JSRuntime* rt, void* ptr) {
+  MYSQLBatch* b = ptr;
+
+  if(--b->ref_count == 0) {
+    JS_FreeValueRT(rt, b->conn);
+    JS_FreeValueRT(rt, b->error);
+    dbuf_free(&b->sql);
+    js_free_rt(rt, b);
+  }
+}
+
+/**
+ * Settles the pending next() or return() with a result set, or with
+ * { affectedRows, insertId, warningCount } for a statement without one.
+ */
+static void
+mysqlbatch_yield(JSContext* ctx, AsyncClosure* ac, MYSQLBatch* b, MYSQL_RES* res) {
+  JSValue value, item;
+
+  if(res) {
+    value = js_mysqlresult_new(ctx, JS_NULL, res);
+    JS_DefinePropertyValueStr(ctx, value, "handle", JS_DupValue(ctx, b->conn), JS_PROP_CONFIGURABLE);
+  } else {
+    value = JS_NewObject(ctx);
+    JS_SetPropertyStr(ctx, value, "affectedRows", JS_NewInt64(ctx, mysql_affected_rows(b->my)));
+    JS_SetPropertyStr(ctx, value, "insertId", JS_NewInt64(ctx, mysql_insert_id(b->my)));
+    JS_SetPropertyStr(ctx, value, "warningCount", JS_NewUint32(ctx, mysql_warning_count(b->my)));
+  }
+
+  item = js_iterator_result(ctx, value, FALSE);
+  JS_FreeValue(ctx, value);
+
+  b->busy = FALSE;
+  asyncclosure_yield(ac, item);
+  JS_FreeValue(ctx, item);
+}
+
+/**
+ * Runs the batch until the next result has been stored or the connection
+ * has to wait. \p err and \p res are the outcome of the step that was
+ * started last. Once the results are exhausted (or a statement failed),
+ * multi-statement support is turned off again if the batch turned it on.
+ */
+static int
+mysqlbatch_advance(JSContext* ctx, AsyncClosure* ac, int err, MYSQL_RES* res) {
+  MYSQLBatch* b = ac->opaque;
+  MYSQL* my = b->my;
+  int state = 0;
+
+  for(;;) {
+    if(b->step == BATCH_STORE && !res && mysql_errno(my))
+      err = 1;
+
+    if(err > 0) {
+      JSValue error = js_mysqlerror_new(ctx, mysql_error(my));
+
+      if(b->enabled && b->step != BATCH_RESTORE) {
+        JS_FreeValue(ctx, b->error);
+        b->error = error;
+        b->step = BATCH_RESTORE;
+        err = 0;
+
+        if((state = mysql_set_server_option_start(&err, my, MYSQL_OPTION_MULTI_STATEMENTS_OFF)))
+          return state;
+
+        continue;
+      }
+
+      if(JS_IsUndefined(b->error)) {
+        b->error = error;
+      } else {
+        JS_FreeValue(ctx, error);
+      }
+
+      b->step = BATCH_DONE;
+    }
+
+    /* a failed statement is reported after the option has been restored */
+    if(b->step == BATCH_DONE && !JS_IsUndefined(b->error)) {
+      JSValue error = b->error;
+      b->error = JS_UNDEFINED;
+      b->busy = FALSE;
+      asyncclosure_error(ac, error);
+      JS_FreeValue(ctx, error);
+      return 0;
+    }
+
+    switch(b->step) {
+      case BATCH_START: {
+        b->step = BATCH_OPTION;
+
+        if(!(my->client_flag & CLIENT_MULTI_STATEMENTS))
+          state = mysql_set_server_option_start(&err, my, MYSQL_OPTION_MULTI_STATEMENTS_ON);
+        break;
+      }
+
+      case BATCH_OPTION: {
+        if(!(my->client_flag & CLIENT_MULTI_STATEMENTS)) {
+          my->client_flag |= CLIENT_MULTI_STATEMENTS;
+          b->enabled = TRUE;
+        }
+
+        b->step = BATCH_QUERY;
+        state = mysql_real_query_start(&err, my, (const char*)b->sql.buf, b->sql.size);
+        break;
+      }
+
+      case BATCH_QUERY:
+      case BATCH_NEXT: {
+        b->step = BATCH_STORE;
+        state = mysql_store_result_start(&res, my);
+        break;
+      }
+
+      case BATCH_STORE: {
+        b->step = BATCH_STORED;
+
+        if(!b->draining) {
+          mysqlbatch_yield(ctx, ac, b, res);
+          return 0;
+        }
+
+        if(res)
+          mysql_free_result(res);
+        break;
+      }
+
+      case BATCH_STORED: {
+        if(!mysql_more_results(my)) {
+          if(b->enabled) {
+            b->step = BATCH_RESTORE;
+            state = mysql_set_server_option_start(&err, my, MYSQL_OPTION_MULTI_STATEMENTS_OFF);
+          } else {
+            b->step = BATCH_DONE;
+          }
+          break;
+        }
+
+        b->step = BATCH_NEXT;
+        res = 0;
+        state = mysql_next_result_start(&err, my);
+        break;
+      }
+
+      case BATCH_RESTORE: {
+        my->client_flag &= ~CLIENT_MULTI_STATEMENTS;
+        b->enabled = FALSE;
+        b->step = BATCH_DONE;
+        break;
+      }
+
+      case BATCH_DONE: {
+        JSValue item = js_iterator_result(ctx, JS_UNDEFINED, TRUE);
+        b->busy = FALSE;
+        asyncclosure_yield(ac, item);
+        JS_FreeValue(ctx, item);
+        return 0;
+      }
+    }
+
+    if(state)
+      return state;
+  }
+}
+
+static JSValue
+js_mysqlbatch_continue(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  AsyncClosure* ac = ptr;
+  MYSQLBatch* b = ac->opaque;
+  MYSQL_RES* res = 0;
+  int err = 0, state;
+
+  switch(b->step) {
+    case BATCH_OPTION: state = mysql_set_server_option_cont(&err, b->my, to_mysql_wait(ac->state)); break;
+    case BATCH_QUERY: state = mysql_real_query_cont(&err, b->my, to_mysql_wait(ac->state)); break;
+    case BATCH_STORE: state = mysql_store_result_cont(&res, b->my, to_mysql_wait(ac->state)); break;
+    case BATCH_NEXT: state = mysql_next_result_cont(&err, b->my, to_mysql_wait(ac->state)); break;
+    case BATCH_RESTORE: state = mysql_set_server_option_cont(&err, b->my, to_mysql_wait(ac->state)); break;
+    default: state = 0; break;
+  }
+
+  if(state == 0)
+    state = mysqlbatch_advance(ctx, ac, err, res);
+
+  asyncclosure_change_event(ac, to_asyncevent(state));
+
+  return JS_UNDEFINED;
+}
+
+enum {
+  BATCH_METHOD_NEXT = 0,
+  BATCH_METHOD_RETURN,
+};
+
+static JSValue
+js_mysqlbatch_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  MYSQLBatch* b;
+  AsyncClosure* ac;
+
+  if(!(b = JS_GetOpaque2(ctx, this_val, js_mysqlbatch_class_id)))
+    return JS_EXCEPTION;
+
+  if(b->busy)
+    return JS_ThrowInternalError(ctx, "MySQLBatch: previous %s() still pending", magic == BATCH_METHOD_RETURN ? "return" : "next");
+
+  if(magic == BATCH_METHOD_RETURN)
+    b->draining = TRUE;
+
+  b->busy = TRUE;
+
+  ac = asyncclosure_new(ctx, js_mysql_fd(ctx, b->conn), WANT_NONE, JS_NULL, &js_mysqlbatch_continue);
+  asyncclosure_opaque(ac, mysqlbatch_dup(b), mysqlbatch_release);
+  asyncclosure_change_event(ac, to_asyncevent(mysqlbatch_advance(ctx, ac, 0, 0)));
+
+  return asyncclosure_promise(ac);
+}
+
+static JSValue
+js_mysqlbatch_iterator(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  return JS_DupValue(ctx, this_val);
+}
+
+static void
+js_mysqlbatch_finalizer(JSRuntime* rt, JSValue val) {
+  MYSQLBatch* b;
+
+  if((b = JS_GetOpaque(val, js_mysqlbatch_class_id)))
+    mysqlbatch_release(rt, b);
+}
+
+static void
+js_mysqlbatch_mark(JSRuntime* rt, JSValueConst val, JS_MarkFunc* mark_func) {
+  MYSQLBatch* b;
+
+  if((b = JS_GetOpaque(val, js_mysqlbatch_class_id)))
+    JS_MarkValue(rt, b->conn, mark_func);
+}
+
+static JSClassDef js_mysqlbatch_class = {
+    .class_name = "MySQLBatch",
+    .finalizer = js_mysqlbatch_finalizer,
+    .gc_mark = js_mysqlbatch_mark,
+};
+
+static const JSCFunctionListEntry js_mysqlbatch_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("next", 0, js_mysqlbatch_method, BATCH_METHOD_NEXT),
+    JS_CFUNC_MAGIC_DEF("return", 0, js_mysqlbatch_method, BATCH_METHOD_RETURN),
+    JS_CFUNC_DEF("[Symbol.asyncIterator]", 0, js_mysqlbatch_iterator),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "MySQLBatch", JS_PROP_CONFIGURABLE),
+};
+
+/**
+ * queryBatch([sql, ...]): sends the statements in one round trip and
+ * returns an async iterator over their results, one per statement.
+ * Multi-statement support is enabled on the connection for the batch
+ * only and turned off again after its last result.
+ * Stopping early (return()) reads and discards the remaining results,
+ * the connection stays usable.
+ */
+static JSValue
+js_mysql_query_batch(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  MYSQLBatch* b;
+  MYSQL* my;
+  JSValue obj;
+  int64_t i, n;
+
+  if(!(my = js_mysql_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(!JS_IsArray(ctx, argv[0]))
+    return JS_ThrowTypeError(ctx, "argument 1 must be an array of statements");
+
+  if(!(b = js_mallocz(ctx, sizeof(MYSQLBatch))))
+    return JS_EXCEPTION;
+
+  b->ref_count = 1;
+  b->my = my;
+  b->conn = JS_DupValue(ctx, this_val);
+  b->error = JS_UNDEFINED;
+  js_dbuf_init_rt(JS_GetRuntime(ctx), &b->sql);
+
+  n = js_array_length(ctx, argv[0]);
+
+  for(i = 0; i < n; i++) {
+    JSValue item = JS_GetPropertyUint32(ctx, argv[0], i);
+    size_t len;
+    const char* s = JS_ToCStringLen(ctx, &len, item);
+
+    JS_FreeValue(ctx, item);
+
+    if(!s) {
+      mysqlbatch_release(JS_GetRuntime(ctx), b);
+      return JS_EXCEPTION;
+    }
+
+    while(len > 0 && (is_whitespace_char(s[len - 1]) || s[len - 1] == ';'))
+      --len;
+
+    if(len) {
+      if(b->sql.size)
+        dbuf_putstr(&b->sql, ";\n");
+
+      dbuf_put(&b->sql, (const uint8_t*)s, len);
+    }
+
+    JS_FreeCString(ctx, s);
+  }
+
+  if(b->sql.size == 0) {
+    mysqlbatch_release(JS_GetRuntime(ctx), b);
+    return JS_ThrowRangeError(ctx, "queryBatch() needs at least one statement");
+  }
+
+  obj = JS_NewObjectProtoClass(ctx, mysqlbatch_proto, js_mysqlbatch_class_id);
+  JS_SetOpaque(obj, b);
+
+  return obj;
+}
+
+static JSValue
+js_mysql_close(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  JSValue ret = JS_UNDEFINED;
+  MYSQL* my;
+  AsyncClosure* ac;
+  int fd = -1;
+
+  if(!(my = js_mysql_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+#ifdef _WIN32
+  if(js_has_propertystr(ctx, this_val, "fd")) {
+    fd = js_get_propertystr_int32(ctx, this_val, "fd");
+    _close(fd);
+  }
+#else
+  fd = mysql_get_socket(my);
+#endif
+
+  if(fd > -1)
+    if((ac = asyncclosure_lookup(fd)))
+      asyncclosure_done(ac);
+
+  mysql_statement_cache_free(JS_GetRuntime(ctx), my);
+  mysql_query_stats_free(JS_GetRuntime(ctx), my);
+  mysql_close(my);
+
+  JS_SetOpaque(this_val, 0);
+
+  return ret;
+}
+
+static void
+js_mysql_finalizer(JSRuntime* rt, JSValue val) {
+  MYSQL* my;
+
+  if((my = JS_GetOpaque(val, js_mysql_class_id))) {
+    mysql_statement_cache_free(rt, my);
+    mysql_query_stats_free(rt, my);
+    mysql_close(my);
+  }
+}
+
+static JSClassDef js_mysql_class = {
+    .class_name = "MySQL",
+    .finalizer = js_mysql_finalizer,
+};
+
+static const JSCFunctionListEntry js_mysql_funcs[] = {
+    JS_CGETSET_MAGIC_DEF("moreResults", js_mysql_get, 0, PROP_MORE_RESULTS),
+    JS_CGETSET_MAGIC_DEF("affectedRows", js_mysql_get, 0, PROP_AFFECTED_ROWS),
+    JS_CGETSET_MAGIC_DEF("warningCount", js_mysql_get, 0, PROP_WARNING_COUNT),
+    JS_CGETSET_MAGIC_DEF("fieldCount", js_mysql_get, 0, PROP_FIELD_COUNT),
+#ifndef _WIN32
+    JS_CGETSET_MAGIC_DEF("fd", js_mysql_get, 0, PROP_SOCKET),
+#endif
+    JS_CGETSET_MAGIC_DEF("socket", js_mysql_get, 0, PROP_SOCKET),
+    JS_CGETSET_MAGIC_DEF("errno", js_mysql_get, 0, PROP_ERRNO),
+    JS_CGETSET_MAGIC_DEF("error", js_mysql_get, 0, PROP_ERROR),
+    JS_CGETSET_MAGIC_DEF("info", js_mysql_get, 0, PROP_INFO),
+    JS_CGETSET_MAGIC_DEF("insertId", js_mysql_get, 0, PROP_INSERT_ID),
+    JS_CGETSET_MAGIC_DEF("charset", js_mysql_get, 0, PROP_CHARSET),
+    JS_CGETSET_MAGIC_DEF("timeout", js_mysql_get, 0, PROP_TIMEOUT),
+    JS_CGETSET_MAGIC_DEF("timeoutMs", js_mysql_get, 0, PROP_TIMEOUT_MS),
+    JS_CGETSET_MAGIC_DEF("serverName", js_mysql_get, 0, PROP_SERVER_NAME),
+    JS_CGETSET_MAGIC_DEF("serverInfo", js_mysql_get, 0, PROP_SERVER_INFO),
+    JS_CGETSET_MAGIC_DEF("serverVersion", js_mysql_get, 0, PROP_SERVER_VERSION),
+    JS_CGETSET_MAGIC_DEF("user", js_mysql_get, 0, PROP_USER),
+    JS_CGETSET_MAGIC_DEF("password", js_mysql_get, 0, PROP_PASSWORD),
+    JS_CGETSET_MAGIC_DEF("host", js_mysql_get, 0, PROP_HOST),
+    JS_CGETSET_MAGIC_DEF("port", js_mysql_get, 0, PROP_PORT),
+    JS_CGETSET_MAGIC_DEF("socket", js_mysql_get, 0, PROP_UNIX_SOCKET),
+    JS_CGETSET_MAGIC_DEF("db", js_mysql_get, 0, PROP_DB),
+    JS_CGETSET_MAGIC_DEF("status", js_mysql_get, 0, PROP_STATUS),
+    JS_CGETSET_MAGIC_DEF("pending", js_mysql_get, 0, PROP_PENDING),
+    JS_CGETSET_MAGIC_DEF("collectStats", js_mysql_get, js_mysql_set, PROP_COLLECT_STATS),
+    JS_CGETSET_MAGIC_DEF("stats", js_mysql_get, 0, PROP_STATS),
+    JS_CGETSET_MAGIC_DEF("onQueryStats", js_mysql_get, js_mysql_set, PROP_STATS_HOOK),
+    JS_CGETSET_MAGIC_DEF("statementCacheSize", js_mysql_get, js_mysql_set, PROP_STATEMENT_CACHE_SIZE),
+    JS_CFUNC_DEF("connect", 1, js_mysql_connect),
+    JS_CFUNC_DEF("query", 1, js_mysql_query),
+    JS_CFUNC_DEF("queryBatch", 1, js_mysql_query_batch),
+    JS_CFUNC_DEF("prepare", 1, js_mysql_prepare),
+    JS_CFUNC_DEF("close", 0, js_mysql_close),
+    JS_ALIAS_DEF("execute", "query"),
+    JS_CFUNC_MAGIC_DEF("escapeString", 1, js_mysql_methods, METHOD_ESCAPE_STRING),
+    JS_CFUNC_MAGIC_DEF("getOption", 1, js_mysql_methods, METHOD_GET_OPTION),
+    JS_CFUNC_MAGIC_DEF("setOption", 2, js_mysql_methods, METHOD_SET_OPTION),
+    JS_CFUNC_MAGIC_DEF("resetStats", 0, js_mysql_methods, METHOD_RESET_STATS),
+    JS_PROP_INT32_DEF("resultType", 0, JS_PROP_C_W_E),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "MySQL", JS_PROP_CONFIGURABLE),
+};
+
+static const JSCFunctionListEntry js_mysql_static[] = {
+    JS_CGETSET_MAGIC_DEF("clientInfo", js_mysql_getstatic, 0, PROP_CLIENT_INFO),
+    JS_CGETSET_MAGIC_DEF("clientVersion", js_mysql_getstatic, 0, PROP_CLIENT_VERSION),
+    JS_CGETSET_MAGIC_DEF("threadSafe", js_mysql_getstatic, 0, PROP_THREAD_SAFE),
+    JS_CFUNC_DEF("escapeString", 1, js_mysql_escape_string),
+    JS_CFUNC_DEF("valueString", 0, js_mysql_value_string),
+    JS_CFUNC_DEF("valuesString", 1, js_mysql_values_string),
+    JS_CFUNC_DEF("insertQuery", 2, js_mysql_insert_query),
+};
+
+static const JSCFunctionListEntry js_mysql_defines[] = {
+    JS_PROP_INT32_DEF("RESULT_OBJECT", RESULT_OBJECT, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("RESULT_STRING", RESULT_STRING, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("RESULT_TBLNAM", RESULT_TBLNAM, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT64_DEF("COUNT_ERROR", MYSQL_COUNT_ERROR, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("DATABASE_DRIVER", MYSQL_DATABASE_DRIVER, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("DEFAULT_AUTH", MYSQL_DEFAULT_AUTH, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("ENABLE_CLEARTEXT_PLUGIN", MYSQL_ENABLE_CLEARTEXT_PLUGIN, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("INIT_COMMAND", MYSQL_INIT_COMMAND, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("STATUS_READY", MYSQL_STATUS_READY, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("STATUS_GET_RESULT", MYSQL_STATUS_GET_RESULT, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("STATUS_USE_RESULT", MYSQL_STATUS_USE_RESULT, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("STATUS_QUERY_SENT", MYSQL_STATUS_QUERY_SENT, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("STATUS_SENDING_LOAD_DATA", MYSQL_STATUS_SENDING_LOAD_DATA, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("STATUS_FETCHING_DATA", MYSQL_STATUS_FETCHING_DATA, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("STATUS_NEXT_RESULT_PENDING", MYSQL_STATUS_NEXT_RESULT_PENDING, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("STATUS_QUIT_SENT", MYSQL_STATUS_QUIT_SENT, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("STATUS_STMT_RESULT", MYSQL_STATUS_STMT_RESULT, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_BIND", MYSQL_OPT_BIND, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_CAN_HANDLE_EXPIRED_PASSWORDS", MYSQL_OPT_CAN_HANDLE_EXPIRED_PASSWORDS, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_COMPRESS", MYSQL_OPT_COMPRESS, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_CONNECT_ATTR_ADD", MYSQL_OPT_CONNECT_ATTR_ADD, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_CONNECT_ATTR_DELETE", MYSQL_OPT_CONNECT_ATTR_DELETE, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_CONNECT_ATTR_RESET", MYSQL_OPT_CONNECT_ATTR_RESET, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_CONNECT_ATTRS", MYSQL_OPT_CONNECT_ATTRS, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_CONNECT_TIMEOUT", MYSQL_OPT_CONNECT_TIMEOUT, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_GUESS_CONNECTION", MYSQL_OPT_GUESS_CONNECTION, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_LOCAL_INFILE", MYSQL_OPT_LOCAL_INFILE, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_MAX_ALLOWED_PACKET", MYSQL_OPT_MAX_ALLOWED_PACKET, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_NAMED_PIPE", MYSQL_OPT_NAMED_PIPE, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_NET_BUFFER_LENGTH", MYSQL_OPT_NET_BUFFER_LENGTH, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_NONBLOCK", MYSQL_OPT_NONBLOCK, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_PROTOCOL", MYSQL_OPT_PROTOCOL, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_READ_TIMEOUT", MYSQL_OPT_READ_TIMEOUT, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_RECONNECT", MYSQL_OPT_RECONNECT, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_SSL_CA", MYSQL_OPT_SSL_CA, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_SSL_CAPATH", MYSQL_OPT_SSL_CAPATH, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_SSL_CERT", MYSQL_OPT_SSL_CERT, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_SSL_CIPHER", MYSQL_OPT_SSL_CIPHER, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_SSL_CRL", MYSQL_OPT_SSL_CRL, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_SSL_CRLPATH", MYSQL_OPT_SSL_CRLPATH, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_SSL_ENFORCE", MYSQL_OPT_SSL_ENFORCE, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_SSL_KEY", MYSQL_OPT_SSL_KEY, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_SSL_VERIFY_SERVER_CERT", MYSQL_OPT_SSL_VERIFY_SERVER_CERT, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_TLS_VERSION", MYSQL_OPT_TLS_VERSION, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_USE_EMBEDDED_CONNECTION", MYSQL_OPT_USE_EMBEDDED_CONNECTION, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_USE_REMOTE_CONNECTION", MYSQL_OPT_USE_REMOTE_CONNECTION, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_USE_RESULT", MYSQL_OPT_USE_RESULT, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("OPT_WRITE_TIMEOUT", MYSQL_OPT_WRITE_TIMEOUT, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("PLUGIN_DIR", MYSQL_PLUGIN_DIR, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("PROGRESS_CALLBACK", MYSQL_PROGRESS_CALLBACK, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("READ_DEFAULT_FILE", MYSQL_READ_DEFAULT_FILE, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("READ_DEFAULT_GROUP", MYSQL_READ_DEFAULT_GROUP, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("REPORT_DATA_TRUNCATION", MYSQL_REPORT_DATA_TRUNCATION, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("SECURE_AUTH", MYSQL_SECURE_AUTH, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("SERVER_PUBLIC_KEY", MYSQL_SERVER_PUBLIC_KEY, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("SET_CHARSET_DIR", MYSQL_SET_CHARSET_DIR, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("SET_CHARSET_NAME", MYSQL_SET_CHARSET_NAME, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("SET_CLIENT_IP", MYSQL_SET_CLIENT_IP, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("SHARED_MEMORY_BASE_NAME", MYSQL_SHARED_MEMORY_BASE_NAME, JS_PROP_CONFIGURABLE),
+};
+
+static JSValue
+mysqlpool_connect(JSContext* ctx, int argc, JSValueConst argv[]) {
+  JSValue obj, ret;
+  MYSQL* my;
+
+  if(!(my = mysql_init(NULL)))
+    return JS_ThrowOutOfMemory(ctx);
+
+  mysql_options(my, MYSQL_OPT_NONBLOCK, 0);
+
+  if(JS_IsException((obj = js_mysql_new(ctx, mysql_proto, my)))) {
+    mysql_close(my);
+    return JS_EXCEPTION;
+  }
+
+  ret = js_mysql_connect(ctx, obj, argc, argv);
+  JS_FreeValue(ctx, obj);
+  return ret;
+}
+
+static BOOL
+mysqlpool_healthy(JSContext* ctx, JSValueConst conn) {
+  MYSQL* my;
+
+  if(!(my = js_mysql_data(conn)))
+    return FALSE;
+
+  return (int)mysql_get_socket(my) >= 0;
+}
+
+static void
+mysqlpool_close(JSContext* ctx, JSValueConst conn) {
+  if(js_mysql_data(conn))
+    JS_FreeValue(ctx, js_mysql_close(ctx, conn, 0, 0));
+}
+
+static const ConnPoolBackend mysqlpool_backend = {
+    .name = "MySQLPool",
+    .connect = mysqlpool_connect,
+    .healthy = mysqlpool_healthy,
+    .close = mysqlpool_close,
+};
+
+enum {
+  POOL_ACQUIRE,
+  POOL_RELEASE,
+  POOL_CLOSE,
+};
+
+enum {
+  POOL_SIZE,
+  POOL_IDLE,
+  POOL_WAITING,
+  POOL_MIN,
+  POOL_MAX,
+  POOL_STATS,
+};
+
+static JSValue
+js_mysqlpool_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  JSValue proto, obj = JS_UNDEFINED;
+  ConnPool* cp;
+
+  if(js_mysqlpool_class_id == 0)
+    js_mysql_init(ctx, 0);
+
+  /* using new_target to get the prototype is necessary when the class is extended. */
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  if(JS_IsException(proto))
+    goto fail;
+
+  obj = JS_NewObjectProtoClass(ctx, proto, js_mysqlpool_class_id);
+  JS_FreeValue(ctx, proto);
+  if(JS_IsException(obj))
+    goto fail;
+
+  if(!(cp = connpool_new(ctx, &mysqlpool_backend, MAX_NUM(argc - 1, 0), argv + 1)))
+    goto fail;
+
+  if(argc > 0)
+    connpool_options(cp, argv[0]);
+
+  JS_SetOpaque(obj, cp);
+
+  connpool_fill(cp);
+  return obj;
+
+fail:
+  JS_FreeValue(ctx, obj);
+  return JS_EXCEPTION;
+}
+
+static JSValue
+js_mysqlpool_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  JSValue ret = JS_UNDEFINED;
+  ConnPool* cp;
+
+  if(!(cp = JS_GetOpaque2(ctx, this_val, js_mysqlpool_class_id)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case POOL_ACQUIRE: {
+      ret = connpool_acquire(cp);
+      break;
+    }
+
+    case POOL_RELEASE: {
+      if(!connpool_release(cp, argv[0]))
+        ret = JS_ThrowTypeError(ctx, "argument 1 must be a MySQL connection acquired from this pool");
+      break;
+    }
+
+    case POOL_CLOSE: {
+      connpool_close(cp);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static JSValue
+js_mysqlpool_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  JSValue ret = JS_UNDEFINED;
+  ConnPool* cp;
+
+  if(!(cp = JS_GetOpaque2(ctx, this_val, js_mysqlpool_class_id)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case POOL_SIZE: {
+      ret = JS_NewUint32(ctx, cp->size);
+      break;
+    }
+
+    case POOL_IDLE: {
+      ret = JS_NewUint32(ctx, cp->nidle);
+      break;
+    }
+
+    case POOL_WAITING: {
+      ret = JS_NewUint32(ctx, cp->nwaiting);
+      break;
+    }
+
+    case POOL_MIN: {
+      ret = JS_NewUint32(ctx, cp->min);
+      break;
+    }
+
+    case POOL_MAX: {
+      ret = JS_NewUint32(ctx, cp->max);
+      break;
+    }
+
+    case POOL_STATS: {
+      ret = connpool_stats(cp);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static void
+js_mysqlpool_finalizer(JSRuntime* rt, JSValue val) {
+  ConnPool* cp;
+
+  if((cp = JS_GetOpaque(val, js_mysqlpool_class_id)))
+    connpool_free(cp);
+}
+
+static JSClassDef js_mysqlpool_class = {
+    .class_name = "MySQLPool",
+    .finalizer = js_mysqlpool_finalizer,
+};
+
+static const JSCFunctionListEntry js_mysqlpool_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("acquire", 0, js_mysqlpool_method, POOL_ACQUIRE),
+    JS_CFUNC_MAGIC_DEF("release", 1, js_mysqlpool_method, POOL_RELEASE),
+    JS_CFUNC_MAGIC_DEF("close", 0, js_mysqlpool_method, POOL_CLOSE),
+    JS_CGETSET_MAGIC_DEF("size", js_mysqlpool_get, 0, POOL_SIZE),
+    JS_CGETSET_MAGIC_DEF("idle", js_mysqlpool_get, 0, POOL_IDLE),
+    JS_CGETSET_MAGIC_DEF("waiting", js_mysqlpool_get, 0, POOL_WAITING),
+    JS_CGETSET_MAGIC_DEF("min", js_mysqlpool_get, 0, POOL_MIN),
+    JS_CGETSET_MAGIC_DEF("max", js_mysqlpool_get, 0, POOL_MAX),
+    JS_CGETSET_MAGIC_DEF("stats", js_mysqlpool_get, 0, POOL_STATS),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "MySQLPool", JS_PROP_CONFIGURABLE),
+};
+
+static JSValue
+js_mysqlerror_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  JSValue obj, proto;
+  JSAtom prop;
+
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  if(JS_IsException(proto))
+    return JS_EXCEPTION;
+
+  if(!JS_IsObject(proto))
+    proto = JS_DupValue(ctx, mysqlerror_proto);
+
+  obj = JS_NewObjectProtoClass(ctx, proto, js_mysqlerror_class_id);
+  JS_FreeValue(ctx, proto);
 
   if(argc > 0) {
     prop = JS_NewAtom(ctx, "message");
@@ -1459,6 +2981,8 @@ result_iterator_value(ResultIterator* ri, MYSQL_ROW row, AsyncClosure* ac) {
   JSValue result = JS_UNDEFINED;
   JSContext* ctx = ac->ctx;
 
+  mysql_query_stats_row(ctx, ri->conn, ri->res, row);
+
   if(row)
     if(mysql_num_fields(ri->res) == ri->field_count)
       result = result_row(ctx, ri->res, row, ri->flags);
@@ -1532,6 +3056,8 @@ js_mysqlresult_next_continue(JSContext* ctx, JSValueConst this_val, int argc, JS
   asyncclosure_change_event(ac, as);
 
   if(state == 0) {
+    mysql_query_stats_row(ctx, ri->conn, res, row);
+
     if(row) {
       if(mysql_num_fields(res) == ri->field_count) {
         ac->result = result_row(ctx, res, row, ri->flags);
@@ -1579,6 +3105,344 @@ js_mysqlresult_next(JSContext* ctx, JSValueConst this_val, int argc, JSValueCons
   return JS_ThrowRangeError(ctx, "MySQLResult is EOF");
 }
 
+typedef struct {
+  MYSQL* conn;
+  MYSQL_RES* res;
+  ResultFlags flags;
+  uint32_t size, count;
+  JSValue rows;
+  JSContext* ctx;
+} ResultBatch;
+
+static void
+result_batch_free(JSRuntime* rt, void* ptr) {
+  ResultBatch* rb = ptr;
+
+  JS_FreeValueRT(rt, rb->rows);
+  js_free_rt(rt, rb);
+}
+
+/**
+ * Collects up to rb->size rows while they arrive without blocking.
+ * Returns the wait state, or 0 once the batch has been settled.
+ */
+static int
+result_batch_fetch(AsyncClosure* ac, MYSQL_ROW row, int state) {
+  ResultBatch* rb = ac->opaque;
+  JSContext* ctx = ac->ctx;
+
+  while(state == 0) {
+    mysql_query_stats_row(ctx, rb->conn, rb->res, row);
+
+    if(row) {
+      JS_SetPropertyUint32(ctx, rb->rows, rb->count++, result_row(ctx, rb->res, row, rb->flags));
+
+      if(rb->count < rb->size) {
+        state = mysql_fetch_row_start(&row, rb->res);
+        continue;
+      }
+    } else if(mysql_errno(rb->conn)) {
+      JSValue error = js_mysqlerror_new(ctx, mysql_error(rb->conn));
+      asyncclosure_error(ac, error);
+      JS_FreeValue(ctx, error);
+      return 0;
+    }
+
+    if(rb->flags & RESULT_ITERAT) {
+      JSValue result = js_iterator_result(ctx, rb->rows, rb->count == 0);
+      asyncclosure_yield(ac, result);
+      JS_FreeValue(ctx, result);
+    } else {
+      asyncclosure_yield(ac, rb->rows);
+    }
+
+    return 0;
+  }
+
+  return state;
+}
+
+static JSValue
+js_mysqlresult_batch_continue(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  AsyncClosure* ac = ptr;
+  ResultBatch* rb = ac->opaque;
+  MYSQL_ROW row;
+  int state = mysql_fetch_row_cont(&row, rb->res, to_mysql_wait(ac->state));
+
+  if(state == 0)
+    state = result_batch_fetch(ac, row, state);
+
+  asyncclosure_change_event(ac, to_asyncevent(state));
+
+  return JS_UNDEFINED;
+}
+
+/**
+ * Resolves with an array of up to size rows (empty at the end of the
+ * result). With RESULT_ITERAT it resolves with an iterator result.
+ * One AsyncClosure serves the whole batch.
+ */
+static JSValue
+mysqlresult_batch(JSContext* ctx, JSValueConst result, uint32_t size, ResultFlags flags) {
+  MYSQL_RES* res;
+  MYSQL_ROW row;
+  ResultBatch* rb;
+  AsyncClosure* ac;
+  JSValue conn;
+  int state;
+
+  if(!(res = js_mysqlresult_data2(ctx, result)))
+    return JS_EXCEPTION;
+
+  if(!(rb = js_mallocz(ctx, sizeof(ResultBatch))))
+    return JS_EXCEPTION;
+
+  conn = js_mysqlresult_connection(ctx, result);
+
+  rb->conn = js_mysqlresult_handle(ctx, result);
+  rb->res = res;
+  rb->flags = flags | (JS_IsObject(conn) ? js_get_propertystr_int32(ctx, conn, "resultType") : 0);
+  rb->size = MAX_NUM(size, 1);
+  rb->rows = JS_NewArray(ctx);
+
+  JS_FreeValue(ctx, conn);
+
+  if(mysql_eof(res)) {
+    row = 0;
+    state = 0;
+  } else {
+    state = mysql_fetch_row_start(&row, res);
+  }
+
+  ac = asyncclosure_new(ctx, js_mysqlresult_fd(ctx, result), to_asyncevent(state), JS_NULL, &js_mysqlresult_batch_continue);
+  asyncclosure_opaque(ac, rb, result_batch_free);
+
+  if(state == 0)
+    asyncclosure_change_event(ac, to_asyncevent(result_batch_fetch(ac, row, state)));
+
+  return asyncclosure_promise(ac);
+}
+
+static JSValue
+js_mysqlresult_fetch_batch(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  uint32_t size = 1000;
+
+  if(argc > 0 && !JS_IsUndefined(argv[0]) && JS_ToUint32(ctx, &size, argv[0]))
+    return JS_EXCEPTION;
+
+  return mysqlresult_batch(ctx, this_val, size, 0);
+}
+
+static JSValue
+js_mysqlresult_batches_next(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, JSValue data[]) {
+  uint32_t size;
+
+  JS_ToUint32(ctx, &size, data[1]);
+
+  return mysqlresult_batch(ctx, data[0], size, RESULT_ITERAT);
+}
+
+static JSValue
+js_mysqlresult_batches_iterator(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  return JS_DupValue(ctx, this_val);
+}
+
+/**
+ * batches(size = 1000): async iterator over arrays of up to size rows,
+ * read straight from the server through mysql_use_result().
+ */
+static JSValue
+js_mysqlresult_batches(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  uint32_t size = 1000;
+  JSValue data[2], iter;
+  JSAtom atom;
+
+  if(!js_mysqlresult_data2(ctx, this_val))
+    return JS_EXCEPTION;
+
+  if(argc > 0 && !JS_IsUndefined(argv[0]) && JS_ToUint32(ctx, &size, argv[0]))
+    return JS_EXCEPTION;
+
+  data[0] = this_val;
+  data[1] = JS_NewUint32(ctx, size);
+
+  iter = JS_NewObject(ctx);
+  JS_SetPropertyStr(ctx, iter, "next", JS_NewCFunctionData(ctx, js_mysqlresult_batches_next, 0, 0, countof(data), data));
+
+  atom = js_symbol_static_atom(ctx, "asyncIterator");
+  JS_SetProperty(ctx, iter, atom, JS_NewCFunction(ctx, js_mysqlresult_batches_iterator, "[Symbol.asyncIterator]", 0));
+  JS_FreeAtom(ctx, atom);
+
+  return iter;
+}
+
+static ColumnType
+mysqlresult_column_type(MYSQL_FIELD const* field) {
+  if(field_is_boolean(field))
+    return COLUMN_BOOL;
+
+  switch(field->type) {
+    case MYSQL_TYPE_TINY:
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_YEAR: return COLUMN_INT32;
+    case MYSQL_TYPE_LONG: return (field->flags & UNSIGNED_FLAG) ? COLUMN_INT64 : COLUMN_INT32;
+    case MYSQL_TYPE_LONGLONG: return COLUMN_INT64;
+    case MYSQL_TYPE_FLOAT:
+    case MYSQL_TYPE_DOUBLE:
+    case MYSQL_TYPE_DECIMAL:
+    case MYSQL_TYPE_NEWDECIMAL: return COLUMN_FLOAT64;
+    case MYSQL_TYPE_BIT: return COLUMN_BINARY;
+    default: return field_is_blob(field) ? COLUMN_BINARY : COLUMN_STRING;
+  }
+}
+
+typedef struct {
+  MYSQL* conn;
+  MYSQL_RES* res;
+  ResultColumn* cols;
+  uint32_t num_fields;
+} ResultColumns;
+
+static void
+result_columns_free(JSRuntime* rt, void* ptr) {
+  ResultColumns* rc = ptr;
+
+  columns_free(rc->cols, rc->num_fields, rt);
+  js_free_rt(rt, rc);
+}
+
+static ResultColumns*
+result_columns_new(JSContext* ctx, MYSQL* my, MYSQL_RES* res) {
+  ResultColumns* rc;
+  MYSQL_FIELD* fields = mysql_fetch_fields(res);
+  uint32_t i, num_fields = mysql_num_fields(res);
+  FieldNameFunc* fn = field_namefunc(fields, num_fields);
+
+  if(!(rc = js_mallocz(ctx, sizeof(ResultColumns))))
+    return 0;
+
+  if(!(rc->cols = js_mallocz(ctx, sizeof(ResultColumn) * MAX_NUM(num_fields, 1)))) {
+    js_free(ctx, rc);
+    return 0;
+  }
+
+  rc->conn = my;
+  rc->res = res;
+  rc->num_fields = num_fields;
+
+  for(i = 0; i < num_fields; i++) {
+    char* name = fn(ctx, &fields[i]);
+
+    column_init(&rc->cols[i], name, mysqlresult_column_type(&fields[i]), ctx);
+
+    if(name)
+      js_free(ctx, name);
+  }
+
+  return rc;
+}
+
+static void
+result_columns_push(ResultColumns* rc, MYSQL_ROW row) {
+  unsigned long* lengths = mysql_fetch_lengths(rc->res);
+
+  for(uint32_t i = 0; i < rc->num_fields; i++) {
+    ResultColumn* col = &rc->cols[i];
+
+    /* numeric cells are not NUL-terminated in every client version */
+    if(row[i] && col->type <= COLUMN_FLOAT64) {
+      char buf[64];
+      size_t n = MIN_NUM(lengths[i], sizeof(buf) - 1);
+
+      memcpy(buf, row[i], n);
+      buf[n] = '\0';
+      column_push(col, buf, n);
+    } else {
+      column_push(col, row[i], row[i] ? lengths[i] : 0);
+    }
+  }
+}
+
+/**
+ * Fetches rows until one would block (returns the wait state) or the
+ * result ends (returns 0, after settling the closure).
+ */
+static int
+result_columns_fetch(AsyncClosure* ac, MYSQL_ROW row, int state) {
+  ResultColumns* rc = ac->opaque;
+  JSContext* ctx = ac->ctx;
+
+  while(state == 0) {
+    mysql_query_stats_row(ctx, rc->conn, rc->res, row);
+
+    if(!row) {
+      if(mysql_errno(rc->conn)) {
+        JSValue error = js_mysqlerror_new(ctx, mysql_error(rc->conn));
+        asyncclosure_error(ac, error);
+        JS_FreeValue(ctx, error);
+      } else {
+        JSValue columns = columns_value(rc->cols, rc->num_fields, ctx);
+        asyncclosure_yield(ac, columns);
+        JS_FreeValue(ctx, columns);
+      }
+
+      return 0;
+    }
+
+    result_columns_push(rc, row);
+    state = mysql_fetch_row_start(&row, rc->res);
+  }
+
+  return state;
+}
+
+static JSValue
+js_mysqlresult_columns_continue(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  AsyncClosure* ac = ptr;
+  ResultColumns* rc = ac->opaque;
+  MYSQL_ROW row;
+  int state = mysql_fetch_row_cont(&row, rc->res, to_mysql_wait(ac->state));
+
+  if(state == 0)
+    state = result_columns_fetch(ac, row, state);
+
+  asyncclosure_change_event(ac, to_asyncevent(state));
+
+  return JS_UNDEFINED;
+}
+
+/**
+ * fetchColumns(): resolves with the remaining rows decoded column by
+ * column (see result-columns.h).
+ */
+static JSValue
+js_mysqlresult_columns(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  MYSQL_RES* res;
+  MYSQL* my;
+  MYSQL_ROW row;
+  ResultColumns* rc;
+  AsyncClosure* ac;
+  int state;
+
+  if(!(res = js_mysqlresult_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  my = js_mysqlresult_handle(ctx, this_val);
+
+  if(!(rc = result_columns_new(ctx, my, res)))
+    return JS_EXCEPTION;
+
+  state = mysql_fetch_row_start(&row, res);
+  ac = asyncclosure_new(ctx, js_mysqlresult_fd(ctx, this_val), to_asyncevent(state), JS_NULL, &js_mysqlresult_columns_continue);
+  asyncclosure_opaque(ac, rc, result_columns_free);
+
+  if(state == 0)
+    asyncclosure_change_event(ac, to_asyncevent(result_columns_fetch(ac, row, state)));
+
+  return asyncclosure_promise(ac);
+}
+
 enum {
   METHOD_FETCH_FIELD,
   METHOD_FETCH_FIELDS,
@@ -1758,6 +3622,9 @@ static const JSCFunctionListEntry js_mysqlresult_funcs[] = {
     JS_CFUNC_MAGIC_DEF("fetchField", 1, js_mysqlresult_functions, METHOD_FETCH_FIELD),
     JS_CFUNC_MAGIC_DEF("fetchFields", 0, js_mysqlresult_functions, METHOD_FETCH_FIELDS),
     JS_CFUNC_MAGIC_DEF("fetchRow", 0, js_mysqlresult_next, 0),
+    JS_CFUNC_DEF("fetchColumns", 0, js_mysqlresult_columns),
+    JS_CFUNC_DEF("fetchBatch", 1, js_mysqlresult_fetch_batch),
+    JS_CFUNC_DEF("batches", 0, js_mysqlresult_batches),
     JS_CFUNC_MAGIC_DEF("[Symbol.iterator]", 0, js_mysqlresult_iterator, METHOD_ITERATOR),
     JS_CFUNC_MAGIC_DEF("[Symbol.asyncIterator]", 0, js_mysqlresult_iterator, METHOD_ASYNC_ITERATOR),
     JS_PROP_STRING_DEF("[Symbol.toStringTag]", "MySQLResult", JS_PROP_CONFIGURABLE),
@@ -2063,12 +3930,38 @@ js_mysql_init(JSContext* ctx, JSModuleDef* m) {
 
     JS_SetPropertyFunctionList(ctx, mysqlresult_proto, js_mysqlresult_funcs, countof(js_mysqlresult_funcs));
     JS_SetClassProto(ctx, js_mysqlresult_class_id, mysqlresult_proto);
+
+    JS_NewClassID(&js_mysqlpool_class_id);
+    JS_NewClass(JS_GetRuntime(ctx), js_mysqlpool_class_id, &js_mysqlpool_class);
+
+    mysqlpool_ctor = JS_NewCFunction2(ctx, js_mysqlpool_constructor, "MySQLPool", 1, JS_CFUNC_constructor, 0);
+    mysqlpool_proto = JS_NewObject(ctx);
+
+    JS_SetPropertyFunctionList(ctx, mysqlpool_proto, js_mysqlpool_funcs, countof(js_mysqlpool_funcs));
+    JS_SetClassProto(ctx, js_mysqlpool_class_id, mysqlpool_proto);
+
+    JS_NewClassID(&js_mysqlstmt_class_id);
+    JS_NewClass(JS_GetRuntime(ctx), js_mysqlstmt_class_id, &js_mysqlstmt_class);
+
+    mysqlstmt_proto = JS_NewObject(ctx);
+
+    JS_SetPropertyFunctionList(ctx, mysqlstmt_proto, js_mysqlstmt_funcs, countof(js_mysqlstmt_funcs));
+    JS_SetClassProto(ctx, js_mysqlstmt_class_id, mysqlstmt_proto);
+
+    JS_NewClassID(&js_mysqlbatch_class_id);
+    JS_NewClass(JS_GetRuntime(ctx), js_mysqlbatch_class_id, &js_mysqlbatch_class);
+
+    mysqlbatch_proto = JS_NewObject(ctx);
+
+    JS_SetPropertyFunctionList(ctx, mysqlbatch_proto, js_mysqlbatch_funcs, countof(js_mysqlbatch_funcs));
+    JS_SetClassProto(ctx, js_mysqlbatch_class_id, mysqlbatch_proto);
   }
 
   if(m) {
     JS_SetModuleExport(ctx, m, "MySQL", mysql_ctor);
     JS_SetModuleExport(ctx, m, "MySQLError", mysqlerror_ctor);
     JS_SetModuleExport(ctx, m, "MySQLResult", mysqlresult_ctor);
+    JS_SetModuleExport(ctx, m, "MySQLPool", mysqlpool_ctor);
   }
 
   return 0;
@@ -2088,6 +3981,7 @@ JS_INIT_MODULE(JSContext* ctx, const char* module_name) {
     JS_AddModuleExport(ctx, m, "MySQL");
     JS_AddModuleExport(ctx, m, "MySQLError");
     JS_AddModuleExport(ctx, m, "MySQLResult");
+    JS_AddModuleExport(ctx, m, "MySQLPool");
   }
 
   return m;
@@ -22,6 +22,7 @@ int js_mysql_init(JSContext*, JSModuleDef*);
 JSModuleDef* js_init_module_mysql(JSContext*, const char* module_name);
 
 extern VISIBLE JSClassID js_mysql_class_id, js_mysqlresult_class_id;
+extern VISIBLE JSClassID js_mysqlpool_class_id;
 
 /**
  * @}
@@ -2,6 +2,7 @@
 #include <cutils.h>
 #include <quickjs.h>
 #include "buffer-utils.h"
+#include "arena.h"
 #include "char-utils.h"
 #include "debug.h"
 
@@ -12,8 +13,15 @@
 
 #include "path.h"
 #include "utils.h"
+#include "js-utils.h"
+#include <errno.h>
 #ifdef _WIN32
 #include <windows.h>
+#else
+#include <pthread.h>
+#endif
+#ifndef AT_FDCWD
+#define AT_FDCWD -100
 #endif
 
 /**
@@ -60,6 +68,13 @@ enum {
   PATH_EQUAL,
 };
 
+enum {
+  CACHE_ENABLE,
+  CACHE_CLEAR,
+  CACHE_INVALIDATE,
+  CACHE_STATS,
+};
+
 static JSValue
 js_path_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
   const char *a = 0, *b = 0;
@@ -325,6 +340,8 @@ js_path_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst arg
 
 static JSValue
 js_path_method_dbuf(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  Arena* arena = js_arena(ctx);
+  ArenaMark mark = arena_mark(arena);
   const char *a = 0, *b = 0;
   DynBuf db = DBUF_INIT_0();
   size_t alen = 0, blen = 0;
@@ -340,7 +357,7 @@ js_path_method_dbuf(JSContext* ctx, JSValueConst this_val, int argc, JSValueCons
       b = JS_ToCStringLen(ctx, &blen, argv[1]);
   }
 
-  js_dbuf_init(ctx, &db);
+  dbuf_init_arena(&db, arena);
 
   switch(magic) {
     case PATH_ABSOLUTE: {
@@ -362,7 +379,7 @@ js_path_method_dbuf(JSContext* ctx, JSValueConst this_val, int argc, JSValueCons
     case PATH_SEARCH: {
       const char* pathstr = a;
       DynBuf db = DBUF_INIT_0();
-      js_dbuf_allocator(ctx, &db);
+      dbuf_init_arena(&db, arena);
 
       for(;;) {
         char* file;
@@ -396,17 +413,17 @@ js_path_method_dbuf(JSContext* ctx, JSValueConst this_val, int argc, JSValueCons
       }
 
       if(from == NULL) {
-        js_dbuf_allocator(ctx, &buf);
+        dbuf_init_arena(&buf, arena);
         from = path_getcwd1(&buf);
       } else if(path_isrelative(from)) {
-        js_dbuf_allocator(ctx, &buf);
+        dbuf_init_arena(&buf, arena);
         path_absolute3(a, alen, &buf);
         dbuf_0(&buf);
         from = (const char*)buf.buf;
       }
 
       if(path_isrelative(to)) {
-        js_dbuf_allocator(ctx, &buf2);
+        dbuf_init_arena(&buf2, arena);
         path_absolute3(b, blen, &buf2);
         dbuf_0(&buf2);
         to = (const char*)buf2.buf;
@@ -431,18 +448,24 @@ js_path_method_dbuf(JSContext* ctx, JSValueConst this_val, int argc, JSValueCons
   if(b)
     JS_FreeCString(ctx, b);
 
-  return JS_IsUndefined(ret) ? dbuf_tostring_free(&db, ctx) : ret;
+  if(JS_IsUndefined(ret))
+    ret = dbuf_tostring_free(&db, ctx);
+
+  arena_release(arena, mark);
+  return ret;
 }
 
 static JSValue
 js_path_join(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  Arena* arena = js_arena(ctx);
+  ArenaMark mark = arena_mark(arena);
   const char* str;
   DynBuf db = DBUF_INIT_0();
   int i;
   size_t len = 0;
   JSValue ret = JS_UNDEFINED;
 
-  js_dbuf_init(ctx, &db);
+  dbuf_init_arena(&db, arena);
 
   for(i = 0; i < argc; i++) {
     str = JS_ToCStringLen(ctx, &len, argv[i]);
@@ -457,17 +480,20 @@ js_path_join(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[
   ret = JS_NewStringLen(ctx, (const char*)db.buf, len);
 
   dbuf_free(&db);
+  arena_release(arena, mark);
   return ret;
 }
 
 static JSValue
 js_path_slice(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  Arena* arena = js_arena(ctx);
+  ArenaMark mark = arena_mark(arena);
   const char* str;
   DynBuf db = DBUF_INIT_0();
   int32_t start = 0, end = -1;
   JSValue ret = JS_UNDEFINED;
 
-  js_dbuf_init(ctx, &db);
+  dbuf_init_arena(&db, arena);
 
   if((str = JS_ToCString(ctx, argv[0]))) {
     int32_t len = path_length1(str);
@@ -496,6 +522,7 @@ js_path_slice(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv
   ret = JS_NewStringLen(ctx, (const char*)db.buf, db.size);
 
   dbuf_free(&db);
+  arena_release(arena, mark);
   return ret;
 }
 
@@ -528,12 +555,14 @@ js_path_parse(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv
 
 static JSValue
 js_path_format(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  Arena* arena = js_arena(ctx);
+  ArenaMark mark = arena_mark(arena);
   JSValueConst obj = argv[0];
   const char *dir, *root, *base, *name, *ext;
   JSValue ret = JS_UNDEFINED;
   DynBuf db = DBUF_INIT_0();
 
-  js_dbuf_init(ctx, &db);
+  dbuf_init_arena(&db, arena);
 
   if((root = js_get_propertystr_cstring(ctx, obj, "root"))) {
     dbuf_putstr(&db, root);
@@ -564,11 +593,14 @@ js_path_format(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst arg
   ret = JS_NewStringLen(ctx, (const char*)db.buf, db.size);
   dbuf_free(&db);
 
+  arena_release(arena, mark);
   return ret;
 }
 
 static JSValue
 js_path_resolve(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  Arena* arena = js_arena(ctx);
+  ArenaMark mark = arena_mark(arena);
   DynBuf db = DBUF_INIT_0(), cwd = DBUF_INIT_0();
   int i;
   const char* str;
@@ -576,7 +608,7 @@ js_path_resolve(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst ar
   JSValue ret = JS_UNDEFINED;
   BOOL absolute = FALSE;
 
-  js_dbuf_init(ctx, &db);
+  dbuf_init_arena(&db, arena);
   dbuf_0(&db);
 
   for(i = argc - 1; i >= 0; i--) {
@@ -605,7 +637,7 @@ js_path_resolve(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst ar
   }
 
   if(!absolute) {
-    js_dbuf_init(ctx, &cwd);
+    dbuf_init_arena(&cwd, arena);
     str = path_getcwd1(&cwd);
     len = cwd.size;
 
@@ -633,6 +665,669 @@ js_path_resolve(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst ar
 
 fail:
   dbuf_free(&db);
+  arena_release(arena, mark);
+  return ret;
+}
+
+static JSValue
+js_path_glob_test(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  const char* str;
+  size_t len;
+  BOOL ret;
+
+  if(!(str = JS_ToCStringLen(ctx, &len, argv[0])))
+    return JS_EXCEPTION;
+
+  ret = path_glob_match(ptr, str, len);
+  JS_FreeCString(ctx, str);
+
+  return JS_NewBool(ctx, ret);
+}
+
+static void
+js_path_glob_free(void* ptr) {
+  path_glob_free(ptr);
+}
+
+/**
+ * compileGlob(pattern, flags = FNM_PERIOD): returns a function testing
+ * paths against pattern, compiled once.
+ */
+static JSValue
+js_path_compile_glob(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  const char* pattern;
+  size_t len;
+  int32_t flags = PATH_FNM_PERIOD;
+  PathGlob* g;
+
+  if(argc > 1 && !JS_IsUndefined(argv[1]) && JS_ToInt32(ctx, &flags, argv[1]))
+    return JS_EXCEPTION;
+
+  if(!(pattern = JS_ToCStringLen(ctx, &len, argv[0])))
+    return JS_EXCEPTION;
+
+  g = path_glob_compile(pattern, len, flags);
+  JS_FreeCString(ctx, pattern);
+
+  if(!g)
+    return JS_ThrowInternalError(ctx, "compileGlob(): pattern too deep or out of memory");
+
+  return js_function_cclosure(ctx, js_path_glob_test, 1, 0, g, js_path_glob_free);
+}
+
+#ifndef _WIN32
+enum {
+  GLOB_NEXT,
+  GLOB_RETURN,
+};
+
+typedef struct glob_dir {
+  struct glob_dir* next;
+  size_t len;
+  uint64_t states[];
+} GlobDir;
+
+#define globdir_path(job, d) ((char*)&(d)->states[(job)->nglobs])
+
+typedef struct glob_job {
+  int ref_count;
+  JSRuntime* rt;
+  PathGlob** globs;
+  uint32_t nglobs, threads, active;
+  BOOL nodir, notified, done;
+  int rootfd, fds[2];
+  pthread_t coordinator;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  GlobDir* queue;
+  volatile int cancel;
+  DynBuf results, taken;
+  size_t pos;
+  ResolveFunctions* pending;
+  uint32_t npending;
+} GlobJob;
+
+static GlobDir*
+globjob_dir(GlobJob* job, const char* dir, size_t dirlen, const char* name, size_t namelen, const uint64_t* states) {
+  size_t len = dirlen ? dirlen + 1 + namelen : namelen;
+  GlobDir* d;
+  char* p;
+
+  if(!(d = malloc(sizeof(GlobDir) + sizeof(uint64_t) * job->nglobs + len + 1)))
+    return 0;
+
+  memcpy(d->states, states, sizeof(uint64_t) * job->nglobs);
+  d->len = len;
+  p = globdir_path(job, d);
+
+  if(dirlen) {
+    memcpy(p, dir, dirlen);
+    p[dirlen] = '/';
+    p += dirlen + 1;
+  }
+
+  memcpy(p, name, namelen);
+  p[namelen] = '\0';
+  return d;
+}
+
+/* lists one directory, queueing the subdirectories some pattern may still match below */
+static void
+globjob_scan(GlobJob* job, GlobDir* d) {
+  const char* path = globdir_path(job, d);
+  uint64_t states[job->nglobs];
+  GlobDir *children = 0, *child;
+  DynBuf out;
+  struct dirent* ent;
+  DIR* dir;
+  BOOL post = FALSE;
+  int fd;
+
+  if((fd = d->len ? openat(job->rootfd, path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC) : dup(job->rootfd)) == -1)
+    return;
+
+  if(!(dir = fdopendir(fd))) {
+    close(fd);
+    return;
+  }
+
+  dbuf_init2(&out, 0, 0);
+
+  while(!job->cancel && (ent = readdir(dir))) {
+    const char* name = ent->d_name;
+    size_t namelen = strlen(name);
+    BOOL accept = FALSE, live = FALSE, isdir;
+
+    if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+      continue;
+
+    for(uint32_t i = 0; i < job->nglobs; i++) {
+      states[i] = path_glob_step(job->globs[i], d->states[i], name, namelen);
+      accept |= path_glob_accepts(job->globs[i], states[i]);
+      live |= path_glob_live(job->globs[i], states[i]);
+    }
+
+    if(!accept && !live)
+      continue;
+
+#ifdef DT_DIR
+    if(ent->d_type != DT_UNKNOWN)
+      isdir = ent->d_type == DT_DIR;
+    else
+#endif
+    {
+      struct stat st;
+
+      isdir = fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+    }
+
+    if(accept && !(isdir && job->nodir)) {
+      if(d->len) {
+        dbuf_put(&out, (const uint8_t*)path, d->len);
+        dbuf_putc(&out, '/');
+      }
+
+      dbuf_put(&out, (const uint8_t*)name, namelen + 1);
+    }
+
+    if(live && isdir && (child = globjob_dir(job, path, d->len, name, namelen, states))) {
+      child->next = children;
+      children = child;
+    }
+  }
+
+  closedir(dir);
+
+  pthread_mutex_lock(&job->lock);
+
+  if(out.size) {
+    dbuf_put(&job->results, out.buf, out.size);
+
+    if(!job->notified)
+      post = job->notified = TRUE;
+  }
+
+  if(children) {
+    for(child = children; child->next; child = child->next) {}
+
+    child->next = job->queue;
+    job->queue = children;
+    pthread_cond_broadcast(&job->cond);
+  }
+
+  pthread_mutex_unlock(&job->lock);
+  dbuf_free(&out);
+
+  /* one wakeup per batch, the handler takes everything queued so far */
+  if(post)
+    while(write(job->fds[1], "r", 1) == -1 && errno == EINTR) {}
+}
+
+static void*
+globjob_worker(void* ptr) {
+  GlobJob* job = ptr;
+  GlobDir* d;
+
+  pthread_mutex_lock(&job->lock);
+
+  for(;;) {
+    while(!job->queue && job->active && !job->cancel)
+      pthread_cond_wait(&job->cond, &job->lock);
+
+    if(job->cancel || !(d = job->queue))
+      break;
+
+    job->queue = d->next;
+    job->active++;
+    pthread_mutex_unlock(&job->lock);
+
+    globjob_scan(job, d);
+    free(d);
+
+    pthread_mutex_lock(&job->lock);
+
+    if(--job->active == 0 && !job->queue)
+      pthread_cond_broadcast(&job->cond);
+  }
+
+  pthread_mutex_unlock(&job->lock);
+  return 0;
+}
+
+static void*
+globjob_coordinator(void* ptr) {
+  GlobJob* job = ptr;
+  pthread_t workers[job->threads];
+  uint32_t i, started = 0;
+
+  for(i = 1; i < job->threads; i++)
+    if(!pthread_create(&workers[started], 0, globjob_worker, job))
+      started++;
+
+  globjob_worker(job);
+
+  for(i = 0; i < started; i++)
+    pthread_join(workers[i], 0);
+
+  while(write(job->fds[1], "d", 1) == -1 && errno == EINTR) {}
+  return 0;
+}
+
+static void
+globjob_free(void* ptr) {
+  GlobJob* job = ptr;
+
+  if(--job->ref_count == 0) {
+    GlobDir *d, *next;
+
+    for(d = job->queue; d; d = next) {
+      next = d->next;
+      free(d);
+    }
+
+    for(uint32_t i = 0; i < job->nglobs; i++)
+      if(job->globs[i])
+        path_glob_free(job->globs[i]);
+
+    for(uint32_t i = 0; i < job->npending; i++)
+      promise_free_funcs(job->rt, &job->pending[i]);
+
+    free(job->pending);
+    free(job->globs);
+    dbuf_free(&job->results);
+    dbuf_free(&job->taken);
+    close(job->rootfd);
+    close(job->fds[0]);
+    close(job->fds[1]);
+    pthread_mutex_destroy(&job->lock);
+    pthread_cond_destroy(&job->cond);
+    free(job);
+  }
+}
+
+/* resolves waiting next() calls from the results taken so far */
+static void
+globjob_settle(JSContext* ctx, GlobJob* job) {
+  while(job->npending > 0 && (job->pos < job->taken.size || job->done)) {
+    ResolveFunctions funcs = job->pending[0];
+    JSValue value = JS_UNDEFINED, result;
+    BOOL done = job->pos >= job->taken.size;
+
+    memmove(job->pending, job->pending + 1, sizeof(ResolveFunctions) * --job->npending);
+
+    if(!done) {
+      const char* p = (const char*)job->taken.buf + job->pos;
+      size_t len = strlen(p);
+
+      value = JS_NewStringLen(ctx, p, len);
+
+      if((job->pos += len + 1) == job->taken.size)
+        job->pos = job->taken.size = 0;
+    }
+
+    result = js_iterator_result(ctx, value, done);
+    promise_resolve(ctx, &funcs, result);
+    JS_FreeValue(ctx, result);
+    JS_FreeValue(ctx, value);
+  }
+}
+
+static JSValue
+js_globjob_event(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  GlobJob* job = ptr;
+  char buf[64];
+  ssize_t n;
+  BOOL done = FALSE;
+
+  while((n = read(job->fds[0], buf, sizeof(buf))) > 0)
+    done |= memchr(buf, 'd', n) != 0;
+
+  pthread_mutex_lock(&job->lock);
+
+  if(!job->cancel)
+    dbuf_put(&job->taken, job->results.buf, job->results.size);
+
+  job->results.size = 0;
+  job->notified = FALSE;
+  pthread_mutex_unlock(&job->lock);
+
+  if(done) {
+    JSValue set_handler = js_iohandler_fn(ctx, FALSE);
+
+    pthread_join(job->coordinator, 0);
+    job->done = TRUE;
+    globjob_settle(ctx, job);
+
+    /* drops the handler's reference, job may be gone after this */
+    js_iohandler_set(ctx, set_handler, job->fds[0], JS_NULL);
+    JS_FreeValue(ctx, set_handler);
+    return JS_UNDEFINED;
+  }
+
+  globjob_settle(ctx, job);
+  return JS_UNDEFINED;
+}
+
+static JSValue
+js_globjob_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  GlobJob* job = ptr;
+  ResolveFunctions* pending;
+  JSValue ret;
+
+  switch(magic) {
+    case GLOB_NEXT: {
+      if(!(pending = realloc(job->pending, sizeof(ResolveFunctions) * (job->npending + 1))))
+        return JS_ThrowOutOfMemory(ctx);
+
+      job->pending = pending;
+      ret = promise_create(ctx, &job->pending[job->npending++]);
+      globjob_settle(ctx, job);
+      return ret;
+    }
+
+    case GLOB_RETURN: {
+      JSValue result;
+
+      /* workers stop after the directory they are on */
+      job->cancel = 1;
+      pthread_mutex_lock(&job->lock);
+      pthread_cond_broadcast(&job->cond);
+      pthread_mutex_unlock(&job->lock);
+
+      job->pos = job->taken.size = 0;
+      result = js_iterator_result(ctx, argc > 0 ? argv[0] : JS_UNDEFINED, TRUE);
+      ret = js_promise_resolve(ctx, result);
+      JS_FreeValue(ctx, result);
+      return ret;
+    }
+  }
+
+  return JS_UNDEFINED;
+}
+
+static JSValue
+js_globjob_iterator(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  return JS_DupValue(ctx, this_val);
+}
+#endif
+
+/**
+ * globIterate(root, patterns, { threads = 1, flags = FNM_PERIOD, nodir }):
+ * async iterator over the paths below root, relative to it, matching any
+ * of patterns. Directories are listed on worker threads and only
+ * descended into while some pattern can still match below them.
+ */
+static JSValue
+js_path_glob_iterate(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+#ifdef _WIN32
+  return JS_ThrowInternalError(ctx, "globIterate() needs POSIX threads");
+#else
+  GlobJob* job;
+  GlobDir* root;
+  JSValue iter, set_handler;
+  JSAtom atom;
+  const char* rootdir;
+  int32_t flags = PATH_FNM_PERIOD, threads = 1;
+  uint64_t states[64];
+  BOOL array = JS_IsArray(ctx, argv[1]);
+  int64_t i, n = array ? js_array_length(ctx, argv[1]) : 1;
+
+  if(n < 0)
+    return JS_EXCEPTION;
+
+  if(n > 64)
+    return JS_ThrowRangeError(ctx, "globIterate(): at most 64 patterns");
+
+  if(argc > 2 && JS_IsObject(argv[2])) {
+    if(js_has_propertystr(ctx, argv[2], "threads"))
+      threads = js_get_propertystr_int32(ctx, argv[2], "threads");
+
+    if(js_has_propertystr(ctx, argv[2], "flags"))
+      flags = js_get_propertystr_int32(ctx, argv[2], "flags");
+  }
+
+  if(!(job = calloc(1, sizeof(GlobJob))))
+    return JS_ThrowOutOfMemory(ctx);
+
+  job->ref_count = 1;
+  job->rt = JS_GetRuntime(ctx);
+  job->threads = MIN_NUM(MAX_NUM(threads, 1), 64);
+  job->nodir = argc > 2 && JS_IsObject(argv[2]) && js_get_propertystr_bool(ctx, argv[2], "nodir");
+  job->rootfd = job->fds[0] = job->fds[1] = -1;
+  dbuf_init2(&job->results, 0, 0);
+  dbuf_init2(&job->taken, 0, 0);
+  pthread_mutex_init(&job->lock, 0);
+  pthread_cond_init(&job->cond, 0);
+
+  if(!(job->globs = calloc(n, sizeof(PathGlob*)))) {
+    globjob_free(job);
+    return JS_ThrowOutOfMemory(ctx);
+  }
+
+  for(i = 0; i < n; i++) {
+    JSValue item = array ? JS_GetPropertyUint32(ctx, argv[1], i) : JS_DupValue(ctx, argv[1]);
+    const char* pattern;
+    size_t len;
+
+    pattern = JS_ToCStringLen(ctx, &len, item);
+    JS_FreeValue(ctx, item);
+
+    if(!pattern) {
+      globjob_free(job);
+      return JS_EXCEPTION;
+    }
+
+    job->globs[job->nglobs] = path_glob_compile(pattern, len, flags);
+    JS_FreeCString(ctx, pattern);
+
+    if(!job->globs[job->nglobs]) {
+      globjob_free(job);
+      return JS_ThrowInternalError(ctx, "globIterate(): pattern too deep or out of memory");
+    }
+
+    states[job->nglobs] = path_glob_start(job->globs[job->nglobs]);
+    job->nglobs++;
+  }
+
+  if(!(rootdir = JS_ToCString(ctx, argv[0]))) {
+    globjob_free(job);
+    return JS_EXCEPTION;
+  }
+
+  job->rootfd = open(rootdir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  JS_FreeCString(ctx, rootdir);
+
+  if(job->rootfd == -1 || pipe(job->fds) == -1) {
+    int err = errno;
+
+    globjob_free(job);
+    return JS_ThrowInternalError(ctx, "globIterate(): %s", strerror(err));
+  }
+
+  fcntl(job->fds[0], F_SETFL, fcntl(job->fds[0], F_GETFL) | O_NONBLOCK);
+
+  if(!(root = globjob_dir(job, "", 0, "", 0, states))) {
+    globjob_free(job);
+    return JS_ThrowOutOfMemory(ctx);
+  }
+
+  root->next = 0;
+  job->queue = root;
+
+  if(pthread_create(&job->coordinator, 0, globjob_coordinator, job)) {
+    globjob_free(job);
+    return JS_ThrowInternalError(ctx, "pthread_create() failed");
+  }
+
+  iter = JS_NewObject(ctx);
+
+  job->ref_count++;
+  JS_SetPropertyStr(ctx, iter, "next", js_function_cclosure(ctx, js_globjob_method, 0, GLOB_NEXT, job, globjob_free));
+  job->ref_count++;
+  JS_SetPropertyStr(ctx, iter, "return", js_function_cclosure(ctx, js_globjob_method, 1, GLOB_RETURN, job, globjob_free));
+
+  atom = js_symbol_static_atom(ctx, "asyncIterator");
+  JS_SetProperty(ctx, iter, atom, JS_NewCFunction(ctx, js_globjob_iterator, "[Symbol.asyncIterator]", 0));
+  JS_FreeAtom(ctx, atom);
+
+  /* the handler keeps the original reference until the walk is done */
+  set_handler = js_iohandler_fn(ctx, FALSE);
+  js_iohandler_set(ctx, set_handler, job->fds[0], js_function_cclosure(ctx, js_globjob_event, 0, 0, job, globjob_free));
+  JS_FreeValue(ctx, set_handler);
+
+  return iter;
+#endif
+}
+
+static void
+js_path_free_buffer(JSRuntime* rt, void* opaque, void* ptr) {
+  js_free_rt(rt, ptr);
+}
+
+static JSValue
+js_path_typedarray(JSContext* ctx, void* data, size_t size, int bits, BOOL floating, BOOL sign) {
+  JSValue buf, ret;
+
+  buf = JS_NewArrayBuffer(ctx, data, size, js_path_free_buffer, 0, FALSE);
+  ret = js_typedarray_new(ctx, bits, floating, sign, buf);
+  JS_FreeValue(ctx, buf);
+  return ret;
+}
+
+/**
+ * statMany(paths | { dirfd, names }, fields = STAT_ALL, follow = true):
+ * stats every path, names relative to dirfd when given. Returns parallel
+ * typed arrays: mode (Uint32Array), size and mtime in milliseconds
+ * (Float64Array) for the fields asked for, and error (Int32Array) with
+ * the errno of each failed lookup, 0 otherwise.
+ */
+static JSValue
+js_path_stat_many(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  JSValue names, ret = JS_UNDEFINED;
+  int32_t dirfd = AT_FDCWD, fields = PATH_STAT_ALL;
+  BOOL follow = argc < 3 || JS_ToBool(ctx, argv[2]);
+  uint32_t* mode = 0;
+  double *size = 0, *mtime = 0;
+  int32_t* error = 0;
+  int64_t i, n;
+
+  if(JS_IsArray(ctx, argv[0])) {
+    names = JS_DupValue(ctx, argv[0]);
+  } else if(JS_IsObject(argv[0])) {
+    JSValue fd = JS_GetPropertyStr(ctx, argv[0], "dirfd");
+
+    if(!JS_IsUndefined(fd) && JS_ToInt32(ctx, &dirfd, fd)) {
+      JS_FreeValue(ctx, fd);
+      return JS_EXCEPTION;
+    }
+
+    JS_FreeValue(ctx, fd);
+    names = JS_GetPropertyStr(ctx, argv[0], "names");
+  } else {
+    return JS_ThrowTypeError(ctx, "argument 1 must be an array or { dirfd, names }");
+  }
+
+  if(argc > 1 && !JS_IsUndefined(argv[1]) && JS_ToInt32(ctx, &fields, argv[1]))
+    goto fail;
+
+  if((n = js_array_length(ctx, names)) < 0)
+    goto fail;
+
+  if(!(error = js_mallocz(ctx, sizeof(int32_t) * MAX_NUM(n, 1))) || ((fields & PATH_STAT_MODE) && !(mode = js_mallocz(ctx, sizeof(uint32_t) * MAX_NUM(n, 1)))) ||
+     ((fields & PATH_STAT_SIZE) && !(size = js_mallocz(ctx, sizeof(double) * MAX_NUM(n, 1)))) || ((fields & PATH_STAT_MTIME) && !(mtime = js_mallocz(ctx, sizeof(double) * MAX_NUM(n, 1)))))
+    goto fail;
+
+  for(i = 0; i < n; i++) {
+    JSValue item = JS_GetPropertyUint32(ctx, names, i);
+    const char* name = JS_ToCString(ctx, item);
+    PathStat st;
+
+    JS_FreeValue(ctx, item);
+
+    if(!name)
+      goto fail;
+
+    if(path_statat(dirfd, name, fields, follow, &st) == -1) {
+      error[i] = errno;
+    } else {
+      if(mode)
+        mode[i] = st.mode;
+      if(size)
+        size[i] = st.size;
+      if(mtime)
+        mtime[i] = st.mtime;
+    }
+
+    JS_FreeCString(ctx, name);
+  }
+
+  ret = JS_NewObject(ctx);
+
+  if(mode)
+    JS_SetPropertyStr(ctx, ret, "mode", js_path_typedarray(ctx, mode, sizeof(uint32_t) * n, 32, FALSE, FALSE));
+  if(size)
+    JS_SetPropertyStr(ctx, ret, "size", js_path_typedarray(ctx, size, sizeof(double) * n, 64, TRUE, FALSE));
+  if(mtime)
+    JS_SetPropertyStr(ctx, ret, "mtime", js_path_typedarray(ctx, mtime, sizeof(double) * n, 64, TRUE, FALSE));
+
+  JS_SetPropertyStr(ctx, ret, "error", js_path_typedarray(ctx, error, sizeof(int32_t) * n, 32, FALSE, TRUE));
+  JS_FreeValue(ctx, names);
+  return ret;
+
+fail:
+  js_free(ctx, error);
+  js_free(ctx, mode);
+  js_free(ctx, size);
+  js_free(ctx, mtime);
+  JS_FreeValue(ctx, names);
+  return JS_EXCEPTION;
+}
+
+static JSValue
+js_path_cache(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  JSValue ret = JS_UNDEFINED;
+
+  switch(magic) {
+    case CACHE_ENABLE: {
+      int64_t capacity = 1024;
+
+      if(argc > 0 && !JS_IsUndefined(argv[0]) && JS_ToInt64(ctx, &capacity, argv[0]))
+        return JS_EXCEPTION;
+
+      ret = JS_NewBool(ctx, path_cache_enable(capacity > 0 ? capacity : 0));
+      break;
+    }
+
+    case CACHE_CLEAR: {
+      path_cache_clear();
+      break;
+    }
+
+    case CACHE_INVALIDATE: {
+      const char* dir;
+      size_t len;
+
+      if(!(dir = JS_ToCStringLen(ctx, &len, argv[0])))
+        return JS_EXCEPTION;
+
+      ret = JS_NewInt64(ctx, path_cache_invalidate(dir, len));
+      JS_FreeCString(ctx, dir);
+      break;
+    }
+
+    case CACHE_STATS: {
+      PathCacheStats st;
+
+      path_cache_stats(&st);
+      ret = JS_NewObject(ctx);
+      JS_SetPropertyStr(ctx, ret, "size", JS_NewInt64(ctx, st.size));
+      JS_SetPropertyStr(ctx, ret, "capacity", JS_NewInt64(ctx, st.capacity));
+      JS_SetPropertyStr(ctx, ret, "hits", JS_NewInt64(ctx, st.hits));
+      JS_SetPropertyStr(ctx, ret, "misses", JS_NewInt64(ctx, st.misses));
+      break;
+    }
+  }
+
   return ret;
 }
 
@@ -677,12 +1372,23 @@ static const JSCFunctionListEntry js_path_funcs[] = {
     JS_CFUNC_DEF("parse", 1, js_path_parse),
     JS_CFUNC_DEF("format", 1, js_path_format),
     JS_CFUNC_DEF("resolve", 1, js_path_resolve),
+    JS_CFUNC_DEF("statMany", 1, js_path_stat_many),
+    JS_CFUNC_DEF("compileGlob", 1, js_path_compile_glob),
+    JS_CFUNC_DEF("globIterate", 2, js_path_glob_iterate),
+    JS_CFUNC_MAGIC_DEF("cacheEnable", 0, js_path_cache, CACHE_ENABLE),
+    JS_CFUNC_MAGIC_DEF("cacheClear", 0, js_path_cache, CACHE_CLEAR),
+    JS_CFUNC_MAGIC_DEF("cacheInvalidate", 1, js_path_cache, CACHE_INVALIDATE),
+    JS_CFUNC_MAGIC_DEF("cacheStats", 0, js_path_cache, CACHE_STATS),
     JS_PROP_STRING_DEF("delimiter", PATHDELIM_S, JS_PROP_CONFIGURABLE),
     JS_PROP_STRING_DEF("sep", PATHSEP_S, JS_PROP_CONFIGURABLE),
     JS_PROP_INT32_DEF("FNM_NOMATCH", PATH_FNM_NOMATCH, JS_PROP_CONFIGURABLE),
     JS_PROP_INT32_DEF("FNM_PATHNAME", PATH_FNM_PATHNAME, JS_PROP_CONFIGURABLE),
     JS_PROP_INT32_DEF("FNM_NOESCAPE", PATH_FNM_NOESCAPE, JS_PROP_CONFIGURABLE),
     JS_PROP_INT32_DEF("FNM_PERIOD", PATH_FNM_PERIOD, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("STAT_MODE", PATH_STAT_MODE, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("STAT_SIZE", PATH_STAT_SIZE, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("STAT_MTIME", PATH_STAT_MTIME, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("STAT_ALL", PATH_STAT_ALL, JS_PROP_CONFIGURABLE),
 };
 
 static int
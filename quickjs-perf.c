@@ -0,0 +1,612 @@
+#include "defines.h"
+#include "quickjs-perf.h"
+#include "utils.h"
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+/**
+ * \addtogroup quickjs-perf
+ * @{
+ */
+enum {
+  PERF_MARK = 0,
+  PERF_MEASURE,
+  PERF_TRACE,
+};
+
+typedef struct {
+  int64_t start, duration;
+  uint64_t value;
+  JSAtom name; /**< marks and measures */
+  uint8_t type, point;
+} PerfEntry;
+
+/** Entries are preallocated, so recording never allocates */
+typedef struct {
+  JSRuntime* rt;
+  PerfEntry* entries;
+  uint32_t capacity, head, count;
+} PerfRing;
+
+#define PERF_RING_DEFAULT 4096
+
+VISIBLE volatile uint32_t perf_trace_mask = 0;
+
+static thread_local PerfRing perf_ring;
+static int64_t perf_origin = 0;
+
+static const char* const perf_types[] = {"mark", "measure", "trace"};
+static const char* const perf_trace_names[PERF_TRACE_COUNT] = {"xml", "lexer", "queue", "socket", "db"};
+
+VISIBLE int64_t
+perf_now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline double
+perf_ms(int64_t ns) {
+  return (double)(ns - perf_origin) / 1e6;
+}
+
+static BOOL
+perf_ring_alloc(PerfRing* r, uint32_t capacity) {
+  PerfEntry* entries;
+
+  if(!(entries = calloc(capacity, sizeof(PerfEntry))))
+    return FALSE;
+
+  free(r->entries);
+  r->entries = entries;
+  r->capacity = capacity;
+  r->head = r->count = 0;
+  return TRUE;
+}
+
+static void
+perf_entry_free(PerfRing* r, PerfEntry* e) {
+  if(e->type != PERF_TRACE && e->name != JS_ATOM_NULL && r->rt)
+    JS_FreeAtomRT(r->rt, e->name);
+
+  e->name = JS_ATOM_NULL;
+}
+
+static PerfEntry*
+perf_ring_push(PerfRing* r) {
+  PerfEntry* e;
+
+  if(!r->entries && !perf_ring_alloc(r, PERF_RING_DEFAULT))
+    return 0;
+
+  e = &r->entries[r->head];
+
+  /* a full ring overwrites the oldest entry */
+  if(r->count == r->capacity)
+    perf_entry_free(r, e);
+  else
+    r->count++;
+
+  r->head = (r->head + 1) % r->capacity;
+  return e;
+}
+
+static inline PerfEntry*
+perf_ring_at(PerfRing* r, uint32_t i) {
+  return &r->entries[(r->head + r->capacity - r->count + i) % r->capacity];
+}
+
+/**
+ * Drops the entries of \p type (-1 for all), keeping the order of the others
+ */
+static void
+perf_ring_clear(PerfRing* r, int type) {
+  uint32_t i, j = 0, n = r->count, first = (r->head + r->capacity - r->count) % (r->capacity ? r->capacity : 1);
+
+  for(i = 0; i < n; i++) {
+    PerfEntry* e = &r->entries[(first + i) % r->capacity];
+
+    if(type == -1 || e->type == type) {
+      perf_entry_free(r, e);
+      continue;
+    }
+
+    if(i != j)
+      r->entries[(first + j) % r->capacity] = *e;
+
+    j++;
+  }
+
+  r->count = j;
+  r->head = r->capacity ? (first + j) % r->capacity : 0;
+}
+
+VISIBLE void
+perf_trace_record(int point, int64_t start, uint64_t value) {
+  PerfEntry* e;
+
+  if(!(e = perf_ring_push(&perf_ring)))
+    return;
+
+  e->type = PERF_TRACE;
+  e->point = point;
+  e->name = JS_ATOM_NULL;
+  e->start = start;
+  e->duration = perf_now() - start;
+  e->value = value;
+}
+
+/* the latest mark called \p name */
+static PerfEntry*
+perf_find_mark(PerfRing* r, JSAtom name) {
+  uint32_t i;
+
+  for(i = r->count; i > 0; i--) {
+    PerfEntry* e = perf_ring_at(r, i - 1);
+
+    if(e->type == PERF_MARK && e->name == name)
+      return e;
+  }
+
+  return 0;
+}
+
+/**
+ * A mark name or a timestamp in milliseconds since the time origin
+ */
+static int
+perf_timestamp(JSContext* ctx, JSValueConst value, int64_t* pns) {
+  PerfEntry* e;
+  JSAtom atom;
+  double ms;
+
+  if(JS_IsNumber(value)) {
+    JS_ToFloat64(ctx, &ms, value);
+    *pns = perf_origin + (int64_t)(ms * 1e6);
+    return 0;
+  }
+
+  if((atom = JS_ValueToAtom(ctx, value)) == JS_ATOM_NULL)
+    return -1;
+
+  e = perf_find_mark(&perf_ring, atom);
+
+  if(!e) {
+    const char* str = JS_AtomToCString(ctx, atom);
+    JS_ThrowSyntaxError(ctx, "The mark '%s' does not exist", str);
+    JS_FreeCString(ctx, str);
+  } else {
+    *pns = e->start;
+  }
+
+  JS_FreeAtom(ctx, atom);
+  return e ? 0 : -1;
+}
+
+static int
+perf_type(JSContext* ctx, JSValueConst value) {
+  const char* str;
+  int i, type = -1;
+
+  if(JS_IsUndefined(value) || JS_IsNull(value))
+    return -1;
+
+  if((str = JS_ToCString(ctx, value))) {
+    for(i = 0; i < (int)countof(perf_types); i++)
+      if(!strcmp(str, perf_types[i]))
+        type = i;
+
+    JS_FreeCString(ctx, str);
+  }
+
+  return type == -1 ? -2 : type;
+}
+
+static int
+perf_trace_point(const char* name) {
+  int i;
+
+  for(i = 0; i < PERF_TRACE_COUNT; i++)
+    if(!strcmp(name, perf_trace_names[i]))
+      return i;
+
+  return -1;
+}
+
+static JSValue
+perf_entry_object(JSContext* ctx, PerfEntry* e) {
+  JSValue obj = JS_NewObject(ctx);
+
+  if(e->type == PERF_TRACE)
+    JS_SetPropertyStr(ctx, obj, "name", JS_NewString(ctx, perf_trace_names[e->point]));
+  else
+    JS_SetPropertyStr(ctx, obj, "name", JS_AtomToString(ctx, e->name));
+
+  JS_SetPropertyStr(ctx, obj, "entryType", JS_NewString(ctx, perf_types[e->type]));
+  JS_SetPropertyStr(ctx, obj, "startTime", JS_NewFloat64(ctx, perf_ms(e->start)));
+  JS_SetPropertyStr(ctx, obj, "duration", JS_NewFloat64(ctx, (double)e->duration / 1e6));
+
+  if(e->type == PERF_TRACE)
+    JS_SetPropertyStr(ctx, obj, "value", JS_NewInt64(ctx, e->value));
+
+  return obj;
+}
+
+#ifdef __linux__
+typedef struct {
+  const char* name;
+  uint32_t type;
+  uint64_t config;
+} PerfCounter;
+
+static const PerfCounter perf_counters[] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"cache-references", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+    {"cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {"branches", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS},
+    {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"task-clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+    {"page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+    {"context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+};
+
+#define PERF_MAX_COUNTERS 8
+
+static int
+perf_counter_open(const PerfCounter* pc, int group_fd) {
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = pc->type;
+  attr.config = pc->config;
+  attr.disabled = group_fd == -1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+  return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+/**
+ * counters(fn, [events]) calls fn() with the hardware counters of this
+ * thread enabled and returns { result, <event>: count, ... }.  Counts are
+ * scaled when the kernel had to multiplex them.
+ */
+static JSValue
+js_perf_counters(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  static const char* const defaults[] = {"cycles", "instructions", "cache-misses"};
+  const PerfCounter* selected[PERF_MAX_COUNTERS];
+  int fds[PERF_MAX_COUNTERS], i, j, n = 0;
+  uint64_t buf[3 + PERF_MAX_COUNTERS];
+  JSValue result, ret = JS_EXCEPTION;
+
+  if(!JS_IsFunction(ctx, argv[0]))
+    return JS_ThrowTypeError(ctx, "argument 1 must be a function");
+
+  if(argc > 1 && !JS_IsUndefined(argv[1])) {
+    int64_t len = js_array_length(ctx, argv[1]);
+
+    for(i = 0; i < len; i++) {
+      JSValue v = JS_GetPropertyUint32(ctx, argv[1], i);
+      const char* name = JS_ToCString(ctx, v);
+
+      JS_FreeValue(ctx, v);
+
+      if(!name)
+        return JS_EXCEPTION;
+
+      for(j = 0; j < (int)countof(perf_counters); j++)
+        if(!strcmp(name, perf_counters[j].name))
+          break;
+
+      if(j == countof(perf_counters) || n == PERF_MAX_COUNTERS) {
+        JS_ThrowRangeError(ctx, j == countof(perf_counters) ? "unknown counter '%s'" : "too many counters at '%s'", name);
+        JS_FreeCString(ctx, name);
+        return JS_EXCEPTION;
+      }
+
+      JS_FreeCString(ctx, name);
+      selected[n++] = &perf_counters[j];
+    }
+  } else {
+    for(i = 0; i < (int)countof(defaults); i++)
+      for(j = 0; j < (int)countof(perf_counters); j++)
+        if(!strcmp(defaults[i], perf_counters[j].name))
+          selected[n++] = &perf_counters[j];
+  }
+
+  if(n == 0)
+    return JS_ThrowRangeError(ctx, "no counters");
+
+  for(i = 0; i < n; i++) {
+    if((fds[i] = perf_counter_open(selected[i], i ? fds[0] : -1)) == -1) {
+      JS_ThrowInternalError(ctx, "perf_event_open(%s) failed: %s", selected[i]->name, strerror(errno));
+      n = i;
+      goto fail;
+    }
+  }
+
+  ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+  result = JS_Call(ctx, argv[0], JS_UNDEFINED, 0, 0);
+
+  ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+  if(JS_IsException(result))
+    goto fail;
+
+  if(read(fds[0], buf, sizeof(uint64_t) * (3 + n)) < (ssize_t)(sizeof(uint64_t) * (3 + n))) {
+    JS_FreeValue(ctx, result);
+    JS_ThrowInternalError(ctx, "reading counters failed: %s", strerror(errno));
+    goto fail;
+  }
+
+  ret = JS_NewObject(ctx);
+  JS_SetPropertyStr(ctx, ret, "result", result);
+
+  /* buf: nr, time_enabled, time_running, values... */
+  for(i = 0; i < n; i++) {
+    double v = buf[3 + i];
+
+    if(buf[2] && buf[2] < buf[1])
+      v = v * buf[1] / buf[2];
+
+    JS_SetPropertyStr(ctx, ret, selected[i]->name, JS_NewFloat64(ctx, v));
+  }
+
+fail:
+  for(i = 0; i < n; i++)
+    close(fds[i]);
+
+  return ret;
+}
+#else
+static JSValue
+js_perf_counters(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  return JS_ThrowInternalError(ctx, "hardware counters need perf_event_open()");
+}
+#endif
+
+enum {
+  PERF_FUNC_MARK = 0,
+  PERF_FUNC_MEASURE,
+  PERF_FUNC_ENTRIES,
+  PERF_FUNC_CLEAR,
+  PERF_FUNC_NOW,
+  PERF_FUNC_BUFFER_SIZE,
+  PERF_FUNC_TRACE,
+  PERF_FUNC_TRACING,
+};
+
+static JSValue
+js_perf_function(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  JSValue ret = JS_UNDEFINED;
+  PerfRing* r = &perf_ring;
+
+  if(!r->rt)
+    r->rt = JS_GetRuntime(ctx);
+
+  switch(magic) {
+    case PERF_FUNC_MARK: {
+      JSAtom name;
+      PerfEntry* e;
+
+      if((name = JS_ValueToAtom(ctx, argv[0])) == JS_ATOM_NULL)
+        return JS_EXCEPTION;
+
+      if(!(e = perf_ring_push(r))) {
+        JS_FreeAtom(ctx, name);
+        return JS_ThrowOutOfMemory(ctx);
+      }
+
+      e->type = PERF_MARK;
+      e->name = name;
+      e->start = perf_now();
+      e->duration = 0;
+      e->value = 0;
+
+      ret = JS_NewFloat64(ctx, perf_ms(e->start));
+      break;
+    }
+
+    case PERF_FUNC_MEASURE: {
+      int64_t start = perf_origin, end = perf_now();
+      JSAtom name;
+      PerfEntry* e;
+
+      if(argc > 1 && !JS_IsUndefined(argv[1]) && perf_timestamp(ctx, argv[1], &start))
+        return JS_EXCEPTION;
+
+      if(argc > 2 && !JS_IsUndefined(argv[2]) && perf_timestamp(ctx, argv[2], &end))
+        return JS_EXCEPTION;
+
+      if((name = JS_ValueToAtom(ctx, argv[0])) == JS_ATOM_NULL)
+        return JS_EXCEPTION;
+
+      if(!(e = perf_ring_push(r))) {
+        JS_FreeAtom(ctx, name);
+        return JS_ThrowOutOfMemory(ctx);
+      }
+
+      e->type = PERF_MEASURE;
+      e->name = name;
+      e->start = start;
+      e->duration = end - start;
+      e->value = 0;
+
+      ret = JS_NewFloat64(ctx, (double)e->duration / 1e6);
+      break;
+    }
+
+    case PERF_FUNC_ENTRIES: {
+      int type = perf_type(ctx, argc > 0 ? argv[0] : JS_UNDEFINED);
+      uint32_t i, j = 0;
+
+      if(type == -2)
+        return JS_ThrowRangeError(ctx, "entry type must be 'mark', 'measure' or 'trace'");
+
+      ret = JS_NewArray(ctx);
+
+      for(i = 0; i < r->count; i++) {
+        PerfEntry* e = perf_ring_at(r, i);
+
+        if(type == -1 || e->type == type)
+          JS_SetPropertyUint32(ctx, ret, j++, perf_entry_object(ctx, e));
+      }
+
+      break;
+    }
+
+    case PERF_FUNC_CLEAR: {
+      int type = perf_type(ctx, argc > 0 ? argv[0] : JS_UNDEFINED);
+
+      if(type == -2)
+        return JS_ThrowRangeError(ctx, "entry type must be 'mark', 'measure' or 'trace'");
+
+      if(r->entries)
+        perf_ring_clear(r, type);
+
+      break;
+    }
+
+    case PERF_FUNC_NOW: {
+      ret = JS_NewFloat64(ctx, perf_ms(perf_now()));
+      break;
+    }
+
+    case PERF_FUNC_BUFFER_SIZE: {
+      uint32_t size;
+
+      if(argc > 0 && !JS_IsUndefined(argv[0])) {
+        if(JS_ToUint32(ctx, &size, argv[0]))
+          return JS_EXCEPTION;
+
+        if(size == 0)
+          return JS_ThrowRangeError(ctx, "buffer size must be positive");
+
+        if(r->entries)
+          perf_ring_clear(r, -1);
+
+        if(!perf_ring_alloc(r, size))
+          return JS_ThrowOutOfMemory(ctx);
+      }
+
+      ret = JS_NewUint32(ctx, r->entries ? r->capacity : PERF_RING_DEFAULT);
+      break;
+    }
+
+    case PERF_FUNC_TRACE: {
+      BOOL enable = argc > 1 ? JS_ToBool(ctx, argv[1]) : TRUE;
+      uint32_t mask = 0;
+      int64_t i, len = JS_IsArray(ctx, argv[0]) ? js_array_length(ctx, argv[0]) : 1;
+
+      for(i = 0; i < len; i++) {
+        JSValue v = JS_IsArray(ctx, argv[0]) ? JS_GetPropertyUint32(ctx, argv[0], i) : JS_DupValue(ctx, argv[0]);
+        const char* name = JS_ToCString(ctx, v);
+        int point;
+
+        JS_FreeValue(ctx, v);
+
+        if(!name)
+          return JS_EXCEPTION;
+
+        if(!strcmp(name, "all")) {
+          mask |= (1u << PERF_TRACE_COUNT) - 1;
+        } else if((point = perf_trace_point(name)) == -1) {
+          JS_ThrowRangeError(ctx, "unknown trace point '%s'", name);
+          JS_FreeCString(ctx, name);
+          return JS_EXCEPTION;
+        } else {
+          mask |= 1u << point;
+        }
+
+        JS_FreeCString(ctx, name);
+      }
+
+      /* the trace points themselves allocate the ring lazily */
+      if(enable && !r->entries && !perf_ring_alloc(r, PERF_RING_DEFAULT))
+        return JS_ThrowOutOfMemory(ctx);
+
+      perf_trace_mask = enable ? (perf_trace_mask | mask) : (perf_trace_mask & ~mask);
+      break;
+    }
+
+    case PERF_FUNC_TRACING: {
+      int i;
+      uint32_t j = 0;
+
+      ret = JS_NewArray(ctx);
+
+      for(i = 0; i < PERF_TRACE_COUNT; i++)
+        if(perf_trace_enabled(i))
+          JS_SetPropertyUint32(ctx, ret, j++, JS_NewString(ctx, perf_trace_names[i]));
+
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static const JSCFunctionListEntry js_perf_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("mark", 1, js_perf_function, PERF_FUNC_MARK),
+    JS_CFUNC_MAGIC_DEF("measure", 1, js_perf_function, PERF_FUNC_MEASURE),
+    JS_CFUNC_MAGIC_DEF("entries", 0, js_perf_function, PERF_FUNC_ENTRIES),
+    JS_CFUNC_MAGIC_DEF("clear", 0, js_perf_function, PERF_FUNC_CLEAR),
+    JS_CFUNC_MAGIC_DEF("now", 0, js_perf_function, PERF_FUNC_NOW),
+    JS_CFUNC_MAGIC_DEF("bufferSize", 0, js_perf_function, PERF_FUNC_BUFFER_SIZE),
+    JS_CFUNC_MAGIC_DEF("trace", 1, js_perf_function, PERF_FUNC_TRACE),
+    JS_CFUNC_MAGIC_DEF("tracing", 0, js_perf_function, PERF_FUNC_TRACING),
+    JS_CFUNC_DEF("counters", 1, js_perf_counters),
+};
+
+static JSValue perf_object = {{0}, JS_TAG_UNDEFINED};
+
+int
+js_perf_init(JSContext* ctx, JSModuleDef* m) {
+  if(!perf_origin)
+    perf_origin = perf_now();
+
+  perf_object = JS_NewObject(ctx);
+  JS_SetPropertyFunctionList(ctx, perf_object, js_perf_funcs, countof(js_perf_funcs));
+
+  if(m) {
+    JS_SetModuleExportList(ctx, m, js_perf_funcs, countof(js_perf_funcs));
+    JS_SetModuleExport(ctx, m, "default", perf_object);
+  }
+
+  return 0;
+}
+
+#ifdef JS_PERF_MODULE
+#define JS_INIT_MODULE js_init_module
+#else
+#define JS_INIT_MODULE js_init_module_perf
+#endif
+
+VISIBLE JSModuleDef*
+JS_INIT_MODULE(JSContext* ctx, const char* module_name) {
+  JSModuleDef* m;
+
+  if((m = JS_NewCModule(ctx, module_name, js_perf_init))) {
+    JS_AddModuleExportList(ctx, m, js_perf_funcs, countof(js_perf_funcs));
+    JS_AddModuleExport(ctx, m, "default");
+  }
+
+  return m;
+}
+
+/**
+ * @}
+ */
@@ -0,0 +1,57 @@
+#ifndef QUICKJS_PERF_H
+#define QUICKJS_PERF_H
+
+#include "defines.h"
+#include <quickjs.h>
+#include <cutils.h>
+
+/**
+ * \defgroup quickjs-perf quickjs-perf: Performance marks and trace points
+ *
+ * Native code brackets hot paths with perf_trace_begin() and
+ * perf_trace_end(). While a trace point is switched off this costs one
+ * load and one branch. While it is on, each span is appended to the
+ * calling thread's ring buffer of performance entries.
+ * @{
+ */
+enum {
+  PERF_TRACE_XML = 0,
+  PERF_TRACE_LEXER,
+  PERF_TRACE_QUEUE,
+  PERF_TRACE_SOCKET,
+  PERF_TRACE_DB,
+  PERF_TRACE_COUNT,
+};
+
+extern VISIBLE volatile uint32_t perf_trace_mask;
+
+VISIBLE int64_t perf_now(void);
+VISIBLE void perf_trace_record(int point, int64_t start, uint64_t value);
+
+static inline BOOL
+perf_trace_enabled(int point) {
+  return !!(perf_trace_mask & (1u << point));
+}
+
+/**
+ * @return  start time in nanoseconds, 0 if the trace point is off
+ */
+static inline int64_t
+perf_trace_begin(int point) {
+  return perf_trace_enabled(point) ? perf_now() : 0;
+}
+
+/**
+ * Records the span since perf_trace_begin(), \p value is a byte or item count
+ */
+static inline void
+perf_trace_end(int point, int64_t start, uint64_t value) {
+  if(start)
+    perf_trace_record(point, start, value);
+}
+
+/**
+ * @}
+ */
+
+#endif /* defined(QUICKJS_PERF_H) */
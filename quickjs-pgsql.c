@@ -4,15 +4,22 @@
 #include "buffer-utils.h"
 #include "char-utils.h"
 #include "js-utils.h"
+#include "conn-pool.h"
+#include "quickjs-stream.h"
+#include "result-columns.h"
+#include "query-stats.h"
+#include "quickjs-perf.h"
+#include "arena.h"
 
 /**
  * \addtogroup quickjs-pgsql
  * @{
  */
 
-VISIBLE JSClassID js_pgsqlerror_class_id = 0, js_pgconn_class_id = 0, js_pgresult_class_id = 0;
+VISIBLE JSClassID js_pgsqlerror_class_id = 0, js_pgconn_class_id = 0, js_pgresult_class_id = 0, js_pgpool_class_id = 0, js_pgstmt_class_id = 0;
 VISIBLE JSValue pgsqlerror_proto = {{0}, JS_TAG_UNDEFINED}, pgsqlerror_ctor = {{0}, JS_TAG_UNDEFINED}, pgsql_proto = {{0}, JS_TAG_UNDEFINED},
-                pgsql_ctor = {{0}, JS_TAG_UNDEFINED}, pgresult_proto = {{0}, JS_TAG_UNDEFINED}, pgresult_ctor = {{0}, JS_TAG_UNDEFINED};
+                pgsql_ctor = {{0}, JS_TAG_UNDEFINED}, pgresult_proto = {{0}, JS_TAG_UNDEFINED}, pgresult_ctor = {{0}, JS_TAG_UNDEFINED},
+                pgpool_proto = {{0}, JS_TAG_UNDEFINED}, pgpool_ctor = {{0}, JS_TAG_UNDEFINED}, pgstmt_proto = {{0}, JS_TAG_UNDEFINED};
 
 static JSValue js_pgresult_wrap(JSContext* ctx, PGresult* res);
 static JSValue string_to_value(JSContext* ctx, const char* func_name, const char* s);
@@ -43,6 +50,63 @@ struct PGConnection {
   PGconn* conn;
   BOOL nonblocking;
   struct PGResult* result;
+  BOOL reading, writing;
+  struct list_head pipeline;
+  struct list_head statements;
+  struct list_head notifies, notify_waiters;
+  int listeners;
+  BOOL waiting, notify_watch;
+  uint32_t num_cached, cache_size, statement_seq;
+  DynBuf deallocate;
+  int result_format;
+  QueryStats* stats;
+  int64_t trace_start;
+};
+
+/* a server-side prepared statement; the connection keeps every live one
+ * in most recently used order, flagged ones count towards the LRU cache */
+struct PGStatement {
+  int ref_count;
+  struct PGConnection* conn;
+  char *name, *sql;
+  BOOL cached;
+  struct list_head link;
+};
+
+struct PGParams {
+  int count;
+  const char** values;
+  int *lengths, *formats;
+  InputBuffer* buffers;
+};
+
+/* a query (or sync point) sent in pipeline mode, awaiting its results */
+struct PGPipelineEntry {
+  struct list_head link;
+  ResolveFunctions funcs;
+  PGresult* result;
+  BOOL sync;
+};
+
+/* a notification not yet taken by an iterator */
+struct PGNotifyEntry {
+  struct list_head link;
+  PGnotify* notify;
+};
+
+/* iterator over the notifications of a connection */
+struct PGNotifications {
+  JSContext* ctx;
+  JSValue conn;
+  struct PGConnection* pq;
+  BOOL closed;
+};
+
+/* a pending next() of an iterator */
+struct PGNotifyWaiter {
+  struct list_head link;
+  struct PGNotifications* owner;
+  ResolveFunctions funcs;
 };
 
 struct PGConnectParameters {
@@ -54,6 +118,12 @@ typedef struct PGConnection PGSQLConnection;
 typedef struct PGResult PGSQLResult;
 typedef struct PGResultIterator PGSQLResultIterator;
 typedef struct PGConnectParameters PGSQLConnectParameters;
+typedef struct PGPipelineEntry PGSQLPipelineEntry;
+typedef struct PGNotifyEntry PGSQLNotifyEntry;
+typedef struct PGNotifications PGSQLNotifications;
+typedef struct PGNotifyWaiter PGSQLNotifyWaiter;
+typedef struct PGStatement PGSQLStatement;
+typedef struct PGParams PGSQLParams;
 
 typedef char* FieldNameFunc(JSContext*, PGSQLResult*, int field);
 typedef JSValue RowValueFunc(JSContext*, PGSQLResult*, int, int);
@@ -86,6 +156,8 @@ static void pgresult_set_conn(PGSQLResult* opaque, PGSQLConnection* conn, JSCont
 
 static JSValue js_pgresult_new(JSContext* ctx, JSValueConst proto, PGresult* res);
 static JSValue js_pgsqlerror_new(JSContext* ctx, const char* msg);
+static void pgstmt_free(JSRuntime* rt, PGSQLStatement* st);
+static void pgconn_cache_trim(PGSQLConnection* pq, JSRuntime* rt);
 
 static void
 connectparams_parse(JSContext* ctx, PGSQLConnectParameters* c, const char* params) {
@@ -401,7 +473,13 @@ pgconn_new(JSContext* ctx) {
   if(!(pq = js_malloc(ctx, sizeof(PGSQLConnection))))
     return 0;
 
-  *pq = (PGSQLConnection){1, NULL, FALSE, NULL};
+  *pq = (PGSQLConnection){1, NULL, FALSE, NULL, FALSE, FALSE};
+  init_list_head(&pq->pipeline);
+  init_list_head(&pq->statements);
+  init_list_head(&pq->notifies);
+  init_list_head(&pq->notify_waiters);
+  pq->cache_size = 32;
+  js_dbuf_init_rt(JS_GetRuntime(ctx), &pq->deallocate);
 
   return pq;
 }
@@ -415,6 +493,47 @@ pgconn_dup(PGSQLConnection* pq) {
 static void
 pgconn_free(PGSQLConnection* pq, JSRuntime* rt) {
   if(--pq->ref_count == 0) {
+    struct list_head *el, *next;
+
+    list_for_each_safe(el, next, &pq->pipeline) {
+      PGSQLPipelineEntry* e = list_entry(el, PGSQLPipelineEntry, link);
+
+      promise_free_funcs(rt, &e->funcs);
+      if(e->result)
+        PQclear(e->result);
+      js_free_rt(rt, e);
+    }
+
+    list_for_each_safe(el, next, &pq->notifies) {
+      PGSQLNotifyEntry* n = list_entry(el, PGSQLNotifyEntry, link);
+
+      PQfreemem(n->notify);
+      js_free_rt(rt, n);
+    }
+
+    list_for_each_safe(el, next, &pq->notify_waiters) {
+      PGSQLNotifyWaiter* w = list_entry(el, PGSQLNotifyWaiter, link);
+
+      promise_free_funcs(rt, &w->funcs);
+      js_free_rt(rt, w);
+    }
+
+    /* statements still referenced from JS outlive the connection, detached */
+    list_for_each_safe(el, next, &pq->statements) {
+      PGSQLStatement* st = list_entry(el, PGSQLStatement, link);
+
+      list_del(&st->link);
+      st->conn = 0;
+
+      if(st->cached) {
+        st->cached = FALSE;
+        pgstmt_free(rt, st);
+      }
+    }
+
+    dbuf_free(&pq->deallocate);
+    if(pq->stats)
+      query_stats_free(pq->stats, rt);
     if(pq->result) {
       pgresult_free(rt, pq->result, 0);
       pq->result = 0;
@@ -434,7 +553,7 @@ pgconn_nonblock(PGSQLConnection* pq) {
 
 static const char*
 pgconn_error(PGSQLConnection* pq) {
-  return pgconn_error(pq);
+  return pq->conn ? PQerrorMessage(pq->conn) : "no connection";
 }
 
 static void
@@ -455,6 +574,34 @@ pgconn_result(PGSQLConnection* pq, PGresult* res, JSContext* ctx) {
   return value;
 }
 
+/**
+ * Ends the 'db' trace span of the current query with its row count
+ */
+static inline void
+pgconn_trace_result(PGSQLConnection* pq, PGresult* res) {
+  perf_trace_end(PERF_TRACE_DB, pq->trace_start, res ? PQntuples(res) : 0);
+  pq->trace_start = 0;
+}
+
+/**
+ * Ends the query timer with the size of its result: the payload of all
+ * cells, which is what the server sent apart from protocol framing.
+ */
+static void
+pgconn_stats_result(PGSQLConnection* pq, PGresult* res, JSContext* ctx) {
+  ExecStatusType status = res ? PQresultStatus(res) : PGRES_FATAL_ERROR;
+  int row, field, rows = res ? PQntuples(res) : 0, fields = res ? PQnfields(res) : 0;
+  size_t bytes = 0;
+
+  for(row = 0; row < rows; row++)
+    for(field = 0; field < fields; field++)
+      bytes += PQgetlength(res, row, field);
+
+  query_stats_first_byte(pq->stats);
+  query_stats_received(pq->stats, rows, bytes);
+  query_stats_end(pq->stats, status == PGRES_FATAL_ERROR || status == PGRES_BAD_RESPONSE, ctx);
+}
+
 static JSValue
 pgconn_get_result(PGSQLConnection* pq, JSContext* ctx) {
   PGresult* res;
@@ -470,7 +617,9 @@ pgconn_lookup_oid(PGSQLConnection* pq, Oid oid, JSContext* ctx) {
   PGresult* res;
   DynBuf buf;
   char* ret = 0;
-  js_dbuf_init(ctx, &buf);
+  Arena* arena = js_arena(ctx);
+  ArenaMark mark = arena_mark(arena);
+  dbuf_init_arena(&buf, arena);
   dbuf_putstr(&buf, "SELECT relname FROM pg_class WHERE oid=");
   dbuf_put_uint32(&buf, oid);
   dbuf_putc(&buf, ';');
@@ -484,6 +633,7 @@ pgconn_lookup_oid(PGSQLConnection* pq, Oid oid, JSContext* ctx) {
     }
   }
   dbuf_free(&buf);
+  arena_release(arena, mark);
   return ret;
 }
 
@@ -492,6 +642,138 @@ js_pgconn_data2(JSContext* ctx, JSValueConst value) {
   return JS_GetOpaque2(ctx, value, js_pgconn_class_id);
 }
 
+/**
+ * \defgroup pgsql-notify LISTEN/NOTIFY
+ *
+ * Every read handler drains PQnotifies() after PQconsumeInput(), so
+ * notifications arriving during a query are delivered as well. While no
+ * query, prepare or pipeline owns the read handler and an iterator is
+ * open, js_pgconn_notify_read() watches the socket.
+ * @{
+ */
+static JSValue
+pgconn_notify_value(JSContext* ctx, PGnotify* n) {
+  JSValue obj = JS_NewObject(ctx);
+
+  JS_SetPropertyStr(ctx, obj, "channel", JS_NewString(ctx, n->relname));
+  JS_SetPropertyStr(ctx, obj, "pid", JS_NewInt32(ctx, n->be_pid));
+  JS_SetPropertyStr(ctx, obj, "payload", JS_NewString(ctx, n->extra ? n->extra : ""));
+
+  return obj;
+}
+
+static void
+pgconn_notify_settle(JSContext* ctx, PGSQLNotifyWaiter* w, JSValueConst value, BOOL done) {
+  JSValue res = js_iterator_result(ctx, value, done);
+
+  list_del(&w->link);
+  promise_resolve(ctx, &w->funcs, res);
+  JS_FreeValue(ctx, res);
+  js_free(ctx, w);
+}
+
+/* hands out notifications libpq has read, unless no iterator wants them */
+static void
+pgconn_notify_dispatch(PGSQLConnection* pq, JSContext* ctx) {
+  PGnotify* n;
+
+  while(pq->listeners && pq->conn && (n = PQnotifies(pq->conn))) {
+    if(!list_empty(&pq->notify_waiters)) {
+      JSValue value = pgconn_notify_value(ctx, n);
+
+      pgconn_notify_settle(ctx, list_entry(pq->notify_waiters.next, PGSQLNotifyWaiter, link), value, FALSE);
+      JS_FreeValue(ctx, value);
+      PQfreemem(n);
+    } else {
+      PGSQLNotifyEntry* e;
+
+      if(!(e = js_malloc(ctx, sizeof(PGSQLNotifyEntry)))) {
+        PQfreemem(n);
+        break;
+      }
+
+      e->notify = n;
+      list_add_tail(&e->link, &pq->notifies);
+    }
+  }
+}
+
+/* ends the pending next() calls of owner, or all of them */
+static void
+pgconn_notify_end(PGSQLConnection* pq, PGSQLNotifications* owner, JSContext* ctx) {
+  struct list_head *el, *next;
+
+  list_for_each_safe(el, next, &pq->notify_waiters) {
+    PGSQLNotifyWaiter* w = list_entry(el, PGSQLNotifyWaiter, link);
+
+    if(!owner || w->owner == owner)
+      pgconn_notify_settle(ctx, w, JS_UNDEFINED, TRUE);
+  }
+}
+
+static JSValue js_pgconn_notify_read(JSContext*, JSValueConst, int, JSValueConst[], int, JSValue[]);
+
+/**
+ * Watches the socket for notifications when enabled, an iterator is open
+ * and no command is reading. Called when a command has removed its read
+ * handler.
+ */
+static void
+pgconn_notify_watch(PGSQLConnection* pq, BOOL enable, JSValueConst conn, JSContext* ctx) {
+  JSValue set_handler, handler = JS_NULL;
+
+  enable = enable && pq->conn && pq->listeners > 0 && !pq->waiting && !pq->reading;
+
+  if(pq->notify_watch == enable || !pq->conn)
+    return;
+
+  if(enable)
+    handler = JS_NewCFunctionData(ctx, js_pgconn_notify_read, 0, 0, 1, &conn);
+
+  set_handler = js_iohandler_fn(ctx, FALSE);
+
+  if(js_iohandler_set(ctx, set_handler, PQsocket(pq->conn), handler))
+    pq->notify_watch = enable;
+
+  JS_FreeValue(ctx, set_handler);
+}
+
+static JSValue
+js_pgconn_notify_read(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, JSValue data[]) {
+  PGSQLConnection* pq;
+
+  if(!(pq = js_pgconn_data2(ctx, data[0])))
+    return JS_EXCEPTION;
+
+  if(!PQconsumeInput(pq->conn)) {
+    JSValue err = js_pgsqlerror_new(ctx, pgconn_error(pq));
+    struct list_head *el, *next;
+
+    list_for_each_safe(el, next, &pq->notify_waiters) {
+      PGSQLNotifyWaiter* w = list_entry(el, PGSQLNotifyWaiter, link);
+
+      list_del(&w->link);
+      promise_reject(ctx, &w->funcs, err);
+      js_free(ctx, w);
+    }
+
+    JS_FreeValue(ctx, err);
+    pgconn_notify_watch(pq, FALSE, data[0], ctx);
+    return JS_UNDEFINED;
+  }
+
+  pgconn_notify_dispatch(pq, ctx);
+
+  if(pq->listeners == 0)
+    pgconn_notify_watch(pq, FALSE, data[0], ctx);
+
+  return JS_UNDEFINED;
+}
+
+/**
+ * @}
+ */
+
 static JSValue
 js_pgconn_new(JSContext* ctx, JSValueConst proto) {
   JSValue obj;
@@ -589,6 +871,12 @@ enum {
   PROP_DB,
   PROP_PORT,
   PROP_CONNINFO,
+  PROP_PIPELINE_STATUS,
+  PROP_STATEMENT_CACHE_SIZE,
+  PROP_RESULT_FORMAT,
+  PROP_COLLECT_STATS,
+  PROP_STATS,
+  PROP_STATS_HOOK,
 
   PROP_CLIENT_INFO,
   PROP_CLIENT_VERSION,
@@ -712,6 +1000,40 @@ js_pgconn_get(JSContext* ctx, JSValueConst this_val, int magic) {
 
       break;
     }
+
+    case PROP_STATEMENT_CACHE_SIZE: {
+      ret = JS_NewUint32(ctx, pq->cache_size);
+      break;
+    }
+
+    case PROP_RESULT_FORMAT: {
+      ret = JS_NewString(ctx, pq->result_format ? "binary" : "text");
+      break;
+    }
+
+    case PROP_COLLECT_STATS: {
+      ret = JS_NewBool(ctx, !!pq->stats);
+      break;
+    }
+
+    case PROP_STATS: {
+      ret = pq->stats ? query_stats_value(pq->stats, ctx) : JS_NULL;
+      break;
+    }
+
+    case PROP_STATS_HOOK: {
+      ret = pq->stats ? JS_DupValue(ctx, pq->stats->hook) : JS_UNDEFINED;
+      break;
+    }
+
+    case PROP_PIPELINE_STATUS: {
+#ifdef LIBPQ_HAS_PIPELINING
+      ret = JS_NewInt32(ctx, pq->conn ? PQpipelineStatus(pq->conn) : PQ_PIPELINE_OFF);
+#else
+      ret = JS_NewInt32(ctx, 0);
+#endif
+      break;
+    }
   }
 
   return ret;
@@ -747,11 +1069,77 @@ js_pgconn_set(JSContext* ctx, JSValueConst this_val, JSValueConst value, int mag
       }
       break;
     }
+
+    case PROP_STATEMENT_CACHE_SIZE: {
+      uint32_t size;
+
+      if(JS_ToUint32(ctx, &size, value))
+        return JS_EXCEPTION;
+
+      pq->cache_size = size;
+      pgconn_cache_trim(pq, JS_GetRuntime(ctx));
+      break;
+    }
+
+    case PROP_RESULT_FORMAT: {
+      if(JS_IsString(value)) {
+        const char* format = JS_ToCString(ctx, value);
+        BOOL binary = format && !strcmp(format, "binary");
+
+        if(!binary && format && strcmp(format, "text")) {
+          JS_FreeCString(ctx, format);
+          return JS_ThrowTypeError(ctx, "resultFormat must be 'text' or 'binary'");
+        }
+
+        JS_FreeCString(ctx, format);
+        pq->result_format = binary;
+      } else {
+        pq->result_format = JS_ToBool(ctx, value);
+      }
+
+      break;
+    }
+
+    case PROP_COLLECT_STATS: {
+      if(!JS_ToBool(ctx, value)) {
+        if(pq->stats)
+          query_stats_free(pq->stats, JS_GetRuntime(ctx));
+
+        pq->stats = 0;
+      } else if(!pq->stats && !(pq->stats = query_stats_new(ctx))) {
+        return JS_EXCEPTION;
+      }
+
+      break;
+    }
+
+    /* setting a hook turns stats collection on */
+    case PROP_STATS_HOOK: {
+      if(!pq->stats && !(pq->stats = query_stats_new(ctx)))
+        return JS_EXCEPTION;
+
+      JS_FreeValue(ctx, pq->stats->hook);
+      pq->stats->hook = JS_IsFunction(ctx, value) ? JS_DupValue(ctx, value) : JS_UNDEFINED;
+      break;
+    }
   }
 
   return JS_UNDEFINED;
 }
 
+static JSValue
+js_pgconn_reset_stats(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  PGSQLConnection* pq;
+
+  if(!(pq = js_pgconn_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(pq->stats)
+    query_stats_reset(pq->stats);
+
+  return JS_UNDEFINED;
+}
+
 static JSValue
 js_pgconn_value_string(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
   JSValue ret;
@@ -972,6 +1360,14 @@ js_pgconn_connect_cont(JSContext* ctx, JSValueConst this_val, int argc, JSValueC
     }
 
     JS_Call(ctx, data[2], JS_UNDEFINED, 1, &data[0]);
+  } else if(newstate == PGRES_POLLING_FAILED) {
+    JSValue error = js_pgsqlerror_new(ctx, pgconn_error(pq));
+
+    if(fd >= 0)
+      js_iohandler_set(ctx, data[1], fd, JS_NULL);
+
+    JS_FreeValue(ctx, JS_Call(ctx, data[3], JS_UNDEFINED, 1, &error));
+    JS_FreeValue(ctx, error);
   } else if(newstate != oldstate) {
     JSValue handler, hdata[4] = {
                          JS_DupValue(ctx, data[0]),
@@ -983,7 +1379,6 @@ js_pgconn_connect_cont(JSContext* ctx, JSValueConst this_val, int argc, JSValueC
 
     js_iohandler_set(ctx, data[1], fd, JS_NULL);
     js_iohandler_set(ctx, hdata[1], fd, handler);
-    JS_FreeValue(ctx, handler);
 
     JS_FreeValue(ctx, hdata[0]);
     JS_FreeValue(ctx, hdata[1]);
@@ -1035,8 +1430,6 @@ js_pgconn_connect_start(JSContext* ctx, JSValueConst this_val, int argc, JSValue
 
     if(!js_iohandler_set(ctx, data[1], fd, handler))
       JS_Call(ctx, data[3], JS_UNDEFINED, 0, 0);
-
-    JS_FreeValue(ctx, handler);
   } else {
     js_pgconn_connect_cont(ctx, this_val, argc, argv, ret, data);
   }
@@ -1086,17 +1479,43 @@ js_pgconn_query_cont(JSContext* ctx, JSValueConst this_val, int argc, JSValueCon
   fd = PQsocket(pq->conn);
   ret = PQconsumeInput(pq->conn);
 
+  if(pq->stats)
+    query_stats_wakeup(pq->stats);
+
+  pgconn_notify_dispatch(pq, ctx);
+
   if(ret == 0) {
     JSValue err = js_pgsqlerror_new(ctx, pgconn_error(pq));
+
+    pgconn_trace_result(pq, 0);
+
+    if(pq->stats)
+      query_stats_end(pq->stats, TRUE, ctx);
+
     JS_Call(ctx, data[3], JS_UNDEFINED, 1, &err);
     JS_FreeValue(ctx, err);
   } else {
+    if(pq->stats)
+      query_stats_first_byte(pq->stats);
 
     if(!PQisBusy(pq->conn)) {
-      PGresult* res = PQgetResult(pq->conn);
-      JSValue res_val = pgconn_result(pq, res, ctx);
+      PGresult *res = PQgetResult(pq->conn), *next;
+      JSValue res_val;
+
+      pgconn_trace_result(pq, res);
+
+      if(pq->stats)
+        pgconn_stats_result(pq, res, ctx);
+
+      res_val = pgconn_result(pq, res, ctx);
+
+      /* collect the terminating NULL so the connection accepts the next command */
+      while(!PQisBusy(pq->conn) && (next = PQgetResult(pq->conn)))
+        PQclear(next);
 
       js_iohandler_set(ctx, data[1], fd, JS_NULL);
+      pq->waiting = FALSE;
+      pgconn_notify_watch(pq, TRUE, data[0], ctx);
 
       JS_Call(ctx, data[2], JS_UNDEFINED, 1, &res_val);
       JS_FreeValue(ctx, res_val);
@@ -1110,23 +1529,14 @@ js_pgconn_query_cont(JSContext* ctx, JSValueConst this_val, int argc, JSValueCon
   return JS_UNDEFINED;
 }
 
+/**
+ * Returns a Promise for the result of a command just sent with one of the
+ * PQsend*() functions (ret is their return value).
+ */
 static JSValue
-js_pgconn_query_start(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+pgconn_query_wait(JSContext* ctx, JSValueConst this_val, PGSQLConnection* pq, int ret) {
   JSValue promise = JS_UNDEFINED, data[4], handler;
-  const char* query = 0;
-  PGSQLConnection* pq;
-  int ret = 0, fd;
-
-  if(!(pq = js_pgconn_data2(ctx, this_val)))
-    return JS_EXCEPTION;
-
-  query = JS_ToCString(ctx, argv[0]);
-  ret = PQsendQuery(pq->conn, query);
-  fd = PQsocket(pq->conn);
-
-#ifdef DEBUG_OUTPUT
-  printf("%s ret=%d query='%s'\n", __func__, ret, query);
-#endif
+  int fd = PQsocket(pq->conn);
 
   promise = JS_NewPromiseCapability(ctx, &data[2]);
 
@@ -1142,12 +1552,15 @@ js_pgconn_query_start(JSContext* ctx, JSValueConst this_val, int argc, JSValueCo
     if(PQisBusy(pq->conn)) {
       handler = JS_NewCFunctionData(ctx, js_pgconn_query_cont, 0, 0, countof(data), data);
 
-      if(!js_iohandler_set(ctx, data[1], fd, handler))
+      /* takes over the socket from pgconn_notify_watch() */
+      if(!js_iohandler_set(ctx, data[1], fd, handler)) {
         JS_Call(ctx, data[3], JS_UNDEFINED, 0, 0);
-
-      JS_FreeValue(ctx, handler);
+      } else {
+        pq->waiting = TRUE;
+        pq->notify_watch = FALSE;
+      }
     } else {
-      js_pgconn_query_cont(ctx, this_val, argc, argv, 0, data);
+      js_pgconn_query_cont(ctx, this_val, 0, 0, 0, data);
     }
 
     JS_FreeValue(ctx, data[0]);
@@ -1161,79 +1574,1755 @@ js_pgconn_query_start(JSContext* ctx, JSValueConst this_val, int argc, JSValueCo
 }
 
 static JSValue
-js_pgconn_query(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+js_pgconn_query_start(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  const char* query = 0;
   PGSQLConnection* pq;
+  JSValue promise;
+  int ret = 0;
 
   if(!(pq = js_pgconn_data2(ctx, this_val)))
     return JS_EXCEPTION;
 
-  if(!pgconn_nonblock(pq)) {
-    PGresult* res = 0;
-    const char* query = 0;
-    JSValue ret = JS_UNDEFINED;
+  query = JS_ToCString(ctx, argv[0]);
 
-    query = JS_ToCString(ctx, argv[0]);
-    res = PQexec(pq->conn, query);
+  pq->trace_start = perf_trace_begin(PERF_TRACE_DB);
 
-    ret = res ? pgconn_result(pq, res, ctx) : JS_NULL;
+  if(pq->stats)
+    query_stats_begin(pq->stats, query ? strlen(query) : 0);
 
-    if(res)
-      JS_DefinePropertyValueStr(ctx, ret, "handle", JS_DupValue(ctx, this_val), JS_PROP_CONFIGURABLE);
+  /* binary results need the extended protocol, which takes a single statement */
+  if(pq->result_format)
+    ret = PQsendQueryParams(pq->conn, query, 0, 0, 0, 0, 0, pq->result_format);
+  else
+    ret = PQsendQuery(pq->conn, query);
 
-    return ret;
-  }
+#ifdef DEBUG_OUTPUT
+  printf("%s ret=%d query='%s'\n", __func__, ret, query);
+#endif
 
-  return js_pgconn_query_start(ctx, this_val, argc, argv);
+  promise = pgconn_query_wait(ctx, this_val, pq, ret);
+  JS_FreeCString(ctx, query);
+  return promise;
 }
 
-static JSValue
-js_pgconn_close(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
-  JSValue ret = JS_UNDEFINED;
-  PGSQLConnection* pq;
+static PGSQLStatement*
+pgstmt_new(JSContext* ctx, PGSQLConnection* pq, const char* sql) {
+  PGSQLStatement* st;
+  char name[32];
 
-  if(!(pq = js_pgconn_data2(ctx, this_val)))
-    return JS_EXCEPTION;
+  if(!(st = js_mallocz(ctx, sizeof(PGSQLStatement))))
+    return 0;
 
-  PQfinish(pq->conn);
-  pq->conn = 0;
+  snprintf(name, sizeof(name), "qjs_%" PRIu32, ++pq->statement_seq);
 
-  return ret;
+  st->ref_count = 1;
+  st->conn = pq;
+  st->name = js_strdup(ctx, name);
+  st->sql = js_strdup(ctx, sql);
+
+  list_add(&st->link, &pq->statements);
+  return st;
+}
+
+static PGSQLStatement*
+pgstmt_dup(PGSQLStatement* st) {
+  ++st->ref_count;
+  return st;
 }
 
+/**
+ * Drops a reference. The last one queues a DEALLOCATE on the connection,
+ * sent ahead of the next prepare.
+ */
 static void
-js_pgconn_finalizer(JSRuntime* rt, JSValue val) {
-  PGSQLConnection* pq;
+pgstmt_free(JSRuntime* rt, PGSQLStatement* st) {
+  if(--st->ref_count == 0) {
+    if(st->conn) {
+      list_del(&st->link);
+      dbuf_printf(&st->conn->deallocate, "DEALLOCATE %s;", st->name);
+    }
 
-  if((pq = JS_GetOpaque(val, js_pgconn_class_id)))
-    pgconn_free(pq, rt);
+    js_free_rt(rt, st->name);
+    js_free_rt(rt, st->sql);
+    js_free_rt(rt, st);
+  }
 }
 
-static JSClassDef js_pgconn_class = {
-    .class_name = "PGconn",
-    .finalizer = js_pgconn_finalizer,
-};
+static void
+pgstmt_touch(PGSQLStatement* st) {
+  list_del(&st->link);
+  list_add(&st->link, &st->conn->statements);
+}
 
-static const JSCFunctionListEntry js_pgconn_funcs[] = {
-    JS_CGETSET_MAGIC_DEF("cmdTuples", js_pgconn_get, 0, PROP_CMD_TUPLES),
-    JS_CGETSET_MAGIC_DEF("affectedRows", js_pgconn_get, 0, PROP_CMD_TUPLES),
+static PGSQLStatement*
+pgconn_cache_lookup(PGSQLConnection* pq, const char* sql) {
+  struct list_head* el;
 
-    JS_CGETSET_MAGIC_DEF("nonblocking", js_pgconn_get, js_pgconn_set, PROP_NONBLOCKING),
-    JS_CGETSET_MAGIC_DEF("fd", js_pgconn_get, 0, PROP_FD),
-    JS_CGETSET_MAGIC_DEF("errorMessage", js_pgconn_get, 0, PROP_ERROR_MESSAGE),
-    JS_CGETSET_MAGIC_DEF("options", js_pgconn_get, 0, PROP_OPTIONS),
-    JS_CGETSET_MAGIC_DEF("insertId", js_pgconn_get, 0, PROP_INSERT_ID),
-    JS_CGETSET_MAGIC_DEF("charset", js_pgconn_get, js_pgconn_set, PROP_CLIENT_ENCODING),
-    JS_CGETSET_MAGIC_DEF("protocolVersion", js_pgconn_get, 0, PROP_PROTOCOL_VERSION),
-    JS_CGETSET_MAGIC_DEF("serverVersion", js_pgconn_get, 0, PROP_SERVER_VERSION),
-    JS_CGETSET_MAGIC_DEF("user", js_pgconn_get, 0, PROP_USER),
-    JS_CGETSET_MAGIC_DEF("password", js_pgconn_get, 0, PROP_PASSWORD),
-    JS_CGETSET_MAGIC_DEF("host", js_pgconn_get, 0, PROP_HOST),
-    JS_CGETSET_MAGIC_DEF("port", js_pgconn_get, 0, PROP_PORT),
+  list_for_each(el, &pq->statements) {
+    PGSQLStatement* st = list_entry(el, PGSQLStatement, link);
+
+    if(st->cached && !strcmp(st->sql, sql)) {
+      pgstmt_touch(st);
+      return st;
+    }
+  }
+
+  return 0;
+}
+
+static void
+pgconn_cache_trim(PGSQLConnection* pq, JSRuntime* rt) {
+  struct list_head *el, *next;
+
+  list_for_each_prev_safe(el, next, &pq->statements) {
+    PGSQLStatement* st = list_entry(el, PGSQLStatement, link);
+
+    if(pq->num_cached <= pq->cache_size)
+      break;
+
+    if(st->cached) {
+      st->cached = FALSE;
+      pq->num_cached--;
+      pgstmt_free(rt, st);
+    }
+  }
+}
+
+static void
+pgconn_cache_add(PGSQLConnection* pq, PGSQLStatement* st, JSRuntime* rt) {
+  if(pq->cache_size == 0)
+    return;
+
+  st->cached = TRUE;
+  pgstmt_dup(st);
+  pq->num_cached++;
+
+  pgconn_cache_trim(pq, rt);
+}
+
+static JSValue
+js_pgstmt_wrap(JSContext* ctx, JSValueConst conn, PGSQLStatement* st) {
+  JSValue obj;
+
+  if(js_pgstmt_class_id == 0)
+    js_pgsql_init(ctx, 0);
+
+  obj = JS_NewObjectProtoClass(ctx, pgstmt_proto, js_pgstmt_class_id);
+  if(JS_IsException(obj))
+    return obj;
+
+  JS_SetOpaque(obj, pgstmt_dup(st));
+  JS_DefinePropertyValueStr(ctx, obj, "handle", JS_DupValue(ctx, conn), JS_PROP_CONFIGURABLE);
+
+  return obj;
+}
+
+static BOOL
+pgparams_init(JSContext* ctx, PGSQLParams* p, int count) {
+  p->count = count;
+  p->values = js_mallocz(ctx, sizeof(char*) * MAX_NUM(count, 1));
+  p->lengths = js_mallocz(ctx, sizeof(int) * MAX_NUM(count, 1));
+  p->formats = js_mallocz(ctx, sizeof(int) * MAX_NUM(count, 1));
+  p->buffers = js_mallocz(ctx, sizeof(InputBuffer) * MAX_NUM(count, 1));
+
+  return p->values && p->lengths && p->formats && p->buffers;
+}
+
+/**
+ * Binary format for ArrayBuffers and typed arrays, NULL for null and
+ * undefined, text otherwise (Dates as ISO strings, objects as JSON).
+ */
+static void
+pgparams_set(JSContext* ctx, PGSQLParams* p, int i, JSValueConst value) {
+  if(js_is_null_or_undefined(value)) {
+    p->values[i] = 0;
+  } else if(js_is_arraybuffer(ctx, value) || js_is_typedarray(ctx, value)) {
+    p->buffers[i] = js_input_buffer(ctx, value);
+    p->values[i] = (const char*)input_buffer_data(&p->buffers[i]);
+    p->lengths[i] = input_buffer_length(&p->buffers[i]);
+    p->formats[i] = 1;
+  } else {
+    JSValue str;
+    size_t len;
+
+    if(js_is_date(ctx, value))
+      str = js_invoke(ctx, value, "toISOString", 0, 0);
+    else if(JS_IsObject(value))
+      str = JS_JSONStringify(ctx, value, JS_UNDEFINED, JS_UNDEFINED);
+    else
+      str = JS_DupValue(ctx, value);
+
+    p->values[i] = JS_ToCStringLen(ctx, &len, str);
+    p->lengths[i] = len;
+    JS_FreeValue(ctx, str);
+  }
+}
+
+static BOOL
+pgparams_array(JSContext* ctx, PGSQLParams* p, JSValueConst array) {
+  int64_t i, len = js_array_length(ctx, array);
+
+  if(!pgparams_init(ctx, p, MAX_NUM(len, 0)))
+    return FALSE;
+
+  for(i = 0; i < len; i++) {
+    JSValue value = JS_GetPropertyUint32(ctx, array, i);
+    pgparams_set(ctx, p, i, value);
+    JS_FreeValue(ctx, value);
+  }
+
+  return TRUE;
+}
+
+static void
+pgparams_free(JSContext* ctx, PGSQLParams* p) {
+  for(int i = 0; p->values && p->formats && i < p->count; i++) {
+    if(p->formats[i])
+      input_buffer_free(&p->buffers[i], ctx);
+    else if(p->values[i])
+      JS_FreeCString(ctx, p->values[i]);
+  }
+
+  js_free(ctx, p->values);
+  js_free(ctx, p->lengths);
+  js_free(ctx, p->formats);
+  js_free(ctx, p->buffers);
+}
+
+struct PGPrepare {
+  JSContext* ctx;
+  JSValue conn, set_handler;
+  ResolveFunctions funcs;
+  PGSQLStatement* stmt;
+  PGresult* result;
+  BOOL deallocating;
+};
+
+typedef struct PGPrepare PGSQLPrepare;
+
+static void
+pgprepare_free(void* ptr) {
+  PGSQLPrepare* pp = ptr;
+  JSRuntime* rt = JS_GetRuntime(pp->ctx);
+
+  if(pp->result)
+    PQclear(pp->result);
+
+  pgstmt_free(rt, pp->stmt);
+  promise_free_funcs(rt, &pp->funcs);
+  JS_FreeValueRT(rt, pp->conn);
+  JS_FreeValueRT(rt, pp->set_handler);
+  js_free_rt(rt, pp);
+}
+
+static void
+pgprepare_settle(PGSQLPrepare* pp, PGSQLConnection* pq) {
+  JSContext* ctx = pp->ctx;
+  ExecStatusType status = pp->result ? PQresultStatus(pp->result) : PGRES_FATAL_ERROR;
+
+  js_iohandler_set(ctx, pp->set_handler, PQsocket(pq->conn), JS_NULL);
+  pq->waiting = FALSE;
+  pgconn_notify_watch(pq, TRUE, pp->conn, ctx);
+
+  if(status == PGRES_COMMAND_OK && pp->stmt->conn) {
+    JSValue obj = js_pgstmt_wrap(ctx, pp->conn, pp->stmt);
+
+    pgconn_cache_add(pq, pp->stmt, JS_GetRuntime(ctx));
+    promise_resolve(ctx, &pp->funcs, obj);
+    JS_FreeValue(ctx, obj);
+  } else {
+    JSValue err = js_pgsqlerror_new(ctx, pp->result ? PQresultErrorMessage(pp->result) : pgconn_error(pq));
+
+    promise_reject(ctx, &pp->funcs, err);
+    JS_FreeValue(ctx, err);
+  }
+}
+
+/**
+ * Read handler while preparing: first runs queued DEALLOCATEs (if any),
+ * then waits for the PQsendPrepare() result.
+ */
+static JSValue
+js_pgconn_prepare_cont(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  PGSQLPrepare* pp = ptr;
+  PGSQLConnection* pq;
+
+  if(!(pq = js_pgconn_data2(ctx, pp->conn)))
+    return JS_EXCEPTION;
+
+  if(!PQconsumeInput(pq->conn)) {
+    pgprepare_settle(pp, pq);
+    return JS_UNDEFINED;
+  }
+
+  pgconn_notify_dispatch(pq, ctx);
+
+  while(!PQisBusy(pq->conn)) {
+    PGresult* res;
+
+    if((res = PQgetResult(pq->conn))) {
+      /* keep the first result, or the first error */
+      if(!pp->result || (PQresultStatus(res) == PGRES_FATAL_ERROR && PQresultStatus(pp->result) != PGRES_FATAL_ERROR)) {
+        if(pp->result)
+          PQclear(pp->result);
+        pp->result = res;
+      } else {
+        PQclear(res);
+      }
+
+      continue;
+    }
+
+    if(pp->deallocating) {
+      pp->deallocating = FALSE;
+
+      if(pp->result) {
+        PQclear(pp->result);
+        pp->result = 0;
+      }
+
+      if(!PQsendPrepare(pq->conn, pp->stmt->name, pp->stmt->sql, 0, 0)) {
+        pgprepare_settle(pp, pq);
+        break;
+      }
+
+      continue;
+    }
+
+    pgprepare_settle(pp, pq);
+    break;
+  }
+
+  return JS_UNDEFINED;
+}
+
+/**
+ * Prepares sql (or reuses the cached statement for it). Returns a
+ * PGstatement, or a Promise for one on nonblocking connections.
+ */
+static JSValue
+js_pgconn_prepare(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  PGSQLConnection* pq;
+  PGSQLStatement* st;
+  const char* sql;
+  JSValue ret;
+
+  if(!(pq = js_pgconn_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(!pq->conn)
+    return JS_ThrowInternalError(ctx, "PGconn not connected");
+
+  if(!(sql = JS_ToCString(ctx, argv[0])))
+    return JS_EXCEPTION;
+
+  if((st = pgconn_cache_lookup(pq, sql))) {
+    JS_FreeCString(ctx, sql);
+    ret = js_pgstmt_wrap(ctx, this_val, st);
+
+    if(pgconn_nonblock(pq)) {
+      JSValue promise = js_promise_resolve(ctx, ret);
+      JS_FreeValue(ctx, ret);
+      ret = promise;
+    }
+
+    return ret;
+  }
+
+  st = pgstmt_new(ctx, pq, sql);
+  JS_FreeCString(ctx, sql);
+
+  if(!st)
+    return JS_EXCEPTION;
+
+  if(!pgconn_nonblock(pq)) {
+    PGresult* res;
+
+    if(pq->deallocate.size) {
+      dbuf_putc(&pq->deallocate, '\0');
+
+      if((res = PQexec(pq->conn, (const char*)pq->deallocate.buf)))
+        PQclear(res);
+
+      pq->deallocate.size = 0;
+    }
+
+    res = PQprepare(pq->conn, st->name, st->sql, 0, 0);
+
+    if(res && PQresultStatus(res) == PGRES_COMMAND_OK) {
+      ret = js_pgstmt_wrap(ctx, this_val, st);
+      pgconn_cache_add(pq, st, JS_GetRuntime(ctx));
+    } else {
+      ret = JS_Throw(ctx, js_pgsqlerror_new(ctx, res ? PQresultErrorMessage(res) : pgconn_error(pq)));
+    }
+
+    if(res)
+      PQclear(res);
+
+    pgstmt_free(JS_GetRuntime(ctx), st);
+    return ret;
+  } else {
+    PGSQLPrepare* pp;
+    JSValue handler;
+    int sent;
+
+    if(!(pp = js_mallocz(ctx, sizeof(PGSQLPrepare)))) {
+      pgstmt_free(JS_GetRuntime(ctx), st);
+      return JS_EXCEPTION;
+    }
+
+    pp->ctx = ctx;
+    pp->conn = JS_DupValue(ctx, this_val);
+    pp->set_handler = js_iohandler_fn(ctx, FALSE);
+    pp->stmt = st;
+
+    ret = JS_NewPromiseCapability(ctx, pp->funcs.array);
+
+    if(pq->deallocate.size) {
+      dbuf_putc(&pq->deallocate, '\0');
+      sent = PQsendQuery(pq->conn, (const char*)pq->deallocate.buf);
+      pq->deallocate.size = 0;
+      pp->deallocating = TRUE;
+    } else {
+      sent = PQsendPrepare(pq->conn, st->name, st->sql, 0, 0);
+    }
+
+    if(!sent) {
+      JSValue err = js_pgsqlerror_new(ctx, pgconn_error(pq));
+
+      promise_reject(ctx, &pp->funcs, err);
+      JS_FreeValue(ctx, err);
+      pgprepare_free(pp);
+      return ret;
+    }
+
+    handler = js_function_cclosure(ctx, js_pgconn_prepare_cont, 0, 0, pp, pgprepare_free);
+
+    if(!js_iohandler_set(ctx, pp->set_handler, PQsocket(pq->conn), handler)) {
+      JS_FreeValue(ctx, ret);
+      return JS_EXCEPTION;
+    }
+
+    pq->waiting = TRUE;
+    pq->notify_watch = FALSE;
+    return ret;
+  }
+}
+
+/**
+ * Runs a prepared statement with the given parameters.
+ */
+static JSValue
+pgstmt_execute(JSContext* ctx, JSValueConst stmt_obj, PGSQLParams* params) {
+  PGSQLStatement* st;
+  PGSQLConnection* pq;
+  JSValue conn, ret;
+
+  if(!(st = JS_GetOpaque2(ctx, stmt_obj, js_pgstmt_class_id)))
+    return JS_EXCEPTION;
+
+  if(!st->conn)
+    return JS_ThrowInternalError(ctx, "PGstatement connection closed");
+
+  pq = st->conn;
+  conn = JS_GetPropertyStr(ctx, stmt_obj, "handle");
+
+  if(st->cached)
+    pgstmt_touch(st);
+
+  pq->trace_start = perf_trace_begin(PERF_TRACE_DB);
+
+  if(pq->stats) {
+    size_t bytes = 0;
+
+    for(int i = 0; i < params->count; i++)
+      if(params->values[i])
+        bytes += params->formats[i] ? (size_t)params->lengths[i] : strlen(params->values[i]);
+
+    query_stats_begin(pq->stats, bytes);
+  }
+
+  if(!pgconn_nonblock(pq)) {
+    PGresult* res = PQexecPrepared(pq->conn, st->name, params->count, params->values, params->lengths, params->formats, pq->result_format);
+
+    pgconn_trace_result(pq, res);
+
+    if(pq->stats)
+      pgconn_stats_result(pq, res, ctx);
+
+    ret = res ? pgconn_result(pq, res, ctx) : JS_NULL;
+
+    if(res)
+      JS_DefinePropertyValueStr(ctx, ret, "handle", JS_DupValue(ctx, conn), JS_PROP_CONFIGURABLE);
+  } else {
+    int sent = PQsendQueryPrepared(pq->conn, st->name, params->count, params->values, params->lengths, params->formats, pq->result_format);
+
+    ret = pgconn_query_wait(ctx, conn, pq, sent);
+  }
+
+  JS_FreeValue(ctx, conn);
+  return ret;
+}
+
+static JSValue
+js_pgstmt_execute(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  PGSQLParams params;
+  JSValue ret;
+
+  if(!pgparams_init(ctx, &params, argc)) {
+    pgparams_free(ctx, &params);
+    return JS_EXCEPTION;
+  }
+
+  for(int i = 0; i < argc; i++)
+    pgparams_set(ctx, &params, i, argv[i]);
+
+  ret = pgstmt_execute(ctx, this_val, &params);
+  pgparams_free(ctx, &params);
+  return ret;
+}
+
+static JSValue
+js_pgstmt_execute_array(JSContext* ctx, JSValueConst stmt_obj, JSValueConst array) {
+  PGSQLParams params;
+  JSValue ret;
+
+  if(!pgparams_array(ctx, &params, array)) {
+    pgparams_free(ctx, &params);
+    return JS_EXCEPTION;
+  }
+
+  ret = pgstmt_execute(ctx, stmt_obj, &params);
+  pgparams_free(ctx, &params);
+  return ret;
+}
+
+static JSValue
+js_pgconn_query_prepared(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, JSValue data[]) {
+  return js_pgstmt_execute_array(ctx, argv[0], data[0]);
+}
+
+/**
+ * query(sql, params): runs sql through the statement cache.
+ */
+static JSValue
+js_pgconn_query_params(JSContext* ctx, JSValueConst this_val, JSValueConst sql, JSValueConst params) {
+  JSValue stmt, ret;
+
+  stmt = js_pgconn_prepare(ctx, this_val, 1, &sql);
+
+  if(JS_IsException(stmt))
+    return stmt;
+
+  if(js_is_promise(ctx, stmt)) {
+    JSValue handler = JS_NewCFunctionData(ctx, js_pgconn_query_prepared, 1, 0, 1, &params);
+
+    ret = promise_then(ctx, stmt, handler);
+    JS_FreeValue(ctx, handler);
+  } else {
+    ret = js_pgstmt_execute_array(ctx, stmt, params);
+  }
+
+  JS_FreeValue(ctx, stmt);
+  return ret;
+}
+
+enum {
+  STMT_NAME,
+  STMT_SQL,
+  STMT_CACHED,
+};
+
+static JSValue
+js_pgstmt_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  PGSQLStatement* st;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(st = JS_GetOpaque2(ctx, this_val, js_pgstmt_class_id)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case STMT_NAME: {
+      ret = JS_NewString(ctx, st->name);
+      break;
+    }
+
+    case STMT_SQL: {
+      ret = JS_NewString(ctx, st->sql);
+      break;
+    }
+
+    case STMT_CACHED: {
+      ret = JS_NewBool(ctx, st->cached);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static void
+js_pgstmt_finalizer(JSRuntime* rt, JSValue val) {
+  PGSQLStatement* st;
+
+  if((st = JS_GetOpaque(val, js_pgstmt_class_id)))
+    pgstmt_free(rt, st);
+}
+
+static JSClassDef js_pgstmt_class = {
+    .class_name = "PGstatement",
+    .finalizer = js_pgstmt_finalizer,
+};
+
+static const JSCFunctionListEntry js_pgstmt_funcs[] = {
+    JS_CFUNC_DEF("execute", 0, js_pgstmt_execute),
+    JS_CGETSET_MAGIC_DEF("name", js_pgstmt_get, 0, STMT_NAME),
+    JS_CGETSET_MAGIC_DEF("sql", js_pgstmt_get, 0, STMT_SQL),
+    JS_CGETSET_MAGIC_DEF("cached", js_pgstmt_get, 0, STMT_CACHED),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "PGstatement", JS_PROP_CONFIGURABLE),
+};
+
+#ifdef LIBPQ_HAS_PIPELINING
+static JSValue js_pgconn_pipeline_read(JSContext*, JSValueConst, int, JSValueConst[], int, JSValue[]);
+static JSValue js_pgconn_pipeline_write(JSContext*, JSValueConst, int, JSValueConst[], int, JSValue[]);
+
+static void
+pgconn_pipeline_watch(PGSQLConnection* pq, BOOL write, BOOL enable, JSValueConst conn, JSContext* ctx) {
+  BOOL* flag = write ? &pq->writing : &pq->reading;
+  JSValue set_handler, handler = JS_NULL;
+
+  if(*flag == enable)
+    return;
+
+  if(enable)
+    handler = JS_NewCFunctionData(ctx, write ? js_pgconn_pipeline_write : js_pgconn_pipeline_read, 0, 0, 1, &conn);
+
+  set_handler = js_iohandler_fn(ctx, write);
+
+  if(js_iohandler_set(ctx, set_handler, PQsocket(pq->conn), handler)) {
+    *flag = enable;
+
+    if(!write)
+      pq->notify_watch = FALSE;
+  }
+
+  JS_FreeValue(ctx, set_handler);
+
+  if(!write && !enable)
+    pgconn_notify_watch(pq, TRUE, conn, ctx);
+}
+
+/**
+ * Sends buffered output, watching for writability while libpq still
+ * has data queued.
+ */
+static BOOL
+pgconn_pipeline_flush(PGSQLConnection* pq, JSValueConst conn, JSContext* ctx) {
+  int ret = PQflush(pq->conn);
+
+  if(ret >= 0)
+    pgconn_pipeline_watch(pq, TRUE, ret == 1, conn, ctx);
+
+  return ret >= 0;
+}
+
+static JSValue
+pgconn_pipeline_push(PGSQLConnection* pq, BOOL sync, JSContext* ctx) {
+  PGSQLPipelineEntry* e;
+  JSValue promise;
+
+  if(!(e = js_malloc(ctx, sizeof(PGSQLPipelineEntry))))
+    return JS_EXCEPTION;
+
+  promise = JS_NewPromiseCapability(ctx, e->funcs.array);
+  e->result = 0;
+  e->sync = sync;
+
+  list_add_tail(&e->link, &pq->pipeline);
+
+  return promise;
+}
+
+static void
+pgconn_pipeline_settle(PGSQLConnection* pq, PGSQLPipelineEntry* e, JSContext* ctx) {
+  ExecStatusType status = e->result ? PQresultStatus(e->result) : PGRES_COMMAND_OK;
+
+  list_del(&e->link);
+
+  if(e->sync) {
+    promise_resolve(ctx, &e->funcs, JS_TRUE);
+  } else if(status == PGRES_FATAL_ERROR || status == PGRES_PIPELINE_ABORTED) {
+    const char* msg = status == PGRES_FATAL_ERROR ? PQresultErrorMessage(e->result) : "pipeline aborted by an earlier error";
+    JSValue err = js_pgsqlerror_new(ctx, msg);
+
+    promise_reject(ctx, &e->funcs, err);
+    JS_FreeValue(ctx, err);
+    PQclear(e->result);
+  } else {
+    JSValue res_val = e->result ? pgconn_result(pq, e->result, ctx) : JS_NULL;
+
+    promise_resolve(ctx, &e->funcs, res_val);
+    JS_FreeValue(ctx, res_val);
+  }
+
+  js_resolve_functions_free(ctx, &e->funcs);
+  js_free(ctx, e);
+}
+
+static void
+pgconn_pipeline_fail(PGSQLConnection* pq, JSContext* ctx) {
+  JSValue err = js_pgsqlerror_new(ctx, pgconn_error(pq));
+  struct list_head *el, *next;
+
+  list_for_each_safe(el, next, &pq->pipeline) {
+    PGSQLPipelineEntry* e = list_entry(el, PGSQLPipelineEntry, link);
+
+    list_del(&e->link);
+    promise_reject(ctx, &e->funcs, err);
+    js_resolve_functions_free(ctx, &e->funcs);
+
+    if(e->result)
+      PQclear(e->result);
+
+    js_free(ctx, e);
+  }
+
+  JS_FreeValue(ctx, err);
+}
+
+/**
+ * Read handler: consumes input and settles queued entries in order.
+ * Each query yields its result(s) followed by NULL, a sync point yields
+ * a single PGRES_PIPELINE_SYNC result.
+ */
+static JSValue
+js_pgconn_pipeline_read(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, JSValue data[]) {
+  PGSQLConnection* pq;
+
+  if(!(pq = js_pgconn_data2(ctx, data[0])))
+    return JS_EXCEPTION;
+
+  if(!PQconsumeInput(pq->conn)) {
+    pgconn_pipeline_fail(pq, ctx);
+  } else {
+    pgconn_notify_dispatch(pq, ctx);
+
+    while(!list_empty(&pq->pipeline) && !PQisBusy(pq->conn)) {
+      PGSQLPipelineEntry* e = list_entry(pq->pipeline.next, PGSQLPipelineEntry, link);
+      PGresult* res = PQgetResult(pq->conn);
+
+      if(res == NULL) {
+        if(e->sync)
+          break;
+
+        pgconn_pipeline_settle(pq, e, ctx);
+        continue;
+      }
+
+      if(PQresultStatus(res) == PGRES_PIPELINE_SYNC) {
+        PQclear(res);
+
+        if(e->sync)
+          pgconn_pipeline_settle(pq, e, ctx);
+
+        continue;
+      }
+
+      /* multi-statement queries keep the last result */
+      if(e->result)
+        PQclear(e->result);
+
+      e->result = res;
+    }
+
+    if(pq->writing)
+      pgconn_pipeline_flush(pq, data[0], ctx);
+  }
+
+  if(list_empty(&pq->pipeline))
+    pgconn_pipeline_watch(pq, FALSE, FALSE, data[0], ctx);
+
+  return JS_UNDEFINED;
+}
+
+static JSValue
+js_pgconn_pipeline_write(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, JSValue data[]) {
+  PGSQLConnection* pq;
+
+  if(!(pq = js_pgconn_data2(ctx, data[0])))
+    return JS_EXCEPTION;
+
+  if(!pgconn_pipeline_flush(pq, data[0], ctx)) {
+    pgconn_pipeline_watch(pq, TRUE, FALSE, data[0], ctx);
+    pgconn_pipeline_fail(pq, ctx);
+  }
+
+  return JS_UNDEFINED;
+}
+
+/**
+ * Queues a query on a connection in pipeline mode. A flush request is
+ * sent with it so the server streams the result back without waiting
+ * for the next sync point.
+ */
+static JSValue
+js_pgconn_pipeline_query(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  PGSQLConnection* pq;
+  const char* query;
+  JSValue promise;
+  int ret;
+
+  if(!(pq = js_pgconn_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(!(query = JS_ToCString(ctx, argv[0])))
+    return JS_EXCEPTION;
+
+  ret = PQsendQueryParams(pq->conn, query, 0, 0, 0, 0, 0, pq->result_format);
+  JS_FreeCString(ctx, query);
+
+  if(!ret || !PQsendFlushRequest(pq->conn))
+    return JS_Throw(ctx, js_pgsqlerror_new(ctx, pgconn_error(pq)));
+
+  promise = pgconn_pipeline_push(pq, FALSE, ctx);
+
+  if(!pgconn_pipeline_flush(pq, this_val, ctx))
+    pgconn_pipeline_fail(pq, ctx);
+  else
+    pgconn_pipeline_watch(pq, FALSE, TRUE, this_val, ctx);
+
+  return promise;
+}
+#endif
+
+enum {
+  PIPELINE_ENTER,
+  PIPELINE_EXIT,
+  PIPELINE_SYNC,
+};
+
+static JSValue
+js_pgconn_pipeline(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  PGSQLConnection* pq;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(pq = js_pgconn_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(!pq->conn)
+    return JS_ThrowInternalError(ctx, "PGconn not connected");
+
+#ifdef LIBPQ_HAS_PIPELINING
+  switch(magic) {
+    case PIPELINE_ENTER: {
+      if(!PQisnonblocking(pq->conn))
+        PQsetnonblocking(pq->conn, 1);
+
+      ret = JS_NewBool(ctx, PQenterPipelineMode(pq->conn));
+      break;
+    }
+
+    case PIPELINE_EXIT: {
+      if(!list_empty(&pq->pipeline))
+        return JS_ThrowInternalError(ctx, "pipeline has pending results");
+
+      ret = JS_NewBool(ctx, PQexitPipelineMode(pq->conn));
+      break;
+    }
+
+    case PIPELINE_SYNC: {
+      if(!PQpipelineSync(pq->conn))
+        return JS_Throw(ctx, js_pgsqlerror_new(ctx, pgconn_error(pq)));
+
+      ret = pgconn_pipeline_push(pq, TRUE, ctx);
+
+      if(!pgconn_pipeline_flush(pq, this_val, ctx))
+        pgconn_pipeline_fail(pq, ctx);
+      else
+        pgconn_pipeline_watch(pq, FALSE, TRUE, this_val, ctx);
+
+      break;
+    }
+  }
+#else
+  ret = JS_ThrowInternalError(ctx, "libpq without pipeline mode");
+#endif
+
+  return ret;
+}
+
+/**
+ * \defgroup pgsql-copy COPY streams
+ *
+ * copyTo() and copyFrom() run a COPY ... TO STDOUT / FROM STDIN and move
+ * its data through a ReadableStream / WritableStream chunk by chunk using
+ * PQgetCopyData / PQputCopyData, so memory stays bounded by the stream's
+ * queue instead of the size of the table.
+ * @{
+ */
+typedef enum {
+  COPY_STARTING = 0,
+  COPY_ACTIVE,
+  COPY_ENDING,
+  COPY_DONE,
+} PGCopyState;
+
+typedef enum {
+  COPY_OP_NONE = 0,
+  COPY_OP_PULL,
+  COPY_OP_WRITE,
+  COPY_OP_END,
+} PGCopyOp;
+
+struct PGCopy {
+  int ref_count;
+  JSContext* ctx;
+  JSValue conn, controller;
+  PGSQLConnection* pq;
+  PGCopyState state;
+  PGCopyOp op;
+  ResolveFunctions funcs;
+  InputBuffer chunk;
+  char* abort_reason;
+  BOOL out, queued, reading, writing;
+  int64_t rows;
+  JSValue error;
+};
+
+typedef struct PGCopy PGSQLCopy;
+
+static PGSQLCopy*
+pgcopy_dup(PGSQLCopy* cp) {
+  ++cp->ref_count;
+  return cp;
+}
+
+static void
+pgcopy_free(void* ptr) {
+  PGSQLCopy* cp = ptr;
+
+  if(--cp->ref_count == 0) {
+    JSContext* ctx = cp->ctx;
+
+    promise_free_funcs(JS_GetRuntime(ctx), &cp->funcs);
+    input_buffer_free(&cp->chunk, ctx);
+
+    if(cp->abort_reason)
+      js_free(ctx, cp->abort_reason);
+
+    JS_FreeValue(ctx, cp->controller);
+    JS_FreeValue(ctx, cp->error);
+    JS_FreeValue(ctx, cp->conn);
+    js_free(ctx, cp);
+  }
+}
+
+static JSValue js_pgcopy_event(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr);
+
+static void
+pgcopy_watch(PGSQLCopy* cp, BOOL write, BOOL enable) {
+  JSContext* ctx = cp->ctx;
+  BOOL* flag = write ? &cp->writing : &cp->reading;
+  JSValue set_handler, handler = JS_NULL;
+
+  if(*flag == enable || !cp->pq->conn)
+    return;
+
+  if(enable)
+    handler = js_function_cclosure(ctx, js_pgcopy_event, 0, write, pgcopy_dup(cp), pgcopy_free);
+
+  set_handler = js_iohandler_fn(ctx, write);
+
+  if(js_iohandler_set(ctx, set_handler, PQsocket(cp->pq->conn), handler)) {
+    *flag = enable;
+
+    if(!write) {
+      cp->pq->waiting = enable;
+      cp->pq->notify_watch = FALSE;
+    }
+  }
+
+  JS_FreeValue(ctx, set_handler);
+
+  if(!write && !enable)
+    pgconn_notify_watch(cp->pq, TRUE, cp->conn, ctx);
+}
+
+static void
+pgcopy_unwatch(PGSQLCopy* cp) {
+  pgcopy_watch(cp, FALSE, FALSE);
+  pgcopy_watch(cp, TRUE, FALSE);
+}
+
+/**
+ * Settles the pending operation. A stream error also errors the
+ * readable side, whose reader is not waiting on a pull() promise.
+ */
+static void
+pgcopy_settle(PGSQLCopy* cp, JSValueConst value, BOOL error) {
+  JSContext* ctx = cp->ctx;
+
+  cp->op = COPY_OP_NONE;
+  input_buffer_free(&cp->chunk, ctx);
+
+  if(error && cp->out && !JS_IsUndefined(cp->controller))
+    JS_FreeValue(ctx, js_invoke(ctx, cp->controller, "error", 1, &value));
+
+  if(!promise_pending(&cp->funcs))
+    return;
+
+  if(error)
+    promise_reject(ctx, &cp->funcs, value);
+  else
+    promise_resolve(ctx, &cp->funcs, value);
+}
+
+static void
+pgcopy_fail(PGSQLCopy* cp, const char* msg) {
+  JSContext* ctx = cp->ctx;
+
+  if(JS_IsUndefined(cp->error))
+    cp->error = js_pgsqlerror_new(ctx, msg);
+
+  /* results of the failed COPY still have to be drained */
+  cp->state = cp->state == COPY_DONE ? COPY_DONE : COPY_ENDING;
+}
+
+/**
+ * Advances the COPY as far as it goes without blocking and arms the
+ * socket handler for whatever it waits on next.
+ */
+static void
+pgcopy_step(PGSQLCopy* cp) {
+  JSContext* ctx = cp->ctx;
+  PGconn* conn = cp->pq->conn;
+  BOOL nonblocking = cp->pq->nonblocking;
+  BOOL want_read = FALSE, want_write = FALSE;
+
+  if(!conn) {
+    pgcopy_fail(cp, "connection closed");
+    cp->state = COPY_DONE;
+  } else if(nonblocking && !PQconsumeInput(conn)) {
+    pgcopy_fail(cp, PQerrorMessage(conn));
+  } else if(nonblocking) {
+    pgconn_notify_dispatch(cp->pq, ctx);
+  }
+
+  for(;;) {
+    switch(cp->state) {
+      case COPY_STARTING: {
+        PGresult* res;
+        ExecStatusType status;
+
+        if(nonblocking && PQisBusy(conn)) {
+          want_read = TRUE;
+          goto wait;
+        }
+
+        if(!(res = PQgetResult(conn))) {
+          pgcopy_fail(cp, "COPY did not start");
+          continue;
+        }
+
+        status = PQresultStatus(res);
+
+        if(status == (cp->out ? PGRES_COPY_OUT : PGRES_COPY_IN))
+          cp->state = COPY_ACTIVE;
+        else
+          pgcopy_fail(cp, status == PGRES_FATAL_ERROR ? PQresultErrorMessage(res) : "not a COPY statement");
+
+        PQclear(res);
+        continue;
+      }
+
+      case COPY_ACTIVE: {
+        if(cp->op == COPY_OP_PULL) {
+          char* buf = 0;
+          int n = PQgetCopyData(conn, &buf, nonblocking);
+
+          if(n > 0) {
+            JSValue chunk = JS_NewArrayBufferCopy(ctx, (const uint8_t*)buf, n);
+
+            PQfreemem(buf);
+            JS_FreeValue(ctx, js_invoke(ctx, cp->controller, "enqueue", 1, &chunk));
+            JS_FreeValue(ctx, chunk);
+            pgcopy_settle(cp, JS_UNDEFINED, FALSE);
+          } else if(n == 0) {
+            want_read = TRUE;
+          } else if(n == -1) {
+            cp->state = COPY_ENDING;
+            continue;
+          } else {
+            pgcopy_fail(cp, PQerrorMessage(conn));
+            continue;
+          }
+        } else if(cp->op == COPY_OP_WRITE) {
+          if(!cp->queued) {
+            int r = PQputCopyData(conn, (const char*)input_buffer_data(&cp->chunk), input_buffer_length(&cp->chunk));
+
+            if(r == 0) {
+              want_write = TRUE;
+              goto wait;
+            }
+
+            if(r < 0) {
+              pgcopy_fail(cp, PQerrorMessage(conn));
+              continue;
+            }
+
+            cp->queued = TRUE;
+          }
+
+          switch(PQflush(conn)) {
+            case 0: {
+              cp->queued = FALSE;
+              pgcopy_settle(cp, JS_UNDEFINED, FALSE);
+              break;
+            }
+
+            case 1: {
+              want_write = TRUE;
+              break;
+            }
+
+            default: {
+              pgcopy_fail(cp, PQerrorMessage(conn));
+              continue;
+            }
+          }
+        } else if(cp->op == COPY_OP_END) {
+          int r = PQputCopyEnd(conn, cp->abort_reason);
+
+          if(r == 0) {
+            want_write = TRUE;
+            goto wait;
+          }
+
+          if(r < 0)
+            pgcopy_fail(cp, PQerrorMessage(conn));
+          else
+            cp->state = COPY_ENDING;
+
+          continue;
+        }
+
+        goto wait;
+      }
+
+      case COPY_ENDING: {
+        PGresult* res;
+
+        if(nonblocking) {
+          int r = PQflush(conn);
+
+          if(r == 1) {
+            want_write = TRUE;
+            goto wait;
+          }
+
+          if(PQisBusy(conn)) {
+            want_read = TRUE;
+            goto wait;
+          }
+        }
+
+        if(!(res = PQgetResult(conn))) {
+          cp->state = COPY_DONE;
+          continue;
+        }
+
+        switch(PQresultStatus(res)) {
+          case PGRES_COMMAND_OK: {
+            const char* tuples = PQcmdTuples(res);
+
+            cp->rows = tuples && *tuples ? atoll(tuples) : 0;
+            break;
+          }
+
+          /* the server still wants data after an error: end the COPY */
+          case PGRES_COPY_IN: {
+            PQputCopyEnd(conn, "COPY aborted");
+            break;
+          }
+
+          case PGRES_COPY_OUT: {
+            char* buf = 0;
+
+            while(PQgetCopyData(conn, &buf, 0) > 0)
+              PQfreemem(buf);
+
+            break;
+          }
+
+          default: {
+            pgcopy_fail(cp, PQresultErrorMessage(res));
+            break;
+          }
+        }
+
+        PQclear(res);
+        continue;
+      }
+
+      case COPY_DONE: {
+        /* an aborted COPY FROM always ends in an error, which is the expected outcome */
+        if(!JS_IsUndefined(cp->error) && !(cp->abort_reason && cp->op == COPY_OP_END)) {
+          JSValue error = JS_DupValue(ctx, cp->error);
+
+          if(cp->op != COPY_OP_NONE || cp->out)
+            pgcopy_settle(cp, error, TRUE);
+
+          JS_FreeValue(ctx, error);
+        } else if(cp->out) {
+          if(!JS_IsUndefined(cp->controller))
+            JS_FreeValue(ctx, js_invoke(ctx, cp->controller, "close", 0, 0));
+
+          pgcopy_settle(cp, JS_UNDEFINED, FALSE);
+        } else if(cp->op == COPY_OP_END) {
+          JSValue rows = JS_NewInt64(ctx, cp->rows);
+
+          pgcopy_settle(cp, rows, FALSE);
+          JS_FreeValue(ctx, rows);
+        } else if(cp->op != COPY_OP_NONE) {
+          JSValue error = js_pgsqlerror_new(ctx, "COPY already finished");
+
+          pgcopy_settle(cp, error, TRUE);
+          JS_FreeValue(ctx, error);
+        }
+
+        /* the controller keeps the stream and thereby this COPY alive */
+        if(cp->out) {
+          JS_FreeValue(ctx, cp->controller);
+          cp->controller = JS_UNDEFINED;
+        }
+
+        goto wait;
+      }
+    }
+  }
+
+wait:
+  if(!nonblocking)
+    want_read = want_write = FALSE;
+
+  pgcopy_watch(cp, FALSE, want_read);
+  pgcopy_watch(cp, TRUE, want_write);
+}
+
+static JSValue
+js_pgcopy_event(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  PGSQLCopy* cp = pgcopy_dup(ptr);
+
+  pgcopy_step(cp);
+  pgcopy_free(cp);
+
+  return JS_UNDEFINED;
+}
+
+/**
+ * Starts operation op and returns its promise. The stream calls write()
+ * and pull() one at a time, so there never is more than one pending.
+ */
+static JSValue
+pgcopy_begin(PGSQLCopy* cp, PGCopyOp op) {
+  JSContext* ctx = cp->ctx;
+  JSValue ret;
+
+  if(cp->op != COPY_OP_NONE)
+    return JS_ThrowInternalError(ctx, "COPY operation already in progress");
+
+  if(JS_IsException((ret = JS_NewPromiseCapability(ctx, cp->funcs.array))))
+    return ret;
+
+  cp->op = op;
+  pgcopy_step(cp);
+
+  return ret;
+}
+
+enum {
+  COPY_METHOD_PULL = 0,
+  COPY_METHOD_CANCEL,
+  COPY_METHOD_WRITE,
+  COPY_METHOD_CLOSE,
+  COPY_METHOD_ABORT,
+};
+
+static JSValue
+js_pgcopy_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  PGSQLCopy* cp = ptr;
+  JSValue ret = JS_UNDEFINED;
+
+  switch(magic) {
+    case COPY_METHOD_PULL: {
+      ret = pgcopy_begin(cp, COPY_OP_PULL);
+      break;
+    }
+
+    case COPY_METHOD_WRITE: {
+      InputBuffer input = js_input_chars(ctx, argv[0]);
+
+      if(!input_buffer_valid(&input)) {
+        JSValue str = JS_ToString(ctx, argv[0]);
+
+        input_buffer_free(&input, ctx);
+        input = js_input_chars(ctx, str);
+        JS_FreeValue(ctx, str);
+      }
+
+      ret = pgcopy_begin(cp, COPY_OP_WRITE);
+
+      if(JS_IsException(ret))
+        input_buffer_free(&input, ctx);
+      else
+        cp->chunk = input;
+
+      break;
+    }
+
+    case COPY_METHOD_CANCEL:
+    case COPY_METHOD_ABORT: {
+      const char* reason = argc > 0 && !JS_IsUndefined(argv[0]) ? JS_ToCString(ctx, argv[0]) : 0;
+
+      if(cp->abort_reason)
+        js_free(ctx, cp->abort_reason);
+
+      cp->abort_reason = js_strdup(ctx, reason ? reason : "COPY aborted");
+
+      if(reason)
+        JS_FreeCString(ctx, reason);
+
+      if(cp->out) {
+        /* libpq has no way to stop COPY OUT early other than a cancel request */
+        char errbuf[256];
+        PGcancel* cancel;
+
+        if(cp->pq->conn && (cancel = PQgetCancel(cp->pq->conn))) {
+          PQcancel(cancel, errbuf, sizeof(errbuf));
+          PQfreeCancel(cancel);
+        }
+
+        JS_FreeValue(ctx, cp->controller);
+        cp->controller = JS_UNDEFINED;
+
+        if(cp->state == COPY_ACTIVE)
+          cp->state = COPY_ENDING;
+
+        pgcopy_step(cp);
+        break;
+      }
+
+      ret = pgcopy_begin(cp, COPY_OP_END);
+      break;
+    }
+
+    case COPY_METHOD_CLOSE: {
+      ret = pgcopy_begin(cp, COPY_OP_END);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static PGSQLCopy*
+pgcopy_new(JSContext* ctx, JSValueConst this_val, PGSQLConnection* pq, BOOL out) {
+  PGSQLCopy* cp;
+
+  if(!(cp = js_mallocz(ctx, sizeof(PGSQLCopy))))
+    return 0;
+
+  cp->ref_count = 1;
+  cp->ctx = ctx;
+  cp->conn = JS_DupValue(ctx, this_val);
+  cp->controller = JS_UNDEFINED;
+  cp->error = JS_UNDEFINED;
+  cp->pq = pq;
+  cp->out = out;
+  cp->funcs.resolve = cp->funcs.reject = JS_NULL;
+
+  return cp;
+}
+
+static void
+pgcopy_define(PGSQLCopy* cp, JSValueConst obj, const char* name, int magic) {
+  JSContext* ctx = cp->ctx;
+
+  JS_SetPropertyStr(ctx, obj, name, js_function_cclosure(ctx, js_pgcopy_method, 1, magic, pgcopy_dup(cp), pgcopy_free));
+}
+
+/**
+ * copyTo(sql) / copyFrom(sql): sends the COPY statement and returns a
+ * ReadableStream of ArrayBuffers (COPY ... TO STDOUT) or a WritableStream
+ * accepting strings and buffers (COPY ... FROM STDIN), whose close()
+ * resolves with the number of rows copied.
+ */
+static JSValue
+js_pgconn_copy(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  PGSQLConnection* pq;
+  PGSQLCopy* cp;
+  const char* sql;
+  JSValue underlying, ret;
+  BOOL out = magic;
+
+  if(!(pq = js_pgconn_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(!pq->conn)
+    return JS_ThrowInternalError(ctx, "PGconn not connected");
+
+  if(!(sql = JS_ToCString(ctx, argv[0])))
+    return JS_EXCEPTION;
+
+  if(!pq->nonblocking) {
+    PGresult* res = PQexec(pq->conn, sql);
+    ExecStatusType status = res ? PQresultStatus(res) : PGRES_FATAL_ERROR;
+
+    JS_FreeCString(ctx, sql);
+
+    if(status != (out ? PGRES_COPY_OUT : PGRES_COPY_IN)) {
+      JSValue error = js_pgsqlerror_new(ctx, res && status == PGRES_FATAL_ERROR ? PQresultErrorMessage(res) : "not a COPY statement");
+
+      if(res)
+        PQclear(res);
+
+      return JS_Throw(ctx, error);
+    }
+
+    PQclear(res);
+  } else {
+    int sent = PQsendQuery(pq->conn, sql);
+
+    JS_FreeCString(ctx, sql);
+
+    if(!sent)
+      return JS_Throw(ctx, js_pgsqlerror_new(ctx, PQerrorMessage(pq->conn)));
+  }
+
+  if(!(cp = pgcopy_new(ctx, this_val, pq, out)))
+    return JS_EXCEPTION;
+
+  cp->state = pq->nonblocking ? COPY_STARTING : COPY_ACTIVE;
+
+  if(js_readable_class_id == 0)
+    js_stream_init(ctx, 0);
+
+  underlying = JS_NewObject(ctx);
+
+  if(out) {
+    pgcopy_define(cp, underlying, "pull", COPY_METHOD_PULL);
+    pgcopy_define(cp, underlying, "cancel", COPY_METHOD_CANCEL);
+
+    ret = js_readable_constructor(ctx, readable_ctor, 1, &underlying);
+
+    /* start() only runs once a reader is created, take the controller from the stream */
+    if(!JS_IsException(ret)) {
+      Readable* st = js_readable_data(ret);
+
+      cp->controller = JS_DupValue(ctx, st->controller);
+    }
+  } else {
+    pgcopy_define(cp, underlying, "write", COPY_METHOD_WRITE);
+    pgcopy_define(cp, underlying, "close", COPY_METHOD_CLOSE);
+    pgcopy_define(cp, underlying, "abort", COPY_METHOD_ABORT);
+
+    ret = js_writable_constructor(ctx, writable_ctor, 1, &underlying);
+  }
+
+  JS_FreeValue(ctx, underlying);
+  pgcopy_free(cp);
+
+  return ret;
+}
+
+/**
+ * @}
+ */
+
+static JSValue
+js_pgconn_query(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  PGSQLConnection* pq;
+
+  if(!(pq = js_pgconn_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+#ifdef LIBPQ_HAS_PIPELINING
+  if(pq->conn && PQpipelineStatus(pq->conn) != PQ_PIPELINE_OFF)
+    return js_pgconn_pipeline_query(ctx, this_val, argc, argv);
+#endif
+
+  if(argc > 1 && JS_IsArray(ctx, argv[1]))
+    return js_pgconn_query_params(ctx, this_val, argv[0], argv[1]);
+
+  if(!pgconn_nonblock(pq)) {
+    PGresult* res = 0;
+    const char* query = 0;
+    JSValue ret = JS_UNDEFINED;
+
+    query = JS_ToCString(ctx, argv[0]);
+
+    pq->trace_start = perf_trace_begin(PERF_TRACE_DB);
+
+    if(pq->stats)
+      query_stats_begin(pq->stats, query ? strlen(query) : 0);
+
+    res = pq->result_format ? PQexecParams(pq->conn, query, 0, 0, 0, 0, 0, pq->result_format) : PQexec(pq->conn, query);
+    JS_FreeCString(ctx, query);
+
+    pgconn_trace_result(pq, res);
+
+    if(pq->stats)
+      pgconn_stats_result(pq, res, ctx);
+
+    ret = res ? pgconn_result(pq, res, ctx) : JS_NULL;
+
+    if(res)
+      JS_DefinePropertyValueStr(ctx, ret, "handle", JS_DupValue(ctx, this_val), JS_PROP_CONFIGURABLE);
+
+    return ret;
+  }
+
+  return js_pgconn_query_start(ctx, this_val, argc, argv);
+}
+
+/**
+ * \addtogroup pgsql-notify
+ * @{
+ */
+static JSClassID js_pgnotify_class_id;
+static JSValue pgnotify_proto;
+
+enum {
+  NOTIFY_NEXT,
+  NOTIFY_RETURN,
+  NOTIFY_ITERATOR,
+};
+
+static void
+pgnotify_close(PGSQLNotifications* it) {
+  JSContext* ctx = it->ctx;
+
+  if(it->closed)
+    return;
+
+  it->closed = TRUE;
+  pgconn_notify_end(it->pq, it, ctx);
+
+  if(--it->pq->listeners == 0)
+    pgconn_notify_watch(it->pq, FALSE, it->conn, ctx);
+}
+
+/**
+ * conn.notifications() returns an async iterator of { channel, pid,
+ * payload } for the channels the connection LISTENs to. Iterators of
+ * one connection share its notifications.
+ */
+static JSValue
+js_pgconn_notifications(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  PGSQLConnection* pq;
+  PGSQLNotifications* it;
+  JSValue obj;
+
+  if(!(pq = js_pgconn_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(!pq->conn)
+    return JS_Throw(ctx, js_pgsqlerror_new(ctx, "no connection"));
+
+  if(!(it = js_mallocz(ctx, sizeof(PGSQLNotifications))))
+    return JS_EXCEPTION;
+
+  obj = JS_NewObjectProtoClass(ctx, pgnotify_proto, js_pgnotify_class_id);
+
+  if(JS_IsException(obj)) {
+    js_free(ctx, it);
+    return obj;
+  }
+
+  it->ctx = ctx;
+  it->conn = JS_DupValue(ctx, this_val);
+  it->pq = pgconn_dup(pq);
+  JS_SetOpaque(obj, it);
+
+  ++pq->listeners;
+
+  /* notifications libpq read before the first iterator was opened */
+  pgconn_notify_dispatch(pq, ctx);
+  pgconn_notify_watch(pq, TRUE, this_val, ctx);
+
+  return obj;
+}
+
+static JSValue
+js_pgnotify_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  PGSQLNotifications* it;
+  PGSQLConnection* pq;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(it = JS_GetOpaque2(ctx, this_val, js_pgnotify_class_id)))
+    return JS_EXCEPTION;
+
+  pq = it->pq;
+
+  switch(magic) {
+    case NOTIFY_NEXT: {
+      if(it->closed || !pq->conn) {
+        JSValue res = js_iterator_result(ctx, JS_UNDEFINED, TRUE);
+
+        ret = js_promise_resolve(ctx, res);
+        JS_FreeValue(ctx, res);
+      } else if(!list_empty(&pq->notifies)) {
+        PGSQLNotifyEntry* e = list_entry(pq->notifies.next, PGSQLNotifyEntry, link);
+        JSValue value = pgconn_notify_value(ctx, e->notify), res = js_iterator_result(ctx, value, FALSE);
+
+        list_del(&e->link);
+        PQfreemem(e->notify);
+        js_free(ctx, e);
+
+        ret = js_promise_resolve(ctx, res);
+        JS_FreeValue(ctx, res);
+        JS_FreeValue(ctx, value);
+      } else {
+        PGSQLNotifyWaiter* w;
+
+        if(!(w = js_malloc(ctx, sizeof(PGSQLNotifyWaiter))))
+          return JS_EXCEPTION;
+
+        w->owner = it;
+        ret = promise_create(ctx, &w->funcs);
+        list_add_tail(&w->link, &pq->notify_waiters);
+      }
+
+      break;
+    }
+
+    case NOTIFY_RETURN: {
+      JSValue res = js_iterator_result(ctx, argc > 0 ? argv[0] : JS_UNDEFINED, TRUE);
+
+      pgnotify_close(it);
+      ret = js_promise_resolve(ctx, res);
+      JS_FreeValue(ctx, res);
+      break;
+    }
+
+    case NOTIFY_ITERATOR: {
+      ret = JS_DupValue(ctx, this_val);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static void
+js_pgnotify_finalizer(JSRuntime* rt, JSValue val) {
+  PGSQLNotifications* it;
+
+  if((it = JS_GetOpaque(val, js_pgnotify_class_id))) {
+    /* no JS here: the read handler unwatches once it sees no listeners */
+    if(!it->closed) {
+      struct list_head *el, *next;
+
+      list_for_each_safe(el, next, &it->pq->notify_waiters) {
+        PGSQLNotifyWaiter* w = list_entry(el, PGSQLNotifyWaiter, link);
+
+        if(w->owner == it) {
+          list_del(&w->link);
+          promise_free_funcs(rt, &w->funcs);
+          js_free_rt(rt, w);
+        }
+      }
+
+      --it->pq->listeners;
+    }
+
+    pgconn_free(it->pq, rt);
+    JS_FreeValueRT(rt, it->conn);
+    js_free_rt(rt, it);
+  }
+}
+
+static JSClassDef js_pgnotify_class = {
+    .class_name = "PGnotifications",
+    .finalizer = js_pgnotify_finalizer,
+};
+
+static const JSCFunctionListEntry js_pgnotify_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("next", 0, js_pgnotify_method, NOTIFY_NEXT),
+    JS_CFUNC_MAGIC_DEF("return", 0, js_pgnotify_method, NOTIFY_RETURN),
+    JS_CFUNC_MAGIC_DEF("[Symbol.asyncIterator]", 0, js_pgnotify_method, NOTIFY_ITERATOR),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "PGnotifications", JS_PROP_CONFIGURABLE),
+};
+
+/**
+ * @}
+ */
+
+static JSValue
+js_pgconn_close(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  JSValue ret = JS_UNDEFINED;
+  PGSQLConnection* pq;
+
+  if(!(pq = js_pgconn_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  pgconn_notify_watch(pq, FALSE, this_val, ctx);
+  pgconn_notify_end(pq, 0, ctx);
+
+  PQfinish(pq->conn);
+  pq->conn = 0;
+
+  return ret;
+}
+
+static void
+js_pgconn_finalizer(JSRuntime* rt, JSValue val) {
+  PGSQLConnection* pq;
+
+  if((pq = JS_GetOpaque(val, js_pgconn_class_id)))
+    pgconn_free(pq, rt);
+}
+
+static JSClassDef js_pgconn_class = {
+    .class_name = "PGconn",
+    .finalizer = js_pgconn_finalizer,
+};
+
+static const JSCFunctionListEntry js_pgconn_funcs[] = {
+    JS_CGETSET_MAGIC_DEF("cmdTuples", js_pgconn_get, 0, PROP_CMD_TUPLES),
+    JS_CGETSET_MAGIC_DEF("affectedRows", js_pgconn_get, 0, PROP_CMD_TUPLES),
+
+    JS_CGETSET_MAGIC_DEF("nonblocking", js_pgconn_get, js_pgconn_set, PROP_NONBLOCKING),
+    JS_CGETSET_MAGIC_DEF("fd", js_pgconn_get, 0, PROP_FD),
+    JS_CGETSET_MAGIC_DEF("errorMessage", js_pgconn_get, 0, PROP_ERROR_MESSAGE),
+    JS_CGETSET_MAGIC_DEF("options", js_pgconn_get, 0, PROP_OPTIONS),
+    JS_CGETSET_MAGIC_DEF("insertId", js_pgconn_get, 0, PROP_INSERT_ID),
+    JS_CGETSET_MAGIC_DEF("charset", js_pgconn_get, js_pgconn_set, PROP_CLIENT_ENCODING),
+    JS_CGETSET_MAGIC_DEF("protocolVersion", js_pgconn_get, 0, PROP_PROTOCOL_VERSION),
+    JS_CGETSET_MAGIC_DEF("serverVersion", js_pgconn_get, 0, PROP_SERVER_VERSION),
+    JS_CGETSET_MAGIC_DEF("user", js_pgconn_get, 0, PROP_USER),
+    JS_CGETSET_MAGIC_DEF("password", js_pgconn_get, 0, PROP_PASSWORD),
+    JS_CGETSET_MAGIC_DEF("host", js_pgconn_get, 0, PROP_HOST),
+    JS_CGETSET_MAGIC_DEF("port", js_pgconn_get, 0, PROP_PORT),
     JS_CGETSET_MAGIC_DEF("db", js_pgconn_get, 0, PROP_DB),
     JS_CGETSET_MAGIC_DEF("conninfo", js_pgconn_get, 0, PROP_CONNINFO),
+    JS_CGETSET_MAGIC_DEF("pipelineStatus", js_pgconn_get, 0, PROP_PIPELINE_STATUS),
+    JS_CGETSET_MAGIC_DEF("statementCacheSize", js_pgconn_get, js_pgconn_set, PROP_STATEMENT_CACHE_SIZE),
+    JS_CGETSET_MAGIC_DEF("resultFormat", js_pgconn_get, js_pgconn_set, PROP_RESULT_FORMAT),
+    JS_CGETSET_MAGIC_DEF("collectStats", js_pgconn_get, js_pgconn_set, PROP_COLLECT_STATS),
+    JS_CGETSET_MAGIC_DEF("stats", js_pgconn_get, 0, PROP_STATS),
+    JS_CGETSET_MAGIC_DEF("onQueryStats", js_pgconn_get, js_pgconn_set, PROP_STATS_HOOK),
+    JS_CFUNC_DEF("resetStats", 0, js_pgconn_reset_stats),
     JS_CFUNC_DEF("connect", 1, js_pgconn_connect),
     JS_CFUNC_DEF("query", 1, js_pgconn_query),
+    JS_CFUNC_DEF("prepare", 1, js_pgconn_prepare),
+    JS_CFUNC_MAGIC_DEF("copyFrom", 1, js_pgconn_copy, 0),
+    JS_CFUNC_MAGIC_DEF("copyTo", 1, js_pgconn_copy, 1),
     JS_CFUNC_DEF("close", 0, js_pgconn_close),
+    JS_CFUNC_DEF("notifications", 0, js_pgconn_notifications),
+    JS_CFUNC_MAGIC_DEF("enterPipeline", 0, js_pgconn_pipeline, PIPELINE_ENTER),
+    JS_CFUNC_MAGIC_DEF("exitPipeline", 0, js_pgconn_pipeline, PIPELINE_EXIT),
+    JS_CFUNC_MAGIC_DEF("pipelineSync", 0, js_pgconn_pipeline, PIPELINE_SYNC),
     JS_ALIAS_DEF("execute", "query"),
     JS_CFUNC_DEF("escapeString", 1, js_pgconn_escape_string),
     JS_CFUNC_MAGIC_DEF("escapeLiteral", 1, js_pgconn_escape_alloc, 0),
@@ -1247,16 +3336,205 @@ static const JSCFunctionListEntry js_pgconn_funcs[] = {
     JS_PROP_STRING_DEF("[Symbol.toStringTag]", "PGconn", JS_PROP_CONFIGURABLE),
 };
 
-static const JSCFunctionListEntry js_pgconn_static[] = {
-    JS_CFUNC_DEF("escapeString", 1, js_pgconn_escape_string),
-    JS_CFUNC_DEF("escapeBytea", 1, js_pgconn_escape_bytea),
-    JS_CFUNC_DEF("unescapeBytea", 1, js_pgconn_unescape_bytea),
+static const JSCFunctionListEntry js_pgconn_static[] = {
+    JS_CFUNC_DEF("escapeString", 1, js_pgconn_escape_string),
+    JS_CFUNC_DEF("escapeBytea", 1, js_pgconn_escape_bytea),
+    JS_CFUNC_DEF("unescapeBytea", 1, js_pgconn_unescape_bytea),
+};
+
+static const JSCFunctionListEntry js_pgconn_defines[] = {
+    JS_PROP_INT32_DEF("RESULT_OBJECT", RESULT_OBJECT, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("RESULT_STRING", RESULT_STRING, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("RESULT_TBLNAM", RESULT_TBLNAM, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("PIPELINE_OFF", 0, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("PIPELINE_ON", 1, JS_PROP_CONFIGURABLE),
+    JS_PROP_INT32_DEF("PIPELINE_ABORTED", 2, JS_PROP_CONFIGURABLE),
+};
+
+static JSValue
+pgpool_connect(JSContext* ctx, int argc, JSValueConst argv[]) {
+  JSValue obj, ret;
+
+  if(JS_IsException((obj = js_pgconn_wrap(ctx, pgsql_proto, 0))))
+    return JS_EXCEPTION;
+
+  ret = js_pgconn_connect_start(ctx, obj, argc, argv);
+  JS_FreeValue(ctx, obj);
+  return ret;
+}
+
+static BOOL
+pgpool_healthy(JSContext* ctx, JSValueConst conn) {
+  PGSQLConnection* pq;
+
+  if(!(pq = JS_GetOpaque(conn, js_pgconn_class_id)) || !pq->conn)
+    return FALSE;
+
+  return PQstatus(pq->conn) == CONNECTION_OK && PQtransactionStatus(pq->conn) == PQTRANS_IDLE;
+}
+
+static void
+pgpool_close(JSContext* ctx, JSValueConst conn) {
+  PGSQLConnection* pq;
+
+  if((pq = JS_GetOpaque(conn, js_pgconn_class_id)) && pq->conn) {
+    PQfinish(pq->conn);
+    pq->conn = 0;
+  }
+}
+
+static const ConnPoolBackend pgpool_backend = {
+    .name = "PGpool",
+    .connect = pgpool_connect,
+    .healthy = pgpool_healthy,
+    .close = pgpool_close,
+};
+
+enum {
+  POOL_ACQUIRE,
+  POOL_RELEASE,
+  POOL_CLOSE,
 };
 
-static const JSCFunctionListEntry js_pgconn_defines[] = {
-    JS_PROP_INT32_DEF("RESULT_OBJECT", RESULT_OBJECT, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("RESULT_STRING", RESULT_STRING, JS_PROP_CONFIGURABLE),
-    JS_PROP_INT32_DEF("RESULT_TBLNAM", RESULT_TBLNAM, JS_PROP_CONFIGURABLE),
+enum {
+  POOL_SIZE,
+  POOL_IDLE,
+  POOL_WAITING,
+  POOL_MIN,
+  POOL_MAX,
+  POOL_STATS,
+};
+
+static JSValue
+js_pgpool_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  JSValue proto, obj = JS_UNDEFINED;
+  ConnPool* cp;
+
+  if(js_pgpool_class_id == 0)
+    js_pgsql_init(ctx, 0);
+
+  /* using new_target to get the prototype is necessary when the class is extended. */
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  if(JS_IsException(proto))
+    goto fail;
+
+  obj = JS_NewObjectProtoClass(ctx, proto, js_pgpool_class_id);
+  JS_FreeValue(ctx, proto);
+  if(JS_IsException(obj))
+    goto fail;
+
+  if(!(cp = connpool_new(ctx, &pgpool_backend, MAX_NUM(argc - 1, 0), argv + 1)))
+    goto fail;
+
+  if(argc > 0)
+    connpool_options(cp, argv[0]);
+
+  JS_SetOpaque(obj, cp);
+
+  connpool_fill(cp);
+  return obj;
+
+fail:
+  JS_FreeValue(ctx, obj);
+  return JS_EXCEPTION;
+}
+
+static JSValue
+js_pgpool_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  JSValue ret = JS_UNDEFINED;
+  ConnPool* cp;
+
+  if(!(cp = JS_GetOpaque2(ctx, this_val, js_pgpool_class_id)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case POOL_ACQUIRE: {
+      ret = connpool_acquire(cp);
+      break;
+    }
+
+    case POOL_RELEASE: {
+      if(!connpool_release(cp, argv[0]))
+        ret = JS_ThrowTypeError(ctx, "argument 1 must be a PGconn acquired from this pool");
+      break;
+    }
+
+    case POOL_CLOSE: {
+      connpool_close(cp);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static JSValue
+js_pgpool_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  JSValue ret = JS_UNDEFINED;
+  ConnPool* cp;
+
+  if(!(cp = JS_GetOpaque2(ctx, this_val, js_pgpool_class_id)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case POOL_SIZE: {
+      ret = JS_NewUint32(ctx, cp->size);
+      break;
+    }
+
+    case POOL_IDLE: {
+      ret = JS_NewUint32(ctx, cp->nidle);
+      break;
+    }
+
+    case POOL_WAITING: {
+      ret = JS_NewUint32(ctx, cp->nwaiting);
+      break;
+    }
+
+    case POOL_MIN: {
+      ret = JS_NewUint32(ctx, cp->min);
+      break;
+    }
+
+    case POOL_MAX: {
+      ret = JS_NewUint32(ctx, cp->max);
+      break;
+    }
+
+    case POOL_STATS: {
+      ret = connpool_stats(cp);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static void
+js_pgpool_finalizer(JSRuntime* rt, JSValue val) {
+  ConnPool* cp;
+
+  if((cp = JS_GetOpaque(val, js_pgpool_class_id)))
+    connpool_free(cp);
+}
+
+static JSClassDef js_pgpool_class = {
+    .class_name = "PGpool",
+    .finalizer = js_pgpool_finalizer,
+};
+
+static const JSCFunctionListEntry js_pgpool_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("acquire", 0, js_pgpool_method, POOL_ACQUIRE),
+    JS_CFUNC_MAGIC_DEF("release", 1, js_pgpool_method, POOL_RELEASE),
+    JS_CFUNC_MAGIC_DEF("close", 0, js_pgpool_method, POOL_CLOSE),
+    JS_CGETSET_MAGIC_DEF("size", js_pgpool_get, 0, POOL_SIZE),
+    JS_CGETSET_MAGIC_DEF("idle", js_pgpool_get, 0, POOL_IDLE),
+    JS_CGETSET_MAGIC_DEF("waiting", js_pgpool_get, 0, POOL_WAITING),
+    JS_CGETSET_MAGIC_DEF("min", js_pgpool_get, 0, POOL_MIN),
+    JS_CGETSET_MAGIC_DEF("max", js_pgpool_get, 0, POOL_MAX),
+    JS_CGETSET_MAGIC_DEF("stats", js_pgpool_get, 0, POOL_STATS),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "PGpool", JS_PROP_CONFIGURABLE),
 };
 
 static JSValue
@@ -1327,6 +3605,294 @@ result_free(JSRuntime* rt, void* opaque, void* ptr) {
   PQfreemem(ptr);
 }
 
+/**
+ * \defgroup pgsql-binary Binary result decoding
+ *
+ * Values of fields received with format 1 (resultFormat = 'binary') are
+ * decoded from the wire representation by type OID. Integers and floats
+ * become numbers (int8 a BigInt), timestamps and dates become Date objects,
+ * bytea an ArrayBuffer, uuid a string and arrays (of any of these) nested
+ * JS arrays. Other types are returned as strings of their raw bytes.
+ * @{
+ */
+#define PG_EPOCH_MS 946684800000LL /* 2000-01-01 in ms since 1970-01-01 */
+
+static inline int64_t
+pgbinary_int64(const uint8_t* p) {
+  return (int64_t)(((uint64_t)uint32_get_be(p) << 32) | uint32_get_be(p + 4));
+}
+
+static inline double
+pgbinary_float64(const uint8_t* p) {
+  union {
+    uint64_t u;
+    double d;
+  } v = {.u = (uint64_t)pgbinary_int64(p)};
+
+  return v.d;
+}
+
+static inline float
+pgbinary_float32(const uint8_t* p) {
+  union {
+    uint32_t u;
+    float f;
+  } v = {.u = uint32_get_be(p)};
+
+  return v.f;
+}
+
+static void
+pgbinary_numeric(DynBuf* out, const uint8_t* p, size_t len) {
+  int16_t ndigits, weight, dscale, d;
+  uint16_t sign;
+  int count;
+  char group[8];
+
+  if(len < 8) {
+    dbuf_putstr(out, "NaN");
+    return;
+  }
+
+  ndigits = (int16_t)uint16_get_be(p);
+  weight = (int16_t)uint16_get_be(p + 2);
+  sign = uint16_get_be(p + 4);
+  dscale = (int16_t)uint16_get_be(p + 6);
+  p += 8;
+
+  if(len < 8 + 2 * (size_t)MAX_NUM(ndigits, 0) || sign == 0xC000) {
+    dbuf_putstr(out, "NaN");
+    return;
+  }
+
+  if(sign == 0xD000 || sign == 0xF000) {
+    dbuf_putstr(out, sign == 0xF000 ? "-Infinity" : "Infinity");
+    return;
+  }
+
+  if(sign == 0x4000)
+    dbuf_putc(out, '-');
+
+  /* base 10000 digits, the first one has weight 'weight' */
+  if(weight < 0)
+    dbuf_putc(out, '0');
+
+  for(d = 0; d <= weight; d++)
+    dbuf_printf(out, d ? "%04u" : "%u", d < ndigits ? uint16_get_be(p + 2 * d) : 0);
+
+  if(dscale > 0) {
+    dbuf_putc(out, '.');
+
+    for(d = weight + 1, count = 0; count < dscale; d++, count += 4) {
+      snprintf(group, sizeof(group), "%04u", d >= 0 && d < ndigits ? uint16_get_be(p + 2 * d) : 0);
+      dbuf_put(out, (const uint8_t*)group, MIN_NUM(4, dscale - count));
+    }
+  }
+}
+
+static JSValue pgbinary_value(JSContext* ctx, Oid type, const uint8_t* p, size_t len);
+
+/* one dimension of an array, recursing into the inner ones */
+static JSValue
+pgbinary_array_dim(JSContext* ctx, Oid elem, const uint8_t** pp, const uint8_t* end, const uint8_t* dims, int ndim) {
+  uint32_t i, n = uint32_get_be(dims);
+  JSValue ret = JS_NewArray(ctx);
+
+  for(i = 0; i < n; i++) {
+    JSValue value = JS_NULL;
+
+    if(ndim > 1) {
+      value = pgbinary_array_dim(ctx, elem, pp, end, dims + 8, ndim - 1);
+    } else if(*pp + 4 <= end) {
+      int32_t len = (int32_t)uint32_get_be(*pp);
+
+      *pp += 4;
+
+      if(len >= 0 && *pp + len <= end) {
+        value = pgbinary_value(ctx, elem, *pp, len);
+        *pp += len;
+      }
+    }
+
+    JS_SetPropertyUint32(ctx, ret, i, value);
+  }
+
+  return ret;
+}
+
+static JSValue
+pgbinary_array(JSContext* ctx, const uint8_t* p, size_t len) {
+  const uint8_t *end = p + len, *data;
+  int32_t ndim;
+  Oid elem;
+
+  if(len < 12)
+    return JS_NewArray(ctx);
+
+  ndim = (int32_t)uint32_get_be(p);
+  elem = uint32_get_be(p + 8);
+  data = p + 12 + 8 * MAX_NUM(ndim, 0);
+
+  if(ndim <= 0 || data > end)
+    return JS_NewArray(ctx);
+
+  return pgbinary_array_dim(ctx, elem, &data, end, p + 12, ndim);
+}
+
+static JSValue
+pgbinary_json(JSContext* ctx, const uint8_t* p, size_t len) {
+  char* str;
+  JSValue ret;
+
+  /* JS_ParseJSON wants a NUL-terminated buffer, array elements are not */
+  if(!(str = js_strndup(ctx, (const char*)p, len)))
+    return JS_EXCEPTION;
+
+  ret = JS_ParseJSON(ctx, str, len, "<json>");
+  js_free(ctx, str);
+
+  return ret;
+}
+
+static JSValue
+pgbinary_value(JSContext* ctx, Oid type, const uint8_t* p, size_t len) {
+  switch(type) {
+    /* bool */
+    case 16: return JS_NewBool(ctx, len > 0 && p[0]);
+    /* bytea */
+    case 17: return JS_NewArrayBufferCopy(ctx, p, len);
+    /* int8 */
+    case 20:
+      if(len >= 8)
+        return JS_NewBigInt64(ctx, pgbinary_int64(p));
+      break;
+    /* int2 */
+    case 21:
+      if(len >= 2)
+        return JS_NewInt32(ctx, (int16_t)uint16_get_be(p));
+      break;
+    /* int4 */
+    case 23:
+      if(len >= 4)
+        return JS_NewInt32(ctx, (int32_t)uint32_get_be(p));
+      break;
+    /* oid, xid, cid */
+    case 26:
+    case 28:
+    case 29:
+      if(len >= 4)
+        return JS_NewUint32(ctx, uint32_get_be(p));
+      break;
+    /* json */
+    case 114: return pgbinary_json(ctx, p, len);
+    /* jsonb: version byte, then text */
+    case 3802:
+      if(len >= 1 && p[0] == 1)
+        return pgbinary_json(ctx, p + 1, len - 1);
+      break;
+    /* float4 */
+    case 700:
+      if(len >= 4)
+        return JS_NewFloat64(ctx, pgbinary_float32(p));
+      break;
+    /* float8 */
+    case 701:
+      if(len >= 8)
+        return JS_NewFloat64(ctx, pgbinary_float64(p));
+      break;
+    /* date: days since 2000-01-01, 'infinity' becomes an invalid Date */
+    case 1082:
+      if(len >= 4) {
+        int32_t days = (int32_t)uint32_get_be(p);
+
+        if(days == INT32_MAX || days == INT32_MIN)
+          return js_date_new(ctx, JS_NewFloat64(ctx, NAN));
+
+        return js_date_from_ms(ctx, PG_EPOCH_MS + (int64_t)days * 86400000LL);
+      }
+      break;
+    /* timestamp, timestamptz: microseconds since 2000-01-01 */
+    case 1114:
+    case 1184:
+      if(len >= 8) {
+        int64_t us = pgbinary_int64(p);
+
+        if(us == INT64_MAX || us == INT64_MIN)
+          return js_date_new(ctx, JS_NewFloat64(ctx, NAN));
+
+        return js_date_from_ms(ctx, PG_EPOCH_MS + us / 1000);
+      }
+      break;
+    /* numeric */
+    case 1700: {
+      DynBuf buf;
+      JSValue ret;
+      Arena* arena = js_arena(ctx);
+      ArenaMark mark = arena_mark(arena);
+
+      dbuf_init_arena(&buf, arena);
+      pgbinary_numeric(&buf, p, len);
+      dbuf_0(&buf);
+
+      ret = string_to_number(ctx, (const char*)buf.buf);
+      arena_release(arena, mark);
+      return ret;
+    }
+    /* uuid */
+    case 2950:
+      if(len >= 16) {
+        char str[37];
+
+        snprintf(str,
+                 sizeof(str),
+                 "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+                 p[0],
+                 p[1],
+                 p[2],
+                 p[3],
+                 p[4],
+                 p[5],
+                 p[6],
+                 p[7],
+                 p[8],
+                 p[9],
+                 p[10],
+                 p[11],
+                 p[12],
+                 p[13],
+                 p[14],
+                 p[15]);
+
+        return JS_NewString(ctx, str);
+      }
+      break;
+    /* bool[], bytea[], int8[], int2[], int4[], text[], varchar[], float4[], float8[], ... */
+    case 1000:
+    case 1001:
+    case 1005:
+    case 1007:
+    case 1009:
+    case 1015:
+    case 1016:
+    case 1021:
+    case 1022:
+    case 1115:
+    case 1182:
+    case 1185:
+    case 1231:
+    case 2951:
+    case 199:
+    case 3807: return pgbinary_array(ctx, p, len);
+  }
+
+  /* text, varchar, name, bpchar and everything without a decoder */
+  return JS_NewStringLen(ctx, (const char*)p, len);
+}
+
+/**
+ * @}
+ */
+
 static JSValue
 result_value(JSContext* ctx, PGSQLResult* opaque, int field, char* buf, size_t len, int rtype) {
   PGresult* res = opaque->result;
@@ -1335,6 +3901,19 @@ result_value(JSContext* ctx, PGSQLResult* opaque, int field, char* buf, size_t l
   if(buf == 0)
     return (rtype & RESULT_STRING) ? JS_NewString(ctx, "NULL") : JS_NULL;
 
+  if(PQfformat(res, field)) {
+    ret = pgbinary_value(ctx, PQftype(res, field), (const uint8_t*)buf, len);
+
+    if((rtype & RESULT_STRING) && !JS_IsString(ret) && !js_is_arraybuffer(ctx, ret)) {
+      JSValue str = JS_ToString(ctx, ret);
+
+      JS_FreeValue(ctx, ret);
+      ret = str;
+    }
+
+    return ret;
+  }
+
   if(field_is_boolean(res, field)) {
     BOOL value = *(BOOL*)buf;
 
@@ -1550,6 +4129,7 @@ enum {
   METHOD_FETCH_FIELDS,
   METHOD_FETCH_ROW,
   METHOD_FETCH_ASSOC,
+  METHOD_FETCH_COLUMNS,
 };
 
 static JSValue
@@ -1581,6 +4161,131 @@ js_pgresult_next(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst*
   return ret;
 }
 
+static ColumnType
+pgresult_column_type(PGresult* res, int field) {
+  switch(PQftype(res, field)) {
+    case 16: return COLUMN_BOOL;
+    case 17: return COLUMN_BINARY;
+    case 20: return COLUMN_INT64;
+    case 21:
+    case 23: return COLUMN_INT32;
+    case 700:
+    case 701:
+    case 1700: return COLUMN_FLOAT64;
+    default: return COLUMN_STRING;
+  }
+}
+
+/* pushes a binary-format cell of a fixed-width column */
+static BOOL
+pgresult_column_binary(ResultColumn* col, Oid type, const uint8_t* p, size_t len, JSContext* ctx) {
+  switch(type) {
+    case 16: {
+      uint8_t b = len > 0 && p[0];
+      return column_push_raw(col, &b);
+    }
+
+    case 20: {
+      int64_t i = len >= 8 ? pgbinary_int64(p) : 0;
+      return column_push_raw(col, &i);
+    }
+
+    case 21: {
+      int32_t i = len >= 2 ? (int16_t)uint16_get_be(p) : 0;
+      return column_push_raw(col, &i);
+    }
+
+    case 23: {
+      int32_t i = len >= 4 ? (int32_t)uint32_get_be(p) : 0;
+      return column_push_raw(col, &i);
+    }
+
+    case 700: {
+      double d = len >= 4 ? pgbinary_float32(p) : 0;
+      return column_push_raw(col, &d);
+    }
+
+    case 701: {
+      double d = len >= 8 ? pgbinary_float64(p) : 0;
+      return column_push_raw(col, &d);
+    }
+
+    case 1700: {
+      DynBuf buf;
+      BOOL ret;
+      Arena* arena = js_arena(ctx);
+      ArenaMark mark = arena_mark(arena);
+
+      dbuf_init_arena(&buf, arena);
+      pgbinary_numeric(&buf, p, len);
+      dbuf_0(&buf);
+
+      ret = column_push(col, (const char*)buf.buf, buf.size);
+      arena_release(arena, mark);
+      return ret;
+    }
+  }
+
+  /* string and bytea columns take the raw bytes */
+  return FALSE;
+}
+
+/**
+ * Decodes the remaining rows column by column (see result-columns.h)
+ * and moves the cursor to the end.
+ */
+static JSValue
+pgresult_columns(PGSQLResult* opaque, JSContext* ctx) {
+  PGresult* res = opaque->result;
+  uint32_t i, row, num_fields = PQnfields(res), ntuples = PQntuples(res);
+  FieldNameFunc* fn = field_namefunc(res);
+  ResultColumn* cols;
+  JSValue ret;
+
+  if(!(cols = js_mallocz(ctx, sizeof(ResultColumn) * MAX_NUM(num_fields, 1))))
+    return JS_EXCEPTION;
+
+  for(i = 0; i < num_fields; i++) {
+    char* name = fn(ctx, opaque, i);
+    ColumnType type = pgresult_column_type(res, i);
+
+    column_init(&cols[i], name, type, ctx);
+    column_reserve(&cols[i], ntuples - MIN_NUM(opaque->row_index, ntuples));
+
+    if(name)
+      js_free(ctx, name);
+  }
+
+  for(row = opaque->row_index; row < ntuples; row++) {
+    for(i = 0; i < num_fields; i++) {
+      const char* value = PQgetisnull(res, row, i) ? 0 : PQgetvalue(res, row, i);
+      size_t len = value ? PQgetlength(res, row, i) : 0;
+
+      if(value && PQfformat(res, i) && pgresult_column_binary(&cols[i], PQftype(res, i), (const uint8_t*)value, len, ctx))
+        continue;
+
+      /* bytea in text format arrives hex-escaped */
+      if(value && cols[i].type == COLUMN_BINARY && !PQfformat(res, i)) {
+        size_t n;
+        unsigned char* data = PQunescapeBytea((const unsigned char*)value, &n);
+
+        column_push(&cols[i], (const char*)data, n);
+        PQfreemem(data);
+        continue;
+      }
+
+      column_push(&cols[i], value, len);
+    }
+  }
+
+  opaque->row_index = MAX_NUM(opaque->row_index, ntuples);
+
+  ret = columns_value(cols, num_fields, ctx);
+  columns_free(cols, num_fields, JS_GetRuntime(ctx));
+
+  return ret;
+}
+
 static JSValue
 js_pgresult_functions(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
   JSValue ret = JS_UNDEFINED;
@@ -1621,6 +4326,11 @@ js_pgresult_functions(JSContext* ctx, JSValueConst this_val, int argc, JSValueCo
       ret = js_pgresult_next(ctx, this_val, argc, argv, &done, magic);
       break;
     }
+
+    case METHOD_FETCH_COLUMNS: {
+      ret = pgresult_columns(JS_GetOpaque(this_val, js_pgresult_class_id), ctx);
+      break;
+    }
   }
 
   return ret;
@@ -1804,6 +4514,7 @@ static const JSCFunctionListEntry js_pgresult_funcs[] = {
     JS_CFUNC_MAGIC_DEF("fetchFields", 0, js_pgresult_functions, METHOD_FETCH_FIELDS),
     JS_CFUNC_MAGIC_DEF("fetchRow", 0, js_pgresult_functions, METHOD_FETCH_ROW),
     JS_CFUNC_MAGIC_DEF("fetchAssoc", 0, js_pgresult_functions, METHOD_FETCH_ASSOC),
+    JS_CFUNC_MAGIC_DEF("fetchColumns", 0, js_pgresult_functions, METHOD_FETCH_COLUMNS),
     JS_CFUNC_DEF("[Symbol.iterator]", 0, js_pgresult_iterator),
     JS_PROP_STRING_DEF("[Symbol.toStringTag]", "PGresult", JS_PROP_CONFIGURABLE),
 };
@@ -2195,12 +4906,37 @@ js_pgsql_init(JSContext* ctx, JSModuleDef* m) {
 
     JS_SetPropertyFunctionList(ctx, pgresult_proto, js_pgresult_funcs, countof(js_pgresult_funcs));
     JS_SetClassProto(ctx, js_pgresult_class_id, pgresult_proto);
+
+    JS_NewClassID(&js_pgpool_class_id);
+    JS_NewClass(JS_GetRuntime(ctx), js_pgpool_class_id, &js_pgpool_class);
+
+    pgpool_ctor = JS_NewCFunction2(ctx, js_pgpool_constructor, "PGpool", 1, JS_CFUNC_constructor, 0);
+    pgpool_proto = JS_NewObject(ctx);
+
+    JS_SetPropertyFunctionList(ctx, pgpool_proto, js_pgpool_funcs, countof(js_pgpool_funcs));
+    JS_SetClassProto(ctx, js_pgpool_class_id, pgpool_proto);
+
+    JS_NewClassID(&js_pgnotify_class_id);
+    JS_NewClass(JS_GetRuntime(ctx), js_pgnotify_class_id, &js_pgnotify_class);
+
+    pgnotify_proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, pgnotify_proto, js_pgnotify_funcs, countof(js_pgnotify_funcs));
+    JS_SetClassProto(ctx, js_pgnotify_class_id, pgnotify_proto);
+
+    JS_NewClassID(&js_pgstmt_class_id);
+    JS_NewClass(JS_GetRuntime(ctx), js_pgstmt_class_id, &js_pgstmt_class);
+
+    pgstmt_proto = JS_NewObject(ctx);
+
+    JS_SetPropertyFunctionList(ctx, pgstmt_proto, js_pgstmt_funcs, countof(js_pgstmt_funcs));
+    JS_SetClassProto(ctx, js_pgstmt_class_id, pgstmt_proto);
   }
 
   if(m) {
     JS_SetModuleExport(ctx, m, "PGconn", pgsql_ctor);
     JS_SetModuleExport(ctx, m, "PGerror", pgsqlerror_ctor);
     JS_SetModuleExport(ctx, m, "PGresult", pgresult_ctor);
+    JS_SetModuleExport(ctx, m, "PGpool", pgpool_ctor);
   }
 
   return 0;
@@ -2220,6 +4956,7 @@ JS_INIT_MODULE(JSContext* ctx, const char* module_name) {
     JS_AddModuleExport(ctx, m, "PGconn");
     JS_AddModuleExport(ctx, m, "PGerror");
     JS_AddModuleExport(ctx, m, "PGresult");
+    JS_AddModuleExport(ctx, m, "PGpool");
   }
 
   return m;
@@ -21,6 +21,7 @@ int js_pgsql_init(JSContext*, JSModuleDef*);
 JSModuleDef* js_init_module_pgsql(JSContext*, const char* module_name);
 
 extern VISIBLE JSClassID js_pgsql_class_id, js_pgsqlresult_class_id;
+extern VISIBLE JSClassID js_pgpool_class_id;
 
 /**
  * @}
@@ -12,6 +12,14 @@
 
 JSClassID js_pointer_class_id = 0;
 JSValue pointer_proto = {{0}, JS_TAG_UNDEFINED}, pointer_ctor = {{0}, JS_TAG_UNDEFINED};
+JSClassID js_pointerset_class_id = 0;
+JSValue pointerset_proto = {{0}, JS_TAG_UNDEFINED}, pointerset_ctor = {{0}, JS_TAG_UNDEFINED};
+
+typedef struct {
+  JSRuntime* rt;
+  Pointer ptr;
+  int32_t slots[];
+} CompiledPointer;
 
 enum {
   METHOD_DEREF = 0,
@@ -30,6 +38,7 @@ enum {
   METHOD_VALUES,
   METHOD_HIER,
   METHOD_AT,
+  METHOD_COMPILE,
 };
 enum {
   STATIC_FROM = 0,
@@ -142,6 +151,46 @@ js_pointer_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValu
   return obj;
 }
 
+static JSValue
+js_pointer_compiled(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* opaque) {
+  CompiledPointer* cp = opaque;
+
+  return pointer_deref_cached(&cp->ptr, cp->slots, argv[0], ctx);
+}
+
+static void
+js_pointer_compiled_free(void* opaque) {
+  CompiledPointer* cp = opaque;
+
+  pointer_reset(&cp->ptr, cp->rt);
+  js_free_rt(cp->rt, cp);
+}
+
+/**
+ * Returns a function dereferencing a copy of the pointer. It caches the
+ * property slot found at each step for objects of the same shape.
+ */
+static JSValue
+js_pointer_compile(JSContext* ctx, Pointer const* ptr) {
+  CompiledPointer* cp;
+  size_t i;
+
+  if(!(cp = js_mallocz(ctx, sizeof(CompiledPointer) + sizeof(int32_t) * ptr->n)))
+    return JS_EXCEPTION;
+
+  cp->rt = JS_GetRuntime(ctx);
+
+  if(!pointer_copy(&cp->ptr, ptr, ctx)) {
+    js_free(ctx, cp);
+    return JS_EXCEPTION;
+  }
+
+  for(i = 0; i < ptr->n; i++)
+    cp->slots[i] = -1;
+
+  return js_function_cclosure(ctx, js_pointer_compiled, 1, 0, cp, js_pointer_compiled_free);
+}
+
 static JSValue
 js_pointer_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
   Pointer* ptr;
@@ -273,6 +322,10 @@ js_pointer_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
       return ret;
     }
 
+    case METHOD_COMPILE: {
+      return js_pointer_compile(ctx, ptr);
+    }
+
     case METHOD_AT: {
       JSValue ret = JS_UNDEFINED;
 
@@ -439,6 +492,7 @@ static const JSCFunctionListEntry js_pointer_proto_funcs[] = {
     JS_CFUNC_MAGIC_DEF("values", 0, js_pointer_method, METHOD_VALUES),
     JS_CFUNC_MAGIC_DEF("hier", 0, js_pointer_method, METHOD_HIER),
     JS_CFUNC_MAGIC_DEF("at", 1, js_pointer_method, METHOD_AT),
+    JS_CFUNC_MAGIC_DEF("compile", 0, js_pointer_method, METHOD_COMPILE),
     JS_ALIAS_DEF("toPrimitive", "toString"),
     JS_ALIAS_DEF("[Symbol.iterator]", "values"),
     JS_CGETSET_MAGIC_DEF("length", js_pointer_get, 0, PROP_LENGTH),
@@ -552,6 +606,146 @@ static JSClassDef js_pointer_class = {
     .exotic = &js_pointer_exotic_methods,
 };
 
+enum {
+  POINTERSET_ADD = 0,
+  POINTERSET_DEREF,
+};
+
+static int32_t
+js_pointerset_add(JSContext* ctx, PointerSet* set, JSValueConst value) {
+  Pointer tmp = {0, 0}, *ptr;
+  int32_t ret;
+
+  if(!(ptr = js_pointer_data(value))) {
+    if(!pointer_from(&tmp, value, ctx)) {
+      JS_ThrowTypeError(ctx, "PointerSet: argument must be a Pointer, string or array");
+      return -1;
+    }
+
+    ptr = &tmp;
+  }
+
+  if((ret = pointerset_add(set, ptr, ctx)) == -1)
+    JS_ThrowOutOfMemory(ctx);
+
+  pointer_reset(&tmp, JS_GetRuntime(ctx));
+
+  return ret;
+}
+
+static JSValue
+js_pointerset_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  PointerSet* set;
+  JSValue obj, proto;
+
+  if(!(set = js_mallocz(ctx, sizeof(PointerSet))))
+    return JS_EXCEPTION;
+
+  pointerset_init(set, JS_GetRuntime(ctx));
+
+  /* using new_target to get the prototype is necessary when the class is extended. */
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  if(JS_IsException(proto))
+    proto = JS_DupValue(ctx, pointerset_proto);
+
+  obj = JS_NewObjectProtoClass(ctx, proto, js_pointerset_class_id);
+  JS_FreeValue(ctx, proto);
+
+  if(JS_IsException(obj)) {
+    pointerset_reset(set, JS_GetRuntime(ctx));
+    js_free(ctx, set);
+    return JS_EXCEPTION;
+  }
+
+  JS_SetOpaque(obj, set);
+
+  if(argc > 0 && !JS_IsUndefined(argv[0])) {
+    JSValue iter = js_iterator_new(ctx, argv[0]);
+
+    for(;;) {
+      BOOL done = FALSE;
+      JSValue item = js_iterator_next(ctx, iter, &done);
+      int32_t r;
+
+      if(done || JS_IsException(item)) {
+        JS_FreeValue(ctx, item);
+        break;
+      }
+
+      r = js_pointerset_add(ctx, set, item);
+      JS_FreeValue(ctx, item);
+
+      if(r == -1) {
+        JS_FreeValue(ctx, iter);
+        JS_FreeValue(ctx, obj);
+        return JS_EXCEPTION;
+      }
+    }
+
+    JS_FreeValue(ctx, iter);
+  }
+
+  return obj;
+}
+
+static JSValue
+js_pointerset_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  PointerSet* set;
+
+  if(!(set = JS_GetOpaque2(ctx, this_val, js_pointerset_class_id)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case POINTERSET_ADD: {
+      int32_t i, index = -1;
+
+      for(i = 0; i < argc; i++)
+        if((index = js_pointerset_add(ctx, set, argv[i])) == -1)
+          return JS_EXCEPTION;
+
+      return JS_NewInt32(ctx, index);
+    }
+
+    case POINTERSET_DEREF: {
+      return pointerset_deref(set, argv[0], ctx);
+    }
+  }
+
+  return JS_UNDEFINED;
+}
+
+static JSValue
+js_pointerset_size(JSContext* ctx, JSValueConst this_val) {
+  PointerSet* set;
+
+  if(!(set = JS_GetOpaque2(ctx, this_val, js_pointerset_class_id)))
+    return JS_EXCEPTION;
+
+  return JS_NewUint32(ctx, pointerset_size(set));
+}
+
+static void
+js_pointerset_finalizer(JSRuntime* rt, JSValue val) {
+  PointerSet* set;
+
+  if((set = JS_GetOpaque(val, js_pointerset_class_id))) {
+    pointerset_reset(set, rt);
+    js_free_rt(rt, set);
+  }
+}
+
+static const JSCFunctionListEntry js_pointerset_proto_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("add", 1, js_pointerset_method, POINTERSET_ADD),
+    JS_CFUNC_MAGIC_DEF("deref", 1, js_pointerset_method, POINTERSET_DEREF),
+    JS_CGETSET_DEF("size", js_pointerset_size, 0),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "PointerSet", JS_PROP_CONFIGURABLE),
+};
+
+static JSClassDef js_pointerset_class = {
+    .class_name = "PointerSet",
+    .finalizer = js_pointerset_finalizer,
+};
+
 static int
 js_pointer_init(JSContext* ctx, JSModuleDef* m) {
 
@@ -579,8 +773,19 @@ js_pointer_init(JSContext* ctx, JSModuleDef* m) {
   JS_SetClassProto(ctx, js_pointer_class_id, pointer_proto);
   JS_SetConstructor(ctx, pointer_ctor, pointer_proto);
 
+  JS_NewClassID(&js_pointerset_class_id);
+  JS_NewClass(JS_GetRuntime(ctx), js_pointerset_class_id, &js_pointerset_class);
+
+  pointerset_proto = JS_NewObject(ctx);
+  JS_SetPropertyFunctionList(ctx, pointerset_proto, js_pointerset_proto_funcs, countof(js_pointerset_proto_funcs));
+  JS_SetClassProto(ctx, js_pointerset_class_id, pointerset_proto);
+
+  pointerset_ctor = JS_NewCFunction2(ctx, js_pointerset_constructor, "PointerSet", 1, JS_CFUNC_constructor, 0);
+  JS_SetConstructor(ctx, pointerset_ctor, pointerset_proto);
+
   if(m) {
     JS_SetModuleExport(ctx, m, "Pointer", pointer_ctor);
+    JS_SetModuleExport(ctx, m, "PointerSet", pointerset_ctor);
   }
 
   return 0;
@@ -598,6 +803,7 @@ JS_INIT_MODULE(JSContext* ctx, const char* module_name) {
 
   if((m = JS_NewCModule(ctx, module_name, js_pointer_init))) {
     JS_AddModuleExport(ctx, m, "Pointer");
+    JS_AddModuleExport(ctx, m, "PointerSet");
   }
 
   return m;
@@ -342,8 +342,77 @@ enum {
   METHOD_EVAL = 0,
   METHOD_KEYS,
   METHOD_VALUES,
+  METHOD_COMPILE,
+  METHOD_FILTER,
+  METHOD_MASK,
+  METHOD_COUNT,
 };
 
+typedef struct {
+  JSContext* ctx;
+  uint8_t* data;
+  size_t count, capacity;
+  BOOL error;
+} PredicateSelection;
+
+static void
+predicate_select_count(void* opaque, size_t offset, const uint8_t* results, size_t n) {
+  PredicateSelection* sel = opaque;
+
+  for(size_t i = 0; i < n; i++)
+    sel->count += results[i];
+}
+
+static void
+predicate_select_index(void* opaque, size_t offset, const uint8_t* results, size_t n) {
+  PredicateSelection* sel = opaque;
+
+  if(sel->error)
+    return;
+
+  if(sel->count + n > sel->capacity) {
+    size_t capacity = MAX_NUM(sel->capacity * 2, sel->count + n);
+    uint8_t* data;
+
+    if(!(data = js_realloc(sel->ctx, sel->data, capacity * sizeof(uint32_t)))) {
+      sel->error = TRUE;
+      return;
+    }
+
+    sel->data = data;
+    sel->capacity = capacity;
+  }
+
+  for(size_t i = 0; i < n; i++)
+    if(results[i])
+      ((uint32_t*)sel->data)[sel->count++] = offset + i;
+}
+
+static void
+predicate_select_mask(void* opaque, size_t offset, const uint8_t* results, size_t n) {
+  PredicateSelection* sel = opaque;
+
+  for(size_t i = 0; i < n; i++)
+    if(results[i])
+      sel->data[(offset + i) >> 3] |= 1 << ((offset + i) & 7);
+}
+
+static void
+predicate_selection_free(JSRuntime* rt, void* opaque, void* ptr) {
+  js_free_rt(rt, ptr);
+}
+
+static JSValue
+predicate_selection_array(PredicateSelection* sel, size_t size, int bits) {
+  JSValue buffer, ret;
+
+  buffer = JS_NewArrayBuffer(sel->ctx, sel->data, size, predicate_selection_free, 0, FALSE);
+  sel->data = 0;
+  ret = js_typedarray_new(sel->ctx, bits, FALSE, FALSE, buffer);
+  JS_FreeValue(sel->ctx, buffer);
+  return ret;
+}
+
 static JSValue
 js_predicate_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
   Predicate* pr;
@@ -368,6 +437,46 @@ js_predicate_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueCons
       ret = predicate_values(pr, ctx);
       break;
     }
+
+    case METHOD_COMPILE: {
+      if(predicate_compile(pr, ctx) < 0)
+        return JS_EXCEPTION;
+
+      ret = JS_DupValue(ctx, this_val);
+      break;
+    }
+
+    case METHOD_FILTER:
+    case METHOD_MASK:
+    case METHOD_COUNT: {
+      PredicateSelection sel = {ctx, 0, 0, 0, FALSE};
+      PredicateScanFunc* fn = magic == METHOD_FILTER ? predicate_select_index : magic == METHOD_MASK ? predicate_select_mask : predicate_select_count;
+      int64_t length = 0;
+
+      if(!js_is_array_like(ctx, argv[0]))
+        return JS_ThrowTypeError(ctx, "argument 1 must be an array or typed array");
+
+      if(magic == METHOD_MASK) {
+        if((length = js_array_length(ctx, argv[0])) < 0)
+          return JS_EXCEPTION;
+
+        if(!(sel.data = js_mallocz(ctx, MAX_NUM((length + 7) >> 3, 1))))
+          return JS_EXCEPTION;
+      }
+
+      if(predicate_scan(pr, ctx, argv[0], fn, &sel) < 0 || sel.error) {
+        js_free(ctx, sel.data);
+        return sel.error ? JS_ThrowOutOfMemory(ctx) : JS_EXCEPTION;
+      }
+
+      switch(magic) {
+        case METHOD_FILTER: ret = predicate_selection_array(&sel, sel.count * sizeof(uint32_t), 32); break;
+        case METHOD_MASK: ret = predicate_selection_array(&sel, (length + 7) >> 3, 8); break;
+        case METHOD_COUNT: ret = JS_NewInt64(ctx, sel.count); break;
+      }
+
+      break;
+    }
   }
   return ret;
 }
@@ -880,6 +989,10 @@ static const JSCFunctionListEntry js_predicate_proto_funcs[] = {
     JS_CGETSET_MAGIC_FLAGS_DEF("id", js_predicate_get, 0, PROP_ID, JS_PROP_CONFIGURABLE),
     JS_CFUNC_MAGIC_DEF("keys", 0, js_predicate_method, METHOD_KEYS),
     JS_CFUNC_MAGIC_DEF("values", 0, js_predicate_method, METHOD_VALUES),
+    JS_CFUNC_MAGIC_DEF("compile", 0, js_predicate_method, METHOD_COMPILE),
+    JS_CFUNC_MAGIC_DEF("filter", 1, js_predicate_method, METHOD_FILTER),
+    JS_CFUNC_MAGIC_DEF("mask", 1, js_predicate_method, METHOD_MASK),
+    JS_CFUNC_MAGIC_DEF("count", 1, js_predicate_method, METHOD_COUNT),
     JS_CGETSET_MAGIC_DEF("length", js_predicate_get, 0, PROP_ARGC),
     JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Predicate", JS_PROP_CONFIGURABLE),
 };
@@ -970,7 +1083,6 @@ static const JSCFunctionListEntry js_predicate_types[] = {
 
 static int
 js_predicate_init(JSContext* ctx, JSModuleDef* m) {
-
   JS_NewClassID(&js_predicate_class_id);
   JS_NewClass(JS_GetRuntime(ctx), js_predicate_class_id, &js_predicate_class);
 
@@ -0,0 +1,336 @@
+#include "defines.h"
+#include "utils.h"
+#include "stack-profile.h"
+#include "quickjs-internal.h"
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
+
+/**
+ * \defgroup quickjs-profiler quickjs-profiler: Sampling CPU profiler
+ *
+ * An ITIMER_PROF timer raises SIGPROF at the configured rate while the
+ * process uses CPU. The signal handler only counts ticks, and the
+ * interrupt handler, which the interpreter polls between bytecodes,
+ * turns them into stack samples. That way nothing runs inside the signal
+ * handler that could observe the VM in an inconsistent state. Time spent
+ * in a long native call is attributed to the frame that made the call.
+ *
+ * Signals and timers are per process, so one runtime owns the profiler.
+ * @{
+ */
+typedef struct {
+  JSRuntime* rt;
+  JSContext* ctx;
+  JSInterruptHandler* prev_handler;
+  void* prev_opaque;
+  StackProfile stacks;
+  int hz, max_depth;
+  BOOL running, hooked;
+  char* signal_file;
+} CpuProfiler;
+
+static CpuProfiler cpu_profiler;
+static volatile sig_atomic_t cpu_profiler_ticks = 0, cpu_profiler_toggle = 0;
+
+static JSValue profiler_object = {{0}, JS_TAG_UNDEFINED};
+
+enum {
+  PROFILER_START = 0,
+  PROFILER_STOP,
+  PROFILER_RUNNING,
+  PROFILER_COLLAPSED,
+  PROFILER_WRITE,
+  PROFILER_RESET,
+  PROFILER_SAMPLES,
+  PROFILER_HANDLE_SIGNAL,
+};
+
+#ifndef _WIN32
+static struct sigaction cpu_profiler_oldprof;
+
+static void
+cpu_profiler_sigprof(int sig) {
+  cpu_profiler_ticks++;
+}
+
+#ifdef SIGUSR2
+static void
+cpu_profiler_sigusr2(int sig) {
+  cpu_profiler_toggle = 1;
+}
+#endif
+
+static int
+cpu_profiler_timer(int hz) {
+  struct itimerval it;
+  long usec = hz > 0 ? 1000000 / hz : 0;
+
+  it.it_interval.tv_sec = usec / 1000000;
+  it.it_interval.tv_usec = usec % 1000000;
+  it.it_value = it.it_interval;
+
+  return setitimer(ITIMER_PROF, &it, 0);
+}
+#endif
+
+static int cpu_profiler_interrupt(JSRuntime*, void*);
+
+/* installs the interrupt handler once, chaining to the one set before */
+static void
+cpu_profiler_hook(JSContext* ctx) {
+  JSRuntime* rt = JS_GetRuntime(ctx);
+
+  if(cpu_profiler.hooked)
+    return;
+
+  cpu_profiler.rt = rt;
+  cpu_profiler.ctx = ctx;
+  cpu_profiler.prev_handler = rt->interrupt_handler;
+  cpu_profiler.prev_opaque = rt->interrupt_opaque;
+  cpu_profiler.hooked = TRUE;
+  stack_profile_init(&cpu_profiler.stacks, rt);
+
+  JS_SetInterruptHandler(rt, cpu_profiler_interrupt, &cpu_profiler);
+}
+
+static int
+cpu_profiler_start(JSContext* ctx, int hz, int max_depth) {
+#ifdef _WIN32
+  JS_ThrowInternalError(ctx, "the CPU profiler needs setitimer()");
+  return -1;
+#else
+  struct sigaction sa;
+
+  if(cpu_profiler.running)
+    return 0;
+
+  cpu_profiler_hook(ctx);
+  cpu_profiler.hz = hz;
+  cpu_profiler.max_depth = max_depth;
+  cpu_profiler_ticks = 0;
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = cpu_profiler_sigprof;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+
+  if(sigaction(SIGPROF, &sa, &cpu_profiler_oldprof) || cpu_profiler_timer(hz)) {
+    JS_ThrowInternalError(ctx, "starting the profiling timer failed: %s", strerror(errno));
+    return -1;
+  }
+
+  cpu_profiler.running = TRUE;
+  return 0;
+#endif
+}
+
+static void
+cpu_profiler_stop(void) {
+#ifndef _WIN32
+  if(!cpu_profiler.running)
+    return;
+
+  cpu_profiler_timer(0);
+  sigaction(SIGPROF, &cpu_profiler_oldprof, 0);
+  cpu_profiler.running = FALSE;
+#endif
+}
+
+static int
+cpu_profiler_interrupt(JSRuntime* rt, void* opaque) {
+  CpuProfiler* prof = opaque;
+  int ticks;
+
+  if(cpu_profiler_toggle) {
+    cpu_profiler_toggle = 0;
+
+    if(prof->running) {
+      cpu_profiler_stop();
+
+      /* a dump on request must not throw into whatever code is running */
+      if(prof->signal_file && !stack_profile_write(&prof->stacks, prof->signal_file))
+        stack_profile_reset(&prof->stacks);
+    } else if(cpu_profiler_start(prof->ctx, prof->hz ? prof->hz : 99, prof->max_depth ? prof->max_depth : STACK_PROFILE_MAX_DEPTH)) {
+      JS_FreeValue(prof->ctx, JS_GetException(prof->ctx));
+    }
+  }
+
+  if((ticks = cpu_profiler_ticks)) {
+    cpu_profiler_ticks = 0;
+
+    if(prof->running) {
+      StackProfileFrame frames[STACK_PROFILE_MAX_DEPTH];
+      int depth = stack_profile_capture(rt, frames, prof->max_depth);
+
+      stack_profile_add(&prof->stacks, prof->ctx, frames, depth, ticks);
+    }
+  }
+
+  return prof->prev_handler ? prof->prev_handler(rt, prof->prev_opaque) : 0;
+}
+
+static JSValue
+js_profiler_function(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  JSValue ret = JS_UNDEFINED;
+
+  if(cpu_profiler.hooked && cpu_profiler.rt != JS_GetRuntime(ctx))
+    return JS_ThrowInternalError(ctx, "the profiler is owned by another runtime");
+
+  switch(magic) {
+    case PROFILER_START: {
+      int32_t hz = 99, max_depth = STACK_PROFILE_MAX_DEPTH;
+
+      if(argc > 0 && JS_IsObject(argv[0])) {
+        JSValue v;
+
+        v = JS_GetPropertyStr(ctx, argv[0], "hz");
+        if(!JS_IsUndefined(v))
+          JS_ToInt32(ctx, &hz, v);
+        JS_FreeValue(ctx, v);
+
+        v = JS_GetPropertyStr(ctx, argv[0], "maxDepth");
+        if(!JS_IsUndefined(v))
+          JS_ToInt32(ctx, &max_depth, v);
+        JS_FreeValue(ctx, v);
+      } else if(argc > 0 && !JS_IsUndefined(argv[0])) {
+        JS_ToInt32(ctx, &hz, argv[0]);
+      }
+
+      if(hz < 1 || hz > 10000)
+        return JS_ThrowRangeError(ctx, "hz must be between 1 and 10000");
+
+      if(max_depth < 1 || max_depth > STACK_PROFILE_MAX_DEPTH)
+        max_depth = STACK_PROFILE_MAX_DEPTH;
+
+      if(cpu_profiler_start(ctx, hz, max_depth))
+        ret = JS_EXCEPTION;
+
+      break;
+    }
+
+    case PROFILER_STOP: {
+      cpu_profiler_stop();
+      break;
+    }
+
+    case PROFILER_RUNNING: {
+      ret = JS_NewBool(ctx, cpu_profiler.running);
+      break;
+    }
+
+    case PROFILER_COLLAPSED: {
+      DynBuf db;
+
+      dbuf_init(&db);
+
+      if(cpu_profiler.hooked)
+        stack_profile_collapse(&cpu_profiler.stacks, &db);
+
+      ret = JS_NewStringLen(ctx, (const char*)db.buf, db.size);
+      dbuf_free(&db);
+      break;
+    }
+
+    case PROFILER_WRITE: {
+      const char* file;
+
+      if(!(file = JS_ToCString(ctx, argv[0])))
+        return JS_EXCEPTION;
+
+      cpu_profiler_hook(ctx);
+
+      if(stack_profile_write(&cpu_profiler.stacks, file))
+        ret = JS_ThrowInternalError(ctx, "writing profile to '%s' failed: %s", file, strerror(errno));
+
+      JS_FreeCString(ctx, file);
+      break;
+    }
+
+    case PROFILER_RESET: {
+      if(cpu_profiler.hooked)
+        stack_profile_reset(&cpu_profiler.stacks);
+
+      break;
+    }
+
+    case PROFILER_SAMPLES: {
+      ret = JS_NewInt64(ctx, cpu_profiler.hooked ? cpu_profiler.stacks.samples : 0);
+      break;
+    }
+
+    case PROFILER_HANDLE_SIGNAL: {
+#ifdef SIGUSR2
+      const char* file;
+
+      if(!(file = JS_ToCString(ctx, argv[0])))
+        return JS_EXCEPTION;
+
+      cpu_profiler_hook(ctx);
+
+      if(cpu_profiler.signal_file)
+        free(cpu_profiler.signal_file);
+
+      cpu_profiler.signal_file = strdup(file);
+      JS_FreeCString(ctx, file);
+
+      signal(SIGUSR2, cpu_profiler_sigusr2);
+#else
+      ret = JS_ThrowInternalError(ctx, "SIGUSR2 is not available");
+#endif
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static const JSCFunctionListEntry js_profiler_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("start", 0, js_profiler_function, PROFILER_START),
+    JS_CFUNC_MAGIC_DEF("stop", 0, js_profiler_function, PROFILER_STOP),
+    JS_CFUNC_MAGIC_DEF("isRunning", 0, js_profiler_function, PROFILER_RUNNING),
+    JS_CFUNC_MAGIC_DEF("collapsed", 0, js_profiler_function, PROFILER_COLLAPSED),
+    JS_CFUNC_MAGIC_DEF("write", 1, js_profiler_function, PROFILER_WRITE),
+    JS_CFUNC_MAGIC_DEF("reset", 0, js_profiler_function, PROFILER_RESET),
+    JS_CFUNC_MAGIC_DEF("samples", 0, js_profiler_function, PROFILER_SAMPLES),
+    JS_CFUNC_MAGIC_DEF("handleSignal", 1, js_profiler_function, PROFILER_HANDLE_SIGNAL),
+};
+
+int
+js_profiler_init(JSContext* ctx, JSModuleDef* m) {
+  profiler_object = JS_NewObject(ctx);
+
+  JS_SetPropertyFunctionList(ctx, profiler_object, js_profiler_funcs, countof(js_profiler_funcs));
+
+  if(m) {
+    JS_SetModuleExportList(ctx, m, js_profiler_funcs, countof(js_profiler_funcs));
+    JS_SetModuleExport(ctx, m, "default", profiler_object);
+  }
+
+  return 0;
+}
+
+#ifdef JS_PROFILER_MODULE
+#define JS_INIT_MODULE js_init_module
+#else
+#define JS_INIT_MODULE js_init_module_profiler
+#endif
+
+VISIBLE JSModuleDef*
+JS_INIT_MODULE(JSContext* ctx, const char* module_name) {
+  JSModuleDef* m;
+
+  if((m = JS_NewCModule(ctx, module_name, js_profiler_init))) {
+    JS_AddModuleExportList(ctx, m, js_profiler_funcs, countof(js_profiler_funcs));
+    JS_AddModuleExport(ctx, m, "default");
+  }
+
+  return m;
+}
+
+/**
+ * @}
+ */
@@ -1,27 +1,16 @@
 #include "defines.h"
-#include "queue.h"
-#include "utils.h"
+#include "quickjs-queue.h"
 #include "buffer-utils.h"
+#include "quickjs-perf.h"
+#include <errno.h>
 
 /**
- * \defgroup quickjs-queue quickjs-queue: Queue reader
+ * \addtogroup quickjs-queue
  * @{
  */
 VISIBLE JSClassID js_queue_class_id = 0, js_queue_iterator_class_id = 0;
 VISIBLE JSValue queue_proto, queue_ctor, queue_iterator_proto;
 
-JSValue chunk_arraybuffer(Chunk* ch, JSContext* ctx);
-
-static inline Queue*
-js_queue_data(JSValueConst value) {
-  return JS_GetOpaque(value, js_queue_class_id);
-}
-
-static inline Queue*
-js_queue_data2(JSContext* ctx, JSValueConst value) {
-  return JS_GetOpaque2(ctx, value, js_queue_class_id);
-}
-
 static JSValue
 js_queue_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
   JSValue proto, obj = JS_UNDEFINED;
@@ -63,6 +52,8 @@ enum {
   QUEUE_NEXT,
   QUEUE_CHUNK,
   QUEUE_AT,
+  QUEUE_WRITE_TO,
+  QUEUE_READ_FROM,
 };
 
 static JSValue
@@ -76,8 +67,10 @@ js_queue_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst ar
   switch(magic) {
     case QUEUE_WRITE: {
       InputBuffer input = js_input_args(ctx, argc, argv);
+      int64_t t = perf_trace_begin(PERF_TRACE_QUEUE);
       int64_t r = queue_write(queue, input_buffer_data(&input), input_buffer_length(&input));
 
+      perf_trace_end(PERF_TRACE_QUEUE, t, r > 0 ? r : 0);
       ret = JS_NewInt64(ctx, r);
       input_buffer_free(&input, ctx);
 
@@ -85,8 +78,10 @@ js_queue_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst ar
     }
     case QUEUE_READ: {
       InputBuffer input = js_input_args(ctx, argc, argv);
+      int64_t t = perf_trace_begin(PERF_TRACE_QUEUE);
       int64_t r = queue_read(queue, input_buffer_data(&input), input_buffer_length(&input));
 
+      perf_trace_end(PERF_TRACE_QUEUE, t, r > 0 ? r : 0);
       ret = JS_NewInt64(ctx, r);
       input_buffer_free(&input, ctx);
       break;
@@ -165,6 +160,25 @@ js_queue_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst ar
 
       break;
     }
+
+    case QUEUE_WRITE_TO:
+    case QUEUE_READ_FROM: {
+      int32_t fd = -1;
+      int64_t max = INT64_MAX;
+      ssize_t r;
+
+      if(JS_ToInt32(ctx, &fd, argv[0]))
+        return JS_EXCEPTION;
+
+      if(argc > 1 && !js_is_null_or_undefined(argv[1]) && JS_ToInt64Ext(ctx, &max, argv[1]))
+        return JS_EXCEPTION;
+
+      max = MAX_NUM(max, 0);
+      r = magic == QUEUE_WRITE_TO ? queue_writev(queue, fd, max) : queue_readv(queue, fd, max);
+
+      ret = JS_NewInt64(ctx, r < 0 ? -errno : r);
+      break;
+    }
   }
 
   return ret;
@@ -254,6 +268,8 @@ static const JSCFunctionListEntry js_queue_funcs[] = {
     JS_CFUNC_MAGIC_DEF("next", 0, js_queue_method, QUEUE_NEXT),
     JS_CFUNC_MAGIC_DEF("chunk", 1, js_queue_method, QUEUE_CHUNK),
     JS_CFUNC_MAGIC_DEF("at", 1, js_queue_method, QUEUE_AT),
+    JS_CFUNC_MAGIC_DEF("writeTo", 1, js_queue_method, QUEUE_WRITE_TO),
+    JS_CFUNC_MAGIC_DEF("readFrom", 1, js_queue_method, QUEUE_READ_FROM),
     JS_CGETSET_MAGIC_DEF("size", js_queue_get, 0, QUEUE_SIZE),
     JS_CGETSET_MAGIC_DEF("empty", js_queue_get, 0, QUEUE_EMPTY),
     JS_CGETSET_MAGIC_DEF("head", js_queue_get, 0, QUEUE_HEAD),
@@ -263,6 +279,39 @@ static const JSCFunctionListEntry js_queue_funcs[] = {
     JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Queue", JS_PROP_CONFIGURABLE),
 };
 
+static JSValue
+js_queue_pool_stats(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  static const char* const classes[CHUNK_POOL_CLASSES] = {"256", "4K", "16K", "64K"};
+  ChunkPoolStats stats;
+  JSValue ret, free;
+
+  chunk_pool_stats(&stats);
+
+  ret = JS_NewObject(ctx);
+  JS_SetPropertyStr(ctx, ret, "hits", JS_NewInt64(ctx, stats.hits));
+  JS_SetPropertyStr(ctx, ret, "misses", JS_NewInt64(ctx, stats.misses));
+  JS_SetPropertyStr(ctx, ret, "slabs", JS_NewInt64(ctx, stats.slabs));
+
+  free = JS_NewObject(ctx);
+
+  for(int i = 0; i < CHUNK_POOL_CLASSES; i++)
+    JS_SetPropertyStr(ctx, free, classes[i], JS_NewInt64(ctx, stats.free[i]));
+
+  JS_SetPropertyStr(ctx, ret, "free", free);
+  return ret;
+}
+
+static JSValue
+js_queue_huge_pages(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  chunk_pool_hugepages(JS_ToBool(ctx, argv[0]));
+  return JS_UNDEFINED;
+}
+
+static const JSCFunctionListEntry js_queue_static[] = {
+    JS_CFUNC_DEF("poolStats", 0, js_queue_pool_stats),
+    JS_CFUNC_DEF("hugePages", 1, js_queue_huge_pages),
+};
+
 static JSClassDef js_queue_iterator_class = {
     .class_name = "QueueIterator",
 };
@@ -303,6 +352,7 @@ js_queue_init(JSContext* ctx, JSModuleDef* m) {
     queue_proto = JS_NewObject(ctx);
 
     JS_SetPropertyFunctionList(ctx, queue_proto, js_queue_funcs, countof(js_queue_funcs));
+    JS_SetPropertyFunctionList(ctx, queue_ctor, js_queue_static, countof(js_queue_static));
 
     JS_SetClassProto(ctx, js_queue_class_id, queue_proto);
     JS_SetConstructor(ctx, queue_ctor, queue_proto);
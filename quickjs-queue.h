@@ -0,0 +1,30 @@
+#ifndef QUICKJS_QUEUE_H
+#define QUICKJS_QUEUE_H
+
+#include "queue.h"
+#include "utils.h"
+
+/**
+ * \defgroup quickjs-queue quickjs-queue: Queue reader
+ * @{
+ */
+extern VISIBLE JSClassID js_queue_class_id, js_queue_iterator_class_id;
+extern VISIBLE JSValue queue_proto, queue_ctor, queue_iterator_proto;
+
+JSValue chunk_arraybuffer(Chunk* ch, JSContext* ctx);
+
+static inline Queue*
+js_queue_data(JSValueConst value) {
+  return JS_GetOpaque(value, js_queue_class_id);
+}
+
+static inline Queue*
+js_queue_data2(JSContext* ctx, JSValueConst value) {
+  return JS_GetOpaque2(ctx, value, js_queue_class_id);
+}
+
+/**
+ * @}
+ */
+
+#endif /* defined(QUICKJS_QUEUE_H) */
@@ -25,6 +25,16 @@ enum repeater_getters {
 };
 enum repeater_state { REPEATER_INITIAL = 0, REPEATER_STARTED, REPEATER_STOPPED, REPEATER_DONE, REPEATER_REJECTED };
 
+/**
+ * What push() does without a waiting next(): unbuffered pushes wait for
+ * their consumer, the others resolve at once while fewer than
+ * high_water_mark values are buffered. Beyond that FIXED waits like an
+ * unbuffered push, SLIDING drops the oldest value and DROPPING the new one.
+ */
+enum repeater_policy { REPEATER_UNBUFFERED = 0, REPEATER_FIXED, REPEATER_SLIDING, REPEATER_DROPPING };
+
+#define REPEATER_MAX_PUSHES 1024
+
 struct resolvable_item {
   JSValue resolve, value;
 };
@@ -46,8 +56,12 @@ typedef struct repeater_object {
   struct list_head pushes, nexts;
   JSValue pending, execution;
   JSValue onnext, onstop;
+  enum repeater_policy policy;
+  uint32_t high_water_mark, npushes, nbuffered;
 } Repeater;
 
+static void repeater_finalizer(JSRuntime*, Repeater*);
+
 Repeater*
 repeater_new(JSContext* ctx, JSValueConst executor) {
   Repeater* rpt;
@@ -118,8 +132,13 @@ resolvable_value(JSContext* ctx, JSValueConst value, struct resolvable_item* rsv
 static JSValue
 resolvable_resolve(JSContext* ctx, struct resolvable_item* rsva, JSValueConst value) {
   JSValue result;
-  result = JS_Call(ctx, rsva->resolve, JS_UNDEFINED, 1, &value);
-  JS_FreeValue(ctx, result);
+
+  /* buffered pushes were resolved when they entered the buffer */
+  if(!JS_IsUndefined(rsva->resolve)) {
+    result = JS_Call(ctx, rsva->resolve, JS_UNDEFINED, 1, &value);
+    JS_FreeValue(ctx, result);
+  }
+
   return JS_DupValue(ctx, rsva->value);
 }
 
@@ -285,25 +304,75 @@ js_repeater_push(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst a
   if(!(rpt = JS_GetOpaque2(ctx, this_val, js_repeater_class_id)))
     return JS_EXCEPTION;
 
-  const char* v = JS_ToCString(ctx, value);
-  // printf("js_repeater_push value=%s pushes=%d nexts=%d\n", v, queue_length(&rpt->pushes),
-  // queue_length(&rpt->nexts));
-  JS_FreeCString(ctx, v);
+  if(rpt->state >= REPEATER_STOPPED)
+    return js_promise_resolve(ctx, JS_UNDEFINED);
 
   if((item = queue_shift(&rpt->nexts))) {
     ret = resolvable_resolve(ctx, &item->resolvable, value);
     queue_free(ctx, item);
-  } else {
-    if(!(item = queue_alloc(ctx)))
-      return JS_EXCEPTION;
+    return ret;
+  }
+
+  if(rpt->policy != REPEATER_UNBUFFERED && rpt->nbuffered >= rpt->high_water_mark) {
+    if(rpt->policy == REPEATER_DROPPING)
+      return js_promise_resolve(ctx, JS_UNDEFINED);
 
+    if(rpt->policy == REPEATER_SLIDING && (item = queue_shift(&rpt->pushes))) {
+      queue_free(ctx, item);
+      rpt->npushes--;
+      rpt->nbuffered--;
+    }
+  }
+
+  if(rpt->npushes - rpt->nbuffered >= REPEATER_MAX_PUSHES)
+    return JS_ThrowRangeError(ctx, "No more than %d pending calls to push() are allowed", REPEATER_MAX_PUSHES);
+
+  if(!(item = queue_alloc(ctx)))
+    return JS_EXCEPTION;
+
+  if(rpt->policy != REPEATER_UNBUFFERED && rpt->nbuffered < rpt->high_water_mark) {
+    item->resolvable.value = JS_DupValue(ctx, value);
+    ret = js_promise_resolve(ctx, JS_UNDEFINED);
+    rpt->nbuffered++;
+  } else {
     ret = resolvable_value(ctx, value, &item->resolvable);
-    queue_add(&rpt->pushes, item);
   }
 
+  queue_add(&rpt->pushes, item);
+  rpt->npushes++;
   return ret;
 }
 
+/**
+ * A buffered value was consumed: the oldest waiting push takes its slot
+ */
+static void
+repeater_shifted(JSContext* ctx, Repeater* rpt, BOOL buffered) {
+  struct list_head* el;
+  uint32_t i = 0;
+
+  rpt->npushes--;
+
+  if(!buffered)
+    return;
+
+  rpt->nbuffered--;
+
+  list_for_each(el, &rpt->pushes) {
+    struct repeater_item* item = list_entry(el, struct repeater_item, link);
+
+    if(i++ == rpt->nbuffered) {
+      JSValue result = JS_Call(ctx, item->resolvable.resolve, JS_UNDEFINED, 0, 0);
+
+      JS_FreeValue(ctx, result);
+      JS_FreeValue(ctx, item->resolvable.resolve);
+      item->resolvable.resolve = JS_UNDEFINED;
+      rpt->nbuffered++;
+      break;
+    }
+  }
+}
+
 static JSValue
 js_repeater_stop(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
   Repeater* rpt;
@@ -327,11 +396,19 @@ js_repeater_stop(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst a
 
   {
     struct list_head *el, *next;
+    uint32_t i = 0;
+
+    /* buffered values can still be consumed, waiting pushes are dropped */
     list_for_each_safe(el, next, &rpt->pushes) {
       struct repeater_item* item = list_entry(el, struct repeater_item, link);
+
+      if(i++ < rpt->nbuffered)
+        continue;
+
       JS_FreeValue(ctx, resolvable_resolve(ctx, &item->resolvable, JS_UNDEFINED));
       list_del(&item->link);
       queue_free(ctx, item);
+      rpt->npushes--;
     }
   }
 
@@ -366,14 +443,67 @@ js_repeater_finish(JSContext* ctx, JSValueConst this_val) {
   }
 }
 
+/**
+ * Buffer options: a highWaterMark number for a fixed buffer or
+ * { policy: 'fixed' | 'sliding' | 'dropping', highWaterMark }
+ */
+static BOOL
+repeater_options(JSContext* ctx, Repeater* rpt, JSValueConst options) {
+  JSValue value = JS_UNDEFINED;
+  int32_t policy = REPEATER_FIXED;
+
+  if(JS_IsObject(options)) {
+    if(js_has_propertystr(ctx, options, "policy")) {
+      const char* str = js_get_propertystr_cstring(ctx, options, "policy");
+
+      if(!str || (strcmp(str, "fixed") && strcmp(str, "sliding") && strcmp(str, "dropping")))
+        policy = -1;
+      else
+        policy = str[0] == 'f' ? REPEATER_FIXED : str[0] == 's' ? REPEATER_SLIDING : REPEATER_DROPPING;
+
+      JS_FreeCString(ctx, str);
+
+      if(policy == -1) {
+        JS_ThrowRangeError(ctx, "policy must be 'fixed', 'sliding' or 'dropping'");
+        return FALSE;
+      }
+    }
+
+    value = JS_GetPropertyStr(ctx, options, "highWaterMark");
+  } else if(JS_IsNumber(options)) {
+    value = JS_DupValue(ctx, options);
+  } else {
+    return TRUE;
+  }
+
+  if(JS_IsUndefined(value) && policy != REPEATER_FIXED) {
+    JS_ThrowRangeError(ctx, "a sliding or dropping buffer needs a highWaterMark");
+    return FALSE;
+  }
+
+  if(JS_ToUint32(ctx, &rpt->high_water_mark, value)) {
+    JS_FreeValue(ctx, value);
+    return FALSE;
+  }
+
+  JS_FreeValue(ctx, value);
+  rpt->policy = policy;
+  return TRUE;
+}
+
 JSValue
-js_repeater_new(JSContext* ctx, JSValueConst proto, JSValueConst executor) {
+js_repeater_new(JSContext* ctx, JSValueConst proto, JSValueConst executor, JSValueConst options) {
   Repeater* rpt;
   JSValue obj = JS_UNDEFINED;
 
   if(!(rpt = repeater_new(ctx, executor)))
     return JS_EXCEPTION;
 
+  if(!repeater_options(ctx, rpt, options)) {
+    repeater_finalizer(JS_GetRuntime(ctx), rpt);
+    return JS_EXCEPTION;
+  }
+
   obj = JS_NewObjectProtoClass(ctx, proto, js_repeater_class_id);
   if(JS_IsException(obj))
     goto fail;
@@ -406,7 +536,7 @@ js_repeater_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSVal
   if(JS_IsException(proto))
     proto = JS_DupValue(ctx, repeater_proto);
 
-  obj = js_repeater_new(ctx, proto, argv[0]);
+  obj = js_repeater_new(ctx, proto, argv[0], argc > 1 ? argv[1] : JS_UNDEFINED);
 
   JS_FreeValue(ctx, proto);
   return obj;
@@ -434,8 +564,12 @@ js_repeater_next(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst a
   // queue_length(&rpt->nexts));
 
   if((item = queue_shift(&rpt->pushes))) {
+    BOOL buffered = JS_IsUndefined(item->resolvable.resolve);
     JSValue it = resolvable_resolve(ctx, &item->resolvable, value);
 
+    queue_free(ctx, item);
+    repeater_shifted(ctx, rpt, buffered);
+
     ret = js_repeater_create_iteration(ctx, this_val, it);
     JS_FreeValue(ctx, it);
 
@@ -465,24 +599,353 @@ js_repeater_next(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst a
   return ret;
 }
 
+/* a single value from next() as a batch */
+static JSValue
+js_repeater_batch_one(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  JSValue value, batch;
+
+  if(js_get_propertystr_bool(ctx, argv[0], "done"))
+    return JS_DupValue(ctx, argv[0]);
+
+  value = JS_GetPropertyStr(ctx, argv[0], "value");
+  batch = js_values_toarray(ctx, 1, &value);
+  JS_FreeValue(ctx, value);
+
+  value = js_iterator_result(ctx, batch, FALSE);
+  JS_FreeValue(ctx, batch);
+  return value;
+}
+
+/**
+ * nextBatch(max): everything buffered, up to max values, as one array in
+ * one resolution. With nothing buffered it waits like next() does.
+ */
+static JSValue
+js_repeater_next_batch(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  Repeater* rpt;
+  struct repeater_item* item;
+  JSValue ret, batch, value;
+  uint32_t i, max = UINT32_MAX;
+  BOOL promises = FALSE;
+
+  if(!(rpt = JS_GetOpaque2(ctx, this_val, js_repeater_class_id)))
+    return JS_EXCEPTION;
+
+  if(argc > 0 && !JS_IsUndefined(argv[0]) && JS_ToUint32(ctx, &max, argv[0]))
+    return JS_EXCEPTION;
+
+  if(list_empty(&rpt->pushes)) {
+    JSValue fn, next = js_repeater_next(ctx, this_val, 0, 0);
+
+    if(JS_IsException(next))
+      return next;
+
+    fn = JS_NewCFunction(ctx, js_repeater_batch_one, "batch", 1);
+    ret = js_promise_then(ctx, next, fn);
+    JS_FreeValue(ctx, fn);
+    JS_FreeValue(ctx, next);
+    return ret;
+  }
+
+  if(JS_IsFunction(ctx, rpt->onnext))
+    JS_FreeValue(ctx, JS_Call(ctx, rpt->onnext, this_val, 0, 0));
+
+  batch = JS_NewArray(ctx);
+
+  for(i = 0; i < MAX_NUM(max, 1) && (item = queue_shift(&rpt->pushes)); i++) {
+    BOOL buffered = JS_IsUndefined(item->resolvable.resolve);
+
+    value = resolvable_resolve(ctx, &item->resolvable, JS_UNDEFINED);
+    queue_free(ctx, item);
+    repeater_shifted(ctx, rpt, buffered);
+
+    promises |= js_is_promise(ctx, value);
+    JS_SetPropertyUint32(ctx, batch, i, value);
+  }
+
+  /* pushed promises are awaited like next() awaits them */
+  if(promises) {
+    JSValue all = js_global_static_func(ctx, "Promise", "all"), promise = js_global_get_str(ctx, "Promise");
+
+    value = JS_Call(ctx, all, promise, 1, &batch);
+    JS_FreeValue(ctx, promise);
+    JS_FreeValue(ctx, all);
+    JS_FreeValue(ctx, batch);
+    batch = value;
+  }
+
+  ret = js_repeater_create_iteration(ctx, this_val, batch);
+  JS_FreeValue(ctx, batch);
+  return ret;
+}
+
 static JSValue
 js_repeater_iterator(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
   return JS_DupValue(ctx, this_val);
 }
 
+typedef struct {
+  JSValue iterator;
+  BOOL single;
+} FanInSource;
+
+/**
+ * Native fan-in for race(), merge() and zip(): each source has exactly
+ * one next() in flight whose settlement pushes into the output repeater,
+ * so a value costs O(1) promises no matter how many sources there are.
+ */
+typedef struct {
+  int ref_count, magic;
+  JSContext* ctx;
+  JSValue out, *values;
+  FanInSource* sources;
+  uint32_t nsources, active, waiting;
+  BOOL finished;
+} FanIn;
+
+enum {
+  FANIN_RESULT = 0,
+  FANIN_ERROR,
+  FANIN_PULL,
+  FANIN_PULL_ALL,
+};
+
+static FanIn*
+fanin_dup(FanIn* fi) {
+  ++fi->ref_count;
+  return fi;
+}
+
+static void
+fanin_free(void* ptr) {
+  FanIn* fi = ptr;
+  JSContext* ctx = fi->ctx;
+
+  if(--fi->ref_count == 0) {
+    for(uint32_t i = 0; i < fi->nsources; i++) {
+      JS_FreeValue(ctx, fi->sources[i].iterator);
+      JS_FreeValue(ctx, fi->values[i]);
+    }
+
+    JS_FreeValue(ctx, fi->out);
+    js_free(ctx, fi->sources);
+    js_free(ctx, fi->values);
+    js_free(ctx, fi);
+  }
+}
+
+static JSValue js_repeater_fanin(JSContext*, JSValueConst, int, JSValueConst[], int, void*);
+
+/* calls fn(value) once promise settles, or fn(error) in the error callback */
+static void
+fanin_then(FanIn* fi, JSValueConst promise, int index, int kind) {
+  JSContext* ctx = fi->ctx;
+  JSValue p = js_promise_resolve(ctx, promise), ret;
+  JSValue fns[2] = {
+      js_function_cclosure(ctx, js_repeater_fanin, 1, index << 2 | kind, fanin_dup(fi), fanin_free),
+      js_function_cclosure(ctx, js_repeater_fanin, 1, index << 2 | FANIN_ERROR, fanin_dup(fi), fanin_free),
+  };
+
+  ret = js_invoke(ctx, p, "then", countof(fns), fns);
+
+  JS_FreeValue(ctx, ret);
+  JS_FreeValue(ctx, fns[0]);
+  JS_FreeValue(ctx, fns[1]);
+  JS_FreeValue(ctx, p);
+}
+
+static void
+fanin_pull(FanIn* fi, uint32_t i) {
+  JSContext* ctx = fi->ctx;
+  FanInSource* src = &fi->sources[i];
+  JSValue result;
+
+  if(src->single) {
+    /* a plain value or promise: settles as the source's return value */
+    fanin_then(fi, src->iterator, i, FANIN_RESULT);
+    return;
+  }
+
+  if(JS_IsException((result = js_invoke(ctx, src->iterator, "next", 0, 0))))
+    result = js_promise_reject(ctx, JS_GetException(ctx));
+
+  fanin_then(fi, result, i, FANIN_RESULT);
+  JS_FreeValue(ctx, result);
+}
+
+/* the output is done: stop it and let the remaining sources go */
+static void
+fanin_finish(FanIn* fi, uint32_t except, JSValueConst error) {
+  JSContext* ctx = fi->ctx;
+
+  if(fi->finished)
+    return;
+
+  fi->finished = TRUE;
+  JS_FreeValue(ctx, js_repeater_stop(ctx, fi->out, JS_IsUndefined(error) ? 0 : 1, &error));
+
+  for(uint32_t i = 0; i < fi->nsources; i++) {
+    JSValue fn;
+
+    if(i == except || fi->sources[i].single)
+      continue;
+
+    fn = JS_GetPropertyStr(ctx, fi->sources[i].iterator, "return");
+
+    if(JS_IsFunction(ctx, fn))
+      JS_FreeValue(ctx, JS_Call(ctx, fn, fi->sources[i].iterator, 0, 0));
+
+    JS_FreeValue(ctx, fn);
+  }
+}
+
+/* pushes value and pulls the next one once push() lets it */
+static void
+fanin_push(FanIn* fi, JSValueConst value, int index, int kind) {
+  JSContext* ctx = fi->ctx;
+  JSValue ret = js_repeater_push(ctx, fi->out, 1, &value);
+
+  if(JS_IsException(ret)) {
+    JSValue error = JS_GetException(ctx);
+
+    fanin_finish(fi, -1, error);
+    JS_FreeValue(ctx, error);
+    return;
+  }
+
+  fanin_then(fi, ret, index, kind);
+  JS_FreeValue(ctx, ret);
+}
+
+static JSValue
+js_repeater_fanin(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* opaque) {
+  FanIn* fi = opaque;
+  JSValueConst arg = argc > 0 ? argv[0] : JS_UNDEFINED;
+  uint32_t index = magic >> 2;
+
+  if(fi->finished)
+    return JS_UNDEFINED;
+
+  switch(magic & 3) {
+    case FANIN_ERROR: {
+      fanin_finish(fi, index, arg);
+      break;
+    }
+
+    case FANIN_PULL: {
+      fanin_pull(fi, index);
+      break;
+    }
+
+    case FANIN_PULL_ALL: {
+      fi->waiting = fi->nsources;
+
+      for(uint32_t i = 0; i < fi->nsources; i++)
+        fanin_pull(fi, i);
+
+      break;
+    }
+
+    case FANIN_RESULT: {
+      BOOL done = fi->sources[index].single || js_get_propertystr_bool(ctx, arg, "done");
+
+      if(done) {
+        if(fi->magic != STATIC_MERGE || --fi->active == 0)
+          fanin_finish(fi, index, JS_UNDEFINED);
+
+        break;
+      }
+
+      JSValue value = JS_GetPropertyStr(ctx, arg, "value");
+
+      if(fi->magic != STATIC_ZIP) {
+        fanin_push(fi, value, index, FANIN_PULL);
+      } else {
+        JS_FreeValue(ctx, fi->values[index]);
+        fi->values[index] = JS_DupValue(ctx, value);
+
+        /* a round is complete: push the tuple, then start the next */
+        if(--fi->waiting == 0) {
+          JSValue tuple = js_values_toarray(ctx, fi->nsources, fi->values);
+
+          fanin_push(fi, tuple, 0, FANIN_PULL_ALL);
+          JS_FreeValue(ctx, tuple);
+        }
+      }
+
+      JS_FreeValue(ctx, value);
+      break;
+    }
+  }
+
+  return JS_UNDEFINED;
+}
+
+/**
+ * Repeater.race(sources[, buffer]), Repeater.merge(...), Repeater.zip(...)
+ *
+ * Sources are async or sync iterables; anything else counts as a source
+ * that returns its (awaited) value right away.
+ */
 static JSValue
 js_repeater_funcs(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
-  Repeater* rpt;
-  JSValue ret = JS_UNDEFINED;
+  FanIn* fi;
+  JSValue *items, ret;
+  size_t n;
 
-  if(!(rpt = JS_GetOpaque2(ctx, this_val, js_repeater_class_id)))
+  if(!JS_IsArray(ctx, argv[0]))
+    return JS_ThrowTypeError(ctx, "argument 1 must be an array of sources");
+
+  ret = js_repeater_new(ctx, repeater_proto, JS_UNDEFINED, argc > 1 ? argv[1] : JS_UNDEFINED);
+
+  if(JS_IsException(ret))
+    return ret;
+
+  if(!(items = js_values_fromarray(ctx, &n, argv[0]))) {
+    JS_FreeValue(ctx, ret);
     return JS_EXCEPTION;
+  }
 
-  switch(magic) {
-    case STATIC_RACE: break;
-    case STATIC_MERGE: break;
-    case STATIC_ZIP: break;
+  if(!(fi = js_mallocz(ctx, sizeof(FanIn)))) {
+    js_values_free(JS_GetRuntime(ctx), n, items);
+    JS_FreeValue(ctx, ret);
+    return JS_EXCEPTION;
   }
+
+  fi->ref_count = 1;
+  fi->magic = magic;
+  fi->ctx = ctx;
+  fi->out = JS_DupValue(ctx, ret);
+  fi->nsources = n;
+  fi->active = n;
+  fi->waiting = n;
+  fi->sources = js_mallocz(ctx, sizeof(FanInSource) * MAX_NUM(n, 1));
+  fi->values = js_mallocz(ctx, sizeof(JSValue) * MAX_NUM(n, 1));
+
+  for(size_t i = 0; i < n; i++) {
+    JSValue meth = JS_IsObject(items[i]) ? js_iterator_method(ctx, items[i]) : JS_UNDEFINED;
+
+    fi->values[i] = JS_UNDEFINED;
+
+    if(JS_IsFunction(ctx, meth)) {
+      fi->sources[i].iterator = JS_Call(ctx, meth, items[i], 0, 0);
+    } else {
+      fi->sources[i].iterator = JS_DupValue(ctx, items[i]);
+      fi->sources[i].single = TRUE;
+    }
+
+    JS_FreeValue(ctx, meth);
+  }
+
+  js_values_free(JS_GetRuntime(ctx), n, items);
+
+  if(n == 0)
+    fanin_finish(fi, -1, JS_UNDEFINED);
+
+  for(uint32_t i = 0; i < fi->nsources && !fi->finished; i++)
+    fanin_pull(fi, i);
+
+  fanin_free(fi);
   return ret;
 }
 
@@ -533,6 +996,7 @@ static JSClassDef js_repeater_class = {
 
 static const JSCFunctionListEntry js_repeater_proto_funcs[] = {
     JS_CFUNC_DEF("next", 0, js_repeater_next),
+    JS_CFUNC_DEF("nextBatch", 0, js_repeater_next_batch),
     JS_CGETSET_MAGIC_DEF("state", js_repeater_get, 0, PROP_STATE),
     JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Repeater", JS_PROP_CONFIGURABLE),
     JS_CFUNC_DEF("[Symbol.asyncIterator]", 0, js_repeater_iterator),
@@ -0,0 +1,851 @@
+#include "defines.h"
+#include "shared-ringbuffer.h"
+#include "mirror-ringbuffer.h"
+#include "utils.h"
+#include "buffer-utils.h"
+#ifndef _WIN32
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+/**
+ * \defgroup quickjs-ringbuffer quickjs-ringbuffer: Shared memory ring buffer
+ *
+ * SharedRingBuffer wraps a lock-free ring living in a SharedArrayBuffer
+ * (or any ArrayBuffer over shared memory, e.g. from mmap()), so workers
+ * and processes can exchange bytes and messages without serializing
+ * through postMessage(). One side creates the ring, the other sides
+ * construct a SharedRingBuffer over the same buffer.
+ * @{
+ */
+typedef struct {
+  SharedRing ring;
+  JSValue buffer;
+} SharedRingBuffer;
+
+VISIBLE JSClassID js_shared_ringbuffer_class_id = 0;
+VISIBLE JSValue shared_ringbuffer_proto = {{0}, JS_TAG_UNDEFINED}, shared_ringbuffer_ctor = {{0}, JS_TAG_UNDEFINED};
+
+enum {
+  RING_WRITE = 0,
+  RING_READ,
+  RING_SEND,
+  RING_RECEIVE,
+  RING_WAIT_READABLE,
+  RING_WAIT_WRITABLE,
+};
+
+enum {
+  PROP_BUFFER = 0,
+  PROP_CAPACITY,
+  PROP_LENGTH,
+  PROP_AVAILABLE,
+  PROP_MODE,
+};
+
+static inline SharedRingBuffer*
+js_shared_ringbuffer_data2(JSContext* ctx, JSValueConst value) {
+  return JS_GetOpaque2(ctx, value, js_shared_ringbuffer_class_id);
+}
+
+static void
+js_shared_ringbuffer_free_buffer(JSRuntime* rt, void* opaque, void* ptr) {
+  js_free_rt(rt, ptr);
+}
+
+/**
+ * new SharedRingBuffer(capacity[, mode]) creates a ring in a new
+ * SharedArrayBuffer; new SharedRingBuffer(buffer[, mode]) attaches to the
+ * ring in buffer, formatting it first when it holds none.
+ */
+static JSValue
+js_shared_ringbuffer_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  JSValue proto, obj = JS_UNDEFINED;
+  SharedRingBuffer* srb;
+  int32_t mode = SHARED_RING_SPSC;
+  uint8_t* ptr;
+  size_t len;
+
+  if(argc > 1 && JS_ToInt32(ctx, &mode, argv[1]))
+    return JS_EXCEPTION;
+
+  if(mode != SHARED_RING_SPSC && mode != SHARED_RING_MPSC)
+    return JS_ThrowRangeError(ctx, "mode must be SharedRingBuffer.SPSC or SharedRingBuffer.MPSC");
+
+  if(!(srb = js_mallocz(ctx, sizeof(SharedRingBuffer))))
+    return JS_EXCEPTION;
+
+  if(argc > 0 && JS_IsNumber(argv[0])) {
+    uint64_t capacity;
+    JSValue size;
+
+    if(JS_ToIndex(ctx, &capacity, argv[0]))
+      goto fail;
+
+    if(capacity < 4 || capacity > 0x80000000u) {
+      JS_ThrowRangeError(ctx, "capacity must be between 4 and 2^31");
+      goto fail;
+    }
+
+    size = JS_NewInt64(ctx, shared_ring_size(capacity));
+    srb->buffer = js_global_new(ctx, "SharedArrayBuffer", 1, &size);
+  } else {
+    srb->buffer = argc > 0 ? JS_DupValue(ctx, argv[0]) : JS_UNDEFINED;
+  }
+
+  if(JS_IsException(srb->buffer) || !(ptr = JS_GetArrayBuffer(ctx, &len, srb->buffer))) {
+    if(!JS_IsException(srb->buffer))
+      JS_ThrowTypeError(ctx, "argument 1 must be a capacity or a (Shared)ArrayBuffer");
+
+    goto fail;
+  }
+
+  if(!shared_ring_attach(&srb->ring, ptr, len) && !shared_ring_init(&srb->ring, ptr, len, mode)) {
+    JS_ThrowRangeError(ctx, "buffer too small or misaligned for a ring");
+    goto fail;
+  }
+
+  /* using new_target to get the prototype is necessary when the class is extended. */
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  if(JS_IsException(proto))
+    goto fail;
+
+  obj = JS_NewObjectProtoClass(ctx, proto, js_shared_ringbuffer_class_id);
+  JS_FreeValue(ctx, proto);
+
+  if(JS_IsException(obj))
+    goto fail;
+
+  JS_SetOpaque(obj, srb);
+
+  return obj;
+
+fail:
+  JS_FreeValue(ctx, srb->buffer);
+  js_free(ctx, srb);
+  return JS_EXCEPTION;
+}
+
+static JSValue
+js_shared_ringbuffer_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  SharedRingBuffer* srb;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(srb = js_shared_ringbuffer_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case RING_WRITE: {
+      InputBuffer input = js_input_args(ctx, argc, argv);
+
+      ret = JS_NewInt64(ctx, shared_ring_write(&srb->ring, input_buffer_data(&input), input_buffer_length(&input)));
+      input_buffer_free(&input, ctx);
+      break;
+    }
+
+    case RING_READ: {
+      InputBuffer output = js_output_args(ctx, argc, argv);
+
+      if(!output.data) {
+        input_buffer_free(&output, ctx);
+        return JS_ThrowTypeError(ctx, "argument 1 must be an ArrayBuffer or typed array");
+      }
+
+      ret = JS_NewInt64(ctx, shared_ring_read(&srb->ring, input_buffer_data(&output), input_buffer_length(&output)));
+      input_buffer_free(&output, ctx);
+      break;
+    }
+
+    case RING_SEND: {
+      InputBuffer input = js_input_args(ctx, argc, argv);
+
+      ret = JS_NewBool(ctx, shared_ring_send(&srb->ring, input_buffer_data(&input), input_buffer_length(&input)));
+      input_buffer_free(&input, ctx);
+      break;
+    }
+
+    case RING_RECEIVE: {
+      ssize_t n;
+      uint8_t* buf;
+
+      if((n = shared_ring_next(&srb->ring)) < 0) {
+        ret = JS_NULL;
+        break;
+      }
+
+      if(n == 0) {
+        shared_ring_receive(&srb->ring, NULL, 0);
+        ret = JS_NewArrayBufferCopy(ctx, 0, 0);
+        break;
+      }
+
+      if(!(buf = js_malloc(ctx, n)))
+        return JS_EXCEPTION;
+
+      shared_ring_receive(&srb->ring, buf, n);
+      ret = JS_NewArrayBuffer(ctx, buf, n, js_shared_ringbuffer_free_buffer, 0, FALSE);
+      break;
+    }
+
+    case RING_WAIT_READABLE:
+    case RING_WAIT_WRITABLE: {
+      int64_t timeout = -1;
+      uint64_t bytes = 1;
+      int i = 0;
+
+      if(magic == RING_WAIT_WRITABLE && argc > i && JS_ToIndex(ctx, &bytes, argv[i++]))
+        return JS_EXCEPTION;
+
+      if(argc > i && !js_is_null_or_undefined(argv[i]) && JS_ToInt64(ctx, &timeout, argv[i]))
+        return JS_EXCEPTION;
+
+      ret = JS_NewBool(ctx,
+                       magic == RING_WAIT_READABLE ? shared_ring_wait_readable(&srb->ring, timeout)
+                                                   : shared_ring_wait_writable(&srb->ring, bytes, timeout));
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static JSValue
+js_shared_ringbuffer_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  SharedRingBuffer* srb;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(srb = js_shared_ringbuffer_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case PROP_BUFFER: {
+      ret = JS_DupValue(ctx, srb->buffer);
+      break;
+    }
+
+    case PROP_CAPACITY: {
+      ret = JS_NewUint32(ctx, shared_ring_capacity(&srb->ring));
+      break;
+    }
+
+    case PROP_LENGTH: {
+      ret = JS_NewInt64(ctx, shared_ring_length(&srb->ring));
+      break;
+    }
+
+    case PROP_AVAILABLE: {
+      ret = JS_NewInt64(ctx, shared_ring_avail(&srb->ring));
+      break;
+    }
+
+    case PROP_MODE: {
+      ret = JS_NewInt32(ctx, srb->ring.hdr->mode);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static void
+js_shared_ringbuffer_finalizer(JSRuntime* rt, JSValue val) {
+  SharedRingBuffer* srb;
+
+  if((srb = JS_GetOpaque(val, js_shared_ringbuffer_class_id))) {
+    JS_FreeValueRT(rt, srb->buffer);
+    js_free_rt(rt, srb);
+  }
+}
+
+static JSClassDef js_shared_ringbuffer_class = {
+    .class_name = "SharedRingBuffer",
+    .finalizer = js_shared_ringbuffer_finalizer,
+};
+
+static const JSCFunctionListEntry js_shared_ringbuffer_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("write", 1, js_shared_ringbuffer_method, RING_WRITE),
+    JS_CFUNC_MAGIC_DEF("read", 1, js_shared_ringbuffer_method, RING_READ),
+    JS_CFUNC_MAGIC_DEF("send", 1, js_shared_ringbuffer_method, RING_SEND),
+    JS_CFUNC_MAGIC_DEF("receive", 0, js_shared_ringbuffer_method, RING_RECEIVE),
+    JS_CFUNC_MAGIC_DEF("waitReadable", 0, js_shared_ringbuffer_method, RING_WAIT_READABLE),
+    JS_CFUNC_MAGIC_DEF("waitWritable", 1, js_shared_ringbuffer_method, RING_WAIT_WRITABLE),
+    JS_CGETSET_MAGIC_DEF("buffer", js_shared_ringbuffer_get, 0, PROP_BUFFER),
+    JS_CGETSET_MAGIC_DEF("capacity", js_shared_ringbuffer_get, 0, PROP_CAPACITY),
+    JS_CGETSET_MAGIC_DEF("length", js_shared_ringbuffer_get, 0, PROP_LENGTH),
+    JS_CGETSET_MAGIC_DEF("available", js_shared_ringbuffer_get, 0, PROP_AVAILABLE),
+    JS_CGETSET_MAGIC_DEF("mode", js_shared_ringbuffer_get, 0, PROP_MODE),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "SharedRingBuffer", JS_PROP_CONFIGURABLE),
+};
+
+static const JSCFunctionListEntry js_shared_ringbuffer_static[] = {
+    JS_PROP_INT32_DEF("SPSC", SHARED_RING_SPSC, JS_PROP_ENUMERABLE),
+    JS_PROP_INT32_DEF("MPSC", SHARED_RING_MPSC, JS_PROP_ENUMERABLE),
+};
+
+/**
+ * MirrorRingBuffer is a process-local byte ring over a double mapping
+ * (see mirror-ringbuffer.h). fill(fd) and drain(fd) move bytes between
+ * the ring and an fd with one read() or write(), also across the wrap
+ * point. They return the byte count, or -errno.
+ */
+enum {
+  MIRROR_WRITE = 0,
+  MIRROR_READ,
+  MIRROR_FILL,
+  MIRROR_DRAIN,
+};
+
+VISIBLE JSClassID js_mirror_ringbuffer_class_id = 0;
+VISIBLE JSValue mirror_ringbuffer_proto = {{0}, JS_TAG_UNDEFINED}, mirror_ringbuffer_ctor = {{0}, JS_TAG_UNDEFINED};
+
+static inline MirrorRing*
+js_mirror_ringbuffer_data2(JSContext* ctx, JSValueConst value) {
+  return JS_GetOpaque2(ctx, value, js_mirror_ringbuffer_class_id);
+}
+
+/**
+ * new MirrorRingBuffer(size) maps a ring of at least size bytes, rounded
+ * up to the page size.
+ */
+static JSValue
+js_mirror_ringbuffer_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  JSValue proto, obj = JS_UNDEFINED;
+  MirrorRing* mr;
+  uint64_t size = 0;
+
+  if(argc > 0 && JS_ToIndex(ctx, &size, argv[0]))
+    return JS_EXCEPTION;
+
+  if(size < 1 || size > 0x80000000u)
+    return JS_ThrowRangeError(ctx, "size must be between 1 and 2^31");
+
+  if(!(mr = js_mallocz(ctx, sizeof(MirrorRing))))
+    return JS_EXCEPTION;
+
+  if(!mirror_ring_init(mr, size)) {
+    JS_ThrowInternalError(ctx, "MirrorRingBuffer: mapping %lu bytes failed: %s", (unsigned long)size, strerror(errno));
+    goto fail;
+  }
+
+  /* using new_target to get the prototype is necessary when the class is extended. */
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  if(JS_IsException(proto))
+    goto fail;
+
+  obj = JS_NewObjectProtoClass(ctx, proto, js_mirror_ringbuffer_class_id);
+  JS_FreeValue(ctx, proto);
+
+  if(JS_IsException(obj))
+    goto fail;
+
+  JS_SetOpaque(obj, mr);
+
+  return obj;
+
+fail:
+  mirror_ring_free(mr);
+  js_free(ctx, mr);
+  return JS_EXCEPTION;
+}
+
+static JSValue
+js_mirror_ringbuffer_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  MirrorRing* mr;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(mr = js_mirror_ringbuffer_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case MIRROR_WRITE: {
+      InputBuffer input = js_input_args(ctx, argc, argv);
+
+      ret = JS_NewInt64(ctx, mirror_ring_write(mr, input_buffer_data(&input), input_buffer_length(&input)));
+      input_buffer_free(&input, ctx);
+      break;
+    }
+
+    case MIRROR_READ: {
+      InputBuffer output = js_output_args(ctx, argc, argv);
+
+      if(!output.data) {
+        input_buffer_free(&output, ctx);
+        return JS_ThrowTypeError(ctx, "argument 1 must be an ArrayBuffer or typed array");
+      }
+
+      ret = JS_NewInt64(ctx, mirror_ring_read(mr, input_buffer_data(&output), input_buffer_length(&output)));
+      input_buffer_free(&output, ctx);
+      break;
+    }
+
+    case MIRROR_FILL:
+    case MIRROR_DRAIN: {
+      int32_t fd = -1;
+      ssize_t n;
+
+      if(JS_ToInt32(ctx, &fd, argv[0]))
+        return JS_EXCEPTION;
+
+      n = magic == MIRROR_FILL ? mirror_ring_fill(mr, fd) : mirror_ring_drain(mr, fd);
+      ret = JS_NewInt64(ctx, n < 0 ? -errno : n);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static JSValue
+js_mirror_ringbuffer_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  MirrorRing* mr;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(mr = js_mirror_ringbuffer_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case PROP_CAPACITY: {
+      ret = JS_NewInt64(ctx, mr->size);
+      break;
+    }
+
+    case PROP_LENGTH: {
+      ret = JS_NewInt64(ctx, mirror_ring_length(mr));
+      break;
+    }
+
+    case PROP_AVAILABLE: {
+      ret = JS_NewInt64(ctx, mirror_ring_avail(mr));
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static void
+js_mirror_ringbuffer_finalizer(JSRuntime* rt, JSValue val) {
+  MirrorRing* mr;
+
+  if((mr = JS_GetOpaque(val, js_mirror_ringbuffer_class_id))) {
+    mirror_ring_free(mr);
+    js_free_rt(rt, mr);
+  }
+}
+
+static JSClassDef js_mirror_ringbuffer_class = {
+    .class_name = "MirrorRingBuffer",
+    .finalizer = js_mirror_ringbuffer_finalizer,
+};
+
+static const JSCFunctionListEntry js_mirror_ringbuffer_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("write", 1, js_mirror_ringbuffer_method, MIRROR_WRITE),
+    JS_CFUNC_MAGIC_DEF("read", 1, js_mirror_ringbuffer_method, MIRROR_READ),
+    JS_CFUNC_MAGIC_DEF("fill", 1, js_mirror_ringbuffer_method, MIRROR_FILL),
+    JS_CFUNC_MAGIC_DEF("drain", 1, js_mirror_ringbuffer_method, MIRROR_DRAIN),
+    JS_CGETSET_MAGIC_DEF("capacity", js_mirror_ringbuffer_get, 0, PROP_CAPACITY),
+    JS_CGETSET_MAGIC_DEF("length", js_mirror_ringbuffer_get, 0, PROP_LENGTH),
+    JS_CGETSET_MAGIC_DEF("available", js_mirror_ringbuffer_get, 0, PROP_AVAILABLE),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "MirrorRingBuffer", JS_PROP_CONFIGURABLE),
+};
+
+#ifndef _WIN32
+/**
+ * RingWriter decouples a file descriptor from its producer: write()
+ * appends to a ring and a background thread drains the ring with
+ * writev(). When the ring is full, BLOCK waits for room and DROP
+ * discards the record and counts it.
+ */
+enum {
+  WRITER_BLOCK = 0,
+  WRITER_DROP,
+};
+
+enum {
+  WRITER_WRITE = 0,
+  WRITER_FLUSH,
+  WRITER_CLOSE,
+};
+
+enum {
+  WRITER_FD = 0,
+  WRITER_CAPACITY,
+  WRITER_LENGTH,
+  WRITER_DROPPED,
+  WRITER_ERRNO,
+  WRITER_POLICY,
+};
+
+#define RING_WRITER_CAPACITY (1 << 20)
+
+typedef struct {
+  SharedRing ring;
+  void* mem;
+  int fd, policy, error;
+  uint64_t dropped;
+  BOOL running, closing;
+  pthread_t thread;
+} RingWriter;
+
+VISIBLE JSClassID js_ring_writer_class_id = 0;
+VISIBLE JSValue ring_writer_proto = {{0}, JS_TAG_UNDEFINED}, ring_writer_ctor = {{0}, JS_TAG_UNDEFINED};
+
+static void
+ring_writer_drain(RingWriter* rw) {
+  SharedRingSpan span[2];
+  struct iovec iov[2];
+  size_t len;
+  ssize_t r;
+
+  while((len = shared_ring_peek(&rw->ring, span))) {
+    /* after a failed write the records are discarded, the producer must not block */
+    if(__atomic_load_n(&rw->error, __ATOMIC_RELAXED)) {
+      shared_ring_skip(&rw->ring, len);
+      continue;
+    }
+
+    iov[0] = (struct iovec){(void*)span[0].ptr, span[0].len};
+    iov[1] = (struct iovec){(void*)span[1].ptr, span[1].len};
+
+    if((r = writev(rw->fd, iov, span[1].len ? 2 : 1)) == -1) {
+      if(errno == EAGAIN || errno == EWOULDBLOCK) {
+        struct pollfd pfd = {rw->fd, POLLOUT, 0};
+
+        poll(&pfd, 1, -1);
+      } else if(errno != EINTR) {
+        __atomic_store_n(&rw->error, errno, __ATOMIC_RELAXED);
+      }
+
+      continue;
+    }
+
+    shared_ring_skip(&rw->ring, r);
+  }
+}
+
+static void*
+ring_writer_thread(void* arg) {
+  RingWriter* rw = arg;
+
+  for(;;) {
+    if(shared_ring_wait_readable(&rw->ring, 100))
+      ring_writer_drain(rw);
+    else if(__atomic_load_n(&rw->closing, __ATOMIC_ACQUIRE))
+      break;
+  }
+
+  return 0;
+}
+
+/* waits until the thread wrote everything, then stops it */
+static void
+ring_writer_stop(RingWriter* rw) {
+  if(rw->running) {
+    shared_ring_wait_writable(&rw->ring, shared_ring_capacity(&rw->ring), -1);
+    __atomic_store_n(&rw->closing, TRUE, __ATOMIC_RELEASE);
+    pthread_join(rw->thread, 0);
+    rw->running = FALSE;
+  }
+}
+
+static BOOL
+ring_writer_write(RingWriter* rw, const uint8_t* x, size_t len) {
+  size_t capacity = shared_ring_capacity(&rw->ring);
+
+  if(rw->policy == WRITER_DROP) {
+    if(shared_ring_avail(&rw->ring) < len) {
+      ++rw->dropped;
+      return FALSE;
+    }
+
+    shared_ring_write(&rw->ring, x, len);
+    return TRUE;
+  }
+
+  /* records larger than the ring go through in pieces */
+  while(len > 0) {
+    size_t n;
+
+    shared_ring_wait_writable(&rw->ring, MIN_NUM(len, capacity), -1);
+    n = shared_ring_write(&rw->ring, x, len);
+    x += n;
+    len -= n;
+  }
+
+  return TRUE;
+}
+
+static inline RingWriter*
+js_ring_writer_data2(JSContext* ctx, JSValueConst value) {
+  return JS_GetOpaque2(ctx, value, js_ring_writer_class_id);
+}
+
+/**
+ * new RingWriter(fd[, { capacity = 1M, policy = RingWriter.BLOCK }])
+ */
+static JSValue
+js_ring_writer_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  JSValue proto, obj = JS_UNDEFINED;
+  RingWriter* rw;
+  uint64_t capacity = RING_WRITER_CAPACITY;
+  size_t size;
+
+  if(!(rw = js_mallocz(ctx, sizeof(RingWriter))))
+    return JS_EXCEPTION;
+
+  if(JS_ToInt32(ctx, &rw->fd, argc > 0 ? argv[0] : JS_UNDEFINED) || rw->fd < 0) {
+    JS_ThrowTypeError(ctx, "argument 1 must be a file descriptor");
+    goto fail;
+  }
+
+  if(argc > 1 && JS_IsObject(argv[1])) {
+    if(js_has_propertystr(ctx, argv[1], "capacity"))
+      capacity = js_get_propertystr_uint64(ctx, argv[1], "capacity");
+
+    if(js_has_propertystr(ctx, argv[1], "policy"))
+      rw->policy = js_get_propertystr_int32(ctx, argv[1], "policy");
+  }
+
+  if(capacity < 4 || capacity > 0x80000000u) {
+    JS_ThrowRangeError(ctx, "capacity must be between 4 and 2^31");
+    goto fail;
+  }
+
+  if(rw->policy != WRITER_BLOCK && rw->policy != WRITER_DROP) {
+    JS_ThrowRangeError(ctx, "policy must be RingWriter.BLOCK or RingWriter.DROP");
+    goto fail;
+  }
+
+  size = shared_ring_size(capacity);
+
+  if(!(rw->mem = js_malloc(ctx, size)))
+    goto fail;
+
+  shared_ring_init(&rw->ring, rw->mem, size, SHARED_RING_SPSC);
+
+  if(pthread_create(&rw->thread, 0, ring_writer_thread, rw)) {
+    JS_ThrowInternalError(ctx, "pthread_create() failed: %s", strerror(errno));
+    goto fail;
+  }
+
+  rw->running = TRUE;
+
+  /* using new_target to get the prototype is necessary when the class is extended. */
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  if(JS_IsException(proto))
+    goto fail;
+
+  obj = JS_NewObjectProtoClass(ctx, proto, js_ring_writer_class_id);
+  JS_FreeValue(ctx, proto);
+
+  if(JS_IsException(obj))
+    goto fail;
+
+  JS_SetOpaque(obj, rw);
+  return obj;
+
+fail:
+  ring_writer_stop(rw);
+  js_free(ctx, rw->mem);
+  js_free(ctx, rw);
+  return JS_EXCEPTION;
+}
+
+static JSValue
+js_ring_writer_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  RingWriter* rw;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(rw = js_ring_writer_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(!rw->running && magic != WRITER_CLOSE)
+    return JS_ThrowInternalError(ctx, "RingWriter is closed");
+
+  switch(magic) {
+    case WRITER_WRITE: {
+      InputBuffer input = js_input_args(ctx, argc, argv);
+
+      ret = JS_NewBool(ctx, ring_writer_write(rw, input_buffer_data(&input), input_buffer_length(&input)));
+      input_buffer_free(&input, ctx);
+      break;
+    }
+
+    case WRITER_FLUSH: {
+      int64_t timeout = -1;
+
+      if(argc > 0 && !js_is_null_or_undefined(argv[0]) && JS_ToInt64(ctx, &timeout, argv[0]))
+        return JS_EXCEPTION;
+
+      ret = JS_NewBool(ctx, shared_ring_wait_writable(&rw->ring, shared_ring_capacity(&rw->ring), timeout));
+      break;
+    }
+
+    case WRITER_CLOSE: {
+      ring_writer_stop(rw);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static JSValue
+js_ring_writer_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  RingWriter* rw;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(rw = js_ring_writer_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case WRITER_FD: {
+      ret = JS_NewInt32(ctx, rw->fd);
+      break;
+    }
+
+    case WRITER_CAPACITY: {
+      ret = JS_NewUint32(ctx, shared_ring_capacity(&rw->ring));
+      break;
+    }
+
+    case WRITER_LENGTH: {
+      ret = JS_NewInt64(ctx, shared_ring_length(&rw->ring));
+      break;
+    }
+
+    case WRITER_DROPPED: {
+      ret = JS_NewInt64(ctx, rw->dropped);
+      break;
+    }
+
+    case WRITER_ERRNO: {
+      ret = JS_NewInt32(ctx, __atomic_load_n(&rw->error, __ATOMIC_RELAXED));
+      break;
+    }
+
+    case WRITER_POLICY: {
+      ret = JS_NewInt32(ctx, rw->policy);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static void
+js_ring_writer_finalizer(JSRuntime* rt, JSValue val) {
+  RingWriter* rw;
+
+  if((rw = JS_GetOpaque(val, js_ring_writer_class_id))) {
+    ring_writer_stop(rw);
+    js_free_rt(rt, rw->mem);
+    js_free_rt(rt, rw);
+  }
+}
+
+static JSClassDef js_ring_writer_class = {
+    .class_name = "RingWriter",
+    .finalizer = js_ring_writer_finalizer,
+};
+
+static const JSCFunctionListEntry js_ring_writer_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("write", 1, js_ring_writer_method, WRITER_WRITE),
+    JS_CFUNC_MAGIC_DEF("flush", 0, js_ring_writer_method, WRITER_FLUSH),
+    JS_CFUNC_MAGIC_DEF("close", 0, js_ring_writer_method, WRITER_CLOSE),
+    JS_CGETSET_MAGIC_DEF("fd", js_ring_writer_get, 0, WRITER_FD),
+    JS_CGETSET_MAGIC_DEF("capacity", js_ring_writer_get, 0, WRITER_CAPACITY),
+    JS_CGETSET_MAGIC_DEF("length", js_ring_writer_get, 0, WRITER_LENGTH),
+    JS_CGETSET_MAGIC_DEF("dropped", js_ring_writer_get, 0, WRITER_DROPPED),
+    JS_CGETSET_MAGIC_DEF("errno", js_ring_writer_get, 0, WRITER_ERRNO),
+    JS_CGETSET_MAGIC_DEF("policy", js_ring_writer_get, 0, WRITER_POLICY),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "RingWriter", JS_PROP_CONFIGURABLE),
+};
+
+static const JSCFunctionListEntry js_ring_writer_static[] = {
+    JS_PROP_INT32_DEF("BLOCK", WRITER_BLOCK, JS_PROP_ENUMERABLE),
+    JS_PROP_INT32_DEF("DROP", WRITER_DROP, JS_PROP_ENUMERABLE),
+};
+#endif
+
+int
+js_ringbuffer_init(JSContext* ctx, JSModuleDef* m) {
+
+  if(js_shared_ringbuffer_class_id == 0) {
+    JS_NewClassID(&js_shared_ringbuffer_class_id);
+    JS_NewClass(JS_GetRuntime(ctx), js_shared_ringbuffer_class_id, &js_shared_ringbuffer_class);
+
+    shared_ringbuffer_ctor = JS_NewCFunction2(ctx, js_shared_ringbuffer_constructor, "SharedRingBuffer", 1, JS_CFUNC_constructor, 0);
+    shared_ringbuffer_proto = JS_NewObject(ctx);
+
+    JS_SetPropertyFunctionList(ctx, shared_ringbuffer_proto, js_shared_ringbuffer_funcs, countof(js_shared_ringbuffer_funcs));
+    JS_SetPropertyFunctionList(ctx, shared_ringbuffer_ctor, js_shared_ringbuffer_static, countof(js_shared_ringbuffer_static));
+
+    JS_SetClassProto(ctx, js_shared_ringbuffer_class_id, shared_ringbuffer_proto);
+    JS_SetConstructor(ctx, shared_ringbuffer_ctor, shared_ringbuffer_proto);
+
+    JS_NewClassID(&js_mirror_ringbuffer_class_id);
+    JS_NewClass(JS_GetRuntime(ctx), js_mirror_ringbuffer_class_id, &js_mirror_ringbuffer_class);
+
+    mirror_ringbuffer_ctor = JS_NewCFunction2(ctx, js_mirror_ringbuffer_constructor, "MirrorRingBuffer", 1, JS_CFUNC_constructor, 0);
+    mirror_ringbuffer_proto = JS_NewObject(ctx);
+
+    JS_SetPropertyFunctionList(ctx, mirror_ringbuffer_proto, js_mirror_ringbuffer_funcs, countof(js_mirror_ringbuffer_funcs));
+
+    JS_SetClassProto(ctx, js_mirror_ringbuffer_class_id, mirror_ringbuffer_proto);
+    JS_SetConstructor(ctx, mirror_ringbuffer_ctor, mirror_ringbuffer_proto);
+
+#ifndef _WIN32
+    JS_NewClassID(&js_ring_writer_class_id);
+    JS_NewClass(JS_GetRuntime(ctx), js_ring_writer_class_id, &js_ring_writer_class);
+
+    ring_writer_ctor = JS_NewCFunction2(ctx, js_ring_writer_constructor, "RingWriter", 1, JS_CFUNC_constructor, 0);
+    ring_writer_proto = JS_NewObject(ctx);
+
+    JS_SetPropertyFunctionList(ctx, ring_writer_proto, js_ring_writer_funcs, countof(js_ring_writer_funcs));
+    JS_SetPropertyFunctionList(ctx, ring_writer_ctor, js_ring_writer_static, countof(js_ring_writer_static));
+
+    JS_SetClassProto(ctx, js_ring_writer_class_id, ring_writer_proto);
+    JS_SetConstructor(ctx, ring_writer_ctor, ring_writer_proto);
+#endif
+  }
+
+  if(m) {
+    JS_SetModuleExport(ctx, m, "SharedRingBuffer", shared_ringbuffer_ctor);
+    JS_SetModuleExport(ctx, m, "MirrorRingBuffer", mirror_ringbuffer_ctor);
+#ifndef _WIN32
+    JS_SetModuleExport(ctx, m, "RingWriter", ring_writer_ctor);
+#endif
+  }
+
+  return 0;
+}
+
+#ifdef JS_RINGBUFFER_MODULE
+#define JS_INIT_MODULE js_init_module
+#else
+#define JS_INIT_MODULE js_init_module_ringbuffer
+#endif
+
+VISIBLE JSModuleDef*
+JS_INIT_MODULE(JSContext* ctx, const char* module_name) {
+  JSModuleDef* m;
+
+  if((m = JS_NewCModule(ctx, module_name, js_ringbuffer_init))) {
+    JS_AddModuleExport(ctx, m, "SharedRingBuffer");
+    JS_AddModuleExport(ctx, m, "MirrorRingBuffer");
+#ifndef _WIN32
+    JS_AddModuleExport(ctx, m, "RingWriter");
+#endif
+  }
+
+  return m;
+}
+
+/**
+ * @}
+ */
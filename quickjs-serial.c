@@ -1,8 +1,13 @@
 #include "defines.h"
 #include "buffer-utils.h"
 #include "utils.h"
+#include "js-utils.h"
+#include "ringbuffer.h"
 #include <errno.h>
 #include <string.h>
+#ifndef _WIN32
+#include <termios.h>
+#endif
 #include "libserialport/libserialport.h"
 
 /**
@@ -497,6 +502,616 @@ js_serialport_finalizer(JSRuntime* rt, JSValue val) {
   // JS_FreeValueRT(rt, val);
 }
 
+/**
+ * SerialReader: event-driven reads into a RingBuffer, delivered as frames
+ */
+typedef enum {
+  FRAME_CHUNK = 0, /**< whatever one wakeup brought in */
+  FRAME_DELIMITER,
+  FRAME_LENGTH,
+  FRAME_GAP, /**< bytes received until the line is idle for timeout ms */
+} SerialFraming;
+
+typedef struct {
+  JSContext* ctx;
+  JSValue port_obj, callback, handler, timer, frames;
+  struct sp_port* port;
+  int fd;
+  RingBuffer buf;
+  SerialFraming framing;
+  uint8_t delimiter[16];
+  uint32_t delimiter_len, prefix, scanned, max_length;
+  BOOL little_endian, active, pending;
+  int32_t timeout;
+  int64_t last_read;
+  ResolveFunctions next;
+} SerialReader;
+
+#define SERIALREADER_MAX_LENGTH (1 << 20)
+
+VISIBLE JSClassID js_serialreader_class_id = 0;
+VISIBLE JSValue serialreader_proto = {{0}, JS_TAG_UNDEFINED};
+
+enum {
+  SERIALREADER_NEXT = 0,
+  SERIALREADER_RETURN,
+  SERIALREADER_READINTO,
+  SERIALREADER_ITERATOR,
+};
+
+enum {
+  SERIALREADER_ACTIVE = 0,
+  SERIALREADER_BUFFERED,
+};
+
+static inline SerialReader*
+js_serialreader_data2(JSContext* ctx, JSValueConst value) {
+  return JS_GetOpaque2(ctx, value, js_serialreader_class_id);
+}
+
+static JSValue
+serialreader_result(JSContext* ctx, JSValue value, BOOL done) {
+  JSValue ret = JS_NewObject(ctx);
+
+  JS_SetPropertyStr(ctx, ret, "value", value);
+  JS_SetPropertyStr(ctx, ret, "done", JS_NewBool(ctx, done));
+  return ret;
+}
+
+static JSValue
+serialreader_resolved(JSContext* ctx, JSValue value, BOOL done) {
+  JSValue result = serialreader_result(ctx, value, done), ret;
+
+  ret = js_promise_resolve(ctx, result);
+  JS_FreeValue(ctx, result);
+  return ret;
+}
+
+static void
+serialreader_timer_clear(SerialReader* sr) {
+  JSContext* ctx = sr->ctx;
+
+  if(!JS_IsUndefined(sr->timer)) {
+    JSValue fn = js_os_function(ctx, "clearTimeout");
+
+    JS_FreeValue(ctx, JS_Call(ctx, fn, JS_UNDEFINED, 1, &sr->timer));
+    JS_FreeValue(ctx, fn);
+    JS_FreeValue(ctx, sr->timer);
+    sr->timer = JS_UNDEFINED;
+  }
+}
+
+/**
+ * Hands a frame to the callback, a waiting next() or the frame queue
+ */
+static void
+serialreader_emit(SerialReader* sr, JSValue frame) {
+  JSContext* ctx = sr->ctx;
+
+  if(JS_IsFunction(ctx, sr->callback)) {
+    JSValue ret = JS_Call(ctx, sr->callback, JS_UNDEFINED, 1, &frame);
+
+    if(JS_IsException(ret))
+      js_error_print(ctx, JS_GetException(ctx));
+
+    JS_FreeValue(ctx, ret);
+    JS_FreeValue(ctx, frame);
+  } else if(sr->pending) {
+    JSValue result = serialreader_result(ctx, frame, FALSE);
+
+    sr->pending = FALSE;
+    promise_resolve(ctx, &sr->next, result);
+    JS_FreeValue(ctx, result);
+  } else {
+    JS_SetPropertyUint32(ctx, sr->frames, js_array_length(ctx, sr->frames), frame);
+  }
+}
+
+/**
+ * Emits \p len bytes at the head of the buffer and consumes \p skip more
+ */
+static void
+serialreader_take(SerialReader* sr, size_t len, size_t skip) {
+  JSValue frame = JS_NewArrayBufferCopy(sr->ctx, ringbuffer_begin(&sr->buf), len);
+
+  ringbuffer_skip(&sr->buf, len + skip);
+  sr->scanned = 0;
+
+  if(ringbuffer_empty(&sr->buf))
+    ringbuffer_reset(&sr->buf);
+
+  serialreader_emit(sr, frame);
+}
+
+/**
+ * Cuts every complete frame off the buffer. The data always lies
+ * contiguous in [tail,head), reads never wrap it.
+ */
+static void
+serialreader_scan(SerialReader* sr) {
+  for(;;) {
+    size_t len = ringbuffer_length(&sr->buf);
+    uint8_t* data = ringbuffer_begin(&sr->buf);
+
+    if(len == 0)
+      break;
+
+    if(sr->framing == FRAME_DELIMITER) {
+      size_t from = sr->scanned > sr->delimiter_len ? sr->scanned - sr->delimiter_len + 1 : 0;
+      uint8_t* p = memmem(data + from, len - from, sr->delimiter, sr->delimiter_len);
+
+      if(p) {
+        serialreader_take(sr, p - data, sr->delimiter_len);
+        continue;
+      }
+
+      sr->scanned = len;
+    } else if(sr->framing == FRAME_LENGTH) {
+      uint32_t n = 0;
+
+      if(len < sr->prefix)
+        break;
+
+      for(uint32_t i = 0; i < sr->prefix; i++)
+        n |= (uint32_t)data[sr->little_endian ? i : sr->prefix - 1 - i] << (i * 8);
+
+      if(len - sr->prefix >= n) {
+        ringbuffer_skip(&sr->buf, sr->prefix);
+        serialreader_take(sr, n, 0);
+        continue;
+      }
+
+      if(n + sr->prefix <= sr->max_length)
+        break;
+
+      /* a length beyond maxLength is taken as line noise */
+      ringbuffer_skip(&sr->buf, 1);
+      continue;
+    } else if(sr->framing == FRAME_CHUNK) {
+      serialreader_take(sr, len, 0);
+      continue;
+    }
+
+    if(len >= sr->max_length)
+      serialreader_take(sr, sr->max_length, 0);
+    else
+      break;
+  }
+}
+
+static JSValue js_serialreader_idle(JSContext*, JSValueConst, int, JSValueConst[], int, JSValue[]);
+
+/**
+ * Keeps one os timer running while bytes are buffered; it flushes them
+ * once the line has been idle for the timeout
+ */
+static void
+serialreader_timer_arm(SerialReader* sr, JSValueConst this_obj) {
+  JSContext* ctx = sr->ctx;
+  JSValue fn, args[2];
+  int64_t delay;
+
+  if(sr->timeout <= 0 || !JS_IsUndefined(sr->timer) || ringbuffer_empty(&sr->buf))
+    return;
+
+  delay = sr->last_read + sr->timeout - js_time_ms();
+
+  fn = js_os_function(ctx, "setTimeout");
+  args[0] = JS_NewCFunctionData(ctx, js_serialreader_idle, 0, 0, 1, (JSValue*)&this_obj);
+  args[1] = JS_NewInt64(ctx, MAX_NUM(delay, 0));
+
+  sr->timer = JS_Call(ctx, fn, JS_UNDEFINED, countof(args), args);
+
+  if(JS_IsException(sr->timer)) {
+    JS_FreeValue(ctx, JS_GetException(ctx));
+    sr->timer = JS_UNDEFINED;
+  }
+
+  JS_FreeValue(ctx, args[0]);
+  JS_FreeValue(ctx, fn);
+}
+
+static JSValue
+js_serialreader_idle(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, JSValue data[]) {
+  SerialReader* sr;
+
+  if(!(sr = js_serialreader_data2(ctx, data[0])))
+    return JS_EXCEPTION;
+
+  JS_FreeValue(ctx, sr->timer);
+  sr->timer = JS_UNDEFINED;
+
+  if(js_time_ms() - sr->last_read >= sr->timeout) {
+    if(!ringbuffer_empty(&sr->buf))
+      serialreader_take(sr, ringbuffer_length(&sr->buf), 0);
+  } else {
+    serialreader_timer_arm(sr, data[0]);
+  }
+
+  return JS_UNDEFINED;
+}
+
+static void
+serialreader_watch(SerialReader* sr, BOOL on) {
+  JSContext* ctx = sr->ctx;
+  JSValue set_handler = js_iohandler_fn(ctx, FALSE);
+
+  if(!JS_IsException(set_handler))
+    js_iohandler_set(ctx, set_handler, sr->fd, on ? JS_DupValue(ctx, sr->handler) : JS_NULL);
+
+  JS_FreeValue(ctx, set_handler);
+}
+
+static void
+serialreader_stop(SerialReader* sr, JSValueConst error) {
+  JSContext* ctx = sr->ctx;
+
+  if(!sr->active)
+    return;
+
+  sr->active = FALSE;
+  serialreader_watch(sr, FALSE);
+  serialreader_timer_clear(sr);
+
+  /* a partial frame is still delivered */
+  if(JS_IsUndefined(error) && !ringbuffer_empty(&sr->buf))
+    serialreader_take(sr, ringbuffer_length(&sr->buf), 0);
+
+  if(JS_IsFunction(ctx, sr->callback) && !JS_IsUndefined(error)) {
+    JSValue args[2] = {JS_UNDEFINED, error};
+
+    JS_FreeValue(ctx, JS_Call(ctx, sr->callback, JS_UNDEFINED, countof(args), (JSValueConst*)args));
+  }
+
+  if(sr->pending) {
+    sr->pending = FALSE;
+
+    if(JS_IsUndefined(error)) {
+      JSValue result = serialreader_result(ctx, JS_UNDEFINED, TRUE);
+
+      promise_resolve(ctx, &sr->next, result);
+      JS_FreeValue(ctx, result);
+    } else {
+      promise_reject(ctx, &sr->next, error);
+    }
+  }
+}
+
+/**
+ * Read handler: drains everything the driver has queued with as few
+ * reads as possible, then cuts the frames
+ */
+static JSValue
+js_serialreader_ready(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, JSValue data[]) {
+  SerialReader* sr;
+  int ret;
+
+  if(!(sr = js_serialreader_data2(ctx, data[0])))
+    return JS_EXCEPTION;
+
+  for(;;) {
+    int waiting = sp_input_waiting(sr->port);
+    size_t want = MAX_NUM(waiting, 4096), room;
+
+    /* move the data to the start instead of letting it wrap */
+    if(sr->buf.tail > 0 && ringbuffer_headroom(&sr->buf) <= want) {
+      size_t len = ringbuffer_length(&sr->buf);
+
+      memmove(sr->buf.data, ringbuffer_begin(&sr->buf), len);
+      sr->buf.tail = 0;
+      sr->buf.head = len;
+    }
+
+    if(!ringbuffer_reserve(&sr->buf, want + 1)) {
+      JSValue error;
+
+      JS_ThrowOutOfMemory(ctx);
+      serialreader_stop(sr, error = JS_GetException(ctx));
+      JS_FreeValue(ctx, error);
+      break;
+    }
+
+    room = ringbuffer_headroom(&sr->buf) - 1;
+
+    if((ret = sp_nonblocking_read(sr->port, ringbuffer_end(&sr->buf), room)) < 0) {
+      JSValue error;
+
+      JS_ThrowInternalError(ctx, "could read serial port '%s': %s", sp_get_port_name(sr->port), sp_last_error_message());
+      serialreader_stop(sr, error = JS_GetException(ctx));
+      JS_FreeValue(ctx, error);
+      break;
+    }
+
+    sr->buf.head += ret;
+
+    if((size_t)ret < room)
+      break;
+  }
+
+  if(sr->active) {
+    sr->last_read = js_time_ms();
+    serialreader_scan(sr);
+
+    if(sr->active)
+      serialreader_timer_arm(sr, data[0]);
+  }
+
+  return JS_UNDEFINED;
+}
+
+/**
+ * port.frames(options, callback?): delivers the received bytes split into
+ * frames, to callback or through the async iterator of the SerialReader.
+ *
+ * options: delimiter (string or buffer), length (size of a length prefix:
+ * 1, 2 or 4), littleEndian, timeout (ms of idle line ending or flushing a
+ * frame), maxLength and vmin (bytes the tty driver queues before waking
+ * the event loop).
+ *
+ * A read error ends the reader: callback is called with (undefined, error)
+ * and a pending next() is rejected.
+ */
+static JSValue
+js_serialport_frames(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  struct sp_port* port;
+  SerialReader* sr;
+  JSValue obj, value;
+  JSValueConst options = argc > 0 && JS_IsObject(argv[0]) ? argv[0] : JS_UNDEFINED;
+  int64_t fd = -1;
+  int32_t vmin = -1;
+
+  if(!(port = js_serialport_data(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(sp_get_port_handle(port, &fd) != SP_OK)
+    return JS_ThrowInternalError(ctx, "could not get serial port file descriptor: %s", sp_last_error_message());
+
+  if(!(sr = js_mallocz(ctx, sizeof(SerialReader))))
+    return JS_EXCEPTION;
+
+  sr->ctx = ctx;
+  sr->port = port;
+  sr->fd = fd;
+  sr->buf = RINGBUFFER(ctx);
+  sr->timer = JS_UNDEFINED;
+  sr->max_length = SERIALREADER_MAX_LENGTH;
+  sr->callback = argc > 1 && JS_IsFunction(ctx, argv[1]) ? JS_DupValue(ctx, argv[1]) : JS_UNDEFINED;
+
+  if(JS_IsObject(options)) {
+    if(!JS_IsUndefined((value = JS_GetPropertyStr(ctx, options, "delimiter")))) {
+      InputBuffer input = js_input_chars(ctx, value);
+      size_t len = input_buffer_length(&input);
+
+      if(len == 0 || len > sizeof(sr->delimiter)) {
+        input_buffer_free(&input, ctx);
+        JS_FreeValue(ctx, value);
+        goto range;
+      }
+
+      memcpy(sr->delimiter, input_buffer_data(&input), len);
+      sr->delimiter_len = len;
+      sr->framing = FRAME_DELIMITER;
+      input_buffer_free(&input, ctx);
+    }
+
+    JS_FreeValue(ctx, value);
+
+    if(!JS_IsUndefined((value = JS_GetPropertyStr(ctx, options, "length")))) {
+      if(JS_ToUint32(ctx, &sr->prefix, value) || (sr->prefix != 1 && sr->prefix != 2 && sr->prefix != 4) || sr->framing) {
+        JS_FreeValue(ctx, value);
+        goto range;
+      }
+
+      sr->framing = FRAME_LENGTH;
+    }
+
+    JS_FreeValue(ctx, value);
+
+    sr->little_endian = js_get_propertystr_bool(ctx, options, "littleEndian");
+
+    value = JS_GetPropertyStr(ctx, options, "timeout");
+    JS_ToInt32(ctx, &sr->timeout, value);
+    JS_FreeValue(ctx, value);
+
+    if(!JS_IsUndefined((value = JS_GetPropertyStr(ctx, options, "maxLength"))))
+      if(JS_ToUint32(ctx, &sr->max_length, value) || sr->max_length == 0) {
+        JS_FreeValue(ctx, value);
+        goto range;
+      }
+
+    JS_FreeValue(ctx, value);
+
+    if(!JS_IsUndefined((value = JS_GetPropertyStr(ctx, options, "vmin"))))
+      JS_ToInt32(ctx, &vmin, value);
+
+    JS_FreeValue(ctx, value);
+  }
+
+  if(sr->framing == FRAME_CHUNK && sr->timeout > 0)
+    sr->framing = FRAME_GAP;
+
+#ifndef _WIN32
+  /* With VTIME 0 the tty driver only reports the fd readable once VMIN
+     bytes are queued, so fast links wake the loop once per batch */
+  if(vmin >= 0) {
+    struct termios tio;
+
+    if(tcgetattr(fd, &tio) == 0) {
+      tio.c_cc[VMIN] = MIN_NUM(vmin, 255);
+      tio.c_cc[VTIME] = 0;
+      tcsetattr(fd, TCSANOW, &tio);
+    }
+  }
+#endif
+
+  obj = JS_NewObjectProtoClass(ctx, serialreader_proto, js_serialreader_class_id);
+
+  if(JS_IsException(obj)) {
+    JS_FreeValue(ctx, sr->callback);
+    js_free(ctx, sr);
+    return JS_EXCEPTION;
+  }
+
+  sr->port_obj = JS_DupValue(ctx, this_val);
+  sr->frames = JS_NewArray(ctx);
+  sr->handler = JS_NewCFunctionData(ctx, js_serialreader_ready, 0, 0, 1, &obj);
+  sr->active = TRUE;
+  JS_SetOpaque(obj, sr);
+
+  serialreader_watch(sr, TRUE);
+  return obj;
+
+range:
+  JS_FreeValue(ctx, sr->callback);
+  js_free(ctx, sr);
+  return JS_ThrowRangeError(ctx, "invalid framing options");
+}
+
+static JSValue
+js_serialreader_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  SerialReader* sr;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(sr = js_serialreader_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case SERIALREADER_NEXT: {
+      if(js_array_length(ctx, sr->frames) > 0) {
+        ret = serialreader_resolved(ctx, js_invoke(ctx, sr->frames, "shift", 0, 0), FALSE);
+      } else if(!sr->active) {
+        ret = serialreader_resolved(ctx, JS_UNDEFINED, TRUE);
+      } else if(sr->pending) {
+        ret = JS_ThrowInternalError(ctx, "SerialReader.next() is already pending");
+      } else {
+        ret = promise_create(ctx, &sr->next);
+        sr->pending = TRUE;
+      }
+
+      break;
+    }
+
+    case SERIALREADER_RETURN: {
+      serialreader_stop(sr, JS_UNDEFINED);
+      ret = serialreader_resolved(ctx, JS_UNDEFINED, TRUE);
+      break;
+    }
+
+    /* readInto(buffer, offset?, length?): copies buffered bytes, then
+       reads the rest straight from the port into the caller's memory */
+    case SERIALREADER_READINTO: {
+      InputBuffer output = js_output_args(ctx, argc, argv);
+      uint8_t* dst = input_buffer_data(&output);
+      size_t size = input_buffer_length(&output), n = MIN_NUM(ringbuffer_length(&sr->buf), size);
+      int r = 0;
+
+      if(!dst) {
+        input_buffer_free(&output, ctx);
+        return JS_ThrowTypeError(ctx, "argument 1 must be an ArrayBuffer or typed array");
+      }
+
+      memcpy(dst, ringbuffer_begin(&sr->buf), n);
+      ringbuffer_skip(&sr->buf, n);
+      sr->scanned = 0;
+
+      if(ringbuffer_empty(&sr->buf))
+        ringbuffer_reset(&sr->buf);
+
+      if(n < size && (r = sp_nonblocking_read(sr->port, dst + n, size - n)) < 0)
+        ret = JS_Throw(ctx, js_serialport_error(ctx, sr->port, r));
+      else
+        ret = JS_NewInt64(ctx, n + r);
+
+      input_buffer_free(&output, ctx);
+      break;
+    }
+
+    case SERIALREADER_ITERATOR: {
+      ret = JS_DupValue(ctx, this_val);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static JSValue
+js_serialreader_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  SerialReader* sr;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(sr = js_serialreader_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case SERIALREADER_ACTIVE: {
+      ret = JS_NewBool(ctx, sr->active);
+      break;
+    }
+
+    case SERIALREADER_BUFFERED: {
+      ret = JS_NewInt64(ctx, ringbuffer_length(&sr->buf));
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static void
+js_serialreader_finalizer(JSRuntime* rt, JSValue val) {
+  SerialReader* sr;
+
+  /* the read handler holds a reference, so the reader is inactive here */
+  if((sr = JS_GetOpaque(val, js_serialreader_class_id))) {
+    if(sr->pending)
+      promise_free_funcs(rt, &sr->next);
+
+    JS_FreeValueRT(rt, sr->port_obj);
+    JS_FreeValueRT(rt, sr->callback);
+    JS_FreeValueRT(rt, sr->handler);
+    JS_FreeValueRT(rt, sr->timer);
+    JS_FreeValueRT(rt, sr->frames);
+    ringbuffer_free(&sr->buf);
+    js_free_rt(rt, sr);
+  }
+}
+
+static void
+js_serialreader_mark(JSRuntime* rt, JSValueConst val, JS_MarkFunc* mark_func) {
+  SerialReader* sr;
+
+  if((sr = JS_GetOpaque(val, js_serialreader_class_id))) {
+    JS_MarkValue(rt, sr->port_obj, mark_func);
+    JS_MarkValue(rt, sr->callback, mark_func);
+    JS_MarkValue(rt, sr->handler, mark_func);
+    JS_MarkValue(rt, sr->timer, mark_func);
+    JS_MarkValue(rt, sr->frames, mark_func);
+
+    if(sr->pending) {
+      JS_MarkValue(rt, sr->next.array[0], mark_func);
+      JS_MarkValue(rt, sr->next.array[1], mark_func);
+    }
+  }
+}
+
+static JSClassDef js_serialreader_class = {
+    .class_name = "SerialReader",
+    .finalizer = js_serialreader_finalizer,
+    .gc_mark = js_serialreader_mark,
+};
+
+static const JSCFunctionListEntry js_serialreader_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("next", 0, js_serialreader_method, SERIALREADER_NEXT),
+    JS_CFUNC_MAGIC_DEF("return", 0, js_serialreader_method, SERIALREADER_RETURN),
+    JS_CFUNC_MAGIC_DEF("stop", 0, js_serialreader_method, SERIALREADER_RETURN),
+    JS_CFUNC_MAGIC_DEF("readInto", 1, js_serialreader_method, SERIALREADER_READINTO),
+    JS_CFUNC_MAGIC_DEF("[Symbol.asyncIterator]", 0, js_serialreader_method, SERIALREADER_ITERATOR),
+    JS_CGETSET_MAGIC_DEF("active", js_serialreader_get, 0, SERIALREADER_ACTIVE),
+    JS_CGETSET_MAGIC_DEF("buffered", js_serialreader_get, 0, SERIALREADER_BUFFERED),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "SerialReader", JS_PROP_CONFIGURABLE),
+};
+
 static JSClassDef js_serialport_class = {
     .class_name = "SerialPort",
     .finalizer = js_serialport_finalizer,
@@ -555,6 +1170,7 @@ static const JSCFunctionListEntry js_serialport_funcs[] = {
     JS_CFUNC_MAGIC_DEF("write", 1, js_serialport_io, SERIALPORT_WRITE),
     JS_CFUNC_MAGIC_DEF("drain", 0, js_serialport_io, SERIALPORT_DRAIN),
     JS_CFUNC_MAGIC_DEF("flush", 0, js_serialport_method, SERIALPORT_FLUSH),
+    JS_CFUNC_DEF("frames", 0, js_serialport_frames),
     JS_CGETSET_MAGIC_DEF("fd", js_serialport_get, 0, SERIALPORT_FD),
     JS_CGETSET_MAGIC_DEF("name", js_serialport_get, 0, SERIALPORT_NAME),
     JS_CGETSET_MAGIC_DEF("transport", js_serialport_get, 0, SERIALPORT_TRANSPORT),
@@ -603,6 +1219,13 @@ js_serial_init(JSContext* ctx, JSModuleDef* m) {
 
     JS_SetClassProto(ctx, js_serialport_class_id, serialport_proto);
 
+    JS_NewClassID(&js_serialreader_class_id);
+    JS_NewClass(JS_GetRuntime(ctx), js_serialreader_class_id, &js_serialreader_class);
+
+    serialreader_proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, serialreader_proto, js_serialreader_funcs, countof(js_serialreader_funcs));
+    JS_SetClassProto(ctx, js_serialreader_class_id, serialreader_proto);
+
     serial_ctor = JS_NewObject(ctx); // JS_NewCFunction2(ctx, js_serial_constructor, "Serial", 1, JS_CFUNC_constructor, 0);
 
     JS_SetPropertyFunctionList(ctx, serial_ctor, js_serial_static, countof(js_serial_static));
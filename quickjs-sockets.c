@@ -4,6 +4,7 @@
 #include "utils.h"
 #include "buffer-utils.h"
 #include "debug.h"
+#include "quickjs-perf.h"
 
 #if defined(_WIN32) && !defined(__MSYS__) && !defined(__CYGWIN__)
 int socketpair(int, int, int, SOCKET[2]);
@@ -25,6 +26,44 @@ typedef int SOCKET;
 #include <assert.h>
 #include <errno.h>
 
+#if defined(__linux__)
+#include <sys/epoll.h>
+#define POLLER_EPOLL 1
+#define POLLER_BACKEND_NAME "epoll"
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) || defined(__DragonFly__)
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#define POLLER_KQUEUE 1
+#define POLLER_BACKEND_NAME "kqueue"
+#else
+#define POLLER_BACKEND_NAME "poll"
+#endif
+
+#if defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__)
+#define HAVE_SENDMMSG 1
+#endif
+
+#if defined(__linux__)
+#include <linux/filter.h>
+#include <sys/sendfile.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__DragonFly__)
+#include <sys/uio.h>
+#define HAVE_BSD_SENDFILE 1
+#endif
+
+#include <sys/stat.h>
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <list.h>
+#include "js-utils.h"
+#endif
+
 /**
  * \addtogroup quickjs-sockets
  * @{
@@ -47,6 +86,16 @@ VISIBLE JSClassID js_sockaddr_class_id = 0, js_socket_class_id = 0, js_asyncsock
 VISIBLE JSValue sockaddr_proto = {{0}, JS_TAG_UNDEFINED}, sockaddr_ctor = {{0}, JS_TAG_UNDEFINED}, socket_proto = {{0}, JS_TAG_UNDEFINED},
                 asyncsocket_proto = {{0}, JS_TAG_UNDEFINED}, socket_ctor = {{0}, JS_TAG_UNDEFINED}, asyncsocket_ctor = {{0}, JS_TAG_UNDEFINED};
 
+#ifndef _WIN32
+VISIBLE JSClassID js_poller_class_id = 0;
+VISIBLE JSValue poller_proto = {{0}, JS_TAG_UNDEFINED}, poller_ctor = {{0}, JS_TAG_UNDEFINED};
+#endif
+
+#ifdef HAVE_LINUX_IO_URING_H
+VISIBLE JSClassID js_ioring_class_id = 0;
+VISIBLE JSValue ioring_proto = {{0}, JS_TAG_UNDEFINED}, ioring_ctor = {{0}, JS_TAG_UNDEFINED};
+#endif
+
 /*extern const uint32_t qjsm_fd_set_size;
 extern const uint8_t qjsm_fd_set[1030];
 extern const uint32_t qjsm_socklen_t_size;
@@ -83,6 +132,9 @@ static const char* syscall_names[] = {
     "close",
     "getsockopt",
     "setsockopt",
+    "recvmmsg",
+    "sendmmsg",
+    "sendfile",
 };
 
 static const char*
@@ -848,14 +900,24 @@ js_select(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[])
 }
 
 #ifndef _WIN32
+#define POLL_STACK_FDS 32
+
+/**
+ * poll(pfds[, nfds[, timeout]])
+ *
+ * \p pfds is either an array of [fd, events, revents] / {fd, events, revents}
+ * members or an ArrayBuffer (or typed array) of struct pollfd. The buffer
+ * form is polled in place, so revents lands in the caller's memory and
+ * nothing is allocated or copied.
+ */
 static JSValue
 js_poll(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
   JSValue ret = JS_UNDEFINED;
   int result;
-  uint32_t nfds = 0;
+  uint32_t i, nfds = 0;
   int32_t timeout = -1;
-  struct pollfd* pfds;
-  BOOL is_array = js_is_array(ctx, argv[0]), is_arraybuffer = js_is_arraybuffer(ctx, argv[0]);
+  struct pollfd stack[POLL_STACK_FDS], *pfds = stack;
+  BOOL is_array = js_is_array(ctx, argv[0]);
 
   if(argc >= 2 && JS_IsNumber(argv[1]))
     JS_ToUint32(ctx, &nfds, argv[1]);
@@ -863,81 +925,1354 @@ js_poll(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
   if(argc >= 3 && JS_IsNumber(argv[2]))
     JS_ToInt32(ctx, &timeout, argv[2]);
 
-  if(nfds == 0) {
-    if(is_array)
-      nfds = js_array_length(ctx, argv[0]);
-    else if(is_arraybuffer)
-      nfds = js_arraybuffer_bytelength(ctx, argv[0]) / sizeof(struct pollfd);
+  if(!is_array) {
+    InputBuffer buf = js_input_buffer(ctx, argv[0]);
+    uint8_t* data;
+    size_t len;
+
+    if(JS_IsException(buf.value))
+      return JS_EXCEPTION;
+
+    data = input_buffer_data(&buf);
+    len = input_buffer_length(&buf);
+    input_buffer_free(&buf, ctx);
+
+    if(len % sizeof(struct pollfd) || (uintptr_t)data % sizeof(int))
+      return JS_ThrowRangeError(ctx, "pfds[] length = %zu", len);
+
+    if(nfds == 0 || nfds > len / sizeof(struct pollfd))
+      nfds = len / sizeof(struct pollfd);
+
+    return JS_NewInt32(ctx, poll((struct pollfd*)data, nfds, timeout));
   }
 
-  assert(nfds);
-  pfds = calloc(sizeof(struct pollfd), nfds);
+  if(nfds == 0)
+    nfds = js_array_length(ctx, argv[0]);
 
-  if(is_array) {
-    uint32_t i;
+  if(nfds > POLL_STACK_FDS && !(pfds = js_malloc(ctx, sizeof(struct pollfd) * nfds)))
+    return JS_EXCEPTION;
 
-    for(i = 0; i < nfds; i++) {
-      JSValue member = JS_GetPropertyUint32(ctx, argv[0], i);
+  for(i = 0; i < nfds; i++) {
+    JSValue member = JS_GetPropertyUint32(ctx, argv[0], i);
 
-      if(!pollfd_read(ctx, member, &pfds[i])) {
-        JS_FreeValue(ctx, member);
-        ret = JS_ThrowInternalError(ctx, "pfds[%i] not valid", i);
-        goto end;
-      }
+    if(!pollfd_read(ctx, member, &pfds[i])) {
+      JS_FreeValue(ctx, member);
+      ret = JS_ThrowInternalError(ctx, "pfds[%i] not valid", i);
+      goto end;
+    }
 
+    JS_FreeValue(ctx, member);
+  }
+
+  result = poll(pfds, nfds, timeout);
+
+  for(i = 0; i < nfds; i++) {
+    JSValue member = JS_GetPropertyUint32(ctx, argv[0], i);
+
+    if(!pollfd_write(ctx, &pfds[i], member)) {
       JS_FreeValue(ctx, member);
+      ret = JS_ThrowInternalError(ctx, "writing pfds[%i]", i);
+      goto end;
     }
-  } else if(is_arraybuffer) {
-    uint8_t* data;
-    size_t len;
 
-    if((data = JS_GetArrayBuffer(ctx, &len, argv[0]))) {
-      if(len > 0 && (len % sizeof(struct pollfd)) == 0) {
-        memcpy(pfds, data, MIN_NUM(len, sizeof(struct pollfd) * nfds));
-      } else {
-        ret = JS_ThrowInternalError(ctx, "pfds[] length = %zu", len);
-        goto end;
+    JS_FreeValue(ctx, member);
+  }
+
+  ret = JS_NewInt32(ctx, result);
+
+end:
+  if(pfds != stack)
+    js_free(ctx, pfds);
+
+  return ret;
+}
+#endif
+
+#ifndef _WIN32
+/**
+ * Persistent interest set: fds are registered once and wait() returns only
+ * the ready ones as (fd, revents) pairs in a reused Int32Array. Backed by
+ * epoll on Linux, kqueue on the BSDs/macOS and poll() elsewhere. Event masks
+ * use the POLL* constants on every backend.
+ */
+typedef struct {
+  int fd;
+  BOOL edge, closed;
+  uint32_t max_events, count;
+#if defined(POLLER_EPOLL)
+  struct epoll_event* events;
+#elif defined(POLLER_KQUEUE)
+  struct kevent* events;
+#else
+  struct pollfd* pfds;
+  uint32_t nfds, capacity;
+#endif
+  JSValue ready;
+  int32_t* ready_data;
+} Poller;
+
+#define POLLER_MAX_EVENTS 256
+
+enum {
+  POLLER_ADD = 0,
+  POLLER_MODIFY,
+  POLLER_REMOVE,
+  POLLER_WAIT,
+  POLLER_CLOSE,
+};
+
+enum {
+  POLLER_READY = 0,
+  POLLER_SIZE,
+  POLLER_FD,
+  POLLER_MAXEVENTS,
+  POLLER_EDGE,
+  POLLER_BACKEND,
+};
+
+static inline Poller*
+js_poller_data2(JSContext* ctx, JSValueConst value) {
+  return JS_GetOpaque2(ctx, value, js_poller_class_id);
+}
+
+#if defined(POLLER_EPOLL)
+static int
+poller_ctl(Poller* p, int op, int fd, uint32_t events, BOOL edge) {
+  static const int ops[] = {EPOLL_CTL_ADD, EPOLL_CTL_MOD, EPOLL_CTL_DEL};
+  /* POLL* and EPOLL* bits coincide on Linux */
+  struct epoll_event ev = {.events = events | (edge ? EPOLLET : 0), .data.fd = fd};
+
+  return epoll_ctl(p->fd, ops[op], fd, &ev);
+}
+
+static int
+poller_wait(Poller* p, int timeout) {
+  int i, n;
+
+  if((n = epoll_wait(p->fd, p->events, (int)p->max_events, timeout)) > 0)
+    for(i = 0; i < n; i++) {
+      p->ready_data[i * 2] = p->events[i].data.fd;
+      p->ready_data[i * 2 + 1] = p->events[i].events & (POLLIN | POLLPRI | POLLOUT | POLLERR | POLLHUP);
+    }
+
+  return n;
+}
+#elif defined(POLLER_KQUEUE)
+static int
+poller_filter(Poller* p, int fd, int filter, BOOL enable, BOOL edge) {
+  struct kevent ev;
+  int ret;
+
+  EV_SET(&ev, fd, filter, enable ? (EV_ADD | EV_ENABLE | (edge ? EV_CLEAR : 0)) : EV_DELETE, 0, 0, 0);
+
+  /* deleting a filter that was never added is not an error here */
+  if((ret = kevent(p->fd, &ev, 1, 0, 0, 0)) == -1 && !enable && errno == ENOENT)
+    ret = 0;
+
+  return ret;
+}
+
+static int
+poller_ctl(Poller* p, int op, int fd, uint32_t events, BOOL edge) {
+  if(op == POLLER_REMOVE)
+    events = 0;
+
+  if(poller_filter(p, fd, EVFILT_READ, !!(events & (POLLIN | POLLPRI)), edge) == -1)
+    return -1;
+
+  return poller_filter(p, fd, EVFILT_WRITE, !!(events & POLLOUT), edge);
+}
+
+static int
+poller_wait(Poller* p, int timeout) {
+  struct timespec ts = {timeout / 1000, (timeout % 1000) * 1000000};
+  int i, j = -1, n;
+
+  if((n = kevent(p->fd, 0, 0, p->events, (int)p->max_events, timeout < 0 ? 0 : &ts)) > 0) {
+    for(i = 0; i < n; i++) {
+      int fd = p->events[i].ident;
+      int32_t revents = p->events[i].filter == EVFILT_WRITE ? POLLOUT : POLLIN;
+
+      if(p->events[i].flags & EV_EOF)
+        revents |= POLLHUP;
+
+      if(p->events[i].flags & EV_ERROR)
+        revents |= POLLERR;
+
+      /* read and write filters of one fd arrive as separate events */
+      if(j >= 0 && p->ready_data[j * 2] == fd) {
+        p->ready_data[j * 2 + 1] |= revents;
+        continue;
       }
+
+      ++j;
+      p->ready_data[j * 2] = fd;
+      p->ready_data[j * 2 + 1] = revents;
     }
+
+    n = j + 1;
   }
 
-  result = poll(pfds, nfds, timeout);
+  return n;
+}
+#else
+static int
+poller_find(Poller* p, int fd) {
+  for(uint32_t i = 0; i < p->nfds; i++)
+    if(p->pfds[i].fd == fd)
+      return i;
+
+  return -1;
+}
 
-  if(is_array) {
-    uint32_t i;
+static int
+poller_ctl(Poller* p, int op, int fd, uint32_t events, BOOL edge) {
+  int i = poller_find(p, fd);
+
+  switch(op) {
+    case POLLER_ADD: {
+      if(i != -1) {
+        errno = EEXIST;
+        return -1;
+      }
 
-    for(i = 0; i < nfds; i++) {
-      JSValue member = JS_GetPropertyUint32(ctx, argv[0], i);
+      if(p->nfds == p->capacity) {
+        uint32_t capacity = p->capacity ? p->capacity * 2 : 64;
+        struct pollfd* pfds;
 
-      if(!pollfd_write(ctx, &pfds[i], member)) {
-        JS_FreeValue(ctx, member);
-        ret = JS_ThrowInternalError(ctx, "writing pfds[%i]", i);
-        goto end;
+        if(!(pfds = realloc(p->pfds, capacity * sizeof(struct pollfd)))) {
+          errno = ENOMEM;
+          return -1;
+        }
+
+        p->pfds = pfds;
+        p->capacity = capacity;
       }
 
-      JS_FreeValue(ctx, member);
+      i = p->nfds++;
+      p->pfds[i].fd = fd;
+      /* fall through */
     }
 
-  } else if(is_arraybuffer) {
-    uint8_t* data;
-    size_t len;
+    case POLLER_MODIFY: {
+      if(i == -1) {
+        errno = ENOENT;
+        return -1;
+      }
 
-    if((data = JS_GetArrayBuffer(ctx, &len, argv[0]))) {
-      if(len > 0 && (len % sizeof(struct pollfd)) == 0) {
-        memcpy(data, pfds, MIN_NUM(len, sizeof(struct pollfd) * nfds));
-      } else {
-        ret = JS_ThrowInternalError(ctx, "pfds[] length = %zu", len);
-        goto end;
+      p->pfds[i].events = events;
+      p->pfds[i].revents = 0;
+      return 0;
+    }
+
+    case POLLER_REMOVE: {
+      if(i == -1) {
+        errno = ENOENT;
+        return -1;
+      }
+
+      p->pfds[i] = p->pfds[--p->nfds];
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+static int
+poller_wait(Poller* p, int timeout) {
+  int n, j = 0;
+
+  if((n = poll(p->pfds, p->nfds, timeout)) > 0)
+    for(uint32_t i = 0; i < p->nfds && j < (int)p->max_events; i++)
+      if(p->pfds[i].revents) {
+        p->ready_data[j * 2] = p->pfds[i].fd;
+        p->ready_data[j * 2 + 1] = p->pfds[i].revents;
+        ++j;
+      }
+
+  return n > 0 ? j : n;
+}
+#endif
+
+static const char* const poller_syscalls[] = {
+#if defined(POLLER_EPOLL)
+    "epoll_ctl",
+    "epoll_wait",
+#elif defined(POLLER_KQUEUE)
+    "kevent",
+    "kevent",
+#else
+    "poll",
+    "poll",
+#endif
+};
+
+static void
+poller_free(JSRuntime* rt, Poller* p) {
+  if(p->fd != -1)
+    close(p->fd);
+
+#if defined(POLLER_EPOLL) || defined(POLLER_KQUEUE)
+  if(p->events)
+    js_free_rt(rt, p->events);
+#else
+  if(p->pfds)
+    free(p->pfds);
+#endif
+
+  JS_FreeValueRT(rt, p->ready);
+  js_free_rt(rt, p);
+}
+
+static JSValue
+js_poller_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  JSValue proto, obj, buffer, length;
+  Poller* p;
+  size_t offset, size;
+
+  if(js_sockaddr_class_id == 0 && js_socket_class_id == 0 && js_asyncsocket_class_id == 0)
+    js_sockets_init(ctx, 0);
+
+  if(!(p = js_mallocz(ctx, sizeof(Poller))))
+    return JS_EXCEPTION;
+
+  p->fd = -1;
+  p->max_events = POLLER_MAX_EVENTS;
+  p->ready = JS_UNDEFINED;
+
+  if(argc > 0 && JS_IsObject(argv[0])) {
+    if(js_has_propertystr(ctx, argv[0], "maxEvents"))
+      p->max_events = MAX_NUM(js_get_propertystr_uint64(ctx, argv[0], "maxEvents"), 1);
+
+    p->edge = js_get_propertystr_bool(ctx, argv[0], "edge");
+  }
+
+#if defined(POLLER_EPOLL)
+  if((p->fd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+    js_syscallerror_throw(ctx, "epoll_create1");
+    goto fail;
+  }
+
+  if(!(p->events = js_malloc(ctx, p->max_events * sizeof(struct epoll_event))))
+    goto fail;
+#elif defined(POLLER_KQUEUE)
+  if((p->fd = kqueue()) == -1) {
+    js_syscallerror_throw(ctx, "kqueue");
+    goto fail;
+  }
+
+  fcntl(p->fd, F_SETFD, FD_CLOEXEC);
+
+  if(!(p->events = js_malloc(ctx, p->max_events * sizeof(struct kevent))))
+    goto fail;
+#endif
+
+  length = JS_NewUint32(ctx, p->max_events * 2);
+  p->ready = js_typedarray_new(ctx, 32, FALSE, TRUE, length);
+
+  if(JS_IsException(p->ready))
+    goto fail;
+
+  buffer = JS_GetTypedArrayBuffer(ctx, p->ready, &offset, 0, 0);
+  p->ready_data = (int32_t*)(JS_GetArrayBuffer(ctx, &size, buffer) + offset);
+  JS_FreeValue(ctx, buffer);
+
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  if(JS_IsException(proto))
+    proto = JS_DupValue(ctx, poller_proto);
+
+  obj = JS_NewObjectProtoClass(ctx, proto, js_poller_class_id);
+  JS_FreeValue(ctx, proto);
+  if(JS_IsException(obj))
+    goto fail;
+
+  JS_SetOpaque(obj, p);
+  return obj;
+
+fail:
+  poller_free(JS_GetRuntime(ctx), p);
+  return JS_EXCEPTION;
+}
+
+static JSValue
+js_poller_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  Poller* p;
+  int32_t fd = -1;
+  uint32_t events = POLLIN;
+  BOOL edge;
+
+  if(!(p = js_poller_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(p->closed && magic != POLLER_CLOSE)
+    return JS_ThrowInternalError(ctx, "Poller is closed");
+
+  switch(magic) {
+    case POLLER_ADD:
+    case POLLER_MODIFY:
+    case POLLER_REMOVE: {
+      if(JS_ToInt32(ctx, &fd, argc > 0 ? argv[0] : JS_UNDEFINED) || fd < 0)
+        return JS_ThrowTypeError(ctx, "argument 1 must be a file descriptor");
+
+      if(argc > 1 && JS_IsNumber(argv[1]))
+        JS_ToUint32(ctx, &events, argv[1]);
+
+      edge = argc > 2 && !JS_IsUndefined(argv[2]) ? JS_ToBool(ctx, argv[2]) : p->edge;
+
+      if(poller_ctl(p, magic, fd, events, edge) == -1)
+        return js_syscallerror_throw(ctx, poller_syscalls[0]);
+
+      if(magic == POLLER_ADD)
+        ++p->count;
+      else if(magic == POLLER_REMOVE)
+        --p->count;
+
+      return JS_UNDEFINED;
+    }
+
+    case POLLER_WAIT: {
+      int32_t timeout = -1;
+      int n;
+
+      if(argc > 0 && JS_IsNumber(argv[0]))
+        JS_ToInt32(ctx, &timeout, argv[0]);
+
+      if((n = poller_wait(p, timeout)) == -1) {
+        if(errno == EINTR)
+          return JS_NewInt32(ctx, 0);
+
+        return js_syscallerror_throw(ctx, poller_syscalls[1]);
+      }
+
+      return JS_NewInt32(ctx, n);
+    }
+
+    case POLLER_CLOSE: {
+      if(p->fd != -1) {
+        close(p->fd);
+        p->fd = -1;
       }
+
+#if !defined(POLLER_EPOLL) && !defined(POLLER_KQUEUE)
+      p->nfds = 0;
+#endif
+      p->closed = TRUE;
+      p->count = 0;
+      return JS_UNDEFINED;
     }
   }
 
-  ret = JS_NewInt32(ctx, result);
+  return JS_UNDEFINED;
+}
+
+static JSValue
+js_poller_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  Poller* p;
+
+  if(!(p = js_poller_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case POLLER_READY: return JS_DupValue(ctx, p->ready);
+    case POLLER_SIZE: return JS_NewUint32(ctx, p->count);
+    case POLLER_FD: return JS_NewInt32(ctx, p->fd);
+    case POLLER_MAXEVENTS: return JS_NewUint32(ctx, p->max_events);
+    case POLLER_EDGE: return JS_NewBool(ctx, p->edge);
+    case POLLER_BACKEND: return JS_NewString(ctx, POLLER_BACKEND_NAME);
+  }
+
+  return JS_UNDEFINED;
+}
+
+static void
+js_poller_finalizer(JSRuntime* rt, JSValue val) {
+  Poller* p;
+
+  if((p = JS_GetOpaque(val, js_poller_class_id)))
+    poller_free(rt, p);
+}
+
+static const JSCFunctionListEntry js_poller_proto_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("add", 2, js_poller_method, POLLER_ADD),
+    JS_CFUNC_MAGIC_DEF("modify", 2, js_poller_method, POLLER_MODIFY),
+    JS_CFUNC_MAGIC_DEF("remove", 1, js_poller_method, POLLER_REMOVE),
+    JS_CFUNC_MAGIC_DEF("wait", 1, js_poller_method, POLLER_WAIT),
+    JS_CFUNC_MAGIC_DEF("close", 0, js_poller_method, POLLER_CLOSE),
+    JS_CGETSET_MAGIC_DEF("ready", js_poller_get, 0, POLLER_READY),
+    JS_CGETSET_MAGIC_DEF("size", js_poller_get, 0, POLLER_SIZE),
+    JS_CGETSET_MAGIC_DEF("fd", js_poller_get, 0, POLLER_FD),
+    JS_CGETSET_MAGIC_DEF("maxEvents", js_poller_get, 0, POLLER_MAXEVENTS),
+    JS_CGETSET_MAGIC_DEF("edge", js_poller_get, 0, POLLER_EDGE),
+    JS_CGETSET_MAGIC_DEF("backend", js_poller_get, 0, POLLER_BACKEND),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Poller", JS_PROP_CONFIGURABLE),
+};
+
+static JSClassDef js_poller_class = {
+    .class_name = "Poller",
+    .finalizer = js_poller_finalizer,
+};
+#endif
+
+#ifdef HAVE_LINUX_IO_URING_H
+/**
+ * io_uring engine. Operations are queued as SQEs and submitted together by a
+ * single io_uring_enter() from a job that runs after the current JS turn;
+ * completions are signalled on an eventfd and every available CQE is reaped
+ * from one read handler call.
+ */
+typedef struct io_ring_op {
+  struct list_head link;
+  Promise promise;
+  JSValue callback, buffer;
+  socklen_t addrlen;
+  uint32_t id;
+  uint16_t group;
+  uint8_t opcode;
+  BOOL multishot : 1;
+} IoOp;
+
+typedef struct io_ring_group {
+  struct list_head link;
+  uint16_t id;
+  uint32_t size, count;
+  uint8_t* data;
+} IoGroup;
+
+typedef struct io_ring {
+  int fd, eventfd;
+  uint32_t entries, tail, pending, inflight, next_id;
+  uint32_t *sq_head, *sq_tail, *sq_mask, *sq_array;
+  uint32_t *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe* sqes;
+  struct io_uring_cqe* cqes;
+  void *sq_ring, *cq_ring;
+  size_t sq_ring_size, cq_ring_size, sqes_size;
+  struct list_head ops, groups;
+  struct iovec* iov;
+  uint32_t niov;
+  JSValue registered;
+  BOOL armed : 1, flush_queued : 1, closed : 1;
+} IoRing;
+
+#define IORING_ENTRIES 256
+
+enum {
+  RING_SEND = 0,
+  RING_RECV,
+  RING_ACCEPT,
+  RING_CONNECT,
+  RING_READ,
+  RING_WRITE,
+  RING_ACCEPT_MULTISHOT,
+  RING_RECV_MULTISHOT,
+  RING_PROVIDE_BUFFERS,
+  RING_REGISTER_BUFFERS,
+  RING_CANCEL,
+  RING_SUBMIT,
+  RING_CLOSE,
+};
+
+enum {
+  RING_PROP_FD = 0,
+  RING_PROP_ENTRIES,
+  RING_PROP_PENDING,
+  RING_PROP_INFLIGHT,
+};
+
+static JSValue js_ioring_handler(JSContext*, JSValueConst, int, JSValueConst[], int, JSValue*);
+
+static inline IoRing*
+js_ioring_data2(JSContext* ctx, JSValueConst value) {
+  return JS_GetOpaque2(ctx, value, js_ioring_class_id);
+}
+
+static const char*
+ioring_opname(uint8_t opcode) {
+  switch(opcode) {
+    case IORING_OP_SEND: return "send";
+    case IORING_OP_RECV: return "recv";
+    case IORING_OP_ACCEPT: return "accept";
+    case IORING_OP_CONNECT: return "connect";
+    case IORING_OP_READ:
+    case IORING_OP_READ_FIXED: return "read";
+    case IORING_OP_WRITE:
+    case IORING_OP_WRITE_FIXED: return "write";
+    case IORING_OP_PROVIDE_BUFFERS: return "provide_buffers";
+  }
+
+  return "io_uring";
+}
+
+static int
+ioring_enter(IoRing* r, uint32_t to_submit) {
+  int ret;
+
+  do
+    ret = syscall(__NR_io_uring_enter, r->fd, to_submit, 0, 0, NULL, 0);
+  while(ret == -1 && errno == EINTR);
+
+  return ret;
+}
+
+static BOOL
+ioring_map(IoRing* r, struct io_uring_params* p) {
+  r->sq_ring_size = p->sq_off.array + p->sq_entries * sizeof(uint32_t);
+  r->cq_ring_size = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+  r->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+
+  if(p->features & IORING_FEAT_SINGLE_MMAP)
+    r->sq_ring_size = r->cq_ring_size = MAX_NUM(r->sq_ring_size, r->cq_ring_size);
+
+  if((r->sq_ring = mmap(0, r->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING)) == MAP_FAILED)
+    return (r->sq_ring = 0), FALSE;
+
+  if(p->features & IORING_FEAT_SINGLE_MMAP)
+    r->cq_ring = r->sq_ring;
+  else if((r->cq_ring = mmap(0, r->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING)) == MAP_FAILED)
+    return (r->cq_ring = 0), FALSE;
+
+  if((r->sqes = mmap(0, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES)) == MAP_FAILED)
+    return (r->sqes = 0), FALSE;
+
+  r->sq_head = (uint32_t*)((uint8_t*)r->sq_ring + p->sq_off.head);
+  r->sq_tail = (uint32_t*)((uint8_t*)r->sq_ring + p->sq_off.tail);
+  r->sq_mask = (uint32_t*)((uint8_t*)r->sq_ring + p->sq_off.ring_mask);
+  r->sq_array = (uint32_t*)((uint8_t*)r->sq_ring + p->sq_off.array);
+  r->cq_head = (uint32_t*)((uint8_t*)r->cq_ring + p->cq_off.head);
+  r->cq_tail = (uint32_t*)((uint8_t*)r->cq_ring + p->cq_off.tail);
+  r->cq_mask = (uint32_t*)((uint8_t*)r->cq_ring + p->cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe*)((uint8_t*)r->cq_ring + p->cq_off.cqes);
+  r->entries = p->sq_entries;
+  r->tail = *r->sq_tail;
+  return TRUE;
+}
+
+static void
+ioring_unmap(IoRing* r) {
+  if(r->sqes)
+    munmap(r->sqes, r->sqes_size);
+
+  if(r->cq_ring && r->cq_ring != r->sq_ring)
+    munmap(r->cq_ring, r->cq_ring_size);
+
+  if(r->sq_ring)
+    munmap(r->sq_ring, r->sq_ring_size);
+
+  r->sqes = 0;
+  r->sq_ring = r->cq_ring = 0;
+}
+
+/**
+ * Publishes the queued SQEs to the kernel in one io_uring_enter().
+ */
+static int
+ioring_flush(IoRing* r) {
+  int ret;
+
+  if(r->pending == 0)
+    return 0;
+
+  __atomic_store_n(r->sq_tail, r->tail, __ATOMIC_RELEASE);
+
+  if((ret = ioring_enter(r, r->pending)) > 0)
+    r->pending -= ret;
+
+  return ret;
+}
+
+static struct io_uring_sqe*
+ioring_sqe(IoRing* r, uint8_t opcode, uint64_t user_data) {
+  struct io_uring_sqe* sqe;
+  uint32_t idx;
+
+  if(r->tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= r->entries)
+    if(ioring_flush(r) == -1 || r->tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= r->entries)
+      return 0;
+
+  idx = r->tail++ & *r->sq_mask;
+  sqe = &r->sqes[idx];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->user_data = user_data;
+  r->sq_array[idx] = idx;
+  r->pending++;
+  r->inflight++;
+  return sqe;
+}
+
+static BOOL
+ioring_arm(IoRing* r, JSValueConst obj, BOOL arm, JSContext* ctx) {
+  JSValue set_handler, handler = JS_NULL;
+  BOOL ret;
+
+  if(r->eventfd < 0 || r->armed == !!arm)
+    return TRUE;
+
+  if(JS_IsException(set_handler = js_iohandler_fn(ctx, FALSE)))
+    return FALSE;
+
+  if(arm)
+    handler = JS_NewCFunctionData(ctx, js_ioring_handler, 0, 0, 1, &obj);
+
+  if((ret = js_iohandler_set(ctx, set_handler, r->eventfd, handler)))
+    r->armed = !!arm;
+
+  JS_FreeValue(ctx, set_handler);
+  return ret;
+}
+
+static JSValue
+js_ioring_flush_job(JSContext* ctx, int argc, JSValueConst argv[]) {
+  IoRing* r;
+
+  if((r = JS_GetOpaque(argv[0], js_ioring_class_id))) {
+    r->flush_queued = FALSE;
+
+    if(!r->closed && ioring_flush(r) == -1)
+      return js_syscallerror_throw(ctx, "io_uring_enter");
+  }
+
+  return JS_UNDEFINED;
+}
+
+/**
+ * Called after SQEs have been queued: schedules the batched submit and makes
+ * sure completions are picked up.
+ */
+static void
+ioring_commit(IoRing* r, JSValueConst obj, JSContext* ctx) {
+  if(!r->flush_queued) {
+    JS_EnqueueJob(ctx, js_ioring_flush_job, 1, &obj);
+    r->flush_queued = TRUE;
+  }
+
+  ioring_arm(r, obj, TRUE, ctx);
+}
+
+static IoOp*
+ioring_op_new(IoRing* r, uint8_t opcode, JSContext* ctx) {
+  IoOp* op;
+
+  if(!(op = js_mallocz(ctx, sizeof(IoOp))))
+    return 0;
+
+  op->opcode = opcode;
+  op->id = ++r->next_id;
+  op->callback = JS_UNDEFINED;
+  op->buffer = JS_UNDEFINED;
+  promise_zero(&op->promise);
+  return op;
+}
+
+static void
+ioring_op_free(IoOp* op, JSRuntime* rt) {
+  promise_free(rt, &op->promise);
+  JS_FreeValueRT(rt, op->callback);
+  JS_FreeValueRT(rt, op->buffer);
+  js_free_rt(rt, op);
+}
+
+static IoGroup*
+ioring_group(IoRing* r, uint16_t id) {
+  struct list_head* el;
+
+  list_for_each(el, &r->groups) {
+    IoGroup* g = list_entry(el, IoGroup, link);
+
+    if(g->id == id)
+      return g;
+  }
+
+  return 0;
+}
+
+/**
+ * Hands buffer \p bid of group \p g back to the kernel once its contents
+ * have been copied out.
+ */
+static void
+ioring_reprovide(IoRing* r, IoGroup* g, uint16_t bid) {
+  struct io_uring_sqe* sqe;
+
+  if((sqe = ioring_sqe(r, IORING_OP_PROVIDE_BUFFERS, 0))) {
+    sqe->fd = 1;
+    sqe->addr = (uintptr_t)(g->data + (size_t)bid * g->size);
+    sqe->len = g->size;
+    sqe->buf_group = g->id;
+    sqe->off = bid;
+  }
+}
+
+static void
+ioring_complete(IoRing* r, IoOp* op, const struct io_uring_cqe* cqe, JSContext* ctx) {
+  JSValue value, error = JS_NULL;
+
+  if(cqe->res < 0) {
+    error = js_syscallerror_new(ctx, ioring_opname(op->opcode), -cqe->res);
+    value = JS_UNDEFINED;
+  } else if(cqe->flags & IORING_CQE_F_BUFFER) {
+    uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    IoGroup* g = ioring_group(r, op->group);
+
+    value = g ? JS_NewArrayBufferCopy(ctx, g->data + (size_t)bid * g->size, cqe->res) : JS_UNDEFINED;
+
+    if(g)
+      ioring_reprovide(r, g, bid);
+  } else if(op->opcode == IORING_OP_RECV && op->multishot) {
+    /* zero-length recv: peer closed */
+    value = JS_NULL;
+  } else {
+    value = JS_NewInt32(ctx, cqe->res);
+  }
+
+  if(op->multishot) {
+    JSValue args[] = {error, value};
+
+    JS_FreeValue(ctx, JS_Call(ctx, op->callback, JS_UNDEFINED, countof(args), args));
+  } else if(cqe->res < 0) {
+    promise_reject(ctx, &op->promise.funcs, error);
+  } else {
+    promise_resolve(ctx, &op->promise.funcs, value);
+  }
+
+  JS_FreeValue(ctx, error);
+  JS_FreeValue(ctx, value);
+}
+
+static void
+ioring_reap(IoRing* r, JSValueConst obj, JSContext* ctx) {
+  uint32_t head;
+  uint64_t count;
+  BOOL more;
+
+  if(read(r->eventfd, &count, sizeof(count)) == -1 && errno != EAGAIN)
+    return;
+
+  while(!r->closed && (head = *r->cq_head) != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+    struct io_uring_cqe cqe = r->cqes[head & *r->cq_mask];
+    IoOp* op = (IoOp*)(uintptr_t)cqe.user_data;
+
+    __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+
+    more = op && op->multishot && (cqe.flags & IORING_CQE_F_MORE);
+
+    if(!more) {
+      r->inflight--;
+
+      if(op)
+        list_del(&op->link);
+    }
+
+    if(op)
+      ioring_complete(r, op, &cqe, ctx);
+
+    if(op && !more)
+      ioring_op_free(op, JS_GetRuntime(ctx));
+  }
+
+  if(r->pending)
+    ioring_commit(r, obj, ctx);
+
+  if(r->inflight == 0)
+    ioring_arm(r, obj, FALSE, ctx);
+}
+
+static JSValue
+js_ioring_handler(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, JSValue* data) {
+  IoRing* r;
+
+  if((r = JS_GetOpaque(data[0], js_ioring_class_id)) && !r->closed)
+    ioring_reap(r, data[0], ctx);
+
+  return JS_UNDEFINED;
+}
+
+static void
+ioring_close(IoRing* r, JSValueConst obj, JSContext* ctx) {
+  JSRuntime* rt = JS_GetRuntime(ctx);
+  struct list_head *el, *next;
+
+  if(r->closed)
+    return;
+
+  ioring_arm(r, obj, FALSE, ctx);
+  r->closed = TRUE;
+
+  /* closing the ring cancels everything still in flight */
+  if(r->fd >= 0)
+    close(r->fd);
+
+  r->fd = -1;
+  ioring_unmap(r);
+
+  list_for_each_safe(el, next, &r->ops) {
+    IoOp* op = list_entry(el, IoOp, link);
+
+    list_del(&op->link);
+
+    if(!op->multishot) {
+      JSValue error = js_syscallerror_new(ctx, ioring_opname(op->opcode), ECANCELED);
+
+      promise_reject(ctx, &op->promise.funcs, error);
+      JS_FreeValue(ctx, error);
+    }
+
+    ioring_op_free(op, rt);
+  }
+
+  r->inflight = r->pending = 0;
+}
+
+static void
+ioring_free(IoRing* r, JSRuntime* rt) {
+  struct list_head *el, *next;
+
+  if(r->fd >= 0)
+    close(r->fd);
+
+  if(r->eventfd >= 0)
+    close(r->eventfd);
+
+  ioring_unmap(r);
+
+  list_for_each_safe(el, next, &r->ops) {
+    IoOp* op = list_entry(el, IoOp, link);
+
+    ioring_op_free(op, rt);
+  }
+
+  list_for_each_safe(el, next, &r->groups) {
+    IoGroup* g = list_entry(el, IoGroup, link);
+
+    js_free_rt(rt, g->data);
+    js_free_rt(rt, g);
+  }
+
+  if(r->iov)
+    js_free_rt(rt, r->iov);
+
+  JS_FreeValueRT(rt, r->registered);
+  js_free_rt(rt, r);
+}
+
+static JSValue
+js_ioring_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  struct io_uring_params params;
+  JSValue proto, obj;
+  uint32_t entries = IORING_ENTRIES;
+  IoRing* r;
+
+  if(js_sockaddr_class_id == 0 && js_socket_class_id == 0 && js_asyncsocket_class_id == 0)
+    js_sockets_init(ctx, 0);
+
+  if(!(r = js_mallocz(ctx, sizeof(IoRing))))
+    return JS_EXCEPTION;
+
+  r->fd = r->eventfd = -1;
+  r->registered = JS_UNDEFINED;
+  init_list_head(&r->ops);
+  init_list_head(&r->groups);
+
+  if(argc > 0 && JS_IsObject(argv[0]) && js_has_propertystr(ctx, argv[0], "entries"))
+    entries = MAX_NUM(js_get_propertystr_uint64(ctx, argv[0], "entries"), 1);
+
+  memset(&params, 0, sizeof(params));
+
+  if((r->fd = syscall(__NR_io_uring_setup, entries, &params)) == -1) {
+    js_syscallerror_throw(ctx, "io_uring_setup");
+    goto fail;
+  }
+
+  if(!ioring_map(r, &params)) {
+    js_syscallerror_throw(ctx, "mmap");
+    goto fail;
+  }
+
+  if((r->eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+    js_syscallerror_throw(ctx, "eventfd");
+    goto fail;
+  }
+
+  if(syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_EVENTFD, &r->eventfd, 1) == -1) {
+    js_syscallerror_throw(ctx, "io_uring_register");
+    goto fail;
+  }
+
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  if(JS_IsException(proto))
+    proto = JS_DupValue(ctx, ioring_proto);
+
+  obj = JS_NewObjectProtoClass(ctx, proto, js_ioring_class_id);
+  JS_FreeValue(ctx, proto);
+  if(JS_IsException(obj))
+    goto fail;
+
+  JS_SetOpaque(obj, r);
+  return obj;
+
+fail:
+  ioring_free(r, JS_GetRuntime(ctx));
+  return JS_EXCEPTION;
+}
+
+static JSValue
+js_ioring_register_buffers(JSContext* ctx, IoRing* r, JSValueConst arg) {
+  uint32_t i, n = js_array_length(ctx, arg);
+  struct iovec* iov = 0;
+
+  if(r->iov) {
+    syscall(__NR_io_uring_register, r->fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+    js_free(ctx, r->iov);
+    r->iov = 0;
+    r->niov = 0;
+    JS_FreeValue(ctx, r->registered);
+    r->registered = JS_UNDEFINED;
+  }
+
+  if(n == 0)
+    return JS_UNDEFINED;
+
+  if(!(iov = js_mallocz(ctx, n * sizeof(struct iovec))))
+    return JS_EXCEPTION;
+
+  for(i = 0; i < n; i++) {
+    JSValue item = JS_GetPropertyUint32(ctx, arg, i);
+    InputBuffer buf = js_input_buffer(ctx, item);
+
+    JS_FreeValue(ctx, item);
+
+    if(JS_IsException(buf.value)) {
+      js_free(ctx, iov);
+      return JS_EXCEPTION;
+    }
+
+    iov[i].iov_base = input_buffer_data(&buf);
+    iov[i].iov_len = input_buffer_length(&buf);
+    input_buffer_free(&buf, ctx);
+  }
+
+  if(syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_BUFFERS, iov, n) == -1) {
+    js_free(ctx, iov);
+    return js_syscallerror_throw(ctx, "io_uring_register");
+  }
+
+  r->iov = iov;
+  r->niov = n;
+  r->registered = JS_DupValue(ctx, arg);
+  return JS_NewUint32(ctx, n);
+}
+
+static JSValue
+js_ioring_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  static const uint8_t opcodes[] = {
+      [RING_SEND] = IORING_OP_SEND,
+      [RING_RECV] = IORING_OP_RECV,
+      [RING_ACCEPT] = IORING_OP_ACCEPT,
+      [RING_CONNECT] = IORING_OP_CONNECT,
+      [RING_READ] = IORING_OP_READ,
+      [RING_WRITE] = IORING_OP_WRITE,
+      [RING_ACCEPT_MULTISHOT] = IORING_OP_ACCEPT,
+      [RING_RECV_MULTISHOT] = IORING_OP_RECV,
+      [RING_PROVIDE_BUFFERS] = IORING_OP_PROVIDE_BUFFERS,
+  };
+  struct io_uring_sqe* sqe;
+  IoRing* r;
+  IoOp* op;
+  int32_t fd = -1;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(r = js_ioring_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(r->closed && magic != RING_CLOSE)
+    return JS_ThrowInternalError(ctx, "IoRing is closed");
+
+  switch(magic) {
+    case RING_REGISTER_BUFFERS: return js_ioring_register_buffers(ctx, r, argc > 0 ? argv[0] : JS_UNDEFINED);
+
+    case RING_SUBMIT: {
+      int n;
+
+      if((n = ioring_flush(r)) == -1)
+        return js_syscallerror_throw(ctx, "io_uring_enter");
+
+      return JS_NewInt32(ctx, n);
+    }
+
+    case RING_CLOSE: {
+      ioring_close(r, this_val, ctx);
+      return JS_UNDEFINED;
+    }
+
+    case RING_CANCEL: {
+      uint32_t id = 0;
+      struct list_head* el;
+
+      JS_ToUint32(ctx, &id, argc > 0 ? argv[0] : JS_UNDEFINED);
+
+      list_for_each(el, &r->ops) {
+        IoOp* other = list_entry(el, IoOp, link);
+
+        if(other->id == id) {
+          if(!(sqe = ioring_sqe(r, IORING_OP_ASYNC_CANCEL, 0)))
+            return JS_ThrowInternalError(ctx, "submission queue full");
+
+          sqe->addr = (uintptr_t)other;
+          ioring_commit(r, this_val, ctx);
+          return JS_TRUE;
+        }
+      }
+
+      return JS_FALSE;
+    }
+  }
+
+  if(magic != RING_PROVIDE_BUFFERS)
+    if(JS_ToInt32(ctx, &fd, argc > 0 ? argv[0] : JS_UNDEFINED) || fd < 0)
+      return JS_ThrowTypeError(ctx, "argument 1 must be a file descriptor");
+
+  if(!(op = ioring_op_new(r, opcodes[magic], ctx)))
+    return JS_EXCEPTION;
+
+  if(!(sqe = ioring_sqe(r, op->opcode, (uintptr_t)op))) {
+    ioring_op_free(op, JS_GetRuntime(ctx));
+    return JS_ThrowInternalError(ctx, "submission queue full");
+  }
+
+  sqe->fd = fd;
+
+  switch(magic) {
+    case RING_SEND:
+    case RING_RECV:
+    case RING_READ:
+    case RING_WRITE: {
+      OffsetLength off = OFFSET_INIT();
+      uint8_t* data;
+      size_t size;
+
+      if(argc > 1 && JS_IsNumber(argv[1]) && (magic == RING_READ || magic == RING_WRITE)) {
+        uint32_t index = 0;
+
+        JS_ToUint32(ctx, &index, argv[1]);
+
+        if(index >= r->niov) {
+          ret = JS_ThrowRangeError(ctx, "no registered buffer #%u", index);
+          break;
+        }
+
+        data = r->iov[index].iov_base;
+        size = r->iov[index].iov_len;
+        sqe->opcode = magic == RING_READ ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+        sqe->buf_index = index;
+      } else {
+        InputBuffer buf;
+
+        /* the op keeps the buffer alive until the kernel is done with it */
+        if(argc > 1 && JS_IsString(argv[1]) && (magic == RING_SEND || magic == RING_WRITE)) {
+          size_t len;
+          const char* str = JS_ToCStringLen(ctx, &len, argv[1]);
+
+          op->buffer = JS_NewArrayBufferCopy(ctx, (const uint8_t*)str, len);
+          JS_FreeCString(ctx, str);
+        } else {
+          op->buffer = JS_DupValue(ctx, argc > 1 ? argv[1] : JS_UNDEFINED);
+        }
+
+        buf = js_input_buffer(ctx, op->buffer);
+
+        if(JS_IsException(buf.value)) {
+          ret = JS_EXCEPTION;
+          break;
+        }
+
+        data = input_buffer_data(&buf);
+        size = input_buffer_length(&buf);
+        input_buffer_free(&buf, ctx);
+      }
+
+      js_offset_length(ctx, size, argc - 2, argv + 2, &off);
+      sqe->addr = (uintptr_t)offset_data(&off, data);
+      sqe->len = offset_size(&off, size);
+
+      if(magic == RING_READ || magic == RING_WRITE) {
+        int64_t position = -1;
+
+        if(argc > 4)
+          JS_ToInt64(ctx, &position, argv[4]);
+
+        sqe->off = (uint64_t)position;
+      } else if(argc > 4) {
+        uint32_t flags = 0;
+
+        JS_ToUint32(ctx, &flags, argv[4]);
+        sqe->msg_flags = flags;
+      }
+
+      break;
+    }
+
+    case RING_ACCEPT:
+    case RING_CONNECT: {
+      SockAddr* a = argc > 1 ? js_sockaddr_data(argv[1]) : 0;
+
+      if(magic == RING_CONNECT && !a) {
+        ret = JS_ThrowTypeError(ctx, "argument 2 must be a SockAddr");
+        break;
+      }
+
+      if(a) {
+        op->buffer = JS_DupValue(ctx, argv[1]);
+        sqe->addr = (uintptr_t)&a->s;
+      }
+
+      if(magic == RING_CONNECT) {
+        sqe->off = sockaddr_size(a);
+      } else if(a) {
+        op->addrlen = sizeof(SockAddr);
+        sqe->addr2 = (uintptr_t)&op->addrlen;
+      }
+
+      break;
+    }
+
+    case RING_ACCEPT_MULTISHOT:
+    case RING_RECV_MULTISHOT: {
+      int i = magic == RING_RECV_MULTISHOT ? 2 : 1;
+
+      if(argc <= i || !JS_IsFunction(ctx, argv[i])) {
+        ret = JS_ThrowTypeError(ctx, "argument %d must be a function", i + 1);
+        break;
+      }
+
+      if(magic == RING_RECV_MULTISHOT) {
+        uint32_t group = 0;
+
+        JS_ToUint32(ctx, &group, argv[1]);
+
+        if(!ioring_group(r, group)) {
+          ret = JS_ThrowRangeError(ctx, "no buffer group #%u", group);
+          break;
+        }
+
+        op->group = group;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags |= IOSQE_BUFFER_SELECT;
+        sqe->buf_group = group;
+      } else {
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+      }
+
+      op->multishot = TRUE;
+      op->callback = JS_DupValue(ctx, argv[i]);
+      break;
+    }
+
+    case RING_PROVIDE_BUFFERS: {
+      uint32_t group = 0, size = 0, count = 0;
+      IoGroup* g;
+
+      JS_ToUint32(ctx, &group, argc > 0 ? argv[0] : JS_UNDEFINED);
+      JS_ToUint32(ctx, &size, argc > 1 ? argv[1] : JS_UNDEFINED);
+      JS_ToUint32(ctx, &count, argc > 2 ? argv[2] : JS_UNDEFINED);
+
+      if(group > UINT16_MAX || size == 0 || count == 0 || count > UINT16_MAX || ioring_group(r, group)) {
+        ret = JS_ThrowRangeError(ctx, "invalid buffer group");
+        break;
+      }
+
+      if(!(g = js_mallocz(ctx, sizeof(IoGroup))) || !(g->data = js_malloc(ctx, (size_t)size * count))) {
+        js_free(ctx, g);
+        ret = JS_EXCEPTION;
+        break;
+      }
+
+      g->id = group;
+      g->size = size;
+      g->count = count;
+      list_add_tail(&g->link, &r->groups);
+
+      sqe->fd = count;
+      sqe->addr = (uintptr_t)g->data;
+      sqe->len = size;
+      sqe->buf_group = group;
+      sqe->off = 0;
+      break;
+    }
+  }
+
+  if(JS_IsException(ret)) {
+    /* turn the already reserved SQE into a no-op */
+    sqe->opcode = IORING_OP_NOP;
+    sqe->flags = 0;
+    sqe->user_data = 0;
+    ioring_op_free(op, JS_GetRuntime(ctx));
+    ioring_commit(r, this_val, ctx);
+    return ret;
+  }
+
+  list_add_tail(&op->link, &r->ops);
+  ioring_commit(r, this_val, ctx);
+
+  if(op->multishot)
+    return JS_NewUint32(ctx, op->id);
+
+  if(!promise_init(ctx, &op->promise))
+    return JS_EXCEPTION;
+
+  return JS_DupValue(ctx, op->promise.value);
+}
+
+static JSValue
+js_ioring_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  IoRing* r;
+
+  if(!(r = js_ioring_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case RING_PROP_FD: return JS_NewInt32(ctx, r->fd);
+    case RING_PROP_ENTRIES: return JS_NewUint32(ctx, r->entries);
+    case RING_PROP_PENDING: return JS_NewUint32(ctx, r->pending);
+    case RING_PROP_INFLIGHT: return JS_NewUint32(ctx, r->inflight);
+  }
+
+  return JS_UNDEFINED;
+}
 
-end:
-  free(pfds);
-  return ret;
+static void
+js_ioring_finalizer(JSRuntime* rt, JSValue val) {
+  IoRing* r;
+
+  if((r = JS_GetOpaque(val, js_ioring_class_id)))
+    ioring_free(r, rt);
 }
+
+static const JSCFunctionListEntry js_ioring_proto_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("send", 2, js_ioring_method, RING_SEND),
+    JS_CFUNC_MAGIC_DEF("recv", 2, js_ioring_method, RING_RECV),
+    JS_CFUNC_MAGIC_DEF("accept", 1, js_ioring_method, RING_ACCEPT),
+    JS_CFUNC_MAGIC_DEF("connect", 2, js_ioring_method, RING_CONNECT),
+    JS_CFUNC_MAGIC_DEF("read", 2, js_ioring_method, RING_READ),
+    JS_CFUNC_MAGIC_DEF("write", 2, js_ioring_method, RING_WRITE),
+    JS_CFUNC_MAGIC_DEF("acceptMultishot", 2, js_ioring_method, RING_ACCEPT_MULTISHOT),
+    JS_CFUNC_MAGIC_DEF("recvMultishot", 3, js_ioring_method, RING_RECV_MULTISHOT),
+    JS_CFUNC_MAGIC_DEF("provideBuffers", 3, js_ioring_method, RING_PROVIDE_BUFFERS),
+    JS_CFUNC_MAGIC_DEF("registerBuffers", 1, js_ioring_method, RING_REGISTER_BUFFERS),
+    JS_CFUNC_MAGIC_DEF("cancel", 1, js_ioring_method, RING_CANCEL),
+    JS_CFUNC_MAGIC_DEF("submit", 0, js_ioring_method, RING_SUBMIT),
+    JS_CFUNC_MAGIC_DEF("close", 0, js_ioring_method, RING_CLOSE),
+    JS_CGETSET_MAGIC_DEF("fd", js_ioring_get, 0, RING_PROP_FD),
+    JS_CGETSET_MAGIC_DEF("entries", js_ioring_get, 0, RING_PROP_ENTRIES),
+    JS_CGETSET_MAGIC_DEF("pending", js_ioring_get, 0, RING_PROP_PENDING),
+    JS_CGETSET_MAGIC_DEF("inflight", js_ioring_get, 0, RING_PROP_INFLIGHT),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "IoRing", JS_PROP_CONFIGURABLE),
+};
+
+static JSClassDef js_ioring_class = {
+    .class_name = "IoRing",
+    .finalizer = js_ioring_finalizer,
+};
 #endif
 
 static BOOL
@@ -1015,8 +2350,8 @@ js_socket_error(JSContext* ctx, Socket sock) {
   int err;
 
   if((err = socket_error(sock))) {
-    if(!(sock.nonblock &&
-         ((sock.sysno == SYSCALL_RECV && err == EAGAIN) || (sock.sysno == SYSCALL_SEND && err == EWOULDBLOCK) || (sock.sysno == SYSCALL_CONNECT && err == EINPROGRESS))))
+    /* would-block and interrupted calls only leave errno/syscall on the socket */
+    if(!(err == EINTR || (sock.nonblock && (syscallerror_retry(err) || (sock.sysno == SYSCALL_CONNECT && err == EINPROGRESS)))))
       ret = JS_Throw(ctx, js_syscallerror_new(ctx, socket_syscall(sock), err));
   }
 
@@ -1149,7 +2484,7 @@ js_socket_get(JSContext* ctx, JSValueConst this_val, int magic) {
     }
 
     case PROP_SYSCALL: {
-      if(s.sysno > 0) {
+      if(s.sysno > 0 && s.sysno < countof(syscall_names)) {
         const char* name;
 
         if((name = syscall_name(s.sysno)))
@@ -1272,6 +2607,9 @@ enum {
   METHOD_SETSOCKOPT,
   METHOD_SHUTDOWN,
   METHOD_CLOSE,
+  METHOD_RECVMANY,
+  METHOD_SENDMANY,
+  METHOD_SENDFILE,
 };
 
 enum {
@@ -1388,6 +2726,357 @@ js_asyncsocket_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueCo
   return promise;
 }
 
+/**
+ * accept() with accept4()-style SOCK_NONBLOCK / SOCK_CLOEXEC \p flags,
+ * emulated through fcntl() where accept4() is missing.
+ */
+static int
+socket_accept(Socket sock, SockAddr* a, socklen_t* addrlen, int flags) {
+  int fd;
+
+#if defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__DragonFly__)
+  if(flags)
+    return accept4(socket_handle(sock), (struct sockaddr*)a, addrlen, flags);
+#endif
+
+  fd = accept(socket_handle(sock), (struct sockaddr*)a, addrlen);
+
+#if !defined(_WIN32) && defined(SOCK_NONBLOCK)
+  if(fd != -1 && (flags & SOCK_NONBLOCK))
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#endif
+#if !defined(_WIN32) && defined(SOCK_CLOEXEC)
+  if(fd != -1 && (flags & SOCK_CLOEXEC))
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+#endif
+
+  return fd;
+}
+
+#define SOCKET_COPY_CHUNK 65536
+
+/**
+ * Copies up to \p length bytes (all if negative) of \p fd starting at
+ * \p offset (the current file position if negative) to the socket without
+ * passing through JS. Stops early when the socket would block; the byte count
+ * is returned then and -1 only if nothing was sent.
+ */
+static ssize_t
+socket_sendfile(Socket sock, int fd, int64_t offset, int64_t length) {
+  ssize_t r = 0, total = 0;
+
+  if(length < 0) {
+    struct stat st;
+
+    if(fstat(fd, &st) == -1)
+      return -1;
+
+    length = st.st_size - (offset >= 0 ? offset : lseek(fd, 0, SEEK_CUR));
+  }
+
+  while(total < length) {
+    size_t count = MIN_NUM(length - total, 0x7ffff000);
+#if defined(__linux__)
+    off_t off = offset + total;
+
+    r = sendfile(socket_handle(sock), fd, offset >= 0 ? &off : 0, count);
+#elif defined(__APPLE__)
+    off_t len = count;
+
+    if((r = sendfile(fd, socket_handle(sock), offset >= 0 ? offset + total : lseek(fd, 0, SEEK_CUR), &len, 0, 0)) == 0 || len > 0)
+      r = len;
+
+    if(offset < 0 && r > 0)
+      lseek(fd, r, SEEK_CUR);
+#elif defined(HAVE_BSD_SENDFILE)
+    off_t sent = 0;
+
+    if((r = sendfile(fd, socket_handle(sock), offset >= 0 ? offset + total : lseek(fd, 0, SEEK_CUR), count, 0, &sent, 0)) == 0 || sent > 0)
+      r = sent;
+
+    if(offset < 0 && r > 0)
+      lseek(fd, r, SEEK_CUR);
+#else
+    uint8_t buf[SOCKET_COPY_CHUNK];
+    ssize_t n, w = 0;
+
+    if(offset >= 0 && lseek(fd, offset + total, SEEK_SET) == -1)
+      return total > 0 ? total : -1;
+
+    if((n = read(fd, buf, MIN_NUM(count, sizeof(buf)))) <= 0) {
+      r = n;
+    } else {
+      while(w < n && (r = send(socket_handle(sock), (const void*)(buf + w), n - w, 0)) > 0)
+        w += r;
+
+      /* rewind what could not be sent so the file position stays exact */
+      if(w < n && offset < 0)
+        lseek(fd, w - n, SEEK_CUR);
+
+      r = w > 0 ? w : r;
+    }
+#endif
+
+    if(r <= 0)
+      break;
+
+    total += r;
+  }
+
+  return total > 0 || r == 0 ? total : r;
+}
+
+#ifndef _WIN32
+/**
+ * Waits until \p fd accepts more data; used when bytes already taken from the
+ * source have to be delivered before returning.
+ */
+static BOOL
+fd_drain_wait(int fd) {
+  struct pollfd pfd = {fd, POLLOUT, 0};
+
+  return (errno == EAGAIN || errno == EWOULDBLOCK) && poll(&pfd, 1, -1) > 0;
+}
+
+/**
+ * Moves up to \p length bytes (until EOF if negative) from \p in to \p out
+ * in the kernel. splice() needs a pipe on one side, so other fd pairs go
+ * through a temporary pipe. Stops when \p in would block.
+ */
+static ssize_t
+fd_splice(int in, int out, int64_t length, unsigned int flags) {
+  ssize_t r = 0, w, n, total = 0;
+#ifdef __linux__
+  struct stat st;
+  BOOL direct = (fstat(in, &st) == 0 && S_ISFIFO(st.st_mode)) || (fstat(out, &st) == 0 && S_ISFIFO(st.st_mode));
+  int p[2] = {-1, -1};
+
+  if(!direct && pipe2(p, O_CLOEXEC) == -1)
+    return -1;
+
+  while(length < 0 || total < length) {
+    size_t count = direct ? 0x40000000 : SOCKET_COPY_CHUNK;
+
+    if(length >= 0)
+      count = MIN_NUM(count, length - total);
+
+    if(direct) {
+      if((r = splice(in, 0, out, 0, count, flags | SPLICE_F_MOVE)) <= 0)
+        break;
+
+      total += r;
+      continue;
+    }
+
+    if((r = splice(in, 0, p[1], 0, count, flags | SPLICE_F_MOVE)) <= 0)
+      break;
+
+    /* everything in the temporary pipe has to reach out */
+    for(n = r; n > 0;) {
+      if((w = splice(p[0], 0, out, 0, n, SPLICE_F_MOVE)) > 0) {
+        n -= w;
+        total += w;
+      } else if(w == 0 || !fd_drain_wait(out)) {
+        r = -1;
+        goto end;
+      }
+    }
+  }
+
+end:
+  if(!direct) {
+    int err = errno;
+
+    close(p[0]);
+    close(p[1]);
+    errno = err;
+  }
+#else
+  uint8_t buf[SOCKET_COPY_CHUNK];
+
+  while(length < 0 || total < length) {
+    size_t count = sizeof(buf);
+
+    if(length >= 0)
+      count = MIN_NUM(count, length - total);
+
+    if((r = read(in, buf, count)) <= 0)
+      break;
+
+    for(n = 0; n < r;) {
+      if((w = write(out, buf + n, r - n)) > 0) {
+        n += w;
+        total += w;
+      } else if(w == 0 || !fd_drain_wait(out)) {
+        return total > 0 ? total : -1;
+      }
+    }
+  }
+#endif
+
+  return total > 0 || r == 0 ? total : -1;
+}
+
+/**
+ * pipe(srcFd, dstFd[, length[, flags]])
+ *
+ * Returns the number of bytes moved, 0 at EOF or -1 if \p srcFd would block.
+ */
+static JSValue
+js_pipe(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  int32_t in = -1, out = -1;
+  int64_t length = -1;
+  uint32_t flags = 0;
+  ssize_t r;
+
+  if(JS_ToInt32(ctx, &in, argc > 0 ? argv[0] : JS_UNDEFINED) || in < 0)
+    return JS_ThrowTypeError(ctx, "argument 1 must be a file descriptor");
+
+  if(JS_ToInt32(ctx, &out, argc > 1 ? argv[1] : JS_UNDEFINED) || out < 0)
+    return JS_ThrowTypeError(ctx, "argument 2 must be a file descriptor");
+
+  if(argc > 2 && !js_is_nullish(ctx, argv[2]))
+    JS_ToInt64(ctx, &length, argv[2]);
+
+  if(argc > 3)
+    JS_ToUint32(ctx, &flags, argv[3]);
+
+  if((r = fd_splice(in, out, length, flags)) == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+#ifdef __linux__
+    return js_syscallerror_throw(ctx, "splice");
+#else
+    return js_syscallerror_throw(ctx, "read");
+#endif
+
+  return JS_NewInt64(ctx, r);
+}
+#endif
+
+#define SOCKET_MMSG_MAX 128
+
+/**
+ * recvMany(buffers[, addrs[, lengths[, flags]]]) / sendMany(...)
+ *
+ * One datagram per element of \p buffers, up to SOCKET_MMSG_MAX per call, in
+ * a single recvmmsg()/sendmmsg() where available. \p addrs is an array of
+ * SockAddr (or, for sending, one SockAddr for all), \p lengths a Uint32Array
+ * that limits the bytes sent and receives the per-datagram byte counts.
+ */
+static JSValue
+js_socket_many(JSContext* ctx, Socket* s, int argc, JSValueConst argv[], BOOL send) {
+  MemoryBlock blocks[SOCKET_MMSG_MAX];
+  SockAddr* addrs[SOCKET_MMSG_MAX];
+  JSValueConst addr_arg = argc > 1 ? argv[1] : JS_UNDEFINED;
+  SockAddr* common = js_sockaddr_data(addr_arg);
+  BOOL addr_array = js_is_array(ctx, addr_arg);
+  InputBuffer lenbuf = {{{0, 0}}, 0, 0, JS_UNDEFINED, OFFSET_INIT()};
+  uint32_t i, n, *lens = 0, nlens = 0;
+  int32_t flags = 0;
+  JSValue ret = JS_UNDEFINED;
+
+  if(argc < 1 || !js_is_array(ctx, argv[0]))
+    return JS_ThrowTypeError(ctx, "argument 1 must be an array of buffers");
+
+  n = MIN_NUM(js_array_length(ctx, argv[0]), SOCKET_MMSG_MAX);
+
+  if(argc > 2 && !js_is_nullish(ctx, argv[2])) {
+    lenbuf = js_input_buffer(ctx, argv[2]);
+
+    if(JS_IsException(lenbuf.value))
+      return JS_EXCEPTION;
+
+    lens = (uint32_t*)input_buffer_data(&lenbuf);
+    nlens = input_buffer_length(&lenbuf) / sizeof(uint32_t);
+  }
+
+  if(argc > 3)
+    JS_ToInt32(ctx, &flags, argv[3]);
+
+  /* the arrays hold references to the buffers for the duration of the call */
+  for(i = 0; i < n; i++) {
+    JSValue item = JS_GetPropertyUint32(ctx, argv[0], i);
+    InputBuffer buf = js_input_buffer(ctx, item);
+
+    JS_FreeValue(ctx, item);
+
+    if(JS_IsException(buf.value)) {
+      ret = JS_EXCEPTION;
+      goto end;
+    }
+
+    blocks[i] = input_buffer_block(&buf);
+    input_buffer_free(&buf, ctx);
+
+    if(send && i < nlens)
+      blocks[i].size = MIN_NUM(blocks[i].size, lens[i]);
+
+    addrs[i] = common;
+
+    if(addr_array) {
+      item = JS_GetPropertyUint32(ctx, addr_arg, i);
+      addrs[i] = js_sockaddr_data(item);
+      JS_FreeValue(ctx, item);
+    }
+  }
+
+#ifdef HAVE_SENDMMSG
+  {
+    struct mmsghdr msgs[SOCKET_MMSG_MAX];
+    struct iovec iov[SOCKET_MMSG_MAX];
+
+    memset(msgs, 0, n * sizeof(struct mmsghdr));
+
+    for(i = 0; i < n; i++) {
+      iov[i].iov_base = blocks[i].base;
+      iov[i].iov_len = blocks[i].size;
+      msgs[i].msg_hdr.msg_iov = &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+
+      if(addrs[i]) {
+        msgs[i].msg_hdr.msg_name = &addrs[i]->s;
+        msgs[i].msg_hdr.msg_namelen = send ? sockaddr_size(addrs[i]) : sizeof(SockAddr);
+      }
+    }
+
+    if(send)
+      JS_SOCKETCALL(SYSCALL_SENDMMSG, s, sendmmsg(socket_handle(*s), msgs, n, flags));
+    else
+      JS_SOCKETCALL(SYSCALL_RECVMMSG, s, recvmmsg(socket_handle(*s), msgs, n, flags, 0));
+
+    for(i = 0; s->ret > 0 && i < (uint32_t)s->ret && i < nlens; i++)
+      lens[i] = msgs[i].msg_len;
+  }
+#else
+  {
+    int r = 0;
+
+    for(i = 0; i < n; i++) {
+      socklen_t alen = addrs[i] ? (send ? sockaddr_size(addrs[i]) : sizeof(SockAddr)) : 0;
+
+      if(send)
+        r = sendto(socket_handle(*s), (const void*)blocks[i].base, blocks[i].size, flags, addrs[i] ? &addrs[i]->s : 0, alen);
+      else
+        r = recvfrom(socket_handle(*s), (void*)blocks[i].base, blocks[i].size, flags, addrs[i] ? &addrs[i]->s : 0, addrs[i] ? &alen : 0);
+
+      if(r < 0)
+        break;
+
+      if(i < nlens)
+        lens[i] = r;
+    }
+
+    /* a partial batch is a success, like recvmmsg() */
+    JS_SOCKETCALL(send ? SYSCALL_SENDMMSG : SYSCALL_RECVMMSG, s, i > 0 ? (int)i : r);
+  }
+#endif
+
+end:
+  if(lens)
+    input_buffer_free(&lenbuf, ctx);
+
+  return ret;
+}
+
 static JSValue
 js_socket_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
   Socket sock = js_socket_data(this_val);
@@ -1443,7 +3132,12 @@ js_socket_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst a
 
     case METHOD_ACCEPT: {
       socklen_t addrlen = sizeof(SockAddr);
-      JS_SOCKETCALL(SYSCALL_ACCEPT, s, accept(socket_handle(*s), (struct sockaddr*)a, &addrlen));
+      int32_t flags = 0;
+
+      if(argc > 1)
+        JS_ToInt32(ctx, &flags, argv[1]);
+
+      JS_SOCKETCALL(SYSCALL_ACCEPT, s, socket_accept(*s, a, &addrlen, flags));
       break;
     }
 
@@ -1469,6 +3163,7 @@ js_socket_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst a
       int32_t flags = 0;
       InputBuffer buf = js_input_buffer(ctx, argv[0]);
       OffsetLength off;
+      int64_t trace_start;
       js_offset_length(ctx, buf.size, argc - 1, argv + 1, &off);
 
 #ifdef DEBUG_OUTPUT
@@ -1478,6 +3173,8 @@ js_socket_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst a
       if(argc >= 4)
         JS_ToInt32(ctx, &flags, argv[3]);
 
+      trace_start = perf_trace_begin(PERF_TRACE_SOCKET);
+
       if(magic == METHOD_RECVFROM) {
         if((a = argc >= 5 ? js_sockaddr_data(argv[4]) : 0))
           alen = sizeof(SockAddr);
@@ -1487,6 +3184,8 @@ js_socket_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst a
         JS_SOCKETCALL(SYSCALL_RECV, s, recv(socket_handle(*s), (void*)(buf.data + off.offset), offset_size(&off, buf.size), flags));
       }
 
+      perf_trace_end(PERF_TRACE_SOCKET, trace_start, s->ret > 0 ? s->ret : 0);
+
       break;
     }
 
@@ -1495,12 +3194,15 @@ js_socket_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst a
       int32_t flags = 0;
       InputBuffer buf = js_input_chars(ctx, argv[0]);
       OffsetLength off;
+      int64_t trace_start;
 
       js_offset_length(ctx, buf.size, argc - 1, argv + 1, &off);
 
       if(argc >= 4)
         JS_ToInt32(ctx, &flags, argv[3]);
 
+      trace_start = perf_trace_begin(PERF_TRACE_SOCKET);
+
       if(magic == METHOD_SENDTO) {
         if((a = argc >= 5 ? js_sockaddr_data(argv[4]) : 0))
           alen = sockaddr_size(a);
@@ -1508,6 +3210,8 @@ js_socket_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst a
       } else {
         JS_SOCKETCALL(SYSCALL_SEND, s, send(socket_handle(*s), (const void*)(buf.data + off.offset), offset_size(&off, buf.size), flags));
       }
+
+      perf_trace_end(PERF_TRACE_SOCKET, trace_start, s->ret > 0 ? s->ret : 0);
       break;
     }
 
@@ -1606,6 +3310,29 @@ js_socket_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst a
       break;
     }
 
+    case METHOD_RECVMANY:
+    case METHOD_SENDMANY: {
+      ret = js_socket_many(ctx, s, argc, argv, magic == METHOD_SENDMANY);
+      break;
+    }
+
+    case METHOD_SENDFILE: {
+      int32_t fd = -1;
+      int64_t offset = -1, length = -1;
+
+      if(JS_ToInt32(ctx, &fd, argc > 0 ? argv[0] : JS_UNDEFINED) || fd < 0)
+        return JS_ThrowTypeError(ctx, "argument 1 must be a file descriptor");
+
+      if(argc > 1 && !js_is_nullish(ctx, argv[1]))
+        JS_ToInt64(ctx, &offset, argv[1]);
+
+      if(argc > 2 && !js_is_nullish(ctx, argv[2]))
+        JS_ToInt64(ctx, &length, argv[2]);
+
+      JS_SOCKETCALL(SYSCALL_SENDFILE, s, socket_sendfile(*s, fd, offset, length));
+      break;
+    }
+
     case METHOD_CLOSE: {
       /*AsyncSocket* asock;
       if((asock = js_asyncsocket_ptr(this_val))) {
@@ -1729,6 +3456,142 @@ js_socket_adopt(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst ar
   return js_socket_new_proto(ctx, socket_proto, fd, FALSE, FALSE);
 }
 
+/**
+ * Socket.listenGroup(addr[, count[, options]])
+ *
+ * Creates \p count listeners bound to the same address with SO_REUSEPORT so
+ * the kernel spreads incoming connections over them (one per worker).
+ *
+ * options: backlog, type, protocol, async, nonblock and steer; the latter
+ * attaches a classic BPF program that picks the listener by the CPU that
+ * received the packet (count should then match the number of CPUs).
+ */
+static JSValue
+js_socket_listen_group(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  SockAddr* a;
+  uint32_t i, count = 1;
+  int32_t backlog = SOMAXCONN, type = SOCK_STREAM, protocol = 0;
+  BOOL async = FALSE, nonblock = FALSE, steer = FALSE;
+  const char* syscall = 0;
+  int err = 0;
+  JSValue ret;
+
+  if(!(a = js_sockaddr_data(argc > 0 ? argv[0] : JS_UNDEFINED)))
+    return JS_ThrowTypeError(ctx, "argument 1 must be of type SockAddr");
+
+  if(argc > 1 && JS_IsNumber(argv[1]))
+    JS_ToUint32(ctx, &count, argv[1]);
+
+  if(argc > 2 && JS_IsObject(argv[2])) {
+    if(js_has_propertystr(ctx, argv[2], "backlog"))
+      backlog = js_get_propertystr_int32(ctx, argv[2], "backlog");
+
+    if(js_has_propertystr(ctx, argv[2], "type"))
+      type = js_get_propertystr_int32(ctx, argv[2], "type");
+
+    if(js_has_propertystr(ctx, argv[2], "protocol"))
+      protocol = js_get_propertystr_int32(ctx, argv[2], "protocol");
+
+    async = js_get_propertystr_bool(ctx, argv[2], "async");
+    nonblock = js_get_propertystr_bool(ctx, argv[2], "nonblock");
+    steer = js_get_propertystr_bool(ctx, argv[2], "steer");
+  }
+
+  if(count == 0)
+    return JS_ThrowRangeError(ctx, "count must be > 0");
+
+  ret = JS_NewArray(ctx);
+
+  for(i = 0; i < count; i++) {
+    int fd, one = 1;
+    JSValue obj;
+
+#ifdef SOCK_CLOEXEC
+    fd = socket(a->family, type | SOCK_CLOEXEC, protocol);
+#else
+    fd = socket(a->family, type, protocol);
+#endif
+
+    if(fd == -1) {
+      syscall = "socket";
+      goto fail;
+    }
+
+    if(setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (const void*)&one, sizeof(one)) == -1) {
+      syscall = "setsockopt";
+      goto fail_fd;
+    }
+
+#ifdef SO_REUSEPORT
+    if(setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (const void*)&one, sizeof(one)) == -1) {
+      syscall = "setsockopt";
+      goto fail_fd;
+    }
+#endif
+
+    if(bind(fd, &a->s, sockaddr_size(a)) == -1) {
+      syscall = "bind";
+      goto fail_fd;
+    }
+
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+    if(i == 0 && steer) {
+      /* A = cpu; A %= count; return A */
+      struct sock_filter code[] = {
+          {BPF_LD | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_CPU},
+          {BPF_ALU | BPF_MOD | BPF_K, 0, 0, count},
+          {BPF_RET | BPF_A, 0, 0, 0},
+      };
+      struct sock_fprog prog = {countof(code), code};
+
+      if(setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) == -1) {
+        syscall = "setsockopt";
+        goto fail_fd;
+      }
+    }
+#endif
+
+    if((type & 0xff) != SOCK_DGRAM && listen(fd, backlog) == -1) {
+      syscall = "listen";
+      goto fail_fd;
+    }
+
+    obj = js_socket_new_proto(ctx, async ? asyncsocket_proto : socket_proto, fd, async, TRUE);
+
+    if(JS_IsException(obj)) {
+      close(fd);
+      JS_FreeValue(ctx, ret);
+      return JS_EXCEPTION;
+    }
+
+    if(nonblock && !async) {
+      Socket sock = js_socket_data(obj);
+
+      sock.nonblock = TRUE;
+      socket_nonblocking(&sock, TRUE);
+      JS_SetOpaque(obj, sock.ptr);
+    }
+
+    JS_SetPropertyUint32(ctx, ret, i, obj);
+    continue;
+
+  fail_fd:
+    err = errno;
+    closesocket(fd);
+    goto fail;
+  }
+
+  return ret;
+
+fail:
+  if(!err)
+    err = errno;
+
+  /* dropping the array closes the listeners created so far */
+  JS_FreeValue(ctx, ret);
+  return JS_Throw(ctx, js_syscallerror_new(ctx, syscall, err));
+}
+
 static void
 js_socket_finalizer(JSRuntime* rt, JSValue val) {
   Socket sock = js_socket_data(val);
@@ -1766,6 +3629,7 @@ static const JSCFunctionListEntry js_sockets_funcs[] = {
     JS_CFUNC_DEF("select", 1, js_select),
 #ifndef _WIN32
     JS_CFUNC_DEF("poll", 1, js_poll),
+    JS_CFUNC_DEF("pipe", 2, js_pipe),
 #endif
     JS_CFUNC_MAGIC_DEF("getsockopt", 4, js_sockopt, METHOD_GETSOCKOPT),
     JS_CFUNC_MAGIC_DEF("setsockopt", 4, js_sockopt, METHOD_SETSOCKOPT),
@@ -1793,6 +3657,9 @@ static const JSCFunctionListEntry js_socket_proto_funcs[] = {
     JS_CFUNC_MAGIC_DEF("sendto", 2, js_socket_method, METHOD_SENDTO),
     JS_CFUNC_MAGIC_DEF("recv", 1, js_socket_method, METHOD_RECV),
     JS_CFUNC_MAGIC_DEF("recvfrom", 2, js_socket_method, METHOD_RECVFROM),
+    JS_CFUNC_MAGIC_DEF("recvMany", 1, js_socket_method, METHOD_RECVMANY),
+    JS_CFUNC_MAGIC_DEF("sendMany", 1, js_socket_method, METHOD_SENDMANY),
+    JS_CFUNC_MAGIC_DEF("sendfile", 1, js_socket_method, METHOD_SENDFILE),
     JS_CFUNC_MAGIC_DEF("shutdown", 1, js_socket_method, METHOD_SHUTDOWN),
     JS_CFUNC_MAGIC_DEF("close", 0, js_socket_method, METHOD_CLOSE),
     JS_CFUNC_MAGIC_DEF("getsockopt", 3, js_socket_method, METHOD_GETSOCKOPT),
@@ -1824,6 +3691,9 @@ static const JSCFunctionListEntry js_asyncsocket_proto_funcs[] = {
     JS_CFUNC_MAGIC_DEF("sendto", 2, js_asyncsocket_method, METHOD_SENDTO),
     JS_CFUNC_MAGIC_DEF("recv", 1, js_asyncsocket_method, METHOD_RECV),
     JS_CFUNC_MAGIC_DEF("recvfrom", 2, js_asyncsocket_method, METHOD_RECVFROM),
+    JS_CFUNC_MAGIC_DEF("recvMany", 1, js_socket_method, METHOD_RECVMANY),
+    JS_CFUNC_MAGIC_DEF("sendMany", 1, js_socket_method, METHOD_SENDMANY),
+    JS_CFUNC_MAGIC_DEF("sendfile", 1, js_socket_method, METHOD_SENDFILE),
     JS_CFUNC_MAGIC_DEF("shutdown", 1, js_socket_method, METHOD_SHUTDOWN),
     JS_CFUNC_MAGIC_DEF("close", 0, js_socket_method, METHOD_CLOSE),
     JS_CFUNC_MAGIC_DEF("getsockopt", 3, js_socket_method, METHOD_GETSOCKOPT),
@@ -1835,6 +3705,7 @@ static const JSCFunctionListEntry js_asyncsocket_proto_funcs[] = {
 
 static const JSCFunctionListEntry js_socket_static_funcs[] = {
     JS_CFUNC_DEF("adopt", 1, js_socket_adopt),
+    JS_CFUNC_DEF("listenGroup", 1, js_socket_listen_group),
 };
 
 static const JSCFunctionListEntry js_sockets_errnos[] = {
@@ -2303,6 +4174,30 @@ static const JSCFunctionListEntry js_sockets_defines[] = {
 #ifdef PF_MAX
     JS_CONSTANT_NONENUMERABLE(PF_MAX),
 #endif
+#ifdef SPLICE_F_MOVE
+    JS_CONSTANT_NONENUMERABLE(SPLICE_F_MOVE),
+#endif
+#ifdef SPLICE_F_NONBLOCK
+    JS_CONSTANT_NONENUMERABLE(SPLICE_F_NONBLOCK),
+#endif
+#ifdef SPLICE_F_MORE
+    JS_CONSTANT_NONENUMERABLE(SPLICE_F_MORE),
+#endif
+#ifdef MSG_PEEK
+    JS_CONSTANT_NONENUMERABLE(MSG_PEEK),
+#endif
+#ifdef MSG_TRUNC
+    JS_CONSTANT_NONENUMERABLE(MSG_TRUNC),
+#endif
+#ifdef MSG_DONTWAIT
+    JS_CONSTANT_NONENUMERABLE(MSG_DONTWAIT),
+#endif
+#ifdef MSG_WAITALL
+    JS_CONSTANT_NONENUMERABLE(MSG_WAITALL),
+#endif
+#ifdef MSG_WAITFORONE
+    JS_CONSTANT_NONENUMERABLE(MSG_WAITFORONE),
+#endif
 #ifdef POLLIN
     JS_CONSTANT_NONENUMERABLE(POLLIN),
 #endif
@@ -2593,10 +4488,42 @@ js_sockets_init(JSContext* ctx, JSModuleDef* m) {
   JS_SetClassProto(ctx, js_asyncsocket_class_id, asyncsocket_proto);
   JS_SetConstructor(ctx, asyncsocket_ctor, asyncsocket_proto);
 
+#ifndef _WIN32
+  JS_NewClassID(&js_poller_class_id);
+  JS_NewClass(JS_GetRuntime(ctx), js_poller_class_id, &js_poller_class);
+
+  poller_ctor = JS_NewCFunction2(ctx, js_poller_constructor, "Poller", 1, JS_CFUNC_constructor, 0);
+  poller_proto = JS_NewObject(ctx);
+
+  JS_SetPropertyFunctionList(ctx, poller_proto, js_poller_proto_funcs, countof(js_poller_proto_funcs));
+
+  JS_SetClassProto(ctx, js_poller_class_id, poller_proto);
+  JS_SetConstructor(ctx, poller_ctor, poller_proto);
+#endif
+
+#ifdef HAVE_LINUX_IO_URING_H
+  JS_NewClassID(&js_ioring_class_id);
+  JS_NewClass(JS_GetRuntime(ctx), js_ioring_class_id, &js_ioring_class);
+
+  ioring_ctor = JS_NewCFunction2(ctx, js_ioring_constructor, "IoRing", 1, JS_CFUNC_constructor, 0);
+  ioring_proto = JS_NewObject(ctx);
+
+  JS_SetPropertyFunctionList(ctx, ioring_proto, js_ioring_proto_funcs, countof(js_ioring_proto_funcs));
+
+  JS_SetClassProto(ctx, js_ioring_class_id, ioring_proto);
+  JS_SetConstructor(ctx, ioring_ctor, ioring_proto);
+#endif
+
   if(m) {
     JS_SetModuleExport(ctx, m, "SockAddr", sockaddr_ctor);
     JS_SetModuleExport(ctx, m, "Socket", socket_ctor);
     JS_SetModuleExport(ctx, m, "AsyncSocket", asyncsocket_ctor);
+#ifndef _WIN32
+    JS_SetModuleExport(ctx, m, "Poller", poller_ctor);
+#endif
+#ifdef HAVE_LINUX_IO_URING_H
+    JS_SetModuleExport(ctx, m, "IoRing", ioring_ctor);
+#endif
     /*JS_SetModuleExport(ctx, m, "fd_set", fdset_ctor);
     JS_SetModuleExport(ctx, m, "socklen_t", socklen_ctor);*/
 
@@ -2629,6 +4556,12 @@ JS_INIT_MODULE(JSContext* ctx, const char* module_name) {
     JS_AddModuleExport(ctx, m, "SockAddr");
     JS_AddModuleExport(ctx, m, "Socket");
     JS_AddModuleExport(ctx, m, "AsyncSocket");
+#ifndef _WIN32
+    JS_AddModuleExport(ctx, m, "Poller");
+#endif
+#ifdef HAVE_LINUX_IO_URING_H
+    JS_AddModuleExport(ctx, m, "IoRing");
+#endif
     JS_AddModuleExport(ctx, m, "fd_set");
     JS_AddModuleExport(ctx, m, "socklen_t");
 
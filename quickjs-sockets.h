@@ -43,7 +43,7 @@ typedef union {
 #define SOCKET_PROPS() \
   unsigned fd : 16; \
   unsigned error : 8; \
-  unsigned sysno : 4; \
+  unsigned sysno : 5; \
   BOOL nonblock : 1, async : 1, owner : 1; \
   signed ret : 32
 
@@ -87,6 +87,14 @@ void* optval_buf(JSContext*, JSValueConst arg, int32_t** tmp_ptr, socklen_t* len
 
 extern VISIBLE JSClassID js_sockaddr_class_id, js_socket_class_id, js_asyncsocket_class_id;
 extern VISIBLE JSValue sockaddr_proto, sockaddr_ctor, socket_proto, socket_ctor, asyncsocket_proto, asyncsocket_ctor;
+#ifndef _WIN32
+extern VISIBLE JSClassID js_poller_class_id;
+extern VISIBLE JSValue poller_proto, poller_ctor;
+#endif
+#ifdef HAVE_LINUX_IO_URING_H
+extern VISIBLE JSClassID js_ioring_class_id;
+extern VISIBLE JSValue ioring_proto, ioring_ctor;
+#endif
 
 enum SocketCalls {
   SYSCALL_SOCKET = 0,
@@ -104,7 +112,10 @@ enum SocketCalls {
   SYSCALL_SHUTDOWN,
   SYSCALL_CLOSE,
   SYSCALL_GETSOCKOPT,
-  SYSCALL_SETSOCKOPT
+  SYSCALL_SETSOCKOPT,
+  SYSCALL_RECVMMSG,
+  SYSCALL_SENDMMSG,
+  SYSCALL_SENDFILE,
 };
 
 #define socket_fd(sock) ((sock).fd)
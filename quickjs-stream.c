@@ -1,26 +1,49 @@
 #include "quickjs-stream.h"
+#include "quickjs-syscallerror.h"
 #include "buffer-utils.h"
 #include "utils.h"
 #include "debug.h"
 #include <list.h>
 #include <assert.h>
+#include <errno.h>
+#include <math.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
 
 /**
  * \defgroup quickjs-stream quickjs-stream: Buffered stream
  * @{
  */
 
-VISIBLE JSClassID js_readable_class_id = 0, js_writable_class_id = 0, js_reader_class_id = 0, js_writer_class_id = 0, js_transform_class_id = 0;
+VISIBLE JSClassID js_readable_class_id = 0, js_writable_class_id = 0, js_reader_class_id = 0, js_writer_class_id = 0, js_transform_class_id = 0,
+                  js_strategy_class_id = 0;
 VISIBLE JSValue readable_proto = {{0}, JS_TAG_UNDEFINED}, readable_controller = {{0}, JS_TAG_UNDEFINED}, readable_ctor = {{0}, JS_TAG_UNDEFINED},
                 writable_proto = {{0}, JS_TAG_UNDEFINED}, writable_controller = {{0}, JS_TAG_UNDEFINED}, writable_ctor = {{0}, JS_TAG_UNDEFINED},
                 transform_proto = {{0}, JS_TAG_UNDEFINED}, transform_controller = {{0}, JS_TAG_UNDEFINED}, transform_ctor = {{0}, JS_TAG_UNDEFINED},
                 reader_proto = {{0}, JS_TAG_UNDEFINED}, reader_ctor = {{0}, JS_TAG_UNDEFINED}, writer_proto = {{0}, JS_TAG_UNDEFINED},
-                writer_ctor = {{0}, JS_TAG_UNDEFINED};
+                writer_ctor = {{0}, JS_TAG_UNDEFINED}, bytelength_strategy_proto = {{0}, JS_TAG_UNDEFINED},
+                bytelength_strategy_ctor = {{0}, JS_TAG_UNDEFINED}, count_strategy_proto = {{0}, JS_TAG_UNDEFINED},
+                count_strategy_ctor = {{0}, JS_TAG_UNDEFINED};
 
 static int reader_update(Reader* rd, JSContext* ctx);
 static BOOL reader_passthrough(Reader* rd, JSValueConst result, JSContext* ctx);
 static int readable_unlock(Readable* st, Reader* rd);
 static int writable_unlock(Writable* st, Writer* wr);
+static JSValue chunk_value(Chunk* ch, JSContext* ctx);
+static BOOL queue_attached(Queue* q, JSContext* ctx);
+static JSValue readable_pull(Readable* st, JSContext* ctx);
+static JSValue readable_source_cancel(Readable* st, JSValueConst reason, JSContext* ctx);
+static void pipe_pump(Pipe* p, JSContext* ctx);
+static Pipe* pipe_dup(Pipe* p);
+static void pipe_free(Pipe* p);
+static void writable_track(Writable* st, JSValueConst promise, int64_t size, Pipe* p, JSContext* ctx);
+static void pipe_abort(Pipe* p, JSValueConst reason, BOOL from_source, JSContext* ctx);
+static JSValue readable_pipe(Readable* st, Writable* dest, JSValueConst options, JSContext* ctx);
 
 static void
 chunk_unref(JSRuntime* rt, void* opaque, void* ptr) {
@@ -39,6 +62,83 @@ chunk_arraybuffer(Chunk* ch, JSContext* ctx) {
   return JS_NewArrayBuffer(ctx, ptr, len, chunk_unref, ch, FALSE);
 }
 
+static void
+strategy_init(QueuingStrategy* qs) {
+  qs->high_water_mark = 1;
+  qs->bytes = FALSE;
+}
+
+static BOOL
+strategy_high_water_mark(JSContext* ctx, QueuingStrategy* qs, double hwm) {
+  if(isnan(hwm) || hwm < 0) {
+    JS_ThrowRangeError(ctx, "highWaterMark must be a non-negative number");
+    return FALSE;
+  }
+
+  qs->high_water_mark = hwm >= (double)INT64_MAX ? INT64_MAX : (int64_t)hwm;
+  return TRUE;
+}
+
+/**
+ * Take the queuing strategy from a ByteLengthQueuingStrategy,
+ * CountQueuingStrategy or a plain { highWaterMark } object (counted in
+ * chunks). Leaves \p qs alone when \p value is not an object.
+ */
+static BOOL
+strategy_from_value(JSContext* ctx, JSValueConst value, QueuingStrategy* qs) {
+  QueuingStrategy* other;
+  JSValue hwm;
+  double d;
+  BOOL ret;
+
+  if((other = js_strategy_data(value))) {
+    *qs = *other;
+    return TRUE;
+  }
+
+  if(!JS_IsObject(value))
+    return TRUE;
+
+  hwm = JS_GetPropertyStr(ctx, value, "highWaterMark");
+
+  if(JS_IsUndefined(hwm))
+    return TRUE;
+
+  ret = !JS_ToFloat64(ctx, &d, hwm) && strategy_high_water_mark(ctx, qs, d);
+  JS_FreeValue(ctx, hwm);
+  return ret;
+}
+
+/**
+ * Size of a chunk under \p qs: its byte length or 1
+ */
+static int64_t
+strategy_size(QueuingStrategy* qs, JSValueConst chunk, JSContext* ctx) {
+  InputBuffer input;
+  int64_t ret;
+
+  if(!qs->bytes)
+    return 1;
+
+  if(!JS_IsString(chunk) && !js_is_typedarray(ctx, chunk) && !js_is_arraybuffer(ctx, chunk))
+    return 0;
+
+  input = js_input_chars(ctx, chunk);
+  ret = input_buffer_length(&input);
+  input_buffer_free(&input, ctx);
+  return ret;
+}
+
+static inline int64_t
+queue_desired(Queue* q, QueuingStrategy* qs) {
+  return qs->high_water_mark - (int64_t)(qs->bytes ? q->nbytes : q->nchunks);
+}
+
+static inline int64_t
+writable_desired(Writable* st) {
+  return st->strategy.high_water_mark - st->inflight;
+}
+
 static Read*
 read_new(Reader* rd, JSContext* ctx) {
   static int read_seq = 0;
@@ -46,6 +146,7 @@ read_new(Reader* rd, JSContext* ctx) {
 
   if((op = js_mallocz(ctx, sizeof(struct read_next)))) {
     op->seq = ++read_seq;
+    op->view = JS_UNDEFINED;
     list_add((struct list_head*)op, &rd->list);
 
     promise_init(ctx, &op->promise);
@@ -55,7 +156,7 @@ read_new(Reader* rd, JSContext* ctx) {
 }
 
 static JSValue
-read_next(Reader* rd, JSContext* ctx) {
+read_next(Reader* rd, JSContext* ctx, Read** opp) {
   JSValue ret = JS_UNDEFINED;
   Read *el, *op = 0;
 
@@ -77,6 +178,9 @@ read_next(Reader* rd, JSContext* ctx) {
     op->promise.value = JS_UNDEFINED;
   }
 
+  if(opp)
+    *opp = op;
+
   return ret;
 }
 
@@ -88,6 +192,7 @@ read_done(Read* op) {
 static void
 read_free_rt(Read* op, JSRuntime* rt) {
   promise_free(rt, &op->promise);
+  JS_FreeValueRT(rt, op->view);
 
   list_del(&op->link);
 }
@@ -171,7 +276,7 @@ reader_cancel(Reader* rd, JSValueConst reason, JSContext* ctx) {
   if(!rd->stream)
     return JS_ThrowInternalError(ctx, "no WriteableStream");
 
-  ret = js_readable_callback(ctx, rd->stream, READABLE_CANCEL, 1, &reason);
+  ret = readable_source_cancel(rd->stream, reason, ctx);
 
   if(js_is_promise(ctx, ret)) {
     ret = promise_forward(ctx, ret, &rd->events[READER_CANCELLED]);
@@ -190,19 +295,26 @@ reader_cancel(Reader* rd, JSContext* ctx) {
 }
 */
 static JSValue
-reader_read(Reader* rd, JSContext* ctx) {
+reader_read(Reader* rd, JSValueConst view, JSContext* ctx) {
   JSValue ret = JS_UNDEFINED;
   Readable* st;
+  Read* op = 0;
   // printf("reader_read (1)  [%zu] closed=%i\n", list_size(&rd->list), rd->stream->closed);
 
-  ret = read_next(rd, ctx);
+  if(rd->byob && !js_is_typedarray(ctx, view) && !js_is_arraybuffer(ctx, view))
+    return JS_ThrowTypeError(ctx, "read(view) requires an ArrayBuffer or TypedArray on a BYOB reader");
+
+  ret = read_next(rd, ctx, &op);
 
   if(JS_IsException(ret))
     return ret;
 
+  if(rd->byob && op)
+    op->view = JS_DupValue(ctx, view);
+
   if((st = rd->stream)) {
     if(queue_empty(&st->q)) {
-      JSValue tmp = js_readable_callback(ctx, st, READABLE_PULL, 1, &st->controller);
+      JSValue tmp = readable_pull(st, ctx);
       JS_FreeValue(ctx, tmp);
     }
   }
@@ -236,6 +348,7 @@ reader_clean(Reader* rd, JSContext* ctx) {
     if(read_done(el)) {
       // printf("reader_clean() delete[%i]\n", el->seq);
       list_del(&el->link);
+      JS_FreeValue(ctx, el->view);
       js_free(ctx, el);
       ret++;
       continue;
@@ -246,6 +359,82 @@ reader_clean(Reader* rd, JSContext* ctx) {
   return ret;
 }
 
+/**
+ * Oldest read still waiting for its promise to be resolved
+ */
+static Read*
+reader_pending(Reader* rd) {
+  Read* el;
+
+  list_for_each_prev(el, &rd->reads) {
+    if(promise_pending(&el->promise.funcs))
+      return el;
+  }
+
+  return 0;
+}
+
+/**
+ * Copy queued bytes straight into the caller-supplied view of a BYOB read
+ * and resolve it with a view of the same type over the bytes written.
+ */
+static BOOL
+reader_fill(Reader* rd, Read* op, JSContext* ctx) {
+  Readable* st = rd->stream;
+  JSValue buffer, ctor, view, result;
+  size_t offset = 0, length, elsize = 1, n, size;
+  uint8_t* data;
+  BOOL typed, done, ok;
+
+  if((typed = js_is_typedarray(ctx, op->view))) {
+    buffer = JS_GetTypedArrayBuffer(ctx, op->view, &offset, &length, &elsize);
+  } else {
+    buffer = JS_DupValue(ctx, op->view);
+    length = js_arraybuffer_length(ctx, buffer);
+  }
+
+  if(!(data = JS_GetArrayBuffer(ctx, &size, buffer))) {
+    JS_FreeValue(ctx, buffer);
+    return FALSE;
+  }
+
+  /* a wrapped buffer that was detached fails this read, not the process */
+  if(!queue_attached(&st->q, ctx)) {
+    JSValue error = JS_GetException(ctx);
+
+    ok = promise_reject(ctx, &op->promise.funcs, error);
+    JS_FreeValue(ctx, error);
+    JS_FreeValue(ctx, buffer);
+    reader_clean(rd, ctx);
+    return ok;
+  }
+
+  n = MIN_NUM(queue_size(&st->q), length);
+  n -= n % elsize;
+
+  if(n == 0 && !(done = readable_closed(st))) {
+    JS_FreeValue(ctx, buffer);
+    return FALSE;
+  }
+
+  n = queue_read(&st->q, data + offset, n);
+  done = n == 0;
+
+  ctor = typed ? JS_GetPropertyStr(ctx, op->view, "constructor") : js_global_get_str(ctx, "Uint8Array");
+  view = JS_CallConstructor(ctx, ctor, 3, (JSValueConst[]){buffer, JS_NewInt64(ctx, offset), JS_NewInt64(ctx, n / elsize)});
+  JS_FreeValue(ctx, ctor);
+  JS_FreeValue(ctx, buffer);
+
+  result = js_iterator_result(ctx, view, done);
+  JS_FreeValue(ctx, view);
+
+  ok = promise_resolve(ctx, &op->promise.funcs, result);
+  JS_FreeValue(ctx, result);
+
+  reader_clean(rd, ctx);
+  return ok;
+}
+
 static int
 reader_update(Reader* rd, JSContext* ctx) {
   JSValue result;
@@ -255,6 +444,21 @@ reader_update(Reader* rd, JSContext* ctx) {
 
   reader_clean(rd, ctx);
 
+  if(rd->byob) {
+    Read* op;
+
+    while((op = reader_pending(rd)) && (!queue_empty(&st->q) || readable_closed(st)))
+      if(reader_fill(rd, op, ctx))
+        ++ret;
+      else
+        break;
+
+    if(readable_closed(st))
+      promise_resolve(ctx, &rd->events[READER_CLOSED].funcs, JS_UNDEFINED);
+
+    return ret;
+  }
+
   // printf("reader_update(1) [%zu] closed=%d queue.size=%zu\n", list_size(&rd->list), readable_closed(st),
   // queue_size(&st->q));
 
@@ -269,7 +473,21 @@ reader_update(Reader* rd, JSContext* ctx) {
     while(!list_empty(&rd->list) && (ch = queue_next(&st->q))) {
       JSValue chunk, result;
       // printf("reader_update(2) Chunk ptr=%p, size=%zu, pos=%zu\n", ch->data, ch->size, ch->pos);
-      chunk = chunk_arraybuffer(ch, ctx);
+      chunk = chunk_value(ch, ctx);
+      chunk_free(ch);
+
+      if(JS_IsException(chunk)) {
+        JSValue error = JS_GetException(ctx);
+        Read* op;
+
+        if((op = reader_pending(rd)) && promise_reject(ctx, &op->promise.funcs, error))
+          ++ret;
+
+        JS_FreeValue(ctx, error);
+        reader_clean(rd, ctx);
+        continue;
+      }
+
       result = js_iterator_result(ctx, chunk, FALSE);
       JS_FreeValue(ctx, chunk);
       if(!reader_passthrough(rd, result, ctx))
@@ -315,6 +533,8 @@ readable_new(JSContext* ctx) {
     st->ref_count = 1;
     st->controller = JS_NULL;
     queue_init(&st->q);
+    strategy_init(&st->strategy);
+    st->fd = -1;
   }
 
   return st;
@@ -329,11 +549,13 @@ readable_dup(Readable* st) {
 static JSValue
 readable_close(Readable* st, JSContext* ctx) {
   JSValue ret = JS_UNDEFINED;
-  static BOOL expected = FALSE;
+  BOOL expected = FALSE;
   // printf("readable_close(1) expected=%i, closed=%i\n", st->closed, expected);
 
   if(atomic_compare_exchange_weak(&st->closed, &expected, TRUE)) {
-    if(readable_locked(st)) {
+    if(st->pipe) {
+      pipe_pump(st->pipe, ctx);
+    } else if(readable_locked(st)) {
       // printf("readable_close(2) expected=%i, closed=%i\n", st->closed, expected);
       promise_resolve(ctx, &st->reader->events[READER_CLOSED].funcs, JS_UNDEFINED);
       reader_close(st->reader, ctx);
@@ -367,6 +589,11 @@ readable_cancel(Readable* st, JSValueConst reason, JSContext* ctx) {
     if(!atomic_compare_exchange_weak(&st->closed, &expected, TRUE))
       JS_ThrowInternalError(ctx, "No locked ReadableStream associated");*/
 
+  if(st->pipe) {
+    pipe_abort(st->pipe, reason, TRUE, ctx);
+    return ret;
+  }
+
   if(readable_locked(st)) {
     promise_resolve(ctx, &st->reader->events[READER_CLOSED].funcs, JS_UNDEFINED);
 
@@ -377,13 +604,198 @@ readable_cancel(Readable* st, JSValueConst reason, JSContext* ctx) {
   /*  ret = js_readable_callback(ctx, st, READABLE_CANCEL, 1, &reason);*/
 }
 
+typedef struct {
+  JSRuntime* rt;
+  JSValue value;
+  /* set when ch->data points into value, at this offset */
+  BOOL wrapped;
+  size_t offset;
+} ChunkValue;
+
+static void
+chunk_value_release(Chunk* ch) {
+  ChunkValue* cv = ch->opaque;
+
+  JS_FreeValueRT(cv->rt, cv->value);
+}
+
+/**
+ * Wrap the memory of an ArrayBuffer/TypedArray as a Chunk without copying;
+ * the chunk keeps a reference to the buffer.
+ */
+static Chunk*
+chunk_from_value(JSValueConst value, JSContext* ctx) {
+  InputBuffer input = js_input_buffer(ctx, value);
+  ChunkValue* cv;
+  Chunk* ch;
+
+  if(JS_IsException(input.value))
+    return 0;
+
+  if(!(ch = chunk_external(input_buffer_data(&input), input_buffer_length(&input), chunk_value_release, sizeof(ChunkValue)))) {
+    input_buffer_free(&input, ctx);
+    return 0;
+  }
+
+  cv = ch->opaque;
+  cv->rt = JS_GetRuntime(ctx);
+  cv->value = input.value;
+  cv->wrapped = TRUE;
+  cv->offset = input_buffer_data(&input) - input.data;
+  return ch;
+}
+
+/**
+ * A wrapped buffer can be detached (transferred) or shrunk while its
+ * chunk is queued. Looks its memory up again before the chunk's bytes are
+ * read, and throws a TypeError when they are gone.
+ */
+static BOOL
+chunk_attached(Chunk* ch, JSContext* ctx) {
+  ChunkValue* cv;
+  uint8_t* ptr;
+  size_t len;
+
+  if(ch->release != chunk_value_release || !(cv = ch->opaque)->wrapped)
+    return TRUE;
+
+  if(!(ptr = JS_GetArrayBuffer(ctx, &len, cv->value)))
+    return FALSE;
+
+  if(len < cv->offset + ch->size) {
+    JS_ThrowTypeError(ctx, "enqueued buffer was detached or shrunk");
+    return FALSE;
+  }
+
+  ch->data = ptr + cv->offset;
+  return TRUE;
+}
+
+static BOOL
+queue_attached(Queue* q, JSContext* ctx) {
+  struct list_head* el;
+
+  list_for_each(el, &q->list) if(!chunk_attached(list_entry(el, Chunk, link), ctx)) return FALSE;
+
+  return TRUE;
+}
+
+/**
+ * Turn an enqueued value into a Chunk. Buffers are wrapped (or copied when
+ * \p copy is set), any other value is copied and kept alongside so it can be
+ * handed on unchanged.
+ */
+static Chunk*
+chunk_retain(JSValueConst value, BOOL copy, JSContext* ctx) {
+  BOOL buffer = js_is_typedarray(ctx, value) || js_is_arraybuffer(ctx, value);
+  InputBuffer input;
+  ChunkValue* cv;
+  Chunk* ch;
+
+  if(buffer && !copy)
+    return chunk_from_value(value, ctx);
+
+  if(buffer || JS_IsString(value))
+    input = js_input_chars(ctx, value);
+  else
+    input = (InputBuffer){{{0, 0}}, 0, 0, JS_UNDEFINED, OFFSET_INIT()};
+
+  if((ch = chunk_alloc(sizeof(ChunkValue) + input_buffer_length(&input)))) {
+    ch->data = ch->buf + sizeof(ChunkValue);
+    ch->size = input_buffer_length(&input);
+
+    if(ch->size)
+      memcpy(ch->data, input_buffer_data(&input), ch->size);
+
+    if(!buffer) {
+      ch->opaque = cv = (ChunkValue*)ch->buf;
+      *cv = (ChunkValue){JS_GetRuntime(ctx), JS_DupValue(ctx, value), FALSE, 0};
+      ch->release = chunk_value_release;
+    }
+  }
+
+  input_buffer_free(&input, ctx);
+  return ch;
+}
+
+/**
+ * JS value for a chunk: the original value if it still holds one and has
+ * not been partially consumed, otherwise an ArrayBuffer over its bytes.
+ */
+static JSValue
+chunk_value(Chunk* ch, JSContext* ctx) {
+  if(ch->release == chunk_value_release && ch->pos == 0)
+    return JS_DupValue(ctx, ((ChunkValue*)ch->opaque)->value);
+
+  if(!chunk_attached(ch, ctx))
+    return JS_EXCEPTION;
+
+  return chunk_arraybuffer(ch, ctx);
+}
+
+/**
+ * Hand a chunk to a readable stream: to a waiting read, the pipe reading
+ * from it, or its queue. Takes over the reference to \p ch.
+ */
+static void
+readable_put(Readable* st, Chunk* ch, JSContext* ctx) {
+  Reader* rd = readable_locked(st);
+
+  if(!st->pipe && rd && !rd->byob && reader_pending(rd)) {
+    JSValue chunk = chunk_value(ch, ctx), result = js_iterator_result(ctx, chunk, FALSE);
+
+    chunk_free(ch);
+    reader_passthrough(rd, result, ctx);
+    JS_FreeValue(ctx, result);
+    JS_FreeValue(ctx, chunk);
+    return;
+  }
+
+  queue_put(&st->q, ch);
+
+  if(st->pipe)
+    pipe_pump(st->pipe, ctx);
+  else if(rd && rd->byob)
+    reader_update(rd, ctx);
+}
+
 static JSValue
-readable_enqueue(Readable* st, JSValueConst chunk, JSContext* ctx) {
+readable_enqueue(Readable* st, JSValueConst chunk, BOOL copy, JSContext* ctx) {
   InputBuffer input;
   int64_t ret;
   Reader* rd;
   // size_t old_size;
 
+  if(st->pipe) {
+    Chunk* ch;
+
+    if(!(ch = chunk_retain(chunk, copy, ctx)))
+      return JS_EXCEPTION;
+
+    ret = ch->size;
+    readable_put(st, ch, ctx);
+    return JS_NewInt64(ctx, ret);
+  }
+
+  if(readable_locked(st) && (rd = st->reader) && rd->byob) {
+    Chunk* ch;
+
+    if(!copy && (js_is_typedarray(ctx, chunk) || js_is_arraybuffer(ctx, chunk))) {
+      if(!(ch = chunk_from_value(chunk, ctx)))
+        return JS_EXCEPTION;
+
+      ret = ch->size;
+      queue_put(&st->q, ch);
+    } else {
+      input = js_input_chars(ctx, chunk);
+      ret = queue_write(&st->q, input.data, input.size);
+      input_buffer_free(&input, ctx);
+    }
+
+    reader_update(rd, ctx);
+    return ret < 0 ? JS_ThrowInternalError(ctx, "enqueue() returned %" PRId64, ret) : JS_NewInt64(ctx, ret);
+  }
+
   if(readable_locked(st) && (rd = st->reader)) {
     JSValue result = js_iterator_result(ctx, chunk, FALSE);
     BOOL ok;
@@ -394,6 +806,17 @@ readable_enqueue(Readable* st, JSValueConst chunk, JSContext* ctx) {
       return JS_UNDEFINED;
   }
 
+  if(!copy && (js_is_typedarray(ctx, chunk) || js_is_arraybuffer(ctx, chunk))) {
+    Chunk* ch;
+
+    if(!(ch = chunk_from_value(chunk, ctx)))
+      return JS_EXCEPTION;
+
+    ret = ch->size;
+    queue_put(&st->q, ch);
+    return JS_NewInt64(ctx, ret);
+  }
+
   input = js_input_chars(ctx, chunk);
   // old_size = queue_size(&st->q);
   ret = queue_write(&st->q, input.data, input.size);
@@ -402,6 +825,110 @@ readable_enqueue(Readable* st, JSValueConst chunk, JSContext* ctx) {
   return ret < 0 ? JS_ThrowInternalError(ctx, "enqueue() returned %" PRId64, ret) : JS_NewInt64(ctx, ret);
 }
 
+static JSValue js_readable_fd_handler(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, JSValue* data);
+
+/**
+ * Install or remove the event loop read handler of an fd-backed stream
+ */
+static BOOL
+readable_fd_arm(Readable* st, BOOL arm, JSContext* ctx) {
+  JSValue set_handler, handler = JS_NULL;
+  BOOL ret;
+
+  if(st->fd < 0 || st->fd_armed == !!arm)
+    return TRUE;
+
+  if(JS_IsException(set_handler = js_iohandler_fn(ctx, FALSE)))
+    return FALSE;
+
+  if(arm) {
+    JSValue obj = js_readable_wrap(ctx, st);
+
+    handler = JS_NewCFunctionData(ctx, js_readable_fd_handler, 0, 0, 1, &obj);
+    JS_FreeValue(ctx, obj);
+  }
+
+  if((ret = js_iohandler_set(ctx, set_handler, st->fd, handler)))
+    st->fd_armed = !!arm;
+
+  JS_FreeValue(ctx, set_handler);
+  return ret;
+}
+
+static void
+readable_fd_release(Readable* st, JSContext* ctx) {
+  readable_fd_arm(st, FALSE, ctx);
+
+  if(st->fd >= 0 && st->fd_autoclose)
+    close(st->fd);
+
+  st->fd = -1;
+}
+
+/**
+ * fd is readable: read() straight into a fresh Chunk and hand it on. Reading
+ * stops once the queue reaches the highWaterMark and resumes on the next pull.
+ */
+static JSValue
+js_readable_fd_handler(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, JSValue* data) {
+  Readable* st;
+  Chunk* ch;
+  ssize_t n;
+
+  if(!(st = js_readable_data(data[0])) || st->fd < 0)
+    return JS_UNDEFINED;
+
+  if(!(ch = chunk_alloc(st->chunk_size)))
+    return JS_ThrowOutOfMemory(ctx);
+
+  if((n = read(st->fd, ch->data, st->chunk_size)) > 0) {
+    ch->size = n;
+    readable_put(st, ch, ctx);
+
+    if(queue_desired(&st->q, &st->strategy) <= 0)
+      readable_fd_arm(st, FALSE, ctx);
+
+    return JS_UNDEFINED;
+  }
+
+  chunk_free(ch);
+
+  if(n == 0) {
+    readable_fd_release(st, ctx);
+    JS_FreeValue(ctx, readable_close(st, ctx));
+  } else if(!syscallerror_retry(errno)) {
+    JSValue error = js_syscallerror_new(ctx, "read", errno);
+
+    readable_fd_release(st, ctx);
+    JS_FreeValue(ctx, readable_cancel(st, error, ctx));
+    JS_FreeValue(ctx, error);
+  }
+
+  return JS_UNDEFINED;
+}
+
+/**
+ * Ask the source for more data: arm the read handler of an fd-backed stream
+ * or call the underlying source's pull(controller)
+ */
+static JSValue
+readable_pull(Readable* st, JSContext* ctx) {
+  if(st->fd >= 0)
+    return readable_fd_arm(st, TRUE, ctx) ? JS_UNDEFINED : JS_EXCEPTION;
+
+  return js_readable_callback(ctx, st, READABLE_PULL, 1, &st->controller);
+}
+
+static JSValue
+readable_source_cancel(Readable* st, JSValueConst reason, JSContext* ctx) {
+  if(st->fd >= 0) {
+    readable_fd_release(st, ctx);
+    return JS_UNDEFINED;
+  }
+
+  return js_readable_callback(ctx, st, READABLE_CANCEL, 1, &reason);
+}
+
 static int
 readable_lock(Readable* st, Reader* rd) {
   Reader* expected = 0;
@@ -414,12 +941,14 @@ readable_unlock(Readable* st, Reader* rd) {
 }
 
 static Reader*
-readable_get_reader(Readable* st, JSContext* ctx) {
+readable_get_reader(Readable* st, BOOL byob, JSContext* ctx) {
   Reader* rd;
 
   if(!(rd = reader_new(ctx, st)))
     return 0;
 
+  rd->byob = byob;
+
   if(!readable_lock(st, rd)) {
     js_free(ctx, rd);
     rd = 0;
@@ -437,6 +966,9 @@ readable_free(Readable* st, JSRuntime* rt) {
     for(size_t i = 0; i < countof(st->on); i++)
       JS_FreeValueRT(rt, st->on[i]);
 
+    if(st->fd >= 0 && st->fd_autoclose)
+      close(st->fd);
+
     queue_clear(&st->q);
     js_free_rt(rt, st);
   }
@@ -539,7 +1071,7 @@ js_reader_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst a
     }
 
     case READER_READ: {
-      ret = reader_read(rd, ctx);
+      ret = reader_read(rd, argc > 0 ? argv[0] : JS_UNDEFINED, ctx);
       break;
     }
 
@@ -633,6 +1165,9 @@ js_readable_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSVal
   if(!(st = readable_new(ctx)))
     return JS_EXCEPTION;
 
+  if(argc >= 2 && !strategy_from_value(ctx, argv[1], &st->strategy))
+    goto fail;
+
   proto = JS_GetPropertyStr(ctx, new_target, "prototype");
   if(JS_IsException(proto))
     proto = JS_DupValue(ctx, readable_proto);
@@ -692,6 +1227,8 @@ JSValue js_readable_iterator(JSContext* ctx, JSValueConst this_val, int argc, JS
 enum {
   READABLE_ABORT = 0,
   READABLE_GET_READER,
+  READABLE_PIPE_TO,
+  READABLE_PIPE_THROUGH,
 };
 
 JSValue
@@ -715,10 +1252,70 @@ js_readable_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
     case READABLE_GET_READER: {
       Reader* rd;
 
-      if((rd = readable_get_reader(st, ctx)))
+      BOOL byob = FALSE;
+
+      if(argc > 0 && JS_IsObject(argv[0])) {
+        const char* mode;
+
+        if((mode = js_get_propertystr_cstring(ctx, argv[0], "mode"))) {
+          if(!strcmp(mode, "byob"))
+            byob = TRUE;
+          else if(strcmp(mode, "default"))
+            ret = JS_ThrowRangeError(ctx, "invalid reader mode '%s'", mode);
+
+          JS_FreeCString(ctx, mode);
+
+          if(JS_IsException(ret))
+            break;
+        }
+      }
+
+      if((rd = readable_get_reader(st, byob, ctx)))
         ret = js_reader_wrap(ctx, rd);
       break;
     }
+
+    case READABLE_PIPE_TO: {
+      Writable* dest;
+
+      if(!(dest = js_writable_data2(ctx, argv[0])))
+        return JS_EXCEPTION;
+
+      ret = readable_pipe(st, dest, argc > 1 ? argv[1] : JS_UNDEFINED, ctx);
+      break;
+    }
+
+    case READABLE_PIPE_THROUGH: {
+      Transform* tr;
+      JSValue promise;
+
+      if((tr = js_transform_data(argv[0]))) {
+        promise = readable_pipe(st, tr->writable, argc > 1 ? argv[1] : JS_UNDEFINED, ctx);
+
+        if(!JS_IsException(promise))
+          ret = js_readable_wrap(ctx, tr->readable);
+      } else {
+        JSValue writable = JS_GetPropertyStr(ctx, argv[0], "writable");
+        Writable* dest;
+
+        if(!(dest = js_writable_data2(ctx, writable))) {
+          JS_FreeValue(ctx, writable);
+          return JS_EXCEPTION;
+        }
+
+        promise = readable_pipe(st, dest, argc > 1 ? argv[1] : JS_UNDEFINED, ctx);
+        JS_FreeValue(ctx, writable);
+
+        if(!JS_IsException(promise))
+          ret = JS_GetPropertyStr(ctx, argv[0], "readable");
+      }
+
+      if(JS_IsException(promise))
+        return JS_EXCEPTION;
+
+      JS_FreeValue(ctx, promise);
+      break;
+    }
   }
 
   return ret;
@@ -772,7 +1369,12 @@ js_readable_controller(JSContext* ctx, JSValueConst this_val, int argc, JSValueC
     }
 
     case READABLE_ENQUEUE: {
-      ret = readable_enqueue(st, argv[0], ctx);
+      BOOL copy = TRUE;
+
+      if(argc > 1 && JS_IsObject(argv[1]) && js_has_propertystr(ctx, argv[1], "copy"))
+        copy = js_get_propertystr_bool(ctx, argv[1], "copy");
+
+      ret = readable_enqueue(st, argv[0], copy, ctx);
       break;
     }
 
@@ -793,13 +1395,8 @@ js_readable_desired(JSContext* ctx, JSValueConst this_val) {
   if(!(st = js_readable_data2(ctx, this_val)))
     return JS_EXCEPTION;
 
-  if(readable_locked(st)) {
-    Reader* rd;
-
-    if((rd = st->reader)) {
-      ret = JS_NewUint32(ctx, rd->desired_size);
-    }
-  }
+  if(!readable_closed(st))
+    ret = JS_NewInt64(ctx, queue_desired(&st->q, &st->strategy));
 
   return ret;
 }
@@ -820,6 +1417,8 @@ JSClassDef js_readable_class = {
 const JSCFunctionListEntry js_readable_proto_funcs[] = {
     JS_CFUNC_MAGIC_DEF("cancel", 0, js_readable_method, READABLE_ABORT),
     JS_CFUNC_MAGIC_DEF("getReader", 0, js_readable_method, READABLE_GET_READER),
+    JS_CFUNC_MAGIC_DEF("pipeTo", 1, js_readable_method, READABLE_PIPE_TO),
+    JS_CFUNC_MAGIC_DEF("pipeThrough", 1, js_readable_method, READABLE_PIPE_THROUGH),
     JS_CGETSET_MAGIC_FLAGS_DEF("closed", js_readable_get, 0, STREAM_CLOSED, JS_PROP_ENUMERABLE),
     JS_CGETSET_MAGIC_FLAGS_DEF("locked", js_readable_get, 0, STREAM_LOCKED, JS_PROP_ENUMERABLE),
     JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Readable", JS_PROP_CONFIGURABLE),
@@ -840,12 +1439,186 @@ enum {
   WRITABLE_GET_WRITER,
 };
 
-static Writer*
-writer_new(JSContext* ctx, Writable* st) {
-  Writer* wr;
+static JSValue js_writable_fd_handler(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, JSValue* data);
 
-  if((wr = js_mallocz(ctx, sizeof(Writer)))) {
-    atomic_store(&wr->stream, st);
+/**
+ * Install or remove the event loop write handler of an fd-backed stream
+ */
+static BOOL
+writable_fd_arm(Writable* st, BOOL arm, JSContext* ctx) {
+  JSValue set_handler, handler = JS_NULL;
+  BOOL ret;
+
+  if(st->fd < 0 || st->fd_armed == !!arm)
+    return TRUE;
+
+  if(JS_IsException(set_handler = js_iohandler_fn(ctx, TRUE)))
+    return FALSE;
+
+  if(arm) {
+    JSValue obj = js_writable_wrap(ctx, st);
+
+    handler = JS_NewCFunctionData(ctx, js_writable_fd_handler, 0, 0, 1, &obj);
+    JS_FreeValue(ctx, obj);
+  }
+
+  if((ret = js_iohandler_set(ctx, set_handler, st->fd, handler)))
+    st->fd_armed = !!arm;
+
+  JS_FreeValue(ctx, set_handler);
+  return ret;
+}
+
+static void
+writable_fd_release(Writable* st, JSContext* ctx) {
+  writable_fd_arm(st, FALSE, ctx);
+
+  if(st->fd >= 0 && st->fd_autoclose)
+    close(st->fd);
+
+  st->fd = -1;
+}
+
+/**
+ * Gather the queued chunks into writev() calls until the queue is empty or
+ * the fd would block. Returns FALSE on a write error (errno is set).
+ */
+static BOOL
+writable_fd_flush(Writable* st) {
+  while(!queue_empty(&st->q)) {
+    ssize_t n = queue_writev(&st->q, st->fd, SIZE_MAX);
+
+    if(n < 0)
+      return syscallerror_retry(errno);
+  }
+
+  return TRUE;
+}
+
+static void
+writable_fd_error(Writable* st, JSContext* ctx) {
+  JSValue error = js_syscallerror_new(ctx, "writev", errno);
+
+  queue_clear(&st->q);
+  writable_fd_release(st, ctx);
+  promise_reject(ctx, &st->flushed.funcs, error);
+  JS_FreeValue(ctx, error);
+}
+
+/**
+ * Queue drained: wake up pending writes and finish a deferred close()
+ */
+static void
+writable_fd_drained(Writable* st, JSContext* ctx) {
+  writable_fd_arm(st, FALSE, ctx);
+
+  if(st->fd_closing)
+    writable_fd_release(st, ctx);
+
+  promise_resolve(ctx, &st->flushed.funcs, JS_UNDEFINED);
+}
+
+static JSValue
+js_writable_fd_handler(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, JSValue* data) {
+  Writable* st;
+
+  if(!(st = js_writable_data(data[0])) || st->fd < 0)
+    return JS_UNDEFINED;
+
+  if(!writable_fd_flush(st))
+    writable_fd_error(st, ctx);
+  else if(queue_empty(&st->q))
+    writable_fd_drained(st, ctx);
+
+  return JS_UNDEFINED;
+}
+
+/**
+ * Promise settled once everything queued so far has been written
+ */
+static JSValue
+writable_fd_pending(Writable* st, JSContext* ctx) {
+  if(!writable_fd_arm(st, TRUE, ctx))
+    return JS_EXCEPTION;
+
+  if(promise_done(&st->flushed.funcs)) {
+    promise_free(JS_GetRuntime(ctx), &st->flushed);
+
+    if(!promise_init(ctx, &st->flushed))
+      return JS_EXCEPTION;
+  }
+
+  return JS_DupValue(ctx, st->flushed.value);
+}
+
+/**
+ * Native sink of an fd-backed WritableStream: queue the chunk and write out
+ * what the fd takes right away. Takes over the reference to \p ch.
+ */
+static JSValue
+writable_fd_write(Writable* st, Chunk* ch, JSContext* ctx) {
+  if(st->fd < 0 || st->fd_closing) {
+    chunk_free(ch);
+    return JS_ThrowTypeError(ctx, "WritableStream is closed");
+  }
+
+  if(!chunk_attached(ch, ctx)) {
+    chunk_free(ch);
+    return JS_EXCEPTION;
+  }
+
+  queue_put(&st->q, ch);
+
+  if(!writable_fd_flush(st)) {
+    JSValue error = js_syscallerror_new(ctx, "writev", errno);
+
+    queue_clear(&st->q);
+    return JS_Throw(ctx, error);
+  }
+
+  return queue_empty(&st->q) ? JS_UNDEFINED : writable_fd_pending(st, ctx);
+}
+
+static JSValue
+writable_fd_close(Writable* st, JSContext* ctx) {
+  if(queue_empty(&st->q)) {
+    writable_fd_release(st, ctx);
+    return JS_UNDEFINED;
+  }
+
+  st->fd_closing = TRUE;
+  return writable_fd_pending(st, ctx);
+}
+
+static void
+writable_fd_abort(Writable* st, JSValueConst reason, JSContext* ctx) {
+  queue_clear(&st->q);
+  writable_fd_release(st, ctx);
+  promise_reject(ctx, &st->flushed.funcs, reason);
+}
+
+/**
+ * Resolve writer.ready while the sink has room below its highWaterMark and
+ * re-arm it with a pending promise once writes in flight fill it up.
+ */
+static void
+writer_update(Writer* wr, Writable* st, JSContext* ctx) {
+  Promise* ready = &wr->events[WRITER_READY];
+
+  if(writable_desired(st) > 0) {
+    promise_resolve(ctx, &ready->funcs, JS_UNDEFINED);
+  } else if(promise_done(&ready->funcs)) {
+    promise_free(JS_GetRuntime(ctx), ready);
+    promise_init(ctx, ready);
+  }
+}
+
+static Writer*
+writer_new(JSContext* ctx, Writable* st) {
+  Writer* wr;
+
+  if((wr = js_mallocz(ctx, sizeof(Writer)))) {
+    atomic_store(&wr->stream, st);
     promise_init(ctx, &wr->events[WRITER_CLOSED]);
     promise_init(ctx, &wr->events[WRITER_READY]);
 
@@ -858,6 +1631,7 @@ writer_new(JSContext* ctx, Writable* st) {
         promise_resolve(ctx, &wr->events[WRITER_READY].funcs, JS_TRUE);*/
 
     JS_FreeValue(ctx, ret);
+    writer_update(wr, st, ctx);
   }
 
   return wr;
@@ -888,8 +1662,30 @@ ssize_t bytes;
    chunk->opaque = promise_new(ctx, &ret);
  }*/
   if(wr->stream) {
-    JSValueConst args[2] = {chunk, wr->stream->controller};
-    return js_writable_callback(ctx, wr->stream, WRITABLE_WRITE, 2, args);
+    Writable* st = wr->stream;
+    JSValueConst args[2] = {chunk, st->controller};
+    JSValue ret;
+
+    /* identity TransformStream: pass the chunk on to its readable side */
+    if(!JS_IsFunction(ctx, st->on[WRITABLE_WRITE]) && st->forward)
+      return readable_enqueue(st->forward, chunk, TRUE, ctx);
+
+    if(st->fd >= 0) {
+      Chunk* ch;
+
+      if(!(ch = chunk_retain(chunk, FALSE, ctx)))
+        return JS_EXCEPTION;
+
+      ret = writable_fd_write(st, ch, ctx);
+    } else {
+      ret = js_writable_callback(ctx, st, WRITABLE_WRITE, 2, args);
+    }
+
+    if(js_is_promise(ctx, ret))
+      writable_track(st, ret, strategy_size(&st->strategy, chunk, ctx), 0, ctx);
+
+    writer_update(wr, st, ctx);
+    return ret;
   }
 
   return JS_ThrowInternalError(ctx, "no WriteableStream");
@@ -902,7 +1698,10 @@ writer_close(Writer* wr, JSContext* ctx) {
   if(!wr->stream)
     return JS_ThrowInternalError(ctx, "no WriteableStream");
 
-  ret = js_writable_callback(ctx, wr->stream, WRITABLE_CLOSE, 0, 0);
+  if(wr->stream->fd >= 0)
+    return writable_fd_close(wr->stream, ctx);
+
+  ret = js_writable_callback(ctx, wr->stream, WRITABLE_CLOSE, 1, &wr->stream->controller);
 
   if(js_is_promise(ctx, ret)) {
     ret = promise_forward(ctx, ret, &wr->events[WRITER_CLOSED]);
@@ -917,6 +1716,11 @@ writer_abort(Writer* wr, JSValueConst reason, JSContext* ctx) {
   if(!wr->stream)
     return JS_ThrowInternalError(ctx, "no WriteableStream");
 
+  if(wr->stream->fd >= 0) {
+    writable_fd_abort(wr->stream, reason, ctx);
+    return JS_UNDEFINED;
+  }
+
   ret = js_writable_callback(ctx, wr->stream, WRITABLE_ABORT, 1, &reason);
 
   if(js_is_promise(ctx, ret)) {
@@ -950,6 +1754,9 @@ writable_new(JSContext* ctx) {
     st->on[3] = st->on[2] = st->on[1] = st->on[0] = JS_NULL;
     st->underlying_sink = JS_NULL;
     st->controller = JS_NULL;
+    strategy_init(&st->strategy);
+    st->fd = -1;
+    promise_zero(&st->flushed);
   }
 
   return st;
@@ -964,7 +1771,7 @@ writable_dup(Writable* st) {
 static JSValue
 writable_abort(Writable* st, JSValueConst reason, JSContext* ctx) {
   JSValue ret = JS_UNDEFINED;
-  static BOOL expected = FALSE;
+  BOOL expected = FALSE;
 
   if(atomic_compare_exchange_weak(&st->closed, &expected, TRUE)) {
     st->reason = js_tostring(ctx, reason);
@@ -980,7 +1787,7 @@ writable_abort(Writable* st, JSValueConst reason, JSContext* ctx) {
 static JSValue
 writable_close(Writable* st, JSContext* ctx) {
   JSValue ret = JS_UNDEFINED;
-  static BOOL expected = FALSE;
+  BOOL expected = FALSE;
 
   if(atomic_compare_exchange_weak(&st->closed, &expected, TRUE)) {
     if(writable_locked(st)) {
@@ -1021,9 +1828,16 @@ writable_free(Writable* st, JSRuntime* rt) {
     JS_FreeValueRT(rt, st->underlying_sink);
     JS_FreeValueRT(rt, st->controller);
 
+    if(st->forward)
+      readable_free(st->forward, rt);
+
     for(size_t i = 0; i < countof(st->on); i++)
       JS_FreeValueRT(rt, st->on[i]);
 
+    if(st->fd >= 0 && st->fd_autoclose)
+      close(st->fd);
+
+    promise_free(rt, &st->flushed);
     queue_clear(&st->q);
     js_free_rt(rt, st);
   }
@@ -1121,6 +1935,10 @@ js_writer_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst a
   return ret;
 }
 
+enum {
+  WRITER_DESIRED_SIZE = WRITER_READY + 1,
+};
+
 JSValue
 js_writer_get(JSContext* ctx, JSValueConst this_val, int magic) {
   Writer* wr;
@@ -1139,6 +1957,14 @@ js_writer_get(JSContext* ctx, JSValueConst this_val, int magic) {
       ret = JS_DupValue(ctx, wr->events[WRITER_READY].value);
       break;
     }
+
+    case WRITER_DESIRED_SIZE: {
+      if(wr->stream && !writable_closed(wr->stream))
+        ret = JS_NewInt64(ctx, writable_desired(wr->stream));
+      else
+        ret = JS_NULL;
+      break;
+    }
   }
   return ret;
 }
@@ -1164,6 +1990,7 @@ const JSCFunctionListEntry js_writer_proto_funcs[] = {
     JS_CFUNC_MAGIC_DEF("releaseLock", 0, js_writer_method, WRITER_RELEASE_LOCK),
     JS_CGETSET_MAGIC_DEF("closed", js_writer_get, 0, WRITER_CLOSED),
     JS_CGETSET_MAGIC_DEF("ready", js_writer_get, 0, WRITER_READY),
+    JS_CGETSET_MAGIC_DEF("desiredSize", js_writer_get, 0, WRITER_DESIRED_SIZE),
     JS_PROP_STRING_DEF("[Symbol.toStringTag]", "StreamWriter", JS_PROP_CONFIGURABLE),
 };
 
@@ -1186,6 +2013,9 @@ js_writable_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSVal
   if(!(st = writable_new(ctx)))
     return JS_EXCEPTION;
 
+  if(argc >= 2 && !strategy_from_value(ctx, argv[1], &st->strategy))
+    goto fail;
+
   proto = JS_GetPropertyStr(ctx, new_target, "prototype");
   if(JS_IsException(proto))
     proto = JS_DupValue(ctx, writable_proto);
@@ -1342,6 +2172,341 @@ const JSCFunctionListEntry js_writable_controller_funcs[] = {
     JS_PROP_STRING_DEF("[Symbol.toStringTag]", "WritableStreamDefaultController", JS_PROP_CONFIGURABLE),
 };
 
+typedef struct {
+  int ref_count;
+  BOOL settled;
+  JSRuntime* rt;
+  Writable* st;
+  Pipe* pipe;
+  int64_t size;
+} WriteOp;
+
+static void
+write_op_free(void* opaque) {
+  WriteOp* op = opaque;
+
+  if(--op->ref_count == 0) {
+    writable_free(op->st, op->rt);
+
+    if(op->pipe)
+      pipe_free(op->pipe);
+
+    js_free_rt(op->rt, op);
+  }
+}
+
+static JSValue
+write_op_settled(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* opaque) {
+  WriteOp* op = opaque;
+  Writer* wr;
+
+  if(op->settled)
+    return JS_UNDEFINED;
+
+  op->settled = TRUE;
+  op->st->inflight -= op->size;
+
+  if((wr = writable_locked(op->st)))
+    writer_update(wr, op->st, ctx);
+
+  if(op->pipe) {
+    if(magic)
+      pipe_abort(op->pipe, argc > 0 ? argv[0] : JS_UNDEFINED, FALSE, ctx);
+    else
+      pipe_pump(op->pipe, ctx);
+  }
+
+  return JS_UNDEFINED;
+}
+
+/**
+ * Count \p size against the sink's highWaterMark until the promise returned
+ * by write() settles, then wake up writer.ready and the pipe (if any).
+ */
+static void
+writable_track(Writable* st, JSValueConst promise, int64_t size, Pipe* p, JSContext* ctx) {
+  JSValue fn, ret, handlers[2];
+  WriteOp* op;
+
+  if(!(op = js_mallocz(ctx, sizeof(WriteOp))))
+    return;
+
+  op->ref_count = 2;
+  op->rt = JS_GetRuntime(ctx);
+  op->st = writable_dup(st);
+  op->pipe = p ? pipe_dup(p) : 0;
+  op->size = size;
+
+  st->inflight += size;
+
+  handlers[0] = js_function_cclosure(ctx, write_op_settled, 1, 0, op, write_op_free);
+  handlers[1] = js_function_cclosure(ctx, write_op_settled, 1, 1, op, write_op_free);
+
+  fn = JS_GetPropertyStr(ctx, promise, "then");
+  ret = JS_Call(ctx, fn, promise, 2, handlers);
+
+  JS_FreeValue(ctx, ret);
+  JS_FreeValue(ctx, fn);
+  JS_FreeValue(ctx, handlers[0]);
+  JS_FreeValue(ctx, handlers[1]);
+}
+
+static Pipe*
+pipe_dup(Pipe* p) {
+  ++p->ref_count;
+  return p;
+}
+
+static void
+pipe_free(Pipe* p) {
+  if(--p->ref_count == 0) {
+    readable_free(p->source, p->rt);
+    writable_free(p->dest, p->rt);
+    promise_free(p->rt, &p->done);
+    js_free_rt(p->rt, p);
+  }
+}
+
+static void
+pipe_release(void* opaque) {
+  pipe_free(opaque);
+}
+
+/**
+ * Release both locks and detach the pipe from its source
+ */
+static void
+pipe_unlock(Pipe* p, JSContext* ctx) {
+  if(p->source->pipe == p) {
+    p->source->pipe = 0;
+    pipe_free(p);
+  }
+
+  if(p->reader) {
+    reader_release_lock(p->reader, ctx);
+    promise_free(p->rt, &p->reader->events[READER_CLOSED]);
+    promise_free(p->rt, &p->reader->events[READER_CANCELLED]);
+    js_free(ctx, p->reader);
+    p->reader = 0;
+  }
+
+  if(p->writer) {
+    writer_release_lock(p->writer, ctx);
+    promise_free(p->rt, &p->writer->events[WRITER_CLOSED]);
+    promise_free(p->rt, &p->writer->events[WRITER_READY]);
+    js_free(ctx, p->writer);
+    p->writer = 0;
+  }
+}
+
+/**
+ * Source is closed and drained: close the destination (unless preventClose)
+ * and resolve the pipe promise once that is done.
+ */
+static void
+pipe_finish(Pipe* p, JSContext* ctx) {
+  JSValue ret = JS_UNDEFINED;
+
+  if(p->finished)
+    return;
+
+  p->finished = TRUE;
+
+  if(!p->prevent_close) {
+    ret = writable_close(p->dest, ctx);
+
+    if(p->dest->forward)
+      JS_FreeValue(ctx, readable_close(p->dest->forward, ctx));
+  }
+
+  pipe_unlock(p, ctx);
+
+  promise_resolve(ctx, &p->done.funcs, JS_IsException(ret) ? JS_UNDEFINED : ret);
+  JS_FreeValue(ctx, ret);
+}
+
+/**
+ * Error on either end: abort the destination when the source failed
+ * (unless preventAbort), cancel the source when the destination failed
+ * (unless preventCancel), then reject the pipe promise.
+ */
+static void
+pipe_abort(Pipe* p, JSValueConst reason, BOOL from_source, JSContext* ctx) {
+  if(p->finished)
+    return;
+
+  p->finished = TRUE;
+  pipe_dup(p);
+
+  if(from_source) {
+    if(!p->prevent_abort) {
+      JS_FreeValue(ctx, writable_abort(p->dest, reason, ctx));
+
+      if(p->dest->forward)
+        JS_FreeValue(ctx, readable_cancel(p->dest->forward, reason, ctx));
+    }
+  } else if(!p->prevent_cancel) {
+    JS_FreeValue(ctx, readable_source_cancel(p->source, reason, ctx));
+  }
+
+  queue_clear(&p->source->q);
+  pipe_unlock(p, ctx);
+
+  promise_reject(ctx, &p->done.funcs, reason);
+  pipe_free(p);
+}
+
+/**
+ * Deliver one chunk. Identity transforms get it moved into their readable
+ * side without a round trip through JS. Takes over the reference to \p ch.
+ */
+static BOOL
+pipe_write(Pipe* p, Chunk* ch, JSContext* ctx) {
+  Writable* dest = p->dest;
+  int64_t size = dest->strategy.bytes ? (int64_t)(ch->size - ch->pos) : 1;
+  JSValue chunk, ret;
+
+  if(dest->fd >= 0) {
+    ret = writable_fd_write(dest, ch, ctx);
+  } else if(!JS_IsFunction(ctx, dest->on[WRITABLE_WRITE])) {
+    if(dest->forward)
+      readable_put(dest->forward, ch, ctx);
+    else
+      chunk_free(ch);
+
+    return TRUE;
+  } else {
+    chunk = chunk_value(ch, ctx);
+    chunk_free(ch);
+
+    ret = JS_IsException(chunk) ? JS_EXCEPTION : js_writable_callback(ctx, dest, WRITABLE_WRITE, 2, (JSValueConst[]){chunk, dest->controller});
+    JS_FreeValue(ctx, chunk);
+  }
+
+  if(JS_IsException(ret)) {
+    JSValue error = JS_GetException(ctx);
+
+    pipe_abort(p, error, FALSE, ctx);
+    JS_FreeValue(ctx, error);
+    return FALSE;
+  }
+
+  if(js_is_promise(ctx, ret))
+    writable_track(dest, ret, size, p, ctx);
+
+  if(p->writer)
+    writer_update(p->writer, dest, ctx);
+
+  JS_FreeValue(ctx, ret);
+  return TRUE;
+}
+
+/**
+ * Destination is full: writes in flight have reached its highWaterMark.
+ * One write is always let through so a zero highWaterMark cannot stall.
+ */
+static inline BOOL
+pipe_saturated(Pipe* p) {
+  return p->dest->inflight > 0 && writable_desired(p->dest) <= 0;
+}
+
+/**
+ * Move queued chunks to the destination while it accepts them. The source
+ * is pulled only when its queue has run dry, so chunks only pile up in the
+ * source queue while the sink is saturated.
+ */
+static void
+pipe_pump(Pipe* p, JSContext* ctx) {
+  Readable* st = p->source;
+  Chunk* ch;
+
+  if(p->pumping)
+    return;
+
+  pipe_dup(p);
+  p->pumping = TRUE;
+
+  while(!p->finished && !pipe_saturated(p)) {
+    if((ch = queue_next(&st->q))) {
+      p->pulled = FALSE;
+
+      if(!pipe_write(p, ch, ctx))
+        break;
+
+      continue;
+    }
+
+    if(readable_closed(st)) {
+      pipe_finish(p, ctx);
+      break;
+    }
+
+    if(p->pulled)
+      break;
+
+    p->pulled = TRUE;
+
+    JSValue ret = readable_pull(st, ctx);
+
+    if(JS_IsException(ret)) {
+      JSValue error = JS_GetException(ctx);
+
+      pipe_abort(p, error, TRUE, ctx);
+      JS_FreeValue(ctx, error);
+      break;
+    }
+
+    JS_FreeValue(ctx, ret);
+  }
+
+  p->pumping = FALSE;
+  pipe_free(p);
+}
+
+static JSValue
+readable_pipe(Readable* st, Writable* dest, JSValueConst options, JSContext* ctx) {
+  Pipe* p;
+  JSValue ret;
+
+  if(readable_locked(st))
+    return JS_ThrowTypeError(ctx, "ReadableStream is locked");
+
+  if(writable_locked(dest))
+    return JS_ThrowTypeError(ctx, "WritableStream is locked");
+
+  if(!(p = js_mallocz(ctx, sizeof(Pipe))))
+    return JS_EXCEPTION;
+
+  p->ref_count = 1;
+  p->rt = JS_GetRuntime(ctx);
+  p->source = readable_dup(st);
+  p->dest = writable_dup(dest);
+
+  if(JS_IsObject(options)) {
+    p->prevent_close = js_get_propertystr_bool(ctx, options, "preventClose");
+    p->prevent_abort = js_get_propertystr_bool(ctx, options, "preventAbort");
+    p->prevent_cancel = js_get_propertystr_bool(ctx, options, "preventCancel");
+  }
+
+  if(!promise_init(ctx, &p->done)) {
+    pipe_free(p);
+    return JS_EXCEPTION;
+  }
+
+  if(!(p->reader = readable_get_reader(st, FALSE, ctx)) || !(p->writer = writable_get_writer(dest, 0, ctx))) {
+    pipe_unlock(p, ctx);
+    pipe_free(p);
+    return JS_ThrowTypeError(ctx, "could not lock streams for piping");
+  }
+
+  st->pipe = pipe_dup(p);
+  ret = JS_DupValue(ctx, p->done.value);
+
+  pipe_pump(p, ctx);
+  pipe_free(p);
+  return ret;
+}
+
 static Transform*
 transform_dup(Transform* st) {
   ++st->ref_count;
@@ -1356,6 +2521,7 @@ transform_new(JSContext* ctx) {
     st->ref_count = 1;
     st->readable = readable_new(ctx);
     st->writable = writable_new(ctx);
+    st->writable->forward = readable_dup(st->readable);
 
     st->controller = JS_NewObjectProtoClass(ctx, transform_controller, js_transform_class_id);
     JS_SetOpaque(st->controller, transform_dup(st));
@@ -1384,6 +2550,15 @@ js_transform_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSVa
   if(!(st = transform_new(ctx)))
     return JS_EXCEPTION;
 
+  if(argc >= 2 && !strategy_from_value(ctx, argv[1], &st->writable->strategy))
+    goto fail;
+
+  /* the readable side of a TransformStream defaults to highWaterMark 0 */
+  st->readable->strategy.high_water_mark = 0;
+
+  if(argc >= 3 && !strategy_from_value(ctx, argv[2], &st->readable->strategy))
+    goto fail;
+
   proto = JS_GetPropertyStr(ctx, new_target, "prototype");
   if(JS_IsException(proto))
     proto = JS_DupValue(ctx, transform_proto);
@@ -1452,7 +2627,7 @@ js_transform_controller(JSContext* ctx, JSValueConst this_val, int argc, JSValue
 
   switch(magic) {
     case TRANSFORM_ENQUEUE: {
-      ret = readable_enqueue(st->readable, argv[0], ctx);
+      ret = readable_enqueue(st->readable, argv[0], TRUE, ctx);
       break;
     }
 
@@ -1480,13 +2655,8 @@ js_transform_desired(JSContext* ctx, JSValueConst this_val) {
   if(!(st = js_transform_data2(ctx, this_val)))
     return JS_EXCEPTION;
 
-  if(readable_locked(st->readable)) {
-    Reader* rd;
-
-    if((rd = st->readable->reader)) {
-      ret = JS_NewUint32(ctx, rd->desired_size);
-    }
-  }
+  if(!readable_closed(st->readable))
+    ret = JS_NewInt64(ctx, queue_desired(&st->readable->q, &st->readable->strategy));
 
   return ret;
 }
@@ -1530,6 +2700,261 @@ const JSCFunctionListEntry js_transform_controller_funcs[] = {
     JS_PROP_STRING_DEF("[Symbol.toStringTag]", "TransformStreamDefaultController", JS_PROP_CONFIGURABLE),
 };
 
+#define STREAM_FD_CHUNK_SIZE 65536
+
+/**
+ * File descriptor argument: a number or an object with an 'fd' property
+ * (Socket, SerialPort, ...). Returns -1 with an exception pending on error.
+ */
+static int
+stream_fd_arg(JSContext* ctx, JSValueConst value) {
+  int32_t fd = -1;
+
+  if(JS_IsObject(value))
+    fd = js_get_propertystr_int32(ctx, value, "fd");
+  else if(JS_ToInt32(ctx, &fd, value))
+    return -1;
+
+  if(fd < 0) {
+    JS_ThrowRangeError(ctx, "invalid file descriptor");
+    return -1;
+  }
+
+  return fd;
+}
+
+/**
+ * ReadableStream.fromFd(fd[, { chunkSize, autoClose }[, strategy]])
+ */
+JSValue
+js_readable_from_fd(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  Readable* st;
+  JSValue obj;
+  int fd;
+
+  if((fd = stream_fd_arg(ctx, argv[0])) < 0)
+    return JS_EXCEPTION;
+
+  if(!(st = readable_new(ctx)))
+    return JS_EXCEPTION;
+
+  st->fd = fd;
+  st->chunk_size = STREAM_FD_CHUNK_SIZE;
+
+  if(argc > 1 && JS_IsObject(argv[1])) {
+    if(js_has_propertystr(ctx, argv[1], "chunkSize"))
+      st->chunk_size = MAX_NUM(js_get_propertystr_uint64(ctx, argv[1], "chunkSize"), 1);
+
+    st->fd_autoclose = js_get_propertystr_bool(ctx, argv[1], "autoClose");
+  }
+
+  if(argc > 2 && !strategy_from_value(ctx, argv[2], &st->strategy)) {
+    st->fd = -1;
+    readable_free(st, JS_GetRuntime(ctx));
+    return JS_EXCEPTION;
+  }
+
+  obj = js_readable_wrap(ctx, st);
+  readable_free(st, JS_GetRuntime(ctx));
+  return obj;
+}
+
+/**
+ * WritableStream.fromFd(fd[, { autoClose }[, strategy]])
+ */
+JSValue
+js_writable_from_fd(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  Writable* st;
+  JSValue obj;
+  int fd;
+
+  if((fd = stream_fd_arg(ctx, argv[0])) < 0)
+    return JS_EXCEPTION;
+
+  if(!(st = writable_new(ctx)))
+    return JS_EXCEPTION;
+
+  st->fd = fd;
+
+  if(argc > 1 && JS_IsObject(argv[1]))
+    st->fd_autoclose = js_get_propertystr_bool(ctx, argv[1], "autoClose");
+
+  if(argc > 2 && !strategy_from_value(ctx, argv[2], &st->strategy)) {
+    st->fd = -1;
+    writable_free(st, JS_GetRuntime(ctx));
+    return JS_EXCEPTION;
+  }
+
+  obj = js_writable_wrap(ctx, st);
+  writable_free(st, JS_GetRuntime(ctx));
+  return obj;
+}
+
+/**
+ * Take the fd out of an unlocked fromFd() stream, which is closed as if
+ * it had reached EOF. A stream that does not own its fd hands out a dup.
+ * *pfd is -1 for other streams; FALSE means the stream is in use.
+ */
+BOOL
+js_stream_detach_fd(JSContext* ctx, JSValueConst value, int* pfd) {
+  Readable* rd;
+  Writable* wr;
+
+  *pfd = -1;
+
+  if((rd = js_readable_data(value)) && rd->fd >= 0) {
+    if(readable_locked(rd) || rd->pipe || !queue_empty(&rd->q)) {
+      JS_ThrowTypeError(ctx, "ReadableStream is locked or has data queued");
+      return FALSE;
+    }
+
+    readable_fd_arm(rd, FALSE, ctx);
+    *pfd = rd->fd_autoclose ? rd->fd : dup(rd->fd);
+    rd->fd = -1;
+    readable_close(rd, ctx);
+  } else if((wr = js_writable_data(value)) && wr->fd >= 0) {
+    if(writable_locked(wr) || !queue_empty(&wr->q)) {
+      JS_ThrowTypeError(ctx, "WritableStream is locked or has data queued");
+      return FALSE;
+    }
+
+    writable_fd_arm(wr, FALSE, ctx);
+    *pfd = wr->fd_autoclose ? wr->fd : dup(wr->fd);
+    wr->fd = -1;
+    writable_close(wr, ctx);
+  }
+
+  return TRUE;
+}
+
+const JSCFunctionListEntry js_readable_static_funcs[] = {
+    JS_CFUNC_DEF("fromFd", 1, js_readable_from_fd),
+};
+
+const JSCFunctionListEntry js_writable_static_funcs[] = {
+    JS_CFUNC_DEF("fromFd", 1, js_writable_from_fd),
+};
+
+static JSValue
+js_strategy_new(JSContext* ctx, JSValueConst new_target, JSValueConst default_proto, BOOL bytes, int argc, JSValueConst argv[]) {
+  JSValue proto, obj, hwm;
+  QueuingStrategy* qs;
+  double d;
+  int r;
+
+  if(argc < 1 || !JS_IsObject(argv[0]) || JS_IsUndefined(hwm = JS_GetPropertyStr(ctx, argv[0], "highWaterMark")))
+    return JS_ThrowTypeError(ctx, "argument 1 must be an object with a highWaterMark");
+
+  r = JS_ToFloat64(ctx, &d, hwm);
+  JS_FreeValue(ctx, hwm);
+
+  if(r)
+    return JS_EXCEPTION;
+
+  if(!(qs = js_mallocz(ctx, sizeof(QueuingStrategy))))
+    return JS_EXCEPTION;
+
+  qs->bytes = bytes;
+
+  if(!strategy_high_water_mark(ctx, qs, d))
+    goto fail;
+
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  if(JS_IsException(proto))
+    proto = JS_DupValue(ctx, default_proto);
+
+  obj = JS_NewObjectProtoClass(ctx, proto, js_strategy_class_id);
+  JS_FreeValue(ctx, proto);
+  if(JS_IsException(obj))
+    goto fail;
+
+  JS_SetOpaque(obj, qs);
+  return obj;
+
+fail:
+  js_free(ctx, qs);
+  return JS_EXCEPTION;
+}
+
+JSValue
+js_bytelength_strategy_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  return js_strategy_new(ctx, new_target, bytelength_strategy_proto, TRUE, argc, argv);
+}
+
+JSValue
+js_count_strategy_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  return js_strategy_new(ctx, new_target, count_strategy_proto, FALSE, argc, argv);
+}
+
+enum {
+  STRATEGY_SIZE = 0,
+};
+
+JSValue
+js_strategy_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  QueuingStrategy* qs;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(qs = js_strategy_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case STRATEGY_SIZE: {
+      ret = JS_NewInt64(ctx, strategy_size(qs, argc > 0 ? argv[0] : JS_UNDEFINED, ctx));
+      break;
+    }
+  }
+
+  return ret;
+}
+
+enum {
+  STRATEGY_HIGH_WATER_MARK = 0,
+};
+
+JSValue
+js_strategy_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  QueuingStrategy* qs;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(qs = js_strategy_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case STRATEGY_HIGH_WATER_MARK: {
+      ret = qs->high_water_mark == INT64_MAX ? JS_NewFloat64(ctx, INFINITY) : JS_NewInt64(ctx, qs->high_water_mark);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+void
+js_strategy_finalizer(JSRuntime* rt, JSValue val) {
+  QueuingStrategy* qs;
+
+  if((qs = js_strategy_data(val)))
+    js_free_rt(rt, qs);
+}
+
+JSClassDef js_strategy_class = {
+    .class_name = "QueuingStrategy",
+    .finalizer = js_strategy_finalizer,
+};
+
+const JSCFunctionListEntry js_bytelength_strategy_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("size", 1, js_strategy_method, STRATEGY_SIZE),
+    JS_CGETSET_MAGIC_FLAGS_DEF("highWaterMark", js_strategy_get, 0, STRATEGY_HIGH_WATER_MARK, JS_PROP_ENUMERABLE),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "ByteLengthQueuingStrategy", JS_PROP_CONFIGURABLE),
+};
+
+const JSCFunctionListEntry js_count_strategy_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("size", 1, js_strategy_method, STRATEGY_SIZE),
+    JS_CGETSET_MAGIC_FLAGS_DEF("highWaterMark", js_strategy_get, 0, STRATEGY_HIGH_WATER_MARK, JS_PROP_ENUMERABLE),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "CountQueuingStrategy", JS_PROP_CONFIGURABLE),
+};
+
 int
 js_stream_init(JSContext* ctx, JSModuleDef* m) {
 
@@ -1554,6 +2979,7 @@ js_stream_init(JSContext* ctx, JSModuleDef* m) {
   readable_ctor = JS_NewCFunction2(ctx, js_readable_constructor, "ReadableStream", 1, JS_CFUNC_constructor, 0);
 
   JS_SetConstructor(ctx, readable_ctor, readable_proto);
+  JS_SetPropertyFunctionList(ctx, readable_ctor, js_readable_static_funcs, countof(js_readable_static_funcs));
 
   readable_controller = JS_NewObject(ctx);
   JS_SetPropertyFunctionList(ctx, readable_controller, js_readable_controller_funcs, countof(js_readable_controller_funcs));
@@ -1580,6 +3006,7 @@ js_stream_init(JSContext* ctx, JSModuleDef* m) {
   writable_ctor = JS_NewCFunction2(ctx, js_writable_constructor, "WritableStream", 1, JS_CFUNC_constructor, 0);
 
   JS_SetConstructor(ctx, writable_ctor, writable_proto);
+  JS_SetPropertyFunctionList(ctx, writable_ctor, js_writable_static_funcs, countof(js_writable_static_funcs));
 
   writable_controller = JS_NewObject(ctx);
   JS_SetPropertyFunctionList(ctx, writable_controller, js_writable_controller_funcs, countof(js_writable_controller_funcs));
@@ -1600,6 +3027,23 @@ js_stream_init(JSContext* ctx, JSModuleDef* m) {
   JS_SetPropertyFunctionList(ctx, transform_controller, js_transform_controller_funcs, countof(js_transform_controller_funcs));
   JS_SetClassProto(ctx, js_transform_class_id, transform_controller);
 
+  JS_NewClassID(&js_strategy_class_id);
+  JS_NewClass(JS_GetRuntime(ctx), js_strategy_class_id, &js_strategy_class);
+
+  bytelength_strategy_proto = JS_NewObject(ctx);
+  JS_SetPropertyFunctionList(ctx, bytelength_strategy_proto, js_bytelength_strategy_funcs, countof(js_bytelength_strategy_funcs));
+
+  bytelength_strategy_ctor = JS_NewCFunction2(ctx, js_bytelength_strategy_constructor, "ByteLengthQueuingStrategy", 1, JS_CFUNC_constructor, 0);
+
+  JS_SetConstructor(ctx, bytelength_strategy_ctor, bytelength_strategy_proto);
+
+  count_strategy_proto = JS_NewObject(ctx);
+  JS_SetPropertyFunctionList(ctx, count_strategy_proto, js_count_strategy_funcs, countof(js_count_strategy_funcs));
+
+  count_strategy_ctor = JS_NewCFunction2(ctx, js_count_strategy_constructor, "CountQueuingStrategy", 1, JS_CFUNC_constructor, 0);
+
+  JS_SetConstructor(ctx, count_strategy_ctor, count_strategy_proto);
+
   // JS_SetPropertyFunctionList(ctx, stream_ctor, js_stream_static_funcs, countof(js_stream_static_funcs));
 
   if(m) {
@@ -1610,6 +3054,8 @@ js_stream_init(JSContext* ctx, JSModuleDef* m) {
     JS_SetModuleExport(ctx, m, "WritableStream", writable_ctor);
     JS_SetModuleExport(ctx, m, "WritableStreamDefaultController", writable_controller);
     JS_SetModuleExport(ctx, m, "TransformStream", transform_ctor);
+    JS_SetModuleExport(ctx, m, "ByteLengthQueuingStrategy", bytelength_strategy_ctor);
+    JS_SetModuleExport(ctx, m, "CountQueuingStrategy", count_strategy_ctor);
   }
 
   return 0;
@@ -1634,6 +3080,8 @@ JS_INIT_MODULE(JSContext* ctx, const char* module_name) {
   JS_AddModuleExport(ctx, m, "WritableStream");
   JS_AddModuleExport(ctx, m, "WritableStreamDefaultController");
   JS_AddModuleExport(ctx, m, "TransformStream");
+  JS_AddModuleExport(ctx, m, "ByteLengthQueuingStrategy");
+  JS_AddModuleExport(ctx, m, "CountQueuingStrategy");
   return m;
 }
 
@@ -31,6 +31,14 @@ typedef enum {
     HEAD(st); \
   }
 
+/**
+ * highWaterMark counted in chunks or, for ByteLengthQueuingStrategy, bytes
+ */
+typedef struct queuing_strategy {
+  int64_t high_water_mark;
+  BOOL bytes;
+} QueuingStrategy;
+
 typedef struct read_next {
   LINK(link, struct read_next);
   int seq;
@@ -38,6 +46,7 @@ typedef struct read_next {
     ResolveFunctions handlers;
     Promise promise;
   };
+  JSValue view;
 } Read;
 
 enum {
@@ -47,6 +56,7 @@ enum {
 
 typedef struct stream_reader {
   int64_t desired_size;
+  BOOL byob;
   _Atomic(struct readable_stream*) stream;
   Promise events[2];
   union {
@@ -81,6 +91,11 @@ typedef struct readable_stream {
   _Atomic(Reader*) reader;
   JSValue on[3];
   JSValue underlying_source, controller;
+  QueuingStrategy strategy;
+  struct stream_pipe* pipe;
+  int fd;
+  size_t chunk_size;
+  BOOL fd_armed : 1, fd_autoclose : 1;
 } Readable;
 
 typedef enum {
@@ -98,6 +113,12 @@ typedef struct writable_stream {
   _Atomic(Writer*) writer;
   JSValue on[4];
   JSValue underlying_sink, controller;
+  QueuingStrategy strategy;
+  int64_t inflight;
+  struct readable_stream* forward;
+  int fd;
+  BOOL fd_armed : 1, fd_autoclose : 1, fd_closing : 1;
+  Promise flushed;
 } Writable;
 
 typedef enum {
@@ -114,14 +135,32 @@ typedef struct transform_stream {
   JSValue underlying_transform, controller;
 } Transform;
 
+/**
+ * Native pipe from a Readable into a Writable. Both streams stay locked
+ * while the pipe runs; chunks are handed from the source queue straight to
+ * the destination and only user-defined write/transform callbacks are
+ * called in JS.
+ */
+typedef struct stream_pipe {
+  int ref_count;
+  JSRuntime* rt;
+  Readable* source;
+  Writable* dest;
+  Reader* reader;
+  Writer* writer;
+  Promise done;
+  BOOL pumping : 1, pulled : 1, finished : 1;
+  BOOL prevent_close : 1, prevent_abort : 1, prevent_cancel : 1;
+} Pipe;
+
 typedef enum {
   TRANSFORM_READABLE = 0,
   TRANSFORM_WRITABLE,
 } TransformProperties;
 
-extern VISIBLE JSClassID js_reader_class_id, js_writer_class_id, js_readable_class_id, js_writable_class_id, js_transform_class_id;
+extern VISIBLE JSClassID js_reader_class_id, js_writer_class_id, js_readable_class_id, js_writable_class_id, js_transform_class_id, js_strategy_class_id;
 extern VISIBLE JSValue reader_proto, reader_ctor, writer_proto, writer_ctor, readable_proto, readable_ctor, writable_proto, writable_ctor, transform_proto,
-    transform_ctor;
+    transform_ctor, bytelength_strategy_proto, bytelength_strategy_ctor, count_strategy_proto, count_strategy_ctor;
 
 JSValue js_reader_constructor(JSContext*, JSValue, int, JSValue argv[]);
 JSValue js_reader_wrap(JSContext*, Reader*);
@@ -135,6 +174,7 @@ JSValue js_readable_method(JSContext*, JSValue, int, JSValue argv[], int magic);
 JSValue js_readable_get(JSContext*, JSValue, int);
 JSValue js_readable_controller(JSContext*, JSValue, int, JSValue argv[], int magic);
 JSValue js_readable_desired(JSContext*, JSValue);
+JSValue js_readable_from_fd(JSContext*, JSValue, int, JSValue argv[]);
 void js_readable_finalizer(JSRuntime*, JSValue);
 JSValue js_writer_constructor(JSContext*, JSValue, int, JSValue argv[]);
 JSValue js_writer_wrap(JSContext*, Writer*);
@@ -149,12 +189,19 @@ JSValue js_writable_handler(JSContext*, JSValue, int);
 JSValue js_writable_method(JSContext*, JSValue, int, JSValue argv[], int magic);
 JSValue js_writable_get(JSContext*, JSValue, int);
 JSValue js_writable_controller(JSContext*, JSValue, int, JSValue argv[], int magic);
+JSValue js_writable_from_fd(JSContext*, JSValue, int, JSValue argv[]);
+BOOL js_stream_detach_fd(JSContext*, JSValueConst, int* fd);
 void js_writable_finalizer(JSRuntime*, JSValue);
 JSValue js_transform_constructor(JSContext*, JSValue, int, JSValue argv[]);
 JSValue js_transform_get(JSContext*, JSValue, int);
 JSValue js_transform_controller(JSContext*, JSValue, int, JSValue argv[], int magic);
 JSValue js_transform_desired(JSContext*, JSValue);
 void js_transform_finalizer(JSRuntime*, JSValue);
+JSValue js_bytelength_strategy_constructor(JSContext*, JSValue, int, JSValue argv[]);
+JSValue js_count_strategy_constructor(JSContext*, JSValue, int, JSValue argv[]);
+JSValue js_strategy_method(JSContext*, JSValue, int, JSValue argv[], int magic);
+JSValue js_strategy_get(JSContext*, JSValue, int);
+void js_strategy_finalizer(JSRuntime*, JSValue);
 int js_stream_init(JSContext*, JSModuleDef*);
 JSModuleDef* js_init_module_stream(JSContext*, const char*);
 
@@ -177,6 +224,8 @@ static inline Writable* js_writable_data(JSValueConst value) { return JS_GetOpaq
 static inline Writable* js_writable_data2(JSContext* ctx, JSValueConst value) { return JS_GetOpaque2(ctx, value, js_writable_class_id); }
 static inline Transform* js_transform_data(JSValueConst value) { return JS_GetOpaque(value, js_transform_class_id); }
 static inline Transform* js_transform_data2(JSContext* ctx, JSValueConst value) { return JS_GetOpaque2(ctx, value, js_transform_class_id); }
+static inline QueuingStrategy* js_strategy_data(JSValueConst value) { return JS_GetOpaque(value, js_strategy_class_id); }
+static inline QueuingStrategy* js_strategy_data2(JSContext* ctx, JSValueConst value) { return JS_GetOpaque2(ctx, value, js_strategy_class_id); }
 /* clang-format on */
 
 /**
@@ -18,21 +18,38 @@ VISIBLE JSValue syscallerror_proto = {{0}, JS_TAG_UNDEFINED}, syscallerror_ctor
 int js_syscallerror_init(JSContext*, JSModuleDef*);
 static const char* error_get(int number);
 
-static char*
-stack_get(JSContext* ctx) {
-  const char* stack;
-  char* ret;
+/**
+ * @brief  Captures the raw Error.stack string
+ *
+ * It is only formatted (see stack_get()) when .stack, .toString() or
+ * inspection asks for it.
+ */
+static JSValue
+backtrace_get(JSContext* ctx) {
   JSValue st, error = js_global_new(ctx, "Error", 0, 0);
   st = JS_GetPropertyStr(ctx, error, "stack");
-
-  stack = JS_ToCString(ctx, st);
-  size_t pos = str_chr(stack, '\n');
-  if(stack[pos])
-    pos++;
-  ret = js_strdup(ctx, stack + pos);
-  JS_FreeCString(ctx, stack);
   JS_FreeValue(ctx, error);
-  return ret;
+  return st;
+}
+
+static const char*
+stack_get(JSContext* ctx, SyscallError* err) {
+  if(!err->stack && JS_IsString(err->backtrace)) {
+    const char* stack;
+
+    if((stack = JS_ToCString(ctx, err->backtrace))) {
+      size_t pos = str_chr(stack, '\n');
+      if(stack[pos])
+        pos++;
+      err->stack = js_strdup(ctx, stack + pos);
+      JS_FreeCString(ctx, stack);
+    }
+
+    JS_FreeValue(ctx, err->backtrace);
+    err->backtrace = JS_UNDEFINED;
+  }
+
+  return err->stack;
 }
 
 SyscallError*
@@ -54,7 +71,7 @@ syscallerror_new(JSContext* ctx, const char* syscall, int number) {
 
   err->syscall = syscall ? js_strdup(ctx, syscall) : 0;
   err->number = number;
-  err->stack = stack_get(ctx);
+  err->backtrace = backtrace_get(ctx);
   return err;
 }
 
@@ -128,7 +145,7 @@ js_syscallerror_constructor(JSContext* ctx, JSValueConst new_target, int argc, J
 
     err->number = number;
   }
-  err->stack = stack_get(ctx);
+  err->backtrace = backtrace_get(ctx);
   JS_FreeValue(ctx, st);
 
   JS_SetOpaque(obj, err);
@@ -140,7 +157,9 @@ fail:
 }
 
 static void
-syscallerror_dump(SyscallError* err, DynBuf* dbuf) {
+syscallerror_dump(JSContext* ctx, SyscallError* err, BOOL with_stack, DynBuf* dbuf) {
+  const char* stack;
+
   if(err->syscall) {
     char buf[FMT_LONG];
     dbuf_putstr(dbuf, err->syscall);
@@ -176,9 +195,9 @@ syscallerror_dump(SyscallError* err, DynBuf* dbuf) {
 #endif
   }
 
-  if(err->stack) {
+  if(with_stack && (stack = stack_get(ctx, err))) {
     dbuf_putc(dbuf, '\n');
-    dbuf_putstr(dbuf, err->stack);
+    dbuf_putstr(dbuf, stack);
   }
 
   dbuf_0(dbuf);
@@ -201,7 +220,7 @@ js_syscallerror_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueC
     case SYSCALLERROR_TOSTRING: {
       DynBuf dbuf = {0};
       js_dbuf_init(ctx, &dbuf);
-      syscallerror_dump(err, &dbuf);
+      syscallerror_dump(ctx, err, TRUE, &dbuf);
       ret = JS_NewStringLen(ctx, (const char*)dbuf.buf, dbuf.size);
       dbuf_free(&dbuf);
       break;
@@ -293,16 +312,20 @@ js_syscallerror_get(JSContext* ctx, JSValueConst this_val, int magic) {
     }
 
     case PROP_STACK: {
+      const char* stack;
       if(err)
-        ret = err->stack ? JS_NewString(ctx, err->stack) : JS_NULL;
+        ret = (stack = stack_get(ctx, err)) ? JS_NewString(ctx, stack) : JS_NULL;
       break;
     }
 
     case PROP_MESSAGE: {
       DynBuf dbuf = {0};
+      if(!err)
+        break;
       js_dbuf_init(ctx, &dbuf);
-      syscallerror_dump(err, &dbuf);
-      ret = JS_NewStringLen(ctx, (const char*)dbuf.buf, byte_chr(dbuf.buf, dbuf.size, '\n'));
+      syscallerror_dump(ctx, err, FALSE, &dbuf);
+      ret = JS_NewStringLen(ctx, (const char*)dbuf.buf, dbuf.size);
+      dbuf_free(&dbuf);
       break;
     }
   }
@@ -734,6 +757,7 @@ js_syscallerror_finalizer(JSRuntime* rt, JSValue val) {
       js_free_rt(rt, err->syscall);
     if(err->stack)
       js_free_rt(rt, err->stack);
+    JS_FreeValueRT(rt, err->backtrace);
 
     js_free_rt(rt, err);
   }
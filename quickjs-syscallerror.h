@@ -3,6 +3,7 @@
 #define QUICKJS_SYSCALLERROR_H
 
 #include "utils.h"
+#include <errno.h>
 
 /**
  * \defgroup quickjs-syscallerror quickjs-syscallerror: System-call error object
@@ -12,15 +13,30 @@ typedef struct {
   char* syscall;
   int number;
   char* stack;
+  JSValue backtrace;
 } SyscallError;
 
+/**
+ * @brief  Whether an errno only means "try again"
+ *
+ * Callers return a status code for these instead of creating a SyscallError.
+ */
+static inline BOOL
+syscallerror_retry(int number) {
+#ifdef EWOULDBLOCK
+  if(number == EWOULDBLOCK)
+    return TRUE;
+#endif
+  return number == EAGAIN || number == EINTR;
+}
+
 #define js_syscall(name, retval) js_syscall_return(name, retval, JS_NewInt32(ctx, result))
 
 #define js_syscall_return(name, retval, successval) \
   do { \
     int prev_errno = errno, result = retval; \
     if(result == -1) { \
-      ret = js_syscallerror_new(ctx, name, errno); \
+      ret = syscallerror_retry(errno) ? JS_NewInt32(ctx, -errno) : js_syscallerror_new(ctx, name, errno); \
       errno = prev_errno; \
     } else { \
       ret = successval; \
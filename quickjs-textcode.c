@@ -3,6 +3,7 @@
 #include "utils.h"
 #include "buffer-utils.h"
 #include "debug.h"
+#include "quickjs-stream.h"
 #include <libutf.h>
 #include <libutf.h>
 #include "tutf8e/include/tutf8e.h"
@@ -15,6 +16,8 @@
 VISIBLE JSClassID js_decoder_class_id = 0, js_encoder_class_id = 0;
 VISIBLE JSValue textdecoder_proto = {{0}, JS_TAG_UNDEFINED}, textdecoder_ctor = {{0}, JS_TAG_UNDEFINED}, textencoder_proto = {{0}, JS_TAG_UNDEFINED},
                 textencoder_ctor = {{0}, JS_TAG_UNDEFINED};
+VISIBLE JSValue textdecoderstream_proto = {{0}, JS_TAG_UNDEFINED}, textdecoderstream_ctor = {{0}, JS_TAG_UNDEFINED},
+                textencoderstream_proto = {{0}, JS_TAG_UNDEFINED}, textencoderstream_ctor = {{0}, JS_TAG_UNDEFINED};
 
 const TUTF8encoder* tutf8e_coders[] = {
     /* 0, 0, 0, 0, 0, 0, 0, 0, */
@@ -32,9 +35,171 @@ const char* const textcode_encodings[] = {
     "WINDOWS-1251", "WINDOWS-1252", "WINDOWS-1253", "WINDOWS-1254", "WINDOWS-1255", "WINDOWS-1256", "WINDOWS-1257", "WINDOWS-1258",
 };
 
+/* UTF-8 for every byte of a single-byte codepage, and the way back */
+typedef struct textcode_table {
+  BOOL built, ascii;
+  uint16_t cp[256];
+  uint8_t utf8[256][4];
+  uint32_t nreverse;
+  struct textcode_reverse {
+    uint16_t cp;
+    uint8_t byte;
+  } reverse[256];
+} TextcodeTable;
+
+static TextcodeTable textcode_tables[countof(tutf8e_coders)];
+
+#define TEXTCODE_UNMAPPED 0xffff
+
+/* UTF encoding of a coder, UNKNOWN for the single-byte codepages */
+#define textcode_utf(tc) ((tc)->type_code >= ISO_8859_1 ? UNKNOWN : (tc)->encoding)
+
+static int
+textcode_reverse_cmp(const void* a, const void* b) {
+  return (int)((const struct textcode_reverse*)a)->cp - (int)((const struct textcode_reverse*)b)->cp;
+}
+
+/**
+ * Tables for a single-byte encoding, filled from its tutf8e encoder on
+ * first use. Returns NULL for the UTF encodings.
+ */
+static const TextcodeTable*
+textcode_table(TextEncoding type) {
+  TextcodeTable* t;
+  size_t index = type - ISO_8859_1;
+
+  if(type < ISO_8859_1 || index >= countof(tutf8e_coders))
+    return 0;
+
+  if(!(t = &textcode_tables[index])->built) {
+    TUTF8encoder encoder = *tutf8e_coders[index];
+    const uint8_t* next;
+
+    t->ascii = TRUE;
+    t->nreverse = 0;
+
+    for(int i = 0; i < 256; i++) {
+      char in = i, out[4];
+      size_t n = sizeof(out);
+
+      t->cp[i] = TEXTCODE_UNMAPPED;
+      t->utf8[i][0] = 0;
+
+      if(TUTF8E_OK != tutf8e_encoder_buffer_encode(encoder, &in, 1, 0, out, &n) || n < 1 || n > 3)
+        continue;
+
+      t->cp[i] = unicode_from_utf8((const uint8_t*)out, n, &next);
+      t->utf8[i][0] = n;
+      memcpy(&t->utf8[i][1], out, n);
+
+      if(i < 0x80 && t->cp[i] != i)
+        t->ascii = FALSE;
+
+      t->reverse[t->nreverse++] = (struct textcode_reverse){t->cp[i], i};
+    }
+
+    qsort(t->reverse, t->nreverse, sizeof(t->reverse[0]), &textcode_reverse_cmp);
+    t->built = TRUE;
+  }
+
+  return t;
+}
+
+static int
+textcode_table_byte(const TextcodeTable* t, int c) {
+  uint32_t lo = 0, hi = t->nreverse;
+
+  while(lo < hi) {
+    uint32_t mid = (lo + hi) / 2;
+
+    if(t->reverse[mid].cp == c)
+      return t->reverse[mid].byte;
+
+    if(t->reverse[mid].cp < c)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return -1;
+}
+
+/**
+ * Converts single-byte text at in to UTF-8 at out, which must hold
+ * *plen * 3 bytes. Stops before a byte the codepage leaves unmapped.
+ */
+static size_t
+textcode_table_decode(const TextcodeTable* t, uint8_t* out, const uint8_t* in, size_t* plen) {
+  const uint8_t *x = in, *end = x + *plen;
+  uint8_t* y = out;
+
+  while(x < end) {
+    if(t->ascii && end - x >= 16 && utf_ascii16(x)) {
+      memcpy(y, x, 16);
+      x += 16;
+      y += 16;
+      continue;
+    }
+
+    if(!t->utf8[*x][0])
+      break;
+
+    memcpy(y, &t->utf8[*x][1], 3);
+    y += t->utf8[*x++][0];
+  }
+
+  *plen = x - in;
+  return y - out;
+}
+
+/**
+ * Converts UTF-8 at in to the codepage at out, which must hold *plen
+ * bytes. Stops before a character the codepage cannot represent.
+ */
+static size_t
+textcode_table_encode(const TextcodeTable* t, uint8_t* out, const uint8_t* in, size_t* plen) {
+  const uint8_t *x = in, *end = x + *plen, *next;
+  uint8_t* y = out;
+  int c, b;
+
+  while(x < end) {
+    if(t->ascii && end - x >= 16 && utf_ascii16(x)) {
+      memcpy(y, x, 16);
+      x += 16;
+      y += 16;
+      continue;
+    }
+
+    if(t->ascii && *x < 0x80) {
+      *y++ = *x++;
+      continue;
+    }
+
+    if((c = unicode_from_utf8(x, end - x, &next)) == -1 || (b = textcode_table_byte(t, c)) == -1)
+      break;
+
+    *y++ = b;
+    x = next;
+  }
+
+  *plen = x - in;
+  return y - out;
+}
+
+/* type code of a single-byte encoding name, or -1 */
+static int
+textcode_lookup(const char* s) {
+  for(int i = ISO_8859_1; i < (int)countof(textcode_encodings); i++)
+    if(!strcasecmp(s, textcode_encodings[i]))
+      return i;
+
+  return -1;
+}
+
 enum {
   DECODER_DECODE,
   DECODER_END,
+  DECODER_DECODE_INTO,
 };
 enum {
   DECODER_ENCODING,
@@ -42,25 +207,19 @@ enum {
   DECODER_BUFFERED,
 };
 
-static size_t
-textdecoder_try(const void* in, size_t len) {
-  const uint8_t *x, *y, *end;
-  size_t r = 0;
-  int ch;
-
-  x = in;
-  end = x + len;
-
-  while(x < end) {
-    y = x;
-
-    if((ch = unicode_from_utf8(x, end - x, &x)) == -1)
-      break;
+/* { read, written } as returned by encodeInto() and decodeInto() */
+static JSValue
+js_textcode_result(JSContext* ctx, size_t read, size_t written) {
+  JSValue ret = JS_NewObject(ctx);
 
-    r += x - y;
-  }
+  JS_SetPropertyStr(ctx, ret, "read", JS_NewInt64(ctx, read));
+  JS_SetPropertyStr(ctx, ret, "written", JS_NewInt64(ctx, written));
+  return ret;
+}
 
-  return r;
+static size_t
+textdecoder_try(const void* in, size_t len) {
+  return utf8_valid(in, len);
 }
 
 size_t
@@ -79,118 +238,343 @@ textdecoder_length(TextDecoder* td) {
   return len;
 }
 
+/**
+ * Appends the UTF-8 for the complete characters at p to out. Returns how
+ * many bytes were used; the rest starts a character that needs more
+ * input. Throws and returns -1 on invalid input.
+ */
+static ssize_t
+textdecoder_block(TextDecoder* dec, DynBuf* out, const uint8_t* p, size_t len, JSContext* ctx) {
+  const TextcodeTable* table = 0;
+  size_t n, rem;
+  uint8_t* dst;
+
+  switch(textcode_utf(dec)) {
+    case UTF8: {
+      n = utf8_valid(p, len);
+
+      if(dbuf_put(out, p, n))
+        return -1;
+
+      return n;
+    }
+    case UTF16: {
+      if(!(dst = dbuf_reserve(out, (len & ~(0x1)) / 2 * 3)))
+        return -1;
+
+      n = len & ~(0x1);
+      out->size += utf16_to_utf8(dst, p, &n, dec->endian == BIG);
+
+      /* a high surrogate at the very end waits for its pair */
+      if((rem = (len & ~(0x1)) - n) >= 4 || (rem == 2 && (uint16_get_endian(p + n, dec->endian) & 0xfc00) != 0xd800)) {
+        JS_ThrowInternalError(ctx, "%s: TextDecoder: not a valid utf-16 code at (%llu: 0x%04x)", __func__, (long long unsigned int)n, (unsigned int)uint16_get_endian(p + n, dec->endian));
+        return -1;
+      }
+
+      return n;
+    }
+    case UTF32: {
+      if(!(dst = dbuf_reserve(out, len & ~(0x3))))
+        return -1;
+
+      n = len & ~(0x3);
+      out->size += utf32_to_utf8(dst, p, &n, dec->endian == BIG);
+
+      if(n < (len & ~(0x3))) {
+        JS_ThrowInternalError(ctx, "%s: TextDecoder: not a valid utf-32 code at (%llu): %lu", __func__, (long long unsigned int)n, (unsigned long)uint32_get_endian(p + n, dec->endian));
+        return -1;
+      }
+
+      return n;
+    }
+    default: {
+      if(!(table = textcode_table(dec->type_code))) {
+        JS_ThrowInternalError(ctx, "%s: TextDecoder: unknown encoding: %s", __func__, textcode_encodings[dec->type_code]);
+        return -1;
+      }
+
+      if(!(dst = dbuf_reserve(out, len * 3)))
+        return -1;
+
+      n = len;
+      out->size += textcode_table_decode(table, dst, p, &n);
+
+      if(n < len) {
+        JS_ThrowInternalError(ctx, "%s: TextDecoder: not a valid %s byte at (%llu): 0x%02x", __func__, textcode_encodings[dec->type_code], (long long unsigned int)n, p[n]);
+        return -1;
+      }
+
+      return n;
+    }
+  }
+}
+
 JSValue
 textdecoder_decode(TextDecoder* dec, JSContext* ctx) {
   JSValue ret = JS_UNDEFINED;
   DynBuf dbuf;
-  size_t i = 0, blen;
-  uint_least32_t cp;
-  char tmp[UTF8_CHAR_LEN_MAX];
-  int len = 0;
+  size_t blen = ringbuffer_length(&dec->buffer);
+  ssize_t n;
+
+  if(!blen)
+    return ret;
+
+  if(blen > ringbuffer_continuous(&dec->buffer))
+    ringbuffer_normalize(&dec->buffer);
+
+  if(textcode_utf(dec) == UTF8) {
+    blen = utf8_valid(ringbuffer_begin(&dec->buffer), blen);
+    ret = JS_NewStringLen(ctx, (const char*)ringbuffer_begin(&dec->buffer), blen);
+    ringbuffer_skip(&dec->buffer, blen);
+    return ret;
+  }
+
   js_dbuf_init(ctx, &dbuf);
-  blen = ringbuffer_length(&dec->buffer);
 
-  if(blen)
-    switch(dec->encoding) {
-      case UTF8: {
-        size_t blen, rlen = ringbuffer_length(&dec->buffer);
+  if((n = textdecoder_block(dec, &dbuf, ringbuffer_begin(&dec->buffer), blen, ctx)) < 0) {
+    ret = JS_EXCEPTION;
+  } else {
+    ringbuffer_skip(&dec->buffer, n);
 
-        if((blen = textdecoder_length(dec)) < rlen) {
-          ringbuffer_normalize(&dec->buffer);
-          blen = textdecoder_length(dec);
-        }
+    if(dbuf.size > 0)
+      ret = JS_NewStringLen(ctx, (const char*)dbuf.buf, dbuf.size);
+  }
 
-        ret = JS_NewStringLen(ctx, (const char*)ringbuffer_begin(&dec->buffer), blen);
-        ringbuffer_skip(&dec->buffer, blen);
-        break;
-      }
-      case UTF16: {
-        uint_least16_t* ptr = ringbuffer_begin(&dec->buffer);
-        size_t n = blen & ~(0x1);
-
-        for(i = 0; i < n; ptr = ringbuffer_next(&dec->buffer, ptr), i += 2) {
-          uint_least16_t u16[2] = {uint16_get_endian(ptr, dec->endian), 0};
-          size_t ns = 2;
-
-          if(utf16_multiword(u16)) {
-            if(i + 2 >= n)
-              break;
-            u16[1] = uint16_get_endian(ptr + 1, dec->endian == BIG);
-            ns += 2;
-          }
-
-          if(!libutf_c16_to_c32(u16, &cp)) {
-            ret = JS_ThrowInternalError(ctx,
-                                        "%s: TextDecoder: not a valid utf-16 code at (%llu: 0x%04x, 0x%04x): %lu",
-                                        __func__,
-                                        (long long unsigned int)i,
-                                        (unsigned int)ptr[0],
-                                        (unsigned int)ptr[1],
-                                        (unsigned long)cp);
-            break;
-          }
-          len = unicode_to_utf8((void*)tmp, cp);
-
-          if(dbuf_put(&dbuf, (const void*)tmp, len))
-            return JS_EXCEPTION;
-        }
+  dbuf_free(&dbuf);
+  return ret;
+}
 
-        break;
-      }
-      case UTF32: {
-        const uint_least32_t* ptr = ringbuffer_begin(&dec->buffer);
-        size_t n = blen & ~(0x3);
-
-        for(i = 0; i < n; ptr = ringbuffer_next(&dec->buffer, ptr), i += 4) {
-          cp = uint32_get_endian(ptr, dec->endian);
-          if(!libutf_c32_to_c8(cp, &len, tmp)) {
-            ret = JS_ThrowInternalError(ctx,
-                                        "%s: TextDecoder: not a valid utf-32 code at (%llu: 0x%04x, 0x%04x): %lu",
-                                        __func__,
-                                        (long long unsigned int)i,
-                                        (unsigned int)ptr[0],
-                                        (unsigned int)ptr[1],
-                                        (unsigned long)cp);
-            break;
-          }
-          if(dbuf_put(&dbuf, (const void*)tmp, len))
-            return JS_EXCEPTION;
-        }
-        break;
+/* input bytes still missing from the character buffered at the front */
+static size_t
+textdecoder_missing(TextDecoder* dec) {
+  size_t len = ringbuffer_length(&dec->buffer), need;
+  uint8_t u[2];
+
+  switch(textcode_utf(dec)) {
+    case UTF8: {
+      uint8_t c = *ringbuffer_peek(&dec->buffer, 0);
+
+      need = c < 0xe0 ? 2 : c < 0xf0 ? 3 : 4;
+      break;
+    }
+    case UTF16: {
+      need = 2;
+
+      if(len >= 2) {
+        u[0] = *ringbuffer_peek(&dec->buffer, 0);
+        u[1] = *ringbuffer_peek(&dec->buffer, 1);
+
+        if((uint16_get_endian(u, dec->endian) & 0xfc00) == 0xd800)
+          need = 4;
       }
-      default: {
-        TUTF8encoder encoder;
 
-        if((encoder = *tutf8e_coders[dec->encoding - 8])) {
+      break;
+    }
+    case UTF32: need = 4; break;
+    default: need = 1; break;
+  }
+
+  return need > len ? need - len : 1;
+}
 
-          const char* ptr = ringbuffer_begin(&dec->buffer);
-          size_t n = 0;
+/**
+ * Decodes a chunk straight from the caller's memory. Only the bytes of a
+ * character split across chunks pass through the ring buffer.
+ */
+JSValue
+textdecoder_feed(TextDecoder* dec, const uint8_t* p, size_t len, JSContext* ctx) {
+  JSValue ret = JS_UNDEFINED;
+  DynBuf dbuf;
+  size_t pos = 0, n;
+  ssize_t r;
 
-          if(TUTF8E_OK == tutf8e_encoder_buffer_length(encoder, ptr, 0, blen, &n)) {
+  if(!ringbuffer_length(&dec->buffer) && textcode_utf(dec) == UTF8) {
+    n = utf8_valid(p, len);
 
-            uint8_t* dst = dbuf_reserve(&dbuf, n);
+    if(ringbuffer_append(&dec->buffer, p + n, len - n, ctx) < 0)
+      return JS_ThrowInternalError(ctx, "%s: TextDecoder: ringbuffer write failed", __func__);
 
-            if(TUTF8E_OK == tutf8e_encoder_buffer_encode(encoder, ptr, blen, 0, (char*)dst, &n)) {
-              dbuf.size += n;
-              i = blen;
-            }
-          }
+    return JS_NewStringLen(ctx, (const char*)p, n);
+  }
 
-        } else {
-          ret = JS_ThrowInternalError(ctx, "%s: TextDecoder: unknown encoding: %s", __func__, textcode_encodings[dec->encoding]);
-        }
-        break;
+  js_dbuf_init(ctx, &dbuf);
+
+  /* complete the character carried over from the previous chunk */
+  while(ringbuffer_length(&dec->buffer) && pos < len) {
+    n = MIN_NUM(textdecoder_missing(dec), len - pos);
+
+    if(ringbuffer_append(&dec->buffer, p + pos, n, ctx) < 0) {
+      JS_ThrowInternalError(ctx, "%s: TextDecoder: ringbuffer write failed", __func__);
+      goto fail;
+    }
+
+    pos += n;
+
+    if(ringbuffer_length(&dec->buffer) > ringbuffer_continuous(&dec->buffer))
+      ringbuffer_normalize(&dec->buffer);
+
+    if((r = textdecoder_block(dec, &dbuf, ringbuffer_begin(&dec->buffer), ringbuffer_length(&dec->buffer), ctx)) < 0)
+      goto fail;
+
+    ringbuffer_skip(&dec->buffer, r);
+
+    /* bytes that never decode hold up the rest, as with decode() */
+    if(!r && ringbuffer_length(&dec->buffer) >= 4) {
+      if(ringbuffer_append(&dec->buffer, p + pos, len - pos, ctx) < 0) {
+        JS_ThrowInternalError(ctx, "%s: TextDecoder: ringbuffer write failed", __func__);
+        goto fail;
       }
+
+      pos = len;
     }
+  }
 
-  ringbuffer_skip(&dec->buffer, i);
+  if(pos < len) {
+    if((r = textdecoder_block(dec, &dbuf, p + pos, len - pos, ctx)) < 0)
+      goto fail;
 
-  if(JS_IsUndefined(ret) && dbuf.size > 0)
-    ret = JS_NewStringLen(ctx, (const char*)dbuf.buf, dbuf.size);
+    pos += r;
 
-  dbuf_free(&dbuf);
+    if(ringbuffer_append(&dec->buffer, p + pos, len - pos, ctx) < 0) {
+      JS_ThrowInternalError(ctx, "%s: TextDecoder: ringbuffer write failed", __func__);
+      goto fail;
+    }
+  }
 
+  ret = JS_NewStringLen(ctx, (const char*)dbuf.buf, dbuf.size);
+  dbuf_free(&dbuf);
   return ret;
+
+fail:
+  dbuf_free(&dbuf);
+  return JS_EXCEPTION;
+}
+
+/* code point at p, -1 when invalid, -2 when more input is needed */
+static int
+textdecoder_next(TextDecoder* dec, const uint8_t* p, size_t len, size_t* plen) {
+  const uint8_t* next;
+  uint32_t c, c2;
+  int r;
+
+  switch(textcode_utf(dec)) {
+    case UTF8: {
+      if((r = unicode_from_utf8(p, len, &next)) == -1)
+        return p[0] >= 0xc0 && len < (size_t)(p[0] < 0xe0 ? 2 : p[0] < 0xf0 ? 3 : 4) ? -2 : -1;
+
+      *plen = next - p;
+      return r;
+    }
+    case UTF16: {
+      if(len < 2)
+        return -2;
+
+      *plen = 2;
+
+      if((c = uint16_get_endian(p, dec->endian)) < 0xd800 || c >= 0xe000)
+        return c;
+
+      if(c >= 0xdc00)
+        return -1;
+
+      if(len < 4)
+        return -2;
+
+      if((c2 = uint16_get_endian(p + 2, dec->endian)) < 0xdc00 || c2 >= 0xe000)
+        return -1;
+
+      *plen = 4;
+      return 0x10000 + ((c - 0xd800) << 10) + (c2 - 0xdc00);
+    }
+    case UTF32: {
+      if(len < 4)
+        return -2;
+
+      *plen = 4;
+      c = uint32_get_endian(p, dec->endian);
+      return c > 0x10ffff || (c >= 0xd800 && c < 0xe000) ? -1 : (int)c;
+    }
+    default: {
+      const TextcodeTable* table;
+
+      if(!(table = textcode_table(dec->type_code)) || table->cp[*p] == TEXTCODE_UNMAPPED)
+        return -1;
+
+      *plen = 1;
+      return table->cp[*p];
+    }
+  }
+}
+
+/* converts at most *plen bytes at p, which must fit in dst */
+static size_t
+textdecoder_convert(TextDecoder* dec, uint8_t* dst, const uint8_t* p, size_t* plen) {
+  const TextcodeTable* table;
+
+  switch(textcode_utf(dec)) {
+    case UTF8: memcpy(dst, p, *plen = utf8_valid(p, *plen)); return *plen;
+    case UTF16: return utf16_to_utf8(dst, p, plen, dec->endian == BIG);
+    case UTF32: return utf32_to_utf8(dst, p, plen, dec->endian == BIG);
+    default: break;
+  }
+
+  if(!(table = textcode_table(dec->type_code))) {
+    *plen = 0;
+    return 0;
+  }
+
+  return textcode_table_decode(table, dst, p, plen);
+}
+
+/**
+ * Decodes buffered input as UTF-8 into dst without splitting a
+ * character. Input that does not fit stays buffered. Returns the bytes
+ * written and sets *pread to the input bytes consumed; returns -1 when
+ * invalid input comes before anything could be written.
+ */
+ssize_t
+textdecoder_decode_into(TextDecoder* dec, uint8_t* dst, size_t size, size_t* pread) {
+  size_t blen = ringbuffer_length(&dec->buffer), pos = 0, out = 0, n, room;
+  const uint8_t* ptr;
+  BOOL invalid = FALSE;
+  int c;
+
+  if(blen > ringbuffer_continuous(&dec->buffer))
+    ringbuffer_normalize(&dec->buffer);
+
+  ptr = ringbuffer_begin(&dec->buffer);
+
+  while(pos < blen && (room = size - out)) {
+    /* longest run whose worst-case output is known to fit */
+    switch(textcode_utf(dec)) {
+      case UTF8: n = room; break;
+      case UTF16: n = room / 3 * 2; break;
+      case UTF32: n = room & ~(size_t)3; break;
+      default: n = room / 3; break;
+    }
+
+    n = MIN_NUM(n, blen - pos);
+    out += textdecoder_convert(dec, dst + out, ptr + pos, &n);
+
+    if(n) {
+      pos += n;
+      continue;
+    }
+
+    /* stopped in front of one character: check it on its own */
+    if((invalid = (c = textdecoder_next(dec, ptr + pos, blen - pos, &n)) == -1))
+      break;
+
+    if(c == -2 || (size_t)(c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4) > room)
+      break;
+
+    out += unicode_to_utf8(dst + out, c);
+    pos += n;
+  }
+
+  ringbuffer_skip(&dec->buffer, pos);
+  *pread = pos;
+  return invalid && !out ? -1 : (ssize_t)out;
 }
 
 static JSValue
@@ -244,8 +628,11 @@ js_decoder_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValu
 
   if(argc >= 1) {
     const char* s = JS_ToCString(ctx, argv[0]);
+    int code;
 
-    if(s[case_finds(s, "utf32")] || s[case_finds(s, "utf-32")])
+    if((code = textcode_lookup(s)) != -1)
+      dec->type_code = code;
+    else if(s[case_finds(s, "utf32")] || s[case_finds(s, "utf-32")])
       dec->encoding = UTF32;
     else if(s[case_finds(s, "utf16")] || s[case_finds(s, "utf-16")])
       dec->encoding = UTF16;
@@ -255,7 +642,7 @@ js_decoder_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValu
       return JS_ThrowInternalError(ctx, "%s: TextDecoder: '%s' is invalid s", __func__, s);
     }
 
-    if(s[case_finds(s, "be")] || s[case_finds(s, "be")])
+    if(code == -1 && s[case_finds(s, "be")])
       dec->endian = BIG;
 
     JS_FreeCString(ctx, s);
@@ -283,22 +670,58 @@ js_decoder_decode(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
   switch(magic) {
     case DECODER_END:
     case DECODER_DECODE: {
-      InputBuffer in = js_input_chars(ctx, argv[0]);
+      if(argc > 0 && !JS_IsUndefined(argv[0])) {
+        InputBuffer in = js_input_chars(ctx, argv[0]);
 
-      // printf("js_decoder_decode (1) %s length=%zu in.size=%zu\n", magic == DECODER_DECODE ? "decode" :
-      // "end", ringbuffer_length(&dec->buffer), in.size);
-      if(ringbuffer_write(&dec->buffer, in.data, in.size) < 0)
-        return JS_ThrowInternalError(ctx, "%s: TextDecoder: ringbuffer %s failed", __func__, magic == DECODER_DECODE ? "decode" : "end");
+        if(JS_IsException(in.value))
+          return JS_EXCEPTION;
 
-      if(ringbuffer_length(&dec->buffer) == 0)
+        if(input_buffer_length(&in) == 0 && ringbuffer_length(&dec->buffer) == 0)
+          ret = JS_NULL;
+        else
+          ret = textdecoder_feed(dec, input_buffer_data(&in), input_buffer_length(&in), ctx);
+
+        input_buffer_free(&in, ctx);
+      } else if(ringbuffer_length(&dec->buffer) == 0) {
         ret = JS_NULL;
-      else
+      } else {
         ret = textdecoder_decode(dec, ctx);
+      }
 
       if(magic == DECODER_END)
         ringbuffer_reset(&dec->buffer);
       break;
     }
+
+    case DECODER_DECODE_INTO: {
+      InputBuffer out;
+      size_t rd = 0;
+      ssize_t wr;
+
+      if(argc > 1 && !JS_IsUndefined(argv[0]) && !JS_IsNull(argv[0])) {
+        InputBuffer in = js_input_chars(ctx, argv[0]);
+
+        if(ringbuffer_append(&dec->buffer, input_buffer_data(&in), input_buffer_length(&in), ctx) < 0) {
+          input_buffer_free(&in, ctx);
+          return JS_ThrowInternalError(ctx, "%s: TextDecoder: ringbuffer decodeInto failed", __func__);
+        }
+
+        input_buffer_free(&in, ctx);
+      }
+
+      out = js_input_buffer(ctx, argv[argc > 1 ? 1 : 0]);
+
+      if(JS_IsException(out.value))
+        return JS_EXCEPTION;
+
+      if((wr = textdecoder_decode_into(dec, input_buffer_data(&out), input_buffer_length(&out), &rd)) < 0)
+        ret = JS_ThrowInternalError(ctx, "%s: TextDecoder: not a valid %s code at (%llu)", __func__, textcode_encodings[dec->type_code], (long long unsigned int)rd);
+      else
+        ret = js_textcode_result(ctx, rd, wr);
+
+      input_buffer_free(&out, ctx);
+      break;
+    }
   }
   return ret;
 }
@@ -335,6 +758,7 @@ static JSClassDef js_decoder_class = {
 static const JSCFunctionListEntry js_decoder_funcs[] = {
     JS_CFUNC_MAGIC_DEF("decode", 1, js_decoder_decode, DECODER_DECODE),
     JS_CFUNC_MAGIC_DEF("end", 1, js_decoder_decode, DECODER_END),
+    JS_CFUNC_MAGIC_DEF("decodeInto", 2, js_decoder_decode, DECODER_DECODE_INTO),
     JS_CGETSET_ENUMERABLE_DEF("encoding", js_decoder_get, 0, DECODER_ENCODING),
     JS_CGETSET_MAGIC_DEF("endian", js_decoder_get, 0, DECODER_ENDIANNESS),
     JS_CGETSET_MAGIC_DEF("buffered", js_decoder_get, 0, DECODER_BUFFERED),
@@ -344,6 +768,7 @@ static const JSCFunctionListEntry js_decoder_funcs[] = {
 enum {
   ENCODER_ENCODE,
   ENCODER_END,
+  ENCODER_ENCODE_INTO,
 };
 enum {
   ENCODER_ENCODING,
@@ -386,11 +811,17 @@ textencoder_read(TextEncoder* te, JSContext* ctx) {
   if(len > ringbuffer_continuous(&te->buffer))
     ringbuffer_normalize(&te->buffer);
 
-  switch(te->encoding) {
+  switch(textcode_utf(te)) {
     case UTF8: bits = 8; break;
     case UTF16: bits = 16; break;
     case UTF32: bits = 32; break;
-    default: return JS_ThrowInternalError(ctx, "%s: TextEncoder: invalid encoding: %d", __func__, te->encoding);
+    default:
+      if(textcode_table(te->type_code)) {
+        bits = 8;
+        break;
+      }
+
+      return JS_ThrowInternalError(ctx, "%s: TextEncoder: invalid encoding: %d", __func__, te->encoding);
   }
 
   buf = JS_NewArrayBufferCopy(ctx, ringbuffer_begin(&te->buffer), len);
@@ -401,79 +832,139 @@ textencoder_read(TextEncoder* te, JSContext* ctx) {
   return ret;
 }
 
+/* UTF-16 code units spelled by the UTF-8 in x */
+static size_t
+textencoder_units(const uint8_t* x, size_t len) {
+  size_t r = 0;
+
+  for(size_t i = 0; i < len; i++)
+    r += ((x[i] & 0xc0) != 0x80) + (x[i] >= 0xf0);
+
+  return r;
+}
+
+/* converts at most *plen bytes at p, which must fit in dst */
+static size_t
+textencoder_convert(TextEncoder* enc, uint8_t* dst, const uint8_t* p, size_t* plen) {
+  const TextcodeTable* table;
+
+  switch(textcode_utf(enc)) {
+    case UTF8: memcpy(dst, p, *plen = utf8_valid(p, *plen)); return *plen;
+    case UTF16: return utf8_to_utf16(dst, p, plen, enc->endian == BIG);
+    case UTF32: return utf8_to_utf32(dst, p, plen, enc->endian == BIG);
+    default: break;
+  }
+
+  if(!(table = textcode_table(enc->type_code))) {
+    *plen = 0;
+    return 0;
+  }
+
+  return textcode_table_encode(table, dst, p, plen);
+}
+
+/* most output bytes per byte of UTF-8 input */
+static size_t
+textencoder_width(TextEncoder* enc) {
+  switch(textcode_utf(enc)) {
+    case UTF16: return 2;
+    case UTF32: return 4;
+    default: return 1;
+  }
+}
+
 JSValue
 textencoder_encode(TextEncoder* enc, InputBuffer in, JSContext* ctx) {
   JSValue ret = JS_UNDEFINED;
-  size_t i;
-  uint32_t cp;
-  uint8_t u8[UTF8_CHAR_LEN_MAX];
-  const uint8_t *ptr, *end, *next;
+  const uint8_t *ptr, *end;
 
-  switch(enc->encoding) {
+  switch(textcode_utf(enc)) {
     case UTF8: {
       if(ringbuffer_write(&enc->buffer, in.data, in.size) < 0)
         return JS_ThrowInternalError(ctx, "%s: TextEncoder: ringbuffer write failed", __func__);
       break;
     }
 
-    case UTF16: {
+    default: {
+      uint8_t* buf;
+      size_t n, len;
+
+      if(!textcode_utf(enc) && !textcode_table(enc->type_code)) {
+        ret = JS_ThrowInternalError(ctx, "%s: TextEncoder: unknown encoding", __func__);
+        break;
+      }
+
       ptr = block_begin(&in.block);
       end = block_end(&in.block);
 
-      for(i = 0; ptr < end; ptr = next, i++) {
-        cp = unicode_from_utf8(ptr, end - ptr, &next);
-
-        {
-          uint_least16_t u16[2];
-          int len;
+      if(!(n = end - ptr))
+        break;
 
-          if(!libutf_c32_to_c16(cp, &len, u16))
-            return JS_ThrowInternalError(ctx,
-                                         "%s: TextEncoder: not a valid code point at (%llu) [%llu]: %lu",
-                                         __func__,
-                                         (long long unsigned int)i,
-                                         (long long unsigned int)(end - ptr),
-                                         (unsigned long)cp);
+      if(!(buf = js_malloc(ctx, n * textencoder_width(enc))))
+        return JS_EXCEPTION;
 
-          for(int j = 0; j < len; j++)
-            uint16_put_endian(u8 + j * 2, u16[j], enc->endian);
+      len = textencoder_convert(enc, buf, ptr, &n);
 
-          if(ringbuffer_append(&enc->buffer, u8, len * sizeof(uint16_t), ctx) < 0)
-            return JS_ThrowInternalError(ctx, "TextEncoder: ringbuffer write failed");
-        }
-      }
+      if(ptr + n < end)
+        ret = JS_ThrowInternalError(ctx, "%s: TextEncoder: not a valid %s code point at (%llu)", __func__, textcode_encodings[enc->type_code], (long long unsigned int)n);
+      else if(ringbuffer_append(&enc->buffer, buf, len, ctx) < 0)
+        ret = JS_ThrowInternalError(ctx, "%s: TextEncoder: ringbuffer write failed", __func__);
 
+      js_free(ctx, buf);
       break;
     }
+  }
 
-    case UTF32: {
-      ptr = block_begin(&in.block);
-      end = block_end(&in.block);
-
-      for(i = 0; ptr < end; ptr = next, i++) {
-        cp = unicode_from_utf8(ptr, end - ptr, &next);
-        if(cp == 0xffffffff)
-          return JS_ThrowInternalError(
-              ctx, "%s: TextEncoder: not a valid code point at (%llu): %lu", __func__, (long long unsigned int)(ptr - in.block.base), (long unsigned int)cp);
-        /*cp = 0;
-        if(!libutf_c8_to_c32(ptr, &cp))
-          return JS_ThrowInternalError(ctx, "No a valid code point at (%zu) [%zu]: %" PRIu32, i, end - ptr,
-        cp); next = ptr + libutf_c8_type(ptr); if(next == ptr) break;*/
+  return ret;
+}
 
-        uint32_put_endian(u8, cp, enc->endian);
+/**
+ * Encodes UTF-8 from src into dst without splitting a character. Returns
+ * the bytes written and sets *pread to the source bytes consumed; returns
+ * -1 when an invalid code point comes before anything could be written.
+ */
+ssize_t
+textencoder_encode_into(TextEncoder* enc, const uint8_t* src, size_t len, uint8_t* dst, size_t size, size_t* pread) {
+  size_t pos = 0, out = 0, n, room, w;
+  const uint8_t* next;
+  BOOL invalid = FALSE;
+  int c;
+
+  while(pos < len && (room = size - out)) {
+    /* longest run whose worst-case output is known to fit */
+    n = MIN_NUM(room / textencoder_width(enc), len - pos);
+    out += textencoder_convert(enc, dst + out, src + pos, &n);
+
+    if(n) {
+      pos += n;
+      continue;
+    }
 
-        if(ringbuffer_append(&enc->buffer, u8, sizeof(cp), ctx) < 0)
-          return JS_ThrowInternalError(ctx, "%s: TextEncoder: ringbuffer write failed", __func__);
-      }
+    /* stopped in front of one character: check it on its own */
+    if((invalid = (c = unicode_from_utf8(src + pos, len - pos, &next)) == -1))
       break;
+
+    switch(textcode_utf(enc)) {
+      case UTF8: w = next - (src + pos); break;
+      case UTF16: w = c >= 0x10000 ? 4 : 2; break;
+      case UTF32: w = 4; break;
+      default: w = 1; break;
     }
-    default: {
-      ret = JS_ThrowInternalError(ctx, "%s: TextEncoder: unknown encoding", __func__);
+
+    if(w > room)
       break;
-    }
+
+    n = next - (src + pos);
+    out += textencoder_convert(enc, dst + out, src + pos, &n);
+
+    if((invalid = !n))
+      break;
+
+    pos += n;
   }
 
-  return ret;
+  *pread = pos;
+  return invalid && !out ? -1 : (ssize_t)out;
 }
 
 static JSValue
@@ -527,8 +1018,11 @@ js_encoder_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValu
 
   if(argc >= 1) {
     const char* s = JS_ToCString(ctx, argv[0]);
+    int code;
 
-    if(s[case_finds(s, "utf32")] || s[case_finds(s, "utf-32")])
+    if((code = textcode_lookup(s)) != -1)
+      enc->type_code = code;
+    else if(s[case_finds(s, "utf32")] || s[case_finds(s, "utf-32")])
       enc->encoding = UTF32;
     else if(s[case_finds(s, "utf16")] || s[case_finds(s, "utf-16")])
       enc->encoding = UTF16;
@@ -538,8 +1032,8 @@ js_encoder_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValu
       return JS_ThrowInternalError(ctx, "TextEncoder '%s' is invalid s", s);
     }
 
-    if(enc->encoding > UTF8)
-      if(s[case_finds(s, "be")] || s[case_finds(s, "be")])
+    if(code == -1 && enc->encoding > UTF8)
+      if(s[case_finds(s, "be")])
         enc->endian = BIG;
 
     JS_FreeCString(ctx, s);
@@ -583,6 +1077,24 @@ js_encoder_encode(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst
         ringbuffer_reset(&enc->buffer);
       break;
     }
+
+    case ENCODER_ENCODE_INTO: {
+      InputBuffer in = js_input_chars(ctx, argv[0]), out = js_input_buffer(ctx, argv[1]);
+      size_t rd = 0;
+      ssize_t wr;
+
+      if(JS_IsException(out.value)) {
+        ret = JS_EXCEPTION;
+      } else if((wr = textencoder_encode_into(enc, input_buffer_data(&in), input_buffer_length(&in), input_buffer_data(&out), input_buffer_length(&out), &rd)) < 0) {
+        ret = JS_ThrowInternalError(ctx, "%s: TextEncoder: not a valid code point at (%llu)", __func__, (long long unsigned int)rd);
+      } else {
+        ret = js_textcode_result(ctx, textencoder_units(input_buffer_data(&in), rd), wr);
+      }
+
+      input_buffer_free(&in, ctx);
+      input_buffer_free(&out, ctx);
+      break;
+    }
   }
   return ret;
 }
@@ -619,12 +1131,132 @@ static JSClassDef js_encoder_class = {
 static const JSCFunctionListEntry js_encoder_funcs[] = {
     JS_CFUNC_MAGIC_DEF("encode", 1, js_encoder_encode, ENCODER_ENCODE),
     JS_CFUNC_MAGIC_DEF("end", 1, js_encoder_encode, ENCODER_END),
+    JS_CFUNC_MAGIC_DEF("encodeInto", 2, js_encoder_encode, ENCODER_ENCODE_INTO),
     JS_CGETSET_ENUMERABLE_DEF("encoding", js_encoder_get, 0, ENCODER_ENCODING),
     JS_CGETSET_MAGIC_DEF("endian", js_encoder_get, 0, ENCODER_ENDIANNESS),
     JS_CGETSET_MAGIC_DEF("buffered", js_encoder_get, 0, ENCODER_BUFFERED),
     JS_PROP_STRING_DEF("[Symbol.toStringTag]", "TextEncoder", JS_PROP_CONFIGURABLE),
 };
 
+enum {
+  CODESTREAM_DECODE,
+  CODESTREAM_DECODE_FLUSH,
+  CODESTREAM_ENCODE,
+  CODESTREAM_ENCODE_FLUSH,
+};
+
+/* transform(chunk, controller) and flush(controller) of the coder streams */
+static JSValue
+js_codestream_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, JSValue* data) {
+  JSValue ret = JS_UNDEFINED, chunk = JS_UNDEFINED;
+  InputBuffer in;
+
+  switch(magic) {
+    case CODESTREAM_DECODE: {
+      TextDecoder* dec;
+
+      if(!(dec = js_decoder_data(ctx, data[0])))
+        return JS_EXCEPTION;
+
+      in = js_input_chars(ctx, argv[0]);
+
+      if(JS_IsException(in.value))
+        return JS_EXCEPTION;
+
+      chunk = textdecoder_feed(dec, input_buffer_data(&in), input_buffer_length(&in), ctx);
+      input_buffer_free(&in, ctx);
+      break;
+    }
+
+    case CODESTREAM_DECODE_FLUSH: {
+      TextDecoder* dec;
+
+      if(!(dec = js_decoder_data(ctx, data[0])))
+        return JS_EXCEPTION;
+
+      /* a character left incomplete at the end becomes U+FFFD */
+      if(ringbuffer_length(&dec->buffer))
+        chunk = JS_NewString(ctx, "\xef\xbf\xbd");
+
+      ringbuffer_reset(&dec->buffer);
+      break;
+    }
+
+    case CODESTREAM_ENCODE: {
+      TextEncoder* enc;
+
+      if(!(enc = js_encoder_data(ctx, data[0])))
+        return JS_EXCEPTION;
+
+      in = js_input_chars(ctx, argv[0]);
+
+      if(JS_IsException(in.value))
+        return JS_EXCEPTION;
+
+      chunk = textencoder_encode(enc, in, ctx);
+      input_buffer_free(&in, ctx);
+
+      if(!JS_IsException(chunk) && ringbuffer_length(&enc->buffer))
+        chunk = textencoder_read(enc, ctx);
+
+      break;
+    }
+
+    case CODESTREAM_ENCODE_FLUSH: break;
+  }
+
+  if(JS_IsException(chunk))
+    return chunk;
+
+  if(!JS_IsUndefined(chunk) && js_get_propertystr_int32(ctx, chunk, "length") > 0)
+    ret = js_invoke(ctx, argv[magic & 1 ? 0 : 1], "enqueue", 1, &chunk);
+
+  JS_FreeValue(ctx, chunk);
+
+  if(JS_IsException(ret))
+    return ret;
+
+  JS_FreeValue(ctx, ret);
+  return JS_UNDEFINED;
+}
+
+/* a TransformStream whose transform and flush run the coder natively */
+static JSValue
+js_codestream_new(JSContext* ctx, JSValueConst new_target, JSValue coder, int magic) {
+  JSValue underlying, ret;
+
+  if(JS_IsException(coder))
+    return coder;
+
+  underlying = JS_NewObject(ctx);
+  JS_SetPropertyStr(ctx, underlying, "transform", JS_NewCFunctionData(ctx, js_codestream_method, 2, magic, 1, &coder));
+  JS_SetPropertyStr(ctx, underlying, "flush", JS_NewCFunctionData(ctx, js_codestream_method, 1, magic + 1, 1, &coder));
+
+  ret = js_transform_constructor(ctx, new_target, 1, &underlying);
+
+  JS_FreeValue(ctx, underlying);
+  JS_FreeValue(ctx, coder);
+  return ret;
+}
+
+static JSValue
+js_decoderstream_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  return js_codestream_new(ctx, new_target, js_decoder_constructor(ctx, textdecoder_ctor, argc, argv), CODESTREAM_DECODE);
+}
+
+static JSValue
+js_encoderstream_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  return js_codestream_new(ctx, new_target, js_encoder_constructor(ctx, textencoder_ctor, argc, argv), CODESTREAM_ENCODE);
+}
+
+static const JSCFunctionListEntry js_decoderstream_funcs[] = {
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "TextDecoderStream", JS_PROP_CONFIGURABLE),
+};
+
+static const JSCFunctionListEntry js_encoderstream_funcs[] = {
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "TextEncoderStream", JS_PROP_CONFIGURABLE),
+};
+
 int
 js_code_init(JSContext* ctx, JSModuleDef* m) {
 
@@ -651,6 +1283,21 @@ js_code_init(JSContext* ctx, JSModuleDef* m) {
 
     JS_SetConstructor(ctx, textencoder_ctor, textencoder_proto);
 
+    if(js_transform_class_id == 0)
+      js_stream_init(ctx, 0);
+
+    textdecoderstream_ctor = JS_NewCFunction2(ctx, js_decoderstream_constructor, "TextDecoderStream", 1, JS_CFUNC_constructor, 0);
+    textdecoderstream_proto = JS_NewObjectProto(ctx, transform_proto);
+
+    JS_SetPropertyFunctionList(ctx, textdecoderstream_proto, js_decoderstream_funcs, countof(js_decoderstream_funcs));
+    JS_SetConstructor(ctx, textdecoderstream_ctor, textdecoderstream_proto);
+
+    textencoderstream_ctor = JS_NewCFunction2(ctx, js_encoderstream_constructor, "TextEncoderStream", 1, JS_CFUNC_constructor, 0);
+    textencoderstream_proto = JS_NewObjectProto(ctx, transform_proto);
+
+    JS_SetPropertyFunctionList(ctx, textencoderstream_proto, js_encoderstream_funcs, countof(js_encoderstream_funcs));
+    JS_SetConstructor(ctx, textencoderstream_ctor, textencoderstream_proto);
+
     // js_set_inspect_method(ctx, textdecoder_proto,
     // js_decoder_inspect);
   }
@@ -658,6 +1305,8 @@ js_code_init(JSContext* ctx, JSModuleDef* m) {
   if(m) {
     JS_SetModuleExport(ctx, m, "TextDecoder", textdecoder_ctor);
     JS_SetModuleExport(ctx, m, "TextEncoder", textencoder_ctor);
+    JS_SetModuleExport(ctx, m, "TextDecoderStream", textdecoderstream_ctor);
+    JS_SetModuleExport(ctx, m, "TextEncoderStream", textencoderstream_ctor);
 
     /*  const char* module_name = JS_AtomToCString(ctx, m->module_name);
 
@@ -683,6 +1332,8 @@ JS_INIT_MODULE(JSContext* ctx, const char* module_name) {
   if((m = JS_NewCModule(ctx, module_name, js_code_init))) {
     JS_AddModuleExport(ctx, m, "TextDecoder");
     JS_AddModuleExport(ctx, m, "TextEncoder");
+    JS_AddModuleExport(ctx, m, "TextDecoderStream");
+    JS_AddModuleExport(ctx, m, "TextEncoderStream");
     /*if(!strcmp(module_name, "textdecoder"))
       JS_AddModuleExport(ctx, m, "default");*/
   }
@@ -61,13 +61,18 @@ typedef struct text_coder TextDecoder;
 
 extern VISIBLE JSClassID js_decoder_class_id, js_encoder_class_id;
 extern VISIBLE JSValue textdecoder_proto, textdecoder_ctor, textencoder_proto, textencoder_ctor;
+extern VISIBLE JSValue textdecoderstream_proto, textdecoderstream_ctor, textencoderstream_proto, textencoderstream_ctor;
 extern const char* const textcode_encodings[];
 
 size_t textdecoder_length(TextDecoder*);
 JSValue textdecoder_read(TextDecoder*, JSContext* ctx);
+JSValue textdecoder_decode(TextDecoder*, JSContext* ctx);
+JSValue textdecoder_feed(TextDecoder*, const uint8_t* p, size_t len, JSContext* ctx);
+ssize_t textdecoder_decode_into(TextDecoder*, uint8_t* dst, size_t size, size_t* pread);
 int js_code_init(JSContext*, JSModuleDef* m);
 size_t textencoder_length(TextEncoder*);
 JSValue textencoder_read(TextEncoder*, JSContext* ctx);
+ssize_t textencoder_encode_into(TextEncoder*, const uint8_t* src, size_t len, uint8_t* dst, size_t size, size_t* pread);
 int js_encoder_init(JSContext*, JSModuleDef* m);
 
 static inline TextDecoder*
@@ -0,0 +1,856 @@
+#include "defines.h"
+#include "utils.h"
+#include "js-utils.h"
+#include "path.h"
+#include "buffer-utils.h"
+#include "shared-ringbuffer.h"
+#include <quickjs-libc.h>
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef CONFIG_SHEXT
+#ifdef __APPLE__
+#define CONFIG_SHEXT ".dylib"
+#else
+#define CONFIG_SHEXT ".so"
+#endif
+#endif
+
+/**
+ * \defgroup quickjs-threadpool quickjs-threadpool: Worker threads with their own runtimes
+ *
+ * Each worker thread runs a QuickJS runtime of its own, with std, os and
+ * the pool's module loaded. Tasks travel as JS_WriteObject() data, so
+ * values are copied and SharedArrayBuffers are shared.
+ *
+ * Every worker has a deque of tasks, filled round-robin by run(). A worker
+ * takes the oldest task of its own deque or steals the newest one of
+ * another's. Finished tasks are posted to a lock-free MPSC SharedRing and
+ * the JS thread is woken through a pipe, at most once per drain.
+ * @{
+ */
+#define POOL_RING_SIZE 65536
+#define POOL_WRITE_FLAGS (JS_WRITE_OBJ_SAB | JS_WRITE_OBJ_REFERENCE)
+#define POOL_READ_FLAGS (JS_READ_OBJ_SAB | JS_READ_OBJ_REFERENCE)
+
+typedef struct pool_task {
+  char* func; /**< name of a module export or function source */
+  BOOL source, error;
+  uint8_t* data; /**< arguments, then the result or error message */
+  size_t len;
+  ResolveFunctions funcs;
+} PoolTask;
+
+typedef struct {
+  pthread_mutex_t lock;
+  PoolTask** tasks;
+  uint32_t head, count, capacity;
+} TaskDeque;
+
+struct thread_pool;
+
+typedef struct {
+  struct thread_pool* pool;
+  uint32_t index;
+  pthread_t thread;
+  TaskDeque queue;
+} PoolWorker;
+
+typedef struct thread_pool {
+  int ref_count; /**< atomic, the workers hold references too */
+  JSContext* ctx;
+  char* module;
+  int fds[2];
+  BOOL closing, watching;
+  int32_t queued, notified;
+  uint32_t size, next, outstanding;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  SharedRing results;
+  void* ring_mem;
+  PoolWorker* workers;
+} ThreadPool;
+
+static JSClassID js_thread_pool_class_id = 0;
+static JSValue thread_pool_proto = {{0}, JS_TAG_UNDEFINED}, thread_pool_ctor = {{0}, JS_TAG_UNDEFINED};
+
+enum {
+  THREAD_POOL_RUN = 0,
+  THREAD_POOL_CLOSE,
+};
+
+enum {
+  THREAD_POOL_SIZE = 0,
+  THREAD_POOL_PENDING,
+};
+
+static ThreadPool*
+pool_dup(ThreadPool* pool) {
+  __atomic_fetch_add(&pool->ref_count, 1, __ATOMIC_RELAXED);
+  return pool;
+}
+
+/* may run on a worker thread, so nothing here touches JS */
+static void
+pool_free(void* ptr) {
+  ThreadPool* pool = ptr;
+
+  if(__atomic_sub_fetch(&pool->ref_count, 1, __ATOMIC_ACQ_REL) == 0) {
+    for(uint32_t i = 0; i < pool->size; i++) {
+      pthread_mutex_destroy(&pool->workers[i].queue.lock);
+      free(pool->workers[i].queue.tasks);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->cond);
+    close(pool->fds[0]);
+    close(pool->fds[1]);
+    free(pool->ring_mem);
+    free(pool->workers);
+    free(pool->module);
+    free(pool);
+  }
+}
+
+static void
+pooltask_free(PoolTask* task) {
+  free(task->func);
+  free(task->data);
+  free(task);
+}
+
+static BOOL
+deque_push(TaskDeque* dq, PoolTask* task) {
+  BOOL ok = TRUE;
+
+  pthread_mutex_lock(&dq->lock);
+
+  if(dq->count == dq->capacity) {
+    uint32_t capacity = dq->capacity ? dq->capacity * 2 : 16;
+    PoolTask** tasks;
+
+    if((ok = !!(tasks = malloc(sizeof(PoolTask*) * capacity)))) {
+      for(uint32_t i = 0; i < dq->count; i++)
+        tasks[i] = dq->tasks[(dq->head + i) % dq->capacity];
+
+      free(dq->tasks);
+      dq->tasks = tasks;
+      dq->head = 0;
+      dq->capacity = capacity;
+    }
+  }
+
+  if(ok)
+    dq->tasks[(dq->head + dq->count++) % dq->capacity] = task;
+
+  pthread_mutex_unlock(&dq->lock);
+  return ok;
+}
+
+/**
+ * The owner takes the oldest task, a thief the newest
+ */
+static PoolTask*
+deque_pop(TaskDeque* dq, BOOL owner) {
+  PoolTask* task = 0;
+
+  pthread_mutex_lock(&dq->lock);
+
+  if(dq->count) {
+    if(owner) {
+      task = dq->tasks[dq->head];
+      dq->head = (dq->head + 1) % dq->capacity;
+    } else {
+      task = dq->tasks[(dq->head + dq->count - 1) % dq->capacity];
+    }
+
+    dq->count--;
+  }
+
+  pthread_mutex_unlock(&dq->lock);
+  return task;
+}
+
+/**
+ * @return  next task for worker \p self, NULL once the pool is closing
+ *          and no task is left
+ */
+static PoolTask*
+pool_take(ThreadPool* pool, uint32_t self) {
+  PoolTask* task;
+  BOOL done;
+
+  for(;;) {
+    if((task = deque_pop(&pool->workers[self].queue, TRUE)))
+      break;
+
+    for(uint32_t i = 1; i < pool->size && !task; i++)
+      task = deque_pop(&pool->workers[(self + i) % pool->size].queue, FALSE);
+
+    if(task)
+      break;
+
+    pthread_mutex_lock(&pool->lock);
+
+    while(__atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) <= 0 && !pool->closing)
+      pthread_cond_wait(&pool->cond, &pool->lock);
+
+    done = pool->closing && __atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) <= 0;
+    pthread_mutex_unlock(&pool->lock);
+
+    if(done)
+      return 0;
+  }
+
+  __atomic_fetch_sub(&pool->queued, 1, __ATOMIC_ACQ_REL);
+  return task;
+}
+
+/**
+ * Hands \p task back to the JS thread
+ */
+static void
+pool_complete(ThreadPool* pool, PoolTask* task) {
+  while(!shared_ring_send(&pool->results, &task, sizeof(task)))
+    shared_ring_wait_writable(&pool->results, sizeof(uint32_t) + sizeof(task), -1);
+
+  if(!__atomic_exchange_n(&pool->notified, 1, __ATOMIC_ACQ_REL))
+    while(write(pool->fds[1], "", 1) == -1 && errno == EINTR) {}
+}
+
+/**
+ * Bare module names are looked up in $QUICKJS_MODULE_PATH as .so and .js,
+ * relative ones next to the importing module
+ */
+static char*
+pool_module_normalize(JSContext* ctx, const char* base, const char* name, void* opaque) {
+  static const char* const extensions[] = {CONFIG_SHEXT, ".js"};
+  DynBuf db;
+
+  js_dbuf_init(ctx, &db);
+
+  if(name[0] == '.') {
+    path_append3(base, path_dirlen1(base), &db);
+    path_append2(name, &db);
+    dbuf_0(&db);
+    db.size = path_normalize2((char*)db.buf, db.size);
+    dbuf_0(&db);
+    return (char*)db.buf;
+  }
+
+  if(!strchr(name, '/')) {
+    const char* list;
+
+    if(!(list = getenv("QUICKJS_MODULE_PATH")))
+#ifdef QUICKJS_MODULE_PATH
+      list = QUICKJS_MODULE_PATH;
+#else
+      list = "";
+#endif
+
+    for(size_t i = 0; i < countof(extensions); i++) {
+      const char* p = list;
+      char* file = js_malloc(ctx, strlen(name) + strlen(extensions[i]) + 1);
+
+      if(!file)
+        break;
+
+      strcpy(file, name);
+      strcat(file, extensions[i]);
+
+      while(path_search(&p, file, &db))
+        if(path_isfile1((const char*)db.buf)) {
+          js_free(ctx, file);
+          return (char*)db.buf;
+        }
+
+      js_free(ctx, file);
+    }
+  }
+
+  dbuf_free(&db);
+  return js_strdup(ctx, name);
+}
+
+/**
+ * Imports the pool's module and returns its namespace
+ */
+static JSValue
+pool_import(JSContext* ctx, const char* module) {
+  JSAtom key = js_symbol_for_atom(ctx, "ThreadPool.module");
+  JSValue ret, global;
+  DynBuf code;
+
+  js_dbuf_init(ctx, &code);
+  dbuf_putstr(&code, "import * as m from \"");
+
+  for(const char* s = module; *s; s++) {
+    if(*s == '"' || *s == '\\')
+      dbuf_putc(&code, '\\');
+
+    dbuf_putc(&code, *s);
+  }
+
+  dbuf_putstr(&code, "\";\nglobalThis[Symbol.for('ThreadPool.module')] = m;\n");
+  dbuf_0(&code);
+
+  ret = JS_Eval(ctx, (const char*)code.buf, code.size, "<threadpool>", JS_EVAL_TYPE_MODULE);
+  dbuf_free(&code);
+
+  if(!JS_IsException(ret)) {
+    js_std_loop(ctx);
+
+    if(js_is_promise(ctx, ret) && JS_PromiseState(ctx, ret) == JS_PROMISE_REJECTED) {
+      JSValue error = JS_PromiseResult(ctx, ret);
+
+      JS_FreeValue(ctx, ret);
+      ret = JS_Throw(ctx, error);
+    }
+  }
+
+  if(!JS_IsException(ret)) {
+    JS_FreeValue(ctx, ret);
+    global = JS_GetGlobalObject(ctx);
+    ret = JS_GetProperty(ctx, global, key);
+    JS_DeleteProperty(ctx, global, key, 0);
+    JS_FreeValue(ctx, global);
+  }
+
+  JS_FreeAtom(ctx, key);
+  return ret;
+}
+
+/**
+ * Looks up a module export, or compiles function source once per worker
+ */
+static JSValue
+pool_function(JSContext* ctx, JSValueConst module, JSValueConst error, JSValueConst cache, PoolTask* task) {
+  JSValue fn;
+
+  if(!task->source) {
+    /* an import error fails every task that needs the module */
+    if(!JS_IsUndefined(error))
+      return JS_Throw(ctx, JS_DupValue(ctx, error));
+
+    if(!JS_IsObject(module))
+      return JS_ThrowReferenceError(ctx, "ThreadPool has no module to look up '%s'", task->func);
+
+    fn = JS_GetPropertyStr(ctx, module, task->func);
+  } else if(JS_IsUndefined((fn = JS_GetPropertyStr(ctx, cache, task->func)))) {
+    DynBuf code;
+
+    js_dbuf_init(ctx, &code);
+    dbuf_putc(&code, '(');
+    dbuf_putstr(&code, task->func);
+    dbuf_putstr(&code, ")");
+    dbuf_0(&code);
+
+    fn = JS_Eval(ctx, (const char*)code.buf, code.size, "<threadpool>", JS_EVAL_TYPE_GLOBAL);
+    dbuf_free(&code);
+
+    if(!JS_IsException(fn))
+      JS_SetPropertyStr(ctx, cache, task->func, JS_DupValue(ctx, fn));
+  }
+
+  if(!JS_IsException(fn) && !JS_IsFunction(ctx, fn)) {
+    JS_FreeValue(ctx, fn);
+    fn = JS_ThrowTypeError(ctx, "ThreadPool task '%.64s' is not a function", task->func);
+  }
+
+  return fn;
+}
+
+static void
+pool_execute(JSContext* ctx, JSValueConst module, JSValueConst error, JSValueConst cache, PoolTask* task) {
+  JSValue fn, args, ret;
+  uint8_t* buf;
+  size_t len;
+
+  args = JS_ReadObject(ctx, task->data, task->len, POOL_READ_FLAGS);
+  free(task->data);
+  task->data = 0;
+  task->len = 0;
+
+  if(JS_IsException(args)) {
+    ret = JS_EXCEPTION;
+  } else if(JS_IsException((fn = pool_function(ctx, module, error, cache, task)))) {
+    JS_FreeValue(ctx, args);
+    ret = JS_EXCEPTION;
+  } else {
+    int64_t argc = js_array_length(ctx, args);
+    JSValue argv[argc > 0 ? argc : 1];
+
+    for(int64_t i = 0; i < argc; i++)
+      argv[i] = JS_GetPropertyUint32(ctx, args, i);
+
+    ret = JS_Call(ctx, fn, JS_UNDEFINED, argc, argv);
+
+    for(int64_t i = 0; i < argc; i++)
+      JS_FreeValue(ctx, argv[i]);
+
+    JS_FreeValue(ctx, fn);
+    JS_FreeValue(ctx, args);
+  }
+
+  /* async tasks run the worker's event loop until they settle */
+  if(js_is_promise(ctx, ret)) {
+    JSPromiseStateEnum state;
+    JSValue result;
+
+    js_std_loop(ctx);
+
+    state = JS_PromiseState(ctx, ret);
+    result = JS_PromiseResult(ctx, ret);
+    JS_FreeValue(ctx, ret);
+
+    if(state == JS_PROMISE_FULFILLED) {
+      ret = result;
+    } else if(state == JS_PROMISE_REJECTED) {
+      ret = JS_Throw(ctx, result);
+    } else {
+      JS_FreeValue(ctx, result);
+      ret = JS_ThrowInternalError(ctx, "ThreadPool task never settled");
+    }
+  }
+
+  if(!JS_IsException(ret)) {
+    buf = JS_WriteObject(ctx, &len, ret, POOL_WRITE_FLAGS);
+    JS_FreeValue(ctx, ret);
+
+    if(buf) {
+      if((task->data = malloc(len ? len : 1))) {
+        memcpy(task->data, buf, len);
+        task->len = len;
+      }
+
+      js_free(ctx, buf);
+      return;
+    }
+  }
+
+  {
+    JSValue exception = JS_GetException(ctx);
+    const char* msg = JS_ToCString(ctx, exception);
+
+    task->error = TRUE;
+    task->data = (uint8_t*)strdup(msg ? msg : "ThreadPool task failed");
+    task->len = task->data ? strlen((const char*)task->data) : 0;
+
+    JS_FreeCString(ctx, msg);
+    JS_FreeValue(ctx, exception);
+  }
+}
+
+static void*
+pool_worker(void* arg) {
+  PoolWorker* w = arg;
+  ThreadPool* pool = w->pool;
+  JSRuntime* rt;
+  JSContext* ctx;
+  JSValue module = JS_UNDEFINED, error = JS_UNDEFINED, cache;
+  PoolTask* task;
+
+  if(!(rt = JS_NewRuntime()) || !(ctx = JS_NewContext(rt))) {
+    /* tasks are left to the other workers */
+    if(rt)
+      JS_FreeRuntime(rt);
+
+    pool_free(pool);
+    return 0;
+  }
+
+  js_std_init_handlers(rt);
+  JS_SetModuleLoaderFunc(rt, pool_module_normalize, js_module_loader, 0);
+  js_std_add_helpers(ctx, 0, 0);
+  js_init_module_std(ctx, "std");
+  js_init_module_os(ctx, "os");
+
+  if(pool->module)
+    if(JS_IsException((module = pool_import(ctx, pool->module))))
+      error = JS_GetException(ctx);
+
+  cache = JS_NewObjectProto(ctx, JS_NULL);
+
+  while((task = pool_take(pool, w->index))) {
+    pool_execute(ctx, module, error, cache, task);
+    pool_complete(pool, task);
+  }
+
+  JS_FreeValue(ctx, cache);
+  JS_FreeValue(ctx, error);
+  JS_FreeValue(ctx, module);
+  js_std_free_handlers(rt);
+  JS_FreeContext(ctx);
+  JS_FreeRuntime(rt);
+  regexp_cache_clear();
+
+  pool_free(pool);
+  return 0;
+}
+
+static JSValue js_thread_pool_event(JSContext*, JSValueConst, int, JSValueConst[], int, void*);
+
+/**
+ * The read handler keeps the event loop alive while tasks are outstanding
+ */
+static void
+pool_watch(ThreadPool* pool, BOOL on) {
+  JSContext* ctx = pool->ctx;
+  JSValue set_handler;
+
+  if(pool->watching == on)
+    return;
+
+  set_handler = js_iohandler_fn(ctx, FALSE);
+  js_iohandler_set(ctx, set_handler, pool->fds[0], on ? js_function_cclosure(ctx, js_thread_pool_event, 0, 0, pool_dup(pool), pool_free) : JS_NULL);
+  JS_FreeValue(ctx, set_handler);
+
+  pool->watching = on;
+}
+
+static void
+pool_settle(JSContext* ctx, PoolTask* task) {
+  JSValue value;
+
+  if(task->error) {
+    value = JS_NewError(ctx);
+    JS_SetPropertyStr(ctx, value, "message", JS_NewStringLen(ctx, (const char*)task->data, task->len));
+    promise_reject(ctx, &task->funcs, value);
+  } else if(JS_IsException((value = JS_ReadObject(ctx, task->data, task->len, POOL_READ_FLAGS)))) {
+    value = JS_GetException(ctx);
+    promise_reject(ctx, &task->funcs, value);
+  } else {
+    promise_resolve(ctx, &task->funcs, value);
+  }
+
+  JS_FreeValue(ctx, value);
+  pooltask_free(task);
+}
+
+static JSValue
+js_thread_pool_event(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  ThreadPool* pool = pool_dup(ptr);
+  PoolTask* task;
+  char buf[64];
+
+  while(read(pool->fds[0], buf, sizeof(buf)) > 0) {}
+
+  /* a worker finishing from here on writes to the pipe again */
+  __atomic_store_n(&pool->notified, 0, __ATOMIC_RELEASE);
+
+  while(shared_ring_receive(&pool->results, &task, sizeof(task)) == sizeof(task)) {
+    pool->outstanding--;
+    pool_settle(ctx, task);
+  }
+
+  if(pool->outstanding == 0)
+    pool_watch(pool, FALSE);
+
+  pool_free(pool);
+  return JS_UNDEFINED;
+}
+
+static void
+pool_close(ThreadPool* pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->closing = TRUE;
+  pthread_cond_broadcast(&pool->cond);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+static inline ThreadPool*
+js_thread_pool_data2(JSContext* ctx, JSValueConst value) {
+  return JS_GetOpaque2(ctx, value, js_thread_pool_class_id);
+}
+
+/**
+ * new ThreadPool([module], { size = number of CPUs }): starts the worker
+ * threads, each importing module first
+ */
+static JSValue
+js_thread_pool_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  JSValue proto, obj = JS_UNDEFINED;
+  JSValueConst options = argc > 1 ? argv[1] : JS_IsObject(argv[0]) ? argv[0] : JS_UNDEFINED;
+  ThreadPool* pool;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  uint32_t size = MAX_NUM(cpus, 1), started = 0;
+  size_t ring_size = shared_ring_size(POOL_RING_SIZE);
+
+  if(JS_IsObject(options)) {
+    JSValue value = JS_GetPropertyStr(ctx, options, "size");
+
+    if(!JS_IsUndefined(value) && (JS_ToUint32(ctx, &size, value) || size == 0)) {
+      JS_FreeValue(ctx, value);
+      return JS_ThrowRangeError(ctx, "ThreadPool size must be a positive integer");
+    }
+
+    JS_FreeValue(ctx, value);
+  }
+
+  if(!(pool = calloc(1, sizeof(ThreadPool))))
+    return JS_ThrowOutOfMemory(ctx);
+
+  pool->ref_count = 1;
+  pool->ctx = ctx;
+  pool->size = size;
+  pool->fds[0] = pool->fds[1] = -1;
+  pthread_mutex_init(&pool->lock, 0);
+  pthread_cond_init(&pool->cond, 0);
+
+  if(!(pool->workers = calloc(size, sizeof(PoolWorker))) || !(pool->ring_mem = malloc(ring_size))) {
+    pool->size = 0;
+    pool_free(pool);
+    return JS_ThrowOutOfMemory(ctx);
+  }
+
+  for(uint32_t i = 0; i < size; i++) {
+    pool->workers[i].pool = pool;
+    pool->workers[i].index = i;
+    pthread_mutex_init(&pool->workers[i].queue.lock, 0);
+  }
+
+  shared_ring_init(&pool->results, pool->ring_mem, ring_size, SHARED_RING_MPSC);
+
+  if(pipe(pool->fds) == -1) {
+    pool_free(pool);
+    return JS_ThrowInternalError(ctx, "pipe() failed: %s", strerror(errno));
+  }
+
+  fcntl(pool->fds[0], F_SETFL, fcntl(pool->fds[0], F_GETFL) | O_NONBLOCK);
+  fcntl(pool->fds[0], F_SETFD, FD_CLOEXEC);
+  fcntl(pool->fds[1], F_SETFD, FD_CLOEXEC);
+
+  if(argc > 0 && JS_IsString(argv[0])) {
+    const char* module = JS_ToCString(ctx, argv[0]);
+
+    pool->module = path_absolute1(module);
+    path_normalize1(pool->module);
+    JS_FreeCString(ctx, module);
+  }
+
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+
+  if(JS_IsException(proto))
+    goto fail;
+
+  obj = JS_NewObjectProtoClass(ctx, proto, js_thread_pool_class_id);
+  JS_FreeValue(ctx, proto);
+
+  if(JS_IsException(obj))
+    goto fail;
+
+  for(uint32_t i = 0; i < size; i++) {
+    pool_dup(pool);
+
+    if(pthread_create(&pool->workers[i].thread, 0, pool_worker, &pool->workers[i])) {
+      pool_free(pool);
+      continue;
+    }
+
+    pthread_detach(pool->workers[i].thread);
+    started++;
+  }
+
+  if(started == 0) {
+    JS_FreeValue(ctx, obj);
+    pool_close(pool);
+    pool_free(pool);
+    return JS_ThrowInternalError(ctx, "pthread_create() failed");
+  }
+
+  JS_SetOpaque(obj, pool);
+  return obj;
+
+fail:
+  pool_free(pool);
+  return JS_EXCEPTION;
+}
+
+static JSValue
+js_thread_pool_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  ThreadPool* pool;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(pool = js_thread_pool_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case THREAD_POOL_RUN: {
+      PoolTask* task;
+      JSValue args;
+      const char* fn;
+      uint8_t* buf;
+      size_t len;
+
+      if(pool->closing)
+        return JS_ThrowInternalError(ctx, "ThreadPool is closed");
+
+      if(!JS_IsString(argv[0]) && !JS_IsFunction(ctx, argv[0]))
+        return JS_ThrowTypeError(ctx, "argument 1 must be a function or the name of an export");
+
+      args = argc > 1 && !JS_IsUndefined(argv[1]) ? JS_DupValue(ctx, argv[1]) : JS_NewArray(ctx);
+
+      if(!JS_IsArray(ctx, args)) {
+        JS_FreeValue(ctx, args);
+        return JS_ThrowTypeError(ctx, "argument 2 must be an array");
+      }
+
+      buf = JS_WriteObject(ctx, &len, args, POOL_WRITE_FLAGS);
+      JS_FreeValue(ctx, args);
+
+      if(!buf)
+        return JS_EXCEPTION;
+
+      if(!(task = calloc(1, sizeof(PoolTask))) || !(task->data = malloc(len ? len : 1))) {
+        free(task);
+        js_free(ctx, buf);
+        return JS_ThrowOutOfMemory(ctx);
+      }
+
+      memcpy(task->data, buf, len);
+      task->len = len;
+      js_free(ctx, buf);
+
+      task->source = JS_IsFunction(ctx, argv[0]);
+
+      if(!(fn = JS_ToCString(ctx, argv[0]))) {
+        pooltask_free(task);
+        return JS_EXCEPTION;
+      }
+
+      task->func = strdup(fn);
+      JS_FreeCString(ctx, fn);
+
+      /* the transferred ArrayBuffers were copied, detach the originals */
+      if(argc > 2 && JS_IsArray(ctx, argv[2])) {
+        int64_t n = js_array_length(ctx, argv[2]);
+
+        for(int64_t i = 0; i < n; i++) {
+          JSValue item = JS_GetPropertyUint32(ctx, argv[2], i);
+
+          if(js_is_arraybuffer(ctx, item))
+            JS_DetachArrayBuffer(ctx, item);
+
+          JS_FreeValue(ctx, item);
+        }
+      }
+
+      ret = promise_create(ctx, &task->funcs);
+
+      if(!task->func || !deque_push(&pool->workers[pool->next++ % pool->size].queue, task)) {
+        js_resolve_functions_free(ctx, &task->funcs);
+        pooltask_free(task);
+        JS_FreeValue(ctx, ret);
+        return JS_ThrowOutOfMemory(ctx);
+      }
+
+      pool->outstanding++;
+      pool_watch(pool, TRUE);
+
+      pthread_mutex_lock(&pool->lock);
+      __atomic_fetch_add(&pool->queued, 1, __ATOMIC_ACQ_REL);
+      pthread_cond_signal(&pool->cond);
+      pthread_mutex_unlock(&pool->lock);
+      break;
+    }
+
+    case THREAD_POOL_CLOSE: {
+      /* queued tasks still run, the workers exit when they are done */
+      pool_close(pool);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static JSValue
+js_thread_pool_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  ThreadPool* pool;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(pool = js_thread_pool_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case THREAD_POOL_SIZE: {
+      ret = JS_NewUint32(ctx, pool->size);
+      break;
+    }
+
+    case THREAD_POOL_PENDING: {
+      ret = JS_NewUint32(ctx, pool->outstanding);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static void
+js_thread_pool_finalizer(JSRuntime* rt, JSValue val) {
+  ThreadPool* pool;
+
+  if((pool = JS_GetOpaque(val, js_thread_pool_class_id))) {
+    pool_close(pool);
+    pool_free(pool);
+  }
+}
+
+static JSClassDef js_thread_pool_class = {
+    .class_name = "ThreadPool",
+    .finalizer = js_thread_pool_finalizer,
+};
+
+static const JSCFunctionListEntry js_thread_pool_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("run", 1, js_thread_pool_method, THREAD_POOL_RUN),
+    JS_CFUNC_MAGIC_DEF("close", 0, js_thread_pool_method, THREAD_POOL_CLOSE),
+    JS_CGETSET_MAGIC_DEF("size", js_thread_pool_get, 0, THREAD_POOL_SIZE),
+    JS_CGETSET_MAGIC_DEF("pending", js_thread_pool_get, 0, THREAD_POOL_PENDING),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "ThreadPool", JS_PROP_CONFIGURABLE),
+};
+
+int
+js_threadpool_init(JSContext* ctx, JSModuleDef* m) {
+
+  if(js_thread_pool_class_id == 0) {
+    JS_NewClassID(&js_thread_pool_class_id);
+    JS_NewClass(JS_GetRuntime(ctx), js_thread_pool_class_id, &js_thread_pool_class);
+
+    thread_pool_ctor = JS_NewCFunction2(ctx, js_thread_pool_constructor, "ThreadPool", 1, JS_CFUNC_constructor, 0);
+    thread_pool_proto = JS_NewObject(ctx);
+
+    JS_SetPropertyFunctionList(ctx, thread_pool_proto, js_thread_pool_funcs, countof(js_thread_pool_funcs));
+
+    JS_SetClassProto(ctx, js_thread_pool_class_id, thread_pool_proto);
+    JS_SetConstructor(ctx, thread_pool_ctor, thread_pool_proto);
+  }
+
+  if(m)
+    JS_SetModuleExport(ctx, m, "ThreadPool", thread_pool_ctor);
+
+  return 0;
+}
+
+#ifdef JS_THREADPOOL_MODULE
+#define JS_INIT_MODULE js_init_module
+#else
+#define JS_INIT_MODULE js_init_module_threadpool
+#endif
+
+VISIBLE JSModuleDef*
+JS_INIT_MODULE(JSContext* ctx, const char* module_name) {
+  JSModuleDef* m;
+
+  if((m = JS_NewCModule(ctx, module_name, js_threadpool_init)))
+    JS_AddModuleExport(ctx, m, "ThreadPool");
+
+  return m;
+}
+
+/**
+ * @}
+ */
@@ -0,0 +1,568 @@
+#include "defines.h"
+#include "utils.h"
+#include <list.h>
+
+/**
+ * \defgroup quickjs-timerwheel quickjs-timerwheel: Hierarchical timer wheel
+ *
+ * setTimeout()/setInterval() on a hierarchical timing wheel with 1ms
+ * resolution. Starting, stopping and refreshing a timer is O(1) and makes
+ * no call into JS. Timers far in the future sit in coarser levels and move
+ * down when their slot comes up. The os module only ever sees one
+ * os.setTimeout() for the next slot that needs attention, it is re-armed
+ * when that slot moves closer. Each runtime with active timers has its own
+ * wheel.
+ * @{
+ */
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 5
+
+/* ~12 days, timers further out wait in the last level and cascade again */
+#define WHEEL_MAX_DELTA (((int64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
+
+#define TIMER_MAX_DELAY INT32_MAX
+
+typedef struct timer_entry {
+  int ref_count;
+  struct list_head link;
+  int64_t expires;
+  uint32_t delay;
+  uint8_t level, slot;
+  BOOL interval, active;
+  JSContext* ctx;
+  JSValue func;
+  struct timer_wheel* wheel; /**< valid while active */
+} TimerEntry;
+
+typedef struct timer_wheel {
+  struct list_head link;
+  JSRuntime* rt;
+  JSContext* ctx; /**< owns os_timer and dispatch */
+  int64_t current, armed;
+  uint32_t count;
+  BOOL running;
+  uint64_t bitmap[WHEEL_LEVELS];
+  struct list_head slots[WHEEL_LEVELS][WHEEL_SIZE];
+  JSValue os_timer, dispatch;
+} TimerWheel;
+
+VISIBLE JSClassID js_timer_class_id = 0;
+static JSValue timer_proto = {{0}, JS_TAG_UNDEFINED};
+
+/* wheels of the runtimes on this thread that have active timers */
+static thread_local struct list_head timer_wheels;
+
+enum {
+  TIMER_SET_TIMEOUT = 0,
+  TIMER_SET_INTERVAL,
+  TIMER_CLEAR,
+};
+
+enum {
+  TIMER_REFRESH = 0,
+};
+
+enum {
+  PROP_ACTIVE = 0,
+  PROP_DELAY,
+  PROP_INTERVAL,
+};
+
+static JSValue wheel_dispatch(JSContext*, JSValueConst, int, JSValueConst[], int, void*);
+
+/**
+ * @return  the wheel of the runtime of \p ctx, created on the first timer
+ */
+static TimerWheel*
+wheel_get(JSContext* ctx) {
+  JSRuntime* rt = JS_GetRuntime(ctx);
+  struct list_head* el;
+  TimerWheel* w;
+
+  if(!timer_wheels.next)
+    init_list_head(&timer_wheels);
+
+  list_for_each(el, &timer_wheels) {
+    if((w = list_entry(el, TimerWheel, link))->rt == rt)
+      return w;
+  }
+
+  if(!(w = js_mallocz(ctx, sizeof(TimerWheel))))
+    return 0;
+
+  for(int l = 0; l < WHEEL_LEVELS; l++)
+    for(int i = 0; i < WHEEL_SIZE; i++)
+      init_list_head(&w->slots[l][i]);
+
+  w->rt = rt;
+  w->ctx = JS_DupContext(ctx);
+  w->os_timer = JS_UNDEFINED;
+  w->dispatch = js_function_cclosure(ctx, wheel_dispatch, 0, 0, w, 0);
+  list_add(&w->link, &timer_wheels);
+  return w;
+}
+
+static void
+timer_free(JSRuntime* rt, TimerEntry* t) {
+  if(--t->ref_count == 0) {
+    JS_FreeValueRT(rt, t->func);
+    js_free_rt(rt, t);
+  }
+}
+
+static void
+wheel_insert(TimerWheel* w, TimerEntry* t) {
+  int64_t delta = t->expires - w->current;
+  int level = 0;
+
+  if(delta > WHEEL_MAX_DELTA)
+    delta = WHEEL_MAX_DELTA;
+
+  while(level < WHEEL_LEVELS - 1 && delta >> (WHEEL_BITS * (level + 1)))
+    level++;
+
+  t->level = level;
+  t->slot = ((w->current + delta) >> (WHEEL_BITS * level)) & WHEEL_MASK;
+
+  list_add_tail(&t->link, &w->slots[level][t->slot]);
+  w->bitmap[level] |= 1ULL << t->slot;
+}
+
+static void
+wheel_unlink(TimerWheel* w, TimerEntry* t) {
+  list_del(&t->link);
+
+  if(list_empty(&w->slots[t->level][t->slot]))
+    w->bitmap[t->level] &= ~(1ULL << t->slot);
+}
+
+/**
+ * @return  time at which the nearest non-empty slot of any level comes up
+ */
+static int64_t
+wheel_next(TimerWheel* w) {
+  int64_t next = INT64_MAX;
+
+  for(int l = 0; l < WHEEL_LEVELS; l++) {
+    int shift = WHEEL_BITS * l;
+    int64_t cur = w->current >> shift, slot;
+    int c = cur & WHEEL_MASK;
+    uint64_t above = c == WHEEL_MASK ? 0 : w->bitmap[l] & (~0ULL << (c + 1));
+
+    if(!w->bitmap[l])
+      continue;
+
+    /* slots at or below the current index belong to the next rotation */
+    slot = above ? (cur - c) + ctz64(above) : (cur - c) + WHEEL_SIZE + ctz64(w->bitmap[l]);
+
+    if((slot << shift) < next)
+      next = slot << shift;
+  }
+
+  return next;
+}
+
+/**
+ * Moves the timers of a slot to \p list and empties the slot
+ */
+static void
+wheel_take(TimerWheel* w, int level, int slot, struct list_head* list) {
+  init_list_head(list);
+  list_splice(&w->slots[level][slot], list);
+  init_list_head(&w->slots[level][slot]);
+  w->bitmap[level] &= ~(1ULL << slot);
+}
+
+static void
+wheel_cascade(TimerWheel* w, int level, int slot) {
+  struct list_head list, *el;
+
+  wheel_take(w, level, slot, &list);
+
+  while(!list_empty(&list)) {
+    el = list.next;
+    list_del(el);
+    wheel_insert(w, list_entry(el, TimerEntry, link));
+  }
+}
+
+/**
+ * Frees a wheel after its last timer stopped
+ */
+static void
+wheel_free(TimerWheel* w) {
+  JSRuntime* rt = w->rt;
+
+  list_del(&w->link);
+  JS_FreeValue(w->ctx, w->dispatch);
+  JS_FreeContext(w->ctx);
+  js_free_rt(rt, w);
+}
+
+/**
+ * Points the os module's timeout at the nearest slot, re-arming it only
+ * when that slot is earlier than the armed one
+ */
+static void
+wheel_arm(TimerWheel* w) {
+  JSContext* ctx = w->ctx;
+  int64_t next;
+  JSValue fn;
+
+  if(w->running)
+    return;
+
+  if(w->armed && (w->count == 0 || (next = wheel_next(w)) < w->armed)) {
+    fn = js_os_function(ctx, "clearTimeout");
+    JS_FreeValue(ctx, JS_Call(ctx, fn, JS_UNDEFINED, 1, &w->os_timer));
+    JS_FreeValue(ctx, fn);
+    JS_FreeValue(ctx, w->os_timer);
+    w->os_timer = JS_UNDEFINED;
+    w->armed = 0;
+  }
+
+  if(w->count == 0) {
+    wheel_free(w);
+    return;
+  }
+
+  if(!w->armed) {
+    int64_t delay = (next = wheel_next(w)) - js_time_ms();
+    JSValue args[2] = {w->dispatch, JS_NewInt64(ctx, delay < 0 ? 0 : delay)};
+
+    fn = js_os_function(ctx, "setTimeout");
+    w->os_timer = JS_Call(ctx, fn, JS_UNDEFINED, 2, args);
+    JS_FreeValue(ctx, fn);
+
+    if(JS_IsException(w->os_timer)) {
+      JS_FreeValue(ctx, JS_GetException(ctx));
+      w->os_timer = JS_UNDEFINED;
+    } else {
+      w->armed = next;
+    }
+  }
+}
+
+static BOOL
+timer_start(JSContext* ctx, TimerEntry* t) {
+  TimerWheel* w;
+  int64_t now = js_time_ms();
+
+  if(!(w = wheel_get(ctx)))
+    return FALSE;
+
+  /* nothing is due before now, so the wheel may skip ahead */
+  if(!w->running && (w->count == 0 || wheel_next(w) > now))
+    w->current = now;
+
+  t->expires = now + t->delay;
+
+  if(t->expires <= w->current)
+    t->expires = w->current + 1;
+
+  wheel_insert(w, t);
+  t->wheel = w;
+  t->active = TRUE;
+  t->ref_count++;
+  w->count++;
+
+  wheel_arm(w);
+  return TRUE;
+}
+
+static void
+timer_remove(JSRuntime* rt, TimerEntry* t) {
+  TimerWheel* w = t->wheel;
+
+  if(t->active) {
+    wheel_unlink(w, t);
+    t->active = FALSE;
+    w->count--;
+    timer_free(rt, t);
+  }
+}
+
+static void
+timer_stop(JSRuntime* rt, TimerEntry* t) {
+  TimerWheel* w = t->wheel;
+
+  /* the wheel of an inactive timer may be gone */
+  if(t->active) {
+    timer_remove(rt, t);
+    wheel_arm(w);
+  }
+}
+
+/**
+ * Runs the timers of the level 0 slot for \p tick after moving the
+ * slots of coarser levels that come up at \p tick down
+ */
+static void
+wheel_tick(TimerWheel* w, int64_t tick, int64_t now, JSValue* error) {
+  struct list_head pending;
+
+  w->current = tick;
+
+  for(int l = WHEEL_LEVELS - 1; l > 0; l--)
+    if((tick & (((int64_t)1 << (WHEEL_BITS * l)) - 1)) == 0)
+      wheel_cascade(w, l, (tick >> (WHEEL_BITS * l)) & WHEEL_MASK);
+
+  wheel_take(w, 0, tick & WHEEL_MASK, &pending);
+
+  /* stopping a pending timer unlinks it from this list */
+  while(!list_empty(&pending)) {
+    TimerEntry* t = list_entry(pending.next, TimerEntry, link);
+    JSContext* ctx = t->ctx;
+    JSValue ret;
+
+    list_del(&t->link);
+
+    if(t->interval) {
+      t->expires = now + t->delay;
+      wheel_insert(w, t);
+      t->ref_count++;
+    } else {
+      t->active = FALSE;
+      w->count--;
+    }
+
+    ret = JS_Call(ctx, t->func, JS_UNDEFINED, 0, 0);
+
+    if(JS_IsException(ret)) {
+      JSValue exception = JS_GetException(ctx);
+
+      if(JS_IsUndefined(*error))
+        *error = exception;
+      else
+        JS_FreeValue(ctx, exception);
+    }
+
+    JS_FreeValue(ctx, ret);
+    timer_free(JS_GetRuntime(ctx), t);
+  }
+}
+
+static JSValue
+wheel_dispatch(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* opaque) {
+  TimerWheel* w = opaque;
+  JSValue error = JS_UNDEFINED;
+  int64_t now = js_time_ms(), next;
+
+  JS_FreeValue(ctx, w->os_timer);
+  w->os_timer = JS_UNDEFINED;
+  w->armed = 0;
+  w->running = TRUE;
+
+  while(w->count && (next = wheel_next(w)) <= now)
+    wheel_tick(w, next, now, &error);
+
+  w->current = now;
+  w->running = FALSE;
+
+  wheel_arm(w);
+
+  /* the first exception of a callback is reported, the others are dropped */
+  return JS_IsUndefined(error) ? JS_UNDEFINED : JS_Throw(ctx, error);
+}
+
+static inline TimerEntry*
+js_timer_data(JSValueConst value) {
+  return JS_GetOpaque(value, js_timer_class_id);
+}
+
+static inline TimerEntry*
+js_timer_data2(JSContext* ctx, JSValueConst value) {
+  return JS_GetOpaque2(ctx, value, js_timer_class_id);
+}
+
+static JSValue
+js_timerwheel_function(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  JSValue ret = JS_UNDEFINED;
+
+  switch(magic) {
+    case TIMER_SET_TIMEOUT:
+    case TIMER_SET_INTERVAL: {
+      TimerEntry* t;
+      int64_t delay = 0;
+
+      if(!JS_IsFunction(ctx, argv[0]))
+        return JS_ThrowTypeError(ctx, "argument 1 must be a function");
+
+      if(argc > 1 && JS_ToInt64(ctx, &delay, argv[1]))
+        return JS_EXCEPTION;
+
+      if(!(t = js_mallocz(ctx, sizeof(TimerEntry))))
+        return JS_EXCEPTION;
+
+      t->ref_count = 1;
+      t->delay = delay < 1 ? 1 : delay > TIMER_MAX_DELAY ? TIMER_MAX_DELAY : delay;
+      t->interval = magic == TIMER_SET_INTERVAL;
+      t->ctx = ctx;
+      t->func = JS_DupValue(ctx, argv[0]);
+
+      ret = JS_NewObjectProtoClass(ctx, timer_proto, js_timer_class_id);
+
+      if(JS_IsException(ret)) {
+        timer_free(JS_GetRuntime(ctx), t);
+        return ret;
+      }
+
+      JS_SetOpaque(ret, t);
+
+      if(!timer_start(ctx, t)) {
+        JS_FreeValue(ctx, ret);
+        return JS_EXCEPTION;
+      }
+
+      break;
+    }
+
+    case TIMER_CLEAR: {
+      TimerEntry* t;
+
+      if((t = js_timer_data(argv[0]))) {
+        timer_stop(JS_GetRuntime(ctx), t);
+      } else if(!js_is_null_or_undefined(argv[0])) {
+        /* handles of os.setTimeout() */
+        JSValue fn = js_os_function(ctx, "clearTimeout");
+
+        ret = JS_IsException(fn) ? fn : JS_Call(ctx, fn, JS_UNDEFINED, 1, argv);
+        JS_FreeValue(ctx, fn);
+      }
+
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static JSValue
+js_timer_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  TimerEntry* t;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(t = js_timer_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case TIMER_REFRESH: {
+      timer_remove(JS_GetRuntime(ctx), t);
+
+      if(!timer_start(ctx, t))
+        return JS_EXCEPTION;
+
+      ret = JS_DupValue(ctx, this_val);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static JSValue
+js_timer_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  TimerEntry* t;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(t = js_timer_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case PROP_ACTIVE: {
+      ret = JS_NewBool(ctx, t->active);
+      break;
+    }
+
+    case PROP_DELAY: {
+      ret = JS_NewUint32(ctx, t->delay);
+      break;
+    }
+
+    case PROP_INTERVAL: {
+      ret = JS_NewBool(ctx, t->interval);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static void
+js_timer_finalizer(JSRuntime* rt, JSValue val) {
+  TimerEntry* t;
+
+  /* an active timer stays in the wheel */
+  if((t = js_timer_data(val)))
+    timer_free(rt, t);
+}
+
+static void
+js_timer_mark(JSRuntime* rt, JSValueConst val, JS_MarkFunc* mark_func) {
+  TimerEntry* t;
+
+  if((t = js_timer_data(val)))
+    JS_MarkValue(rt, t->func, mark_func);
+}
+
+static JSClassDef js_timer_class = {
+    .class_name = "Timer",
+    .finalizer = js_timer_finalizer,
+    .gc_mark = js_timer_mark,
+};
+
+static const JSCFunctionListEntry js_timer_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("refresh", 0, js_timer_method, TIMER_REFRESH),
+    JS_CGETSET_MAGIC_DEF("active", js_timer_get, 0, PROP_ACTIVE),
+    JS_CGETSET_MAGIC_DEF("delay", js_timer_get, 0, PROP_DELAY),
+    JS_CGETSET_MAGIC_DEF("interval", js_timer_get, 0, PROP_INTERVAL),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Timer", JS_PROP_CONFIGURABLE),
+};
+
+static const JSCFunctionListEntry js_timerwheel_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("setTimeout", 2, js_timerwheel_function, TIMER_SET_TIMEOUT),
+    JS_CFUNC_MAGIC_DEF("setInterval", 2, js_timerwheel_function, TIMER_SET_INTERVAL),
+    JS_CFUNC_MAGIC_DEF("clearTimeout", 1, js_timerwheel_function, TIMER_CLEAR),
+    JS_CFUNC_MAGIC_DEF("clearInterval", 1, js_timerwheel_function, TIMER_CLEAR),
+};
+
+int
+js_timerwheel_init(JSContext* ctx, JSModuleDef* m) {
+
+  if(js_timer_class_id == 0) {
+    JS_NewClassID(&js_timer_class_id);
+    JS_NewClass(JS_GetRuntime(ctx), js_timer_class_id, &js_timer_class);
+
+    timer_proto = JS_NewObject(ctx);
+
+    JS_SetPropertyFunctionList(ctx, timer_proto, js_timer_funcs, countof(js_timer_funcs));
+    JS_SetClassProto(ctx, js_timer_class_id, timer_proto);
+  }
+
+  if(m)
+    JS_SetModuleExportList(ctx, m, js_timerwheel_funcs, countof(js_timerwheel_funcs));
+
+  return 0;
+}
+
+#ifdef JS_TIMERWHEEL_MODULE
+#define JS_INIT_MODULE js_init_module
+#else
+#define JS_INIT_MODULE js_init_module_timerwheel
+#endif
+
+VISIBLE JSModuleDef*
+JS_INIT_MODULE(JSContext* ctx, const char* module_name) {
+  JSModuleDef* m;
+
+  if((m = JS_NewCModule(ctx, module_name, js_timerwheel_init)))
+    JS_AddModuleExportList(ctx, m, js_timerwheel_funcs, countof(js_timerwheel_funcs));
+
+  return m;
+}
+
+/**
+ * @}
+ */
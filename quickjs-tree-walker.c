@@ -54,6 +54,7 @@ enum tree_iterator_return {
 typedef struct {
   int ref_count;
   uint32_t tag_mask;
+  int flags;
   Vector hier;
   JSValueConst filter, transform;
 } TreeWalker;
@@ -66,6 +67,7 @@ tree_walker_reset(TreeWalker* w, JSContext* ctx) {
   vector_clear(&w->hier);
 
   w->tag_mask = TYPE_ALL;
+  w->flags = PROPENUM_DEFAULT_FLAGS;
   w->filter = JS_UNDEFINED;
   w->transform = JS_UNDEFINED;
 }
@@ -85,8 +87,10 @@ tree_walker_free(TreeWalker* w, JSRuntime* rt) {
 static TreeWalker*
 tree_walker_new(JSContext* ctx) {
   TreeWalker* w;
-  if((w = js_mallocz(ctx, sizeof(TreeWalker))))
+  if((w = js_mallocz(ctx, sizeof(TreeWalker)))) {
     w->ref_count = 1;
+    w->flags = PROPENUM_DEFAULT_FLAGS;
+  }
   return w;
 }
 
@@ -96,6 +100,48 @@ tree_walker_setroot(TreeWalker* w, JSContext* ctx, JSValueConst object) {
   return property_recursion_push(&w->hier, ctx, JS_DupValue(ctx, object), PROPENUM_DEFAULT_FLAGS);
 }
 
+/**
+ * Checks \p value against the type mask, skipping the array/function
+ * probes of js_value_type() when the mask accepts every kind of object.
+ */
+static inline BOOL
+tree_walker_accept(JSContext* ctx, JSValueConst value, ValueTypeMask mask) {
+  const ValueTypeMask objects = TYPE_OBJECT | TYPE_ARRAY | TYPE_FUNCTION;
+
+  if(!mask || mask == TYPE_ALL)
+    return TRUE;
+
+  if(JS_VALUE_GET_TAG(value) == JS_TAG_OBJECT && (mask & objects) == objects)
+    return TRUE;
+
+  return (mask & js_value_type(ctx, value)) != 0;
+}
+
+/**
+ * Moves past the current node, whose value the caller already holds,
+ * descending into it when \p descend is set and it is a non-circular object.
+ * Unlike property_recursion_next() the value is not fetched again.
+ */
+static PropertyEnumeration*
+tree_walker_advance(TreeWalker* w, JSContext* ctx, JSValueConst value, BOOL descend) {
+  PropertyEnumeration* it;
+
+  if(!(it = property_recursion_top(&w->hier)))
+    return 0;
+
+  if(descend && JS_IsObject(value) && !property_recursion_circular(&w->hier, value))
+    if((it = property_recursion_push(&w->hier, ctx, JS_DupValue(ctx, value), w->flags)))
+      return it;
+
+  it = property_recursion_top(&w->hier);
+
+  while(!property_enumeration_next(it))
+    if(!(it = property_recursion_pop(&w->hier, ctx)))
+      break;
+
+  return it;
+}
+
 static void
 tree_walker_dump(TreeWalker* w, JSContext* ctx, DynBuf* db) {
   dbuf_printf(db, "TreeWalker {\n  depth: %u", vector_size(&w->hier, sizeof(PropertyEnumeration)));
@@ -195,35 +241,101 @@ js_tree_walker_tostring(JSContext* ctx, JSValueConst this_val, int argc, JSValue
   return ret;
 }
 
+/**
+ * Advances to the next node accepted by the type mask and \p pred.
+ * Each node's value is fetched once; on success it is stored in \p pvalue.
+ */
 static PropertyEnumeration*
-js_tree_walker_next(JSContext* ctx, TreeWalker* w, JSValueConst this_arg, JSValueConst pred) {
+js_tree_walker_next(JSContext* ctx, TreeWalker* w, JSValueConst this_arg, JSValueConst pred, JSValue* pvalue) {
   PropertyEnumeration* it;
-  ValueTypeMask type, mask = w->tag_mask & TYPE_ALL;
-
-  for(; (property_recursion_next(&w->hier, ctx), it = property_recursion_top(&w->hier));) {
-    if(mask && mask != TYPE_ALL) {
-      JSValue value;
-      value = property_enumeration_value(it, ctx);
-      type = js_value_type(ctx, value);
-      JS_FreeValue(ctx, value);
-      if((mask & type) == 0)
-        continue;
-    }
-    if(JS_IsFunction(ctx, pred)) {
-      BOOL result = property_enumeration_predicate(it, ctx, pred, this_arg);
+  ValueTypeMask mask = w->tag_mask & TYPE_ALL;
+  BOOL has_pred = JS_IsFunction(ctx, pred);
+  JSValue value;
+
+  if(!(it = property_recursion_top(&w->hier)))
+    return 0;
+
+  value = property_enumeration_value(it, ctx);
+
+  for(;;) {
+    it = tree_walker_advance(w, ctx, value, TRUE);
+    JS_FreeValue(ctx, value);
+    value = JS_UNDEFINED;
+
+    if(!it)
+      break;
+
+    value = property_enumeration_value(it, ctx);
+
+    if(!tree_walker_accept(ctx, value, mask))
+      continue;
+
+    if(has_pred) {
+      JSValue ret;
+      JSValueConst args[3] = {value, JS_AtomToValue(ctx, property_enumeration_atom(it)), this_arg};
+      BOOL result;
+
+      ret = JS_Call(ctx, pred, JS_UNDEFINED, 3, args);
+      JS_FreeValue(ctx, args[1]);
+
+      if(JS_IsException(ret)) {
+        JS_GetException(ctx);
+        ret = JS_FALSE;
+      }
+
+      result = JS_ToBool(ctx, ret);
+      JS_FreeValue(ctx, ret);
+
+      /* the predicate may have moved the walker */
+      if(it != property_recursion_top(&w->hier)) {
+        JS_FreeValue(ctx, value);
+        value = JS_UNDEFINED;
+
+        if(!(it = property_recursion_top(&w->hier)))
+          break;
+
+        value = property_enumeration_value(it, ctx);
+      }
+
       if(!result)
         continue;
     }
+
     break;
   }
+
+  if(pvalue)
+    *pvalue = value;
+  else
+    JS_FreeValue(ctx, value);
+
   return it;
 }
 
+static JSValue
+tree_walker_result(TreeWalker* w, JSContext* ctx, JSValue value) {
+  JSValue ret;
+
+  switch(w->tag_mask & RETURN_MASK) {
+    case RETURN_VALUE: return value;
+    case RETURN_PATH: JS_FreeValue(ctx, value); return property_recursion_path(&w->hier, ctx);
+    case RETURN_VALUE_PATH:
+    default: {
+      ret = JS_NewArray(ctx);
+      JS_SetPropertyUint32(ctx, ret, 0, value);
+      JS_SetPropertyUint32(ctx, ret, 1, property_recursion_path(&w->hier, ctx));
+      break;
+    }
+  }
+
+  return ret;
+}
+
 static JSValue
 js_tree_walker_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
   TreeWalker* w;
   PropertyEnumeration* it;
-  JSValue ret = JS_UNDEFINED, predicate = JS_UNDEFINED;
+  JSValue ret = JS_UNDEFINED, predicate = JS_UNDEFINED, value = JS_UNDEFINED;
 
   if(!(w = JS_GetOpaque2(ctx, this_val, js_tree_walker_class_id)))
     return JS_EXCEPTION;
@@ -243,18 +355,19 @@ js_tree_walker_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueCo
     else if(JS_IsFunction(ctx, w->filter))
       predicate = w->filter;
 
-    it = js_tree_walker_next(ctx, w, this_val, predicate);
+    if(!(it = js_tree_walker_next(ctx, w, this_val, predicate, &value)))
+      return JS_UNDEFINED;
   }
 
   switch(magic) {
     case FIRST_CHILD: {
-      if((it = property_recursion_enter(&w->hier, ctx, 0, PROPENUM_DEFAULT_FLAGS)) == 0)
+      if((it = property_recursion_enter(&w->hier, ctx, 0, w->flags)) == 0)
         return JS_UNDEFINED;
       break;
     }
 
     case LAST_CHILD: {
-      if((it = property_recursion_enter(&w->hier, ctx, -1, PROPENUM_DEFAULT_FLAGS)) == 0)
+      if((it = property_recursion_enter(&w->hier, ctx, -1, w->flags)) == 0)
         return JS_UNDEFINED;
       break;
     }
@@ -278,24 +391,8 @@ js_tree_walker_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueCo
     }
   }
 
-  // ret = it ? property_enumeration_value(it, ctx) : JS_UNDEFINED;
-
-  ret = JS_UNDEFINED;
-
-  if(it) {
-    int r = w->tag_mask & RETURN_MASK;
-    switch(r) {
-      case RETURN_VALUE: ret = property_enumeration_value(it, ctx); break;
-      case RETURN_PATH: ret = property_recursion_path(&w->hier, ctx); break;
-      case RETURN_VALUE_PATH:
-      default: {
-        ret = JS_NewArray(ctx);
-        JS_SetPropertyUint32(ctx, ret, 0, property_enumeration_value(it, ctx));
-        JS_SetPropertyUint32(ctx, ret, 1, property_recursion_path(&w->hier, ctx));
-        break;
-      }
-    }
-  }
+  if(it)
+    ret = tree_walker_result(w, ctx, magic == NEXT_NODE ? value : property_enumeration_value(it, ctx));
 
   if(JS_IsFunction(ctx, w->transform)) {
     JSValue args[] = {ret, property_recursion_path(&w->hier, ctx), this_val};
@@ -308,6 +405,86 @@ js_tree_walker_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueCo
   return ret;
 }
 
+/**
+ * walk(callback, {maxDepth}) visits the current node and everything after it
+ * in document order without returning to JS between nodes. Nodes rejected
+ * by the type mask are passed over without a call. The callback receives
+ * (value, key, walker). It can leave the traversal by returning false, and
+ * it can skip a node's subtree by returning FILTER_REJECT. The path is only
+ * built if the callback reads walker.currentPath. Returns the number of
+ * callback invocations.
+ */
+static JSValue
+js_tree_walker_walk(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  TreeWalker* w;
+  PropertyEnumeration* it;
+  ValueTypeMask mask;
+  int32_t max_depth = -1;
+  int64_t count = 0;
+
+  if(!(w = JS_GetOpaque2(ctx, this_val, js_tree_walker_class_id)))
+    return JS_EXCEPTION;
+
+  if(argc < 1 || !JS_IsFunction(ctx, argv[0]))
+    return JS_ThrowTypeError(ctx, "argument 1 must be a function");
+
+  if(argc > 1) {
+    if(JS_IsNumber(argv[1]))
+      JS_ToInt32(ctx, &max_depth, argv[1]);
+    else if(JS_IsObject(argv[1]) && js_has_propertystr(ctx, argv[1], "maxDepth"))
+      max_depth = js_get_propertystr_int32(ctx, argv[1], "maxDepth");
+  }
+
+  mask = w->tag_mask & TYPE_ALL;
+
+  while((it = property_recursion_top(&w->hier))) {
+    JSValue value = property_enumeration_value(it, ctx);
+    int32_t depth = property_recursion_depth(&w->hier);
+    BOOL descend = max_depth < 0 || depth <= max_depth;
+
+    if(tree_walker_accept(ctx, value, mask)) {
+      uint32_t idx = it->idx;
+      JSValue ret;
+      JSValueConst args[3] = {value, property_enumeration_key(it, ctx), this_val};
+
+      ret = JS_Call(ctx, argv[0], JS_UNDEFINED, 3, args);
+      JS_FreeValue(ctx, args[1]);
+      count++;
+
+      if(JS_IsException(ret)) {
+        JS_FreeValue(ctx, value);
+        return JS_EXCEPTION;
+      }
+
+      if(JS_IsBool(ret) && !JS_ToBool(ctx, ret)) {
+        JS_FreeValue(ctx, value);
+        break;
+      }
+
+      if(JS_VALUE_GET_TAG(ret) == JS_TAG_INT && JS_VALUE_GET_INT(ret) == FILTER_REJECT)
+        descend = FALSE;
+
+      JS_FreeValue(ctx, ret);
+
+      /* the callback moved the walker, continue from where it left it */
+      if((it = property_recursion_top(&w->hier)) == 0 || property_recursion_depth(&w->hier) != depth || it->idx != idx) {
+        JS_FreeValue(ctx, value);
+
+        if(!it)
+          break;
+
+        value = property_enumeration_value(it, ctx);
+        descend = max_depth < 0 || property_recursion_depth(&w->hier) <= max_depth;
+      }
+    }
+
+    tree_walker_advance(w, ctx, value, descend);
+    JS_FreeValue(ctx, value);
+  }
+
+  return JS_NewInt64(ctx, count);
+}
+
 static JSValue
 js_tree_walker_get(JSContext* ctx, JSValueConst this_val, int magic) {
   JSValue ret = JS_UNDEFINED;
@@ -365,6 +542,11 @@ js_tree_walker_get(JSContext* ctx, JSValueConst this_val, int magic) {
       ret = JS_NewUint32(ctx, w->tag_mask);
       break;
     }
+
+    case PROP_FLAGS: {
+      ret = JS_NewInt32(ctx, w->flags);
+      break;
+    }
   }
 
   return ret;
@@ -397,6 +579,13 @@ js_tree_walker_set(JSContext* ctx, JSValueConst this_val, JSValueConst value, in
       w->tag_mask = tag_mask;
       break;
     }
+
+    case PROP_FLAGS: {
+      int32_t flags = 0;
+      JS_ToInt32(ctx, &flags, value);
+      w->flags = flags;
+      break;
+    }
   }
   return JS_UNDEFINED;
 }
@@ -470,36 +659,18 @@ fail:
 
 JSValue
 js_tree_iterator_next(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], BOOL* pdone, int magic) {
-  PropertyEnumeration* it;
   TreeWalker* w;
-  enum tree_iterator_return r;
-  JSValue ret = JS_UNDEFINED;
+  JSValue value;
 
   w = JS_GetOpaque(this_val, js_tree_iterator_class_id);
-  r = w->tag_mask & RETURN_MASK;
 
-  for(;;) {
-    if((it = js_tree_walker_next(ctx, w, this_val, argc > 0 ? argv[0] : JS_UNDEFINED))) {
-      *pdone = FALSE;
-      switch(r) {
-        case RETURN_VALUE: ret = property_enumeration_value(it, ctx); break;
-        case RETURN_PATH: ret = property_recursion_path(&w->hier, ctx); break;
-        case RETURN_VALUE_PATH:
-        default: {
-          ret = JS_NewArray(ctx);
-          JS_SetPropertyUint32(ctx, ret, 0, property_enumeration_value(it, ctx));
-          JS_SetPropertyUint32(ctx, ret, 1, property_recursion_path(&w->hier, ctx));
-          break;
-        }
-      }
-    } else {
-      *pdone = TRUE;
-      ret = JS_UNDEFINED;
-    }
-    break;
+  if(js_tree_walker_next(ctx, w, this_val, argc > 0 ? argv[0] : JS_UNDEFINED, &value)) {
+    *pdone = FALSE;
+    return tree_walker_result(w, ctx, value);
   }
 
-  return ret;
+  *pdone = TRUE;
+  return JS_UNDEFINED;
 }
 
 static void
@@ -530,6 +701,7 @@ static const JSCFunctionListEntry js_tree_walker_proto_funcs[] = {
     JS_CFUNC_MAGIC_DEF("parentNode", 0, js_tree_walker_method, PARENT_NODE),
     JS_CFUNC_MAGIC_DEF("previousNode", 0, js_tree_walker_method, PREVIOUS_NODE),
     JS_CFUNC_MAGIC_DEF("previousSibling", 0, js_tree_walker_method, PREVIOUS_SIBLING),
+    JS_CFUNC_DEF("walk", 1, js_tree_walker_walk),
     JS_CGETSET_MAGIC_DEF("root", js_tree_walker_get, NULL, PROP_ROOT),
     JS_CGETSET_MAGIC_DEF("currentNode", js_tree_walker_get, NULL, PROP_CURRENT_NODE),
     JS_CGETSET_MAGIC_DEF("currentKey", js_tree_walker_get, NULL, PROP_CURRENT_KEY),
@@ -572,7 +744,6 @@ static const JSCFunctionListEntry js_tree_iterator_proto_funcs[] = {
 
 static int
 js_tree_walker_init(JSContext* ctx, JSModuleDef* m) {
-
   JS_NewClassID(&js_tree_walker_class_id);
   JS_NewClass(JS_GetRuntime(ctx), js_tree_walker_class_id, &js_tree_walker_class);
 
@@ -9,8 +9,22 @@
 #include "debug.h"
 #include "virtual-properties.h"
 #include "quickjs-location.h"
+#include "quickjs-perf.h"
+#include "arena.h"
+#include "line-index.h"
+#include "simd.h"
 
 #include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include "mmap-win32.h"
+#else
+#include <sys/mman.h>
+#endif
 
 char* js_inspect_tostring(JSContext* ctx, JSValueConst value);
 
@@ -30,6 +44,7 @@ char* js_inspect_tostring(JSContext* ctx, JSValueConst value);
 #define QUESTION 0x200
 #define EXCLAM 0x400
 #define HYPHEN 0x400
+#define SCAN 0x800
 
 static int chars[256] = {0};
 
@@ -59,7 +74,7 @@ typedef struct {
 } OutputValue;
 
 typedef struct {
-  BOOL flat, tolerant, location;
+  BOOL flat, tolerant, location, lazy;
   const char* const* self_closing_tags;
 } ParseOptions;
 
@@ -79,8 +94,48 @@ character_classes_init(int c[256]) {
   c['?'] = SPECIAL | QUESTION;
   c['\\'] = BACKSLASH;
   c['-'] = HYPHEN;
+
+  c['<'] |= SCAN;
+  c['>'] |= SCAN;
+  c['"'] |= SCAN;
+  c['\''] |= SCAN;
+  c['='] |= SCAN;
+  c['&'] |= SCAN;
+}
+
+/**
+ * \defgroup xml-scan Structural character scanner
+ *
+ * Finds the next of '<', '>', '"', '\'', '=' and '&' (the SCAN class)
+ * 16 or 32 bytes at a time so the parser can skip over text and
+ * attribute values instead of stepping through them byte by byte.
+ * @{
+ */
+static inline size_t
+xml_scan(const uint8_t* p, size_t n) {
+  size_t i = 0;
+
+#ifdef SIMD_BLOCK
+  for(; i + SIMD_BLOCK <= n; i += SIMD_BLOCK) {
+    simd_vec v = simd_load(p + i);
+    uint64_t mask = simd_movemask(simd_or(simd_or(simd_or(simd_eq(v, '<'), simd_eq(v, '>')), simd_or(simd_eq(v, '"'), simd_eq(v, '\''))), simd_or(simd_eq(v, '='), simd_eq(v, '&'))));
+
+    if(mask)
+      return i + simd_first(mask);
+  }
+#endif
+
+  for(; i < n; i++)
+    if(chars[p[i]] & SCAN)
+      break;
+
+  return i;
 }
 
+/**
+ * @}
+ */
+
 #ifdef DEBUG_OUTPUT
 #define xml_debug(args...) printf(args)
 #else
@@ -91,7 +146,7 @@ character_classes_init(int c[256]) {
   do { \
     xml_debug("push  [%" PRIu32 "] %.*s\n", vector_size(&st, sizeof(OutputValue)), (int)namelen, name); \
     out = vector_push(&st, ((OutputValue){0, JS_NewArray(ctx), name, namelen})); \
-    JS_SetPropertyStr(ctx, element, "children", out->obj); \
+    xml_intern_set(&intern, ctx, element, (const uint8_t*)"children", 8, out->obj); \
   } while(0)
 
 #define yield_pop() \
@@ -130,28 +185,37 @@ character_classes_init(int c[256]) {
 
 #define parse_getc() \
   do { \
-    parse_loc() c = *++ptr; \
+    c = *++ptr; \
     if(ptr >= end) \
       done = TRUE; \
   } while(0)
 
-#define parse_loc() \
-  if(*ptr == '\n') { \
-    lineno++; \
-    column = 1; \
-  } else { \
-    column++; \
-  }
-
 #define parse_skip(cond) \
   do { \
     c = *ptr; \
     if(!(cond)) \
       break; \
-    parse_loc() if(++ptr >= end) done = TRUE; \
+    if(++ptr >= end) \
+      done = TRUE; \
   } while(!done)
 
 #define parse_until(cond) parse_skip(!(cond))
+
+/* like parse_until(), but cond must only be true for SCAN class characters */
+#define parse_scan(cond) \
+  do { \
+    size_t skip = xml_scan(ptr, end - ptr); \
+    if((ptr += skip) >= end) { \
+      c = ptr[-1]; \
+      done = TRUE; \
+      break; \
+    } \
+    c = *ptr; \
+    if(cond) \
+      break; \
+    if(++ptr >= end) \
+      done = TRUE; \
+  } while(!done)
 #define parse_skipspace() parse_skip(chars[c] & WS)
 #define parse_is(c, classes) (chars[(c)] & (classes))
 #define parse_inside(tag) (strlen((tag)) == out->namelen && !strncmp((const char*)out->name, (const char*)(tag), out->namelen))
@@ -210,6 +274,167 @@ xml_set_attr_bytes(JSContext* ctx, JSValueConst obj, const char* attr, size_t al
   xml_set_attr_value(ctx, obj, attr, alen, JS_NewStringLen(ctx, (const char*)str, slen));
 }
 
+/**
+ * \defgroup xml-intern Name intern table
+ *
+ * Documents repeat a small set of tag and attribute names; each distinct
+ * name gets its JSAtom and JSValue string created only once per parse.
+ * @{
+ */
+typedef struct {
+  uint32_t hash, len;
+  char* bytes;
+  JSAtom atom;
+  JSValue str;
+} XMLInternEntry;
+
+typedef struct {
+  XMLInternEntry* entries;
+  uint32_t size, count;
+} XMLIntern;
+
+/* longer names (comments, declarations) are unlikely to repeat */
+#define XML_INTERN_MAXLEN 64
+
+static inline uint32_t
+xml_intern_hash(const uint8_t* x, size_t n) {
+  uint32_t h = 2166136261u;
+
+  while(n--)
+    h = (h ^ *x++) * 16777619u;
+
+  return h;
+}
+
+static BOOL
+xml_intern_grow(XMLIntern* it, JSContext* ctx) {
+  uint32_t i, size = it->size ? it->size * 2 : 64;
+  XMLInternEntry* entries;
+
+  if(!(entries = js_mallocz(ctx, sizeof(XMLInternEntry) * size)))
+    return FALSE;
+
+  for(i = 0; i < it->size; i++) {
+    XMLInternEntry* e = &it->entries[i];
+    uint32_t j;
+
+    if(!e->bytes)
+      continue;
+
+    for(j = e->hash & (size - 1); entries[j].bytes; j = (j + 1) & (size - 1))
+      ;
+
+    entries[j] = *e;
+  }
+
+  if(it->entries)
+    js_free(ctx, it->entries);
+
+  it->entries = entries;
+  it->size = size;
+  return TRUE;
+}
+
+static XMLInternEntry*
+xml_intern_lookup(XMLIntern* it, JSContext* ctx, const uint8_t* x, size_t n) {
+  uint32_t i, hash;
+  XMLInternEntry* e;
+
+  if(n > XML_INTERN_MAXLEN)
+    return 0;
+
+  hash = xml_intern_hash(x, n);
+
+  if((it->count + 1) * 2 > it->size && !xml_intern_grow(it, ctx))
+    return 0;
+
+  for(i = hash & (it->size - 1);; i = (i + 1) & (it->size - 1)) {
+    e = &it->entries[i];
+
+    if(!e->bytes)
+      break;
+
+    if(e->hash == hash && e->len == n && !memcmp(e->bytes, x, n))
+      return e;
+  }
+
+  if(!(e->bytes = js_strndup(ctx, (const char*)x, n)))
+    return 0;
+
+  e->hash = hash;
+  e->len = n;
+  e->atom = JS_ATOM_NULL;
+  e->str = JS_UNDEFINED;
+  it->count++;
+  return e;
+}
+
+/* returns a borrowed atom, owned by the table */
+static JSAtom
+xml_intern_atom(XMLIntern* it, JSContext* ctx, const uint8_t* x, size_t n) {
+  XMLInternEntry* e;
+
+  if(!(e = xml_intern_lookup(it, ctx, x, n)))
+    return JS_ATOM_NULL;
+
+  if(e->atom == JS_ATOM_NULL)
+    e->atom = JS_NewAtomLen(ctx, e->bytes, n);
+
+  return e->atom;
+}
+
+static JSValue
+xml_intern_string(XMLIntern* it, JSContext* ctx, const uint8_t* x, size_t n) {
+  XMLInternEntry* e;
+
+  if(!it || !(e = xml_intern_lookup(it, ctx, x, n)))
+    return JS_NewStringLen(ctx, (const char*)x, n);
+
+  if(JS_IsUndefined(e->str))
+    e->str = JS_NewStringLen(ctx, e->bytes, n);
+
+  return JS_DupValue(ctx, e->str);
+}
+
+static void
+xml_intern_set(XMLIntern* it, JSContext* ctx, JSValueConst obj, const uint8_t* x, size_t n, JSValue value) {
+  JSAtom prop;
+
+  if(!it || (prop = xml_intern_atom(it, ctx, x, n)) == JS_ATOM_NULL) {
+    xml_set_attr_value(ctx, obj, (const char*)x, n, value);
+    return;
+  }
+
+  JS_SetProperty(ctx, obj, prop, value);
+}
+
+static void
+xml_intern_free(XMLIntern* it, JSRuntime* rt) {
+  uint32_t i;
+
+  for(i = 0; i < it->size; i++) {
+    XMLInternEntry* e = &it->entries[i];
+
+    if(!e->bytes)
+      continue;
+
+    if(e->atom != JS_ATOM_NULL)
+      JS_FreeAtomRT(rt, e->atom);
+
+    JS_FreeValueRT(rt, e->str);
+    js_free_rt(rt, e->bytes);
+  }
+
+  if(it->entries)
+    js_free_rt(rt, it->entries);
+
+  it->entries = 0;
+  it->size = it->count = 0;
+}
+/**
+ * @}
+ */
+
 static void
 xml_write_attributes(JSContext* ctx, JSValueConst attributes, DynBuf* db) {
   size_t i;
@@ -423,22 +648,153 @@ make_tuple(JSContext* ctx, JSValue a, JSValue b) {
   return ret;
 }
 
+/**
+ * \defgroup xml-locations XMLLocations: element positions of read(..., {location: true})
+ *
+ * The parser only records the byte offset of every element, with the
+ * offsets of the line starts of the input. get() turns an offset into
+ * [line, column] when it is asked for.
+ * @{
+ */
+typedef struct {
+  JSValue map; /**< WeakMap element => byte offset */
+  DynBuf lines; /**< uint64_t offset following each '\n' */
+} XMLLocations;
+
+enum {
+  XML_LOCATIONS_GET,
+  XML_LOCATIONS_HAS,
+  XML_LOCATIONS_OFFSET,
+};
+
+static JSClassID js_xml_locations_class_id;
+static JSValue xml_locations_proto;
+
+static JSValue
+js_xml_locations_new(JSContext* ctx, const uint8_t* buf, size_t len, JSValue map) {
+  XMLLocations* xl;
+  JSValue obj;
+  BOOL inquote = FALSE;
+
+  if(!(xl = js_mallocz(ctx, sizeof(XMLLocations)))) {
+    JS_FreeValue(ctx, map);
+    return JS_EXCEPTION;
+  }
+
+  xl->map = map;
+  dbuf_init2(&xl->lines, JS_GetRuntime(ctx), (DynBufReallocFunc*)&js_realloc_rt);
+
+  if(line_index_scan(buf, len, '\n', -1, &inquote, 0, &xl->lines) < 0) {
+    dbuf_free(&xl->lines);
+    JS_FreeValue(ctx, map);
+    js_free(ctx, xl);
+    return JS_ThrowOutOfMemory(ctx);
+  }
+
+  obj = JS_NewObjectProtoClass(ctx, xml_locations_proto, js_xml_locations_class_id);
+  JS_SetOpaque(obj, xl);
+  return obj;
+}
+
 static JSValue
-js_xml_parse_location(JSContext* ctx, uint32_t line, uint32_t column) {
-  return make_tuple(ctx, JS_NewUint32(ctx, line), JS_NewUint32(ctx, column));
+js_xml_locations_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  XMLLocations* xl;
+  JSValue value, ret = JS_UNDEFINED;
+  int64_t offset;
+  const uint64_t* lines;
+  size_t lo = 0, hi;
+
+  if(!(xl = JS_GetOpaque2(ctx, this_val, js_xml_locations_class_id)))
+    return JS_EXCEPTION;
+
+  value = js_invoke(ctx, xl->map, "get", argc > 0 ? 1 : 0, argv);
+
+  if(JS_IsException(value) || JS_IsUndefined(value))
+    return magic == XML_LOCATIONS_HAS && !JS_IsException(value) ? JS_FALSE : value;
+
+  switch(magic) {
+    case XML_LOCATIONS_HAS: {
+      ret = JS_TRUE;
+      break;
+    }
+
+    case XML_LOCATIONS_OFFSET: {
+      ret = JS_DupValue(ctx, value);
+      break;
+    }
+
+    case XML_LOCATIONS_GET: {
+      JS_ToInt64(ctx, &offset, value);
+
+      lines = (const uint64_t*)xl->lines.buf;
+      hi = xl->lines.size / sizeof(uint64_t);
+
+      /* number of line starts <= offset */
+      while(lo < hi) {
+        size_t mid = (lo + hi) / 2;
+
+        if(lines[mid] <= (uint64_t)offset)
+          lo = mid + 1;
+        else
+          hi = mid;
+      }
+
+      ret = make_tuple(ctx, JS_NewUint32(ctx, lo + 1), JS_NewUint32(ctx, offset - (lo ? lines[lo - 1] : 0) + 1));
+      break;
+    }
+  }
+
+  JS_FreeValue(ctx, value);
+  return ret;
+}
+
+static void
+js_xml_locations_finalizer(JSRuntime* rt, JSValue val) {
+  XMLLocations* xl;
+
+  if((xl = JS_GetOpaque(val, js_xml_locations_class_id))) {
+    JS_FreeValueRT(rt, xl->map);
+    dbuf_free(&xl->lines);
+    js_free_rt(rt, xl);
+  }
+}
+
+static void
+js_xml_locations_mark(JSRuntime* rt, JSValueConst val, JS_MarkFunc* mark_func) {
+  XMLLocations* xl;
+
+  if((xl = JS_GetOpaque(val, js_xml_locations_class_id)))
+    JS_MarkValue(rt, xl->map, mark_func);
 }
 
+static JSClassDef js_xml_locations_class = {
+    .class_name = "XMLLocations",
+    .finalizer = js_xml_locations_finalizer,
+    .gc_mark = js_xml_locations_mark,
+};
+
+static const JSCFunctionListEntry js_xml_locations_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("get", 1, js_xml_locations_method, XML_LOCATIONS_GET),
+    JS_CFUNC_MAGIC_DEF("has", 1, js_xml_locations_method, XML_LOCATIONS_HAS),
+    JS_CFUNC_MAGIC_DEF("offset", 1, js_xml_locations_method, XML_LOCATIONS_OFFSET),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "XMLLocations", JS_PROP_CONFIGURABLE),
+};
+
+/**
+ * @}
+ */
+
 static JSValue
 js_xml_parse(JSContext* ctx, const uint8_t* buf, size_t len, const char* input_name, ParseOptions opts) {
   BOOL done = FALSE;
   const uint8_t *ptr, *end, *start;
-  uint32_t lineno = 1, column = 1;
   uint8_t c;
   OutputValue* out;
   JSValue ret, element = JS_UNDEFINED, locObj;
-  Vector st = VECTOR(ctx);
+  VECTOR_INLINE(st, OutputValue, 32, ctx);
   Location loc = LOCATION_FILE(JS_NewAtom(ctx, input_name));
   VirtualProperties vprop;
+  XMLIntern intern = {0};
 
   ptr = buf;
   end = buf + len;
@@ -468,7 +824,7 @@ js_xml_parse(JSContext* ctx, const uint8_t* buf, size_t len, const char* input_n
       }
 
     } else {
-      parse_until(parse_is(c, START));
+      parse_scan(parse_is(c, START));
     }
 
     size_t leading_ws = scan_whitenskip((const char*)start, ptr - start);
@@ -507,7 +863,7 @@ js_xml_parse(JSContext* ctx, const uint8_t* buf, size_t len, const char* input_n
     c = *ptr;
 
     if(opts.location)
-      locObj = js_xml_parse_location(ctx, lineno, column);
+      locObj = JS_NewInt64(ctx, ptr - buf);
 
     if(parse_is(c, START)) {
       const uint8_t* name;
@@ -545,7 +901,7 @@ js_xml_parse(JSContext* ctx, const uint8_t* buf, size_t len, const char* input_n
 
         if(opts.flat) {
           yield_next();
-          xml_set_attr_bytes(ctx, element, "tagName", 7, name - 1, namelen + 1);
+          xml_intern_set(&intern, ctx, element, (const uint8_t*)"tagName", 7, xml_intern_string(&intern, ctx, name - 1, namelen + 1));
 
         } else {
 
@@ -561,6 +917,7 @@ js_xml_parse(JSContext* ctx, const uint8_t* buf, size_t len, const char* input_n
               if(file)
                 js_free(ctx, file);
 
+              xml_intern_free(&intern, JS_GetRuntime(ctx));
               return ret;
             }
 
@@ -594,7 +951,7 @@ js_xml_parse(JSContext* ctx, const uint8_t* buf, size_t len, const char* input_n
           namelen = ptr - name;
         }
 
-        xml_set_attr_bytes(ctx, element, "tagName", 7, name, namelen);
+        xml_intern_set(&intern, ctx, element, (const uint8_t*)"tagName", 7, xml_intern_string(&intern, ctx, name, namelen));
 
         if(namelen && parse_is(name[0], EXCLAM)) {
           parse_getc();
@@ -605,7 +962,7 @@ js_xml_parse(JSContext* ctx, const uint8_t* buf, size_t len, const char* input_n
         const uint8_t *attr, *value;
         size_t alen, vlen, num_attrs = 0;
         JSValue attributes = JS_NewObject(ctx);
-        JS_SetPropertyStr(ctx, element, "attributes", attributes);
+        xml_intern_set(&intern, ctx, element, (const uint8_t*)"attributes", 10, attributes);
 
         while(!done) {
           parse_skipspace();
@@ -620,7 +977,7 @@ js_xml_parse(JSContext* ctx, const uint8_t* buf, size_t len, const char* input_n
             break;
 
           if(parse_is(c, WS | CLOSE | SLASH)) {
-            xml_set_attr_value(ctx, attributes, (const char*)attr, alen, JS_NewBool(ctx, TRUE));
+            xml_intern_set(&intern, ctx, attributes, attr, alen, JS_NewBool(ctx, TRUE));
             num_attrs++;
             continue;
           }
@@ -634,14 +991,14 @@ js_xml_parse(JSContext* ctx, const uint8_t* buf, size_t len, const char* input_n
             }
             value = ptr;
             if(quote)
-              parse_until(c == quote);
+              parse_scan(c == quote);
             else
               parse_until(parse_is(c, (WS | CLOSE)));
 
             vlen = ptr - value;
             if(quote && parse_is(c, QUOTE))
               parse_getc();
-            xml_set_attr_bytes(ctx, attributes, (const char*)attr, alen, value, vlen);
+            xml_intern_set(&intern, ctx, attributes, attr, alen, JS_NewStringLen(ctx, (const char*)value, vlen));
             num_attrs++;
           }
         }
@@ -666,7 +1023,7 @@ js_xml_parse(JSContext* ctx, const uint8_t* buf, size_t len, const char* input_n
         str_copyn(&tagName[1], (const char*)name, namelen);
 
         yield_next();
-        xml_set_attr_bytes(ctx, element, "tagName", 7, (const uint8_t*)tagName, namelen + 1);
+        xml_intern_set(&intern, ctx, element, (const uint8_t*)"tagName", 7, xml_intern_string(&intern, ctx, (const uint8_t*)tagName, namelen + 1));
         js_free(ctx, tagName);
       }
 
@@ -676,18 +1033,46 @@ js_xml_parse(JSContext* ctx, const uint8_t* buf, size_t len, const char* input_n
     }
   }
   JS_FreeAtom(ctx, loc.file);
+  xml_intern_free(&intern, JS_GetRuntime(ctx));
+  vector_free(&st);
 
   if(opts.location)
-    return make_tuple(ctx, ret, vprop.this_obj);
+    return make_tuple(ctx, ret, js_xml_locations_new(ctx, buf, len, vprop.this_obj));
 
   return ret;
 }
 
+static void
+xml_parse_options(JSContext* ctx, JSValueConst obj, ParseOptions* opts) {
+  JSValue tags = JS_UNDEFINED;
+
+  if(js_has_propertystr(ctx, obj, "flat"))
+    opts->flat = js_get_propertystr_bool(ctx, obj, "flat");
+  if(js_has_propertystr(ctx, obj, "tolerant"))
+    opts->tolerant = js_get_propertystr_bool(ctx, obj, "tolerant");
+  if(js_has_propertystr(ctx, obj, "location"))
+    opts->location = js_get_propertystr_bool(ctx, obj, "location");
+  if(js_has_propertystr(ctx, obj, "lazy"))
+    opts->lazy = js_get_propertystr_bool(ctx, obj, "lazy");
+  if(js_has_propertystr(ctx, obj, "selfClosingTags"))
+    tags = JS_GetPropertyStr(ctx, obj, "selfClosingTags");
+
+  if(JS_IsArray(ctx, tags)) {
+    size_t ac;
+    opts->self_closing_tags = (const char* const*)js_array_to_argv(ctx, &ac, tags);
+  }
+
+  JS_FreeValue(ctx, tags);
+}
+
+static JSValue xml_tape_read(JSContext*, JSValueConst, InputBuffer*, const ParseOptions*);
+
 static JSValue
 js_xml_read(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
   JSValue ret;
   InputBuffer input = js_input_chars(ctx, argv[0]);
   const char* input_name = 0;
+  int64_t trace_start;
   ParseOptions opts = {
       .flat = FALSE,
       .tolerant = FALSE,
@@ -705,24 +1090,7 @@ js_xml_read(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]
 
   if(argc >= 3) {
     if(JS_IsObject(argv[2])) {
-      JSValue tags = JS_UNDEFINED;
-
-      if(js_has_propertystr(ctx, argv[2], "flat"))
-        opts.flat = js_get_propertystr_bool(ctx, argv[2], "flat");
-      if(js_has_propertystr(ctx, argv[2], "tolerant"))
-        opts.tolerant = js_get_propertystr_bool(ctx, argv[2], "tolerant");
-      if(js_has_propertystr(ctx, argv[2], "location"))
-        opts.location = js_get_propertystr_bool(ctx, argv[2], "location");
-      if(js_has_propertystr(ctx, argv[2], "selfClosingTags"))
-        tags = JS_GetPropertyStr(ctx, argv[2], "selfClosingTags");
-
-      if(JS_IsArray(ctx, tags)) {
-        size_t ac;
-        opts.self_closing_tags = (const char* const*)js_array_to_argv(ctx, &ac, tags);
-      }
-
-      JS_FreeValue(ctx, tags);
-
+      xml_parse_options(ctx, argv[2], &opts);
     } else {
       opts.flat = JS_ToBool(ctx, argv[2]);
 
@@ -731,17 +1099,257 @@ js_xml_read(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]
     }
   }
 
-  ret = js_xml_parse(ctx, input.data, input.size, input_name ? input_name : "<xml>", opts);
+  trace_start = perf_trace_begin(PERF_TRACE_XML);
+
+  if(opts.lazy)
+    ret = xml_tape_read(ctx, argv[0], &input, &opts);
+  else
+    ret = js_xml_parse(ctx, input.data, input.size, input_name ? input_name : "<xml>", opts);
+
+  perf_trace_end(PERF_TRACE_XML, trace_start, input.size);
 
   if(input_name)
     JS_FreeCString(ctx, input_name);
 
+  if(opts.self_closing_tags != default_self_closing_tags)
+    js_strv_free(ctx, (char**)opts.self_closing_tags);
+
   input_buffer_free(&input, ctx);
   return ret;
 }
 
+/**
+ * \defgroup xml-sink XMLSink: chunked output for xml.write()
+ *
+ * When xml.write() is given an output (function, WritableStream, object
+ * with a write() method or file descriptor) the DynBuf is flushed in
+ * chunks of at least chunk_size bytes instead of being turned into one
+ * string at the end.
+ * @{
+ */
+typedef struct {
+  DynBuf* db;
+  JSValue fn, obj;
+  int fd;
+  size_t chunk_size, written;
+  BOOL error;
+} XMLSink;
+
+#define XML_SINK_CHUNK_SIZE 65536
+
+static BOOL
+xml_sink_init(XMLSink* sink, JSContext* ctx, JSValueConst output, DynBuf* db) {
+  sink->db = db;
+  sink->fn = JS_UNDEFINED;
+  sink->obj = JS_UNDEFINED;
+  sink->fd = -1;
+  sink->written = 0;
+  sink->error = FALSE;
+
+  if(sink->chunk_size == 0)
+    sink->chunk_size = XML_SINK_CHUNK_SIZE;
+
+  if(JS_IsNumber(output)) {
+    int32_t fd = -1;
+
+    JS_ToInt32(ctx, &fd, output);
+    sink->fd = fd;
+    return fd >= 0;
+  }
+
+  if(JS_IsFunction(ctx, output)) {
+    sink->fn = JS_DupValue(ctx, output);
+    return TRUE;
+  }
+
+  if(JS_IsObject(output)) {
+    JSValue obj = JS_DupValue(ctx, output);
+
+    if(js_has_propertystr(ctx, obj, "getWriter")) {
+      JSValue writer = js_invoke(ctx, obj, "getWriter", 0, 0);
+
+      JS_FreeValue(ctx, obj);
+      obj = writer;
+    }
+
+    if(JS_IsObject(obj)) {
+      JSValue fn = JS_GetPropertyStr(ctx, obj, "write");
+
+      if(JS_IsFunction(ctx, fn)) {
+        sink->fn = fn;
+        sink->obj = obj;
+        return TRUE;
+      }
+
+      JS_FreeValue(ctx, fn);
+    }
+
+    JS_FreeValue(ctx, obj);
+  }
+
+  return FALSE;
+}
+
+static void
+xml_sink_free(XMLSink* sink, JSContext* ctx) {
+  JS_FreeValue(ctx, sink->fn);
+  JS_FreeValue(ctx, sink->obj);
+  sink->fn = JS_UNDEFINED;
+  sink->obj = JS_UNDEFINED;
+}
+
+static void
+xml_sink_put(XMLSink* sink, JSContext* ctx, const uint8_t* data, size_t len) {
+  if(sink->error || len == 0)
+    return;
+
+  if(sink->fd >= 0) {
+    size_t pos = 0;
+
+    while(pos < len) {
+      ssize_t r = write(sink->fd, data + pos, len - pos);
+
+      if(r < 0) {
+        if(errno == EINTR)
+          continue;
+
+        JS_ThrowInternalError(ctx, "xml.write(): write(%d) failed: %s", sink->fd, strerror(errno));
+        sink->error = TRUE;
+        return;
+      }
+
+      pos += r;
+    }
+  } else {
+    JSValue chunk = JS_NewStringLen(ctx, (const char*)data, len);
+    JSValue ret = JS_Call(ctx, sink->fn, JS_IsUndefined(sink->obj) ? JS_NULL : sink->obj, 1, &chunk);
+
+    JS_FreeValue(ctx, chunk);
+
+    if(JS_IsException(ret)) {
+      sink->error = TRUE;
+      return;
+    }
+
+    JS_FreeValue(ctx, ret);
+  }
+
+  sink->written += len;
+}
+
+/**
+ * Flushes the buffer once it holds more than chunk_size bytes.
+ *
+ * The writer functions look back at the end of the buffer (trimming
+ * trailing whitespace, checking for '\n'), so everything from the last
+ * non-whitespace character on stays in the buffer.
+ */
+static void
+xml_sink_flush(XMLSink* sink, JSContext* ctx) {
+  DynBuf* db;
+  size_t keep;
+
+  if(!sink || sink->error || sink->db->size < sink->chunk_size)
+    return;
+
+  db = sink->db;
+  keep = db->size;
+
+  while(keep > 0 && is_whitespace_char(db->buf[keep - 1]))
+    keep--;
+
+  if(keep == 0)
+    return;
+
+  keep--;
+  xml_sink_put(sink, ctx, db->buf, keep);
+  memmove(db->buf, db->buf + keep, db->size - keep);
+  db->size -= keep;
+}
+
+static void
+xml_sink_end(XMLSink* sink, JSContext* ctx) {
+  xml_sink_put(sink, ctx, sink->db->buf, sink->db->size);
+  sink->db->size = 0;
+}
+/**
+ * @}
+ */
+
+static void
+xml_mmap_free(JSRuntime* rt, void* opaque, void* ptr) {
+  munmap(ptr, (size_t)opaque);
+}
+
+/**
+ * xml.readFile(path[, options]) maps the file privately and parses the
+ * mapping in place. With { lazy: true } the returned nodes keep the
+ * mapping alive and slice text and attributes out of it on access.
+ */
+static JSValue
+js_xml_read_file(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  const char* path;
+  struct stat st;
+  void* ptr;
+  int fd, flags = MAP_PRIVATE;
+  JSValue args[3], ret;
+
+  if(!(path = JS_ToCString(ctx, argv[0])))
+    return JS_EXCEPTION;
+
+  if((fd = open(path, O_RDONLY)) == -1) {
+    ret = JS_ThrowInternalError(ctx, "xml.readFile(): open('%s') failed: %s", path, strerror(errno));
+    JS_FreeCString(ctx, path);
+    return ret;
+  }
+
+  if(fstat(fd, &st) == -1) {
+    ret = JS_ThrowInternalError(ctx, "xml.readFile(): fstat('%s') failed: %s", path, strerror(errno));
+    close(fd);
+    JS_FreeCString(ctx, path);
+    return ret;
+  }
+
+  /* a directory, FIFO or device has no size to map */
+  if(!S_ISREG(st.st_mode) || st.st_size == 0) {
+    ret = JS_ThrowInternalError(ctx, "xml.readFile(): '%s' is %s", path, S_ISREG(st.st_mode) ? "empty" : "not a regular file");
+    close(fd);
+    JS_FreeCString(ctx, path);
+    return ret;
+  }
+
+#ifdef MAP_POPULATE
+  flags |= MAP_POPULATE;
+#endif
+
+  /* private and writable, so writes to the ArrayBuffer never reach the file */
+  ptr = mmap(0, st.st_size, PROT_READ | PROT_WRITE, flags, fd, 0);
+  close(fd);
+
+  if(ptr == MAP_FAILED) {
+    ret = JS_ThrowInternalError(ctx, "xml.readFile(): mmap('%s') failed: %s", path, strerror(errno));
+    JS_FreeCString(ctx, path);
+    return ret;
+  }
+
+#ifdef MADV_SEQUENTIAL
+  madvise(ptr, st.st_size, MADV_SEQUENTIAL);
+#endif
+
+  args[0] = JS_NewArrayBuffer(ctx, ptr, st.st_size, &xml_mmap_free, (void*)(size_t)st.st_size, FALSE);
+  args[1] = JS_NewString(ctx, path);
+  args[2] = argc > 1 ? argv[1] : JS_UNDEFINED;
+  JS_FreeCString(ctx, path);
+
+  ret = js_xml_read(ctx, this_val, argc > 1 ? 3 : 2, args);
+
+  JS_FreeValue(ctx, args[0]);
+  JS_FreeValue(ctx, args[1]);
+  return ret;
+}
+
 static JSValue
-js_xml_write_tree(JSContext* ctx, JSValueConst obj, int max_depth, DynBuf* output) {
+js_xml_write_tree(JSContext* ctx, JSValueConst obj, int max_depth, DynBuf* output, XMLSink* sink) {
   Vector enumerations = VECTOR(ctx);
   PropertyEnumeration* it;
   JSValue str, value = JS_UNDEFINED;
@@ -763,13 +1371,19 @@ js_xml_write_tree(JSContext* ctx, JSValueConst obj, int max_depth, DynBuf* outpu
     }
 
     JS_FreeValue(ctx, value);
-  } while((it = xml_enumeration_next(&enumerations, ctx, output, max_depth)));
+    xml_sink_flush(sink, ctx);
+  } while(!(sink && sink->error) && (it = xml_enumeration_next(&enumerations, ctx, output, max_depth)));
 
   while(output->size > 0 && (output->buf[output->size - 1] == '\0' || byte_chr("\r\n\t ", 4, output->buf[output->size - 1]) < 4))
     output->size--;
-  dbuf_putc(output, '\0');
 
-  str = JS_NewString(ctx, (const char*)output->buf);
+  if(sink) {
+    xml_sink_end(sink, ctx);
+    str = sink->error ? JS_EXCEPTION : JS_NewInt64(ctx, sink->written);
+  } else {
+    dbuf_putc(output, '\0');
+    str = JS_NewString(ctx, (const char*)output->buf);
+  }
   // str = JS_NewStringLen(ctx, output->buf, output->size);
 
   vector_foreach_t(&enumerations, it) { property_enumeration_reset(it, JS_GetRuntime(ctx)); }
@@ -778,7 +1392,7 @@ js_xml_write_tree(JSContext* ctx, JSValueConst obj, int max_depth, DynBuf* outpu
 }
 
 static JSValue
-js_xml_write_list(JSContext* ctx, JSValueConst obj, size_t len, DynBuf* output) {
+js_xml_write_list(JSContext* ctx, JSValueConst obj, size_t len, DynBuf* output, XMLSink* sink) {
   size_t i;
   int32_t depth = 0;
   BOOL single_line = FALSE;
@@ -825,23 +1439,78 @@ js_xml_write_list(JSContext* ctx, JSValueConst obj, size_t len, DynBuf* output)
     }
     if(tagName)
       JS_FreeCString(ctx, tagName);
+
+    xml_sink_flush(sink, ctx);
+
+    if(sink && sink->error)
+      break;
+  }
+
+  JS_FreeValue(ctx, value);
+  JS_FreeValue(ctx, next);
+
+  if(sink) {
+    xml_sink_end(sink, ctx);
+    return sink->error ? JS_EXCEPTION : JS_NewInt64(ctx, sink->written);
   }
+
   return JS_NewStringLen(ctx, (const char*)output->buf, output->size);
 }
 
 static JSValue
 js_xml_write(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
   DynBuf output = {0};
-  JSValueConst obj = argc > 0 ? argv[0] : JS_UNDEFINED;
+  JSValueConst obj = argc > 0 ? argv[0] : JS_UNDEFINED, out = argc > 2 ? argv[2] : JS_UNDEFINED;
   JSValue ret, last, children = JS_UNDEFINED, arr = JS_UNDEFINED;
   int32_t max_depth = INT32_MAX;
   size_t len;
   BOOL flat = TRUE;
+  XMLSink sink = {.chunk_size = 0}, *sinkp = 0;
 
   js_dbuf_init(ctx, &output);
 
-  if(argc >= 2)
-    JS_ToInt32(ctx, &max_depth, argv[1]);
+  if(argc >= 2) {
+    if(JS_IsObject(argv[1]) && !JS_IsFunction(ctx, argv[1])) {
+      JSValue value;
+
+      if(js_has_propertystr(ctx, argv[1], "maxDepth")) {
+        value = JS_GetPropertyStr(ctx, argv[1], "maxDepth");
+        JS_ToInt32(ctx, &max_depth, value);
+        JS_FreeValue(ctx, value);
+      }
+
+      if(js_has_propertystr(ctx, argv[1], "chunkSize")) {
+        int64_t chunk_size = 0;
+        value = JS_GetPropertyStr(ctx, argv[1], "chunkSize");
+        JS_ToInt64(ctx, &chunk_size, value);
+        JS_FreeValue(ctx, value);
+        sink.chunk_size = MAX_NUM(chunk_size, 0);
+      }
+
+      if(argc <= 2)
+        out = JS_GetPropertyStr(ctx, argv[1], "output");
+      else
+        out = JS_DupValue(ctx, out);
+    } else {
+      if(!JS_IsUndefined(argv[1]))
+        JS_ToInt32(ctx, &max_depth, argv[1]);
+
+      out = JS_DupValue(ctx, out);
+    }
+  }
+
+  if(!JS_IsUndefined(out) && !JS_IsNull(out)) {
+    if(!xml_sink_init(&sink, ctx, out, &output)) {
+      JS_FreeValue(ctx, out);
+      xml_sink_free(&sink, ctx);
+      dbuf_free(&output);
+      return JS_ThrowTypeError(ctx, "xml.write(): output must be a function, a writer, a WritableStream or a file descriptor");
+    }
+
+    sinkp = &sink;
+  }
+
+  JS_FreeValue(ctx, out);
 
   if(!JS_IsArray(ctx, obj)) {
     arr = JS_NewArray(ctx);
@@ -863,9 +1532,12 @@ js_xml_write(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[
   xml_debug("js_xml_write len=%zu, children=%s, flat=%d\n", len, JS_ToCString(ctx, children), flat);
 
   if(flat)
-    ret = js_xml_write_list(ctx, obj, len, &output);
+    ret = js_xml_write_list(ctx, obj, len, &output, sinkp);
   else
-    ret = js_xml_write_tree(ctx, obj, max_depth, &output);
+    ret = js_xml_write_tree(ctx, obj, max_depth, &output, sinkp);
+
+  if(sinkp)
+    xml_sink_free(sinkp, ctx);
 
   dbuf_free(&output);
 
@@ -875,24 +1547,2161 @@ js_xml_write(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[
   return ret;
 }
 
-static const JSCFunctionListEntry js_xml_funcs[] = {
-    JS_CFUNC_DEF("read", 1, js_xml_read),
-    JS_CFUNC_DEF("write", 2, js_xml_write),
+/**
+ * \defgroup xml-parser XMLParser: incremental (SAX-style) parser
+ *
+ * Input is fed in chunks through write(), only the unconsumed tail of the
+ * input and the stack of open tag names are kept between calls.
+ * @{
+ */
+typedef struct {
+  char* name;
+  size_t namelen;
+} XMLParserTag;
+
+typedef struct {
+  DynBuf buf;
+  Vector stack;
+  ParseOptions opts;
+  XMLIntern intern;
+  JSValue handlers, events;
+  uint32_t nevents;
+  BOOL ended;
+} XMLParser;
+
+enum {
+  XML_EVENT_START_ELEMENT = 0,
+  XML_EVENT_END_ELEMENT,
+  XML_EVENT_TEXT,
+  XML_EVENT_COMMENT,
+};
+
+static const char* const xml_event_names[] = {
+    "startElement",
+    "endElement",
+    "text",
+    "comment",
 };
 
+static JSClassID js_xml_parser_class_id;
+static JSValue xml_parser_proto, xml_parser_ctor;
+
+static inline XMLParser*
+js_xml_parser_data2(JSContext* ctx, JSValueConst value) {
+  return JS_GetOpaque2(ctx, value, js_xml_parser_class_id);
+}
+
+static inline XMLParserTag*
+xml_parser_top(XMLParser* xp) {
+  return vector_empty(&xp->stack) ? 0 : vector_back(&xp->stack, sizeof(XMLParserTag));
+}
+
 static int
-js_xml_init(JSContext* ctx, JSModuleDef* m) {
+xml_parser_emit(XMLParser* xp, JSContext* ctx, int type, int argc, JSValueConst argv[]) {
+  int i;
 
-  character_classes_init(chars);
+  if(JS_IsObject(xp->handlers)) {
+    JSValue fn = JS_GetPropertyStr(ctx, xp->handlers, xml_event_names[type]);
 
-  if(js_location_class_id == 0)
-    js_location_init(ctx, 0);
+    if(JS_IsFunction(ctx, fn)) {
+      JSValue ret = JS_Call(ctx, fn, xp->handlers, argc, argv);
+
+      JS_FreeValue(ctx, fn);
+
+      if(JS_IsException(ret))
+        return -1;
+
+      JS_FreeValue(ctx, ret);
+      return 0;
+    }
+
+    JS_FreeValue(ctx, fn);
+    return 0;
+  }
+
+  /* no handler object: collect [type, ...args] tuples to be returned from write() */
+  JSValue ev = JS_NewArray(ctx);
+  JS_SetPropertyUint32(ctx, ev, 0, JS_NewString(ctx, xml_event_names[type]));
+
+  for(i = 0; i < argc; i++)
+    JS_SetPropertyUint32(ctx, ev, i + 1, JS_DupValue(ctx, argv[i]));
+
+  JS_SetPropertyUint32(ctx, xp->events, xp->nevents++, ev);
+  return 0;
+}
+
+static int
+xml_parser_emit_name(XMLParser* xp, JSContext* ctx, int type, const uint8_t* name, size_t namelen, JSValueConst attributes) {
+  JSValue args[3] = {
+      xml_intern_string(&xp->intern, ctx, name, namelen),
+      JS_IsUndefined(attributes) ? JS_UNDEFINED : JS_DupValue(ctx, attributes),
+      JS_NewUint32(ctx, vector_size(&xp->stack, sizeof(XMLParserTag))),
+  };
+  int ret = xml_parser_emit(xp, ctx, type, type == XML_EVENT_START_ELEMENT ? 3 : 1, args);
+
+  JS_FreeValue(ctx, args[0]);
+  JS_FreeValue(ctx, args[1]);
+  return ret;
+}
+
+static int
+xml_parser_text(XMLParser* xp, JSContext* ctx, int type, const uint8_t* x, size_t n) {
+  JSValue str;
+  int ret;
+
+  if(type == XML_EVENT_TEXT) {
+    size_t skip = scan_whitenskip((const char*)x, n);
+
+    x += skip;
+    n -= skip;
+
+    while(n > 0 && is_whitespace_char(x[n - 1]))
+      n--;
+
+    if(n == 0)
+      return 0;
+  }
+
+  str = JS_NewStringLen(ctx, (const char*)x, n);
+  ret = xml_parser_emit(xp, ctx, type, 1, &str);
+  JS_FreeValue(ctx, str);
+  return ret;
+}
+
+static JSValue
+xml_parse_attributes(JSContext* ctx, const uint8_t* ptr, const uint8_t* end, XMLIntern* intern) {
+  JSValue attributes = JS_NewObject(ctx);
+
+  while(ptr < end) {
+    const uint8_t *attr, *value;
+    size_t alen;
+
+    while(ptr < end && parse_is(*ptr, WS))
+      ptr++;
+
+    attr = ptr;
+
+    while(ptr < end && !parse_is(*ptr, EQUAL | WS | SPECIAL | END))
+      ptr++;
+
+    if((alen = ptr - attr) == 0)
+      break;
+
+    if(ptr == end || !parse_is(*ptr, EQUAL)) {
+      xml_intern_set(intern, ctx, attributes, attr, alen, JS_NewBool(ctx, TRUE));
+      continue;
+    }
+
+    if(++ptr < end && parse_is(*ptr, QUOTE)) {
+      uint8_t quote = *ptr++;
+
+      value = ptr;
+      ptr += byte_chr(ptr, end - ptr, quote);
+      xml_intern_set(intern, ctx, attributes, attr, alen, JS_NewStringLen(ctx, (const char*)value, ptr - value));
+
+      if(ptr < end)
+        ptr++;
+    } else {
+      value = ptr;
+
+      while(ptr < end && !parse_is(*ptr, WS | CLOSE))
+        ptr++;
+
+      xml_intern_set(intern, ctx, attributes, attr, alen, JS_NewStringLen(ctx, (const char*)value, ptr - value));
+    }
+  }
+
+  return attributes;
+}
+
+/* returns the offset of the '>' ending the tag starting at x[0] = '<', or n when incomplete */
+static size_t
+xml_parser_tag_end(const uint8_t* x, size_t n) {
+  size_t i;
+  uint8_t quote = 0;
+
+  /* a CDATA section may contain '>' and quotes, only "]]>" ends it */
+  if(n >= 9 && !strncmp((const char*)x, "<![CDATA[", 9))
+    return (i = byte_finds(x + 9, n - 9, "]]>")) == n - 9 ? n : 9 + i + 2;
+
+  for(i = 1; (i += xml_scan(x + i, n - i)) < n; i++) {
+    if(quote) {
+      if(x[i] == quote)
+        quote = 0;
+    } else if(parse_is(x[i], QUOTE)) {
+      quote = x[i];
+    } else if(x[i] == '>') {
+      break;
+    }
+  }
+
+  return i;
+}
+
+static int32_t
+xml_parser_find(XMLParser* xp, const uint8_t* name, size_t namelen) {
+  XMLParserTag* tag;
+  int32_t index = vector_size(&xp->stack, sizeof(XMLParserTag));
+
+  for(tag = vector_end(&xp->stack); index > 0;) {
+    --tag;
+    --index;
+
+    if(tag->namelen == namelen && !strncmp(tag->name, (const char*)name, namelen))
+      return index;
+  }
+
+  return -1;
+}
+
+static int
+xml_parser_close(XMLParser* xp, JSContext* ctx, const uint8_t* name, size_t namelen) {
+  int32_t index = xml_parser_find(xp, name, namelen);
+
+  if(index == -1) {
+    if(xp->opts.tolerant)
+      return 0;
+
+    JS_ThrowSyntaxError(ctx, "mismatch </%.*s>", (int)namelen, name);
+    return -1;
+  }
+
+  /* implicitly close any elements left open inside this one */
+  while(vector_size(&xp->stack, sizeof(XMLParserTag)) > (uint32_t)index) {
+    XMLParserTag* top = xml_parser_top(xp);
+    XMLParserTag tag = *top;
+    int ret;
+
+    vector_pop(&xp->stack, sizeof(XMLParserTag));
+    ret = xml_parser_emit_name(xp, ctx, XML_EVENT_END_ELEMENT, (const uint8_t*)tag.name, tag.namelen, JS_UNDEFINED);
+    js_free(ctx, tag.name);
+
+    if(ret)
+      return -1;
+  }
+
+  return 0;
+}
+
+static int
+xml_parser_element(XMLParser* xp, JSContext* ctx, const uint8_t* x, size_t n) {
+  const uint8_t *name = x, *end = x + n;
+  size_t namelen;
+  BOOL self_closing = FALSE;
+  JSValue attributes;
+  int ret;
+
+  if(n > 0 && parse_is(x[0], SLASH)) {
+    name++;
+    namelen = 0;
+
+    while(name + namelen < end && !parse_is(name[namelen], WS))
+      namelen++;
+
+    return xml_parser_close(xp, ctx, name, namelen);
+  }
+
+  /* <!DOCTYPE ...> and friends are reported as an empty element named by the whole declaration */
+  if(n > 0 && parse_is(x[0], EXCLAM)) {
+    if((ret = xml_parser_emit_name(xp, ctx, XML_EVENT_START_ELEMENT, x, n, JS_UNDEFINED)) == 0)
+      ret = xml_parser_emit_name(xp, ctx, XML_EVENT_END_ELEMENT, x, n, JS_UNDEFINED);
+    return ret;
+  }
+
+  if(end > name && (end[-1] == '/' || (parse_is(name[0], QUESTION) && end[-1] == '?'))) {
+    self_closing = TRUE;
+    end--;
+  }
+
+  for(namelen = 0; name + namelen < end && !parse_is(name[namelen], WS | END); namelen++)
+    ;
+
+  if(parse_is(name[0], QUESTION) || is_self_closing_tag((const char*)name, namelen, &xp->opts))
+    self_closing = TRUE;
+
+  attributes = xml_parse_attributes(ctx, name + namelen, end, &xp->intern);
+  ret = xml_parser_emit_name(xp, ctx, XML_EVENT_START_ELEMENT, name, namelen, attributes);
+  JS_FreeValue(ctx, attributes);
+
+  if(ret)
+    return -1;
+
+  if(self_closing)
+    return xml_parser_emit_name(xp, ctx, XML_EVENT_END_ELEMENT, name, namelen, JS_UNDEFINED);
+
+  XMLParserTag tag = {js_strndup(ctx, (const char*)name, namelen), namelen};
+  vector_push(&xp->stack, tag);
+  return 0;
+}
+
+/* parses as much of the buffered input as possible, keeping an incomplete tail unless 'final' is set */
+static int
+xml_parser_run(XMLParser* xp, JSContext* ctx, BOOL final) {
+  size_t pos = 0, n, i;
+  const uint8_t* x;
+  int ret = 0;
+
+  while(pos < xp->buf.size) {
+    XMLParserTag* top = xml_parser_top(xp);
+
+    x = xp->buf.buf + pos;
+    n = xp->buf.size - pos;
+
+    if(top && top->namelen == 6 && !strncasecmp(top->name, "script", 6)) {
+      if((i = byte_finds(x, n, "</script")) == n && !final)
+        break;
+
+      if(i > 0 && (ret = xml_parser_text(xp, ctx, XML_EVENT_TEXT, x, i)))
+        break;
+
+      pos += i;
+
+      if(i == n)
+        continue;
+
+      x = xp->buf.buf + pos;
+      n = xp->buf.size - pos;
+    }
+
+    if(*x != '<') {
+      if((i = byte_chr(x, n, '<')) == n && !final)
+        break;
+
+      if((ret = xml_parser_text(xp, ctx, XML_EVENT_TEXT, x, i)))
+        break;
+
+      pos += i;
+      continue;
+    }
+
+    if(n >= 4 && !strncmp((const char*)x, "<!--", 4)) {
+      if((i = byte_finds(x + 4, n - 4, "-->")) == n - 4 && !final)
+        break;
+
+      if((ret = xml_parser_text(xp, ctx, XML_EVENT_COMMENT, x + 4, i)))
+        break;
+
+      pos += MIN_NUM(n, 4 + i + 3);
+      continue;
+    }
+
+    if((i = xml_parser_tag_end(x, n)) == n && !final)
+      break;
+
+    if((ret = xml_parser_element(xp, ctx, x + 1, i - 1)))
+      break;
+
+    pos += MIN_NUM(n, i + 1);
+  }
+
+  /* discard consumed input */
+  if(pos > 0) {
+    memmove(xp->buf.buf, xp->buf.buf + pos, xp->buf.size - pos);
+    xp->buf.size -= pos;
+  }
+
+  return ret;
+}
+
+static JSValue
+js_xml_parser_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  JSValue proto, obj = JS_UNDEFINED;
+  XMLParser* xp;
+
+  if(!(xp = js_mallocz(ctx, sizeof(XMLParser))))
+    return JS_ThrowOutOfMemory(ctx);
+
+  js_dbuf_init_rt(JS_GetRuntime(ctx), &xp->buf);
+  vector_init_rt(&xp->stack, JS_GetRuntime(ctx));
+
+  xp->opts = (ParseOptions){
+      .flat = FALSE,
+      .tolerant = FALSE,
+      .location = FALSE,
+      .self_closing_tags = default_self_closing_tags,
+  };
+
+  xp->handlers = argc > 0 && JS_IsObject(argv[0]) ? JS_DupValue(ctx, argv[0]) : JS_UNDEFINED;
+  xp->events = JS_UNDEFINED;
+
+  if(argc > 1 && JS_IsObject(argv[1]))
+    xml_parse_options(ctx, argv[1], &xp->opts);
+
+  /* using new_target to get the prototype is necessary when the class is extended. */
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  if(JS_IsException(proto))
+    goto fail;
+
+  obj = JS_NewObjectProtoClass(ctx, proto, js_xml_parser_class_id);
+  JS_FreeValue(ctx, proto);
+
+  if(JS_IsException(obj))
+    goto fail;
+
+  JS_SetOpaque(obj, xp);
+  return obj;
+
+fail:
+  JS_FreeValue(ctx, xp->handlers);
+  vector_free(&xp->stack);
+  dbuf_free(&xp->buf);
+
+  if(xp->opts.self_closing_tags != default_self_closing_tags)
+    js_strv_free(ctx, (char**)xp->opts.self_closing_tags);
+
+  js_free(ctx, xp);
+  JS_FreeValue(ctx, obj);
+  return JS_EXCEPTION;
+}
+
+enum {
+  XML_PARSER_WRITE = 0,
+  XML_PARSER_END,
+};
+
+static JSValue
+js_xml_parser_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  XMLParser* xp;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(xp = js_xml_parser_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  if(xp->ended)
+    return JS_ThrowInternalError(ctx, "XMLParser: write after end");
+
+  if(argc > 0 && !JS_IsUndefined(argv[0])) {
+    InputBuffer input = js_input_chars(ctx, argv[0]);
+
+    if(!input_buffer_valid(&input))
+      return JS_EXCEPTION;
+
+    dbuf_put(&xp->buf, input_buffer_data(&input), input_buffer_length(&input));
+    input_buffer_free(&input, ctx);
+  }
+
+  if(!JS_IsObject(xp->handlers)) {
+    xp->events = JS_NewArray(ctx);
+    xp->nevents = 0;
+  }
+
+  if(xml_parser_run(xp, ctx, magic == XML_PARSER_END))
+    ret = JS_EXCEPTION;
+
+  if(magic == XML_PARSER_END && !JS_IsException(ret)) {
+    XMLParserTag* tag;
+
+    if(!vector_empty(&xp->stack) && !xp->opts.tolerant) {
+      tag = vector_begin(&xp->stack);
+      ret = JS_ThrowSyntaxError(ctx, "XMLParser: unclosed <%.*s>", (int)tag->namelen, tag->name);
+    } else if(!vector_empty(&xp->stack)) {
+      tag = vector_begin(&xp->stack);
+
+      if(xml_parser_close(xp, ctx, (const uint8_t*)tag->name, tag->namelen))
+        ret = JS_EXCEPTION;
+    }
+
+    xp->ended = TRUE;
+  }
+
+  if(!JS_IsObject(xp->handlers)) {
+    if(JS_IsException(ret))
+      JS_FreeValue(ctx, xp->events);
+    else
+      ret = xp->events;
+
+    xp->events = JS_UNDEFINED;
+  }
+
+  return ret;
+}
+
+enum {
+  XML_PARSER_DEPTH = 0,
+  XML_PARSER_PENDING,
+};
+
+static JSValue
+js_xml_parser_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  XMLParser* xp;
+  JSValue ret = JS_UNDEFINED;
+
+  if(!(xp = js_xml_parser_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case XML_PARSER_DEPTH: {
+      ret = JS_NewUint32(ctx, vector_size(&xp->stack, sizeof(XMLParserTag)));
+      break;
+    }
+    case XML_PARSER_PENDING: {
+      ret = JS_NewInt64(ctx, xp->buf.size);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static void
+js_xml_parser_finalizer(JSRuntime* rt, JSValue val) {
+  XMLParser* xp;
+
+  if((xp = JS_GetOpaque(val, js_xml_parser_class_id))) {
+    XMLParserTag* tag;
+
+    vector_foreach_t(&xp->stack, tag) { js_free_rt(rt, tag->name); }
+    vector_free(&xp->stack);
+    dbuf_free(&xp->buf);
+    xml_intern_free(&xp->intern, rt);
+
+    if(xp->opts.self_closing_tags != default_self_closing_tags)
+      js_strv_free_rt(rt, (char**)xp->opts.self_closing_tags);
+
+    JS_FreeValueRT(rt, xp->handlers);
+    js_free_rt(rt, xp);
+  }
+}
+
+static void
+js_xml_parser_mark(JSRuntime* rt, JSValueConst val, JS_MarkFunc* mark_func) {
+  XMLParser* xp;
+
+  if((xp = JS_GetOpaque(val, js_xml_parser_class_id)))
+    JS_MarkValue(rt, xp->handlers, mark_func);
+}
+
+static JSClassDef js_xml_parser_class = {
+    .class_name = "XMLParser",
+    .finalizer = js_xml_parser_finalizer,
+    .gc_mark = js_xml_parser_mark,
+};
+
+static const JSCFunctionListEntry js_xml_parser_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("write", 1, js_xml_parser_method, XML_PARSER_WRITE),
+    JS_CFUNC_MAGIC_DEF("end", 0, js_xml_parser_method, XML_PARSER_END),
+    JS_CGETSET_MAGIC_DEF("depth", js_xml_parser_get, 0, XML_PARSER_DEPTH),
+    JS_CGETSET_MAGIC_DEF("pending", js_xml_parser_get, 0, XML_PARSER_PENDING),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "XMLParser", JS_PROP_CONFIGURABLE),
+};
+
+/**
+ * @}
+ */
+
+/**
+ * \defgroup xml-tape Lazy (tape-based) document
+ *
+ * xml.read(input, name, { lazy: true }) only records a tape of node
+ * offsets and spans into the input.  Elements are XMLNode objects which
+ * produce their tagName, attributes and children when first accessed.
+ * @{
+ */
+enum {
+  XML_NODE_ELEMENT = 0,
+  XML_NODE_TEXT,
+  XML_NODE_DECLARATION,
+};
+
+typedef struct {
+  uint32_t parent, first, last, next;
+  uint32_t name, namelen;
+  uint32_t attrs, attrslen;
+  uint8_t type;
+  BOOL self_closing;
+} XMLTapeNode;
+
+typedef struct {
+  int ref_count;
+  /* refreshed by xml_tape_data() before each use */
+  const uint8_t* data;
+  size_t size, offset;
+  uint8_t* copy;
+  JSValue buffer;
+  Vector nodes;
+  XMLIntern intern;
+} XMLTape;
+
+typedef struct {
+  XMLTape* tape;
+  uint32_t index;
+  JSValue attributes, children;
+} XMLNodeRef;
+
+static JSClassID js_xml_node_class_id;
+static JSValue xml_node_proto;
+
+static inline XMLTapeNode*
+xml_tape_node(XMLTape* tape, uint32_t index) {
+  return vector_at(&tape->nodes, sizeof(XMLTapeNode), index);
+}
+
+/**
+ * The input ArrayBuffer can be detached (transferred) or resized after
+ * xml.read() returned, so its data is looked up again on every access.
+ * Throws a TypeError when the input is gone.
+ */
+static const uint8_t*
+xml_tape_data(XMLTape* tape, JSContext* ctx) {
+  uint8_t* ptr;
+  size_t len;
+
+  if(tape->copy)
+    return tape->data;
+
+  if(!(ptr = JS_GetArrayBuffer(ctx, &len, tape->buffer)))
+    return tape->data = 0;
+
+  if(len < tape->offset + tape->size) {
+    JS_ThrowTypeError(ctx, "XMLNode: the input buffer was detached or shrunk");
+    return tape->data = 0;
+  }
+
+  return tape->data = ptr + tape->offset;
+}
+
+static void
+xml_tape_free(XMLTape* tape, JSRuntime* rt) {
+  if(--tape->ref_count == 0) {
+    vector_free(&tape->nodes);
+    xml_intern_free(&tape->intern, rt);
+
+    if(tape->copy)
+      js_free_rt(rt, tape->copy);
+
+    JS_FreeValueRT(rt, tape->buffer);
+    js_free_rt(rt, tape);
+  }
+}
+
+/* node 0 is the document, so 0 doubles as 'no node' in the first/next links */
+static uint32_t
+xml_tape_add(XMLTape* tape, uint32_t parent, int type, const uint8_t* x, size_t n) {
+  XMLTapeNode node = {parent, 0, 0, 0, x - tape->data, n, 0, 0, type, FALSE};
+  uint32_t index = vector_size(&tape->nodes, sizeof(XMLTapeNode));
+  XMLTapeNode* p;
+
+  vector_push(&tape->nodes, node);
+  p = xml_tape_node(tape, parent);
+
+  if(p->last)
+    xml_tape_node(tape, p->last)->next = index;
+  else
+    p->first = index;
+
+  p->last = index;
+  return index;
+}
+
+static int
+xml_tape_build(XMLTape* tape, JSContext* ctx, const ParseOptions* opts) {
+  const uint8_t *base = tape->data, *x;
+  size_t pos = 0, n, i, size = tape->size;
+  uint32_t current = 0;
+  XMLTapeNode document = {0};
+
+  vector_push(&tape->nodes, document);
+
+  while(pos < size) {
+    XMLTapeNode* top = xml_tape_node(tape, current);
+
+    x = base + pos;
+    n = size - pos;
+
+    if(current && top->namelen == 6 && !strncasecmp((const char*)base + top->name, "script", 6)) {
+      if((i = byte_finds(x, n, "</script")) > 0)
+        xml_tape_add(tape, current, XML_NODE_TEXT, x, i);
+
+      if((pos += i) == size)
+        break;
+
+      x = base + pos;
+      n = size - pos;
+    }
+
+    if(*x != '<') {
+      size_t skip, len;
+
+      i = byte_chr(x, n, '<');
+      skip = scan_whitenskip((const char*)x, i);
+
+      for(len = i - skip; len > 0 && is_whitespace_char(x[skip + len - 1]);)
+        len--;
+
+      if(len > 0)
+        xml_tape_add(tape, current, XML_NODE_TEXT, x + skip, len);
+
+      pos += i;
+      continue;
+    }
+
+    if(n >= 4 && !strncmp((const char*)x, "<!--", 4)) {
+      i = 4 + byte_finds(x + 4, n - 4, "-->");
+      xml_tape_add(tape, current, XML_NODE_DECLARATION, x + 1, MIN_NUM(n, i + 2) - 1);
+      pos += MIN_NUM(n, i + 3);
+      continue;
+    }
+
+    i = xml_parser_tag_end(x, n);
+
+    if(i > 1 && x[1] == '/') {
+      const uint8_t* name = x + 2;
+      size_t namelen = 0;
+      uint32_t index;
+
+      while(namelen < i - 2 && !parse_is(name[namelen], WS))
+        namelen++;
+
+      for(index = current; index; index = xml_tape_node(tape, index)->parent) {
+        XMLTapeNode* node = xml_tape_node(tape, index);
+
+        if(node->namelen == namelen && !strncmp((const char*)base + node->name, (const char*)name, namelen))
+          break;
+      }
+
+      if(index)
+        current = xml_tape_node(tape, index)->parent;
+      else if(!opts->tolerant) {
+        JS_ThrowSyntaxError(ctx, "mismatch </%.*s>", (int)namelen, name);
+        return -1;
+      }
+
+    } else if(i > 1 && parse_is(x[1], EXCLAM)) {
+      xml_tape_add(tape, current, XML_NODE_DECLARATION, x + 1, i - 1);
+
+    } else if(i > 1) {
+      const uint8_t *name = x + 1, *end = x + i;
+      size_t namelen;
+      BOOL self_closing = FALSE;
+      uint32_t index;
+      XMLTapeNode* node;
+
+      if(end[-1] == '/' || (parse_is(name[0], QUESTION) && end[-1] == '?')) {
+        self_closing = TRUE;
+        end--;
+      }
+
+      for(namelen = 0; name + namelen < end && !parse_is(name[namelen], WS | END); namelen++)
+        ;
+
+      if(parse_is(name[0], QUESTION) || is_self_closing_tag((const char*)name, namelen, opts))
+        self_closing = TRUE;
+
+      index = xml_tape_add(tape, current, XML_NODE_ELEMENT, name, namelen);
+      node = xml_tape_node(tape, index);
+      node->attrs = name + namelen - base;
+      node->attrslen = end - (name + namelen);
+      node->self_closing = self_closing;
+
+      if(!self_closing)
+        current = index;
+    }
+
+    pos += MIN_NUM(n, i + 1);
+  }
+
+  if(current && !opts->tolerant) {
+    XMLTapeNode* node = xml_tape_node(tape, current);
+
+    JS_ThrowSyntaxError(ctx, "unclosed <%.*s>", (int)node->namelen, base + node->name);
+    return -1;
+  }
+
+  return 0;
+}
+
+static inline XMLNodeRef*
+js_xml_node_data2(JSContext* ctx, JSValueConst value) {
+  return JS_GetOpaque2(ctx, value, js_xml_node_class_id);
+}
+
+static JSValue js_xml_node_children(JSContext*, XMLTape*, uint32_t);
+
+static JSValue
+js_xml_node_wrap(JSContext* ctx, XMLTape* tape, uint32_t index) {
+  XMLTapeNode* node = xml_tape_node(tape, index);
+  XMLNodeRef* ref;
+  JSValue obj;
+
+  if(node->type == XML_NODE_TEXT) {
+    const uint8_t* data;
+
+    if(!(data = xml_tape_data(tape, ctx)))
+      return JS_EXCEPTION;
+
+    return JS_NewStringLen(ctx, (const char*)data + node->name, node->namelen);
+  }
+
+  if(!(ref = js_malloc(ctx, sizeof(XMLNodeRef))))
+    return JS_EXCEPTION;
+
+  obj = JS_NewObjectProtoClass(ctx, xml_node_proto, js_xml_node_class_id);
+
+  if(JS_IsException(obj)) {
+    js_free(ctx, ref);
+    return obj;
+  }
+
+  ++tape->ref_count;
+  *ref = (XMLNodeRef){tape, index, JS_UNDEFINED, JS_UNDEFINED};
+  JS_SetOpaque(obj, ref);
+  return obj;
+}
+
+static JSValue
+js_xml_node_children(JSContext* ctx, XMLTape* tape, uint32_t index) {
+  JSValue ret = JS_NewArray(ctx);
+  uint32_t i = 0, child;
+
+  for(child = xml_tape_node(tape, index)->first; child; child = xml_tape_node(tape, child)->next) {
+    JSValue item = js_xml_node_wrap(ctx, tape, child);
+
+    if(JS_IsException(item)) {
+      JS_FreeValue(ctx, ret);
+      return JS_EXCEPTION;
+    }
+
+    JS_SetPropertyUint32(ctx, ret, i++, item);
+  }
+
+  return ret;
+}
+
+enum {
+  XML_NODE_TAGNAME = 0,
+  XML_NODE_ATTRIBUTES,
+  XML_NODE_CHILDREN,
+};
+
+static const char* const xml_node_properties[] = {
+    "tagName",
+    "attributes",
+    "children",
+};
+
+static JSAtom xml_node_atoms[countof(xml_node_properties)];
+
+/* xml.read() sets no attributes on declarations and no children on self-closing elements */
+static BOOL
+xml_node_has(XMLTapeNode* node, int prop) {
+  switch(prop) {
+    case XML_NODE_TAGNAME: return TRUE;
+    case XML_NODE_ATTRIBUTES: return node->type == XML_NODE_ELEMENT;
+    case XML_NODE_CHILDREN: return node->type == XML_NODE_ELEMENT && !node->self_closing;
+  }
+
+  return FALSE;
+}
+
+static JSValue
+xml_node_get(JSContext* ctx, XMLNodeRef* ref, int prop) {
+  XMLTapeNode* node = xml_tape_node(ref->tape, ref->index);
+  const uint8_t* data;
+
+  switch(prop) {
+    case XML_NODE_TAGNAME: {
+      if(!(data = xml_tape_data(ref->tape, ctx)))
+        return JS_EXCEPTION;
+
+      return xml_intern_string(&ref->tape->intern, ctx, data + node->name, node->namelen);
+    }
+    case XML_NODE_ATTRIBUTES: {
+      if(JS_IsUndefined(ref->attributes)) {
+        JSValue attributes;
+
+        if(!(data = xml_tape_data(ref->tape, ctx)))
+          return JS_EXCEPTION;
+
+        if(JS_IsException((attributes = xml_parse_attributes(ctx, data + node->attrs, data + node->attrs + node->attrslen, &ref->tape->intern))))
+          return JS_EXCEPTION;
+
+        ref->attributes = attributes;
+      }
+
+      return JS_DupValue(ctx, ref->attributes);
+    }
+    case XML_NODE_CHILDREN: {
+      if(JS_IsUndefined(ref->children)) {
+        JSValue children;
+
+        if(JS_IsException((children = js_xml_node_children(ctx, ref->tape, ref->index))))
+          return JS_EXCEPTION;
+
+        ref->children = children;
+      }
+
+      return JS_DupValue(ctx, ref->children);
+    }
+  }
+
+  return JS_UNDEFINED;
+}
+
+static int
+xml_node_property(JSContext* ctx, XMLTapeNode* node, JSAtom prop) {
+  int i;
+
+  for(i = 0; i < (int)countof(xml_node_properties); i++)
+    if(prop == xml_node_atoms[i] && xml_node_has(node, i))
+      return i;
+
+  return -1;
+}
+
+static int
+js_xml_node_get_own_property(JSContext* ctx, JSPropertyDescriptor* pdesc, JSValueConst obj, JSAtom prop) {
+  XMLNodeRef* ref;
+  int i;
+
+  if(!(ref = js_xml_node_data2(ctx, obj)))
+    return -1;
+
+  if((i = xml_node_property(ctx, xml_tape_node(ref->tape, ref->index), prop)) == -1)
+    return FALSE;
+
+  if(pdesc) {
+    if(JS_IsException((pdesc->value = xml_node_get(ctx, ref, i))))
+      return -1;
+
+    pdesc->flags = JS_PROP_ENUMERABLE;
+    pdesc->getter = JS_UNDEFINED;
+    pdesc->setter = JS_UNDEFINED;
+  }
+
+  return TRUE;
+}
+
+static int
+js_xml_node_get_own_property_names(JSContext* ctx, JSPropertyEnum** ptab, uint32_t* plen, JSValueConst obj) {
+  XMLNodeRef* ref;
+  JSPropertyEnum* props;
+  uint32_t i, len = 0;
+
+  if(!(ref = js_xml_node_data2(ctx, obj)))
+    return -1;
+
+  if(!(props = js_malloc(ctx, sizeof(JSPropertyEnum) * countof(xml_node_properties))))
+    return -1;
+
+  for(i = 0; i < countof(xml_node_properties); i++) {
+    if(xml_node_has(xml_tape_node(ref->tape, ref->index), i)) {
+      props[len].is_enumerable = TRUE;
+      props[len].atom = JS_DupAtom(ctx, xml_node_atoms[i]);
+      len++;
+    }
+  }
+
+  *ptab = props;
+  *plen = len;
+  return 0;
+}
+
+static void
+js_xml_node_finalizer(JSRuntime* rt, JSValue val) {
+  XMLNodeRef* ref;
+
+  if((ref = JS_GetOpaque(val, js_xml_node_class_id))) {
+    JS_FreeValueRT(rt, ref->attributes);
+    JS_FreeValueRT(rt, ref->children);
+    xml_tape_free(ref->tape, rt);
+    js_free_rt(rt, ref);
+  }
+}
+
+static void
+js_xml_node_mark(JSRuntime* rt, JSValueConst val, JS_MarkFunc* mark_func) {
+  XMLNodeRef* ref;
+
+  if((ref = JS_GetOpaque(val, js_xml_node_class_id))) {
+    JS_MarkValue(rt, ref->attributes, mark_func);
+    JS_MarkValue(rt, ref->children, mark_func);
+  }
+}
+
+static JSClassExoticMethods js_xml_node_exotic_methods = {
+    .get_own_property = js_xml_node_get_own_property,
+    .get_own_property_names = js_xml_node_get_own_property_names,
+};
+
+static JSClassDef js_xml_node_class = {
+    .class_name = "XMLNode",
+    .finalizer = js_xml_node_finalizer,
+    .gc_mark = js_xml_node_mark,
+    .exotic = &js_xml_node_exotic_methods,
+};
+
+static const JSCFunctionListEntry js_xml_node_funcs[] = {
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "XMLNode", JS_PROP_CONFIGURABLE),
+};
+
+static JSValue
+xml_tape_read(JSContext* ctx, JSValueConst value, InputBuffer* input, const ParseOptions* opts) {
+  XMLTape* tape;
+  JSValue ret;
+
+  if(!(tape = js_mallocz(ctx, sizeof(XMLTape))))
+    return JS_EXCEPTION;
+
+  tape->ref_count = 1;
+  tape->buffer = JS_UNDEFINED;
+  tape->size = input_buffer_length(input);
+  vector_init_rt(&tape->nodes, JS_GetRuntime(ctx));
+
+  /* strings are converted to a temporary UTF-8 copy, buffers are referenced */
+  if(JS_IsString(value)) {
+    if(!(tape->copy = js_malloc(ctx, tape->size + 1))) {
+      xml_tape_free(tape, JS_GetRuntime(ctx));
+      return JS_EXCEPTION;
+    }
+
+    memcpy(tape->copy, input_buffer_data(input), tape->size);
+    tape->data = tape->copy;
+  } else {
+    tape->buffer = JS_DupValue(ctx, input->value);
+    tape->data = input_buffer_data(input);
+    tape->offset = tape->data - input->data;
+  }
+
+  if(xml_tape_build(tape, ctx, opts)) {
+    xml_tape_free(tape, JS_GetRuntime(ctx));
+    return JS_EXCEPTION;
+  }
+
+  ret = js_xml_node_children(ctx, tape, 0);
+  xml_tape_free(tape, JS_GetRuntime(ctx));
+  return ret;
+}
+/**
+ * @}
+ */
+
+/**
+ * \defgroup xml-selector Selector: compiled CSS / XPath subset
+ *
+ * A selector is compiled once into chains of steps and can then be run
+ * against any number of documents, either xml.read() trees or the lazy
+ * tape, where matching never leaves C.
+ *
+ * Supported: CSS type, '*', #id, .class, [attr], [attr op value] with
+ * =, ~=, |=, ^=, $=, *=, the descendant and '>' combinators and ','
+ * lists; XPath /step, //step, '*', [@attr], [@attr='value'] and '|'.
+ * @{
+ */
+enum {
+  SELECTOR_EXISTS = 0,
+  SELECTOR_EQUALS,
+  SELECTOR_WORD,
+  SELECTOR_DASH,
+  SELECTOR_PREFIX,
+  SELECTOR_SUFFIX,
+  SELECTOR_CONTAINS,
+};
+
+enum {
+  SELECTOR_DESCENDANT = 0,
+  SELECTOR_CHILD,
+  SELECTOR_ROOT,
+};
+
+typedef struct {
+  int op;
+  char *name, *value;
+  size_t namelen, valuelen;
+} SelectorAttr;
+
+typedef struct {
+  char* tag;
+  size_t taglen;
+  int combinator;
+  Vector attrs;
+} SelectorStep;
+
+typedef struct {
+  char* source;
+  Vector chains;
+} Selector;
+
+typedef struct {
+  const uint8_t* tag;
+  size_t taglen;
+  const uint8_t *attrs, *attrs_end;
+  JSValue attributes;
+} SelectorElement;
+
+typedef struct SelectorCursor {
+  JSContext* ctx;
+  BOOL (*element)(struct SelectorCursor*, intptr_t, SelectorElement*);
+  intptr_t (*parent)(struct SelectorCursor*, intptr_t);
+  void* opaque;
+  uint32_t limit;
+} SelectorCursor;
+
+static JSClassID js_selector_class_id;
+static JSValue selector_proto, selector_ctor;
+
+static inline Selector*
+js_selector_data2(JSContext* ctx, JSValueConst value) {
+  return JS_GetOpaque2(ctx, value, js_selector_class_id);
+}
+
+static void
+selector_free(Selector* sel, JSRuntime* rt) {
+  Vector* chain;
+
+  vector_foreach_t(&sel->chains, chain) {
+    SelectorStep* step;
+
+    vector_foreach_t(chain, step) {
+      SelectorAttr* attr;
+
+      vector_foreach_t(&step->attrs, attr) {
+        js_free_rt(rt, attr->name);
+        js_free_rt(rt, attr->value);
+      }
+
+      vector_free(&step->attrs);
+      js_free_rt(rt, step->tag);
+    }
+
+    vector_free(chain);
+  }
+
+  vector_free(&sel->chains);
+  js_free_rt(rt, sel->source);
+  js_free_rt(rt, sel);
+}
+
+static inline BOOL
+selector_is_name_char(uint8_t c) {
+  return is_alphanumeric_char(c) || c == '-' || c == '_' || c == ':' || c == '.' || c >= 0x80;
+}
+
+static size_t
+selector_name(const char* s, size_t n, BOOL css) {
+  size_t i;
+
+  for(i = 0; i < n; i++)
+    if(!selector_is_name_char(s[i]) || (css && s[i] == '.'))
+      break;
+
+  return i;
+}
+
+static const char*
+selector_compile_attr(JSContext* ctx, SelectorStep* step, const char* s, const char* end, BOOL xpath) {
+  SelectorAttr attr = {SELECTOR_EXISTS, 0, 0, 0, 0};
+  size_t n;
+
+  s += scan_whitenskip(s, end - s);
+
+  if(xpath) {
+    if(s == end || *s != '@')
+      return 0;
+    s++;
+  }
+
+  if((n = selector_name(s, end - s, FALSE)) == 0)
+    return 0;
+
+  attr.name = js_strndup(ctx, s, n);
+  attr.namelen = n;
+  s += n;
+  s += scan_whitenskip(s, end - s);
+
+  if(s < end && *s != ']') {
+    static const char ops[] = "=~|^$*";
+    const char* op;
+
+    if(!(op = strchr(ops, *s)) || !*op)
+      goto fail;
+
+    attr.op = *s == '=' ? SELECTOR_EQUALS : SELECTOR_WORD + (op - ops) - 1;
+
+    if(*s++ != '=' && (s == end || *s++ != '='))
+      goto fail;
+
+    s += scan_whitenskip(s, end - s);
+
+    if(s < end && (*s == '"' || *s == '\'')) {
+      char quote = *s++;
+
+      n = byte_chr(s, end - s, quote);
+
+      if(s + n == end)
+        goto fail;
+
+      attr.value = js_strndup(ctx, s, n);
+      attr.valuelen = n;
+      s += n + 1;
+    } else if(!xpath && (n = selector_name(s, end - s, FALSE))) {
+      attr.value = js_strndup(ctx, s, n);
+      attr.valuelen = n;
+      s += n;
+    } else {
+      goto fail;
+    }
+
+    s += scan_whitenskip(s, end - s);
+  }
+
+  if(s == end || *s != ']')
+    goto fail;
+
+  vector_push(&step->attrs, attr);
+  return s + 1;
+
+fail:
+  js_free(ctx, attr.name);
+  js_free(ctx, attr.value);
+  return 0;
+}
+
+static void
+selector_attr_add(JSContext* ctx, SelectorStep* step, int op, const char* name, const char* value, size_t valuelen) {
+  SelectorAttr attr = {op, js_strdup(ctx, name), js_strndup(ctx, value, valuelen), strlen(name), valuelen};
+
+  vector_push(&step->attrs, attr);
+}
+
+/* parses one compound selector (CSS) or location step (XPath) */
+static const char*
+selector_compile_step(JSContext* ctx, SelectorStep* step, const char* s, const char* end, BOOL xpath) {
+  size_t n;
+  const char* start = s;
+
+  if(s < end && *s == '*') {
+    s++;
+  } else if((n = selector_name(s, end - s, !xpath))) {
+    step->tag = js_strndup(ctx, s, n);
+    step->taglen = n;
+    s += n;
+  }
+
+  while(s < end) {
+    if(*s == '[') {
+      if(!(s = selector_compile_attr(ctx, step, s + 1, end, xpath)))
+        return 0;
+    } else if(!xpath && (*s == '#' || *s == '.')) {
+      BOOL id = *s++ == '#';
+
+      if((n = selector_name(s, end - s, TRUE)) == 0)
+        return 0;
+
+      selector_attr_add(ctx, step, id ? SELECTOR_EQUALS : SELECTOR_WORD, id ? "id" : "class", s, n);
+      s += n;
+    } else {
+      break;
+    }
+  }
+
+  return s == start ? 0 : s;
+}
+
+static BOOL
+selector_compile(JSContext* ctx, Selector* sel, const char* s, size_t len) {
+  const char *end = s + len, *p = s;
+  BOOL xpath;
+
+  p += scan_whitenskip(p, end - p);
+  xpath = p < end && *p == '/';
+
+  while(p < end) {
+    Vector chain = VECTOR_RT(JS_GetRuntime(ctx));
+    int combinator = xpath ? SELECTOR_ROOT : SELECTOR_DESCENDANT;
+
+    for(;;) {
+      SelectorStep step = {0, 0, combinator, VECTOR_RT(JS_GetRuntime(ctx))};
+
+      p += scan_whitenskip(p, end - p);
+
+      if(xpath) {
+        if(p == end || *p != '/')
+          goto fail;
+
+        step.combinator = (p + 1 < end && p[1] == '/') ? SELECTOR_DESCENDANT : (vector_empty(&chain) ? SELECTOR_ROOT : SELECTOR_CHILD);
+        p += step.combinator == SELECTOR_DESCENDANT ? 2 : 1;
+      }
+
+      if(!(p = selector_compile_step(ctx, &step, p, end, xpath))) {
+        vector_push(&chain, step);
+        goto fail;
+      }
+
+      vector_push(&chain, step);
+
+      if(p == end)
+        break;
+
+      if(xpath) {
+        p += scan_whitenskip(p, end - p);
+
+        if(p == end)
+          break;
+
+        if(*p == '|') {
+          p++;
+          p += scan_whitenskip(p, end - p);
+          break;
+        }
+
+        continue;
+      }
+
+      {
+        const char* q = p + scan_whitenskip(p, end - p);
+
+        if(q == end) {
+          p = q;
+          break;
+        }
+
+        if(*q == ',') {
+          p = q + 1;
+          break;
+        }
+
+        if(*q == '>') {
+          combinator = SELECTOR_CHILD;
+          p = q + 1;
+        } else if(q > p) {
+          combinator = SELECTOR_DESCENDANT;
+          p = q;
+        } else {
+          goto fail;
+        }
+      }
+    }
+
+    vector_push(&sel->chains, chain);
+    continue;
+
+  fail:
+    vector_push(&sel->chains, chain);
+    JS_ThrowSyntaxError(ctx, "Selector: unsupported or invalid expression at offset %zu: '%.*s'", (size_t)(p ? p - s : 0), (int)len, s);
+    return FALSE;
+  }
+
+  if(vector_empty(&sel->chains)) {
+    JS_ThrowSyntaxError(ctx, "Selector: empty expression");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* looks up an attribute in the raw attribute text of a tag (as recorded by the tape) */
+static BOOL
+xml_attr_lookup(const uint8_t* ptr, const uint8_t* end, const char* name, size_t namelen, const uint8_t** value, size_t* vlen) {
+  while(ptr < end) {
+    const uint8_t *attr, *v;
+    size_t alen, n;
+
+    while(ptr < end && parse_is(*ptr, WS))
+      ptr++;
+
+    attr = ptr;
+
+    while(ptr < end && !parse_is(*ptr, EQUAL | WS | SPECIAL | END))
+      ptr++;
+
+    if((alen = ptr - attr) == 0)
+      break;
+
+    v = ptr;
+    n = 0;
+
+    if(ptr < end && parse_is(*ptr, EQUAL)) {
+      if(++ptr < end && parse_is(*ptr, QUOTE)) {
+        uint8_t quote = *ptr++;
+
+        v = ptr;
+        ptr += (n = byte_chr(ptr, end - ptr, quote));
+
+        if(ptr < end)
+          ptr++;
+      } else {
+        for(v = ptr; ptr < end && !parse_is(*ptr, WS | CLOSE);)
+          ptr++;
+
+        n = ptr - v;
+      }
+    }
+
+    if(alen == namelen && !memcmp(attr, name, namelen)) {
+      *value = v;
+      *vlen = n;
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+static BOOL
+selector_attr_match(const SelectorAttr* attr, const uint8_t* v, size_t n) {
+  size_t i;
+
+  switch(attr->op) {
+    case SELECTOR_EXISTS: return TRUE;
+    case SELECTOR_EQUALS: return n == attr->valuelen && !memcmp(v, attr->value, n);
+    case SELECTOR_PREFIX: return n >= attr->valuelen && !memcmp(v, attr->value, attr->valuelen);
+    case SELECTOR_SUFFIX: return n >= attr->valuelen && !memcmp(v + n - attr->valuelen, attr->value, attr->valuelen);
+    case SELECTOR_CONTAINS: return byte_findb(v, n, attr->value, attr->valuelen) < n;
+    case SELECTOR_DASH: return n >= attr->valuelen && !memcmp(v, attr->value, attr->valuelen) && (n == attr->valuelen || v[attr->valuelen] == '-');
+    case SELECTOR_WORD: {
+      for(i = 0; i < n;) {
+        size_t w;
+
+        i += scan_whitenskip((const char*)v + i, n - i);
+
+        for(w = 0; i + w < n && !is_whitespace_char(v[i + w]);)
+          w++;
+
+        if(w && w == attr->valuelen && !memcmp(v + i, attr->value, w))
+          return TRUE;
+
+        i += w;
+      }
+
+      return FALSE;
+    }
+  }
+
+  return FALSE;
+}
+
+static BOOL
+selector_step_match(const SelectorStep* step, SelectorCursor* cur, const SelectorElement* el) {
+  SelectorAttr* attr;
+
+  if(step->tag && (el->taglen != step->taglen || memcmp(el->tag, step->tag, step->taglen)))
+    return FALSE;
+
+  vector_foreach_t(&step->attrs, attr) {
+    const uint8_t* v = 0;
+    size_t n = 0;
+    BOOL ret;
+
+    if(JS_IsObject(el->attributes)) {
+      JSValue value;
+      const char* str = 0;
+
+      if(!js_has_propertystr(cur->ctx, el->attributes, attr->name))
+        return FALSE;
+
+      value = JS_GetPropertyStr(cur->ctx, el->attributes, attr->name);
+
+      /* valueless attributes are stored as true */
+      if(!JS_IsBool(value) && (str = JS_ToCStringLen(cur->ctx, &n, value)))
+        v = (const uint8_t*)str;
+
+      ret = selector_attr_match(attr, v ? v : (const uint8_t*)"", v ? n : 0);
+
+      if(str)
+        JS_FreeCString(cur->ctx, str);
+
+      JS_FreeValue(cur->ctx, value);
+    } else {
+      if(!xml_attr_lookup(el->attrs, el->attrs_end, attr->name, attr->namelen, &v, &n))
+        return FALSE;
+
+      ret = selector_attr_match(attr, v, n);
+    }
+
+    if(!ret)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+static BOOL
+selector_chain_match(const Vector* chain, int32_t k, SelectorCursor* cur, intptr_t node) {
+  const SelectorStep* step = vector_at(chain, sizeof(SelectorStep), k);
+  SelectorElement el;
+  intptr_t parent;
+
+  if(!cur->element(cur, node, &el) || !selector_step_match(step, cur, &el))
+    return FALSE;
+
+  parent = cur->parent(cur, node);
+
+  switch(step->combinator) {
+    case SELECTOR_ROOT: return k == 0 && parent == -1;
+    case SELECTOR_CHILD: return k > 0 && parent != -1 && selector_chain_match(chain, k - 1, cur, parent);
+    case SELECTOR_DESCENDANT: {
+      if(k == 0)
+        return TRUE;
+
+      for(; parent != -1; parent = cur->parent(cur, parent))
+        if(selector_chain_match(chain, k - 1, cur, parent))
+          return TRUE;
+
+      return FALSE;
+    }
+  }
+
+  return FALSE;
+}
+
+static BOOL
+selector_match(Selector* sel, SelectorCursor* cur, intptr_t node) {
+  Vector* chain;
+
+  vector_foreach_t(&sel->chains, chain) if(selector_chain_match(chain, vector_size(chain, sizeof(SelectorStep)) - 1, cur, node)) return TRUE;
+
+  return FALSE;
+}
+
+/* tape cursor: nodes are tape indices, ancestors are followed up to (excluding) cur->limit */
+static BOOL
+selector_tape_element(SelectorCursor* cur, intptr_t index, SelectorElement* el) {
+  XMLTape* tape = cur->opaque;
+  XMLTapeNode* node = xml_tape_node(tape, index);
+
+  if(node->type != XML_NODE_ELEMENT)
+    return FALSE;
+
+  *el = (SelectorElement){tape->data + node->name, node->namelen, tape->data + node->attrs, tape->data + node->attrs + node->attrslen, JS_UNDEFINED};
+  return TRUE;
+}
+
+static intptr_t
+selector_tape_parent(SelectorCursor* cur, intptr_t index) {
+  uint32_t parent = xml_tape_node(cur->opaque, index)->parent;
+
+  return parent == cur->limit ? -1 : (intptr_t)parent;
+}
+
+/* tree cursor: nodes are depths into the stack of open elements */
+typedef struct {
+  JSValue list;
+  uint32_t index, length;
+  SelectorElement el;
+  const char* tag;
+} SelectorFrame;
+
+static BOOL
+selector_tree_element(SelectorCursor* cur, intptr_t depth, SelectorElement* el) {
+  SelectorFrame* frame = vector_at(cur->opaque, sizeof(SelectorFrame), depth);
+
+  *el = frame->el;
+  return frame->tag != 0;
+}
+
+static intptr_t
+selector_tree_parent(SelectorCursor* cur, intptr_t depth) {
+  return depth - 1;
+}
+
+/* paths have the deep.select() form: [index, 'children', index, ...] */
+static void
+selector_path_push(JSContext* ctx, JSValueConst path, uint32_t* n, BOOL top, BOOL array, uint32_t index) {
+  if(top && !array)
+    return;
+
+  if(!top)
+    JS_SetPropertyUint32(ctx, path, (*n)++, JS_NewString(ctx, "children"));
+
+  JS_SetPropertyUint32(ctx, path, (*n)++, JS_NewUint32(ctx, index));
+}
+
+static JSValue
+selector_tape_path(JSContext* ctx, XMLTape* tape, uint32_t index, uint32_t limit, BOOL array) {
+  Arena* arena = js_arena(ctx);
+  ArenaMark mark = arena_mark(arena);
+  Vector positions = VECTOR_ARENA(arena);
+  JSValue path = JS_NewArray(ctx);
+  uint32_t i, n, *pos;
+
+  for(i = index; i != limit; i = xml_tape_node(tape, i)->parent) {
+    uint32_t child;
+
+    for(n = 0, child = xml_tape_node(tape, xml_tape_node(tape, i)->parent)->first; child != i; child = xml_tape_node(tape, child)->next)
+      n++;
+
+    vector_push(&positions, n);
+  }
+
+  n = 0;
+
+  for(pos = vector_end(&positions); pos != vector_begin(&positions);) {
+    --pos;
+    selector_path_push(ctx, path, &n, pos + 1 == (uint32_t*)vector_end(&positions), array, *pos);
+  }
+
+  arena_release(arena, mark);
+  return path;
+}
+
+static JSValue
+selector_select_tape(JSContext* ctx, Selector* sel, XMLTape* tape, uint32_t root, BOOL array, BOOL paths, BOOL first) {
+  SelectorCursor cur = {ctx, selector_tape_element, selector_tape_parent, tape, 0};
+  uint32_t i, end, count = vector_size(&tape->nodes, sizeof(XMLTapeNode)), n = 0;
+  JSValue ret;
+
+  /* selector_tape_element() reads the refreshed tape->data */
+  if(!xml_tape_data(tape, ctx))
+    return JS_EXCEPTION;
+
+  ret = first ? JS_NULL : JS_NewArray(ctx);
+
+  /* the subtree of 'root' ends at the next sibling of it or of its nearest ancestor */
+  for(i = root, end = count; i; i = xml_tape_node(tape, i)->parent)
+    if(xml_tape_node(tape, i)->next) {
+      end = xml_tape_node(tape, i)->next;
+      break;
+    }
+
+  cur.limit = array ? root : xml_tape_node(tape, root)->parent;
+
+  for(i = array ? root + 1 : root; i < end; i++) {
+    JSValue value;
+
+    if(!selector_match(sel, &cur, i))
+      continue;
+
+    if(paths) {
+      value = selector_tape_path(ctx, tape, i, cur.limit, array);
+    } else if(JS_IsException((value = js_xml_node_wrap(ctx, tape, i)))) {
+      JS_FreeValue(ctx, ret);
+      return value;
+    }
+
+    if(first)
+      return value;
+
+    JS_SetPropertyUint32(ctx, ret, n++, value);
+  }
+
+  return ret;
+}
+
+static void
+selector_frame_release(JSContext* ctx, SelectorFrame* frame) {
+  if(frame->tag)
+    JS_FreeCString(ctx, frame->tag);
+
+  JS_FreeValue(ctx, frame->el.attributes);
+  frame->tag = 0;
+  frame->el = (SelectorElement){0, 0, 0, 0, JS_UNDEFINED};
+}
+
+static JSValue
+selector_select_tree(JSContext* ctx, Selector* sel, JSValueConst root, BOOL array, BOOL paths, BOOL first) {
+  VECTOR_INLINE(frames, SelectorFrame, 16, ctx);
+  SelectorCursor cur = {ctx, selector_tree_element, selector_tree_parent, &frames, 0};
+  SelectorFrame frame = {JS_UNDEFINED, 0, 0, {0, 0, 0, 0, JS_UNDEFINED}, 0};
+  JSValue ret = first ? JS_NULL : JS_NewArray(ctx), list;
+  uint32_t n = 0;
+  BOOL done = FALSE;
+
+  if(array) {
+    list = JS_DupValue(ctx, root);
+  } else {
+    list = JS_NewArray(ctx);
+    JS_SetPropertyUint32(ctx, list, 0, JS_DupValue(ctx, root));
+  }
+
+  frame.list = list;
+  frame.length = js_array_length(ctx, list);
+  vector_push(&frames, frame);
+
+  while(!done && !vector_empty(&frames)) {
+    SelectorFrame* top = vector_back(&frames, sizeof(SelectorFrame));
+    intptr_t depth = vector_size(&frames, sizeof(SelectorFrame)) - 1;
+    JSValue value, children;
+
+    if(top->index >= top->length) {
+      JS_FreeValue(ctx, top->list);
+      vector_pop(&frames, sizeof(SelectorFrame));
+
+      if(vector_empty(&frames))
+        break;
+
+      top = vector_back(&frames, sizeof(SelectorFrame));
+      selector_frame_release(ctx, top);
+      top->index++;
+      continue;
+    }
+
+    value = JS_GetPropertyUint32(ctx, top->list, top->index);
+
+    if(!JS_IsObject(value) || JS_IsArray(ctx, value) || !(top->tag = js_get_propertystr_cstringlen(ctx, value, "tagName", &top->el.taglen))) {
+      JS_FreeValue(ctx, value);
+      top->index++;
+      continue;
+    }
+
+    top->el.tag = (const uint8_t*)top->tag;
+    top->el.attributes = JS_GetPropertyStr(ctx, value, "attributes");
+
+    if(selector_match(sel, &cur, depth)) {
+      JSValue result;
+
+      if(paths) {
+        SelectorFrame* f;
+        uint32_t i = 0;
+
+        result = JS_NewArray(ctx);
+
+        vector_foreach_t(&frames, f) selector_path_push(ctx, result, &i, f == vector_begin(&frames), array, f->index);
+      } else {
+        result = JS_DupValue(ctx, value);
+      }
+
+      if(first) {
+        ret = result;
+        done = TRUE;
+      } else {
+        JS_SetPropertyUint32(ctx, ret, n++, result);
+      }
+    }
+
+    children = done ? JS_UNDEFINED : JS_GetPropertyStr(ctx, value, "children");
+    JS_FreeValue(ctx, value);
+
+    if(JS_IsArray(ctx, children)) {
+      frame = (SelectorFrame){children, 0, js_array_length(ctx, children), {0, 0, 0, 0, JS_UNDEFINED}, 0};
+      vector_push(&frames, frame);
+      continue;
+    }
+
+    JS_FreeValue(ctx, children);
+    selector_frame_release(ctx, top);
+    top->index++;
+  }
+
+  {
+    SelectorFrame* f;
+
+    vector_foreach_t(&frames, f) {
+      selector_frame_release(ctx, f);
+      JS_FreeValue(ctx, f->list);
+    }
+  }
+
+  vector_free(&frames);
+  return ret;
+}
+
+static BOOL
+selector_tape_root(JSContext* ctx, JSValueConst root, XMLTape** tape, uint32_t* index, BOOL* array) {
+  XMLNodeRef* ref;
+
+  if((ref = JS_GetOpaque(root, js_xml_node_class_id))) {
+    *tape = ref->tape;
+    *index = ref->index;
+    *array = FALSE;
+    return TRUE;
+  }
+
+  if(JS_IsArray(ctx, root)) {
+    int64_t i, len = js_array_length(ctx, root);
+
+    for(i = 0; i < len; i++) {
+      JSValue item = JS_GetPropertyUint32(ctx, root, i);
+
+      ref = JS_GetOpaque(item, js_xml_node_class_id);
+      JS_FreeValue(ctx, item);
+
+      if(ref) {
+        *tape = ref->tape;
+        *index = xml_tape_node(ref->tape, ref->index)->parent;
+        *array = TRUE;
+        return TRUE;
+      }
+
+      if(JS_IsObject(item))
+        break;
+    }
+  }
+
+  return FALSE;
+}
+
+static JSValue
+js_selector_constructor(JSContext* ctx, JSValueConst new_target, int argc, JSValueConst argv[]) {
+  JSValue proto, obj = JS_UNDEFINED;
+  Selector* sel;
+  const char* str;
+  size_t len;
+
+  if(!(str = JS_ToCStringLen(ctx, &len, argv[0])))
+    return JS_EXCEPTION;
+
+  if(!(sel = js_mallocz(ctx, sizeof(Selector)))) {
+    JS_FreeCString(ctx, str);
+    return JS_ThrowOutOfMemory(ctx);
+  }
+
+  sel->source = js_strndup(ctx, str, len);
+  sel->chains = VECTOR_RT(JS_GetRuntime(ctx));
+
+  if(!selector_compile(ctx, sel, str, len)) {
+    JS_FreeCString(ctx, str);
+    goto fail;
+  }
+
+  JS_FreeCString(ctx, str);
+
+  /* using new_target to get the prototype is necessary when the class is extended. */
+  proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+  if(JS_IsException(proto))
+    goto fail;
+
+  obj = JS_NewObjectProtoClass(ctx, proto, js_selector_class_id);
+  JS_FreeValue(ctx, proto);
+
+  if(JS_IsException(obj))
+    goto fail;
+
+  JS_SetOpaque(obj, sel);
+  return obj;
+
+fail:
+  selector_free(sel, JS_GetRuntime(ctx));
+  JS_FreeValue(ctx, obj);
+  return JS_EXCEPTION;
+}
+
+enum {
+  SELECTOR_SELECT = 0,
+  SELECTOR_FIRST,
+  SELECTOR_MATCHES,
+  SELECTOR_TOSTRING,
+};
+
+static JSValue
+js_selector_method(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic) {
+  Selector* sel;
+  JSValue ret = JS_UNDEFINED;
+  XMLTape* tape;
+  uint32_t index;
+  BOOL array, paths = argc > 1 && JS_ToBool(ctx, argv[1]);
+
+  if(!(sel = js_selector_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  switch(magic) {
+    case SELECTOR_SELECT:
+    case SELECTOR_FIRST: {
+      BOOL first = magic == SELECTOR_FIRST;
+
+      if(selector_tape_root(ctx, argv[0], &tape, &index, &array))
+        ret = selector_select_tape(ctx, sel, tape, index, array, paths, first);
+      else if(JS_IsObject(argv[0]))
+        ret = selector_select_tree(ctx, sel, argv[0], JS_IsArray(ctx, argv[0]), paths, first);
+      else
+        ret = JS_ThrowTypeError(ctx, "Selector: argument 1 must be an element or an array of elements");
+      break;
+    }
+    case SELECTOR_MATCHES: {
+      XMLNodeRef* ref;
+
+      if((ref = JS_GetOpaque(argv[0], js_xml_node_class_id))) {
+        SelectorCursor cur = {ctx, selector_tape_element, selector_tape_parent, ref->tape, 0};
+
+        ret = JS_NewBool(ctx, selector_match(sel, &cur, ref->index));
+      } else if(JS_IsObject(argv[0])) {
+        VECTOR_INLINE(frames, SelectorFrame, 1, ctx);
+        SelectorCursor cur = {ctx, selector_tree_element, selector_tree_parent, &frames, 0};
+        SelectorFrame frame = {JS_UNDEFINED, 0, 1, {0, 0, 0, 0, JS_UNDEFINED}, 0};
+
+        if((frame.tag = js_get_propertystr_cstringlen(ctx, argv[0], "tagName", &frame.el.taglen))) {
+          frame.el.tag = (const uint8_t*)frame.tag;
+          frame.el.attributes = JS_GetPropertyStr(ctx, argv[0], "attributes");
+        }
+
+        vector_push(&frames, frame);
+        ret = JS_NewBool(ctx, frame.tag && selector_match(sel, &cur, 0));
+        selector_frame_release(ctx, vector_begin(&frames));
+        vector_free(&frames);
+      } else {
+        ret = JS_FALSE;
+      }
+      break;
+    }
+    case SELECTOR_TOSTRING: {
+      ret = JS_NewString(ctx, sel->source);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static JSValue
+js_selector_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  Selector* sel;
+
+  if(!(sel = js_selector_data2(ctx, this_val)))
+    return JS_EXCEPTION;
+
+  return JS_NewString(ctx, sel->source);
+}
+
+static void
+js_selector_finalizer(JSRuntime* rt, JSValue val) {
+  Selector* sel;
+
+  if((sel = JS_GetOpaque(val, js_selector_class_id)))
+    selector_free(sel, rt);
+}
+
+static JSClassDef js_selector_class = {
+    .class_name = "Selector",
+    .finalizer = js_selector_finalizer,
+};
+
+static const JSCFunctionListEntry js_selector_funcs[] = {
+    JS_CFUNC_MAGIC_DEF("select", 1, js_selector_method, SELECTOR_SELECT),
+    JS_CFUNC_MAGIC_DEF("first", 1, js_selector_method, SELECTOR_FIRST),
+    JS_CFUNC_MAGIC_DEF("matches", 1, js_selector_method, SELECTOR_MATCHES),
+    JS_CFUNC_MAGIC_DEF("toString", 0, js_selector_method, SELECTOR_TOSTRING),
+    JS_CGETSET_MAGIC_DEF("source", js_selector_get, 0, 0),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Selector", JS_PROP_CONFIGURABLE),
+};
+/**
+ * @}
+ */
+
+typedef struct {
+  JSValue list;
+  uint32_t index, length;
+} XMLIndexFrame;
+
+static void
+xml_index_push(JSContext* ctx, JSValueConst map, JSAtom key, JSValueConst path) {
+  JSValue list = JS_GetProperty(ctx, map, key);
+
+  if(!JS_IsArray(ctx, list)) {
+    JS_FreeValue(ctx, list);
+    list = JS_NewArray(ctx);
+    JS_SetProperty(ctx, map, key, JS_DupValue(ctx, list));
+  }
+
+  JS_SetPropertyUint32(ctx, list, js_array_length(ctx, list), JS_DupValue(ctx, path));
+  JS_FreeValue(ctx, list);
+}
+
+static void
+xml_index_attributes(JSContext* ctx, JSValueConst element, JSValueConst path, JSValueConst ids, JSValueConst classes) {
+  JSValue attributes = JS_GetPropertyStr(ctx, element, "attributes"), value;
+
+  if(!JS_IsObject(attributes)) {
+    JS_FreeValue(ctx, attributes);
+    return;
+  }
+
+  value = JS_GetPropertyStr(ctx, attributes, "id");
+
+  if(JS_IsString(value)) {
+    JSAtom atom = JS_ValueToAtom(ctx, value);
+
+    /* like getElementById(), the first element in document order wins */
+    if(JS_HasProperty(ctx, ids, atom) == FALSE)
+      JS_SetProperty(ctx, ids, atom, JS_DupValue(ctx, path));
+
+    JS_FreeAtom(ctx, atom);
+  }
+
+  JS_FreeValue(ctx, value);
+  value = JS_GetPropertyStr(ctx, attributes, "class");
+
+  if(JS_IsString(value)) {
+    const char* s;
+    size_t len, i = 0, n;
+
+    if((s = JS_ToCStringLen(ctx, &len, value))) {
+      while(i < len) {
+        if(byte_chr(" \t\r\n\f", 5, s[i]) < 5) {
+          i++;
+          continue;
+        }
+
+        for(n = 0; i + n < len && byte_chr(" \t\r\n\f", 5, s[i + n]) == 5; n++)
+          ;
+
+        JSAtom atom = JS_NewAtomLen(ctx, s + i, n);
+        xml_index_push(ctx, classes, atom, path);
+        JS_FreeAtom(ctx, atom);
+        i += n;
+      }
+
+      JS_FreeCString(ctx, s);
+    }
+  }
+
+  JS_FreeValue(ctx, value);
+  JS_FreeValue(ctx, attributes);
+}
+
+/**
+ * index(tree): tag, id and class lookup tables for an xml.read() tree,
+ * built in one walk as { tags, ids, classes } with null prototypes and
+ * keyed by atom. tags and classes map to arrays of element paths, ids to
+ * the path of the first element with that id. Paths have the form of
+ * Selector.prototype.select(tree, true); an element tree's root is not
+ * indexed, the elements of an array are.
+ */
+static JSValue
+js_xml_index(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  VECTOR_INLINE(frames, XMLIndexFrame, 16, ctx);
+  XMLIndexFrame frame;
+  BOOL array = JS_IsArray(ctx, argv[0]);
+  JSValue ret, tags, ids, classes, list;
+
+  if(!JS_IsObject(argv[0]))
+    return JS_ThrowTypeError(ctx, "xml.index: argument 1 must be an element or an array of elements");
+
+  if(array) {
+    list = JS_DupValue(ctx, argv[0]);
+  } else {
+    list = JS_NewArray(ctx);
+    JS_SetPropertyUint32(ctx, list, 0, JS_DupValue(ctx, argv[0]));
+  }
+
+  tags = JS_NewObjectProto(ctx, JS_NULL);
+  ids = JS_NewObjectProto(ctx, JS_NULL);
+  classes = JS_NewObjectProto(ctx, JS_NULL);
+
+  frame = (XMLIndexFrame){list, 0, js_array_length(ctx, list)};
+  vector_push(&frames, frame);
+
+  while(!vector_empty(&frames)) {
+    XMLIndexFrame* top = vector_back(&frames, sizeof(XMLIndexFrame));
+    JSValue value, tag, children;
+
+    if(top->index >= top->length) {
+      JS_FreeValue(ctx, top->list);
+      vector_pop(&frames, sizeof(XMLIndexFrame));
+
+      if(!vector_empty(&frames))
+        ((XMLIndexFrame*)vector_back(&frames, sizeof(XMLIndexFrame)))->index++;
+
+      continue;
+    }
+
+    value = JS_GetPropertyUint32(ctx, top->list, top->index);
+    tag = JS_IsObject(value) && !JS_IsArray(ctx, value) ? JS_GetPropertyStr(ctx, value, "tagName") : JS_UNDEFINED;
+
+    if(!JS_IsString(tag)) {
+      JS_FreeValue(ctx, tag);
+      JS_FreeValue(ctx, value);
+      top->index++;
+      continue;
+    }
+
+    if(array || vector_size(&frames, sizeof(XMLIndexFrame)) > 1) {
+      JSValue path = JS_NewArray(ctx);
+      XMLIndexFrame* f;
+      uint32_t i = 0;
+      JSAtom atom = JS_ValueToAtom(ctx, tag);
+
+      vector_foreach_t(&frames, f) selector_path_push(ctx, path, &i, f == vector_begin(&frames), array, f->index);
+
+      xml_index_push(ctx, tags, atom, path);
+      xml_index_attributes(ctx, value, path, ids, classes);
+
+      JS_FreeAtom(ctx, atom);
+      JS_FreeValue(ctx, path);
+    }
+
+    children = JS_GetPropertyStr(ctx, value, "children");
+    JS_FreeValue(ctx, tag);
+    JS_FreeValue(ctx, value);
+
+    if(JS_IsArray(ctx, children)) {
+      frame = (XMLIndexFrame){children, 0, js_array_length(ctx, children)};
+      vector_push(&frames, frame);
+      continue;
+    }
+
+    JS_FreeValue(ctx, children);
+    top->index++;
+  }
+
+  vector_free(&frames);
+
+  ret = JS_NewObject(ctx);
+  JS_SetPropertyStr(ctx, ret, "tags", tags);
+  JS_SetPropertyStr(ctx, ret, "ids", ids);
+  JS_SetPropertyStr(ctx, ret, "classes", classes);
+  return ret;
+}
+
+static const JSCFunctionListEntry js_xml_funcs[] = {
+    JS_CFUNC_DEF("read", 1, js_xml_read),
+    JS_CFUNC_DEF("readFile", 1, js_xml_read_file),
+    JS_CFUNC_DEF("write", 2, js_xml_write),
+    JS_CFUNC_DEF("index", 1, js_xml_index),
+};
+
+static int
+js_xml_init(JSContext* ctx, JSModuleDef* m) {
+
+  character_classes_init(chars);
+
+  if(js_location_class_id == 0)
+    js_location_init(ctx, 0);
+
+  if(js_xml_locations_class_id == 0) {
+    JS_NewClassID(&js_xml_locations_class_id);
+    JS_NewClass(JS_GetRuntime(ctx), js_xml_locations_class_id, &js_xml_locations_class);
+
+    xml_locations_proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, xml_locations_proto, js_xml_locations_funcs, countof(js_xml_locations_funcs));
+    JS_SetClassProto(ctx, js_xml_locations_class_id, xml_locations_proto);
+  }
+
+  if(js_xml_parser_class_id == 0) {
+    JS_NewClassID(&js_xml_parser_class_id);
+    JS_NewClass(JS_GetRuntime(ctx), js_xml_parser_class_id, &js_xml_parser_class);
+
+    xml_parser_ctor = JS_NewCFunction2(ctx, js_xml_parser_constructor, "XMLParser", 2, JS_CFUNC_constructor, 0);
+    xml_parser_proto = JS_NewObject(ctx);
+
+    JS_SetPropertyFunctionList(ctx, xml_parser_proto, js_xml_parser_funcs, countof(js_xml_parser_funcs));
+    JS_SetClassProto(ctx, js_xml_parser_class_id, xml_parser_proto);
+    JS_SetConstructor(ctx, xml_parser_ctor, xml_parser_proto);
+  }
+
+  if(js_xml_node_class_id == 0) {
+    JS_NewClassID(&js_xml_node_class_id);
+    JS_NewClass(JS_GetRuntime(ctx), js_xml_node_class_id, &js_xml_node_class);
+
+    xml_node_proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, xml_node_proto, js_xml_node_funcs, countof(js_xml_node_funcs));
+    JS_SetClassProto(ctx, js_xml_node_class_id, xml_node_proto);
+
+    for(size_t i = 0; i < countof(xml_node_properties); i++)
+      xml_node_atoms[i] = JS_NewAtom(ctx, xml_node_properties[i]);
+  }
+
+  if(js_selector_class_id == 0) {
+    JS_NewClassID(&js_selector_class_id);
+    JS_NewClass(JS_GetRuntime(ctx), js_selector_class_id, &js_selector_class);
+
+    selector_ctor = JS_NewCFunction2(ctx, js_selector_constructor, "Selector", 1, JS_CFUNC_constructor, 0);
+    selector_proto = JS_NewObject(ctx);
+
+    JS_SetPropertyFunctionList(ctx, selector_proto, js_selector_funcs, countof(js_selector_funcs));
+    JS_SetClassProto(ctx, js_selector_class_id, selector_proto);
+    JS_SetConstructor(ctx, selector_ctor, selector_proto);
+  }
 
   JS_SetModuleExportList(ctx, m, js_xml_funcs, countof(js_xml_funcs));
+  JS_SetModuleExport(ctx, m, "XMLParser", JS_DupValue(ctx, xml_parser_ctor));
+  JS_SetModuleExport(ctx, m, "Selector", JS_DupValue(ctx, selector_ctor));
 
   JSValue defaultObj = JS_NewObject(ctx);
   JS_SetPropertyStr(ctx, defaultObj, "read", JS_NewCFunction(ctx, js_xml_read, "read", 1));
+  JS_SetPropertyStr(ctx, defaultObj, "readFile", JS_NewCFunction(ctx, js_xml_read_file, "readFile", 1));
   JS_SetPropertyStr(ctx, defaultObj, "write", JS_NewCFunction(ctx, js_xml_write, "write", 2));
+  JS_SetPropertyStr(ctx, defaultObj, "index", JS_NewCFunction(ctx, js_xml_index, "index", 1));
+  JS_SetPropertyStr(ctx, defaultObj, "XMLParser", JS_DupValue(ctx, xml_parser_ctor));
+  JS_SetPropertyStr(ctx, defaultObj, "Selector", JS_DupValue(ctx, selector_ctor));
   JS_SetModuleExport(ctx, m, "default", defaultObj);
 
   return 0;
@@ -910,6 +3719,8 @@ JS_INIT_MODULE(JSContext* ctx, const char* module_name) {
 
   if((m = JS_NewCModule(ctx, module_name, js_xml_init))) {
     JS_AddModuleExportList(ctx, m, js_xml_funcs, countof(js_xml_funcs));
+    JS_AddModuleExport(ctx, m, "XMLParser");
+    JS_AddModuleExport(ctx, m, "Selector");
     JS_AddModuleExport(ctx, m, "default");
   }
 
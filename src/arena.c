@@ -0,0 +1,140 @@
+#include "arena.h"
+#include "defines.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * \addtogroup arena
+ * @{
+ */
+
+/* each allocation is preceded by its capacity */
+#define ARENA_ALIGN(n) (((n) + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1))
+#define ARENA_HEADER(ptr) (((size_t*)(ptr)) - 1)
+
+/* released blocks bigger than this go back to libc */
+#define ARENA_SPARE_MAX (ARENA_BLOCK_SIZE * 16)
+
+static thread_local Arena js_arena_tls;
+
+/**
+ * Returns the scratch arena for native calls in \p ctx. All contexts of
+ * a thread share one, their calls cannot interleave.
+ */
+Arena*
+js_arena(JSContext* ctx) {
+  return &js_arena_tls;
+}
+
+static ArenaBlock*
+arena_block(Arena* a, size_t need) {
+  ArenaBlock* b;
+
+  if(a->spare && a->spare->size >= need) {
+    b = a->spare;
+    a->spare = 0;
+  } else {
+    size_t size = need > ARENA_BLOCK_SIZE ? need : ARENA_BLOCK_SIZE;
+
+    if(!(b = malloc(sizeof(ArenaBlock) + size)))
+      return 0;
+
+    b->size = size;
+  }
+
+  b->used = 0;
+  b->prev = a->block;
+  a->block = b;
+  return b;
+}
+
+void*
+arena_alloc(Arena* a, size_t size) {
+  size_t* hdr;
+  size_t cap = ARENA_ALIGN(size), need = sizeof(size_t) + cap;
+  ArenaBlock* b = a->block;
+
+  if(!b || b->size - b->used < need)
+    if(!(b = arena_block(a, need)))
+      return 0;
+
+  hdr = (size_t*)(b->data + b->used);
+  *hdr = cap;
+  b->used += need;
+  return hdr + 1;
+}
+
+/**
+ * DynBufReallocFunc for arena buffers: the newest allocation grows and
+ * shrinks in place, older ones are copied. Freeing only reclaims the
+ * newest allocation, the rest is reclaimed by arena_release().
+ */
+void*
+arena_realloc(Arena* a, void* ptr, size_t size) {
+  ArenaBlock* b = a->block;
+  size_t *hdr, cap;
+  BOOL top;
+  void* ret;
+
+  if(!ptr)
+    return size ? arena_alloc(a, size) : 0;
+
+  hdr = ARENA_HEADER(ptr);
+  top = b && (char*)ptr + *hdr == b->data + b->used;
+
+  if(size == 0) {
+    if(top)
+      b->used -= sizeof(size_t) + *hdr;
+
+    return 0;
+  }
+
+  if(size <= *hdr)
+    return ptr;
+
+  cap = ARENA_ALIGN(size);
+
+  if(top && (size_t)((char*)ptr - b->data) + cap <= b->size) {
+    b->used += cap - *hdr;
+    *hdr = cap;
+    return ptr;
+  }
+
+  if((ret = arena_alloc(a, size)))
+    memcpy(ret, ptr, *hdr);
+
+  return ret;
+}
+
+/**
+ * Frees everything allocated since \p mark was taken
+ */
+void
+arena_release(Arena* a, ArenaMark mark) {
+  ArenaBlock* b;
+
+  while((b = a->block) && b != mark.block) {
+    a->block = b->prev;
+
+    if(b->size <= ARENA_SPARE_MAX && (!a->spare || b->size > a->spare->size)) {
+      free(a->spare);
+      a->spare = b;
+    } else {
+      free(b);
+    }
+  }
+
+  if(a->block)
+    a->block->used = mark.used;
+}
+
+void
+arena_free(Arena* a) {
+  arena_release(a, (ArenaMark){0, 0});
+  free(a->spare);
+  a->spare = 0;
+}
+
+/**
+ * @}
+ */
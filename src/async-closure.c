@@ -1,5 +1,17 @@
 #include "async-closure.h"
+#include "defines.h"
 #include <assert.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#define ASYNC_REGISTRY_EPOLL 1
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) || defined(__DragonFly__)
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#define ASYNC_REGISTRY_KQUEUE 1
+#endif
 
 /**
  * \addtogroup async-closure
@@ -24,6 +36,190 @@ asyncclosure_lookup(int fd) {
   return NULL;
 }
 
+#if defined(ASYNC_REGISTRY_EPOLL) || defined(ASYNC_REGISTRY_KQUEUE)
+#define ASYNC_REGISTRY_EVENTS 256
+
+/**
+ * epoll/kqueue fd watching the fds of all native closures of one runtime,
+ * itself watched by os.setReadHandler() while count > 0
+ */
+typedef struct {
+  int fd;
+  uint32_t count;
+  JSRuntime* rt;
+} AsyncRegistry;
+
+static thread_local AsyncRegistry asyncclosure_registry = {-1, 0, 0};
+
+static JSValue asyncregistry_dispatch(JSContext*, JSValueConst, int, JSValueConst[], int, void*);
+
+static BOOL
+asyncregistry_handler(JSContext* ctx, AsyncRegistry* reg, BOOL on) {
+  JSValue set_handler = js_iohandler_fn(ctx, FALSE);
+  BOOL ret = js_iohandler_set(ctx, set_handler, reg->fd, on ? js_function_cclosure(ctx, asyncregistry_dispatch, 0, 0, reg, 0) : JS_NULL);
+
+  JS_FreeValue(ctx, set_handler);
+  return ret;
+}
+
+static int
+asyncregistry_ctl(AsyncRegistry* reg, AsyncClosure* ac, AsyncEvent old_state, AsyncEvent new_state) {
+#if defined(ASYNC_REGISTRY_EPOLL)
+  struct epoll_event ev = {
+      .events = ((new_state & WANT_READ) ? EPOLLIN : 0) | ((new_state & WANT_WRITE) ? EPOLLOUT : 0),
+      .data.ptr = ac,
+  };
+
+  return epoll_ctl(reg->fd, !new_state ? EPOLL_CTL_DEL : old_state ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, ac->fd, &ev);
+#else
+  struct kevent ev[2];
+  int n = 0;
+
+  if((old_state ^ new_state) & WANT_READ)
+    EV_SET(&ev[n++], ac->fd, EVFILT_READ, (new_state & WANT_READ) ? EV_ADD : EV_DELETE, 0, 0, ac);
+
+  if((old_state ^ new_state) & WANT_WRITE)
+    EV_SET(&ev[n++], ac->fd, EVFILT_WRITE, (new_state & WANT_WRITE) ? EV_ADD : EV_DELETE, 0, 0, ac);
+
+  return kevent(reg->fd, ev, n, 0, 0, 0);
+#endif
+}
+
+/**
+ * Moves \p ac to \p new_state in the registry
+ *
+ * @return  FALSE when the registry can't be used, the caller falls back
+ *          to the os module's handlers
+ */
+static BOOL
+asyncregistry_change(AsyncClosure* ac, AsyncEvent new_state) {
+  AsyncRegistry* reg = &asyncclosure_registry;
+  JSContext* ctx = ac->ctx;
+  AsyncEvent old_state = ac->native ? ac->state : WANT_NONE;
+
+  if(!ac->native) {
+    if(!new_state || ac->state)
+      return FALSE;
+
+    if(reg->count && reg->rt != JS_GetRuntime(ctx))
+      return FALSE;
+
+    if(reg->fd == -1) {
+#if defined(ASYNC_REGISTRY_EPOLL)
+      reg->fd = epoll_create1(EPOLL_CLOEXEC);
+#else
+      reg->fd = kqueue();
+#endif
+      if(reg->fd == -1)
+        return FALSE;
+    }
+  }
+
+  if(asyncregistry_ctl(reg, ac, old_state, new_state) == -1 && new_state) {
+    /* the fd is gone or can't be watched, e.g. a regular file */
+    if(!old_state) {
+      if(reg->count == 0) {
+        close(reg->fd);
+        reg->fd = -1;
+      }
+
+      return FALSE;
+    }
+
+    promise_reject(ctx, &ac->promise.funcs, JS_NewError(ctx));
+  }
+
+  ac->state = new_state;
+
+  if(!old_state) {
+    ac->native = TRUE;
+    asyncclosure_dup(ac);
+
+    if(reg->count++ == 0) {
+      reg->rt = JS_GetRuntime(ctx);
+
+      if(!asyncregistry_handler(ctx, reg, TRUE))
+        promise_reject(ctx, &ac->promise.funcs, JS_GetException(ctx));
+    }
+  } else if(!new_state) {
+    ac->native = FALSE;
+
+    if(--reg->count == 0) {
+      if(!asyncregistry_handler(ctx, reg, FALSE))
+        promise_reject(ctx, &ac->promise.funcs, JS_GetException(ctx));
+
+      close(reg->fd);
+      reg->fd = -1;
+      reg->rt = 0;
+    }
+
+    asyncclosure_free(ac);
+  }
+
+  return TRUE;
+}
+
+/**
+ * Read handler of the registry fd: collects every closure that became
+ * ready and resumes them one after another
+ */
+static JSValue
+asyncregistry_dispatch(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* opaque) {
+  AsyncRegistry* reg = opaque;
+  AsyncClosure* ready[ASYNC_REGISTRY_EVENTS];
+  int i, j, n;
+#if defined(ASYNC_REGISTRY_EPOLL)
+  struct epoll_event events[ASYNC_REGISTRY_EVENTS];
+
+  if((n = epoll_wait(reg->fd, events, ASYNC_REGISTRY_EVENTS, 0)) <= 0)
+    return JS_UNDEFINED;
+
+  for(i = 0; i < n; i++)
+    ready[i] = asyncclosure_dup(events[i].data.ptr);
+#else
+  struct kevent events[ASYNC_REGISTRY_EVENTS];
+  struct timespec ts = {0, 0};
+  int k;
+
+  if((k = kevent(reg->fd, 0, 0, events, ASYNC_REGISTRY_EVENTS, &ts)) <= 0)
+    return JS_UNDEFINED;
+
+  /* read and write filters of one closure arrive as separate events */
+  for(i = 0, n = 0; i < k; i++) {
+    for(j = 0; j < n; j++)
+      if(ready[j] == events[i].udata)
+        break;
+
+    if(j == n)
+      ready[n++] = asyncclosure_dup(events[i].udata);
+  }
+#endif
+
+  for(i = 0; i < n; i++) {
+    AsyncClosure* ac = ready[i];
+    JSValue ret = JS_UNDEFINED;
+
+    /* an earlier closure of this pass may have finished this one */
+    if(ac->native && ac->state)
+      ret = ac->ccfunc(ac->ctx, JS_UNDEFINED, 0, 0, ac->state, ac);
+
+    asyncclosure_free(ac);
+
+    if(JS_IsException(ret)) {
+      /* the others are level-triggered and come again */
+      for(j = i + 1; j < n; j++)
+        asyncclosure_free(ready[j]);
+
+      return ret;
+    }
+
+    JS_FreeValue(ctx, ret);
+  }
+
+  return JS_UNDEFINED;
+}
+#endif
+
 static JSValue
 asyncclosure_function(AsyncClosure* ac, CClosureFunc* func, int magic) {
   return js_function_cclosure(ac->ctx, func, 0, magic, asyncclosure_dup(ac), asyncclosure_free);
@@ -44,6 +240,7 @@ asyncclosure_new(JSContext* ctx, int fd, AsyncEvent state, JSValueConst this_val
   ac->ref_count = 1;
   ac->fd = fd;
   ac->state = 0;
+  ac->native = FALSE;
   ac->ccfunc = func;
   ac->ctx = ctx;
   ac->result = JS_DupValue(ctx, this_val);
@@ -140,6 +337,11 @@ asyncclosure_change_event(AsyncClosure* ac, AsyncEvent new_state) {
   if(ac->state != new_state) {
     JSContext* ctx = ac->ctx;
 
+#if defined(ASYNC_REGISTRY_EPOLL) || defined(ASYNC_REGISTRY_KQUEUE)
+    if(asyncregistry_change(ac, new_state))
+      return TRUE;
+#endif
+
     /* Had a previous handler? */
     if(ac->state) {
       if(!js_iohandler_set(ctx, ac->set_handler, ac->fd, JS_NULL))
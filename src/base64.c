@@ -2,6 +2,11 @@
 /* SPDX-License-Identifier: Apache-2.0 */
 
 #include "base64.h"
+#if defined(__SSSE3__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 /**
  * \addtogroup base64
@@ -9,6 +14,10 @@
  */
 static void encode(const char* map, const uint8_t* in, size_t len, uint8_t* out);
 static size_t decode(const int8_t* map, const uint8_t* in, size_t len, uint8_t* out);
+static size_t decode_blocks(const int8_t* map, const uint8_t* in, size_t len, uint8_t* out, size_t* pos);
+
+static const char b64_map[65] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/=";
+static const char b64url_map[65] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_\0";
 
 size_t
 b64_get_encoded_buffer_size(const size_t decoded_size) {
@@ -59,23 +68,17 @@ b64url_get_decoded_buffer_size(const size_t encoded_size) {
 
 void
 b64_encode(const uint8_t* raw, const size_t len, uint8_t* out) {
-  static const char map[65] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/=";
-
-  encode(map, raw, len, out);
+  encode(b64_map, raw, len, out);
 }
 
 void
 b64url_encode(const uint8_t* raw, const size_t len, uint8_t* out) {
-  static const char map[65] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_\0";
-
-  encode(map, raw, len, out);
+  encode(b64url_map, raw, len, out);
 }
 
-size_t
-b64_decode(const uint8_t* enc, const size_t len, uint8_t* out) {
-  // -1 = invalid
-  // -2 = padding
-  static const int8_t map[256] = {
+// -1 = invalid
+// -2 = padding
+static const int8_t b64_decode_map[256] = {
       -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* 0x00-0x0f */
       -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* 0x10-0x1f */
       -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63, /* 0x20-0x2f */
@@ -92,21 +95,9 @@ b64_decode(const uint8_t* enc, const size_t len, uint8_t* out) {
       -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* 0xd0-0xdf */
       -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* 0xe0-0xef */
       -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* 0xf0-0xff */
-  };
-  size_t max = b64_get_decoded_buffer_size(len);
-
-  if((0 == max) || !enc || !out) {
-    return 0;
-  }
+};
 
-  return decode(map, enc, len, out);
-}
-
-size_t
-b64url_decode(const uint8_t* enc, const size_t len, uint8_t* out) {
-  // -1 = invalid
-  // -2 = padding
-  static const int8_t map[256] = {
+static const int8_t b64url_decode_map[256] = {
       -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* 0x00-0x0f */
       -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* 0x10-0x1f */
       -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, /* 0x20-0x2f */
@@ -123,41 +114,176 @@ b64url_decode(const uint8_t* enc, const size_t len, uint8_t* out) {
       -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* 0xd0-0xdf */
       -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* 0xe0-0xef */
       -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* 0xf0-0xff */
-  };
+};
+
+size_t
+b64_decode(const uint8_t* enc, const size_t len, uint8_t* out) {
+  size_t max = b64_get_decoded_buffer_size(len);
+
+  if((0 == max) || !enc || !out) {
+    return 0;
+  }
+
+  return decode(b64_decode_map, enc, len, out);
+}
+
+size_t
+b64url_decode(const uint8_t* enc, const size_t len, uint8_t* out) {
   size_t max = b64url_get_decoded_buffer_size(len);
 
   if((0 == max) || !enc || !out) {
     return 0;
   }
 
-  return decode(map, enc, len, out);
+  return decode(b64url_decode_map, enc, len, out);
+}
+
+/**
+ * Decodes the complete groups of 4 characters at the start of enc, for
+ * streaming input. Stops before the first group that holds padding or is
+ * incomplete, which the caller decodes with b64_decode() at the end.
+ *
+ * @param  pos  receives the number of characters consumed
+ * @return      number of bytes written, or -1 if a group holds an invalid
+ *              character (*pos is then its offset)
+ */
+ssize_t
+b64_decode_partial(const uint8_t* enc, size_t len, uint8_t* out, int url, size_t* pos) {
+  const int8_t* map = url ? b64url_decode_map : b64_decode_map;
+  size_t n = decode_blocks(map, enc, len, out, pos);
+
+  if(len - *pos >= 4) {
+    size_t i;
+
+    /* a group with padding is only valid at the end */
+    for(i = *pos; i < *pos + 4; i++)
+      if(map[enc[i]] == -1 || (map[enc[i]] == -2 && len - *pos > 4))
+        return -1;
+  }
+
+  return n;
 }
 
 /*----------------------------------------------------------------------------*/
 /*                             Internal functions                             */
 /*----------------------------------------------------------------------------*/
+#if defined(__SSSE3__)
+/* 12 bytes -> 16 indices -> 16 characters, see Wojciech Muła's base64 notes */
+static inline __m128i
+encode_block(__m128i in, __m128i shift_lut) {
+  __m128i t0, t1, t2, t3, indices, result;
+
+  in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+  t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+  t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+  t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+  t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+  indices = _mm_or_si128(t1, t3);
+
+  /* 0..25 -> 13, 26..51 -> 0, 52..63 -> 1..12 selects the offset to add */
+  result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+  result = _mm_or_si128(result, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+
+  return _mm_add_epi8(_mm_shuffle_epi8(shift_lut, result), indices);
+}
+
+static inline __m128i
+decode_range(__m128i c, char lo, char hi) {
+  return _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(lo - 1)), _mm_cmpgt_epi8(_mm_set1_epi8(hi + 1), c));
+}
+
+/* 16 characters -> 12 bytes, FALSE if any of them is not in the alphabet */
+static inline int
+decode_block(__m128i c, char c62, char c63, __m128i* out) {
+  __m128i upper = decode_range(c, 'A', 'Z'), lower = decode_range(c, 'a', 'z'), digit = decode_range(c, '0', '9');
+  __m128i m62 = _mm_cmpeq_epi8(c, _mm_set1_epi8(c62)), m63 = _mm_cmpeq_epi8(c, _mm_set1_epi8(c63));
+  __m128i values, valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, _mm_or_si128(m62, m63)));
+
+  if(_mm_movemask_epi8(valid) != 0xffff)
+    return 0;
+
+  values = _mm_or_si128(_mm_and_si128(upper, _mm_sub_epi8(c, _mm_set1_epi8('A'))), _mm_and_si128(lower, _mm_sub_epi8(c, _mm_set1_epi8('a' - 26))));
+  values = _mm_or_si128(values, _mm_and_si128(digit, _mm_add_epi8(c, _mm_set1_epi8(52 - '0'))));
+  values = _mm_or_si128(values, _mm_or_si128(_mm_and_si128(m62, _mm_set1_epi8(62)), _mm_and_si128(m63, _mm_set1_epi8(63))));
+
+  values = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+  values = _mm_madd_epi16(values, _mm_set1_epi32(0x00011000));
+  *out = _mm_shuffle_epi8(values, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+  return 1;
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+static inline uint8x16_t
+encode_lookup(uint8x16_t idx, uint8x16x4_t table) {
+  return vqtbl4q_u8(table, idx);
+}
+
+static inline uint8x16_t
+decode_range(uint8x16_t c, uint8_t lo, uint8_t hi) {
+  return vandq_u8(vcgeq_u8(c, vdupq_n_u8(lo)), vcleq_u8(c, vdupq_n_u8(hi)));
+}
+
+static inline uint8x16_t
+decode_lane(uint8x16_t c, uint8_t c62, uint8_t c63, uint8x16_t* valid) {
+  uint8x16_t upper = decode_range(c, 'A', 'Z'), lower = decode_range(c, 'a', 'z'), digit = decode_range(c, '0', '9');
+  uint8x16_t m62 = vceqq_u8(c, vdupq_n_u8(c62)), m63 = vceqq_u8(c, vdupq_n_u8(c63));
+  uint8x16_t v = vandq_u8(upper, vsubq_u8(c, vdupq_n_u8('A')));
+
+  v = vorrq_u8(v, vandq_u8(lower, vsubq_u8(c, vdupq_n_u8('a' - 26))));
+  v = vorrq_u8(v, vandq_u8(digit, vaddq_u8(c, vdupq_n_u8(52 - '0'))));
+  v = vorrq_u8(v, vorrq_u8(vandq_u8(m62, vdupq_n_u8(62)), vandq_u8(m63, vdupq_n_u8(63))));
+
+  *valid = vandq_u8(*valid, vorrq_u8(vorrq_u8(upper, lower), vorrq_u8(digit, vorrq_u8(m62, m63))));
+  return v;
+}
+#endif
+
 static void
 encode(const char* map, const uint8_t* in, size_t len, uint8_t* out) {
-  uint32_t bits = 0;
-  int bit_count = 0;
-  size_t j = 0;
+  size_t i = 0, j = 0;
 
-  for(size_t i = 0; i < len; i++) {
-    bits = (bits << 8) | in[i];
-    bit_count += 8;
+#if defined(__SSSE3__)
+  {
+    __m128i shift_lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, map[62] - 62, map[63] - 63, 'A', 0, 0);
 
-    while(6 <= bit_count) {
-      bit_count -= 6;
-      out[j++] = (uint8_t)map[0x3f & (bits >> bit_count)];
+    /* loads 16 bytes of which 12 are used */
+    for(; i + 16 <= len; i += 12, j += 16)
+      _mm_storeu_si128((__m128i*)(out + j), encode_block(_mm_loadu_si128((const __m128i*)(in + i)), shift_lut));
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  {
+    uint8x16x4_t table = vld1q_u8_x4((const uint8_t*)map);
+
+    for(; i + 48 <= len; i += 48, j += 64) {
+      uint8x16x3_t b = vld3q_u8(in + i);
+      uint8x16x4_t c;
+
+      c.val[0] = encode_lookup(vshrq_n_u8(b.val[0], 2), table);
+      c.val[1] = encode_lookup(vandq_u8(vorrq_u8(vshlq_n_u8(b.val[0], 4), vshrq_n_u8(b.val[1], 4)), vdupq_n_u8(0x3f)), table);
+      c.val[2] = encode_lookup(vandq_u8(vorrq_u8(vshlq_n_u8(b.val[1], 2), vshrq_n_u8(b.val[2], 6)), vdupq_n_u8(0x3f)), table);
+      c.val[3] = encode_lookup(vandq_u8(b.val[2], vdupq_n_u8(0x3f)), table);
+      vst4q_u8(out + j, c);
     }
   }
+#endif
+
+  for(; i + 3 <= len; i += 3, j += 4) {
+    uint32_t n = (uint32_t)in[i] << 16 | (uint32_t)in[i + 1] << 8 | in[i + 2];
+
+    out[j] = map[n >> 18];
+    out[j + 1] = map[(n >> 12) & 0x3f];
+    out[j + 2] = map[(n >> 6) & 0x3f];
+    out[j + 3] = map[n & 0x3f];
+  }
 
   /* Handle the extra bits. */
-  if(bit_count) {
-    bits <<= 8;
-    bit_count += 8;
-    bit_count -= 6;
-    out[j++] = (uint8_t)map[0x3f & (bits >> bit_count)];
+  if(i < len) {
+    uint32_t n = (uint32_t)in[i] << 16 | (i + 1 < len ? (uint32_t)in[i + 1] << 8 : 0);
+
+    out[j++] = map[n >> 18];
+    out[j++] = map[(n >> 12) & 0x3f];
+
+    if(i + 1 < len)
+      out[j++] = map[(n >> 6) & 0x3f];
   }
 
   /* Pad */
@@ -166,44 +292,94 @@ encode(const char* map, const uint8_t* in, size_t len, uint8_t* out) {
   }
 }
 
+/**
+ * Decodes groups of 4 characters up to the first one that is incomplete or
+ * holds a character outside the alphabet (padding included).
+ */
+static size_t
+decode_blocks(const int8_t* map, const uint8_t* in, size_t len, uint8_t* out, size_t* pos) {
+  size_t i = 0, j = 0;
+
+#if defined(__SSSE3__)
+  {
+    char c62 = map == b64url_decode_map ? '-' : '+', c63 = map == b64url_decode_map ? '_' : '/';
+    __m128i block;
+
+    /* stores 16 bytes of which 12 are used, the remaining input guarantees the room */
+    for(; i + 24 <= len && decode_block(_mm_loadu_si128((const __m128i*)(in + i)), c62, c63, &block); i += 16, j += 12)
+      _mm_storeu_si128((__m128i*)(out + j), block);
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  uint8_t c62 = map == b64url_decode_map ? '-' : '+', c63 = map == b64url_decode_map ? '_' : '/';
+
+  for(; i + 64 <= len; i += 64, j += 48) {
+    uint8x16x4_t c = vld4q_u8(in + i);
+    uint8x16x3_t b;
+    uint8x16_t a0, a1, a2, a3, valid = vdupq_n_u8(0xff);
+
+    a0 = decode_lane(c.val[0], c62, c63, &valid);
+    a1 = decode_lane(c.val[1], c62, c63, &valid);
+    a2 = decode_lane(c.val[2], c62, c63, &valid);
+    a3 = decode_lane(c.val[3], c62, c63, &valid);
+
+    if(vminvq_u8(valid) != 0xff)
+      break;
+
+    b.val[0] = vorrq_u8(vshlq_n_u8(a0, 2), vshrq_n_u8(a1, 4));
+    b.val[1] = vorrq_u8(vshlq_n_u8(a1, 4), vshrq_n_u8(a2, 2));
+    b.val[2] = vorrq_u8(vshlq_n_u8(a2, 6), a3);
+    vst3q_u8(out + j, b);
+  }
+#endif
+
+  for(; i + 4 <= len; i += 4, j += 3) {
+    int8_t a = map[in[i]], b = map[in[i + 1]], c = map[in[i + 2]], d = map[in[i + 3]];
+    uint32_t n;
+
+    if((a | b | c | d) < 0)
+      break;
+
+    n = (uint32_t)a << 18 | (uint32_t)b << 12 | (uint32_t)c << 6 | d;
+    out[j] = n >> 16;
+    out[j + 1] = n >> 8;
+    out[j + 2] = n;
+  }
+
+  *pos = i;
+  return j;
+}
+
 static size_t
 decode(const int8_t* map, const uint8_t* in, size_t len, uint8_t* out) {
+  size_t i, j, k = 0, padding = 0;
+  uint32_t n = 0;
+
+  j = decode_blocks(map, in, len, out, &i);
 
-  uint32_t bits = 0;
-  int bit_count = 0;
-  size_t padding = 0;
-  size_t j = 0;
+  /* the last group, with padding or unpadded */
+  for(; i < len; i++) {
+    int8_t val = map[in[i]];
 
-  if('=' == in[len - 1]) {
-    padding++;
-    if('=' == in[len - 2]) {
+    if(val == -2) {
       padding++;
+      continue;
     }
 
-    /* If there is padding then it should only pad to ensure the string
-     * has a multiple of 4.  Anything else is an error. */
-    if(0 != (0x03 & len)) {
+    if(val < 0 || padding || k == 4)
       return 0;
-    }
-  }
 
-  len -= padding;
+    n = (n << 6) | val;
+    k++;
+  }
 
-  for(size_t i = 0; i < len; i++) {
-    int8_t val;
+  if(k == 1 || (padding && k + padding != 4))
+    return 0;
 
-    val = map[in[i]];
-    if(val < 0) {
-      return 0;
-    }
-    bits = (bits << 6) | val;
-    bit_count += 6;
+  if(k >= 2)
+    out[j++] = (n << (6 * (4 - k))) >> 16;
 
-    if(8 <= bit_count) {
-      out[j++] = (uint8_t)(0x0ff & (bits >> (bit_count - 8)));
-      bit_count -= 8;
-    }
-  }
+  if(k >= 3)
+    out[j++] = (n << 6) >> 8;
 
   return j;
 }
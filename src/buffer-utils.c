@@ -2,6 +2,7 @@
 #include "char-utils.h"
 #include "buffer-utils.h"
 #include "utils.h"
+#include "vector.h"
 #ifdef _WIN32
 #include <windows.h>
 #elif defined(HAVE_TERMIOS_H)
@@ -515,6 +516,54 @@ dbuf_tostring_free(DynBuf* s, JSContext* ctx) {
   return r;
 }
 
+static void
+dbuf_arraybuffer_free_js(JSRuntime* rt, void* opaque, void* ptr) {
+  js_free_rt(rt, ptr);
+}
+
+static void
+dbuf_arraybuffer_free_libc(JSRuntime* rt, void* opaque, void* ptr) {
+  free(ptr);
+}
+
+/**
+ * Turns the contents of \p s into an ArrayBuffer and frees \p s. Buffers
+ * from the JS or libc allocators are handed over, others (arena, inline
+ * storage) are copied.
+ */
+JSValue
+dbuf_steal_arraybuffer(DynBuf* s, JSContext* ctx) {
+  JSFreeArrayBufferDataFunc* free_func = 0;
+  DynBufReallocFunc* fn = s->realloc_func;
+  uint8_t* buf;
+  size_t len;
+  JSValue ret;
+
+  if(s->error) {
+    dbuf_free(s);
+    return JS_ThrowOutOfMemory(ctx);
+  }
+
+  if(fn == (DynBufReallocFunc*)&utils_js_realloc || fn == (DynBufReallocFunc*)&vector_js_realloc || fn == (DynBufReallocFunc*)&utils_js_realloc_rt ||
+     fn == (DynBufReallocFunc*)&vector_js_realloc_rt
+#ifndef js_realloc_rt
+     || fn == (DynBufReallocFunc*)&js_realloc_rt
+#endif
+  )
+    free_func = dbuf_arraybuffer_free_js;
+  else if(fn == (DynBufReallocFunc*)&vector_realloc)
+    free_func = dbuf_arraybuffer_free_libc;
+
+  if(!free_func || !s->buf) {
+    ret = JS_NewArrayBufferCopy(ctx, s->buf, s->size);
+    dbuf_free(s);
+    return ret;
+  }
+
+  buf = dbuf_steal(s, &len);
+  return JS_NewArrayBuffer(ctx, buf, len, free_func, 0, FALSE);
+}
+
 ssize_t
 dbuf_load(DynBuf* s, const char* filename) {
   FILE* fp;
@@ -547,13 +596,15 @@ InputBuffer
 js_input_buffer(JSContext* ctx, JSValueConst value) {
   InputBuffer ret = {{{0, 0}}, 0, &input_buffer_free_default, JS_UNDEFINED, {0, INT64_MAX}};
 
-  if(js_is_typedarray(ctx, value)) {
+  BuiltinTypeMask type = js_value_type_flags(ctx, value);
+
+  if(type & OBJECT_TYPEDARRAY) {
     ret.value = offset_typedarray(&ret.range, value, ctx);
-  } else if(js_is_arraybuffer(ctx, value) || js_is_sharedarraybuffer(ctx, value)) {
+  } else if(type & OBJECT_ANYBUFFER) {
     ret.value = JS_DupValue(ctx, value);
   }
 
-  if(js_is_arraybuffer(ctx, ret.value) || js_is_sharedarraybuffer(ctx, ret.value)) {
+  if(js_value_type_flags(ctx, ret.value) & OBJECT_ANYBUFFER) {
     block_arraybuffer(&ret.block, ret.value, ctx);
   } else {
     JS_ThrowTypeError(ctx, "Invalid type (%s) for input buffer", js_value_typestr(ctx, ret.value));
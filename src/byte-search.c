@@ -0,0 +1,198 @@
+#include "byte-search.h"
+#include <stdlib.h>
+#include <string.h>
+#include "simd.h"
+
+/**
+ * \addtogroup byte-search
+ * @{
+ */
+#ifdef SIMD_BLOCK
+static inline uint64_t
+search_mask(const uint8_t* p, const uint8_t* q, uint8_t first, uint8_t last) {
+  return simd_movemask(simd_and(simd_eq(simd_load(p), first), simd_eq(simd_load(q), last)));
+}
+#endif
+
+/**
+ * First occurrence of n in h, or NULL.
+ */
+const uint8_t*
+byte_search(const uint8_t* h, size_t hl, const uint8_t* n, size_t nl) {
+  size_t i = 0;
+
+  if(nl == 0)
+    return h;
+
+  if(nl > hl)
+    return 0;
+
+  if(nl == 1)
+    return memchr(h, n[0], hl);
+
+#ifdef SIMD_BLOCK
+  for(; i + nl - 1 + SIMD_BLOCK <= hl; i += SIMD_BLOCK) {
+    uint64_t m = search_mask(h + i, h + i + nl - 1, n[0], n[nl - 1]);
+
+    for(; m; m = simd_clear(m)) {
+      size_t k = i + simd_first(m);
+
+      if(!memcmp(h + k + 1, n + 1, nl - 2))
+        return h + k;
+    }
+  }
+#endif
+
+  for(; i + nl <= hl; i++)
+    if(h[i] == n[0] && h[i + nl - 1] == n[nl - 1] && !memcmp(h + i + 1, n + 1, nl - 2))
+      return h + i;
+
+  return 0;
+}
+
+void
+byte_matcher_free(ByteMatcher* bm) {
+  free(bm->next);
+  free(bm->match);
+  free(bm->suffix);
+  free(bm->chain);
+  free(bm->lengths);
+  memset(bm, 0, sizeof(ByteMatcher));
+}
+
+/**
+ * Builds the automaton. Every state gets a transition for every class, so
+ * the scan looks up one table entry per byte.
+ *
+ * @return  0 on success, -1 when out of memory
+ */
+int
+byte_matcher_init(ByteMatcher* bm, const uint8_t* const patterns[], const size_t lengths[], uint32_t count) {
+  size_t total = 1, i, j;
+  uint32_t c, s, head = 0, tail = 0, *queue = 0;
+  int32_t* fail = 0;
+
+  memset(bm, 0, sizeof(ByteMatcher));
+  bm->nclasses = 1;
+
+  for(i = 0; i < count; i++) {
+    total += lengths[i];
+
+    for(j = 0; j < lengths[i]; j++)
+      if(!bm->classes[patterns[i][j]])
+        bm->classes[patterns[i][j]] = bm->nclasses++;
+  }
+
+  if(total > INT32_MAX / bm->nclasses)
+    return -1;
+
+  bm->npatterns = count;
+  bm->nstates = 1;
+
+  if(!(bm->next = malloc(total * bm->nclasses * sizeof(int32_t))) || !(bm->match = malloc(total * sizeof(int32_t))) ||
+     !(bm->suffix = malloc(total * sizeof(int32_t))) || !(bm->chain = malloc((count + 1) * sizeof(int32_t))) ||
+     !(bm->lengths = malloc((count + 1) * sizeof(uint32_t))) || !(fail = malloc(total * sizeof(int32_t))) ||
+     !(queue = malloc(total * sizeof(uint32_t))))
+    goto fail;
+
+  memset(bm->next, 0xff, total * bm->nclasses * sizeof(int32_t));
+  memset(bm->match, 0xff, total * sizeof(int32_t));
+
+  /* trie */
+  for(i = 0; i < count; i++) {
+    int32_t* t;
+
+    for(s = 0, j = 0; j < lengths[i]; j++) {
+      t = &bm->next[s * bm->nclasses + bm->classes[patterns[i][j]]];
+
+      if(*t == -1)
+        *t = bm->nstates++;
+
+      s = *t;
+    }
+
+    bm->chain[i] = bm->match[s];
+    bm->match[s] = i;
+    bm->lengths[i] = lengths[i];
+  }
+
+  /* failure links in breadth-first order turn the trie into a DFA */
+  fail[0] = 0;
+  bm->suffix[0] = -1;
+
+  for(c = 0; c < bm->nclasses; c++) {
+    int32_t* t = &bm->next[c];
+
+    if(*t == -1) {
+      *t = 0;
+    } else {
+      fail[*t] = 0;
+      bm->suffix[*t] = -1;
+      queue[tail++] = *t;
+    }
+  }
+
+  while(head < tail) {
+    s = queue[head++];
+
+    for(c = 0; c < bm->nclasses; c++) {
+      int32_t *t = &bm->next[s * bm->nclasses + c], f = bm->next[fail[s] * bm->nclasses + c];
+
+      if(*t == -1) {
+        *t = f;
+      } else {
+        fail[*t] = f;
+        bm->suffix[*t] = bm->match[f] != -1 ? f : bm->suffix[f];
+        queue[tail++] = *t;
+      }
+    }
+  }
+
+  free(fail);
+  free(queue);
+  return 0;
+
+fail:
+  free(fail);
+  free(queue);
+  byte_matcher_free(bm);
+  return -1;
+}
+
+/**
+ * Appends the start offset (base + position, as uint64_t) and the id
+ * (as uint32_t) of every occurrence, including overlapping ones, in the
+ * order in which they end.
+ *
+ * @return  number of matches, or -1 when out of memory
+ */
+ssize_t
+byte_matcher_scan(const ByteMatcher* bm, const uint8_t* p, size_t n, uint64_t base, DynBuf* offsets, DynBuf* ids) {
+  const int32_t* next = bm->next;
+  size_t i, found = 0;
+  int32_t s = 0;
+
+  for(i = 0; i < n; i++) {
+    int32_t t, id;
+
+    s = next[s * bm->nclasses + bm->classes[p[i]]];
+
+    for(t = bm->match[s] != -1 ? s : bm->suffix[s]; t != -1; t = bm->suffix[t]) {
+      for(id = bm->match[t]; id != -1; id = bm->chain[id]) {
+        uint64_t offset = base + i + 1 - bm->lengths[id];
+        uint32_t u = id;
+
+        if(dbuf_put(offsets, (const uint8_t*)&offset, sizeof(offset)) || dbuf_put(ids, (const uint8_t*)&u, sizeof(u)))
+          return -1;
+
+        found++;
+      }
+    }
+  }
+
+  return found;
+}
+
+/**
+ * @}
+ */
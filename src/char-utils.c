@@ -1,5 +1,6 @@
 #include "char-utils.h"
 #include "libutf/include/libutf.h"
+#include "simd.h"
 #if defined(_WIN32) || defined(__CYGWIN__) || defined(__MSYS__)
 #include <winnls.h>
 #include <windows.h>
@@ -363,17 +364,177 @@ scan_eolskip(const char* s, size_t limit) {
   return n;
 }
 
+#ifdef SIMD_BLOCK
+#define UTF8_BLOCK SIMD_BLOCK
+#define UTF8_SHIFT SIMD_SHIFT
+/* bit i set when x[i] is not a continuation byte, i.e. starts a character */
+static inline uint64_t
+utf8_lead_mask(const uint8_t* x) {
+  return simd_movemask(simd_gt(simd_load(x), -65));
+}
+#else
+#define UTF8_BLOCK 8
+#define UTF8_SHIFT 0
+/* the low bit of each byte is set when it starts a character */
+static inline uint64_t
+utf8_lead_mask(const uint8_t* x) {
+  uint64_t w;
+
+  memcpy(&w, x, sizeof(w));
+  return ((~w >> 7) | (w >> 6)) & 0x0101010101010101ull;
+}
+#endif
+
+static inline BOOL
+utf8_lead(uint8_t c) {
+  return (c & 0xc0) != 0x80;
+}
+
+/**
+ * Number of characters in in: every byte but the continuation bytes
+ * counts, so a malformed sequence counts as one character per lead byte.
+ */
 size_t
 utf8_strlen(const void* in, size_t len) {
-  const uint8_t *pos, *end, *next;
+  const uint8_t* x = in;
+  size_t i = 0, count = 0;
+
+  for(; i + UTF8_BLOCK <= len; i += UTF8_BLOCK)
+    count += __builtin_popcountll(utf8_lead_mask(x + i)) >> UTF8_SHIFT;
+
+  for(; i < len; i++)
+    count += utf8_lead(x[i]);
+
+  return count;
+}
+
+/**
+ * Byte offset of character \p chars in in, len when in is shorter
+ */
+size_t
+utf8_byte_offset(const void* in, size_t len, size_t chars) {
+  const uint8_t* x = in;
   size_t i = 0;
 
-  for(pos = (const uint8_t*)in, end = pos + len; pos < end; pos = next, ++i)
-    unicode_from_utf8(pos, end - pos, &next);
+  for(; i + UTF8_BLOCK <= len; i += UTF8_BLOCK) {
+    size_t n = __builtin_popcountll(utf8_lead_mask(x + i)) >> UTF8_SHIFT;
+
+    if(n > chars)
+      break;
+
+    chars -= n;
+  }
+
+  for(; i < len; i++)
+    if(utf8_lead(x[i]) && chars-- == 0)
+      break;
 
   return i;
 }
 
+/**
+ * Records the character count at every UTF8_INDEX_STRIDE bytes of data,
+ * as far as a lookup needs it. A conversion then scans at most one
+ * stride.
+ */
+static BOOL
+utf8_index_extend(Utf8Index* idx, size_t marks) {
+  uint64_t* v = (uint64_t*)idx->marks.buf;
+  size_t n = idx->marks.size / sizeof(uint64_t), last = (idx->len + UTF8_INDEX_STRIDE - 1) / UTF8_INDEX_STRIDE;
+
+  if(marks > last + 1)
+    marks = last + 1;
+
+  if(n == 0) {
+    uint64_t zero = 0;
+
+    if(dbuf_put(&idx->marks, (const uint8_t*)&zero, sizeof(zero)))
+      return FALSE;
+
+    n = 1;
+  }
+
+  for(; n < marks; n++) {
+    size_t from = (n - 1) * UTF8_INDEX_STRIDE, to = MIN_NUM(from + UTF8_INDEX_STRIDE, idx->len);
+    uint64_t count;
+
+    v = (uint64_t*)idx->marks.buf;
+    count = v[n - 1] + utf8_strlen(idx->data + from, to - from);
+
+    if(dbuf_put(&idx->marks, (const uint8_t*)&count, sizeof(count)))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+void
+utf8_index_init(Utf8Index* idx, const void* data, size_t len) {
+  idx->data = data;
+  idx->len = len;
+  dbuf_init(&idx->marks);
+}
+
+void
+utf8_index_free(Utf8Index* idx) {
+  dbuf_free(&idx->marks);
+}
+
+/**
+ * Character offset of byte \p pos
+ */
+size_t
+utf8_index_chars(Utf8Index* idx, size_t pos) {
+  size_t mark;
+
+  if(pos > idx->len)
+    pos = idx->len;
+
+  mark = pos / UTF8_INDEX_STRIDE;
+
+  if(!utf8_index_extend(idx, mark + 1))
+    return utf8_strlen(idx->data, pos);
+
+  return ((uint64_t*)idx->marks.buf)[mark] + utf8_strlen(idx->data + mark * UTF8_INDEX_STRIDE, pos - mark * UTF8_INDEX_STRIDE);
+}
+
+/**
+ * Byte offset of character \p chars
+ */
+size_t
+utf8_index_bytes(Utf8Index* idx, size_t chars) {
+  const uint64_t* v;
+  size_t lo = 0, hi, n;
+
+  /* extend until the last mark passes chars or the data ends */
+  for(;;) {
+    n = idx->marks.size / sizeof(uint64_t);
+
+    if(n && (((uint64_t*)idx->marks.buf)[n - 1] > chars || (n - 1) * UTF8_INDEX_STRIDE >= idx->len))
+      break;
+
+    if(!utf8_index_extend(idx, n ? n * 2 : 16))
+      return utf8_byte_offset(idx->data, idx->len, chars);
+  }
+
+  v = (const uint64_t*)idx->marks.buf;
+  hi = n - 1;
+
+  /* last mark with a count <= chars */
+  while(lo < hi) {
+    size_t mid = (lo + hi + 1) / 2;
+
+    if(v[mid] <= chars)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+
+  lo = MIN_NUM(lo * UTF8_INDEX_STRIDE, idx->len);
+
+  return lo + utf8_byte_offset(idx->data + lo, idx->len - lo, chars - v[lo / UTF8_INDEX_STRIDE]);
+}
+
 #if defined(_WIN32) || defined(__CYGWIN__) || defined(__MSYS__)
 wchar_t*
 utf8_towcs(const char* s) {
@@ -412,6 +573,294 @@ utf16_multiword(const void* in) {
   return !((LIBUTF_UTF16_NOT_SURROGATE == type) || (LIBUTF_UTF16_SURROGATE_HIGH != type || LIBUTF_UTF16_SURROGATE_LOW != libutf_c16_type(p16[1])));
 }
 
+/* the 8 bytes at x have none of the bits in the byte pattern m */
+static inline BOOL
+utf_clear64(const uint8_t* x, const uint8_t m[8]) {
+  uint64_t w, mask;
+
+  memcpy(&w, x, sizeof(w));
+  memcpy(&mask, m, sizeof(mask));
+  return !(w & mask);
+}
+
+static inline uint32_t
+utf16_unit(const uint8_t* x, BOOL big) {
+  return big ? (x[0] << 8) | x[1] : x[0] | (x[1] << 8);
+}
+
+static inline uint32_t
+utf32_unit(const uint8_t* x, BOOL big) {
+  return big ? ((uint32_t)x[0] << 24) | (x[1] << 16) | (x[2] << 8) | x[3] : x[0] | (x[1] << 8) | (x[2] << 16) | ((uint32_t)x[3] << 24);
+}
+
+static inline uint8_t*
+utf16_put(uint8_t* y, uint32_t u, BOOL big) {
+  y[big] = u & 0xff;
+  y[!big] = u >> 8;
+  return y + 2;
+}
+
+static inline uint8_t*
+utf32_put(uint8_t* y, uint32_t c, BOOL big) {
+  for(int i = 0; i < 4; i++, c >>= 8)
+    y[big ? 3 - i : i] = c & 0xff;
+
+  return y + 4;
+}
+
+static inline BOOL
+utf_scalar(uint32_t c) {
+  return c <= 0x10ffff && (c < 0xd800 || c >= 0xe000);
+}
+
+#ifdef SIMD_BLOCK
+/* mask of the bytes above the low byte (at low) of each code unit */
+static inline uint64_t
+utf_unit_zero(int unit, int low) {
+  uint64_t m = 0;
+
+  for(int i = 0; i < SIMD_BLOCK; i++)
+    if(i % unit != low)
+      m |= simd_byte(i);
+
+  return m;
+}
+
+/* the UTF-16 or UTF-32 code units in the SIMD_BLOCK bytes at x are ASCII */
+static inline BOOL
+utf_units_ascii(const uint8_t* x, uint64_t zero) {
+  simd_vec v = simd_load(x);
+
+  return simd_movemask(simd_gt(v, -1)) == SIMD_ALL && (simd_movemask(simd_eq(v, 0)) & zero) == zero;
+}
+#endif
+
+/**
+ * Length of the longest prefix of in that is complete, valid UTF-8.
+ * Runs of ASCII are skipped UTF_ASCII_BLOCK bytes at a time.
+ */
+size_t
+utf8_valid(const void* in, size_t len) {
+  const uint8_t *x = in, *end = x + len, *next;
+
+  while(x < end) {
+    if(end - x >= UTF_ASCII_BLOCK && utf_ascii_block(x)) {
+      x += UTF_ASCII_BLOCK;
+      continue;
+    }
+
+    if(*x < 0x80) {
+      x++;
+      continue;
+    }
+
+    if(unicode_from_utf8(x, end - x, &next) == -1)
+      break;
+
+    x = next;
+  }
+
+  return x - (const uint8_t*)in;
+}
+
+/**
+ * Converts UTF-16 at in to UTF-8 at out, which must hold *plen / 2 * 3
+ * bytes. Stops before an unpaired surrogate; *plen is set to the bytes
+ * consumed and the bytes written are returned.
+ */
+size_t
+utf16_to_utf8(uint8_t* out, const void* in, size_t* plen, BOOL big) {
+  static const uint8_t ascii[2][8] = {
+      {0x80, 0xff, 0x80, 0xff, 0x80, 0xff, 0x80, 0xff},
+      {0xff, 0x80, 0xff, 0x80, 0xff, 0x80, 0xff, 0x80},
+  };
+  const uint8_t *x = in, *end = x + (*plen & ~(size_t)1);
+  uint8_t* y = out;
+  uint32_t c, c2;
+
+  big = !!big;
+
+#ifdef SIMD_BLOCK
+  uint64_t zero = utf_unit_zero(2, big);
+#endif
+
+  while(x < end) {
+#ifdef SIMD_BLOCK
+    if(end - x >= SIMD_BLOCK && utf_units_ascii(x, zero)) {
+      for(int i = 0; i < SIMD_BLOCK / 2; i++)
+        y[i] = x[i * 2 + big];
+
+      x += SIMD_BLOCK;
+      y += SIMD_BLOCK / 2;
+      continue;
+    }
+#endif
+
+    if(end - x >= 8 && utf_clear64(x, ascii[big])) {
+      for(int i = 0; i < 4; i++)
+        y[i] = x[i * 2 + big];
+
+      x += 8;
+      y += 4;
+      continue;
+    }
+
+    if((c = utf16_unit(x, big)) < 0x80) {
+      *y++ = c;
+      x += 2;
+      continue;
+    }
+
+    if(c >= 0xd800 && c < 0xe000) {
+      if(c >= 0xdc00 || end - x < 4)
+        break;
+
+      if((c2 = utf16_unit(x + 2, big)) < 0xdc00 || c2 >= 0xe000)
+        break;
+
+      c = 0x10000 + ((c - 0xd800) << 10) + (c2 - 0xdc00);
+      x += 2;
+    }
+
+    x += 2;
+    y += unicode_to_utf8(y, c);
+  }
+
+  *plen = x - (const uint8_t*)in;
+  return y - out;
+}
+
+/**
+ * Converts UTF-32 at in to UTF-8 at out, which must hold *plen bytes.
+ * Stops before a surrogate or a value above U+10FFFF.
+ */
+size_t
+utf32_to_utf8(uint8_t* out, const void* in, size_t* plen, BOOL big) {
+  static const uint8_t ascii[2][8] = {
+      {0x80, 0xff, 0xff, 0xff, 0x80, 0xff, 0xff, 0xff},
+      {0xff, 0xff, 0xff, 0x80, 0xff, 0xff, 0xff, 0x80},
+  };
+  const uint8_t *x = in, *end = x + (*plen & ~(size_t)3);
+  uint8_t* y = out;
+  uint32_t c;
+
+  big = !!big;
+
+#ifdef SIMD_BLOCK
+  uint64_t zero = utf_unit_zero(4, big ? 3 : 0);
+#endif
+
+  while(x < end) {
+#ifdef SIMD_BLOCK
+    if(end - x >= SIMD_BLOCK && utf_units_ascii(x, zero)) {
+      for(int i = 0; i < SIMD_BLOCK / 4; i++)
+        y[i] = x[i * 4 + (big ? 3 : 0)];
+
+      x += SIMD_BLOCK;
+      y += SIMD_BLOCK / 4;
+      continue;
+    }
+#endif
+
+    if(end - x >= 16 && utf_clear64(x, ascii[big]) && utf_clear64(x + 8, ascii[big])) {
+      for(int i = 0; i < 4; i++)
+        y[i] = x[i * 4 + (big ? 3 : 0)];
+
+      x += 16;
+      y += 4;
+      continue;
+    }
+
+    if(!utf_scalar(c = utf32_unit(x, big)))
+      break;
+
+    x += 4;
+    y += unicode_to_utf8(y, c);
+  }
+
+  *plen = x - (const uint8_t*)in;
+  return y - out;
+}
+
+/**
+ * Converts UTF-8 at in to UTF-16 at out, which must hold *plen * 2
+ * bytes. Stops before an invalid or incomplete sequence.
+ */
+size_t
+utf8_to_utf16(uint8_t* out, const void* in, size_t* plen, BOOL big) {
+  const uint8_t *x = in, *end = x + *plen, *next;
+  uint8_t* y = out;
+  int c;
+
+  big = !!big;
+
+  while(x < end) {
+    if(end - x >= UTF_ASCII_BLOCK && utf_ascii_block(x)) {
+      for(int i = 0; i < UTF_ASCII_BLOCK; i++)
+        y = utf16_put(y, x[i], big);
+
+      x += UTF_ASCII_BLOCK;
+      continue;
+    }
+
+    if(*x < 0x80) {
+      y = utf16_put(y, *x++, big);
+      continue;
+    }
+
+    if((c = unicode_from_utf8(x, end - x, &next)) == -1 || !utf_scalar(c))
+      break;
+
+    if(c >= 0x10000) {
+      y = utf16_put(y, 0xd800 + ((c - 0x10000) >> 10), big);
+      c = 0xdc00 + ((c - 0x10000) & 0x3ff);
+    }
+
+    y = utf16_put(y, c, big);
+    x = next;
+  }
+
+  *plen = x - (const uint8_t*)in;
+  return y - out;
+}
+
+/**
+ * Converts UTF-8 at in to UTF-32 at out, which must hold *plen * 4
+ * bytes. Stops before an invalid or incomplete sequence.
+ */
+size_t
+utf8_to_utf32(uint8_t* out, const void* in, size_t* plen, BOOL big) {
+  const uint8_t *x = in, *end = x + *plen, *next;
+  uint8_t* y = out;
+  int c;
+
+  big = !!big;
+
+  while(x < end) {
+    if(end - x >= UTF_ASCII_BLOCK && utf_ascii_block(x)) {
+      for(int i = 0; i < UTF_ASCII_BLOCK; i++)
+        y = utf32_put(y, x[i], big);
+
+      x += UTF_ASCII_BLOCK;
+      continue;
+    }
+
+    if(*x < 0x80) {
+      y = utf32_put(y, *x++, big);
+      continue;
+    }
+
+    if((c = unicode_from_utf8(x, end - x, &next)) == -1 || !utf_scalar(c))
+      break;
+
+    y = utf32_put(y, c, big);
+    x = next;
+  }
+
+  *plen = x - (const uint8_t*)in;
+  return y - out;
+}
+
 int
 case_lowerc(int c) {
   if(c >= 'A' && c <= 'Z')
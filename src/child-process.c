@@ -177,7 +177,7 @@ child_process_spawn(ChildProcess* cp) {
 
   posix_spawn_file_actions_init(&actions);
 
-  for(i = 0; i <= 2; i++)
+  for(i = 0; i < cp->num_fds; i++)
     if(cp->child_fds[i] >= 0)
       posix_spawn_file_actions_adddup2(&actions, cp->child_fds[i], i);
 
@@ -186,6 +186,13 @@ child_process_spawn(ChildProcess* cp) {
     return -1;
   }
 
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attr);
+
+  for(i = 0; i < cp->num_fds; i++)
+    if(cp->child_fds[i] >= 0 && cp->child_fds[i] != i)
+      close(cp->child_fds[i]);
+
 #else
   int i;
   pid_t pid;
@@ -0,0 +1,495 @@
+#include "conn-pool.h"
+#include "defines.h"
+
+/**
+ * \addtogroup conn-pool
+ * @{
+ */
+
+static void connpool_dispatch(ConnPool*);
+static void connpool_schedule(ConnPool*);
+
+static void
+connpool_release_opaque(void* ptr) {
+  connpool_free(ptr);
+}
+
+static JSValue
+connpool_function(ConnPool* cp, CClosureFunc* func, int length, int magic) {
+  return js_function_cclosure(cp->ctx, func, length, magic, connpool_dup(cp), connpool_release_opaque);
+}
+
+static ConnPoolEntry*
+connpool_entry_new(ConnPool* cp, JSValueConst conn) {
+  ConnPoolEntry* e;
+
+  if(!(e = js_malloc(cp->ctx, sizeof(ConnPoolEntry))))
+    return 0;
+
+  e->conn = JS_DupValue(cp->ctx, conn);
+  e->since = js_time_ms();
+  return e;
+}
+
+static void
+connpool_entry_close(ConnPool* cp, ConnPoolEntry* e) {
+  list_del(&e->link);
+  cp->size--;
+
+  cp->backend->close(cp->ctx, e->conn);
+  JS_FreeValue(cp->ctx, e->conn);
+  js_free(cp->ctx, e);
+}
+
+static ConnPoolEntry*
+connpool_entry_find(struct list_head* list, JSValueConst conn) {
+  struct list_head* el;
+
+  if(!JS_IsObject(conn))
+    return 0;
+
+  list_for_each(el, list) {
+    ConnPoolEntry* e = list_entry(el, ConnPoolEntry, link);
+
+    if(JS_VALUE_GET_OBJ(e->conn) == JS_VALUE_GET_OBJ(conn))
+      return e;
+  }
+
+  return 0;
+}
+
+static ConnPoolWaiter*
+connpool_waiter_shift(ConnPool* cp) {
+  ConnPoolWaiter* w;
+
+  if(list_empty(&cp->waiters))
+    return 0;
+
+  w = list_entry(cp->waiters.next, ConnPoolWaiter, link);
+  list_del(&w->link);
+  cp->nwaiting--;
+  return w;
+}
+
+static void
+connpool_waiter_settle(ConnPool* cp, ConnPoolWaiter* w, BOOL reject, JSValueConst value) {
+  if(reject) {
+    promise_reject(cp->ctx, &w->promise.funcs, value);
+  } else {
+    int64_t wait = js_time_ms() - w->since;
+
+    cp->acquired++;
+    cp->wait_time += wait;
+    cp->max_wait = MAX_NUM(cp->max_wait, wait);
+
+    promise_resolve(cp->ctx, &w->promise.funcs, value);
+  }
+
+  promise_free(JS_GetRuntime(cp->ctx), &w->promise);
+  js_free(cp->ctx, w);
+}
+
+/**
+ * Settles a pending connect: magic 0 is the fulfillment, magic 1 the rejection.
+ */
+static JSValue
+connpool_connected(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  ConnPool* cp = ptr;
+  JSValueConst value = argc > 0 ? argv[0] : JS_UNDEFINED;
+
+  cp->opening--;
+
+  if(magic) {
+    ConnPoolWaiter* w;
+
+    /* the error goes to the oldest waiter, the others get another attempt */
+    if((w = connpool_waiter_shift(cp)))
+      connpool_waiter_settle(cp, w, TRUE, value);
+  } else if(cp->closed) {
+    cp->backend->close(ctx, value);
+  } else {
+    ConnPoolEntry* e;
+
+    if((e = connpool_entry_new(cp, value))) {
+      list_add(&e->link, &cp->idle);
+      cp->nidle++;
+      cp->size++;
+    }
+  }
+
+  connpool_dispatch(cp);
+  return JS_UNDEFINED;
+}
+
+static void
+connpool_open(ConnPool* cp) {
+  JSContext* ctx = cp->ctx;
+  JSValue promise, ret, fn, handlers[2];
+
+  cp->opening++;
+  promise = cp->backend->connect(ctx, cp->argc, cp->argv);
+
+  if(JS_IsException(promise)) {
+    JSValue error = JS_GetException(ctx);
+    ConnPoolWaiter* w;
+
+    cp->opening--;
+
+    if((w = connpool_waiter_shift(cp)))
+      connpool_waiter_settle(cp, w, TRUE, error);
+
+    JS_FreeValue(ctx, error);
+    return;
+  }
+
+  handlers[0] = connpool_function(cp, connpool_connected, 1, 0);
+  handlers[1] = connpool_function(cp, connpool_connected, 1, 1);
+
+  fn = JS_GetPropertyStr(ctx, promise, "then");
+  ret = JS_Call(ctx, fn, promise, countof(handlers), handlers);
+
+  JS_FreeValue(ctx, ret);
+  JS_FreeValue(ctx, fn);
+  JS_FreeValue(ctx, handlers[0]);
+  JS_FreeValue(ctx, handlers[1]);
+  JS_FreeValue(ctx, promise);
+}
+
+/**
+ * Hands idle connections to waiters in FIFO order, and opens new ones
+ * (up to max) for waiters that remain.
+ */
+static void
+connpool_dispatch(ConnPool* cp) {
+  while(cp->nwaiting > 0) {
+    if(!list_empty(&cp->idle)) {
+      ConnPoolEntry* e = list_entry(cp->idle.next, ConnPoolEntry, link);
+      ConnPoolWaiter* w;
+
+      cp->nidle--;
+
+      if(!cp->backend->healthy(cp->ctx, e->conn)) {
+        connpool_entry_close(cp, e);
+        continue;
+      }
+
+      list_del(&e->link);
+      list_add_tail(&e->link, &cp->busy);
+
+      w = connpool_waiter_shift(cp);
+      connpool_waiter_settle(cp, w, FALSE, e->conn);
+      continue;
+    }
+
+    if(cp->opening < cp->nwaiting && cp->size + cp->opening < cp->max) {
+      connpool_open(cp);
+      continue;
+    }
+
+    break;
+  }
+
+  if(!cp->closed)
+    connpool_fill(cp);
+
+  connpool_schedule(cp);
+}
+
+/**
+ * Idle timer: drops unhealthy connections, closes the ones idle longer
+ * than idle_timeout (oldest first, never below min) and reschedules.
+ */
+static JSValue
+connpool_sweep(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[], int magic, void* ptr) {
+  ConnPool* cp = ptr;
+  struct list_head *el, *next;
+  int64_t now = js_time_ms();
+
+  JS_FreeValue(ctx, cp->timer);
+  cp->timer = JS_UNDEFINED;
+
+  list_for_each_prev_safe(el, next, &cp->idle) {
+    ConnPoolEntry* e = list_entry(el, ConnPoolEntry, link);
+    BOOL expired = cp->idle_timeout > 0 && now - e->since >= cp->idle_timeout && cp->size > cp->min;
+
+    if(expired || !cp->backend->healthy(ctx, e->conn)) {
+      cp->nidle--;
+      connpool_entry_close(cp, e);
+    }
+  }
+
+  connpool_dispatch(cp);
+  return JS_UNDEFINED;
+}
+
+static void
+connpool_schedule(ConnPool* cp) {
+  JSContext* ctx = cp->ctx;
+  JSValue set_timeout, args[2];
+  ConnPoolEntry* oldest;
+  int64_t delay;
+
+  if(cp->closed || cp->idle_timeout <= 0 || list_empty(&cp->idle) || !JS_IsUndefined(cp->timer))
+    return;
+
+  oldest = list_entry(cp->idle.prev, ConnPoolEntry, link);
+  delay = MAX_NUM(oldest->since + cp->idle_timeout - js_time_ms(), 0);
+
+  set_timeout = js_os_function(ctx, "setTimeout");
+
+  if(JS_IsException(set_timeout)) {
+    JS_FreeValue(ctx, JS_GetException(ctx));
+    return;
+  }
+
+  args[0] = connpool_function(cp, connpool_sweep, 0, 0);
+  args[1] = JS_NewInt64(ctx, delay);
+
+  cp->timer = JS_Call(ctx, set_timeout, JS_UNDEFINED, countof(args), args);
+
+  if(JS_IsException(cp->timer)) {
+    JS_FreeValue(ctx, JS_GetException(ctx));
+    cp->timer = JS_UNDEFINED;
+  }
+
+  JS_FreeValue(ctx, args[0]);
+  JS_FreeValue(ctx, set_timeout);
+}
+
+ConnPool*
+connpool_new(JSContext* ctx, const ConnPoolBackend* backend, int argc, JSValueConst argv[]) {
+  ConnPool* cp;
+
+  if(!(cp = js_mallocz(ctx, sizeof(ConnPool))))
+    return 0;
+
+  if(argc > 0 && !(cp->argv = js_malloc(ctx, sizeof(JSValue) * argc))) {
+    js_free(ctx, cp);
+    return 0;
+  }
+
+  cp->ref_count = 1;
+  cp->ctx = ctx;
+  cp->backend = backend;
+  cp->argc = argc;
+
+  for(int i = 0; i < argc; i++)
+    cp->argv[i] = JS_DupValue(ctx, argv[i]);
+
+  cp->min = 0;
+  cp->max = 10;
+  cp->idle_timeout = 30000;
+  cp->timer = JS_UNDEFINED;
+
+  init_list_head(&cp->idle);
+  init_list_head(&cp->busy);
+  init_list_head(&cp->waiters);
+
+  return cp;
+}
+
+ConnPool*
+connpool_dup(ConnPool* cp) {
+  ++cp->ref_count;
+  return cp;
+}
+
+void
+connpool_free(ConnPool* cp) {
+  JSRuntime* rt;
+  struct list_head *el, *next;
+
+  if(--cp->ref_count)
+    return;
+
+  rt = JS_GetRuntime(cp->ctx);
+
+  list_for_each_safe(el, next, &cp->waiters) {
+    ConnPoolWaiter* w = list_entry(el, ConnPoolWaiter, link);
+
+    promise_free(rt, &w->promise);
+    js_free_rt(rt, w);
+  }
+
+  /* connections still referenced elsewhere close in their own finalizers */
+  list_for_each_safe(el, next, &cp->idle) {
+    ConnPoolEntry* e = list_entry(el, ConnPoolEntry, link);
+
+    JS_FreeValueRT(rt, e->conn);
+    js_free_rt(rt, e);
+  }
+
+  list_for_each_safe(el, next, &cp->busy) {
+    ConnPoolEntry* e = list_entry(el, ConnPoolEntry, link);
+
+    JS_FreeValueRT(rt, e->conn);
+    js_free_rt(rt, e);
+  }
+
+  for(int i = 0; i < cp->argc; i++)
+    JS_FreeValueRT(rt, cp->argv[i]);
+
+  if(cp->argv)
+    js_free_rt(rt, cp->argv);
+
+  JS_FreeValueRT(rt, cp->timer);
+  js_free_rt(rt, cp);
+}
+
+/**
+ * Reads { min, max, idleTimeout } from an options object.
+ */
+void
+connpool_options(ConnPool* cp, JSValueConst options) {
+  JSContext* ctx = cp->ctx;
+
+  if(!JS_IsObject(options))
+    return;
+
+  if(js_has_propertystr(ctx, options, "min"))
+    cp->min = MAX_NUM(js_get_propertystr_int32(ctx, options, "min"), 0);
+
+  if(js_has_propertystr(ctx, options, "max"))
+    cp->max = MAX_NUM(js_get_propertystr_int32(ctx, options, "max"), 1);
+
+  if(js_has_propertystr(ctx, options, "idleTimeout"))
+    cp->idle_timeout = js_get_propertystr_uint64(ctx, options, "idleTimeout");
+
+  if(cp->min > cp->max)
+    cp->min = cp->max;
+}
+
+/**
+ * Opens connections until the pool holds at least min.
+ */
+void
+connpool_fill(ConnPool* cp) {
+  while(!cp->closed && cp->size + cp->opening < cp->min)
+    connpool_open(cp);
+}
+
+/**
+ * Returns a Promise resolving to a connection; callers are served in
+ * the order they asked.
+ */
+JSValue
+connpool_acquire(ConnPool* cp) {
+  JSContext* ctx = cp->ctx;
+  ConnPoolWaiter* w;
+  JSValue ret;
+
+  if(cp->closed)
+    return JS_ThrowInternalError(ctx, "%s pool is closed", cp->backend->name);
+
+  if(!(w = js_malloc(ctx, sizeof(ConnPoolWaiter))))
+    return JS_EXCEPTION;
+
+  if(!promise_init(ctx, &w->promise)) {
+    js_free(ctx, w);
+    return JS_EXCEPTION;
+  }
+
+  ret = JS_DupValue(ctx, w->promise.value);
+  w->since = js_time_ms();
+
+  list_add_tail(&w->link, &cp->waiters);
+  cp->nwaiting++;
+
+  connpool_dispatch(cp);
+  return ret;
+}
+
+/**
+ * Gives a connection back. Unhealthy connections (and all of them once
+ * the pool is closed) are closed instead of kept idle.
+ *
+ * @return FALSE when conn isn't checked out from this pool
+ */
+BOOL
+connpool_release(ConnPool* cp, JSValueConst conn) {
+  ConnPoolEntry* e;
+
+  if(!(e = connpool_entry_find(&cp->busy, conn)))
+    return FALSE;
+
+  if(cp->closed || !cp->backend->healthy(cp->ctx, e->conn)) {
+    connpool_entry_close(cp, e);
+  } else {
+    list_del(&e->link);
+    list_add(&e->link, &cp->idle);
+    e->since = js_time_ms();
+    cp->nidle++;
+  }
+
+  connpool_dispatch(cp);
+  return TRUE;
+}
+
+/**
+ * Rejects all waiters, closes idle connections and stops the idle timer.
+ * Busy connections are closed as they are released.
+ */
+void
+connpool_close(ConnPool* cp) {
+  JSContext* ctx = cp->ctx;
+  ConnPoolWaiter* w;
+  struct list_head *el, *next;
+
+  if(cp->closed)
+    return;
+
+  cp->closed = TRUE;
+
+  if(!JS_IsUndefined(cp->timer)) {
+    JSValue clear_timeout = js_os_function(ctx, "clearTimeout");
+
+    if(!JS_IsException(clear_timeout)) {
+      JSValue ret = JS_Call(ctx, clear_timeout, JS_UNDEFINED, 1, &cp->timer);
+      JS_FreeValue(ctx, ret);
+    } else {
+      JS_FreeValue(ctx, JS_GetException(ctx));
+    }
+
+    JS_FreeValue(ctx, clear_timeout);
+    JS_FreeValue(ctx, cp->timer);
+    cp->timer = JS_UNDEFINED;
+  }
+
+  if(cp->nwaiting) {
+    JSValue error = JS_NewError(ctx);
+
+    JS_DefinePropertyValueStr(ctx, error, "message", JS_NewString(ctx, "pool closed"), JS_PROP_WRITABLE | JS_PROP_CONFIGURABLE);
+
+    while((w = connpool_waiter_shift(cp)))
+      connpool_waiter_settle(cp, w, TRUE, error);
+
+    JS_FreeValue(ctx, error);
+  }
+
+  list_for_each_safe(el, next, &cp->idle) {
+    ConnPoolEntry* e = list_entry(el, ConnPoolEntry, link);
+
+    cp->nidle--;
+    connpool_entry_close(cp, e);
+  }
+}
+
+/**
+ * Acquisition totals as { acquired, waitTime, maxWait }, times in
+ * milliseconds spent between acquire() and getting a connection.
+ */
+JSValue
+connpool_stats(ConnPool* cp) {
+  JSContext* ctx = cp->ctx;
+  JSValue ret = JS_NewObject(ctx);
+
+  JS_SetPropertyStr(ctx, ret, "acquired", JS_NewInt64(ctx, cp->acquired));
+  JS_SetPropertyStr(ctx, ret, "waitTime", JS_NewInt64(ctx, cp->wait_time));
+  JS_SetPropertyStr(ctx, ret, "maxWait", JS_NewInt64(ctx, cp->max_wait));
+
+  return ret;
+}
+
+/**
+ * @}
+ */
@@ -0,0 +1,457 @@
+#include "dirindex.h"
+#include "getdents.h"
+#include "defines.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * \addtogroup dirindex
+ * @{
+ */
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DIRINDEX_MASK \
+  (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_MODIFY | IN_CLOSE_WRITE | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+
+static int
+dirindex_compare(const char* a, size_t alen, const char* b, size_t blen) {
+  int r = memcmp(a, b, alen < blen ? alen : blen);
+
+  return r ? r : alen < blen ? -1 : alen > blen;
+}
+
+static BOOL
+dirindex_below(const DirIndexEntry* e, const char* dir, size_t len) {
+  return e->len > len && e->path[len] == '/' && !memcmp(e->path, dir, len);
+}
+
+static void
+dirindex_log(DirIndex* idx, DirIndexEntry* e) {
+  e->seq = ++idx->seq;
+
+  /* drops superseded records once they make up half the log */
+  if(idx->nlog == idx->alog && idx->nlog >= 2 * idx->count) {
+    size_t i, j = 0;
+
+    for(i = 0; i < idx->nlog; i++)
+      if(idx->log[i].entry->seq == idx->log[i].seq)
+        idx->log[j++] = idx->log[i];
+
+    idx->nlog = j;
+  }
+
+  if(idx->nlog == idx->alog) {
+    size_t alloc = idx->alog ? idx->alog * 2 : 256;
+    DirIndexChange* log;
+
+    if(!(log = realloc(idx->log, sizeof(DirIndexChange) * alloc)))
+      return;
+
+    idx->log = log;
+    idx->alog = alloc;
+  }
+
+  idx->log[idx->nlog].entry = e;
+  idx->log[idx->nlog].seq = e->seq;
+  idx->nlog++;
+}
+
+/**
+ * Position of path in the sorted table, or where it would be inserted.
+ */
+size_t
+dirindex_find(DirIndex* idx, const char* path, size_t len) {
+  size_t lo = 0, hi = idx->count;
+
+  while(lo < hi) {
+    size_t mid = (lo + hi) / 2;
+
+    if(dirindex_compare(idx->entries[mid]->path, idx->entries[mid]->len, path, len) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+static DirIndexEntry*
+dirindex_at(DirIndex* idx, size_t i, const char* path, size_t len) {
+  DirIndexEntry* e;
+
+  if(i >= idx->count)
+    return 0;
+
+  e = idx->entries[i];
+  return dirindex_compare(e->path, e->len, path, len) ? 0 : e;
+}
+
+DirIndexEntry*
+dirindex_lookup(DirIndex* idx, const char* path, size_t len) {
+  return dirindex_at(idx, dirindex_find(idx, path, len), path, len);
+}
+
+/* records path as present, logging it when it is new or changed */
+static DirIndexEntry*
+dirindex_put(DirIndex* idx, const char* path, size_t len, int type, uint64_t ino) {
+  size_t i = dirindex_find(idx, path, len);
+  DirIndexEntry* e;
+
+  if((e = dirindex_at(idx, i, path, len))) {
+    e->seen = TRUE;
+
+    if(e->removed || e->type != type || e->ino != ino) {
+      e->removed = FALSE;
+      e->type = type;
+      e->ino = ino;
+      dirindex_log(idx, e);
+    }
+
+    return e;
+  }
+
+  if(idx->count == idx->capacity) {
+    size_t capacity = idx->capacity ? idx->capacity * 2 : 1024;
+    DirIndexEntry** entries;
+
+    if(!(entries = realloc(idx->entries, sizeof(DirIndexEntry*) * capacity)))
+      return 0;
+
+    idx->entries = entries;
+    idx->capacity = capacity;
+  }
+
+  if(!(e = malloc(sizeof(DirIndexEntry) + len + 1)))
+    return 0;
+
+  e->ino = ino;
+  e->type = type;
+  e->removed = FALSE;
+  e->seen = TRUE;
+  e->len = len;
+  memcpy(e->path, path, len);
+  e->path[len] = '\0';
+
+  memmove(&idx->entries[i + 1], &idx->entries[i], sizeof(DirIndexEntry*) * (idx->count - i));
+  idx->entries[i] = e;
+  idx->count++;
+  dirindex_log(idx, e);
+  return e;
+}
+
+static void
+dirindex_unwatch(DirIndex* idx, const char* dir, size_t len) {
+  for(int wd = 0; wd < idx->nwatches; wd++) {
+    const char* w = idx->watches[wd];
+
+    if(w && !strncmp(w, dir, len) && (w[len] == '\0' || w[len] == '/')) {
+      inotify_rm_watch(idx->fd, wd);
+      free(idx->watches[wd]);
+      idx->watches[wd] = 0;
+    }
+  }
+}
+
+/* marks path and everything below it as removed */
+static void
+dirindex_remove(DirIndex* idx, const char* path, size_t len) {
+  size_t i = dirindex_find(idx, path, len);
+  DirIndexEntry* e;
+
+  if((e = dirindex_at(idx, i, path, len))) {
+    if(e->type == TYPE_DIR)
+      dirindex_unwatch(idx, path, len);
+
+    if(!e->removed) {
+      e->removed = TRUE;
+      dirindex_log(idx, e);
+    }
+
+    i++;
+  }
+
+  for(; i < idx->count && (idx->entries[i]->len < len || !memcmp(idx->entries[i]->path, path, len)); i++)
+    if(dirindex_below(e = idx->entries[i], path, len) && !e->removed) {
+      e->removed = TRUE;
+      dirindex_log(idx, e);
+    }
+}
+
+static BOOL
+dirindex_watch(DirIndex* idx, const char* dir, size_t len) {
+  char full[PATH_MAX];
+  int wd;
+
+  if(snprintf(full, sizeof(full), "%s%s%.*s", idx->root, len ? "/" : "", (int)len, dir) >= (int)sizeof(full))
+    return FALSE;
+
+  if((wd = inotify_add_watch(idx->fd, full, DIRINDEX_MASK)) == -1)
+    return FALSE;
+
+  if(wd >= idx->nwatches) {
+    int n = MAX_NUM(wd + 1, idx->nwatches * 2);
+    char** watches;
+
+    if(!(watches = realloc(idx->watches, sizeof(char*) * n)))
+      return FALSE;
+
+    memset(&watches[idx->nwatches], 0, sizeof(char*) * (n - idx->nwatches));
+    idx->watches = watches;
+    idx->nwatches = n;
+  }
+
+  free(idx->watches[wd]);
+  idx->watches[wd] = strndup(dir, len);
+  return TRUE;
+}
+
+/* watches dir, then records its entries and recurses into subdirectories */
+static void
+dirindex_crawl(DirIndex* idx, const char* dir, size_t len) {
+  struct dirent* ent;
+  DIR* d;
+  int fd;
+
+  /* watch first, so nothing created during the listing is missed */
+  if(!dirindex_watch(idx, dir, len))
+    return;
+
+  if((fd = openat(idx->rootfd, len ? dir : ".", O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)) == -1)
+    return;
+
+  if(!(d = fdopendir(fd))) {
+    close(fd);
+    return;
+  }
+
+  while((ent = readdir(d))) {
+    const char* name = ent->d_name;
+    size_t namelen = strlen(name), plen = len ? len + 1 + namelen : namelen;
+    int type = getdents_dtype(ent->d_type);
+    char path[PATH_MAX];
+
+    if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+      continue;
+
+    if(plen >= sizeof(path))
+      continue;
+
+    if(len) {
+      memcpy(path, dir, len);
+      path[len] = '/';
+    }
+
+    memcpy(path + plen - namelen, name, namelen + 1);
+
+    if(type == 0) {
+      struct stat st;
+
+      if(fstatat(dirfd(d), name, &st, AT_SYMLINK_NOFOLLOW) == -1)
+        continue;
+
+      type = getdents_mode(st.st_mode);
+    }
+
+    if(dirindex_put(idx, path, plen, type, ent->d_ino) && type == TYPE_DIR)
+      dirindex_crawl(idx, path, plen);
+  }
+
+  closedir(d);
+}
+
+/* stats one path that an event named and records it */
+static void
+dirindex_refresh(DirIndex* idx, const char* path, size_t len, BOOL create) {
+  struct stat st;
+  DirIndexEntry* e;
+  int type;
+
+  if(fstatat(idx->rootfd, path, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+    if(errno == ENOENT)
+      dirindex_remove(idx, path, len);
+    return;
+  }
+
+  type = getdents_mode(st.st_mode);
+
+  if(!create && (e = dirindex_lookup(idx, path, len)) && !e->removed && e->type == type && e->ino == st.st_ino) {
+    dirindex_log(idx, e);
+    return;
+  }
+
+  if(dirindex_put(idx, path, len, type, st.st_ino) && type == TYPE_DIR && create)
+    dirindex_crawl(idx, path, len);
+}
+
+/**
+ * Crawls root and starts watching it. All entries found start at
+ * sequence number 0. Returns 0, or -1 with errno set.
+ */
+int
+dirindex_open(DirIndex* idx, const char* root) {
+  size_t len = strlen(root);
+
+  memset(idx, 0, sizeof(DirIndex));
+  idx->fd = idx->rootfd = -1;
+
+  while(len > 1 && root[len - 1] == '/')
+    len--;
+
+  if(!(idx->root = strndup(root, len)))
+    return -1;
+
+  idx->rootlen = len;
+
+  if((idx->rootfd = open(idx->root, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1 || (idx->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1 || !dirindex_watch(idx, "", 0)) {
+    int err = errno;
+
+    dirindex_close(idx);
+    errno = err;
+    return -1;
+  }
+
+  dirindex_crawl(idx, "", 0);
+
+  for(size_t i = 0; i < idx->count; i++)
+    idx->entries[i]->seq = 0;
+
+  idx->seq = 0;
+  idx->nlog = 0;
+  return 0;
+}
+
+void
+dirindex_close(DirIndex* idx) {
+  for(size_t i = 0; i < idx->count; i++)
+    free(idx->entries[i]);
+
+  for(int wd = 0; wd < idx->nwatches; wd++)
+    free(idx->watches[wd]);
+
+  free(idx->entries);
+  free(idx->log);
+  free(idx->watches);
+  free(idx->root);
+
+  if(idx->fd != -1)
+    close(idx->fd);
+
+  if(idx->rootfd != -1)
+    close(idx->rootfd);
+
+  memset(idx, 0, sizeof(DirIndex));
+  idx->fd = idx->rootfd = -1;
+}
+
+/**
+ * Crawls the whole tree again and records only what differs, for when
+ * events were lost.
+ */
+void
+dirindex_rescan(DirIndex* idx) {
+  for(size_t i = 0; i < idx->count; i++)
+    idx->entries[i]->seen = FALSE;
+
+  dirindex_crawl(idx, "", 0);
+
+  for(size_t i = 0; i < idx->count; i++) {
+    DirIndexEntry* e = idx->entries[i];
+
+    if(!e->seen && !e->removed) {
+      e->removed = TRUE;
+      dirindex_log(idx, e);
+    }
+  }
+}
+
+/**
+ * Applies all pending events. Returns how many changes were recorded,
+ * or -1 on a read error.
+ */
+int
+dirindex_update(DirIndex* idx) {
+  uint8_t buf[65536] __attribute__((aligned(__alignof__(struct inotify_event))));
+  uint64_t start = idx->seq;
+  ssize_t n;
+
+  while((n = read(idx->fd, buf, sizeof(buf))) > 0) {
+    for(ssize_t i = 0; i + (ssize_t)sizeof(struct inotify_event) <= n;) {
+      struct inotify_event* ev = (struct inotify_event*)&buf[i];
+      const char* dir;
+      char path[PATH_MAX];
+      size_t len, dirlen, namelen;
+
+      i += sizeof(struct inotify_event) + ev->len;
+
+      if(ev->mask & IN_Q_OVERFLOW) {
+        dirindex_rescan(idx);
+        continue;
+      }
+
+      if(ev->wd < 0 || ev->wd >= idx->nwatches || !(dir = idx->watches[ev->wd]))
+        continue;
+
+      if(ev->mask & IN_IGNORED) {
+        free(idx->watches[ev->wd]);
+        idx->watches[ev->wd] = 0;
+        continue;
+      }
+
+      if(!ev->len || !(namelen = strlen(ev->name)))
+        continue;
+
+      dirlen = strlen(dir);
+      len = dirlen ? dirlen + 1 + namelen : namelen;
+
+      if(len >= sizeof(path))
+        continue;
+
+      snprintf(path, sizeof(path), "%s%s%s", dir, dirlen ? "/" : "", ev->name);
+
+      if(ev->mask & (IN_DELETE | IN_MOVED_FROM))
+        dirindex_remove(idx, path, len);
+      else if(ev->mask & (IN_CREATE | IN_MOVED_TO))
+        dirindex_refresh(idx, path, len, TRUE);
+      else
+        dirindex_refresh(idx, path, len, FALSE);
+    }
+  }
+
+  if(n == -1 && errno != EAGAIN && errno != EINTR)
+    return -1;
+
+  return idx->seq - start;
+}
+
+/**
+ * Index of the first log record after seq. The records from there on
+ * whose seq still equals their entry's are the changes since seq.
+ */
+size_t
+dirindex_since(DirIndex* idx, uint64_t seq) {
+  size_t lo = 0, hi = idx->nlog;
+
+  while(lo < hi) {
+    size_t mid = (lo + hi) / 2;
+
+    if(idx->log[mid].seq <= seq)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+#endif
+
+/**
+ * @}
+ */
@@ -191,6 +191,31 @@ getdents_issock(const DirEntry* e) {
   return 0;
 }
 
+uint64_t
+getdents_ino(const DirEntry* e) {
+  return 0;
+}
+
+int
+getdents_type(const DirEntry* e) {
+  if(getdents_isblk(e))
+    return TYPE_BLK;
+  if(getdents_ischr(e))
+    return TYPE_CHR;
+  if(getdents_isdir(e))
+    return TYPE_DIR;
+  if(getdents_isfifo(e))
+    return TYPE_FIFO;
+  if(getdents_islnk(e))
+    return TYPE_LNK;
+  if(getdents_issock(e))
+    return TYPE_SOCK;
+  if(getdents_isreg(e))
+    return TYPE_REG;
+
+  return 0;
+}
+
 #else
 #include <dirent.h> /* Defines DT_* constants */
 #include <fcntl.h>
@@ -360,28 +385,54 @@ getdents_issock(const DirEntry* e) {
   return ((dirent_struct*)e)->d_type == DT_SOCK;
 }
 
-#endif /* defined(_WIN32) */
+uint64_t
+getdents_ino(const DirEntry* e) {
+  return ((dirent_struct*)e)->d_ino;
+}
 
+/**
+ * TYPE_* flag for a d_type, 0 when the file system leaves it unknown.
+ */
 int
-getdents_type(const DirEntry* e) {
-  if(getdents_isblk(e))
-    return TYPE_BLK;
-  if(getdents_ischr(e))
-    return TYPE_CHR;
-  if(getdents_isdir(e))
-    return TYPE_DIR;
-  if(getdents_isfifo(e))
-    return TYPE_FIFO;
-  if(getdents_islnk(e))
-    return TYPE_LNK;
-  if(getdents_issock(e))
-    return TYPE_SOCK;
-  if(getdents_isreg(e))
-    return TYPE_REG;
+getdents_dtype(unsigned d_type) {
+  switch(d_type) {
+    case DT_REG: return TYPE_REG;
+    case DT_DIR: return TYPE_DIR;
+    case DT_LNK: return TYPE_LNK;
+    case DT_BLK: return TYPE_BLK;
+    case DT_CHR: return TYPE_CHR;
+    case DT_FIFO: return TYPE_FIFO;
+    case DT_SOCK: return TYPE_SOCK;
+  }
 
   return 0;
 }
 
+/**
+ * TYPE_* flag for a st_mode.
+ */
+int
+getdents_mode(unsigned mode) {
+  switch(mode & S_IFMT) {
+    case S_IFREG: return TYPE_REG;
+    case S_IFDIR: return TYPE_DIR;
+    case S_IFLNK: return TYPE_LNK;
+    case S_IFBLK: return TYPE_BLK;
+    case S_IFCHR: return TYPE_CHR;
+    case S_IFIFO: return TYPE_FIFO;
+    case S_IFSOCK: return TYPE_SOCK;
+  }
+
+  return 0;
+}
+
+int
+getdents_type(const DirEntry* e) {
+  return getdents_dtype(((dirent_struct*)e)->d_type);
+}
+
+#endif /* defined(_WIN32) */
+
 /**
  * @}
  */
@@ -0,0 +1,239 @@
+#include "gpio-capture.h"
+#include "defines.h"
+
+#ifdef __linux__
+#include <linux/gpio.h>
+#endif
+
+#ifdef GPIO_V2_GET_LINE_IOCTL
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+/**
+ * \addtogroup gpio-capture
+ * @{
+ */
+#define GPIO_CAPTURE_BLOCK 64
+
+static void*
+gpio_capture_thread(void* arg) {
+  GPIOCapture* gc = arg;
+  struct gpio_v2_line_event events[GPIO_CAPTURE_BLOCK];
+  GPIOEdge edges[GPIO_CAPTURE_BLOCK];
+  struct pollfd pfd[2] = {
+      {gc->line_fd, POLLIN, 0},
+      {gc->stop[0], POLLIN, 0},
+  };
+
+  for(;;) {
+    ssize_t r;
+    size_t n;
+
+    if(poll(pfd, 2, -1) < 0) {
+      if(errno == EINTR)
+        continue;
+
+      break;
+    }
+
+    if(pfd[1].revents)
+      break;
+
+    if((r = read(gc->line_fd, events, sizeof(events))) <= 0) {
+      if(r < 0 && (errno == EINTR || errno == EAGAIN))
+        continue;
+
+      break;
+    }
+
+    n = r / sizeof(events[0]);
+
+    for(size_t i = 0; i < n; i++) {
+      edges[i].timestamp_ns = events[i].timestamp_ns;
+      edges[i].line = events[i].offset;
+      edges[i].edge = events[i].id == GPIO_V2_LINE_EVENT_RISING_EDGE ? GPIO_EDGE_RISING : GPIO_EDGE_FALLING;
+    }
+
+    /* a full ring drops the whole block rather than blocking the kernel
+       fifo, the count tells the reader */
+    if(shared_ring_avail(&gc->ring) < n * sizeof(GPIOEdge)) {
+      __atomic_fetch_add(&gc->dropped, n, __ATOMIC_RELAXED);
+      continue;
+    }
+
+    shared_ring_write(&gc->ring, edges, n * sizeof(GPIOEdge));
+
+    if(!__atomic_exchange_n(&gc->notified, 1, __ATOMIC_ACQ_REL))
+      while(write(gc->wake[1], "", 1) == -1 && errno == EINTR) {}
+  }
+
+  return 0;
+}
+
+static int
+gpio_capture_pipe(int fds[2]) {
+  if(pipe(fds) == -1)
+    return -1;
+
+  for(int i = 0; i < 2; i++)
+    fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+
+  return 0;
+}
+
+/**
+ * Requests \p lines as inputs with edge detection and starts the capture
+ * thread. \p capacity is the number of edges the ring holds.
+ *
+ * @return  0 on success, -1 with errno set otherwise
+ */
+int
+gpio_capture_open(GPIOCapture* gc, const char* chip, const uint32_t* lines, uint32_t num_lines, int edges, uint32_t debounce_us, uint32_t capacity) {
+  struct gpio_v2_line_request req;
+  size_t ring_size;
+  int chip_fd, err;
+
+  memset(gc, 0, sizeof(GPIOCapture));
+  gc->line_fd = gc->wake[0] = gc->wake[1] = gc->stop[0] = gc->stop[1] = -1;
+
+  if(num_lines == 0 || num_lines > GPIO_V2_LINES_MAX || num_lines > GPIO_CAPTURE_MAX_LINES) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if((chip_fd = open(chip, O_RDONLY | O_CLOEXEC)) == -1)
+    return -1;
+
+  memset(&req, 0, sizeof(req));
+  memcpy(req.offsets, lines, num_lines * sizeof(uint32_t));
+  strncpy(req.consumer, "quickjs-gpio", sizeof(req.consumer) - 1);
+
+  req.num_lines = num_lines;
+  req.event_buffer_size = MIN_NUM(capacity, GPIO_V2_LINES_MAX * 16);
+  req.config.flags = GPIO_V2_LINE_FLAG_INPUT | ((edges & GPIO_EDGE_RISING) ? GPIO_V2_LINE_FLAG_EDGE_RISING : 0) |
+                     ((edges & GPIO_EDGE_FALLING) ? GPIO_V2_LINE_FLAG_EDGE_FALLING : 0);
+
+  if(debounce_us) {
+    req.config.num_attrs = 1;
+    req.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_DEBOUNCE;
+    req.config.attrs[0].attr.debounce_period_us = debounce_us;
+    req.config.attrs[0].mask = num_lines == 64 ? ~(uint64_t)0 : ((uint64_t)1 << num_lines) - 1;
+  }
+
+  err = ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &req);
+  close(chip_fd);
+
+  if(err == -1)
+    return -1;
+
+  gc->line_fd = req.fd;
+  ring_size = shared_ring_size(capacity * sizeof(GPIOEdge));
+
+  if(!(gc->ring_mem = malloc(ring_size))) {
+    errno = ENOMEM;
+    goto fail;
+  }
+
+  shared_ring_init(&gc->ring, gc->ring_mem, ring_size, SHARED_RING_SPSC);
+
+  if(gpio_capture_pipe(gc->wake) == -1 || gpio_capture_pipe(gc->stop) == -1)
+    goto fail;
+
+  fcntl(gc->wake[0], F_SETFL, fcntl(gc->wake[0], F_GETFL) | O_NONBLOCK);
+
+  if((err = pthread_create(&gc->thread, 0, gpio_capture_thread, gc))) {
+    errno = err;
+    goto fail;
+  }
+
+  gc->running = true;
+  return 0;
+
+fail:
+  err = errno;
+  gpio_capture_close(gc);
+  errno = err;
+  return -1;
+}
+
+/**
+ * Takes up to \p max edges off the ring. Once the caller has drained it,
+ * the next batch wakes the event loop again.
+ */
+size_t
+gpio_capture_read(GPIOCapture* gc, GPIOEdge* out, size_t max) {
+  char buf[64];
+  size_t n;
+
+  while(read(gc->wake[0], buf, sizeof(buf)) > 0) {}
+
+  __atomic_store_n(&gc->notified, 0, __ATOMIC_RELEASE);
+
+  n = MIN_NUM(shared_ring_length(&gc->ring) / sizeof(GPIOEdge), max);
+  shared_ring_read(&gc->ring, out, n * sizeof(GPIOEdge));
+  return n;
+}
+
+size_t
+gpio_capture_pending(GPIOCapture* gc) {
+  return shared_ring_length(&gc->ring) / sizeof(GPIOEdge);
+}
+
+void
+gpio_capture_close(GPIOCapture* gc) {
+  if(gc->running) {
+    while(write(gc->stop[1], "", 1) == -1 && errno == EINTR) {}
+
+    pthread_join(gc->thread, 0);
+    gc->running = false;
+  }
+
+  for(int i = 0; i < 2; i++) {
+    if(gc->wake[i] != -1)
+      close(gc->wake[i]);
+
+    if(gc->stop[i] != -1)
+      close(gc->stop[i]);
+
+    gc->wake[i] = gc->stop[i] = -1;
+  }
+
+  if(gc->line_fd != -1)
+    close(gc->line_fd);
+
+  gc->line_fd = -1;
+  free(gc->ring_mem);
+  gc->ring_mem = 0;
+}
+
+/**
+ * @}
+ */
+#else
+#include <errno.h>
+
+int
+gpio_capture_open(GPIOCapture* gc, const char* chip, const uint32_t* lines, uint32_t num_lines, int edges, uint32_t debounce_us, uint32_t capacity) {
+  errno = ENOSYS;
+  return -1;
+}
+
+size_t
+gpio_capture_read(GPIOCapture* gc, GPIOEdge* out, size_t max) {
+  return 0;
+}
+
+size_t
+gpio_capture_pending(GPIOCapture* gc) {
+  return 0;
+}
+
+void
+gpio_capture_close(GPIOCapture* gc) {
+}
+#endif /* defined(GPIO_V2_GET_LINE_IOCTL) */
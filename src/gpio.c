@@ -127,6 +127,30 @@ gpio_get_pin(struct gpio* gpio, const uint8_t pin) {
   return value;
 }
 
+/**
+ * Reads the level register of \p bank: bit n is pin 32 * bank + n
+ */
+uint32_t
+gpio_read_bank(struct gpio* gpio, const uint8_t bank) {
+  return *(volatile uint32_t*)(gpio->map + lvl[0] + (bank & 1));
+}
+
+/**
+ * Drives the pins of \p bank selected by \p mask to the bits in \p value,
+ * with one write to the set and one to the clear register
+ */
+void
+gpio_write_bank(struct gpio* gpio, const uint8_t bank, const uint32_t mask, const uint32_t value) {
+  if(value & mask)
+    *(volatile uint32_t*)(gpio->map + set[0] + (bank & 1)) = value & mask;
+
+  if(~value & mask)
+    *(volatile uint32_t*)(gpio->map + clr[0] + (bank & 1)) = ~value & mask;
+
+  if(gpio->debug)
+    fprintf(stdout, "Set bank %d mask 0x%08x to 0x%08x\n", bank & 1, mask, value & mask);
+}
+
 /**
  * @}
  */
@@ -146,6 +146,346 @@ lexer_rule_expand(Lexer* lex, char* p, DynBuf* db) {
   return TRUE;
 }
 
+/**
+ * First-byte sets: for every rule the set of bytes a non-empty match can
+ * start with is derived from its (expanded) regex, so lexer_peek() only
+ * runs the rules that can match at the current position. Constructs the
+ * analysis does not understand yield the full set.
+ */
+static inline void
+charset_set(uint64_t cs[4], unsigned c) {
+  cs[c >> 6] |= (uint64_t)1 << (c & 63);
+}
+
+static inline void
+charset_range(uint64_t cs[4], unsigned from, unsigned to) {
+  for(; from <= to; from++)
+    charset_set(cs, from);
+}
+
+static inline void
+charset_union(uint64_t cs[4], const uint64_t other[4]) {
+  for(int i = 0; i < 4; i++)
+    cs[i] |= other[i];
+}
+
+/* the pattern is matched against bytes, every non-ASCII construct may match any high byte */
+static inline void
+charset_high(uint64_t cs[4]) {
+  cs[2] = cs[3] = ~(uint64_t)0;
+}
+
+static void
+charset_class_escape(uint64_t cs[4], char c) {
+  uint64_t tmp[4] = {0, 0, 0, 0};
+  BOOL negate = isupper(c);
+
+  switch(tolower(c)) {
+    case 'd': charset_range(tmp, '0', '9'); break;
+    case 'w':
+      charset_range(tmp, '0', '9');
+      charset_range(tmp, 'A', 'Z');
+      charset_range(tmp, 'a', 'z');
+      charset_set(tmp, '_');
+      break;
+    case 's':
+      charset_range(tmp, '\t', '\r');
+      charset_set(tmp, ' ');
+      charset_high(tmp);
+      break;
+  }
+
+  if(negate) {
+    tmp[0] = ~tmp[0];
+    tmp[1] = ~tmp[1];
+    charset_high(tmp);
+  }
+
+  charset_union(cs, tmp);
+}
+
+#define LEXER_ESCAPE_SET -2
+#define LEXER_ESCAPE_ANY -3
+
+/* parses an escape at p (after the backslash), returns the character or one of the codes above */
+static int
+lexer_first_escape(const char** pp, const char* end, uint64_t cs[4], BOOL in_class) {
+  const char* p = *pp;
+  int c = (unsigned char)*p++;
+
+  *pp = p;
+
+  switch(c) {
+    case 'd':
+    case 'D':
+    case 'w':
+    case 'W':
+    case 's':
+    case 'S': charset_class_escape(cs, c); return LEXER_ESCAPE_SET;
+    case 'n': return '\n';
+    case 'r': return '\r';
+    case 't': return '\t';
+    case 'v': return '\v';
+    case 'f': return '\f';
+    case '0': return 0;
+    case 'b': return in_class ? '\b' : LEXER_ESCAPE_SET;
+    case 'B': return LEXER_ESCAPE_SET;
+    case 'x':
+    case 'u': {
+      size_t n = c == 'x' ? 2 : 4, i;
+      unsigned v = 0;
+
+      for(i = 0; i < n && p + i < end && isxdigit(p[i]); i++)
+        v = v * 16 + (isdigit(p[i]) ? p[i] - '0' : (tolower(p[i]) - 'a' + 10));
+
+      if(i < n)
+        return c;
+
+      *pp = p + n;
+
+      if(v >= 0x80) {
+        charset_high(cs);
+        return LEXER_ESCAPE_SET;
+      }
+
+      return v;
+    }
+    case 'c':
+    case 'k':
+    case 'p':
+    case 'P': return LEXER_ESCAPE_ANY;
+  }
+
+  if(c >= '1' && c <= '9')
+    return LEXER_ESCAPE_ANY;
+
+  if(c >= 0x80) {
+    while(p < end && ((unsigned char)*p & 0xc0) == 0x80)
+      p++;
+
+    *pp = p;
+    charset_high(cs);
+    return LEXER_ESCAPE_SET;
+  }
+
+  return c;
+}
+
+static const char*
+lexer_first_class(const char* p, const char* end, uint64_t cs[4], BOOL* any) {
+  uint64_t tmp[4] = {0, 0, 0, 0};
+  BOOL negate = FALSE;
+  int prev = -1;
+
+  if(p < end && *p == '^') {
+    negate = TRUE;
+    p++;
+  }
+
+  while(p < end && *p != ']') {
+    int c = (unsigned char)*p++;
+
+    if(c == '\\' && p < end) {
+      if((c = lexer_first_escape(&p, end, tmp, TRUE)) == LEXER_ESCAPE_ANY)
+        *any = TRUE;
+
+      if(c < 0) {
+        prev = -1;
+        continue;
+      }
+    } else if(c >= 0x80) {
+      while(p < end && ((unsigned char)*p & 0xc0) == 0x80)
+        p++;
+
+      charset_high(tmp);
+      prev = -1;
+      continue;
+    }
+
+    if(c == '-' && prev >= 0 && p < end && *p != ']') {
+      int to = (unsigned char)*p++;
+
+      if(to == '\\' && p < end)
+        to = lexer_first_escape(&p, end, tmp, TRUE);
+
+      if(to >= 0x80 || to < 0) {
+        charset_range(tmp, prev, 0x7f);
+        charset_high(tmp);
+      } else if(to >= prev) {
+        charset_range(tmp, prev, to);
+      }
+
+      prev = -1;
+      continue;
+    }
+
+    charset_set(tmp, c);
+    prev = c;
+  }
+
+  if(negate) {
+    tmp[0] = ~tmp[0];
+    tmp[1] = ~tmp[1];
+    charset_high(tmp);
+  }
+
+  charset_union(cs, tmp);
+  return p < end ? p + 1 : p;
+}
+
+static const char* lexer_first_disjunction(const char*, const char*, uint64_t[4], BOOL*, BOOL*);
+
+static const char*
+lexer_first_atom(const char* p, const char* end, uint64_t cs[4], BOOL* nullable, BOOL* any) {
+  int c = (unsigned char)*p++;
+
+  *nullable = FALSE;
+
+  switch(c) {
+    case '(': {
+      uint64_t tmp[4] = {0, 0, 0, 0};
+      BOOL zero_width = FALSE;
+
+      if(p < end && *p == '?') {
+        if(p + 1 < end && (p[1] == '=' || p[1] == '!')) {
+          zero_width = TRUE;
+          p += 2;
+        } else if(p + 2 < end && p[1] == '<' && (p[2] == '=' || p[2] == '!')) {
+          zero_width = TRUE;
+          p += 3;
+        } else if(p + 1 < end && p[1] == ':') {
+          p += 2;
+        } else if(p + 1 < end && p[1] == '<') {
+          p += 2 + byte_chr(p + 2, end - (p + 2), '>');
+
+          if(p < end)
+            p++;
+        } else {
+          *any = TRUE;
+        }
+      }
+
+      p = lexer_first_disjunction(p, end, zero_width ? tmp : cs, nullable, any);
+
+      if(zero_width)
+        *nullable = TRUE;
+
+      return p < end && *p == ')' ? p + 1 : p;
+    }
+    case '[': return lexer_first_class(p, end, cs, any);
+    case '^':
+    case '$': *nullable = TRUE; return p;
+    case '.': charset_range(cs, 0, 0xff); return p;
+    case '\\': {
+      if(p == end) {
+        charset_set(cs, '\\');
+        return p;
+      }
+
+      if((c = lexer_first_escape(&p, end, cs, FALSE)) == LEXER_ESCAPE_ANY)
+        *any = TRUE;
+      else if(c == LEXER_ESCAPE_SET && (p[-1] == 'b' || p[-1] == 'B'))
+        *nullable = TRUE;
+      else if(c >= 0)
+        charset_set(cs, c);
+
+      return p;
+    }
+  }
+
+  if(c >= 0x80) {
+    while(p < end && ((unsigned char)*p & 0xc0) == 0x80)
+      p++;
+
+    charset_high(cs);
+    return p;
+  }
+
+  charset_set(cs, c);
+  return p;
+}
+
+static const char*
+lexer_first_quantifier(const char* p, const char* end, BOOL* nullable) {
+  if(p == end)
+    return p;
+
+  switch(*p) {
+    case '*':
+    case '?': *nullable = TRUE; p++; break;
+    case '+': p++; break;
+    case '{': {
+      const char* q = p + 1;
+      unsigned long min;
+
+      if(q == end || !isdigit(*q))
+        return p;
+
+      min = strtoul(q, (char**)&q, 10);
+
+      if(min == 0)
+        *nullable = TRUE;
+
+      p = q + byte_chr(q, end - q, '}');
+
+      if(p < end)
+        p++;
+      break;
+    }
+    default: return p;
+  }
+
+  if(p < end && *p == '?')
+    p++;
+
+  return p;
+}
+
+static const char*
+lexer_first_disjunction(const char* p, const char* end, uint64_t cs[4], BOOL* nullable, BOOL* any) {
+  *nullable = FALSE;
+
+  for(;;) {
+    BOOL alt_nullable = TRUE;
+
+    while(p < end && *p != '|' && *p != ')') {
+      uint64_t tmp[4] = {0, 0, 0, 0};
+      BOOL atom_nullable;
+
+      p = lexer_first_atom(p, end, tmp, &atom_nullable, any);
+      p = lexer_first_quantifier(p, end, &atom_nullable);
+
+      if(alt_nullable)
+        charset_union(cs, tmp);
+
+      alt_nullable = alt_nullable && atom_nullable;
+    }
+
+    *nullable = *nullable || alt_nullable;
+
+    if(p == end || *p != '|')
+      break;
+
+    p++;
+  }
+
+  return p;
+}
+
+static void
+lexer_rule_first(LexerRule* rule) {
+  const char* re = rule->expansion;
+  BOOL nullable, any = FALSE;
+
+  memset(rule->first, 0, sizeof(rule->first));
+
+  if(re)
+    lexer_first_disjunction(re, re + strlen(re), rule->first, &nullable, &any);
+
+  if(!re || any)
+    memset(rule->first, 0xff, sizeof(rule->first));
+}
+
 static BOOL
 lexer_rule_compile(Lexer* lex, LexerRule* rule, JSContext* ctx) {
   DynBuf dbuf = DBUF_INIT_0();
@@ -157,9 +497,13 @@ lexer_rule_compile(Lexer* lex, LexerRule* rule, JSContext* ctx) {
   js_dbuf_init(ctx, &dbuf);
 
   if(lexer_rule_expand(lex, lexer_rule_regex(rule), &dbuf)) {
+    RegExp re = {(char*)dbuf.buf, dbuf.size, LRE_FLAG_GLOBAL | LRE_FLAG_MULTILINE | LRE_FLAG_STICKY};
+
     rule->expansion = js_strndup(ctx, (const char*)dbuf.buf, dbuf.size);
-    rule->bytecode = regexp_compile(regexp_from_dbuf(&dbuf, LRE_FLAG_GLOBAL | LRE_FLAG_MULTILINE | LRE_FLAG_STICKY), ctx);
+    /* lexers built from the same grammar share the compiled bytecode */
+    rule->bytecode = regexp_compile_shared(re, ctx);
     ret = rule->bytecode != 0;
+    lexer_rule_first(rule);
 
   } else {
     JS_ThrowInternalError(ctx, "Error expanding rule '%s'", rule->name);
@@ -252,7 +596,7 @@ lexer_rule_release_rt(LexerRule* rule, JSRuntime* rt) {
   js_free_rt(rt, rule->expr);
 
   if(rule->bytecode)
-    orig_js_free_rt(rt, rule->bytecode);
+    regexp_bytecode_free(rule->bytecode);
 }
 
 void
@@ -283,6 +627,8 @@ lexer_init(Lexer* lex, enum lexer_mode mode, JSContext* ctx) {
   vector_init(&lex->states, ctx);
   vector_push(&lex->states, initial);
   vector_init(&lex->state_stack, ctx);
+  vector_init(&lex->checkpoints, ctx);
+  vector_init(&lex->checkpoint_stack, ctx);
 }
 
 void
@@ -319,9 +665,12 @@ lexer_peek(Lexer* lex, /*uint64_t __state,*/ unsigned start_rule, JSContext* ctx
   uint8_t* capture[512];
   int ret = LEXER_ERROR_NOMATCH;
   size_t len = 0;
+  uint8_t c;
 
   if(input_buffer_eof(&lex->input))
-    return LEXER_EOF;
+    return lexer_awaiting_input(lex) ? LEXER_INCOMPLETE : LEXER_EOF;
+
+  c = lex->data[lex->pos];
 
   if(lex->loc.byte_offset == -1)
     location_zero(&lex->loc);
@@ -334,6 +683,10 @@ lexer_peek(Lexer* lex, /*uint64_t __state,*/ unsigned start_rule, JSContext* ctx
     if((rule->mask & (1 << lex->state)) == 0)
       continue;
 
+    /* a compiled rule whose first-byte set excludes the next byte cannot match */
+    if(rule->bytecode && !(rule->first[c >> 6] & ((uint64_t)1 << (c & 63))))
+      continue;
+
     result = lexer_rule_match(lex, rule, capture, ctx);
 
     /*size_t elen = strlen(rule->expansion);
@@ -366,13 +719,14 @@ lexer_peek(Lexer* lex, /*uint64_t __state,*/ unsigned start_rule, JSContext* ctx
     } else if(result > 0 && (capture[1] - capture[0]) > 0) {
 
 #ifdef DEBUG_OUTPUT
-      const char* filename = lex->loc.file == -1 ? 0 : JS_AtomToCString(ctx, lex->loc.file);
+      const Location* loc = lexer_location(lex);
+      const char* filename = loc->file == -1 ? 0 : JS_AtomToCString(ctx, loc->file);
 
       printf("%s%s%" PRIu32 ":%-4" PRIu32 " #%i %-20s - /%s/ [%zu] %.*s\n",
              filename ? filename : "",
              filename ? ":" : "",
-             lex->loc.line + 1,
-             lex->loc.column + 1,
+             loc->line + 1,
+             loc->column + 1,
              (int)(rule - start),
              rule->name,
              rule->expr,
@@ -392,6 +746,11 @@ lexer_peek(Lexer* lex, /*uint64_t __state,*/ unsigned start_rule, JSContext* ctx
     }
   }
 
+  /* with more input to come, a match touching the end of the buffered data may still grow */
+  if(lexer_awaiting_input(lex))
+    if(ret == LEXER_ERROR_NOMATCH || (ret >= 0 && lex->pos + len + lex->lookahead >= lex->size))
+      ret = LEXER_INCOMPLETE;
+
   if(ret >= 0) {
     lex->byte_length = len;
     lex->token_id = ret;
@@ -427,12 +786,10 @@ lexer_skip_n(Lexer* lex, size_t bytes) {
 
   assert(bytes <= lex->size - lex->pos);
 
-  lex->loc.byte_offset = lex->pos;
-  len = location_count(&lex->loc, &lex->data[lex->pos], bytes);
+  /* lex->loc catches up in lexer_location() */
+  len = utf8_strlen(&lex->data[lex->pos], bytes);
   lex->pos += bytes;
 
-  // location_count(&lex->loc, &lex->data[tok->loc->byte_offset], bytes);
-
   // lexer_clear_token(lex);
   /* lex->byte_length = 0;
    lex->token_id = -1;*/
@@ -496,17 +853,216 @@ void
 lexer_set_input(Lexer* lex, InputBuffer input, int32_t file_atom) {
   lex->input = input;
   lex->loc.file = file_atom;
+  lex->loc_pos = lex->pos;
+}
+
+static void
+lexer_chunk_free(JSContext* ctx, const char* str, JSValue val) {
+  js_free(ctx, (char*)str);
+}
+
+/**
+ * Append a chunk of input. The first call switches the lexer to an owned,
+ * growable buffer (holding the unconsumed part of the current input). Data
+ * before the current token (and its line, within LEXER_CHUNK_KEEP_LINE) is
+ * released; lex->base keeps byte offsets absolute.
+ */
+int
+lexer_feed(Lexer* lex, const void* x, size_t n, JSContext* ctx) {
+  size_t keep;
+
+  if(!lex->chunked) {
+    size_t size = lex->size, pos = lex->pos;
+    uint8_t* buf;
+
+    if(!(buf = js_malloc(ctx, size + n + 1)))
+      return -1;
+
+    if(size)
+      memcpy(buf, lex->data, size);
+
+    input_buffer_free(&lex->input, ctx);
+    lex->input = (InputBuffer){{{buf, size}}, pos, &lexer_chunk_free, JS_UNDEFINED, OFFSET_INIT()};
+    lex->capacity = size + n + 1;
+    lex->chunked = TRUE;
+    lex->closed = FALSE;
+    lexer_checkpoints_clear(lex);
+  }
+
+  for(keep = lex->pos; keep > 0 && lex->pos - keep < LEXER_CHUNK_KEEP_LINE; keep--)
+    if(lex->data[keep - 1] == '\n')
+      break;
+
+  if(keep > 0 && lex->data[keep - 1] != '\n')
+    keep = lex->pos;
+
+  if(keep > 0) {
+    lexer_location(lex);
+    memmove(lex->data, lex->data + keep, lex->size - keep);
+    lex->size -= keep;
+    lex->pos -= keep;
+    lex->loc_pos = lex->pos;
+    lex->base += keep;
+  }
+
+  if(lex->size + n + 1 > lex->capacity) {
+    size_t capacity = MAX_NUM(lex->capacity * 2, lex->size + n + 1);
+    uint8_t* buf;
+
+    if(!(buf = js_realloc(ctx, lex->data, capacity)))
+      return -1;
+
+    lex->data = buf;
+    lex->capacity = capacity;
+  }
+
+  memcpy(lex->data + lex->size, x, n);
+  lex->size += n;
+  lex->data[lex->size] = '\0';
+
+  return 0;
+}
+
+/**
+ * No more input: matches at the end of the buffered data become final.
+ */
+void
+lexer_end(Lexer* lex) {
+  lex->closed = TRUE;
 }
 
 void
 lexer_set_location(Lexer* lex, const Location* loc, JSContext* ctx) {
   // lex->start = loc->char_offset;
   lex->byte_length = 0;
-  lex->pos = loc->char_offset;
+  lex->pos = loc->byte_offset >= (int64_t)lex->base ? (size_t)loc->byte_offset - lex->base : utf8_byte_offset(lex->data, lex->size, loc->char_offset);
+  lex->loc_pos = lex->pos;
   location_release(&lex->loc, JS_GetRuntime(ctx));
   location_copy(&lex->loc, loc, ctx);
 }
 
+/**
+ * Returns lex->loc for the current position. Skipping only advances
+ * lex->pos, the lines and characters in between are counted here, once
+ * someone asks for them.
+ */
+Location*
+lexer_location(Lexer* lex) {
+  if(lex->loc_pos != lex->pos) {
+    if(lex->loc.byte_offset == -1)
+      location_zero(&lex->loc);
+
+    if(lex->loc_pos < lex->pos) {
+      lex->loc.byte_offset = lex->base + lex->loc_pos;
+      location_count(&lex->loc, &lex->data[lex->loc_pos], lex->pos - lex->loc_pos);
+    }
+
+    lex->loc_pos = lex->pos;
+  }
+
+  return &lex->loc;
+}
+
+/**
+ * Record the current state as a checkpoint. Must be called between
+ * tokens (no pending token) with lex->records naming the next record.
+ */
+void
+lexer_checkpoint(Lexer* lex) {
+  LexerCheckpoint cp;
+  size_t depth = lexer_state_depth(lex);
+  const Location* loc = lexer_location(lex);
+
+  cp.pos = lex->pos;
+  cp.index = lex->records;
+  cp.line = loc->line;
+  cp.column = loc->column;
+  cp.char_offset = loc->char_offset;
+  cp.state = lex->state;
+  cp.stack_start = vector_size(&lex->checkpoint_stack, sizeof(int32_t));
+  cp.stack_depth = depth;
+
+  if(depth)
+    vector_put(&lex->checkpoint_stack, vector_begin(&lex->state_stack), depth * sizeof(int32_t));
+
+  vector_push(&lex->checkpoints, cp);
+}
+
+/**
+ * Find the last checkpoint before byte offset \p pos (or the first
+ * checkpoint when none precedes it).
+ */
+LexerCheckpoint*
+lexer_checkpoint_find(Lexer* lex, size_t pos) {
+  LexerCheckpoint* cps = vector_begin(&lex->checkpoints);
+  size_t lo = 0, hi = lexer_num_checkpoints(lex);
+
+  if(hi == 0)
+    return 0;
+
+  while(hi - lo > 1) {
+    size_t mid = (lo + hi) / 2;
+
+    if(cps[mid].pos < pos)
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  return &cps[lo];
+}
+
+void
+lexer_checkpoint_restore(Lexer* lex, const LexerCheckpoint* cp) {
+  const int32_t* stack = vector_begin(&lex->checkpoint_stack);
+
+  lex->pos = cp->pos;
+  lex->records = cp->index;
+  lex->loc.byte_offset = cp->pos;
+  lex->loc.line = cp->line;
+  lex->loc.column = cp->column;
+  lex->loc.char_offset = cp->char_offset;
+  lex->loc_pos = cp->pos;
+  lex->state = cp->state;
+  lex->byte_length = 0;
+  lex->token_id = -1;
+
+  vector_clear(&lex->state_stack);
+
+  if(cp->stack_depth)
+    vector_put(&lex->state_stack, &stack[cp->stack_start], cp->stack_depth * sizeof(int32_t));
+}
+
+/**
+ * Compare the start condition and state stack with a checkpoint whose
+ * stack slice starts at \p stack.
+ */
+BOOL
+lexer_checkpoint_same_state(Lexer* lex, const LexerCheckpoint* cp, const int32_t* stack) {
+  if(lex->state != cp->state || lexer_state_depth(lex) != cp->stack_depth)
+    return FALSE;
+
+  return !cp->stack_depth || !memcmp(vector_begin(&lex->state_stack), stack, cp->stack_depth * sizeof(int32_t));
+}
+
+/**
+ * Discard \p cp and all checkpoints after it.
+ */
+void
+lexer_checkpoint_truncate(Lexer* lex, const LexerCheckpoint* cp) {
+  LexerCheckpoint* begin = vector_begin(&lex->checkpoints);
+
+  vector_shrink(&lex->checkpoint_stack, sizeof(int32_t), cp->stack_start);
+  vector_shrink(&lex->checkpoints, sizeof(LexerCheckpoint), cp - begin);
+}
+
+void
+lexer_checkpoints_clear(Lexer* lex) {
+  vector_clear(&lex->checkpoints);
+  vector_clear(&lex->checkpoint_stack);
+  lex->records = 0;
+}
+
 void
 lexer_release(Lexer* lex, JSRuntime* rt) {
   char** statep;
@@ -522,6 +1078,8 @@ lexer_release(Lexer* lex, JSRuntime* rt) {
   vector_free(&lex->rules);
   vector_free(&lex->states);
   vector_free(&lex->state_stack);
+  vector_free(&lex->checkpoints);
+  vector_free(&lex->checkpoint_stack);
 
   location_release(&lex->loc, rt);
 }
@@ -541,7 +1099,7 @@ lexer_dump(Lexer* lex, DynBuf* dbuf) {
   dbuf_putstr(dbuf, ",\n  input: ");
   input_buffer_dump(&lex->input, dbuf);
   dbuf_putstr(dbuf, ",\n  location: ");
-  location_print(&lex->loc, dbuf, 0);
+  location_print(lexer_location(lex), dbuf, 0);
   dbuf_putstr(dbuf, "\n}");
 }
 
@@ -550,7 +1108,7 @@ lexer_get_location(Lexer* lex, JSContext* ctx) {
   Location loc;
 
   loc.ref_count = 1;
-  location_copy(&loc, &lex->loc, ctx);
+  location_copy(&loc, lexer_location(lex), ctx);
 
   // location_count(&loc, &lex->data[lex->pos], lex->byte_length);
 
@@ -0,0 +1,121 @@
+#include "line-index.h"
+#include <string.h>
+#include "simd.h"
+
+/**
+ * \addtogroup line-index
+ * @{
+ */
+#ifdef SIMD_BLOCK
+static inline uint64_t
+line_mask(const uint8_t* p, uint8_t ch) {
+  return simd_movemask(simd_eq(simd_load(p), ch));
+}
+#endif
+
+/**
+ * Number of ch bytes in p.
+ */
+size_t
+line_index_count(const uint8_t* p, size_t n, uint8_t ch) {
+  size_t i = 0, count = 0;
+
+#ifdef SIMD_BLOCK
+  for(; i + SIMD_BLOCK <= n; i += SIMD_BLOCK)
+    count += simd_count(line_mask(p + i, ch));
+#endif
+
+  for(; i < n; i++)
+    count += p[i] == ch;
+
+  return count;
+}
+
+/**
+ * Length of the prefix of p that contains none of the \p nset bytes in
+ * set, n when there is none. Sets of up to 8 bytes are compared a block
+ * at a time.
+ */
+size_t
+line_index_span(const uint8_t* p, size_t n, const uint8_t* set, size_t nset) {
+  size_t i = 0;
+
+#ifdef SIMD_BLOCK
+  if(nset <= 8)
+    for(; i + SIMD_BLOCK <= n; i += SIMD_BLOCK) {
+      uint64_t m = 0;
+
+      for(size_t k = 0; k < nset; k++)
+        m |= line_mask(p + i, set[k]);
+
+      if(m)
+        return i + simd_first(m);
+    }
+#endif
+
+  for(; i < n; i++)
+    if(memchr(set, p[i], nset))
+      break;
+
+  return i;
+}
+
+/**
+ * Appends base + i + 1 as a uint64_t to out for every separator p[i].
+ * quote < 0 disables quoting; *inquote carries the parity across calls.
+ * Returns how many offsets were appended, or -1 when out of memory.
+ */
+ssize_t
+line_index_scan(const uint8_t* p, size_t n, int sep, int quote, BOOL* inquote, uint64_t base, DynBuf* out) {
+  size_t i = 0, start = out->size;
+  BOOL q = *inquote;
+
+#ifdef SIMD_BLOCK
+  for(; i + SIMD_BLOCK <= n; i += SIMD_BLOCK) {
+    uint64_t m = line_mask(p + i, sep), qm = quote >= 0 ? line_mask(p + i, quote) : 0;
+    uint64_t* w;
+
+    if(!(m | qm) || (q && !qm))
+      continue;
+
+    if(dbuf_realloc(out, out->size + SIMD_BLOCK * sizeof(uint64_t)))
+      return -1;
+
+    w = (uint64_t*)(out->buf + out->size);
+
+    if(!qm) {
+      for(; m; m = simd_clear(m))
+        *w++ = base + i + simd_first(m) + 1;
+    } else {
+      for(m |= qm; m; m = simd_clear(m)) {
+        size_t k = simd_first(m);
+
+        if(p[i + k] == quote)
+          q = !q;
+        else if(!q)
+          *w++ = base + i + k + 1;
+      }
+    }
+
+    out->size = (uint8_t*)w - out->buf;
+  }
+#endif
+
+  for(; i < n; i++) {
+    if(p[i] == quote) {
+      q = !q;
+    } else if(p[i] == sep && !q) {
+      uint64_t offset = base + i + 1;
+
+      if(dbuf_put(out, (const uint8_t*)&offset, sizeof(offset)))
+        return -1;
+    }
+  }
+
+  *inquote = q;
+  return (out->size - start) / sizeof(uint64_t);
+}
+
+/**
+ * @}
+ */
@@ -1,5 +1,6 @@
 #include <stddef.h>
 #include "location.h"
+#include "line-index.h"
 #include "buffer-utils.h"
 #include "debug.h"
 
@@ -108,21 +109,19 @@ location_count(Location* loc, const uint8_t* x, size_t n) {
 
   start = loc->char_offset;
 
-  for(i = 0; i < n;) {
-    size_t bytes = utf8_charlen((const void*)&x[i], n - i);
+  /* chars after the last newline continue or start the column */
+  for(i = n; i > 0 && x[i - 1] != '\n'; i--)
+    ;
 
-    if(bytes == 1 && x[i] == '\n') {
-      loc->line++;
-      loc->column = 0;
-    } else {
-      loc->column++;
-    }
-
-    loc->char_offset++;
-    loc->byte_offset += bytes;
-    i += bytes;
+  if(i > 0) {
+    loc->line += line_index_count(x, i - 1, '\n') + 1;
+    loc->column = 0;
   }
 
+  loc->column += utf8_strlen(&x[i], n - i);
+  loc->char_offset += utf8_strlen(x, n);
+  loc->byte_offset += n;
+
   return loc->char_offset - start;
 }
 
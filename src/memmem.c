@@ -1,15 +1,20 @@
 #include <sys/types.h>
 #include <string.h>
 
+/* memchr() finds candidates for the first byte, memcmp() checks the rest */
 void*
 memmem(const void* haystack, size_t hl, const void* needle, size_t nl) {
-  int i;
-  if(nl > hl)
-    return 0;
-  for(i = hl - nl + 1; i; --i) {
-    if(!memcmp(haystack, needle, nl))
-      return (char*)haystack;
-    ++haystack;
+  const char *p = haystack, *end = p + hl, *first;
+
+  if(nl == 0)
+    return (void*)haystack;
+
+  while((size_t)(end - p) >= nl && (first = memchr(p, *(const char*)needle, end - p - nl + 1))) {
+    if(!memcmp(first + 1, (const char*)needle + 1, nl - 1))
+      return (void*)first;
+
+    p = first + 1;
   }
+
   return 0;
 }
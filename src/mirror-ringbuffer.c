@@ -0,0 +1,188 @@
+#include "mirror-ringbuffer.h"
+#include "defines.h"
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#endif
+
+/**
+ * \addtogroup mirror-ringbuffer
+ * @{
+ */
+#ifdef _WIN32
+static size_t
+mirror_granularity(void) {
+  SYSTEM_INFO si;
+
+  GetSystemInfo(&si);
+  return si.dwAllocationGranularity;
+}
+
+static uint8_t*
+mirror_map(size_t size) {
+  HANDLE map;
+  uint8_t* ret = 0;
+
+  if(!(map = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, NULL)))
+    return 0;
+
+  /* the reserved range may be taken by another thread between VirtualFree() and MapViewOfFileEx(), so retry */
+  for(int tries = 0; tries < 16 && !ret; tries++) {
+    uint8_t *addr, *lo, *hi;
+
+    if(!(addr = VirtualAlloc(NULL, 2 * size, MEM_RESERVE, PAGE_NOACCESS)))
+      break;
+
+    VirtualFree(addr, 0, MEM_RELEASE);
+
+    if((lo = MapViewOfFileEx(map, FILE_MAP_ALL_ACCESS, 0, 0, size, addr))) {
+      if((hi = MapViewOfFileEx(map, FILE_MAP_ALL_ACCESS, 0, 0, size, addr + size)))
+        ret = lo;
+      else
+        UnmapViewOfFile(lo);
+    }
+  }
+
+  /* the views keep the mapping alive */
+  CloseHandle(map);
+  return ret;
+}
+
+static void
+mirror_unmap(uint8_t* data, size_t size) {
+  UnmapViewOfFile(data + size);
+  UnmapViewOfFile(data);
+}
+#else
+static size_t
+mirror_granularity(void) {
+  return sysconf(_SC_PAGESIZE);
+}
+
+static int
+mirror_fd(void) {
+#ifdef MFD_CLOEXEC
+  return memfd_create("ringbuffer", MFD_CLOEXEC);
+#else
+  static unsigned counter;
+  char name[64];
+  int fd;
+
+  snprintf(name, sizeof(name), "/ringbuffer-%ld-%u", (long)getpid(), __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED));
+
+  if((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) != -1)
+    shm_unlink(name);
+
+  return fd;
+#endif
+}
+
+static uint8_t*
+mirror_map(size_t size) {
+  uint8_t* addr = MAP_FAILED;
+  int fd;
+
+  if((fd = mirror_fd()) == -1)
+    return 0;
+
+  if(ftruncate(fd, size) == 0 && (addr = mmap(NULL, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) != MAP_FAILED) {
+    /* replace both halves of the reservation with views of the same pages */
+    if(mmap(addr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+       mmap(addr + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+      munmap(addr, 2 * size);
+      addr = MAP_FAILED;
+    }
+  }
+
+  close(fd);
+  return addr == MAP_FAILED ? 0 : addr;
+}
+
+static void
+mirror_unmap(uint8_t* data, size_t size) {
+  munmap(data, 2 * size);
+}
+#endif
+
+/**
+ * Maps a ring of at least min_size bytes; FALSE when the platform can't
+ * map the pages twice.
+ */
+BOOL
+mirror_ring_init(MirrorRing* r, size_t min_size) {
+  size_t page = mirror_granularity();
+
+  r->size = ((MAX_NUM(min_size, 1) + page - 1) / page) * page;
+  r->head = r->tail = 0;
+
+  return (r->data = mirror_map(r->size)) != 0;
+}
+
+void
+mirror_ring_free(MirrorRing* r) {
+  if(r->data)
+    mirror_unmap(r->data, r->size);
+
+  r->data = 0;
+  r->size = r->head = r->tail = 0;
+}
+
+/**
+ * Queues up to len bytes; returns how many fit.
+ */
+size_t
+mirror_ring_write(MirrorRing* r, const void* x, size_t len) {
+  len = MIN_NUM(len, mirror_ring_avail(r));
+
+  memcpy(mirror_ring_end(r), x, len);
+  mirror_ring_produce(r, len);
+  return len;
+}
+
+/**
+ * Dequeues up to len bytes; returns how many were queued.
+ */
+size_t
+mirror_ring_read(MirrorRing* r, void* x, size_t len) {
+  len = MIN_NUM(len, mirror_ring_length(r));
+
+  memcpy(x, mirror_ring_begin(r), len);
+  mirror_ring_consume(r, len);
+  return len;
+}
+
+/**
+ * Reads from fd into all of the free space with one read().
+ */
+ssize_t
+mirror_ring_fill(MirrorRing* r, int fd) {
+  ssize_t n;
+
+  if((n = read(fd, mirror_ring_end(r), mirror_ring_avail(r))) > 0)
+    mirror_ring_produce(r, n);
+
+  return n;
+}
+
+/**
+ * Writes all queued bytes to fd with one write().
+ */
+ssize_t
+mirror_ring_drain(MirrorRing* r, int fd) {
+  ssize_t n;
+
+  if((n = write(fd, mirror_ring_begin(r), mirror_ring_length(r))) > 0)
+    mirror_ring_consume(r, n);
+
+  return n;
+}
+
+/**
+ * @}
+ */
@@ -10,6 +10,14 @@
 #ifdef _WIN32
 #include <shlobj.h>
 #endif
+#ifdef __linux__
+#include <errno.h>
+#include <linux/stat.h>
+#include <sys/syscall.h>
+#if defined(SYS_statx) && defined(STATX_TYPE)
+#define HAVE_STATX 1
+#endif
+#endif
 
 /**
  * \addtogroup path
@@ -813,6 +821,62 @@ path_stat2(const char* p, size_t plen, struct stat* st) {
   return r;
 }
 
+#ifdef HAVE_STATX
+static thread_local BOOL path_statx_missing;
+#endif
+
+/**
+ * Stats name relative to dirfd (AT_FDCWD for the working directory),
+ * asking only for the PATH_STAT_* fields given. On Linux that is one
+ * statx() with the matching mask. Returns 0, or -1 with errno set.
+ */
+int
+path_statat(int dirfd, const char* name, int fields, BOOL follow, PathStat* st) {
+  struct stat s;
+
+#ifdef HAVE_STATX
+  if(!path_statx_missing) {
+    struct statx sx;
+    unsigned mask = 0;
+
+    if(fields & PATH_STAT_MODE)
+      mask |= STATX_TYPE | STATX_MODE;
+    if(fields & PATH_STAT_SIZE)
+      mask |= STATX_SIZE;
+    if(fields & PATH_STAT_MTIME)
+      mask |= STATX_MTIME;
+
+    if(syscall(SYS_statx, dirfd, name, AT_STATX_DONT_SYNC | (follow ? 0 : AT_SYMLINK_NOFOLLOW), mask, &sx) == 0) {
+      st->mode = sx.stx_mode;
+      st->size = sx.stx_size;
+      st->mtime = (double)sx.stx_mtime.tv_sec * 1000 + sx.stx_mtime.tv_nsec / 1e6;
+      return 0;
+    }
+
+    if(errno != ENOSYS)
+      return -1;
+
+    path_statx_missing = TRUE;
+  }
+#endif
+
+#ifdef _WIN32
+  if(stat(name, &s) == -1)
+#else
+  if(fstatat(dirfd, name, &s, follow ? 0 : AT_SYMLINK_NOFOLLOW) == -1)
+#endif
+    return -1;
+
+  st->mode = s.st_mode;
+  st->size = s.st_size;
+#ifdef __linux__
+  st->mtime = (double)s.st_mtim.tv_sec * 1000 + s.st_mtim.tv_nsec / 1e6;
+#else
+  st->mtime = (double)s.st_mtime * 1000;
+#endif
+  return 0;
+}
+
 int
 path_isdir1(const char* p) {
   struct stat st;
@@ -968,8 +1032,548 @@ path_issymlink2(const char* p, size_t plen) {
   return r;
 }
 
-int
-path_resolve3(const char* path, DynBuf* db, int symbolic) {
+enum {
+  GLOB_END = 0,
+  GLOB_LITERAL, /* length byte, then the bytes */
+  GLOB_ANY,
+  GLOB_STAR,
+  GLOB_CLASS, /* 256-bit set */
+};
+
+typedef struct {
+  uint32_t code;
+  BOOL globstar, dot;
+} PathGlobSegment;
+
+struct path_glob {
+  int flags;
+  BOOL absolute;
+  uint32_t nseg;
+  PathGlobSegment* seg;
+  DynBuf code;
+};
+
+/* parses [...] at p; returns the bytes consumed, 0 when it is unterminated */
+static size_t
+path_glob_class(const char* p, size_t len, int flags, uint8_t set[32]) {
+  size_t i = 1;
+  BOOL neg = FALSE;
+
+  memset(set, 0, 32);
+
+  if(i < len && (p[i] == '!' || p[i] == '^')) {
+    neg = TRUE;
+    i++;
+  }
+
+  for(size_t start = i; i < len && !path_issep(p[i]); i++) {
+    uint8_t lo, hi;
+
+    if(p[i] == ']' && i > start) {
+      if(neg)
+        for(int j = 0; j < 32; j++)
+          set[j] = ~set[j];
+
+      /* never matches a separator */
+      set['/' >> 3] &= ~(1 << ('/' & 7));
+      return i + 1;
+    }
+
+    if(p[i] == '\\' && !(flags & PATH_FNM_NOESCAPE) && i + 1 < len)
+      i++;
+
+    lo = hi = p[i];
+
+    if(i + 2 < len && p[i + 1] == '-' && p[i + 2] != ']') {
+      i += 2;
+
+      if(p[i] == '\\' && !(flags & PATH_FNM_NOESCAPE) && i + 1 < len)
+        i++;
+
+      hi = p[i];
+    }
+
+    for(unsigned c = lo; c <= hi; c++)
+      set[c >> 3] |= 1 << (c & 7);
+  }
+
+  return 0;
+}
+
+/* compiles one path component, up to the next separator */
+static size_t
+path_glob_segment(PathGlob* g, const char* p, size_t len) {
+  PathGlobSegment* seg = &g->seg[g->nseg++];
+  size_t i = 0, lit = 0;
+
+  seg->code = g->code.size;
+  seg->globstar = FALSE;
+  seg->dot = FALSE;
+
+  while(i < len && !path_issep(p[i])) {
+    uint8_t set[32];
+    size_t n;
+    char c = p[i];
+
+    if(c == '*' || c == '?' || (c == '[' && (n = path_glob_class(p + i, len - i, g->flags, set)))) {
+      if(c == '*') {
+        while(i < len && p[i] == '*')
+          i++;
+
+        dbuf_putc(&g->code, GLOB_STAR);
+        lit = 0;
+        continue;
+      }
+
+      if(c == '?') {
+        dbuf_putc(&g->code, GLOB_ANY);
+        i++;
+      } else {
+        dbuf_putc(&g->code, GLOB_CLASS);
+        dbuf_put(&g->code, set, sizeof(set));
+        i += n;
+      }
+
+      lit = 0;
+      continue;
+    }
+
+    if(c == '\\' && !(g->flags & PATH_FNM_NOESCAPE) && i + 1 < len && !path_issep(p[i + 1]))
+      c = p[++i];
+
+    if(lit == 0 || g->code.buf[lit] == 255) {
+      dbuf_putc(&g->code, GLOB_LITERAL);
+      lit = g->code.size;
+      dbuf_putc(&g->code, 0);
+    }
+
+    if(c == '.' && g->code.size == seg->code + 2)
+      seg->dot = TRUE;
+
+    g->code.buf[lit]++;
+    dbuf_putc(&g->code, c);
+    i++;
+  }
+
+  seg->globstar = (i == 2 && p[0] == '*' && p[1] == '*');
+  dbuf_putc(&g->code, GLOB_END);
+  return i;
+}
+
+/**
+ * Compiles a glob pattern into a reusable matcher. Components are split
+ * at separators, '**' as a whole component matches any number of them.
+ * Honours PATH_FNM_NOESCAPE and PATH_FNM_PERIOD. Returns NULL when out of
+ * memory or the pattern has more than 63 components.
+ */
+PathGlob*
+path_glob_compile(const char* pattern, size_t len, int flags) {
+  PathGlob* g;
+  size_t i = 0, n = 1;
+
+  for(size_t j = 0; j < len; j++)
+    n += path_issep(pattern[j]);
+
+  if(n > 63 || !(g = calloc(1, sizeof(PathGlob))))
+    return 0;
+
+  if(!(g->seg = calloc(n, sizeof(PathGlobSegment)))) {
+    free(g);
+    return 0;
+  }
+
+  g->flags = flags;
+  g->absolute = len > 0 && path_issep(pattern[0]);
+  dbuf_init2(&g->code, 0, 0);
+
+  while(i < len) {
+    if(path_issep(pattern[i])) {
+      i++;
+      continue;
+    }
+
+    i += path_glob_segment(g, pattern + i, len - i);
+  }
+
+  if(g->code.error) {
+    path_glob_free(g);
+    return 0;
+  }
+
+  return g;
+}
+
+void
+path_glob_free(PathGlob* g) {
+  dbuf_free(&g->code);
+  free(g->seg);
+  free(g);
+}
+
+/* matches one component; a star retries from one byte further on mismatch */
+static BOOL
+path_glob_segment_match(const uint8_t* op, const char* s, size_t n) {
+  const uint8_t* star = 0;
+  size_t i = 0, pos = 0;
+
+  for(;;) {
+    switch(*op) {
+      case GLOB_END: {
+        if(i == n)
+          return TRUE;
+        break;
+      }
+
+      case GLOB_LITERAL: {
+        if(n - i >= op[1] && !memcmp(s + i, op + 2, op[1])) {
+          i += op[1];
+          op += 2 + op[1];
+          continue;
+        }
+        break;
+      }
+
+      case GLOB_ANY: {
+        if(i < n) {
+          i++;
+          op++;
+          continue;
+        }
+        break;
+      }
+
+      case GLOB_CLASS: {
+        if(i < n && (op[1 + ((uint8_t)s[i] >> 3)] >> ((uint8_t)s[i] & 7) & 1)) {
+          i++;
+          op += 33;
+          continue;
+        }
+        break;
+      }
+
+      case GLOB_STAR: {
+        star = ++op;
+        pos = i;
+        continue;
+      }
+    }
+
+    if(!star || pos >= n)
+      return FALSE;
+
+    op = star;
+    i = ++pos;
+  }
+}
+
+/* adds the states reachable by letting a '**' match nothing */
+static uint64_t
+path_glob_closure(const PathGlob* g, uint64_t states) {
+  for(uint32_t i = 0; i < g->nseg; i++)
+    if((states >> i & 1) && g->seg[i].globstar)
+      states |= (uint64_t)1 << (i + 1);
+
+  return states;
+}
+
+/**
+ * States before the first component; bit i set means component i is
+ * next, bit nseg means the whole pattern matched.
+ */
+uint64_t
+path_glob_start(const PathGlob* g) {
+  return path_glob_closure(g, 1);
+}
+
+/**
+ * Advances states over one path component.
+ */
+uint64_t
+path_glob_step(const PathGlob* g, uint64_t states, const char* name, size_t len) {
+  uint64_t next = 0;
+  BOOL hidden = len > 0 && name[0] == '.' && (g->flags & PATH_FNM_PERIOD);
+
+  for(uint32_t i = 0; i < g->nseg; i++) {
+    const PathGlobSegment* seg = &g->seg[i];
+
+    if(!(states >> i & 1))
+      continue;
+
+    if(seg->globstar) {
+      if(!hidden)
+        next |= (uint64_t)1 << i;
+    } else if((!hidden || seg->dot) && path_glob_segment_match(g->code.buf + seg->code, name, len)) {
+      next |= (uint64_t)1 << (i + 1);
+    }
+  }
+
+  return path_glob_closure(g, next);
+}
+
+BOOL
+path_glob_accepts(const PathGlob* g, uint64_t states) {
+  return (states >> g->nseg) & 1;
+}
+
+/**
+ * Whether a path below the one states were reached with can still match.
+ */
+BOOL
+path_glob_live(const PathGlob* g, uint64_t states) {
+  return (states & (((uint64_t)1 << g->nseg) - 1)) != 0;
+}
+
+BOOL
+path_glob_match(const PathGlob* g, const char* s, size_t len) {
+  uint64_t states = path_glob_start(g);
+  size_t i = 0;
+
+  if(g->absolute != (len > 0 && path_issep(s[0])))
+    return FALSE;
+
+  while(i < len && states) {
+    size_t n;
+
+    if(path_issep(s[i])) {
+      i++;
+      continue;
+    }
+
+    n = path_component3(s + i, len - i, 0);
+    states = path_glob_step(g, states, s + i, n);
+    i += n;
+  }
+
+  return path_glob_accepts(g, states);
+}
+
+enum {
+  PATH_CACHE_RESOLVE = 0,
+  PATH_CACHE_SYMBOLIC,
+  PATH_CACHE_REALPATH,
+};
+
+typedef struct path_cache_entry {
+  struct path_cache_entry *chain, *prev, *next;
+  uint32_t hash;
+  int kind, ret;
+  size_t keylen, len;
+  char* value;
+  char key[];
+} PathCacheEntry;
+
+/* hash chains plus a recency list, most recently used first */
+typedef struct {
+  PathCacheEntry **buckets, *head, *tail;
+  size_t count, capacity, mask;
+  uint64_t hits, misses;
+} PathCache;
+
+static thread_local PathCache path_cache;
+
+static uint32_t
+path_cache_hash(int kind, const char* key, size_t len) {
+  uint32_t h = 2166136261u ^ (uint32_t)kind;
+
+  while(len--)
+    h = (h ^ (uint8_t)*key++) * 16777619u;
+
+  return h;
+}
+
+static void
+path_cache_unlink(PathCacheEntry* e) {
+  PathCacheEntry** pp = &path_cache.buckets[e->hash & path_cache.mask];
+
+  while(*pp != e)
+    pp = &(*pp)->chain;
+
+  *pp = e->chain;
+
+  if(e->prev)
+    e->prev->next = e->next;
+  else
+    path_cache.head = e->next;
+
+  if(e->next)
+    e->next->prev = e->prev;
+  else
+    path_cache.tail = e->prev;
+
+  path_cache.count--;
+}
+
+static void
+path_cache_push(PathCacheEntry* e) {
+  e->prev = 0;
+
+  if((e->next = path_cache.head))
+    e->next->prev = e;
+  else
+    path_cache.tail = e;
+
+  path_cache.head = e;
+}
+
+static PathCacheEntry*
+path_cache_find(int kind, const char* key, size_t len) {
+  PathCacheEntry* e;
+  uint32_t h;
+
+  if(!path_cache.capacity)
+    return 0;
+
+  h = path_cache_hash(kind, key, len);
+
+  for(e = path_cache.buckets[h & path_cache.mask]; e; e = e->chain)
+    if(e->hash == h && e->kind == kind && e->keylen == len && !memcmp(e->key, key, len))
+      break;
+
+  if(!e) {
+    path_cache.misses++;
+    return 0;
+  }
+
+  path_cache.hits++;
+
+  if(e != path_cache.head) {
+    e->prev->next = e->next;
+
+    if(e->next)
+      e->next->prev = e->prev;
+    else
+      path_cache.tail = e->prev;
+
+    path_cache_push(e);
+  }
+
+  return e;
+}
+
+static void
+path_cache_store(int kind, const char* key, size_t keylen, const void* value, size_t len, int ret) {
+  PathCacheEntry* e;
+
+  if(!path_cache.capacity)
+    return;
+
+  if(path_cache.count >= path_cache.capacity) {
+    e = path_cache.tail;
+    path_cache_unlink(e);
+    free(e);
+  }
+
+  if(!(e = malloc(sizeof(PathCacheEntry) + keylen + len + 2)))
+    return;
+
+  e->hash = path_cache_hash(kind, key, keylen);
+  e->kind = kind;
+  e->ret = ret;
+  e->keylen = keylen;
+  e->len = len;
+  e->value = e->key + keylen + 1;
+  memcpy(e->key, key, keylen);
+  e->key[keylen] = '\0';
+  if(len)
+    memcpy(e->value, value, len);
+  e->value[len] = '\0';
+
+  e->chain = path_cache.buckets[e->hash & path_cache.mask];
+  path_cache.buckets[e->hash & path_cache.mask] = e;
+  path_cache_push(e);
+  path_cache.count++;
+}
+
+/* dir is a prefix of p ending at a component boundary */
+static BOOL
+path_cache_within(const char* p, size_t len, const char* dir, size_t dirlen) {
+  while(dirlen > 0 && path_issep(dir[dirlen - 1]))
+    dirlen--;
+
+  if(len < dirlen || memcmp(p, dir, dirlen))
+    return FALSE;
+
+  return len == dirlen || path_issep(p[dirlen]);
+}
+
+/**
+ * Sets the number of resolved paths remembered by path_resolve3() and
+ * path_realpath3() on this thread. 0 disables the cache. Existing entries
+ * are dropped.
+ */
+BOOL
+path_cache_enable(size_t capacity) {
+  size_t n = 16;
+
+  path_cache_clear();
+  free(path_cache.buckets);
+  memset(&path_cache, 0, sizeof(path_cache));
+
+  if(capacity == 0)
+    return TRUE;
+
+  while(n < capacity)
+    n <<= 1;
+
+  if(!(path_cache.buckets = calloc(n, sizeof(PathCacheEntry*))))
+    return FALSE;
+
+  path_cache.capacity = capacity;
+  path_cache.mask = n - 1;
+  return TRUE;
+}
+
+/**
+ * Drops every cached path.
+ */
+void
+path_cache_clear(void) {
+  PathCacheEntry *e, *next;
+
+  for(e = path_cache.head; e; e = next) {
+    next = e->next;
+    free(e);
+  }
+
+  if(path_cache.buckets)
+    memset(path_cache.buckets, 0, (path_cache.mask + 1) * sizeof(PathCacheEntry*));
+
+  path_cache.head = path_cache.tail = 0;
+  path_cache.count = 0;
+}
+
+/**
+ * Drops cached paths whose input or result lies at or below dir; an
+ * empty dir drops everything. Returns how many were dropped.
+ */
+size_t
+path_cache_invalidate(const char* dir, size_t dirlen) {
+  PathCacheEntry *e, *next;
+  size_t n = 0;
+
+  for(e = path_cache.head; e; e = next) {
+    next = e->next;
+
+    if(path_cache_within(e->key, e->keylen, dir, dirlen) || path_cache_within(e->value, e->len, dir, dirlen)) {
+      path_cache_unlink(e);
+      free(e);
+      n++;
+    }
+  }
+
+  return n;
+}
+
+void
+path_cache_stats(PathCacheStats* st) {
+  st->size = path_cache.count;
+  st->capacity = path_cache.capacity;
+  st->hits = path_cache.hits;
+  st->misses = path_cache.misses;
+}
+
+static int
+path_resolve_db(const char* path, DynBuf* db, int symbolic) {
   size_t n;
   struct stat st;
   int ret = 1;
@@ -1032,7 +1636,7 @@ start:
         db->size = path_right2((const char*)db->buf, db->size);
         buf[n] = '\0';
 
-        if(!(rret = path_resolve3(buf, db, symbolic)))
+        if(!(rret = path_resolve_db(buf, db, symbolic)))
           return 0;
       }
     }
@@ -1044,6 +1648,31 @@ start:
   return ret;
 }
 
+/**
+ * Appends path with every symlink followed to db. Absolute paths resolved
+ * into an empty db are served from the path cache when it is enabled.
+ */
+int
+path_resolve3(const char* path, DynBuf* db, int symbolic) {
+  PathCacheEntry* e;
+  size_t len;
+  int ret;
+
+  if(db->size || !path_cache.capacity || !path_isabsolute1(path))
+    return path_resolve_db(path, db, symbolic);
+
+  len = strlen(path);
+
+  if((e = path_cache_find(symbolic ? PATH_CACHE_SYMBOLIC : PATH_CACHE_RESOLVE, path, len))) {
+    dbuf_put(db, (const uint8_t*)e->value, e->len);
+    return e->ret;
+  }
+
+  ret = path_resolve_db(path, db, symbolic);
+  path_cache_store(symbolic ? PATH_CACHE_SYMBOLIC : PATH_CACHE_RESOLVE, path, len, db->buf, db->size, ret);
+  return ret;
+}
+
 char*
 path_resolve2(const char* path, int symbolic) {
   DynBuf db;
@@ -1057,12 +1686,22 @@ int
 path_realpath3(const char* path, size_t len, DynBuf* buf) {
   int ret;
   DynBuf db;
-  if(!path_exists2(path, len))
-    return 0;
+  PathCacheEntry* e;
+  size_t start = buf->size;
+
   dbuf_init2(&db, 0, 0);
   path_absolute3(path, len, &db);
   dbuf_0(&db);
-  ret = path_resolve3((const char*)db.buf, buf, 1);
+
+  /* keyed on the absolute path, so a chdir() never yields a stale hit */
+  if((e = path_cache_find(PATH_CACHE_REALPATH, (const char*)db.buf, db.size))) {
+    dbuf_put(buf, (const uint8_t*)e->value, e->len);
+    ret = e->ret;
+  } else {
+    ret = path_exists2((const char*)db.buf, db.size) ? path_resolve_db((const char*)db.buf, buf, 1) : 0;
+    path_cache_store(PATH_CACHE_REALPATH, (const char*)db.buf, db.size, buf->buf + start, buf->size - start, ret);
+  }
+
   dbuf_free(&db);
   dbuf_0(buf);
   return ret;
@@ -4,6 +4,7 @@
 #include "utils.h"
 #include "buffer-utils.h"
 #include "debug.h"
+#include "quickjs-internal.h"
 
 static JSAtom deref_key(JSContext* ctx, JSValueConst obj, JSAtom atom);
 static JSValue deref_value(JSContext* ctx, JSValueConst obj, JSAtom atom);
@@ -384,13 +385,79 @@ pointer_pushfree(Pointer* ptr, JSValue item, JSContext* ctx) {
   JS_FreeValue(ctx, item);
 }
 
+/**
+ * Gets property \p atom of \p obj, reading plain own data properties and
+ * fast array elements straight from the object. \p slot remembers where the
+ * property was found last time. The guess is checked against the object's
+ * current shape, so objects built the same way reuse it and skip the hash
+ * lookup. Everything else goes through deref_value().
+ */
+static JSValue
+pointer_get_cached(JSContext* ctx, JSValueConst obj, JSAtom atom, int32_t* slot) {
+  JSObject* p;
+  JSShape* sh;
+  JSShapeProperty* prs = 0;
+
+  if(JS_VALUE_GET_TAG(obj) != JS_TAG_OBJECT)
+    return deref_value(ctx, obj, atom);
+
+  p = JS_VALUE_GET_OBJ(obj);
+
+  if(p->fast_array && (p->class_id == JS_CLASS_ARRAY || p->class_id == JS_CLASS_ARGUMENTS) && JS_ATOM_ISINT(atom)) {
+    uint32_t idx = atom & JS_ATOM_MAX_INT;
+
+    if(idx < p->u.array.count)
+      return JS_DupValue(ctx, p->u.array.u.values[idx]);
+
+    return deref_value(ctx, obj, atom);
+  }
+
+  if(p->is_exotic)
+    return deref_value(ctx, obj, atom);
+
+  sh = p->shape;
+
+  if(slot && *slot >= 0 && *slot < sh->prop_count && sh->prop[*slot].atom == atom) {
+    prs = &sh->prop[*slot];
+  } else {
+    uint32_t h = ((uint32_t*)sh)[-(int32_t)(atom & sh->prop_hash_mask) - 1];
+
+    while(h) {
+      if(sh->prop[h - 1].atom == atom) {
+        prs = &sh->prop[h - 1];
+        break;
+      }
+
+      h = sh->prop[h - 1].hash_next;
+    }
+  }
+
+  if(prs && (prs->flags & JS_PROP_TMASK) == JS_PROP_NORMAL) {
+    if(slot)
+      *slot = prs - sh->prop;
+
+    return JS_DupValue(ctx, p->prop[prs - sh->prop].u.value);
+  }
+
+  return deref_value(ctx, obj, atom);
+}
+
 JSValue
 pointer_deref(Pointer const* ptr, JSValueConst arg, JSContext* ctx) {
+  return pointer_deref_cached(ptr, 0, arg, ctx);
+}
+
+/**
+ * Like pointer_deref(), \p slots is an optional cache of one property slot
+ * per pointer element, initialized to -1.
+ */
+JSValue
+pointer_deref_cached(Pointer const* ptr, int32_t* slots, JSValueConst arg, JSContext* ctx) {
   size_t i;
   JSValue obj = JS_DupValue(ctx, arg);
 
   for(i = 0; i < ptr->n; i++) {
-    JSValue child = deref_value(ctx, obj, ptr->atoms[i]);
+    JSValue child = pointer_get_cached(ctx, obj, ptr->atoms[i], slots ? &slots[i] : 0);
 
     JS_FreeValue(ctx, obj);
 
@@ -530,6 +597,120 @@ pointer_toarray(Pointer const* ptr, JSContext* ctx) {
   return array;
 }
 
+void
+pointerset_init(PointerSet* set, JSRuntime* rt) {
+  PointerSetNode* root;
+
+  vector_init_rt(&set->nodes, rt);
+  vector_init_rt(&set->ends, rt);
+
+  if((root = vector_emplace(&set->nodes, sizeof(PointerSetNode))))
+    *root = (PointerSetNode){JS_ATOM_NULL, -1, 0, 0, 0};
+}
+
+void
+pointerset_reset(PointerSet* set, JSRuntime* rt) {
+  PointerSetNode* node;
+
+  vector_foreach_t(&set->nodes, node) {
+    if(node->atom != JS_ATOM_NULL)
+      JS_FreeAtomRT(rt, node->atom);
+  }
+
+  vector_free(&set->nodes);
+  vector_free(&set->ends);
+}
+
+/**
+ * Inserts \p ptr into the trie, sharing the nodes of any common prefix.
+ *
+ * @return  index of the pointer in the results of pointerset_deref(), or -1
+ */
+int32_t
+pointerset_add(PointerSet* set, Pointer const* ptr, JSContext* ctx) {
+  uint32_t i, index = 0;
+
+  if(vector_empty(&set->nodes))
+    return -1;
+
+  for(i = 0; i < ptr->n; i++) {
+    PointerSetNode* node = vector_at(&set->nodes, sizeof(PointerSetNode), index);
+    uint32_t child;
+
+    for(child = node->first_child; child; child = ((PointerSetNode*)vector_at(&set->nodes, sizeof(PointerSetNode), child))->next_sibling)
+      if(((PointerSetNode*)vector_at(&set->nodes, sizeof(PointerSetNode), child))->atom == ptr->atoms[i])
+        break;
+
+    if(!child) {
+      PointerSetNode* new_node;
+
+      child = vector_size(&set->nodes, sizeof(PointerSetNode));
+
+      if(!(new_node = vector_emplace(&set->nodes, sizeof(PointerSetNode))))
+        return -1;
+
+      /* the vector may have moved */
+      node = vector_at(&set->nodes, sizeof(PointerSetNode), index);
+
+      *new_node = (PointerSetNode){JS_DupAtom(ctx, ptr->atoms[i]), -1, index, 0, node->first_child};
+      node->first_child = child;
+    }
+
+    index = child;
+  }
+
+  if(!vector_push(&set->ends, index))
+    return -1;
+
+  return pointerset_size(set) - 1;
+}
+
+/**
+ * Dereferences all pointers of the set against \p arg, looking up every
+ * shared prefix only once.
+ *
+ * @return  array with the value of the n-th added pointer at index n,
+ *          undefined where it does not resolve
+ */
+JSValue
+pointerset_deref(PointerSet* set, JSValueConst arg, JSContext* ctx) {
+  uint32_t i, n = vector_size(&set->nodes, sizeof(PointerSetNode)), nends = pointerset_size(set);
+  PointerSetNode* nodes = vector_begin(&set->nodes);
+  uint32_t* ends = vector_begin(&set->ends);
+  JSValue *values, ret;
+
+  if(!(values = js_malloc(ctx, sizeof(JSValue) * MAX_NUM(n, 1))))
+    return JS_EXCEPTION;
+
+  values[0] = JS_DupValue(ctx, arg);
+
+  /* parents always precede their children */
+  for(i = 1; i < n; i++) {
+    JSValueConst parent = values[nodes[i].parent];
+
+    if(JS_IsUndefined(parent) || JS_IsNull(parent)) {
+      values[i] = JS_UNDEFINED;
+      continue;
+    }
+
+    values[i] = pointer_get_cached(ctx, parent, nodes[i].atom, &nodes[i].slot);
+
+    if(JS_IsException(values[i])) {
+      JS_FreeValue(ctx, JS_GetException(ctx));
+      values[i] = JS_UNDEFINED;
+    }
+  }
+
+  ret = JS_NewArray(ctx);
+
+  for(i = 0; i < nends; i++)
+    JS_SetPropertyUint32(ctx, ret, i, JS_DupValue(ctx, values[ends[i]]));
+
+  js_values_free(JS_GetRuntime(ctx), n, values);
+
+  return ret;
+}
+
 /**
  * @}
  */
@@ -24,6 +24,83 @@ utf8_to_unicode(const char* str, size_t len, Vector* out) {
   return vector_size(out, sizeof(uint32_t));
 }
 
+static int
+predicate_codepoint_cmp(const void* a, const void* b) {
+  uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+
+  return x < y ? -1 : x > y;
+}
+
+/**
+ * Turns the set into a bitmap for code points below 256 and a sorted
+ * table of merged ranges for the others.
+ */
+static BOOL
+predicate_charset_build(CharsetPredicate* cs, JSContext* ctx) {
+  uint32_t* codepoints;
+  size_t i, n;
+
+  if(cs->chars.size == 0 && cs->chars.data == 0) {
+    vector_init(&cs->chars, ctx);
+    utf8_to_unicode(cs->set, cs->len, &cs->chars);
+  }
+
+  n = vector_size(&cs->chars, sizeof(uint32_t));
+
+  if(!(codepoints = js_malloc(ctx, MAX_NUM(n, 1) * sizeof(uint32_t))))
+    return FALSE;
+
+  if(!(cs->ranges = js_malloc(ctx, MAX_NUM(n, 1) * sizeof(*cs->ranges)))) {
+    js_free(ctx, codepoints);
+    return FALSE;
+  }
+
+  memcpy(codepoints, vector_begin(&cs->chars), n * sizeof(uint32_t));
+  qsort(codepoints, n, sizeof(uint32_t), predicate_codepoint_cmp);
+
+  memset(cs->latin1, 0, sizeof(cs->latin1));
+  cs->nranges = 0;
+
+  for(i = 0; i < n; i++) {
+    uint32_t cp = codepoints[i];
+
+    if(cp < 256)
+      cs->latin1[cp >> 5] |= 1u << (cp & 31);
+    else if(cs->nranges && cp <= cs->ranges[cs->nranges - 1][1] + 1)
+      cs->ranges[cs->nranges - 1][1] = cp;
+    else {
+      cs->ranges[cs->nranges][0] = cp;
+      cs->ranges[cs->nranges][1] = cp;
+      cs->nranges++;
+    }
+  }
+
+  js_free(ctx, codepoints);
+  cs->built = TRUE;
+  return TRUE;
+}
+
+static inline BOOL
+predicate_charset_has(const CharsetPredicate* cs, uint32_t cp) {
+  size_t lo = 0, hi = cs->nranges;
+
+  if(cp < 256)
+    return (cs->latin1[cp >> 5] >> (cp & 31)) & 1;
+
+  while(lo < hi) {
+    size_t mid = (lo + hi) / 2;
+
+    if(cp < cs->ranges[mid][0])
+      hi = mid;
+    else if(cp > cs->ranges[mid][1])
+      lo = mid + 1;
+    else
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
 static void
 free_arraybuffer_slice(JSRuntime* rt, void* opaque, void* ptr) {
   JSValue obj = JS_MKPTR(JS_TAG_OBJECT, opaque);
@@ -62,8 +139,8 @@ predicate_callable(JSContext* ctx, JSValueConst value) {
   return predicate_is(value) || JS_IsFunction(ctx, value);
 }
 
-JSValue
-predicate_eval(Predicate* pr, JSContext* ctx, JSArguments* args) {
+static JSValue
+predicate_walk(Predicate* pr, JSContext* ctx, JSArguments* args) {
   JSValue ret = JS_UNDEFINED;
 
   switch(pr->id) {
@@ -75,19 +152,33 @@ predicate_eval(Predicate* pr, JSContext* ctx, JSArguments* args) {
 
     case PREDICATE_CHARSET: {
       InputBuffer input = js_input_chars(ctx, js_arguments_at(args, 0));
-      if(pr->charset.chars.size == 0 && pr->charset.chars.data == 0) {
-        vector_init(&pr->charset.chars, ctx);
-        utf8_to_unicode(pr->charset.set, pr->charset.len, &pr->charset.chars);
+      const uint8_t *p = input.data, *end = p + input.size, *next;
+
+      if(!pr->charset.built && !predicate_charset_build(&pr->charset, ctx)) {
+        input_buffer_free(&input, ctx);
+        ret = JS_EXCEPTION;
+        break;
       }
+
       ret = JS_NewInt32(ctx, 1);
-      while(!input_buffer_eof(&input)) {
-        uint32_t codepoint = input_buffer_getc(&input);
-        ssize_t idx = vector_find(&pr->charset.chars, sizeof(uint32_t), &codepoint);
-        if(idx == -1) {
+
+      for(; p < end; p = next) {
+        int32_t codepoint;
+
+        if(*p < 0x80) {
+          codepoint = *p;
+          next = p + 1;
+        } else if((codepoint = unicode_from_utf8(p, end - p, &next)) < 0 || next <= p) {
+          codepoint = -1;
+          next = p + 1;
+        }
+
+        if(codepoint < 0 || !predicate_charset_has(&pr->charset, codepoint)) {
           ret = JS_NewInt32(ctx, 0);
           break;
         }
       }
+
       input_buffer_free(&input, ctx);
       break;
     }
@@ -95,10 +186,11 @@ predicate_eval(Predicate* pr, JSContext* ctx, JSArguments* args) {
     case PREDICATE_STRING: {
       InputBuffer input = js_input_chars(ctx, js_arguments_at(args, 0));
 
-      if(input.size == pr->string.len) 
+      if(input.size == pr->string.len)
         if(!memcmp(input.data, pr->string.str, pr->string.len))
           ret = JS_NewBool(ctx, TRUE); // JS_NewInt32(ctx, 1);
 
+      input_buffer_free(&input, ctx);
       break;
     }
 
@@ -397,6 +489,1140 @@ predicate_value(JSContext* ctx, JSValueConst value, JSArguments* args) {
   return ret;
 }
 
+/**
+ * Compiled predicates: the tree is flattened into a linear program for a
+ * small stack machine. Sub-predicates are inlined, property atoms are
+ * resolved at compile time and subtrees over primitive constants are
+ * folded. Node types without an opcode of their own are evaluated with
+ * predicate_walk() from within the program.
+ */
+enum PredicateOpcode {
+  OP_CONST = 0,
+  OP_ARG_VALUE,
+  OP_CALL_ARGS,
+  OP_CALL1,
+  OP_WALK,
+  OP_TYPE,
+  OP_NOT,
+  OP_NOTNOT,
+  OP_BNOT,
+  OP_SQRT,
+  OP_ARITH,
+  OP_XOR,
+  OP_JUMP_IF_TRUE,
+  OP_JUMP_IF_FALSE,
+  OP_INSTANCEOF,
+  OP_PROTOTYPEIS,
+  OP_EQUAL,
+  OP_HAS,
+  OP_GET_PROPERTY,
+  OP_UNDEFINED,
+  OP_ENTER,
+  OP_SHIFT,
+  OP_LEAVE,
+};
+
+typedef struct {
+  enum PredicateOpcode op;
+  int32_t arg, target;
+  union {
+    JSValue value;
+    JSAtom atom;
+    Predicate* pr;
+  };
+} PredicateInstr;
+
+struct predicate_program {
+  size_t size;
+  int max_stack, max_frames;
+  PredicateInstr code[];
+};
+
+typedef struct {
+  JSArguments args;
+  JSValue value;
+} PredicateFrame;
+
+typedef struct {
+  JSContext* ctx;
+  PredicateInstr* code;
+  size_t size, capacity;
+  int stack, max_stack, frames, max_frames, nesting;
+} PredicateCompiler;
+
+/* deeper trees are evaluated by predicate_walk() below this level */
+#define PREDICATE_COMPILE_NESTING 64
+
+static void
+predicate_instr_free(PredicateInstr* in, JSRuntime* rt) {
+  switch(in->op) {
+    case OP_CONST:
+    case OP_CALL_ARGS:
+    case OP_CALL1:
+    case OP_INSTANCEOF:
+    case OP_PROTOTYPEIS:
+    case OP_EQUAL: JS_FreeValueRT(rt, in->value); break;
+    case OP_HAS:
+    case OP_GET_PROPERTY: JS_FreeAtomRT(rt, in->atom); break;
+    default: break;
+  }
+}
+
+static JSValue
+predicate_run(const PredicateInstr* code, size_t start, size_t end, int max_stack, int max_frames, JSContext* ctx, JSArguments* args) {
+  JSValue stack[max_stack], *sp = stack, v;
+  PredicateFrame frames[max_frames + 1], *fp = frames;
+  size_t pc;
+
+  fp->args = *args;
+  fp->value = JS_UNDEFINED;
+
+#define PUSH(expr) \
+  do { \
+    if(JS_IsException((v = (expr)))) \
+      goto fail; \
+    *sp++ = v; \
+  } while(0)
+
+  for(pc = start; pc < end; pc++) {
+    const PredicateInstr* in = &code[pc];
+
+    switch(in->op) {
+      case OP_CONST: {
+        *sp++ = JS_DupValue(ctx, in->value);
+        break;
+      }
+
+      case OP_ARG_VALUE: {
+        PUSH(predicate_value(ctx, js_arguments_at(&fp->args, in->arg), &fp->args));
+        break;
+      }
+
+      case OP_CALL_ARGS: {
+        PUSH(JS_Call(ctx, in->value, JS_UNDEFINED, js_arguments_count(&fp->args), fp->args.v + fp->args.p));
+        break;
+      }
+
+      case OP_CALL1: {
+        v = JS_Call(ctx, in->value, JS_UNDEFINED, 1, &sp[-1]);
+        JS_FreeValue(ctx, sp[-1]);
+        sp[-1] = v;
+
+        if(JS_IsException(v)) {
+          --sp;
+          goto fail;
+        }
+
+        break;
+      }
+
+      case OP_WALK: {
+        PUSH(predicate_walk(in->pr, ctx, &fp->args));
+        break;
+      }
+
+      case OP_TYPE: {
+        *sp++ = JS_NewBool(ctx, !!(js_value_type(ctx, js_arguments_at(&fp->args, 0)) & in->arg));
+        break;
+      }
+
+      case OP_NOT:
+      case OP_NOTNOT: {
+        BOOL b = JS_ToBool(ctx, sp[-1]);
+
+        JS_FreeValue(ctx, sp[-1]);
+        sp[-1] = JS_NewBool(ctx, in->op == OP_NOT ? !b : b);
+        break;
+      }
+
+      case OP_BNOT: {
+        sp[-1] = JS_NewInt64(ctx, ~js_value_toint64_free(ctx, sp[-1]));
+        break;
+      }
+
+      case OP_SQRT: {
+        sp[-1] = JS_NewFloat64(ctx, sqrt(js_value_todouble_free(ctx, sp[-1])));
+        break;
+      }
+
+      case OP_ARITH: {
+        double left = js_value_todouble_free(ctx, sp[-2]), right = js_value_todouble_free(ctx, sp[-1]), r;
+
+        switch(in->arg) {
+          case PREDICATE_ADD: r = left + right; break;
+          case PREDICATE_SUB: r = left - right; break;
+          case PREDICATE_MUL: r = left * right; break;
+          case PREDICATE_DIV: r = left / right; break;
+          case PREDICATE_MOD: r = fmod(left, right); break;
+          case PREDICATE_BOR: r = (uint64_t)left | (uint64_t)right; break;
+          case PREDICATE_BAND: r = (uint64_t)left & (uint64_t)right; break;
+          case PREDICATE_POW: r = pow(left, right); break;
+          case PREDICATE_ATAN2: r = atan2(left, right); break;
+          default: r = nan(""); break;
+        }
+
+        --sp;
+        sp[-1] = JS_NewFloat64(ctx, r);
+        break;
+      }
+
+      case OP_XOR: {
+        int64_t left = js_value_toint64_free(ctx, sp[-2]), right = js_value_toint64_free(ctx, sp[-1]);
+
+        --sp;
+        sp[-1] = JS_NewInt64(ctx, left ^ right);
+        break;
+      }
+
+      case OP_JUMP_IF_TRUE:
+      case OP_JUMP_IF_FALSE: {
+        if(JS_ToBool(ctx, sp[-1]) == (in->op == OP_JUMP_IF_TRUE))
+          pc = in->target - 1;
+        else
+          JS_FreeValue(ctx, *--sp);
+
+        break;
+      }
+
+      case OP_INSTANCEOF: {
+        *sp++ = JS_NewBool(ctx, JS_IsInstanceOf(ctx, js_arguments_at(&fp->args, 0), in->value));
+        break;
+      }
+
+      case OP_PROTOTYPEIS: {
+        JSValue proto = JS_GetPrototype(ctx, js_arguments_at(&fp->args, 0));
+
+        *sp++ = JS_NewBool(ctx, JS_VALUE_GET_OBJ(proto) == JS_VALUE_GET_OBJ(in->value));
+        break;
+      }
+
+      case OP_EQUAL: {
+        *sp++ = JS_NewBool(ctx, js_value_equals(ctx, js_arguments_at(&fp->args, 0), in->value));
+        break;
+      }
+
+      case OP_HAS: {
+        *sp++ = JS_NewBool(ctx, JS_HasProperty(ctx, js_arguments_at(&fp->args, 0), in->atom));
+        break;
+      }
+
+      case OP_GET_PROPERTY: {
+        PUSH(JS_GetProperty(ctx, js_arguments_at(&fp->args, 0), in->atom));
+        break;
+      }
+
+      case OP_UNDEFINED: {
+        JS_FreeValue(ctx, sp[-1]);
+        sp[-1] = JS_UNDEFINED;
+        break;
+      }
+
+      case OP_ENTER: {
+        ++fp;
+        fp->value = *--sp;
+        fp->args = js_arguments_new(1, &fp->value);
+        break;
+      }
+
+      case OP_SHIFT: {
+        if(in->arg <= fp->args.c) {
+          fp[1].args = fp->args;
+          fp[1].value = JS_UNDEFINED;
+          js_arguments_shiftn(&(++fp)->args, in->arg);
+        } else {
+          *sp++ = JS_UNDEFINED;
+          pc = in->target - 1;
+        }
+
+        break;
+      }
+
+      case OP_LEAVE: {
+        JS_FreeValue(ctx, fp->value);
+        --fp;
+        break;
+      }
+    }
+  }
+
+#undef PUSH
+
+  assert(sp == stack + 1);
+  assert(fp == frames);
+
+  return stack[0];
+
+fail:
+  while(sp > stack)
+    JS_FreeValue(ctx, *--sp);
+
+  for(; fp > frames; --fp)
+    JS_FreeValue(ctx, fp->value);
+
+  return JS_EXCEPTION;
+}
+
+static PredicateInstr*
+predicate_emit(PredicateCompiler* c, enum PredicateOpcode op, int32_t arg, int stack) {
+  PredicateInstr* in;
+
+  if(c->size == c->capacity) {
+    size_t capacity = c->capacity ? c->capacity * 2 : 16;
+
+    if(!(in = js_realloc(c->ctx, c->code, capacity * sizeof(PredicateInstr))))
+      return 0;
+
+    c->code = in;
+    c->capacity = capacity;
+  }
+
+  in = &c->code[c->size++];
+  in->op = op;
+  in->arg = arg;
+  in->target = 0;
+  in->value = JS_UNDEFINED;
+
+  if((c->stack += stack) > c->max_stack)
+    c->max_stack = c->stack;
+
+  return in;
+}
+
+static BOOL
+predicate_emit_value(PredicateCompiler* c, enum PredicateOpcode op, JSValueConst value, int stack) {
+  PredicateInstr* in;
+
+  if(!(in = predicate_emit(c, op, 0, stack)))
+    return FALSE;
+
+  in->value = JS_DupValue(c->ctx, value);
+  return TRUE;
+}
+
+static BOOL
+predicate_emit_atom(PredicateCompiler* c, enum PredicateOpcode op, JSAtom atom) {
+  PredicateInstr* in;
+
+  if(!(in = predicate_emit(c, op, 0, 1)))
+    return FALSE;
+
+  in->atom = JS_DupAtom(c->ctx, atom);
+  return TRUE;
+}
+
+static void
+predicate_frame(PredicateCompiler* c, int delta) {
+  if((c->frames += delta) > c->max_frames)
+    c->max_frames = c->frames;
+}
+
+/* replaces the code from start on by its constant result */
+static void
+predicate_fold(PredicateCompiler* c, size_t start) {
+  JSArguments args = js_arguments_new(0, 0);
+  JSValue value = predicate_run(c->code, start, c->size, c->max_stack, c->max_frames, c->ctx, &args);
+  PredicateInstr* in;
+
+  if(JS_IsException(value)) {
+    JS_FreeValue(c->ctx, JS_GetException(c->ctx));
+    return;
+  }
+
+  while(c->size > start)
+    predicate_instr_free(&c->code[--c->size], JS_GetRuntime(c->ctx));
+
+  in = &c->code[c->size++];
+  in->op = OP_CONST;
+  in->value = value;
+}
+
+static int predicate_compile_node(PredicateCompiler*, Predicate*);
+
+/**
+ * Code for predicate_value(ctx, value, args): returns 1 when the result
+ * is a primitive constant, 0 when not and -1 on failure
+ */
+static int
+predicate_compile_value(PredicateCompiler* c, JSValueConst value) {
+  Predicate* pr;
+
+  if((pr = js_predicate_data(value)))
+    return predicate_compile_node(c, pr);
+
+  if(JS_IsFunction(c->ctx, value))
+    return predicate_emit_value(c, OP_CALL_ARGS, value, 1) ? 0 : -1;
+
+  if(!predicate_emit_value(c, OP_CONST, value, 1))
+    return -1;
+
+  return !JS_IsObject(value);
+}
+
+/* code for predicate_call(ctx, value, 1, &item) with item on the stack */
+static int
+predicate_compile_call1(PredicateCompiler* c, JSValueConst value) {
+  Predicate* pr;
+
+  if((pr = js_predicate_data(value))) {
+    if(!predicate_emit(c, OP_ENTER, 0, -1))
+      return -1;
+
+    predicate_frame(c, 1);
+
+    if(predicate_compile_node(c, pr) < 0)
+      return -1;
+
+    predicate_frame(c, -1);
+    return predicate_emit(c, OP_LEAVE, 0, 0) ? 0 : -1;
+  }
+
+  if(JS_IsFunction(c->ctx, value))
+    return predicate_emit_value(c, OP_CALL1, value, 0) ? 0 : -1;
+
+  return predicate_emit(c, OP_UNDEFINED, 0, 0) ? 0 : -1;
+}
+
+static int
+predicate_compile_node(PredicateCompiler* c, Predicate* pr) {
+  size_t start = c->size;
+  PredicateInstr* in;
+  int r, constant = 0;
+
+  if(++c->nesting > PREDICATE_COMPILE_NESTING)
+    goto walk;
+
+  switch(pr->id) {
+    case PREDICATE_TYPE: {
+      if(!predicate_emit(c, OP_TYPE, pr->type.flags, 1))
+        return -1;
+
+      break;
+    }
+
+    case PREDICATE_NOTNOT:
+    case PREDICATE_NOT:
+    case PREDICATE_BNOT:
+    case PREDICATE_SQRT: {
+      static const enum PredicateOpcode ops[] = {OP_NOTNOT, OP_NOT, OP_BNOT, OP_SQRT};
+
+      if((constant = predicate_compile_value(c, pr->unary.predicate)) < 0 || !predicate_emit(c, ops[pr->id - PREDICATE_NOTNOT], 0, 0))
+        return -1;
+
+      break;
+    }
+
+    case PREDICATE_ADD:
+    case PREDICATE_SUB:
+    case PREDICATE_MUL:
+    case PREDICATE_DIV:
+    case PREDICATE_MOD:
+    case PREDICATE_BOR:
+    case PREDICATE_BAND:
+    case PREDICATE_POW:
+    case PREDICATE_ATAN2: {
+      JSValueConst values[2] = {pr->binary.left, pr->binary.right};
+
+      constant = 1;
+
+      for(int i = 0; i < 2; i++) {
+        if(js_is_null_or_undefined(values[i])) {
+          if(!predicate_emit(c, OP_ARG_VALUE, i, 1))
+            return -1;
+
+          constant = 0;
+        } else {
+          if((r = predicate_compile_value(c, values[i])) < 0)
+            return -1;
+
+          constant &= r;
+        }
+      }
+
+      if(!predicate_emit(c, OP_ARITH, pr->id, -1))
+        return -1;
+
+      break;
+    }
+
+    case PREDICATE_OR:
+    case PREDICATE_AND: {
+      size_t i, n = pr->boolean.npredicates;
+
+      if(n == 0) {
+        if(!predicate_emit_value(c, OP_CONST, JS_UNDEFINED, 1))
+          return -1;
+
+        constant = 1;
+        break;
+      }
+
+      size_t jumps[n];
+
+      constant = 1;
+
+      /* short-circuits with the deciding value left on the stack */
+      for(i = 0; i < n; i++) {
+        if((r = predicate_compile_value(c, pr->boolean.predicates[i])) < 0)
+          return -1;
+
+        constant &= r;
+        jumps[i] = c->size;
+
+        if(i + 1 < n && !predicate_emit(c, pr->id == PREDICATE_OR ? OP_JUMP_IF_TRUE : OP_JUMP_IF_FALSE, 0, -1))
+          return -1;
+      }
+
+      for(i = 0; i + 1 < n; i++)
+        c->code[jumps[i]].target = c->size;
+
+      break;
+    }
+
+    case PREDICATE_XOR: {
+      if(!predicate_emit_value(c, OP_CONST, JS_NewInt64(c->ctx, 0), 1))
+        return -1;
+
+      constant = 1;
+
+      for(size_t i = 0; i < pr->boolean.npredicates; i++) {
+        if((r = predicate_compile_value(c, pr->boolean.predicates[i])) < 0 || !predicate_emit(c, OP_XOR, 0, -1))
+          return -1;
+
+        constant &= r;
+      }
+
+      break;
+    }
+
+    case PREDICATE_INSTANCEOF:
+    case PREDICATE_PROTOTYPEIS:
+    case PREDICATE_EQUAL: {
+      enum PredicateOpcode op = pr->id == PREDICATE_INSTANCEOF ? OP_INSTANCEOF : pr->id == PREDICATE_PROTOTYPEIS ? OP_PROTOTYPEIS : OP_EQUAL;
+
+      if(!predicate_emit_value(c, op, pr->unary.predicate, 1))
+        return -1;
+
+      break;
+    }
+
+    case PREDICATE_HAS: {
+      if(!predicate_emit_atom(c, OP_HAS, pr->property.atom))
+        return -1;
+
+      break;
+    }
+
+    case PREDICATE_PROPERTY: {
+      if(!predicate_emit_atom(c, OP_GET_PROPERTY, pr->property.atom) || predicate_compile_call1(c, pr->property.predicate) < 0)
+        return -1;
+
+      break;
+    }
+
+    case PREDICATE_SHIFT: {
+      size_t shift = c->size;
+
+      if(!predicate_emit(c, OP_SHIFT, pr->shift.n, 0))
+        return -1;
+
+      predicate_frame(c, 1);
+
+      if(predicate_compile_value(c, pr->shift.predicate) < 0 || !predicate_emit(c, OP_LEAVE, 0, 0))
+        return -1;
+
+      predicate_frame(c, -1);
+      c->code[shift].target = c->size;
+      break;
+    }
+
+    default: {
+      goto walk;
+    }
+  }
+
+  --c->nesting;
+
+  if(constant && c->size - start > 1)
+    predicate_fold(c, start);
+
+  return constant;
+
+walk:
+  --c->nesting;
+
+  if(!(in = predicate_emit(c, OP_WALK, 0, 1)))
+    return -1;
+
+  in->pr = pr;
+  return 0;
+}
+
+/**
+ * Compiles the predicate so that predicate_eval() runs it as a flat
+ * program. Returns 0 on success and -1 on failure.
+ */
+int
+predicate_compile(Predicate* pr, JSContext* ctx) {
+  PredicateCompiler c = {ctx, 0, 0, 0, 0, 0, 0, 0, 0};
+  PredicateProgram* prog;
+
+  if(pr->program)
+    return 0;
+
+  if(predicate_compile_node(&c, pr) < 0)
+    goto fail;
+
+  if(!(prog = js_malloc(ctx, sizeof(PredicateProgram) + c.size * sizeof(PredicateInstr))))
+    goto fail;
+
+  prog->size = c.size;
+  prog->max_stack = c.max_stack;
+  prog->max_frames = c.max_frames;
+  memcpy(prog->code, c.code, c.size * sizeof(PredicateInstr));
+  js_free(ctx, c.code);
+
+  pr->program = prog;
+  return 0;
+
+fail:
+  while(c.size > 0)
+    predicate_instr_free(&c.code[--c.size], JS_GetRuntime(ctx));
+
+  js_free(ctx, c.code);
+  return -1;
+}
+
+static void
+predicate_program_free(PredicateProgram* prog, JSRuntime* rt) {
+  for(size_t i = 0; i < prog->size; i++)
+    predicate_instr_free(&prog->code[i], rt);
+
+  js_free_rt(rt, prog);
+}
+
+JSValue
+predicate_eval(Predicate* pr, JSContext* ctx, JSArguments* args) {
+  PredicateProgram* prog;
+
+  if((prog = pr->program))
+    return predicate_run(prog->code, 0, prog->size, prog->max_stack, prog->max_frames, ctx, args);
+
+  return predicate_walk(pr, ctx, args);
+}
+
+/**
+ * Numeric kernels: predicates that only do arithmetic, logic and
+ * comparisons on numbers are translated to operations on blocks of
+ * PREDICATE_KERNEL_BLOCK doubles, so a whole typed array is tested
+ * without creating a JSValue per element. Each operation is a plain loop
+ * over the block, which the compiler vectorizes.
+ *
+ * Arguments are (element, index), as for Array.prototype.filter.
+ */
+enum PredicateKernelOp {
+  KERNEL_ELEMENT = 0,
+  KERNEL_INDEX,
+  KERNEL_CONST,
+  KERNEL_TYPE,
+  KERNEL_EQUAL,
+  KERNEL_NOT,
+  KERNEL_NOTNOT,
+  KERNEL_BNOT,
+  KERNEL_SQRT,
+  KERNEL_ARITH,
+  KERNEL_AND,
+  KERNEL_OR,
+  KERNEL_XOR,
+};
+
+/* how the constant of an equal() kernel compares to elements */
+enum {
+  KERNEL_EQUAL_INT = 0,
+  KERNEL_EQUAL_FLOAT,
+  KERNEL_EQUAL_NAN,
+};
+
+typedef struct {
+  enum PredicateKernelOp op;
+  int32_t arg;
+  double value;
+} PredicateKernelInstr;
+
+struct predicate_kernel {
+  size_t size;
+  int max_stack;
+  PredicateKernelInstr code[];
+};
+
+typedef struct {
+  JSContext* ctx;
+  PredicateKernelInstr* code;
+  size_t size, capacity;
+  int stack, max_stack, nesting;
+} PredicateKernelCompiler;
+
+static inline BOOL
+kernel_truthy(double x) {
+  return x == x && x != 0;
+}
+
+/* JS_ToInt64() of a double */
+static inline int64_t
+kernel_toint64(double x) {
+  uint64_t u;
+
+  if(fabs(x) < 9223372036854775808.0)
+    return (int64_t)x;
+
+  if(!isfinite(x))
+    return 0;
+
+  u = (uint64_t)fmod(fabs(x), 18446744073709551616.0);
+  return (int64_t)(x < 0 ? -u : u);
+}
+
+static BOOL
+kernel_emit(PredicateKernelCompiler* c, enum PredicateKernelOp op, int32_t arg, double value, int stack) {
+  PredicateKernelInstr* in;
+
+  if(c->size == c->capacity) {
+    size_t capacity = c->capacity ? c->capacity * 2 : 16;
+
+    if(!(in = js_realloc(c->ctx, c->code, capacity * sizeof(PredicateKernelInstr))))
+      return FALSE;
+
+    c->code = in;
+    c->capacity = capacity;
+  }
+
+  in = &c->code[c->size++];
+  in->op = op;
+  in->arg = arg;
+  in->value = value;
+
+  if((c->stack += stack) > c->max_stack)
+    c->max_stack = c->stack;
+
+  return TRUE;
+}
+
+static BOOL kernel_compile_node(PredicateKernelCompiler*, const Predicate*);
+
+/* a number for predicate_value(), or FALSE when it is not numeric */
+static BOOL
+kernel_compile_value(PredicateKernelCompiler* c, JSValueConst value) {
+  Predicate* pr;
+
+  if((pr = js_predicate_data(value)))
+    return kernel_compile_node(c, pr);
+
+  switch(JS_VALUE_GET_TAG(value)) {
+    case JS_TAG_INT: return kernel_emit(c, KERNEL_CONST, 0, JS_VALUE_GET_INT(value), 1);
+    case JS_TAG_BOOL: return kernel_emit(c, KERNEL_CONST, 0, !!JS_VALUE_GET_BOOL(value), 1);
+    case JS_TAG_NULL: return kernel_emit(c, KERNEL_CONST, 0, 0, 1);
+    case JS_TAG_UNDEFINED: return kernel_emit(c, KERNEL_CONST, 0, NAN, 1);
+    case JS_TAG_FLOAT64: return kernel_emit(c, KERNEL_CONST, 0, JS_VALUE_GET_FLOAT64(value), 1);
+  }
+
+  return FALSE;
+}
+
+static BOOL
+kernel_compile_node(PredicateKernelCompiler* c, const Predicate* pr) {
+  BOOL ret = FALSE;
+
+  if(++c->nesting > PREDICATE_COMPILE_NESTING)
+    return FALSE;
+
+  switch(pr->id) {
+    case PREDICATE_TYPE: {
+      ret = kernel_emit(c, KERNEL_TYPE, pr->type.flags, 0, 1);
+      break;
+    }
+
+    case PREDICATE_EQUAL: {
+      JSValueConst value = pr->unary.predicate;
+
+      if(JS_VALUE_IS_NAN(value))
+        ret = kernel_emit(c, KERNEL_EQUAL, KERNEL_EQUAL_NAN, 0, 1);
+      else if(JS_VALUE_GET_TAG(value) == JS_TAG_INT)
+        ret = kernel_emit(c, KERNEL_EQUAL, KERNEL_EQUAL_INT, JS_VALUE_GET_INT(value), 1);
+      else if(JS_VALUE_GET_TAG(value) == JS_TAG_FLOAT64)
+        ret = kernel_emit(c, KERNEL_EQUAL, KERNEL_EQUAL_FLOAT, JS_VALUE_GET_FLOAT64(value), 1);
+      else if(!JS_IsObject(value))
+        /* a number never equals another type */
+        ret = kernel_emit(c, KERNEL_CONST, 0, 0, 1);
+
+      break;
+    }
+
+    case PREDICATE_NOTNOT:
+    case PREDICATE_NOT:
+    case PREDICATE_BNOT:
+    case PREDICATE_SQRT: {
+      static const enum PredicateKernelOp ops[] = {KERNEL_NOTNOT, KERNEL_NOT, KERNEL_BNOT, KERNEL_SQRT};
+
+      ret = kernel_compile_value(c, pr->unary.predicate) && kernel_emit(c, ops[pr->id - PREDICATE_NOTNOT], 0, 0, 0);
+      break;
+    }
+
+    case PREDICATE_ADD:
+    case PREDICATE_SUB:
+    case PREDICATE_MUL:
+    case PREDICATE_DIV:
+    case PREDICATE_MOD:
+    case PREDICATE_BOR:
+    case PREDICATE_BAND:
+    case PREDICATE_POW:
+    case PREDICATE_ATAN2: {
+      JSValueConst values[2] = {pr->binary.left, pr->binary.right};
+
+      ret = TRUE;
+
+      for(int i = 0; ret && i < 2; i++)
+        ret = js_is_null_or_undefined(values[i]) ? kernel_emit(c, i ? KERNEL_INDEX : KERNEL_ELEMENT, 0, 0, 1) : kernel_compile_value(c, values[i]);
+
+      ret = ret && kernel_emit(c, KERNEL_ARITH, pr->id, 0, -1);
+      break;
+    }
+
+    case PREDICATE_OR:
+    case PREDICATE_AND:
+    case PREDICATE_XOR: {
+      size_t n = pr->boolean.npredicates;
+      enum PredicateKernelOp op = pr->id == PREDICATE_OR ? KERNEL_OR : pr->id == PREDICATE_AND ? KERNEL_AND : KERNEL_XOR;
+
+      if(op == KERNEL_XOR)
+        ret = kernel_emit(c, KERNEL_CONST, 0, 0, 1);
+      else if(n == 0)
+        ret = kernel_emit(c, KERNEL_CONST, 0, NAN, 1);
+      else
+        ret = TRUE;
+
+      /* folded pairwise, which keeps the short-circuit result */
+      for(size_t i = 0; ret && i < n; i++) {
+        ret = kernel_compile_value(c, pr->boolean.predicates[i]);
+
+        if(ret && (i > 0 || op == KERNEL_XOR))
+          ret = kernel_emit(c, op, 0, 0, -1);
+      }
+
+      break;
+    }
+
+    default: {
+      break;
+    }
+  }
+
+  --c->nesting;
+  return ret;
+}
+
+/**
+ * Numeric kernel for the predicate, or NULL when it needs JSValues.
+ */
+PredicateKernel*
+predicate_kernel_new(const Predicate* pr, JSContext* ctx) {
+  PredicateKernelCompiler c = {ctx, 0, 0, 0, 0, 0, 0};
+  PredicateKernel* kernel = 0;
+
+  if(kernel_compile_node(&c, pr) && (kernel = js_malloc(ctx, sizeof(PredicateKernel) + c.size * sizeof(PredicateKernelInstr)))) {
+    kernel->size = c.size;
+    kernel->max_stack = c.max_stack;
+    memcpy(kernel->code, c.code, c.size * sizeof(PredicateKernelInstr));
+  }
+
+  js_free(ctx, c.code);
+  return kernel;
+}
+
+void
+predicate_kernel_free(PredicateKernel* kernel, JSContext* ctx) {
+  js_free(ctx, kernel);
+}
+
+/**
+ * Tests n <= PREDICATE_KERNEL_BLOCK elements starting at index offset;
+ * isint tells which of them are int-tagged as JSValues. Sets out[i] to
+ * whether the predicate holds for element i.
+ */
+void
+predicate_kernel_run(const PredicateKernel* kernel, const double* x, const uint8_t* isint, size_t offset, size_t n, uint8_t* out) {
+  double stack[kernel->max_stack][PREDICATE_KERNEL_BLOCK];
+  double(*sp)[PREDICATE_KERNEL_BLOCK] = stack;
+  size_t i;
+
+  for(size_t pc = 0; pc < kernel->size; pc++) {
+    const PredicateKernelInstr* in = &kernel->code[pc];
+    /* b is pushed, a is the top and l the one below */
+    double *b = 0, *a = 0, *l = 0;
+
+    switch(in->op) {
+      case KERNEL_ELEMENT:
+      case KERNEL_INDEX:
+      case KERNEL_CONST:
+      case KERNEL_TYPE:
+      case KERNEL_EQUAL: b = *sp++; break;
+      case KERNEL_ARITH:
+      case KERNEL_AND:
+      case KERNEL_OR:
+      case KERNEL_XOR:
+        a = *--sp;
+        l = sp[-1];
+        break;
+      default: a = sp[-1]; break;
+    }
+
+    switch(in->op) {
+      case KERNEL_ELEMENT: {
+        memcpy(b, x, n * sizeof(double));
+        break;
+      }
+
+      case KERNEL_INDEX: {
+        for(i = 0; i < n; i++)
+          b[i] = offset + i;
+        break;
+      }
+
+      case KERNEL_CONST: {
+        for(i = 0; i < n; i++)
+          b[i] = in->value;
+        break;
+      }
+
+      case KERNEL_TYPE: {
+        for(i = 0; i < n; i++)
+          b[i] = !!(in->arg & (isint[i] ? TYPE_INT : x[i] != x[i] ? TYPE_NAN : TYPE_FLOAT64));
+        break;
+      }
+
+      case KERNEL_EQUAL: {
+        switch(in->arg) {
+          case KERNEL_EQUAL_INT:
+            for(i = 0; i < n; i++)
+              b[i] = isint[i] && x[i] == in->value;
+            break;
+          case KERNEL_EQUAL_FLOAT:
+            for(i = 0; i < n; i++)
+              b[i] = !isint[i] && x[i] == in->value;
+            break;
+          case KERNEL_EQUAL_NAN:
+            for(i = 0; i < n; i++)
+              b[i] = x[i] != x[i];
+            break;
+        }
+        break;
+      }
+
+      case KERNEL_NOT: {
+        for(i = 0; i < n; i++)
+          a[i] = !kernel_truthy(a[i]);
+        break;
+      }
+
+      case KERNEL_NOTNOT: {
+        for(i = 0; i < n; i++)
+          a[i] = kernel_truthy(a[i]);
+        break;
+      }
+
+      case KERNEL_BNOT: {
+        for(i = 0; i < n; i++)
+          a[i] = ~kernel_toint64(a[i]);
+        break;
+      }
+
+      case KERNEL_SQRT: {
+        for(i = 0; i < n; i++)
+          a[i] = sqrt(a[i]);
+        break;
+      }
+
+      case KERNEL_ARITH: {
+        switch(in->arg) {
+          case PREDICATE_ADD:
+            for(i = 0; i < n; i++)
+              l[i] += a[i];
+            break;
+          case PREDICATE_SUB:
+            for(i = 0; i < n; i++)
+              l[i] -= a[i];
+            break;
+          case PREDICATE_MUL:
+            for(i = 0; i < n; i++)
+              l[i] *= a[i];
+            break;
+          case PREDICATE_DIV:
+            for(i = 0; i < n; i++)
+              l[i] /= a[i];
+            break;
+          case PREDICATE_MOD:
+            for(i = 0; i < n; i++)
+              l[i] = fmod(l[i], a[i]);
+            break;
+          case PREDICATE_BOR:
+            for(i = 0; i < n; i++)
+              l[i] = (uint64_t)l[i] | (uint64_t)a[i];
+            break;
+          case PREDICATE_BAND:
+            for(i = 0; i < n; i++)
+              l[i] = (uint64_t)l[i] & (uint64_t)a[i];
+            break;
+          case PREDICATE_POW:
+            for(i = 0; i < n; i++)
+              l[i] = pow(l[i], a[i]);
+            break;
+          case PREDICATE_ATAN2:
+            for(i = 0; i < n; i++)
+              l[i] = atan2(l[i], a[i]);
+            break;
+        }
+        break;
+      }
+
+      case KERNEL_AND: {
+        for(i = 0; i < n; i++)
+          l[i] = kernel_truthy(l[i]) ? a[i] : l[i];
+        break;
+      }
+
+      case KERNEL_OR: {
+        for(i = 0; i < n; i++)
+          l[i] = kernel_truthy(l[i]) ? l[i] : a[i];
+        break;
+      }
+
+      case KERNEL_XOR: {
+        for(i = 0; i < n; i++)
+          l[i] = kernel_toint64(l[i]) ^ kernel_toint64(a[i]);
+        break;
+      }
+    }
+  }
+
+  for(i = 0; i < n; i++)
+    out[i] = kernel_truthy(stack[0][i]);
+}
+
+static BOOL
+predicate_scan_typedarray(PredicateKernel* kernel, JSContext* ctx, JSValueConst array, PredicateScanFunc* fn, void* opaque) {
+  double x[PREDICATE_KERNEL_BLOCK];
+  uint8_t isint[PREDICATE_KERNEL_BLOCK], out[PREDICATE_KERNEL_BLOCK];
+  size_t offset, length, bytes, size, count;
+  const char* tag;
+  BOOL floating, sign;
+  uint8_t* data;
+  JSValue buffer;
+
+  if(!(tag = js_get_tostringtag_cstr(ctx, array)))
+    return FALSE;
+
+  floating = !strncmp(tag, "Float", 5);
+  sign = !strncmp(tag, "Int", 3);
+  JS_FreeCString(ctx, tag);
+
+  buffer = JS_GetTypedArrayBuffer(ctx, array, &offset, &length, &bytes);
+
+  if(JS_IsException(buffer)) {
+    JS_FreeValue(ctx, JS_GetException(ctx));
+    return FALSE;
+  }
+
+  data = JS_GetArrayBuffer(ctx, &size, buffer);
+  JS_FreeValue(ctx, buffer);
+
+  /* BigInt arrays and detached buffers take the generic path */
+  if(!data || bytes > (floating ? 8 : 4))
+    return FALSE;
+
+  data += offset;
+  count = length / bytes;
+
+  for(size_t base = 0; base < count; base += PREDICATE_KERNEL_BLOCK) {
+    size_t i, n = MIN_NUM(count - base, PREDICATE_KERNEL_BLOCK);
+    const uint8_t* p = data + base * bytes;
+
+#define LOAD(type) \
+  for(i = 0; i < n; i++) \
+    x[i] = ((const type*)p)[i]
+
+    switch(bytes | (floating << 4) | (sign << 5)) {
+      case 1: LOAD(uint8_t); break;
+      case 1 | 32: LOAD(int8_t); break;
+      case 2: LOAD(uint16_t); break;
+      case 2 | 32: LOAD(int16_t); break;
+      case 4: LOAD(uint32_t); break;
+      case 4 | 32: LOAD(int32_t); break;
+      case 4 | 16: LOAD(float); break;
+      case 8 | 16: LOAD(double); break;
+      default: return FALSE;
+    }
+
+#undef LOAD
+
+    /* the tags JS_GetPropertyUint32() would give the elements */
+    for(i = 0; i < n; i++)
+      isint[i] = !floating && x[i] <= INT32_MAX;
+
+    predicate_kernel_run(kernel, x, isint, base, n, out);
+    fn(opaque, base, out, n);
+  }
+
+  return TRUE;
+}
+
+/**
+ * Tests the predicate on each (element, index) of an array or typed
+ * array and hands the results to fn in blocks. Numeric predicates on
+ * number typed arrays run as a kernel; others are evaluated per element.
+ * Returns -1 on exception.
+ */
+int
+predicate_scan(Predicate* pr, JSContext* ctx, JSValueConst array, PredicateScanFunc* fn, void* opaque) {
+  uint8_t out[PREDICATE_KERNEL_BLOCK];
+  PredicateKernel* kernel;
+  int64_t i, length;
+  size_t n = 0;
+
+  if(js_is_typedarray(ctx, array) && (kernel = predicate_kernel_new(pr, ctx))) {
+    BOOL done = predicate_scan_typedarray(kernel, ctx, array, fn, opaque);
+
+    predicate_kernel_free(kernel, ctx);
+
+    if(done)
+      return 0;
+  }
+
+  if((length = js_array_length(ctx, array)) < 0)
+    return -1;
+
+  for(i = 0; i < length; i++) {
+    JSValueConst argv[2] = {JS_GetPropertyUint32(ctx, array, i), JS_NewInt64(ctx, i)};
+    JSArguments args = js_arguments_new(2, argv);
+    JSValue ret;
+
+    if(JS_IsException(argv[0]))
+      return -1;
+
+    ret = predicate_eval(pr, ctx, &args);
+    JS_FreeValue(ctx, argv[0]);
+
+    if(JS_IsException(ret))
+      return -1;
+
+    out[n++] = js_value_tobool_free(ctx, ret);
+
+    if(n == PREDICATE_KERNEL_BLOCK || i + 1 == length) {
+      fn(opaque, i + 1 - n, out, n);
+      n = 0;
+    }
+  }
+
+  return 0;
+}
+
 const char*
 predicate_typename(const Predicate* pr) {
   return ((const char*[]){
@@ -833,6 +2059,7 @@ predicate_free_rt(Predicate* pr, JSRuntime* rt) {
     case PREDICATE_CHARSET: {
       js_free_rt(rt, pr->charset.set);
       vector_free(&pr->charset.chars);
+      js_free_rt(rt, pr->charset.ranges);
       break;
     }
 
@@ -874,7 +2101,8 @@ predicate_free_rt(Predicate* pr, JSRuntime* rt) {
     }
 
     case PREDICATE_REGEXP: {
-      // if(pr->regexp.bytecode) js_free_rt(rt, pr->regexp.bytecode);
+      if(pr->regexp.bytecode)
+        regexp_bytecode_free(pr->regexp.bytecode);
       js_free_rt(rt, pr->regexp.expr.source);
       break;
     }
@@ -912,6 +2140,10 @@ predicate_free_rt(Predicate* pr, JSRuntime* rt) {
       break;
     }
   }
+
+  if(pr->program)
+    predicate_program_free(pr->program, rt);
+
   memset(pr, 0, sizeof(Predicate));
 }
 
@@ -1155,7 +2387,7 @@ predicate_clone(const Predicate* pr, JSContext* ctx) {
       ret->regexp.expr.source = js_strndup(ctx, pr->regexp.expr.source, pr->regexp.expr.len);
       ret->regexp.expr.len = pr->regexp.expr.len;
       ret->regexp.expr.flags = pr->regexp.expr.flags;
-      ret->regexp.bytecode = 0;
+      ret->regexp.bytecode = pr->regexp.bytecode ? regexp_bytecode_dup(pr->regexp.bytecode) : 0;
       break;
     }
 
@@ -1209,7 +2441,7 @@ predicate_regexp_compile(Predicate* pr, JSContext* ctx) {
   assert(pr->id == PREDICATE_REGEXP);
   assert(pr->regexp.bytecode == 0);
 
-  if((pr->regexp.bytecode = regexp_compile(pr->regexp.expr, ctx)))
+  if((pr->regexp.bytecode = regexp_compile_shared(pr->regexp.expr, ctx)))
     return lre_get_capture_count(pr->regexp.bytecode);
 
   return 0;
@@ -4,15 +4,93 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include "buffer-utils.h"
+#include "quickjs-internal.h"
 
 /**
  * \addtogroup property-enumeration
  * @{
  */
+/* JS_ATOM_TYPE_STRING in quickjs.c */
+#define ATOM_TYPE_STRING 1
+
+/**
+ * Reads the keys of a plain object straight from its shape, skipping
+ * JS_GetOwnPropertyNames() and its JSPropertyEnum copy. Gives up when
+ * the shape holds index or symbol keys, those need the spec ordering.
+ */
+static BOOL
+property_enumeration_shape(PropertyEnumeration* it, JSContext* ctx, JSObject* p, int flags) {
+  JSRuntime* rt = JS_GetRuntime(ctx);
+  JSShape* sh = p->shape;
+  JSShapeProperty* prs;
+  uint32_t i, n = 0;
+
+  if(sh->has_small_array_index)
+    return FALSE;
+
+  for(i = 0, prs = sh->prop; i < (uint32_t)sh->prop_count; i++, prs++) {
+    if(prs->atom == JS_ATOM_NULL)
+      continue;
+
+    if(PROPENUM_ATOM_IS_INDEX(prs->atom) || rt->atom_array[prs->atom]->atom_type != ATOM_TYPE_STRING)
+      return FALSE;
+
+    if(!(flags & JS_GPN_ENUM_ONLY) || (prs->flags & JS_PROP_ENUMERABLE))
+      n++;
+  }
+
+  if(n && !(it->tab_atom = js_malloc(ctx, sizeof(JSAtom) * n)))
+    return FALSE;
+
+  for(i = 0, prs = sh->prop; i < (uint32_t)sh->prop_count; i++, prs++)
+    if(prs->atom != JS_ATOM_NULL && (!(flags & JS_GPN_ENUM_ONLY) || (prs->flags & JS_PROP_ENUMERABLE)))
+      it->tab_atom[it->tab_atom_len++] = JS_DupAtom(ctx, prs->atom);
+
+  return TRUE;
+}
+
+/**
+ * Fast arrays and plain objects are enumerated without
+ * JS_GetOwnPropertyNames(): the keys of a fast array are its indices and
+ * need no atoms, a plain object's names are read from its shape.
+ */
+static BOOL
+property_enumeration_fast(PropertyEnumeration* it, JSContext* ctx, JSValueConst obj, int flags) {
+  JSObject* p;
+
+  if(!JS_IsObject(obj) || (flags & (JS_GPN_RECURSIVE | PROPENUM_SORT_ATOMS)) || !(flags & JS_GPN_STRING_MASK))
+    return FALSE;
+
+  p = JS_VALUE_GET_OBJ(obj);
+
+  switch(p->class_id) {
+    case JS_CLASS_ARRAY: {
+      /* only 'length' in the shape, which is not enumerable */
+      if(!p->fast_array || p->shape->prop_count != 1 || !(flags & JS_GPN_ENUM_ONLY) || p->u.array.count > INT32_MAX)
+        return FALSE;
+
+      it->array = TRUE;
+      it->tab_atom_len = p->u.array.count;
+      return TRUE;
+    }
+
+    case JS_CLASS_OBJECT: {
+      return !p->is_exotic && property_enumeration_shape(it, ctx, p, flags);
+    }
+  }
+
+  return FALSE;
+}
+
 int
 property_enumeration_init(PropertyEnumeration* it, JSContext* ctx, JSValueConst obj, int flags) {
   *it = (PropertyEnumeration)PROPENUM_INIT();
 
+  if(property_enumeration_fast(it, ctx, obj, flags)) {
+    it->obj = obj;
+    return 0;
+  }
+
   if(!(it->tab_atom = js_object_properties(ctx, &it->tab_atom_len, obj, flags & ~(PROPENUM_SORT_ATOMS)))) {
     it->tab_atom_len = 0;
     return -1;
@@ -43,7 +121,7 @@ property_enumeration_dump(PropertyEnumeration* it, JSContext* ctx, DynBuf* out)
     if(i)
       dbuf_putstr(out, ", ");
 
-    const char* s = JS_AtomToCString(ctx, it->tab_atom[i]);
+    const char* s = JS_AtomToCString(ctx, it->array ? PROPENUM_INDEX_ATOM(i) : it->tab_atom[i]);
 
     dbuf_putstr(out, i == it->idx ? COLOR_LIGHTRED : COLOR_GRAY);
     dbuf_putstr(out, s);
@@ -105,9 +183,11 @@ property_enumeration_reset(PropertyEnumeration* it, JSRuntime* rt) {
     orig_js_free_rt(rt, it->tab_atom);
 
     it->tab_atom = 0;
-    it->tab_atom_len = 0;
   }
 
+  it->tab_atom_len = 0;
+  it->array = FALSE;
+
   JS_FreeValueRT(rt, it->obj);
   it->obj = JS_UNDEFINED;
 }
@@ -116,9 +196,10 @@ JSValue
 property_enumeration_key(const PropertyEnumeration* it, JSContext* ctx) {
   JSValue key;
 
-  assert(it->idx < it->tab_atom_len);
+  if(it->array)
+    return JS_NewUint32(ctx, it->idx);
 
-  key = JS_AtomToValue(ctx, it->tab_atom[it->idx]);
+  key = JS_AtomToValue(ctx, property_enumeration_atom(it));
 
   if(JS_IsArray(ctx, it->obj)) {
     int64_t idx;
@@ -137,8 +218,8 @@ property_enumeration_predicate(PropertyEnumeration* it, JSContext* ctx, JSValueC
   BOOL result;
   JSValue ret;
   JSValueConst argv[3] = {
-      JS_GetProperty(ctx, it->obj, it->tab_atom[it->idx]),
-      JS_AtomToValue(ctx, it->tab_atom[it->idx]),
+      property_enumeration_value(it, ctx),
+      JS_AtomToValue(ctx, property_enumeration_atom(it)),
       this_arg,
   };
 
@@ -9,6 +9,8 @@
 #include <fcntl.h>
 #include <time.h>
 #include <signal.h>
+#include <limits.h>
+#include <math.h>
 #ifdef HAVE_ALLOCA_H
 #include <alloca.h>
 #endif
@@ -49,6 +51,7 @@
 #include "buffer-utils.h"
 #include "base64.h"
 #include "debug.h"
+#include "stack-profile.h"
 
 #include "quickjs-internal.h"
 
@@ -64,6 +67,11 @@ static thread_local int debug_module_loader = 0;
 static thread_local Vector module_debug = VECTOR_INIT();
 static thread_local Vector module_list = VECTOR_INIT();
 static thread_local ModuleLoaderContext* module_loaders = NULL;
+static thread_local char* module_cache_dir = NULL;
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
 
 #ifndef QUICKJS_MODULE_PATH
 #ifdef QUICKJS_PREFIX
@@ -96,9 +104,310 @@ has_dot_or_slash(const char* s) {
   return !!s[str_chrs(s, "." PATHSEP_S, 2)];
 }
 
+/**
+ * Resolution cache: stat() results (negative ones included) and
+ * normalized module names are remembered for the lifetime of the runtime,
+ * so repeated imports don't probe every extension in every search path
+ * again.  When a cache directory is set the stat() results are persisted
+ * together with the mtime of their parent directory, which changes
+ * whenever an entry is created or removed in it.
+ */
+typedef struct resolve_entry {
+  struct resolve_entry* next;
+  uint64_t hash;
+  int64_t mtime; /**< RESOLVE_STAT: mtime of the parent directory, RESOLVE_DIR: own mtime, -1 if missing */
+  int mode;      /**< RESOLVE_STAT, RESOLVE_DIR: file type bits, -1 if missing */
+  char* value;   /**< RESOLVE_NAME: normalized module name */
+  char key[];    /**< type character followed by the path */
+} ResolveEntry;
+
+#define RESOLVE_STAT 's'
+#define RESOLVE_DIR 'd'
+#define RESOLVE_NAME 'r'
+
+static thread_local ResolveEntry** resolve_table = NULL;
+static thread_local size_t resolve_size = 0, resolve_count = 0;
+static thread_local BOOL resolve_dirty = FALSE;
+
+static uint64_t
+jsm_fnv64(const char* s, size_t n) {
+  uint64_t h = 0xcbf29ce484222325ull;
+
+  while(n--)
+    h = (h ^ (uint8_t)*s++) * 0x100000001b3ull;
+
+  return h;
+}
+
+static int64_t
+jsm_mtime(const struct stat* st) {
+#ifdef __linux__
+  return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+#else
+  return st->st_mtime;
+#endif
+}
+
+static ResolveEntry*
+resolve_find(const char* key, size_t len, uint64_t h) {
+  ResolveEntry* e;
+
+  if(resolve_size)
+    for(e = resolve_table[h & (resolve_size - 1)]; e; e = e->next)
+      if(e->hash == h && !strncmp(e->key, key, len) && e->key[len] == '\0')
+        return e;
+
+  return 0;
+}
+
+static ResolveEntry*
+resolve_add(const char* key, size_t len, uint64_t h) {
+  ResolveEntry* e;
+
+  if(resolve_count >= resolve_size) {
+    size_t i, size = resolve_size ? resolve_size * 2 : 256;
+    ResolveEntry **table, *next;
+
+    if(!(table = calloc(size, sizeof(ResolveEntry*))))
+      return 0;
+
+    for(i = 0; i < resolve_size; i++)
+      for(e = resolve_table[i]; e; e = next) {
+        next = e->next;
+        e->next = table[e->hash & (size - 1)];
+        table[e->hash & (size - 1)] = e;
+      }
+
+    free(resolve_table);
+    resolve_table = table;
+    resolve_size = size;
+  }
+
+  if(!(e = calloc(1, sizeof(ResolveEntry) + len + 1)))
+    return 0;
+
+  e->hash = h;
+  e->mtime = -1;
+  e->mode = -1;
+  memcpy(e->key, key, len);
+  e->next = resolve_table[h & (resolve_size - 1)];
+  resolve_table[h & (resolve_size - 1)] = e;
+  ++resolve_count;
+
+  return e;
+}
+
+static void
+resolve_clear(void) {
+  size_t i;
+  ResolveEntry *e, *next;
+
+  for(i = 0; i < resolve_size; i++)
+    for(e = resolve_table[i]; e; e = next) {
+      next = e->next;
+      free(e->value);
+      free(e);
+    }
+
+  free(resolve_table);
+  resolve_table = 0;
+  resolve_size = resolve_count = 0;
+}
+
+/* looks up <type><path> and returns its entry, the key is built in a stack buffer */
+static ResolveEntry*
+resolve_entry(int type, const char* path, size_t len, BOOL create, BOOL* found) {
+  char buf[PATH_MAX + 2];
+  uint64_t h;
+  ResolveEntry* e;
+
+  if(len > PATH_MAX)
+    return 0;
+
+  buf[0] = type;
+  memcpy(&buf[1], path, len);
+  h = jsm_fnv64(buf, len + 1);
+
+  if((e = resolve_find(buf, len + 1, h))) {
+    *found = TRUE;
+    return e;
+  }
+
+  *found = FALSE;
+  return create ? resolve_add(buf, len + 1, h) : 0;
+}
+
+static int64_t
+resolve_dir_mtime(const char* path, size_t len) {
+  ResolveEntry* e;
+  BOOL found;
+  struct stat st;
+  char dir[PATH_MAX + 1];
+
+  if(!(e = resolve_entry(RESOLVE_DIR, path, len, TRUE, &found)))
+    return -1;
+
+  if(!found) {
+    memcpy(dir, path, len);
+    dir[len] = '\0';
+
+    if(!stat(len ? dir : ".", &st)) {
+      e->mtime = jsm_mtime(&st);
+      e->mode = st.st_mode & S_IFMT;
+    }
+  }
+
+  return e->mtime;
+}
+
+/**
+ * @return  file type bits of \p path or -1 if it doesn't exist
+ */
+static int
+jsm_stat_mode(const char* path) {
+  ResolveEntry* e;
+  BOOL found;
+  struct stat st;
+  size_t len = strlen(path);
+
+  if(!(e = resolve_entry(RESOLVE_STAT, path, len, TRUE, &found)))
+    return stat(path, &st) ? -1 : (int)(st.st_mode & S_IFMT);
+
+  if(!found) {
+    /* the directory is sampled before the entry so a concurrent change invalidates it */
+    if(module_cache_dir)
+      e->mtime = resolve_dir_mtime(path, path_dirlen1(path));
+
+    e->mode = stat(path, &st) ? -1 : (int)(st.st_mode & S_IFMT);
+    resolve_dirty = TRUE;
+  }
+
+  return e->mode;
+}
+
+static inline BOOL
+jsm_isfile(const char* path) {
+  return jsm_stat_mode(path) == S_IFREG;
+}
+
+static inline BOOL
+jsm_exists(const char* path) {
+  return jsm_stat_mode(path) != -1;
+}
+
+static char*
+resolve_cache_file(void) {
+  size_t len = strlen(module_cache_dir) + sizeof("/resolve.cache");
+  char* file;
+
+  if((file = malloc(len)))
+    snprintf(file, len, "%s/resolve.cache", module_cache_dir);
+
+  return file;
+}
+
+/**
+ * Reads the persisted stat() results, keeping those whose parent directory
+ * still has the recorded mtime.  Relative paths are only valid for the
+ * working directory they were recorded in.
+ */
+static void
+resolve_restore(void) {
+  char *file, *cwd, line[PATH_MAX + 64];
+  FILE* f;
+  BOOL same_cwd = FALSE, found;
+
+  if(!module_cache_dir || !(file = resolve_cache_file()))
+    return;
+
+  f = fopen(file, "r");
+  free(file);
+
+  if(!f)
+    return;
+
+  cwd = getcwd(NULL, 0);
+
+  if(fgets(line, sizeof(line), f) && !strncmp(line, "qjsm-resolve 1 ", 15)) {
+    line[str_chrs(line, "\r\n", 2)] = '\0';
+    same_cwd = cwd && !strcmp(&line[15], cwd);
+
+    while(fgets(line, sizeof(line), f)) {
+      int mode;
+      int64_t mtime;
+      int n = 0;
+      const char* path;
+      size_t len;
+      ResolveEntry* e;
+
+      line[str_chrs(line, "\r\n", 2)] = '\0';
+
+      if(sscanf(line, "s %d %" SCNd64 " %n", &mode, &mtime, &n) < 2 || n == 0)
+        continue;
+
+      path = &line[n];
+
+      if(!same_cwd && !path_isabsolute1(path))
+        continue;
+
+      len = strlen(path);
+
+      if(resolve_dir_mtime(path, path_dirlen1(path)) != mtime)
+        continue;
+
+      if((e = resolve_entry(RESOLVE_STAT, path, len, TRUE, &found)) && !found) {
+        e->mtime = mtime;
+        e->mode = mode;
+      }
+    }
+  }
+
+  free(cwd);
+  fclose(f);
+}
+
+static void
+resolve_save(void) {
+  char *file, *tmp, *cwd;
+  size_t i, len;
+  ResolveEntry* e;
+  FILE* f;
+
+  if(!module_cache_dir || !resolve_dirty || !(file = resolve_cache_file()))
+    return;
+
+  len = strlen(file) + 32;
+
+  if(!(tmp = malloc(len))) {
+    free(file);
+    return;
+  }
+
+  /* write to a temporary file and rename() it, concurrent instances may run */
+  snprintf(tmp, len, "%s.%ld.tmp", file, (long)getpid());
+
+  if((f = fopen(tmp, "w"))) {
+    cwd = getcwd(NULL, 0);
+    fprintf(f, "qjsm-resolve 1 %s\n", cwd ? cwd : "");
+    free(cwd);
+
+    for(i = 0; i < resolve_size; i++)
+      for(e = resolve_table[i]; e; e = e->next)
+        if(e->key[0] == RESOLVE_STAT)
+          fprintf(f, "s %d %" PRId64 " %s\n", e->mode, e->mtime, &e->key[1]);
+
+    if(fclose(f) || rename(tmp, file))
+      unlink(tmp);
+  }
+
+  free(tmp);
+  free(file);
+  resolve_dirty = FALSE;
+}
+
 static char*
 is_module(JSContext* ctx, const char* module_name) {
-  BOOL yes = path_isfile1(module_name);
+  BOOL yes = jsm_isfile(module_name);
 
   if(debug_module_loader > 2)
     printf("%-20s (module_name=\"%s\")=%s\n", __FUNCTION__, module_name, ((yes) ? "TRUE" : "FALSE"));
@@ -158,6 +467,7 @@ jsm_module_extern_native(std);
 jsm_module_extern_native(os);
 jsm_module_extern_native(child_process);
 jsm_module_extern_native(deep);
+jsm_module_extern_native(emitter);
 jsm_module_extern_native(inspect);
 jsm_module_extern_native(lexer);
 jsm_module_extern_native(misc);
@@ -166,6 +476,7 @@ jsm_module_extern_native(path);
 jsm_module_extern_native(pointer);
 jsm_module_extern_native(predicate);
 jsm_module_extern_native(repeater);
+jsm_module_extern_native(ringbuffer);
 jsm_module_extern_native(tree_walker);
 jsm_module_extern_native(xml);
 
@@ -394,6 +705,7 @@ jsm_stack_load(JSContext* ctx, const char* file, BOOL module, BOOL is_main) {
 }
 
 JSModuleDef* js_init_module_deep(JSContext*, const char*);
+JSModuleDef* js_init_module_emitter(JSContext*, const char*);
 JSModuleDef* js_init_module_inspect(JSContext*, const char*);
 JSModuleDef* js_init_module_lexer(JSContext*, const char*);
 JSModuleDef* js_init_module_misc(JSContext*, const char*);
@@ -401,6 +713,7 @@ JSModuleDef* js_init_module_path(JSContext*, const char*);
 JSModuleDef* js_init_module_pointer(JSContext*, const char*);
 JSModuleDef* js_init_module_predicate(JSContext*, const char*);
 JSModuleDef* js_init_module_repeater(JSContext*, const char*);
+JSModuleDef* js_init_module_ringbuffer(JSContext*, const char*);
 JSModuleDef* js_init_module_tree_walker(JSContext*, const char*);
 JSModuleDef* js_init_module_xml(JSContext*, const char*);
 
@@ -419,6 +732,7 @@ jsm_init_modules(JSContext* ctx) {
   jsm_builtin_native(os);
   jsm_builtin_native(child_process);
   jsm_builtin_native(deep);
+  jsm_builtin_native(emitter);
   jsm_builtin_native(inspect);
   jsm_builtin_native(lexer);
   jsm_builtin_native(misc);
@@ -427,6 +741,7 @@ jsm_init_modules(JSContext* ctx) {
   jsm_builtin_native(pointer);
   jsm_builtin_native(predicate);
   jsm_builtin_native(repeater);
+  jsm_builtin_native(ringbuffer);
   jsm_builtin_native(tree_walker);
   jsm_builtin_native(xml);
 
@@ -545,7 +860,7 @@ jsm_search_list(JSContext* ctx, const char* module_name, const char* list) {
     t[i] = '/';
     strcpy(&t[i + 1], module_name);
 
-    if(path_isfile1(t))
+    if(jsm_isfile(t))
       return t;
 
     if(s[i])
@@ -808,6 +1123,155 @@ jsm_module_json(JSContext* ctx, const char* name) {
   return m;
 }
 
+/**
+ * Bytecode cache entry, followed by the absolute source path and the
+ * JS_WriteObject() output. An entry is only used when the source still has
+ * the recorded size and mtime and qjsm is the same build that wrote it.
+ */
+typedef struct {
+  char magic[8];
+  char version[48];
+  uint32_t pointer_size, path_len;
+  int64_t mtime, size;
+} ModuleCacheHeader;
+
+static const char module_cache_magic[8] = "QJSMBC\0\1";
+
+#ifdef CONFIG_VERSION
+#define MODULE_CACHE_VERSION CONFIG_VERSION " " __DATE__ " " __TIME__
+#else
+#define MODULE_CACHE_VERSION __DATE__ " " __TIME__
+#endif
+
+static void
+jsm_cache_header(ModuleCacheHeader* hdr, const struct stat* st, size_t path_len) {
+  memset(hdr, 0, sizeof(ModuleCacheHeader));
+  memcpy(hdr->magic, module_cache_magic, sizeof(hdr->magic));
+  strncpy(hdr->version, MODULE_CACHE_VERSION, sizeof(hdr->version) - 1);
+  hdr->pointer_size = sizeof(void*);
+  hdr->path_len = path_len;
+  hdr->mtime = jsm_mtime(st);
+  hdr->size = st->st_size;
+}
+
+/* <cache dir>/<FNV-1a of the absolute path>.jsbc */
+static char*
+jsm_cache_file(const char* abs) {
+  uint64_t h = jsm_fnv64(abs, strlen(abs));
+  size_t len = strlen(module_cache_dir) + 1 + 16 + 5 + 1;
+  char* file;
+
+  if((file = malloc(len)))
+    snprintf(file, len, "%s/%016" PRIx64 ".jsbc", module_cache_dir, h);
+
+  return file;
+}
+
+static JSModuleDef*
+jsm_cache_module(JSContext* ctx, JSValue func) {
+  JSModuleDef* m;
+
+  if(JS_IsException(func) || JS_VALUE_GET_TAG(func) != JS_TAG_MODULE) {
+    JS_FreeValue(ctx, func);
+    return 0;
+  }
+
+  js_module_set_import_meta(ctx, func, TRUE, FALSE);
+  m = JS_VALUE_GET_PTR(func);
+  JS_FreeValue(ctx, func);
+  return m;
+}
+
+/**
+ * Loads a module from the bytecode cache, or compiles it and writes it to
+ * the cache. The entry is written to a temporary file and renamed, so
+ * concurrent processes never read a partial one.
+ */
+static JSModuleDef*
+jsm_cache_load(JSContext* ctx, const char* module) {
+  ModuleCacheHeader hdr, *found;
+  struct stat st;
+  char *abs, *file = 0;
+  uint8_t *buf = 0, *code;
+  size_t len, path_len;
+  JSValue func;
+  JSModuleDef* m = 0;
+
+  if(stat(module, &st) || !(abs = path_absolute1(module)))
+    return js_module_loader(ctx, module, 0);
+
+  path_len = strlen(abs);
+  jsm_cache_header(&hdr, &st, path_len);
+
+  if(!(file = jsm_cache_file(abs)))
+    goto fallback;
+
+  if((buf = js_load_file(ctx, &len, file))) {
+    found = (ModuleCacheHeader*)buf;
+
+    if(len > sizeof(hdr) + path_len && !memcmp(found, &hdr, sizeof(hdr)) && !memcmp(buf + sizeof(hdr), abs, path_len)) {
+      func = JS_ReadObject(ctx, buf + sizeof(hdr) + path_len, len - sizeof(hdr) - path_len, JS_READ_OBJ_BYTECODE);
+
+      /* written by a different QuickJS, compile it again */
+      if(JS_IsException(func))
+        JS_FreeValue(ctx, JS_GetException(ctx));
+      else if((m = jsm_cache_module(ctx, func)))
+        goto end;
+    }
+
+    js_free(ctx, buf);
+    buf = 0;
+  }
+
+  if(debug_module_loader >= 1)
+    printf("%-20s \"%s\" -> \"%s\" (miss)\n", __FUNCTION__, module, file);
+
+  if(!(code = js_load_file(ctx, &len, module))) {
+    JS_ThrowReferenceError(ctx, "could not load module filename '%s'", module);
+    goto end;
+  }
+
+  func = JS_Eval(ctx, (const char*)code, len, module, JS_EVAL_TYPE_MODULE | JS_EVAL_FLAG_COMPILE_ONLY);
+  js_free(ctx, code);
+
+  if(!JS_IsException(func)) {
+    char* tmp;
+    int fd;
+
+    if(!(buf = JS_WriteObject(ctx, &len, func, JS_WRITE_OBJ_BYTECODE))) {
+      /* not cacheable, but the module itself is fine */
+      JS_FreeValue(ctx, JS_GetException(ctx));
+    } else if((tmp = malloc(strlen(file) + 32))) {
+      sprintf(tmp, "%s.%d.tmp", file, (int)getpid());
+
+      if((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) != -1) {
+        BOOL ok = write(fd, &hdr, sizeof(hdr)) == sizeof(hdr) && write(fd, abs, path_len) == (ssize_t)path_len && write(fd, buf, len) == (ssize_t)len;
+
+        close(fd);
+
+        if(!ok || rename(tmp, file))
+          unlink(tmp);
+      }
+
+      free(tmp);
+    }
+  }
+
+  m = jsm_cache_module(ctx, func);
+
+end:
+  if(buf)
+    js_free(ctx, buf);
+
+  free(file);
+  free(abs);
+  return m;
+
+fallback:
+  free(abs);
+  return js_module_loader(ctx, module, 0);
+}
+
 char*
 jsm_module_locate(JSContext* ctx, const char* module_name, void* opaque) {
   char *file = 0, *s;
@@ -818,7 +1282,7 @@ jsm_module_locate(JSContext* ctx, const char* module_name, void* opaque) {
       printf("%-20s [1](module_name=\"%s\", opaque=%p) s=%s\n", __FUNCTION__, module_name, opaque, s);
 
     if(has_dot_or_slash(s))
-      if(path_isfile1(s))
+      if(jsm_isfile(s))
         break;
 
     if(is_searchable(s)) {
@@ -1009,6 +1473,8 @@ restart:
 
     if(str_ends(s, ".json"))
       m = jsm_module_json(ctx, s);
+    else if(module_cache_dir && !str_ends(s, CONFIG_SHEXT))
+      m = jsm_cache_load(ctx, s);
     else
       m = js_module_loader(ctx, s, opaque);
 
@@ -1025,8 +1491,8 @@ end:
   return m;
 }
 
-char*
-jsm_module_normalize(JSContext* ctx, const char* path, const char* name, void* opaque) {
+static char*
+jsm_module_resolve(JSContext* ctx, const char* path, const char* name, void* opaque) {
   char* file = 0;
   BuiltinModule* bltin = 0;
 
@@ -1066,7 +1532,7 @@ jsm_module_normalize(JSContext* ctx, const char* path, const char* name, void* o
 
       file = (char*)db.buf;
 
-    } else if(has_dot_or_slash(name) && path_exists1(name) && path_isrelative(name)) {
+    } else if(has_dot_or_slash(name) && jsm_exists(name) && path_isrelative(name)) {
       file = path_absolute1(name);
       path_normalize1(file);
     }
@@ -1090,6 +1556,42 @@ jsm_module_normalize(JSContext* ctx, const char* path, const char* name, void* o
   return file;
 }
 
+/**
+ * Normalizes \p name relative to \p path, memoizing the result for
+ * everything except builtins, whose name depends on their init state.
+ */
+char*
+jsm_module_normalize(JSContext* ctx, const char* path, const char* name, void* opaque) {
+  size_t plen = strlen(path), nlen = strlen(name);
+  ResolveEntry* e = 0;
+  BOOL found = FALSE;
+  char* key;
+  char* file;
+
+  if(!has_dot_or_slash(name) && jsm_builtin_find(name))
+    return jsm_module_resolve(ctx, path, name, opaque);
+
+  if((key = malloc(plen + 1 + nlen + 1))) {
+    memcpy(key, path, plen);
+    key[plen] = '\n';
+    memcpy(&key[plen + 1], name, nlen);
+    e = resolve_entry(RESOLVE_NAME, key, plen + 1 + nlen, TRUE, &found);
+    free(key);
+  }
+
+  if(found && e->value) {
+    if(debug_module_loader >= 1)
+      printf("%-20s %s: \"%s\" => \"%s\" (cached)\n", __FUNCTION__, path, name, e->value);
+
+    return js_strdup(ctx, e->value);
+  }
+
+  if((file = jsm_module_resolve(ctx, path, name, opaque)) && e)
+    e->value = strdup(file);
+
+  return file;
+}
+
 static void
 jsm_module_save(void) {
   char* home = path_gethome();
@@ -1384,6 +1886,189 @@ static const JSMallocFunctions trace_mf = {
 #endif
 };
 
+/**
+ * Sampling allocation profiler: roughly every \c interval allocated bytes
+ * (exponentially distributed so periodic patterns don't alias) the JS
+ * stack is recorded.  Stacks are aggregated in memory and written in
+ * collapsed format ("outer;inner bytes") for flamegraph.pl / pprof.
+ *
+ * The stack is captured with stack-profile.h, which neither allocates nor
+ * enters the interpreter, so sampling from inside the allocator is safe.
+ */
+static thread_local struct {
+  JSRuntime* rt;
+  size_t interval;
+  int64_t countdown;
+  uint64_t seed;
+  StackProfile stacks;
+  BOOL busy;
+  const char* output;
+} alloc_profile;
+
+static volatile sig_atomic_t alloc_profile_requested = 0;
+
+static int64_t
+alloc_profile_next(void) {
+  uint64_t x = alloc_profile.seed;
+  double u, n;
+
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  alloc_profile.seed = x;
+
+  /* u in (0, 1] */
+  u = ((x >> 11) + 1) * (1.0 / 9007199254740992.0);
+  n = -log(u) * alloc_profile.interval;
+
+  return n < 1 ? 1 : n > (double)INT64_MAX ? INT64_MAX : (int64_t)n;
+}
+
+static int
+alloc_profile_write(const char* file) {
+  char name[64];
+
+  if(!file) {
+    snprintf(name, sizeof(name), "qjsm-alloc.%ld.folded", (long)getpid());
+    file = name;
+  }
+
+  return stack_profile_write(&alloc_profile.stacks, file);
+}
+
+static void
+alloc_profile_sample(size_t size) {
+  StackProfileFrame frames[STACK_PROFILE_MAX_DEPTH];
+  int depth;
+
+  if(!alloc_profile.rt || alloc_profile.busy) {
+    alloc_profile.countdown = alloc_profile.rt ? alloc_profile_next() : INT64_MAX;
+    return;
+  }
+
+  alloc_profile.busy = TRUE;
+  alloc_profile.countdown = alloc_profile_next();
+
+  depth = ctx ? stack_profile_capture(alloc_profile.rt, frames, STACK_PROFILE_MAX_DEPTH) : 0;
+  stack_profile_add(&alloc_profile.stacks, ctx, frames, depth, size > alloc_profile.interval ? size : alloc_profile.interval);
+
+  if(alloc_profile_requested) {
+    alloc_profile_requested = 0;
+    alloc_profile_write(alloc_profile.output);
+  }
+
+  alloc_profile.busy = FALSE;
+}
+
+#ifdef SIGUSR2
+static void
+alloc_profile_signal(int sig) {
+  alloc_profile_requested = 1;
+}
+#endif
+
+static void*
+jsm_sample_malloc(JSMallocState* s, size_t size) {
+  void* ptr;
+
+  assert(size != 0);
+
+  if(unlikely(s->malloc_size + size > s->malloc_limit))
+    return 0;
+
+  if(!(ptr = malloc(size)))
+    return 0;
+
+  s->malloc_count++;
+  s->malloc_size += jsm_trace_malloc_usable_size(ptr) + MALLOC_OVERHEAD;
+
+  if((alloc_profile.countdown -= size) < 0)
+    alloc_profile_sample(size);
+
+  return ptr;
+}
+
+static void
+jsm_sample_free(JSMallocState* s, void* ptr) {
+  if(!ptr)
+    return;
+
+  s->malloc_count--;
+  s->malloc_size -= jsm_trace_malloc_usable_size(ptr) + MALLOC_OVERHEAD;
+  free(ptr);
+}
+
+static void*
+jsm_sample_realloc(JSMallocState* s, void* ptr, size_t size) {
+  size_t old_size;
+
+  if(!ptr)
+    return size ? jsm_sample_malloc(s, size) : 0;
+
+  old_size = jsm_trace_malloc_usable_size(ptr);
+
+  if(size == 0) {
+    s->malloc_count--;
+    s->malloc_size -= old_size + MALLOC_OVERHEAD;
+    free(ptr);
+    return 0;
+  }
+
+  if(s->malloc_size + size - old_size > s->malloc_limit)
+    return 0;
+
+  if(!(ptr = realloc(ptr, size)))
+    return 0;
+
+  s->malloc_size += jsm_trace_malloc_usable_size(ptr) - old_size;
+
+  /* only growth counts as allocation */
+  if(size > old_size && (alloc_profile.countdown -= size - old_size) < 0)
+    alloc_profile_sample(size - old_size);
+
+  return ptr;
+}
+
+/**
+ * allocationProfile() returns the collapsed stacks, allocationProfile(file)
+ * writes them to a file; a true second argument clears the profile.
+ */
+static JSValue
+jsm_allocation_profile(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  JSValue ret = JS_UNDEFINED;
+
+  if(!alloc_profile.rt)
+    return JS_NULL;
+
+  alloc_profile.busy = TRUE;
+
+  if(argc > 0 && !JS_IsUndefined(argv[0]) && !JS_IsNull(argv[0])) {
+    const char* file;
+
+    if(!(file = JS_ToCString(ctx, argv[0]))) {
+      ret = JS_EXCEPTION;
+    } else {
+      if(alloc_profile_write(file))
+        ret = JS_ThrowInternalError(ctx, "writing allocation profile to '%s' failed: %s", file, strerror(errno));
+
+      JS_FreeCString(ctx, file);
+    }
+  } else {
+    DynBuf db;
+
+    dbuf_init(&db);
+    stack_profile_collapse(&alloc_profile.stacks, &db);
+    ret = JS_NewStringLen(ctx, (const char*)db.buf, db.size);
+    dbuf_free(&db);
+  }
+
+  if(!JS_IsException(ret) && argc > 1 && JS_ToBool(ctx, argv[1]))
+    stack_profile_reset(&alloc_profile.stacks);
+
+  alloc_profile.busy = FALSE;
+  return ret;
+}
+
 void
 jsm_help(void) {
   printf("QuickJS version " CONFIG_VERSION "\n"
@@ -1407,10 +2092,16 @@ jsm_help(void) {
          "    --memory-limit n       limit the memory usage to 'n' bytes\n"
          "    --stack-size n         limit the stack size to 'n' bytes\n"
          "    --unhandled-rejection  dump unhandled promise rejections\n"
+         "    --cache-dir dir        keep compiled modules and lookups in 'dir' (or $QJSM_CACHE_DIR)\n"
+         "    --alloc-profile n      sample the JS stack every ~'n' allocated bytes (or $QJSM_ALLOC_PROFILE)\n"
+         "    --alloc-profile-out f  write the collapsed stacks to 'f' at exit\n"
          "-q  --quit         just instantiate the interpreter and quit\n"
 #ifdef SIGUSR1
          "\n"
          "  USR1 signal starts interactive mode\n"
+#endif
+#ifdef SIGUSR2
+         "  USR2 signal writes the allocation profile\n"
 #endif
          ,
          exename);
@@ -1693,6 +2384,68 @@ jsm_module_func(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst ar
   return val;
 }
 
+/**
+ * Forgets cached lookups, e.g. after module files have been created.
+ */
+static JSValue
+jsm_clear_resolve_cache(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst argv[]) {
+  resolve_clear();
+  resolve_dirty = FALSE;
+  return JS_UNDEFINED;
+}
+
+enum {
+  LAZY_PROCESS = 0,
+  LAZY_CONSOLE,
+};
+
+static const char* const jsm_lazy_names[] = {
+    "process",
+    "console",
+};
+
+static const char* const jsm_lazy_scripts[] = {
+    "import process from 'process';\nglobalThis.process = process;\n",
+    "import { Console } from 'console';\n"
+    "import { out } from 'std';\n"
+    "globalThis.console = new Console(out, { inspectOptions: { customInspect: true } });\n",
+};
+
+/**
+ * Getter of a lazily initialized global: the first access replaces the
+ * accessor with a data property and evaluates the module import that
+ * fills it, so the module graph behind it is only loaded when used.
+ */
+static JSValue
+jsm_lazy_get(JSContext* ctx, JSValueConst this_val, int magic) {
+  JSValue global = JS_GetGlobalObject(ctx), ret = JS_EXCEPTION;
+  const char* name = jsm_lazy_names[magic];
+
+  if(JS_DefinePropertyValueStr(ctx, global, name, JS_UNDEFINED, JS_PROP_C_W_E) >= 0)
+    if(js_eval_str(ctx, jsm_lazy_scripts[magic], "<lazy>", JS_EVAL_TYPE_MODULE) != -1)
+      ret = JS_GetPropertyStr(ctx, global, name);
+
+  JS_FreeValue(ctx, global);
+  return ret;
+}
+
+/**
+ * Assigning before the first access just replaces the accessor.
+ */
+static JSValue
+jsm_lazy_set(JSContext* ctx, JSValueConst this_val, JSValueConst value, int magic) {
+  JSValue global = JS_GetGlobalObject(ctx);
+  int ret = JS_DefinePropertyValueStr(ctx, global, jsm_lazy_names[magic], JS_DupValue(ctx, value), JS_PROP_C_W_E);
+
+  JS_FreeValue(ctx, global);
+  return ret < 0 ? JS_EXCEPTION : JS_UNDEFINED;
+}
+
+static const JSCFunctionListEntry jsm_lazy_globals[] = {
+    JS_CGETSET_MAGIC_DEF("process", jsm_lazy_get, jsm_lazy_set, LAZY_PROCESS),
+    JS_CGETSET_MAGIC_DEF("console", jsm_lazy_get, jsm_lazy_set, LAZY_CONSOLE),
+};
+
 static const JSCFunctionListEntry jsm_global_funcs[] = {
     JS_CFUNC_MAGIC_DEF("evalFile", 1, jsm_eval_script, 0),
     JS_CFUNC_MAGIC_DEF("evalScript", 1, jsm_eval_script, 1),
@@ -1706,6 +2459,8 @@ static const JSCFunctionListEntry jsm_global_funcs[] = {
     JS_CGETSET_MAGIC_DEF("__filename", jsm_stack_get, 0, SCRIPT_FILENAME),
     JS_CGETSET_MAGIC_DEF("__dirname", jsm_stack_get, 0, SCRIPT_DIRNAME),
     JS_CFUNC_MAGIC_DEF("findModule", 1, jsm_module_func, FIND_MODULE),
+    JS_CFUNC_DEF("clearResolveCache", 0, jsm_clear_resolve_cache),
+    JS_CFUNC_DEF("allocationProfile", 0, jsm_allocation_profile),
     JS_CFUNC_MAGIC_DEF("findModuleIndex", 1, jsm_module_func, FIND_MODULE_INDEX),
     JS_CFUNC_MAGIC_DEF("loadModule", 1, jsm_module_func, LOAD_MODULE),
     JS_CFUNC_MAGIC_DEF("addModule", 1, jsm_module_func, ADD_MODULE),
@@ -1946,6 +2701,36 @@ main(int argc, char** argv) {
         break;
       }
 
+      if(!strcmp(longopt, "cache-dir")) {
+        if(optind >= argc) {
+          fprintf(stderr, "expecting cache directory\n");
+          exit(1);
+        }
+
+        module_cache_dir = argv[optind++];
+        break;
+      }
+
+      if(!strcmp(longopt, "alloc-profile")) {
+        if(optind >= argc) {
+          fprintf(stderr, "expecting sampling interval\n");
+          exit(1);
+        }
+
+        alloc_profile.interval = (size_t)strtod(argv[optind++], 0);
+        break;
+      }
+
+      if(!strcmp(longopt, "alloc-profile-out")) {
+        if(optind >= argc) {
+          fprintf(stderr, "expecting output file\n");
+          exit(1);
+        }
+
+        alloc_profile.output = argv[optind++];
+        break;
+      }
+
       if(!strcmp(longopt, "stack-size")) {
         if(optind >= argc) {
           fprintf(stderr, "expecting stack size");
@@ -1970,6 +2755,23 @@ main(int argc, char** argv) {
 
   jsm_init_modules(ctx);
 
+  if(!module_cache_dir)
+    module_cache_dir = getenv("QJSM_CACHE_DIR");
+
+  /* an unusable directory disables the cache */
+  if(module_cache_dir && *module_cache_dir) {
+#ifdef _WIN32
+    if(mkdir(module_cache_dir) && errno != EEXIST)
+#else
+    if(mkdir(module_cache_dir, 0755) && errno != EEXIST)
+#endif
+      module_cache_dir = 0;
+  } else {
+    module_cache_dir = 0;
+  }
+
+  resolve_restore();
+
 #ifdef HAVE_GET_MODULE_LOADER_FUNC
   module_loader = js_std_get_module_loader_func();
 #endif
@@ -1996,9 +2798,30 @@ main(int argc, char** argv) {
     bignum_ext = 1;
 #endif
 
+  if(!alloc_profile.interval && getenv("QJSM_ALLOC_PROFILE"))
+    alloc_profile.interval = (size_t)strtod(getenv("QJSM_ALLOC_PROFILE"), 0);
+
   if(trace_memory) {
     jsm_trace_malloc_init(&trace_data);
     rt = JS_NewRuntime2(&trace_mf, &trace_data);
+  } else if(alloc_profile.interval) {
+    JSMallocFunctions sample_mf = trace_mf;
+
+    sample_mf.js_malloc = jsm_sample_malloc;
+    sample_mf.js_free = jsm_sample_free;
+    sample_mf.js_realloc = jsm_sample_realloc;
+
+    alloc_profile.seed = (uint64_t)time(0) * 0x9e3779b97f4a7c15ull | 1;
+    alloc_profile.countdown = alloc_profile_next();
+
+    if((rt = JS_NewRuntime2(&sample_mf, 0))) {
+      alloc_profile.rt = rt;
+      stack_profile_init(&alloc_profile.stacks, rt);
+    }
+
+#ifdef SIGUSR2
+    signal(SIGUSR2, alloc_profile_signal);
+#endif
   } else {
     rt = JS_NewRuntime();
   }
@@ -2045,11 +2868,16 @@ main(int argc, char** argv) {
 
     js_std_add_helpers(ctx, argc - optind, argv + optind);
 
-    dbuf_putstr(&db, "import process from 'process';\nglobalThis.process = process;\n");
-
     // dbuf_putstr(&db, "import require from 'require';\nglobalThis.require = require;\n");
 
-    JS_SetPropertyFunctionList(ctx, JS_GetGlobalObject(ctx), jsm_global_funcs, countof(jsm_global_funcs));
+    {
+      JSValue global = JS_GetGlobalObject(ctx);
+      JS_SetPropertyFunctionList(ctx, global, jsm_global_funcs, countof(jsm_global_funcs));
+
+      /* 'process' and 'console' are only imported when first used */
+      JS_SetPropertyFunctionList(ctx, global, jsm_lazy_globals, countof(jsm_lazy_globals));
+      JS_FreeValue(ctx, global);
+    }
 
     if(load_std) {
       const char* str = "import * as std from 'std';\nimport * as os from 'os';\nglobalThis.std = "
@@ -2082,13 +2910,6 @@ main(int argc, char** argv) {
         goto fail;
     }
 
-    js_eval_str(ctx,
-                "import { Console } from 'console';\n"
-                "import { out } from 'std';\n"
-                "globalThis.console = new Console(out, { inspectOptions: { customInspect: true } });\n",
-                0,
-                JS_EVAL_TYPE_MODULE);
-
     if(!interactive) {
 #ifdef SIGUSR1
       signal(SIGUSR1, jsm_signal_handler);
@@ -2126,9 +2947,20 @@ main(int argc, char** argv) {
     JS_DumpMemoryUsage(stdout, &stats, rt);
   }
 
+  resolve_save();
+  resolve_clear();
+
+  if(alloc_profile.rt) {
+    alloc_profile.busy = TRUE;
+    alloc_profile_write(alloc_profile.output);
+    stack_profile_reset(&alloc_profile.stacks);
+    alloc_profile.rt = 0;
+  }
+
   js_std_free_handlers(rt);
   JS_FreeContext(ctx);
   JS_FreeRuntime(rt);
+  regexp_cache_clear();
 
   if(empty_run && dump_memory) {
     clock_t t[5];
@@ -2155,8 +2987,17 @@ main(int argc, char** argv) {
 
   return 0;
 fail:
+  resolve_save();
+  resolve_clear();
+
+  if(alloc_profile.rt) {
+    stack_profile_reset(&alloc_profile.stacks);
+    alloc_profile.rt = 0;
+  }
+
   js_std_free_handlers(rt);
   JS_FreeContext(ctx);
   JS_FreeRuntime(rt);
+  regexp_cache_clear();
   return 1;
 }
@@ -0,0 +1,166 @@
+#include "query-stats.h"
+#include "utils.h"
+#include "defines.h"
+#include <string.h>
+
+/**
+ * \addtogroup query-stats
+ * @{
+ */
+
+static int64_t
+query_stats_now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+QueryStats*
+query_stats_new(JSContext* ctx) {
+  QueryStats* qs;
+
+  if((qs = js_mallocz(ctx, sizeof(QueryStats))))
+    qs->hook = JS_UNDEFINED;
+
+  return qs;
+}
+
+void
+query_stats_free(QueryStats* qs, JSRuntime* rt) {
+  JS_FreeValueRT(rt, qs->hook);
+  js_free_rt(rt, qs);
+}
+
+void
+query_stats_reset(QueryStats* qs) {
+  JSValue hook = qs->hook;
+
+  memset(qs, 0, sizeof(QueryStats));
+  qs->hook = hook;
+}
+
+void
+query_stats_begin(QueryStats* qs, size_t bytes_sent) {
+  QueryTimer* qt = &qs->current;
+
+  memset(qt, 0, sizeof(QueryTimer));
+  qt->start = query_stats_now();
+  qt->bytes_sent = bytes_sent;
+  qt->active = TRUE;
+}
+
+/**
+ * Counts one *_cont wakeup of the current query.
+ */
+void
+query_stats_wakeup(QueryStats* qs) {
+  if(qs->current.active)
+    qs->current.wakeups++;
+}
+
+/**
+ * Marks the arrival of the server's first response, once per query.
+ */
+void
+query_stats_first_byte(QueryStats* qs) {
+  QueryTimer* qt = &qs->current;
+
+  if(qt->active && !qt->first_byte)
+    qt->first_byte = query_stats_now();
+}
+
+void
+query_stats_received(QueryStats* qs, uint64_t rows, size_t bytes) {
+  QueryTimer* qt = &qs->current;
+
+  if(qt->active) {
+    qt->rows += rows;
+    qt->bytes_received += bytes;
+  }
+}
+
+static int
+query_stats_bucket(int64_t us) {
+  int i = 0;
+
+  while(i < QUERY_STATS_BUCKETS - 1 && us >= ((int64_t)1 << i))
+    i++;
+
+  return i;
+}
+
+/**
+ * Ends the current query (after its last row), adds it to the totals and
+ * passes the per-query record to the hook, if one is set.
+ */
+void
+query_stats_end(QueryStats* qs, BOOL error, JSContext* ctx) {
+  QueryTimer* qt = &qs->current;
+  int64_t now, last_row, first_byte;
+
+  if(!qt->active)
+    return;
+
+  qt->active = FALSE;
+  now = query_stats_now();
+  last_row = now - qt->start;
+  first_byte = (qt->first_byte ? qt->first_byte : now) - qt->start;
+
+  qs->queries++;
+  qs->errors += !!error;
+  qs->rows += qt->rows;
+  qs->wakeups += qt->wakeups;
+  qs->bytes_sent += qt->bytes_sent;
+  qs->bytes_received += qt->bytes_received;
+  qs->first_byte_time += first_byte;
+  qs->last_row_time += last_row;
+  qs->histogram[query_stats_bucket(last_row)]++;
+
+  if(ctx && JS_IsFunction(ctx, qs->hook)) {
+    JSValue record = JS_NewObject(ctx), ret;
+
+    JS_SetPropertyStr(ctx, record, "firstByte", JS_NewFloat64(ctx, first_byte / 1000.0));
+    JS_SetPropertyStr(ctx, record, "lastRow", JS_NewFloat64(ctx, last_row / 1000.0));
+    JS_SetPropertyStr(ctx, record, "rows", JS_NewInt64(ctx, qt->rows));
+    JS_SetPropertyStr(ctx, record, "wakeups", JS_NewUint32(ctx, qt->wakeups));
+    JS_SetPropertyStr(ctx, record, "bytesSent", JS_NewInt64(ctx, qt->bytes_sent));
+    JS_SetPropertyStr(ctx, record, "bytesReceived", JS_NewInt64(ctx, qt->bytes_received));
+    JS_SetPropertyStr(ctx, record, "error", JS_NewBool(ctx, error));
+
+    ret = JS_Call(ctx, qs->hook, JS_UNDEFINED, 1, &record);
+
+    JS_FreeValue(ctx, ret);
+    JS_FreeValue(ctx, record);
+  }
+}
+
+/**
+ * Totals as { queries, errors, rows, wakeups, bytesSent, bytesReceived,
+ * firstByteTime, lastRowTime, histogram }, times in milliseconds.
+ */
+JSValue
+query_stats_value(QueryStats* qs, JSContext* ctx) {
+  JSValue ret = JS_NewObject(ctx), histogram = JS_NewArray(ctx);
+
+  JS_SetPropertyStr(ctx, ret, "queries", JS_NewInt64(ctx, qs->queries));
+  JS_SetPropertyStr(ctx, ret, "errors", JS_NewInt64(ctx, qs->errors));
+  JS_SetPropertyStr(ctx, ret, "rows", JS_NewInt64(ctx, qs->rows));
+  JS_SetPropertyStr(ctx, ret, "wakeups", JS_NewInt64(ctx, qs->wakeups));
+  JS_SetPropertyStr(ctx, ret, "bytesSent", JS_NewInt64(ctx, qs->bytes_sent));
+  JS_SetPropertyStr(ctx, ret, "bytesReceived", JS_NewInt64(ctx, qs->bytes_received));
+  JS_SetPropertyStr(ctx, ret, "firstByteTime", JS_NewFloat64(ctx, qs->first_byte_time / 1000.0));
+  JS_SetPropertyStr(ctx, ret, "lastRowTime", JS_NewFloat64(ctx, qs->last_row_time / 1000.0));
+
+  for(int i = 0; i < QUERY_STATS_BUCKETS; i++)
+    JS_SetPropertyUint32(ctx, histogram, i, JS_NewUint32(ctx, qs->histogram[i]));
+
+  JS_SetPropertyStr(ctx, ret, "histogram", histogram);
+
+  return ret;
+}
+
+/**
+ * @}
+ */
@@ -2,19 +2,214 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
 #include "debug.h"
 
 /**
  * \addtogroup queue
  * @{
  */
+static const size_t chunk_classes[CHUNK_POOL_CLASSES] = {256, 4096, 16384, 65536};
+
+typedef struct chunk_pool {
+  Chunk* free[CHUNK_POOL_CLASSES];
+  /* chunks freed on other threads, taken over when free[] runs dry */
+  Chunk* remote[CHUNK_POOL_CLASSES];
+  /* unused rest of the newest slab */
+  uint8_t* slab;
+  size_t slab_left;
+  /* all slabs, linked through their first bytes */
+  void* slabs;
+  /* chunks handed out, plus one while the owning thread runs */
+  long refs;
+  ChunkPoolStats stats;
+} ChunkPool;
+
+/* slot sizes are multiples of 64, so is the slab header */
+#define CHUNK_SLAB_HEADER 64
+
+static thread_local ChunkPool* chunk_pool;
+static int chunk_pool_huge = 0;
+static pthread_key_t chunk_pool_key;
+static pthread_once_t chunk_pool_once = PTHREAD_ONCE_INIT;
+
+static void
+chunk_pool_destroy(ChunkPool* pool) {
+  void *slab, *next;
+
+  for(slab = pool->slabs; slab; slab = next) {
+    next = *(void**)slab;
+    free(slab);
+  }
+
+  free(pool);
+}
+
+static inline void
+chunk_pool_release(ChunkPool* pool) {
+  if(__atomic_sub_fetch(&pool->refs, 1, __ATOMIC_ACQ_REL) == 0)
+    chunk_pool_destroy(pool);
+}
+
+/**
+ * Thread exit: the slabs go away now, or with the last chunk that
+ * another thread still holds.
+ */
+static void
+chunk_pool_exit(void* ptr) {
+  ChunkPool* pool = ptr;
+
+  if(chunk_pool == pool)
+    chunk_pool = 0;
+
+  chunk_pool_release(pool);
+}
+
+static void
+chunk_pool_init(void) {
+  pthread_key_create(&chunk_pool_key, chunk_pool_exit);
+}
+
+static ChunkPool*
+chunk_pool_self(void) {
+  if(!chunk_pool) {
+    pthread_once(&chunk_pool_once, chunk_pool_init);
+
+    if((chunk_pool = calloc(1, sizeof(ChunkPool)))) {
+      chunk_pool->refs = 1;
+      pthread_setspecific(chunk_pool_key, chunk_pool);
+    }
+  }
+
+  return chunk_pool;
+}
+
+static inline size_t
+chunk_slot_size(int cls) {
+  return (sizeof(Chunk) + chunk_classes[cls] + 63) & ~(size_t)63;
+}
+
+static uint8_t*
+chunk_slab_alloc(void) {
+#ifdef MADV_HUGEPAGE
+  void* ptr;
+
+  if(chunk_pool_huge && posix_memalign(&ptr, CHUNK_SLAB_SIZE, CHUNK_SLAB_SIZE) == 0) {
+    madvise(ptr, CHUNK_SLAB_SIZE, MADV_HUGEPAGE);
+    return ptr;
+  }
+#endif
+
+  return malloc(CHUNK_SLAB_SIZE);
+}
+
+static Chunk*
+chunk_pool_get(ChunkPool* pool, int cls) {
+  size_t slot = chunk_slot_size(cls);
+  Chunk* ch;
+
+  if(!pool->free[cls] && __atomic_load_n(&pool->remote[cls], __ATOMIC_RELAXED)) {
+    pool->free[cls] = __atomic_exchange_n(&pool->remote[cls], 0, __ATOMIC_ACQUIRE);
+
+    for(ch = pool->free[cls]; ch; ch = ch->next)
+      pool->stats.free[cls]++;
+  }
+
+  if((ch = pool->free[cls])) {
+    pool->free[cls] = ch->next;
+    pool->stats.free[cls]--;
+    pool->stats.hits++;
+    __atomic_add_fetch(&pool->refs, 1, __ATOMIC_RELAXED);
+    return ch;
+  }
+
+  if(pool->slab_left < slot) {
+    /* the rest of the old slab goes to the free lists it can still serve */
+    for(int i = cls - 1; i >= 0; i--) {
+      while(pool->slab_left >= chunk_slot_size(i)) {
+        Chunk* rest = (Chunk*)pool->slab;
+
+        rest->next = pool->free[i];
+        pool->free[i] = rest;
+        pool->stats.free[i]++;
+        pool->slab += chunk_slot_size(i);
+        pool->slab_left -= chunk_slot_size(i);
+      }
+    }
+
+    if(!(pool->slab = chunk_slab_alloc())) {
+      pool->slab_left = 0;
+      return 0;
+    }
+
+    *(void**)pool->slab = pool->slabs;
+    pool->slabs = pool->slab;
+    pool->slab += CHUNK_SLAB_HEADER;
+    pool->slab_left = CHUNK_SLAB_SIZE - CHUNK_SLAB_HEADER;
+    pool->stats.slabs++;
+  }
+
+  ch = (Chunk*)pool->slab;
+  pool->slab += slot;
+  pool->slab_left -= slot;
+  pool->stats.hits++;
+  __atomic_add_fetch(&pool->refs, 1, __ATOMIC_RELAXED);
+  return ch;
+}
+
 Chunk*
 chunk_alloc(size_t size) {
+  ChunkPool* pool = chunk_pool_self();
   Chunk* ch;
+  int cls = 0;
+
+  while(cls < CHUNK_POOL_CLASSES && size > chunk_classes[cls])
+    cls++;
 
-  if((ch = malloc(sizeof(Chunk) + size))) {
+  if(pool && cls < CHUNK_POOL_CLASSES) {
+    ch = chunk_pool_get(pool, cls);
+  } else {
+    ch = malloc(sizeof(Chunk) + size);
+    cls = -1;
+
+    if(pool)
+      pool->stats.misses++;
+  }
+
+  if(ch) {
     memset(ch, 0, sizeof(Chunk));
     ch->ref_count = 1;
+    ch->pool = cls;
+    ch->owner = cls >= 0 ? pool : 0;
+    ch->data = ch->buf;
+  }
+
+  return ch;
+}
+
+/**
+ * Allocate a chunk referring to memory it does not own. \p release is
+ * called when the last reference goes away. \p extra bytes of inline
+ * storage are reserved for the owner's bookkeeping (ch->opaque points
+ * there).
+ */
+Chunk*
+chunk_external(void* data, size_t size, void (*release)(Chunk*), size_t extra) {
+  Chunk* ch;
+
+  if((ch = chunk_alloc(extra))) {
+    ch->opaque = ch->buf;
+    ch->data = data;
+    ch->size = size;
+    ch->release = release;
   }
 
   return ch;
@@ -22,8 +217,50 @@ chunk_alloc(size_t size) {
 
 void
 chunk_free(Chunk* ch) {
-  if(--ch->ref_count == 0)
-    free(ch);
+  if(--ch->ref_count == 0) {
+    if(ch->release)
+      ch->release(ch);
+
+    if(ch->pool >= 0 && ch->owner == chunk_pool) {
+      ch->next = ch->owner->free[ch->pool];
+      ch->owner->free[ch->pool] = ch;
+      ch->owner->stats.free[ch->pool]++;
+      chunk_pool_release(ch->owner);
+    } else if(ch->pool >= 0) {
+      /* back to the thread that allocated it, so its slabs get reused */
+      ChunkPool* owner = ch->owner;
+      Chunk** head = &owner->remote[ch->pool];
+
+      ch->next = __atomic_load_n(head, __ATOMIC_RELAXED);
+
+      while(!__atomic_compare_exchange_n(head, &ch->next, ch, TRUE, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {}
+
+      /* frees the pool when its thread is gone and this was the last chunk */
+      chunk_pool_release(owner);
+    } else {
+      free(ch);
+    }
+  }
+}
+
+/**
+ * Pool counters of the calling thread: hits were served from the
+ * pool, misses were too large for it and went to malloc.
+ */
+void
+chunk_pool_stats(ChunkPoolStats* stats) {
+  if(chunk_pool)
+    *stats = chunk_pool->stats;
+  else
+    memset(stats, 0, sizeof(ChunkPoolStats));
+}
+
+/**
+ * Backs new slabs with transparent huge pages, where supported.
+ */
+void
+chunk_pool_hugepages(int enable) {
+  chunk_pool_huge = enable;
 }
 
 static void
@@ -96,6 +333,16 @@ queue_write(Queue* q, const void* x, size_t n) {
   return -1;
 }
 
+/**
+ * Append a chunk without copying; the queue takes over the reference.
+ */
+void
+queue_put(Queue* q, Chunk* ch) {
+  list_add(&ch->link, &q->list);
+  q->nbytes += ch->size - ch->pos;
+  q->nchunks++;
+}
+
 ssize_t
 queue_read(Queue* q, void* x, size_t n) {
   Chunk* b;
@@ -124,20 +371,19 @@ queue_read(Queue* q, void* x, size_t n) {
 
 ssize_t
 queue_peek(Queue* q, void* x, size_t n) {
-  Chunk* b;
+  struct list_head* el;
   ssize_t ret = 0;
   uint8_t* p = x;
 
-  while(n > 0 && (b = queue_tail(q))) {
+  /* oldest chunk first, like queue_read() */
+  for(el = q->list.prev; n > 0 && el != &q->list; el = el->prev) {
+    Chunk* b = list_entry(el, Chunk, link);
     size_t bytes = MIN_NUM((b->size - b->pos), n);
 
     memcpy(p, &b->data[b->pos], bytes);
     p += bytes;
     n -= bytes;
     ret += bytes;
-
-    if(b->pos < b->size)
-      break;
   }
 
   return ret;
@@ -262,6 +508,108 @@ queue_at(Queue* q, ssize_t offset, size_t* skip) {
   return NULL;
 }
 
+/**
+ * Writes up to max bytes from the front of the queue with one writev()
+ * over at most QUEUE_IOV chunks, and drops what was written. Returns the
+ * byte count or -1 (errno is set).
+ */
+ssize_t
+queue_writev(Queue* q, int fd, size_t max) {
+  ssize_t n;
+#ifdef _WIN32
+  Chunk* ch;
+
+  if(!(ch = queue_tail(q)) || !max)
+    return 0;
+
+  n = write(fd, ch->data + ch->pos, MIN_NUM(ch->size - ch->pos, max));
+#else
+  struct iovec iov[QUEUE_IOV];
+  struct list_head* el;
+  int i = 0;
+
+  for(el = q->list.prev; el != &q->list && i < QUEUE_IOV && max > 0; el = el->prev, i++) {
+    Chunk* ch = list_entry(el, Chunk, link);
+
+    iov[i].iov_base = ch->data + ch->pos;
+    iov[i].iov_len = MIN_NUM(ch->size - ch->pos, max);
+    max -= iov[i].iov_len;
+  }
+
+  if(i == 0)
+    return 0;
+
+  n = writev(fd, iov, i);
+#endif
+
+  if(n > 0)
+    queue_skip(q, n);
+
+  return n;
+}
+
+/**
+ * Reads up to max bytes with one readv() into fresh chunks of at most
+ * QUEUE_READ_CHUNK bytes, which are appended to the queue without
+ * copying. Returns the byte count, 0 at end of file or -1 (errno is set).
+ */
+ssize_t
+queue_readv(Queue* q, int fd, size_t max) {
+  Chunk* chunks[QUEUE_IOV];
+  size_t lens[QUEUE_IOV];
+  ssize_t n, left;
+  int i, count = 0;
+#ifndef _WIN32
+  struct iovec iov[QUEUE_IOV];
+#endif
+
+  while(max > 0 && count < QUEUE_IOV) {
+    lens[count] = MIN_NUM(max, QUEUE_READ_CHUNK);
+
+    if(!(chunks[count] = chunk_alloc(lens[count])))
+      break;
+
+#ifndef _WIN32
+    iov[count].iov_base = chunks[count]->data;
+    iov[count].iov_len = lens[count];
+#endif
+    max -= lens[count];
+    count++;
+
+#ifdef _WIN32
+    break;
+#endif
+  }
+
+  if(count == 0) {
+    if(max == 0)
+      return 0;
+
+    errno = ENOMEM;
+    return -1;
+  }
+
+#ifdef _WIN32
+  n = read(fd, chunks[0]->data, lens[0]);
+#else
+  n = readv(fd, iov, count);
+#endif
+
+  for(i = 0, left = MAX_NUM(n, 0); i < count; i++) {
+    size_t len = MIN_NUM((size_t)left, lens[i]);
+
+    if(len > 0) {
+      chunks[i]->size = len;
+      queue_put(q, chunks[i]);
+      left -= len;
+    } else {
+      chunk_free(chunks[i]);
+    }
+  }
+
+  return n;
+}
+
 /**
  * @}
  */
@@ -0,0 +1,229 @@
+#include "result-columns.h"
+#include "utils.h"
+#include "defines.h"
+#include <stdlib.h>
+
+/**
+ * \addtogroup result-columns
+ * @{
+ */
+
+static const char* const column_types[] = {
+    "int32",
+    "int64",
+    "float64",
+    "bool",
+    "string",
+    "binary",
+};
+
+static const uint8_t column_sizes[] = {
+    sizeof(int32_t),
+    sizeof(int64_t),
+    sizeof(double),
+    sizeof(uint8_t),
+    0,
+    0,
+};
+
+static inline BOOL
+column_is_bytes(const ResultColumn* col) {
+  return col->type == COLUMN_STRING || col->type == COLUMN_BINARY;
+}
+
+void
+column_init(ResultColumn* col, const char* name, ColumnType type, JSContext* ctx) {
+  col->name = js_strdup(ctx, name);
+  col->type = type;
+  col->length = 0;
+  col->null_count = 0;
+
+  js_dbuf_init(ctx, &col->values);
+  js_dbuf_init(ctx, &col->offsets);
+  js_dbuf_init(ctx, &col->validity);
+
+  if(column_is_bytes(col)) {
+    uint32_t offset = 0;
+
+    dbuf_put(&col->offsets, (const uint8_t*)&offset, sizeof(offset));
+  }
+}
+
+/**
+ * Pre-allocates storage when the row count is known up front.
+ */
+void
+column_reserve(ResultColumn* col, uint32_t rows) {
+  size_t size = column_sizes[col->type];
+
+  if(size)
+    dbuf_realloc(&col->values, col->values.size + size * rows);
+  else
+    dbuf_realloc(&col->offsets, col->offsets.size + sizeof(uint32_t) * rows);
+
+  dbuf_realloc(&col->validity, col->validity.size + (rows + 7) / 8);
+}
+
+/**
+ * Appends one text cell; buf == NULL appends a NULL.
+ */
+BOOL
+column_push(ResultColumn* col, const char* buf, size_t len) {
+  uint32_t row = col->length++;
+  int r = 0;
+
+  if((row & 7) == 0)
+    if(dbuf_putc(&col->validity, 0))
+      return FALSE;
+
+  if(buf)
+    col->validity.buf[row >> 3] |= 1 << (row & 7);
+  else
+    col->null_count++;
+
+  switch(col->type) {
+    case COLUMN_INT32: {
+      int32_t i = buf ? (int32_t)strtol(buf, 0, 10) : 0;
+
+      r = dbuf_put(&col->values, (const uint8_t*)&i, sizeof(i));
+      break;
+    }
+
+    case COLUMN_INT64: {
+      int64_t i = buf ? (int64_t)strtoll(buf, 0, 10) : 0;
+
+      r = dbuf_put(&col->values, (const uint8_t*)&i, sizeof(i));
+      break;
+    }
+
+    case COLUMN_FLOAT64: {
+      double d = buf ? strtod(buf, 0) : 0;
+
+      r = dbuf_put(&col->values, (const uint8_t*)&d, sizeof(d));
+      break;
+    }
+
+    case COLUMN_BOOL: {
+      /* 't'/'f' from PostgreSQL, '1'/'0' from MySQL */
+      r = dbuf_putc(&col->values, buf && len > 0 && (buf[0] == 't' || buf[0] == 'T' || buf[0] == '1'));
+      break;
+    }
+
+    case COLUMN_STRING:
+    case COLUMN_BINARY: {
+      uint32_t offset;
+
+      if(buf && len)
+        if((r = dbuf_put(&col->values, (const uint8_t*)buf, len)))
+          break;
+
+      offset = col->values.size;
+      r = dbuf_put(&col->offsets, (const uint8_t*)&offset, sizeof(offset));
+      break;
+    }
+  }
+
+  return r == 0;
+}
+
+/**
+ * Appends one already decoded fixed-width value (int32_t, int64_t,
+ * double or uint8_t, according to the column type); NULL appends a NULL.
+ */
+BOOL
+column_push_raw(ResultColumn* col, const void* value) {
+  uint32_t row = col->length;
+  size_t size = column_sizes[col->type];
+
+  if(!size)
+    return FALSE;
+
+  if(!value)
+    return column_push(col, 0, 0);
+
+  col->length++;
+
+  if((row & 7) == 0)
+    if(dbuf_putc(&col->validity, 0))
+      return FALSE;
+
+  col->validity.buf[row >> 3] |= 1 << (row & 7);
+
+  return dbuf_put(&col->values, value, size) == 0;
+}
+
+static JSValue
+column_array(DynBuf* db, int bits, BOOL floating, BOOL sign, JSContext* ctx) {
+  JSValue buffer = dbuf_steal_arraybuffer(db, ctx);
+  JSValue ret = js_typedarray_new(ctx, bits, floating, sign, buffer);
+
+  JS_FreeValue(ctx, buffer);
+  return ret;
+}
+
+/**
+ * Returns { name, type, length, nullCount, values, validity[, offsets] }
+ * and moves the column's buffers into it. Bit i of validity is set when
+ * row i is not NULL; string and binary columns store row i in
+ * values[offsets[i]..offsets[i + 1]].
+ */
+JSValue
+column_value(ResultColumn* col, JSContext* ctx) {
+  JSValue ret = JS_NewObject(ctx), values = JS_UNDEFINED;
+
+  JS_SetPropertyStr(ctx, ret, "name", JS_NewString(ctx, col->name ? col->name : ""));
+  JS_SetPropertyStr(ctx, ret, "type", JS_NewString(ctx, column_types[col->type]));
+  JS_SetPropertyStr(ctx, ret, "length", JS_NewUint32(ctx, col->length));
+  JS_SetPropertyStr(ctx, ret, "nullCount", JS_NewUint32(ctx, col->null_count));
+
+  switch(col->type) {
+    case COLUMN_INT32: values = column_array(&col->values, 32, FALSE, TRUE, ctx); break;
+    case COLUMN_INT64: values = column_array(&col->values, 64, FALSE, TRUE, ctx); break;
+    case COLUMN_FLOAT64: values = column_array(&col->values, 64, TRUE, TRUE, ctx); break;
+    case COLUMN_BOOL:
+    case COLUMN_STRING:
+    case COLUMN_BINARY: values = column_array(&col->values, 8, FALSE, FALSE, ctx); break;
+  }
+
+  JS_SetPropertyStr(ctx, ret, "values", values);
+  JS_SetPropertyStr(ctx, ret, "validity", column_array(&col->validity, 8, FALSE, FALSE, ctx));
+
+  if(column_is_bytes(col))
+    JS_SetPropertyStr(ctx, ret, "offsets", column_array(&col->offsets, 32, FALSE, FALSE, ctx));
+
+  return ret;
+}
+
+void
+column_free(ResultColumn* col, JSRuntime* rt) {
+  if(col->name)
+    js_free_rt(rt, col->name);
+
+  col->name = 0;
+
+  dbuf_free(&col->values);
+  dbuf_free(&col->offsets);
+  dbuf_free(&col->validity);
+}
+
+JSValue
+columns_value(ResultColumn* cols, uint32_t num_columns, JSContext* ctx) {
+  JSValue ret = JS_NewArray(ctx);
+
+  for(uint32_t i = 0; i < num_columns; i++)
+    JS_SetPropertyUint32(ctx, ret, i, column_value(&cols[i], ctx));
+
+  return ret;
+}
+
+void
+columns_free(ResultColumn* cols, uint32_t num_columns, JSRuntime* rt) {
+  for(uint32_t i = 0; i < num_columns; i++)
+    column_free(&cols[i], rt);
+
+  js_free_rt(rt, cols);
+}
+
+/**
+ * @}
+ */
@@ -0,0 +1,378 @@
+#include "shared-ringbuffer.h"
+#include "utils.h"
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include <sched.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+/**
+ * \addtogroup shared-ringbuffer
+ * @{
+ */
+#define ring_load(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define ring_store(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#define ring_own(ptr) __atomic_load_n((ptr), __ATOMIC_RELAXED)
+
+static void
+ring_futex_wait(uint32_t* addr, uint32_t value, int64_t timeout_ms) {
+#ifdef __linux__
+  struct timespec ts = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000};
+
+  syscall(SYS_futex, addr, FUTEX_WAIT, value, timeout_ms >= 0 ? &ts : NULL, NULL, 0);
+#elif defined(_WIN32)
+  Sleep(1);
+#else
+  /* no futex: poll every millisecond */
+  struct timespec ts = {0, 1000000};
+
+  nanosleep(&ts, NULL);
+#endif
+}
+
+static void
+ring_futex_wake(uint32_t* addr) {
+#ifdef __linux__
+  syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+static inline uint32_t
+ring_free(SharedRing* ring, uint32_t pos) {
+  return shared_ring_capacity(ring) - (pos - ring_load(&ring->hdr->tail));
+}
+
+static void
+ring_copy_in(SharedRing* ring, uint32_t pos, const void* x, size_t len) {
+  uint32_t offset = pos & ring->mask;
+  size_t n = MIN_NUM(len, shared_ring_capacity(ring) - offset);
+
+  memcpy(ring->data + offset, x, n);
+  memcpy(ring->data, (const uint8_t*)x + n, len - n);
+}
+
+static void
+ring_copy_out(SharedRing* ring, uint32_t pos, void* x, size_t len) {
+  uint32_t offset = pos & ring->mask;
+  size_t n = MIN_NUM(len, shared_ring_capacity(ring) - offset);
+
+  memcpy(x, ring->data + offset, n);
+  memcpy((uint8_t*)x + n, ring->data, len - n);
+}
+
+/* claims len bytes for the calling producer, all or nothing */
+static BOOL
+ring_claim(SharedRing* ring, size_t len, uint32_t* ppos) {
+  SharedRingHeader* hdr = ring->hdr;
+  uint32_t pos;
+
+  if(hdr->mode != SHARED_RING_MPSC) {
+    pos = ring_own(&hdr->head);
+
+    if(ring_free(ring, pos) < len)
+      return FALSE;
+  } else {
+    pos = ring_own(&hdr->reserve);
+
+    do {
+      if(ring_free(ring, pos) < len)
+        return FALSE;
+    } while(!__atomic_compare_exchange_n(&hdr->reserve, &pos, pos + (uint32_t)len, TRUE, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+  }
+
+  *ppos = pos;
+  return TRUE;
+}
+
+/* makes [pos, pos + len) visible to the consumer, after earlier claims */
+static void
+ring_publish(SharedRing* ring, uint32_t pos, size_t len) {
+  SharedRingHeader* hdr = ring->hdr;
+
+  if(hdr->mode == SHARED_RING_MPSC)
+    while(ring_load(&hdr->head) != pos)
+      sched_yield();
+
+  ring_store(&hdr->head, pos + (uint32_t)len);
+
+  /* orders the store above before the check for sleeping readers */
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+  if(ring_own(&hdr->readers_waiting))
+    ring_futex_wake(&hdr->head);
+}
+
+static void
+ring_consume(SharedRing* ring, uint32_t tail, size_t len) {
+  SharedRingHeader* hdr = ring->hdr;
+
+  ring_store(&hdr->tail, tail + (uint32_t)len);
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+  if(ring_own(&hdr->writers_waiting))
+    ring_futex_wake(&hdr->tail);
+}
+
+/**
+ * Bytes of shared memory needed for a ring of at least capacity bytes.
+ */
+size_t
+shared_ring_size(size_t capacity) {
+  size_t n = 1;
+
+  while(n < capacity)
+    n <<= 1;
+
+  return sizeof(SharedRingHeader) + n;
+}
+
+/**
+ * Formats mem as an empty ring using the largest power-of-two capacity
+ * that fits. Other parties attach only after this returns.
+ */
+BOOL
+shared_ring_init(SharedRing* ring, void* mem, size_t size, SharedRingMode mode) {
+  SharedRingHeader* hdr = mem;
+  size_t capacity = 1;
+
+  if(((uintptr_t)mem & 3) || size < sizeof(SharedRingHeader) + 4)
+    return FALSE;
+
+  while(capacity * 2 <= size - sizeof(SharedRingHeader) && capacity * 2 <= 0x80000000u)
+    capacity *= 2;
+
+  memset(hdr, 0, sizeof(SharedRingHeader));
+  hdr->capacity = capacity;
+  hdr->mode = mode;
+  ring_store(&hdr->magic, SHARED_RING_MAGIC);
+
+  ring->hdr = hdr;
+  ring->data = (uint8_t*)mem + sizeof(SharedRingHeader);
+  ring->mask = capacity - 1;
+  return TRUE;
+}
+
+/**
+ * Attaches to a ring formatted by shared_ring_init().
+ */
+BOOL
+shared_ring_attach(SharedRing* ring, void* mem, size_t size) {
+  SharedRingHeader* hdr = mem;
+  uint32_t capacity;
+
+  if(((uintptr_t)mem & 3) || size < sizeof(SharedRingHeader) || ring_load(&hdr->magic) != SHARED_RING_MAGIC)
+    return FALSE;
+
+  capacity = hdr->capacity;
+
+  if(!capacity || (capacity & (capacity - 1)) || capacity > size - sizeof(SharedRingHeader))
+    return FALSE;
+
+  ring->hdr = hdr;
+  ring->data = (uint8_t*)mem + sizeof(SharedRingHeader);
+  ring->mask = capacity - 1;
+  return TRUE;
+}
+
+/**
+ * Bytes ready to be read.
+ */
+size_t
+shared_ring_length(SharedRing* ring) {
+  return ring_load(&ring->hdr->head) - ring_load(&ring->hdr->tail);
+}
+
+/**
+ * Bytes that can be written now.
+ */
+size_t
+shared_ring_avail(SharedRing* ring) {
+  SharedRingHeader* hdr = ring->hdr;
+
+  return ring_free(ring, ring_load(hdr->mode == SHARED_RING_MPSC ? &hdr->reserve : &hdr->head));
+}
+
+/**
+ * Writes up to len bytes; returns how many were written. MPSC rings
+ * write everything or nothing.
+ */
+size_t
+shared_ring_write(SharedRing* ring, const void* x, size_t len) {
+  uint32_t pos;
+
+  if(ring->hdr->mode != SHARED_RING_MPSC)
+    len = MIN_NUM(len, ring_free(ring, ring_own(&ring->hdr->head)));
+
+  if(!len || !ring_claim(ring, len, &pos))
+    return 0;
+
+  ring_copy_in(ring, pos, x, len);
+  ring_publish(ring, pos, len);
+  return len;
+}
+
+/**
+ * Reads up to len bytes (consumer only); returns how many were read.
+ */
+size_t
+shared_ring_read(SharedRing* ring, void* x, size_t len) {
+  SharedRingHeader* hdr = ring->hdr;
+  uint32_t tail = ring_own(&hdr->tail);
+
+  if((len = MIN_NUM(len, ring_load(&hdr->head) - tail))) {
+    ring_copy_out(ring, tail, x, len);
+    ring_consume(ring, tail, len);
+  }
+
+  return len;
+}
+
+/**
+ * Queues one message as a 32-bit length followed by len bytes. Fails
+ * when it does not fit right now.
+ */
+BOOL
+shared_ring_send(SharedRing* ring, const void* x, size_t len) {
+  uint32_t pos, n = len;
+
+  if(len > shared_ring_capacity(ring) - sizeof(uint32_t) || !ring_claim(ring, sizeof(uint32_t) + len, &pos))
+    return FALSE;
+
+  ring_copy_in(ring, pos, &n, sizeof(n));
+  ring_copy_in(ring, pos + sizeof(n), x, len);
+  ring_publish(ring, pos, sizeof(n) + len);
+  return TRUE;
+}
+
+/**
+ * Length of the next message, or -1 when none is queued.
+ */
+ssize_t
+shared_ring_next(SharedRing* ring) {
+  SharedRingHeader* hdr = ring->hdr;
+  uint32_t n, tail = ring_own(&hdr->tail);
+
+  if(ring_load(&hdr->head) - tail < sizeof(n))
+    return -1;
+
+  ring_copy_out(ring, tail, &n, sizeof(n));
+  return n;
+}
+
+/**
+ * Dequeues the next message into x; returns its length, or -1 when none
+ * is queued or it is longer than len.
+ */
+ssize_t
+shared_ring_receive(SharedRing* ring, void* x, size_t len) {
+  uint32_t tail = ring_own(&ring->hdr->tail);
+  ssize_t n;
+
+  if((n = shared_ring_next(ring)) < 0 || (size_t)n > len)
+    return -1;
+
+  ring_copy_out(ring, tail + sizeof(uint32_t), x, n);
+  ring_consume(ring, tail, sizeof(uint32_t) + n);
+  return n;
+}
+
+/**
+ * Points span at the readable bytes without copying them (consumer only);
+ * returns their total length. Release them with shared_ring_skip().
+ */
+size_t
+shared_ring_peek(SharedRing* ring, SharedRingSpan span[2]) {
+  SharedRingHeader* hdr = ring->hdr;
+  uint32_t tail = ring_own(&hdr->tail), offset = tail & ring->mask;
+  size_t len = ring_load(&hdr->head) - tail, n = MIN_NUM(len, shared_ring_capacity(ring) - offset);
+
+  span[0] = (SharedRingSpan){ring->data + offset, n};
+  span[1] = (SharedRingSpan){ring->data, len - n};
+  return len;
+}
+
+/**
+ * Releases len bytes returned by shared_ring_peek() to the producers.
+ */
+void
+shared_ring_skip(SharedRing* ring, size_t len) {
+  ring_consume(ring, ring_own(&ring->hdr->tail), len);
+}
+
+static int64_t
+ring_remaining(uint64_t deadline) {
+  uint64_t now = time_us();
+
+  return now >= deadline ? 0 : (int64_t)(deadline - now + 999) / 1000;
+}
+
+/**
+ * Blocks until data is readable; timeout_ms < 0 waits forever. Returns
+ * FALSE on timeout.
+ */
+BOOL
+shared_ring_wait_readable(SharedRing* ring, int64_t timeout_ms) {
+  SharedRingHeader* hdr = ring->hdr;
+  uint64_t deadline = time_us() + (timeout_ms > 0 ? timeout_ms * 1000 : 0);
+
+  for(;;) {
+    uint32_t head = ring_load(&hdr->head);
+    int64_t remaining = timeout_ms < 0 ? -1 : ring_remaining(deadline);
+
+    if(head != ring_own(&hdr->tail))
+      return TRUE;
+
+    if(remaining == 0)
+      return FALSE;
+
+    __atomic_fetch_add(&hdr->readers_waiting, 1, __ATOMIC_SEQ_CST);
+
+    if(ring_load(&hdr->head) == head)
+      ring_futex_wait(&hdr->head, head, remaining);
+
+    __atomic_fetch_sub(&hdr->readers_waiting, 1, __ATOMIC_SEQ_CST);
+  }
+}
+
+/**
+ * Blocks until len bytes can be written; timeout_ms < 0 waits forever.
+ * Returns FALSE on timeout or when len exceeds the capacity.
+ */
+BOOL
+shared_ring_wait_writable(SharedRing* ring, size_t len, int64_t timeout_ms) {
+  SharedRingHeader* hdr = ring->hdr;
+  uint64_t deadline = time_us() + (timeout_ms > 0 ? timeout_ms * 1000 : 0);
+
+  if(len > shared_ring_capacity(ring))
+    return FALSE;
+
+  for(;;) {
+    uint32_t tail = ring_load(&hdr->tail);
+    int64_t remaining = timeout_ms < 0 ? -1 : ring_remaining(deadline);
+
+    if(shared_ring_avail(ring) >= len)
+      return TRUE;
+
+    if(remaining == 0)
+      return FALSE;
+
+    __atomic_fetch_add(&hdr->writers_waiting, 1, __ATOMIC_SEQ_CST);
+
+    if(ring_load(&hdr->tail) == tail)
+      ring_futex_wait(&hdr->tail, tail, remaining);
+
+    __atomic_fetch_sub(&hdr->writers_waiting, 1, __ATOMIC_SEQ_CST);
+  }
+}
+
+/**
+ * @}
+ */
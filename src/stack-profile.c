@@ -0,0 +1,315 @@
+#include "stack-profile.h"
+#include "quickjs-internal.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+/**
+ * \addtogroup stack-profile
+ * @{
+ */
+
+#define PC2LINE_BASE (-1)
+#define PC2LINE_RANGE 5
+#define PC2LINE_OP_FIRST 1
+
+static const uint8_t*
+pc2line_leb128(const uint8_t* p, const uint8_t* end, uint32_t* pval) {
+  uint32_t v = 0;
+  int shift;
+
+  for(shift = 0; p < end && shift < 35; shift += 7) {
+    uint8_t c = *p++;
+    v |= (uint32_t)(c & 0x7f) << shift;
+
+    if(!(c & 0x80)) {
+      *pval = v;
+      return p;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Decodes the pc2line table of \p b like find_line_num() in quickjs.c.
+ */
+static int
+stack_profile_line(JSFunctionBytecode* b, const uint8_t* cur_pc) {
+  const uint8_t *p, *end;
+  uint32_t pc = 0, pc_value, val;
+  int line, new_line;
+
+  if(!b->has_debug)
+    return 0;
+
+  line = b->debug.line_num;
+
+  if(!b->debug.pc2line_buf || !cur_pc || cur_pc < b->byte_code_buf)
+    return line;
+
+  /* cur_pc is the instruction after the call */
+  pc_value = cur_pc - b->byte_code_buf - 1;
+  p = b->debug.pc2line_buf;
+  end = p + b->debug.pc2line_len;
+
+  while(p < end) {
+    unsigned int op = *p++;
+
+    if(op == 0) {
+      if(!(p = pc2line_leb128(p, end, &val)))
+        break;
+
+      pc += val;
+
+      if(!(p = pc2line_leb128(p, end, &val)))
+        break;
+
+      /* zigzag encoded */
+      new_line = line + (int)((val >> 1) ^ -(val & 1));
+    } else {
+      op -= PC2LINE_OP_FIRST;
+      pc += op / PC2LINE_RANGE;
+      new_line = line + (int)(op % PC2LINE_RANGE) + PC2LINE_BASE;
+    }
+
+    if(pc_value < pc)
+      break;
+
+    line = new_line;
+  }
+
+  return line;
+}
+
+/**
+ * Copies up to \p max_depth frames of the running JS stack, innermost
+ * first.  For the innermost frame the line is that of the last call it
+ * made, the interpreter doesn't store its pc otherwise.
+ */
+int
+stack_profile_capture(JSRuntime* rt, StackProfileFrame* frames, int max_depth) {
+  JSStackFrame* sf;
+  int n = 0;
+
+  for(sf = rt->current_stack_frame; sf && n < max_depth; sf = sf->prev_frame) {
+    JSObject* p;
+    JSFunctionBytecode* b;
+
+    if(JS_VALUE_GET_TAG(sf->cur_func) != JS_TAG_OBJECT)
+      continue;
+
+    p = JS_VALUE_GET_OBJ(sf->cur_func);
+
+    switch(p->class_id) {
+      case JS_CLASS_BYTECODE_FUNCTION:
+      case JS_CLASS_GENERATOR_FUNCTION:
+      case JS_CLASS_ASYNC_FUNCTION:
+      case JS_CLASS_ASYNC_GENERATOR_FUNCTION: {
+        b = p->u.func.function_bytecode;
+        frames[n].name = b->func_name;
+        frames[n].file = b->has_debug ? b->debug.filename : JS_ATOM_NULL;
+        frames[n].line = stack_profile_line(b, sf->cur_pc);
+        break;
+      }
+
+      default: {
+        frames[n].name = JS_ATOM_NULL;
+        frames[n].file = JS_ATOM_NULL;
+        frames[n].line = -1;
+        break;
+      }
+    }
+
+    ++n;
+  }
+
+  return n;
+}
+
+static uint64_t
+stack_profile_hash(const StackProfileFrame* frames, int depth) {
+  const uint8_t* p = (const uint8_t*)frames;
+  size_t n = depth * sizeof(StackProfileFrame);
+  uint64_t h = 0xcbf29ce484222325ull;
+
+  while(n--)
+    h = (h ^ *p++) * 0x100000001b3ull;
+
+  return h;
+}
+
+/**
+ * Counts one sample of the given stack.  New stacks pin their atoms, the
+ * functions may be gone by the time the profile is written.
+ */
+void
+stack_profile_add(StackProfile* sp, JSContext* ctx, const StackProfileFrame* frames, int depth, uint64_t weight) {
+  uint64_t h = stack_profile_hash(frames, depth);
+  StackProfileEntry *e, **table, *next;
+  size_t i, size;
+  int j;
+
+  sp->samples++;
+
+  if(sp->size)
+    for(e = sp->table[h & (sp->size - 1)]; e; e = e->next)
+      if(e->hash == h && e->depth == depth && !memcmp(e->frames, frames, depth * sizeof(StackProfileFrame))) {
+        e->samples++;
+        e->weight += weight;
+        return;
+      }
+
+  if(sp->count >= sp->size) {
+    size = sp->size ? sp->size * 2 : 1024;
+
+    if(!(table = calloc(size, sizeof(StackProfileEntry*))))
+      return;
+
+    for(i = 0; i < sp->size; i++)
+      for(e = sp->table[i]; e; e = next) {
+        next = e->next;
+        e->next = table[e->hash & (size - 1)];
+        table[e->hash & (size - 1)] = e;
+      }
+
+    free(sp->table);
+    sp->table = table;
+    sp->size = size;
+  }
+
+  if(!(e = malloc(sizeof(StackProfileEntry) + depth * sizeof(StackProfileFrame))))
+    return;
+
+  e->hash = h;
+  e->samples = 1;
+  e->weight = weight;
+  e->depth = depth;
+  memcpy(e->frames, frames, depth * sizeof(StackProfileFrame));
+
+  for(j = 0; j < depth; j++) {
+    JS_DupAtom(ctx, e->frames[j].name);
+    JS_DupAtom(ctx, e->frames[j].file);
+  }
+
+  e->next = sp->table[h & (sp->size - 1)];
+  sp->table[h & (sp->size - 1)] = e;
+  sp->count++;
+}
+
+void
+stack_profile_reset(StackProfile* sp) {
+  StackProfileEntry *e, *next;
+  size_t i;
+  int j;
+
+  for(i = 0; i < sp->size; i++)
+    for(e = sp->table[i]; e; e = next) {
+      next = e->next;
+
+      for(j = 0; j < e->depth; j++) {
+        JS_FreeAtomRT(sp->rt, e->frames[j].name);
+        JS_FreeAtomRT(sp->rt, e->frames[j].file);
+      }
+
+      free(e);
+    }
+
+  free(sp->table);
+  sp->table = 0;
+  sp->size = sp->count = 0;
+  sp->samples = 0;
+}
+
+/* decodes the atom itself, JS_AtomToCString() would allocate on the JS heap */
+static void
+stack_profile_atom(StackProfile* sp, DynBuf* db, JSAtom atom, const char* dflt) {
+  JSString* str;
+  uint32_t i, c;
+  uint8_t buf[UTF8_CHAR_LEN_MAX];
+
+  if(atom & JS_ATOM_TAG_INT) {
+    dbuf_printf(db, "%u", atom & JS_ATOM_MAX_INT);
+    return;
+  }
+
+  if(atom == JS_ATOM_NULL || !(str = sp->rt->atom_array[atom]) || str->len == 0) {
+    dbuf_putstr(db, dflt);
+    return;
+  }
+
+  for(i = 0; i < str->len; i++) {
+    c = str->is_wide_char ? str->u.str16[i] : str->u.str8[i];
+
+    if(c >= 0xd800 && c < 0xdc00 && str->is_wide_char && i + 1 < str->len && str->u.str16[i + 1] >= 0xdc00 && str->u.str16[i + 1] < 0xe000)
+      c = 0x10000 + ((c - 0xd800) << 10) + (str->u.str16[++i] - 0xdc00);
+
+    /* ';' separates the frames */
+    if(c == ';')
+      c = ':';
+
+    if(c < 0x80)
+      dbuf_putc(db, c);
+    else
+      dbuf_put(db, buf, unicode_to_utf8(buf, c));
+  }
+}
+
+/**
+ * Appends one "outer (file:line);inner (file:line) weight" line per stack,
+ * the format read by flamegraph.pl and pprof.
+ */
+void
+stack_profile_collapse(StackProfile* sp, DynBuf* db) {
+  StackProfileEntry* e;
+  size_t i;
+  int j;
+
+  for(i = 0; i < sp->size; i++)
+    for(e = sp->table[i]; e; e = e->next) {
+      if(e->depth == 0)
+        dbuf_putstr(db, "[runtime]");
+
+      for(j = e->depth - 1; j >= 0; j--) {
+        StackProfileFrame* fr = &e->frames[j];
+
+        stack_profile_atom(sp, db, fr->name, fr->line == -1 ? "[native]" : "<anonymous>");
+
+        if(fr->line != -1) {
+          dbuf_putstr(db, " (");
+          stack_profile_atom(sp, db, fr->file, "?");
+          dbuf_printf(db, ":%d)", fr->line);
+        }
+
+        if(j)
+          dbuf_putc(db, ';');
+      }
+
+      dbuf_printf(db, " %" PRIu64 "\n", e->weight);
+    }
+}
+
+int
+stack_profile_write(StackProfile* sp, const char* file) {
+  DynBuf db;
+  FILE* f;
+  int ret = -1;
+
+  dbuf_init(&db);
+  stack_profile_collapse(sp, &db);
+
+  if((f = fopen(file, "w"))) {
+    ret = (db.size && fwrite(db.buf, 1, db.size, f) != db.size) ? -1 : 0;
+
+    if(fclose(f))
+      ret = -1;
+  }
+
+  dbuf_free(&db);
+  return ret;
+}
+
+/**
+ * @}
+ */
@@ -1,12 +1,16 @@
 #include "stream-utils.h"
 #include "buffer-utils.h"
+#include "line-index.h"
 #include "defines.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
 #ifdef _WIN32
 #include <io.h>
 #else
 #include <unistd.h>
+#include <sys/uio.h>
 #endif
 
 #define RESULT(r, acc) \
@@ -45,21 +49,156 @@ write_tee(Writer* wptr, const void* buf, size_t len) {
   return MIN_NUM(r[0], r[1]);
 }
 
+static ssize_t
+flush_tee(void* opaque) {
+  Writer* wptr = opaque;
+  ssize_t a = writer_flush(&wptr[0]), b = writer_flush(&wptr[1]);
+
+  return a < 0 || b < 0 ? -1 : 0;
+}
+
+#ifdef _WIN32
+struct iovec {
+  void* iov_base;
+  size_t iov_len;
+};
+
+static ssize_t
+writev(int fd, const struct iovec* iov, int iovcnt) {
+  ssize_t r, total = 0;
+
+  for(int i = 0; i < iovcnt; i++) {
+    if((r = write(fd, iov[i].iov_base, iov[i].iov_len)) < 0)
+      return total ? total : r;
+
+    total += r;
+
+    if((size_t)r < iov[i].iov_len)
+      break;
+  }
+
+  return total;
+}
+#endif
+
+/**
+ * Staging buffer for an fd. Small writes are copied, a large write goes
+ * out with whatever is staged in the same writev() and is not copied.
+ */
+typedef struct {
+  intptr_t fd;
+  bool close_on_end;
+  size_t size, capacity;
+  uint8_t buf[];
+} VectoredWriter;
+
+/**
+ * writev() of the staged bytes followed by \p len bytes at \p x. After a
+ * short write or an error (EAGAIN) the unwritten staged bytes move to the
+ * front of the buffer and are retried by the next call. Returns how many
+ * bytes of x were written, or -1 when not all staged bytes went out.
+ */
+static ssize_t
+send_vectored(VectoredWriter* vw, const uint8_t* x, size_t len) {
+  size_t done = 0, total = vw->size + len;
+  ssize_t r;
+
+  while(done < total) {
+    struct iovec iov[2];
+    int n = 0;
+
+    if(done < vw->size) {
+      iov[n++] = (struct iovec){vw->buf + done, vw->size - done};
+
+      if(len)
+        iov[n++] = (struct iovec){(void*)x, len};
+    } else {
+      iov[n++] = (struct iovec){(void*)(x + (done - vw->size)), total - done};
+    }
+
+    if((r = writev(vw->fd, iov, n)) <= 0) {
+      if(r < 0 && errno == EINTR)
+        continue;
+
+      break;
+    }
+
+    done += r;
+  }
+
+  if(done < vw->size) {
+    memmove(vw->buf, vw->buf + done, vw->size - done);
+    vw->size -= done;
+    return -1;
+  }
+
+  done -= vw->size;
+  vw->size = 0;
+
+  return len && !done ? -1 : (ssize_t)done;
+}
+
+static ssize_t
+write_vectored(intptr_t opaque, const void* x, size_t len, Writer* wr) {
+  VectoredWriter* vw = (VectoredWriter*)opaque;
+
+  if(len >= vw->capacity / 4)
+    return send_vectored(vw, x, len);
+
+  if(vw->size + len > vw->capacity)
+    send_vectored(vw, 0, 0);
+
+  /* what could not be written out is still staged */
+  if(vw->size + len > vw->capacity)
+    return -1;
+
+  memcpy(vw->buf + vw->size, x, len);
+  vw->size += len;
+
+  return len;
+}
+
+static ssize_t
+flush_vectored(void* opaque) {
+  return send_vectored(opaque, 0, 0);
+}
+
+static ssize_t
+free_vectored(void* opaque) {
+  VectoredWriter* vw = opaque;
+  ssize_t r = flush_vectored(vw);
+
+  if(vw->close_on_end)
+    close(vw->fd);
+
+  free(vw);
+  return r;
+}
+
 typedef struct {
   Writer* parent;
   const char* chars;
   size_t nchars;
 } EscapedWriter;
 
+/* runs without escaped characters are passed on in one write */
 static ssize_t
 write_escaped(EscapedWriter* ew, const uint8_t* x, size_t len) {
   ssize_t r = 0;
 
-  for(size_t i = 0; i < len; i++) {
-    if(byte_chr(ew->chars, ew->nchars, x[i]) < ew->nchars)
-      RESULT_LOOP(writer_putc(ew->parent, '\\'), r);
+  for(size_t i = 0; i < len;) {
+    size_t run = line_index_span(x + i, len - i, (const uint8_t*)ew->chars, ew->nchars);
+
+    if(run) {
+      RESULT_LOOP(writer_write(ew->parent, x + i, run), r);
+      i += run;
+    }
+
+    if(i < len) {
+      char esc[2] = {'\\', x[i++]};
 
-    RESULT_LOOP(writer_putc(ew->parent, x[i]), r);
+      RESULT_LOOP(writer_write(ew->parent, esc, 2), r);
+    }
   }
 
   return r;
@@ -73,18 +212,23 @@ write_urlencoded(Writer* parent, const uint8_t* x, size_t len) {
                                         "0123456789"
                                         "@*_+-./";
 
-  for(size_t i = 0; i < len; i++) {
+  for(size_t i = 0; i < len;) {
+    size_t j;
 
-    if(!memchr(unescaped_chars, x[i], sizeof(unescaped_chars) - 1)) {
-      char buf[4] = {'%'};
+    for(j = i; j < len && memchr(unescaped_chars, x[j], sizeof(unescaped_chars) - 1); j++)
+      ;
 
-      fmt_xlong0(&buf[1], x[i], 2);
-
-      RESULT_LOOP(writer_write(parent, buf, 3), r);
+    if(j > i) {
+      RESULT_LOOP(writer_write(parent, x + i, j - i), r);
+      i = j;
       continue;
     }
 
-    RESULT_LOOP(writer_putc(parent, x[i]), r);
+    char buf[4] = {'%'};
+
+    fmt_xlong0(&buf[1], x[i++], 2);
+
+    RESULT_LOOP(writer_write(parent, buf, 3), r);
   }
 
   return r;
@@ -182,6 +326,7 @@ writer_tee(const Writer a, const Writer b) {
       (WriteFunction*)&write_tee,
       (void*)opaque,
       (WriterFinalizer*)(void*)&orig_free,
+      &flush_tee,
   };
 }
 
@@ -211,11 +356,39 @@ writer_urlencode(Writer* out) {
   };
 }
 
+/**
+ * Writer for \p fd that stages up to \p capacity bytes and hands them to
+ * writev() together with the next large write.
+ */
+Writer
+writer_vectored(intptr_t fd, size_t capacity, bool close_on_end) {
+  VectoredWriter* vw;
+
+  if(!capacity)
+    capacity = WRITER_BUFFER_SIZE;
+
+  if((vw = malloc(sizeof(VectoredWriter) + capacity))) {
+    vw->fd = fd;
+    vw->close_on_end = close_on_end;
+    vw->size = 0;
+    vw->capacity = capacity;
+  }
+
+  assert(vw);
+
+  return (Writer){&write_vectored, vw, &free_vectored, &flush_vectored};
+}
+
 ssize_t
 writer_write(Writer* wr, const void* buf, size_t len) {
   return wr->write((intptr_t)wr->opaque, buf, len, wr);
 }
 
+ssize_t
+writer_flush(Writer* wr) {
+  return wr->flush ? wr->flush(wr->opaque) : 0;
+}
+
 void
 writer_free(Writer* wr) {
   if(wr->finalizer)
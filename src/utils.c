@@ -2,6 +2,7 @@
 #undef _ISOC99_SOURCE
 #define _ISOC99_SOURCE 1
 #include "utils.h"
+#include "quickjs-internal.h"
 #include "defines.h"
 #include <list.h>
 #include <cutils.h>
@@ -178,6 +179,189 @@ regexp_compile(RegExp re, JSContext* ctx) {
   return bytecode;
 }
 
+/* compiled bytecode shared by source and flags, see regexp_compile_shared() */
+typedef struct regexp_cache_entry {
+  struct regexp_cache_entry *chain, *prev, *next;
+  uint32_t hash;
+  int flags, ref_count;
+  size_t srclen, len;
+  char* source;
+  uint8_t bytecode[];
+} RegExpCacheEntry;
+
+#define REGEXP_CACHE_BUCKETS 256
+#define REGEXP_CACHE_IDLE 128
+
+/* hash chains plus a list of unreferenced entries, most recently released first */
+typedef struct {
+  RegExpCacheEntry *buckets[REGEXP_CACHE_BUCKETS], *head, *tail;
+  size_t idle;
+} RegExpCache;
+
+static thread_local RegExpCache regexp_cache;
+
+#ifdef USE_WORKER
+static pthread_key_t regexp_cache_key;
+static pthread_once_t regexp_cache_once = PTHREAD_ONCE_INIT;
+
+/* frees what is left in the cache of an exiting (worker) thread */
+static void
+regexp_cache_exit(void* ptr) {
+  regexp_cache_clear();
+}
+
+static void
+regexp_cache_init(void) {
+  pthread_key_create(&regexp_cache_key, regexp_cache_exit);
+}
+#endif
+
+static inline RegExpCacheEntry*
+regexp_cache_entry(const uint8_t* bc) {
+  return (RegExpCacheEntry*)(bc - offsetof(RegExpCacheEntry, bytecode));
+}
+
+static uint32_t
+regexp_cache_hash(const char* source, size_t len, int flags) {
+  uint32_t h = 2166136261u ^ (uint32_t)flags;
+
+  while(len--)
+    h = (h ^ (uint8_t)*source++) * 16777619u;
+
+  return h;
+}
+
+static void
+regexp_cache_idle_unlink(RegExpCacheEntry* e) {
+  if(e->prev)
+    e->prev->next = e->next;
+  else
+    regexp_cache.head = e->next;
+
+  if(e->next)
+    e->next->prev = e->prev;
+  else
+    regexp_cache.tail = e->prev;
+
+  e->prev = e->next = 0;
+  regexp_cache.idle--;
+}
+
+static void
+regexp_cache_remove(RegExpCacheEntry* e) {
+  RegExpCacheEntry** pp = &regexp_cache.buckets[e->hash % REGEXP_CACHE_BUCKETS];
+
+  while(*pp != e)
+    pp = &(*pp)->chain;
+
+  *pp = e->chain;
+  free(e);
+}
+
+/**
+ * Compiles \p re, or returns the bytecode already compiled for the same
+ * source and flags on this thread. The bytecode is reference counted and
+ * independent of any runtime: release it with regexp_bytecode_free().
+ */
+uint8_t*
+regexp_compile_shared(RegExp re, JSContext* ctx) {
+  RegExpCacheEntry* e;
+  uint32_t h = regexp_cache_hash(re.source, re.len, re.flags);
+  char error_msg[64];
+  uint8_t* bc;
+  int len = 0;
+
+  for(e = regexp_cache.buckets[h % REGEXP_CACHE_BUCKETS]; e; e = e->chain)
+    if(e->hash == h && e->flags == re.flags && e->srclen == re.len && !memcmp(e->source, re.source, re.len))
+      return regexp_bytecode_dup(e->bytecode);
+
+  if(!(bc = lre_compile(&len, error_msg, sizeof(error_msg), re.source, re.len, re.flags, ctx))) {
+    JS_ThrowInternalError(ctx, "Error compiling regex /%.*s/: %s", (int)re.len, re.source, error_msg);
+    return 0;
+  }
+
+  if(!(e = malloc(sizeof(RegExpCacheEntry) + len + re.len + 1))) {
+    orig_js_free_rt(JS_GetRuntime(ctx), bc);
+    JS_ThrowOutOfMemory(ctx);
+    return 0;
+  }
+
+  e->hash = h;
+  e->flags = re.flags;
+  e->ref_count = 1;
+  e->srclen = re.len;
+  e->len = len;
+  e->prev = e->next = 0;
+  memcpy(e->bytecode, bc, len);
+  e->source = (char*)e->bytecode + len;
+  memcpy(e->source, re.source, re.len);
+  e->source[re.len] = '\0';
+  orig_js_free_rt(JS_GetRuntime(ctx), bc);
+
+  e->chain = regexp_cache.buckets[h % REGEXP_CACHE_BUCKETS];
+  regexp_cache.buckets[h % REGEXP_CACHE_BUCKETS] = e;
+
+#ifdef USE_WORKER
+  pthread_once(&regexp_cache_once, regexp_cache_init);
+  pthread_setspecific(regexp_cache_key, &regexp_cache);
+#endif
+  return e->bytecode;
+}
+
+uint8_t*
+regexp_bytecode_dup(uint8_t* bc) {
+  RegExpCacheEntry* e = regexp_cache_entry(bc);
+
+  if(e->ref_count++ == 0)
+    regexp_cache_idle_unlink(e);
+
+  return bc;
+}
+
+/**
+ * Drops a reference from regexp_compile_shared(). Unreferenced bytecode
+ * stays cached until REGEXP_CACHE_IDLE newer entries have been released.
+ */
+void
+regexp_bytecode_free(uint8_t* bc) {
+  RegExpCacheEntry* e = regexp_cache_entry(bc);
+
+  assert(e->ref_count > 0);
+
+  if(--e->ref_count > 0)
+    return;
+
+  e->prev = 0;
+
+  if((e->next = regexp_cache.head))
+    e->next->prev = e;
+  else
+    regexp_cache.tail = e;
+
+  regexp_cache.head = e;
+
+  if(++regexp_cache.idle > REGEXP_CACHE_IDLE) {
+    RegExpCacheEntry* oldest = regexp_cache.tail;
+
+    regexp_cache_idle_unlink(oldest);
+    regexp_cache_remove(oldest);
+  }
+}
+
+/**
+ * Frees every cached bytecode that is no longer referenced. Called when a
+ * runtime is torn down, and on exit of threads that compiled regexps.
+ */
+void
+regexp_cache_clear(void) {
+  while(regexp_cache.tail) {
+    RegExpCacheEntry* e = regexp_cache.tail;
+
+    regexp_cache_idle_unlink(e);
+    regexp_cache_remove(e);
+  }
+}
+
 BOOL
 regexp_match(const uint8_t* bc, const void* cbuf, size_t clen, JSContext* ctx) {
   uint8_t* capture[512];
@@ -980,18 +1164,26 @@ js_object_properties(JSContext* ctx, uint32_t* lenptr, JSValueConst obj, int fla
 
     atoms = js_realloc(ctx, atoms, sizeof(JSAtom) * (num_atoms + tmp_len));
 
-    for(i = 0; i < tmp_len; i++) {
+    /* the first level has no duplicates */
+    if(num_atoms == 0) {
+      for(i = 0; i < tmp_len; i++)
+        atoms[i] = tmp_tab[i].atom;
 
-      for(j = 0; j < num_atoms; j++)
+      pos = tmp_len;
+    } else {
+      for(i = 0; i < tmp_len; i++) {
 
-        if(atoms[j] == tmp_tab[i].atom)
-          break;
+        for(j = 0; j < num_atoms; j++)
 
-      if(j < num_atoms)
-        continue;
+          if(atoms[j] == tmp_tab[i].atom)
+            break;
 
-      atoms[num_atoms + pos] = tmp_tab[i].atom;
-      pos++;
+        if(j < num_atoms)
+          continue;
+
+        atoms[num_atoms + pos] = tmp_tab[i].atom;
+        pos++;
+      }
     }
 
     num_atoms += pos;
@@ -2089,65 +2281,112 @@ js_module_load(JSContext* ctx, const char* name) {
   return loader(ctx, name, opaque);
 }
 
+/**
+ * Returns the class IDs of the builtins in enum builtin_classes.  These are
+ * the fixed JS_CLASS_* IDs every runtime registers, so the table does not
+ * depend on the globals or intrinsics of a context.
+ */
+const JSClassID*
+js_builtin_classes(JSContext* ctx) {
+  static const JSClassID ids[BUILTIN_CLASS_COUNT] = {
+      [BUILTIN_ARRAYBUFFER] = JS_CLASS_ARRAY_BUFFER,
+      [BUILTIN_SHAREDARRAYBUFFER] = JS_CLASS_SHARED_ARRAY_BUFFER,
+      [BUILTIN_DATE] = JS_CLASS_DATE,
+      [BUILTIN_MAP] = JS_CLASS_MAP,
+      [BUILTIN_SET] = JS_CLASS_SET,
+      [BUILTIN_GENERATOR] = JS_CLASS_GENERATOR,
+      [BUILTIN_ASYNCGENERATOR] = JS_CLASS_ASYNC_GENERATOR,
+      [BUILTIN_REGEXP] = JS_CLASS_REGEXP,
+      [BUILTIN_PROMISE] = JS_CLASS_PROMISE,
+      [BUILTIN_DATAVIEW] = JS_CLASS_DATAVIEW,
+      [BUILTIN_ERROR] = JS_CLASS_ERROR,
+      [BUILTIN_TYPEDARRAY] = JS_CLASS_UINT8C_ARRAY,
+      [BUILTIN_TYPEDARRAY_LAST] = JS_CLASS_FLOAT64_ARRAY,
+  };
+
+  return ids;
+}
+
+/**
+ * Classifies an object by its class ID in one pass.
+ *
+ * @return  one of OBJECT_*, 0 for primitives and other classes
+ */
+BuiltinTypeMask
+js_value_type_flags(JSContext* ctx, JSValueConst value) {
+  const JSClassID* ids;
+  JSClassID id;
+  int i;
+
+  if(!JS_IsObject(value))
+    return 0;
+
+  ids = js_builtin_classes(ctx);
+  id = JS_GetClassID(value);
+
+  if(ids[BUILTIN_TYPEDARRAY] && id >= ids[BUILTIN_TYPEDARRAY] && id <= ids[BUILTIN_TYPEDARRAY_LAST])
+    return OBJECT_TYPEDARRAY;
+
+  for(i = 0; i < BUILTIN_TYPEDARRAY; i++)
+    if(ids[i] && id == ids[i])
+      return 1 << i;
+
+  return 0;
+}
+
 BOOL
 js_is_arraybuffer(JSContext* ctx, JSValueConst value) {
-  return JS_IsObject(value) && (js_global_instanceof(ctx, value, "ArrayBuffer") || js_object_is(ctx, value, "[object ArrayBuffer]"));
+  return js_is_builtin(ctx, value, BUILTIN_ARRAYBUFFER);
 }
 
 BOOL
 js_is_sharedarraybuffer(JSContext* ctx, JSValueConst value) {
-  return JS_IsObject(value) && (js_global_instanceof(ctx, value, "SharedArrayBuffer") || js_object_is(ctx, value, "[object SharedArrayBuffer]"));
+  return js_is_builtin(ctx, value, BUILTIN_SHAREDARRAYBUFFER);
 }
 
 BOOL
 js_is_date(JSContext* ctx, JSValueConst value) {
-  return JS_IsObject(value) && (js_global_instanceof(ctx, value, "Date") || js_object_is(ctx, value, "[object Date]"));
+  return js_is_builtin(ctx, value, BUILTIN_DATE);
 }
 
 BOOL
 js_is_map(JSContext* ctx, JSValueConst value) {
-  return JS_IsObject(value) && (js_global_instanceof(ctx, value, "Map") || js_object_is(ctx, value, "[object Map]"));
+  return js_is_builtin(ctx, value, BUILTIN_MAP);
 }
 
 BOOL
 js_is_set(JSContext* ctx, JSValueConst value) {
-  return JS_IsObject(value) && (js_global_instanceof(ctx, value, "Set") || js_object_is(ctx, value, "[object Set]"));
+  return js_is_builtin(ctx, value, BUILTIN_SET);
 }
 
 BOOL
 js_is_generator(JSContext* ctx, JSValueConst value) {
-  JSValue ctor = js_generator_constructor(ctx);
-  BOOL ret = JS_IsInstanceOf(ctx, value, ctor);
-  JS_FreeValue(ctx, ctor);
-  return ret || (JS_IsObject(value) && js_object_is(ctx, value, "[object Generator]"));
+  return js_is_builtin(ctx, value, BUILTIN_GENERATOR);
 }
 
 BOOL
 js_is_asyncgenerator(JSContext* ctx, JSValueConst value) {
-  JSValue ctor = js_asyncgenerator_constructor(ctx);
-  BOOL ret = JS_IsInstanceOf(ctx, value, ctor);
-  JS_FreeValue(ctx, ctor);
-  return ret || (JS_IsObject(value) && js_object_is(ctx, value, "[object AsyncGenerator]"));
+  return js_is_builtin(ctx, value, BUILTIN_ASYNCGENERATOR);
 }
 
 BOOL
 js_is_regexp(JSContext* ctx, JSValueConst value) {
-  return JS_IsObject(value) && (js_global_instanceof(ctx, value, "RegExp") || js_object_is(ctx, value, "[object RegExp]"));
+  return js_is_builtin(ctx, value, BUILTIN_REGEXP);
 }
 
 BOOL
 js_is_promise(JSContext* ctx, JSValueConst value) {
-  return JS_IsObject(value) && (js_global_instanceof(ctx, value, "Promise") || js_object_is(ctx, value, "[object Promise]"));
+  return js_is_builtin(ctx, value, BUILTIN_PROMISE);
 }
 
 BOOL
 js_is_dataview(JSContext* ctx, JSValueConst value) {
-  return JS_IsObject(value) && (js_global_instanceof(ctx, value, "DataView") || js_object_is(ctx, value, "[object DataView]"));
+  return js_is_builtin(ctx, value, BUILTIN_DATAVIEW);
 }
 
 BOOL
 js_is_error(JSContext* ctx, JSValueConst value) {
-  return JS_IsObject(value) && (JS_IsError(ctx, value) || js_global_instanceof(ctx, value, "Error") || js_object_is(ctx, value, "[object Error]"));
+  return JS_IsObject(value) && JS_IsError(ctx, value);
 }
 
 BOOL
@@ -2615,9 +2854,8 @@ js_error_uncatchable(JSContext* ctx) {
 static thread_local JSModuleDef* io_module;
 
 JSValue
-js_iohandler_fn(JSContext* ctx, BOOL write) {
-  const char* handlers[2] = {"setReadHandler", "setWriteHandler"};
-  JSValue set_handler = JS_NULL;
+js_os_function(JSContext* ctx, const char* name) {
+  JSValue fn = JS_NULL;
 
   if(!io_module)
     io_module = js_module_load(ctx, "io");
@@ -2626,13 +2864,13 @@ js_iohandler_fn(JSContext* ctx, BOOL write) {
     io_module = js_module_load(ctx, "os");
 
   if(io_module)
-    set_handler = module_exports_find_str(ctx, io_module, handlers[!!write]);
+    fn = module_exports_find_str(ctx, io_module, name);
 
-  if(js_is_null_or_undefined(set_handler)) {
+  if(js_is_null_or_undefined(fn)) {
     JSValue osval = js_global_get_str(ctx, "os");
 
     if(!js_is_null_or_undefined(osval)) {
-      set_handler = JS_GetPropertyStr(ctx, osval, handlers[!!write]);
+      fn = JS_GetPropertyStr(ctx, osval, name);
       JS_FreeValue(ctx, osval);
     } else {
       JSModuleDef* os;
@@ -2641,23 +2879,30 @@ js_iohandler_fn(JSContext* ctx, BOOL write) {
       if(!(os = js_module_find(ctx, "os")))
         return JS_ThrowReferenceError(ctx, "'os' module required");
 
-      func_name = JS_NewAtom(ctx, handlers[!!write]);
-      set_handler = module_exports_find(ctx, os, func_name);
+      func_name = JS_NewAtom(ctx, name);
+      fn = module_exports_find(ctx, os, func_name);
       JS_FreeAtom(ctx, func_name);
     }
   }
 
-  if(js_is_null_or_undefined(set_handler))
-    return JS_ThrowReferenceError(ctx, "no os.%s function", handlers[!!write]);
+  if(js_is_null_or_undefined(fn))
+    return JS_ThrowReferenceError(ctx, "no os.%s function", name);
 
-  return set_handler;
+  return fn;
+}
+
+JSValue
+js_iohandler_fn(JSContext* ctx, BOOL write) {
+  return js_os_function(ctx, write ? "setWriteHandler" : "setReadHandler");
 }
 
 BOOL
 js_iohandler_set(JSContext* ctx, JSValueConst set_handler, int fd, JSValue handler) {
 
-  if(JS_IsException(set_handler))
+  if(JS_IsException(set_handler)) {
+    JS_FreeValue(ctx, handler);
     return FALSE;
+  }
 
   JSValue args[2] = {
       JS_NewInt32(ctx, fd),
@@ -2957,10 +3202,9 @@ js_is_identifier_len(JSContext* ctx, const char* str, size_t len) {
   uint8_t* bc;
   BOOL ret = FALSE;
 
-  if((bc = regexp_compile(re, ctx))) {
-
+  if((bc = regexp_compile_shared(re, ctx))) {
     ret = regexp_match(bc, str, len, ctx);
-    js_free(ctx, bc);
+    regexp_bytecode_free(bc);
   }
 
   return ret;
@@ -17,6 +17,62 @@ realloc2_helper(vector_realloc);
 js_realloc_helper(vector_js_realloc);
 js_realloc_rt_helper(vector_js_realloc_rt);
 
+/**
+ * Leaves the inline storage on the first growth beyond it, freeing the
+ * inline storage is a no-op.
+ */
+void*
+vector_inline_realloc(VectorStorage* st, void* ptr, size_t size) {
+  void* ret;
+
+  if(ptr != st->data)
+    return vector_js_realloc(st->ctx, ptr, size);
+
+  if(size == 0)
+    return 0;
+
+  if(size <= st->size)
+    return ptr;
+
+  if((ret = vector_js_realloc(st->ctx, 0, size)))
+    memcpy(ret, ptr, st->size);
+
+  return ret;
+}
+
+/**
+ * Hands the elements of \p src over to the empty \p dst, they are only
+ * copied out of inline storage. \p src is left empty.
+ */
+BOOL
+vector_move(Vector* dst, Vector* src) {
+  if(vector_is_inline(src)) {
+    VectorStorage* st = src->opaque;
+    void* data = 0;
+
+    if(src->size && !(data = vector_js_realloc(st->ctx, 0, src->size)))
+      return FALSE;
+
+    if(src->size)
+      memcpy(data, src->data, src->size);
+
+    dst->data = data;
+    dst->size = dst->capacity = src->size;
+    dst->error = FALSE;
+    dst->realloc_func = (DynBufReallocFunc*)&vector_js_realloc;
+    dst->opaque = st->ctx;
+
+    src->size = 0;
+    return TRUE;
+  }
+
+  *dst = *src;
+  src->data = 0;
+  src->size = src->capacity = 0;
+  src->error = FALSE;
+  return TRUE;
+}
+
 #define HAVE_UINT128
 
 #if(defined(__GNUC__) && (__GNUC__ >= 5)) || defined(HAVE__BUILTIN_MUL_OVERFLOW)
@@ -0,0 +1,170 @@
+import * as std from 'std';
+import { getMemoryUsage, getPerformanceCounter } from 'misc';
+import BNFLexer from '../lib/lexer/bnf.js';
+import CLexer from '../lib/lexer/c.js';
+import CSVLexer from '../lib/lexer/csv.js';
+import ECMAScriptLexer from '../lib/lexer/ecmascript.js';
+import EBNFParser from '../lib/parser/ebnf.js';
+
+/*
+ * Lexer/parser throughput benchmark.
+ *
+ * Usage: qjsm bench_lexer.js [--rounds N] [--csv-rows N] [name...]
+ *
+ * Prints a JSON array with one record per (corpus, method):
+ *   tokens, bytes, seconds, tokensPerSec, bytesPerSec,
+ *   allocationsPerToken (live malloc blocks per token while the result is retained),
+ *   peakRSS (kB, VmHWM)
+ */
+
+const corpora = [
+  { name: 'c', Lexer: CLexer, file: 'src/lexer.c' },
+  { name: 'ecmascript', Lexer: ECMAScriptLexer, file: 'lib/parser/ebnf.js' },
+  { name: 'bnf-ansi-c', Lexer: BNFLexer, file: 'tests/ANSI-C-grammar-2011.y' },
+  { name: 'bnf-shell-y', Lexer: BNFLexer, file: 'tests/Shell-Grammar.y' },
+  { name: 'bnf-shell-l', Lexer: BNFLexer, file: 'tests/Shell-Grammar.l' },
+  { name: 'csv', Lexer: CSVLexer, generate: GenerateCSV },
+  { name: 'ebnf-parser', Parser: EBNFParser, file: 'tests/Shell-Grammar.y' }
+];
+
+/* deterministic CSV corpus */
+function GenerateCSV(rows = 20000) {
+  let out = 'id,name,quoted,value\n',
+    seed = 1;
+
+  const rand = () => (seed = (seed * 1103515245 + 12345) & 0x7fffffff);
+
+  for(let i = 0; i < rows; i++) out += `${i},name${rand() % 1000},"a ""quoted"" field ${rand() % 97}",${(rand() % 100000) / 100}\n`;
+
+  return out;
+}
+
+function PeakRSS() {
+  const status = std.loadFile('/proc/self/status');
+  const m = status && /VmHWM:\s*(\d+)/.exec(status);
+
+  return m ? +m[1] : undefined;
+}
+
+const methods = {
+  /* one Token object per lexeme */
+  tokens(lexer) {
+    const tokens = [];
+    let tok;
+
+    while((tok = lexer.nextToken())) tokens.push(tok);
+
+    return [tokens, tokens.length];
+  },
+  /* one id per lexeme, no Token objects */
+  lex(lexer) {
+    const ids = [];
+    let id;
+
+    while(typeof (id = lexer.lex()) == 'number') ids.push(id);
+
+    return [ids, ids.length];
+  },
+  /* packed records in one native call */
+  tokenize(lexer) {
+    const records = lexer.tokenize();
+
+    return [records, records.length / 4];
+  }
+};
+
+function Measure(fn, rounds) {
+  let best = Infinity,
+    tokens = 0,
+    allocations = 0;
+
+  for(let i = 0; i < rounds; i++) {
+    std.gc();
+
+    const before = getMemoryUsage().mallocCount;
+    const start = getPerformanceCounter();
+    const [result, n] = fn();
+    const end = getPerformanceCounter();
+
+    allocations = getMemoryUsage().mallocCount - before;
+    tokens = n;
+    best = Math.min(best, (end - start) / 1000);
+
+    if(!result) break;
+  }
+
+  return { tokens, seconds: best, allocations };
+}
+
+function Record(name, method, bytes, { tokens, seconds, allocations }) {
+  return {
+    name,
+    method,
+    tokens,
+    bytes,
+    seconds,
+    tokensPerSec: seconds > 0 ? Math.round(tokens / seconds) : null,
+    bytesPerSec: seconds > 0 ? Math.round(bytes / seconds) : null,
+    allocationsPerToken: tokens > 0 ? allocations / tokens : null,
+    peakRSS: PeakRSS()
+  };
+}
+
+function main(...args) {
+  let rounds = 5,
+    csvRows = 20000,
+    only = [];
+
+  for(let i = 0; i < args.length; i++) {
+    if(args[i] == '--rounds') rounds = +args[++i];
+    else if(args[i] == '--csv-rows') csvRows = +args[++i];
+    else only.push(args[i]);
+  }
+
+  const results = [];
+
+  for(const corpus of corpora) {
+    if(only.length && only.indexOf(corpus.name) == -1) continue;
+
+    const input = corpus.generate ? corpus.generate(csvRows) : std.loadFile(corpus.file);
+    const file = corpus.file ?? corpus.name;
+    const bytes = input.length;
+
+    if(corpus.Parser) {
+      try {
+        const m = Measure(() => {
+          const parser = new corpus.Parser(null);
+
+          parser.setInput(input, file);
+
+          return [parser.parse(), parser.lexer.seq];
+        }, rounds);
+
+        results.push(Record(corpus.name, 'parse', bytes, m));
+      } catch(error) {
+        results.push({ name: corpus.name, method: 'parse', error: error.message });
+      }
+
+      continue;
+    }
+
+    for(const method in methods) {
+      try {
+        const m = Measure(() => methods[method](new corpus.Lexer(input, file)), rounds);
+
+        results.push(Record(corpus.name, method, bytes, m));
+      } catch(error) {
+        results.push({ name: corpus.name, method, error: error.message });
+      }
+    }
+  }
+
+  std.puts(JSON.stringify(results, null, 2) + '\n');
+}
+
+try {
+  main(...scriptArgs.slice(1));
+} catch(error) {
+  std.err.puts(`FAIL: ${error.message}\n${error.stack}\n`);
+  std.exit(1);
+}
@@ -0,0 +1,254 @@
+import * as std from 'std';
+import { getMemoryUsage, getPerformanceCounter } from 'misc';
+import { read as xmlRead, write as xmlWrite } from 'xml';
+import { clone, equals, select } from 'deep';
+import inspect from 'inspect';
+import { List } from 'list';
+import { Queue } from 'queue';
+import { SharedRingBuffer } from 'ringbuffer';
+import { TextDecoder } from 'textcode';
+import { join, normalize, relative, resolve } from 'path';
+import { AF_UNIX, SOCK_STREAM, Socket, socketpair } from 'sockets';
+import BNFLexer from '../lib/lexer/bnf.js';
+
+/*
+ * Native module benchmark.
+ *
+ * Usage: qjsm bench_native.js [--iterations N] [--warmup N] [name...]
+ *
+ * Every scenario runs ops operations per iteration. Prints a JSON array
+ * with one record per scenario:
+ *   ops, iterations, min/mean/p50/p90/p99/max (µs per iteration),
+ *   opsPerSec (from the median), allocationsPerOp and bytesPerOp (growth
+ *   of live malloc blocks and bytes over an iteration, before gc)
+ */
+
+/* deterministic document with nested elements and attributes */
+function GenerateXML(n = 500) {
+  let out = '<?xml version="1.0"?>\n<root>\n';
+
+  for(let i = 0; i < n; i++) out += `  <item id="${i}" name="item${i}"><value>${i * 7}</value><tags><tag>a</tag><tag>b${i % 13}</tag></tags></item>\n`;
+
+  return out + '</root>\n';
+}
+
+function GenerateTree(depth = 4, width = 5) {
+  if(depth == 0) return { id: width, name: 'leaf', values: [1, 2, 3] };
+
+  const node = { depth, children: [] };
+
+  for(let i = 0; i < width; i++) node.children.push(GenerateTree(depth - 1, width));
+
+  return node;
+}
+
+const scenarios = [
+  {
+    name: 'xml.read',
+    ops: 1,
+    setup: () => GenerateXML(),
+    run: doc => xmlRead(doc)
+  },
+  {
+    name: 'xml.write',
+    ops: 1,
+    setup: () => xmlRead(GenerateXML()),
+    run: tree => xmlWrite(tree)
+  },
+  {
+    name: 'lexer.bnf.tokenize',
+    ops: 1,
+    setup: () => std.loadFile('tests/ANSI-C-grammar-2011.y'),
+    run: input => new BNFLexer(input, 'ANSI-C-grammar-2011.y').tokenize()
+  },
+  {
+    name: 'deep.select',
+    ops: 1,
+    setup: () => GenerateTree(),
+    run: tree => select(tree, v => typeof v == 'object' && v.name == 'leaf')
+  },
+  {
+    name: 'deep.clone',
+    ops: 1,
+    setup: () => GenerateTree(),
+    run: tree => clone(tree)
+  },
+  {
+    name: 'deep.equals',
+    ops: 1,
+    setup: () => [GenerateTree(), GenerateTree()],
+    run: ([a, b]) => equals(a, b)
+  },
+  {
+    name: 'inspect',
+    ops: 1,
+    setup: () => GenerateTree(3, 4),
+    run: tree => inspect(tree, { depth: Infinity, colors: false, compact: false })
+  },
+  {
+    name: 'list.push-shift',
+    ops: 10000,
+    setup: () => new List(),
+    run: list => {
+      for(let i = 0; i < 10000; i++) list.push(i);
+      while(list.shift() !== undefined);
+    }
+  },
+  {
+    name: 'queue.write-read',
+    ops: 1000,
+    setup: () => [new Queue(), new ArrayBuffer(4096)],
+    run: ([q, buf]) => {
+      for(let i = 0; i < 1000; i++) {
+        q.write(buf);
+        q.read(buf);
+      }
+    },
+    bytes: 4096 * 1000
+  },
+  {
+    name: 'ringbuffer.write-read',
+    ops: 1000,
+    setup: () => [new SharedRingBuffer(65536), new ArrayBuffer(4096)],
+    run: ([rb, buf]) => {
+      for(let i = 0; i < 1000; i++) {
+        rb.write(buf);
+        rb.read(buf);
+      }
+    },
+    bytes: 4096 * 1000
+  },
+  {
+    name: 'textdecoder.utf8',
+    ops: 1,
+    setup: () => {
+      const text = 'ASCII text, Ümläüte, ギリシャ語 αβγ and emoji 🙂\n'.repeat(2000);
+      const bytes = new Uint8Array([...unescape(encodeURIComponent(text))].map(c => c.charCodeAt(0)));
+
+      return [new TextDecoder('utf-8'), bytes.buffer];
+    },
+    run: ([decoder, buf]) => decoder.decode(buf)
+  },
+  {
+    name: 'path',
+    ops: 1000,
+    setup: () => '/usr/local/lib/../share/./quickjs/modules/lib/xml/read.js',
+    run: p => {
+      for(let i = 0; i < 1000; i++) {
+        normalize(p);
+        join('/usr/local', 'lib', '..', 'share', 'x.js');
+        relative('/usr/local/share', p);
+        resolve('lib', 'x.js');
+      }
+    }
+  },
+  {
+    name: 'socketpair.echo',
+    ops: 1000,
+    setup: () => {
+      const fds = [];
+
+      if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) throw new Error('socketpair() failed');
+
+      return [...fds.map(fd => Socket.adopt(fd)), new ArrayBuffer(256)];
+    },
+    run: ([a, b, buf]) => {
+      for(let i = 0; i < 1000; i++) {
+        a.send(buf);
+        b.recv(buf);
+        b.send(buf);
+        a.recv(buf);
+      }
+    },
+    teardown: ([a, b]) => (a.close(), b.close()),
+    bytes: 256 * 2 * 1000
+  }
+];
+
+function Percentile(sorted, p) {
+  return sorted[Math.min(sorted.length - 1, Math.floor((sorted.length * p) / 100))];
+}
+
+function Measure({ ops, setup, run, teardown, bytes }, iterations, warmup) {
+  const state = setup ? setup() : undefined;
+  const times = [];
+  let allocations = 0,
+    allocated = 0;
+
+  try {
+    for(let i = 0; i < warmup; i++) run(state);
+
+    for(let i = 0; i < iterations; i++) {
+      std.gc();
+
+      const before = getMemoryUsage();
+      const start = getPerformanceCounter();
+
+      run(state);
+
+      const end = getPerformanceCounter();
+      const after = getMemoryUsage();
+
+      times.push((end - start) * 1000);
+      allocations += after.mallocCount - before.mallocCount;
+      allocated += after.mallocSize - before.mallocSize;
+    }
+  } finally {
+    if(teardown) teardown(state);
+  }
+
+  times.sort((a, b) => a - b);
+
+  const p50 = Percentile(times, 50);
+  const round = n => Math.round(n * 1000) / 1000;
+  const record = {
+    ops,
+    iterations,
+    min: round(times[0]),
+    mean: round(times.reduce((a, t) => a + t, 0) / times.length),
+    p50: round(p50),
+    p90: round(Percentile(times, 90)),
+    p99: round(Percentile(times, 99)),
+    max: round(times[times.length - 1]),
+    opsPerSec: p50 > 0 ? Math.round((ops * 1e6) / p50) : null,
+    allocationsPerOp: round(allocations / (iterations * ops)),
+    bytesPerOp: round(allocated / (iterations * ops))
+  };
+
+  if(bytes) record.bytesPerSec = p50 > 0 ? Math.round((bytes * 1e6) / p50) : null;
+
+  return record;
+}
+
+function main(...args) {
+  let iterations = 50,
+    warmup = 5,
+    only = [];
+
+  for(let i = 0; i < args.length; i++) {
+    if(args[i] == '--iterations') iterations = +args[++i];
+    else if(args[i] == '--warmup') warmup = +args[++i];
+    else only.push(args[i]);
+  }
+
+  const results = [];
+
+  for(const scenario of scenarios) {
+    if(only.length && !only.some(name => scenario.name.startsWith(name))) continue;
+
+    try {
+      results.push({ name: scenario.name, ...Measure(scenario, iterations, warmup) });
+    } catch(error) {
+      results.push({ name: scenario.name, error: error.message });
+    }
+  }
+
+  std.puts(JSON.stringify(results, null, 2) + '\n');
+}
+
+try {
+  main(...scriptArgs.slice(1));
+} catch(error) {
+  std.err.puts(`FAIL: ${error.message}\n${error.stack}\n`);
+  std.exit(1);
+}
@@ -0,0 +1,8 @@
+import { ProcessPool } from 'child_process';
+import * as os from 'os';
+
+ProcessPool.serve(async ({ n }, fds) => {
+  for(let fd of fds) os.close(fd);
+
+  return { n: n * 2, fds: fds.length };
+});
@@ -0,0 +1,14 @@
+import { SharedRingBuffer } from 'ringbuffer';
+import * as os from 'os';
+
+const parent = os.Worker.parent;
+
+parent.onmessage = ({ data }) => {
+  let rb = new SharedRingBuffer(data);
+
+  for(let i = 0; i < 100; i++) {
+    while(!rb.send(new Uint32Array([i]).buffer)) rb.waitWritable(8, 1000);
+  }
+
+  parent.onmessage = null;
+};
@@ -0,0 +1,303 @@
+import * as fs from 'fs';
+import * as os from 'os';
+import * as std from 'std';
+import { Archive, ArchiveEntry } from 'archive';
+import { ArchiveFS, PathTrie, UnionFS } from '../lib/vfs.js';
+import { assert, eq, tests } from './tinytest.js';
+
+const base = `/tmp/test_archive.${os.getpid?.() ?? Date.now()}`;
+let seq = 0;
+
+os.mkdir(base, 0o755);
+
+function TempDir() {
+  const dir = `${base}/${++seq}`;
+
+  eq(os.mkdir(dir, 0o755), 0);
+  return dir;
+}
+
+/* writes a tar of [pathname, data, props] entries */
+function Tar(file, entries) {
+  const ar = Archive.write(file);
+
+  for(const [pathname, data = '', props = {}] of entries) {
+    ar.write(new ArchiveEntry(pathname, { mode: 0o100644, size: data.length, ...props }));
+
+    if(data.length) ar.write(data);
+  }
+
+  ar.close();
+  return file;
+}
+
+function Exists(path) {
+  return os.lstat(path)[1] == 0;
+}
+
+/* an old-style GNU sparse entry: a hole of holeSize zeros, then data */
+function SparseTar(file, name, holeSize, data) {
+  const tar = new Uint8Array(512 * 4);
+  const put = (pos, str) => {
+    for(let i = 0; i < str.length; i++) tar[pos + i] = str.charCodeAt(i);
+  };
+  const octal = (pos, width, n) => put(pos, n.toString(8).padStart(width - 1, '0') + '\0');
+
+  put(0, name);
+  octal(100, 8, 0o644);
+  octal(108, 8, 0);
+  octal(116, 8, 0);
+  octal(124, 12, 512);
+  octal(136, 12, 0);
+  put(148, '        ');
+  put(156, 'S');
+  put(257, 'ustar  \0');
+  octal(386, 12, holeSize);
+  octal(398, 12, data.length);
+  octal(483, 12, holeSize + data.length);
+
+  octal(148, 7, tar.slice(0, 512).reduce((a, b) => a + b, 0));
+  put(512, data);
+
+  const f = std.open(file, 'wb');
+  f.write(tar.buffer, 0, tar.byteLength);
+  f.close();
+  return file;
+}
+
+async function ReadStream(readable) {
+  const reader = readable.getReader();
+  const chunks = [];
+  let result;
+
+  while(!(result = await reader.read()).done) chunks.push(new Uint8Array(result.value));
+
+  return chunks;
+}
+
+async function Rejects(promise) {
+  try {
+    await promise;
+  } catch(e) {
+    return e;
+  }
+}
+
+tests({
+  async 'stream() fills sparse holes in bounded chunks'() {
+    const dir = TempDir();
+    const data = 'x'.repeat(512);
+    const ar = Archive.read(SparseTar(`${dir}/sparse.tar`, 'sparse.bin', 150000, data));
+    const entry = ar.next();
+
+    eq(entry.size, 150512);
+
+    const chunks = await ReadStream(entry.stream());
+    const bytes = new Uint8Array(chunks.reduce((n, c) => n + c.length, 0));
+
+    chunks.reduce((pos, c) => (bytes.set(c, pos), pos + c.length), 0);
+
+    assert(chunks.every(c => c.length <= 65536), 'a hole chunk is larger than 64K');
+    assert(chunks.length >= 4, `${chunks.length} chunks for a 150000 byte hole`);
+    eq(bytes.length, 150512);
+    assert(bytes.subarray(0, 150000).every(b => b == 0), 'the hole is not zero-filled');
+    eq(String.fromCharCode(...bytes.subarray(150000)), data);
+  },
+  'index() keeps __proto__ as a plain entry'() {
+    const dir = TempDir();
+    const ar = Archive.read(Tar(`${dir}/proto.tar`, [['a.txt', 'A'], ['__proto__', 'PP'], ['b.txt', 'BBB']]));
+    const { entries, seekable } = ar.index();
+
+    eq(seekable, true);
+    eq(Object.getPrototypeOf(entries), null);
+    eq(Object.keys(entries).join(), 'a.txt,__proto__,b.txt');
+    eq(entries['__proto__'][1], 2);
+    eq(entries['b.txt'][1], 3);
+    eq('toString' in entries, false);
+  },
+  'openEntry() through the index'() {
+    const dir = TempDir();
+    const ar = Archive.read(Tar(`${dir}/open.tar`, [['a.txt', 'A'], ['__proto__', 'PP'], ['b.txt', 'BBB']]));
+
+    ar.entryIndex = ar.index();
+
+    for(const [name, data] of [['b.txt', 'BBB'], ['__proto__', 'PP']]) {
+      const entry = ar.openEntry(name);
+      const buf = new ArrayBuffer(16);
+
+      eq(entry.pathname, name);
+      eq(entry.archive.read(buf), data.length);
+      eq(String.fromCharCode(...new Uint8Array(buf, 0, data.length)), data);
+      entry.archive.close();
+    }
+
+    eq(ar.openEntry('toString'), null);
+  },
+  'addFile() copies from offset 0 of a path or an fd'() {
+    const dir = TempDir();
+    const content = 'addFile contents\n'.repeat(4096);
+    const src = `${dir}/src.txt`;
+    let f = std.open(src, 'w');
+
+    f.puts(content);
+    f.close();
+
+    const fd = os.open(src, os.O_RDONLY);
+
+    /* a moved fd position must not change what is archived */
+    os.seek(fd, 100, std.SEEK_SET);
+
+    const ar = Archive.write(`${dir}/add.tar`);
+
+    eq(ar.addFile(src), content.length);
+    eq(ar.addFile(fd, { pathname: 'from-fd.txt' }), content.length);
+
+    let error;
+
+    try {
+      ar.addFile(fd);
+    } catch(e) {
+      error = e;
+    }
+
+    assert(error instanceof TypeError, 'addFile(fd) without a pathname');
+    ar.close();
+    os.close(fd);
+
+    const rd = Archive.read(`${dir}/add.tar`);
+
+    for(const name of [src.replace(/^\/+/, ''), 'from-fd.txt']) {
+      const entry = rd.openEntry(name);
+      const buf = new ArrayBuffer(content.length + 1);
+
+      assert(entry, `'${name}' is not in the archive`);
+      eq(entry.size, content.length);
+      eq(entry.archive.read(buf), content.length);
+      eq(String.fromCharCode(...new Uint8Array(buf, 0, 64)), content.slice(0, 64));
+      entry.archive.close();
+    }
+  },
+  async 'extractAll() from a file'() {
+    const dir = TempDir();
+    const file = Tar(`${dir}/a.tar`, [
+      ['a.txt', 'first'],
+      ['sub/', '', { mode: 0o40755 }],
+      ['sub/b.txt', 'second']
+    ]);
+
+    eq(os.mkdir(`${dir}/out`, 0o755), 0);
+    eq(await Archive.read(file).extractAll(`${dir}/out`, { threads: 2 }), 3);
+    eq(std.loadFile(`${dir}/out/a.txt`), 'first');
+    eq(std.loadFile(`${dir}/out/sub/b.txt`), 'second');
+  },
+  async 'extractAll() from an ArrayBuffer'() {
+    const dir = TempDir();
+    const buf = fs.readFileSync(Tar(`${dir}/a.tar`, [['c.txt', 'third']]), null);
+
+    eq(os.mkdir(`${dir}/out`, 0o755), 0);
+    eq(await new Archive().open(buf).extractAll(`${dir}/out`), 1);
+    eq(std.loadFile(`${dir}/out/c.txt`), 'third');
+  },
+  async 'extractAll() refuses ../ entries'() {
+    const dir = TempDir();
+    const file = Tar(`${dir}/evil.tar`, [['../../evil.txt', 'outside']]);
+
+    eq(os.mkdir(`${dir}/out`, 0o755), 0);
+    eq(os.mkdir(`${dir}/out/deep`, 0o755), 0);
+
+    const error = await Rejects(Archive.read(file).extractAll(`${dir}/out/deep`));
+
+    assert(error, "'../../evil.txt' was extracted");
+    assert(!Exists(`${dir}/evil.txt`), 'a file was written outside dest');
+  },
+  async 'extractAll() refuses entries through a symlink'() {
+    const dir = TempDir();
+    const file = Tar(`${dir}/link.tar`, [
+      ['link', '', { mode: 0o120777, symlink: base }],
+      ['link/escaped.txt', 'outside']
+    ]);
+
+    eq(os.mkdir(`${dir}/out`, 0o755), 0);
+
+    const error = await Rejects(Archive.read(file).extractAll(`${dir}/out`, { threads: 1 }));
+
+    assert(error, "'link/escaped.txt' was extracted");
+    assert(!Exists(`${base}/escaped.txt`), 'a file was written through the symlink');
+  },
+  async 'extractAll() needs an existing dest'() {
+    const dir = TempDir();
+    const file = Tar(`${dir}/a.tar`, [['a.txt', 'x']]);
+    let error;
+
+    try {
+      await Archive.read(file).extractAll(`${dir}/missing`);
+    } catch(e) {
+      error = e;
+    }
+
+    assert(error, 'extractAll() into a missing directory succeeded');
+  },
+  'ArchiveFS answers lookups from the index'() {
+    const dir = TempDir();
+    const afs = new ArchiveFS(Tar(`${dir}/fs.tar`, [['a.txt', 'A'], ['dir/b.txt', 'BB'], ['dir/sub/c.txt', 'CCC']]));
+
+    eq(afs.existsSync('a.txt'), true);
+    eq(afs.existsSync('dir/sub'), true);
+    eq(afs.existsSync('dir/missing.txt'), false);
+    eq(afs.readdirSync('').join(), 'a.txt,dir');
+    eq(afs.readdirSync('dir').join(), 'b.txt,sub');
+    eq(afs.sizeSync('dir/sub/c.txt'), 3);
+    eq(afs.statSync('dir').isDirectory(), true);
+    eq(afs.statSync('dir/b.txt').isFile(), true);
+    eq(afs.statSync('nothing'), undefined);
+    eq(afs.readFileSync('dir/b.txt', 'utf-8'), 'BB');
+    eq(afs.readFileSync('dir/sub/c.txt').byteLength, 3);
+    eq(afs.readFileSync('dir'), undefined);
+
+    let error;
+
+    try {
+      afs.readdirSync('a.txt');
+    } catch(e) {
+      error = e;
+    }
+
+    assert(error, 'readdirSync() of a file member');
+  },
+  'PathTrie matches ancestors outermost first'() {
+    const trie = new PathTrie();
+
+    trie.set('/a', 1);
+    trie.set('/a/b/c', 2);
+    trie.set('/x', 3);
+
+    eq(trie.match('/a/b/c/d').join(), '1,2');
+    eq(trie.match('/a/b').join(), '1');
+    eq(trie.match('/ab').length, 0);
+  },
+  'UnionFS mounts an ArchiveFS and caches relative paths'() {
+    const dir = TempDir();
+    const afs = new ArchiveFS(Tar(`${dir}/union.tar`, [['x.txt', 'from archive'], ['d/y.txt', 'Y']]));
+    const ufs = new UnionFS();
+
+    eq(os.mkdir(`${dir}/real`, 0o755), 0);
+
+    ufs.appendPath(`${dir}/real`, fs);
+    ufs.appendPath(`${dir}/mnt`, afs);
+
+    eq(afs.root, `${dir}/mnt`);
+    eq(ufs.existsSync(`${dir}/mnt/d/y.txt`), true);
+    eq(ufs.readdirSync(`${dir}/mnt/d`).join(), `${dir}/mnt/d/y.txt`);
+    eq(ufs.readFileSync(`${dir}/mnt/d/y.txt`, 'utf-8'), 'Y');
+    eq(ufs.readFileSync('x.txt', 'utf-8'), 'from archive');
+
+    /* a change behind the union's back is seen only after clearCache() */
+    const f = std.open(`${dir}/real/x.txt`, 'w');
+    f.puts('from disk');
+    f.close();
+
+    eq(ufs.readFileSync('x.txt', 'utf-8'), 'from archive');
+    ufs.clearCache();
+    eq(ufs.readFileSync('x.txt', 'utf-8'), 'from disk');
+  }
+});
@@ -0,0 +1,44 @@
+import { bcryptAsync, bcryptCompareAsync } from 'misc';
+import { assert, eq, tests } from './tinytest.js';
+
+tests({
+  async 'hash and compare'() {
+    const hash = await bcryptAsync('correct horse', 4);
+
+    eq(typeof hash, 'string');
+    assert(hash.startsWith('$2'), `unexpected hash '${hash}'`);
+    eq(hash.slice(4, 6), '04');
+
+    eq(await bcryptCompareAsync('correct horse', hash), true);
+    eq(await bcryptCompareAsync('battery staple', hash), false);
+  },
+  async 'hash with a salt'() {
+    const hash = await bcryptAsync('secret', 4);
+    const salt = hash.slice(0, 29);
+
+    eq(await bcryptAsync('secret', salt), hash);
+  },
+  async 'concurrent jobs'() {
+    const passwords = ['a', 'bb', 'ccc', 'dddd', 'eeeee', 'ffffff', 'ggggggg', 'hhhhhhhh'];
+    const hashes = await Promise.all(passwords.map(pw => bcryptAsync(pw, 4)));
+
+    eq(new Set(hashes).size, passwords.length);
+
+    const right = await Promise.all(passwords.map((pw, i) => bcryptCompareAsync(pw, hashes[i])));
+    const wrong = await Promise.all(passwords.map((pw, i) => bcryptCompareAsync(pw, hashes[(i + 1) % hashes.length])));
+
+    assert(right.every(ok => ok === true), 'a password does not match its own hash');
+    assert(wrong.every(ok => ok === false), 'a password matches another hash');
+  },
+  async 'invalid arguments'() {
+    let error;
+
+    try {
+      await bcryptCompareAsync('secret', '');
+    } catch(e) {
+      error = e;
+    }
+
+    assert(error instanceof RangeError, 'an empty hash is rejected');
+  }
+});
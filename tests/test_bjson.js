@@ -0,0 +1,83 @@
+import { Dictionary, FrameDecoder, read, write, writeFrame } from 'bjson';
+import { Console } from 'console';
+import { Queue } from 'queue';
+import * as std from 'std';
+
+function main(...args) {
+  globalThis.console = new Console({
+    inspectOptions: {
+      depth: 8,
+      maxArrayLength: 256,
+      compact: 2
+    }
+  });
+
+  let messages = [{ a: 1, b: [2, 3] }, 'x'.repeat(300), 42, null];
+  let frames = messages.map(msg => new Uint8Array(writeFrame(msg)));
+  let bytes = new Uint8Array(frames.reduce((n, f) => n + f.byteLength, 0));
+
+  frames.reduce((pos, f) => (bytes.set(f, pos), pos + f.byteLength), 0);
+
+  let received = [];
+  let decoder = new FrameDecoder(msg => received.push(msg));
+
+  /* feed the stream in pieces that split frames and prefixes */
+  for(let pos = 0; pos < bytes.byteLength; pos += 7) decoder.write(bytes.slice(pos, pos + 7));
+
+  if(decoder.pending != 0) throw new Error(`FrameDecoder.pending = ${decoder.pending}`);
+  if(JSON.stringify(received) != JSON.stringify(messages)) throw new Error(`FrameDecoder received ${JSON.stringify(received)}`);
+
+  let q = new Queue();
+
+  for(let msg of messages) writeFrame(msg, false, q);
+
+  let next = new FrameDecoder();
+
+  if(JSON.stringify(next.next(q)) != JSON.stringify(messages[0]) || next.next(q) != messages[1]) throw new Error('FrameDecoder.next(queue) failed');
+
+  decoder.push(bytes.slice(0, 2));
+
+  if(decoder.next() !== undefined || decoder.pending != 2) throw new Error('FrameDecoder.next() decoded an incomplete frame');
+
+  let limited = new FrameDecoder({ maxLength: 16 });
+  let threw = false;
+
+  try {
+    limited.push(frames[1]);
+    limited.next();
+  } catch(e) {
+    threw = e instanceof RangeError;
+  }
+
+  if(!threw) throw new Error('FrameDecoder maxLength not enforced');
+
+  let records = Array.from({ length: 100 }, (_, i) => ({ id: i, name: `n${i}`, value: i / 3, tags: ['a'], when: new Date(0) }));
+  let writer = new Dictionary(),
+    reader = new Dictionary();
+  let first = writer.write(records.slice(0, 50)),
+    second = writer.write(records.slice(50));
+
+  if(writer.size != 1) throw new Error(`Dictionary.size = ${writer.size}`);
+  if(second.byteLength >= write(records.slice(50)).byteLength / 2) throw new Error(`Dictionary.write() = ${second.byteLength} bytes`);
+
+  let decoded = [...reader.read(first), ...reader.read(second)];
+
+  if(JSON.stringify(decoded) != JSON.stringify(records) || !(decoded[99].when instanceof Date)) throw new Error('Dictionary round-trip failed');
+
+  let framed = new FrameDecoder({ dictionary: new Dictionary() });
+
+  framed.push(writeFrame(records[0], writer), writeFrame(records[1], writer));
+
+  if(framed.next().name != 'n0' || framed.next().id != 1) throw new Error('FrameDecoder with a dictionary failed');
+
+  let buf = write({ x: 'y' });
+
+  if(read(buf, 0, buf.byteLength).x != 'y') throw new Error('write() round-trip failed');
+}
+
+try {
+  main(...scriptArgs.slice(1));
+} catch(error) {
+  console.log(`FAIL: ${error.message}\n${error.stack}`);
+  std.exit(1);
+}
@@ -1,6 +1,7 @@
 import { Blob } from 'blob';
 import { Console } from 'console';
 import { escape, toArrayBuffer } from 'misc';
+import * as os from 'os';
 import * as std from 'std';
 
 ('use strict');
@@ -51,6 +52,24 @@ function main(...args) {
 
     console.log(`sl[${i}]`, escape(sl.text()));
   }
+
+  let whole = new Blob(['abc', new Blob(['def']), 'ghi']);
+  let part = whole.slice(2, -2);
+
+  if(part.size != 5 || part.text() != 'cdefg' || part.slice(-2).text() != 'fg') throw new Error(`Blob.slice() = '${part.text()}'`);
+
+  let file = `/tmp/test_blob.${Date.now()}`;
+  let f = std.open(file, 'w');
+  f.puts('0123456789');
+  f.close();
+
+  let fromFile = Blob.fromFile(file, { type: 'text/plain' });
+  let joined = new Blob([fromFile.slice(7), '|', fromFile.slice(0, 3)]);
+
+  if(fromFile.size != 10 || fromFile.type != 'text/plain' || joined.text() != '789|012') throw new Error(`Blob.fromFile() = '${joined.text()}'`);
+  if(new Uint8Array(fromFile.arrayBuffer())[9] != 0x39) throw new Error('Blob.fromFile().arrayBuffer() failed');
+
+  os.remove(file);
 }
 
 try {
@@ -1,4 +1,4 @@
-import child_process from 'child_process';
+import child_process, { ProcessPool } from 'child_process';
 import * as os from 'os';
 import { toString } from 'util';
 import Console from '../lib/console.js';
@@ -70,6 +70,41 @@ function main(...args) {
 
   console.log('data:', data);
 
+  let pool = new ProcessPool(['qjsm', scriptArgs[0].replace(/[^/]*$/, '') + 'pool_worker.js'], { size: 2 });
+  let [rd, wr] = os.pipe();
+
+  Promise.all([1, 2, 3].map(n => pool.run({ n }, n == 3 ? [rd, wr] : [])))
+    .then(results => {
+      if(results.map(({ n }) => n).join() != '2,4,6' || results[2].fds != 2) throw new Error(`ProcessPool.run() = ${JSON.stringify(results)}`);
+    })
+    .catch(error => {
+      console.log(`FAIL: ${error.message}\n${error.stack}`);
+      std.exit(1);
+    })
+    .finally(() => pool.close());
+
+  os.close(rd);
+  os.close(wr);
+
+  let echo = child_process.spawn('echo', ['piped'], { stdio: ['inherit', 'pipe', 'inherit'] });
+  let cat = child_process.spawn('cat', [], { stdio: [echo.stdout, 'pipe', 'inherit'] });
+  let reader = cat.stdout.getReader();
+
+  (async () => {
+    let out = '',
+      result;
+
+    while(!(result = await reader.read()).done) out += toString(result.value);
+
+    if(out != 'piped\n') throw new Error(`echo | cat = '${out}'`);
+
+    echo.wait();
+    cat.wait();
+  })().catch(error => {
+    console.log(`FAIL: ${error.message}\n${error.stack}`);
+    std.exit(1);
+  });
+
   /*  data = ReadChild('lz4', '-9', '-f', '/etc/services', 'services.lz4');
 
   console.log('data:', data.slice(0, 100));
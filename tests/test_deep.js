@@ -85,6 +85,39 @@ function main(...args) {
     'select()3:',
     deep.select(obj3, () => true, deep.RETURN_VALUE_PATH)
   );
+  console.log('select() pattern:', deep.select(obj3, 'x.*', deep.RETURN_VALUE_PATH));
+  console.log('select() deep pattern:', deep.select(obj3, '**.name', deep.RETURN_PATH_VALUE));
+  console.log('find() pattern:', deep.find(obj3, ['y', '2'], deep.RETURN_PATH_VALUE));
+  for(let [n, p] of deep.iterate(obj3, 'z.*', deep.RETURN_VALUE_PATH)) console.log(`deep.iterate() pattern`, { n, p });
+
+  let cow = deep.clone(obj3, { cow: true });
+  cow.x.a = 3;
+  delete cow.w;
+  console.log('clone() cow:', { x: cow.x.a, source: obj3.x.a, w: 'w' in cow, shared: cow.y[2] === obj3.y[2] });
+
+  if(deep.equals(obj3, obj2) || !deep.equals(obj3, deep.clone(obj3))) throw new Error('equals()');
+  if(deep.equals(Object.freeze({ a: 1 }), Object.freeze({ a: 2 }), { hash: true })) throw new Error('equals() hash: different objects are equal');
+  if(!deep.equals({ a: [1, NaN] }, { a: [1, NaN] }, { hash: true })) throw new Error('equals() hash: equal objects differ');
+  if(deep.hash({ a: 1, b: [2] }) != deep.hash({ b: [2], a: 1 })) throw new Error('hash() depends on key order');
+  if(deep.hash({ a: 1 }) == deep.hash({ a: 2 })) throw new Error('hash() ignores values');
+
+  let changes = deep.diff(obj2, obj3);
+  console.log('diff():', changes);
+
+  if(!changes.length || !changes.every(({ op, path }) => ['add', 'remove', 'replace'].includes(op) && Array.isArray(path))) throw new Error('diff()');
+  if(!deep.equals(deep.patch(deep.clone(obj2), changes), obj3)) throw new Error('patch() does not reproduce the diff target');
+  if(deep.diff(obj3, deep.clone(obj3)).length) throw new Error('diff() of equal objects');
+
+  let table = deep.flattenColumns([
+    { id: 1, pos: { x: 0.5, y: 2 }, ok: true, tags: ['a'] },
+    { id: 2, pos: { x: 1.5 }, ok: false, tags: ['b', 'c'] }
+  ]);
+  console.log('flattenColumns():', table.paths, table.columns);
+
+  if(table.paths.join() != 'id,pos.x,pos.y,ok,tags.0,tags.1') throw new Error(`flattenColumns() paths: ${table.paths}`);
+  if(!(table.columns[0] instanceof Int32Array) || !(table.columns[1] instanceof Float64Array) || !(table.columns[3] instanceof Uint8Array))
+    throw new Error('flattenColumns() column types');
+  if(!isNaN(table.columns[2][1]) || table.columns[5][0] !== undefined) throw new Error('flattenColumns() missing cells');
   return;
 
   for(let o of [obj1, obj2]) {
@@ -1,5 +1,7 @@
 import Console from 'console';
-import { Directory } from 'directory';
+import { Directory, DirectoryIndex } from 'directory';
+import * as os from 'os';
+import * as std from 'std';
 
 function main(...args) {
   globalThis.console = new Console({
@@ -28,6 +30,46 @@ function main(...args) {
       console.log('entry', console.config({ compact: 0 }), { index: index++, name, type });
     }
   }
+
+  let batch = new Directory('.').readBatch(100000, Directory.BOTH | Directory.INODE);
+  let walker = Directory.walk('.', { maxDepth: 0 });
+  let names = [...walker];
+
+  if(batch.length != names.length) throw new Error(`readBatch() returned ${batch.length} entries, walk() ${names.length}`);
+  if(!batch.every(([name, type, inode]) => names.includes(name) && typeof inode == 'number')) throw new Error('readBatch() and walk() differ');
+
+  walker = Directory.walk('.', { types: Directory.TYPE_DIR });
+
+  for(let name of walker) {
+    if(walker.type != Directory.TYPE_DIR || walker.path != './' + name && !walker.path.endsWith('/' + name)) throw new Error(`walk() entry ${walker.path}`);
+    if(name == 'node_modules' || name[0] == '.') walker.skip();
+  }
+
+  if(os.platform == 'linux') {
+    let root = `/tmp/test_directory.${Date.now()}`;
+
+    os.mkdir(root);
+    os.mkdir(root + '/a');
+    std.open(root + '/a/x', 'w').close();
+
+    let idx = new DirectoryIndex(root, { watch: false });
+
+    if(idx.size != 2 || idx.seq != 0 || idx.lookup('a/x')?.type != Directory.TYPE_REG) throw new Error(`DirectoryIndex initial crawl: ${idx.size} entries`);
+
+    os.mkdir(root + '/b');
+    std.open(root + '/b/y', 'w').close();
+    os.remove(root + '/a/x');
+    idx.update();
+
+    if(idx.list().join() != 'a,b' || idx.list('a').length != 0 || idx.lookup('a/x') !== null) throw new Error(`DirectoryIndex.list() = ${idx.list()}`);
+    if(!idx.changedSince(0).some(({ path, removed }) => path == 'a/x' && removed)) throw new Error('DirectoryIndex.changedSince() misses a/x');
+
+    idx.close();
+    os.remove(root + '/b/y');
+    os.remove(root + '/b');
+    os.remove(root + '/a');
+    os.remove(root);
+  }
 }
 
 try {
@@ -0,0 +1,63 @@
+import { EventEmitter } from 'emitter';
+import { EventEmitter as Events, eventify } from 'events';
+import * as std from 'std';
+
+class Sub extends EventEmitter {}
+
+function main() {
+  if(Events !== EventEmitter) throw new Error(`'events' doesn't export the native EventEmitter`);
+
+  const em = new Sub(),
+    calls = [];
+
+  if(!(em instanceof Sub) || !(em instanceof EventEmitter)) throw new Error('EventEmitter can not be extended');
+
+  const a = (...args) => calls.push(['a', ...args]),
+    b = function(x) {
+      calls.push(['b', this === em, x]);
+      em.removeListener('x', a);
+      em.on('x', c);
+    },
+    c = () => calls.push(['c']);
+
+  em.on('x', a);
+  em.on('x', b);
+  em.once('y', x => calls.push(['once', x]));
+
+  /* removing and adding during emit() affects the next emit() only */
+  if(em.emit('x', 1, 2) !== true) throw new Error('emit() with listeners did not return true');
+  if(JSON.stringify(calls) != '[["a",1,2],["b",true,1]]') throw new Error(`first emit(): ${JSON.stringify(calls)}`);
+
+  calls.length = 0;
+  em.emit('x', 3);
+
+  if(JSON.stringify(calls) != '[["b",true,3],["c"]]') throw new Error(`second emit(): ${JSON.stringify(calls)}`);
+
+  calls.length = 0;
+  em.emit('y', 'first');
+  em.emit('y', 'second');
+
+  if(JSON.stringify(calls) != '[["once","first"]]') throw new Error(`once(): ${JSON.stringify(calls)}`);
+  if(em.emit('nothing') !== false) throw new Error('emit() without listeners did not return false');
+  if(em.listenerCount('x') != 3 || em.rawListeners('x')[0] !== b) throw new Error(`rawListeners(): ${em.rawListeners('x')}`);
+
+  em.removeAllListeners('x');
+
+  if(em.rawListeners('x') !== undefined) throw new Error('removeAllListeners() left listeners');
+
+  const obj = eventify({});
+  let got;
+
+  obj.on('z', v => (got = v));
+  obj.emit('z', 42);
+
+  if(got !== 42) throw new Error(`eventify(): ${got}`);
+}
+
+try {
+  main();
+  console.log('SUCCESS');
+} catch(error) {
+  console.log(`FAIL: ${error.message}\n${error.stack}`);
+  std.exit(1);
+}
@@ -168,6 +168,39 @@ async function main(...args) {
 
   console.log('inspect(map)', inspect(map, { compact: Infinity }));
 
+  let frame = new Uint8Array(64).map((_, i) => i * 7);
+  console.log('inspect(frame.buffer, { offsets, groupBytes })', inspect(frame.buffer, { offsets: true, groupBytes: 4, colors: false }));
+  console.log('inspect(Int16Array)', inspect(new Int16Array([-1, 2, -300]), { colors: false }));
+  console.log('inspect(Uint32Array, { numberBase: 16 })', inspect(new Uint32Array([0xdeadbeef, 1]), { numberBase: 16, colors: false }));
+  console.log('inspect(DataView)', inspect(new DataView(frame.buffer, 8, 16), { colors: false }));
+
+  let big = Array.from({ length: 10000 }, (_, i) => ({ i, s: 'x'.repeat(100) }));
+  console.log('inspect(big, { maxBytes })', inspect(big, { maxBytes: 200, colors: false }));
+
+  let chunks = [];
+  let written = inspect(big, { maxBytes: 10000, colors: false, write: chunk => chunks.push(chunk) });
+  console.log('inspect(big, { write })', { written, chunks: chunks.length });
+
+  /* small writes are staged, the long string goes out in the same writev() */
+  let [rfd, wfd] = os.pipe();
+  let piped = { a: 1, long: 'y'.repeat(20000), list: Array.from({ length: 200 }, (_, i) => i) };
+  let expected = inspect(piped, { colors: false });
+
+  written = inspect(piped, { colors: false, fd: wfd });
+  os.close(wfd);
+
+  let buf = new ArrayBuffer(65536),
+    output = '',
+    n;
+
+  while((n = os.read(rfd, buf, 0, buf.byteLength)) > 0) output += String.fromCharCode(...new Uint8Array(buf, 0, n));
+
+  os.close(rfd);
+
+  if(output !== expected) throw new Error(`inspect({ fd }) wrote ${output.length} bytes, expected ${expected.length}`);
+  if(written != expected.length) throw new Error(`inspect({ fd }) returned ${written}`);
+  console.log('inspect(piped, { fd })', { written });
+
   std.gc();
   return;
 }
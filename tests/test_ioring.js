@@ -0,0 +1,54 @@
+import * as os from 'os';
+import * as sockets from 'sockets';
+import { toString } from 'util';
+import { eq, tests } from './tinytest.js';
+
+function NewRing() {
+  try {
+    return sockets.IoRing && new sockets.IoRing({ entries: 8 });
+  } catch(error) {
+    /* kernel without io_uring or blocked by seccomp */
+  }
+}
+
+tests({
+  async 'IoRing write()/read()'() {
+    const ring = NewRing();
+
+    if(!ring) return;
+
+    const [rfd, wfd] = os.pipe();
+    const buf = new ArrayBuffer(16);
+
+    const written = ring.write(wfd, 'hello');
+    eq(ring.pending, 1);
+    eq(await written, 5);
+    eq(ring.pending, 0);
+
+    eq(await ring.read(rfd, buf, 0, 16), 5);
+    eq(toString(buf.slice(0, 5)), 'hello');
+
+    ring.close();
+    os.close(rfd);
+    os.close(wfd);
+  },
+  async 'IoRing registerBuffers()'() {
+    const ring = NewRing();
+
+    if(!ring) return;
+
+    const [rfd, wfd] = os.pipe();
+    const bufs = [new ArrayBuffer(8), new ArrayBuffer(8)];
+
+    new Uint8Array(bufs[0]).set([1, 2, 3]);
+    eq(ring.registerBuffers(bufs), 2);
+
+    eq(await ring.write(wfd, 0, 0, 3), 3);
+    eq(await ring.read(rfd, 1, 0, 8), 3);
+    eq(new Uint8Array(bufs[1], 0, 3).join(','), '1,2,3');
+
+    ring.close();
+    os.close(rfd);
+    os.close(wfd);
+  }
+});
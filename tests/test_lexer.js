@@ -9,7 +9,7 @@ import CSVLexer from '../lib/lexer/csv.js';
 import ECMAScriptLexer from '../lib/lexer/ecmascript.js';
 import { Console } from 'console';
 import inspect from 'inspect';
-import { Location } from 'lexer';
+import { Lexer, Location } from 'lexer';
 import { escape, toString } from 'misc';
 import { MAP_PRIVATE, mmap, PROT_READ } from 'mmap';
 import { err, exit, gc, open as fopen, puts } from 'std';
@@ -203,6 +203,113 @@ function PrintCJSImport({ type, local, file }) {
   }[type]();
 }
 
+function WordLexer(input) {
+  const lexer = new Lexer(input, Lexer.LONGEST);
+
+  lexer.skip = 0;
+  lexer.addRule('word', /[a-z]+/);
+  lexer.addRule('number', /[0-9]+/);
+  lexer.addRule('space', /[ \n]+/);
+  lexer.addRule('operator', /[+*]/);
+  return lexer;
+}
+
+const Records = records => [...Array(records.length / 4)].map((_, i) => [...records.slice(i * 4, i * 4 + 4)].map(Number));
+
+function Expect(what, actual, expected) {
+  if(JSON.stringify(actual) != JSON.stringify(expected)) throw new Error(`${what}: ${JSON.stringify(actual)} != ${JSON.stringify(expected)}`);
+}
+
+/* applies the result of edit() to the records tokenize() returned before */
+function ApplyEdit(records, { index, deleteCount, tokens, byteDelta, lineDelta }) {
+  const tail = records.slice(index + deleteCount).map(([id, offset, length, line]) => [id, offset + byteDelta, length, line + lineDelta]);
+
+  return [...records.slice(0, index), ...Records(tokens), ...tail];
+}
+
+function TestNative() {
+  const input = 'ab 12+cd\nx';
+  const [word, number, space, operator] = [0, 1, 2, 3];
+  const all = Records(WordLexer(input).tokenize());
+
+  Expect(
+    'tokenize() ids and ranges',
+    all.map(([id, offset, length]) => [id, offset, length]),
+    [
+      [word, 0, 2],
+      [space, 2, 1],
+      [number, 3, 2],
+      [operator, 5, 1],
+      [word, 6, 2],
+      [space, 8, 1],
+      [word, 9, 1]
+    ]
+  );
+  Expect('tokenize() lines', all.map(r => r[3] - all[0][3]), [0, 0, 0, 0, 0, 0, 1]);
+
+  let lexer = WordLexer(input);
+
+  Expect('tokenize(n)', Records(lexer.tokenize(2)), all.slice(0, 2));
+
+  let buf32 = new Int32Array(8),
+    buf64 = new BigInt64Array(16);
+
+  Expect('tokensInto(Int32Array)', lexer.tokensInto(buf32), 2);
+  Expect('tokensInto(Int32Array) records', Records(buf32), all.slice(2, 4));
+  Expect('tokensInto(BigInt64Array)', lexer.tokensInto(buf64), 3);
+  Expect('tokensInto(BigInt64Array) records', Records(buf64.subarray(0, 12)), all.slice(4));
+
+  /* '12' and 'cd' are split across chunks */
+  lexer = WordLexer('');
+
+  let chunked = [];
+
+  for(let chunk of ['ab 1', '2+c', 'd\n']) {
+    lexer.feed(chunk);
+    chunked.push(...Records(lexer.tokenize()));
+  }
+
+  lexer.end('x');
+  chunked.push(...Records(lexer.tokenize()));
+  Expect('feed()/end()', chunked, all);
+
+  /* edits spanning several checkpoints, compared against a fresh lex */
+  let text = [...Array(300)].map((_, i) => (i % 7 ? 'w' + 'abc'[i % 3] : '1' + i) + (i % 11 ? ' ' : '\n')).join('');
+
+  lexer = WordLexer(text);
+
+  let records = Records(lexer.tokenize());
+
+  for(let [offset, deleted, inserted] of [
+    [400, 5, 'xy\nz 42'],
+    [3, 0, '+7 '],
+    [text.length - 9, 4, ''],
+    [700, 20, 'q\n\nr']
+  ]) {
+    records = ApplyEdit(records, lexer.edit(offset, deleted, inserted));
+    text = text.slice(0, offset) + inserted + text.slice(offset + deleted);
+
+    Expect(`edit(${offset}, ${deleted})`, records, Records(WordLexer(text).tokenize()));
+  }
+
+  /* a failed edit leaves the lexer as it was */
+  const size = lexer.size;
+  let error;
+
+  try {
+    lexer.edit(10, 1, '#');
+  } catch(e) {
+    error = e;
+  }
+
+  if(!error) throw new Error('edit() with an unmatched character did not throw');
+
+  Expect('size after failed edit()', lexer.size, size);
+  records = ApplyEdit(records, lexer.edit(10, 1, 'ok'));
+  text = text.slice(0, 10) + 'ok' + text.slice(11);
+  Expect('edit() after failed edit()', records, Records(WordLexer(text).tokenize()));
+}
+
 function main(...args) {
   globalThis.console = new Console(process.stderr, {
     inspectOptions: {
@@ -216,6 +323,7 @@ function main(...args) {
     }
   });
   console.log('args', args);
+  TestNative();
   let optind = 0;
   let code = 'c';
   let debug,
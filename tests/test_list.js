@@ -1,4 +1,16 @@
 import { List } from 'list';
+
+function assert(cond, msg) {
+  if(!cond) throw new Error('assertion failed: ' + msg);
+}
+
+/* compares a List with the Array it should equal */
+function same(list, array) {
+  const values = [...list];
+
+  return list.size == array.length && values.length == array.length && values.every((v, i) => v === array[i]);
+}
+
 let l = new List([6, 5, 4, 3, 2, 1]);
 
 let letter = 'a';
@@ -44,3 +56,115 @@ console.log('it', it);
 
 //insert();
 //console.log('l', l);
+
+/* spans several storage blocks */
+let model = Array.from({ length: 100 }, (v, i) => i);
+let big = List.from(model);
+let removed = big.splice(30, 10, 'x', 'y');
+
+assert(same(removed, model.splice(30, 10, 'x', 'y')), 'splice() returns the removed values');
+assert(same(big, model), 'splice() across blocks');
+
+big.unshift(-1);
+model.unshift(-1);
+assert(big.size == 93 && big[0] === -1 && big[31] === 'x' && big[big.size - 1] === 99, 'unshift() and index access');
+assert(same(big.slice(29, 34), model.slice(29, 34)), 'slice() across the spliced range');
+assert(big.reduce((acc, v) => acc + (typeof v == 'number' ? v : 0), 0) == model.reduce((acc, v) => acc + (typeof v == 'number' ? v : 0), 0), 'reduce()');
+
+/* removing whole blocks and refilling them keeps the order */
+removed = big.splice(5, 70);
+model.splice(5, 70);
+assert(removed.size == 70 && same(big, model), 'splice() of several whole blocks');
+
+for(let i = 0; i < 80; i++) {
+  big.splice(5, 0, i);
+  model.splice(5, 0, i);
+}
+
+assert(same(big, model), 'splice() inserts into split blocks');
+
+while(big.size) {
+  assert(big.pop() === model.pop(), 'pop() after splice()');
+
+  if(big.size) assert(big.shift() === model.shift(), 'shift() after splice()');
+}
+
+assert(big.size == 0 && model.length == 0, 'emptied');
+
+/* large lists look positions up through the block index */
+let seed = 12345;
+const random = n => ((seed = (Math.imul(seed, 1103515245) + 12345) & 0x7fffffff) % n);
+
+model = Array.from({ length: 20000 }, (v, i) => i);
+big = List.from(model);
+
+for(let i = 0; i < 500; i++) {
+  const pos = random(model.length);
+
+  assert(big.at(pos) === model[pos] && big[pos] === model[pos], `indexed get at ${pos}`);
+}
+
+for(let i = 0; i < 2000; i++) {
+  const pos = random(model.length + 1);
+
+  if(i & 1) {
+    big.splice(pos, 0, -i);
+    model.splice(pos, 0, -i);
+  } else if(pos < model.length) {
+    assert(big.splice(pos, 1)[0] === model.splice(pos, 1)[0], `remove at ${pos}`);
+  }
+
+  const probe = random(model.length);
+
+  assert(big[probe] === model[probe], `get at ${probe} after ${i + 1} changes`);
+}
+
+assert(same(big, model), 'insert/remove at random positions');
+
+/* shrinking below the index threshold and growing past it again */
+big.splice(100, model.length - 200);
+model.splice(100, model.length - 200);
+assert(same(big, model) && big[150] === model[150], 'splice() below the index threshold');
+
+for(let i = 0; i < 5000; i++) {
+  const pos = random(model.length + 1);
+
+  big.splice(pos, 0, i);
+  model.splice(pos, 0, i);
+}
+
+assert(same(big, model) && big[4321] === model[4321], 'regrown index');
+
+/* sort() works in place and returns the list */
+let words = List.of('pear', 3, 'apple', undefined, 10, 'fig', 2);
+
+assert(words.sort() === words, 'sort() returns the list');
+assert(same(words, [2, 3, 10, 'apple', 'fig', 'pear', undefined]), 'default order: numbers, strings, undefined');
+assert(same(List.of(5, 1, 4).sort((a, b) => b - a), [5, 4, 1]), 'sort(compare)');
+assert(same(List.of('ccc', 'a', 'bb').sort({ key: s => s.length }), ['a', 'bb', 'ccc']), 'sort({ key })');
+
+/* values with equal keys keep their order, in both the compare and the key form */
+let records = Array.from({ length: 1000 }, (v, i) => ({ k: random(7), i }));
+let stable = (a, b) => a.k - b.k || a.i - b.i;
+
+assert(same(List.from(records).sort((a, b) => a.k - b.k), records.slice().sort(stable)), 'sort(compare) is stable');
+assert(same(List.from(records).sort({ key: r => r.k }), records.slice().sort(stable)), 'sort({ key }) is stable');
+assert(same(List.from(records).sort({ key: r => String(r.k), compare: (a, b) => (a < b ? -1 : a > b ? 1 : 0) }), records.slice().sort(stable)), 'sort({ key, compare }) is stable');
+
+/* an exception from compare stops the sort without losing values */
+let throwing = List.from(model.slice(0, 100)),
+  calls = 0,
+  error;
+
+try {
+  throwing.sort((a, b) => {
+    if(++calls == 50) throw new Error('compare');
+
+    return a - b;
+  });
+} catch(e) {
+  error = e;
+}
+
+assert(error?.message == 'compare', 'sort() rethrows the compare exception');
+assert(same(List.from([...throwing].sort((a, b) => a - b)), model.slice(0, 100).sort((a, b) => a - b)), 'sort() keeps every value after an exception');
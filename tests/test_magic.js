@@ -0,0 +1,39 @@
+import { Magic } from 'magic';
+import * as std from 'std';
+
+function fail(message) {
+  console.log(`FAIL: ${message}`);
+  std.exit(1);
+}
+
+function main() {
+  if(!Magic.preload()) console.log(`no compiled database at ${Magic.DEFAULT_DB}`);
+
+  let type = Magic.classify('tests/test_magic.js');
+
+  if(!/^(text|application)\//.test(type)) fail(`classify(file): ${type}`);
+  if(Magic.classify('tests/test_magic.js') != type) fail('cached result differs');
+
+  let png = new Uint8Array([0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a, 0, 0, 0, 0x0d, 0x49, 0x48, 0x44, 0x52, 0, 0, 0, 1, 0, 0, 0, 1, 8, 6, 0, 0, 0]);
+
+  if(Magic.classify(png.buffer) != 'image/png') fail(`classify(buffer): ${Magic.classify(png.buffer)}`);
+
+  let previous = Magic.cacheSize(0);
+
+  if(Magic.classify(png.buffer) != 'image/png') fail('uncached classify');
+
+  Magic.cacheSize(previous);
+  Magic.clearCache();
+
+  let magic = new Magic(Magic.MIME_TYPE, Magic.DEFAULT_DB);
+
+  if(magic.buffer(png.buffer) != 'image/png') fail(`Magic.buffer(): ${magic.buffer(png.buffer)}`);
+}
+
+try {
+  main();
+  console.log('SUCCESS');
+} catch(error) {
+  console.log(`FAIL: ${error.message}\n${error.stack}`);
+  std.exit(1);
+}
@@ -4,7 +4,7 @@ import extendArray from 'extendArray';
 import { format } from 'util';
 import { Console } from 'console';
 import { Location } from 'location';
-import { arrayToBitfield, atob, atomToValue, bitfieldToArray, btoa, compileScript, getByteCode, getClassConstructor, getClassID, getClassName, getOpCodes, JS_EVAL_FLAG_COMPILE_ONLY, readObject, toArrayBuffer, valueToAtom, writeObject } from 'misc';
+import { arrayToBitfield, atob, atomToValue, base64Decode, base64DecodeInto, base64Encode, base64EncodeInto, bitfieldToArray, btoa, compileScript, getByteCode, getClassConstructor, getClassID, getClassName, getOpCodes, JS_EVAL_FLAG_COMPILE_ONLY, readObject, searchAll, searchArrayBuffer, toArrayBuffer, valueToAtom, writeObject } from 'misc';
 import * as std from 'std';
 
 ('use strict');
@@ -159,6 +159,39 @@ function main(...args) {
     let str_size = str_len << is_wide;
     return get_bytes(buf, j, str_size);
   }
+
+  let log = toArrayBuffer('GET /a 200\nPOST /b 500\nGET /c 404\n' + 'x'.repeat(100) + 'ERROR');
+
+  if(searchArrayBuffer(log, toArrayBuffer('ERROR')) != 134 || searchArrayBuffer(log, toArrayBuffer('404'), 40) !== null) throw new Error('searchArrayBuffer() failed');
+
+  let { offsets, ids } = searchAll(log, ['GET', 'POST', '500', '00', 'ERROR']);
+
+  if(!(offsets instanceof Float64Array) || [...offsets].join() != '0,8,11,19,20,23,134' || [...ids].join() != '0,3,1,2,3,0,4') throw new Error(`searchAll() = ${offsets}, ${ids}`);
+  if(searchAll(log, ['GET'], 1).offsets.join() != '23' || searchAll(log, ['GET'], 0, 3).offsets.length != 1) throw new Error('searchAll() range failed');
+
+  let bytes = new Uint8Array(100).map((_, i) => i * 7);
+
+  if(btoa('hello') != 'aGVsbG8=' || btoa('hello', true) != 'aGVsbG8' || new Uint8Array(atob('aGVsbG8=')).length != 5) throw new Error('btoa()/atob() failed');
+  if(new Uint8Array(base64Decode(base64Encode(bytes, true), true)).join() != bytes.join()) throw new Error('base64Encode()/base64Decode() round-trip failed');
+
+  let encoded = new Uint8Array(base64Encode(bytes)),
+    decoded = new Uint8Array(bytes.length),
+    carry = 0,
+    written = 0;
+
+  /* chunks that split groups */
+  for(let pos = 0; pos < encoded.length; pos += 10) {
+    let chunk = encoded.subarray(pos - carry, pos + 10),
+      final = pos + 10 >= encoded.length;
+    let [r, w] = base64DecodeInto(chunk, decoded.subarray(written), false, final);
+
+    carry = chunk.length - r;
+    written += w;
+  }
+
+  if(written != bytes.length || decoded.join() != bytes.join()) throw new Error(`base64DecodeInto() = ${written} bytes`);
+  if(base64EncodeInto(bytes, new Uint8Array(8), false, false).join() != '6,8') throw new Error('base64EncodeInto() failed');
+
   std.gc();
 }
 
@@ -1,6 +1,6 @@
 import * as os from 'os';
 import Console from '../lib/console.js';
-import { MAP_PRIVATE, mmap, munmap, PROT_READ } from 'mmap';
+import { LineIndex, MappedFile, MADV_RANDOM, MADV_WILLNEED, MAP_PRIVATE, madvise, mincore, mmap, munmap, PROT_READ } from 'mmap';
 import * as std from 'std';
 async function main(...args) {
   globalThis.console = new Console({
@@ -26,7 +26,42 @@ async function main(...args) {
 
   console.log('map =', ArrayBufToString(map));
 
+  if(madvise(map, 0, size, MADV_RANDOM) != 0 || madvise(map, 0, undefined, MADV_WILLNEED) != 0) throw new Error('madvise() failed');
+
+  let resident = mincore(map);
+  console.log('resident', resident);
+
+  if(!(resident instanceof Uint8Array) || resident.length < 1) throw new Error(`mincore() returned ${resident}`);
+
+  let text = ArrayBufToString(map);
+  let lines = text.replace(/\n$/, '').split('\n');
+
+  for(let threads of [1, 3]) {
+    let index = new LineIndex(map, { threads });
+
+    if(index.length != lines.length) throw new Error(`LineIndex.length = ${index.length}, expected ${lines.length}`);
+    if(index.line(0) != lines[0] || index.line(-1) != lines[lines.length - 1]) throw new Error(`LineIndex.line() = ${index.line(0)}`);
+    if(index.find(lines[0].length + 1) != 1) throw new Error(`LineIndex.find() = ${index.find(lines[0].length + 1)}`);
+  }
+
+  let csv = Uint8Array.from('a,"b ""q"", c",d\n"x\ny",2\n', c => c.charCodeAt(0)).buffer;
+  let records = new LineIndex(csv, { quote: '"' });
+
+  if(records.length != 2 || records.fields(0).join('|') != 'a|b "q", c|d' || records.field(1, 0) != 'x\ny') throw new Error(`LineIndex.fields() = ${records.fields(0)}`);
+
   munmap(map);
+
+  let walFile = `/tmp/test_mmap.${Date.now()}`;
+  let wal = new MappedFile(walFile, { size: 16 });
+  new Uint8Array(wal.buffer).set([1, 2, 3], 0);
+
+  let grown = wal.grow(1 << 20);
+
+  if(wal.filename != walFile || wal.buffer.byteLength != 1 << 20 || new Uint8Array(grown)[2] != 3) throw new Error(`MappedFile.grow() lost data`);
+
+  wal.flush(0, 16);
+  wal.close();
+  os.remove(walFile);
 }
 
 function ArrayBufToString(buf, offset, length) {
@@ -1,7 +1,7 @@
 import { abbreviate, ansiStyles, className, randStr } from 'util';
 import extendArray from '../lib/extendArray.js';
 import { Console } from 'console';
-import { MySQL, MySQLResult } from 'mysql';
+import { MySQL, MySQLPool, MySQLResult } from 'mysql';
 import { exit } from 'std';
 extendArray();
 
@@ -170,14 +170,216 @@ async function main(...args) {
   console.log('row[0] =', row[0]);
 
   console.log('id =', (id = my.insertId));
+
+  let batch = [];
+
+  for await(let result of my.queryBatch([`SELECT COUNT(*) FROM users;`, `SET @n = 1;`, `SELECT @n;`])) batch.push(result instanceof MySQLResult ? [...result] : result);
+
+  console.log('queryBatch() =', batch);
+  if(batch.length != 3 || typeof batch[1].affectedRows != 'number') throw new Error(`queryBatch() returned ${batch.length} results`);
+
+  /* the batch turns multi-statement support off again after its last result */
+  let stacked;
+
+  try {
+    await my.query(`SELECT 1; SELECT 2;`);
+  } catch(e) {
+    stacked = e;
+  }
+
+  if(!stacked) throw new Error(`query() accepted stacked statements after queryBatch()`);
+
+  batch = [];
+
+  for await(let result of my.queryBatch([`SELECT 1;`, `SELECT 2;`])) batch.push(result);
+
+  if(batch.length != 2) throw new Error(`second queryBatch() returned ${batch.length} results`);
+  await PreparedTest(my);
+  await ColumnsTest(my);
+  await BatchTest(my);
+  await StatsTest(my);
+
   console.log('my.close', my.close);
 
   my.close();
 
+  await PoolTest();
+
   //startInteractive();
   // os.kill(process.pid, os.SIGUSR1);
 }
 
+async function PreparedTest(my) {
+  if(my.statementCacheSize != 32) throw new Error(`statementCacheSize = ${my.statementCacheSize}`);
+
+  const sql = `SELECT ? + ?, ?;`;
+  const st = await my.prepare(sql);
+
+  if(st.sql != sql || !st.cached) throw new Error(`prepare() returned ${st.sql} (cached ${st.cached})`);
+  if(st.paramCount != 3 || st.fieldCount != 2) throw new Error(`MySQLStatement paramCount/fieldCount = ${st.paramCount}/${st.fieldCount}`);
+
+  const rows = await st.execute(2, 3, 'x');
+
+  if(rows.length != 1 || rows[0][0] != 5 || rows[0][1] != 'x') throw new Error(`MySQLStatement.execute() returned ${JSON.stringify(rows)}`);
+  if(typeof rows.affectedRows != 'number' || typeof rows.insertId != 'number') throw new Error('MySQLStatement.execute() result without affectedRows/insertId');
+
+  let error;
+
+  try {
+    st.execute(1);
+  } catch(e) {
+    error = e;
+  }
+
+  if(!(error instanceof RangeError)) throw new Error('MySQLStatement.execute() accepted a wrong parameter count');
+
+  /* the second prepare() of the same text comes from the cache */
+  if(!(await my.prepare(sql)).cached) throw new Error('prepare() did not reuse the cached statement');
+
+  const [concat] = await my.query(`SELECT CONCAT(?, ?);`, ['a', 'b']);
+
+  if(concat[0] != 'ab') throw new Error(`query(sql, params) returned ${concat}`);
+
+  my.statementCacheSize = 0;
+
+  if(st.cached) throw new Error('statementCacheSize = 0 kept a cached statement');
+  if((await my.prepare(`SELECT ?;`)).cached) throw new Error('prepare() cached a statement with statementCacheSize = 0');
+
+  my.statementCacheSize = 32;
+}
+
+async function ColumnsTest(my) {
+  const res = await my.query(`SELECT CAST(1 AS SIGNED) AS i, 1.5 AS f, 'ab' AS s UNION ALL SELECT NULL, 2.5, 'cde';`);
+  const columns = await res.fetchColumns();
+  const [i, f, s] = columns;
+  const types = columns.map(c => `${c.name}:${c.type}`).join();
+
+  if(types != 'i:int64,f:float64,s:string') throw new Error(`fetchColumns() types ${types}`);
+  if(!columns.every(c => c.length == 2)) throw new Error(`fetchColumns() lengths ${columns.map(c => c.length)}`);
+
+  if(!(i.values instanceof BigInt64Array) || i.values[0] != 1n || i.nullCount != 1 || i.validity[0] != 0b01) throw new Error('fetchColumns() integer column');
+  if(!(f.values instanceof Float64Array) || f.values[0] != 1.5 || f.values[1] != 2.5) throw new Error('fetchColumns() decimal column');
+
+  /* strings share one byte buffer, row n is values[offsets[n]..offsets[n + 1]] */
+  if(!(s.offsets instanceof Uint32Array) || [...s.offsets].join() != '0,2,5') throw new Error(`fetchColumns() string offsets ${s.offsets}`);
+  if(String.fromCharCode(...s.values) != 'abcde' || s.validity[0] != 0b11) throw new Error('fetchColumns() string column');
+}
+
+async function BatchTest(my) {
+  const seq = `WITH RECURSIVE seq(n) AS (SELECT 1 UNION ALL SELECT n + 1 FROM seq WHERE n < 250) SELECT n FROM seq;`;
+  let res = await my.query(seq);
+  let sizes = [],
+    values = [],
+    batch;
+
+  while((batch = await res.fetchBatch(100)).length) {
+    sizes.push(batch.length);
+    values.push(...batch.map(row => +row[0]));
+  }
+
+  if(sizes.join() != '100,100,50') throw new Error(`fetchBatch(100) returned batches of ${sizes}`);
+  if(!values.every((n, i) => n == i + 1)) throw new Error('fetchBatch() returned rows out of order');
+
+  res = await my.query(seq);
+  sizes = [];
+
+  for await(let rows of res.batches(64)) sizes.push(rows.length);
+
+  if(sizes.join() != '64,64,64,58') throw new Error(`batches(64) yielded batches of ${sizes}`);
+}
+
+async function StatsTest(my) {
+  const records = [];
+
+  /* setting a hook turns collection on */
+  my.onQueryStats = record => records.push(record);
+  my.resetStats();
+
+  if(!my.collectStats) throw new Error('onQueryStats did not enable collectStats');
+
+  /* a SELECT ends with its last row */
+  for await(let row of await my.query(`SELECT 1 UNION ALL SELECT 2 UNION ALL SELECT 3;`));
+
+  await my.query(`SELECT * FROM no_such_table;`).catch(e => e);
+
+  if(records.length != 2 || records[0].rows != 3 || records[0].error || !records[1].error) throw new Error(`onQueryStats records ${JSON.stringify(records)}`);
+  if(!(records[0].bytesSent > 0) || !(records[0].lastRow >= records[0].firstByte)) throw new Error(`onQueryStats record ${JSON.stringify(records[0])}`);
+
+  const { queries, errors, rows, histogram } = my.stats;
+
+  if(queries != 2 || errors != 1 || rows != 3) throw new Error(`stats queries/errors/rows = ${queries}/${errors}/${rows}`);
+  if(histogram.reduce((a, n) => a + n, 0) != 2) throw new Error(`stats histogram ${histogram}`);
+
+  my.resetStats();
+
+  if(my.stats.queries != 0) throw new Error('resetStats() kept the totals');
+
+  my.onQueryStats = null;
+  my.collectStats = false;
+
+  if(my.stats !== null) throw new Error('stats without collectStats');
+}
+
+async function PoolTest() {
+  const pool = new MySQLPool({ min: 1, max: 2, idleTimeout: 1000 }, '192.168.178.23', 'roman', 'r4eHuJ', 'web');
+
+  if(pool.min != 1 || pool.max != 2) throw new Error(`MySQLPool min/max = ${pool.min}/${pool.max}`);
+
+  const a = await pool.acquire();
+  const b = await pool.acquire();
+
+  if(!(a instanceof MySQL) || a === b) throw new Error('MySQLPool.acquire() did not return two connections');
+  if(pool.size != 2 || pool.idle != 0) throw new Error(`MySQLPool size/idle = ${pool.size}/${pool.idle}`);
+
+  /* the pool is full, so the next caller waits for a release */
+  const waiter = pool.acquire();
+
+  if(pool.waiting != 1) throw new Error(`MySQLPool.waiting = ${pool.waiting}`);
+
+  pool.release(a);
+
+  const c = await waiter;
+
+  if(c !== a || pool.waiting != 0) throw new Error('MySQLPool did not hand the released connection to the waiter');
+
+  let rows = [];
+
+  for await(let row of await c.query(`SELECT 1 + 1;`)) rows.push(row);
+
+  console.log('pool query =', rows);
+  if(rows.length != 1) throw new Error(`MySQLPool connection query returned ${rows.length} rows`);
+
+  pool.release(b);
+  pool.release(c);
+
+  if(pool.idle != 2) throw new Error(`MySQLPool.idle = ${pool.idle}`);
+
+  const { acquired, waitTime, maxWait } = pool.stats;
+
+  if(acquired != 3 || maxWait > waitTime) throw new Error(`MySQLPool.stats = ${JSON.stringify(pool.stats)}`);
+
+  let error;
+
+  try {
+    pool.release(new MySQL());
+  } catch(e) {
+    error = e;
+  }
+
+  if(!(error instanceof TypeError)) throw new Error('MySQLPool.release() accepted a foreign connection');
+
+  pool.close();
+  error = undefined;
+
+  try {
+    await pool.acquire();
+  } catch(e) {
+    error = e;
+  }
+
+  if(!error) throw new Error('MySQLPool.acquire() succeeded after close()');
+}
+
 try {
   main(...scriptArgs.slice(1)).catch(err => console.log(`FAIL: ${err.message}\n${err.stack}`));
 } catch(error) {
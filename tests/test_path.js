@@ -117,6 +117,19 @@ tests({
   'realpath()'() {
     eq(path.realpath('/proc/self/cwd'), path.getcwd());
   },
+  'cacheEnable()'() {
+    assert(path.cacheEnable(16));
+    eq(path.realpath('/proc/self/cwd'), path.getcwd());
+    eq(path.realpath('/proc/self/cwd'), path.getcwd());
+    eq(path.realpath('/nonexistent/file'), null);
+    eq(path.realpath('/nonexistent/file'), null);
+    eq(path.cacheStats().hits, 2);
+    eq(path.cacheStats().size, 2);
+    eq(path.cacheInvalidate('/proc/self'), 1);
+    path.cacheClear();
+    eq(path.cacheStats().size, 0);
+    assert(path.cacheEnable(0));
+  },
   'at()'() {
     eq(path.at('////tmp////other//..//test', 0), '');
     eq(path.at('////tmp////other//..//test', 1), 'tmp');
@@ -191,6 +204,33 @@ tests({
     eq(path.toArray('/tmp/test.obj').join('/'), '/tmp/test.obj');
     eq(path.toArray('./../../..') + '', '.,..,..,..');
   },
+  'statMany()'() {
+    const { mode, size, mtime, error } = path.statMany(['/', '/nonexistent', '/proc/self/cwd']);
+    assert(path.isDirectory('/') && (mode[0] & 0o170000) == 0o040000);
+    assert(error[0] == 0 && error[1] != 0 && mode[1] == 0);
+    assert(size instanceof Float64Array && mtime[0] > 0);
+    const only = path.statMany({ names: ['tests'] }, path.STAT_MODE, false);
+    eq(Object.keys(only).sort().join(','), 'error,mode');
+  },
+  'compileGlob()'() {
+    const match = path.compileGlob('src/**/*.[ch]');
+    assert(match('src/path.c'));
+    assert(match('src/a/b/path.h'));
+    assert(!match('src/path.js'));
+    assert(!match('include/path.h'));
+    assert(!path.compileGlob('*')('.hidden'));
+    assert(path.compileGlob('*', 0)('.hidden'));
+  },
+  async 'globIterate()'() {
+    for(let threads of [1, 4]) {
+      const found = [];
+      for await(let file of path.globIterate('.', ['tests/test_p*.js', 'include/path.h'], { threads })) found.push(file);
+      found.sort();
+      assert(found.indexOf('tests/test_path.js') != -1);
+      assert(found.indexOf('include/path.h') != -1);
+      assert(found.every(f => /^(tests\/test_p.*\.js|include\/path\.h)$/.test(f)));
+    }
+  },
   'offsets()'() {},
   'lengths()'() {},
   'ranges()'() {}
@@ -0,0 +1,62 @@
+import { clear, counters, entries, mark, measure, now, trace, tracing } from 'perf';
+import { read as xmlRead } from 'xml';
+import * as std from 'std';
+
+function main() {
+  let t = now();
+
+  if(typeof t != 'number' || !(t >= 0)) throw new Error(`now() returned ${t}`);
+
+  mark('a');
+  for(let i = 0, n = 0; i < 100000; i++) n += i;
+  mark('b');
+
+  let d = measure('a-b', 'a', 'b');
+
+  if(!(d >= 0)) throw new Error(`measure() returned ${d}`);
+
+  let marks = entries('mark'),
+    measures = entries('measure');
+
+  if(marks.map(e => e.name).join(',') != 'a,b') throw new Error(`entries('mark'): ${JSON.stringify(marks)}`);
+  if(measures.length != 1 || measures[0].name != 'a-b' || measures[0].duration != d) throw new Error(`entries('measure'): ${JSON.stringify(measures)}`);
+  if(measures[0].startTime != marks[0].startTime) throw new Error('measure() did not start at its mark');
+
+  clear('mark');
+
+  if(entries('mark').length != 0 || entries().length != 1) throw new Error('clear(\'mark\') removed the wrong entries');
+
+  clear();
+  trace('xml');
+
+  if(tracing().join(',') != 'xml') throw new Error(`tracing(): ${tracing()}`);
+
+  xmlRead('<a><b/></a>');
+  trace('all', false);
+  xmlRead('<a/>');
+
+  let traces = entries('trace');
+
+  if(traces.length != 1 || traces[0].name != 'xml' || traces[0].value != 11) throw new Error(`entries('trace'): ${JSON.stringify(traces)}`);
+  if(tracing().length != 0) throw new Error(`trace('all', false) left ${tracing()}`);
+
+  /* perf_event_open() may be disabled by perf_event_paranoid or seccomp */
+  try {
+    let c = counters(() => {
+      for(let i = 0, n = 0; i < 100000; i++) n += i;
+    }, ['instructions']);
+
+    if(!(c.instructions > 0)) throw new Error(`counters(): ${JSON.stringify(c)}`);
+  } catch(error) {
+    if(!(error instanceof InternalError)) throw error;
+    console.log(`counters() unavailable: ${error.message}`);
+  }
+}
+
+try {
+  main();
+  console.log('SUCCESS');
+} catch(error) {
+  console.log(`FAIL: ${error.message}\n${error.stack}`);
+  std.exit(1);
+}
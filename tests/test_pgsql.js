@@ -1,7 +1,7 @@
 import { abbreviate, randStr, startInteractive } from 'util';
 import extendArray from '../lib/extendArray.js';
 import { Console } from 'console';
-import { PGconn, PGresult } from 'pgsql';
+import { PGconn, PGpool, PGresult } from 'pgsql';
 import { exit } from 'std';
 extendArray();
 
@@ -93,9 +93,285 @@ async function main(...args) {
   console.log('pq.affectedRows =', pq.affectedRows);
   console.log('id =', (id = pq.insertId));
 
+  const notifications = pq.notifications();
+
+  await q(`LISTEN test_channel`);
+  await q(`NOTIFY test_channel, 'hello'`);
+
+  const { value: note } = await notifications.next();
+  console.log('notification =', note);
+
+  if(note.channel != 'test_channel' || note.payload != 'hello') throw new Error(`notifications(): ${JSON.stringify(note)}`);
+
+  await notifications.return();
+
+  await PreparedTest(pq);
+  await CopyTest(pq);
+  await ColumnsTest(pq);
+  await BinaryTest(pq);
+  await StatsTest(pq);
+  await PipelineTest(pq);
+  await PoolTest();
+
   startInteractive();
 }
 
+async function PreparedTest(pq) {
+  if(pq.statementCacheSize != 32) throw new Error(`statementCacheSize = ${pq.statementCacheSize}`);
+
+  const sql = `SELECT $1::int + $2::int;`;
+  const st = await pq.prepare(sql);
+
+  if(st.sql != sql || !st.cached) throw new Error(`prepare() returned ${st.sql} (cached ${st.cached})`);
+
+  const [row] = [...(await st.execute(2, 3))];
+
+  if(row[0] != 5) throw new Error(`PGstatement.execute(2, 3) returned ${row}`);
+
+  /* the second prepare() of the same text comes from the cache */
+  if((await pq.prepare(sql)).name != st.name) throw new Error('prepare() did not reuse the cached statement');
+
+  const [concat] = [...(await pq.query(`SELECT $1::text || $2::text;`, ['a', 'b']))];
+
+  if(concat[0] != 'ab') throw new Error(`query(sql, params) returned ${concat}`);
+
+  pq.statementCacheSize = 0;
+
+  const uncached = await pq.prepare(sql);
+
+  if(uncached.cached || uncached.name == st.name) throw new Error('prepare() cached a statement with statementCacheSize = 0');
+
+  const [again] = [...(await uncached.execute(4, 5))];
+
+  if(again[0] != 9) throw new Error(`uncached execute(4, 5) returned ${again}`);
+
+  pq.statementCacheSize = 32;
+}
+
+async function CopyTest(pq) {
+  const lines = ['1\tone\n', '2\ttwo\n', '3\tthree\n'];
+
+  await pq.query(`CREATE TEMPORARY TABLE copy_test (id integer, name text);`);
+
+  const writer = pq.copyFrom(`COPY copy_test FROM STDIN;`).getWriter();
+
+  for(const line of lines) await writer.write(line);
+
+  const copied = await writer.close();
+
+  if(copied != lines.length) throw new Error(`copyFrom() close() resolved with ${copied}`);
+
+  const reader = pq.copyTo(`COPY (SELECT * FROM copy_test ORDER BY id) TO STDOUT;`).getReader();
+  let text = '',
+    chunks = 0,
+    chunk;
+
+  while(!(chunk = await reader.read()).done) {
+    if(!(chunk.value instanceof ArrayBuffer)) throw new Error(`copyTo() chunk is a ${typeof chunk.value}`);
+
+    text += String.fromCharCode(...new Uint8Array(chunk.value));
+    chunks++;
+  }
+
+  if(text != lines.join('') || chunks != lines.length) throw new Error(`copyTo() returned ${chunks} chunks: ${JSON.stringify(text)}`);
+
+  /* an aborted COPY FROM leaves the table unchanged */
+  const aborted = pq.copyFrom(`COPY copy_test FROM STDIN;`).getWriter();
+
+  await aborted.write('4\tfour\n');
+  await aborted.abort('test abort').catch(e => e);
+
+  const [count] = [...(await pq.query(`SELECT count(*) FROM copy_test;`))];
+
+  if(count[0] != lines.length) throw new Error(`copy_test has ${count[0]} rows after abort()`);
+
+  await pq.query(`DROP TABLE copy_test;`);
+}
+
+async function ColumnsTest(pq) {
+  const res = await pq.query(`SELECT * FROM (VALUES (1, 10000000000::int8, 1.5::float8, true, 'ab'), (NULL, -2, 2.5, false, 'cde')) AS t(i, b, f, ok, s);`);
+  const columns = res.fetchColumns();
+  const [i, b, f, ok, s] = columns;
+  const types = columns.map(c => `${c.name}:${c.type}`).join();
+
+  if(types != 'i:int32,b:int64,f:float64,ok:bool,s:string') throw new Error(`fetchColumns() types ${types}`);
+  if(!columns.every(c => c.length == 2)) throw new Error(`fetchColumns() lengths ${columns.map(c => c.length)}`);
+
+  if(!(i.values instanceof Int32Array) || i.values[0] != 1 || i.nullCount != 1 || i.validity[0] != 0b01) throw new Error(`fetchColumns() int4 column ${JSON.stringify(i)}`);
+  if(!(b.values instanceof BigInt64Array) || b.values[0] != 10000000000n || b.values[1] != -2n) throw new Error('fetchColumns() int8 column');
+  if(!(f.values instanceof Float64Array) || f.values[1] != 2.5) throw new Error('fetchColumns() float8 column');
+  if(!(ok.values instanceof Uint8Array) || ok.values[0] != 1 || ok.values[1] != 0) throw new Error('fetchColumns() bool column');
+
+  /* strings share one byte buffer, row n is values[offsets[n]..offsets[n + 1]] */
+  if(!(s.offsets instanceof Uint32Array) || [...s.offsets].join() != '0,2,5') throw new Error(`fetchColumns() string offsets ${s.offsets}`);
+  if(String.fromCharCode(...s.values) != 'abcde' || s.nullCount != 0 || s.validity[0] != 0b11) throw new Error('fetchColumns() string column');
+
+  if(res.fetchRow()) throw new Error('fetchColumns() did not consume the rows');
+}
+
+async function BinaryTest(pq) {
+  pq.resultFormat = 'binary';
+
+  if(pq.resultFormat != 'binary') throw new Error(`resultFormat = ${pq.resultFormat}`);
+
+  const [row] = [
+    ...(await pq.query(`SELECT 7::int2, 70000::int4, 9007199254740993::int8, 1.25::float8, -12.5::numeric, true, '\\x0102'::bytea,
+  '2020-01-02'::date, '2020-01-02 03:04:05.678Z'::timestamptz, 'infinity'::timestamp, '-infinity'::date,
+  'a0eebc99-9c0b-4ef8-bb6d-6bb9bd380a11'::uuid, '{"a": [1, 2]}'::jsonb, ARRAY[[1, 2], [3, NULL]]::int4[];`))
+  ];
+
+  pq.resultFormat = 'text';
+
+  const [int2, int4, int8, float8, numeric, bool, bytea, date, timestamptz, infinite, negInfinite, uuid, jsonb, array] = row;
+
+  if(int2 !== 7 || int4 !== 70000 || int8 !== 9007199254740993n) throw new Error(`binary integers ${int2}, ${int4}, ${int8}`);
+  if(float8 !== 1.25 || numeric !== -12.5 || bool !== true) throw new Error(`binary float/numeric/bool ${float8}, ${numeric}, ${bool}`);
+  if(!(bytea instanceof ArrayBuffer) || [...new Uint8Array(bytea)].join() != '1,2') throw new Error('binary bytea');
+  if(!(date instanceof Date) || date.getTime() != Date.UTC(2020, 0, 2)) throw new Error(`binary date ${date}`);
+  if(!(timestamptz instanceof Date) || timestamptz.toISOString() != '2020-01-02T03:04:05.678Z') throw new Error(`binary timestamptz ${timestamptz}`);
+
+  /* infinite dates and timestamps become invalid Dates */
+  for(const d of [infinite, negInfinite]) if(!(d instanceof Date) || !isNaN(d.getTime())) throw new Error(`binary infinity ${d}`);
+
+  if(uuid != 'a0eebc99-9c0b-4ef8-bb6d-6bb9bd380a11') throw new Error(`binary uuid ${uuid}`);
+  if(JSON.stringify(jsonb) != '{"a":[1,2]}') throw new Error(`binary jsonb ${JSON.stringify(jsonb)}`);
+  if(JSON.stringify(array) != '[[1,2],[3,null]]') throw new Error(`binary int4[] ${JSON.stringify(array)}`);
+}
+
+async function StatsTest(pq) {
+  const records = [];
+
+  /* setting a hook turns collection on */
+  pq.onQueryStats = record => records.push(record);
+  pq.resetStats();
+
+  if(!pq.collectStats) throw new Error('onQueryStats did not enable collectStats');
+
+  await pq.query(`SELECT generate_series(1, 3);`);
+  await pq.query(`SELECT 1 / 0;`).catch(e => e);
+
+  if(records.length != 2 || records[0].rows != 3 || records[0].error || !records[1].error) throw new Error(`onQueryStats records ${JSON.stringify(records)}`);
+  if(!(records[0].bytesSent > 0) || !(records[0].lastRow >= records[0].firstByte)) throw new Error(`onQueryStats record ${JSON.stringify(records[0])}`);
+
+  const { queries, errors, rows, histogram } = pq.stats;
+
+  if(queries != 2 || errors != 1 || rows != 3) throw new Error(`stats queries/errors/rows = ${queries}/${errors}/${rows}`);
+  if(histogram.reduce((a, n) => a + n, 0) != 2) throw new Error(`stats histogram ${histogram}`);
+
+  pq.resetStats();
+
+  if(pq.stats.queries != 0) throw new Error('resetStats() kept the totals');
+
+  pq.onQueryStats = null;
+  pq.collectStats = false;
+
+  if(pq.stats !== null) throw new Error('stats without collectStats');
+}
+
+async function PipelineTest(pq) {
+  try {
+    pq.enterPipeline();
+  } catch(e) {
+    console.log('pipeline mode unavailable:', e.message);
+    return;
+  }
+
+  if(pq.pipelineStatus != PGconn.PIPELINE_ON) throw new Error(`pipelineStatus = ${pq.pipelineStatus}`);
+
+  const queries = [1, 2, 3].map(n => pq.query(`SELECT ${n} * 10;`));
+  const failing = pq.query(`SELECT 1 / 0;`).catch(e => e);
+  const skipped = pq.query(`SELECT 4;`).catch(e => e);
+  const synced = pq.pipelineSync();
+
+  let error;
+
+  try {
+    pq.exitPipeline();
+  } catch(e) {
+    error = e;
+  }
+
+  if(!error) throw new Error('exitPipeline() succeeded with pending results');
+
+  /* results arrive in the order the queries were sent */
+  for(let i = 0; i < queries.length; i++) {
+    const [row] = [...(await queries[i])];
+
+    if(row[0] != (i + 1) * 10) throw new Error(`pipelined query ${i} returned ${row}`);
+  }
+
+  if(!((await failing) instanceof Error)) throw new Error('a failing pipelined query resolved');
+  if(!((await skipped) instanceof Error)) throw new Error('a query after the error was not skipped');
+  if((await synced) !== true) throw new Error('pipelineSync() did not resolve with true');
+
+  /* the sync point ends the aborted state */
+  const [row] = [...(await Promise.all([pq.query(`SELECT 5;`), pq.pipelineSync()]))[0]];
+
+  if(row[0] != 5) throw new Error(`query after the sync point returned ${row}`);
+
+  pq.exitPipeline();
+
+  if(pq.pipelineStatus != PGconn.PIPELINE_OFF) throw new Error(`pipelineStatus after exitPipeline() = ${pq.pipelineStatus}`);
+}
+
+async function PoolTest() {
+  const pool = new PGpool({ min: 1, max: 2, idleTimeout: 1000 }, 'localhost', 'roman', 'r4eHuJ', 'roman', 5432, 10);
+
+  if(pool.min != 1 || pool.max != 2) throw new Error(`PGpool min/max = ${pool.min}/${pool.max}`);
+
+  const a = await pool.acquire();
+  const b = await pool.acquire();
+
+  if(!(a instanceof PGconn) || a === b) throw new Error('PGpool.acquire() did not return two connections');
+  if(pool.size != 2 || pool.idle != 0) throw new Error(`PGpool size/idle = ${pool.size}/${pool.idle}`);
+
+  /* the pool is full, so the next caller waits for a release */
+  const waiter = pool.acquire();
+
+  if(pool.waiting != 1) throw new Error(`PGpool.waiting = ${pool.waiting}`);
+
+  pool.release(a);
+
+  const c = await waiter;
+
+  if(c !== a || pool.waiting != 0) throw new Error('PGpool did not hand the released connection to the waiter');
+
+  const [row] = [...(await c.query(`SELECT 1 + 1;`))];
+
+  console.log('pool query =', row);
+  if(row[0] != 2) throw new Error(`PGpool connection query returned ${row}`);
+
+  pool.release(b);
+  pool.release(c);
+
+  if(pool.idle != 2) throw new Error(`PGpool.idle = ${pool.idle}`);
+
+  const { acquired, waitTime, maxWait } = pool.stats;
+
+  if(acquired != 3 || maxWait > waitTime) throw new Error(`PGpool.stats = ${JSON.stringify(pool.stats)}`);
+
+  let error;
+
+  try {
+    pool.release(new PGconn());
+  } catch(e) {
+    error = e;
+  }
+
+  if(!(error instanceof TypeError)) throw new Error('PGpool.release() accepted a foreign connection');
+
+  pool.close();
+  error = undefined;
+
+  try {
+    await pool.acquire();
+  } catch(e) {
+    error = e;
+  }
+
+  if(!error) throw new Error('PGpool.acquire() succeeded after close()');
+}
+
 try {
   main(...scriptArgs.slice(1)).catch(err => console.log(`FAIL: ${err.message}\n${err.stack}`));
 } catch(error) {
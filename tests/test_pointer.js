@@ -1,6 +1,6 @@
 import Console from '../lib/console.js';
 import inspect from 'inspect';
-import { Pointer } from 'pointer';
+import { Pointer, PointerSet } from 'pointer';
 import * as std from 'std';
 import * as xml from 'xml';
 
@@ -67,6 +67,17 @@ function main(...args) {
 
   console.log('deref ptr2:', ptr2.deref(result));
   console.log('dump ptr2:', ptr2);
+
+  let doc = { list: [{ a: 1, b: { c: 2 } }, { a: 3, b: { c: 4 } }], x: 'y' };
+  let deref = new Pointer('b.c').compile();
+
+  if(doc.list.map(item => deref(item)).join() != '2,4') throw new Error('Pointer.compile() dereferenced wrong values');
+
+  let set = new PointerSet(['list[0].a', 'list[1].b.c', 'list[0].missing.c', 'x']);
+  let values = set.deref(doc);
+
+  if(set.size != 4 || values.length != 4 || values[0] != 1 || values[1] != 4 || values[2] !== undefined || values[3] != 'y')
+    throw new Error(`PointerSet.deref() = ${values}`);
   std.gc();
 }
 
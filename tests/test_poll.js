@@ -0,0 +1,35 @@
+import * as os from 'os';
+import { POLLIN, POLLOUT, poll } from 'sockets';
+import { assert, eq, tests } from './tinytest.js';
+
+tests({
+  'poll() in place'() {
+    const [rfd, wfd] = os.pipe();
+    const pfds = new Int32Array(4);
+    const revents = i => new Int16Array(pfds.buffer)[i * 4 + 3];
+
+    pfds.set([rfd, POLLIN, wfd, POLLOUT]);
+
+    eq(poll(pfds.buffer, 2, 0), 1);
+    eq(revents(0), 0);
+    assert(revents(1) & POLLOUT);
+
+    os.write(wfd, new Uint8Array([1]).buffer, 0, 1);
+
+    eq(poll(pfds, 0, 0), 2);
+    assert(revents(0) & POLLIN);
+
+    os.close(rfd);
+    os.close(wfd);
+  },
+  'poll() array'() {
+    const [rfd, wfd] = os.pipe();
+    const pfds = [{ fd: wfd, events: POLLOUT }];
+
+    eq(poll(pfds, 1, 0), 1);
+    assert(pfds[0].revents & POLLOUT);
+
+    os.close(rfd);
+    os.close(wfd);
+  }
+});
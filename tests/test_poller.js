@@ -0,0 +1,46 @@
+import * as os from 'os';
+import { Poller, POLLIN, POLLOUT } from 'sockets';
+import { assert, eq, tests } from './tinytest.js';
+
+tests({
+  'Poller level-triggered'() {
+    const [rfd, wfd] = os.pipe();
+    const poller = new Poller({ maxEvents: 8 });
+
+    poller.add(rfd, POLLIN);
+    poller.add(wfd, POLLOUT);
+    eq(poller.size, 2);
+
+    eq(poller.wait(0), 1);
+    eq(poller.ready[0], wfd);
+    assert(poller.ready[1] & POLLOUT);
+
+    os.write(wfd, new Uint8Array([1]).buffer, 0, 1);
+    poller.remove(wfd);
+
+    eq(poller.wait(0), 1);
+    eq(poller.ready[0], rfd);
+    assert(poller.ready[1] & POLLIN);
+    eq(poller.wait(0), 1);
+
+    poller.close();
+    os.close(rfd);
+    os.close(wfd);
+  },
+  'Poller edge-triggered'() {
+    const [rfd, wfd] = os.pipe();
+    const poller = new Poller({ edge: true });
+
+    if(poller.backend == 'poll') return poller.close();
+
+    poller.add(rfd, POLLIN);
+    os.write(wfd, new Uint8Array([1]).buffer, 0, 1);
+
+    eq(poller.wait(0), 1);
+    eq(poller.wait(0), 0);
+
+    poller.close();
+    os.close(rfd);
+    os.close(wfd);
+  }
+});
@@ -207,6 +207,37 @@ async function main(...args) {
   console.log('add(20)', add(20));
   console.log('term(19)', term(19));
 
+  let compiled = Predicate.mod(Predicate.add(Predicate.div(Predicate.mul(null, 8), 0.5), 5), 2).compile();
+  for(let n of [18, 19, 20]) if(compiled(n) !== term(n)) throw new Error(`compiled(${n}) = ${compiled(n)}, expected ${term(n)}`);
+
+  let folded = Predicate.or(Predicate.not(Predicate.property('x', Predicate.equal(1))), Predicate.and(Predicate.add(1, 2), Predicate.type(Predicate.TYPE_OBJECT))).compile();
+  console.log('folded({ x: 1 })', folded({ x: 1 }));
+  console.log('folded({ x: 2 })', folded({ x: 2 }));
+
+  let cs = Predicate.charset('ABCDEFGHIJKLMNOPQRSTUVWXYZ★⦿❔');
+  for(let [s, r] of [['ABC★', 1], ['X⦿Y', 1], ['❔X', 1], ['abcd', 0], ['A☆', 0]])
+    if(cs(s) !== r) throw new Error(`charset(${s}) = ${cs(s)}`);
+
+  /* predicates with the same expression share bytecode, which must outlive any one of them */
+  let shared = [Predicate.regexp('^a+b$'), Predicate.regexp('^a+b$')];
+  for(let p of shared) if(p('aab') !== true) throw new Error(`regexp('^a+b$')('aab') = ${p('aab')}`);
+
+  shared.shift();
+  std.gc();
+  if(shared[0]('aaab') !== true || shared[0]('ba') !== false) throw new Error('shared regexp broken after a reference was dropped');
+
+  /* push the released entries out of the idle list */
+  for(let i = 0; i < 300; i++) if(Predicate.regexp(`^x{${i}}$`)('x'.repeat(i)) !== true) throw new Error(`regexp('^x{${i}}$')`);
+  std.gc();
+  if(shared[0]('ab') !== true || Predicate.regexp('^a+b$')('b') !== false) throw new Error('shared regexp broken after idle entries were evicted');
+
+  let values = new Float64Array([18, 19, 20, 21, 22.5]);
+  let odd = Predicate.mod(null, 2);
+  console.log('odd.filter(values)', odd.filter(values));
+  console.log('odd.mask(values)', odd.mask(values));
+  if(odd.count(values) !== values.filter(n => n % 2).length) throw new Error(`odd.count(values) = ${odd.count(values)}`);
+  if(odd.count([...values]) !== odd.count(values)) throw new Error('odd.count() differs between Array and Float64Array');
+
   let pred = 2 ** mul;
   console.log('pred.toString()', pred.toString());
   console.log('pred', pred);
@@ -0,0 +1,36 @@
+import { collapsed, isRunning, reset, samples, start, stop } from 'profiler';
+import * as std from 'std';
+
+function busy(ms) {
+  let t = Date.now(),
+    n = 0;
+  while(Date.now() - t < ms) n += Math.sqrt(n + 1);
+  return n;
+}
+
+function main() {
+  start({ hz: 1000 });
+
+  if(!isRunning()) throw new Error('start() did not start the profiler');
+
+  busy(300);
+  stop();
+
+  let text = collapsed();
+
+  if(isRunning() || samples() == 0) throw new Error(`profiler took ${samples()} samples`);
+  if(!/busy \(.*test_profiler\.js:\d+\)/.test(text)) throw new Error(`collapsed() lacks busy():\n${text}`);
+  if(!text.split('\n').every(line => line == '' || /^\S.* \d+$/.test(line))) throw new Error(`collapsed() format:\n${text}`);
+
+  reset();
+
+  if(samples() != 0 || collapsed() != '') throw new Error('reset() kept samples');
+}
+
+try {
+  main();
+  console.log('SUCCESS');
+} catch(error) {
+  console.log(`FAIL: ${error.message}\n${error.stack}`);
+  std.exit(1);
+}
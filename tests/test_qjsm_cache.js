@@ -0,0 +1,192 @@
+import * as os from 'os';
+import * as std from 'std';
+import { require } from '../lib/require.js';
+
+const base = `/tmp/test_qjsm_cache.${os.getpid?.() ?? Date.now()}`;
+const [exe] = os.readlink('/proc/self/exe');
+
+function assert(cond, msg) {
+  if(!cond) throw new Error('assertion failed: ' + msg);
+}
+
+function WriteFile(file, data) {
+  const f = std.open(file, 'w');
+  f.puts(data);
+  f.close();
+}
+
+const quote = s => `'${s.replace(/'/g, `'\\''`)}'`;
+
+/* runs qjsm with args, returns stdout and stderr */
+function Run(args, env = '') {
+  const f = std.popen(`${env} ${quote(exe)} ${args.map(quote).join(' ')} 2>&1`, 'r');
+  const out = f.readAsString();
+
+  f.close();
+  return out;
+}
+
+function Entries(dir) {
+  const [names = []] = os.readdir(dir);
+
+  return names.filter(name => name.endsWith('.jsbc'));
+}
+
+const inode = file => os.stat(file)[0]?.ino;
+
+function TestModuleCache() {
+  const dir = `${base}/modules`,
+    cache = `${base}/cache`;
+
+  os.mkdir(dir, 0o755);
+  WriteFile(`${dir}/lib.js`, `export const value = 'one';\n`);
+  WriteFile(`${dir}/main.js`, `import * as std from 'std';\nimport { value } from './lib.js';\nstd.puts(value + '\\n');\n`);
+
+  assert(Run(['--cache-dir', cache, `${dir}/main.js`]) == 'one\n', 'first run');
+
+  /* lib.js is cached, the main script isn't */
+  const entries = Entries(cache);
+
+  assert(entries.length == 1, `${entries.length} cache entries`);
+
+  const entry = `${cache}/${entries[0]}`,
+    ino = inode(entry);
+
+  assert(Run(['--cache-dir', cache, `${dir}/main.js`]) == 'one\n', 'run from the cache');
+  assert(inode(entry) == ino, 'a cache hit rewrote the entry');
+
+  /* a changed source is compiled again */
+  WriteFile(`${dir}/lib.js`, `export const value = 'changed';\n`);
+
+  assert(Run(['--cache-dir', cache, `${dir}/main.js`]) == 'changed\n', 'run after a source change');
+  assert(inode(entry) != ino, 'a stale entry was not replaced');
+
+  /* bytecode that fails to load is a miss */
+  WriteFile(entry, 'garbage');
+
+  assert(Run(['--cache-dir', cache, `${dir}/main.js`]) == 'changed\n', 'run with a corrupt entry');
+  assert(os.stat(entry)[0].size > 7, 'a corrupt entry was not replaced');
+
+  /* $QJSM_CACHE_DIR does the same as --cache-dir */
+  const envCache = `${base}/envcache`;
+
+  assert(Run([`${dir}/main.js`], `QJSM_CACHE_DIR=${quote(envCache)}`) == 'changed\n', 'run with $QJSM_CACHE_DIR');
+  assert(Entries(envCache).length == 1, '$QJSM_CACHE_DIR has no entry');
+
+  assert(Run(['--cache-dir']) == 'expecting cache directory\n', '--cache-dir without a directory');
+}
+
+/* process and console are accessors until first use */
+function TestLazyGlobals() {
+  const script = `${base}/lazy.js`;
+
+  WriteFile(
+    script,
+    `import * as std from 'std';
+const accessor = name => typeof Object.getOwnPropertyDescriptor(globalThis, name).get == 'function';
+const before = [accessor('process'), accessor('console')];
+const arch = typeof process.arch;
+
+globalThis.console = { log: (...args) => std.puts('own ' + args.join(' ') + '\\n') };
+console.log(before.join(), arch, accessor('process'), accessor('console'));
+`
+  );
+
+  const out = Run([script]);
+
+  assert(out == 'own true,true string false false\n', `lazy globals: ${JSON.stringify(out)}`);
+}
+
+function TestResolveCache() {
+  const dir = `${base}/resolve`,
+    cache = `${base}/resolvecache`;
+
+  os.mkdir(dir, 0o755);
+
+  /* negative lookups are persisted, but a change of the directory invalidates them */
+  WriteFile(`${dir}/main.js`, `import * as std from 'std';\nimport('./late.js').then(m => std.puts(m.value + '\\n'), () => std.puts('missing\\n'));\n`);
+
+  assert(Run(['--cache-dir', cache, `${dir}/main.js`]) == 'missing\n', 'import of a missing module');
+
+  const lines = std.loadFile(`${cache}/resolve.cache`)?.split('\n') ?? [];
+
+  assert(lines[0] == `qjsm-resolve 1 ${os.getcwd()[0]}`, `resolve.cache header ${lines[0]}`);
+  assert(lines.some(line => line.startsWith('s -1 ') && line.endsWith(`${dir}/late.js`)), 'resolve.cache lacks the negative lookup');
+
+  WriteFile(`${dir}/late.js`, `export const value = 'late';\n`);
+
+  assert(Run(['--cache-dir', cache, `${dir}/main.js`]) == 'late\n', 'import after the module was created');
+
+  /* within a run a miss is remembered until clearResolveCache() */
+  const later = `${dir}/later.js`;
+
+  WriteFile(
+    `${dir}/runtime.js`,
+    `import * as std from 'std';
+const load = () => import(${JSON.stringify(later)}).then(m => m.value, () => 'missing');
+
+(async () => {
+  const first = await load();
+  const f = std.open(${JSON.stringify(later)}, 'w');
+
+  f.puts("export const value = 'later';\\n");
+  f.close();
+
+  const stale = await load();
+
+  clearResolveCache();
+  std.puts([first, stale, await load()].join(' ') + '\\n');
+})();
+`
+  );
+
+  const out = Run([`${dir}/runtime.js`]);
+
+  assert(out == 'missing missing later\n', `clearResolveCache(): ${JSON.stringify(out)}`);
+}
+
+/* lib/require.js memoizes its lookups the same way */
+function TestRequire() {
+  const file = `${base}/data.json`;
+  let error;
+
+  try {
+    require(file);
+  } catch(e) {
+    error = e;
+  }
+
+  assert(error, 'require() of a missing file');
+
+  WriteFile(file, '{ "n": 1 }');
+  error = undefined;
+
+  try {
+    require(file);
+  } catch(e) {
+    error = e;
+  }
+
+  assert(error, 'require() forgot the failed lookup');
+
+  require.clearResolveCache();
+
+  assert(require(file).n === 1, 'require() after clearResolveCache()');
+}
+
+function main() {
+  os.mkdir(base, 0o755);
+
+  TestModuleCache();
+  TestLazyGlobals();
+  TestResolveCache();
+  TestRequire();
+}
+
+try {
+  main();
+  console.log('SUCCESS');
+} catch(error) {
+  console.log(`FAIL: ${error.message}\n${error.stack}`);
+  std.exit(1);
+}
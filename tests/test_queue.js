@@ -0,0 +1,135 @@
+import * as os from 'os';
+import { Queue } from 'queue';
+import { AF_UNIX, EAGAIN, SOCK_STREAM, Socket, socketpair } from 'sockets';
+import { assert, eq, tests } from './tinytest.js';
+
+function Pattern(size, start = 0) {
+  const a = new Uint8Array(size);
+
+  for(let i = 0; i < size; i++) a[i] = (start + i) * 7 & 0xff;
+
+  return a;
+}
+
+function Contents(q) {
+  const buf = new ArrayBuffer(q.size);
+
+  eq(q.read(buf), buf.byteLength);
+  return new Uint8Array(buf);
+}
+
+function Same(a, b) {
+  if(a.length != b.length) return false;
+
+  for(let i = 0; i < a.length; i++) if(a[i] != b[i]) return false;
+
+  return true;
+}
+
+tests({
+  'writeTo() / readFrom() through a pipe'() {
+    const [rfd, wfd] = os.pipe();
+    const q = new Queue(),
+      out = new Queue();
+
+    for(let pos = 0; pos < 3000; pos += 300) q.write(Pattern(300, pos));
+
+    eq(q.writeTo(wfd, 1000), 1000);
+    eq(q.size, 2000);
+    eq(q.writeTo(wfd), 2000);
+    eq(q.empty, true);
+    os.close(wfd);
+
+    let n;
+
+    while((n = out.readFrom(rfd)) > 0);
+
+    eq(n, 0);
+    os.close(rfd);
+    assert(Same(Contents(out), Pattern(3000)), 'contents differ after the round-trip');
+  },
+  'partial writes and EAGAIN'() {
+    const fds = [];
+
+    eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    const [a, b] = fds.map(fd => Socket.adopt(fd));
+    const size = 1 << 22,
+      q = new Queue(),
+      out = new Queue();
+
+    a.nonblock = b.nonblock = true;
+
+    for(let pos = 0; pos < size; pos += 3000) q.write(Pattern(Math.min(3000, size - pos), pos));
+
+    let r,
+      partial = false,
+      blocked = false;
+
+    while(!q.empty) {
+      let before;
+
+      /* write until the socket buffer is full */
+      while((before = q.size) && (r = q.writeTo(a.fd)) > 0) {
+        if(r < before) partial = true;
+
+        eq(q.size, before - r);
+      }
+
+      if(!q.empty) {
+        eq(r, -EAGAIN);
+        eq(q.size, before);
+        blocked = true;
+      }
+
+      while((r = out.readFrom(b.fd, 10000)) > 0) assert(r <= 10000, 'readFrom() read more than max');
+
+      eq(r, -EAGAIN);
+    }
+
+    assert(partial, 'writeTo() never left part of the queue unwritten');
+    assert(blocked, 'writeTo() never saw EAGAIN');
+    eq(out.size, size);
+    assert(Same(Contents(out), Pattern(size)), 'contents differ after the round-trip');
+
+    a.close();
+    b.close();
+  },
+  'poolStats() counts pooled and malloc\'ed chunks'() {
+    const q = new Queue();
+    const before = Queue.poolStats();
+
+    eq(typeof before.hits, 'number');
+    eq(Object.keys(before.free).join(), '256,4K,16K,64K');
+
+    q.write(Pattern(100));
+    q.write(Pattern(70000));
+
+    const written = Queue.poolStats();
+
+    eq(written.hits, before.hits + 1);
+    eq(written.misses, before.misses + 1);
+    assert(written.slabs >= 1, 'a pooled chunk without a slab');
+
+    Contents(q);
+
+    const read = Queue.poolStats();
+
+    eq(read.free['256'], written.free['256'] + 1);
+    eq(read.misses, written.misses);
+  },
+  'hugePages() keeps the pool usable'() {
+    const q = new Queue(),
+      size = 60000 * 50;
+
+    Queue.hugePages(true);
+
+    /* more than a 2M slab of 64K chunks */
+    for(let pos = 0; pos < size; pos += 60000) q.write(Pattern(60000, pos));
+
+    Queue.hugePages(false);
+
+    eq(q.size, size);
+    assert(Same(Contents(q), Pattern(size)), 'contents differ with huge pages');
+  }
+});
@@ -46,10 +46,43 @@ async function main(...args) {
     if(it.done) break;
   }
   console.log(`rpt.state`, states[rpt.state]);
+
+  let sliding = new Repeater(push => {
+    for(let i = 0; i < 10; i++) push(i);
+  }, { policy: 'sliding', highWaterMark: 3 });
+
+  let latest = [(await sliding.next()).value, (await sliding.next()).value, (await sliding.next()).value];
+
+  if(latest.join() != '7,8,9') throw new Error(`sliding buffer kept ${latest}`);
+
+  async function* count(n, step) {
+    for(let i = 0; i < n; i++) yield i * step;
+  }
+
+  let merged = [];
+
+  for(let it = Repeater.merge([count(3, 1), count(3, 10)]), result; !(result = await it.next()).done; ) merged.push(result.value);
+
+  if(merged.sort((a, b) => a - b).join() != '0,0,1,2,10,20') throw new Error(`Repeater.merge() = ${merged}`);
+
+  let zipped = await Repeater.zip([count(2, 1), count(5, 10)]).next();
+
+  if(zipped.value.join() != '0,0') throw new Error(`Repeater.zip() = ${zipped.value}`);
+
+  let samples = new Repeater(push => {
+    for(let i = 0; i < 5; i++) push(i);
+  }, 100);
+
+  let batch = await samples.nextBatch(4);
+
+  if(batch.done || batch.value.join() != '0,1,2,3' || (await samples.nextBatch()).value.join() != '4') throw new Error(`nextBatch() = ${batch.value}`);
   /*
   for await(let value of rpt) {
     console.log('value', value);
   }*/
 }
 
-main();
+main().catch(error => {
+  console.log(`FAIL: ${error.message}\n${error.stack}`);
+  std.exit(1);
+});
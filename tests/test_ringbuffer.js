@@ -0,0 +1,114 @@
+import { MirrorRingBuffer, SharedRingBuffer, RingWriter } from 'ringbuffer';
+import * as std from 'std';
+import * as os from 'os';
+
+function assert(cond, msg) {
+  if(!cond) throw new Error('assertion failed: ' + msg);
+}
+
+function main() {
+  let rb = new SharedRingBuffer(16);
+  assert(rb.capacity == 16, 'capacity');
+  assert(rb.buffer instanceof SharedArrayBuffer, 'buffer');
+
+  let data = new Uint8Array([...'0123456789abcdefXYZ'].map(c => c.charCodeAt(0)));
+  assert(rb.write(data.buffer) == 16, 'write stops when full');
+  assert(rb.available == 0 && rb.length == 16, 'full');
+
+  let out = new Uint8Array(10);
+  assert(rb.read(out.buffer) == 10, 'read');
+  assert(String.fromCharCode(...out) == '0123456789', 'read data');
+  assert(rb.waitReadable(0), 'readable');
+
+  let other = new SharedRingBuffer(rb.buffer);
+  assert(other.length == 6, 'attached');
+  other.read(new ArrayBuffer(6));
+  assert(!rb.waitReadable(10), 'empty after read');
+
+  let mp = new SharedRingBuffer(64, SharedRingBuffer.MPSC);
+  assert(mp.mode == SharedRingBuffer.MPSC, 'mode');
+  assert(mp.send('hello'), 'send');
+  assert(mp.send(new Uint8Array([1, 2, 3]).buffer), 'send buffer');
+  assert(!mp.send(new ArrayBuffer(64)), 'send too large');
+
+  let msg = mp.receive();
+  assert(String.fromCharCode(...new Uint8Array(msg)) == 'hello', 'receive');
+  assert(mp.receive().byteLength == 3, 'receive buffer');
+  assert(mp.receive() === null, 'receive empty');
+
+  if(os.Worker) {
+    let worker = new os.Worker('./ringbuffer_worker.js');
+    worker.postMessage(mp.buffer);
+
+    for(let i = 0; i < 100; i++) {
+      assert(mp.waitReadable(5000), 'message ' + i + ' timed out');
+      assert(new Uint32Array(mp.receive())[0] == i, 'message ' + i);
+    }
+  }
+
+  if(RingWriter) {
+    let [rd, wr] = os.pipe();
+    let writer = new RingWriter(wr, { capacity: 64, policy: RingWriter.DROP });
+
+    assert(writer.write('line 1\n') && writer.write('line 2\n'), 'writer write');
+    assert(!writer.write(new ArrayBuffer(128)), 'writer drops records larger than the ring');
+    assert(writer.dropped == 1, 'writer dropped');
+    assert(writer.flush(5000) && writer.length == 0, 'writer flush');
+
+    let buf = new Uint8Array(64);
+    let n = os.read(rd, buf.buffer, 0, buf.length);
+    assert(String.fromCharCode(...buf.subarray(0, n)) == 'line 1\nline 2\n', 'writer output');
+
+    writer.close();
+    os.close(rd);
+    os.close(wr);
+  }
+
+  let mr = new MirrorRingBuffer(100);
+  let size = mr.capacity;
+  assert(size >= 100 && size % 4096 == 0, 'mirror capacity is page sized');
+
+  let pattern = n => new Uint8Array(n).map((_, i) => (i * 13 + n) & 0xff);
+  let same = (a, b) => a.length == b.length && a.every((x, i) => x == b[i]);
+
+  /* move the tail close to the end, so the next writes wrap around */
+  assert(mr.write(new ArrayBuffer(size - 10)) == size - 10, 'mirror write');
+  assert(mr.read(new ArrayBuffer(size - 10)) == size - 10, 'mirror read');
+  assert(mr.length == 0 && mr.available == size, 'mirror empty');
+
+  let wrapped = pattern(100);
+  assert(mr.write(wrapped.buffer) == 100, 'mirror write across the end');
+
+  let back = new Uint8Array(100);
+  assert(mr.read(back.buffer) == 100 && same(back, wrapped), 'mirror read across the end');
+
+  let full = pattern(size);
+  assert(mr.write(full.buffer) == size && mr.write(new ArrayBuffer(1)) == 0, 'mirror full');
+
+  back = new Uint8Array(size);
+  assert(mr.read(back.buffer) == size && same(back, full), 'mirror read when full');
+
+  /* fill() and drain() move a wrapped span with one call each */
+  let [prd, pwr] = os.pipe();
+  let sent = pattern(60);
+
+  mr.write(new ArrayBuffer(size - 30));
+  mr.read(new ArrayBuffer(size - 30));
+  os.write(pwr, sent.buffer, 0, sent.length);
+  assert(mr.fill(prd) == 60, 'mirror fill across the end');
+  assert(mr.drain(pwr) == 60 && mr.length == 0, 'mirror drain across the end');
+
+  back = new Uint8Array(60);
+  assert(os.read(prd, back.buffer, 0, 60) == 60 && same(back, sent), 'mirror fill/drain data');
+  os.close(prd);
+  os.close(pwr);
+
+  console.log('SUCCESS');
+}
+
+try {
+  main();
+} catch(error) {
+  console.log(`FAIL: ${error.message}\n${error.stack}`);
+  std.exit(1);
+}
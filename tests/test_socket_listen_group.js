@@ -0,0 +1,19 @@
+import { AF_INET, SockAddr, Socket } from 'sockets';
+import { assert, eq, tests } from './tinytest.js';
+
+tests({
+  'Socket.listenGroup()'() {
+    const listeners = Socket.listenGroup(new SockAddr(AF_INET, '127.0.0.1', 0), 1, { backlog: 16 });
+
+    eq(listeners.length, 1);
+    assert(listeners[0] instanceof Socket);
+    assert(listeners[0].local.port > 0);
+
+    const port = listeners[0].local.port;
+    const group = [...listeners, ...Socket.listenGroup(new SockAddr(AF_INET, '127.0.0.1', port), 2)];
+
+    eq(group.length, 3);
+    group.forEach(sock => eq(sock.local.port, port));
+    group.forEach(sock => sock.close());
+  }
+});
@@ -0,0 +1,26 @@
+import { AF_UNIX, MSG_DONTWAIT, SOCK_DGRAM, Socket, socketpair } from 'sockets';
+import { toString } from 'util';
+import { eq, tests } from './tinytest.js';
+
+tests({
+  'sendMany()/recvMany()'() {
+    const fds = [];
+
+    eq(socketpair(AF_UNIX, SOCK_DGRAM, 0, fds), 0);
+
+    const [a, b] = fds.map(fd => Socket.adopt(fd));
+    const out = ['one', 'two', 'three'].map(s => new Uint8Array([...s].map(c => c.charCodeAt(0))).buffer);
+
+    eq(a.sendMany(out), 3);
+
+    const bufs = [new ArrayBuffer(16), new ArrayBuffer(16), new ArrayBuffer(16), new ArrayBuffer(16)];
+    const lengths = new Uint32Array(bufs.length);
+
+    eq(b.recvMany(bufs, null, lengths, MSG_DONTWAIT), 3);
+    eq(lengths.join(','), '3,3,5');
+    eq(toString(bufs[2].slice(0, lengths[2])), 'three');
+
+    a.close();
+    b.close();
+  }
+});
@@ -0,0 +1,43 @@
+import * as os from 'os';
+import * as std from 'std';
+import { AF_UNIX, SOCK_STREAM, Socket, pipe, socketpair } from 'sockets';
+import { toString } from 'util';
+import { eq, tests } from './tinytest.js';
+
+tests({
+  'socket.sendfile()'() {
+    const file = std.tmpfile();
+
+    file.puts('0123456789');
+    file.flush();
+
+    const fds = [];
+    eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    const [a, b] = fds.map(fd => Socket.adopt(fd));
+    const buf = new ArrayBuffer(16);
+
+    eq(a.sendfile(file.fileno(), 2, 5), 5);
+    eq(a.syscall, 'sendfile');
+    eq(b.recv(buf), 5);
+    eq(toString(buf.slice(0, 5)), '23456');
+
+    a.close();
+    b.close();
+    file.close();
+  },
+  'pipe()'() {
+    const [r1, w1] = os.pipe();
+    const [r2, w2] = os.pipe();
+    const buf = new ArrayBuffer(16);
+
+    os.write(w1, new Uint8Array([104, 105]).buffer, 0, 2);
+    os.close(w1);
+
+    eq(pipe(r1, w2), 2);
+    eq(os.read(r2, buf, 0, 16), 2);
+    eq(toString(buf.slice(0, 2)), 'hi');
+
+    [r1, r2, w2].forEach(fd => os.close(fd));
+  }
+});
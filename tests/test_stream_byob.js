@@ -0,0 +1,102 @@
+import { ReadableStream } from 'stream';
+import { assert, eq, tests } from './tinytest.js';
+
+function ByteStream() {
+  let controller;
+  const readable = new ReadableStream({
+    start(c) {
+      controller = c;
+    }
+  });
+
+  return [readable, controller];
+}
+
+tests({
+  async 'read(view) fills the caller view'() {
+    const [readable, controller] = ByteStream();
+    const reader = readable.getReader({ mode: 'byob' });
+    const buf = new ArrayBuffer(8);
+
+    controller.enqueue(new Uint8Array([104, 101, 108, 108, 111]), { copy: false });
+
+    const { value, done } = await reader.read(new Uint8Array(buf, 2, 4));
+
+    eq(done, false);
+    assert(value instanceof Uint8Array, 'value is a Uint8Array');
+    assert(value.buffer === buf, 'value views the caller buffer');
+    eq(value.byteOffset, 2);
+    eq(value.length, 4);
+    eq(String.fromCharCode(...value), 'hell');
+    eq(new Uint8Array(buf)[2], 104);
+  },
+  async 'short final read and done'() {
+    const [readable, controller] = ByteStream();
+    const reader = readable.getReader({ mode: 'byob' });
+    let result;
+
+    controller.enqueue(new Uint8Array([104, 101, 108, 108, 111]));
+    controller.close();
+
+    result = await reader.read(new Uint8Array(4));
+    eq(result.value.length, 4);
+
+    result = await reader.read(new Uint8Array(4));
+    eq(result.done, false);
+    eq(result.value.length, 1);
+    eq(String.fromCharCode(...result.value), 'o');
+
+    result = await reader.read(new Uint8Array(4));
+    eq(result.done, true);
+    eq(result.value.length, 0);
+  },
+  async 'pending read and typed views'() {
+    const [readable, controller] = ByteStream();
+    const reader = readable.getReader({ mode: 'byob' });
+    const view = new Uint16Array(4);
+    const pending = reader.read(view);
+
+    controller.enqueue(new Uint8Array([1, 0, 2, 0, 3]));
+
+    const { value } = await pending;
+
+    assert(value instanceof Uint16Array, 'value keeps the view type');
+    assert(value.buffer === view.buffer, 'value views the caller buffer');
+    eq(value.length, 2);
+    eq(value[0], 1);
+    eq(value[1], 2);
+  },
+  'read() needs a view'() {
+    const [readable] = ByteStream();
+    const reader = readable.getReader({ mode: 'byob' });
+    let error;
+
+    try {
+      reader.read();
+    } catch(e) {
+      error = e;
+    }
+
+    assert(error instanceof TypeError, 'read() without a view throws a TypeError');
+  },
+  async 'read(view) of a detached wrapped buffer rejects'() {
+    const [readable, controller] = ByteStream();
+    const reader = readable.getReader({ mode: 'byob' });
+    const buf = new Uint8Array([1, 2, 3, 4]).buffer;
+
+    if(typeof buf.transfer != 'function') return;
+
+    controller.enqueue(buf, { copy: false });
+    buf.transfer();
+
+    let error;
+
+    try {
+      await reader.read(new Uint8Array(4));
+    } catch(e) {
+      error = e;
+    }
+
+    assert(error instanceof TypeError, 'a read from a detached buffer rejects with a TypeError');
+  }
+});
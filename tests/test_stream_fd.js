@@ -0,0 +1,39 @@
+import * as os from 'os';
+import { ReadableStream, WritableStream } from 'stream';
+import { toString } from 'util';
+import { eq, tests } from './tinytest.js';
+
+async function ReadAll(readable) {
+  const reader = readable.getReader();
+  let out = '',
+    result;
+
+  while(!(result = await reader.read()).done) out += toString(result.value);
+
+  return out;
+}
+
+tests({
+  async 'fromFd() writer/reader'() {
+    const [rfd, wfd] = os.pipe();
+    const writer = WritableStream.fromFd(wfd, { autoClose: true }).getWriter();
+
+    await writer.write('hello ');
+    await writer.write(new Uint8Array([119, 111, 114, 108, 100]));
+    await writer.close();
+
+    eq(await ReadAll(ReadableStream.fromFd(rfd, { autoClose: true })), 'hello world');
+  },
+  async 'fromFd() pipeTo()'() {
+    const [r1, w1] = os.pipe();
+    const [r2, w2] = os.pipe();
+
+    os.write(w1, new Uint8Array([97, 98, 99]).buffer, 0, 3);
+    os.close(w1);
+
+    const done = ReadableStream.fromFd(r1, { autoClose: true }, { highWaterMark: 4 }).pipeTo(WritableStream.fromFd(w2, { autoClose: true }));
+
+    eq(await ReadAll(ReadableStream.fromFd(r2, { autoClose: true })), 'abc');
+    await done;
+  }
+});
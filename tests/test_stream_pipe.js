@@ -0,0 +1,78 @@
+import { ReadableStream, TransformStream, WritableStream } from 'stream';
+import { toString } from 'util';
+import { assert, eq, tests } from './tinytest.js';
+
+function Source(...chunks) {
+  return new ReadableStream({
+    start(controller) {
+      for(const chunk of chunks) controller.enqueue(chunk);
+      controller.close();
+    }
+  });
+}
+
+function Sink(out) {
+  return new WritableStream({
+    write(chunk) {
+      out.push(toString(chunk));
+    },
+    close() {
+      out.closed = true;
+    }
+  });
+}
+
+tests({
+  'pipeTo()'() {
+    const out = [];
+
+    Source('abc', 'def').pipeTo(Sink(out));
+
+    eq(out.join(''), 'abcdef');
+    assert(out.closed);
+  },
+  'pipeTo() preventClose'() {
+    const out = [];
+
+    Source('abc').pipeTo(Sink(out), { preventClose: true });
+
+    eq(out.join(''), 'abc');
+    assert(!out.closed);
+  },
+  'pipeTo() locks'() {
+    const source = Source('abc');
+
+    source.getReader();
+
+    let error;
+
+    try {
+      source.pipeTo(Sink([]));
+    } catch(e) {
+      error = e;
+    }
+
+    assert(error instanceof TypeError);
+  },
+  'pipeThrough() identity'() {
+    const out = [];
+
+    Source('abc', 'def').pipeThrough(new TransformStream()).pipeTo(Sink(out));
+
+    eq(out.join(''), 'abcdef');
+    assert(out.closed);
+  },
+  'pipeThrough() transform'() {
+    const out = [];
+    const upper = new TransformStream({
+      transform(chunk, controller) {
+        controller.enqueue(toString(chunk).toUpperCase());
+      }
+    });
+
+    Source('abc', 'def').pipeThrough(upper).pipeTo(Sink(out));
+
+    eq(out.join(''), 'ABCDEF');
+    assert(out.closed);
+  }
+});
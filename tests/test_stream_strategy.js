@@ -0,0 +1,63 @@
+import { ByteLengthQueuingStrategy, CountQueuingStrategy, ReadableStream, WritableStream } from 'stream';
+import { assert, eq, tests } from './tinytest.js';
+
+tests({
+  'ByteLengthQueuingStrategy'() {
+    const qs = new ByteLengthQueuingStrategy({ highWaterMark: 16 });
+
+    eq(qs.highWaterMark, 16);
+    eq(qs.size(new ArrayBuffer(8)), 8);
+    eq(qs.size(new Uint16Array(3)), 6);
+  },
+  'CountQueuingStrategy'() {
+    const qs = new CountQueuingStrategy({ highWaterMark: Infinity });
+
+    eq(qs.highWaterMark, Infinity);
+    eq(qs.size(new ArrayBuffer(8)), 1);
+  },
+  'invalid highWaterMark'() {
+    let error;
+
+    try {
+      new CountQueuingStrategy({ highWaterMark: -1 });
+    } catch(e) {
+      error = e;
+    }
+
+    assert(error instanceof RangeError);
+  },
+  'ReadableStream desiredSize in bytes'() {
+    let controller;
+    const rs = new ReadableStream(
+      {
+        start(c) {
+          controller = c;
+        }
+      },
+      new ByteLengthQueuingStrategy({ highWaterMark: 4 })
+    );
+
+    rs.getReader();
+    eq(controller.desiredSize, 4);
+
+    controller.enqueue(new ArrayBuffer(6));
+    eq(controller.desiredSize, -2);
+  },
+  'WritableStream desiredSize counts writes in flight'() {
+    const ws = new WritableStream(
+      {
+        write() {
+          return new Promise(() => {});
+        }
+      },
+      new CountQueuingStrategy({ highWaterMark: 2 })
+    );
+    const writer = ws.getWriter();
+
+    eq(writer.desiredSize, 2);
+    writer.write('a');
+    eq(writer.desiredSize, 1);
+    writer.write('b');
+    eq(writer.desiredSize, 0);
+  }
+});
@@ -1,5 +1,5 @@
 import { toString } from 'util';
-import { TextEncoderStream } from '../lib/streams.js';
+import { TextDecoderStream, TextEncoderStream } from '../lib/streams.js';
 import { Console } from 'console';
 
 async function main(...args) {
@@ -31,10 +31,23 @@ async function main(...args) {
     chunk = reader.read();
     console.log('chunk', chunk);
     chunk = await chunk;
-    console.log('chunk', toString(chunk.value));
+    console.log('chunk', toString(chunk.value?.buffer));
   } while(chunk && !chunk.done);
 
   await reader.releaseLock();
+
+  stream = new TextDecoderStream('utf-8');
+  writer = stream.writable.getWriter();
+  writer.write(new Uint8Array([0x63, 0x61, 0x66, 0xc3]));
+  writer.write(new Uint8Array([0xa9, 0x21]));
+  writer.close();
+
+  let text = '';
+  reader = stream.readable.getReader();
+
+  while(!(chunk = await reader.read()).done) text += chunk.value;
+
+  if(text !== 'café!') throw new Error(`TextDecoderStream gave '${text}'`);
 }
 
 try {
@@ -0,0 +1,31 @@
+import { AF_UNIX, EAGAIN, SOCK_DGRAM, Socket, SyscallError, socketpair } from 'sockets';
+import { eq, tests } from './tinytest.js';
+
+tests({
+  'would-block returns a status'() {
+    const fds = [];
+
+    eq(socketpair(AF_UNIX, SOCK_DGRAM, 0, fds), 0);
+
+    const [a, b] = fds.map(fd => Socket.adopt(fd));
+
+    b.nonblock = true;
+
+    eq(b.recvfrom(new ArrayBuffer(16)), -1);
+    eq(b.errno, EAGAIN);
+    eq(b.syscall, 'recvfrom');
+    eq(b.error instanceof SyscallError, true);
+
+    a.close();
+    b.close();
+  },
+  'message and stack'() {
+    const err = new SyscallError('open', 2);
+
+    eq(err.message.startsWith('open() = -1 (errno = 2)'), true);
+    eq(err.message.indexOf('\n'), -1);
+    eq(typeof err.stack, 'string');
+    eq(err.stack, err.stack);
+    eq(err.toString().startsWith(err.message + '\n'), true);
+  }
+});
@@ -74,6 +74,31 @@ function main(...args) {
     ])
   );
 
+  let long = 'plain ascii log line, '.repeat(8) + s1 + s2 + '\n'.repeat(40);
+
+  for(let encoding of ['utf-16le', 'utf-16be', 'utf-32le', 'utf-32be']) {
+    let buf = new TextEncoder(encoding).encode(long).buffer;
+    /* splits inside the first non-ASCII character */
+    let split = encoding.startsWith('utf-16') ? 176 * 2 + 2 : 176 * 4 + 2;
+    let decoder = new TextDecoder(encoding);
+    let result = decoder.decode(buf.slice(0, split)) + decoder.end(buf.slice(split));
+
+    if(result !== long) throw new Error(`${encoding} round-trip failed`);
+  }
+
+  let out = new Uint8Array(10);
+  let { read, written } = new TextEncoder().encodeInto('abc€😀déf', out);
+  if(read !== 6 || written !== 10) throw new Error(`encodeInto() = { read: ${read}, written: ${written} }`);
+
+  let into = new TextDecoder('utf-16le');
+  let part = into.decodeInto(new TextEncoder('utf-16le').encode('abc€😀déf').buffer, out);
+  if(part.written !== 10 || into.buffered !== 6) throw new Error(`decodeInto() = { read: ${part.read}, written: ${part.written} }`);
+
+  let latin1 = new TextDecoder('ISO-8859-1').decode(new Uint8Array([0x63, 0x61, 0x66, 0xe9]));
+  if(latin1 !== 'café') throw new Error(`ISO-8859-1 decoded '${latin1}'`);
+  let cp1252 = new TextEncoder('WINDOWS-1252').encode('5 €');
+  if(cp1252.length != 3 || cp1252[2] != 0x80) throw new Error(`WINDOWS-1252 encoded ${cp1252}`);
+
   const encoder = new TextEncoder();
   const view = encoder.encode('€');
   console.log(`encoder.encode('€')`, view); // Uint8Array(3) [226, 130, 172]
@@ -0,0 +1,44 @@
+import { ThreadPool } from 'threadpool';
+import * as std from 'std';
+
+function fail(message) {
+  console.log(`FAIL: ${message}`);
+  std.exit(1);
+}
+
+async function main() {
+  let pool = new ThreadPool('tests/threadpool_worker.js', { size: 2 });
+
+  if(pool.size != 2) fail(`size ${pool.size}`);
+
+  let sums = await Promise.all([...Array(16).keys()].map(i => pool.run('add', [i, 1])));
+
+  if(sums.join(',') != [...Array(16).keys()].map(i => i + 1).join(',')) fail(`add: ${sums}`);
+  if((await pool.run('delayed', [{ x: [1, 2] }])).x[1] != 2) fail('async task result');
+  if((await pool.run((a, b) => a * b, [6, 7])) != 42) fail('function source task');
+
+  let sab = new SharedArrayBuffer(16);
+
+  if((await pool.run('fill', [sab, 7])) != 16 || new Int32Array(sab)[3] != 7) fail('SharedArrayBuffer not shared');
+
+  let ab = new ArrayBuffer(8);
+
+  await pool.run('add', [ab, 0], [ab]);
+
+  if(ab.byteLength != 0) fail('transferred ArrayBuffer not detached');
+
+  try {
+    await pool.run('fail', ['boom']);
+    fail('task error not propagated');
+  } catch(error) {
+    if(!/boom/.test(error.message)) fail(`task error: ${error.message}`);
+  }
+
+  if(pool.pending != 0) fail(`pending ${pool.pending}`);
+
+  pool.close();
+}
+
+main()
+  .then(() => console.log('SUCCESS'))
+  .catch(error => fail(`${error.message}\n${error.stack}`));
@@ -0,0 +1,55 @@
+import { clearInterval, clearTimeout, setInterval, setTimeout } from 'timerwheel';
+import * as timers from '../lib/timers.js';
+import * as os from 'os';
+import * as std from 'std';
+
+function fail(message) {
+  console.log(`FAIL: ${message}`);
+  std.exit(1);
+}
+
+function main() {
+  let order = [],
+    ticks = 0;
+
+  setTimeout(() => order.push(30), 30);
+  setTimeout(() => order.push(10), 10);
+  setTimeout(() => order.push(20), 20);
+
+  let cancelled = setTimeout(() => fail('cleared timeout fired'), 15);
+
+  if(!cancelled.active || cancelled.delay != 15 || cancelled.interval) fail(`timer state: ${cancelled.active} ${cancelled.delay}`);
+
+  clearTimeout(cancelled);
+
+  if(cancelled.active) fail('timer still active after clearTimeout()');
+
+  /* os.setTimeout() handles are cleared by the os module */
+  clearTimeout(os.setTimeout(() => fail('cleared os timeout fired'), 15));
+  timers.clearInterval(os.setTimeout(() => fail('cleared os timeout fired'), 15));
+  clearTimeout(undefined);
+
+  let iv = setInterval(() => {
+    if(++ticks == 3) clearInterval(iv);
+  }, 5);
+
+  if(!iv.interval) fail('setInterval() returned a timeout');
+
+  /* refresh() pushes the deadline back instead of adding a timer */
+  let started = Date.now(),
+    refreshed = setTimeout(() => {
+      if(Date.now() - started < 60) fail(`refreshed timer fired after ${Date.now() - started}ms`);
+      if(order.join(',') != '10,20,30') fail(`order: ${order}`);
+      if(ticks != 3) fail(`interval ran ${ticks} times`);
+      console.log('SUCCESS');
+    }, 40);
+
+  setTimeout(() => refreshed.refresh(), 25);
+}
+
+try {
+  main();
+} catch(error) {
+  console.log(`FAIL: ${error.message}\n${error.stack}`);
+  std.exit(1);
+}
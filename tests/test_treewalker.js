@@ -40,6 +40,7 @@ function main(...args) {
   }
   //console.log('result:', result);
   TestIterator();
+  TestWalk();
 
   function TestWalker() {
     let walk = new TreeWalker(result);
@@ -77,6 +78,24 @@ function main(...args) {
       console.log(`pointer: ${pointer}, entry:`, entry);
     }
   }
+  function TestWalk() {
+    let tree = { a: 1, b: { c: 'x', d: { e: 2 } }, f: [3, { g: 4 }] };
+    let keys = [];
+    let visited = new TreeWalker(tree).walk((v, k) => keys.push(k));
+
+    if(visited != 9 || keys.join() != 'a,b,c,d,e,f,0,1,g') throw new Error(`walk() returned ${visited}, visited ${keys}`);
+
+    let walker = new TreeWalker(tree, TreeWalker.TYPE_INT);
+    let paths = [];
+    walker.walk((v, k, w) => void paths.push(w.currentPath.join('.')), { maxDepth: 1 });
+
+    if(paths.join() != 'a,f.0') throw new Error(`walk({ maxDepth: 1 }) visited ${paths}`);
+
+    keys = [];
+    new TreeWalker(tree).walk((v, k) => (keys.push(k), k == 'b' ? TreeWalker.FILTER_REJECT : k == 'f' ? false : undefined));
+
+    if(keys.join() != 'a,b,f') throw new Error(`walk() FILTER_REJECT/false visited ${keys}`);
+  }
   console.log('result', result);
   std.gc();
 }
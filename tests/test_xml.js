@@ -5,6 +5,7 @@ import readXML from '../lib/xml/read.js';
 import writeXML from '../lib/xml/write.js';
 import * as deep from 'deep';
 import * as std from 'std';
+import { XMLParser, Selector, index as xmlIndex, read as xmlRead, readFile as xmlReadFile, write as xmlWrite } from 'xml';
 
 ('use strict');
 
@@ -16,6 +17,153 @@ function WriteFile(file, data) {
   console.log('Wrote "' + file + '": ' + data.length + ' bytes');
 }
 
+function TestParser(data) {
+  let depth = 0,
+    maxDepth = 0,
+    elements = 0;
+  const parser = new XMLParser({
+    startElement(name, attributes, level) {
+      elements++;
+      maxDepth = Math.max(maxDepth, ++depth);
+    },
+    endElement(name) {
+      depth--;
+    }
+  });
+
+  /* feed the document in small chunks to exercise the incremental path */
+  for(let i = 0; i < data.length; i += 17) parser.write(data.slice(i, i + 17));
+  parser.end();
+
+  if(depth != 0) throw new Error(`XMLParser: unbalanced events (depth ${depth})`);
+
+  const events = new XMLParser().write('<a x="1"><b/>text</a>');
+  const types = events.map(([type]) => type).join(',');
+
+  if(types != 'startElement,startElement,endElement,text,endElement') throw new Error(`XMLParser: unexpected events ${types}`);
+
+  /* '>' and quotes inside CDATA don't end it, also when split across writes */
+  const cdata = new XMLParser();
+  const doc = '<a><![CDATA[x > y "q]]><b/></a>';
+  let cdataEvents = [];
+
+  for(let i = 0; i < doc.length; i += 5) cdataEvents.push(...cdata.write(doc.slice(i, i + 5)));
+  cdataEvents.push(...cdata.end());
+
+  if(cdataEvents.length != 6 || cdataEvents[1][1] != '![CDATA[x > y "q]]' || cdataEvents[3][1] != 'b') throw new Error(`XMLParser: CDATA events ${JSON.stringify(cdataEvents)}`);
+
+  console.log(`XMLParser: ${elements} elements, max depth ${maxDepth}`);
+}
+
+function TestSink(result) {
+  const expected = xmlWrite(result);
+  let chunks = [];
+  const written = xmlWrite(result, { chunkSize: 256, output: chunk => chunks.push(chunk) });
+
+  if(chunks.join('') != expected) throw new Error(`xml.write(): chunked output differs from string output`);
+  if(typeof written != 'number') throw new Error(`xml.write(): expected byte count, got ${typeof written}`);
+
+  console.log(`xml.write(): ${chunks.length} chunks, ${written} bytes`);
+}
+
+function TestLazy() {
+  const doc = '<a x="1"><b/>text<c>d</c></a>';
+  const eager = JSON.stringify(xmlRead(doc));
+  const lazy = JSON.stringify(xmlRead(doc, '<lazy>', { lazy: true }));
+
+  if(lazy != eager) throw new Error(`xml.read({ lazy: true }): ${lazy} != ${eager}`);
+
+  /* a lazy tree over a detached buffer throws instead of reading freed memory */
+  const buf = new Uint8Array([...doc].map(c => c.charCodeAt(0))).buffer;
+  const [node] = xmlRead(buf, '<lazy>', { lazy: true });
+
+  if(node.tagName != 'a') throw new Error(`xml.read(ArrayBuffer, { lazy: true }): tagName ${node.tagName}`);
+
+  if(typeof buf.transfer == 'function') {
+    let error;
+
+    buf.transfer();
+
+    try {
+      node.attributes;
+    } catch(e) {
+      error = e;
+    }
+
+    if(!(error instanceof TypeError)) throw new Error(`xml.read({ lazy: true }) after detach: ${error}`);
+  }
+
+  console.log(`xml.read({ lazy: true }): ok`);
+}
+
+function TestLocation() {
+  const [[a], locations] = xmlRead('<a>\n  <b/>\n <c>d</c></a>', '<location>', { location: true });
+  const [b, c] = a.children;
+  const got = JSON.stringify([a, b, c].map(e => locations.get(e)));
+
+  if(got != '[[1,1],[2,3],[3,2]]') throw new Error(`xml.read({ location: true }): ${got}`);
+  if(locations.offset(c) != 13 || locations.has({})) throw new Error(`xml.read({ location: true }): offset() ${locations.offset(c)}`);
+
+  console.log(`xml.read({ location: true }): ok`);
+}
+
+function TestReadFile(file, data) {
+  const mapped = JSON.stringify(xmlReadFile(file));
+
+  if(mapped != JSON.stringify(xmlRead(data))) throw new Error(`xml.readFile('${file}'): result differs from xml.read()`);
+
+  let error;
+
+  try {
+    xmlReadFile('tests');
+  } catch(e) {
+    error = e;
+  }
+
+  if(!/not a regular file/.test(error?.message)) throw new Error(`xml.readFile() of a directory: ${error?.message}`);
+
+  console.log(`xml.readFile('${file}'): ok`);
+}
+
+function TestSelector() {
+  const doc = '<a id="x"><b class="p q"/><c><b k="v"/></c></a>';
+  const tests = [
+    ['b', 2],
+    ['a > b', 1],
+    ['c b[k=v]', 1],
+    ['.q', 1],
+    ['#x, c', 2],
+    ['/a/c/b', 1],
+    ["//b[@k='v'] | /a", 2]
+  ];
+
+  for(const tree of [xmlRead(doc), xmlRead(doc, '<lazy>', { lazy: true })]) {
+    for(const [expr, count] of tests) {
+      const sel = new Selector(expr);
+      const n = sel.select(tree).length;
+
+      if(n != count) throw new Error(`Selector('${expr}'): ${n} matches, expected ${count}`);
+    }
+
+    const path = new Selector('c > b').first(tree, true);
+
+    if(path.join('.') != '0.children.1.children.0') throw new Error(`Selector.first(): unexpected path ${path}`);
+  }
+
+  console.log(`Selector: ${tests.length} expressions ok`);
+}
+
+function TestIndex() {
+  const tree = xmlRead('<a id="x"><b class="p q"/><c id="x"><b k="v"/></c></a>');
+  const { tags, ids, classes } = xmlIndex(tree);
+
+  if(tags.b.map(p => p.join('.')).join() != '0.children.0,0.children.1.children.0') throw new Error(`xml.index() tags: ${tags.b}`);
+  if(ids.x.join('.') != '0') throw new Error(`xml.index() ids: ${ids.x}`);
+  if(classes.q.length != 1 || classes.p[0] !== tags.b[0]) throw new Error(`xml.index() classes: ${classes.q}`);
+
+  console.log(`xml.index(): ok`);
+}
+
 function main(...args) {
   globalThis.console = new Console(process.stdout, {
     inspectOptions: {
@@ -98,6 +246,14 @@ function main(...args) {
 
   WriteFile(base + '.xml', str);
 
+  TestParser(data);
+  TestSink(result);
+  TestLazy();
+  TestLocation();
+  TestReadFile(file, data);
+  TestSelector();
+  TestIndex();
+
   std.gc();
 }
 
@@ -0,0 +1,17 @@
+export function add(a, b) {
+  return a + b;
+}
+
+export async function delayed(value) {
+  await null;
+  return value;
+}
+
+export function fill(sab, value) {
+  new Int32Array(sab).fill(value);
+  return sab.byteLength;
+}
+
+export function fail(message) {
+  throw new Error(message);
+}